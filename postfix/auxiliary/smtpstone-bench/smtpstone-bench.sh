@@ -0,0 +1,312 @@
+#!/bin/sh
+
+# smtpstone-bench - repeatable end-to-end Postfix throughput benchmark
+#
+# Run this script as root in the top-level Postfix source directory,
+# after "make". For each workload it creates a throw-away Postfix
+# instance under a scratch directory, using the programs in bin/ and
+# libexec/, and relays mail from smtp-source through that instance
+# to smtp-sink. See the README file for the workloads and the output
+# format.
+
+PATH=/bin:/usr/bin:/sbin:/usr/sbin; export PATH
+umask 022
+
+usage() {
+    echo "usage: $0 [-d scratch_dir] [-g setgid_group] [-k] [-m messages]" 1>&2
+    echo "	[-o mail_owner] [-p base_port] [-s sessions] [-w timeout]" 1>&2
+    echo "	[workload ...]" 1>&2
+    echo "workloads: small large explode tls deferred (default: all but tls)" 1>&2
+    exit 1
+}
+
+fatal() {
+    echo "$0: fatal: $*" 1>&2
+    stop_instance
+    exit 1
+}
+
+# Defaults.
+
+scratch=/tmp/smtpstone-bench.$$
+owner=postfix
+group=postdrop
+keep=
+messages=10000
+port=52525
+sessions=20
+timeout=600
+
+while getopts d:g:km:o:p:s:w: opt
+do
+    case $opt in
+    d) scratch="$OPTARG";;
+    g) group="$OPTARG";;
+    k) keep=1;;
+    m) messages="$OPTARG";;
+    o) owner="$OPTARG";;
+    p) port="$OPTARG";;
+    s) sessions="$OPTARG";;
+    w) timeout="$OPTARG";;
+    *) usage;;
+    esac
+done
+shift `expr $OPTIND - 1`
+workloads="${*:-small large explode deferred}"
+
+top=`pwd`
+bin=$top/bin
+libexec=$top/libexec
+smtp_port=$port
+sink_port=`expr $port + 1`
+tls_port=`expr $port + 2`
+
+test -x $libexec/master -a -x $bin/smtp-source -a -x $bin/smtp-sink ||
+    fatal "run this script in a Postfix source tree after \"make\""
+test "`id -u`" = 0 || fatal "this script must be run by the super-user"
+id "$owner" >/dev/null 2>&1 || fatal "unknown mail_owner: $owner"
+mkdir "$scratch" || fatal "cannot create $scratch"
+
+# Portable enough clock with sub-second resolution where available.
+
+now() {
+    case `date +%N` in
+    [0-9]*) date +%s.%N;;
+    *)	    date +%s;;
+    esac
+}
+
+# CPU time in clock ticks of the master process, its reaped child
+# processes, and its running child processes (Linux only).
+
+cpu_ticks() {
+    test -r /proc/$master_pid/stat || { echo 0; return; }
+    for pid in $master_pid `pgrep -P $master_pid 2>/dev/null`
+    do
+	cat /proc/$pid/stat 2>/dev/null
+	echo
+    done | awk -v master=$master_pid '
+	NF >= 17 { ticks += $14 + $15; if ($1 == master) ticks += $16 + $17 }
+	END { print ticks + 0 }'
+}
+
+# Count the log records that match the pattern.
+
+count() {
+    grep -c -- "$1" $instance/maillog 2>/dev/null || true
+}
+
+# Wait until the log contains the expected number of matching records.
+
+wait_count() {
+    deadline=`expr \`date +%s\` + $timeout`
+    while test "`count \"$1\"`" -lt "$2"
+    do
+	test "`date +%s`" -lt $deadline ||
+	    fatal "$workload: timeout after ${timeout}s waiting for $2 \"$1\" records"
+	sleep 1
+    done
+}
+
+# Create and start a fresh Postfix instance for one workload.
+
+start_instance() {
+    instance=$scratch/$workload
+    conf=$instance/conf
+    queue=$instance/queue
+    mkdir -p $conf $queue/pid $instance/data || fatal "cannot create $instance"
+    for dir in incoming active deferred bounce defer trace flush hold \
+	corrupt saved private
+    do
+	mkdir $queue/$dir && chown $owner $queue/$dir && chmod 700 $queue/$dir
+    done
+    mkdir $queue/maildrop $queue/public
+    chown $owner:$group $queue/maildrop $queue/public
+    chmod 730 $queue/maildrop
+    chmod 710 $queue/public
+    chown $owner $instance/data
+    touch $instance/maillog
+    chown $owner $instance/maillog
+
+    cat >$conf/main.cf <<EOF
+compatibility_level = 3.6
+queue_directory = $queue
+data_directory = $instance/data
+meta_directory = $conf
+command_directory = $bin
+daemon_directory = $libexec
+mail_owner = $owner
+setgid_group = $group
+myhostname = bench.invalid
+mydestination =
+alias_maps =
+alias_database =
+inet_interfaces = 127.0.0.1
+inet_protocols = ipv4
+mynetworks = 127.0.0.0/8
+smtpd_relay_restrictions = permit_mynetworks, reject
+relayhost = [127.0.0.1]:$sink_port
+smtp_dns_support_level = disabled
+maillog_file = $instance/maillog
+maillog_file_prefixes = $instance
+default_process_limit = 200
+EOF
+
+    cat >$conf/master.cf <<EOF
+127.0.0.1:$smtp_port inet n - n - - smtpd
+pickup    unix  n - n 60 1 pickup
+cleanup   unix  n - n - 0 cleanup
+qmgr      unix  n - n 300 1 qmgr
+tlsmgr    unix  - - n 1000? 1 tlsmgr
+rewrite   unix  - - n - - trivial-rewrite
+bounce    unix  - - n - 0 bounce
+defer     unix  - - n - 0 bounce
+trace     unix  - - n - 0 bounce
+verify    unix  - - n - 1 verify
+flush     unix  n - n 1000? 0 flush
+proxymap  unix  - - n - - proxymap
+smtp      unix  - - n - - smtp
+relay     unix  - - n - - smtp
+sink      unix  - - n - - smtp -o smtp_tls_security_level=none
+showq     unix  n - n - - showq
+error     unix  - - n - - error
+retry     unix  - - n - - error
+discard   unix  - - n - - discard
+anvil     unix  - - n - 1 anvil
+scache    unix  - - n - 1 scache
+postlog   unix-dgram n - n - 1 postlogd
+EOF
+    chown -R root $conf
+
+    # Workload-specific settings.
+    case $workload in
+    explode)
+	echo "default_destination_recipient_limit = 1" >>$conf/main.cf;;
+    tls)
+	openssl req -x509 -newkey rsa:2048 -nodes -days 1 \
+	    -subj /CN=bench.invalid -keyout $conf/key.pem \
+	    -out $conf/cert.pem >/dev/null 2>&1 ||
+	    fatal "cannot create TLS certificate"
+	cat >>$conf/main.cf <<EOF
+relayhost = [127.0.0.1]:$tls_port
+smtp_tls_security_level = encrypt
+smtp_tls_session_cache_database =
+EOF
+	echo "127.0.0.1:$tls_port inet n - n - - smtpd" \
+	    "-o smtpd_tls_security_level=encrypt" \
+	    "-o smtpd_tls_cert_file=$conf/cert.pem" \
+	    "-o smtpd_tls_key_file=$conf/key.pem" \
+	    "-o content_filter=sink:[127.0.0.1]:$sink_port" >>$conf/master.cf;;
+    deferred)
+	echo "minimal_backoff_time = 1h" >>$conf/main.cf
+	echo "maximal_backoff_time = 1h" >>$conf/main.cf;;
+    esac
+
+    # With -w, the master runs as a session leader, so that it can
+    # terminate its child processes when it is stopped.
+    $libexec/master -c $conf -w ||
+	fatal "cannot start master (see $instance/maillog)"
+    master_pid=`awk '{ print $1 }' $queue/pid/master.pid`
+}
+
+stop_instance() {
+    if [ -n "$master_pid" ]
+    then
+	kill -TERM $master_pid 2>/dev/null
+	while kill -0 $master_pid 2>/dev/null
+	do
+	    sleep 1
+	done
+    fi
+    test -n "$sink_pid" && kill -TERM $sink_pid 2>/dev/null
+    wait
+    master_pid= sink_pid=
+}
+
+start_sink() {
+    $bin/smtp-sink -u $owner "$@" 127.0.0.1:$sink_port 1024 &
+    sink_pid=$!
+    sleep 1
+}
+
+stop_sink() {
+    kill -TERM $sink_pid 2>/dev/null
+    wait $sink_pid 2>/dev/null
+    sink_pid=
+}
+
+# Report throughput, latency percentiles from the delay= log
+# attribute of the final deliveries, and CPU time per message.
+
+report() {
+    grep -- "relay=[^ ]*:$sink_port, .*status=sent" $instance/maillog |
+	sed 's/.* delay=\([0-9.]*\),.*/\1/' | sort -n |
+	awk -v workload=$workload -v msgs=$1 -v elapsed=$2 -v ticks=$3 \
+	    -v hz=`getconf CLK_TCK 2>/dev/null || echo 100` '
+	{ delay[NR] = $1 }
+	function pct(p,  i) {
+	    i = int(NR * p / 100 + 0.5); if (i < 1) i = 1; if (i > NR) i = NR
+	    return delay[i]
+	}
+	END {
+	    if (NR == 0) { print workload ": no deliveries"; exit }
+	    printf "%-9s %7d dlvs %8.2f s %9.1f dlvs/s  delay p50 %s p90 %s p99 %s s",
+		workload, msgs, elapsed, msgs / elapsed, pct(50), pct(90), pct(99)
+	    if (ticks > 0)
+		printf "  cpu %.2f ms/dlv", 1000 * ticks / hz / msgs
+	    printf "\n"
+	}'
+}
+
+# Run the workloads. smtp-source sends one message per "messages",
+# except where noted.
+
+for workload in $workloads
+do
+    case $workload in
+    small)    args="-l 1024"; count=$messages;;
+    large)    count=`expr $messages / 100 + 1`; args="-l 4194304";;
+    explode)  count=`expr $messages / 100 + 1`; args="-r 100";;
+    tls)      args="-l 1024"; count=$messages
+	      grep USE_TLS conf/makedefs.out >/dev/null 2>&1 ||
+		  fatal "tls: this Postfix was built without TLS support";;
+    deferred) args="-l 1024"; count=$messages;;
+    *)	      usage;;
+    esac
+    case $workload in
+    explode) deliveries=`expr $count \* 100`;;
+    *)	     deliveries=$count;;
+    esac
+
+    start_instance
+    case $workload in
+    deferred) start_sink -r RCPT;;
+    *)	      start_sink;;
+    esac
+    ticks0=`cpu_ticks`
+    start=`now`
+    $bin/smtp-source -d -s $sessions -m $count $args \
+	-f bench@bench.invalid -t rcpt@sink.invalid \
+	127.0.0.1:$smtp_port || fatal "$workload: smtp-source failed"
+
+    # For the deferred-queue workload, measure how fast Postfix drains
+    # a deferred queue after the destination becomes available again.
+    if [ $workload = deferred ]
+    then
+	wait_count "status=deferred" $deliveries
+	stop_sink
+	start_sink
+	ticks0=`cpu_ticks`
+	start=`now`
+	$bin/postqueue -c $conf -f || fatal "$workload: postqueue -f failed"
+    fi
+    wait_count "relay=[^ ]*:$sink_port, .*status=sent" $deliveries
+    end=`now`
+    ticks=`expr \`cpu_ticks\` - $ticks0`
+    report $deliveries `echo "$end $start" | awk '{ print $1 - $2 }'` $ticks
+    stop_instance
+    test -n "$keep" || rm -rf $instance
+done
+
+test -n "$keep" || rm -rf $scratch
+exit 0
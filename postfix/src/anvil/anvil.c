@@ -307,6 +307,12 @@ int     var_anvil_stat_time;
   */
 static HTABLE *anvil_remote_map;	/* indexed by service+ remote client */
 
+ /*
+  * The reply uses the same attribute format as the request: text, or binary
+  * when the request starts with the attr_scan_bin(3) request marker.
+  */
+static ATTR_PRINT_COMMON_FN anvil_reply = attr_print_plain;
+
  /*
   * Remote connection state, one instance for each (service, client) pair.
   */
@@ -559,15 +565,15 @@ static void anvil_remote_lookup(VSTREAM *client_stream, const char *ident)
      */
     if ((anvil_remote =
 	 (ANVIL_REMOTE *) htable_find(anvil_remote_map, ident)) == 0) {
-	attr_print_plain(client_stream, ATTR_FLAG_NONE,
-			 SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-			 SEND_ATTR_INT(ANVIL_ATTR_COUNT, 0),
-			 SEND_ATTR_INT(ANVIL_ATTR_RATE, 0),
-			 SEND_ATTR_INT(ANVIL_ATTR_MAIL, 0),
-			 SEND_ATTR_INT(ANVIL_ATTR_RCPT, 0),
-			 SEND_ATTR_INT(ANVIL_ATTR_NTLS, 0),
-			 SEND_ATTR_INT(ANVIL_ATTR_AUTH, 0),
-			 ATTR_TYPE_END);
+	anvil_reply(client_stream, ATTR_FLAG_NONE,
+		    SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		    SEND_ATTR_INT(ANVIL_ATTR_COUNT, 0),
+		    SEND_ATTR_INT(ANVIL_ATTR_RATE, 0),
+		    SEND_ATTR_INT(ANVIL_ATTR_MAIL, 0),
+		    SEND_ATTR_INT(ANVIL_ATTR_RCPT, 0),
+		    SEND_ATTR_INT(ANVIL_ATTR_NTLS, 0),
+		    SEND_ATTR_INT(ANVIL_ATTR_AUTH, 0),
+		    ATTR_TYPE_END);
     } else {
 
 	/*
@@ -576,15 +582,15 @@ static void anvil_remote_lookup(VSTREAM *client_stream, const char *ident)
 	if (anvil_remote->start != 0
 	    && anvil_remote->start + var_anvil_time_unit < event_time())
 	    ANVIL_REMOTE_RSET_RATE(anvil_remote, 0);
-	attr_print_plain(client_stream, ATTR_FLAG_NONE,
-			 SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		       SEND_ATTR_INT(ANVIL_ATTR_COUNT, anvil_remote->count),
-			 SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->rate),
-			 SEND_ATTR_INT(ANVIL_ATTR_MAIL, anvil_remote->mail),
-			 SEND_ATTR_INT(ANVIL_ATTR_RCPT, anvil_remote->rcpt),
-			 SEND_ATTR_INT(ANVIL_ATTR_NTLS, anvil_remote->ntls),
-			 SEND_ATTR_INT(ANVIL_ATTR_AUTH, anvil_remote->auth),
-			 ATTR_TYPE_END);
+	anvil_reply(client_stream, ATTR_FLAG_NONE,
+		    SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		    SEND_ATTR_INT(ANVIL_ATTR_COUNT, anvil_remote->count),
+		    SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->rate),
+		    SEND_ATTR_INT(ANVIL_ATTR_MAIL, anvil_remote->mail),
+		    SEND_ATTR_INT(ANVIL_ATTR_RCPT, anvil_remote->rcpt),
+		    SEND_ATTR_INT(ANVIL_ATTR_NTLS, anvil_remote->ntls),
+		    SEND_ATTR_INT(ANVIL_ATTR_AUTH, anvil_remote->auth),
+		    ATTR_TYPE_END);
     }
 }
 
@@ -653,11 +659,11 @@ static void anvil_remote_connect(VSTREAM *client_stream, const char *ident)
     /*
      * Respond to the local server.
      */
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     SEND_ATTR_INT(ANVIL_ATTR_COUNT, anvil_remote->count),
-		     SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->rate),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		SEND_ATTR_INT(ANVIL_ATTR_COUNT, anvil_remote->count),
+		SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->rate),
+		ATTR_TYPE_END);
 
     /*
      * Update peak statistics.
@@ -685,10 +691,10 @@ static void anvil_remote_mail(VSTREAM *client_stream, const char *ident)
      * Update message delivery request rate and respond to local server.
      */
     ANVIL_REMOTE_INCR_MAIL(anvil_remote);
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->mail),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->mail),
+		ATTR_TYPE_END);
 
     /*
      * Update peak statistics.
@@ -714,10 +720,10 @@ static void anvil_remote_rcpt(VSTREAM *client_stream, const char *ident)
      * Update recipient address rate and respond to local server.
      */
     ANVIL_REMOTE_INCR_RCPT(anvil_remote);
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->rcpt),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->rcpt),
+		ATTR_TYPE_END);
 
     /*
      * Update peak statistics.
@@ -743,10 +749,10 @@ static void anvil_remote_auth(VSTREAM *client_stream, const char *ident)
      * Update recipient address rate and respond to local server.
      */
     ANVIL_REMOTE_INCR_AUTH(anvil_remote);
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->auth),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->auth),
+		ATTR_TYPE_END);
 
     /*
      * Update peak statistics.
@@ -772,10 +778,10 @@ static void anvil_remote_newtls(VSTREAM *client_stream, const char *ident)
      * Update newtls rate and respond to local server.
      */
     ANVIL_REMOTE_INCR_NTLS(anvil_remote);
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->ntls),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		SEND_ATTR_INT(ANVIL_ATTR_RATE, anvil_remote->ntls),
+		ATTR_TYPE_END);
 
     /*
      * Update peak statistics.
@@ -812,10 +818,10 @@ static void anvil_remote_newtls_stat(VSTREAM *client_stream, const char *ident)
     /*
      * Respond to local server.
      */
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     SEND_ATTR_INT(ANVIL_ATTR_RATE, rate),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		SEND_ATTR_INT(ANVIL_ATTR_RATE, rate),
+		ATTR_TYPE_END);
 }
 
 /* anvil_remote_disconnect - report disconnect event */
@@ -849,9 +855,9 @@ static void anvil_remote_disconnect(VSTREAM *client_stream, const char *ident)
     /*
      * Respond to the local server.
      */
-    attr_print_plain(client_stream, ATTR_FLAG_NONE,
-		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
-		     ATTR_TYPE_END);
+    anvil_reply(client_stream, ATTR_FLAG_NONE,
+		SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_OK),
+		ATTR_TYPE_END);
 }
 
 /* anvil_service_done - clean up */
@@ -927,6 +933,8 @@ static void anvil_service(VSTREAM *client_stream, char *unused_service, char **a
 	0, 0,
     };
     const ANVIL_REQ_TABLE *rp;
+    ATTR_SCAN_COMMON_FN scan_fn;
+    int     binary;
 
     /*
      * Sanity check. This service takes no command-line arguments.
@@ -950,17 +958,21 @@ static void anvil_service(VSTREAM *client_stream, char *unused_service, char **a
      */
     if (msg_verbose)
 	msg_info("--- start request ---");
-    if (attr_scan_plain(client_stream,
-			ATTR_FLAG_MISSING | ATTR_FLAG_STRICT,
-			RECV_ATTR_STR(ANVIL_ATTR_REQ, request),
-			RECV_ATTR_STR(ANVIL_ATTR_IDENT, ident),
-			ATTR_TYPE_END) == 2) {
+    binary = attr_scan_bin_mark(client_stream);
+    scan_fn = (binary > 0 ? attr_scan_bin : attr_scan_plain);
+    anvil_reply = (binary > 0 ? attr_print_bin : attr_print_plain);
+    if (binary >= 0
+	&& scan_fn(client_stream,
+		   ATTR_FLAG_MISSING | ATTR_FLAG_STRICT,
+		   RECV_ATTR_STR(ANVIL_ATTR_REQ, request),
+		   RECV_ATTR_STR(ANVIL_ATTR_IDENT, ident),
+		   ATTR_TYPE_END) == 2) {
 	for (rp = request_table; /* see below */ ; rp++) {
 	    if (rp->name == 0) {
 		msg_warn("unrecognized request: \"%s\", ignored", STR(request));
-		attr_print_plain(client_stream, ATTR_FLAG_NONE,
-			  SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_FAIL),
-				 ATTR_TYPE_END);
+		anvil_reply(client_stream, ATTR_FLAG_NONE,
+		     SEND_ATTR_INT(ANVIL_ATTR_STATUS, ANVIL_STAT_FAIL),
+			    ATTR_TYPE_END);
 		break;
 	    }
 	    if (STREQ(rp->name, STR(request))) {
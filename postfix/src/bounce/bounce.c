@@ -134,6 +134,11 @@
 /*	Available in Postfix 3.7 and later:
 /* .IP "\fBheader_from_format (standard)\fR"
 /*	The format of the Postfix-generated \fBFrom:\fR header.
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBbounce_default_return (full)\fR"
+/*	What a non-delivery notification returns of the original message
+/*	when the sender did not request DSN RET=FULL or RET=HDRS.
 /* FILES
 /*	/var/spool/postfix/bounce/* non-delivery records
 /*	/var/spool/postfix/defer/* non-delivery records
@@ -188,6 +193,7 @@
 #include <rcpt_buf.h>
 #include <dsb_scan.h>
 #include <hfrom_format.h>
+#include <dsn_mask.h>
 
 /* Single-threaded server skeleton. */
 
@@ -210,6 +216,7 @@ char   *var_delay_rcpt;
 char   *var_bounce_tmpl;
 bool    var_threaded_bounce;
 char   *var_hfrom_format;		/* header_from_format */
+char   *var_bounce_def_ret;
 
  /*
   * We're single threaded, so we can avoid some memory allocation overhead.
@@ -233,6 +240,11 @@ BOUNCE_TEMPLATES *bounce_templates;
   */
 int     bounce_hfrom_format;
 
+ /*
+  * What to return when the sender did not specify DSN RET.
+  */
+int     bounce_default_ret;
+
 #define STR vstring_str
 
 #define VS_NEUTER(s) printable(vstring_str(s), '?')
@@ -304,6 +316,75 @@ static int bounce_append_proto(char *service_name, VSTREAM *client)
 				  &rcpt_buf->rcpt, &dsn_buf->dsn));
 }
 
+/* bounce_append_list_proto - bounce_append server protocol, multiple records */
+
+static int bounce_append_list_proto(char *service_name, VSTREAM *client)
+{
+    const char *myname = "bounce_append_list_proto";
+    int     flags;
+    int     count;
+    int     n;
+
+    /*
+     * Read and validate the request header. The recipient records follow.
+     */
+    if (attr_scan(client, ATTR_FLAG_STRICT | ATTR_FLAG_MORE,
+		  RECV_ATTR_INT(MAIL_ATTR_FLAGS, &flags),
+		  RECV_ATTR_STR(MAIL_ATTR_QUEUEID, queue_id),
+		  RECV_ATTR_INT(MAIL_ATTR_RCPT_COUNT, &count),
+		  ATTR_TYPE_END) != 3 || count <= 0) {
+	msg_warn("malformed request");
+	return (-1);
+    }
+    if (mail_queue_id_ok(STR(queue_id)) == 0) {
+	msg_warn("malformed queue id: %s", printable(STR(queue_id), '?'));
+	return (-1);
+    }
+    if (msg_verbose)
+	msg_info("%s: flags=0x%x service=%s id=%s count=%d",
+		 myname, flags, service_name, STR(queue_id), count);
+
+    /*
+     * On request by the client, set up a trap to delete the log file in case
+     * of errors.
+     */
+    if (flags & BOUNCE_FLAG_CLEAN)
+	bounce_cleanup_register(service_name, STR(queue_id));
+
+    /*
+     * Append all records with one logfile update. Undo the update when the
+     * request turns out to be malformed.
+     */
+    bounce_append_begin(service_name, STR(queue_id));
+    for (n = 0; n < count; n++) {
+	if (attr_scan(client, ATTR_FLAG_STRICT | ATTR_FLAG_MORE,
+		      RECV_ATTR_FUNC(rcpb_scan, (void *) rcpt_buf),
+		      RECV_ATTR_FUNC(dsb_scan, (void *) dsn_buf),
+		      ATTR_TYPE_END) != 2) {
+	    msg_warn("malformed request");
+	    return (bounce_append_end(BOUNCE_APPEND_ABORT));
+	}
+	VS_NEUTER(rcpt_buf->address);
+	VS_NEUTER(rcpt_buf->orig_addr);
+	VS_NEUTER(rcpt_buf->dsn_orcpt);
+	VS_NEUTER(dsn_buf->status);
+	VS_NEUTER(dsn_buf->action);
+	VS_NEUTER(dsn_buf->reason);
+	VS_NEUTER(dsn_buf->dtype);
+	VS_NEUTER(dsn_buf->dtext);
+	VS_NEUTER(dsn_buf->mtype);
+	VS_NEUTER(dsn_buf->mname);
+	(void) RECIPIENT_FROM_RCPT_BUF(rcpt_buf);
+	(void) DSN_FROM_DSN_BUF(dsn_buf);
+	bounce_append_record(&rcpt_buf->rcpt, &dsn_buf->dsn);
+    }
+    if (attr_scan(client, ATTR_FLAG_STRICT, ATTR_TYPE_END) != 0) {
+	msg_warn("malformed request");
+	return (bounce_append_end(BOUNCE_APPEND_ABORT));
+    }
+    return (bounce_append_end(BOUNCE_APPEND_COMMIT));
+}
+
 /* bounce_notify_proto - bounce_notify server protocol */
 
 static int bounce_notify_proto(char *service_name, VSTREAM *client,
@@ -574,6 +655,8 @@ static void bounce_service(VSTREAM *client, char *service_name, char **argv)
 				     bounce_trace_service);
     } else if (command == BOUNCE_CMD_APPEND) {
 	status = bounce_append_proto(service_name, client);
+    } else if (command == BOUNCE_CMD_APPEND_LIST) {
+	status = bounce_append_list_proto(service_name, client);
     } else if (command == BOUNCE_CMD_ONE) {
 	status = bounce_one_proto(service_name, client);
     } else {
@@ -632,6 +715,8 @@ static void pre_jail_init(char *unused_name, char **unused_argv)
 static void post_jail_init(char *service_name, char **unused_argv)
 {
     bounce_hfrom_format = hfrom_format_parse(VAR_HFROM_FORMAT, var_hfrom_format);
+    if ((bounce_default_ret = dsn_ret_code(var_bounce_def_ret)) == 0)
+	msg_fatal("bad %s value: %s", VAR_BOUNCE_DEF_RET, var_bounce_def_ret);
 
     /*
      * Special case: dump bounce templates. This is not part of the master(5)
@@ -686,6 +771,7 @@ int     main(int argc, char **argv)
 	VAR_DELAY_RCPT, DEF_DELAY_RCPT, &var_delay_rcpt, 1, 0,
 	VAR_BOUNCE_TMPL, DEF_BOUNCE_TMPL, &var_bounce_tmpl, 0, 0,
 	VAR_HFROM_FORMAT, DEF_HFROM_FORMAT, &var_hfrom_format, 1, 0,
+	VAR_BOUNCE_DEF_RET, DEF_BOUNCE_DEF_RET, &var_bounce_def_ret, 1, 0,
 	0,
     };
     static const CONFIG_NBOOL_TABLE nbool_table[] = {
@@ -12,10 +12,31 @@
 /*	char	*queue_id;
 /*	RECIPIENT *rcpt;
 /*	DSN	*dsn;
+/*
+/*	void	bounce_append_begin(service, queue_id)
+/*	char	*service;
+/*	char	*queue_id;
+/*
+/*	void	bounce_append_record(rcpt, dsn)
+/*	RECIPIENT *rcpt;
+/*	DSN	*dsn;
+/*
+/*	int	bounce_append_end(commit)
+/*	int	commit;
 /* DESCRIPTION
 /*	This module implements the server side of the bounce_append()
 /*	(append bounce log) request. This routine either succeeds or
 /*	it raises a fatal error.
+/*
+/*	bounce_append_begin(), bounce_append_record() and
+/*	bounce_append_end() append multiple records with one logfile
+/*	update. bounce_append_begin() opens and locks the logfile.
+/*	bounce_append_record() appends one record. bounce_append_end()
+/*	with \fIcommit\fR equal to BOUNCE_APPEND_COMMIT flushes the
+/*	records to stable storage with one fsync() call, and returns
+/*	zero. With \fIcommit\fR equal to BOUNCE_APPEND_ABORT, it
+/*	truncates the logfile to its original length, and returns -1.
+/*	Either way, it closes the logfile.
 /* DIAGNOSTICS
 /*	Fatal errors: all file access errors; memory allocation errors.
 /* BUGS
@@ -60,14 +81,29 @@
 
 #include "bounce_service.h"
 
-/* bounce_append_service - append bounce log */
+#define NOT_NULL_EMPTY(s) ((s) != 0 && *(s) != 0)
+#define STR(x) vstring_str(x)
 
-int     bounce_append_service(int unused_flags, char *service, char *queue_id,
-			              RECIPIENT *rcpt, DSN *dsn)
+ /*
+  * The logfile that is being updated, and its length before the update.
+  */
+static VSTREAM *bounce_log;
+static long bounce_log_length;
+static char *bounce_log_service;
+static char *bounce_log_queue_id;
+static VSTRING *bounce_log_buf;
+
+/* bounce_append_begin - open and lock bounce log */
+
+void    bounce_append_begin(char *service, char *queue_id)
 {
-    VSTRING *in_buf = vstring_alloc(100);
-    VSTREAM *log;
-    long    orig_length;
+    const char *myname = "bounce_append_begin";
+
+    if (bounce_log != 0)
+	msg_panic("%s: update of %s %s is still in progress",
+		  myname, bounce_log_service, bounce_log_queue_id);
+    if (bounce_log_buf == 0)
+	bounce_log_buf = vstring_alloc(100);
 
     /*
      * This code is paranoid for a good reason. Once the bounce service takes
@@ -76,24 +112,44 @@ int     bounce_append_service(int unused_flags, char *service, char *queue_id,
      * system is under stress or that something has been mis-configured, and
      * force a backoff by raising a fatal run-time error.
      */
-    log = mail_queue_open(service, queue_id,
-			  O_WRONLY | O_APPEND | O_CREAT, 0600);
-    if (log == 0)
+    bounce_log = mail_queue_open(service, queue_id,
+				 O_WRONLY | O_APPEND | O_CREAT, 0600);
+    if (bounce_log == 0)
 	msg_fatal("open file %s %s: %m", service, queue_id);
+    bounce_log_service = service;
+    bounce_log_queue_id = queue_id;
 
     /*
      * Lock out other processes to avoid truncating someone else's data in
      * case of trouble.
      */
-    if (deliver_flock(vstream_fileno(log), INTERNAL_LOCK, (VSTRING *) 0) < 0)
+    if (deliver_flock(vstream_fileno(bounce_log), INTERNAL_LOCK,
+		      (VSTRING *) 0) < 0)
 	msg_fatal("lock file %s %s: %m", service, queue_id);
 
     /*
-     * Now, go for it. Append a record. Truncate the log to the original
-     * length when the append operation fails. We use the plain stream-lf
-     * file format because we do not need anything more complicated. As a
-     * benefit, we can still recover some data when the file is a little
-     * garbled.
+     * Truncate the log to the original length when the append operation
+     * fails.
+     */
+    if ((bounce_log_length = vstream_fseek(bounce_log, 0L, SEEK_END)) < 0)
+	msg_fatal("seek file %s %s: %m", service, queue_id);
+}
+
+/* bounce_append_record - append one record to bounce log */
+
+void    bounce_append_record(RECIPIENT *rcpt, DSN *dsn)
+{
+    const char *myname = "bounce_append_record";
+    VSTREAM *log = bounce_log;
+    VSTRING *in_buf = bounce_log_buf;
+
+    if (log == 0)
+	msg_panic("%s: no update in progress", myname);
+
+    /*
+     * Now, go for it. Append a record. We use the plain stream-lf file
+     * format because we do not need anything more complicated. As a benefit,
+     * we can still recover some data when the file is a little garbled.
      * 
      * XXX addresses in defer logfiles are in printable quoted form, while
      * addresses in message envelope records are in raw unquoted form. This
@@ -105,12 +161,6 @@ int     bounce_append_service(int unused_flags, char *service, char *queue_id,
      * compatibility by writing an old-style record before the new-style
      * records.
      */
-    if ((orig_length = vstream_fseek(log, 0L, SEEK_END)) < 0)
-	msg_fatal("seek file %s %s: %m", service, queue_id);
-
-#define NOT_NULL_EMPTY(s) ((s) != 0 && *(s) != 0)
-#define STR(x) vstring_str(x)
-
     vstream_fputs("\n", log);
     if (var_oldlog_compat) {
 	vstream_fprintf(log, "<%s>: %s\n", *rcpt->address == 0 ? "" :
@@ -145,13 +195,32 @@ int     bounce_append_service(int unused_flags, char *service, char *queue_id,
     if (NOT_NULL_EMPTY(dsn->reason))
 	vstream_fprintf(log, "%s=%s\n", MAIL_ATTR_WHY, dsn->reason);
     vstream_fputs("\n", log);
+}
+
+/* bounce_append_end - commit or undo bounce log update */
 
-    if (vstream_fflush(log) != 0 || fsync(vstream_fileno(log)) < 0) {
+int     bounce_append_end(int commit)
+{
+    const char *myname = "bounce_append_end";
+    VSTREAM *log = bounce_log;
+    char   *service = bounce_log_service;
+    char   *queue_id = bounce_log_queue_id;
+
+    if (log == 0)
+	msg_panic("%s: no update in progress", myname);
+    bounce_log = 0;
+
+    /*
+     * One fsync() call for all records of this update.
+     */
+    if (commit == 0 || vstream_fflush(log) != 0
+	|| fsync(vstream_fileno(log)) < 0) {
 #ifndef NO_TRUNCATE
-	if (ftruncate(vstream_fileno(log), (off_t) orig_length) < 0)
+	if (ftruncate(vstream_fileno(log), (off_t) bounce_log_length) < 0)
 	    msg_fatal("truncate file %s %s: %m", service, queue_id);
 #endif
-	msg_fatal("append file %s %s: %m", service, queue_id);
+	if (commit)
+	    msg_fatal("append file %s %s: %m", service, queue_id);
     }
 
     /*
@@ -160,9 +229,17 @@ int     bounce_append_service(int unused_flags, char *service, char *queue_id,
      * original length. But, this could happen only when the log is kept on a
      * remote file system, and that is not recommended practice anyway.
      */
-    if (vstream_fclose(log) != 0)
+    if (vstream_fclose(log) != 0 && commit)
 	msg_warn("append file %s %s: %m", service, queue_id);
+    return (commit ? 0 : -1);
+}
 
-    vstring_free(in_buf);
-    return (0);
+/* bounce_append_service - append bounce log */
+
+int     bounce_append_service(int unused_flags, char *service, char *queue_id,
+			              RECIPIENT *rcpt, DSN *dsn)
+{
+    bounce_append_begin(service, queue_id);
+    bounce_append_record(rcpt, dsn);
+    return (bounce_append_end(BOUNCE_APPEND_COMMIT));
 }
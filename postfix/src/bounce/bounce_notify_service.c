@@ -237,7 +237,7 @@ int     bounce_notify_service(int flags, char *service, char *queue_name,
 		&& bounce_diagnostic_dsn(bounce, bounce_info,
 					 DSN_NOTIFY_FAILURE) > 0) {
 		bounce_original(bounce, bounce_info, dsn_ret ?
-				dsn_ret : DSN_RET_FULL);
+				dsn_ret : bounce_default_ret);
 		bounce_status = post_mail_fclose(bounce);
 		if (bounce_status == 0)
 		    msg_info("%s: sender non-delivery notification: %s",
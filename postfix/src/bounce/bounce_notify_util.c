@@ -196,6 +196,7 @@
 #include <is_header.h>
 #include <record.h>
 #include <rec_type.h>
+#include <rec_size_trailer.h>
 #include <post_mail.h>
 #include <mail_addr.h>
 #include <mail_error.h>
@@ -330,6 +331,12 @@ static BOUNCE_INFO *bounce_mail_alloc(const char *service,
 	     * Postfix version dependent: data offset in SIZE record.
 	     */
 	    if (rec_type == REC_TYPE_SIZE) {
+		if (bounce_info->message_size == 0
+		    && strcmp(STR(bounce_info->buf), REC_TYPE_SIZE_TRAILER) == 0
+		    && rec_size_trailer(bounce_info->orig_fp,
+					bounce_info->buf) != REC_TYPE_SIZE)
+		    msg_warn("%s: bad size trailer",
+			     VSTREAM_PATH(bounce_info->orig_fp));
 		if (bounce_info->message_size == 0)
 		    sscanf(STR(bounce_info->buf), "%ld %ld",
 			   &bounce_info->message_size,
@@ -181,7 +181,7 @@ int     bounce_notify_verp(int flags, char *service, char *queue_name,
 		    && bounce_header_dsn(bounce, bounce_info) == 0
 		    && bounce_recipient_dsn(bounce, bounce_info) == 0)
 		    bounce_original(bounce, bounce_info, dsn_ret ?
-				    dsn_ret : DSN_RET_FULL);
+				    dsn_ret : bounce_default_ret);
 		bounce_status = post_mail_fclose(bounce);
 		if (bounce_status == 0)
 		    msg_info("%s: sender non-delivery notification: %s",
@@ -27,11 +27,18 @@
   * bounce_service.c
   */
 extern int bounce_hfrom_format;
+extern int bounce_default_ret;
 
  /*
   * bounce_append_service.c
   */
 extern int bounce_append_service(int, char *, char *, RECIPIENT *, DSN *);
+extern void bounce_append_begin(char *, char *);
+extern void bounce_append_record(RECIPIENT *, DSN *);
+extern int bounce_append_end(int);
+
+#define BOUNCE_APPEND_ABORT	0
+#define BOUNCE_APPEND_COMMIT	1
 
  /*
   * bounce_notify_service.c
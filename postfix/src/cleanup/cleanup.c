@@ -216,6 +216,16 @@
 /*	Optional list of \fIname=value\fR pairs that specify default
 /*	values for arbitrary macros that Postfix may send to Milter
 /*	applications.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBmilter_parallel_events (no)\fR"
+/*	Send each event to all Milter applications before receiving
+/*	their replies, so that the Milter latency is that of the
+/*	slowest application instead of the sum.
+/* .IP "\fBmilter_connection_reuse (no)\fR"
+/*	Keep a connection to a Milter application open after the end
+/*	of an SMTP session or message, and use it again for the next
+/*	one.
 /* MIME PROCESSING CONTROLS
 /* .ad
 /* .fi
@@ -433,6 +443,32 @@
 /*	Convert body content that claims to be 8-bit into quoted-printable,
 /*	before header_checks, body_checks, Milters, and before after-queue
 /*	content filters.
+/* .IP "\fBcleanup_group_commit_lock_file (empty)\fR"
+/*	A lock file, relative to the queue directory, that enables
+/*	cleanup(8) processes to share one file system sync for queue
+/*	files that are finished at the same time.
+/* .IP "\fBqueue_replication_peer (empty)\fR"
+/*	The address of a \fBreplicad\fR(8) service on a peer node
+/*	that keeps a copy of each new queue file, instead of a local
+/*	file system sync.
+/* .IP "\fBqueue_replication_timeout (10s)\fR"
+/*	The time limit for sending a queue file to, or receiving a
+/*	reply from, the queue_replication_peer node.
+/* .IP "\fBqueue_file_size_trailer (no)\fR"
+/*	Write each queue file strictly sequentially, with the final
+/*	message size information in a trailer record at the end of
+/*	the file.
+/* .IP "\fBmessage_stream_buffer_size (65536)\fR"
+/*	The I/O buffer size for message content that is received from
+/*	Postfix clients, and for queue files that are written by the
+/*	cleanup(8) server.
+/* .IP "\fBcleanup_duplicate_filter_style (exact)\fR"
+/*	How the cleanup(8) server remembers recipients for duplicate
+/*	elimination: a copy of each recipient, or a hash fingerprint.
+/* .IP "\fBcleanup_client_limit (1)\fR"
+/*	The number of messages that one cleanup(8) process receives
+/*	at the same time, before the master(8) daemon starts another
+/*	cleanup(8) process.
 /* FILES
 /*	/etc/postfix/canonical*, canonical mapping table
 /*	/etc/postfix/virtual*, virtual mapping table
@@ -485,6 +521,7 @@
 #include <msg.h>
 #include <vstring.h>
 #include <dict.h>
+#include <events.h>
 
 /* Global library. */
 
@@ -496,7 +533,7 @@
 #include <rec_type.h>
 #include <mail_version.h>
 
-/* Single-threaded server skeleton. */
+/* Server skeleton. */
 
 #include <mail_server.h>
 
@@ -504,9 +541,9 @@
 
 #include "cleanup.h"
 
-/* cleanup_service - process one request to inject a message into the queue */
+/* cleanup_session - process one request to inject a message into the queue */
 
-static void cleanup_service(VSTREAM *src, char *unused_service, char **argv)
+static void cleanup_session(VSTREAM *src)
 {
     VSTRING *buf = vstring_alloc(100);
     CLEANUP_STATE *state;
@@ -514,12 +551,6 @@ static void cleanup_service(VSTREAM *src, char *unused_service, char **argv)
     int     type = 0;
     int     status;
 
-    /*
-     * Sanity check. This service takes no command-line arguments.
-     */
-    if (argv[0])
-	msg_fatal("unexpected command-line argument: %s", argv[0]);
-
     /*
      * Open a queue file and initialize state.
      */
@@ -608,15 +639,84 @@ static void cleanup_service(VSTREAM *src, char *unused_service, char **argv)
     vstring_free(buf);
 }
 
+/* cleanup_service - handle one client connection */
+
+static void cleanup_service(VSTREAM *src, char *unused_service, char **argv)
+{
+
+    /*
+     * Sanity check. This service takes no command-line arguments.
+     */
+    if (argv[0])
+	msg_fatal("unexpected command-line argument: %s", argv[0]);
+
+    /*
+     * Receive message content in large blocks. See also mail_stream(3).
+     */
+    if (var_msg_stream_bufsize > 0)
+	vstream_control(src,
+		      CA_VSTREAM_CTL_BUFSIZE((ssize_t) var_msg_stream_bufsize),
+			CA_VSTREAM_CTL_END);
+
+    /*
+     * With the default client limit of 1, receive the message from start to
+     * end, just like a single-threaded server. Otherwise, receive input
+     * from multiple clients as it arrives.
+     */
+    if (var_cleanup_client_limit > 1) {
+	cleanup_mux_service(src);
+    } else {
+	cleanup_session(src);
+	event_server_disconnect(src);
+    }
+}
+
+/* cleanup_drain - finish messages in progress, then terminate */
+
+static void cleanup_drain(char *unused_service, char **unused_argv)
+{
+    int     count;
+
+    /*
+     * Don't drop messages that are being received, or connections that are
+     * waiting for in_flow_delay. Instead, handle them in the background, and
+     * let the master start a new process.
+     */
+    for (count = 0; /* see below */ ; count++) {
+	if (count >= 5) {
+	    msg_fatal("fork: %m");
+	} else if (event_server_drain() != 0) {
+	    msg_warn("fork: %m");
+	    sleep(1);
+	    continue;
+	} else {
+	    /* event_server_drain() resets the fatal error handler. */
+	    msg_cleanup(cleanup_all);
+	    return;
+	}
+    }
+}
+
+/* cleanup_restart - finish messages in progress after table change */
+
+static void cleanup_restart(int unused_event, void *unused_context)
+{
+    cleanup_drain((char *) 0, (char **) 0);
+}
+
 /* pre_accept - see if tables have changed */
 
 static void pre_accept(char *unused_name, char **unused_argv)
 {
     const char *table;
 
+    /*
+     * Accept this connection, and restart after returning to the event
+     * loop.
+     */
     if ((table = dict_changed_name()) != 0) {
 	msg_info("table %s has changed -- restarting", table);
-	exit(0);
+	event_request_timer(cleanup_restart, (void *) 0, 0);
     }
 }
 
@@ -640,17 +740,20 @@ int     main(int argc, char **argv)
     msg_cleanup(cleanup_all);
 
     /*
-     * Pass control to the single-threaded service skeleton.
+     * Pass control to the event-driven service skeleton. With a client
+     * limit of 1, this behaves like the single-threaded skeleton.
      */
-    single_server_main(argc, argv, cleanup_service,
-		       CA_MAIL_SERVER_INT_TABLE(cleanup_int_table),
-		       CA_MAIL_SERVER_BOOL_TABLE(cleanup_bool_table),
-		       CA_MAIL_SERVER_STR_TABLE(cleanup_str_table),
-		       CA_MAIL_SERVER_TIME_TABLE(cleanup_time_table),
-		       CA_MAIL_SERVER_PRE_INIT(cleanup_pre_jail),
-		       CA_MAIL_SERVER_POST_INIT(cleanup_post_jail),
-		       CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
-		       CA_MAIL_SERVER_IN_FLOW_DELAY,
-		       CA_MAIL_SERVER_UNLIMITED,
-		       0);
+    event_server_main(argc, argv, cleanup_service,
+		      CA_MAIL_SERVER_INT_TABLE(cleanup_int_table),
+		      CA_MAIL_SERVER_BOOL_TABLE(cleanup_bool_table),
+		      CA_MAIL_SERVER_STR_TABLE(cleanup_str_table),
+		      CA_MAIL_SERVER_TIME_TABLE(cleanup_time_table),
+		      CA_MAIL_SERVER_PRE_INIT(cleanup_pre_jail),
+		      CA_MAIL_SERVER_POST_INIT(cleanup_post_jail),
+		      CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
+		      CA_MAIL_SERVER_IN_FLOW_DELAY,
+		      CA_MAIL_SERVER_UNLIMITED,
+		      CA_MAIL_SERVER_CLIENT_LIMIT(&var_cleanup_client_limit),
+		      CA_MAIL_SERVER_SLOW_EXIT(cleanup_drain),
+		      0);
 }
@@ -252,11 +252,56 @@ extern void cleanup_message(CLEANUP_STATE *, int, const char *, ssize_t);
   */
 extern void cleanup_extracted(CLEANUP_STATE *, int, const char *, ssize_t);
 
+ /*
+  * cleanup_mux.c
+  */
+extern void cleanup_mux_service(VSTREAM *);
+extern void cleanup_mux_all(void);
+
  /*
   * cleanup_final.c
   */
 extern void cleanup_final(CLEANUP_STATE *);
 
+ /*
+  * cleanup_stages.c
+  */
+#define CLEANUP_STAGE_DATA	0	/* start of message content */
+#define CLEANUP_STAGE_CONTENT	1	/* end of message content */
+#define CLEANUP_STAGE_QUEUED	2	/* ready to commit */
+#define CLEANUP_STAGE_MARKS	3
+
+#define CLEANUP_STAGE_REWRITE	0	/* trivial-rewrite(8) requests */
+#define CLEANUP_STAGE_MAPS	1	/* table lookups */
+#define CLEANUP_STAGE_MILTER	2	/* Milter applications */
+#define CLEANUP_STAGE_ACTIVITIES 3
+
+typedef struct CLEANUP_STAGES {
+    struct timeval connect;		/* SMTP session start */
+    struct timeval marks[CLEANUP_STAGE_MARKS];	/* stage boundaries */
+    long    usecs[CLEANUP_STAGE_ACTIVITIES];	/* activity accumulators */
+    off_t   offset;			/* place holder record */
+} CLEANUP_STAGES;
+
+extern void cleanup_stages_init(void);
+extern void cleanup_stages_connect(CLEANUP_STATE *, const char *);
+extern void cleanup_stages_mark(int);
+extern void cleanup_stages_add(int, struct timeval *);
+extern void cleanup_stages_reserve(CLEANUP_STATE *);
+extern void cleanup_stages_update(CLEANUP_STATE *);
+extern void cleanup_stages_save(CLEANUP_STAGES *);
+extern void cleanup_stages_restore(const CLEANUP_STAGES *);
+
+#define CLEANUP_STAGE_START(start) do { \
+	if (var_stage_timing) \
+	    GETTIMEOFDAY(start); \
+    } while (0)
+
+#define CLEANUP_STAGE_STOP(which, start) do { \
+	if (var_stage_timing) \
+	    cleanup_stages_add((which), (start)); \
+    } while (0)
+
  /*
   * cleanup_rewrite.c
   */
@@ -274,7 +319,9 @@ extern int cleanup_map11_tree(CLEANUP_STATE *, TOK822 *, MAPS *, int);
  /*
   * cleanup_map1n.c
   */
-ARGV   *cleanup_map1n_internal(CLEANUP_STATE *, const char *, MAPS *, int);
+typedef void (*CLEANUP_MAP1N_FN) (CLEANUP_STATE *, const char *, void *);
+extern ssize_t cleanup_map1n_internal(CLEANUP_STATE *, const char *, MAPS *,
+				             int, CLEANUP_MAP1N_FN, void *);
 
  /*
   * cleanup_masquerade.c
@@ -353,6 +400,11 @@ extern void cleanup_body_edit_free(CLEANUP_STATE *);
   */
 extern int cleanup_hfrom_format;
 
+ /*
+  * Recipient duplicate filter.
+  */
+extern int cleanup_dup_filter_flags;
+
 /* LICENSE
 /* .ad
 /* .fi
@@ -124,6 +124,7 @@
 #include <mail_flow.h>
 #include <rec_type.h>
 #include <smtputf8.h>
+#include <metrics_clnt.h>
 
 /* Milter library. */
 
@@ -150,6 +151,7 @@ CLEANUP_STATE *cleanup_open(VSTREAM *src)
      * Initialize private state.
      */
     state = cleanup_state_alloc(src);
+    cleanup_stages_init();
 
     /*
      * Open the queue file. Save the queue file name in a global variable, so
@@ -216,6 +218,7 @@ int     cleanup_flush(CLEANUP_STATE *state)
     int     status;
     char   *junk;
     VSTRING *trace_junk;
+    struct timeval start;
 
     /*
      * Raise these errors only if we examined all queue file records.
@@ -240,6 +243,7 @@ int     cleanup_flush(CLEANUP_STATE *state)
      * XXX Include test for a built-in action to tempfail this message.
      */
     if (CLEANUP_MILTER_OK(state)) {
+	CLEANUP_STAGE_START(&start);
 	if (state->milters)
 	    cleanup_milter_inspect(state, state->milters);
 	else if (cleanup_milters) {
@@ -247,6 +251,7 @@ int     cleanup_flush(CLEANUP_STATE *state)
 	    if (CLEANUP_MILTER_OK(state))
 		cleanup_milter_inspect(state, cleanup_milters);
 	}
+	CLEANUP_STAGE_STOP(CLEANUP_STAGE_MILTER, &start);
     }
 
     /*
@@ -370,6 +375,22 @@ int     cleanup_flush(CLEANUP_STATE *state)
 	vstring_free(trace_junk);
     myfree(junk);
 
+    /*
+     * Update the message counters.
+     */
+    if (state->errs != 0) {
+	metrics_count("postfix_cleanup_messages_total", 1,
+		      "status", "rejected", (char *) 0);
+    } else if (state->flags & CLEANUP_FLAG_DISCARD) {
+	metrics_count("postfix_cleanup_messages_total", 1,
+		      "status", "discarded", (char *) 0);
+    } else {
+	metrics_count("postfix_cleanup_messages_total", 1,
+		      "status", "queued", (char *) 0);
+	metrics_count("postfix_cleanup_bytes_total", (long) state->cont_length,
+		      (char *) 0);
+    }
+
     /*
      * Cleanup internal state. This is simply complementary to the
      * initializations at the beginning of cleanup_open().
@@ -95,14 +95,20 @@ void    cleanup_envelope(CLEANUP_STATE *state, int type,
      * updated in place. This information takes precedence over any size
      * estimate provided by the client. It's all in one record, data size
      * first, for backwards compatibility reasons.
+     * 
+     * Optionally, the size information goes into a trailer record at the end
+     * of the queue file, so that the file is written strictly sequentially.
      */
-    cleanup_out_format(state, REC_TYPE_SIZE, REC_TYPE_SIZE_FORMAT,
-		       (REC_TYPE_SIZE_CAST1) 0,	/* extra offs - content offs */
-		       (REC_TYPE_SIZE_CAST2) 0,	/* content offset */
-		       (REC_TYPE_SIZE_CAST3) 0,	/* recipient count */
-		       (REC_TYPE_SIZE_CAST4) 0,	/* qmgr options */
-		       (REC_TYPE_SIZE_CAST5) 0,	/* content length */
-		       (REC_TYPE_SIZE_CAST6) 0);	/* smtputf8 */
+    if (var_qfile_size_trailer)
+	cleanup_out_string(state, REC_TYPE_SIZE, REC_TYPE_SIZE_TRAILER);
+    else
+	cleanup_out_format(state, REC_TYPE_SIZE, REC_TYPE_SIZE_FORMAT,
+			   (REC_TYPE_SIZE_CAST1) 0,	/* extra offs - content offs */
+			   (REC_TYPE_SIZE_CAST2) 0,	/* content offset */
+			   (REC_TYPE_SIZE_CAST3) 0,	/* recipient count */
+			   (REC_TYPE_SIZE_CAST4) 0,	/* qmgr options */
+			   (REC_TYPE_SIZE_CAST5) 0,	/* content length */
+			   (REC_TYPE_SIZE_CAST6) 0);	/* smtputf8 */
 
     /*
      * Pass control to the actual envelope processing routine.
@@ -125,6 +131,7 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
     int     mapped_type = type;
     const char *mapped_buf = buf;
     int     milter_count;
+    struct timeval start;
 
 #ifdef DELAY_ACTION
     int     defer_delay;
@@ -275,8 +282,11 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
 	cleanup_addr_recipient(state, buf);
 	if (cleanup_milters != 0
 	    && state->milters == 0
-	    && CLEANUP_MILTER_OK(state))
+	    && CLEANUP_MILTER_OK(state)) {
+	    CLEANUP_STAGE_START(&start);
 	    cleanup_milter_emul_rcpt(state, cleanup_milters, state->recip);
+	    CLEANUP_STAGE_STOP(CLEANUP_STAGE_MILTER, &start);
+	}
 	myfree(state->orig_rcpt);
 	state->orig_rcpt = 0;
 	if (state->dsn_orcpt != 0) {
@@ -332,6 +342,7 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
 	return;
     }
     if (type == REC_TYPE_MESG) {
+	cleanup_stages_mark(CLEANUP_STAGE_DATA);
 	state->action = cleanup_message;
 	if (state->flags & CLEANUP_FLAG_INRCPT) {
 	    if (state->milters || cleanup_milters) {
@@ -406,8 +417,11 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
 	}
 	if (cleanup_milters != 0
 	    && state->milters == 0
-	    && CLEANUP_MILTER_OK(state))
+	    && CLEANUP_MILTER_OK(state)) {
+	    CLEANUP_STAGE_START(&start);
 	    cleanup_milter_emul_mail(state, cleanup_milters, state->sender);
+	    CLEANUP_STAGE_STOP(CLEANUP_STAGE_MILTER, &start);
+	}
 	return;
     }
     if (mapped_type == REC_TYPE_DSN_ENVID) {
@@ -482,6 +496,12 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
 		return;
 	    }
 	}
+	if (strcmp(attr_name, MAIL_ATTR_STAGE_CONNECT) == 0) {
+	    /* Not part of queue file format. */
+	    if (var_stage_timing)
+		cleanup_stages_connect(state, attr_value);
+	    return;
+	}
 	if (strcmp(attr_name, MAIL_ATTR_TRACE_FLAGS) == 0) {
 	    if (!alldig(attr_value)) {
 		msg_warn("%s: message rejected: bad TFLAG record <%.200s>",
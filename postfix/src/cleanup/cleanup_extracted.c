@@ -103,11 +103,13 @@ void    cleanup_extracted_process(CLEANUP_STATE *state, int type,
 {
     const char *myname = "cleanup_extracted_process";
     const char *encoding;
+    const char *priority;
     char   *attr_name;
     char   *attr_value;
     const char *error_text;
     int     extra_opts;
     int     junk;
+    struct timeval start;
 
 #ifdef DELAY_ACTION
     int     defer_delay;
@@ -172,6 +174,9 @@ void    cleanup_extracted_process(CLEANUP_STATE *state, int type,
 	    buf = attr_value;
 	    type = junk;
 	}
+	/* Discard stale stage times from a requeued message. */
+	if (strcmp(attr_name, MAIL_ATTR_STAGE_TIMES) == 0)
+	    return;
     }
 
     /*
@@ -187,6 +192,9 @@ void    cleanup_extracted_process(CLEANUP_STATE *state, int type,
 	if ((encoding = nvtable_find(state->attr, MAIL_ATTR_ENCODING)) != 0)
 	    cleanup_out_format(state, REC_TYPE_ATTR, "%s=%s",
 			       MAIL_ATTR_ENCODING, encoding);
+	if ((priority = nvtable_find(state->attr, MAIL_ATTR_PRIORITY)) != 0)
+	    cleanup_out_format(state, REC_TYPE_ATTR, "%s=%s",
+			       MAIL_ATTR_PRIORITY, priority);
 	state->flags |= CLEANUP_FLAG_INRCPT;
 	/* Make room to append more meta records. */
 	if (state->milters || cleanup_milters) {
@@ -213,8 +221,11 @@ void    cleanup_extracted_process(CLEANUP_STATE *state, int type,
 	cleanup_addr_recipient(state, buf);
 	if (cleanup_milters != 0
 	    && state->milters == 0
-	    && CLEANUP_MILTER_OK(state))
+	    && CLEANUP_MILTER_OK(state)) {
+	    CLEANUP_STAGE_START(&start);
 	    cleanup_milter_emul_rcpt(state, cleanup_milters, state->recip);
+	    CLEANUP_STAGE_STOP(CLEANUP_STAGE_MILTER, &start);
+	}
 	myfree(state->orig_rcpt);
 	state->orig_rcpt = 0;
 	if (state->dsn_orcpt != 0) {
@@ -322,7 +333,8 @@ void    cleanup_extracted_finish(CLEANUP_STATE *state)
     }
 
     /*
-     * Terminate the extracted segment.
+     * Make room for the stage times, and terminate the extracted segment.
      */
+    cleanup_stages_reserve(state);
     cleanup_out_string(state, REC_TYPE_END, "");
 }
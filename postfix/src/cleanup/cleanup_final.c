@@ -35,6 +35,8 @@
 
 #include <cleanup_user.h>
 #include <rec_type.h>
+#include <rec_size_trailer.h>
+#include <mail_params.h>
 
 /* Application-specific. */
 
@@ -45,6 +47,7 @@
 void    cleanup_final(CLEANUP_STATE *state)
 {
     const char *myname = "cleanup_final";
+    off_t   trailer_offset = 0;
 
     /*
      * vstream_fseek() would flush the buffer anyway, but the code just reads
@@ -62,12 +65,25 @@ void    cleanup_final(CLEANUP_STATE *state)
 	return;
     }
 
+    /*
+     * Update the stage times place holder.
+     */
+    cleanup_stages_update(state);
+
     /*
      * Update the preliminary message size and count fields with the actual
-     * values.
+     * values. With a size trailer, append the actual values instead. The
+     * trailer must be the last record in the file, after any records that
+     * were appended with Milter edits. Readers find it at a fixed distance
+     * from the end of the file.
      */
-    if (vstream_fseek(state->dst, 0L, SEEK_SET) < 0)
-	msg_fatal("%s: vstream_fseek %s: %m", myname, cleanup_path);
+    if (var_qfile_size_trailer) {
+	if ((trailer_offset = vstream_fseek(state->dst, 0L, SEEK_END)) < 0)
+	    msg_fatal("%s: vstream_fseek %s: %m", myname, cleanup_path);
+    } else {
+	if (vstream_fseek(state->dst, 0L, SEEK_SET) < 0)
+	    msg_fatal("%s: vstream_fseek %s: %m", myname, cleanup_path);
+    }
     cleanup_out_format(state, REC_TYPE_SIZE, REC_TYPE_SIZE_FORMAT,
 	    (REC_TYPE_SIZE_CAST1) (state->xtra_offset - state->data_offset),
 		       (REC_TYPE_SIZE_CAST2) state->data_offset,
@@ -75,4 +91,9 @@ void    cleanup_final(CLEANUP_STATE *state)
 		       (REC_TYPE_SIZE_CAST4) state->qmgr_opts,
 		       (REC_TYPE_SIZE_CAST5) state->cont_length,
 		       (REC_TYPE_SIZE_CAST6) state->smtputf8);
+    if (var_qfile_size_trailer && CLEANUP_OUT_OK(state)
+	&& vstream_ftell(state->dst) != trailer_offset + REC_SIZE_TRAILER_LEN) {
+	msg_warn("%s: bad size trailer length", state->queue_id);
+	state->errs |= CLEANUP_STAT_WRITE;
+    }
 }
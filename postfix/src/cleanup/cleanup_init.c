@@ -58,6 +58,11 @@
 /*
 /*	cleanup_sig() must be called in case of SIGTERM, in order
 /*	to remove an incomplete queue file.
+/*
+/*	When a cleanup process receives multiple messages at the same
+/*	time, cleanup_all() and cleanup_sig() also remove the queue
+/*	files of messages that are not being processed at this moment
+/*	(see cleanup_mux(3)).
 /* DIAGNOSTICS
 /*	Problems and transactions are logged to \fBsyslogd\fR(8)
 /*	or \fBpostlogd\fR(8).
@@ -175,6 +180,10 @@ int     var_always_add_hdrs;		/* always add missing headers */
 int     var_virt_addrlen_limit;		/* stop exponential growth */
 char   *var_hfrom_format;		/* header_from_format */
 int     var_force_mime_iconv;		/* force mime downgrade on input */
+char   *var_cleanup_sync_lock;		/* group commit lock file */
+char   *var_cleanup_dup_style;		/* exact or fingerprint */
+int     var_qfile_size_trailer;		/* size info at end of queue file */
+int     var_cleanup_client_limit;	/* concurrent submissions */
 
 const CONFIG_INT_TABLE cleanup_int_table[] = {
     VAR_HOPCOUNT_LIMIT, DEF_HOPCOUNT_LIMIT, &var_hopcount_limit, 1, 0,
@@ -184,6 +193,7 @@ const CONFIG_INT_TABLE cleanup_int_table[] = {
     VAR_VIRT_EXPAN_LIMIT, DEF_VIRT_EXPAN_LIMIT, &var_virt_expan_limit, 1, 0,
     VAR_VIRT_ADDRLEN_LIMIT, DEF_VIRT_ADDRLEN_LIMIT, &var_virt_addrlen_limit, 1, 0,
     VAR_BODY_CHECK_LEN, DEF_BODY_CHECK_LEN, &var_body_check_len, 0, 0,
+    VAR_CLEANUP_CLIENT_LIMIT, DEF_CLEANUP_CLIENT_LIMIT, &var_cleanup_client_limit, 1, 0,
     0,
 };
 
@@ -192,6 +202,7 @@ const CONFIG_BOOL_TABLE cleanup_bool_table[] = {
     VAR_AUTO_8BIT_ENC_HDR, DEF_AUTO_8BIT_ENC_HDR, &var_auto_8bit_enc_hdr,
     VAR_ALWAYS_ADD_HDRS, DEF_ALWAYS_ADD_HDRS, &var_always_add_hdrs,
     VAR_FORCE_MIME_ICONV, DEF_FORCE_MIME_ICONV, &var_force_mime_iconv,
+    VAR_QFILE_SIZE_TRAILER, DEF_QFILE_SIZE_TRAILER, &var_qfile_size_trailer,
     0,
 };
 
@@ -243,6 +254,8 @@ const CONFIG_STR_TABLE cleanup_str_table[] = {
     VAR_MILT_HEAD_CHECKS, DEF_MILT_HEAD_CHECKS, &var_milt_head_checks, 0, 0,
     VAR_MILT_MACRO_DEFLTS, DEF_MILT_MACRO_DEFLTS, &var_milt_macro_deflts, 0, 0,
     VAR_HFROM_FORMAT, DEF_HFROM_FORMAT, &var_hfrom_format, 1, 0,
+    VAR_CLEANUP_SYNC_LOCK, DEF_CLEANUP_SYNC_LOCK, &var_cleanup_sync_lock, 0, 0,
+    VAR_CLEANUP_DUP_STYLE, DEF_CLEANUP_DUP_STYLE, &var_cleanup_dup_style, 1, 0,
     0,
 };
 
@@ -287,6 +300,11 @@ MILTERS *cleanup_milters;
   */
 int     cleanup_hfrom_format;
 
+ /*
+  * Recipient duplicate filter.
+  */
+int     cleanup_dup_filter_flags;
+
 /* cleanup_all - callback for the runtime error handler */
 
 void    cleanup_all(void)
@@ -315,6 +333,7 @@ void    cleanup_sig(int sig)
 	    (void) REMOVE(cleanup_path);
 	    cleanup_path = 0;
 	}
+	cleanup_mux_all();
 	if (sig)
 	    _exit(sig);
     }
@@ -439,6 +458,11 @@ void    cleanup_pre_jail(char *unused_name, char **unused_argv)
 
 void    cleanup_post_jail(char *unused_name, char **unused_argv)
 {
+    static const NAME_CODE dup_filter_styles[] = {
+	DUP_FILTER_STYLE_EXACT, BH_FLAG_NONE,
+	DUP_FILTER_STYLE_FPRINT, BH_FLAG_DIGEST,
+	0, -1,
+    };
 
     /*
      * Optionally set the file size resource limit. XXX This limits the
@@ -473,4 +497,25 @@ void    cleanup_post_jail(char *unused_name, char **unused_argv)
      * From: header formatting.
      */
     cleanup_hfrom_format = hfrom_format_parse(VAR_HFROM_FORMAT, var_hfrom_format);
+
+    /*
+     * Recipient duplicate filter implementation.
+     */
+    if ((cleanup_dup_filter_flags = name_code(dup_filter_styles,
+					      NAME_CODE_FLAG_NONE,
+					      var_cleanup_dup_style)) < 0)
+	msg_fatal("unsupported %s value: \"%s\"",
+		  VAR_CLEANUP_DUP_STYLE, var_cleanup_dup_style);
+
+    /*
+     * Optionally share file system syncs with other cleanup processes.
+     */
+    if (*var_cleanup_sync_lock)
+	mail_stream_sync_lock(var_cleanup_sync_lock);
+
+    /*
+     * Optionally replace the file system sync with a copy on a peer node.
+     */
+    if (*var_queue_repl_peer)
+	mail_stream_replicate(1);
 }
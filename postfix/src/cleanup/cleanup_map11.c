@@ -83,6 +83,7 @@
 #include <cleanup_user.h>
 #include <mail_addr_map.h>
 #include <quote_822_local.h>
+#include <mail_params.h>
 
 /* Application-specific. */
 
@@ -101,6 +102,7 @@ int     cleanup_map11_external(CLEANUP_STATE *state, VSTRING *addr,
     ARGV   *new_addr;
     char   *saved_addr;
     int     did_rewrite = 0;
+    struct timeval start;
 
     /*
      * Produce sensible output even in the face of a recoverable error. This
@@ -109,9 +111,12 @@ int     cleanup_map11_external(CLEANUP_STATE *state, VSTRING *addr,
      * the place.
      */
     for (count = 0; count < MAX_RECURSION; count++) {
-	if ((new_addr = mail_addr_map_opt(maps, STR(addr), propagate,
-					  MA_FORM_EXTERNAL, MA_FORM_EXTERNAL,
-					  MA_FORM_EXTERNAL)) != 0) {
+	CLEANUP_STAGE_START(&start);
+	new_addr = mail_addr_map_opt(maps, STR(addr), propagate,
+				     MA_FORM_EXTERNAL, MA_FORM_EXTERNAL,
+				     MA_FORM_EXTERNAL);
+	CLEANUP_STAGE_STOP(CLEANUP_STAGE_MAPS, &start);
+	if (new_addr != 0) {
 	    if (new_addr->argc > 1)
 		msg_warn("%s: multi-valued %s entry for %s",
 			 state->queue_id, maps->title, STR(addr));
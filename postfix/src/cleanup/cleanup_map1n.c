@@ -6,11 +6,15 @@
 /* SYNOPSIS
 /*	#include <cleanup.h>
 /*
-/*	ARGV	*cleanup_map1n_internal(state, addr, maps, propagate)
+/*	ssize_t	cleanup_map1n_internal(state, addr, maps, propagate,
+/*					action, context)
 /*	CLEANUP_STATE *state;
 /*	const char *addr;
 /*	MAPS	*maps;
 /*	int	propagate;
+/*	void	(*action)(CLEANUP_STATE *state, const char *addr,
+/*				void *context);
+/*	void	*context;
 /* DESCRIPTION
 /*	This module implements one-to-many table mapping via table lookup.
 /*	Table lookups are done with quoted (externalized) address forms.
@@ -18,15 +22,23 @@
 /*	left-hand side appears in its own expansion.
 /*
 /*	cleanup_map1n_internal() is the interface for addresses in
-/*	internal (unquoted) form.
+/*	internal (unquoted) form. It calls \fIaction\fR for each
+/*	address in the expansion, in expansion order, as soon as
+/*	that address cannot be expanded further, and then discards
+/*	its copy of that address. Thus, a large alias
+/*	expansion is not kept in memory in its entirety. The result
+/*	value is the number of \fIaction\fR calls.
 /* DIAGNOSTICS
 /*	When the maximal expansion or recursion limit is reached,
-/*	the alias is not expanded and the CLEANUP_STAT_DEFER error
-/*	is raised with reason "4.6.0 Alias expansion error".
+/*	the expansion stops and the CLEANUP_STAT_DEFER error is
+/*	raised with reason "4.6.0 Alias expansion error".
 /*
-/*	When table lookup fails, the alias is not expanded and the
+/*	When table lookup fails, the expansion stops and the
 /*	CLEANUP_STAT_WRITE error is raised with reason "4.6.0 Alias
 /*	expansion error".
+/*
+/*	In both cases, \fIaction\fR is called with the unexpanded
+/*	address if it was not called before.
 /* SEE ALSO
 /*	mail_addr_map(3) address mappings
 /*	mail_addr_find(3) address lookups
@@ -74,16 +86,19 @@
 
 /* cleanup_map1n_internal - one-to-many table lookups */
 
-ARGV   *cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
-			               MAPS *maps, int propagate)
+ssize_t cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
+			               MAPS *maps, int propagate,
+			               CLEANUP_MAP1N_FN action, void *context)
 {
     ARGV   *argv;
     ARGV   *lookup;
     int     count;
     int     i;
-    int     arg;
+    ssize_t arg;
+    ssize_t done = 0;
     BH_TABLE *been_here;
     char   *saved_lhs;
+    struct timeval start;
 
     /*
      * Initialize.
@@ -99,27 +114,34 @@ ARGV   *cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
      * address, and repeat the process. Beware: argv is being changed, so we
      * must index the array explicitly, instead of running along it with a
      * pointer.
+     * 
+     * Addresses before argv->argv[arg] are final. They have been passed to
+     * the action routine, and are periodically removed from the vector. The
+     * expansion size is the number of those addresses plus the size of the
+     * vector after argv->argv[arg].
      */
 #define UPDATE(ptr,new)	do { \
 	if (ptr) { myfree(ptr); } ptr = mystrdup(new); \
     } while (0)
 #define STR	vstring_str
 #define RETURN(x) do { \
-	been_here_free(been_here); return (x); \
+	been_here_free(been_here); argv_free(argv); return (x); \
     } while (0)
-#define UNEXPAND(argv, addr) do { \
-	argv_truncate((argv), 0); argv_add((argv), (addr), (char *) 0); \
+#define UNEXPAND(addr) do { \
+	if (done == 0) { action(state, (addr), context); done = 1; } \
     } while (0)
+#define EXPANSION_SIZE(argv, arg) (done + (argv)->argc - (arg))
+#define MIN_RECLAIM	100
 
     for (arg = 0; arg < argv->argc; arg++) {
-	if (argv->argc > var_virt_expan_limit) {
+	if (EXPANSION_SIZE(argv, arg) > var_virt_expan_limit) {
 	    msg_warn("%s: unreasonable %s map expansion size for %s -- "
 		     "message not accepted, try again later",
 		     state->queue_id, maps->title, addr);
 	    state->errs |= CLEANUP_STAT_DEFER;
 	    UPDATE(state->reason, "4.6.0 Alias expansion error");
-	    UNEXPAND(argv, addr);
-	    RETURN(argv);
+	    UNEXPAND(addr);
+	    RETURN(done);
 	}
 	for (count = 0; /* void */ ; count++) {
 
@@ -134,11 +156,13 @@ ARGV   *cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
 			 state->queue_id, maps->title, addr);
 		state->errs |= CLEANUP_STAT_DEFER;
 		UPDATE(state->reason, "4.6.0 Alias expansion error");
-		UNEXPAND(argv, addr);
-		RETURN(argv);
+		UNEXPAND(addr);
+		RETURN(done);
 	    }
-	    if ((lookup = mail_addr_map_internal(maps, argv->argv[arg],
-						 propagate)) != 0) {
+	    CLEANUP_STAGE_START(&start);
+	    lookup = mail_addr_map_internal(maps, argv->argv[arg], propagate);
+	    CLEANUP_STAGE_STOP(CLEANUP_STAGE_MAPS, &start);
+	    if (lookup != 0) {
 		saved_lhs = mystrdup(argv->argv[arg]);
 		for (i = 0; i < lookup->argc; i++) {
 		    if (strlen(lookup->argv[i]) > var_virt_addrlen_limit) {
@@ -147,8 +171,10 @@ ARGV   *cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
 			     state->queue_id, maps->title, lookup->argv[i]);
 			state->errs |= CLEANUP_STAT_DEFER;
 			UPDATE(state->reason, "4.6.0 Alias expansion error");
-			UNEXPAND(argv, addr);
-			RETURN(argv);
+			UNEXPAND(addr);
+			myfree(saved_lhs);
+			argv_free(lookup);
+			RETURN(done);
 		    }
 		    if (i == 0) {
 			UPDATE(argv->argv[arg], lookup->argv[i]);
@@ -171,12 +197,23 @@ ARGV   *cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
 			 state->queue_id, maps->title, addr);
 		state->errs |= CLEANUP_STAT_WRITE;
 		UPDATE(state->reason, "4.6.0 Alias expansion error");
-		UNEXPAND(argv, addr);
-		RETURN(argv);
+		UNEXPAND(addr);
+		RETURN(done);
 	    } else {
 		break;
 	    }
 	}
+
+	/*
+	 * This address is final. Pass it on, and reclaim memory once at
+	 * least half the vector is final, so that the cost is linear.
+	 */
+	action(state, argv->argv[arg], context);
+	done += 1;
+	if (arg + 1 >= MIN_RECLAIM && 2 * (arg + 1) >= argv->argc) {
+	    argv_delete(argv, 0, arg + 1);
+	    arg = -1;
+	}
     }
-    RETURN(argv);
+    RETURN(done);
 }
@@ -90,6 +90,7 @@
 #include <conv_time.h>
 #include <info_log_addr_form.h>
 #include <hfrom_format.h>
+#include <mail_priority.h>
 
 /* Application-specific. */
 
@@ -373,6 +374,20 @@ static const char *cleanup_act(CLEANUP_STATE *state, char *context,
 	}
 	return (buf);
     }
+    if (STREQUAL(value, "PRIORITY", command_len)) {
+	int     code;
+
+	if ((code = mail_priority_code(optional_text)) == MAIL_PRIORITY_UNKNOWN) {
+	    msg_warn("bad PRIORITY class \"%s\" in %s map -- "
+		     "need high, normal or low",
+		     optional_text, map_class);
+	} else {
+	    nvtable_update(state->attr, MAIL_ATTR_PRIORITY,
+			   str_mail_priority(code));
+	    cleanup_act_log(state, "priority", context, buf, optional_text);
+	}
+	return (buf);
+    }
 
     /*
      * The DELAY feature is disabled because it has too many problems. 1) It
@@ -536,8 +551,12 @@ static void cleanup_header_callback(void *context, int header_class,
     || CHECK(MIME_HDR_NESTED, cleanup_nesthdr_checks, VAR_NESTHDR_CHECKS))) {
 	char   *header = vstring_str(header_buf);
 	const char *value;
+	struct timeval start;
 
-	if ((value = maps_find(checks, header, 0)) != 0) {
+	CLEANUP_STAGE_START(&start);
+	value = maps_find(checks, header, 0);
+	CLEANUP_STAGE_STOP(CLEANUP_STAGE_MAPS, &start);
+	if (value != 0) {
 	    const char *result;
 
 	    if ((result = cleanup_act(state, CLEANUP_ACT_CTXT_HEADER,
@@ -891,8 +910,12 @@ static void cleanup_body_callback(void *context, int type,
 	&& cleanup_body_checks
 	&& (var_body_check_len == 0 || offset < var_body_check_len)) {
 	const char *value;
+	struct timeval start;
 
-	if ((value = maps_find(cleanup_body_checks, buf, 0)) != 0) {
+	CLEANUP_STAGE_START(&start);
+	value = maps_find(cleanup_body_checks, buf, 0);
+	CLEANUP_STAGE_STOP(CLEANUP_STAGE_MAPS, &start);
+	if (value != 0) {
 	    const char *result;
 
 	    if ((result = cleanup_act(state, CLEANUP_ACT_CTXT_BODY,
@@ -979,6 +1002,7 @@ static void cleanup_message_headerbody(CLEANUP_STATE *state, int type,
      * current file position so we can compute the message size lateron.
      */
     else if (type == REC_TYPE_XTRA) {
+	cleanup_stages_mark(CLEANUP_STAGE_CONTENT);
 	state->mime_errs = mime_state_update(state->mime_state, type, buf, len);
 	if (state->milters || cleanup_milters)
 	    /* Make room for body modification. */
@@ -1073,6 +1097,19 @@ void    cleanup_message(CLEANUP_STATE *state, int type, const char *buf, ssize_t
 	}
 	if (var_force_mime_iconv)
 	    mime_options |= MIME_OPT_DOWNGRADE;
+
+	/*
+	 * Skip MIME structure processing when nothing would use it: no
+	 * content checks or MIME error reports, no 8-bit downgrade, and no
+	 * Content-Transfer-Encoding: inspection in attachments. The output
+	 * is the same, except that long attachment headers are no longer
+	 * truncated at $header_size_limit.
+	 */
+	if (mime_options == 0 && !var_auto_8bit_enc_hdr
+	    && ((state->flags & CLEANUP_FLAG_FILTER) == 0
+		|| (*var_header_checks == 0 && *var_mimehdr_checks == 0
+		    && *var_nesthdr_checks == 0 && *var_body_checks == 0)))
+	    mime_options |= MIME_OPT_DISABLE_MIME;
     }
     state->mime_state = mime_state_alloc(mime_options,
 					 cleanup_header_callback,
@@ -2361,6 +2361,7 @@ MAPS   *cleanup_send_bcc_maps;
 int     cleanup_send_canon_flags;
 MAPS   *cleanup_send_canon_maps;
 int     var_dup_filter_limit = DEF_DUP_FILTER_LIMIT;
+int     cleanup_dup_filter_flags;
 char   *var_empty_addr = DEF_EMPTY_ADDR;
 MAPS   *cleanup_virt_alias_maps;
 char   *var_milt_daemon_name = "host.example.com";
@@ -2388,8 +2389,9 @@ int     cleanup_map11_internal(CLEANUP_STATE *state, VSTRING *addr,
     msg_panic("cleanup_map11_internal dummy");
 }
 
-ARGV   *cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
-			               MAPS *maps, int propagate)
+ssize_t cleanup_map1n_internal(CLEANUP_STATE *state, const char *addr,
+			               MAPS *maps, int propagate,
+			               CLEANUP_MAP1N_FN action, void *context)
 {
     msg_panic("cleanup_map1n_internal dummy");
 }
@@ -0,0 +1,506 @@
+/*++
+/* NAME
+/*	cleanup_mux 3
+/* SUMMARY
+/*	receive multiple messages at the same time
+/* SYNOPSIS
+/*	#include "cleanup.h"
+/*
+/*	void	cleanup_mux_service(src)
+/*	VSTREAM	*src;
+/*
+/*	void	cleanup_mux_all()
+/* DESCRIPTION
+/*	This module allows one cleanup process to receive messages
+/*	from multiple clients at the same time, so that a slow SMTP
+/*	client or a slow local submission does not tie up an entire
+/*	cleanup process. The process reads a record from a client
+/*	only when the complete record has arrived, processes that
+/*	record, and then moves on to the next client that has input.
+/*	Input that does not yet complete a record is moved from the
+/*	kernel into a per-client buffer, so that the process does
+/*	not receive the same input event over and over.
+/*
+/*	The cleanup code keeps the queue file pathname and stage
+/*	timing information for the current message in process-global
+/*	storage. This module saves that information when it stops
+/*	working on a message, and restores it before it resumes
+/*	work on that message.
+/*
+/*	Messages that are subject to non_smtpd_milters are received
+/*	to completion without interruption, because the Milter
+/*	connections are shared by all messages in a process. Records
+/*	that are larger than a typical socket buffer, the client
+/*	processing options and Milter information from smtpd(8)
+/*	are read with a time-limited blocking read.
+/*
+/*	cleanup_mux_service() opens a queue file for a new client,
+/*	sends the queue ID to the client, and arranges for the
+/*	message to be received as input arrives. The client stream
+/*	is closed with event_server_disconnect() after the status
+/*	is reported to the client.
+/*
+/*	cleanup_mux_all() removes the queue files of messages that
+/*	are not being processed at this moment. This function is
+/*	called by the cleanup_all() error handler and by the
+/*	cleanup_sig() signal handler.
+/* DIAGNOSTICS
+/*	Problems and transactions are logged to \fBsyslogd\fR(8)
+/*	or \fBpostlogd\fR(8).
+/* SEE ALSO
+/*	cleanup_api(3) cleanup callable interface, message processing
+/*	cleanup_init(3) cleanup callable interface, initializations
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <events.h>
+#include <iostuff.h>
+
+/* Global library. */
+
+#include <cleanup_user.h>
+#include <mail_proto.h>
+#include <mail_params.h>
+#include <record.h>
+#include <rec_type.h>
+
+/* Single-threaded server skeleton. */
+
+#include <mail_server.h>
+
+/* Application-specific. */
+
+#include "cleanup.h"
+
+ /*
+  * Per-client state. The queue file pathnames and the stage timing state
+  * are saved here while the process works on other messages.
+  */
+typedef struct CLEANUP_MUX {
+    VSTREAM *src;			/* client stream */
+    CLEANUP_STATE *state;		/* message state */
+    VSTRING *buf;			/* record buffer */
+    VSTRING *inbuf;			/* partial record input */
+    ssize_t in_off;			/* inbuf read offset */
+    int     phase;			/* see below */
+    char   *path;			/* saved cleanup_path */
+    VSTRING *trace_path;		/* saved cleanup_trace_path */
+    CLEANUP_STAGES stages;		/* saved stage timing */
+    struct CLEANUP_MUX *prev;		/* linkage */
+    struct CLEANUP_MUX *next;		/* linkage */
+} CLEANUP_MUX;
+
+#define CLEANUP_MUX_PHASE_FLAGS	0	/* expecting client options */
+#define CLEANUP_MUX_PHASE_COPY	1	/* copying records */
+#define CLEANUP_MUX_PHASE_SKIP	2	/* skipping records after error */
+
+static CLEANUP_MUX *cleanup_mux_list;	/* all clients */
+static CLEANUP_MUX *cleanup_mux_current;	/* message being processed */
+
+ /*
+  * A record header has one type byte and up to five length bytes. A record
+  * that does not fit in a typical socket buffer is read with a time-limited
+  * blocking read, instead of waiting until it has arrived completely.
+  */
+#define CLEANUP_MUX_HDR_LEN	6
+#define CLEANUP_MUX_PEEK_LIMIT	4096
+
+ /*
+  * cleanup_mux_copy() modes.
+  */
+#define CLEANUP_MUX_COPY_BLOCK	0	/* read until done */
+#define CLEANUP_MUX_COPY_EVENT	1	/* read after input event */
+#define CLEANUP_MUX_COPY_POLL	2	/* read complete records only */
+
+ /*
+  * cleanup_mux_ready() results.
+  */
+#define CLEANUP_MUX_EMPTY	(-1)	/* no complete record, no more input */
+#define CLEANUP_MUX_WAIT	0	/* no complete record, more input */
+#define CLEANUP_MUX_READY	1	/* complete record */
+
+static void cleanup_mux_event(int, void *);
+
+/* cleanup_mux_enter - make this message the current message */
+
+static void cleanup_mux_enter(CLEANUP_MUX *mux)
+{
+    if (cleanup_mux_current != 0 || cleanup_path != 0)
+	msg_panic("cleanup_mux_enter: another message is being processed");
+
+    /*
+     * Update the global variables before the saved copies, so that the
+     * signal handler always finds the queue file pathnames.
+     */
+    cleanup_path = mux->path;
+    mux->path = 0;
+    cleanup_trace_path = mux->trace_path;
+    mux->trace_path = 0;
+    cleanup_stages_restore(&mux->stages);
+    cleanup_mux_current = mux;
+}
+
+/* cleanup_mux_leave - save the state of the current message */
+
+static void cleanup_mux_leave(CLEANUP_MUX *mux)
+{
+    if (cleanup_mux_current != mux)
+	msg_panic("cleanup_mux_leave: message is not being processed");
+    mux->path = cleanup_path;
+    cleanup_path = 0;
+    mux->trace_path = cleanup_trace_path;
+    cleanup_trace_path = 0;
+    cleanup_stages_save(&mux->stages);
+    cleanup_mux_current = 0;
+}
+
+/* cleanup_mux_find - find client by file descriptor */
+
+static CLEANUP_MUX *cleanup_mux_find(int fd)
+{
+    CLEANUP_MUX *mux;
+
+    for (mux = cleanup_mux_list; mux != 0; mux = mux->next)
+	if (vstream_fileno(mux->src) == fd)
+	    return (mux);
+    return (0);
+}
+
+/* cleanup_mux_read - read from partial record input, then from client */
+
+static ssize_t cleanup_mux_read(int fd, void *buf, size_t len, int timeout,
+				        void *context)
+{
+    CLEANUP_MUX *mux;
+    ssize_t avail;
+
+    /*
+     * The stream context belongs to the server skeleton, so we find our own
+     * state by file descriptor.
+     */
+    if ((mux = cleanup_mux_find(fd)) != 0
+	&& (avail = VSTRING_LEN(mux->inbuf) - mux->in_off) > 0) {
+	if (avail > (ssize_t) len)
+	    avail = len;
+	memcpy(buf, vstring_str(mux->inbuf) + mux->in_off, avail);
+	if ((mux->in_off += avail) == VSTRING_LEN(mux->inbuf)) {
+	    VSTRING_RESET(mux->inbuf);
+	    mux->in_off = 0;
+	}
+	return (avail);
+    }
+    return (timed_read(fd, buf, len, timeout, context));
+}
+
+/* cleanup_mux_ready - see if a complete record is pending */
+
+static int cleanup_mux_ready(CLEANUP_MUX *mux)
+{
+    VSTREAM *src = mux->src;
+    unsigned char hdr[CLEANUP_MUX_HDR_LEN];
+    int     fd = vstream_fileno(src);
+    ssize_t buffered;
+    ssize_t saved;
+    ssize_t pending;
+    ssize_t have;
+    ssize_t want;
+    ssize_t got;
+    ssize_t len;
+    unsigned shift;
+    int     n;
+
+    /*
+     * Let the record reader report errors.
+     */
+    buffered = vstream_peek(src);
+    saved = VSTRING_LEN(mux->inbuf) - mux->in_off;
+    if ((pending = peekfd(fd)) < 0)
+	return (CLEANUP_MUX_READY);
+
+    /*
+     * The record header may be split between the stream buffer, our own
+     * buffer, and the kernel, so we look at all three, in that order.
+     */
+    have = buffered < CLEANUP_MUX_HDR_LEN ? buffered : CLEANUP_MUX_HDR_LEN;
+    if (have > 0)
+	memcpy(hdr, vstream_peek_data(src), have);
+    if (have < CLEANUP_MUX_HDR_LEN && saved > 0) {
+	want = CLEANUP_MUX_HDR_LEN - have;
+	if (want > saved)
+	    want = saved;
+	memcpy(hdr + have, vstring_str(mux->inbuf) + mux->in_off, want);
+	have += want;
+    }
+    if (have < CLEANUP_MUX_HDR_LEN && pending > 0) {
+	want = CLEANUP_MUX_HDR_LEN - have;
+	if (want > pending)
+	    want = pending;
+	if ((got = recv(fd, (void *) (hdr + have), want, MSG_PEEK)) < 0)
+	    return (CLEANUP_MUX_READY);
+	have += got;
+    }
+
+    /*
+     * Same length decoding as rec_get_raw().
+     */
+    for (len = 0, shift = 0, n = 1; n < have; n++, shift += 7) {
+	len |= (hdr[n] & 0177) << shift;
+	if ((hdr[n] & 0200) == 0)
+	    break;
+    }
+    if (n >= have) {
+	if (have >= CLEANUP_MUX_HDR_LEN)
+	    return (CLEANUP_MUX_READY);
+    } else if (len < 0 || n + 1 + len > CLEANUP_MUX_PEEK_LIMIT
+	       || buffered + saved + pending >= n + 1 + len) {
+	return (CLEANUP_MUX_READY);
+    }
+    if (pending == 0)
+	return (CLEANUP_MUX_EMPTY);
+
+    /*
+     * The record is incomplete. Move the pending input out of the kernel,
+     * so that the read event stays quiet until more input arrives. This
+     * read does not block because the input has already arrived.
+     */
+    VSTRING_SPACE(mux->inbuf, pending);
+    if ((got = read(fd, vstring_end(mux->inbuf), pending)) <= 0)
+	return (CLEANUP_MUX_READY);
+    vstring_set_payload_size(mux->inbuf, VSTRING_LEN(mux->inbuf) + got);
+    return (CLEANUP_MUX_WAIT);
+}
+
+/* cleanup_mux_copy - process pending records, return non-zero when done */
+
+static int cleanup_mux_copy(CLEANUP_MUX *mux, int mode)
+{
+    CLEANUP_STATE *state = mux->state;
+    int     status;
+    int     type;
+    int     count;
+
+    for (count = 0; /* see below */ ; count++) {
+
+	/*
+	 * Don't block. Right after an input event, a stream without pending
+	 * input means that the client has disconnected, and the record
+	 * reader will report the premature end of input.
+	 */
+	if (mode != CLEANUP_MUX_COPY_BLOCK
+	    && (status = cleanup_mux_ready(mux)) != CLEANUP_MUX_READY
+	    && (status != CLEANUP_MUX_EMPTY || count > 0
+		|| mode != CLEANUP_MUX_COPY_EVENT))
+	    return (0);
+
+	/*
+	 * See cleanup_service() for the rationale.
+	 */
+	type = rec_get_raw(mux->src, mux->buf, 0, REC_FLAG_NONE);
+	if (mux->phase == CLEANUP_MUX_PHASE_COPY) {
+	    if (type < 0) {
+		state->errs |= CLEANUP_STAT_BAD;
+		return (1);
+	    }
+	    if (REC_GET_HIDDEN_TYPE(type)) {
+		msg_warn("%s: record type %d not allowed - discarding this message",
+			 state->queue_id, type);
+		state->errs |= CLEANUP_STAT_BAD;
+	    } else {
+		CLEANUP_RECORD(state, type, vstring_str(mux->buf),
+			       VSTRING_LEN(mux->buf));
+		if (type == REC_TYPE_END)
+		    return (1);
+	    }
+	    if (CLEANUP_OUT_OK(state) == 0)
+		mux->phase = CLEANUP_MUX_PHASE_SKIP;
+	    else if (REC_GET_HIDDEN_TYPE(type))
+		return (1);
+	} else {
+	    if (type <= 0 || type == REC_TYPE_END)
+		return (1);
+	    if (type == REC_TYPE_MILT_COUNT) {
+		int     milter_count = atoi(vstring_str(mux->buf));
+
+		/* Avoid deadlock. */
+		if (milter_count >= 0)
+		    cleanup_milter_receive(state, milter_count);
+	    }
+	}
+    }
+}
+
+/* cleanup_mux_finish - report status and disconnect */
+
+static void cleanup_mux_finish(CLEANUP_MUX *mux)
+{
+    CLEANUP_STATE *state = mux->state;
+    VSTREAM *src = mux->src;
+    int     status;
+
+    /*
+     * Log something to make timeout errors easier to debug.
+     */
+    if (vstream_ftimeout(src))
+	msg_warn("%s: read timeout on %s",
+		 state->queue_id, VSTREAM_PATH(src));
+
+    /*
+     * Finish this message, and report the result status to the client.
+     */
+    status = cleanup_flush(state);		/* in case state is modified */
+    attr_print(src, ATTR_FLAG_NONE,
+	       SEND_ATTR_INT(MAIL_ATTR_STATUS, status),
+	       SEND_ATTR_STR(MAIL_ATTR_WHY,
+			     (state->flags & CLEANUP_FLAG_SMTP_REPLY)
+			     && state->smtp_reply ? state->smtp_reply :
+			     state->reason ? state->reason : ""),
+	       ATTR_TYPE_END);
+    cleanup_free(state);
+    cleanup_mux_leave(mux);
+
+    /*
+     * Cleanup.
+     */
+    event_disable_readwrite(vstream_fileno(src));
+    event_cancel_timer(cleanup_mux_event, (void *) mux);
+    if (mux->prev)
+	mux->prev->next = mux->next;
+    else
+	cleanup_mux_list = mux->next;
+    if (mux->next)
+	mux->next->prev = mux->prev;
+    vstring_free(mux->buf);
+    vstring_free(mux->inbuf);
+    myfree((void *) mux);
+    event_server_disconnect(src);
+}
+
+/* cleanup_mux_event - process client input or timeout */
+
+static void cleanup_mux_event(int event, void *context)
+{
+    CLEANUP_MUX *mux = (CLEANUP_MUX *) context;
+    CLEANUP_STATE *state = mux->state;
+    int     flags;
+    int     done;
+
+    cleanup_mux_enter(mux);
+
+    if (event == EVENT_TIME) {
+	msg_warn("%s: read timeout on %s",
+		 state->queue_id, VSTREAM_PATH(mux->src));
+	state->errs |= CLEANUP_STAT_BAD;
+	done = 1;
+    } else if (mux->phase == CLEANUP_MUX_PHASE_FLAGS) {
+
+	/*
+	 * Read client processing options. If we can't read the client
+	 * processing options we can pretty much forget about the whole
+	 * operation.
+	 */
+	if (attr_scan(mux->src, ATTR_FLAG_STRICT,
+		      RECV_ATTR_INT(MAIL_ATTR_FLAGS, &flags),
+		      ATTR_TYPE_END) != 1) {
+	    state->errs |= CLEANUP_STAT_BAD;
+	    flags = 0;
+	}
+	cleanup_control(state, flags);
+	mux->phase = CLEANUP_MUX_PHASE_COPY;
+	if (CLEANUP_OUT_OK(state) == 0)
+	    done = 1;
+	else if (cleanup_milters != 0 && (state->flags & CLEANUP_FLAG_MILTER))
+	    done = cleanup_mux_copy(mux, CLEANUP_MUX_COPY_BLOCK);
+	else
+	    done = cleanup_mux_copy(mux, CLEANUP_MUX_COPY_POLL);
+    } else {
+	done = cleanup_mux_copy(mux, CLEANUP_MUX_COPY_EVENT);
+    }
+
+    if (done) {
+	cleanup_mux_finish(mux);
+    } else {
+	cleanup_mux_leave(mux);
+	event_request_timer(cleanup_mux_event, (void *) mux, var_ipc_timeout);
+    }
+}
+
+/* cleanup_mux_service - start receiving a message */
+
+void    cleanup_mux_service(VSTREAM *src)
+{
+    CLEANUP_MUX *mux;
+
+    mux = (CLEANUP_MUX *) mymalloc(sizeof(*mux));
+    mux->src = src;
+    mux->buf = vstring_alloc(100);
+    mux->inbuf = vstring_alloc(CLEANUP_MUX_PEEK_LIMIT);
+    mux->in_off = 0;
+    mux->phase = CLEANUP_MUX_PHASE_FLAGS;
+    mux->path = 0;
+    mux->trace_path = 0;
+    cleanup_stages_save(&mux->stages);
+    mux->prev = 0;
+    if ((mux->next = cleanup_mux_list) != 0)
+	mux->next->prev = mux;
+    cleanup_mux_list = mux;
+    vstream_control(src,
+		    CA_VSTREAM_CTL_READ_FN(cleanup_mux_read),
+		    CA_VSTREAM_CTL_END);
+
+    /*
+     * Open a queue file and initialize state. Send the queue id to the
+     * client now; the client processing options follow later.
+     */
+    cleanup_mux_enter(mux);
+    mux->state = cleanup_open(src);
+    attr_print(src, ATTR_FLAG_NONE,
+	       SEND_ATTR_STR(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_CLEANUP),
+	       SEND_ATTR_STR(MAIL_ATTR_QUEUEID, mux->state->queue_id),
+	       ATTR_TYPE_END);
+    if (vstream_fflush(src) != 0)
+	msg_warn("%s: write queue ID to %s: %m",
+		 mux->state->queue_id, VSTREAM_PATH(src));
+    cleanup_mux_leave(mux);
+
+    event_enable_read(vstream_fileno(src), cleanup_mux_event, (void *) mux);
+    event_request_timer(cleanup_mux_event, (void *) mux, var_ipc_timeout);
+}
+
+/* cleanup_mux_all - remove queue files of inactive messages */
+
+void    cleanup_mux_all(void)
+{
+    CLEANUP_MUX *mux;
+
+    /*
+     * XXX While running as a signal handler, can't ask the memory manager to
+     * release VSTRING storage.
+     */
+    for (mux = cleanup_mux_list; mux != 0; mux = mux->next) {
+	if (mux->trace_path) {
+	    (void) REMOVE(vstring_str(mux->trace_path));
+	    mux->trace_path = 0;
+	}
+	if (mux->path) {
+	    (void) REMOVE(mux->path);
+	    mux->path = 0;
+	}
+    }
+}
@@ -67,8 +67,8 @@
 
 /* Utility library. */
 
-#include <argv.h>
 #include <msg.h>
+#include <mymalloc.h>
 
 /* Global library. */
 
@@ -124,6 +124,96 @@ static void cleanup_verify_append(CLEANUP_STATE *state, RECIPIENT *rcpt,
     }
 }
 
+/* cleanup_out_rcpt - append one recipient unless it is a duplicate */
+
+static void cleanup_out_rcpt(CLEANUP_STATE *state, const char *dsn_orcpt,
+			             int dsn_notify, const char *orcpt,
+			             const char *recip)
+{
+    /* Matches been_here_drop{,_fixed}() calls cleanup_del_rcpt(). */
+    if ((var_enable_orcpt ?
+	 been_here(state->dups, "%s\n%d\n%s\n%s",
+		   dsn_orcpt, dsn_notify, orcpt, recip) :
+	 been_here_fixed(state->dups, recip)) == 0) {
+	if (dsn_notify)
+	    cleanup_out_format(state, REC_TYPE_ATTR, "%s=%d",
+			       MAIL_ATTR_DSN_NOTIFY, dsn_notify);
+	if (*dsn_orcpt)
+	    cleanup_out_format(state, REC_TYPE_ATTR, "%s=%s",
+			       MAIL_ATTR_DSN_ORCPT, dsn_orcpt);
+	cleanup_out_string(state, REC_TYPE_ORCP, orcpt);
+	cleanup_out_string(state, REC_TYPE_RCPT, recip);
+	state->rcpt_count++;
+    }
+}
+
+ /*
+  * Virtual alias expansion in progress. Recipient records are written while
+  * the alias is expanded, but the first address is held back until we know
+  * if the alias expands into more than one address.
+  */
+typedef struct {
+    const char *dsn_orcpt;		/* DSN original recipient */
+    int     dsn_notify;			/* DSN notify flags */
+    const char *orcpt;			/* original recipient */
+    const char *recip;			/* the alias */
+    char   *first;			/* held-back address */
+    ssize_t count;			/* addresses so far */
+    int     discard;			/* don't write records */
+} CLEANUP_EXPANSION;
+
+/* cleanup_out_first - write held-back address */
+
+static void cleanup_out_first(CLEANUP_STATE *state, CLEANUP_EXPANSION *xp)
+{
+    RECIPIENT rcpt;
+    DSN     dsn;
+
+    if (xp->count > 1 && (state->tflags & DEL_REQ_FLAG_MTA_VRFY)) {
+	(void) DSN_SIMPLE(&dsn, "2.0.0", "aliased to multiple recipients");
+	dsn.action = "deliverable";
+	RECIPIENT_ASSIGN(&rcpt, 0, xp->dsn_orcpt, xp->dsn_notify,
+			 xp->orcpt, xp->recip);
+	cleanup_verify_append(state, &rcpt, &dsn, DEL_RCPT_STAT_OK);
+	xp->discard = 1;
+    } else {
+	if ((xp->dsn_notify & DSN_NOTIFY_SUCCESS)
+	    && (xp->count > 1 || strcmp(xp->recip, xp->first) != 0)) {
+	    (void) DSN_SIMPLE(&dsn, "2.0.0", "alias expanded");
+	    dsn.action = "expanded";
+	    RECIPIENT_ASSIGN(&rcpt, 0, xp->dsn_orcpt, xp->dsn_notify,
+			     xp->orcpt, xp->recip);
+	    cleanup_trace_append(state, &rcpt, &dsn);
+	    xp->dsn_notify = (xp->dsn_notify == DSN_NOTIFY_SUCCESS ?
+			      DSN_NOTIFY_NEVER :
+			      xp->dsn_notify & ~DSN_NOTIFY_SUCCESS);
+	}
+	cleanup_out_rcpt(state, xp->dsn_orcpt, xp->dsn_notify,
+			 xp->orcpt, xp->first);
+    }
+    myfree(xp->first);
+    xp->first = 0;
+}
+
+/* cleanup_out_expansion - write one address from alias expansion */
+
+static void cleanup_out_expansion(CLEANUP_STATE *state, const char *addr,
+				          void *context)
+{
+    CLEANUP_EXPANSION *xp = (CLEANUP_EXPANSION *) context;
+
+    xp->count += 1;
+    if (xp->count == 1) {
+	xp->first = mystrdup(addr);
+	return;
+    }
+    if (xp->count == 2)
+	cleanup_out_first(state, xp);
+    if (xp->discard == 0)
+	cleanup_out_rcpt(state, xp->dsn_orcpt, xp->dsn_notify,
+			 xp->orcpt, addr);
+}
+
 /* cleanup_out_recipient - envelope recipient output filter */
 
 void    cleanup_out_recipient(CLEANUP_STATE *state,
@@ -132,8 +222,6 @@ void    cleanup_out_recipient(CLEANUP_STATE *state,
 			              const char *orcpt,
 			              const char *recip)
 {
-    ARGV   *argv;
-    char  **cpp;
 
     /*
      * XXX Not elegant, but eliminates complexity in the record reading loop.
@@ -154,23 +242,8 @@ void    cleanup_out_recipient(CLEANUP_STATE *state,
 #define STREQ(x, y) (strcmp((x), (y)) == 0)
 
     if ((state->flags & CLEANUP_FLAG_MAP_OK) == 0
-	|| cleanup_virt_alias_maps == 0) {
-	/* Matches been_here_drop{,_fixed}() calls cleanup_del_rcpt(). */
-	if ((var_enable_orcpt ?
-	     been_here(state->dups, "%s\n%d\n%s\n%s",
-		       dsn_orcpt, dsn_notify, orcpt, recip) :
-	     been_here_fixed(state->dups, recip)) == 0) {
-	    if (dsn_notify)
-		cleanup_out_format(state, REC_TYPE_ATTR, "%s=%d",
-				   MAIL_ATTR_DSN_NOTIFY, dsn_notify);
-	    if (*dsn_orcpt)
-		cleanup_out_format(state, REC_TYPE_ATTR, "%s=%s",
-				   MAIL_ATTR_DSN_ORCPT, dsn_orcpt);
-	    cleanup_out_string(state, REC_TYPE_ORCP, orcpt);
-	    cleanup_out_string(state, REC_TYPE_RCPT, recip);
-	    state->rcpt_count++;
-	}
-    }
+	|| cleanup_virt_alias_maps == 0)
+	cleanup_out_rcpt(state, dsn_orcpt, dsn_notify, orcpt, recip);
 
     /*
      * XXX DSN. RFC 3461 gives us three options for multi-recipient aliases
@@ -221,46 +294,26 @@ void    cleanup_out_recipient(CLEANUP_STATE *state,
      * Multiple verify(8) updates for one verify(8) request would overwrite
      * each other's status, and if the last status update is "undeliverable",
      * then the whole alias is flagged as undeliverable.
+     * 
+     * Recipient records are written while the alias is being expanded.
+     * cleanup_out_first() makes the above decisions when the second address
+     * in the expansion is produced, or when the expansion is complete.
      */
     else {
-	RECIPIENT rcpt;
-	DSN     dsn;
+	CLEANUP_EXPANSION expansion;
 
-	argv = cleanup_map1n_internal(state, recip, cleanup_virt_alias_maps,
-				  cleanup_ext_prop_mask & EXT_PROP_VIRTUAL);
-	if (argv->argc > 1 && (state->tflags & DEL_REQ_FLAG_MTA_VRFY)) {
-	    (void) DSN_SIMPLE(&dsn, "2.0.0", "aliased to multiple recipients");
-	    dsn.action = "deliverable";
-	    RECIPIENT_ASSIGN(&rcpt, 0, dsn_orcpt, dsn_notify, orcpt, recip);
-	    cleanup_verify_append(state, &rcpt, &dsn, DEL_RCPT_STAT_OK);
-	    argv_free(argv);
-	    return;
-	}
-	if ((dsn_notify & DSN_NOTIFY_SUCCESS)
-	    && (argv->argc > 1 || strcmp(recip, argv->argv[0]) != 0)) {
-	    (void) DSN_SIMPLE(&dsn, "2.0.0", "alias expanded");
-	    dsn.action = "expanded";
-	    RECIPIENT_ASSIGN(&rcpt, 0, dsn_orcpt, dsn_notify, orcpt, recip);
-	    cleanup_trace_append(state, &rcpt, &dsn);
-	    dsn_notify = (dsn_notify == DSN_NOTIFY_SUCCESS ? DSN_NOTIFY_NEVER :
-			  dsn_notify & ~DSN_NOTIFY_SUCCESS);
-	}
-	for (cpp = argv->argv; *cpp; cpp++) {
-	    if ((var_enable_orcpt ?
-		 been_here(state->dups, "%s\n%d\n%s\n%s",
-			   dsn_orcpt, dsn_notify, orcpt, *cpp) :
-		 been_here_fixed(state->dups, *cpp)) == 0) {
-		if (dsn_notify)
-		    cleanup_out_format(state, REC_TYPE_ATTR, "%s=%d",
-				       MAIL_ATTR_DSN_NOTIFY, dsn_notify);
-		if (*dsn_orcpt)
-		    cleanup_out_format(state, REC_TYPE_ATTR, "%s=%s",
-				       MAIL_ATTR_DSN_ORCPT, dsn_orcpt);
-		cleanup_out_string(state, REC_TYPE_ORCP, orcpt);
-		cleanup_out_string(state, REC_TYPE_RCPT, *cpp);
-		state->rcpt_count++;
-	    }
-	}
-	argv_free(argv);
+	expansion.dsn_orcpt = dsn_orcpt;
+	expansion.dsn_notify = dsn_notify;
+	expansion.orcpt = orcpt;
+	expansion.recip = recip;
+	expansion.first = 0;
+	expansion.count = 0;
+	expansion.discard = 0;
+	(void) cleanup_map1n_internal(state, recip, cleanup_virt_alias_maps,
+				  cleanup_ext_prop_mask & EXT_PROP_VIRTUAL,
+				      cleanup_out_expansion,
+				      (void *) &expansion);
+	if (expansion.first)
+	    cleanup_out_first(state, &expansion);
     }
 }
@@ -36,7 +36,8 @@
 /*
 /*	cleanup_rewrite_tree() is a wrapper around the
 /*	cleanup_rewrite_external() routine that transforms from
-/*	internal parse tree form to external form and back.
+/*	internal parse tree form to external form and back. The
+/*	tree is left alone when the address is not changed.
 /*
 /*	Arguments:
 /* .IP context_name
@@ -72,6 +73,7 @@
 #include <tok822.h>
 #include <rewrite_clnt.h>
 #include <quote_822_local.h>
+#include <mail_params.h>
 
 /* Application-specific. */
 
@@ -84,7 +86,11 @@
 int     cleanup_rewrite_external(const char *context_name, VSTRING *result,
 				         const char *addr)
 {
+    struct timeval start;
+
+    CLEANUP_STAGE_START(&start);
     rewrite_clnt(context_name, addr, result);
+    CLEANUP_STAGE_STOP(CLEANUP_STAGE_REWRITE, &start);
     return (strcmp(STR(result), addr) != 0);
 }
 
@@ -98,8 +104,10 @@ int    cleanup_rewrite_tree(const char *context_name, TOK822 *tree)
 
     tok822_externalize(src, tree->head, TOK822_STR_DEFL);
     did_rewrite = cleanup_rewrite_external(context_name, dst, STR(src));
-    tok822_free_tree(tree->head);
-    tree->head = tok822_scan(STR(dst), &tree->tail);
+    if (did_rewrite) {
+	tok822_free_tree(tree->head);
+	tree->head = tok822_scan(STR(dst), &tree->tail);
+    }
     vstring_free(dst);
     vstring_free(src);
     return (did_rewrite);
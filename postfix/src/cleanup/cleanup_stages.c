@@ -0,0 +1,256 @@
+/*++
+/* NAME
+/*	cleanup_stages 3
+/* SUMMARY
+/*	per-message stage timing
+/* SYNOPSIS
+/*	#include "cleanup.h"
+/*
+/*	void	cleanup_stages_init()
+/*
+/*	void	cleanup_stages_connect(state, value)
+/*	CLEANUP_STATE *state;
+/*	const char *value;
+/*
+/*	void	cleanup_stages_mark(stage)
+/*	int	stage;
+/*
+/*	void	CLEANUP_STAGE_START(start)
+/*	struct timeval *start;
+/*
+/*	void	CLEANUP_STAGE_STOP(which, start)
+/*	int	which;
+/*	struct timeval *start;
+/*
+/*	void	cleanup_stages_reserve(state)
+/*	CLEANUP_STATE *state;
+/*
+/*	void	cleanup_stages_update(state)
+/*	CLEANUP_STATE *state;
+/*
+/*	void	cleanup_stages_save(stages)
+/*	CLEANUP_STAGES *stages;
+/*
+/*	void	cleanup_stages_restore(stages)
+/*	const CLEANUP_STAGES *stages;
+/* DESCRIPTION
+/*	This module collects microsecond timestamps for the stages
+/*	of message reception, and stores them in the queue file as
+/*	one named attribute, so that the queue manager can log a
+/*	per-message stage summary when delivery completes. All
+/*	functions do nothing unless enable_stage_timing is turned on.
+/*
+/*	The cleanup server processes one message at a time, so that
+/*	the state can be kept in process-global storage, just like
+/*	the queue file pathname. When a process receives multiple
+/*	messages at the same time, cleanup_stages_save() and
+/*	cleanup_stages_restore() switch between the state of
+/*	different messages.
+/*
+/*	cleanup_stages_init() resets the stage timestamps and
+/*	accumulators for a new message.
+/*
+/*	cleanup_stages_connect() saves the SMTP session start time
+/*	that smtpd(8) sends as the stage_connect attribute value.
+/*
+/*	cleanup_stages_mark() records the current time as the start
+/*	of message content (CLEANUP_STAGE_DATA), the end of message
+/*	content (CLEANUP_STAGE_CONTENT), or as the time that the
+/*	message is ready to be committed (CLEANUP_STAGE_QUEUED).
+/*
+/*	CLEANUP_STAGE_START() and CLEANUP_STAGE_STOP() bracket a
+/*	call into address rewriting (CLEANUP_STAGE_REWRITE), table
+/*	lookup (CLEANUP_STAGE_MAPS) or Milter (CLEANUP_STAGE_MILTER)
+/*	code, and add the elapsed time to the accumulator for that
+/*	activity.
+/*
+/*	cleanup_stages_reserve() writes a fixed-length place holder
+/*	record for the stage times. It should be called once, before
+/*	the end of the extracted segment.
+/*
+/*	cleanup_stages_update() overwrites the place holder record
+/*	with the actual stage times. The record stays in place when
+/*	Milter applications add or remove records.
+/*
+/*	cleanup_stages_save() copies the state of the current message
+/*	to the specified storage.
+/*
+/*	cleanup_stages_restore() makes the specified state the
+/*	state of the current message.
+/* BUGS
+/*	Time spent in fsync() and in the rename to the incoming
+/*	queue happens after the queue file content is final; it
+/*	is included in the queue manager's "queue" interval.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdlib.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstream.h>
+
+/* Global library. */
+
+#include <rec_type.h>
+#include <mail_proto.h>
+#include <mail_params.h>
+
+/* Application-specific. */
+
+#include "cleanup.h"
+
+ /*
+  * Stage timestamps and per-activity accumulators for the current message.
+  */
+static CLEANUP_STAGES cleanup_stages;
+
+ /*
+  * The place holder record has fixed-width fields, so that it can be
+  * updated in place. Unknown values are -1, and values that would not fit
+  * (more than 11 days) are clamped.
+  */
+#define CLEANUP_STAGE_MAX	999999999999L
+#define CLEANUP_STAGE_CLAMP(x)	((x) > CLEANUP_STAGE_MAX ? CLEANUP_STAGE_MAX : \
+				 (x) < -1 ? -1L : (x))
+#define CLEANUP_STAGE_FIELD	"%12ld"
+#define CLEANUP_STAGE_FORMAT	"%s=" CLEANUP_STAGE_FIELD \
+	" " CLEANUP_STAGE_FIELD " " CLEANUP_STAGE_FIELD " " CLEANUP_STAGE_FIELD \
+	" " CLEANUP_STAGE_FIELD " " CLEANUP_STAGE_FIELD " " CLEANUP_STAGE_FIELD
+
+ /*
+  * Microseconds from "start" to "end", or -1 if either is unknown.
+  */
+#define CLEANUP_STAGE_DIFF(end, start) \
+	(((end).tv_sec == 0 || (start).tv_sec == 0) ? -1L : \
+	    (long) ((end).tv_sec - (start).tv_sec) * 1000000L \
+	    + (long) ((end).tv_usec - (start).tv_usec))
+
+/* cleanup_stages_init - reset for new message */
+
+void    cleanup_stages_init(void)
+{
+    int     n;
+
+    cleanup_stages.connect.tv_sec = cleanup_stages.connect.tv_usec = 0;
+    for (n = 0; n < CLEANUP_STAGE_MARKS; n++)
+	cleanup_stages.marks[n].tv_sec = cleanup_stages.marks[n].tv_usec = 0;
+    for (n = 0; n < CLEANUP_STAGE_ACTIVITIES; n++)
+	cleanup_stages.usecs[n] = 0;
+    cleanup_stages.offset = -1;
+}
+
+/* cleanup_stages_connect - save SMTP session start time */
+
+void    cleanup_stages_connect(CLEANUP_STATE *state, const char *value)
+{
+    char   *end;
+    long    sec;
+    long    usec = 0;
+
+    sec = strtol(value, &end, 10);
+    if (*end == '.')
+	usec = strtol(end + 1, &end, 10);
+    if (*end != 0 || sec <= 0 || usec < 0 || usec >= 1000000) {
+	msg_warn("%s: ignoring malformed %s attribute: %.100s",
+		 state->queue_id, MAIL_ATTR_STAGE_CONNECT, value);
+	return;
+    }
+    cleanup_stages.connect.tv_sec = sec;
+    cleanup_stages.connect.tv_usec = usec;
+}
+
+/* cleanup_stages_mark - record stage boundary */
+
+void    cleanup_stages_mark(int stage)
+{
+    if (var_stage_timing == 0)
+	return;
+    if (stage < 0 || stage >= CLEANUP_STAGE_MARKS)
+	msg_panic("cleanup_stages_mark: bad stage: %d", stage);
+    if (cleanup_stages.marks[stage].tv_sec == 0)
+	GETTIMEOFDAY(cleanup_stages.marks + stage);
+}
+
+/* cleanup_stages_add - update activity accumulator */
+
+void    cleanup_stages_add(int which, struct timeval * start)
+{
+    struct timeval now;
+
+    if (which < 0 || which >= CLEANUP_STAGE_ACTIVITIES)
+	msg_panic("cleanup_stages_add: bad activity: %d", which);
+    GETTIMEOFDAY(&now);
+    cleanup_stages.usecs[which] += CLEANUP_STAGE_DIFF(now, *start);
+}
+
+/* cleanup_stages_format - write the stage times record */
+
+static void cleanup_stages_format(CLEANUP_STATE *state)
+{
+    struct timeval *arrival = &state->arrival_time;
+    struct timeval *marks = cleanup_stages.marks;
+    long    session = CLEANUP_STAGE_DIFF(*arrival, cleanup_stages.connect);
+    long    data = CLEANUP_STAGE_DIFF(marks[CLEANUP_STAGE_DATA], *arrival);
+    long    content = CLEANUP_STAGE_DIFF(marks[CLEANUP_STAGE_CONTENT], *arrival);
+    long    queued = CLEANUP_STAGE_DIFF(marks[CLEANUP_STAGE_QUEUED], *arrival);
+    long   *usecs = cleanup_stages.usecs;
+
+    cleanup_out_format(state, REC_TYPE_ATTR, CLEANUP_STAGE_FORMAT,
+		       MAIL_ATTR_STAGE_TIMES,
+		       CLEANUP_STAGE_CLAMP(session),
+		       CLEANUP_STAGE_CLAMP(data),
+		       CLEANUP_STAGE_CLAMP(content),
+		       CLEANUP_STAGE_CLAMP(queued),
+		       CLEANUP_STAGE_CLAMP(usecs[CLEANUP_STAGE_REWRITE]),
+		       CLEANUP_STAGE_CLAMP(usecs[CLEANUP_STAGE_MAPS]),
+		       CLEANUP_STAGE_CLAMP(usecs[CLEANUP_STAGE_MILTER]));
+}
+
+/* cleanup_stages_reserve - write place holder record */
+
+void    cleanup_stages_reserve(CLEANUP_STATE *state)
+{
+    const char *myname = "cleanup_stages_reserve";
+
+    if (var_stage_timing == 0 || cleanup_stages.offset >= 0)
+	return;
+    if ((cleanup_stages.offset = vstream_ftell(state->dst)) < 0)
+	msg_fatal("%s: vstream_ftell %s: %m", myname, cleanup_path);
+    cleanup_stages_format(state);
+}
+
+/* cleanup_stages_update - overwrite place holder record */
+
+void    cleanup_stages_update(CLEANUP_STATE *state)
+{
+    const char *myname = "cleanup_stages_update";
+
+    if (var_stage_timing == 0 || cleanup_stages.offset < 0)
+	return;
+    cleanup_stages_mark(CLEANUP_STAGE_QUEUED);
+    if (vstream_fseek(state->dst, cleanup_stages.offset, SEEK_SET) < 0)
+	msg_fatal("%s: vstream_fseek %s: %m", myname, cleanup_path);
+    cleanup_stages_format(state);
+}
+
+/* cleanup_stages_save - save state of current message */
+
+void    cleanup_stages_save(CLEANUP_STAGES *stages)
+{
+    *stages = cleanup_stages;
+}
+
+/* cleanup_stages_restore - restore state of current message */
+
+void    cleanup_stages_restore(const CLEANUP_STAGES *stages)
+{
+    cleanup_stages = *stages;
+}
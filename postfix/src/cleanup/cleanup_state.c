@@ -93,7 +93,8 @@ CLEANUP_STATE *cleanup_state_alloc(VSTREAM *src)
     state->headers_seen = 0;
     state->hop_count = 0;
     state->resent = "";
-    state->dups = been_here_init(var_dup_filter_limit, BH_FLAG_FOLD);
+    state->dups = been_here_init(var_dup_filter_limit,
+				 BH_FLAG_FOLD | cleanup_dup_filter_flags);
     state->action = cleanup_envelope;
     state->data_offset = -1;
     state->body_offset = -1;
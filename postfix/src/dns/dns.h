@@ -259,6 +259,12 @@ extern int dns_lookup_rl(const char *, unsigned, DNS_RR **, VSTRING *,
 extern int dns_lookup_rv(const char *, unsigned, DNS_RR **, VSTRING *,
 			         VSTRING *, int *, int, unsigned *);
 extern int dns_get_h_errno(void);
+extern void dns_lookup_batch(const char **, int, unsigned, int *, int);
+extern void dns_lookup_cache(ssize_t, int);
+
+typedef void (*DNS_ASYNC_FN) (int, DNS_RR *, void *);
+extern int dns_lookup_async(const char *, unsigned, unsigned, int,
+			            DNS_ASYNC_FN, void *);
 
 #define dns_lookup(name, type, rflags, list, fqdn, why) \
     dns_lookup_x((name), (type), (rflags), (list), (fqdn), (why), (int *) 0, \
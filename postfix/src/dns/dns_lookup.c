@@ -33,6 +33,25 @@
 /*	unsigned *ltype;
 /*
 /*	int	dns_get_h_errno()
+/*
+/*	void	dns_lookup_batch(names, count, type, status, timeout)
+/*	const char **names;
+/*	int	count;
+/*	unsigned type;
+/*	int	*status;
+/*	int	timeout;
+/*
+/*	void	dns_lookup_cache(size, ttl_limit)
+/*	ssize_t	size;
+/*	int	ttl_limit;
+/*
+/*	int	dns_lookup_async(name, type, lflags, timeout, callback, context)
+/*	const char *name;
+/*	unsigned type;
+/*	unsigned lflags;
+/*	int	timeout;
+/*	void	(*callback)(int status, DNS_RR *list, void *context);
+/*	void	*context;
 /* AUXILIARY FUNCTIONS
 /*	extern int var_dns_ncache_ttl_fix;
 /*
@@ -98,6 +117,49 @@
 /*	dns_lookup_l() and dns_lookup_v() allow the user to specify
 /*	a list of resource types.
 /*
+/*	dns_lookup_batch() sends one UDP query per name to the first
+/*	IPv4 name server in the resolver configuration, without
+/*	waiting for replies in between, and then waits up to \fItimeout\fR
+/*	seconds for the replies. The result for names[i] is stored
+/*	in status[i]: DNS_NOTFOUND when a recursive name server
+/*	replies that the name does not exist or has no data, DNS_OK
+/*	when the reply contains answer records, and DNS_RETRY when
+/*	no usable reply was received. The result is a hint only:
+/*	it does not include CNAME processing, reply filtering or
+/*	TCP fallback, so that DNS_OK and DNS_RETRY results must be
+/*	confirmed with dns_lookup(). The names are looked up as
+/*	is, without RES_DNSRCH or RES_DEFNAMES processing.
+/*
+/*	dns_lookup_cache() enables an in-process cache for successful
+/*	lookup results, with room for \fIsize\fR results. A result is
+/*	cached for the smallest TTL of its resource records, but no
+/*	longer than \fIttl_limit\fR seconds. The cache key includes the
+/*	query name, type, rflags and lflags, so that a result with
+/*	DNSSEC validation is never returned for a query without, and
+/*	vice versa; cached records keep their dnssec_valid status.
+/*	Unsuccessful lookups are not cached.
+/*
+/*	dns_lookup_async() is an event-driven version of dns_lookup()
+/*	for programs that must not block, such as postscreen(8). It
+/*	sends a UDP query to a name server in the resolver
+/*	configuration, and returns immediately. Each query uses a
+/*	new socket with a source port that is chosen by the kernel. When the reply
+/*	arrives, or after \fItimeout\fR seconds, it calls
+/*	\fIcallback\fR with a DNS_OK, DNS_NOTFOUND, DNS_POLICY or
+/*	DNS_RETRY status, and with the resulting resource records
+/*	(including the SOA records for DNS_REQ_FLAG_NCACHE_TTL).
+/*	These records are freed after the callback returns. The query
+/*	is sent again to the next name server after the resolver
+/*	retransmission interval. Concurrent requests for the same
+/*	name, type and lflags share one query. The name is looked up
+/*	as is, without RES_DNSRCH or RES_DEFNAMES processing, and
+/*	without TCP fallback, DNSSEC, or CNAME recursion; a truncated
+/*	reply or a reply with an unresolved CNAME is reported as
+/*	DNS_RETRY. The result value is 0 when the request is in
+/*	progress, and -1 when no query could be sent; in that case
+/*	the callback is not called, and the caller should fall back
+/*	to dns_lookup().
+/*
 /*	dns_lookup_x, dns_lookup_r(), dns_lookup_rl() and dns_lookup_rv()
 /*	accept or return additional information.
 /*
@@ -249,9 +311,13 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <sys/socket.h>
 #include <netdb.h>
+#include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
 
 /* Utility library. */
 
@@ -260,6 +326,10 @@
 #include <msg.h>
 #include <valid_hostname.h>
 #include <stringops.h>
+#include <iostuff.h>
+#include <ctable.h>
+#include <htable.h>
+#include <events.h>
 
 /* Global library. */
 
@@ -341,6 +411,13 @@ static struct __res_state dns_res_state;
 #define DNS_SET_H_ERRNO(statp, err)	(DNS_GET_H_ERRNO(statp) = (err))
 #endif
 
+ /*
+  * Null res_mkquery() arguments.
+  */
+#define NO_MKQUERY_DATA_BUF     ((unsigned char *) 0)
+#define NO_MKQUERY_DATA_LEN     ((int) 0)
+#define NO_MKQUERY_NEWRR        ((unsigned char *) 0)
+
  /*
   * To improve postscreen's allowlisting support, we need to know how long a
   * DNSBL "not found" answer is valid. The 2010 implementation assumed it was
@@ -398,10 +475,6 @@ static int dns_neg_query(const char *name, int class, int type,
      */
     reply_header->rcode = NOERROR;
 
-#define NO_MKQUERY_DATA_BUF     ((unsigned char *) 0)
-#define NO_MKQUERY_DATA_LEN     ((int) 0)
-#define NO_MKQUERY_NEWRR        ((unsigned char *) 0)
-
     if ((len = DNS_RES_NMKQUERY(&dns_res_state,
 			      QUERY, name, class, type, NO_MKQUERY_DATA_BUF,
 				NO_MKQUERY_DATA_LEN, NO_MKQUERY_NEWRR,
@@ -1013,11 +1086,12 @@ static int dns_get_answer(const char *orig_name, DNS_REPLY *reply, int type,
     return (not_found_status);
 }
 
-/* dns_lookup_x - DNS lookup user interface */
+/* dns_lookup_uncached - DNS lookup without result cache */
 
-int     dns_lookup_x(const char *name, unsigned type, unsigned flags,
-		             DNS_RR **rrlist, VSTRING *fqdn, VSTRING *why,
-		             int *rcode, unsigned lflags)
+static int dns_lookup_uncached(const char *name, unsigned type,
+			               unsigned flags, DNS_RR **rrlist,
+			               VSTRING *fqdn, VSTRING *why,
+			               int *rcode, unsigned lflags)
 {
     char    cname[DNS_NAME_LEN];
     int     c_len = sizeof(cname);
@@ -1167,6 +1241,150 @@ int     dns_lookup_x(const char *name, unsigned type, unsigned flags,
     return (DNS_NOTFOUND);
 }
 
+ /*
+  * Optional lookup result cache. The request is passed to the cache create
+  * function through a static structure, because the cache key does not
+  * preserve the caller's result buffers.
+  */
+typedef struct {
+    int     status;			/* dns_lookup() status */
+    DNS_RR *rr;				/* resource records */
+    char   *fqdn;			/* fully-qualified name */
+    char   *why;			/* error text */
+    int     rcode;			/* server reply code */
+    time_t  expires;			/* zero if not cacheable */
+} DNS_CACHE_ENTRY;
+
+typedef struct {
+    const char *name;
+    unsigned type;
+    unsigned flags;
+    unsigned lflags;
+} DNS_CACHE_REQUEST;
+
+static CTABLE *dns_cache;
+static int dns_cache_ttl_limit;
+static DNS_CACHE_REQUEST dns_cache_request;
+
+/* dns_cache_create - look up name after cache miss */
+
+static void *dns_cache_create(const char *unused_key, void *unused_context)
+{
+    DNS_CACHE_REQUEST *rp = &dns_cache_request;
+    DNS_CACHE_ENTRY *ep;
+    static VSTRING *fqdn;
+    static VSTRING *why;
+    DNS_RR *rr;
+    time_t  expires;
+
+    if (fqdn == 0) {
+	fqdn = vstring_alloc(100);
+	why = vstring_alloc(100);
+    }
+    VSTRING_RESET(fqdn);
+    VSTRING_TERMINATE(fqdn);
+    VSTRING_RESET(why);
+    VSTRING_TERMINATE(why);
+    ep = (DNS_CACHE_ENTRY *) mymalloc(sizeof(*ep));
+    ep->rcode = NOERROR;
+    ep->status = dns_lookup_uncached(rp->name, rp->type, rp->flags, &ep->rr,
+				     fqdn, why, &ep->rcode, rp->lflags);
+    ep->fqdn = mystrdup(vstring_str(fqdn));
+    ep->why = mystrdup(vstring_str(why));
+    if (ep->status == DNS_OK) {
+	expires = time((time_t *) 0) + dns_cache_ttl_limit;
+	for (rr = ep->rr; rr; rr = rr->next)
+	    if (expires > time((time_t *) 0) + rr->ttl)
+		expires = time((time_t *) 0) + rr->ttl;
+	ep->expires = expires;
+    } else {
+	ep->expires = 0;
+    }
+    return ((void *) ep);
+}
+
+/* dns_cache_delete - destroy cache entry */
+
+static void dns_cache_delete(void *value, void *unused_context)
+{
+    DNS_CACHE_ENTRY *ep = (DNS_CACHE_ENTRY *) value;
+
+    if (ep->rr)
+	dns_rr_free(ep->rr);
+    myfree(ep->fqdn);
+    myfree(ep->why);
+    myfree((void *) ep);
+}
+
+/* dns_lookup_cache - enable lookup result cache */
+
+void    dns_lookup_cache(ssize_t size, int ttl_limit)
+{
+    if (dns_cache != 0)
+	ctable_free(dns_cache);
+    dns_cache_ttl_limit = ttl_limit;
+    dns_cache = (size > 0 && ttl_limit > 0) ?
+	ctable_create(size, dns_cache_create, dns_cache_delete, (void *) 0) : 0;
+}
+
+/* dns_lookup_x - DNS lookup user interface */
+
+int     dns_lookup_x(const char *name, unsigned type, unsigned flags,
+		             DNS_RR **rrlist, VSTRING *fqdn, VSTRING *why,
+		             int *rcode, unsigned lflags)
+{
+    static VSTRING *key;
+    const DNS_CACHE_ENTRY *ep;
+    DNS_RR *rr;
+    DNS_RR *copy;
+    time_t  now;
+    int     was_cached;
+
+    if (dns_cache == 0)
+	return (dns_lookup_uncached(name, type, flags, rrlist, fqdn, why,
+				    rcode, lflags));
+
+    /*
+     * Only successful results are kept in the cache. Other results expire
+     * immediately; they are returned only to the request that created them.
+     */
+    if (key == 0)
+	key = vstring_alloc(100);
+    vstring_sprintf(key, "%u:%u:%u:%s", type, flags, lflags, name);
+    dns_cache_request.name = name;
+    dns_cache_request.type = type;
+    dns_cache_request.flags = flags;
+    dns_cache_request.lflags = lflags;
+    now = time((time_t *) 0);
+    was_cached = ctable_exists(dns_cache, vstring_str(key));
+    ep = (const DNS_CACHE_ENTRY *) ctable_locate(dns_cache, vstring_str(key));
+    if (was_cached && ep->expires <= now)
+	ep = (const DNS_CACHE_ENTRY *) ctable_refresh(dns_cache,
+						      vstring_str(key));
+    if (msg_verbose && was_cached)
+	msg_info("dns_lookup: %s/%s: cached result", name, dns_strtype(type));
+
+    /*
+     * Return a copy of the result, with the remaining time to live.
+     */
+    if (rrlist) {
+	*rrlist = 0;
+	for (rr = ep->rr; rr; rr = rr->next) {
+	    copy = dns_rr_copy(rr);
+	    if (ep->expires > now && copy->ttl > ep->expires - now)
+		copy->ttl = ep->expires - now;
+	    *rrlist = dns_rr_append(*rrlist, copy);
+	}
+    }
+    if (fqdn && *ep->fqdn)
+	vstring_strcpy(fqdn, ep->fqdn);
+    if (why && *ep->why)
+	vstring_strcpy(why, ep->why);
+    if (rcode)
+	*rcode = ep->rcode;
+    return (ep->status);
+}
+
 /* dns_lookup_rl - DNS lookup interface with types list */
 
 int     dns_lookup_rl(const char *name, unsigned flags, DNS_RR **rrlist,
@@ -1294,6 +1512,491 @@ int     dns_lookup_rv(const char *name, unsigned flags, DNS_RR **rrlist,
     return (status);
 }
 
+/* dns_lookup_batch - send queries in parallel, report existence */
+
+void    dns_lookup_batch(const char **names, int count, unsigned type,
+			         int *status, int timeout)
+{
+    const char *myname = "dns_lookup_batch";
+    struct sockaddr_in *server = 0;
+    struct sockaddr_in from;
+    SOCKADDR_SIZE from_len;
+    unsigned char reply_buf[DEF_DNS_REPLY_SIZE];
+    HEADER *reply_header = (HEADER *) reply_buf;
+    unsigned char **query_buf;
+    int    *query_len;
+    int     pending = 0;
+    time_t  deadline;
+    time_t  now;
+    ssize_t len;
+    int     fd = -1;
+    int     i;
+    int     j;
+
+    for (i = 0; i < count; i++)
+	status[i] = DNS_RETRY;
+
+    /*
+     * Initialize the name service. We talk to one IPv4 name server only;
+     * anything else falls back to the caller's dns_lookup().
+     */
+    if ((dns_res_state.options & RES_INIT) == 0
+	&& DNS_RES_NINIT(&dns_res_state) < 0)
+	return;
+    for (i = 0; i < dns_res_state.nscount && i < MAXNS; i++) {
+	if (dns_res_state.nsaddr_list[i].sin_family == AF_INET) {
+	    server = dns_res_state.nsaddr_list + i;
+	    break;
+	}
+    }
+    if (server == 0 || count <= 0
+	|| (fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	return;
+    non_blocking(fd, NON_BLOCKING);
+
+    /*
+     * Send all queries before we wait for any reply.
+     */
+    query_buf = (unsigned char **) mymalloc(count * sizeof(*query_buf));
+    query_len = (int *) mymalloc(count * sizeof(*query_len));
+    for (i = 0; i < count; i++) {
+	query_buf[i] = (unsigned char *) mymalloc(MAX_DNS_QUERY_SIZE);
+	if ((query_len[i] = DNS_RES_NMKQUERY(&dns_res_state, QUERY, names[i],
+					     C_IN, type, NO_MKQUERY_DATA_BUF,
+					     NO_MKQUERY_DATA_LEN,
+					     NO_MKQUERY_NEWRR, query_buf[i],
+					     MAX_DNS_QUERY_SIZE)) <= HFIXEDSZ
+	    || sendto(fd, query_buf[i], query_len[i], 0,
+		      (struct sockaddr *) server, sizeof(*server)) < 0) {
+	    if (msg_verbose)
+		msg_info("%s: cannot send query for %s: %m", myname, names[i]);
+	    query_len[i] = 0;
+	} else {
+	    pending++;
+	}
+    }
+
+    /*
+     * Match each reply against the query ID and the query section, so that
+     * a stray or late reply cannot be mistaken for an answer.
+     */
+    deadline = time((time_t *) 0) + timeout;
+    while (pending > 0 && (now = time((time_t *) 0)) < deadline
+	   && read_wait(fd, deadline - now) == 0) {
+	for (;;) {
+	    from_len = sizeof(from);
+	    if ((len = recvfrom(fd, reply_buf, sizeof(reply_buf), 0,
+				(struct sockaddr *) &from, &from_len)) < 0)
+		break;
+	    if (len < HFIXEDSZ || reply_header->qr == 0
+		|| from.sin_addr.s_addr != server->sin_addr.s_addr
+		|| from.sin_port != server->sin_port)
+		continue;
+	    for (i = 0; i < count; i++) {
+		if (query_len[i] == 0 || len < query_len[i]
+		    || reply_header->id != ((HEADER *) query_buf[i])->id)
+		    continue;
+		for (j = HFIXEDSZ; j < query_len[i]; j++)
+		    if (TOLOWER(reply_buf[j]) != TOLOWER(query_buf[i][j]))
+			break;
+		if (j < query_len[i])
+		    continue;
+		if (reply_header->tc || reply_header->ra == 0)
+		    status[i] = DNS_RETRY;
+		else if (reply_header->rcode == NXDOMAIN)
+		    status[i] = DNS_NOTFOUND;
+		else if (reply_header->rcode != NOERROR)
+		    status[i] = DNS_RETRY;
+		else if (reply_header->ancount == 0)
+		    status[i] = DNS_NOTFOUND;
+		else
+		    status[i] = DNS_OK;
+		if (msg_verbose)
+		    msg_info("%s: %s: %s", myname, names[i],
+			     status[i] == DNS_OK ? "found" :
+			     status[i] == DNS_NOTFOUND ? "not found" :
+			     "no answer");
+		query_len[i] = 0;
+		pending--;
+		break;
+	    }
+	}
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	    break;
+    }
+    (void) close(fd);
+    for (i = 0; i < count; i++)
+	myfree((void *) query_buf[i]);
+    myfree((void *) query_buf);
+    myfree((void *) query_len);
+}
+
+ /*
+  * Event-driven UDP client. Each query has its own socket, bound to a port
+  * that the kernel picks at random, so that a spoofed reply must guess the
+  * source port as well as the message ID. Replies are matched by server
+  * address, message ID and query section. Requests for the same name, type
+  * and lflags share one query, and their callbacks are called in order of
+  * arrival.
+  */
+typedef struct DNS_ASYNC_WAITER {
+    DNS_ASYNC_FN callback;		/* application call-back */
+    void   *context;			/* application context */
+    struct DNS_ASYNC_WAITER *next;	/* linked list */
+} DNS_ASYNC_WAITER;
+
+typedef struct {
+    char   *key;			/* name, type, lflags */
+    char   *name;			/* query name */
+    unsigned type;			/* query type */
+    unsigned lflags;			/* DNS_REQ_FLAG_NCACHE_TTL */
+    unsigned char *query_buf;		/* DNS query message */
+    int     query_len;			/* DNS query message length */
+    int     fd;				/* private UDP socket */
+    int     server;			/* name server index */
+    struct sockaddr_storage server_addr;/* current name server */
+    time_t  deadline;			/* give up after this time */
+    DNS_ASYNC_WAITER *waiters;		/* first waiter */
+    DNS_ASYNC_WAITER *last;		/* last waiter */
+} DNS_ASYNC_QUERY;
+
+static HTABLE *dns_async_by_key;
+
+static void dns_async_timer(int, void *);
+static void dns_async_receive(int, void *);
+
+ /*
+  * The resolver stores IPv6 name server addresses outside nsaddr_list[].
+  * Where we know how to find them, we use them too.
+  */
+#if defined(HAS_IPV6) && defined(__GLIBC__)
+#define DNS_NSADDR6(statp, i)	((statp)->_u._ext.nsaddrs[i])
+#endif
+
+/* dns_async_nsaddr - copy name server address, if usable */
+
+static int dns_async_nsaddr(int i, struct sockaddr_storage *addr)
+{
+    if (dns_res_state.nsaddr_list[i].sin_family == AF_INET) {
+	memcpy((void *) addr, (void *) (dns_res_state.nsaddr_list + i),
+	       sizeof(struct sockaddr_in));
+	return (1);
+    }
+#ifdef DNS_NSADDR6
+    if (DNS_NSADDR6(&dns_res_state, i) != 0
+	&& DNS_NSADDR6(&dns_res_state, i)->sin6_family == AF_INET6) {
+	memcpy((void *) addr, (void *) DNS_NSADDR6(&dns_res_state, i),
+	       sizeof(struct sockaddr_in6));
+	return (1);
+    }
+#endif
+    return (0);
+}
+
+/* dns_async_server - find the same or next usable name server */
+
+static int dns_async_server(DNS_ASYNC_QUERY *query)
+{
+    int     n;
+    int     i;
+
+    for (n = 0; n < dns_res_state.nscount && n < MAXNS; n++) {
+	i = (query->server + n) % dns_res_state.nscount;
+	if (dns_async_nsaddr(i, &query->server_addr)) {
+	    query->server = i;
+	    return (0);
+	}
+    }
+    return (-1);
+}
+
+/* dns_async_close - close the private query socket */
+
+static void dns_async_close(DNS_ASYNC_QUERY *query)
+{
+    if (query->fd >= 0) {
+	event_disable_readwrite(query->fd);
+	(void) close(query->fd);
+	query->fd = -1;
+    }
+}
+
+/* dns_async_send - send query to the current name server */
+
+static int dns_async_send(DNS_ASYNC_QUERY *query)
+{
+    const char *myname = "dns_async_send";
+    struct sockaddr *server = (struct sockaddr *) &query->server_addr;
+
+    /*
+     * Use a new socket for each transmission, so that a retransmission does
+     * not reuse a source port that an attacker may have learned, and so
+     * that the socket family matches the name server address.
+     */
+    dns_async_close(query);
+    if (dns_async_server(query) < 0)
+	return (-1);
+    if ((query->fd = socket(SOCK_ADDR_FAMILY(server), SOCK_DGRAM, 0)) < 0) {
+	msg_warn("%s: socket: %m", myname);
+	return (-1);
+    }
+    non_blocking(query->fd, NON_BLOCKING);
+    close_on_exec(query->fd, CLOSE_ON_EXEC);
+    if (sendto(query->fd, query->query_buf, query->query_len, 0,
+	       server, SOCK_ADDR_LEN(server)) < 0) {
+	if (msg_verbose)
+	    msg_info("%s: cannot send query for %s: %m", myname, query->name);
+	dns_async_close(query);
+	return (-1);
+    }
+    event_enable_read(query->fd, dns_async_receive, (void *) query);
+    return (0);
+}
+
+/* dns_async_done - notify waiters and destroy query */
+
+static void dns_async_done(DNS_ASYNC_QUERY *query, int status, DNS_RR *rr)
+{
+    DNS_ASYNC_WAITER *waiter;
+    DNS_ASYNC_WAITER *next;
+
+    /*
+     * Unlink the query before making any call-back, so that a call-back can
+     * safely request the same name again.
+     */
+    event_cancel_timer(dns_async_timer, (void *) query);
+    dns_async_close(query);
+    htable_delete(dns_async_by_key, query->key, (void (*) (void *)) 0);
+    if (msg_verbose)
+	msg_info("dns_lookup_async: %s (%s): %s", query->name,
+		 dns_strtype(query->type), status == DNS_OK ? "found" :
+		 status == DNS_NOTFOUND ? "not found" : "no answer");
+    for (waiter = query->waiters; waiter != 0; waiter = next) {
+	next = waiter->next;
+	waiter->callback(status, rr, waiter->context);
+	myfree((void *) waiter);
+    }
+    if (rr)
+	dns_rr_free(rr);
+    myfree(query->key);
+    myfree(query->name);
+    myfree((void *) query->query_buf);
+    myfree((void *) query);
+}
+
+/* dns_async_timer - retransmit or give up */
+
+static void dns_async_timer(int unused_event, void *context)
+{
+    DNS_ASYNC_QUERY *query = (DNS_ASYNC_QUERY *) context;
+    time_t  now = time((time_t *) 0);
+    int     delay;
+
+    if (now >= query->deadline) {
+	dns_async_done(query, DNS_RETRY, (DNS_RR *) 0);
+	return;
+    }
+    query->server += 1;
+    (void) dns_async_send(query);
+    delay = dns_res_state.retrans > 0 ? dns_res_state.retrans : 1;
+    if (delay > query->deadline - now)
+	delay = query->deadline - now;
+    event_request_timer(dns_async_timer, (void *) query, delay);
+}
+
+/* dns_async_parse - decode name server reply */
+
+static int dns_async_parse(DNS_ASYNC_QUERY *query, unsigned char *buf,
+			           ssize_t len, DNS_RR **rrlist)
+{
+    HEADER *reply_header = (HEADER *) buf;
+    DNS_REPLY reply;
+    char    cname[DNS_NAME_LEN];
+    int     maybe_secure = 0;
+    int     status;
+
+    /*
+     * Without TCP fallback, a truncated reply is no better than no reply.
+     */
+    if (reply_header->tc || reply_header->ra == 0
+	|| (reply_header->rcode != NOERROR && reply_header->rcode != NXDOMAIN))
+	return (DNS_RETRY);
+
+    reply.buf = buf;
+    reply.buf_len = len;
+    reply.rcode = reply_header->rcode;
+    reply.dnssec_ad = 0;
+    SET_HAVE_DNS_REPLY_PACKET(&reply, len);
+    reply.query_start = reply.buf + sizeof(HEADER);
+    reply.answer_start = 0;
+    reply.query_count = ntohs(reply_header->qdcount);
+    reply.answer_count = ntohs(reply_header->ancount);
+    reply.auth_count = ntohs(reply_header->nscount);
+
+    if (reply.rcode == NOERROR && reply.answer_count > 0) {
+	status = dns_get_answer(query->name, &reply, query->type, rrlist,
+				(VSTRING *) 0, cname, sizeof(cname),
+				&maybe_secure);
+	if (status == DNS_RECURSE)
+	    return (DNS_RETRY);
+	if (status == DNS_OK && dns_rr_filter_maps) {
+	    if (dns_rr_filter_execute(rrlist) < 0) {
+		dns_rr_free(*rrlist);
+		*rrlist = 0;
+		return (DNS_RETRY);
+	    } else if (*rrlist == 0)
+		return (DNS_POLICY);
+	}
+	return (status);
+    }
+
+    /*
+     * As with dns_lookup(), the negative reply TTL is the TTL of the SOA
+     * record in the authority section.
+     */
+    if ((query->lflags & DNS_REQ_FLAG_NCACHE_TTL) && reply.auth_count > 0) {
+	reply.answer_count = reply.auth_count;	/* XXX TODO: Fix API */
+	(void) dns_get_answer(query->name, &reply, T_SOA, rrlist,
+			      (VSTRING *) 0, cname, sizeof(cname),
+			      &maybe_secure);
+    }
+    return (DNS_NOTFOUND);
+}
+
+/* dns_async_receive - match and decode name server replies */
+
+static void dns_async_receive(int unused_event, void *context)
+{
+    DNS_ASYNC_QUERY *query = (DNS_ASYNC_QUERY *) context;
+    unsigned char reply_buf[DEF_DNS_REPLY_SIZE];
+    HEADER *reply_header = (HEADER *) reply_buf;
+    struct sockaddr_storage from;
+    SOCKADDR_SIZE from_len;
+    struct sockaddr *server = (struct sockaddr *) &query->server_addr;
+    DNS_RR *rr;
+    ssize_t len;
+    int     status;
+    int     j;
+
+    for (;;) {
+	from_len = sizeof(from);
+	if ((len = recvfrom(query->fd, reply_buf, sizeof(reply_buf), 0,
+			    (struct sockaddr *) &from, &from_len)) < 0)
+	    break;
+	if (len < HFIXEDSZ || reply_header->qr == 0
+	    || SOCK_ADDR_FAMILY(&from) != SOCK_ADDR_FAMILY(server)
+	    || sock_addr_cmp_addr((struct sockaddr *) &from, server) != 0
+	    || sock_addr_cmp_port((struct sockaddr *) &from, server) != 0
+	    || reply_header->id != ((HEADER *) query->query_buf)->id
+	    || len < query->query_len)
+	    continue;
+	for (j = HFIXEDSZ; j < query->query_len; j++)
+	    if (TOLOWER(reply_buf[j]) != TOLOWER(query->query_buf[j]))
+		break;
+	if (j < query->query_len)
+	    continue;
+	rr = 0;
+	status = dns_async_parse(query, reply_buf, len, &rr);
+	dns_async_done(query, status, rr);
+	return;
+    }
+}
+
+/* dns_lookup_async - start event-driven lookup */
+
+int     dns_lookup_async(const char *name, unsigned type, unsigned lflags,
+			         int timeout, DNS_ASYNC_FN callback,
+			         void *context)
+{
+    const char *myname = "dns_lookup_async";
+    static VSTRING *key;
+    DNS_ASYNC_QUERY *query;
+    DNS_ASYNC_WAITER *waiter;
+    unsigned char *query_buf;
+    int     query_len;
+    int     delay;
+
+    /*
+     * Sanity check.
+     */
+    if (lflags & ~DNS_REQ_FLAG_NCACHE_TTL)
+	msg_panic("%s: bad lflags: 0x%x", myname, lflags);
+
+    /*
+     * Share the query with a concurrent request for the same information.
+     */
+    if (key == 0)
+	key = vstring_alloc(100);
+    vstring_sprintf(key, "%u:%u:%s", type, lflags, name);
+    if (dns_async_by_key != 0 && (query = (DNS_ASYNC_QUERY *)
+			   htable_find(dns_async_by_key, vstring_str(key))) != 0) {
+	if (msg_verbose)
+	    msg_info("%s: %s (%s): share pending query",
+		     myname, name, dns_strtype(type));
+    } else {
+
+	/*
+	 * Initialize the name service.
+	 */
+	if ((dns_res_state.options & RES_INIT) == 0
+	    && DNS_RES_NINIT(&dns_res_state) < 0)
+	    return (-1);
+	if (dns_async_by_key == 0)
+	    dns_async_by_key = htable_create(13);
+
+	/*
+	 * Each query has its own socket, so the message ID need not be
+	 * unique among pending queries.
+	 */
+	query_buf = (unsigned char *) mymalloc(MAX_DNS_QUERY_SIZE);
+	if ((query_len = DNS_RES_NMKQUERY(&dns_res_state, QUERY, name,
+					  C_IN, type, NO_MKQUERY_DATA_BUF,
+					  NO_MKQUERY_DATA_LEN,
+					  NO_MKQUERY_NEWRR, query_buf,
+					  MAX_DNS_QUERY_SIZE)) <= HFIXEDSZ) {
+	    myfree((void *) query_buf);
+	    return (-1);
+	}
+	query = (DNS_ASYNC_QUERY *) mymalloc(sizeof(*query));
+	query->key = mystrdup(vstring_str(key));
+	query->name = mystrdup(name);
+	query->type = type;
+	query->lflags = lflags;
+	query->query_buf = query_buf;
+	query->query_len = query_len;
+	query->fd = -1;
+	query->server = 0;
+	query->deadline = time((time_t *) 0) + timeout;
+	query->waiters = query->last = 0;
+	if (dns_async_send(query) < 0) {
+	    myfree(query->key);
+	    myfree(query->name);
+	    myfree((void *) query->query_buf);
+	    myfree((void *) query);
+	    return (-1);
+	}
+	(void) htable_enter(dns_async_by_key, query->key, (void *) query);
+	delay = dns_res_state.retrans > 0 ? dns_res_state.retrans : 1;
+	if (delay > timeout)
+	    delay = timeout > 0 ? timeout : 1;
+	event_request_timer(dns_async_timer, (void *) query, delay);
+    }
+
+    /*
+     * Append the requestor to the waiter list.
+     */
+    waiter = (DNS_ASYNC_WAITER *) mymalloc(sizeof(*waiter));
+    waiter->callback = callback;
+    waiter->context = context;
+    waiter->next = 0;
+    if (query->last)
+	query->last->next = waiter;
+    else
+	query->waiters = waiter;
+    query->last = waiter;
+    return (0);
+}
+
 /* dns_get_h_errno - get the last lookup status */
 
 int     dns_get_h_errno(void)
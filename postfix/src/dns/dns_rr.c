@@ -144,12 +144,27 @@
 
 #include <msg.h>
 #include <mymalloc.h>
+#include <mypool.h>
 #include <myrand.h>
 
 /* DNS library. */
 
 #include "dns.h"
 
+ /*
+  * Resource records are created and destroyed for each DNS lookup.
+  */
+static MYPOOL *dns_rr_pool;
+
+/* dns_rr_alloc - allocate resource record structure */
+
+static DNS_RR *dns_rr_alloc(void)
+{
+    if (dns_rr_pool == 0)
+	dns_rr_pool = mypool_create("dns_rr", sizeof(DNS_RR));
+    return ((DNS_RR *) mypool_alloc(dns_rr_pool));
+}
+
 /* dns_rr_create - fill in resource record structure */
 
 DNS_RR *dns_rr_create(const char *qname, const char *rname,
@@ -163,7 +178,7 @@ DNS_RR *dns_rr_create(const char *qname, const char *rname,
     /*
      * Note: if this function is changed, update dns_rr_copy().
      */
-    rr = (DNS_RR *) mymalloc(sizeof(*rr));
+    rr = dns_rr_alloc();
     rr->qname = mystrdup(qname);
     rr->rname = mystrdup(rname);
     rr->type = type;
@@ -195,7 +210,7 @@ void    dns_rr_free(DNS_RR *rr)
 	myfree(rr->rname);
 	if (rr->data)
 	    myfree(rr->data);
-	myfree((void *) rr);
+	mypool_free(dns_rr_pool, (void *) rr);
     }
 }
 
@@ -208,7 +223,7 @@ DNS_RR *dns_rr_copy(DNS_RR *src)
     /*
      * Note: struct copy, because dns_rr_create() would not copy all fields.
      */
-    dst = (DNS_RR *) mymalloc(sizeof(*dst));
+    dst = dns_rr_alloc();
     *dst = *src;
     dst->qname = mystrdup(src->qname);
     dst->rname = mystrdup(src->rname);
@@ -46,6 +46,11 @@
 /*	This request completes in the background.
 /* .IP \fBpurge\fR
 /*	Do a \fBrefresh\fR for all per-destination logfiles.
+/* .PP
+/*	The \fBsend_site\fR and \fBsend_file\fR requests move
+/*	messages to the incoming queue. When there are only a few,
+/*	the \fBqmgr\fR(8) server is told their queue IDs, so that it
+/*	does not have to scan the incoming queue.
 /* SECURITY
 /* .ad
 /* .fi
@@ -225,10 +230,19 @@ static DOMAIN_LIST *flush_domains;
   */
 #define FLUSH_DUP_FILTER_SIZE	10000	/* graceful degradation */
 
+ /*
+  * When we move only a few queue files to the incoming queue, we name them
+  * in the trigger request, so that the queue manager does not have to scan
+  * the incoming queue. Each trigger request must fit in one atomic write.
+  */
+#define FLUSH_EXPEDITE_LIMIT	100	/* else scan incoming queue */
+#define FLUSH_EXPEDITE_CHUNK	500	/* < PIPE_BUF */
+
  /*
   * Silly little macros.
   */
 #define STR(x)			vstring_str(x)
+#define LEN(x)			VSTRING_LEN(x)
 #define STREQ(x,y)		(STRREF(x) == STRREF(y) || strcmp(x,y) == 0)
 
  /*
@@ -484,6 +498,27 @@ static int flush_one_file(const char *queue_id, VSTRING *queue_file,
     return (1);
 }
 
+/* flush_expedite_send - send pending expedite requests */
+
+static void flush_expedite_send(VSTRING *buf)
+{
+    if (LEN(buf) > 0) {
+	mail_trigger(MAIL_CLASS_PUBLIC, var_queue_service, STR(buf), LEN(buf));
+	VSTRING_RESET(buf);
+    }
+}
+
+/* flush_expedite_add - request delivery for one incoming queue file */
+
+static void flush_expedite_add(VSTRING *buf, const char *queue_id)
+{
+    if (LEN(buf) + strlen(queue_id) + 2 > FLUSH_EXPEDITE_CHUNK)
+	flush_expedite_send(buf);
+    VSTRING_ADDCH(buf, QMGR_REQ_EXPEDITE);
+    vstring_strcat(buf, queue_id);
+    VSTRING_ADDCH(buf, 0);
+}
+
 /* flush_send_path - flush logfile file */
 
 static int flush_send_path(const char *path, int how)
@@ -500,7 +535,9 @@ static int flush_send_path(const char *path, int how)
 	QMGR_REQ_SCAN_INCOMING,		/* scan incoming queue */
     };
     HTABLE *dup_filter;
+    VSTRING *expedite;
     int     count;
+    int     moved;
 
     /*
      * Sanity check.
@@ -563,9 +600,10 @@ static int flush_send_path(const char *path, int how)
      */
     queue_id = vstring_alloc(10);
     queue_file = vstring_alloc(10);
+    expedite = vstring_alloc(FLUSH_EXPEDITE_CHUNK);
     dup_filter = htable_create(10);
     tbuf.actime = tbuf.modtime = event_time();
-    for (count = 0; vstring_get_nonl(queue_id, log) != VSTREAM_EOF; count++) {
+    for (moved = count = 0; vstring_get_nonl(queue_id, log) != VSTREAM_EOF; count++) {
 	if (!mail_queue_id_ok(STR(queue_id))) {
 	    msg_warn("bad queue id \"%.30s...\" in fast flush logfile %s",
 		     STR(queue_id), path);
@@ -578,7 +616,11 @@ static int flush_send_path(const char *path, int how)
 			 myname, path, STR(queue_id));
 	    if (dup_filter->used <= FLUSH_DUP_FILTER_SIZE)
 		htable_enter(dup_filter, STR(queue_id), 0);
-	    count += flush_one_file(STR(queue_id), queue_file, &tbuf, how);
+	    if (flush_one_file(STR(queue_id), queue_file, &tbuf, how)) {
+		count++;
+		if (++moved <= FLUSH_EXPEDITE_LIMIT)
+		    flush_expedite_add(expedite, STR(queue_id));
+	    }
 	} else {
 	    if (msg_verbose)
 		msg_info("%s: logfile %s: skip queue file %s as duplicate",
@@ -610,9 +652,13 @@ static int flush_send_path(const char *path, int how)
     if (count > 0) {
 	if (msg_verbose)
 	    msg_info("%s: requesting delivery for logfile %s", myname, path);
-	mail_trigger(MAIL_CLASS_PUBLIC, var_queue_service,
-		     qmgr_scan_trigger, sizeof(qmgr_scan_trigger));
+	if (moved <= FLUSH_EXPEDITE_LIMIT)
+	    flush_expedite_send(expedite);
+	else
+	    mail_trigger(MAIL_CLASS_PUBLIC, var_queue_service,
+			 qmgr_scan_trigger, sizeof(qmgr_scan_trigger));
     }
+    vstring_free(expedite);
     return (FLUSH_STAT_OK);
 }
 
@@ -622,10 +668,8 @@ static int flush_send_file_service(const char *queue_id)
 {
     const char *myname = "flush_send_file_service";
     VSTRING *queue_file;
+    VSTRING *expedite;
     struct utimbuf tbuf;
-    static char qmgr_scan_trigger[] = {
-	QMGR_REQ_SCAN_INCOMING,		/* scan incoming queue */
-    };
 
     /*
      * Sanity check.
@@ -637,10 +681,13 @@ static int flush_send_file_service(const char *queue_id)
 	msg_info("%s: requesting delivery for queue_id %s", myname, queue_id);
 
     queue_file = vstring_alloc(30);
+    expedite = vstring_alloc(30);
     tbuf.actime = tbuf.modtime = event_time();
-    if (flush_one_file(queue_id, queue_file, &tbuf, UNTHROTTLE_AFTER) > 0)
-	mail_trigger(MAIL_CLASS_PUBLIC, var_queue_service,
-		     qmgr_scan_trigger, sizeof(qmgr_scan_trigger));
+    if (flush_one_file(queue_id, queue_file, &tbuf, UNTHROTTLE_AFTER) > 0) {
+	flush_expedite_add(expedite, queue_id);
+	flush_expedite_send(expedite);
+    }
+    vstring_free(expedite);
     vstring_free(queue_file);
 
     return (FLUSH_STAT_OK);
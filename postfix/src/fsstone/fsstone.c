@@ -7,6 +7,11 @@
 /* .fi
 /*	\fBfsstone\fR [\fB-cr\fR] [\fB-s \fIsize\fR]
 /*		\fImsg_count files_per_dir\fR
+/*
+/*	\fBfsstone -q\fR [\fB-d \fIdepth\fR] [\fB-D \fIpercent\fR]
+/*		[\fB-g \fIgroup\fR] [\fB-h \fIqueue_names\fR]
+/*		[\fB-p \fIscanners\fR] [\fB-s \fIsize\fR]
+/*		\fImsg_count backlog\fR
 /* DESCRIPTION
 /*	The \fBfsstone\fR command measures the cost of creating, renaming
 /*	and deleting queue files versus appending messages to existing
@@ -16,9 +21,44 @@
 /*	and arranges for at most \fIfiles_per_dir\fR simultaneous files
 /*	in the same directory.
 /*
+/*	With \fB-q\fR, the program instead simulates how the Postfix
+/*	queue uses the file system. It creates \fBincoming\fR,
+/*	\fBactive\fR and \fBdeferred\fR subdirectories in the current
+/*	directory. For each message, it creates a file with a temporary
+/*	name in \fBincoming\fR, writes and fsyncs the file, and renames
+/*	it to a queue ID name as cleanup(8) does; it renames the file
+/*	into \fBactive\fR as qmgr(8) does; and once the \fBactive\fR
+/*	queue holds more than \fIbacklog\fR messages, it reads the
+/*	oldest message as a delivery agent does, and deletes that
+/*	message or renames it into \fBdeferred\fR. Queue IDs have the
+/*	same format as short Postfix queue IDs.
+/*	After the timed run, the program moves all deferred messages
+/*	back into \fBactive\fR and deletes them, and reports the time
+/*	for this deferred queue flush separately.
+/*
 /*	Options:
 /* .IP \fB-c\fR
 /*	Create and delete files.
+/* .IP "\fB-d \fIdepth\fR (default: 1)"
+/*	With \fB-q\fR, the number of subdirectory levels for hashed
+/*	queues, as with the hash_queue_depth parameter.
+/* .IP "\fB-D \fIpercent\fR (default: 0)"
+/*	With \fB-q\fR, the percentage of messages that are deferred.
+/* .IP "\fB-g \fIgroup\fR (default: 1)"
+/*	With \fB-q\fR, write \fIgroup\fR new messages before
+/*	fsyncing them all (group commit). Postfix itself fsyncs each
+/*	message before it acknowledges the message.
+/* .IP "\fB-h \fIqueue_names\fR (default: deferred)"
+/*	With \fB-q\fR, the names of the queues that are hashed, as
+/*	with the hash_queue_names parameter. Specify an empty string
+/*	to disable hashing.
+/* .IP "\fB-p \fIscanners\fR (default: 0)"
+/*	With \fB-q\fR, run \fIscanners\fR processes that repeatedly
+/*	scan the \fBincoming\fR and \fBdeferred\fR queues, as qmgr(8)
+/*	and showq(8) do, while messages flow through the queue. Each
+/*	process reports the number of completed scans.
+/* .IP \fB-q\fR
+/*	Simulate Postfix queue file-system usage.
 /* .IP \fB-r\fR
 /*	Rename files twice (requires \fB-c\fR).
 /* .IP \fB-s \fIsize\fR
@@ -27,10 +67,8 @@
 /*	Problems are reported to the standard error stream.
 /* BUGS
 /*	The \fB-r\fR option renames files within the same directory.
-/*	For a more realistic simulation, the program should rename files
-/*	<i>between</i> directories, and should also have an option to use
-/*	<i>hashed</i> directories as implemented with, for example, the
-/*	\fBdir_forest\fR(3) module.
+/*	Use \fB-q\fR for a simulation that renames files between
+/*	hashed directories.
 /* LICENSE
 /* .ad
 /* .fi
@@ -50,15 +88,26 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <msg_vstream.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <argv.h>
+#include <dir_forest.h>
+#include <make_dirs.h>
+#include <scan_dir.h>
+#include <myrand.h>
 
 /* Global directory. */
 
 #include <mail_version.h>
+#include <mail_scan_dir.h>
 
 /* rename_file - rename a file */
 
@@ -149,11 +198,312 @@ static void remove_silent(int seq)
     (void) remove(path);
 }
 
+/* elapsed - report elapsed time */
+
+static void elapsed(const char *what, struct timeval * start)
+{
+    struct timeval end;
+
+    GETTIMEOFDAY(&end);
+    if (end.tv_usec < start->tv_usec) {
+	end.tv_sec--;
+	end.tv_usec += 1000000;
+    }
+    printf("%s: %ld.%06ld\n", what,
+	   (long) (end.tv_sec - start->tv_sec),
+	   (long) (end.tv_usec - start->tv_usec));
+    fflush(stdout);
+}
+
+ /*
+  * Queue simulation.
+  */
+#define QUEUE_INCOMING	"incoming"
+#define QUEUE_ACTIVE	"active"
+#define QUEUE_DEFERRED	"deferred"
+
+static ARGV *hash_names;
+static int hash_depth = 1;
+
+/* queue_path - map queue name and queue ID to pathname */
+
+static const char *queue_path(VSTRING *buf, const char *queue, const char *id)
+{
+    char  **cpp;
+
+    vstring_sprintf(buf, "%s/", queue);
+    for (cpp = hash_names->argv; *cpp; cpp++) {
+	if (strcmp(*cpp, queue) == 0) {
+	    vstring_strcat(buf, dir_forest((VSTRING *) 0, id, hash_depth));
+	    break;
+	}
+    }
+    vstring_strcat(buf, id);
+    return (vstring_str(buf));
+}
+
+/* queue_move - rename file, create hashed subdirectory on the fly */
+
+static void queue_move(const char *old_path, const char *new_path)
+{
+    char   *dir;
+    char   *cp;
+
+    /*
+     * Like mail_queue_rename(), create missing subdirectories only when
+     * needed.
+     */
+    if (rename(old_path, new_path) == 0)
+	return;
+    if (errno == ENOENT && (cp = strrchr(new_path, '/')) != 0) {
+	dir = mystrndup(new_path, cp - new_path);
+	if (make_dirs(dir, 0700) < 0)
+	    msg_fatal("create directory %s: %m", dir);
+	myfree(dir);
+	if (rename(old_path, new_path) == 0)
+	    return;
+    }
+    msg_fatal("rename %s to %s: %m", old_path, new_path);
+}
+
+/* queue_rename - move message between queues */
+
+static void queue_rename(const char *id, const char *old_queue,
+			         const char *new_queue)
+{
+    static VSTRING *old_path;
+    static VSTRING *new_path;
+
+    if (old_path == 0) {
+	old_path = vstring_alloc(100);
+	new_path = vstring_alloc(100);
+    }
+    queue_path(old_path, old_queue, id);
+    queue_path(new_path, new_queue, id);
+    queue_move(vstring_str(old_path), vstring_str(new_path));
+}
+
+/* queue_deliver - read message, and delete it */
+
+static void queue_deliver(const char *id, const char *queue)
+{
+    static VSTRING *path;
+    char    buf[BUFSIZ];
+    FILE   *fp;
+
+    if (path == 0)
+	path = vstring_alloc(100);
+    queue_path(path, queue, id);
+    if ((fp = fopen(vstring_str(path), "r")) == 0)
+	msg_fatal("open %s: %m", vstring_str(path));
+    while (fgets(buf, sizeof(buf), fp))
+	 /* void */ ;
+    if (fclose(fp))
+	msg_fatal("fclose: %m");
+    if (remove(vstring_str(path)))
+	msg_fatal("remove %s: %m", vstring_str(path));
+}
+
+/* queue_arrive - create a group of messages, and move them to active */
+
+static void queue_arrive(char **ids, int count, int size)
+{
+    VSTRING *temp_path = vstring_alloc(100);
+    VSTRING *path = vstring_alloc(100);
+    FILE  **fps = (FILE **) mymalloc(sizeof(*fps) * count);
+    char    buf[1024];
+    int     n;
+    int     i;
+
+    /*
+     * Like cleanup(8), create the file under a temporary name in the
+     * incoming queue, and write the content. Defer fsync() until the whole
+     * group is written.
+     */
+    memset(buf, 'x', sizeof(buf));
+    for (n = 0; n < count; n++) {
+	vstring_sprintf(temp_path, "%s/t%s", QUEUE_INCOMING, ids[n]);
+	if ((fps[n] = fopen(vstring_str(temp_path), "w")) == 0)
+	    msg_fatal("open %s: %m", vstring_str(temp_path));
+	for (i = 0; i < size; i++)
+	    if (fwrite(buf, 1, sizeof(buf), fps[n]) != sizeof(buf))
+		msg_fatal("fwrite: %m");
+	if (fflush(fps[n]))
+	    msg_fatal("fflush: %m");
+    }
+
+    /*
+     * Commit the group, give each file its queue ID name, and hand it to
+     * the queue manager.
+     */
+    for (n = 0; n < count; n++) {
+	if (fsync(fileno(fps[n])))
+	    msg_fatal("fsync: %m");
+	if (fclose(fps[n]))
+	    msg_fatal("fclose: %m");
+	vstring_sprintf(temp_path, "%s/t%s", QUEUE_INCOMING, ids[n]);
+	queue_path(path, QUEUE_INCOMING, ids[n]);
+	queue_move(vstring_str(temp_path), vstring_str(path));
+	queue_rename(ids[n], QUEUE_INCOMING, QUEUE_ACTIVE);
+    }
+    myfree((void *) fps);
+    vstring_free(path);
+    vstring_free(temp_path);
+}
+
+static volatile int scan_stop;
+
+/* scan_stop_handler - terminate scanner process */
+
+static void scan_stop_handler(int unused_sig)
+{
+    scan_stop = 1;
+}
+
+/* queue_scanner - scan incoming and deferred queues until terminated */
+
+static void queue_scanner(void)
+{
+    static const char *queues[] = {QUEUE_INCOMING, QUEUE_DEFERRED, 0};
+    const char **qp;
+    SCAN_DIR *scan;
+    long    scans = 0;
+    long    files = 0;
+
+    signal(SIGTERM, scan_stop_handler);
+    while (scan_stop == 0) {
+	for (qp = queues; *qp; qp++) {
+	    scan = scan_dir_open(*qp);
+	    while (mail_scan_dir_next(scan) != 0)
+		files++;
+	}
+	scans++;
+    }
+    printf("scanner %ld: %ld scans, %ld files\n",
+	   (long) getpid(), scans, files);
+    exit(0);
+}
+
+/* queue_stone - simulate the Postfix queue */
+
+static void queue_stone(int op_count, int backlog, int size, int group,
+			        int defer_pct, int scanners)
+{
+    static const char *queues[] = {
+	QUEUE_INCOMING, QUEUE_ACTIVE, QUEUE_DEFERRED, 0};
+    const char **qp;
+    struct timeval start;
+    struct timeval now;
+    ARGV   *deferred = argv_alloc(op_count * (defer_pct / 100.0) + 1);
+    char  **ring;
+    char  **ids;
+    int     ring_size = backlog + group;
+    int     head = 0;
+    int     tail = 0;
+    int     active = 0;
+    pid_t  *scan_pids;
+    int     seq = 0;
+    int     count;
+    int     n;
+
+    for (qp = queues; *qp; qp++)
+	if (make_dirs(*qp, 0700) < 0)
+	    msg_fatal("create directory %s: %m", *qp);
+    ring = (char **) mymalloc(sizeof(*ring) * ring_size);
+    ids = (char **) mymalloc(sizeof(*ids) * group);
+    scan_pids = (pid_t *) mymalloc(sizeof(*scan_pids) * (scanners + 1));
+
+    /*
+     * Start the queue scanners.
+     */
+    for (n = 0; n < scanners; n++) {
+	if ((scan_pids[n] = fork()) < 0)
+	    msg_fatal("fork: %m");
+	if (scan_pids[n] == 0)
+	    queue_scanner();
+    }
+
+    /*
+     * Simulate arrival and delivery of mail messages. Like short Postfix
+     * queue IDs, each ID starts with the microseconds of the time of day,
+     * so that hashed queue subdirectories fill evenly.
+     */
+    GETTIMEOFDAY(&start);
+    while (op_count > 0) {
+	count = (op_count < group ? op_count : group);
+	for (n = 0; n < count; n++) {
+	    GETTIMEOFDAY(&now);
+	    ids[n] = ring[(head + n) % ring_size] = mymalloc(32);
+	    sprintf(ids[n], "%05X%X", (int) now.tv_usec, seq++);
+	}
+	queue_arrive(ids, count, size);
+	head = (head + count) % ring_size;
+	active += count;
+	op_count -= count;
+
+	/*
+	 * Deliver the oldest messages. Move a fraction of them to the
+	 * deferred queue.
+	 */
+	for ( /* void */ ; active > backlog; active--) {
+	    if (defer_pct > 0 && myrand() % 100 < defer_pct) {
+		queue_rename(ring[tail], QUEUE_ACTIVE, QUEUE_DEFERRED);
+		argv_add(deferred, ring[tail], (char *) 0);
+	    } else {
+		queue_deliver(ring[tail], QUEUE_ACTIVE);
+	    }
+	    myfree(ring[tail]);
+	    tail = (tail + 1) % ring_size;
+	}
+    }
+    elapsed("elapsed time", &start);
+
+    /*
+     * Stop the queue scanners.
+     */
+    for (n = 0; n < scanners; n++)
+	(void) kill(scan_pids[n], SIGTERM);
+    while (scanners > 0) {
+	if (waitpid(-1, (WAIT_STATUS_T *) 0, 0) < 0) {
+	    if (errno != EINTR)
+		msg_fatal("waitpid: %m");
+	} else {
+	    scanners--;
+	}
+    }
+
+    /*
+     * Flush the deferred queue.
+     */
+    if (deferred->argc > 0) {
+	GETTIMEOFDAY(&start);
+	for (n = 0; n < deferred->argc; n++) {
+	    queue_rename(deferred->argv[n], QUEUE_DEFERRED, QUEUE_ACTIVE);
+	    queue_deliver(deferred->argv[n], QUEUE_ACTIVE);
+	}
+	printf("deferred messages: %ld\n", (long) deferred->argc);
+	elapsed("deferred flush time", &start);
+    }
+
+    /*
+     * Clean up the backlog.
+     */
+    for ( /* void */ ; active > 0; active--) {
+	queue_deliver(ring[tail], QUEUE_ACTIVE);
+	myfree(ring[tail]);
+	tail = (tail + 1) % ring_size;
+    }
+    argv_free(deferred);
+    myfree((void *) ring);
+    myfree((void *) ids);
+    myfree((void *) scan_pids);
+}
+
 /* usage - explain */
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s [-cr] [-s size] messages directory_entries", myname);
+    msg_fatal("usage: %s [-cqr] [-d depth] [-D percent] [-g group] [-h queue_names] [-p scanners] [-s size] messages directory_entries", myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -162,9 +512,14 @@ int     main(int argc, char **argv)
 {
     int     op_count;
     int     max_file;
-    struct timeval start, end;
+    struct timeval start;
     int     do_rename = 0;
     int     do_create = 0;
+    int     do_queue = 0;
+    int     group = 1;
+    int     defer_pct = 0;
+    int     scanners = 0;
+    char   *hash_queue_names = QUEUE_DEFERRED;
     int     seq;
     int     ch;
     int     size = 2;
@@ -175,11 +530,33 @@ int     main(int argc, char **argv)
     MAIL_VERSION_STAMP_ALLOCATE;
 
     msg_vstream_init(argv[0], VSTREAM_ERR);
-    while ((ch = GETOPT(argc, argv, "crs:")) != EOF) {
+    while ((ch = GETOPT(argc, argv, "cd:D:g:h:p:qrs:")) != EOF) {
 	switch (ch) {
 	case 'c':
 	    do_create++;
 	    break;
+	case 'd':
+	    if ((hash_depth = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
+	case 'D':
+	    if ((defer_pct = atoi(optarg)) < 0 || defer_pct > 100)
+		usage(argv[0]);
+	    break;
+	case 'g':
+	    if ((group = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
+	case 'h':
+	    hash_queue_names = optarg;
+	    break;
+	case 'p':
+	    if ((scanners = atoi(optarg)) < 0)
+		usage(argv[0]);
+	    break;
+	case 'q':
+	    do_queue++;
+	    break;
 	case 'r':
 	    do_rename++;
 	    break;
@@ -192,13 +569,24 @@ int     main(int argc, char **argv)
 	}
     }
 
-    if (argc - optind != 2 || (do_rename && !do_create))
+    if (argc - optind != 2 || (do_rename && !do_create)
+	|| (do_queue && (do_create || do_rename)))
 	usage(argv[0]);
     if ((op_count = atoi(argv[optind])) <= 0)
 	usage(argv[0]);
     if ((max_file = atoi(argv[optind + 1])) <= 0)
 	usage(argv[0]);
 
+    /*
+     * Simulate the Postfix queue.
+     */
+    if (do_queue) {
+	hash_names = argv_split(hash_queue_names, CHARS_COMMA_SP);
+	mysrand((int) getpid());
+	queue_stone(op_count, max_file, size, group, defer_pct, scanners);
+	return (0);
+    }
+
     /*
      * Populate the directory with little files.
      */
@@ -224,14 +612,7 @@ int     main(int argc, char **argv)
 	seq++;
 	op_count--;
     }
-    GETTIMEOFDAY(&end);
-    if (end.tv_usec < start.tv_usec) {
-	end.tv_sec--;
-	end.tv_usec += 1000000;
-    }
-    printf("elapsed time: %ld.%06ld\n",
-	   (long) (end.tv_sec - start.tv_sec),
-	   (long) (end.tv_usec - start.tv_usec));
+    elapsed("elapsed time", &start);
 
     /*
      * Clean up directory fillers.
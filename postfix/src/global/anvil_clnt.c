@@ -66,8 +66,19 @@
 /*	int	*ntls;
 /*	int	*auths;
 /* DESCRIPTION
-/*	anvil_clnt_create() instantiates a local anvil service
-/*	client endpoint.
+/*	anvil_clnt_create() instantiates an anvil service client
+/*	endpoint. The client uses the attr_print_bin(3)
+/*	binary attribute format, and falls back to the text format
+/*	when the anvil server does not support it.
+/*
+/*	The anvil_service_endpoints parameter specifies one or more
+/*	anvil server endpoints. With multiple endpoints, each request
+/*	goes to the endpoint that is selected with a hash of the
+/*	remote client address, so that all counters for a remote
+/*	client are maintained by the same anvil server. This spreads
+/*	the load over multiple anvil processes, and allows Postfix
+/*	instances on different hosts to share counters when they
+/*	specify the same list of inet: endpoints.
 /*
 /*	anvil_clnt_connect() informs the anvil server that a
 /*	remote client has connected, and returns the current
@@ -97,8 +108,7 @@
 /*	anvil_clnt_lookup() returns the current count and rate
 /*	information for the specified client.
 /*
-/*	anvil_clnt_free() destroys a local anvil service client
-/*	endpoint.
+/*	anvil_clnt_free() destroys an anvil service client endpoint.
 /*
 /*	Arguments:
 /* .IP anvil_clnt
@@ -158,6 +168,8 @@
 #include <msg.h>
 #include <attr_clnt.h>
 #include <stringops.h>
+#include <argv.h>
+#include <hash_fnv.h>
 
 /* Global library. */
 
@@ -167,9 +179,23 @@
 
 /* Application specific. */
 
+struct ANVIL_CLNT {
+    ATTR_CLNT **servers;		/* one client per endpoint */
+    int     server_count;		/* number of endpoints */
+};
+
 #define ANVIL_IDENT(service, addr) \
     printable(concatenate(service, ":", addr, (char *) 0), '?')
 
+ /*
+  * All requests for the same remote client go to the same anvil server,
+  * independent of the service name, so that a connect and the matching
+  * disconnect update the same counter.
+  */
+#define ANVIL_SERVER(clnt, addr) \
+    ((clnt)->server_count == 1 ? (clnt)->servers[0] : \
+     (clnt)->servers[hash_fnvz(addr) % (clnt)->server_count])
+
 /* anvil_clnt_handshake - receive server protocol announcement */
 
 static int anvil_clnt_handshake(VSTREAM *stream)
@@ -183,29 +209,43 @@ static int anvil_clnt_handshake(VSTREAM *stream)
 
 ANVIL_CLNT *anvil_clnt_create(void)
 {
-    ATTR_CLNT *anvil_clnt;
+    ANVIL_CLNT *anvil_clnt;
+    ARGV   *endpoints;
+    int     n;
 
     /*
      * Use whatever IPC is preferred for internal use: UNIX-domain sockets or
-     * Solaris streams.
+     * Solaris streams. Multiple endpoints are allowed for load sharing.
      */
-#ifndef VAR_ANVIL_SERVICE
-    anvil_clnt = attr_clnt_create("local:" ANVIL_CLASS "/" ANVIL_SERVICE,
-				  var_ipc_timeout, 0, 0);
-#else
-    anvil_clnt = attr_clnt_create(var_anvil_service, var_ipc_timeout, 0, 0);
-#endif
-    attr_clnt_control(anvil_clnt,
-		      ATTR_CLNT_CTL_HANDSHAKE, anvil_clnt_handshake,
-		      ATTR_CLNT_CTL_END);
-    return ((ANVIL_CLNT *) anvil_clnt);
+    endpoints = argv_split(var_anvil_service, CHARS_COMMA_SP);
+    if (endpoints->argc == 0)
+	argv_add(endpoints, "local:" ANVIL_CLASS "/" ANVIL_SERVICE, (char *) 0);
+    anvil_clnt = (ANVIL_CLNT *) mymalloc(sizeof(*anvil_clnt));
+    anvil_clnt->server_count = endpoints->argc;
+    anvil_clnt->servers = (ATTR_CLNT **)
+	mymalloc(sizeof(*anvil_clnt->servers) * endpoints->argc);
+    for (n = 0; n < endpoints->argc; n++) {
+	anvil_clnt->servers[n] =
+	    attr_clnt_create(endpoints->argv[n], var_ipc_timeout, 0, 0);
+	attr_clnt_control(anvil_clnt->servers[n],
+			  ATTR_CLNT_CTL_HANDSHAKE, anvil_clnt_handshake,
+			  ATTR_CLNT_CTL_BINARY, 1,
+			  ATTR_CLNT_CTL_END);
+    }
+    argv_free(endpoints);
+    return (anvil_clnt);
 }
 
 /* anvil_clnt_free - destroy connection rate service client */
 
 void    anvil_clnt_free(ANVIL_CLNT *anvil_clnt)
 {
-    attr_clnt_free((ATTR_CLNT *) anvil_clnt);
+    int     n;
+
+    for (n = 0; n < anvil_clnt->server_count; n++)
+	attr_clnt_free(anvil_clnt->servers[n]);
+    myfree((void *) anvil_clnt->servers);
+    myfree((void *) anvil_clnt);
 }
 
 /* anvil_clnt_lookup - status query */
@@ -217,7 +257,7 @@ int     anvil_clnt_lookup(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_LOOKUP),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -246,7 +286,7 @@ int     anvil_clnt_connect(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_CONN),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -271,7 +311,7 @@ int     anvil_clnt_mail(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_MAIL),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -295,7 +335,7 @@ int     anvil_clnt_rcpt(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_RCPT),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -319,7 +359,7 @@ int     anvil_clnt_newtls(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_NTLS),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -343,7 +383,7 @@ int     anvil_clnt_newtls_stat(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_NTLS_STAT),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -367,7 +407,7 @@ int     anvil_clnt_auth(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_AUTH),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
@@ -391,7 +431,7 @@ int     anvil_clnt_disconnect(ANVIL_CLNT *anvil_clnt, const char *service,
     char   *ident = ANVIL_IDENT(service, addr);
     int     status;
 
-    if (attr_clnt_request((ATTR_CLNT *) anvil_clnt,
+    if (attr_clnt_request(ANVIL_SERVER(anvil_clnt, addr),
 			  ATTR_FLAG_NONE,	/* Query attributes. */
 			  SEND_ATTR_STR(ANVIL_ATTR_REQ, ANVIL_REQ_DISC),
 			  SEND_ATTR_STR(ANVIL_ATTR_IDENT, ident),
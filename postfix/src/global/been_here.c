@@ -76,6 +76,13 @@
 /* .RS
 /* .IP BH_FLAG_FOLD
 /*	Enable case-insensitive lookup.
+/* .IP BH_FLAG_DIGEST
+/*	Remember a hash_fnv(3) fingerprint of each string instead
+/*	of a copy, in an open-addressing table with 8 to 16 bytes
+/*	per entry for 64-bit fingerprints. This is not exact: a
+/*	string may be reported as found when a different string has
+/*	the same fingerprint. With 64-bit fingerprints and 100000
+/*	strings, the probability of that is less than one in 10^9.
 /* .IP BH_FLAG_NONE
 /*	A manifest constant that requests no special processing.
 /* .RE
@@ -106,6 +113,7 @@
 #include "sys_defs.h"
 #include <stdlib.h>			/* 44BSD stdarg.h uses abort() */
 #include <stdarg.h>
+#include <string.h>
 
 /* Utility library. */
 
@@ -114,6 +122,7 @@
 #include <htable.h>
 #include <vstring.h>
 #include <stringops.h>
+#include <hash_fnv.h>
 
 /* Global library. */
 
@@ -121,6 +130,98 @@
 
 #define STR(x)	vstring_str(x)
 
+ /*
+  * Fingerprint table with open addressing and linear probing. Zero marks an
+  * unused slot. The size is a power of two, and the table is at most half
+  * full.
+  */
+struct BH_DIGESTS {
+    HASH_FNV_T *slots;			/* fingerprints */
+    ssize_t size;			/* number of slots */
+    ssize_t used;			/* slots in use */
+};
+
+#define BH_DIGEST_MIN_SIZE	64
+#define BH_DIGEST_SLOT(dp, fp)	((ssize_t) ((fp) & ((dp)->size - 1)))
+#define BH_DIGEST_NEXT(dp, n)	(((n) + 1) & ((dp)->size - 1))
+
+/* bh_digest_key - compute fingerprint */
+
+static HASH_FNV_T bh_digest_key(const char *string)
+{
+    HASH_FNV_T fp = hash_fnvz(string);
+
+    return (fp ? fp : 1);
+}
+
+/* bh_digest_find - find fingerprint, or slot for insertion */
+
+static ssize_t bh_digest_find(struct BH_DIGESTS *dp, HASH_FNV_T fp)
+{
+    ssize_t n;
+
+    for (n = BH_DIGEST_SLOT(dp, fp); dp->slots[n] != 0 && dp->slots[n] != fp;
+	 n = BH_DIGEST_NEXT(dp, n))
+	 /* void */ ;
+    return (n);
+}
+
+/* bh_digest_alloc - allocate empty fingerprint table */
+
+static void bh_digest_alloc(struct BH_DIGESTS *dp, ssize_t size)
+{
+    dp->slots = (HASH_FNV_T *) mymalloc(size * sizeof(*dp->slots));
+    memset((void *) dp->slots, 0, size * sizeof(*dp->slots));
+    dp->size = size;
+    dp->used = 0;
+}
+
+/* bh_digest_enter - add fingerprint, table must not have it */
+
+static void bh_digest_enter(struct BH_DIGESTS *dp, HASH_FNV_T fp)
+{
+    HASH_FNV_T *old_slots;
+    ssize_t old_size;
+    ssize_t n;
+
+    if (2 * (dp->used + 1) > dp->size) {
+	old_slots = dp->slots;
+	old_size = dp->size;
+	bh_digest_alloc(dp, 2 * old_size);
+	for (n = 0; n < old_size; n++)
+	    if (old_slots[n] != 0)
+		bh_digest_enter(dp, old_slots[n]);
+	myfree((void *) old_slots);
+    }
+    dp->slots[bh_digest_find(dp, fp)] = fp;
+    dp->used += 1;
+}
+
+/* bh_digest_delete - remove fingerprint, table must have it */
+
+static void bh_digest_delete(struct BH_DIGESTS *dp, HASH_FNV_T fp)
+{
+    ssize_t hole = bh_digest_find(dp, fp);
+    ssize_t n;
+    ssize_t home;
+
+    /*
+     * Move later entries in the same cluster back into the hole, unless
+     * that would put them before their home slot.
+     */
+    dp->slots[hole] = 0;
+    dp->used -= 1;
+    for (n = BH_DIGEST_NEXT(dp, hole); dp->slots[n] != 0;
+	 n = BH_DIGEST_NEXT(dp, n)) {
+	home = BH_DIGEST_SLOT(dp, dp->slots[n]);
+	if (((n - home) & (dp->size - 1)) >= ((n - hole) & (dp->size - 1))) {
+	    dp->slots[hole] = dp->slots[n];
+	    dp->slots[n] = 0;
+	    hole = n;
+	}
+    }
+}
+
 /* been_here_init - initialize duplicate filter */
 
 BH_TABLE *been_here_init(int limit, int flags)
@@ -130,7 +231,15 @@ BH_TABLE *been_here_init(int limit, int flags)
     dup_filter = (BH_TABLE *) mymalloc(sizeof(*dup_filter));
     dup_filter->limit = limit;
     dup_filter->flags = flags;
-    dup_filter->table = htable_create(0);
+    if (flags & BH_FLAG_DIGEST) {
+	dup_filter->table = 0;
+	dup_filter->digests =
+	    (struct BH_DIGESTS *) mymalloc(sizeof(*dup_filter->digests));
+	bh_digest_alloc(dup_filter->digests, BH_DIGEST_MIN_SIZE);
+    } else {
+	dup_filter->table = htable_create(0);
+	dup_filter->digests = 0;
+    }
     return (dup_filter);
 }
 
@@ -138,7 +247,12 @@ BH_TABLE *been_here_init(int limit, int flags)
 
 void    been_here_free(BH_TABLE *dup_filter)
 {
-    htable_free(dup_filter->table, (void (*) (void *)) 0);
+    if (dup_filter->digests) {
+	myfree((void *) dup_filter->digests->slots);
+	myfree((void *) dup_filter->digests);
+    } else {
+	htable_free(dup_filter->table, (void (*) (void *)) 0);
+    }
     myfree((void *) dup_filter);
 }
 
@@ -191,7 +305,18 @@ int     been_here_fixed(BH_TABLE *dup_filter, const char *string)
     /*
      * Do the duplicate check.
      */
-    if (htable_locate(dup_filter->table, lookup_key) != 0) {
+    if (dup_filter->digests) {
+	struct BH_DIGESTS *dp = dup_filter->digests;
+	HASH_FNV_T fp = bh_digest_key(lookup_key);
+
+	if (dp->slots[bh_digest_find(dp, fp)] != 0) {
+	    status = 1;
+	} else {
+	    if (dup_filter->limit <= 0 || dup_filter->limit > dp->used)
+		bh_digest_enter(dp, fp);
+	    status = 0;
+	}
+    } else if (htable_locate(dup_filter->table, lookup_key) != 0) {
 	status = 1;
     } else {
 	if (dup_filter->limit <= 0
@@ -260,7 +385,11 @@ int     been_here_check_fixed(BH_TABLE *dup_filter, const char *string)
     /*
      * Do the duplicate check.
      */
-    status = (htable_locate(dup_filter->table, lookup_key) != 0);
+    if (dup_filter->digests)
+	status = (dup_filter->digests->slots[bh_digest_find(dup_filter->digests,
+				       bh_digest_key(lookup_key))] != 0);
+    else
+	status = (htable_locate(dup_filter->table, lookup_key) != 0);
     if (msg_verbose)
 	msg_info("been_here_check: %s: %d", string, status);
 
@@ -322,8 +451,13 @@ int     been_here_drop_fixed(BH_TABLE *dup_filter, const char *string)
     /*
      * Drop the filter entry.
      */
-    if ((status = been_here_check_fixed(dup_filter, lookup_key)) != 0)
-	htable_delete(dup_filter->table, lookup_key, (void (*) (void *)) 0);
+    if ((status = been_here_check_fixed(dup_filter, lookup_key)) != 0) {
+	if (dup_filter->digests)
+	    bh_digest_delete(dup_filter->digests, bh_digest_key(lookup_key));
+	else
+	    htable_delete(dup_filter->table, lookup_key,
+			  (void (*) (void *)) 0);
+    }
 
     /*
      * Cleanup.
@@ -23,11 +23,13 @@ typedef struct {
     int     limit;			/* ceiling, zero for none */
     int     flags;			/* see below */
     struct HTABLE *table;
+    struct BH_DIGESTS *digests;		/* BH_FLAG_DIGEST */
 } BH_TABLE;
 
 #define BH_BOUND_NONE	0		/* no upper bound */
 #define BH_FLAG_NONE	0		/* no special processing */
 #define BH_FLAG_FOLD	(1<<0)		/* fold case */
+#define BH_FLAG_DIGEST	(1<<1)		/* remember fingerprints */
 
 extern BH_TABLE *been_here_init(int, int);
 extern void been_here_free(BH_TABLE *);
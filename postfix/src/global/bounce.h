@@ -46,6 +46,7 @@ extern void bounce_client_init(const char *, const char *);
 #define BOUNCE_CMD_VERP		3	/* send log, verp style */
 #define BOUNCE_CMD_ONE		4	/* send one recipient notice */
 #define BOUNCE_CMD_TRACE	5	/* send delivery record */
+#define BOUNCE_CMD_APPEND_LIST	6	/* append multiple records */
 
  /*
   * Macros to make obscure code more readable.
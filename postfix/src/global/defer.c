@@ -6,6 +6,10 @@
 /* SYNOPSIS
 /*	#include <defer.h>
 /*
+/*	void	defer_batch_begin()
+/*
+/*	void	defer_batch_end()
+/*
 /*	int	defer_append(flags, id, stats, rcpt, relay, dsn)
 /*	int	flags;
 /*	const char *id;
@@ -62,6 +66,15 @@
 /*	which maintains a per-message logfile with status records for
 /*	each recipient whose delivery is deferred, and the dsn_text why.
 /*
+/*	defer_batch_begin() starts collecting defer logfile records
+/*	in memory. defer_batch_end() sends collected records to the
+/*	defer service, and stops collecting records. Collected records
+/*	for the same queue file are sent with one request, and the
+/*	defer service updates the logfile with one fsync() call.
+/*	Collected records are also sent before a request for a
+/*	different queue file or with different flags, when too many
+/*	records are pending, and before defer_flush() or defer_warn().
+/*
 /*	defer_append() appends a record to the per-message defer log,
 /*	with the dsn_text for delayed delivery to the named rcpt,
 /*	updates the address verification service, or updates a message
@@ -169,6 +182,7 @@
 
 #include <msg.h>
 #include <vstring.h>
+#include <mymalloc.h>
 
 /* Global library. */
 
@@ -183,10 +197,125 @@
 #include <dsn_print.h>
 #include <log_adhoc.h>
 #include <trace.h>
+#include <recipient_list.h>
 #include <defer.h>
 
 #define STR(x)	vstring_str(x)
 
+ /*
+  * Defer logfile records that are collected with defer_batch_begin(). These
+  * are sent to the defer service when the batch is full, when a record for
+  * a different queue file or with different flags is added, and with
+  * defer_batch_end(). defer_append() always returns a non-zero result, so
+  * that callers cannot tell the difference.
+  */
+#define DEFER_BATCH_LIMIT	100
+
+static int defer_batch_enabled;
+static int defer_batch_flags;
+static VSTRING *defer_batch_id;
+static RECIPIENT_LIST defer_batch_rcpt;
+static DSN *defer_batch_dsn[DEFER_BATCH_LIMIT];
+
+/* defer_batch_print - send collected records */
+
+static int defer_batch_print(ATTR_PRINT_COMMON_FN print_fn, VSTREAM *fp,
+			             int flags, const void *unused_ptr)
+{
+    int     ret;
+    int     n;
+
+    ret = print_fn(fp, flags | ATTR_FLAG_MORE,
+		   SEND_ATTR_INT(MAIL_ATTR_RCPT_COUNT, defer_batch_rcpt.len),
+		   ATTR_TYPE_END);
+    for (n = 0; ret == 0 && n < defer_batch_rcpt.len; n++)
+	if ((ret = rcpt_print(print_fn, fp, flags,
+			      (void *) (defer_batch_rcpt.info + n))) == 0)
+	    ret = dsn_print(print_fn, fp, flags, (void *) defer_batch_dsn[n]);
+    return (ret);
+}
+
+/* defer_batch_send - send and discard collected records */
+
+static void defer_batch_send(void)
+{
+    const char *id = STR(defer_batch_id);
+    int     status;
+    int     n;
+
+    if (defer_batch_rcpt.len == 0)
+	return;
+
+    /*
+     * A single record is sent with the traditional request.
+     */
+    if (defer_batch_rcpt.len == 1)
+	status = mail_command_client(MAIL_CLASS_PRIVATE, var_defer_service,
+				     MAIL_ATTR_PROTO_BOUNCE,
+			   SEND_ATTR_INT(MAIL_ATTR_NREQ, BOUNCE_CMD_APPEND),
+				SEND_ATTR_INT(MAIL_ATTR_FLAGS, defer_batch_flags),
+				     SEND_ATTR_STR(MAIL_ATTR_QUEUEID, id),
+				     SEND_ATTR_FUNC(rcpt_print,
+				       (const void *) defer_batch_rcpt.info),
+				     SEND_ATTR_FUNC(dsn_print,
+					  (const void *) defer_batch_dsn[0]),
+				     ATTR_TYPE_END);
+    else
+	status = mail_command_client(MAIL_CLASS_PRIVATE, var_defer_service,
+				     MAIL_ATTR_PROTO_BOUNCE,
+		      SEND_ATTR_INT(MAIL_ATTR_NREQ, BOUNCE_CMD_APPEND_LIST),
+				SEND_ATTR_INT(MAIL_ATTR_FLAGS, defer_batch_flags),
+				     SEND_ATTR_STR(MAIL_ATTR_QUEUEID, id),
+				     SEND_ATTR_FUNC(defer_batch_print,
+						    (const void *) 0),
+				     ATTR_TYPE_END);
+    if (status != 0)
+	msg_warn("%s: %s service failure", id, var_defer_service);
+
+    for (n = 0; n < defer_batch_rcpt.len; n++)
+	dsn_free(defer_batch_dsn[n]);
+    recipient_list_free(&defer_batch_rcpt);
+    recipient_list_init(&defer_batch_rcpt, RCPT_LIST_INIT_STATUS);
+}
+
+/* defer_batch_add - collect one record */
+
+static void defer_batch_add(int flags, const char *id, RECIPIENT *rcpt,
+			            DSN *dsn)
+{
+    if (defer_batch_rcpt.len > 0
+	&& (defer_batch_rcpt.len >= DEFER_BATCH_LIMIT
+	    || flags != defer_batch_flags
+	    || strcmp(id, STR(defer_batch_id)) != 0))
+	defer_batch_send();
+    defer_batch_flags = flags;
+    vstring_strcpy(defer_batch_id, id);
+    defer_batch_dsn[defer_batch_rcpt.len] = DSN_COPY(dsn);
+    recipient_list_add(&defer_batch_rcpt, rcpt->offset, rcpt->dsn_orcpt,
+		       rcpt->dsn_notify, rcpt->orig_addr, rcpt->address);
+}
+
+/* defer_batch_begin - start collecting records */
+
+void    defer_batch_begin(void)
+{
+    if (defer_batch_id == 0) {
+	defer_batch_id = vstring_alloc(20);
+	recipient_list_init(&defer_batch_rcpt, RCPT_LIST_INIT_STATUS);
+    }
+    defer_batch_enabled = 1;
+}
+
+/* defer_batch_end - send collected records, stop collecting */
+
+void    defer_batch_end(void)
+{
+    if (defer_batch_enabled) {
+	defer_batch_send();
+	defer_batch_enabled = 0;
+    }
+}
+
 /* defer_append - defer message delivery */
 
 int     defer_append(int flags, const char *id, MSG_STATS *stats,
@@ -261,7 +390,9 @@ int     defer_append_intern(int flags, const char *id, MSG_STATS *stats,
 	 */
 	my_dsn.action = "delayed";
 
-	if (mail_command_client(MAIL_CLASS_PRIVATE, var_defer_service,
+	if (defer_batch_enabled)
+	    defer_batch_add(flags, id, rcpt, &my_dsn);
+	else if (mail_command_client(MAIL_CLASS_PRIVATE, var_defer_service,
 				MAIL_ATTR_PROTO_BOUNCE,
 			   SEND_ATTR_INT(MAIL_ATTR_NREQ, BOUNCE_CMD_APPEND),
 				SEND_ATTR_INT(MAIL_ATTR_FLAGS, flags),
@@ -306,6 +437,8 @@ int     defer_flush(int flags, const char *queue, const char *id,
 {
     flags |= BOUNCE_FLAG_DELRCPT;
 
+    if (defer_batch_enabled)
+	defer_batch_send();
     if (mail_command_client(MAIL_CLASS_PRIVATE, var_defer_service,
 			    MAIL_ATTR_PROTO_BOUNCE,
 			    SEND_ATTR_INT(MAIL_ATTR_NREQ, BOUNCE_CMD_FLUSH),
@@ -331,6 +464,8 @@ int     defer_warn(int flags, const char *queue, const char *id,
 		           const char *encoding, int smtputf8,
 		         const char *sender, const char *envid, int dsn_ret)
 {
+    if (defer_batch_enabled)
+	defer_batch_send();
     if (mail_command_client(MAIL_CLASS_PRIVATE, var_defer_service,
 			    MAIL_ATTR_PROTO_BOUNCE,
 			    SEND_ATTR_INT(MAIL_ATTR_NREQ, BOUNCE_CMD_WARN),
@@ -19,6 +19,8 @@
  /*
   * External interface.
   */
+extern void defer_batch_begin(void);
+extern void defer_batch_end(void);
 extern int defer_append(int, const char *, MSG_STATS *, RECIPIENT *,
 			        const char *, DSN *);
 extern int defer_flush(int, const char *, const char *, const char *, int,
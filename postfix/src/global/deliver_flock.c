@@ -10,12 +10,25 @@
 /*	int	fd;
 /*	int	lock_style;
 /*	VSTRING	*why;
+/*
+/*	int	deliver_lock_retry(waited)
+/*	long	*waited;
 /* DESCRIPTION
 /*	deliver_flock() sets one exclusive kernel lock on an open file,
 /*	for example in order to deliver mail.
 /*	It performs several non-blocking attempts to acquire an exclusive
 /*	lock before giving up.
 /*
+/*	deliver_lock_retry() sleeps before the next attempt to acquire
+/*	a lock, and returns non-zero, or returns zero when the caller
+/*	should give up. The caller initializes \fIwaited\fR to zero
+/*	before its first attempt. The first delay is short, and each
+/*	later delay equals the time waited so far, up to the
+/*	deliver_lock_delay limit, so that short-lived contention
+/*	costs milliseconds instead of seconds. The total time is
+/*	bounded by (deliver_lock_attempts - 1) * deliver_lock_delay,
+/*	as before.
+/*
 /*	Arguments:
 /* .IP fd
 /*	A file descriptor that is associated with an open file.
@@ -61,20 +74,40 @@
 /* Application-specific. */
 
 #define MILLION	1000000
+#define MIN_DELAY	10000		/* first retry, microseconds */
+
+/* deliver_lock_retry - back off before next lock attempt */
+
+int     deliver_lock_retry(long *waited)
+{
+    long    max_delay = (long) var_flock_delay * MILLION;
+    long    budget = (long) (var_flock_tries - 1) * max_delay;
+    long    delay;
+
+    if (*waited >= budget)
+	return (0);
+    delay = (*waited < MIN_DELAY ? MIN_DELAY : *waited);
+    if (delay > max_delay)
+	delay = max_delay;
+    if (delay > budget - *waited)
+	delay = budget - *waited;
+    rand_sleep(delay, delay / 2);
+    *waited += delay;
+    return (1);
+}
 
 /* deliver_flock - lock open file for mail delivery */
 
 int     deliver_flock(int fd, int lock_style, VSTRING *why)
 {
-    int     i;
+    long    waited = 0;
 
-    for (i = 1; /* void */ ; i++) {
+    for (;;) {
 	if (myflock(fd, lock_style,
 		    MYFLOCK_OP_EXCLUSIVE | MYFLOCK_OP_NOWAIT) == 0)
 	    return (0);
-	if (i >= var_flock_tries)
+	if (deliver_lock_retry(&waited) == 0)
 	    break;
-	rand_sleep(var_flock_delay * MILLION, var_flock_delay * MILLION / 2);
     }
     if (why)
 	vstring_sprintf(why, "unable to lock for exclusive access: %m");
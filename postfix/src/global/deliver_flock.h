@@ -21,6 +21,7 @@
   * External interface.
   */
 extern int deliver_flock(int, int, VSTRING *);
+extern int deliver_lock_retry(long *);
 
 /* LICENSE
 /* .ad
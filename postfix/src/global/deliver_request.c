@@ -49,8 +49,10 @@
 /*
 /*	deliver_request_read() reads a client message delivery request,
 /*	opens the queue file, and acquires a shared lock.
+/*	The file must be a regular file with mode 0700.
 /*	A null result means that the client sent bad information or that
-/*	it went away unexpectedly.
+/*	it went away unexpectedly. Otherwise, defer logfile records
+/*	are collected in memory; see defer_batch_begin(3).
 /*
 /*	The \fBflags\fR structure member is the bit-wise OR of zero or more
 /*	of the following:
@@ -73,7 +75,8 @@
 /*	when all delivery to the destination in \fInexthop\fR should
 /*	be deferred. This member is passed to dsn_free().
 /*
-/*	deliver_request_done() reports the delivery status back to the
+/*	deliver_request_done() sends collected defer logfile records
+/*	to the defer service, reports the delivery status back to the
 /*	client, including the optional \fIhop_status\fR etc. information,
 /*	closes the queue file,
 /*	and destroys the DELIVER_REQUEST structure. The result is
@@ -106,6 +109,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 /* Utility library. */
 
@@ -118,14 +122,15 @@
 
 /* Global library. */
 
+#include "mail_params.h"
 #include "mail_queue.h"
 #include "mail_proto.h"
-#include "mail_open_ok.h"
 #include "recipient_list.h"
 #include "dsn.h"
 #include "dsn_print.h"
 #include "deliver_request.h"
 #include "rcpt_buf.h"
+#include "defer.h"
 
 /* deliver_request_initial - send initial status code */
 
@@ -193,7 +198,6 @@ static int deliver_request_final(VSTREAM *stream, DELIVER_REQUEST *request,
 static int deliver_request_get(VSTREAM *stream, DELIVER_REQUEST *request)
 {
     const char *myname = "deliver_request_get";
-    const char *path;
     struct stat st;
     static VSTRING *queue_name;
     static VSTRING *queue_id;
@@ -276,8 +280,11 @@ static int deliver_request_get(VSTREAM *stream, DELIVER_REQUEST *request)
 	msg_warn("%s: error receiving common attributes", myname);
 	return (-1);
     }
-    if (mail_open_ok(vstring_str(queue_name),
-		     vstring_str(queue_id), &st, &path) == 0)
+    if (mail_queue_name_ok(vstring_str(queue_name)) == 0) {
+	msg_warn("bad mail queue name: %s", vstring_str(queue_name));
+	return (-1);
+    }
+    if (mail_queue_id_ok(vstring_str(queue_id)) == 0)
 	return (-1);
 
     /* Don't override hand-off time after deliver_pass() delegation. */
@@ -344,23 +351,66 @@ static int deliver_request_get(VSTREAM *stream, DELIVER_REQUEST *request)
      * system running out of resources. Instead of throwing away mail, we're
      * raising a fatal error which forces the mail system to back off, and
      * retry later.
+     * 
+     * Look up the file attributes after opening the file, instead of with
+     * mail_open_ok() before opening it. This saves one queue file path
+     * lookup per delivery request, and is not subject to a race between
+     * the two lookups. Don't follow a symlink where a queue file should be.
      */
 #define DELIVER_LOCK_MODE (MYFLOCK_OP_SHARED | MYFLOCK_OP_NOWAIT)
 
-    request->fp =
-	mail_queue_open(request->queue_name, request->queue_id, O_RDWR, 0);
+#ifdef O_NOFOLLOW
+#define DELIVER_OPEN_FLAGS (O_RDWR | O_NOFOLLOW)
+#else
+#define DELIVER_OPEN_FLAGS O_RDWR
+#endif
+
+    request->fp = mail_queue_open(request->queue_name, request->queue_id,
+				  DELIVER_OPEN_FLAGS, 0);
     if (request->fp == 0) {
+	if (errno == ELOOP) {
+	    msg_warn("%s %s: not a regular file",
+		     request->queue_name, request->queue_id);
+	    return (-1);
+	}
 	if (errno != ENOENT)
 	    msg_fatal("open %s %s: %m", request->queue_name, request->queue_id);
 	msg_warn("open %s %s: %m", request->queue_name, request->queue_id);
 	return (-1);
     }
+    if (fstat(vstream_fileno(request->fp), &st) < 0)
+	msg_fatal("fstat %s: %m", VSTREAM_PATH(request->fp));
+    if (!S_ISREG(st.st_mode)) {
+	msg_warn("%s: uid %ld: not a regular file",
+		 VSTREAM_PATH(request->fp), (long) st.st_uid);
+	return (-1);
+    }
+    if ((st.st_mode & S_IRWXU) != MAIL_QUEUE_STAT_READY)
+	return (-1);
     if (msg_verbose)
 	msg_info("%s: file %s", myname, VSTREAM_PATH(request->fp));
     if (myflock(vstream_fileno(request->fp), INTERNAL_LOCK, DELIVER_LOCK_MODE) < 0)
 	msg_fatal("shared lock %s: %m", VSTREAM_PATH(request->fp));
     close_on_exec(vstream_fileno(request->fp), CLOSE_ON_EXEC);
 
+    /*
+     * Read the message content in large blocks. A large message has one
+     * queue file record per line; with the default buffer size, reading the
+     * body would take one read() system call per 4096 bytes.
+     * 
+     * XXX Do not replace this with a memory-mapped stream. Delivery agents
+     * update the queue file through this stream (deliver_completed() marks
+     * recipients as done), a memory stream has no file descriptor for the
+     * shared lock that keeps the queue manager away, and every rec_get()
+     * caller expects its own copy of the record content in a VSTRING that
+     * it may modify. A mapping would save one memory copy per record, but
+     * not a system call.
+     */
+    if (var_msg_stream_bufsize > 0)
+	vstream_control(request->fp,
+		      CA_VSTREAM_CTL_BUFSIZE((ssize_t) var_msg_stream_bufsize),
+			CA_VSTREAM_CTL_END);
+
     return (0);
 }
 
@@ -468,6 +518,8 @@ DELIVER_REQUEST *deliver_request_read(VSTREAM *stream)
     if (deliver_request_get(stream, request) < 0) {
 	deliver_request_done(stream, request, XXX_DEFER_STATUS);
 	request = 0;
+    } else {
+	defer_batch_begin();
     }
     return (request);
 }
@@ -478,6 +530,11 @@ int     deliver_request_done(VSTREAM *stream, DELIVER_REQUEST *request, int stat
 {
     int     err;
 
+    /*
+     * Update the defer logfile before the queue manager learns that this
+     * request is finished.
+     */
+    defer_batch_end();
     err = deliver_request_final(stream, request, status);
     deliver_request_free(request);
     return (err);
@@ -81,6 +81,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
 
 #ifdef STRCASECMP_IN_STRINGS_H
 #include <strings.h>
@@ -109,6 +110,7 @@
 #include <dict.h>
 #include <stringops.h>
 #include <binhash.h>
+#include <ctable.h>
 #include <name_code.h>
 
 /* Global library. */
@@ -203,10 +205,31 @@ typedef struct {
 #endif
     BINHASH_INFO *ht;			/* hash entry for LDAP connection */
     LDAP   *ld;				/* duplicated from conn->conn_ld */
+    int     cache_ttl;			/* result cache time to live */
+    int     cache_size;			/* result cache entry limit */
+    int     cache_flags;		/* dict flags for cached results */
+    CTABLE *cache;			/* result cache, or null */
 } DICT_LDAP;
 
+ /*
+  * Result cache entry. Lookup errors are not reused.
+  */
+typedef struct {
+    char   *value;			/* lookup result or null */
+    int     error;			/* lookup error */
+    time_t  expires;			/* entry expiration time */
+} DICT_LDAP_CACHE_ENT;
+
+static int dict_ldap_cache_new;		/* entry was created just now */
+
 #define DICT_LDAP_CONN(d) ((LDAP_CONN *)((d)->ht->value))
 
+ /*
+  * Upper bound on the number of DN or URL searches that are outstanding at
+  * the same time, per level of special result attribute expansion.
+  */
+#define DICT_LDAP_PIPELINE	20
+
 #define DICT_LDAP_UNBIND_RETURN(__ld, __err, __ret) do { \
 	dict_ldap_unbind(__ld); \
 	(__ld) = 0; \
@@ -470,15 +493,12 @@ static int dict_ldap_bind_st(DICT_LDAP *dict_ldap)
     return (rc == LDAP_SUCCESS ? err : rc);
 }
 
-/* search_st - Synchronous search with timeout */
+/* search_start - Start asynchronous search with timeout */
 
-static int search_st(LDAP *ld, char *base, int scope, char *query,
-		             char **attrs, int timeout, LDAPMessage **res)
+static int search_start(LDAP *ld, char *base, int scope, char *query,
+			        char **attrs, int timeout, int *msgid)
 {
     struct timeval mytimeval;
-    int     msgid;
-    int     rc;
-    int     err;
 
     mytimeval.tv_sec = timeout;
     mytimeval.tv_usec = 0;
@@ -486,10 +506,16 @@ static int search_st(LDAP *ld, char *base, int scope, char *query,
 #define WANTVALS 0
 #define USE_SIZE_LIM_OPT -1			/* Any negative value will do */
 
-    if ((rc = ldap_search_ext(ld, base, scope, query, attrs, WANTVALS, 0, 0,
-			      &mytimeval, USE_SIZE_LIM_OPT,
-			      &msgid)) != LDAP_SUCCESS)
-	return rc;
+    return (ldap_search_ext(ld, base, scope, query, attrs, WANTVALS, 0, 0,
+			    &mytimeval, USE_SIZE_LIM_OPT, msgid));
+}
+
+/* search_finish - Wait for search result with timeout */
+
+static int search_finish(LDAP *ld, int msgid, int timeout, LDAPMessage **res)
+{
+    int     rc;
+    int     err;
 
     if ((rc = dict_ldap_result(ld, msgid, timeout, res)) != LDAP_SUCCESS)
 	return (rc);
@@ -499,6 +525,20 @@ static int search_st(LDAP *ld, char *base, int scope, char *query,
     return (err != LDAP_SUCCESS ? err : rc);
 }
 
+/* search_st - Synchronous search with timeout */
+
+static int search_st(LDAP *ld, char *base, int scope, char *query,
+		             char **attrs, int timeout, LDAPMessage **res)
+{
+    int     msgid;
+    int     rc;
+
+    if ((rc = search_start(ld, base, scope, query, attrs, timeout,
+			   &msgid)) != LDAP_SUCCESS)
+	return (rc);
+    return (search_finish(ld, msgid, timeout, res));
+}
+
 #ifdef LDAP_API_FEATURE_X_OPENLDAP
 static int dict_ldap_set_tls_options(DICT_LDAP *dict_ldap)
 {
@@ -981,6 +1021,11 @@ static void dict_ldap_get_values(DICT_LDAP *dict_ldap, LDAPMessage *res,
     struct berval **vals;
     int     valcount;
     LDAPURLDesc *url;
+    int     msgids[DICT_LDAP_PIPELINE];
+    int     search_rc[DICT_LDAP_PIPELINE];
+    char   *search_dn[DICT_LDAP_PIPELINE];
+    int     pending;
+    int     k;
     const char *myname = "dict_ldap_get_values";
     int     is_leaf = 1;		/* No recursion via this entry */
     int     is_terminal = 0;		/* No expansion via this entry */
@@ -1124,70 +1169,104 @@ static void dict_ldap_get_values(DICT_LDAP *dict_ldap, LDAPMessage *res,
 	    } else if (recursion < dict_ldap->recursion_limit
 		       && dict_ldap->result_attributes->argv[i]) {
 		/* Special result attribute */
-		for (i = 0; i < valcount; i++) {
-		    if (ldap_is_ldap_url(vals[i]->bv_val)) {
-			rc = ldap_url_parse(vals[i]->bv_val, &url);
-			if (rc == 0) {
-			    if ((attrs = url_attrs(dict_ldap, url)) != 0) {
-				if (msg_verbose)
-				    msg_info("%s[%d]: looking up URL %s",
-					     myname, recursion,
-					     vals[i]->bv_val);
-				rc = search_st(dict_ldap->ld, url->lud_dn,
-					       url->lud_scope,
-					       url->lud_filter,
-					       attrs, dict_ldap->timeout,
-					       &resloop);
-			    }
-			    ldap_free_urldesc(url);
-			    if (attrs == 0) {
-				if (msg_verbose)
-				    msg_info("%s[%d]: skipping URL %s: no "
-					     "pertinent attributes", myname,
-					     recursion, vals[i]->bv_val);
-				continue;
+		for (i = 0; i < valcount && dict_ldap->dict.error == 0;
+		     /* void */ ) {
+
+		    /*
+		     * Start the searches for up to DICT_LDAP_PIPELINE values
+		     * before waiting for the first result, so that the
+		     * server round trips overlap. The results are processed
+		     * in the original order, so the lookup result does not
+		     * change.
+		     */
+		    for (pending = 0;
+			 i < valcount && pending < DICT_LDAP_PIPELINE; i++) {
+			if (ldap_is_ldap_url(vals[i]->bv_val)) {
+			    rc = ldap_url_parse(vals[i]->bv_val, &url);
+			    if (rc == 0) {
+				if ((attrs = url_attrs(dict_ldap, url)) != 0) {
+				    if (msg_verbose)
+					msg_info("%s[%d]: looking up URL %s",
+						 myname, recursion,
+						 vals[i]->bv_val);
+				    rc = search_start(dict_ldap->ld,
+						      url->lud_dn,
+						      url->lud_scope,
+						      url->lud_filter,
+						      attrs, dict_ldap->timeout,
+						      &msgids[pending]);
+				}
+				ldap_free_urldesc(url);
+				if (attrs == 0) {
+				    if (msg_verbose)
+					msg_info("%s[%d]: skipping URL %s: no "
+						 "pertinent attributes", myname,
+						 recursion, vals[i]->bv_val);
+				    continue;
+				}
+			    } else {
+				msg_warn("%s[%d]: malformed URL %s: %s(%d)",
+					 myname, recursion, vals[i]->bv_val,
+					 ldap_err2string(rc), rc);
+				dict_ldap->dict.error = DICT_ERR_RETRY;
+				break;
 			    }
 			} else {
-			    msg_warn("%s[%d]: malformed URL %s: %s(%d)",
-				     myname, recursion, vals[i]->bv_val,
-				     ldap_err2string(rc), rc);
-			    dict_ldap->dict.error = DICT_ERR_RETRY;
-			    break;
+			    if (msg_verbose)
+				msg_info("%s[%d]: looking up DN %s",
+					 myname, recursion, vals[i]->bv_val);
+			    rc = search_start(dict_ldap->ld, vals[i]->bv_val,
+					      LDAP_SCOPE_BASE, "objectclass=*",
+					      dict_ldap->result_attributes->argv,
+					      dict_ldap->timeout,
+					      &msgids[pending]);
 			}
-		    } else {
-			if (msg_verbose)
-			    msg_info("%s[%d]: looking up DN %s",
-				     myname, recursion, vals[i]->bv_val);
-			rc = search_st(dict_ldap->ld, vals[i]->bv_val,
-				       LDAP_SCOPE_BASE, "objectclass=*",
-				       dict_ldap->result_attributes->argv,
-				       dict_ldap->timeout, &resloop);
-		    }
-		    switch (rc) {
-		    case LDAP_SUCCESS:
-			dict_ldap_get_values(dict_ldap, resloop, result, name);
-			break;
-		    case LDAP_NO_SUCH_OBJECT:
-
-			/*
-			 * Go ahead and treat this as though the DN existed
-			 * and just didn't have any result attributes.
-			 */
-			msg_warn("%s[%d]: DN %s not found, skipping ", myname,
-				 recursion, vals[i]->bv_val);
-			break;
-		    default:
-			msg_warn("%s[%d]: search error %d: %s ", myname,
-				 recursion, rc, ldap_err2string(rc));
-			dict_ldap->dict.error = DICT_ERR_RETRY;
-			break;
+			search_rc[pending] = rc;
+			search_dn[pending] = vals[i]->bv_val;
+			pending += 1;
 		    }
 
-		    if (resloop != 0)
-			ldap_msgfree(resloop);
+		    /*
+		     * After an error, abandon the searches that are still
+		     * outstanding.
+		     */
+		    for (k = 0; k < pending; k++) {
+			if (dict_ldap->dict.error != 0) {
+			    if (search_rc[k] == LDAP_SUCCESS)
+				(void) dict_ldap_abandon(dict_ldap->ld,
+							 msgids[k]);
+			    continue;
+			}
+			if ((rc = search_rc[k]) == LDAP_SUCCESS)
+			    rc = search_finish(dict_ldap->ld, msgids[k],
+					       dict_ldap->timeout, &resloop);
+			switch (rc) {
+			case LDAP_SUCCESS:
+			    dict_ldap_get_values(dict_ldap, resloop, result,
+						 name);
+			    break;
+			case LDAP_NO_SUCH_OBJECT:
+
+			    /*
+			     * Go ahead and treat this as though the DN
+			     * existed and just didn't have any result
+			     * attributes.
+			     */
+			    msg_warn("%s[%d]: DN %s not found, skipping ",
+				     myname, recursion, search_dn[k]);
+			    break;
+			default:
+			    msg_warn("%s[%d]: search error %d: %s ", myname,
+				     recursion, rc, ldap_err2string(rc));
+			    dict_ldap->dict.error = DICT_ERR_RETRY;
+			    break;
+			}
 
-		    if (dict_ldap->dict.error != 0)
-			break;
+			if (resloop != 0) {
+			    ldap_msgfree(resloop);
+			    resloop = 0;
+			}
+		    }
 		}
 		if (msg_verbose && dict_ldap->dict.error == 0)
 		    msg_info("%s[%d]: search returned %d value(s) for"
@@ -1452,6 +1531,66 @@ static const char *dict_ldap_lookup(DICT *dict, const char *name)
     return (VSTRING_LEN(result) > 0 && !dict_ldap->dict.error ? vstring_str(result) : 0);
 }
 
+/* dict_ldap_cache_create - callback: look up key that is not in cache */
+
+static void *dict_ldap_cache_create(const char *key, void *context)
+{
+    DICT_LDAP *dict_ldap = (DICT_LDAP *) context;
+    DICT_LDAP_CACHE_ENT *ent;
+    const char *value;
+
+    value = dict_ldap_lookup(&dict_ldap->dict, key);
+    ent = (DICT_LDAP_CACHE_ENT *) mymalloc(sizeof(*ent));
+    ent->value = (value ? mystrdup(value) : 0);
+    ent->error = dict_ldap->dict.error;
+    ent->expires = time((time_t *) 0) + dict_ldap->cache_ttl;
+    dict_ldap_cache_new = 1;
+    return ((void *) ent);
+}
+
+/* dict_ldap_cache_delete - callback: delete cache entry */
+
+static void dict_ldap_cache_delete(void *value, void *unused_context)
+{
+    DICT_LDAP_CACHE_ENT *ent = (DICT_LDAP_CACHE_ENT *) value;
+
+    if (ent->value)
+	myfree(ent->value);
+    myfree((void *) ent);
+}
+
+/* dict_ldap_lookup_cached - find database entry, using result cache */
+
+static const char *dict_ldap_lookup_cached(DICT *dict, const char *name)
+{
+    DICT_LDAP *dict_ldap = (DICT_LDAP *) dict;
+    const DICT_LDAP_CACHE_ENT *ent;
+
+    /*
+     * Start over when the caller changes how keys are folded.
+     */
+    if ((dict->flags ^ dict_ldap->cache_flags) & DICT_FLAG_FOLD_FIX) {
+	ctable_free(dict_ldap->cache);
+	dict_ldap->cache = ctable_create(dict_ldap->cache_size,
+					 dict_ldap_cache_create,
+					 dict_ldap_cache_delete,
+					 (void *) dict_ldap);
+	dict_ldap->cache_flags = dict->flags;
+    }
+
+    /*
+     * Repeat the search when an older entry has expired, or when it records
+     * a lookup error.
+     */
+    dict_ldap_cache_new = 0;
+    ent = (const DICT_LDAP_CACHE_ENT *) ctable_locate(dict_ldap->cache, name);
+    if (dict_ldap_cache_new == 0
+	&& (ent->error != 0 || ent->expires <= time((time_t *) 0)))
+	ent = (const DICT_LDAP_CACHE_ENT *)
+	    ctable_refresh(dict_ldap->cache, name);
+    DICT_ERR_VAL_RETURN(dict, ent->error, ent->value);
+}
+
 /* dict_ldap_close - disassociate from data base */
 
 static void dict_ldap_close(DICT *dict)
@@ -1470,6 +1609,8 @@ static void dict_ldap_close(DICT *dict)
 	}
 	binhash_delete(conn_hash, ht->key, ht->key_len, myfree);
     }
+    if (dict_ldap->cache)
+	ctable_free(dict_ldap->cache);
     cfg_parser_free(dict_ldap->parser);
     myfree(dict_ldap->server_host);
     myfree(dict_ldap->search_base);
@@ -1544,6 +1685,7 @@ DICT   *dict_ldap_open(const char *ldapsource, int open_flags, int dict_flags)
 
     dict_ldap->ld = NULL;
     dict_ldap->parser = parser;
+    dict_ldap->cache = 0;
 
     server_host = cfg_get_str(dict_ldap->parser, "server_host",
 			      "localhost", 1, 0);
@@ -1761,6 +1903,23 @@ DICT   *dict_ldap_open(const char *ldapsource, int open_flags, int dict_flags)
     if (tmp >= 0)
 	msg_warn("%s: %s ignoring cache_size", myname, ldapsource);
 
+    /*
+     * Optional result cache, for repeated lookups in long-running processes
+     * such as proxymap(8).
+     */
+    dict_ldap->cache_ttl = cfg_get_int(dict_ldap->parser,
+				       "result_cache_ttl", 0, 0, 0);
+    if (dict_ldap->cache_ttl > 0) {
+	dict_ldap->cache_size = cfg_get_int(dict_ldap->parser,
+					    "result_cache_size", 1000, 1, 0);
+	dict_ldap->cache = ctable_create(dict_ldap->cache_size,
+					 dict_ldap_cache_create,
+					 dict_ldap_cache_delete,
+					 (void *) dict_ldap);
+	dict_ldap->cache_flags = dict_flags;
+	dict_ldap->dict.lookup = dict_ldap_lookup_cached;
+    }
+
     dict_ldap->recursion_limit = cfg_get_int(dict_ldap->parser,
 					     "recursion_limit", 1000, 1, 0);
 
@@ -18,6 +18,12 @@
 /*	Arguments:
 /* .IP name
 /*	The path to the Postfix memcache configuration file.
+/*
+/*	When a caller searches several keys in order of preference
+/*	with dict_get_first(), the memcache is searched for all keys
+/*	with one multi-key "get" request. Keys that are not found
+/*	in the memcache are then looked up one at a time in the
+/*	optional backup database, in the same order.
 /* .IP open_flags
 /*	O_RDONLY or O_RDWR. This function ignores flags that don't
 /*	specify a read, write or append mode.
@@ -57,6 +63,7 @@
 #include <stringops.h>
 #include <auto_clnt.h>
 #include <vstream.h>
+#include <argv.h>
 
 /* Global library. */
 
@@ -88,6 +95,8 @@ typedef struct {
     VSTRING *clnt_buf;			/* memcache client buffer */
     VSTRING *key_buf;			/* lookup key */
     VSTRING *res_buf;			/* lookup result */
+    ARGV   *mget_keys;			/* multi-key lookup keys */
+    VSTRING *mget_buf;			/* multi-key lookup request */
     int     error;			/* memcache dict_errno */
     DICT   *backup;			/* persistent backup */
 } DICT_MC;
@@ -107,6 +116,8 @@ typedef struct {
 #define DICT_MC_DEF_MAX_DATA	10240
 #define DICT_MC_DEF_ERR_PAUSE	1
 
+#define DICT_MC_MGET_MAX	20	/* keys per multi-key "get" */
+
 #define DICT_MC_NAME_MEMCACHE	"memcache"
 #define DICT_MC_NAME_BACKUP	"backup"
 #define DICT_MC_NAME_KEY_FMT	"key_format"
@@ -219,6 +230,86 @@ static const char *dict_memcache_get(DICT_MC *dict_mc)
     DICT_ERR_VAL_RETURN(dict_mc, DICT_ERR_RETRY, (char *) 0);
 }
 
+/* dict_memcache_get_multi - get first of several memcache keys */
+
+static const char *dict_memcache_get_multi(DICT_MC *dict_mc, ssize_t *slot)
+{
+    ARGV   *keys = dict_mc->mget_keys;
+    VSTREAM *fp;
+    long    todo;
+    int     count;
+    ssize_t best;
+    ssize_t n;
+    char   *key;
+    char   *cp;
+
+    VSTRING_RESET(dict_mc->mget_buf);
+    vstring_strcpy(dict_mc->mget_buf, "get");
+    for (n = 0; n < keys->argc; n++)
+	vstring_sprintf_append(dict_mc->mget_buf, " %s", keys->argv[n]);
+
+    /*
+     * The reply has one VALUE entry for each key that is found. Remember the
+     * value of the first key in request order.
+     */
+    for (count = 0; count < dict_mc->max_tries; count++) {
+	if (count > 0)
+	    sleep(dict_mc->err_pause);
+	if ((fp = auto_clnt_access(dict_mc->clnt)) == 0)
+	    break;
+	if (memcache_printf(fp, "%s", STR(dict_mc->mget_buf)) < 0) {
+	    if (count > 0)
+		msg_warn(errno ? "database %s:%s: I/O error: %m" :
+			 "database %s:%s: I/O error",
+			 DICT_TYPE_MEMCACHE, dict_mc->dict.name);
+	    auto_clnt_recover(dict_mc->clnt);
+	    continue;
+	}
+	for (best = keys->argc; /* void */ ; /* void */ ) {
+	    if (memcache_get(fp, dict_mc->clnt_buf, dict_mc->max_line) < 0) {
+		if (count > 0)
+		    msg_warn(errno ? "database %s:%s: I/O error: %m" :
+			     "database %s:%s: I/O error",
+			     DICT_TYPE_MEMCACHE, dict_mc->dict.name);
+		break;
+	    }
+	    if (strcmp(STR(dict_mc->clnt_buf), "END") == 0) {
+		/* Victory! */
+		*slot = best;
+		DICT_ERR_VAL_RETURN(dict_mc, DICT_ERR_NONE, best < keys->argc ?
+				    STR(dict_mc->res_buf) : (char *) 0);
+	    }
+	    n = keys->argc;
+	    if (strncmp(STR(dict_mc->clnt_buf), "VALUE ", 6) == 0
+		&& (cp = strchr(key = STR(dict_mc->clnt_buf) + 6, ' ')) != 0
+		&& sscanf(cp, "%*s %ld", &todo) == 1
+		&& todo >= 0 && todo <= dict_mc->max_data) {
+		*cp = 0;
+		for (n = 0; n < keys->argc; n++)
+		    if (strcmp(keys->argv[n], key) == 0)
+			break;
+	    }
+	    if (n == keys->argc) {
+		if (count > 0)
+		    msg_warn("%s: unexpected memcache server reply: %.30s",
+			     dict_mc->dict.name, STR(dict_mc->clnt_buf));
+		break;
+	    }
+	    if (memcache_fread(fp, n < best ? dict_mc->res_buf :
+			       dict_mc->clnt_buf, todo) < 0) {
+		if (count > 0)
+		    msg_warn("%s: EOF receiving memcache server reply",
+			     dict_mc->dict.name);
+		break;
+	    }
+	    if (n < best)
+		best = n;
+	}
+	auto_clnt_recover(dict_mc->clnt);
+    }
+    DICT_ERR_VAL_RETURN(dict_mc, DICT_ERR_RETRY, (char *) 0);
+}
+
 /* dict_memcache_del - delete memcache key/value */
 
 static int dict_memcache_del(DICT_MC *dict_mc)
@@ -408,6 +499,102 @@ static const char *dict_memcache_lookup(DICT *dict, const char *name)
     return (retval);
 }
 
+/* dict_memcache_lookup_first - find first of several keys */
+
+static const char *dict_memcache_lookup_first(DICT *dict, const char **names,
+					              ssize_t count, ssize_t *index)
+{
+    const char *myname = "dict_memcache_lookup_first";
+    DICT_MC *dict_mc = (DICT_MC *) dict;
+    DICT   *backup = dict_mc->backup;
+    ssize_t name_index[DICT_MC_MGET_MAX];
+    const char *retval;
+    const char *value;
+    ssize_t stop;
+    ssize_t slot;
+    ssize_t n;
+    int     stop_error = DICT_ERR_NONE;
+
+    /*
+     * Search one key at a time when the table is wrapped by a different
+     * lookup method, or when there is nothing to gain.
+     */
+    if (dict->lookup != dict_memcache_lookup
+	|| count < 2 || count > DICT_MC_MGET_MAX) {
+	for (n = 0; n < count; n++)
+	    if ((retval = dict_get(dict, names[n])) != 0 || dict->error != 0)
+		break;
+	*index = n;
+	return (n < count ? retval : 0);
+    }
+
+    /*
+     * Skip keys that cannot exist, as with dict_memcache_lookup(). A key
+     * that cannot be checked ends the search, but only after the keys that
+     * precede it.
+     */
+    argv_truncate(dict_mc->mget_keys, 0);
+    for (stop = 0; stop < count; stop++) {
+	if (dict_memcache_valid_key(dict_mc, names[stop], "lookup",
+				    msg_info) == 0) {
+	    if ((stop_error = dict_mc->error) != 0)
+		break;
+	    continue;
+	}
+	name_index[dict_mc->mget_keys->argc] = stop;
+	argv_add(dict_mc->mget_keys, STR(dict_mc->key_buf), ARGV_END);
+    }
+
+    /*
+     * Search the memcache first, for all keys at once. After a memcache
+     * error, let dict_memcache_lookup() handle each key with the backup
+     * database.
+     */
+    slot = 0;
+    retval = 0;
+    if (dict_mc->mget_keys->argc > 0) {
+	retval = dict_memcache_get_multi(dict_mc, &slot);
+	if (dict_mc->error != 0) {
+	    for (n = 0; n < count; n++)
+		if ((retval = dict_get(dict, names[n])) != 0
+		    || dict->error != 0)
+		    break;
+	    *index = n;
+	    return (n < count ? retval : 0);
+	}
+    }
+
+    /*
+     * Search the backup database for the keys before the first memcache
+     * hit. Update the memcache if the data is found.
+     */
+    if (backup) {
+	for (n = 0; n < slot; n++) {
+	    backup->error = 0;
+	    if ((value = backup->lookup(backup, names[name_index[n]])) != 0) {
+		vstring_strcpy(dict_mc->key_buf, dict_mc->mget_keys->argv[n]);
+		dict_memcache_set(dict_mc, value, dict_mc->mc_ttl);
+		*index = name_index[n];
+		DICT_ERR_VAL_RETURN(dict, DICT_ERR_NONE, value);
+	    }
+	    if (backup->error != 0) {
+		*index = name_index[n];
+		DICT_ERR_VAL_RETURN(dict, backup->error, (char *) 0);
+	    }
+	}
+    }
+    if (slot < dict_mc->mget_keys->argc) {
+	*index = name_index[slot];
+	if (msg_verbose)
+	    msg_info("%s: %s: key \"%s\"(%s) => %s",
+		     myname, dict_mc->dict.name, names[*index],
+		     dict_mc->mget_keys->argv[slot], retval);
+	DICT_ERR_VAL_RETURN(dict, DICT_ERR_NONE, retval);
+    }
+    *index = stop;
+    DICT_ERR_VAL_RETURN(dict, stop_error, (char *) 0);
+}
+
 /* dict_memcache_delete - delete memcache entry */
 
 static int dict_memcache_delete(DICT *dict, const char *name)
@@ -487,6 +674,8 @@ static void dict_memcache_close(DICT *dict)
     vstring_free(dict_mc->clnt_buf);
     vstring_free(dict_mc->key_buf);
     vstring_free(dict_mc->res_buf);
+    argv_free(dict_mc->mget_keys);
+    vstring_free(dict_mc->mget_buf);
     if (dict->fold_buf)
 	vstring_free(dict->fold_buf);
     if (dict_mc->backup)
@@ -528,6 +717,7 @@ DICT   *dict_memcache_open(const char *name, int open_flags, int dict_flags)
     dict_mc = (DICT_MC *) dict_alloc(DICT_TYPE_MEMCACHE, name,
 				     sizeof(*dict_mc));
     dict_mc->dict.lookup = dict_memcache_lookup;
+    dict_mc->dict.lookup_first = dict_memcache_lookup_first;
     if (open_flags == O_RDWR) {
 	dict_mc->dict.update = dict_memcache_update;
 	dict_mc->dict.delete = dict_memcache_delete;
@@ -537,6 +727,8 @@ DICT   *dict_memcache_open(const char *name, int open_flags, int dict_flags)
     dict_mc->dict.flags = dict_flags;
     dict_mc->key_buf = vstring_alloc(10);
     dict_mc->res_buf = vstring_alloc(10);
+    dict_mc->mget_keys = argv_alloc(DICT_MC_MGET_MAX);
+    dict_mc->mget_buf = vstring_alloc(100);
 
     /*
      * Parse the configuration file.
@@ -24,6 +24,12 @@
 /*	The intent of this feature is to eliminate a single point of
 /*	failure for mail systems that would otherwise rely on a single
 /*	pgsql server.
+/*
+/*	When a caller searches several keys in order of preference
+/*	with dict_get_first(), the queries for those keys are sent
+/*	to the server as one multi-statement request, so that a
+/*	domain walk costs one round trip instead of one per key.
+/*	This is not done when the query template contains ';'.
 /* .PP
 /*	Arguments:
 /* .IP name
@@ -114,6 +120,8 @@
 #define RETRY_CONN_INTV			60	/* 1 minute */
 #define IDLE_CONN_INTV			60	/* 1 minute */
 
+#define BATCH_KEYS_MAX			20	/* keys per multi-statement query */
+
 typedef struct {
     PGconn *db;
     char   *hostname;
@@ -153,11 +161,15 @@ typedef struct {
 /* internal function declarations */
 static PLPGSQL *plpgsql_init(ARGV *);
 static PGSQL_RES *plpgsql_query(DICT_PGSQL *, const char *, VSTRING *);
+static int plpgsql_query_batch(DICT_PGSQL *, const char **, ssize_t,
+			               VSTRING *, PGSQL_RES **);
 static void plpgsql_dealloc(PLPGSQL *);
 static void plpgsql_close_host(HOST *);
 static void plpgsql_down_host(HOST *);
 static void plpgsql_connect_single(DICT_PGSQL *, HOST *);
 static const char *dict_pgsql_lookup(DICT *, const char *);
+static const char *dict_pgsql_lookup_first(DICT *, const char **, ssize_t,
+					           ssize_t *);
 DICT   *dict_pgsql_open(const char *, int, int);
 static void dict_pgsql_close(DICT *);
 static HOST *host_init(const char *);
@@ -243,6 +255,49 @@ static void dict_pgsql_quote(DICT *dict, const char *name, VSTRING *result)
     }
 }
 
+/* dict_pgsql_expand_result - expand result set for one key */
+
+static const char *dict_pgsql_expand_result(DICT_PGSQL *dict_pgsql,
+					            const char *name,
+					            PGSQL_RES *query_res,
+					            VSTRING *result)
+{
+    const char *myname = "dict_pgsql_expand_result";
+    DICT   *dict = &dict_pgsql->dict;
+    int     i;
+    int     j;
+    int     numrows;
+    int     numcols;
+    int     expansion;
+    const char *r;
+
+    VSTRING_RESET(result);
+    VSTRING_TERMINATE(result);
+    numrows = PQntuples(query_res);
+    if (msg_verbose)
+	msg_info("%s: retrieved %d rows", myname, numrows);
+    if (numrows == 0)
+	return (0);
+    numcols = PQnfields(query_res);
+
+    for (expansion = i = 0; i < numrows && dict->error == 0; i++) {
+	for (j = 0; j < numcols; j++) {
+	    r = PQgetvalue(query_res, i, j);
+	    if (db_common_expand(dict_pgsql->ctx, dict_pgsql->result_format,
+				 r, name, result, 0)
+		&& dict_pgsql->expansion_limit > 0
+		&& ++expansion > dict_pgsql->expansion_limit) {
+		msg_warn("%s: %s: Expansion limit exceeded for key: '%s'",
+			 myname, dict_pgsql->parser->name, name);
+		dict->error = DICT_ERR_RETRY;
+		break;
+	    }
+	}
+    }
+    r = vstring_str(result);
+    return ((dict->error == 0 && *r) ? r : 0);
+}
+
 /* dict_pgsql_lookup - find database entry */
 
 static const char *dict_pgsql_lookup(DICT *dict, const char *name)
@@ -252,11 +307,6 @@ static const char *dict_pgsql_lookup(DICT *dict, const char *name)
     DICT_PGSQL *dict_pgsql;
     static VSTRING *query;
     static VSTRING *result;
-    int     i;
-    int     j;
-    int     numrows;
-    int     numcols;
-    int     expansion;
     const char *r;
     int     domain_rc;
 
@@ -327,32 +377,124 @@ static const char *dict_pgsql_lookup(DICT *dict, const char *name)
 	dict->error = DICT_ERR_RETRY;
 	return 0;
     }
-    numrows = PQntuples(query_res);
-    if (msg_verbose)
-	msg_info("%s: retrieved %d rows", myname, numrows);
-    if (numrows == 0) {
-	PQclear(query_res);
-	return 0;
+    r = dict_pgsql_expand_result(dict_pgsql, name, query_res, result);
+    PQclear(query_res);
+    return (r);
+}
+
+/* dict_pgsql_lookup_first - find first of several database entries */
+
+static const char *dict_pgsql_lookup_first(DICT *dict, const char **keys,
+					           ssize_t count, ssize_t *index)
+{
+    const char *myname = "dict_pgsql_lookup_first";
+    DICT_PGSQL *dict_pgsql = (DICT_PGSQL *) dict;
+    static VSTRING *query;
+    static VSTRING *result;
+    static ARGV *folded;
+    const char *names[BATCH_KEYS_MAX];
+    ssize_t name_index[BATCH_KEYS_MAX];
+    PGSQL_RES *query_res[BATCH_KEYS_MAX];
+    ssize_t name_count;
+    ssize_t stop;
+    ssize_t n;
+    const char *name;
+    const char *r = 0;
+    int     domain_rc = 0;
+
+    /*
+     * Search one key at a time when the table is wrapped by a different
+     * lookup method, when there is nothing to gain, or when a ';' could
+     * make it impossible to match query results to keys.
+     */
+    n = 0;
+    if (dict->lookup == dict_pgsql_lookup
+	&& count > 1 && count <= BATCH_KEYS_MAX
+	&& strchr(dict_pgsql->query, ';') == 0)
+	while (n < count && strchr(keys[n], ';') == 0)
+	    n++;
+    if (n < count) {
+	for (n = 0; n < count; n++)
+	    if ((r = dict_get(dict, keys[n])) != 0 || dict->error != 0)
+		break;
+	*index = n;
+	return (n < count ? r : 0);
     }
-    numcols = PQnfields(query_res);
+    INIT_VSTR(query, 10);
+    INIT_VSTR(result, 10);
+    if (folded == 0)
+	folded = argv_alloc(BATCH_KEYS_MAX);
+    argv_truncate(folded, 0);
 
-    for (expansion = i = 0; i < numrows && dict->error == 0; i++) {
-	for (j = 0; j < numcols; j++) {
-	    r = PQgetvalue(query_res, i, j);
-	    if (db_common_expand(dict_pgsql->ctx, dict_pgsql->result_format,
-				 r, name, result, 0)
-		&& dict_pgsql->expansion_limit > 0
-		&& ++expansion > dict_pgsql->expansion_limit) {
-		msg_warn("%s: %s: Expansion limit exceeded for key: '%s'",
+    dict->error = 0;
+
+    /*
+     * Apply the same per-key checks as dict_pgsql_lookup(). A key that
+     * would not be looked up is a miss; a key that cannot be checked ends
+     * the search, but only after the keys that precede it.
+     */
+    for (name_count = stop = 0; stop < count; stop++) {
+	name = keys[stop];
+#ifdef SNAPSHOT
+	if ((dict->flags & DICT_FLAG_UTF8_ACTIVE) == 0
+	    && !valid_utf8_stringz(name)) {
+	    if (msg_verbose)
+		msg_info("%s: %s: Skipping lookup of non-UTF-8 key '%s'",
 			 myname, dict_pgsql->parser->name, name);
-		dict->error = DICT_ERR_RETRY;
-		break;
-	    }
+	    continue;
 	}
+#endif
+	if (dict->flags & DICT_FLAG_FOLD_FIX) {
+	    argv_add(folded, name, (char *) 0);
+	    name = lowercase(folded->argv[folded->argc - 1]);
+	}
+	if ((domain_rc = db_common_check_domain(dict_pgsql->ctx, name)) == 0) {
+	    if (msg_verbose)
+		msg_info("%s: Skipping lookup of '%s'", myname, name);
+	    continue;
+	}
+	if (domain_rc < 0)
+	    break;
+	VSTRING_RESET(query);
+	VSTRING_TERMINATE(query);
+	if (!db_common_expand(dict_pgsql->ctx, dict_pgsql->query,
+			      name, 0, query, 0))
+	    continue;
+	names[name_count] = name;
+	name_index[name_count] = stop;
+	name_count += 1;
     }
-    PQclear(query_res);
-    r = vstring_str(result);
-    return ((dict->error == 0 && *r) ? r : 0);
+
+    /*
+     * Send all queries in one request, and use the first non-empty result.
+     */
+    if (name_count == 1) {
+	if ((query_res[0] = plpgsql_query(dict_pgsql, names[0], query)) == 0) {
+	    *index = name_index[0];
+	    DICT_ERR_VAL_RETURN(dict, DICT_ERR_RETRY, (char *) 0);
+	}
+    } else if (name_count > 1) {
+	if (plpgsql_query_batch(dict_pgsql, names, name_count,
+				query, query_res) < 0) {
+	    *index = name_index[0];
+	    DICT_ERR_VAL_RETURN(dict, DICT_ERR_RETRY, (char *) 0);
+	}
+    }
+    for (n = 0; n < name_count; n++) {
+	if (r == 0 && dict->error == 0) {
+	    r = dict_pgsql_expand_result(dict_pgsql, names[n],
+					 query_res[n], result);
+	    if (r != 0 || dict->error != 0)
+		*index = name_index[n];
+	}
+	PQclear(query_res[n]);
+    }
+    if (r != 0 || dict->error != 0)
+	return (r);
+    *index = stop;
+    if (stop < count)
+	DICT_ERR_VAL_RETURN(dict, domain_rc, (char *) 0);
+    return (0);
 }
 
 /* dict_pgsql_check_stat - check the status of a host */
@@ -449,6 +591,49 @@ static void dict_pgsql_event(int unused_event, void *context)
 	plpgsql_close_host(host);
 }
 
+/* plpgsql_result_ok - check the status of a non-null query result */
+
+static int plpgsql_result_ok(HOST *host, PGSQL_RES *res)
+{
+    ExecStatusType status;
+
+    /*
+     * XXX Because non-null result pointer does not imply success, we need to
+     * check the command's result status.
+     * 
+     * Section 28.3.1: A result of status PGRES_NONFATAL_ERROR will never be
+     * returned directly by PQexec or other query execution functions;
+     * results of this kind are instead passed to the notice processor.
+     * 
+     * PGRES_EMPTY_QUERY is being sent by the server when the query string is
+     * empty. The sanity-checking done by the Postfix infrastructure makes
+     * this case impossible, so we need not handle this situation
+     * explicitly.
+     */
+    switch ((status = PQresultStatus(res))) {
+    case PGRES_TUPLES_OK:
+    case PGRES_COMMAND_OK:
+	/* Success. */
+	if (msg_verbose)
+	    msg_info("dict_pgsql: successful query from host %s",
+		     host->hostname);
+	return (1);
+    case PGRES_FATAL_ERROR:
+	msg_warn("pgsql query failed: fatal error from host %s: %s",
+		 host->hostname, PQresultErrorMessage(res));
+	break;
+    case PGRES_BAD_RESPONSE:
+	msg_warn("pgsql query failed: protocol error, host %s",
+		 host->hostname);
+	break;
+    default:
+	msg_warn("pgsql query failed: unknown code 0x%lx from host %s",
+		 (unsigned long) status, host->hostname);
+	break;
+    }
+    return (0);
+}
+
 /*
  * plpgsql_query - process a PostgreSQL query.  Return PGSQL_RES* on success.
  *			On failure, log failure and try other db instances.
@@ -463,7 +648,6 @@ static PGSQL_RES *plpgsql_query(DICT_PGSQL *dict_pgsql,
     PLPGSQL *PLDB = dict_pgsql->pldb;
     HOST   *host;
     PGSQL_RES *res = 0;
-    ExecStatusType status;
 
     while ((host = dict_pgsql_get_active(dict_pgsql, PLDB)) != NULL) {
 
@@ -495,43 +679,10 @@ static PGSQL_RES *plpgsql_query(DICT_PGSQL *dict_pgsql,
 	 * as inability to send the command to the server.
 	 */
 	if ((res = PQexec(host->db, vstring_str(query))) != 0) {
-
-	    /*
-	     * XXX Because non-null result pointer does not imply success, we
-	     * need to check the command's result status.
-	     * 
-	     * Section 28.3.1: A result of status PGRES_NONFATAL_ERROR will
-	     * never be returned directly by PQexec or other query execution
-	     * functions; results of this kind are instead passed to the
-	     * notice processor.
-	     * 
-	     * PGRES_EMPTY_QUERY is being sent by the server when the query
-	     * string is empty. The sanity-checking done by the Postfix
-	     * infrastructure makes this case impossible, so we need not
-	     * handle this situation explicitly.
-	     */
-	    switch ((status = PQresultStatus(res))) {
-	    case PGRES_TUPLES_OK:
-	    case PGRES_COMMAND_OK:
-		/* Success. */
-		if (msg_verbose)
-		    msg_info("dict_pgsql: successful query from host %s",
-			     host->hostname);
+	    if (plpgsql_result_ok(host, res)) {
 		event_request_timer(dict_pgsql_event, (void *) host,
 				    IDLE_CONN_INTV);
 		return (res);
-	    case PGRES_FATAL_ERROR:
-		msg_warn("pgsql query failed: fatal error from host %s: %s",
-			 host->hostname, PQresultErrorMessage(res));
-		break;
-	    case PGRES_BAD_RESPONSE:
-		msg_warn("pgsql query failed: protocol error, host %s",
-			 host->hostname);
-		break;
-	    default:
-		msg_warn("pgsql query failed: unknown code 0x%lx from host %s",
-			 (unsigned long) status, host->hostname);
-		break;
 	    }
 	} else {
 
@@ -555,6 +706,91 @@ static PGSQL_RES *plpgsql_query(DICT_PGSQL *dict_pgsql,
     return (0);
 }
 
+/*
+ * plpgsql_query_batch - send several queries in one request. Store one
+ *			result per query and return 0 on success. On failure,
+ *			log failure and try other db instances; on failure of
+ *			all db instances, return -1.
+ */
+
+static int plpgsql_query_batch(DICT_PGSQL *dict_pgsql,
+			               const char **names, ssize_t count,
+			               VSTRING *query, PGSQL_RES **res)
+{
+    PLPGSQL *PLDB = dict_pgsql->pldb;
+    HOST   *host;
+    PGSQL_RES *r;
+    ssize_t got;
+    ssize_t n;
+    int     ok;
+
+    while ((host = dict_pgsql_get_active(dict_pgsql, PLDB)) != NULL) {
+
+	/*
+	 * Quote each key in the context of the active connection, and
+	 * separate the queries with ';'.
+	 */
+	dict_pgsql->active_host = host;
+	VSTRING_RESET(query);
+	for (n = 0; n < count && host->stat != STATFAIL; n++) {
+	    if (n > 0)
+		VSTRING_ADDCH(query, ';');
+	    db_common_expand(dict_pgsql->ctx, dict_pgsql->query,
+			     names[n], 0, query, dict_pgsql_quote);
+	}
+	VSTRING_TERMINATE(query);
+	dict_pgsql->active_host = 0;
+
+	/* Check for potential dict_pgsql_quote() failure. */
+	if (host->stat == STATFAIL) {
+	    plpgsql_down_host(host);
+	    continue;
+	}
+
+	/*
+	 * The server runs the statements in order and sends one result per
+	 * statement, or stops at the first failed statement. Read all
+	 * results, so that the connection can be reused.
+	 */
+	if (PQsendQuery(host->db, vstring_str(query)) == 0) {
+	    msg_warn("pgsql query failed: fatal error from host %s: %s",
+		     host->hostname, PQerrorMessage(host->db));
+	    plpgsql_down_host(host);
+	    continue;
+	}
+	for (ok = 1, got = 0; (r = PQgetResult(host->db)) != 0; /* void */ ) {
+	    if (ok && got == count) {
+		msg_warn("pgsql query failed: more than %ld results from host %s",
+			 (long) count, host->hostname);
+		ok = 0;
+	    }
+	    if (ok && plpgsql_result_ok(host, r)) {
+		res[got++] = r;
+	    } else {
+		ok = 0;
+		PQclear(r);
+	    }
+	}
+	if (ok && got == count) {
+	    event_request_timer(dict_pgsql_event, (void *) host,
+				IDLE_CONN_INTV);
+	    return (0);
+	}
+	if (ok)
+	    msg_warn("pgsql query failed: expected %ld results, got %ld"
+		     " from host %s", (long) count, (long) got, host->hostname);
+
+	/*
+	 * XXX An error occurred. Clean up memory and skip this connection.
+	 */
+	while (got > 0)
+	    PQclear(res[--got]);
+	plpgsql_down_host(host);
+    }
+
+    return (-1);
+}
+
 /*
  * plpgsql_connect_single -
  * used to reconnect to a single database when one is down or none is
@@ -709,6 +945,7 @@ DICT   *dict_pgsql_open(const char *name, int open_flags, int dict_flags)
     dict_pgsql = (DICT_PGSQL *) dict_alloc(DICT_TYPE_PGSQL, name,
 					   sizeof(DICT_PGSQL));
     dict_pgsql->dict.lookup = dict_pgsql_lookup;
+    dict_pgsql->dict.lookup_first = dict_pgsql_lookup_first;
     dict_pgsql->dict.close = dict_pgsql_close;
     dict_pgsql->dict.flags = dict_flags;
     dict_pgsql->parser = parser;
@@ -22,6 +22,13 @@
 /*	The connection to the Postfix proxymap server is automatically
 /*	closed after $ipc_idle seconds of idle time, or after $ipc_ttl
 /*	seconds of activity.
+/*
+/*	dict_get_first() sends all keys in one request, so that a
+/*	search for a domain and its parent domains costs one round
+/*	trip instead of one per key. With a proxymap server that
+/*	does not support this request, or with UTF-8 or debug
+/*	handlers that wrap the lookup method, the keys are looked
+/*	up one at a time.
 /* SECURITY
 /*	The proxy map server is not meant to be a trusted process. Proxy
 /*	maps must not be used to look up security sensitive information
@@ -80,6 +87,7 @@ typedef struct {
     int     inst_flags;			/* saved dict flags */
     VSTRING *reskey;			/* result key storage */
     VSTRING *result;			/* storage */
+    int     no_lookup_first;		/* server lacks "lookup_first" */
 } DICT_PROXY;
 
  /*
@@ -258,6 +266,120 @@ static const char *dict_proxy_lookup(DICT *dict, const char *key)
     }
 }
 
+/* dict_proxy_lookup_first - find first of several keys */
+
+static const char *dict_proxy_lookup_first(DICT *dict, const char **keys,
+				            ssize_t count, ssize_t *index)
+{
+    const char *myname = "dict_proxy_lookup_first";
+    DICT_PROXY *dict_proxy = (DICT_PROXY *) dict;
+    VSTREAM *stream;
+    const char *value;
+    int     status;
+    int     reply_index;
+    int     got = 0;
+    int     retries = 0;
+    int     request_flags;
+    ssize_t n;
+
+    /*
+     * Search one key at a time when the table is not a bare proxy client,
+     * when the server does not support this request, or when there is
+     * nothing to gain.
+     */
+    if (dict->lookup != dict_proxy_lookup || dict_proxy->no_lookup_first
+	|| count < 2 || count > PROXY_LOOKUP_FIRST_LIMIT) {
+	for (n = 0; n < count; n++)
+	    if ((value = dict_get(dict, keys[n])) != 0 || dict->error != 0)
+		break;
+	*index = n;
+	return (n < count ? value : 0);
+    }
+
+    /*
+     * Send all keys in one request. An old server replies with only a
+     * status and leaves the remainder of the request unread; drop that
+     * connection, and never try this request again with this table.
+     */
+    VSTRING_RESET(dict_proxy->result);
+    VSTRING_TERMINATE(dict_proxy->result);
+    request_flags = dict_proxy->inst_flags
+	| (dict->flags & DICT_FLAG_RQST_MASK);
+    for (;;) {
+	stream = clnt_stream_access(dict_proxy->clnt);
+	errno = 0;
+	retries += 1;
+	got = 0;
+	if (stream == 0
+	    || attr_print(stream, ATTR_FLAG_NONE,
+			  SEND_ATTR_STR(MAIL_ATTR_REQ, PROXY_REQ_LOOKUP_FIRST),
+			  SEND_ATTR_STR(MAIL_ATTR_TABLE, dict->name),
+			  SEND_ATTR_INT(MAIL_ATTR_FLAGS, request_flags),
+			  SEND_ATTR_INT(MAIL_ATTR_KEY_COUNT, count),
+			  ATTR_TYPE_END) != 0)
+	    n = -1;
+	else
+	    for (n = 0; n < count; n++)
+		if (attr_print(stream, ATTR_FLAG_NONE,
+			       SEND_ATTR_STR(MAIL_ATTR_KEY, keys[n]),
+			       ATTR_TYPE_END) != 0)
+		    break;
+	if (n != count
+	    || vstream_fflush(stream)
+	    || (got = attr_scan(stream, ATTR_FLAG_STRICT,
+				RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+			      RECV_ATTR_INT(MAIL_ATTR_KEY_INDEX, &reply_index),
+			      RECV_ATTR_STR(MAIL_ATTR_VALUE, dict_proxy->result),
+				ATTR_TYPE_END)) != 3) {
+	    if (got == 1 && status == PROXY_STAT_BAD) {
+		if (msg_verbose)
+		    msg_info("%s: service %s does not support \"%s\"",
+			     myname, dict_proxy->service,
+			     PROXY_REQ_LOOKUP_FIRST);
+		clnt_stream_recover(dict_proxy->clnt);
+		dict_proxy->no_lookup_first = 1;
+		return (dict_proxy_lookup_first(dict, keys, count, index));
+	    }
+	    if (msg_verbose || retries > 1 || (errno && errno != EPIPE && errno != ENOENT))
+		msg_warn("%s: service %s: %m", myname, dict_proxy->service);
+	} else if (reply_index < 0 || reply_index > count) {
+	    msg_warn("%s lookup failed for table \"%s\": "
+		     "bad key index %d", dict_proxy->service,
+		     dict->name, reply_index);
+	} else {
+	    if (msg_verbose)
+		msg_info("%s: table=%s flags=%s keys=%ld -> status=%d "
+			 "index=%d result=%s", myname, dict->name,
+			 dict_flags_str(request_flags), (long) count,
+			 status, reply_index, STR(dict_proxy->result));
+	    *index = reply_index;
+	    switch (status) {
+	    case PROXY_STAT_BAD:
+		msg_fatal("%s lookup failed for table \"%s\" key \"%s\": "
+			  "invalid request",
+			  dict_proxy->service, dict->name, keys[0]);
+	    case PROXY_STAT_DENY:
+		msg_fatal("%s service is not configured for table \"%s\"",
+			  dict_proxy->service, dict->name);
+	    case PROXY_STAT_OK:
+		DICT_ERR_VAL_RETURN(dict, DICT_ERR_NONE, STR(dict_proxy->result));
+	    case PROXY_STAT_NOKEY:
+		DICT_ERR_VAL_RETURN(dict, DICT_ERR_NONE, (char *) 0);
+	    case PROXY_STAT_RETRY:
+		DICT_ERR_VAL_RETURN(dict, DICT_ERR_RETRY, (char *) 0);
+	    case PROXY_STAT_CONFIG:
+		DICT_ERR_VAL_RETURN(dict, DICT_ERR_CONFIG, (char *) 0);
+	    default:
+		msg_warn("%s lookup failed for table \"%s\" key \"%s\": "
+			 "unexpected reply status %d",
+			 dict_proxy->service, dict->name, keys[0], status);
+	    }
+	}
+	clnt_stream_recover(dict_proxy->clnt);
+	sleep(1);				/* XXX make configurable */
+    }
+}
+
 /* dict_proxy_update - update table entry */
 
 static int dict_proxy_update(DICT *dict, const char *key, const char *value)
@@ -478,9 +600,11 @@ DICT   *dict_proxy_open(const char *map, int open_flags, int dict_flags)
     dict_proxy->dict.delete = dict_proxy_delete;
     dict_proxy->dict.sequence = dict_proxy_sequence;
     dict_proxy->dict.close = dict_proxy_close;
+    dict_proxy->dict.lookup_first = dict_proxy_lookup_first;
     dict_proxy->inst_flags = (dict_flags & DICT_FLAG_INST_MASK);
     dict_proxy->reskey = vstring_alloc(10);
     dict_proxy->result = vstring_alloc(10);
+    dict_proxy->no_lookup_first = 0;
     dict_proxy->clnt = *pstream;
     dict_proxy->service = service;
 
@@ -33,6 +33,9 @@ extern MKMAP *mkmap_proxy_open(const char *);
 #define PROXY_REQ_UPDATE	"update"
 #define PROXY_REQ_DELETE	"delete"
 #define PROXY_REQ_SEQUENCE	"sequence"
+#define PROXY_REQ_LOOKUP_FIRST	"lookup_first"
+
+#define PROXY_LOOKUP_FIRST_LIMIT 20	/* max keys per "lookup_first" */
 
 #define PROXY_STAT_OK		0	/* operation succeeded */
 #define PROXY_STAT_NOKEY	1	/* requested key not found */
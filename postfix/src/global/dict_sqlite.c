@@ -34,6 +34,12 @@
 /*	Must be O_RDONLY.
 /* .IP dict_flags
 /*	See dict_open(3).
+/* .PP
+/*	When every '%' expansion in the query template is enclosed
+/*	in single quotes by itself (for example, WHERE mailbox =
+/*	'%s'), the query is prepared once, and the expansions are
+/*	passed as parameters. Otherwise, each lookup expands and
+/*	prepares the query as text.
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
 /*	sqlite_table(5) sqlite client configuration
@@ -63,6 +69,7 @@
 /* Utility library. */
 
 #include <msg.h>
+#include <argv.h>
 #include <dict.h>
 #include <vstring.h>
 #include <stringops.h>
@@ -86,6 +93,10 @@ typedef struct {
     void   *ctx;			/* db_common_parse() context */
     char   *dbpath;			/* dbpath config attribute */
     int     expansion_limit;		/* expansion_limit config attribute */
+    int     mmap_size;			/* mmap_size config attribute */
+    char   *stmt_query;			/* parameterized query or null */
+    sqlite3_stmt *stmt;			/* prepared stmt_query or null */
+    ARGV   *stmt_args;			/* stmt_query parameter values */
 } DICT_SQLITE;
 
 /* dict_sqlite_quote - escape SQL metacharacters in input string */
@@ -102,6 +113,97 @@ static void dict_sqlite_quote(DICT *dict, const char *raw_text, VSTRING *result)
     sqlite3_free(quoted_text);
 }
 
+/* dict_sqlite_bind - save parameter value, and quote it for logging */
+
+static void dict_sqlite_bind(DICT *dict, const char *raw_text, VSTRING *result)
+{
+    DICT_SQLITE *dict_sqlite = (DICT_SQLITE *) dict;
+
+    argv_add(dict_sqlite->stmt_args, raw_text, (char *) 0);
+    dict_sqlite_quote(dict, raw_text, result);
+}
+
+/* dict_sqlite_param_query - convert query template to parameterized form */
+
+static char *dict_sqlite_param_query(const char *template)
+{
+    VSTRING *buf = vstring_alloc(100);
+    const char *cp;
+    int     in_quote = 0;
+
+    /*
+     * Replace each '%x' by a ? parameter, and %% by %. Give up when an
+     * expansion is part of a larger string, or when the template already
+     * contains a ? parameter. Ignore quotes that are escaped as ''.
+     */
+    for (cp = template; *cp; cp++) {
+	if (in_quote) {
+	    if (*cp == '%') {
+		if (cp[1] != '%')
+		    break;
+		cp++;
+	    } else if (*cp == '\'') {
+		if (cp[1] == '\'')
+		    VSTRING_ADDCH(buf, *cp++);
+		else
+		    in_quote = 0;
+	    }
+	} else if (*cp == '\'' && cp[1] == '%' && cp[2] != 0 && cp[2] != '%'
+		   && cp[3] == '\'') {
+	    VSTRING_ADDCH(buf, '?');
+	    cp += 3;
+	    continue;
+	} else if (*cp == '\'') {
+	    in_quote = 1;
+	} else if (*cp == '%') {
+	    if (cp[1] != '%')
+		break;
+	    cp++;
+	} else if (*cp == '?') {
+	    break;
+	}
+	VSTRING_ADDCH(buf, *cp);
+    }
+    if (*cp != 0) {
+	vstring_free(buf);
+	return (0);
+    }
+    VSTRING_TERMINATE(buf);
+    return (vstring_export(buf));
+}
+
+/* dict_sqlite_stmt - prepare the parameterized query, once */
+
+static sqlite3_stmt *dict_sqlite_stmt(DICT_SQLITE *dict_sqlite)
+{
+    const char *myname = "dict_sqlite_stmt";
+    const char *query_remainder;
+
+    /*
+     * Fall back to text queries when the parameterized query cannot be
+     * prepared. The text query will report the error, if any.
+     */
+    if (dict_sqlite->stmt == 0) {
+	if (sqlite3_prepare_v2(dict_sqlite->db, dict_sqlite->stmt_query, -1,
+			       &dict_sqlite->stmt, &query_remainder) != SQLITE_OK
+	    || *query_remainder != 0
+	    || sqlite3_bind_parameter_count(dict_sqlite->stmt)
+	    != dict_sqlite->stmt_args->argc) {
+	    if (msg_verbose)
+		msg_info("%s: %s: using text queries instead of %s",
+			 myname, dict_sqlite->parser->name,
+			 dict_sqlite->stmt_query);
+	    if (dict_sqlite->stmt != 0) {
+		(void) sqlite3_finalize(dict_sqlite->stmt);
+		dict_sqlite->stmt = 0;
+	    }
+	    myfree(dict_sqlite->stmt_query);
+	    dict_sqlite->stmt_query = 0;
+	}
+    }
+    return (dict_sqlite->stmt);
+}
+
 /* dict_sqlite_close - close the database */
 
 static void dict_sqlite_close(DICT *dict)
@@ -112,12 +214,17 @@ static void dict_sqlite_close(DICT *dict)
     if (msg_verbose)
 	msg_info("%s: %s", myname, dict_sqlite->parser->name);
 
+    if (dict_sqlite->stmt != 0)
+	(void) sqlite3_finalize(dict_sqlite->stmt);
     if (sqlite3_close(dict_sqlite->db) != SQLITE_OK)
 	msg_fatal("%s: close %s failed", myname, dict_sqlite->parser->name);
     cfg_parser_free(dict_sqlite->parser);
     myfree(dict_sqlite->dbpath);
     myfree(dict_sqlite->query);
     myfree(dict_sqlite->result_format);
+    if (dict_sqlite->stmt_query)
+	myfree(dict_sqlite->stmt_query);
+    argv_free(dict_sqlite->stmt_args);
     if (dict_sqlite->ctx)
 	db_common_free_ctx(dict_sqlite->ctx);
     if (dict->fold_buf)
@@ -139,6 +246,7 @@ static const char *dict_sqlite_lookup(DICT *dict, const char *name)
     int     expansion = 0;
     int     status;
     int     domain_rc;
+    int     n;
 
     /*
      * In case of return without lookup (skipped key, etc.).
@@ -189,24 +297,40 @@ static const char *dict_sqlite_lookup(DICT *dict, const char *name)
     } while (0)
 
     INIT_VSTR(query, 10);
+    argv_truncate(dict_sqlite->stmt_args, 0);
 
     if (!db_common_expand(dict_sqlite->ctx, dict_sqlite->query,
-			  name, 0, query, dict_sqlite_quote))
+			  name, 0, query, dict_sqlite->stmt_query ?
+			  dict_sqlite_bind : dict_sqlite_quote))
 	return (0);
 
     if (msg_verbose)
 	msg_info("%s: %s: Searching with query %s",
 		 myname, dict_sqlite->parser->name, vstring_str(query));
 
-    if (sqlite3_prepare_v2(dict_sqlite->db, vstring_str(query), -1,
-			   &sql_stmt, &query_remainder) != SQLITE_OK)
-	msg_fatal("%s: %s: SQL prepare failed: %s\n",
-		  myname, dict_sqlite->parser->name,
-		  sqlite3_errmsg(dict_sqlite->db));
-
-    if (*query_remainder && msg_verbose)
-	msg_info("%s: %s: Ignoring text at end of query: %s",
-		 myname, dict_sqlite->parser->name, query_remainder);
+    /*
+     * Reuse the prepared statement if possible.
+     */
+    if (dict_sqlite->stmt_query != 0
+	&& (sql_stmt = dict_sqlite_stmt(dict_sqlite)) != 0) {
+	for (n = 0; n < dict_sqlite->stmt_args->argc; n++)
+	    if (sqlite3_bind_text(sql_stmt, n + 1,
+				  dict_sqlite->stmt_args->argv[n], -1,
+				  SQLITE_TRANSIENT) != SQLITE_OK)
+		msg_fatal("%s: %s: SQL bind failed: %s\n",
+			  myname, dict_sqlite->parser->name,
+			  sqlite3_errmsg(dict_sqlite->db));
+    } else {
+	if (sqlite3_prepare_v2(dict_sqlite->db, vstring_str(query), -1,
+			       &sql_stmt, &query_remainder) != SQLITE_OK)
+	    msg_fatal("%s: %s: SQL prepare failed: %s\n",
+		      myname, dict_sqlite->parser->name,
+		      sqlite3_errmsg(dict_sqlite->db));
+
+	if (*query_remainder && msg_verbose)
+	    msg_info("%s: %s: Ignoring text at end of query: %s",
+		     myname, dict_sqlite->parser->name, query_remainder);
+    }
 
     /*
      * Retrieve and expand the result(s).
@@ -236,9 +360,12 @@ static const char *dict_sqlite_lookup(DICT *dict, const char *name)
     }
 
     /*
-     * Clean up.
+     * Clean up. Resetting a prepared statement reports the last step error,
+     * which has already been handled.
      */
-    if (sqlite3_finalize(sql_stmt))
+    if (sql_stmt == dict_sqlite->stmt)
+	(void) sqlite3_reset(sql_stmt);
+    else if (sqlite3_finalize(sql_stmt))
 	msg_fatal("%s: %s: SQL finalize failed for query '%s': %s\n",
 		  myname, dict_sqlite->parser->name,
 		  vstring_str(query), sqlite3_errmsg(dict_sqlite->db));
@@ -269,6 +396,8 @@ static void sqlite_parse_config(DICT_SQLITE *dict_sqlite, const char *sqlitecf)
 	cfg_get_str(dict_sqlite->parser, "result_format", "%s", 1, 0);
     dict_sqlite->expansion_limit =
 	cfg_get_int(dict_sqlite->parser, "expansion_limit", 0, 0, 0);
+    dict_sqlite->mmap_size =
+	cfg_get_int(dict_sqlite->parser, "mmap_size", 0, 0, 0);
 
     /*
      * Parse the query / result templates and the optional domain filter.
@@ -278,6 +407,9 @@ static void sqlite_parse_config(DICT_SQLITE *dict_sqlite, const char *sqlitecf)
 			   dict_sqlite->query, 1);
     (void) db_common_parse(0, &dict_sqlite->ctx, dict_sqlite->result_format, 0);
     db_common_parse_domain(dict_sqlite->parser, dict_sqlite->ctx);
+    dict_sqlite->stmt_query = dict_sqlite_param_query(dict_sqlite->query);
+    dict_sqlite->stmt = 0;
+    dict_sqlite->stmt_args = argv_alloc(1);
 
     /*
      * Maps that use substring keys should only be used with the full input
@@ -324,6 +456,18 @@ DICT   *dict_sqlite_open(const char *name, int open_flags, int dict_flags)
 	msg_fatal("%s:%s: Can't open database: %s\n",
 		  DICT_TYPE_SQLITE, name, sqlite3_errmsg(dict_sqlite->db));
 
+    if (dict_sqlite->mmap_size > 0) {
+	char   *pragma = sqlite3_mprintf("PRAGMA mmap_size = %d",
+					 dict_sqlite->mmap_size);
+
+	if (pragma == 0)
+	    msg_fatal("dict_sqlite_open: out of memory");
+	if (sqlite3_exec(dict_sqlite->db, pragma, 0, 0, 0) != SQLITE_OK)
+	    msg_warn("%s:%s: %s: %s", DICT_TYPE_SQLITE, name, pragma,
+		     sqlite3_errmsg(dict_sqlite->db));
+	sqlite3_free(pragma);
+    }
+
     dict_sqlite->dict.owner = cfg_get_owner(dict_sqlite->parser);
 
     return (DICT_DEBUG (&dict_sqlite->dict));
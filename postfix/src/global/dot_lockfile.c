@@ -69,25 +69,22 @@
 /* Global library. */
 
 #include "mail_params.h"
+#include "deliver_flock.h"
 #include "dot_lockfile.h"
 
-/* Application-specific. */
-
-#define MILLION	1000000
-
 /* dot_lockfile - create user.lock file */
 
 int     dot_lockfile(const char *path, VSTRING *why)
 {
     char   *lock_file;
-    int     count;
+    long    waited = 0;
     struct stat st;
     int     fd;
     int     status = -1;
 
     lock_file = concatenate(path, ".lock", (char *) 0);
 
-    for (count = 1; /* void */ ; count++) {
+    for (;;) {
 
 	/*
 	 * Attempt to create the lock. This code relies on O_EXCL | O_CREAT
@@ -99,8 +96,6 @@ int     dot_lockfile(const char *path, VSTRING *why)
 	    status = 0;
 	    break;
 	}
-	if (count >= var_flock_tries)
-	    break;
 
 	/*
 	 * We can deal only with "file exists" errors. Any other error means
@@ -110,16 +105,23 @@ int     dot_lockfile(const char *path, VSTRING *why)
 	    break;
 
 	/*
-	 * Break the lock when it is too old. Give up when we are unable to
-	 * remove a stale lock.
+	 * Break the lock when it is too old, and try again without delay.
+	 * Give up when we are unable to remove a stale lock.
 	 */
 	if (stat(lock_file, &st) == 0)
-	    if (time((time_t *) 0) > st.st_ctime + var_flock_stale)
-		if (unlink(lock_file) < 0)
-		    if (errno != ENOENT)
-			break;
+	    if (time((time_t *) 0) > st.st_ctime + var_flock_stale) {
+		if (unlink(lock_file) == 0)
+		    continue;
+		if (errno != ENOENT)
+		    break;
+	    }
 
-	rand_sleep(var_flock_delay * MILLION, var_flock_delay * MILLION / 2);
+	/*
+	 * Back off quickly at first, then at $deliver_lock_delay intervals.
+	 */
+	errno = EEXIST;
+	if (deliver_lock_retry(&waited) == 0)
+	    break;
     }
     if (status && why)
 	vstring_sprintf(why, "unable to create lock file %s: %m", lock_file);
@@ -32,6 +32,8 @@
 
 #include <sys_defs.h>
 #include <ctype.h>
+#include <limits.h>
+#include <string.h>
 
 /* Utility library. */
 
@@ -94,6 +96,17 @@ static HEADER_OPTS header_opts[] = {
 static HTABLE *header_hash;		/* quick lookup */
 static VSTRING *header_key;
 
+ /*
+  * Quick reject: for each lower-case first character, a bit mask of the
+  * name lengths in header_hash (lengths >= 31 share one bit). Most header
+  * names in a message are not in the table, and are rejected without making
+  * a lower-case copy.
+  */
+static unsigned header_len_mask[UCHAR_MAX + 1];
+
+#define HEADER_LEN_BIT(len)	(1U << ((len) < 31 ? (len) : 31))
+#define HEADER_LEN_MASK(name)	header_len_mask[(unsigned char) TOLOWER(*(name))]
+
 /* header_opts_init - initialize */
 
 static void header_opts_init(void)
@@ -113,6 +126,7 @@ static void header_opts_init(void)
 	    VSTRING_ADDCH(header_key, TOLOWER(*cp));
 	VSTRING_TERMINATE(header_key);
 	htable_enter(header_hash, vstring_str(header_key), (void *) hp);
+	HEADER_LEN_MASK(hp->name) |= HEADER_LEN_BIT(cp - hp->name);
     }
 }
 
@@ -144,6 +158,7 @@ static void header_drop_init(void)
 	    hp->flags = HDR_OPT_DROP;
 	    ht = htable_enter(header_hash, *cpp, (void *) hp);
 	    hp->name = ht->key;
+	    HEADER_LEN_MASK(hp->name) |= HEADER_LEN_BIT(strlen(hp->name));
 	} else
 	    hp = (HEADER_OPTS *) ht->value;
 	hp->flags |= HDR_OPT_DROP;
@@ -156,6 +171,7 @@ static void header_drop_init(void)
 const HEADER_OPTS *header_opts_find(const char *string)
 {
     const char *cp;
+    const char *end;
 
     if (header_hash == 0) {
 	header_opts_init();
@@ -163,17 +179,24 @@ const HEADER_OPTS *header_opts_find(const char *string)
     }
 
     /*
-     * Look up the lower-cased version of the header name.
+     * Find the end of the header name, and skip names that cannot be in the
+     * table.
      */
-    VSTRING_RESET(header_key);
-    for (cp = string; *cp != ':'; cp++) {
+    for (cp = string; *cp != ':'; cp++)
 	if (*cp == 0)
 	    msg_panic("header_opts_find: no colon in header: %.30s", string);
+    if (cp == string)
+	return (0);
+    end = trimblanks((char *) string, cp - string);
+    if ((HEADER_LEN_MASK(string) & HEADER_LEN_BIT(end - string)) == 0)
+	return (0);
+
+    /*
+     * Look up the lower-cased version of the header name.
+     */
+    VSTRING_RESET(header_key);
+    for (cp = string; cp < end; cp++)
 	VSTRING_ADDCH(header_key, TOLOWER(*cp));
-    }
-    vstring_truncate(header_key,
-		     trimblanks(vstring_str(header_key), cp - string)
-		     - vstring_str(header_key));
     VSTRING_TERMINATE(header_key);
     return ((const HEADER_OPTS *) htable_find(header_hash, vstring_str(header_key)));
 }
@@ -70,7 +70,9 @@
 
 #include <log_adhoc.h>
 #include <mail_params.h>
+#include <mail_conf.h>
 #include <info_log_addr_form.h>
+#include <metrics_clnt.h>
 
  /*
   * Don't use "struct timeval" for time differences; use explicit signed
@@ -95,6 +97,7 @@ void    log_adhoc(const char *id, MSG_STATS *stats, RECIPIENT *recipient,
     DELTA_TIME sdelay;			/* connection set-up latency */
     DELTA_TIME xdelay;			/* transmission latency */
     struct timeval now;
+    const char *service;
 
     /*
      * Alas, we need an intermediate buffer for the pre-formatted result.
@@ -218,4 +221,16 @@ void    log_adhoc(const char *id, MSG_STATS *stats, RECIPIENT *recipient,
      * Ship it off.
      */
     msg_info("%s", vstring_str(buf));
+
+    /*
+     * Label the delay with the master.cf service name, so that, for example,
+     * "relay" and "smtp" deliveries can be told apart.
+     */
+    if (var_metrics_enable) {
+	if ((service = mail_conf_lookup(VAR_SERVNAME)) == 0)
+	    service = var_procname;
+	metrics_observe("postfix_delivery_delay_seconds",
+			delay.dt_sec + delay.dt_usec / 1000000.0,
+			"service", service, "status", status, (char *) 0);
+    }
 }
@@ -36,7 +36,10 @@
 /*	dictionary. When the configuration directory name is not
 /*	trusted, this function requires that the directory name is
 /*	authorized with the alternate_config_directories setting
-/*	in the default main.cf file.
+/*	in the default main.cf file. A process that was started by
+/*	the master(8) daemon uses the pre-parsed main.cf snapshot
+/*	that it inherits, provided that main.cf has not changed
+/*	since; see mail_conf_snap(3).
 /*
 /*	This function requires that all configuration directory
 /*	override mechanisms set the MAIL_CONFIG environment variable,
@@ -84,6 +87,7 @@
 /* ENVIRONMENT
 /*	MAIL_CONFIG, non-default configuration database
 /*	MAIL_VERBOSE, enable verbose mode
+/*	MAIL_CONFIG_SNAPSHOT, pre-parsed main.cf file descriptor
 /* FILES
 /*	/etc/postfix: default Postfix configuration directory.
 /* SEE ALSO
@@ -219,7 +223,8 @@ void    mail_conf_suck(void)
 	&& unsafe())				/* untrusted env and cli */
 	mail_conf_checkdir(var_config_dir);
     path = concatenate(var_config_dir, "/", "main.cf", (char *) 0);
-    if (dict_load_file_xt(CONFIG_DICT, path) == 0)
+    if (mail_conf_snap_load(CONFIG_DICT, path) == 0
+	&& dict_load_file_xt(CONFIG_DICT, path) == 0)
 	msg_fatal("open %s: %m", path);
     myfree(path);
 }
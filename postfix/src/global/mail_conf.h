@@ -23,6 +23,7 @@
 #define CONF_ENV_VERB	"MAIL_VERBOSE"	/* verbose mode on */
 #define CONF_ENV_DEBUG	"MAIL_DEBUG"	/* live debugging */
 #define CONF_ENV_LOGTAG	"MAIL_LOGTAG"	/* instance name */
+#define CONF_ENV_SNAP	"MAIL_CONFIG_SNAPSHOT"	/* pre-parsed main.cf */
 
  /*
   * External representation for booleans.
@@ -38,6 +39,12 @@ extern void mail_conf_suck(void);
 extern void mail_conf_flush(void);
 extern void mail_conf_checkdir(const char *);
 
+ /*
+  * Pre-parsed main.cf snapshot.
+  */
+extern int mail_conf_snap_create(const char *, const char *);
+extern int mail_conf_snap_load(const char *, const char *);
+
 extern void mail_conf_update(const char *, const char *);
 extern const char *mail_conf_lookup(const char *);
 extern const char *mail_conf_eval(const char *);
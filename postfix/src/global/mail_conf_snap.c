@@ -0,0 +1,309 @@
+/*++
+/* NAME
+/*	mail_conf_snap 3
+/* SUMMARY
+/*	pre-parsed main.cf snapshot
+/* SYNOPSIS
+/*	#include <mail_conf.h>
+/*
+/*	int	mail_conf_snap_create(conf_path, snap_path)
+/*	const char *conf_path;
+/*	const char *snap_path;
+/*
+/*	int	mail_conf_snap_load(dict_name, conf_path)
+/*	const char *dict_name;
+/*	const char *conf_path;
+/* DESCRIPTION
+/*	This module saves the name=value pairs of a main.cf file in
+/*	a compact binary form, so that a process can enter them into
+/*	a dictionary without reading and parsing the text file again.
+/*	The master(8) daemon uses this to speed up the start-up of
+/*	its child processes.
+/*
+/*	mail_conf_snap_create() reads the main.cf file specified
+/*	with \fIconf_path\fR, and saves its parsed content to a
+/*	temporary file specified with \fIsnap_path\fR. The temporary
+/*	file is removed immediately. The result is an open file
+/*	descriptor with the close-on-exec flag turned on, or -1 when
+/*	the snapshot could not be created. No snapshot is created
+/*	while main.cf is still being changed.
+/*
+/*	mail_conf_snap_load() looks for an inherited snapshot file
+/*	descriptor in the MAIL_CONFIG_SNAPSHOT environment variable,
+/*	and enters its content into the named dictionary, as
+/*	dict_load_file_xt() would do with the main.cf file specified
+/*	with \fIconf_path\fR. The snapshot is used only when the
+/*	device, inode number, size, modification time and status
+/*	change time of the main.cf file are unchanged since the
+/*	snapshot was created. The file descriptor is closed after
+/*	use. The result value is non-zero when the snapshot was
+/*	loaded, and zero when the caller must read the main.cf file
+/*	instead.
+/* SECURITY
+/* .ad
+/* .fi
+/*	mail_conf_snap_load() ignores the environment when the process
+/*	is running with set-uid or set-gid privileges, and a snapshot
+/*	must be owned by root or by the process owner.
+/* ENVIRONMENT
+/* .ad
+/* .fi
+/*	MAIL_CONFIG_SNAPSHOT, inherited snapshot file descriptor.
+/* SEE ALSO
+/*	mail_conf(3) global configuration parameter management
+/*	dict(3) generic dictionary manager
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef MAP_FAILED
+#define MAP_FAILED ((void *) -1)
+#endif
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <dict.h>
+#include <dict_ht.h>
+#include <iostuff.h>
+#include <safe.h>
+#include <stringops.h>
+
+/* Global library. */
+
+#include "mail_conf.h"
+
+ /*
+  * Snapshot file layout: a fixed-size header, followed by name\0value\0
+  * pairs. The header records the identity of the main.cf file that the
+  * pairs were read from. The snapshot is produced and consumed by programs
+  * from the same build, so there is no need for a portable encoding.
+  */
+#define MAIL_CONF_SNAP_MAGIC	"PFCONF01"
+
+typedef struct {
+    char    magic[sizeof(MAIL_CONF_SNAP_MAGIC)];
+    dev_t   dev;			/* main.cf device */
+    ino_t   ino;			/* main.cf inode */
+    off_t   size;			/* main.cf size */
+    time_t  mtime;			/* main.cf modification time */
+    time_t  ctime;			/* main.cf status change time */
+    uid_t   uid;			/* main.cf owner */
+    ssize_t count;			/* number of name=value pairs */
+    ssize_t len;			/* bytes after header */
+} MAIL_CONF_SNAP_HDR;
+
+#define MAIL_CONF_SNAP_TMP	"mail_conf_snap"
+
+/* mail_conf_snap_create - save parsed main.cf */
+
+int     mail_conf_snap_create(const char *conf_path, const char *snap_path)
+{
+    MAIL_CONF_SNAP_HDR hdr;
+    VSTREAM *fp;
+    VSTRING *buf;
+    struct stat st;
+    time_t  before;
+    DICT   *dict;
+    const char *name;
+    const char *value;
+    int     status;
+    int     fd;
+
+    /*
+     * Parse main.cf into a private dictionary. Don't save a file that is
+     * still being changed; the child processes will read main.cf themselves.
+     */
+    before = time((time_t *) 0);
+    if ((fp = vstream_fopen(conf_path, O_RDONLY, 0)) == 0) {
+	msg_warn("open %s: %m", conf_path);
+	return (-1);
+    }
+    dict_load_fp(MAIL_CONF_SNAP_TMP, fp);
+    if (fstat(vstream_fileno(fp), &st) < 0)
+	msg_fatal("fstat %s: %m", conf_path);
+    if (vstream_ferror(fp) || vstream_fclose(fp))
+	msg_fatal("read %s: %m", conf_path);
+    if (st.st_mtime >= before - 1 || st.st_ctime >= before - 1) {
+	if (msg_verbose)
+	    msg_info("%s: file is hot, no snapshot", conf_path);
+	dict_unregister(MAIL_CONF_SNAP_TMP);
+	return (-1);
+    }
+
+    /*
+     * Serialize the dictionary.
+     */
+    dict = dict_handle(MAIL_CONF_SNAP_TMP);
+    buf = vstring_alloc(10000);
+    memset((void *) &hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MAIL_CONF_SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.dev = st.st_dev;
+    hdr.ino = st.st_ino;
+    hdr.size = st.st_size;
+    hdr.mtime = st.st_mtime;
+    hdr.ctime = st.st_ctime;
+    hdr.uid = st.st_uid;
+    for (status = dict->sequence(dict, DICT_SEQ_FUN_FIRST, &name, &value);
+	 status == 0;
+	 status = dict->sequence(dict, DICT_SEQ_FUN_NEXT, &name, &value)) {
+	vstring_strcat(buf, name);
+	VSTRING_ADDCH(buf, 0);
+	vstring_strcat(buf, value);
+	VSTRING_ADDCH(buf, 0);
+	hdr.count += 1;
+    }
+    hdr.len = VSTRING_LEN(buf);
+    dict_unregister(MAIL_CONF_SNAP_TMP);
+
+    /*
+     * Save the result to an anonymous file. Only the file descriptor is
+     * passed on to child processes.
+     */
+    if (unlink(snap_path) < 0 && errno != ENOENT)
+	msg_warn("remove %s: %m", snap_path);
+    if ((fd = open(snap_path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+	msg_warn("create %s: %m", snap_path);
+	vstring_free(buf);
+	return (-1);
+    }
+    if (unlink(snap_path) < 0)
+	msg_warn("remove %s: %m", snap_path);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+    fp = vstream_fdopen(fd, O_RDWR);
+    if (vstream_fwrite(fp, (void *) &hdr, sizeof(hdr)) != sizeof(hdr)
+	|| vstream_fwrite(fp, vstring_str(buf), VSTRING_LEN(buf))
+	!= VSTRING_LEN(buf)
+	|| vstream_fflush(fp) != 0) {
+	msg_warn("write %s: %m", snap_path);
+	(void) vstream_fclose(fp);
+	fd = -1;
+    } else {
+	(void) vstream_fdclose(fp);
+    }
+    vstring_free(buf);
+    return (fd);
+}
+
+/* mail_conf_snap_read - load parsed main.cf from open snapshot */
+
+static int mail_conf_snap_read(int fd, const char *dict_name,
+			               const char *conf_path)
+{
+    const char *myname = "mail_conf_snap_load";
+    MAIL_CONF_SNAP_HDR *hp;
+    struct stat fst;
+    struct stat st;
+    char   *map;
+    char   *cp;
+    char   *end;
+    char   *name;
+    char   *value;
+    DICT   *dict;
+    ssize_t n;
+
+    /*
+     * Sanity check the inherited file. Give up at the first sign of trouble.
+     */
+    if (fstat(fd, &fst) < 0 || !S_ISREG(fst.st_mode)
+	|| (fst.st_uid != 0 && fst.st_uid != getuid())
+	|| fst.st_size < (off_t) sizeof(*hp))
+	return (0);
+    if ((map = mmap((void *) 0, fst.st_size, PROT_READ, MAP_SHARED,
+		    fd, (off_t) 0)) == MAP_FAILED) {
+	msg_warn("%s: mmap: %m", myname);
+	return (0);
+    }
+    hp = (MAIL_CONF_SNAP_HDR *) map;
+    if (memcmp(hp->magic, MAIL_CONF_SNAP_MAGIC, sizeof(hp->magic)) != 0
+	|| hp->len != fst.st_size - (off_t) sizeof(*hp)
+	|| (hp->len > 0 && map[fst.st_size - 1] != 0)) {
+	(void) munmap(map, fst.st_size);
+	return (0);
+    }
+
+    /*
+     * Use the snapshot only if main.cf has not changed.
+     */
+    if (stat(conf_path, &st) < 0
+	|| st.st_dev != hp->dev || st.st_ino != hp->ino
+	|| st.st_size != hp->size || st.st_mtime != hp->mtime
+	|| st.st_ctime != hp->ctime) {
+	if (msg_verbose)
+	    msg_info("%s: %s has changed", myname, conf_path);
+	(void) munmap(map, fst.st_size);
+	return (0);
+    }
+
+    /*
+     * Instantiate the dictionary even if the file is empty.
+     */
+    if ((dict = dict_handle(dict_name)) == 0) {
+	dict = dict_ht_open(dict_name, O_CREAT | O_RDWR, 0);
+	dict_register(dict_name, dict);
+    }
+    cp = map + sizeof(*hp);
+    end = map + fst.st_size;
+    for (n = 0; n < hp->count && cp < end; n++) {
+	name = cp;
+	cp += strlen(cp) + 1;
+	if (cp >= end)
+	    msg_fatal("%s: truncated snapshot of %s", myname, conf_path);
+	value = cp;
+	cp += strlen(cp) + 1;
+	if (msg_verbose > 1)
+	    msg_info("%s: %s = %s", myname, name, value);
+	if (dict->update(dict, name, value) != 0)
+	    msg_fatal("%s: unable to update %s:%s",
+		      conf_path, dict->type, dict->name);
+    }
+    if (n != hp->count || cp != end)
+	msg_fatal("%s: corrupted snapshot of %s", myname, conf_path);
+    dict->owner.uid = hp->uid;
+    dict->owner.status = (hp->uid != 0);
+    (void) munmap(map, fst.st_size);
+    return (1);
+}
+
+/* mail_conf_snap_load - load parsed main.cf */
+
+int     mail_conf_snap_load(const char *dict_name, const char *conf_path)
+{
+    char   *fd_str;
+    int     fd;
+    int     status;
+
+    /*
+     * Don't trust the environment of a privileged process. Don't close the
+     * standard streams when the environment is bogus.
+     */
+    if ((fd_str = safe_getenv(CONF_ENV_SNAP)) == 0 || !alldig(fd_str))
+	return (0);
+    fd = atoi(fd_str);
+    (void) unsetenv(CONF_ENV_SNAP);
+    if (fd <= STDERR_FILENO)
+	return (0);
+
+    /*
+     * The snapshot is used once. Close it whether or not we can use it.
+     */
+    status = mail_conf_snap_read(fd, dict_name, conf_path);
+    (void) close(fd);
+    return (status);
+}
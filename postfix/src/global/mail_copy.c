@@ -39,9 +39,9 @@
 /* .IP MAIL_COPY_DOT
 /*	Prepend a `.' character to lines beginning with `.'.
 /* .IP MAIL_COPY_TOFILE
-/*	On systems that support this, use fsync() to flush the
-/*	data to stable storage, and truncate the destination
-/*	file to its original length in case of problems.
+/*	On systems that support this, use fdatasync() or fsync()
+/*	to flush the data to stable storage, and truncate the
+/*	destination file to its original length in case of problems.
 /* .IP MAIL_COPY_FROM
 /*	Prepend a UNIX-style From_ line to the message.
 /* .IP MAIL_COPY_BLANK
@@ -270,7 +270,10 @@ int     mail_copy(const char *sender,
      */
     read_error = vstream_ferror(src);
     write_error = vstream_fflush(dst);
-#ifdef HAS_FSYNC
+#if defined(HAS_FDATASYNC)
+    if ((flags & MAIL_COPY_TOFILE) != 0)
+	write_error |= fdatasync(vstream_fileno(dst));
+#elif defined(HAS_FSYNC)
     if ((flags & MAIL_COPY_TOFILE) != 0)
 	write_error |= fsync(vstream_fileno(dst));
 #endif
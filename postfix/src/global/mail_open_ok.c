@@ -11,6 +11,12 @@
 /*	const char *queue_id;
 /*	struct stat *statp;
 /*	char	**pathp
+/*
+/*	VSTREAM	*mail_open_ok_stream(queue_name, queue_id, flags, statp)
+/*	const char *queue_name;
+/*	const char *queue_id;
+/*	int	flags;
+/*	struct stat *statp;
 /* DESCRIPTION
 /*	mail_open_ok() determines if it is OK to open the specified
 /*	queue file.
@@ -36,11 +42,22 @@
 /*	attributes and \fIpathp\fR a copy of the file name. The file
 /*	name is volatile. Make a copy if it is to be used for any
 /*	appreciable amount of time.
+/*
+/*	mail_open_ok_stream() opens the specified queue file with
+/*	mail_queue_open() and the specified open flags, and then
+/*	applies the same tests to the open file. This saves one
+/*	queue file path lookup, and is not subject to race conditions.
+/*	The file is opened in non-blocking mode and without following
+/*	a symlink, so that a non-file object cannot block the caller;
+/*	the stream is in blocking mode upon return.
 /* DIAGNOSTICS
 /*	Warnings: bad file attributes (file type), multiple hard links.
 /*	mail_open_ok() returns MAIL_OPEN_YES for good files, MAIL_OPEN_NO
 /*	for anything else. It is left up to the system administrator to
 /*	deal with non-file objects.
+/*
+/*	mail_open_ok_stream() returns a null pointer for anything
+/*	that is not a good file.
 /* BUGS
 /*	mail_open_ok() examines a queue file without actually opening
 /*	it, and therefore is susceptible to race conditions.
@@ -61,45 +78,26 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <warn_stat.h>
+#include <vstream.h>
+#include <iostuff.h>
 
 /* Global library. */
 
 #include "mail_queue.h"
 #include "mail_open_ok.h"
 
-/* mail_open_ok - see if this file is OK to open */
+/* mail_open_ok_attr - see if these file attributes are OK */
 
-int     mail_open_ok(const char *queue_name, const char *queue_id,
-		             struct stat * statp, const char **path)
+static int mail_open_ok_attr(const char *path, struct stat * statp)
 {
-    if (mail_queue_name_ok(queue_name) == 0) {
-	msg_warn("bad mail queue name: %s", queue_name);
-	return (MAIL_OPEN_NO);
-    }
-    if (mail_queue_id_ok(queue_id) == 0)
-	return (MAIL_OPEN_NO);
-
-
-    /*
-     * I really would like to look up the file attributes *after* opening the
-     * file so that we could save one directory traversal on systems without
-     * name-to-inode cache. However, we don't necessarily always want to open
-     * the file.
-     */
-    *path = mail_queue_path((VSTRING *) 0, queue_name, queue_id);
-
-    if (lstat(*path, statp) < 0) {
-	if (errno != ENOENT)
-	    msg_warn("%s: %m", *path);
-	return (MAIL_OPEN_NO);
-    }
     if (!S_ISREG(statp->st_mode)) {
-	msg_warn("%s: uid %ld: not a regular file", *path, (long) statp->st_uid);
+	msg_warn("%s: uid %ld: not a regular file", path, (long) statp->st_uid);
 	return (MAIL_OPEN_NO);
     }
     if ((statp->st_mode & S_IRWXU) != MAIL_QUEUE_STAT_READY)
@@ -117,11 +115,84 @@ int     mail_open_ok(const char *queue_name, const char *queue_id,
 
     if (statp->st_nlink > 1) {
 	if (msg_verbose)
-	    msg_info("%s: uid %ld: file has %d links", *path,
+	    msg_info("%s: uid %ld: file has %d links", path,
 		     (long) statp->st_uid, (int) statp->st_nlink);
 	else if (statp->st_ctime < time((time_t *) 0) - MINUTE_SECONDS)
-	    msg_warn("%s: uid %ld: file has %d links", *path,
+	    msg_warn("%s: uid %ld: file has %d links", path,
 		     (long) statp->st_uid, (int) statp->st_nlink);
     }
     return (MAIL_OPEN_YES);
 }
+
+/* mail_open_ok_name - see if this queue file name is OK */
+
+static int mail_open_ok_name(const char *queue_name, const char *queue_id)
+{
+    if (mail_queue_name_ok(queue_name) == 0) {
+	msg_warn("bad mail queue name: %s", queue_name);
+	return (MAIL_OPEN_NO);
+    }
+    if (mail_queue_id_ok(queue_id) == 0)
+	return (MAIL_OPEN_NO);
+    return (MAIL_OPEN_YES);
+}
+
+/* mail_open_ok - see if this file is OK to open */
+
+int     mail_open_ok(const char *queue_name, const char *queue_id,
+		             struct stat * statp, const char **path)
+{
+    if (mail_open_ok_name(queue_name, queue_id) == MAIL_OPEN_NO)
+	return (MAIL_OPEN_NO);
+
+    /*
+     * I really would like to look up the file attributes *after* opening the
+     * file so that we could save one directory traversal on systems without
+     * name-to-inode cache. However, we don't necessarily always want to open
+     * the file. See mail_open_ok_stream() for callers that do.
+     */
+    *path = mail_queue_path((VSTRING *) 0, queue_name, queue_id);
+
+    if (lstat(*path, statp) < 0) {
+	if (errno != ENOENT)
+	    msg_warn("%s: %m", *path);
+	return (MAIL_OPEN_NO);
+    }
+    return (mail_open_ok_attr(*path, statp));
+}
+
+/* mail_open_ok_stream - open file and see if it is OK */
+
+VSTREAM *mail_open_ok_stream(const char *queue_name, const char *queue_id,
+			             int flags, struct stat * statp)
+{
+    VSTREAM *fp;
+
+#ifdef O_NOFOLLOW
+#define MAIL_OPEN_OK_FLAGS	(O_NONBLOCK | O_NOFOLLOW)
+#else
+#define MAIL_OPEN_OK_FLAGS	O_NONBLOCK
+#endif
+
+    if (mail_open_ok_name(queue_name, queue_id) == MAIL_OPEN_NO)
+	return (0);
+    if ((fp = mail_queue_open(queue_name, queue_id,
+			      flags | MAIL_OPEN_OK_FLAGS, 0)) == 0) {
+	if (errno == ELOOP)
+	    msg_warn("%s %s: not a regular file", queue_name, queue_id);
+	else if (errno != ENOENT)
+	    msg_warn("open %s %s: %m", queue_name, queue_id);
+	return (0);
+    }
+    if (fstat(vstream_fileno(fp), statp) < 0) {
+	msg_warn("fstat %s: %m", VSTREAM_PATH(fp));
+	(void) vstream_fclose(fp);
+	return (0);
+    }
+    if (mail_open_ok_attr(VSTREAM_PATH(fp), statp) == MAIL_OPEN_NO) {
+	(void) vstream_fclose(fp);
+	return (0);
+    }
+    non_blocking(vstream_fileno(fp), BLOCKING);
+    return (fp);
+}
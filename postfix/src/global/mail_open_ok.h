@@ -11,10 +11,17 @@
 /* DESCRIPTION
 /* .nf
 
+ /*
+  * Utility library.
+  */
+#include <vstream.h>
+
  /* External interface. */
 
 extern int mail_open_ok(const char *, const char *, struct stat *,
 			        const char **);
+extern VSTREAM *mail_open_ok_stream(const char *, const char *, int,
+				            struct stat *);
 
 #define MAIL_OPEN_YES	1
 #define MAIL_OPEN_NO	2
@@ -39,6 +39,7 @@
 /*	char	*var_servname;
 /*	int	var_pid;
 /*	int	var_ipc_timeout;
+/*	char	*var_anvil_service;
 /*	char	*var_pid_dir;
 /*	int	var_dont_remove;
 /*	char	*var_inet_interfaces;
@@ -53,9 +54,15 @@
 /*	char	*var_mail_version;
 /*	int	var_ipc_idle_limit;
 /*	int	var_ipc_ttl_limit;
+/*	int	var_maps_cache_size;
+/*	int	var_syslog_buf_size;
+/*	int	var_maps_cache_ttl;
+/*	int	var_sockmap_max_idle;
+/*	int	var_sockmap_max_ttl;
 /*	char	*var_db_type;
 /*	char	*var_hash_queue_names;
 /*	int	var_hash_queue_depth;
+/*	char	*var_queue_stripe_dirs;
 /*	int	var_trigger_timeout;
 /*	char	*var_rcpt_delim;
 /*	int	var_fork_tries;
@@ -65,6 +72,8 @@
 /*	int	var_flock_stale;
 /*	int	var_disable_dns;
 /*	int	var_soft_bounce;
+/*	bool	var_milt_parallel;
+/*	bool	var_milt_conn_reuse;
 /*	time_t	var_starttime;
 /*	int	var_ownreq_special;
 /*	int	var_daemon_timeout;
@@ -124,6 +133,15 @@
 /*	bool	var_multi_enable;
 /*	bool	var_long_queue_ids;
 /*	bool	var_daemon_open_fatal;
+/*	bool	var_reopen_tables;
+/*	bool	var_excl_accept;
+/*	bool	var_stage_timing;
+/*	bool	var_metrics_enable;
+/*	char	*var_metrics_service;
+/*	bool	var_metrics_memory;
+/*	char	*var_queue_repl_peer;
+/*	int	var_queue_repl_tmout;
+/*	int	var_table_stats_int;
 /*	char	*var_dsn_filter;
 /*	int	var_smtputf8_enable
 /*	int	var_strict_smtputf8;
@@ -160,6 +178,7 @@
 /*	char	*var_maillog_file_comp;
 /*	char	*var_maillog_file_stamp;
 /*	char	*var_maillog_file_perms;
+/*	char	*var_maillog_file_format;
 /*	char	*var_postlog_service;
 /*
 /*	char	*var_dnssec_probe;
@@ -223,6 +242,7 @@
 #include <dict.h>
 #include <dict_db.h>
 #include <dict_lmdb.h>
+#include <dict_sockmap.h>
 #include <inet_proto.h>
 #include <vstring_vstream.h>
 #include <iostuff.h>
@@ -240,6 +260,7 @@
 #include <mail_params.h>
 #include <compat_level.h>
 #include <config_known_tcp_ports.h>
+#include <maps.h>
 
  /*
   * Special configuration variables.
@@ -277,6 +298,7 @@ char   *var_procname;
 char   *var_servname;
 int     var_pid;
 int     var_ipc_timeout;
+char   *var_anvil_service;
 char   *var_pid_dir;
 int     var_dont_remove;
 char   *var_inet_interfaces;
@@ -285,15 +307,24 @@ char   *var_inet_protocols;
 char   *var_mynetworks;
 char   *var_double_bounce_sender;
 int     var_line_limit;
+int     var_msg_stream_bufsize;
+bool    var_milt_parallel;
+bool    var_milt_conn_reuse;
 char   *var_alias_db_map;
 long    var_message_limit;
 char   *var_mail_release;
 char   *var_mail_version;
 int     var_ipc_idle_limit;
 int     var_ipc_ttl_limit;
+int     var_maps_cache_size;
+int     var_syslog_buf_size;
+int     var_maps_cache_ttl;
+int     var_sockmap_max_idle;
+int     var_sockmap_max_ttl;
 char   *var_db_type;
 char   *var_hash_queue_names;
 int     var_hash_queue_depth;
+char   *var_queue_stripe_dirs;
 int     var_trigger_timeout;
 char   *var_rcpt_delim;
 int     var_fork_tries;
@@ -362,6 +393,15 @@ char   *var_multi_name;
 bool    var_multi_enable;
 bool    var_long_queue_ids;
 bool    var_daemon_open_fatal;
+bool    var_reopen_tables;
+bool    var_excl_accept;
+bool    var_stage_timing;
+bool    var_metrics_enable;
+char   *var_metrics_service;
+bool    var_metrics_memory;
+char   *var_queue_repl_peer;
+int     var_queue_repl_tmout;
+int     var_table_stats_int;
 bool    var_dns_ncache_ttl_fix;
 char   *var_dsn_filter;
 int     var_smtputf8_enable;
@@ -378,6 +418,7 @@ char   *var_maillog_file_pfxs;
 char   *var_maillog_file_comp;
 char   *var_maillog_file_stamp;
 char   *var_maillog_file_perms;
+char   *var_maillog_file_format;
 char   *var_postlog_service;
 
 char   *var_dnssec_probe;
@@ -737,6 +778,7 @@ void    mail_params_init()
 	VAR_MAILLOG_FILE_COMP, DEF_MAILLOG_FILE_COMP, &var_maillog_file_comp, 1, 0,
 	VAR_MAILLOG_FILE_STAMP, DEF_MAILLOG_FILE_STAMP, &var_maillog_file_stamp, 1, 0,
 	VAR_MAILLOG_FILE_PERMS, DEF_MAILLOG_FILE_PERMS, &var_maillog_file_perms, 1, 0,
+	VAR_MAILLOG_FILE_FORMAT, DEF_MAILLOG_FILE_FORMAT, &var_maillog_file_format, 1, 0,
 	VAR_POSTLOG_SERVICE, DEF_POSTLOG_SERVICE, &var_postlog_service, 1, 0,
 	VAR_DNSSEC_PROBE, DEF_DNSSEC_PROBE, &var_dnssec_probe, 0, 0,
 	VAR_KNOWN_TCP_PORTS, DEF_KNOWN_TCP_PORTS, &var_known_tcp_ports, 0, 0,
@@ -777,12 +819,14 @@ void    mail_params_init()
 	VAR_PID_DIR, DEF_PID_DIR, &var_pid_dir, 1, 0,
 	VAR_INET_INTERFACES, DEF_INET_INTERFACES, &var_inet_interfaces, 0, 0,
 	VAR_PROXY_INTERFACES, DEF_PROXY_INTERFACES, &var_proxy_interfaces, 0, 0,
+	VAR_ANVIL_SERVICE, DEF_ANVIL_SERVICE, &var_anvil_service, 1, 0,
 	VAR_DOUBLE_BOUNCE, DEF_DOUBLE_BOUNCE, &var_double_bounce_sender, 1, 0,
 	VAR_DEFAULT_PRIVS, DEF_DEFAULT_PRIVS, &var_default_privs, 1, 0,
 	VAR_ALIAS_DB_MAP, DEF_ALIAS_DB_MAP, &var_alias_db_map, 0, 0,
 	VAR_MAIL_RELEASE, DEF_MAIL_RELEASE, &var_mail_release, 1, 0,
 	VAR_DB_TYPE, DEF_DB_TYPE, &var_db_type, 1, 0,
 	VAR_HASH_QUEUE_NAMES, DEF_HASH_QUEUE_NAMES, &var_hash_queue_names, 1, 0,
+	VAR_QUEUE_STRIPE_DIRS, DEF_QUEUE_STRIPE_DIRS, &var_queue_stripe_dirs, 0, 0,
 	VAR_RCPT_DELIM, DEF_RCPT_DELIM, &var_rcpt_delim, 0, 0,
 	VAR_RELAY_DOMAINS, DEF_RELAY_DOMAINS, &var_relay_domains, 0, 0,
 	VAR_FFLUSH_DOMAINS, DEF_FFLUSH_DOMAINS, &var_fflush_domains, 0, 0,
@@ -814,6 +858,8 @@ void    mail_params_init()
 	VAR_SMTPUTF8_AUTOCLASS, DEF_SMTPUTF8_AUTOCLASS, &var_smtputf8_autoclass, 1, 0,
 	VAR_DROP_HDRS, DEF_DROP_HDRS, &var_drop_hdrs, 0, 0,
 	VAR_INFO_LOG_ADDR_FORM, DEF_INFO_LOG_ADDR_FORM, &var_info_log_addr_form, 1, 0,
+	VAR_METRICS_SERVICE, DEF_METRICS_SERVICE, &var_metrics_service, 1, 0,
+	VAR_QUEUE_REPL_PEER, DEF_QUEUE_REPL_PEER, &var_queue_repl_peer, 0, 0,
 	0,
     };
     static const CONFIG_STR_FN_TABLE function_str_defaults_2[] = {
@@ -825,6 +871,7 @@ void    mail_params_init()
 	VAR_MAX_USE, DEF_MAX_USE, &var_use_limit, 1, 0,
 	VAR_DONT_REMOVE, DEF_DONT_REMOVE, &var_dont_remove, 0, 0,
 	VAR_LINE_LIMIT, DEF_LINE_LIMIT, &var_line_limit, 512, 0,
+	VAR_MSG_STREAM_BUFSIZE, DEF_MSG_STREAM_BUFSIZE, &var_msg_stream_bufsize, 0, 0,
 	VAR_HASH_QUEUE_DEPTH, DEF_HASH_QUEUE_DEPTH, &var_hash_queue_depth, 1, 0,
 	VAR_FORK_TRIES, DEF_FORK_TRIES, &var_fork_tries, 1, 0,
 	VAR_FLOCK_TRIES, DEF_FLOCK_TRIES, &var_flock_tries, 1, 0,
@@ -838,6 +885,8 @@ void    mail_params_init()
 	VAR_MIME_BOUND_LEN, DEF_MIME_BOUND_LEN, &var_mime_bound_len, 1, 0,
 	VAR_DELAY_MAX_RES, DEF_DELAY_MAX_RES, &var_delay_max_res, MIN_DELAY_MAX_RES, MAX_DELAY_MAX_RES,
 	VAR_INET_WINDOW, DEF_INET_WINDOW, &var_inet_windowsize, 0, 0,
+	VAR_MAPS_CACHE_SIZE, DEF_MAPS_CACHE_SIZE, &var_maps_cache_size, 0, 0,
+	VAR_SYSLOG_BUF_SIZE, DEF_SYSLOG_BUF_SIZE, &var_syslog_buf_size, 0, 0,
 	0,
     };
     static const CONFIG_LONG_TABLE long_defaults[] = {
@@ -851,12 +900,17 @@ void    mail_params_init()
 	VAR_IPC_TIMEOUT, DEF_IPC_TIMEOUT, &var_ipc_timeout, 1, 0,
 	VAR_IPC_IDLE, DEF_IPC_IDLE, &var_ipc_idle_limit, 1, 0,
 	VAR_IPC_TTL, DEF_IPC_TTL, &var_ipc_ttl_limit, 1, 0,
+	VAR_MAPS_CACHE_TTL, DEF_MAPS_CACHE_TTL, &var_maps_cache_ttl, 1, 0,
+	VAR_SOCKMAP_MAX_IDLE, DEF_SOCKMAP_MAX_IDLE, &var_sockmap_max_idle, 1, 0,
+	VAR_SOCKMAP_MAX_TTL, DEF_SOCKMAP_MAX_TTL, &var_sockmap_max_ttl, 1, 0,
 	VAR_TRIGGER_TIMEOUT, DEF_TRIGGER_TIMEOUT, &var_trigger_timeout, 1, 0,
 	VAR_FORK_DELAY, DEF_FORK_DELAY, &var_fork_delay, 1, 0,
 	VAR_FLOCK_DELAY, DEF_FLOCK_DELAY, &var_flock_delay, 1, 0,
 	VAR_FLOCK_STALE, DEF_FLOCK_STALE, &var_flock_stale, 1, 0,
 	VAR_DAEMON_TIMEOUT, DEF_DAEMON_TIMEOUT, &var_daemon_timeout, 1, 0,
 	VAR_IN_FLOW_DELAY, DEF_IN_FLOW_DELAY, &var_in_flow_delay, 0, 10,
+	VAR_TABLE_STATS_INT, DEF_TABLE_STATS_INT, &var_table_stats_int, 0, 0,
+	VAR_QUEUE_REPL_TMOUT, DEF_QUEUE_REPL_TMOUT, &var_queue_repl_tmout, 1, 0,
 	0,
     };
     static const CONFIG_BOOL_TABLE bool_defaults[] = {
@@ -877,6 +931,13 @@ void    mail_params_init()
 	VAR_LONG_QUEUE_IDS, DEF_LONG_QUEUE_IDS, &var_long_queue_ids,
 	VAR_STRICT_SMTPUTF8, DEF_STRICT_SMTPUTF8, &var_strict_smtputf8,
 	VAR_ENABLE_ORCPT, DEF_ENABLE_ORCPT, &var_enable_orcpt,
+	VAR_MILT_PARALLEL, DEF_MILT_PARALLEL, &var_milt_parallel,
+	VAR_MILT_CONN_REUSE, DEF_MILT_CONN_REUSE, &var_milt_conn_reuse,
+	VAR_REOPEN_TABLES, DEF_REOPEN_TABLES, &var_reopen_tables,
+	VAR_EXCL_ACCEPT, DEF_EXCL_ACCEPT, &var_excl_accept,
+	VAR_STAGE_TIMING, DEF_STAGE_TIMING, &var_stage_timing,
+	VAR_METRICS_ENABLE, DEF_METRICS_ENABLE, &var_metrics_enable,
+	VAR_METRICS_MEMORY, DEF_METRICS_MEMORY, &var_metrics_memory,
 	0,
     };
     const char *cp;
@@ -987,9 +1048,18 @@ void    mail_params_init()
     dict_db_cache_size = var_db_read_buf;
     dict_lmdb_map_size = var_lmdb_map_size;
     inet_windowsize = var_inet_windowsize;
+    maps_cache_size = var_maps_cache_size;
+    msg_syslog_set_buffer_size(var_syslog_buf_size);
+    maps_cache_ttl = var_maps_cache_ttl;
+    dict_stats_interval = var_table_stats_int;
+    dict_sockmap_max_idle = var_sockmap_max_idle;
+    dict_sockmap_max_ttl = var_sockmap_max_ttl;
     if (set_logwriter_create_perms(var_maillog_file_perms) < 0)
 	msg_warn("ignoring bad permissions: %s = %s",
 		 VAR_MAILLOG_FILE_PERMS, var_maillog_file_perms);
+    if (set_logwriter_format(var_maillog_file_format) < 0)
+	msg_warn("ignoring bad format: %s = %s",
+		 VAR_MAILLOG_FILE_FORMAT, var_maillog_file_format);
 
     /*
      * Variables whose defaults are determined at runtime, after other
@@ -384,6 +384,10 @@ extern char *var_syslog_facility;
 #define LOG_FACILITY	LOG_MAIL
 #endif
 
+#define VAR_SYSLOG_BUF_SIZE	"syslog_buffer_size"
+#define DEF_SYSLOG_BUF_SIZE	0
+extern int var_syslog_buf_size;
+
  /*
   * Big brother: who receives a blank-carbon copy of all mail that enters
   * this mail system.
@@ -428,6 +432,40 @@ extern char *var_drop_hdrs;
 #define DEF_HFROM_FORMAT	HFROM_FORMAT_NAME_STD
 extern char *var_hfrom_format;
 
+ /*
+  * Cleanup server: share file system syncs between queue files (group
+  * commit).
+  */
+#define VAR_CLEANUP_SYNC_LOCK	"cleanup_group_commit_lock_file"
+#define DEF_CLEANUP_SYNC_LOCK	""
+extern char *var_cleanup_sync_lock;
+
+ /*
+  * Cleanup server: write the queue file strictly sequentially, with the
+  * final message size information in a trailer record.
+  */
+#define VAR_QFILE_SIZE_TRAILER	"queue_file_size_trailer"
+#define DEF_QFILE_SIZE_TRAILER	0
+extern int var_qfile_size_trailer;
+
+ /*
+  * Cleanup server: number of message submissions that one process handles
+  * concurrently.
+  */
+#define VAR_CLEANUP_CLIENT_LIMIT	"cleanup_client_limit"
+#define DEF_CLEANUP_CLIENT_LIMIT	1
+extern int var_cleanup_client_limit;
+
+ /*
+  * Cleanup server: remember a fingerprint instead of a copy of each
+  * recipient in the duplicate filter.
+  */
+#define DUP_FILTER_STYLE_EXACT	"exact"
+#define DUP_FILTER_STYLE_FPRINT	"fingerprint"
+#define VAR_CLEANUP_DUP_STYLE	"cleanup_duplicate_filter_style"
+#define DEF_CLEANUP_DUP_STYLE	DUP_FILTER_STYLE_EXACT
+extern char *var_cleanup_dup_style;
+
  /*
   * Standards violation: allow/permit RFC 822-style addresses in SMTP
   * commands.
@@ -634,6 +672,10 @@ extern char *var_fbck_transp_maps;
 #define DEF_FORWARD_PATH	"$home/.forward${recipient_delimiter}${extension}, $home/.forward"
 extern char *var_forward_path;
 
+#define VAR_FWD_CACHE_TTL	"local_forward_cache_ttl"
+#define DEF_FWD_CACHE_TTL	"0s"
+extern int var_fwd_cache_ttl;
+
  /*
   * Local delivery: external command execution directory.
   */
@@ -910,6 +952,101 @@ extern char *var_defer_xports;
 #define DEF_QMGR_CLOG_WARN_TIME	"300s"
 extern int var_qmgr_clog_warn_time;
 
+ /*
+  * Queue manager: optional persistent index with deferred queue file
+  * delivery attempt times.
+  */
+#define VAR_QMGR_INDEX_MAP	"qmgr_queue_index_map"
+#define DEF_QMGR_INDEX_MAP	""
+extern char *var_qmgr_index_map;
+
+#define VAR_QMGR_INDEX_SCAN	"qmgr_queue_index_cleanup_interval"
+#define DEF_QMGR_INDEX_SCAN	"12h"
+extern int var_qmgr_index_scan;
+
+ /*
+  * Queue manager: time-ordered deferred queue scans.
+  */
+#define VAR_QMGR_FULL_SCAN_INT	"qmgr_deferred_full_scan_interval"
+#define DEF_QMGR_FULL_SCAN_INT	"0s"
+extern int var_qmgr_full_scan_int;
+
+ /*
+  * Queue manager: paced deferred queue flush.
+  */
+#define VAR_QMGR_DFR_FEED_RATE	"qmgr_deferred_feed_rate"
+#define DEF_QMGR_DFR_FEED_RATE	0
+extern int var_qmgr_dfr_feed_rate;
+
+ /*
+  * Queue manager: sharing one queue among multiple queue manager processes.
+  */
+#define VAR_QMGR_SHARD_COUNT	"qmgr_shard_count"
+#define DEF_QMGR_SHARD_COUNT	1
+extern int var_qmgr_shard_count;
+
+#define VAR_QMGR_SHARD_INDEX	"qmgr_shard_index"
+#define DEF_QMGR_SHARD_INDEX	0
+extern int var_qmgr_shard_index;
+
+#define VAR_QMGR_SHARD_TRIGGERS	"qmgr_shard_trigger_services"
+#define DEF_QMGR_SHARD_TRIGGERS	""
+extern char *var_qmgr_shard_triggers;
+
+ /*
+  * Queue manager: periodic scheduler status snapshots.
+  */
+#define VAR_QMGR_STATUS_FILE	"qmgr_status_file"
+#define DEF_QMGR_STATUS_FILE	""
+extern char *var_qmgr_status_file;
+
+#define VAR_QMGR_STATUS_INT	"qmgr_status_update_interval"
+#define DEF_QMGR_STATUS_INT	"10s"
+extern int var_qmgr_status_int;
+
+ /*
+  * Queue manager: destination feedback state that survives a restart.
+  */
+#define VAR_QMGR_FBSTATE_FILE	"qmgr_feedback_state_file"
+#define DEF_QMGR_FBSTATE_FILE	""
+extern char *var_qmgr_fbstate_file;
+
+#define VAR_QMGR_FBSTATE_INT	"qmgr_feedback_state_update_interval"
+#define DEF_QMGR_FBSTATE_INT	"60s"
+extern int var_qmgr_fbstate_int;
+
+#define VAR_QMGR_FBSTATE_MAXAGE	"qmgr_feedback_state_max_age"
+#define DEF_QMGR_FBSTATE_MAXAGE	"1h"
+extern int var_qmgr_fbstate_maxage;
+
+ /*
+  * Queue manager: memory budget for in-core messages and recipients.
+  */
+#define VAR_QMGR_MEMORY_LIMIT	"qmgr_message_memory_limit"
+#define DEF_QMGR_MEMORY_LIMIT	0
+extern long var_qmgr_memory_limit;
+
+ /*
+  * Queue manager: skip deferred mail for dead destinations without reading.
+  */
+#define VAR_QMGR_PARK_DEAD	"qmgr_dead_destination_parking"
+#define DEF_QMGR_PARK_DEAD	0
+extern bool var_qmgr_park_dead;
+
+ /*
+  * Queue manager: scheduling head start for high-priority mail.
+  */
+#define VAR_QMGR_PRIO_OFFSET	"qmgr_priority_time_offset"
+#define DEF_QMGR_PRIO_OFFSET	"3600s"
+extern int var_qmgr_prio_offset;
+
+ /*
+  * Queue manager: DNS prefetch for new destinations.
+  */
+#define VAR_QMGR_PREFETCH_XPORTS	"qmgr_dns_prefetch_transports"
+#define DEF_QMGR_PREFETCH_XPORTS	""
+extern char *var_qmgr_prefetch_xports;
+
  /*
   * Master: default process count limit per mail subsystem.
   */
@@ -924,6 +1061,26 @@ extern int var_proc_limit;
 #define DEF_THROTTLE_TIME	"60s"
 extern int var_throttle_time;
 
+#define VAR_MASTER_STATS_FILE	"master_stats_file"
+#define DEF_MASTER_STATS_FILE	""
+extern char *var_master_stats_file;
+
+#define VAR_MASTER_STATS_INT	"master_stats_update_interval"
+#define DEF_MASTER_STATS_INT	"10s"
+extern int var_master_stats_int;
+
+#define VAR_LIMIT_GROW_DELAY	"master_limit_grow_delay"
+#define DEF_LIMIT_GROW_DELAY	"2s"
+extern int var_limit_grow_delay;
+
+#define VAR_LIMIT_SHRINK_DELAY	"master_limit_shrink_delay"
+#define DEF_LIMIT_SHRINK_DELAY	"300s"
+extern int var_limit_shrink_delay;
+
+#define VAR_LIMIT_MEM_RESERVE	"master_limit_memory_reserve"
+#define DEF_LIMIT_MEM_RESERVE	0
+extern long var_limit_mem_reserve;
+
  /*
   * Master: what master.cf services are turned off.
   */
@@ -931,6 +1088,14 @@ extern int var_throttle_time;
 #define DEF_MASTER_DISABLE	""
 extern char *var_master_disable;
 
+#define VAR_MASTER_CPU_AFFINITY	"master_cpu_affinity"
+#define DEF_MASTER_CPU_AFFINITY	""
+extern char *var_master_cpu_affinity;
+
+#define VAR_MASTER_INCR_RELOAD	"master_incremental_reload"
+#define DEF_MASTER_INCR_RELOAD	0
+extern bool var_master_incr_reload;
+
  /*
   * Any subsystem: default maximum number of clients serviced before a mail
   * subsystem terminates (except queue manager).
@@ -972,6 +1137,30 @@ extern int var_ipc_idle_limit;
 #define DEF_IPC_TTL		"1000s"
 extern int var_ipc_ttl_limit;
 
+ /*
+  * Any subsystem: optional per-process cache of lookup table search results
+  * (see maps(3)). A size of zero disables the cache.
+  */
+#define VAR_MAPS_CACHE_SIZE	"maps_cache_size"
+#define DEF_MAPS_CACHE_SIZE	0
+extern int var_maps_cache_size;
+
+#define VAR_MAPS_CACHE_TTL	"maps_cache_ttl"
+#define DEF_MAPS_CACHE_TTL	"60s"
+extern int var_maps_cache_ttl;
+
+ /*
+  * Any subsystem: socketmap client connection management (see
+  * dict_sockmap(3)).
+  */
+#define VAR_SOCKMAP_MAX_IDLE	"socketmap_max_idle"
+#define DEF_SOCKMAP_MAX_IDLE	"10s"
+extern int var_sockmap_max_idle;
+
+#define VAR_SOCKMAP_MAX_TTL	"socketmap_max_ttl"
+#define DEF_SOCKMAP_MAX_TTL	"100s"
+extern int var_sockmap_max_ttl;
+
  /*
   * Any front-end subsystem: avoid running out of memory when someone sends
   * infinitely-long requests or replies.
@@ -980,6 +1169,15 @@ extern int var_ipc_ttl_limit;
 #define DEF_LINE_LIMIT		2048
 extern int var_line_limit;
 
+ /*
+  * Mail streams: I/O buffer size for message content that is sent to the
+  * cleanup server, for queue files written by the cleanup server, and for
+  * queue files read by delivery agents.
+  */
+#define VAR_MSG_STREAM_BUFSIZE	"message_stream_buffer_size"
+#define DEF_MSG_STREAM_BUFSIZE	65536
+extern int var_msg_stream_bufsize;
+
  /*
   * Specify what SMTP peers need verbose logging.
   */
@@ -1003,6 +1201,14 @@ extern char *var_hash_queue_names;
 #define DEF_HASH_QUEUE_DEPTH	1
 extern int var_hash_queue_depth;
 
+ /*
+  * Queue management: additional directories that message queues are
+  * striped across.
+  */
+#define VAR_QUEUE_STRIPE_DIRS	"queue_stripe_directories"
+#define DEF_QUEUE_STRIPE_DIRS	""
+extern char *var_queue_stripe_dirs;
+
  /*
   * Short queue IDs contain the time in microseconds and file inode number.
   * Long queue IDs also contain the time in seconds.
@@ -1072,6 +1278,18 @@ extern bool var_smtp_cache_demand;
 #define DEF_SMTP_CONN_TMOUT	"30s"
 extern int var_smtp_conn_tmout;
 
+#define VAR_SMTP_CONN_DELAY	"smtp_connection_attempt_delay"
+#define DEF_SMTP_CONN_DELAY	"0s"
+#define VAR_LMTP_CONN_DELAY	"lmtp_connection_attempt_delay"
+#define DEF_LMTP_CONN_DELAY	"0s"
+extern int var_smtp_conn_delay;
+
+#define VAR_SMTP_RSET_PIPELINING	"smtp_rset_pipelining"
+#define DEF_SMTP_RSET_PIPELINING	0
+#define VAR_LMTP_RSET_PIPELINING	"lmtp_rset_pipelining"
+#define DEF_LMTP_RSET_PIPELINING	0
+extern bool var_smtp_rset_pipelining;
+
 #define VAR_SMTP_HELO_TMOUT	"smtp_helo_timeout"
 #define DEF_SMTP_HELO_TMOUT	"300s"
 #define VAR_LMTP_HELO_TMOUT	"lmtp_lhlo_timeout"
@@ -1266,7 +1484,7 @@ extern int var_smtpd_soft_erlim;
 extern int var_smtpd_hard_erlim;
 
 #define VAR_SMTPD_ERR_SLEEP	"smtpd_error_sleep_time"
-#define DEF_SMTPD_ERR_SLEEP	"1s"
+#define DEF_SMTPD_ERR_SLEEP	"${stress?{0}:{1}}s"
 extern int var_smtpd_err_sleep;
 
 #define VAR_SMTPD_JUNK_CMD	"smtpd_junk_command_limit"
@@ -2047,6 +2265,13 @@ extern int var_body_check_len;
 #define DEF_BOUNCE_LIMIT	50000
 extern int var_bounce_limit;
 
+ /*
+  * Bounce service: what to return when the sender did not specify DSN RET.
+  */
+#define VAR_BOUNCE_DEF_RET	"bounce_default_return"
+#define DEF_BOUNCE_DEF_RET	"full"
+extern char *var_bounce_def_ret;
+
  /*
   * Bounce service: reserved sender address for double bounces. The local
   * delivery service discards undeliverable double bounces.
@@ -2159,6 +2384,10 @@ extern char *var_relay_rcpt_maps;
 #define DEF_RELAY_RCPT_CODE	550
 extern int var_relay_rcpt_code;
 
+#define VAR_SMTPD_RCPT_FILTER_MAPS	"smtpd_recipient_filter_maps"
+#define DEF_SMTPD_RCPT_FILTER_MAPS	""
+extern char *var_smtpd_rcpt_filter_maps;
+
 #define VAR_RELAY_CCERTS	"relay_clientcerts"
 #define DEF_RELAY_CCERTS	""
 extern char *var_smtpd_relay_ccerts;
@@ -2415,6 +2644,14 @@ extern int var_map_defer_code;
 #define PERMIT_DNSWL_CLIENT	"permit_dnswl_client"
 #define PERMIT_RHSWL_CLIENT	"permit_rhswl_client"
 
+#define VAR_SMTPD_DNSBL_PREFETCH	"smtpd_dnsbl_prefetch"
+#define DEF_SMTPD_DNSBL_PREFETCH	0
+extern bool var_smtpd_dnsbl_prefetch;
+
+#define VAR_SMTPD_DNSBL_PF_TMOUT	"smtpd_dnsbl_prefetch_timeout"
+#define DEF_SMTPD_DNSBL_PF_TMOUT	"5s"
+extern int var_smtpd_dnsbl_pf_tmout;
+
 #define VAR_RBL_REPLY_MAPS	"rbl_reply_maps"
 #define DEF_RBL_REPLY_MAPS	""
 extern char *var_rbl_reply_maps;
@@ -2452,6 +2689,22 @@ extern char *var_smtpd_exp_filter;
 #define DEF_SMTPD_PEERNAME_LOOKUP	1
 extern bool var_smtpd_peername_lookup;
 
+#define VAR_SMTPD_PEER_CACHE_MAP	"smtpd_peername_cache_map"
+#define DEF_SMTPD_PEER_CACHE_MAP	""
+extern char *var_smtpd_peer_cache_map;
+
+#define VAR_SMTPD_PEER_CACHE_TTL	"smtpd_peername_cache_ttl"
+#define DEF_SMTPD_PEER_CACHE_TTL	"3600s"
+extern int var_smtpd_peer_cache_ttl;
+
+#define VAR_SMTPD_PEER_CACHE_TEMP_TTL	"smtpd_peername_cache_temp_ttl"
+#define DEF_SMTPD_PEER_CACHE_TEMP_TTL	"60s"
+extern int var_smtpd_peer_cache_temp_ttl;
+
+#define VAR_SMTPD_SHAPE_LOG	"smtpd_session_shape_logging"
+#define DEF_SMTPD_SHAPE_LOG	0
+extern bool var_smtpd_shape_log;
+
 #define VAR_SMTPD_FORBID_UNAUTH_PIPE	"smtpd_forbid_unauth_pipelining"
 #define DEF_SMTPD_FORBID_UNAUTH_PIPE	1
 extern bool var_smtpd_forbid_unauth_pipe;
@@ -2555,7 +2808,8 @@ extern char *var_proxy_read_maps;
 #define DEF_PROXY_WRITE_MAPS	"$" VAR_SMTP_SASL_AUTH_CACHE_NAME \
 				" $" VAR_LMTP_SASL_AUTH_CACHE_NAME \
 				" $" VAR_VERIFY_MAP \
-				" $" VAR_PSC_CACHE_MAP
+				" $" VAR_PSC_CACHE_MAP \
+				" $" VAR_SMTPD_PEER_CACHE_MAP
 extern char *var_proxy_write_maps;
 
 #define VAR_PROXY_READ_ACL	"proxy_read_access_list"
@@ -2566,6 +2820,22 @@ extern char *var_proxy_read_acl;
 #define DEF_PROXY_WRITE_ACL	"reject"
 extern char *var_proxy_write_acl;
 
+#define VAR_PROXY_POS_TTL	"proxymap_positive_cache_time"
+#define DEF_PROXY_POS_TTL	"0s"
+extern int var_proxy_pos_ttl;
+
+#define VAR_PROXY_NEG_TTL	"proxymap_negative_cache_time"
+#define DEF_PROXY_NEG_TTL	"0s"
+extern int var_proxy_neg_ttl;
+
+#define VAR_PROXY_CACHE_SIZE	"proxymap_cache_size_limit"
+#define DEF_PROXY_CACHE_SIZE	10000
+extern int var_proxy_cache_size;
+
+#define VAR_PROXY_CLIENT_LIMIT	"proxymap_client_limit"
+#define DEF_PROXY_CLIENT_LIMIT	0
+extern int var_proxy_client_limit;
+
  /*
   * Other.
   */
@@ -2693,6 +2963,25 @@ extern long var_virt_mailbox_limit;
 #define DEF_VIRT_MAILBOX_LOCK		"fcntl, dotlock"
 extern char *var_virt_mailbox_lock;
 
+#define VAR_VIRT_MAILDIR_SHARE		"virtual_maildir_single_copy"
+#define DEF_VIRT_MAILDIR_SHARE		0
+extern bool var_virt_maildir_share;
+
+#define VAR_VIRT_RCPT_PARALLEL		"virtual_recipient_parallelism"
+#define DEF_VIRT_RCPT_PARALLEL		1
+extern int var_virt_rcpt_parallel;
+
+ /*
+  * pickup(8) mail submission.
+  */
+#define VAR_PICKUP_PARALLEL		"pickup_cleanup_parallelism"
+#define DEF_PICKUP_PARALLEL		1
+extern int var_pickup_parallel;
+
+#define VAR_POSTDROP_DIRECT		"postdrop_direct_cleanup"
+#define DEF_POSTDROP_DIRECT		0
+extern bool var_postdrop_direct;
+
  /*
   * Distinct logging tag for multiple Postfix instances.
   */
@@ -2856,6 +3145,21 @@ extern bool var_resolve_nulldom;
 #define DEF_RESOLVE_NUM_DOM		0
 extern bool var_resolve_num_dom;
 
+ /*
+  * trivial-rewrite(8) resolve result cache.
+  */
+#define VAR_RESOLVE_CACHE_TIME		"resolve_cache_time"
+#define DEF_RESOLVE_CACHE_TIME		"0s"
+extern int var_resolve_cache_time;
+
+#define VAR_RESOLVE_CACHE_SIZE		"resolve_cache_size_limit"
+#define DEF_RESOLVE_CACHE_SIZE		10000
+extern int var_resolve_cache_size;
+
+#define VAR_REWRITE_CLIENT_LIMIT	"trivial_rewrite_client_limit"
+#define DEF_REWRITE_CLIENT_LIMIT	0
+extern int var_rewrite_client_limit;
+
  /*
   * Service names. The transport (TCP, FIFO or UNIX-domain) type is frozen
   * because you cannot simply mix them, and accessibility (private/public) is
@@ -2920,6 +3224,10 @@ extern int var_scache_ttl_lim;
 #define DEF_SCACHE_STAT_TIME		"600s"
 extern int var_scache_stat_time;
 
+#define VAR_SCACHE_DEM_LIM		"connection_cache_demand_ttl_limit"
+#define DEF_SCACHE_DEM_LIM		"0s"
+extern int var_scache_dem_lim;
+
 #define VAR_VRFY_PEND_LIMIT		"address_verify_pending_request_limit"
 #define DEF_VRFY_PEND_LIMIT		(DEF_QMGR_ACT_LIMIT / 4)
 extern int var_vrfy_pend_limit;
@@ -2959,6 +3267,14 @@ extern bool var_verify_neg_cache;
 #define DEF_VERIFY_SCAN_CACHE		"12h"
 extern int var_verify_scan_cache;
 
+#define VAR_VERIFY_MEM_CACHE		"address_verify_cache_memory_size"
+#define DEF_VERIFY_MEM_CACHE		0
+extern int var_verify_mem_cache;
+
+#define VAR_VERIFY_WRITE_DELAY		"address_verify_cache_write_delay"
+#define DEF_VERIFY_WRITE_DELAY		"0s"
+extern int var_verify_write_delay;
+
 #define VAR_VERIFY_SENDER		"address_verify_sender"
 #define DEF_VERIFY_SENDER		"$" VAR_DOUBLE_BOUNCE
 extern char *var_verify_sender;
@@ -3245,17 +3561,13 @@ extern int var_anvil_time_unit;
 extern int var_anvil_stat_time;
 
  /*
-  * Temporary stop gap.
+  * The anvil(8) server(s) that a client talks to. With multiple servers,
+  * the client picks one by remote client address.
   */
-#if 0
-#include <anvil_clnt.h>
-
-#define VAR_ANVIL_SERVICE		"client_connection_rate_service_name"
-#define DEF_ANVIL_SERVICE		"local:" ANVIL_CLASS "/" ANVIL_SERVICE
+#define VAR_ANVIL_SERVICE		"anvil_service_endpoints"
+#define DEF_ANVIL_SERVICE		"local:private/anvil"
 extern char *var_anvil_service;
 
-#endif
-
  /*
   * What domain names to assume when no valid domain context exists.
   */
@@ -3472,6 +3784,10 @@ extern char *var_tls_ssl_options;
 #define DEF_TLS_TKT_CIPHER	"aes-256-cbc"
 extern char *var_tls_tkt_cipher;
 
+#define VAR_TLS_TKT_SECRET	"tls_session_ticket_secret_file"
+#define DEF_TLS_TKT_SECRET	""
+extern char *var_tls_tkt_secret;
+
 #define VAR_TLS_BC_PKEY_FPRINT	"tls_legacy_public_key_fingerprints"
 #define DEF_TLS_BC_PKEY_FPRINT	0
 extern bool var_tls_bc_pkey_fprint;
@@ -3587,6 +3903,14 @@ extern char *var_milt_head_checks;
 #define DEF_MILT_MACRO_DEFLTS		""
 extern char *var_milt_macro_deflts;
 
+#define VAR_MILT_PARALLEL		"milter_parallel_events"
+#define DEF_MILT_PARALLEL		0
+extern bool var_milt_parallel;
+
+#define VAR_MILT_CONN_REUSE		"milter_connection_reuse"
+#define DEF_MILT_CONN_REUSE		0
+extern bool var_milt_conn_reuse;
+
  /*
   * What internal mail do we inspect/stamp/etc.? This is not yet safe enough
   * to enable world-wide.
@@ -3606,6 +3930,10 @@ extern char *var_int_filt_classes;
 #define DEF_SMTPD_CLIENT_PORT_LOG		0
 extern bool var_smtpd_client_port_log;
 
+#define VAR_SMTPD_SESS_TIME_LOG		"smtpd_session_time_logging"
+#define DEF_SMTPD_SESS_TIME_LOG		0
+extern bool var_smtpd_sess_time_log;
+
 #define VAR_QMQPD_CLIENT_PORT_LOG		"qmqpd_client_port_logging"
 #define DEF_QMQPD_CLIENT_PORT_LOG		0
 extern bool var_qmqpd_client_port_log;
@@ -3665,6 +3993,14 @@ extern char *var_conc_neg_feedback;
 #define CONC_FDBACK_NAME_WIN	"concurrency"
 #define CONC_FDBACK_NAME_SQRT_WIN "sqrt_concurrency"
 
+#define VAR_CONC_FDBACK_MODE	"default_destination_concurrency_feedback_mode"
+#define _CONC_FDBACK_MODE	"_destination_concurrency_feedback_mode"
+#define DEF_CONC_FDBACK_MODE	CONC_FDBACK_MODE_COUNT
+extern char *var_conc_fdback_mode;
+
+#define CONC_FDBACK_MODE_COUNT	"count"
+#define CONC_FDBACK_MODE_LATENCY "latency"
+
 #define VAR_CONC_COHORT_LIM	"default_destination_concurrency_failed_cohort_limit"
 #define _CONC_COHORT_LIM	"_destination_concurrency_failed_cohort_limit"
 #define DEF_CONC_COHORT_LIM	1
@@ -3771,6 +4107,14 @@ extern int var_psc_cache_ret;
 #define DEF_PSC_CACHE_SCAN	"12h"
 extern int var_psc_cache_scan;
 
+#define VAR_PSC_CACHE_MEM	"postscreen_cache_memory_limit"
+#define DEF_PSC_CACHE_MEM	10000
+extern int var_psc_cache_mem;
+
+#define VAR_PSC_PROC_CLIENTS	"postscreen_process_client_limit"
+#define DEF_PSC_PROC_CLIENTS	1000
+extern int var_psc_proc_clients;
+
 #define VAR_PSC_GREET_WAIT	"postscreen_greet_wait"
 #define DEF_PSC_GREET_WAIT	"${stress?{2}:{6}}s"
 extern int var_psc_greet_wait;
@@ -3831,6 +4175,14 @@ extern char *var_psc_dnsbl_reply;
 #define DEF_PSC_DNSBL_TMOUT	"10s"
 extern int var_psc_dnsbl_tmout;
 
+#define VAR_PSC_DNSBL_BUILTIN	"postscreen_dnsbl_builtin_resolver"
+#define DEF_PSC_DNSBL_BUILTIN	0
+extern bool var_psc_dnsbl_builtin;
+
+#define VAR_PSC_DNSBL_CACHE	"postscreen_dnsbl_cache_limit"
+#define DEF_PSC_DNSBL_CACHE	10000
+extern int var_psc_dnsbl_cache;
+
 #define VAR_PSC_PIPEL_ENABLE	"postscreen_pipelining_enable"
 #define DEF_PSC_PIPEL_ENABLE	0
 extern bool var_psc_pipel_enable;
@@ -3982,6 +4334,14 @@ extern char *var_tlsproxy_service;
 #define DEF_TLSP_WATCHDOG	"10s"
 extern int var_tlsp_watchdog;
 
+#define VAR_TLSP_TLS_ASYNC	"tlsproxy_tls_async_mode"
+#define DEF_TLSP_TLS_ASYNC	0
+extern bool var_tlsp_tls_async;
+
+#define VAR_TLSP_CLIENT_LIMIT	"tlsproxy_client_limit"
+#define DEF_TLSP_CLIENT_LIMIT	0
+extern int var_tlsp_client_limit;
+
 #define VAR_TLSP_TLS_LEVEL	"tlsproxy_tls_security_level"
 #define DEF_TLSP_TLS_LEVEL	"$" VAR_SMTPD_TLS_LEVEL
 extern char *var_tlsp_tls_level;
@@ -4264,6 +4624,21 @@ extern char *var_sm_fix_eol;
 #define DEF_DAEMON_OPEN_FATAL	0
 extern bool var_daemon_open_fatal;
 
+ /*
+  * Reopen a changed table in place, or restart the daemon process?
+  */
+#define VAR_REOPEN_TABLES	"reopen_changed_tables"
+#define DEF_REOPEN_TABLES	0
+extern bool var_reopen_tables;
+
+ /*
+  * Wake up only one of the processes that wait for a connection on a shared
+  * listening socket, instead of serializing them with a lock file.
+  */
+#define VAR_EXCL_ACCEPT		"exclusive_accept_wakeup"
+#define DEF_EXCL_ACCEPT		1
+extern bool var_excl_accept;
+
  /*
   * Optional delivery status filter.
   */
@@ -4298,6 +4673,12 @@ extern char *var_local_dsn_filter;
 #define DEF_LMTP_DNS_RE_FILTER		""
 extern char *var_smtp_dns_re_filter;
 
+#define VAR_SMTP_DNS_CACHE_TIME		"smtp_dns_cache_ttl_limit"
+#define DEF_SMTP_DNS_CACHE_TIME		"0s"
+#define VAR_LMTP_DNS_CACHE_TIME		"lmtp_dns_cache_ttl_limit"
+#define DEF_LMTP_DNS_CACHE_TIME		"0s"
+extern int var_smtp_dns_cache_time;
+
 #define VAR_SMTPD_DNS_RE_FILTER		"smtpd_dns_reply_filter"
 #define DEF_SMTPD_DNS_RE_FILTER		""
 extern char *var_smtpd_dns_re_filter;
@@ -4391,6 +4772,10 @@ extern char *var_maillog_file_stamp;
 #define DEF_MAILLOG_FILE_PERMS	"0600"
 extern char *var_maillog_file_perms;
 
+#define VAR_MAILLOG_FILE_FORMAT	"maillog_file_format"
+#define DEF_MAILLOG_FILE_FORMAT	"text"
+extern char *var_maillog_file_format;
+
 #define VAR_POSTLOG_SERVICE	"postlog_service_name"
 #define DEF_POSTLOG_SERVICE	MAIL_SERVICE_POSTLOG
 extern char *var_postlog_service;
@@ -4399,6 +4784,58 @@ extern char *var_postlog_service;
 #define DEF_POSTLOGD_WATCHDOG	"10s"
 extern int var_postlogd_watchdog;
 
+#define VAR_POSTLOGD_FSYNC_TIME	"postlogd_fsync_interval"
+#define DEF_POSTLOGD_FSYNC_TIME	"0s"
+extern int var_postlogd_fsync_time;
+
+ /*
+  * Per-message stage timing, logged by the queue manager.
+  */
+#define VAR_STAGE_TIMING	"enable_stage_timing"
+#define DEF_STAGE_TIMING	0
+extern bool var_stage_timing;
+
+ /*
+  * Metrics collector.
+  */
+#define VAR_METRICS_ENABLE	"enable_metrics"
+#define DEF_METRICS_ENABLE	0
+extern bool var_metrics_enable;
+
+#define VAR_METRICS_SERVICE	"metrics_service_name"
+#define DEF_METRICS_SERVICE	MAIL_SERVICE_METRICS
+extern char *var_metrics_service;
+
+#define VAR_METRICS_HTTP_ADDR	"metrics_http_address"
+#define DEF_METRICS_HTTP_ADDR	"127.0.0.1:9154"
+extern char *var_metrics_http_addr;
+
+#define VAR_METRICS_MEMORY	"metrics_memory_accounting"
+#define DEF_METRICS_MEMORY	0
+extern bool var_metrics_memory;
+
+ /*
+  * Queue file replication to a peer node.
+  */
+#define VAR_QUEUE_REPL_PEER	"queue_replication_peer"
+#define DEF_QUEUE_REPL_PEER	""
+extern char *var_queue_repl_peer;
+
+#define VAR_QUEUE_REPL_TMOUT	"queue_replication_timeout"
+#define DEF_QUEUE_REPL_TMOUT	"10s"
+extern int var_queue_repl_tmout;
+
+#define VAR_QUEUE_REPL_CLIENTS	"queue_replication_clients"
+#define DEF_QUEUE_REPL_CLIENTS	""
+extern char *var_queue_repl_clients;
+
+ /*
+  * Per-table lookup statistics.
+  */
+#define VAR_TABLE_STATS_INT	"table_statistics_interval"
+#define DEF_TABLE_STATS_INT	"0s"
+extern int var_table_stats_int;
+
  /*
   * Backwards compatibility for internal-form address logging.
   */
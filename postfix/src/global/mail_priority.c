@@ -0,0 +1,73 @@
+/*++
+/* NAME
+/*	mail_priority 3
+/* SUMMARY
+/*	message scheduling class
+/* SYNOPSIS
+/*	#include <mail_priority.h>
+/*
+/*	int	mail_priority_code(name)
+/*	const char *name;
+/*
+/*	const char *str_mail_priority(code)
+/*	int	code;
+/* DESCRIPTION
+/*	A message may carry a scheduling class, as set with the
+/*	PRIORITY action in an access(5) or header_checks(5) table.
+/*	The class is stored in the queue file as a named attribute,
+/*	and is used by the queue manager to order deliveries.
+/*
+/*	mail_priority_code() maps a case-insensitive class name
+/*	(high, normal, low) to the corresponding MAIL_PRIORITY_HIGH,
+/*	MAIL_PRIORITY_NORMAL or MAIL_PRIORITY_LOW code.
+/*
+/*	str_mail_priority() does the reverse mapping.
+/* DIAGNOSTICS
+/*	mail_priority_code() returns MAIL_PRIORITY_UNKNOWN when the
+/*	name is not recognized. str_mail_priority() returns a null
+/*	pointer when the code is not recognized.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+ /*
+  * System library.
+  */
+#include <sys_defs.h>
+
+ /*
+  * Utility library.
+  */
+#include <name_code.h>
+
+ /*
+  * Global library.
+  */
+#include <mail_proto.h>
+#include <mail_priority.h>
+
+ /*
+  * The name-to-code mapping.
+  */
+static const NAME_CODE mail_priority_table[] = {
+    MAIL_ATTR_PRIO_HIGH, MAIL_PRIORITY_HIGH,
+    MAIL_ATTR_PRIO_NORMAL, MAIL_PRIORITY_NORMAL,
+    MAIL_ATTR_PRIO_LOW, MAIL_PRIORITY_LOW,
+    0, MAIL_PRIORITY_UNKNOWN,
+};
+
+/* mail_priority_code - map class name to code */
+
+int     mail_priority_code(const char *name)
+{
+    return (name_code(mail_priority_table, NAME_CODE_FLAG_NONE, name));
+}
+
+/* str_mail_priority - map code to class name */
+
+const char *str_mail_priority(int code)
+{
+    return (str_name_code(mail_priority_table, code));
+}
@@ -0,0 +1,31 @@
+#ifndef _MAIL_PRIORITY_H_INCLUDED_
+#define _MAIL_PRIORITY_H_INCLUDED_
+
+/*++
+/* NAME
+/*	mail_priority 3h
+/* SUMMARY
+/*	message scheduling class
+/* SYNOPSIS
+/*	#include <mail_priority.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * External interface.
+  */
+#define MAIL_PRIORITY_UNKNOWN	0	/* bad name */
+#define MAIL_PRIORITY_LOW	1	/* bulk mail */
+#define MAIL_PRIORITY_NORMAL	2	/* the default */
+#define MAIL_PRIORITY_HIGH	3	/* latency sensitive */
+
+extern int mail_priority_code(const char *);
+extern const char *str_mail_priority(int);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
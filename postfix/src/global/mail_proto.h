@@ -61,6 +61,7 @@
 #define MAIL_SERVICE_DNSBLOG	"dnsblog"
 #define MAIL_SERVICE_TLSPROXY	"tlsproxy"
 #define MAIL_SERVICE_POSTLOG	"postlog"
+#define MAIL_SERVICE_METRICS	"metrics"
 
  /*
   * Process names: convention is to use the basename of an executable file,
@@ -115,6 +116,7 @@
 #define QMGR_REQ_SCAN_INCOMING	'I'	/* scan incoming queue */
 #define QMGR_REQ_FLUSH_DEAD	'F'	/* flush dead xport/site */
 #define QMGR_REQ_SCAN_ALL	'A'	/* ignore time stamps */
+#define QMGR_REQ_EXPEDITE	'Q'	/* queue ID and null byte follow */
 
  /*
   * Functional interface.
@@ -140,6 +142,7 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_PROTO_FLUSH	"queue_flush_protocol"
 #define MAIL_ATTR_PROTO_POSTDROP "postdrop_protocol"
 #define MAIL_ATTR_PROTO_PROXYMAP "proxymap_protocol"
+#define MAIL_ATTR_PROTO_REPLICA	"queue_replica_protocol"
 #define MAIL_ATTR_PROTO_SCACHE	"connection_cache_protocol"
 #define MAIL_ATTR_PROTO_SHOWQ	"mail_queue_list_protocol"
 #define MAIL_ATTR_PROTO_TLSMGR	"tlsmgr_protocol"
@@ -173,6 +176,7 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_CREATE_TIME	"create_time"
 #define MAIL_ATTR_RULE		"rule"
 #define MAIL_ATTR_ADDR		"address"
+#define MAIL_ATTR_ADDR_COUNT	"address_count"
 #define MAIL_ATTR_TRANSPORT	"transport"
 #define MAIL_ATTR_NEXTHOP	"nexthop"
 #define MAIL_ATTR_TRACE_FLAGS	"trace_flags"
@@ -180,6 +184,8 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_ACTION	"action"
 #define MAIL_ATTR_TABLE		"table"
 #define MAIL_ATTR_KEY		"key"
+#define MAIL_ATTR_KEY_COUNT	"key_count"
+#define MAIL_ATTR_KEY_INDEX	"key_index"
 #define MAIL_ATTR_VALUE		"value"
 #define MAIL_ATTR_INSTANCE	"instance"
 #define MAIL_ATTR_SASL_METHOD	"sasl_method"
@@ -192,6 +198,19 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_RWR_CONTEXT	"rewrite_context"
 #define MAIL_ATTR_POL_CONTEXT	"policy_context"
 #define MAIL_ATTR_FORCED_EXPIRE	"forced_expire"
+#define MAIL_ATTR_STAGE_CONNECT	"stage_connect"
+#define MAIL_ATTR_STAGE_TIMES	"stage_times"
+
+ /*
+  * Queue listing filters.
+  */
+#define MAIL_ATTR_SHOWQ_QUEUES	"queue_filter"
+#define MAIL_ATTR_SHOWQ_SENDER	"sender_filter"
+#define MAIL_ATTR_SHOWQ_DOMAIN	"recipient_domain_filter"
+#define MAIL_ATTR_SHOWQ_MIN_AGE	"minimum_age"
+
+#define SHOWQ_FLAG_NONE		0
+#define SHOWQ_FLAG_BRIEF	(1<<0)	/* no recipients, no reasons */
 
 #define MAIL_ATTR_RWR_LOCAL	"local"
 #define MAIL_ATTR_RWR_REMOTE	"remote"
@@ -235,6 +254,10 @@ extern char *mail_pathname(const char *, const char *);
 #define MAIL_ATTR_ENC_8BIT	"8bit"	/* 8BITMIME equivalent */
 #define MAIL_ATTR_ENC_7BIT	"7bit"	/* 7BIT equivalent */
 #define MAIL_ATTR_ENC_NONE	""	/* encoding unknown */
+#define MAIL_ATTR_PRIORITY	"priority"	/* scheduling class */
+#define MAIL_ATTR_PRIO_HIGH	"high"	/* latency sensitive */
+#define MAIL_ATTR_PRIO_NORMAL	"normal"	/* the default */
+#define MAIL_ATTR_PRIO_LOW	"low"	/* bulk mail */
 
 #define MAIL_ATTR_LOG_CLIENT_NAME "log_client_name"	/* client hostname */
 #define MAIL_ATTR_LOG_CLIENT_ADDR "log_client_address"	/* client address */
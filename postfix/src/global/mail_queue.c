@@ -44,6 +44,9 @@
 /*
 /*	int	mail_queue_id_ok(queue_id)
 /*	const char *queue_id;
+/*
+/*	const char *mail_queue_stripe_next(path)
+/*	const char *path;
 /* DESCRIPTION
 /*	This module encapsulates access to the mail queue hierarchy.
 /*	Unlike most other modules, this one does not abort the program
@@ -56,7 +59,10 @@
 /*	The only guarantee given is that on a given machine, no two queue
 /*	entries will have the same queue ID at the same time. The tp
 /*	argument, if not a null pointer, receives the time stamp that
-/*	corresponds with the queue ID.
+/*	corresponds with the queue ID. Where the system supports it,
+/*	the file is created without a name and then linked into the
+/*	queue under its final name; otherwise it is created under a
+/*	temporary name and renamed.
 /*
 /*	mail_queue_open() opens the named queue file. The \fIflags\fR
 /*	and \fImode\fR arguments are as with open(2). The result is a
@@ -86,9 +92,29 @@
 /*	non-zero (true) if the name contains no nasty characters.
 /*
 /*	mail_queue_id_ok() does the same thing for mail queue ID names.
+/*
+/*	mail_queue_stripe_next() supports scans of striped queues
+/*	(see below). Given a queue directory name as used with
+/*	scan_dir_open(), it returns the name of the same queue in
+/*	the next stripe that exists, or a null pointer when there
+/*	is none. The result is overwritten upon the next call.
+/* QUEUE STRIPES
+/* .ad
+/* .fi
+/*	With queue_stripe_directories, the files of the incoming,
+/*	active, deferred, hold, corrupt, saved, bounce, defer and
+/*	trace queues are spread over the queue directory itself
+/*	(stripe 0) and the listed subdirectories (stripes 1 and
+/*	up), which may be mount points on different devices. The
+/*	stripe is selected by the microsecond part of the queue ID,
+/*	so that all files for one message stay on the same file
+/*	system, and so that queue IDs remain unique even though
+/*	inode numbers are unique only per file system. A queue file
+/*	with a queue ID that does not parse lives in stripe 0.
 /* DIAGNOSTICS
 /*	Panic: invalid queue name or id given to mail_queue_path(),
 /*	mail_queue_rename(), or mail_queue_remove().
+/*	Fatal error: invalid queue_stripe_directories entry.
 /*	Fatal error: out of memory.
 /* LICENSE
 /* .ad
@@ -103,6 +129,7 @@
 
 /* System library. */
 
+#define _GNU_SOURCE			/* O_TMPFILE */
 #include <sys_defs.h>
 #include <stdio.h>			/* rename() */
 #include <stdlib.h>
@@ -140,6 +167,143 @@
 
 #define STR	vstring_str
 
+ /*
+  * Queue stripes. Only queues that hold per-message files are striped, so
+  * that a queue file never needs to move between file systems. The maildrop
+  * queue is written by unprivileged users, and the flush queue is indexed by
+  * destination.
+  */
+static ARGV *mail_queue_stripes;	/* stripe 1 and up */
+
+static const char *mail_queue_striped_names[] = {
+    MAIL_QUEUE_INCOMING, MAIL_QUEUE_ACTIVE, MAIL_QUEUE_DEFERRED,
+    MAIL_QUEUE_HOLD, MAIL_QUEUE_CORRUPT, MAIL_QUEUE_SAVED,
+    MAIL_QUEUE_BOUNCE, MAIL_QUEUE_DEFER, MAIL_QUEUE_TRACE, 0,
+};
+
+#define MAIL_QUEUE_STRIPE_COUNT(queue_name) \
+	(mail_queue_stripes->argc > 0 && mail_queue_striped(queue_name) ? \
+	    mail_queue_stripes->argc + 1 : 1)
+
+ /*
+  * Where the system can create a file without a name and link it into the
+  * file system later, mail_queue_enter() creates a queue file with its final
+  * name in one directory update, instead of creating it under a temporary
+  * name and renaming it once the file ID is known. Linking a file through
+  * its descriptor requires /proc, which is not available in a chroot jail;
+  * then we fall back to the temporary name.
+  */
+#if defined(HAS_O_TMPFILE) && defined(O_TMPFILE)
+#define MAIL_QUEUE_LINK_FD	"/proc/self/fd/%d"
+#endif
+
+/* mail_queue_stripe_init - one-time initialization */
+
+static void mail_queue_stripe_init(void)
+{
+    char  **cpp;
+
+    if (mail_queue_stripes != 0)
+	return;
+    mail_queue_stripes = argv_split(var_queue_stripe_dirs, CHARS_COMMA_SP);
+    for (cpp = mail_queue_stripes->argv; *cpp; cpp++)
+	if (mail_queue_name_ok(*cpp) == 0)
+	    msg_fatal("bad %s entry: \"%s\"", VAR_QUEUE_STRIPE_DIRS, *cpp);
+}
+
+/* mail_queue_striped - is this a striped queue */
+
+static int mail_queue_striped(const char *queue_name)
+{
+    const char **cpp;
+
+    for (cpp = mail_queue_striped_names; *cpp; cpp++)
+	if (strcmp(*cpp, queue_name) == 0)
+	    return (1);
+    return (0);
+}
+
+/* mail_queue_stripe_id - find the stripe for a queue ID */
+
+static int mail_queue_stripe_id(const char *queue_name, const char *queue_id)
+{
+    static VSTRING *usec_buf;
+    const char *delim;
+    unsigned long usec;
+    int     count;
+    int     error;
+
+    if ((count = MAIL_QUEUE_STRIPE_COUNT(queue_name)) == 1)
+	return (0);
+    if (usec_buf == 0)
+	usec_buf = vstring_alloc(10);
+    if (MQID_FIND_LG_INUM_SEPARATOR(delim, queue_id)) {
+	vstring_strncpy(usec_buf, delim - MQID_LG_USEC_PAD, MQID_LG_USEC_PAD);
+	MQID_LG_DECODE_USEC(STR(usec_buf), usec, error);
+    } else {
+	vstring_strncpy(usec_buf, queue_id, MQID_SH_USEC_PAD);
+	MQID_SH_DECODE_INUM(STR(usec_buf), usec, error);
+    }
+    return (error ? 0 : (int) (usec % count));
+}
+
+/* mail_queue_stripe_dir - queue directory in a stripe */
+
+static const char *mail_queue_stripe_dir(VSTRING *buf, int stripe,
+					         const char *queue_name)
+{
+    if (stripe > 0)
+	vstring_sprintf(buf, "%s/%s", mail_queue_stripes->argv[stripe - 1],
+			queue_name);
+    else
+	vstring_strcpy(buf, queue_name);
+    return (STR(buf));
+}
+
+/* mail_queue_stripe_next - same queue in the next stripe */
+
+const char *mail_queue_stripe_next(const char *path)
+{
+    static VSTRING *buf;
+    const char *queue_name;
+    const char *slash;
+    int     stripe = 0;
+    int     count;
+
+    mail_queue_stripe_init();
+    if (mail_queue_stripes->argc == 0)
+	return (0);
+    if (buf == 0)
+	buf = vstring_alloc(100);
+
+    /*
+     * A queue directory is either "queue" in stripe 0, or "stripe/queue".
+     */
+    if ((slash = strchr(path, '/')) == 0) {
+	queue_name = path;
+    } else {
+	queue_name = slash + 1;
+	for (stripe = 1; stripe <= mail_queue_stripes->argc; stripe++)
+	    if (strncmp(mail_queue_stripes->argv[stripe - 1], path,
+			slash - path) == 0
+		&& mail_queue_stripes->argv[stripe - 1][slash - path] == 0)
+		break;
+    }
+
+    /*
+     * Skip stripes where the queue directory does not yet exist.
+     */
+    count = MAIL_QUEUE_STRIPE_COUNT(queue_name);
+    while (++stripe < count) {
+	mail_queue_stripe_dir(buf, stripe, queue_name);
+	if (access(STR(buf), F_OK) == 0)
+	    return (STR(buf));
+	if (errno != ENOENT)
+	    msg_warn("%s: %m", STR(buf));
+    }
+    return (0);
+}
+
 /* mail_queue_dir - construct mail queue directory name */
 
 const char *mail_queue_dir(VSTRING *buf, const char *queue_name,
@@ -172,12 +336,15 @@ const char *mail_queue_dir(VSTRING *buf, const char *queue_name,
     if (hash_buf == 0) {
 	hash_buf = vstring_alloc(100);
 	hash_queue_names = argv_split(var_hash_queue_names, CHARS_COMMA_SP);
+	mail_queue_stripe_init();
     }
 
     /*
-     * First, put the basic queue directory name into place.
+     * First, put the basic queue directory name into place, in the stripe
+     * that holds this queue file.
      */
-    vstring_strcpy(buf, queue_name);
+    mail_queue_stripe_dir(buf, mail_queue_stripe_id(queue_name, queue_id),
+			  queue_name);
     vstring_strcat(buf, "/");
 
     /*
@@ -314,38 +481,153 @@ int     mail_queue_id_ok(const char *queue_id)
     return (1);
 }
 
+/* mail_queue_make_id - queue ID from file ID and current time */
+
+static void mail_queue_make_id(VSTRING *id_buf, const char *file_id,
+			               struct timeval * tp, int stripe,
+			               int stripe_count)
+{
+    static VSTRING *sec_buf;
+    static VSTRING *usec_buf;
+
+    if (usec_buf == 0) {
+	sec_buf = vstring_alloc(10);
+	usec_buf = vstring_alloc(10);
+    }
+
+    /*
+     * The queue ID determines the stripe. Wait at most a few microseconds
+     * for a time stamp that selects the stripe where the file was created.
+     */
+    do {
+	GETTIMEOFDAY(tp);
+    } while (tp->tv_usec % stripe_count != stripe);
+    if (var_long_queue_ids) {
+	vstring_sprintf(id_buf, "%s%s%c%s",
+			MQID_LG_ENCODE_SEC(sec_buf, tp->tv_sec),
+			MQID_LG_ENCODE_USEC(usec_buf, tp->tv_usec),
+			MQID_LG_INUM_SEP, file_id);
+    } else {
+	vstring_sprintf(id_buf, "%s%s",
+			MQID_SH_ENCODE_USEC(usec_buf, tp->tv_usec),
+			file_id);
+    }
+}
+
+#ifdef MAIL_QUEUE_LINK_FD
+
+/* mail_queue_enter_linked - create unnamed file and link it into the queue */
+
+static int mail_queue_enter_linked(const char *queue_name, mode_t mode,
+				           struct timeval * tp,
+				           VSTRING *id_buf, VSTRING *path_buf,
+				           const char *dir, int stripe,
+				           int stripe_count)
+{
+    static int disabled;
+    static VSTRING *fd_path;
+    const char *file_id;
+    int     fd;
+    int     count;
+
+    if (disabled)
+	return (-1);
+
+    /*
+     * Older kernels and some file systems don't support unnamed files. Let
+     * the caller report other errors.
+     */
+    if ((fd = open(dir, O_TMPFILE | O_RDWR, mode)) < 0) {
+	if (errno == EISDIR || errno == EOPNOTSUPP || errno == EINVAL)
+	    disabled = 1;
+	return (-1);
+    }
+    if (fd_path == 0)
+	fd_path = vstring_alloc(30);
+    vstring_sprintf(fd_path, MAIL_QUEUE_LINK_FD, fd);
+
+    /*
+     * Unlike rename(), linkat() does not replace an existing file. That is
+     * fine, because the queue ID changes with each attempt.
+     */
+    file_id = get_file_id_fd(fd, var_long_queue_ids);
+    for (count = 0; count < 1000; count++) {
+	mail_queue_make_id(id_buf, file_id, tp, stripe, stripe_count);
+	mail_queue_path(path_buf, queue_name, STR(id_buf));
+	if (linkat(AT_FDCWD, STR(fd_path), AT_FDCWD, STR(path_buf),
+		   AT_SYMLINK_FOLLOW) == 0)
+	    return (fd);
+	if (errno == EEXIST)			/* collision. weird. */
+	    continue;
+	if (errno != ENOENT || count > 0 || mail_queue_mkdirs(STR(path_buf)) < 0)
+	    break;
+    }
+
+    /*
+     * No /proc, or some other problem. Don't try again.
+     */
+    if (msg_verbose)
+	msg_info("mail_queue_enter: link %s to %s: %m; using temporary names",
+		 STR(fd_path), STR(path_buf));
+    disabled = 1;
+    (void) close(fd);
+    return (-1);
+}
+
+#endif
+
 /* mail_queue_enter - make mail queue entry with locally-unique name */
 
 VSTREAM *mail_queue_enter(const char *queue_name, mode_t mode,
 			          struct timeval * tp)
 {
     const char *myname = "mail_queue_enter";
-    static VSTRING *sec_buf;
-    static VSTRING *usec_buf;
     static VSTRING *id_buf;
     static int pid;
     static VSTRING *path_buf;
     static VSTRING *temp_path;
+    static VSTRING *dir_buf;
     struct timeval tv;
     int     fd;
     const char *file_id;
     VSTREAM *stream;
     int     count;
+    const char *dir;
+    int     stripe;
+    int     stripe_count;
 
     /*
      * Initialize.
      */
     if (id_buf == 0) {
 	pid = getpid();
-	sec_buf = vstring_alloc(10);
-	usec_buf = vstring_alloc(10);
 	id_buf = vstring_alloc(10);
 	path_buf = vstring_alloc(10);
 	temp_path = vstring_alloc(100);
+	dir_buf = vstring_alloc(100);
+	mail_queue_stripe_init();
     }
     if (tp == 0)
 	tp = &tv;
 
+    /*
+     * Pick a stripe. The queue ID that we choose later must map to it.
+     */
+    GETTIMEOFDAY(tp);
+    stripe_count = MAIL_QUEUE_STRIPE_COUNT(queue_name);
+    stripe = tp->tv_usec % stripe_count;
+    dir = mail_queue_stripe_dir(dir_buf, stripe, queue_name);
+
+#ifdef MAIL_QUEUE_LINK_FD
+    if ((fd = mail_queue_enter_linked(queue_name, mode, tp, id_buf,
+				      path_buf, dir, stripe, stripe_count)) >= 0) {
+	stream = vstream_fdopen(fd, O_RDWR);
+	vstream_control(stream, CA_VSTREAM_CTL_PATH(STR(path_buf)),
+			CA_VSTREAM_CTL_END);
+	return (stream);
+    }
+#endif
+
     /*
      * Create a file with a temporary name that does not collide. The process
      * ID alone is not sufficiently unique: maildrops can be shared via the
@@ -357,12 +639,15 @@ VSTREAM *mail_queue_enter(const char *queue_name, mode_t mode,
      */
     for (;;) {
 	GETTIMEOFDAY(tp);
-	vstring_sprintf(temp_path, "%s/%d.%d", queue_name,
+	vstring_sprintf(temp_path, "%s/%d.%d", dir,
 			(int) tp->tv_usec, pid);
 	if ((fd = open(STR(temp_path), O_RDWR | O_CREAT | O_EXCL, mode)) >= 0)
 	    break;
 	if (errno == EEXIST || errno == EISDIR)
 	    continue;
+	if (errno == ENOENT && stripe > 0
+	    && mail_queue_mkdirs(STR(temp_path)) == 0)
+	    continue;
 	msg_warn("%s: create file %s: %m", myname, STR(temp_path));
 	sleep(10);
     }
@@ -389,17 +674,7 @@ VSTREAM *mail_queue_enter(const char *queue_name, mode_t mode,
      * prevents multiple messages from getting the same Message-ID value.
      */
     for (count = 0;; count++) {
-	GETTIMEOFDAY(tp);
-	if (var_long_queue_ids) {
-	    vstring_sprintf(id_buf, "%s%s%c%s",
-			    MQID_LG_ENCODE_SEC(sec_buf, tp->tv_sec),
-			    MQID_LG_ENCODE_USEC(usec_buf, tp->tv_usec),
-			    MQID_LG_INUM_SEP, file_id);
-	} else {
-	    vstring_sprintf(id_buf, "%s%s",
-			    MQID_SH_ENCODE_USEC(usec_buf, tp->tv_usec),
-			    file_id);
-	}
+	mail_queue_make_id(id_buf, file_id, tp, stripe, stripe_count);
 	mail_queue_path(path_buf, queue_name, STR(id_buf));
 	if (sane_rename(STR(temp_path), STR(path_buf)) == 0)	/* success */
 	    break;
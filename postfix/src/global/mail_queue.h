@@ -36,6 +36,7 @@
 #define MAIL_QUEUE_CORRUPT	"corrupt"
 #define MAIL_QUEUE_FLUSH	"flush"
 #define MAIL_QUEUE_SAVED	"saved"
+#define MAIL_QUEUE_REPLICA	"replica"
 
  /*
   * Queue file modes.
@@ -61,6 +62,7 @@ extern const char *mail_queue_path(VSTRING *, const char *, const char *);
 extern int mail_queue_mkdirs(const char *);
 extern int mail_queue_name_ok(const char *);
 extern int mail_queue_id_ok(const char *);
+extern const char *mail_queue_stripe_next(const char *);
 
  /*
   * MQID - Mail Queue ID format definitions. Needed only by code that creates
@@ -12,6 +12,8 @@
 /*	The \fBmail_scan_dir_next\fR() routine is a wrapper around
 /*	scan_dir_next() that understands the structure of a Postfix
 /*	mail queue.  The result is a queue ID or a null pointer.
+/*	When the queue is striped, the scan continues with the same
+/*	queue in the next stripe; see mail_queue(3).
 /* SEE ALSO
 /*	scan_dir(3) directory scanner
 /* LICENSE
@@ -32,16 +34,20 @@
 
 /* Utility library. */
 
+#include <vstring.h>
 #include <scan_dir.h>
 
 /* Global library. */
 
+#include <mail_queue.h>
 #include <mail_scan_dir.h>
 
 /* mail_scan_dir_next - return next queue file */
 
 char   *mail_scan_dir_next(SCAN_DIR *scan)
 {
+    static VSTRING *dir;
+    const char *path;
     char   *name;
 
     /*
@@ -51,8 +57,16 @@ char   *mail_scan_dir_next(SCAN_DIR *scan)
      */
     for (;;) {
 	if ((name = scan_dir_next(scan)) == 0) {
-	    if (scan_dir_pop(scan) == 0)
+	    if ((path = scan_dir_path(scan)) == 0)
 		return (0);
+	    if (dir == 0)
+		dir = vstring_alloc(100);
+	    vstring_strcpy(dir, path);
+	    if (scan_dir_pop(scan) == 0) {
+		if ((path = mail_queue_stripe_next(vstring_str(dir))) == 0)
+		    return (0);
+		scan_dir_push(scan, path);
+	    }
 	} else if (strlen(name) == 1) {
 	    scan_dir_push(scan, name);
 	} else {
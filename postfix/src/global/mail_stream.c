@@ -25,9 +25,19 @@
 /*	const char *class;
 /*	const char *service;
 /*
+/*	MAIL_STREAM *mail_stream_service_nowait(class, service)
+/*	const char *class;
+/*	const char *service;
+/*
 /*	MAIL_STREAM *mail_stream_command(command)
 /*	const char *command;
 /*
+/*	void	mail_stream_sync_lock(path)
+/*	const char *path;
+/*
+/*	void	mail_stream_replicate(enable)
+/*	int	enable;
+/*
 /*	void	mail_stream_cleanup(info)
 /*	MAIL_STREAM *info;
 /*
@@ -51,6 +61,9 @@
 /*	But it may take forever. The mode argument specifies additional
 /*	file permissions that will be OR-ed in when the file is finished.
 /*	While embryonic files have mode 0600, finished files have mode 0700.
+/*	The trigger is a wakeup request, or a QMGR_REQ_EXPEDITE
+/*	request with the queue ID when the file is finished in the
+/*	incoming queue.
 /*
 /*	mail_stream_command() opens a mail stream to external command,
 /*	and receives queue ID information from the command. The result
@@ -63,6 +76,10 @@
 /*	is a null pointer when the initial handshake fails. At finish
 /*	time, the daemon is expected to send a completion status.
 /*
+/*	mail_stream_service_nowait() is like mail_stream_service(),
+/*	but does not wait until the service becomes available. The
+/*	result is a null pointer when the service cannot be reached.
+/*
 /*	mail_stream_cleanup() cancels the operation that was started with
 /*	any of the mail_stream_xxx() routines, and destroys the argument.
 /*	It is up to the caller to remove incomplete file objects.
@@ -96,6 +113,55 @@
 /*	file modification time stamp by this amount.  This has
 /*	effect only within the deferred mail queue.
 /*	This feature may have no effect with remote file systems.
+/*
+/*	The streams that are opened with mail_stream_file() and
+/*	mail_stream_service() use an I/O buffer of message_stream_buffer_size
+/*	bytes, so that message content is written to the queue file
+/*	or to the cleanup server in large blocks instead of one
+/*	VSTREAM_BUFSIZE block at a time.
+/*
+/*	mail_stream_sync_lock() enables group commit for file-based
+/*	mail streams that are finished by this process. Instead of
+/*	fsync() for each queue file, processes that finish a queue
+/*	file at the same time share one syncfs() call for the file
+/*	system. The path argument specifies a lock file in the same
+/*	file system; it is opened when the first mail stream is
+/*	finished. See the DURABILITY section below. This feature is
+/*	not available on systems without syncfs(); on those systems,
+/*	the request is ignored with a warning.
+/*
+/*	mail_stream_replicate() controls queue file replication for
+/*	file-based mail streams that are finished by this process.
+/*	When enabled, a queue file is sent to the queue_replication_peer
+/*	node with replica_clnt_store(3), and the local fsync() or
+/*	syncfs() call is skipped when the peer confirms that it has
+/*	a copy. When the peer is unavailable, the queue file is made
+/*	durable locally as usual.
+/* DURABILITY
+/* .ad
+/* .fi
+/*	With group commit, a process that has written a queue file
+/*	takes an exclusive lock. If the lock file shows that a
+/*	syncfs() call started after the queue file was written, and
+/*	completed without error, then the queue file is already
+/*	durable. Otherwise, the process calls syncfs(), records the
+/*	time when that call started, and releases the lock. While
+/*	one process waits for syncfs(), other processes queue up
+/*	behind the lock, and all their queue files are made durable
+/*	by the next syncfs() call.
+/*
+/*	Time stamps are taken from the system-wide monotonic clock.
+/*	A record is also tagged with the system boot time, so that a
+/*	lock file from before a reboot can't be mistaken for a recent
+/*	one. When in doubt, the process calls syncfs() itself.
+/*
+/*	Note: Linux syncfs() reports write errors only with kernel
+/*	versions 5.8 and later.
+/*
+/*	With replication, a queue file that is acknowledged by the
+/*	peer survives the loss of this node, but it is not made
+/*	durable on local storage: both nodes must fail before their
+/*	page caches are written out for the file to be lost.
 /* LICENSE
 /* .ad
 /* .fi
@@ -121,6 +187,13 @@
 #include <utime.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+
+#if defined(HAS_SYNCFS) && !defined(_GNU_SOURCE)
+extern int syncfs(int);			/* glibc declares it with _GNU_SOURCE */
+#endif
 
 /* Utility library. */
 
@@ -132,12 +205,16 @@
 #include <argv.h>
 #include <sane_fsops.h>
 #include <warn_stat.h>
+#include <myflock.h>
+#include <iostuff.h>
+#include <probes.h>
 
 /* Global library. */
 
 #include <cleanup_user.h>
 #include <mail_proto.h>
 #include <mail_queue.h>
+#include <replica_clnt.h>
 #include <opened.h>
 #include <mail_params.h>
 #include <mail_stream.h>
@@ -146,11 +223,23 @@
 /* Application-specific. */
 
 static VSTRING *id_buf;
+static VSTRING *trigger_buf;
 
 #define FREE_AND_WIPE(free, arg) do { if (arg) free(arg); arg = 0; } while (0)
 
 #define STR(x)	vstring_str(x)
 
+ /*
+  * Use large I/O buffers for message content, to reduce the number of
+  * read/write system calls per message.
+  */
+#define MAIL_STREAM_BUFSIZE(stream) do { \
+	if (var_msg_stream_bufsize > 0) \
+	    vstream_control((stream), \
+			    CA_VSTREAM_CTL_BUFSIZE((ssize_t) var_msg_stream_bufsize), \
+			    CA_VSTREAM_CTL_END); \
+    } while (0)
+
 /* mail_stream_cleanup - clean up after success or failure */
 
 void    mail_stream_cleanup(MAIL_STREAM *info)
@@ -216,6 +305,119 @@ static int stamp_path(const char *path, time_t when)
     }
 }
 
+#ifdef HAS_SYNCFS
+
+ /*
+  * Group commit. The lock file contains the start time of the last syncfs()
+  * call that completed without error.
+  */
+typedef struct {
+    struct timespec start;		/* CLOCK_MONOTONIC */
+    time_t  boot;			/* CLOCK_REALTIME - CLOCK_MONOTONIC */
+} MAIL_STREAM_SYNC;
+
+static char *mail_stream_sync_path;
+static int mail_stream_sync_fd = -1;
+
+#define TIMESPEC_GT(a, b) ((a).tv_sec > (b).tv_sec \
+	|| ((a).tv_sec == (b).tv_sec && (a).tv_nsec > (b).tv_nsec))
+
+/* mail_stream_boot_time - estimate system boot time */
+
+static time_t mail_stream_boot_time(const struct timespec *mono)
+{
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_REALTIME, &now) < 0)
+	return (0);
+    return (now.tv_sec - mono->tv_sec);
+}
+
+/* mail_stream_group_sync - make queue file durable, sharing syncfs() */
+
+static int mail_stream_group_sync(VSTREAM *stream)
+{
+    int     fd = vstream_fileno(stream);
+    struct timespec written;
+    MAIL_STREAM_SYNC last;
+    MAIL_STREAM_SYNC this;
+    int     status;
+    int     saved_errno;
+
+    /*
+     * Open the lock file on first use, after the process has entered its
+     * chroot jail. Fall back to fsync() when group commit is unavailable.
+     */
+    if (mail_stream_sync_fd < 0) {
+	if ((mail_stream_sync_fd = open(mail_stream_sync_path,
+					O_RDWR | O_CREAT, 0600)) < 0) {
+	    msg_warn("open %s: %m -- using fsync() for each queue file",
+		     mail_stream_sync_path);
+	    FREE_AND_WIPE(myfree, mail_stream_sync_path);
+	    return (fsync(fd));
+	}
+	close_on_exec(mail_stream_sync_fd, CLOSE_ON_EXEC);
+    }
+    if (clock_gettime(CLOCK_MONOTONIC, &written) < 0
+	|| myflock(mail_stream_sync_fd, INTERNAL_LOCK,
+		   MYFLOCK_OP_EXCLUSIVE) < 0)
+	return (fsync(fd));
+
+    /*
+     * If a syncfs() call started after we wrote our queue file, and that
+     * call completed without error, then our queue file is already durable.
+     * Otherwise, sync the file system on behalf of everyone who is waiting
+     * for the lock.
+     */
+    if (pread(mail_stream_sync_fd, (void *) &last, sizeof(last), 0)
+	== sizeof(last)
+	&& TIMESPEC_GT(last.start, written)
+	&& labs((long) (last.boot - mail_stream_boot_time(&written))) <= 1) {
+	status = 0;
+    } else if (clock_gettime(CLOCK_MONOTONIC, &this.start) < 0) {
+	status = fsync(fd);
+    } else {
+	this.boot = mail_stream_boot_time(&this.start);
+	if ((status = syncfs(fd)) == 0
+	    && pwrite(mail_stream_sync_fd, (void *) &this, sizeof(this), 0)
+	    != sizeof(this))
+	    msg_warn("write %s: %m", mail_stream_sync_path);
+    }
+    saved_errno = errno;
+    if (myflock(mail_stream_sync_fd, INTERNAL_LOCK, MYFLOCK_OP_NONE) < 0)
+	msg_fatal("unlock %s: %m", mail_stream_sync_path);
+    errno = saved_errno;
+    return (status);
+}
+
+#endif
+
+/* mail_stream_sync_lock - enable group commit */
+
+void    mail_stream_sync_lock(const char *path)
+{
+#ifdef HAS_SYNCFS
+    if (mail_stream_sync_fd >= 0)
+	msg_panic("mail_stream_sync_lock: lock file is already open");
+    FREE_AND_WIPE(myfree, mail_stream_sync_path);
+    if (path != 0 && *path != 0)
+	mail_stream_sync_path = mystrdup(path);
+#else
+    if (path != 0 && *path != 0)
+	msg_warn("group commit is not supported on this system -- "
+		 "ignoring lock file %s", path);
+#endif
+}
+
+/* mail_stream_replicate - enable or disable queue file replication */
+
+static int mail_stream_replica;
+
+void    mail_stream_replicate(int enable)
+{
+    mail_stream_replica = enable;
+}
+
 /* mail_stream_finish_file - finish file mail stream */
 
 static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
@@ -230,6 +432,7 @@ static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
     int     err;
     time_t  want_stamp;
     time_t  expect_stamp;
+    int     replicated;
 
     /*
      * Make sure the message makes it to file. Set the execute bit when no
@@ -293,6 +496,18 @@ static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
      * This may not be available because of chroot, or because of access
      * restrictions after a process changes privileges.
      */
+    POSTFIX_PROBE1(queue_file_sync_start, VSTREAM_PATH(info->stream));
+
+    /*
+     * With replication, a copy on the peer node replaces the local sync.
+     * Replicate before the file becomes ready for delivery, so that the
+     * queue manager can't request removal of a replica that does not yet
+     * exist.
+     */
+    replicated = (mail_stream_replica
+		  && vstream_fflush(info->stream) == 0
+		  && replica_clnt_store(info->id, vstream_fileno(info->stream))
+		  == REPLICA_STAT_OK);
     if (vstream_fflush(info->stream)
 #ifdef CAN_STAMP_BY_STREAM
 	|| stamp_stream(info->stream, want_stamp)
@@ -300,13 +515,18 @@ static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
 	|| (want_stamp && stamp_path(VSTREAM_PATH(info->stream), want_stamp))
 #endif
 	|| fchmod(vstream_fileno(info->stream), 0700 | info->mode)
-#ifdef HAS_FSYNC
-	|| fsync(vstream_fileno(info->stream))
+#ifdef HAS_SYNCFS
+	|| (!replicated
+	    && (mail_stream_sync_path ? mail_stream_group_sync(info->stream) :
+		fsync(vstream_fileno(info->stream))))
+#elif defined(HAS_FSYNC)
+	|| (!replicated && fsync(vstream_fileno(info->stream)))
 #endif
 	|| (check_incoming_fs_clock
 	    && fstat(vstream_fileno(info->stream), &st) < 0)
 	)
 	status = (errno == EFBIG ? CLEANUP_STAT_SIZE : CLEANUP_STAT_WRITE);
+    POSTFIX_PROBE2(queue_file_sync_done, VSTREAM_PATH(info->stream), status);
 #ifdef TEST
     st.st_mtime += 10;
 #endif
@@ -362,10 +582,23 @@ static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
 
     /*
      * When all is well, notify the next service that a new message has been
-     * queued.
+     * queued. Name a new incoming queue file in the request, so that the
+     * queue manager can pick it up without an incoming queue scan.
      */
-    if (status == CLEANUP_STAT_OK && info->class && info->service)
-	mail_trigger(info->class, info->service, wakeup, sizeof(wakeup));
+    if (status == CLEANUP_STAT_OK && info->class && info->service) {
+	if (strcmp(info->queue, MAIL_QUEUE_INCOMING) == 0) {
+	    if (trigger_buf == 0)
+		trigger_buf = vstring_alloc(20);
+	    VSTRING_RESET(trigger_buf);
+	    VSTRING_ADDCH(trigger_buf, QMGR_REQ_EXPEDITE);
+	    vstring_strcat(trigger_buf, info->id);
+	    VSTRING_ADDCH(trigger_buf, 0);
+	    mail_trigger(info->class, info->service, STR(trigger_buf),
+			 VSTRING_LEN(trigger_buf));
+	} else {
+	    mail_trigger(info->class, info->service, wakeup, sizeof(wakeup));
+	}
+    }
 
     /*
      * Cleanup.
@@ -418,6 +651,7 @@ MAIL_STREAM *mail_stream_file(const char *queue, const char *class,
     stream = mail_queue_enter(queue, 0600 | mode, &tv);
     if (msg_verbose)
 	msg_info("open %s", VSTREAM_PATH(stream));
+    MAIL_STREAM_BUFSIZE(stream);
 
     info = (MAIL_STREAM *) mymalloc(sizeof(*info));
     info->stream = stream;
@@ -435,23 +669,22 @@ MAIL_STREAM *mail_stream_file(const char *queue, const char *class,
     return (info);
 }
 
-/* mail_stream_service - destination is service */
+/* mail_stream_service_open - handshake with connected service */
 
-MAIL_STREAM *mail_stream_service(const char *class, const char *name)
+static MAIL_STREAM *mail_stream_service_open(VSTREAM *stream)
 {
-    VSTREAM *stream;
     MAIL_STREAM *info;
 
     if (id_buf == 0)
 	id_buf = vstring_alloc(10);
 
-    stream = mail_connect_wait(class, name);
     if (attr_scan(stream, ATTR_FLAG_STRICT,
 		  RECV_ATTR_STREQ(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_CLEANUP),
 		  RECV_ATTR_STR(MAIL_ATTR_QUEUEID, id_buf), 0) != 1) {
 	vstream_fclose(stream);
 	return (0);
     } else {
+	MAIL_STREAM_BUFSIZE(stream);
 	info = (MAIL_STREAM *) mymalloc(sizeof(*info));
 	info->stream = stream;
 	info->finish = mail_stream_finish_ipc;
@@ -464,6 +697,24 @@ MAIL_STREAM *mail_stream_service(const char *class, const char *name)
     }
 }
 
+/* mail_stream_service - destination is service */
+
+MAIL_STREAM *mail_stream_service(const char *class, const char *name)
+{
+    return (mail_stream_service_open(mail_connect_wait(class, name)));
+}
+
+/* mail_stream_service_nowait - destination is service, don't wait */
+
+MAIL_STREAM *mail_stream_service_nowait(const char *class, const char *name)
+{
+    VSTREAM *stream;
+
+    if ((stream = mail_connect(class, name, BLOCKING)) == 0)
+	return (0);
+    return (mail_stream_service_open(stream));
+}
+
 /* mail_stream_command - destination is command */
 
 MAIL_STREAM *mail_stream_command(const char *command)
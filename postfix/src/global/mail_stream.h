@@ -71,10 +71,13 @@ CHECK_CPTR_HELPER_DCL(MAIL_STREAM, char);
 
 extern MAIL_STREAM *mail_stream_file(const char *, const char *, const char *, int);
 extern MAIL_STREAM *mail_stream_service(const char *, const char *);
+extern MAIL_STREAM *mail_stream_service_nowait(const char *, const char *);
 extern MAIL_STREAM *mail_stream_command(const char *);
 extern void mail_stream_cleanup(MAIL_STREAM *);
 extern int mail_stream_finish(MAIL_STREAM *, VSTRING *);
 extern void mail_stream_ctl(MAIL_STREAM *, int,...);
+extern void mail_stream_sync_lock(const char *);
+extern void mail_stream_replicate(int);
 
 
 /* LICENSE
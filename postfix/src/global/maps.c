@@ -21,6 +21,13 @@
 /*	const char *key;
 /*	int	flags;
 /*
+/*	const char *maps_find_first(maps, keys, flags, count, index)
+/*	MAPS	*maps;
+/*	const char **keys;
+/*	const int *flags;
+/*	ssize_t	count;
+/*	ssize_t	*index;
+/*
 /*	MAPS	*maps_free(maps)
 /*	MAPS	*maps;
 /* DESCRIPTION
@@ -48,6 +55,26 @@
 /*	the base64 lookup result. This requires that the maps are
 /*	opened with DICT_FLAG_SRC_RHS_IS_FILE.
 /*
+/*	maps_find_first() produces the same result as calling
+/*	maps_find() for each of \fIkeys[0]\fR, ... \fIkeys[count-1]\fR
+/*	with the corresponding \fIflags\fR, stopping at the first key
+/*	that is found or that causes a lookup error. The \fIindex\fR
+/*	result is the position of that key, or \fIcount\fR. Instead
+/*	of one query per key and dictionary, each dictionary receives
+/*	one dict_get_first() query for the keys that can still make
+/*	a difference; with proxy: tables, that is one proxymap(8)
+/*	round trip per table.
+/*
+/*	When the maps_cache_size variable is non-zero, maps_find()
+/*	and maps_find_first() remember up to that many search results
+/*	per maps_create() handle, for maps_cache_ttl seconds.
+/*	mail_params_init() sets these from the main.cf parameters
+/*	with the same names. This
+/*	includes results for keys that were not found, but not
+/*	lookup errors. The cache is discarded when a dictionary is
+/*	replaced with dict_replace(3). maps_file_find() does not
+/*	use the cache.
+/*
 /*	maps_free() releases storage claimed by maps_create()
 /*	and conveniently returns a null pointer.
 /*
@@ -106,6 +133,7 @@
 
 #include <sys_defs.h>
 #include <string.h>
+#include <time.h>
 
 /* Utility library. */
 
@@ -115,12 +143,112 @@
 #include <dict.h>
 #include <stringops.h>
 #include <split_at.h>
+#include <vstring.h>
+#include <ctable.h>
+#include <probes.h>
 
 /* Global library. */
 
 #include "mail_conf.h"
 #include "maps.h"
 
+ /*
+  * Optional search result cache. An entry remembers a search result, or that
+  * the key was not found. The cache key combines the search flags and the
+  * lookup key.
+  */
+typedef struct {
+    char   *value;			/* search result or null */
+    time_t  expires;			/* entry expiration time */
+} MAPS_CACHE_ENT;
+
+static const char *maps_cache_value;	/* result being cached */
+
+ /*
+  * Cache limits; mail_params_init() sets these from main.cf.
+  */
+int     maps_cache_size = 0;
+int     maps_cache_ttl = 60;
+
+/* maps_cache_create - callback: remember search result */
+
+static void *maps_cache_create(const char *unused_key, void *unused_context)
+{
+    MAPS_CACHE_ENT *ent = (MAPS_CACHE_ENT *) mymalloc(sizeof(*ent));
+
+    ent->value = (maps_cache_value ? mystrdup(maps_cache_value) : 0);
+    ent->expires = time((time_t *) 0) + maps_cache_ttl;
+    return ((void *) ent);
+}
+
+/* maps_cache_delete - callback: forget search result */
+
+static void maps_cache_delete(void *value, void *unused_context)
+{
+    MAPS_CACHE_ENT *ent = (MAPS_CACHE_ENT *) value;
+
+    if (ent->value)
+	myfree(ent->value);
+    myfree((void *) ent);
+}
+
+/* maps_cache_key - format cache lookup key */
+
+static const char *maps_cache_key(const char *name, int flags)
+{
+    static VSTRING *key;
+
+    if (key == 0)
+	key = vstring_alloc(100);
+    vstring_sprintf(key, "%x:%s", flags, name);
+    return (vstring_str(key));
+}
+
+/* maps_cache_get - find unexpired cache entry */
+
+static const MAPS_CACHE_ENT *maps_cache_get(MAPS *maps, const char *name,
+					            int flags)
+{
+    const MAPS_CACHE_ENT *ent;
+    const char *key;
+    int     tag;
+
+    /*
+     * Results from a replaced dictionary are no longer valid.
+     */
+    if (maps->cache_gen != dict_replace_count) {
+	ctable_free(maps->cache);
+	tag = mymalloc_set_tag(MYMALLOC_TAG_DICT_CACHE);
+	maps->cache = ctable_create(maps_cache_size, maps_cache_create,
+				    maps_cache_delete, (void *) 0);
+	(void) mymalloc_set_tag(tag);
+	maps->cache_gen = dict_replace_count;
+	return (0);
+    }
+    key = maps_cache_key(name, flags);
+    if (ctable_exists(maps->cache, key) == 0)
+	return (0);
+    ent = (const MAPS_CACHE_ENT *) ctable_locate(maps->cache, key);
+    return (ent->expires > time((time_t *) 0) ? ent : 0);
+}
+
+/* maps_cache_put - remember search result */
+
+static const char *maps_cache_put(MAPS *maps, const char *name, int flags,
+				          const char *value)
+{
+    const MAPS_CACHE_ENT *ent;
+    int     tag;
+
+    maps_cache_value = value;
+    tag = mymalloc_set_tag(MYMALLOC_TAG_DICT_CACHE);
+    ent = (const MAPS_CACHE_ENT *)
+	ctable_refresh(maps->cache, maps_cache_key(name, flags));
+    (void) mymalloc_set_tag(tag);
+    maps_cache_value = 0;
+    return (ent->value);
+}
+
 /* maps_create - initialize */
 
 MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
@@ -134,6 +262,7 @@ MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
     char   *map_type_name;
     VSTRING *map_type_name_flags;
     DICT   *dict;
+    int     tag;
 
     /*
      * Initialize.
@@ -142,6 +271,15 @@ MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
     maps->title = mystrdup(title);
     maps->argv = argv_alloc(2);
     maps->error = 0;
+    if (maps_cache_size > 0) {
+	tag = mymalloc_set_tag(MYMALLOC_TAG_DICT_CACHE);
+	maps->cache = ctable_create(maps_cache_size, maps_cache_create,
+				    maps_cache_delete, (void *) 0);
+	(void) mymalloc_set_tag(tag);
+	maps->cache_gen = dict_replace_count;
+    } else {
+	maps->cache = 0;
+    }
 
     /*
      * For each specified type:name pair, either register a new dictionary,
@@ -171,9 +309,9 @@ MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
     return (maps);
 }
 
-/* maps_find - search a list of dictionaries */
+/* maps_find_nocache - search a list of dictionaries */
 
-const char *maps_find(MAPS *maps, const char *name, int flags)
+static const char *maps_find_nocache(MAPS *maps, const char *name, int flags)
 {
     const char *myname = "maps_find";
     char  **map_name;
@@ -197,7 +335,11 @@ const char *maps_find(MAPS *maps, const char *name, int flags)
 	    msg_panic("%s: dictionary not found: %s", myname, *map_name);
 	if (flags != 0 && (dict->flags & flags) == 0)
 	    continue;
-	if ((expansion = dict_get(dict, name)) != 0) {
+	POSTFIX_PROBE3(maps_lookup_start, maps->title, *map_name, name);
+	expansion = dict_get(dict, name);
+	POSTFIX_PROBE4(maps_lookup_done, maps->title, *map_name, name,
+		       expansion);
+	if (expansion != 0) {
 	    if (*expansion == 0) {
 		msg_warn("%s lookup of %s returns an empty string result",
 			 maps->title, name);
@@ -223,6 +365,156 @@ const char *maps_find(MAPS *maps, const char *name, int flags)
     return (0);
 }
 
+/* maps_find - search a list of dictionaries, with optional cache */
+
+const char *maps_find(MAPS *maps, const char *name, int flags)
+{
+    const char *myname = "maps_find";
+    const MAPS_CACHE_ENT *ent;
+    const char *expansion;
+
+    if (maps->cache == 0 || *name == 0)
+	return (maps_find_nocache(maps, name, flags));
+    if ((ent = maps_cache_get(maps, name, flags)) != 0) {
+	maps->error = 0;
+	POSTFIX_PROBE3(maps_cache_hit, maps->title, name, ent->value);
+	if (msg_verbose)
+	    msg_info("%s: %s: %s: cached %s", myname, maps->title, name,
+		     ent->value ? ent->value : "not found");
+	return (ent->value);
+    }
+    if ((expansion = maps_find_nocache(maps, name, flags)) == 0
+	&& maps->error != 0)
+	return (0);
+    return (maps_cache_put(maps, name, flags, expansion));
+}
+
+/* maps_find_first_nocache - search dictionaries for first of many keys */
+
+static const char *maps_find_first_nocache(MAPS *maps, const char **keys,
+					           const int *flags,
+					           ssize_t count, ssize_t *index)
+{
+    const char *myname = "maps_find_first";
+    char  **map_name;
+    const char *expansion;
+    const char *result = 0;
+    DICT   *dict;
+    DICT   *result_dict = 0;
+    const char **sub_keys;
+    ssize_t *sub_pos;
+    ssize_t sub_count;
+    ssize_t found = count;		/* first key found so far */
+    ssize_t failed = count;		/* first key with lookup error */
+    int     error = 0;
+    ssize_t n;
+
+    maps->error = 0;
+    sub_keys = (const char **) mymalloc((count + 1) * sizeof(*sub_keys));
+    sub_pos = (ssize_t *) mymalloc((count + 1) * sizeof(*sub_pos));
+
+    /*
+     * Query one dictionary at a time, for the keys that precede the first
+     * key found (or failed) so far. This gives the same result as searching
+     * all dictionaries for each key in turn.
+     */
+    for (map_name = maps->argv->argv; *map_name; map_name++) {
+	if ((dict = dict_handle(*map_name)) == 0)
+	    msg_panic("%s: dictionary not found: %s", myname, *map_name);
+	if (dict == result_dict)
+	    continue;
+	for (sub_count = n = 0; n < found && n < failed; n++) {
+	    /* Temp. workaround, for buggy callers that pass zero-length keys. */
+	    if (*keys[n] == 0 || (flags[n] != 0 && (dict->flags & flags[n]) == 0))
+		continue;
+	    sub_keys[sub_count] = keys[n];
+	    sub_pos[sub_count++] = n;
+	}
+	if (sub_count == 0)
+	    continue;
+	if ((expansion = dict_get_first(dict, sub_keys, sub_count, &n)) != 0) {
+	    if (*expansion == 0) {
+		msg_warn("%s lookup of %s returns an empty string result",
+			 maps->title, sub_keys[n]);
+		msg_warn("%s should return NO RESULT in case of NOT FOUND",
+			 maps->title);
+		failed = sub_pos[n];
+		error = DICT_ERR_CONFIG;
+	    } else {
+		found = sub_pos[n];
+		result = expansion;
+		result_dict = dict;
+		if (msg_verbose)
+		    msg_info("%s: %s: %s: %s = %.100s%s", myname, maps->title,
+			     *map_name, keys[found], expansion,
+			     strlen(expansion) > 100 ? "..." : "");
+	    }
+	} else if (dict->error != 0) {
+	    msg_warn("%s:%s lookup error for \"%s\"",
+		     dict->type, dict->name, sub_keys[n]);
+	    failed = sub_pos[n];
+	    error = dict->error;
+	}
+	if (found == 0 || failed == 0)
+	    break;
+    }
+    myfree((void *) sub_keys);
+    myfree((void *) sub_pos);
+
+    if (found < failed) {
+	*index = found;
+	return (result);
+    }
+    *index = failed;
+    maps->error = error;
+    if (msg_verbose)
+	msg_info("%s: %s: %s: %s", myname, maps->title, count ? keys[0] : "",
+		 maps->error ? "search aborted" : "not found");
+    return (0);
+}
+
+/* maps_find_first - search for first of many keys, with optional cache */
+
+const char *maps_find_first(MAPS *maps, const char **keys, const int *flags,
+			            ssize_t count, ssize_t *index)
+{
+    const MAPS_CACHE_ENT *ent;
+    const char *expansion;
+    ssize_t found;
+    ssize_t n;
+
+    if (maps->cache == 0)
+	return (maps_find_first_nocache(maps, keys, flags, count, index));
+
+    /*
+     * Use cached results for the leading keys, and search the dictionaries
+     * for the remainder. Remember the keys that were not found.
+     */
+    maps->error = 0;
+    for (n = 0; n < count; n++) {
+	if (*keys[n] == 0)
+	    continue;
+	if ((ent = maps_cache_get(maps, keys[n], flags[n])) == 0)
+	    break;
+	if (ent->value != 0) {
+	    *index = n;
+	    return (ent->value);
+	}
+    }
+    if (n == count) {
+	*index = count;
+	return (0);
+    }
+    expansion = maps_find_first_nocache(maps, keys + n, flags + n,
+					count - n, &found);
+    for (*index = n + found; n < *index; n++)
+	if (*keys[n] != 0)
+	    maps_cache_put(maps, keys[n], flags[n], (char *) 0);
+    if (expansion != 0)
+	expansion = maps_cache_put(maps, keys[n], flags[n], expansion);
+    return (expansion);
+}
+
 /* maps_file_find - search a list of dictionaries and base64 decode */
 
 const char *maps_file_find(MAPS *maps, const char *name, int flags)
@@ -301,6 +593,8 @@ MAPS   *maps_free(MAPS *maps)
     }
     myfree(maps->title);
     argv_free(maps->argv);
+    if (maps->cache)
+	ctable_free(maps->cache);
     myfree((void *) maps);
     return (0);
 }
@@ -23,13 +23,20 @@ typedef struct MAPS {
     char   *title;
     struct ARGV *argv;
     int     error;			/* last request only */
+    struct ctable *cache;		/* optional result cache */
+    int     cache_gen;			/* dict_replace_count snapshot */
 } MAPS;
 
 extern MAPS *maps_create(const char *, const char *, int);
 extern const char *maps_find(MAPS *, const char *, int);
 extern const char *maps_file_find(MAPS *, const char *, int);
+extern const char *maps_find_first(MAPS *, const char **, const int *,
+				            ssize_t, ssize_t *);
 extern MAPS *maps_free(MAPS *);
 
+extern int maps_cache_size;		/* max results per MAPS, 0=off */
+extern int maps_cache_ttl;		/* result time to live */
+
 /* LICENSE
 /* .ad
 /* .fi
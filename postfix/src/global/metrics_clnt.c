@@ -0,0 +1,376 @@
+/*++
+/* NAME
+/*	metrics_clnt 3
+/* SUMMARY
+/*	metrics collector client
+/* SYNOPSIS
+/*	#include <metrics_clnt.h>
+/*
+/*	void	metrics_count(name, delta, label_name, label_value, ...,
+/*				(char *) 0)
+/*	const char *name;
+/*	long	delta;
+/*	const char *label_name;
+/*	const char *label_value;
+/*
+/*	void	metrics_gauge(name, value, label_name, label_value, ...,
+/*				(char *) 0)
+/*	const char *name;
+/*	double	value;
+/*	const char *label_name;
+/*	const char *label_value;
+/*
+/*	void	metrics_observe(name, value, label_name, label_value, ...,
+/*				(char *) 0)
+/*	const char *name;
+/*	double	value;
+/*	const char *label_name;
+/*	const char *label_value;
+/*
+/*	void	metrics_flush()
+/*
+/*	void	metrics_memory()
+/* DESCRIPTION
+/*	This module reports counters, gauges and histogram observations
+/*	to the metricsd(8) service. All functions do nothing unless
+/*	enable_metrics is turned on.
+/*
+/*	Updates are aggregated in memory, and are sent at most once
+/*	per second, in as few datagrams as possible, without blocking.
+/*	Updates are lost when the metricsd(8) service is unavailable,
+/*	or when its socket queue is full. Pending updates are sent
+/*	when the process terminates with exit(), and by the master
+/*	server skeletons before a process waits for an accept lock.
+/*
+/*	metrics_count() adds \fIdelta\fR to the named counter.
+/*
+/*	metrics_gauge() sets the named gauge to \fIvalue\fR.
+/*
+/*	metrics_observe() adds \fIvalue\fR (usually a time in
+/*	seconds) to the named histogram, with the buckets defined
+/*	in <metrics_clnt.h>.
+/*
+/*	metrics_flush() sends pending updates immediately.
+/*
+/*	metrics_memory() reports the mymalloc(3) memory accounting
+/*	counts for this process as the gauges "postfix_memory_bytes"
+/*	and "postfix_memory_blocks", labeled with the process name
+/*	and the accounting tag, and schedules itself to run again
+/*	after METRICS_MEMORY_INTERVAL seconds. This function does
+/*	nothing unless metrics_memory_accounting is also turned on.
+/*
+/*	Arguments:
+/* .IP name
+/*	A metric name, for example, "postfix_smtpd_rejects_total".
+/* .IP "label_name, label_value"
+/*	Zero or more label name and value pairs, terminated with a
+/*	null label name. Characters in a label value that would
+/*	require quoting are replaced with "_".
+/* BUGS
+/*	A child process discards updates that it inherits from its
+/*	parent, so that they are not counted twice.
+/* SEE ALSO
+/*	metricsd(8), metrics collector
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <htable.h>
+#include <vstring.h>
+#include <events.h>
+#include <connect.h>
+#include <iostuff.h>
+#include <stringops.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <metrics_clnt.h>
+
+ /*
+  * Aggregated updates, keyed by name{labels}.
+  */
+typedef struct {
+    int     type;			/* counter, gauge, histogram */
+    double  value;			/* delta, value, or sum */
+    long    count;			/* histogram observations */
+    long    buckets[METRICS_BUCKET_COUNT];	/* histogram buckets */
+} METRICS_ENTRY;
+
+static HTABLE *metrics_table;
+static pid_t metrics_owner;
+static time_t metrics_last_flush;
+static int metrics_timer_pending;
+static int metrics_sock = -1;
+static VSTRING *metrics_key;
+
+#define METRICS_FLUSH_INTERVAL	1	/* seconds */
+#define METRICS_MEMORY_INTERVAL	10	/* seconds */
+#define METRICS_LABEL_MAXLEN	100	/* label value length */
+
+static const double metrics_bounds[] = {METRICS_BUCKET_BOUNDS};
+
+/* metrics_connect - connect to the metricsd service */
+
+static int metrics_connect(void)
+{
+    char   *path;
+
+    if (metrics_sock < 0) {
+	path = concatenate(METRICS_CLASS, "/", var_metrics_service, (char *) 0);
+	metrics_sock = unix_dgram_connect(path, NON_BLOCKING);
+	if (metrics_sock >= 0)
+	    close_on_exec(metrics_sock, CLOSE_ON_EXEC);
+	else if (msg_verbose)
+	    msg_info("metrics_connect: %s: %m", path);
+	myfree(path);
+    }
+    return (metrics_sock);
+}
+
+/* metrics_send - send one datagram, drop it on error */
+
+static void metrics_send(VSTRING *buf)
+{
+    if (VSTRING_LEN(buf) == 0 || metrics_connect() < 0)
+	return;
+    if (send(metrics_sock, vstring_str(buf), VSTRING_LEN(buf), 0) < 0) {
+	if (msg_verbose)
+	    msg_info("metrics_send: %m");
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+	    /* The metricsd service was restarted or removed. */
+	    (void) close(metrics_sock);
+	    metrics_sock = -1;
+	}
+    }
+}
+
+/* metrics_flush - send pending updates */
+
+void    metrics_flush(void)
+{
+    static VSTRING *buf;
+    static VSTRING *line;
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    METRICS_ENTRY *mp;
+    int     n;
+
+    if (metrics_table == 0)
+	return;
+    if (metrics_owner != getpid()) {
+	htable_free(metrics_table, myfree);
+	metrics_table = 0;
+	return;
+    }
+    if (buf == 0) {
+	buf = vstring_alloc(METRICS_DGRAM_SIZE);
+	line = vstring_alloc(100);
+    }
+    VSTRING_RESET(buf);
+    list = htable_list(metrics_table);
+    for (ht = list; *ht; ht++) {
+	mp = (METRICS_ENTRY *) ht[0]->value;
+	if (mp->type == METRICS_TYPE_HISTOGRAM) {
+	    vstring_sprintf(line, "%c %s %ld %.15g", mp->type, ht[0]->key,
+			    mp->count, mp->value);
+	    for (n = 0; n < METRICS_BUCKET_COUNT; n++)
+		vstring_sprintf_append(line, " %ld", mp->buckets[n]);
+	} else {
+	    vstring_sprintf(line, "%c %s %.15g", mp->type, ht[0]->key,
+			    mp->value);
+	}
+	VSTRING_ADDCH(line, '\n');
+	if (VSTRING_LEN(buf) + VSTRING_LEN(line) > METRICS_DGRAM_SIZE) {
+	    metrics_send(buf);
+	    VSTRING_RESET(buf);
+	}
+	vstring_memcat(buf, vstring_str(line), VSTRING_LEN(line));
+    }
+    metrics_send(buf);
+    myfree((void *) list);
+    htable_free(metrics_table, myfree);
+    metrics_table = 0;
+    metrics_last_flush = time((time_t *) 0);
+}
+
+/* metrics_flush_event - timer call-back */
+
+static void metrics_flush_event(int unused_event, void *unused_context)
+{
+    metrics_timer_pending = 0;
+    metrics_flush();
+}
+
+/* metrics_update - aggregate one update */
+
+static void metrics_update(int type, const char *name, double value,
+			           va_list ap)
+{
+    static int exit_handler;
+    METRICS_ENTRY *mp;
+    const char *label;
+    const char *cp;
+    char   *wp;
+    ssize_t start;
+    int     n;
+
+    /*
+     * Don't send updates that this process inherited from its parent.
+     */
+    if (metrics_table != 0 && metrics_owner != getpid())
+	metrics_flush();
+    if (metrics_table == 0) {
+	metrics_table = htable_create(13);
+	metrics_owner = getpid();
+	if (metrics_key == 0)
+	    metrics_key = vstring_alloc(100);
+	if (exit_handler == 0) {
+	    atexit(metrics_flush);
+	    exit_handler = 1;
+	}
+    }
+
+    /*
+     * Format the name{labels} key.
+     */
+    vstring_strcpy(metrics_key, name);
+    for (n = 0; (label = va_arg(ap, const char *)) != 0; n++) {
+	vstring_sprintf_append(metrics_key, "%c%s=\"", n ? ',' : '{', label);
+	start = VSTRING_LEN(metrics_key);
+	if ((cp = va_arg(ap, const char *)) == 0 || *cp == 0)
+	    cp = "unknown";
+	vstring_strncat(metrics_key, cp, METRICS_LABEL_MAXLEN);
+	for (wp = vstring_str(metrics_key) + start; *wp; wp++)
+	    if (!ISPRINT(*wp) || ISSPACE(*wp) || *wp == '"' || *wp == '\\')
+		*wp = '_';
+	VSTRING_ADDCH(metrics_key, '"');
+    }
+    if (n > 0)
+	VSTRING_ADDCH(metrics_key, '}');
+    VSTRING_TERMINATE(metrics_key);
+
+    /*
+     * Update the aggregate.
+     */
+    if ((mp = (METRICS_ENTRY *) htable_find(metrics_table,
+					    vstring_str(metrics_key))) == 0) {
+	mp = (METRICS_ENTRY *) mymalloc(sizeof(*mp));
+	memset((void *) mp, 0, sizeof(*mp));
+	mp->type = type;
+	(void) htable_enter(metrics_table, vstring_str(metrics_key), (void *) mp);
+    }
+    switch (type) {
+    case METRICS_TYPE_COUNTER:
+	mp->value += value;
+	break;
+    case METRICS_TYPE_GAUGE:
+	mp->value = value;
+	break;
+    case METRICS_TYPE_HISTOGRAM:
+	for (n = 0; n < METRICS_BUCKET_COUNT - 1; n++)
+	    if (value <= metrics_bounds[n])
+		break;
+	mp->buckets[n] += 1;
+	mp->count += 1;
+	mp->value += value;
+	break;
+    }
+
+    /*
+     * Send updates at most once per interval. The timer takes care of the
+     * last updates before a process goes idle.
+     */
+    if (time((time_t *) 0) >= metrics_last_flush + METRICS_FLUSH_INTERVAL) {
+	metrics_flush();
+    } else if (metrics_timer_pending == 0) {
+	event_request_timer(metrics_flush_event, (void *) 0,
+			    METRICS_FLUSH_INTERVAL);
+	metrics_timer_pending = 1;
+    }
+}
+
+/* metrics_count - update counter */
+
+void    metrics_count(const char *name, long delta,...)
+{
+    va_list ap;
+
+    if (var_metrics_enable == 0)
+	return;
+    va_start(ap, delta);
+    metrics_update(METRICS_TYPE_COUNTER, name, (double) delta, ap);
+    va_end(ap);
+}
+
+/* metrics_gauge - update gauge */
+
+void    metrics_gauge(const char *name, double value,...)
+{
+    va_list ap;
+
+    if (var_metrics_enable == 0)
+	return;
+    va_start(ap, value);
+    metrics_update(METRICS_TYPE_GAUGE, name, value, ap);
+    va_end(ap);
+}
+
+/* metrics_observe - update histogram */
+
+void    metrics_observe(const char *name, double value,...)
+{
+    va_list ap;
+
+    if (var_metrics_enable == 0)
+	return;
+    va_start(ap, value);
+    metrics_update(METRICS_TYPE_HISTOGRAM, name, value, ap);
+    va_end(ap);
+}
+
+/* metrics_memory_event - report memory accounting gauges */
+
+static void metrics_memory_event(int unused_event, void *unused_context)
+{
+    const MYMALLOC_STAT *sp;
+    const char *name;
+    int     tag;
+
+    for (tag = 0; tag < MYMALLOC_TAG_COUNT; tag++) {
+	sp = mymalloc_stat(tag);
+	name = mymalloc_tag_name(tag);
+	metrics_gauge("postfix_memory_bytes", (double) sp->bytes,
+		      "process", var_procname, "tag", name, (char *) 0);
+	metrics_gauge("postfix_memory_blocks", (double) sp->blocks,
+		      "process", var_procname, "tag", name, (char *) 0);
+    }
+    event_request_timer(metrics_memory_event, (void *) 0,
+			METRICS_MEMORY_INTERVAL);
+}
+
+/* metrics_memory - start memory accounting reports */
+
+void    metrics_memory(void)
+{
+    if (var_metrics_enable && var_metrics_memory)
+	metrics_memory_event(0, (void *) 0);
+}
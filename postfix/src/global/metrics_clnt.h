@@ -0,0 +1,48 @@
+#ifndef _METRICS_CLNT_H_INCLUDED_
+#define _METRICS_CLNT_H_INCLUDED_
+
+/*++
+/* NAME
+/*	metrics_clnt 3h
+/* SUMMARY
+/*	metrics collector client
+/* SYNOPSIS
+/*	#include <metrics_clnt.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Protocol interface. One datagram carries one or more newline-terminated
+  * records. Histograms have fixed buckets, with non-cumulative bucket
+  * counts on the wire; the last bucket is +Inf.
+  */
+#define METRICS_CLASS		"private"
+
+#define METRICS_TYPE_COUNTER	'c'	/* c name{labels} delta */
+#define METRICS_TYPE_GAUGE	'g'	/* g name{labels} value */
+#define METRICS_TYPE_HISTOGRAM	'h'	/* h name{labels} count sum b0... */
+
+#define METRICS_BUCKET_BOUNDS \
+	0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, \
+	300, 3600, 86400
+#define METRICS_BUCKET_COUNT	17	/* bounds + Inf */
+
+#define METRICS_DGRAM_SIZE	4096	/* dgram_server(3) limit */
+
+ /*
+  * External interface. Labels are name, value pairs, terminated with a null
+  * name.
+  */
+extern void metrics_count(const char *, long,...);
+extern void metrics_gauge(const char *, double,...);
+extern void metrics_observe(const char *, double,...);
+extern void metrics_flush(void);
+extern void metrics_memory(void);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
@@ -441,6 +441,30 @@ static const MIME_ENCODING mime_encoding_map[] = {	/* RFC 2045 */
 	} \
     } while(0)
 
+/* mime_state_has_8bit - look for 8-bit data, a word at a time */
+
+static int mime_state_has_8bit(const char *text, ssize_t len)
+{
+    const unsigned char *cp = CU_CHAR_PTR(text);
+    const unsigned char *end = cp + len;
+    unsigned long word;
+
+#define HIGH_BITS	((~0UL / 0377) * 0200)
+
+    while (cp < end && ((size_t) cp % sizeof(word)) != 0)
+	if (*cp++ & 0200)
+	    return (1);
+    for ( /* void */ ; end - cp >= (ssize_t) sizeof(word); cp += sizeof(word)) {
+	memcpy((void *) &word, (const void *) cp, sizeof(word));
+	if (word & HIGH_BITS)
+	    return (1);
+    }
+    while (cp < end)
+	if (*cp++ & 0200)
+	    return (1);
+    return (0);
+}
+
 /* mime_state_push - push boundary onto stack */
 
 static void mime_state_push(MIME_STATE *state, int def_ctype, int def_stype,
@@ -837,15 +861,11 @@ int     mime_state_update(MIME_STATE *state, int rec_type,
 			mime_state_content_encoding(state, header_info);
 		}
 		if ((state->static_flags & MIME_OPT_REPORT_8BIT_IN_HEADER) != 0
-		    && (state->err_flags & MIME_ERR_8BIT_IN_HEADER) == 0) {
-		    for (cp = CU_CHAR_PTR(STR(state->output_buffer));
-			 cp < CU_CHAR_PTR(END(state->output_buffer)); cp++)
-			if (*cp & 0200) {
-			    REPORT_ERROR_BUF(state, MIME_ERR_8BIT_IN_HEADER,
-					     state->output_buffer);
-			    break;
-			}
-		}
+		    && (state->err_flags & MIME_ERR_8BIT_IN_HEADER) == 0
+		    && mime_state_has_8bit(STR(state->output_buffer),
+					   LEN(state->output_buffer)))
+		    REPORT_ERROR_BUF(state, MIME_ERR_8BIT_IN_HEADER,
+				     state->output_buffer);
 		/* Output routine is explicitly allowed to change the data. */
 		if (header_info == 0
 		    || header_info->type != HDR_CONTENT_TRANSFER_ENCODING
@@ -1074,14 +1094,9 @@ int     mime_state_update(MIME_STATE *state, int rec_type,
 	if (input_is_text) {
 	    if ((state->static_flags & MIME_OPT_REPORT_8BIT_IN_7BIT_BODY) != 0
 		&& state->curr_encoding == MIME_ENC_7BIT
-		&& (state->err_flags & MIME_ERR_8BIT_IN_7BIT_BODY) == 0) {
-		for (cp = CU_CHAR_PTR(text); cp < CU_CHAR_PTR(text + len); cp++)
-		    if (*cp & 0200) {
-			REPORT_ERROR_LEN(state, MIME_ERR_8BIT_IN_7BIT_BODY,
-					 text, len);
-			break;
-		    }
-	    }
+		&& (state->err_flags & MIME_ERR_8BIT_IN_7BIT_BODY) == 0
+		&& mime_state_has_8bit(text, len))
+		REPORT_ERROR_LEN(state, MIME_ERR_8BIT_IN_7BIT_BODY, text, len);
 	    if (state->stack && state->prev_rec_type != REC_TYPE_CONT
 		&& len > 2 && text[0] == '-' && text[1] == '-') {
 		for (sp = state->stack; sp != 0; sp = sp->next) {
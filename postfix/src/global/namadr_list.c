@@ -139,3 +139,103 @@ int     main(int argc, char **argv)
 }
 
 #endif
+
+#ifdef BENCH
+
+ /*
+  * Time matching of client names and addresses against a pattern list
+  * that looks like a typical mynetworks or access list: domain names,
+  * network blocks and addresses. Half of the queries match.
+  */
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <msg.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <msg_vstream.h>
+
+static double bench_since(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec) * 1e9
+	    + (now.tv_usec - start->tv_usec) * 1e3);
+}
+
+static long bench_maxrss(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+	msg_fatal("getrusage: %m");
+    return ((long) usage.ru_maxrss);
+}
+
+int     main(int argc, char **argv)
+{
+    long    patterns = (argc > 1 ? atol(argv[1]) : 100);
+    long    lookups = (argc > 2 ? atol(argv[2]) : 100000);
+    VSTRING *list_buf = vstring_alloc(100);
+    VSTRING *host = vstring_alloc(100);
+    VSTRING *addr = vstring_alloc(100);
+    NAMADR_LIST *list;
+    struct timeval start;
+    double  t_match;
+    long    rss;
+    long    found = 0;
+    long    n;
+    long    i;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    if (patterns <= 0 || lookups <= 0)
+	msg_fatal("usage: %s [patterns [lookups]]", argv[0]);
+    for (n = 0; n < patterns; n++) {
+	switch (n % 3) {
+	case 0:
+	    vstring_sprintf_append(list_buf, "host%ld.example.com, ", n);
+	    break;
+	case 1:
+	    vstring_sprintf_append(list_buf, "10.%ld.%ld.0/24, ",
+				   (n >> 8) & 0xff, n & 0xff);
+	    break;
+	case 2:
+	    vstring_sprintf_append(list_buf, "192.168.%ld.%ld, ",
+				   (n >> 8) & 0xff, n & 0xff);
+	    break;
+	}
+    }
+    rss = bench_maxrss();
+    list = namadr_list_init("benchmark", MATCH_FLAG_PARENT
+			    | MATCH_FLAG_RETURN, vstring_str(list_buf));
+    rss = bench_maxrss() - rss;
+    GETTIMEOFDAY(&start);
+    for (n = 0; n < lookups; n++) {
+	i = (n * 7919) % patterns;
+	if (n % 2) {
+	    vstring_sprintf(host, "client%ld.example.net", i);
+	    vstring_sprintf(addr, "172.16.%ld.%ld", (i >> 8) & 0xff, i & 0xff);
+	} else {
+	    i -= i % 3;
+	    vstring_sprintf(host, "host%ld.example.com", i);
+	    vstring_sprintf(addr, "172.16.%ld.%ld", (i >> 8) & 0xff, i & 0xff);
+	}
+	found += (namadr_list_match(list, vstring_str(host),
+				    vstring_str(addr)) != 0);
+    }
+    t_match = bench_since(&start);
+    if (found != (lookups + 1) / 2)
+	msg_panic("found %ld of %ld matches", found, (lookups + 1) / 2);
+    vstream_printf("namadr_list: %ld patterns, ns/match %.0f, "
+		   "matches/s %.0f, maxrss +%ld kB\n", patterns,
+		   t_match / lookups, 1e9 * lookups / t_match, rss);
+    vstream_fflush(VSTREAM_OUT);
+    namadr_list_free(list);
+    vstring_free(list_buf);
+    vstring_free(host);
+    vstring_free(addr);
+    return (0);
+}
+
+#endif
@@ -33,6 +33,10 @@
 /*
 /*	proxy_inet_addr_list() returns the list of all addresses that
 /*	belong to proxy network interfaces.
+/*
+/*	own_inet_addr() and proxy_inet_addr() use a binary search,
+/*	so that their cost does not grow linearly with the number
+/*	of addresses.
 /* LICENSE
 /* .ad
 /* .fi
@@ -72,6 +76,14 @@ static INET_ADDR_LIST saved_addr_list;
 static INET_ADDR_LIST saved_mask_list;
 static INET_ADDR_LIST saved_proxy_list;
 
+ /*
+  * A sorted copy of saved_addr_list. That list itself is not sorted when it
+  * comes from the system's interface list, and saved_mask_list must stay in
+  * the same order.
+  */
+static INET_ADDR_LIST saved_addr_index;
+static int saved_addr_indexed = 0;
+
 /* own_inet_addr_init - initialize my own address list */
 
 static void own_inet_addr_init(INET_ADDR_LIST *addr_list,
@@ -193,15 +205,20 @@ static void own_inet_addr_init(INET_ADDR_LIST *addr_list,
 
 int     own_inet_addr(struct sockaddr * addr)
 {
-    int     i;
+    struct sockaddr_storage *sa;
 
     if (saved_addr_list.used == 0)
 	own_inet_addr_init(&saved_addr_list, &saved_mask_list);
 
-    for (i = 0; i < saved_addr_list.used; i++)
-	if (SOCK_ADDR_EQ_ADDR(addr, saved_addr_list.addrs + i))
-	    return (1);
-    return (0);
+    if (saved_addr_indexed == 0) {
+	inet_addr_list_init(&saved_addr_index);
+	for (sa = saved_addr_list.addrs;
+	     sa < saved_addr_list.addrs + saved_addr_list.used; sa++)
+	    inet_addr_list_append(&saved_addr_index, SOCK_ADDR_PTR(sa));
+	inet_addr_list_uniq(&saved_addr_index);
+	saved_addr_indexed = 1;
+    }
+    return (inet_addr_list_find(&saved_addr_index, addr));
 }
 
 /* own_inet_addr_list - return list of addresses */
@@ -255,18 +272,14 @@ static void proxy_inet_addr_init(INET_ADDR_LIST *addr_list)
 
 int     proxy_inet_addr(struct sockaddr * addr)
 {
-    int     i;
-
     if (*var_proxy_interfaces == 0)
 	return (0);
 
     if (saved_proxy_list.used == 0)
 	proxy_inet_addr_init(&saved_proxy_list);
 
-    for (i = 0; i < saved_proxy_list.used; i++)
-	if (SOCK_ADDR_EQ_ADDR(addr, saved_proxy_list.addrs + i))
-	    return (1);
-    return (0);
+    /* proxy_inet_addr_init() sorted the list. */
+    return (inet_addr_list_find(&saved_proxy_list, addr));
 }
 
 /* proxy_inet_addr_list - return list of addresses */
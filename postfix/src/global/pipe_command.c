@@ -111,6 +111,7 @@
 /* .IP PIPE_STAT_CORRUPT
 /*	The queue file is corrupted.
 /* SEE ALSO
+/*	vfork_exec(3) run external command
 /*	mail_copy(3) deliver to any.
 /*	mark_corrupt(3) mark queue file as corrupt.
 /*	sys_exits(3) sendmail-compatible exit status codes.
@@ -135,32 +136,23 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <stdlib.h>
-#ifdef USE_PATHS_H
-#include <paths.h>
-#endif
-#include <syslog.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <vstream.h>
-#include <msg_vstream.h>
 #include <vstring.h>
 #include <stringops.h>
 #include <iostuff.h>
 #include <timed_wait.h>
-#include <set_ugid.h>
 #include <set_eugid.h>
-#include <argv.h>
-#include <chroot_uid.h>
+#include <vfork_exec.h>
 
 /* Global library. */
 
 #include <mail_params.h>
 #include <mail_copy.h>
-#include <clean_env.h>
 #include <pipe_command.h>
-#include <exec_command.h>
 #include <sys_exits.h>
 #include <dsn_util.h>
 #include <dsn_buf.h>
@@ -369,21 +361,6 @@ static int pipe_command_wait_or_kill(pid_t pid, WAIT_STATUS_T *statusp, int sig,
     return (n);
 }
 
-/* pipe_child_cleanup - child fatal error handler */
-
-static void pipe_child_cleanup(void)
-{
-
-    /*
-     * WARNING: don't place code here. This code may run as mail_owner, as
-     * root, or as the user/group specified with the "user" attribute. The
-     * only safe action is to terminate.
-     * 
-     * Future proofing. If you need exit() here then you broke Postfix.
-     */
-    _exit(EX_TEMPFAIL);
-}
-
 /* pipe_command - execute command with extreme prejudice */
 
 int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
@@ -401,8 +378,7 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
     int     cmd_in_pipe[2];
     int     cmd_out_pipe[2];
     struct pipe_args args;
-    char  **cpp;
-    ARGV   *argv;
+    VFORK_EXEC request;
     DSN_SPLIT dp;
     const SYS_EXITS_DETAIL *sp;
 
@@ -446,238 +422,163 @@ int     pipe_command(VSTREAM *src, DSN_BUF *why,...)
 
     /*
      * Spawn off a child process and irrevocably change privilege to the
-     * user. This includes revoking all rights on open files (via the close
-     * on exec flag). If we cannot run the command now, try again some time
-     * later.
+     * user. This includes revoking all rights on open files. Run the child
+     * in a separate process group so that the parent can kill not just the
+     * child but also its offspring. vfork_exec() avoids copying the page
+     * tables of this process, which may have grown large with table and TLS
+     * state. Replace random exit status codes from a failed child by
+     * EX_TEMPFAIL. Command output, including child diagnostics, is captured
+     * in the parent process.
      */
-    switch (pid = fork()) {
+    request.name = myname;
+    request.argv = args.argv;
+    request.command = args.argv ? 0 : args.command;
+    request.shell = args.shell;
+    request.uid = args.uid;
+    request.gid = args.gid;
+    request.chroot = args.chroot;
+    request.cwd = args.cwd;
+    request.stdin_fd = cmd_in_pipe[0];
+    request.stdout_fd = cmd_out_pipe[1];
+    request.stderr_fd = cmd_out_pipe[1];
+    request.export = args.export;
+    request.env = args.env;
+    request.fail_status = EX_TEMPFAIL;
 
-	/*
-	 * Error. Instead of trying again right now, back off, give the
-	 * system a chance to recover, and try again later.
-	 */
-    case -1:
+    /*
+     * Error. Instead of trying again right now, back off, give the system a
+     * chance to recover, and try again later.
+     */
+    if ((pid = vfork_exec(&request)) < 0) {
 	msg_warn("fork: %m");
-	dsb_unix(why, "4.3.0", sys_exits_detail(EX_OSERR)->text,
-		 "Delivery failed: %m");
-	return (PIPE_STAT_DEFER);
-
-	/*
-	 * Child. Run the child in a separate process group so that the
-	 * parent can kill not just the child but also its offspring.
-	 * 
-	 * Redirect fatal exits to our own fatal exit handler (never leave the
-	 * parent's handler enabled :-) so we can replace random exit status
-	 * codes by EX_TEMPFAIL.
-	 */
-    case 0:
-	(void) msg_cleanup(pipe_child_cleanup);
-
-	/*
-	 * In order to chroot it is necessary to switch euid back to root.
-	 * Right after chroot we call set_ugid() so all privileges will be
-	 * dropped again.
-	 * 
-	 * XXX For consistency we use chroot_uid() to change root+current
-	 * directory. However, we must not use chroot_uid() to change process
-	 * privileges (assuming a version that accepts numeric privileges).
-	 * That would create a maintenance problem, because we would have two
-	 * different code paths to set the external command's privileges.
-	 */
-	if (args.chroot) {
-	    seteuid(0);
-	    chroot_uid(args.chroot, (char *) 0);
-	}
-
-	/*
-	 * XXX If we put code before the set_ugid() call, then the code that
-	 * changes root directory must switch back to the mail_owner UID,
-	 * otherwise we'd be running with root privileges.
-	 */
-	set_ugid(args.uid, args.gid);
-	if (setsid() < 0)
-	    msg_warn("setsid failed: %m");
-
-	/*
-	 * Pipe plumbing.
-	 */
+	close(cmd_in_pipe[0]);
 	close(cmd_in_pipe[1]);
 	close(cmd_out_pipe[0]);
-	if (DUP2(cmd_in_pipe[0], STDIN_FILENO) < 0
-	    || DUP2(cmd_out_pipe[1], STDOUT_FILENO) < 0
-	    || DUP2(cmd_out_pipe[1], STDERR_FILENO) < 0)
-	    msg_fatal("%s: dup2: %m", myname);
-	close(cmd_in_pipe[0]);
 	close(cmd_out_pipe[1]);
+	dsb_unix(why, "4.3.0", sys_exits_detail(EX_OSERR)->text,
+		 "Delivery failed: %m");
+	return (PIPE_STAT_DEFER);
+    }
 
-	/*
-	 * Working directory plumbing.
-	 */
-	if (args.cwd && chdir(args.cwd) < 0)
-	    msg_fatal("cannot change directory to \"%s\" for uid=%lu gid=%lu: %m",
-		      args.cwd, (unsigned long) args.uid,
-		      (unsigned long) args.gid);
-
-	/*
-	 * Environment plumbing. Always reset the command search path. XXX
-	 * That should probably be done by clean_env().
-	 */
-	if (args.export)
-	    clean_env(args.export);
-	if (setenv("PATH", _PATH_DEFPATH, 1))
-	    msg_fatal("%s: setenv: %m", myname);
-	if (args.env)
-	    for (cpp = args.env; *cpp; cpp += 2)
-		if (setenv(cpp[0], cpp[1], 1))
-		    msg_fatal("setenv: %m");
-
-	/*
-	 * Process plumbing. If possible, avoid running a shell.
-	 * 
-	 * As a safety for buggy libraries, we close the syslog socket.
-	 * Otherwise we could leak a file descriptor that was created by a
-	 * privileged process.
-	 * 
-	 * XXX To avoid losing fatal error messages we open a VSTREAM and
-	 * capture the output in the parent process.
-	 */
-	closelog();
-	msg_vstream_init(var_procname, VSTREAM_ERR);
-	if (args.argv) {
-	    execvp(args.argv[0], args.argv);
-	    msg_fatal("%s: execvp %s: %m", myname, args.argv[0]);
-	} else if (args.shell && *args.shell) {
-	    argv = argv_split(args.shell, CHARS_SPACE);
-	    argv_add(argv, args.command, (char *) 0);
-	    argv_terminate(argv);
-	    execvp(argv->argv[0], argv->argv);
-	    msg_fatal("%s: execvp %s: %m", myname, argv->argv[0]);
-	} else {
-	    exec_command(args.command);
-	}
-	/* NOTREACHED */
+    /*
+     * Parent.
+     */
+    close(cmd_in_pipe[0]);
+    close(cmd_out_pipe[1]);
 
-	/*
-	 * Parent.
-	 */
-    default:
-	close(cmd_in_pipe[0]);
-	close(cmd_out_pipe[1]);
+    cmd_in_stream = vstream_fdopen(cmd_in_pipe[1], O_WRONLY);
+    cmd_out_stream = vstream_fdopen(cmd_out_pipe[0], O_RDONLY);
 
-	cmd_in_stream = vstream_fdopen(cmd_in_pipe[1], O_WRONLY);
-	cmd_out_stream = vstream_fdopen(cmd_out_pipe[0], O_RDONLY);
+    /*
+     * Give the command a limited amount of time to run, by enforcing
+     * timeouts on all I/O from and to it.
+     */
+    vstream_control(cmd_in_stream,
+		    CA_VSTREAM_CTL_WRITE_FN(pipe_command_write),
+		    CA_VSTREAM_CTL_END);
+    vstream_control(cmd_out_stream,
+		    CA_VSTREAM_CTL_READ_FN(pipe_command_read),
+		    CA_VSTREAM_CTL_END);
+    pipe_command_timeout = 0;
 
-	/*
-	 * Give the command a limited amount of time to run, by enforcing
-	 * timeouts on all I/O from and to it.
-	 */
-	vstream_control(cmd_in_stream,
-			CA_VSTREAM_CTL_WRITE_FN(pipe_command_write),
-			CA_VSTREAM_CTL_END);
-	vstream_control(cmd_out_stream,
-			CA_VSTREAM_CTL_READ_FN(pipe_command_read),
-			CA_VSTREAM_CTL_END);
-	pipe_command_timeout = 0;
+    /*
+     * Pipe the message into the command. Examine the error report only
+     * if we can't recognize a more specific error from the command exit
+     * status or from the command output.
+     */
+    write_status = mail_copy(args.sender, args.orig_rcpt,
+			     args.delivered, src,
+			     cmd_in_stream, args.flags,
+			     args.eol, why);
+    write_errno = errno;
 
-	/*
-	 * Pipe the message into the command. Examine the error report only
-	 * if we can't recognize a more specific error from the command exit
-	 * status or from the command output.
-	 */
-	write_status = mail_copy(args.sender, args.orig_rcpt,
-				 args.delivered, src,
-				 cmd_in_stream, args.flags,
-				 args.eol, why);
-	write_errno = errno;
+    /*
+     * Capture a limited amount of command output, for inclusion in a
+     * bounce message. Turn tabs and newlines into whitespace, and
+     * replace other non-printable characters by underscore.
+     */
+    log_len = vstream_fread(cmd_out_stream, log_buf, sizeof(log_buf) - 1);
+    (void) vstream_fclose(cmd_out_stream);
+    log_buf[log_len] = 0;
+    translit(log_buf, "\t\n", "  ");
+    printable(log_buf, '_');
 
-	/*
-	 * Capture a limited amount of command output, for inclusion in a
-	 * bounce message. Turn tabs and newlines into whitespace, and
-	 * replace other non-printable characters by underscore.
-	 */
-	log_len = vstream_fread(cmd_out_stream, log_buf, sizeof(log_buf) - 1);
-	(void) vstream_fclose(cmd_out_stream);
-	log_buf[log_len] = 0;
-	translit(log_buf, "\t\n", "  ");
-	printable(log_buf, '_');
+    /*
+     * Just because the child closes its output streams, don't assume
+     * that it will terminate. Instead, be prepared for the situation
+     * that the child does not terminate, even when the parent
+     * experiences no read/write timeout. Make sure that the child
+     * terminates before the parent attempts to retrieve its exit status,
+     * otherwise the parent could become stuck, and the mail system would
+     * eventually run out of delivery agents. Do a thorough job, and kill
+     * not just the child process but also its offspring.
+     */
+    if (pipe_command_timeout)
+	kill_command(pid, SIGKILL, args.uid, args.gid);
+    if (pipe_command_wait_or_kill(pid, &wait_status, SIGKILL,
+				  args.uid, args.gid) < 0)
+	msg_fatal("wait: %m");
+    if (pipe_command_timeout) {
+	dsb_unix(why, "5.3.0", log_len ?
+		 log_buf : sys_exits_detail(EX_SOFTWARE)->text,
+		 "Command time limit exceeded: \"%s\"%s%s",
+		 args.command,
+		 log_len ? ". Command output: " : "", log_buf);
+	return (PIPE_STAT_BOUNCE);
+    }
 
-	/*
-	 * Just because the child closes its output streams, don't assume
-	 * that it will terminate. Instead, be prepared for the situation
-	 * that the child does not terminate, even when the parent
-	 * experiences no read/write timeout. Make sure that the child
-	 * terminates before the parent attempts to retrieve its exit status,
-	 * otherwise the parent could become stuck, and the mail system would
-	 * eventually run out of delivery agents. Do a thorough job, and kill
-	 * not just the child process but also its offspring.
-	 */
-	if (pipe_command_timeout)
-	    kill_command(pid, SIGKILL, args.uid, args.gid);
-	if (pipe_command_wait_or_kill(pid, &wait_status, SIGKILL,
-				      args.uid, args.gid) < 0)
-	    msg_fatal("wait: %m");
-	if (pipe_command_timeout) {
-	    dsb_unix(why, "5.3.0", log_len ?
+    /*
+     * Command exits. Give special treatment to sendmail style exit
+     * status codes.
+     */
+    if (!NORMAL_EXIT_STATUS(wait_status)) {
+	if (WIFSIGNALED(wait_status)) {
+	    dsb_unix(why, "4.3.0", log_len ?
 		     log_buf : sys_exits_detail(EX_SOFTWARE)->text,
-		     "Command time limit exceeded: \"%s\"%s%s",
-		     args.command,
+		     "Command died with signal %d: \"%s\"%s%s",
+		     WTERMSIG(wait_status), args.command,
 		     log_len ? ". Command output: " : "", log_buf);
-	    return (PIPE_STAT_BOUNCE);
+	    return (PIPE_STAT_DEFER);
+	}
+	/* Use "D.S.N text" command output. XXX What diagnostic code? */
+	else if (dsn_valid(log_buf) > 0) {
+	    dsn_split(&dp, "5.3.0", log_buf);
+	    dsb_unix(why, DSN_STATUS(dp.dsn), dp.text, "%s", dp.text);
+	    return (DSN_CLASS(dp.dsn) == '4' ?
+		    PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
+	}
+	/* Use <sysexits.h> compatible exit status. */
+	else if (SYS_EXITS_CODE(WEXITSTATUS(wait_status))) {
+	    sp = sys_exits_detail(WEXITSTATUS(wait_status));
+	    dsb_unix(why, sp->dsn,
+		     log_len ? log_buf : sp->text, "%s%s%s", sp->text,
+		     log_len ? ". Command output: " : "", log_buf);
+	    return (sp->dsn[0] == '4' ?
+		    PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
 	}
 
 	/*
-	 * Command exits. Give special treatment to sendmail style exit
-	 * status codes.
+	 * No "D.S.N text" or <sysexits.h> compatible status. Fake it.
 	 */
-	if (!NORMAL_EXIT_STATUS(wait_status)) {
-	    if (WIFSIGNALED(wait_status)) {
-		dsb_unix(why, "4.3.0", log_len ?
-			 log_buf : sys_exits_detail(EX_SOFTWARE)->text,
-			 "Command died with signal %d: \"%s\"%s%s",
-			 WTERMSIG(wait_status), args.command,
-			 log_len ? ". Command output: " : "", log_buf);
-		return (PIPE_STAT_DEFER);
-	    }
-	    /* Use "D.S.N text" command output. XXX What diagnostic code? */
-	    else if (dsn_valid(log_buf) > 0) {
-		dsn_split(&dp, "5.3.0", log_buf);
-		dsb_unix(why, DSN_STATUS(dp.dsn), dp.text, "%s", dp.text);
-		return (DSN_CLASS(dp.dsn) == '4' ?
-			PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
-	    }
-	    /* Use <sysexits.h> compatible exit status. */
-	    else if (SYS_EXITS_CODE(WEXITSTATUS(wait_status))) {
-		sp = sys_exits_detail(WEXITSTATUS(wait_status));
-		dsb_unix(why, sp->dsn,
-			 log_len ? log_buf : sp->text, "%s%s%s", sp->text,
-			 log_len ? ". Command output: " : "", log_buf);
-		return (sp->dsn[0] == '4' ?
-			PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
-	    }
-
-	    /*
-	     * No "D.S.N text" or <sysexits.h> compatible status. Fake it.
-	     */
-	    else {
-		sp = sys_exits_detail(WEXITSTATUS(wait_status));
-		dsb_unix(why, sp->dsn,
-			 log_len ? log_buf : sp->text,
-			 "Command died with status %d: \"%s\"%s%s",
-			 WEXITSTATUS(wait_status), args.command,
-			 log_len ? ". Command output: " : "", log_buf);
-		return (PIPE_STAT_BOUNCE);
-	    }
-	} else if (write_status &
-		   MAIL_COPY_STAT_CORRUPT) {
-	    return (PIPE_STAT_CORRUPT);
-	} else if (write_status && write_errno != EPIPE) {
-	    vstring_prepend(why->reason, "Command failed: ",
-			    sizeof("Command failed: ") - 1);
-	    vstring_sprintf_append(why->reason, ": \"%s\"", args.command);
+	else {
+	    sp = sys_exits_detail(WEXITSTATUS(wait_status));
+	    dsb_unix(why, sp->dsn,
+		     log_len ? log_buf : sp->text,
+		     "Command died with status %d: \"%s\"%s%s",
+		     WEXITSTATUS(wait_status), args.command,
+		     log_len ? ". Command output: " : "", log_buf);
 	    return (PIPE_STAT_BOUNCE);
-	} else {
-	    vstring_strcpy(why->reason, log_buf);
-	    return (PIPE_STAT_OK);
 	}
+    } else if (write_status &
+	       MAIL_COPY_STAT_CORRUPT) {
+	return (PIPE_STAT_CORRUPT);
+    } else if (write_status && write_errno != EPIPE) {
+	vstring_prepend(why->reason, "Command failed: ",
+			sizeof("Command failed: ") - 1);
+	vstring_sprintf_append(why->reason, ": \"%s\"", args.command);
+	return (PIPE_STAT_BOUNCE);
+    } else {
+	vstring_strcpy(why->reason, log_buf);
+	return (PIPE_STAT_OK);
     }
 }
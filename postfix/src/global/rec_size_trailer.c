@@ -0,0 +1,74 @@
+/*++
+/* NAME
+/*	rec_size_trailer 3
+/* SUMMARY
+/*	queue file size record at the end of a queue file
+/* SYNOPSIS
+/*	#include <rec_size_trailer.h>
+/*
+/*	int	rec_size_trailer(fp, buf)
+/*	VSTREAM	*fp;
+/*	VSTRING	*buf;
+/* DESCRIPTION
+/*	Normally, the cleanup(8) server writes a placeholder size
+/*	record at the start of a queue file, and updates it when the
+/*	message sizes and offsets are known. Optionally, it writes
+/*	all late-known information in a size record at the very end
+/*	of the queue file instead, so that queue files are written
+/*	strictly sequentially. The record at the start of the queue
+/*	file then has the content REC_TYPE_SIZE_TRAILER.
+/*
+/*	The trailer follows the REC_TYPE_END record and any records
+/*	that were appended with Milter edits; programs that read a
+/*	queue file sequentially never see it.
+/*
+/*	rec_size_trailer() reads the size record at the end of the
+/*	specified queue file. The result is REC_TYPE_SIZE, with the
+/*	record content in the buf argument, or REC_TYPE_ERROR when
+/*	the queue file has no valid trailer. The stream read/write
+/*	position is restored before the function returns.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Utility library. */
+
+#include <vstream.h>
+#include <vstring.h>
+#include <record.h>
+
+/* Global library. */
+
+#include <rec_type.h>
+#include <rec_size_trailer.h>
+
+/* rec_size_trailer - read size record at end of queue file */
+
+int     rec_size_trailer(VSTREAM *fp, VSTRING *buf)
+{
+    struct stat st;
+    off_t   saved_offset;
+    int     rec_type;
+
+    if ((saved_offset = vstream_ftell(fp)) < 0
+	|| fstat(vstream_fileno(fp), &st) < 0
+	|| st.st_size < REC_SIZE_TRAILER_LEN
+	|| vstream_fseek(fp, st.st_size - REC_SIZE_TRAILER_LEN, SEEK_SET) < 0)
+	return (REC_TYPE_ERROR);
+    rec_type = rec_get_raw(fp, buf, 0, REC_FLAG_NONE);
+    if (rec_type != REC_TYPE_SIZE
+	|| VSTRING_LEN(buf) != REC_SIZE_TRAILER_PAYL
+	|| vstream_ftell(fp) != st.st_size)
+	rec_type = REC_TYPE_ERROR;
+    if (vstream_fseek(fp, saved_offset, SEEK_SET) < 0)
+	return (REC_TYPE_ERROR);
+    return (rec_type);
+}
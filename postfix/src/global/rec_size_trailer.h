@@ -0,0 +1,39 @@
+#ifndef _REC_SIZE_TRAILER_H_INCLUDED_
+#define _REC_SIZE_TRAILER_H_INCLUDED_
+
+/*++
+/* NAME
+/*	rec_size_trailer 3h
+/* SUMMARY
+/*	queue file size record at the end of a queue file
+/* SYNOPSIS
+/*	#include <rec_size_trailer.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <vstream.h>
+#include <vstring.h>
+
+ /*
+  * The trailer is a REC_TYPE_SIZE record with REC_TYPE_SIZE_FORMAT content
+  * (6 fields of at least 15 digits, separated by spaces), with a one-byte
+  * record type and a one-byte record length.
+  */
+#define REC_SIZE_TRAILER_PAYL	(6 * 15 + 5)
+#define REC_SIZE_TRAILER_LEN	(1 + 1 + REC_SIZE_TRAILER_PAYL)
+
+ /*
+  * External interface.
+  */
+extern int rec_size_trailer(VSTREAM *, VSTRING *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
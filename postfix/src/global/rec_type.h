@@ -132,6 +132,13 @@
 #define REC_TYPE_SIZE_CAST5	long	/* Postfix 2.4 content length */
 #define REC_TYPE_SIZE_CAST6	long	/* Postfix 3.0 smtputf8 flags */
 
+ /*
+  * Postfix 3.9: the size record at the start of the queue file may instead
+  * say that the size information is in a trailer at the end of the queue
+  * file. See rec_size_trailer(3).
+  */
+#define REC_TYPE_SIZE_TRAILER	"trailer"
+
  /*
   * The warn record specifies when the next warning that the message was
   * deferred should be sent.  It is updated in place by qmgr, so changing
@@ -43,6 +43,16 @@
 /*	const char *orig_rcpt;
 /*	const char *recipient;
 /*
+/*	const char *recipient_list_update(list, old, new)
+/*	RECIPIENT_LIST *list;
+/*	const char *old;
+/*	const char *new;
+/*
+/*	void	RECIPIENT_LIST_UPDATE(list, ptr, new)
+/*	RECIPIENT_LIST *list;
+/*	const char *ptr;
+/*	const char *new;
+/*
 /*	void	recipient_list_swap(a, b)
 /*	RECIPIENT_LIST *a;
 /*	RECIPIENT_LIST *b;
@@ -71,10 +81,25 @@
 /*	recipient_list_add() and to recipient_list_free(). The variant
 /*	argument specifies how list elements should be initialized;
 /*	specify RCPT_LIST_INIT_STATUS to zero the status field, and
-/*	RCPT_LIST_INIT_QUEUE to zero the queue field.
+/*	RCPT_LIST_INIT_QUEUE to zero the queue field. Specify the
+/*	bit-wise OR of the variant and RCPT_LIST_FLAG_POOL to store
+/*	the recipient address information of the list in a few large
+/*	memory blocks that are released all at once. Such a list
+/*	stores an original recipient only once when it is identical
+/*	to the recipient address, and shares the original recipient
+/*	and DSN original recipient with the preceding recipient
+/*	when those are identical, as is common with mailing lists.
 /*
 /*	recipient_list_add() adds a recipient to the specified list.
-/*	Recipient address information is copied with mystrdup().
+/*	Recipient address information is copied with mystrdup(),
+/*	or into the list's memory pool.
+/*
+/*	recipient_list_update() returns a copy of the \fInew\fR
+/*	string, and releases the \fIold\fR string, which must be
+/*	stored in the specified list. RECIPIENT_LIST_UPDATE() is a
+/*	wrapper that updates a recipient field. Use these instead of
+/*	RECIPIENT_UPDATE() with lists that were created with
+/*	RCPT_LIST_FLAG_POOL.
 /*
 /*	recipient_list_swap() swaps the recipients between
 /*	the given two recipient lists.
@@ -109,11 +134,18 @@
 /*	IBM T.J. Watson Research
 /*	P.O. Box 704
 /*	Yorktown Heights, NY 10598, USA
+/*
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
 /*--*/
 
 /* System library. */
 
 #include <sys_defs.h>
+#include <stddef.h>			/* offsetof() */
+#include <string.h>
 
 /* Utility library. */
 
@@ -124,6 +156,68 @@
 
 #include "recipient_list.h"
 
+ /*
+  * String storage for pooled recipient lists. Strings are allocated from
+  * the most recent memory block; block sizes double from RCPT_POOL_MINSIZE
+  * to RCPT_POOL_MAXSIZE, so that small lists (a queue manager delivery
+  * request) stay small while large lists (a queue manager in-core message)
+  * need only a few memory allocations. Strings are never released
+  * individually.
+  */
+typedef struct RCPT_POOL {
+    struct RCPT_POOL *next;		/* older block */
+    size_t  size;			/* data size */
+    size_t  used;			/* data in use */
+    char    data[1];			/* actually, a lot more */
+} RCPT_POOL;
+
+#define RCPT_POOL_MINSIZE	512
+#define RCPT_POOL_MAXSIZE	65536
+
+/* recipient_list_strdup - save string in pool or heap */
+
+static const char *recipient_list_strdup(RECIPIENT_LIST *list, const char *str)
+{
+    RCPT_POOL *pool = list->pool;
+    RCPT_POOL *block;
+    size_t  len;
+    size_t  size;
+    char   *copy;
+
+    if ((list->variant & RCPT_LIST_FLAG_POOL) == 0)
+	return (mystrdup(str));
+
+    len = strlen(str) + 1;
+    if (pool == 0 || pool->size - pool->used < len) {
+	size = (pool == 0 ? RCPT_POOL_MINSIZE :
+		pool->size < RCPT_POOL_MAXSIZE / 2 ?
+		2 * pool->size : RCPT_POOL_MAXSIZE);
+	if (size < len)
+	    size = len;
+	block = (RCPT_POOL *) mymalloc(offsetof(RCPT_POOL, data) + size);
+	block->size = size;
+	block->used = 0;
+
+	/*
+	 * Keep the partially used block in front when an oversized string
+	 * gets a block of its own.
+	 */
+	if (size > RCPT_POOL_MAXSIZE && pool != 0 && pool->used < pool->size) {
+	    block->next = pool->next;
+	    pool->next = block;
+	} else {
+	    block->next = pool;
+	    list->pool = pool = block;
+	}
+	copy = block->data + block->used;
+	block->used += len;
+    } else {
+	copy = pool->data + pool->used;
+	pool->used += len;
+    }
+    return (memcpy(copy, str, len));
+}
+
 /* recipient_list_init - initialize */
 
 void    recipient_list_init(RECIPIENT_LIST *list, int variant)
@@ -132,6 +226,7 @@ void    recipient_list_init(RECIPIENT_LIST *list, int variant)
     list->len = 0;
     list->info = (RECIPIENT *) mymalloc(sizeof(RECIPIENT));
     list->variant = variant;
+    list->pool = 0;
 }
 
 /* recipient_list_add - add rcpt to list */
@@ -140,7 +235,10 @@ void    recipient_list_add(RECIPIENT_LIST *list, long offset,
 			           const char *dsn_orcpt, int dsn_notify,
 			           const char *orig_rcpt, const char *rcpt)
 {
+    RECIPIENT *rp;
+    RECIPIENT *prev;
     int     new_avail;
+    int     variant;
 
     if (list->len >= list->avail) {
 	new_avail = list->avail * 2;
@@ -148,20 +246,52 @@ void    recipient_list_add(RECIPIENT_LIST *list, long offset,
 	    myrealloc((void *) list->info, new_avail * sizeof(RECIPIENT));
 	list->avail = new_avail;
     }
-    list->info[list->len].orig_addr = mystrdup(orig_rcpt);
-    list->info[list->len].address = mystrdup(rcpt);
+    rp = list->info + list->len;
+    prev = (list->len > 0 ? rp - 1 : 0);
+    if ((list->variant & RCPT_LIST_FLAG_POOL) == 0) {
+	rp->orig_addr = mystrdup(orig_rcpt);
+	rp->address = mystrdup(rcpt);
+	rp->dsn_orcpt = mystrdup(dsn_orcpt);
+    } else {
+
+	/*
+	 * Share identical strings with the same or preceding recipient. This
+	 * is safe because pooled strings are never released individually.
+	 */
+	rp->address = recipient_list_strdup(list, rcpt);
+	if (strcmp(orig_rcpt, rcpt) == 0)
+	    rp->orig_addr = rp->address;
+	else if (prev != 0 && strcmp(orig_rcpt, prev->orig_addr) == 0)
+	    rp->orig_addr = prev->orig_addr;
+	else
+	    rp->orig_addr = recipient_list_strdup(list, orig_rcpt);
+	if (prev != 0 && strcmp(dsn_orcpt, prev->dsn_orcpt) == 0)
+	    rp->dsn_orcpt = prev->dsn_orcpt;
+	else
+	    rp->dsn_orcpt = recipient_list_strdup(list, dsn_orcpt);
+    }
     list->info[list->len].offset = offset;
-    list->info[list->len].dsn_orcpt = mystrdup(dsn_orcpt);
     list->info[list->len].dsn_notify = dsn_notify;
-    if (list->variant == RCPT_LIST_INIT_STATUS)
+    variant = (list->variant & ~RCPT_LIST_FLAG_POOL);
+    if (variant == RCPT_LIST_INIT_STATUS)
 	list->info[list->len].u.status = 0;
-    else if (list->variant == RCPT_LIST_INIT_QUEUE)
+    else if (variant == RCPT_LIST_INIT_QUEUE)
 	list->info[list->len].u.queue = 0;
-    else if (list->variant == RCPT_LIST_INIT_ADDR)
+    else if (variant == RCPT_LIST_INIT_ADDR)
 	list->info[list->len].u.addr_type = 0;
     list->len++;
 }
 
+/* recipient_list_update - replace recipient string */
+
+const char *recipient_list_update(RECIPIENT_LIST *list, const char *old,
+				          const char *new)
+{
+    if ((list->variant & RCPT_LIST_FLAG_POOL) == 0)
+	myfree((void *) old);
+    return (recipient_list_strdup(list, new));
+}
+
 /* recipient_list_swap - swap recipients between the two recipient lists */
 
 void    recipient_list_swap(RECIPIENT_LIST *a, RECIPIENT_LIST *b)
@@ -174,6 +304,7 @@ void    recipient_list_swap(RECIPIENT_LIST *a, RECIPIENT_LIST *b)
     SWAP(RECIPIENT *, info);
     SWAP(int, len);
     SWAP(int, avail);
+    SWAP(RCPT_POOL *, pool);
 }
 
 /* recipient_list_free - release memory for in-core recipient structure */
@@ -181,11 +312,19 @@ void    recipient_list_swap(RECIPIENT_LIST *a, RECIPIENT_LIST *b)
 void    recipient_list_free(RECIPIENT_LIST *list)
 {
     RECIPIENT *rcpt;
+    RCPT_POOL *block;
 
-    for (rcpt = list->info; rcpt < list->info + list->len; rcpt++) {
-	myfree((void *) rcpt->dsn_orcpt);
-	myfree((void *) rcpt->orig_addr);
-	myfree((void *) rcpt->address);
+    if ((list->variant & RCPT_LIST_FLAG_POOL) == 0) {
+	for (rcpt = list->info; rcpt < list->info + list->len; rcpt++) {
+	    myfree((void *) rcpt->dsn_orcpt);
+	    myfree((void *) rcpt->orig_addr);
+	    myfree((void *) rcpt->address);
+	}
+    } else {
+	while ((block = list->pool) != 0) {
+	    list->pool = block->next;
+	    myfree((void *) block);
+	}
     }
     myfree((void *) list->info);
 }
@@ -51,10 +51,12 @@ typedef struct RECIPIENT_LIST {
     int     len;
     int     avail;
     int     variant;
+    struct RCPT_POOL *pool;		/* null or string storage */
 } RECIPIENT_LIST;
 
 extern void recipient_list_init(RECIPIENT_LIST *, int);
 extern void recipient_list_add(RECIPIENT_LIST *, long, const char *, int, const char *, const char *);
+extern const char *recipient_list_update(RECIPIENT_LIST *, const char *, const char *);
 extern void recipient_list_swap(RECIPIENT_LIST *, RECIPIENT_LIST *);
 extern void recipient_list_free(RECIPIENT_LIST *);
 
@@ -62,6 +64,12 @@ extern void recipient_list_free(RECIPIENT_LIST *);
 #define RCPT_LIST_INIT_QUEUE	2
 #define RCPT_LIST_INIT_ADDR	3
 
+#define RCPT_LIST_FLAG_POOL	(1<<8)	/* recipient_list_init() flag */
+
+#define RECIPIENT_LIST_UPDATE(list, ptr, new) do { \
+    (ptr) = recipient_list_update((list), (ptr), (new)); \
+} while (0)
+
 /* LICENSE
 /* .ad
 /* .fi
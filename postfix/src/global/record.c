@@ -163,6 +163,7 @@
 #include <vstream.h>
 #include <vstring.h>
 #include <stringops.h>
+#include <probes.h>
 
 /* Global library. */
 
@@ -202,6 +203,7 @@ int     rec_put(VSTREAM *stream, int type, const char *data, ssize_t len)
     if (msg_verbose > 2)
 	msg_info("rec_put: type %c len %ld data %.10s",
 		 type, (long) len, data);
+    POSTFIX_PROBE3(record_put, stream, type, len);
 
     /*
      * Write the record type, one byte.
@@ -296,6 +298,7 @@ int     rec_get_raw(VSTREAM *stream, VSTRING *buf, ssize_t maxsize, int flags)
 	if (msg_verbose > 2)
 	    msg_info("%s: type %c len %ld data %.10s", myname,
 		     type, (long) len, vstring_str(buf));
+	POSTFIX_PROBE3(record_get, stream, type, len);
 
 	/*
 	 * Transparency options.
@@ -0,0 +1,295 @@
+/*++
+/* NAME
+/*	replica_clnt 3
+/* SUMMARY
+/*	queue file replication client
+/* SYNOPSIS
+/*	#include <replica_clnt.h>
+/*
+/*	int	replica_clnt_store(queue_id, fd)
+/*	const char *queue_id;
+/*	int	fd;
+/*
+/*	void	replica_clnt_remove(queue_id)
+/*	const char *queue_id;
+/*
+/*	void	replica_clnt_flush()
+/* DESCRIPTION
+/*	This module talks to the replicad(8) service on the peer node
+/*	that is specified with queue_replication_peer. All functions
+/*	do nothing when that parameter is empty. The connection is
+/*	kept open for the next request, and is opened again once
+/*	when the peer closed a cached connection. I/O is limited
+/*	to queue_replication_timeout per read or write operation.
+/*
+/*	After a connection or I/O error, no new connection is made
+/*	for REPLICA_RETRY_DELAY seconds, so that a dead peer costs
+/*	one timeout, instead of one timeout per message.
+/*
+/*	replica_clnt_store() sends the content of the named queue
+/*	file, and waits until the peer has stored it in its replica
+/*	directory. The file offset of the \fIfd\fR argument is not
+/*	changed. The result is REPLICA_STAT_OK when the peer holds
+/*	a complete copy, REPLICA_STAT_FAIL otherwise.
+/*
+/*	replica_clnt_remove() requests that the peer remove the
+/*	replica for the named queue file. Requests are sent in
+/*	batches, by a timer event after REPLICA_FLUSH_DELAY seconds
+/*	or when REPLICA_BATCH_LIMIT requests are pending. This
+/*	requires that the caller runs the event loop. Requests that
+/*	could not be sent are retried later; they are discarded
+/*	with a warning when REPLICA_PENDING_LIMIT requests are
+/*	pending.
+/*
+/*	replica_clnt_flush() sends pending remove requests immediately.
+/* DIAGNOSTICS
+/*	Warnings: connection or I/O errors, and requests that the
+/*	peer did not complete.
+/* SEE ALSO
+/*	replicad(8), queue file replication server
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <argv.h>
+#include <vstream.h>
+#include <events.h>
+#include <connect.h>
+#include <iostuff.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_proto.h>
+#include <replica_clnt.h>
+
+ /*
+  * Tunables. These are not worth a main.cf parameter.
+  */
+#define REPLICA_RETRY_DELAY	60	/* seconds after a peer failure */
+#define REPLICA_FLUSH_DELAY	1	/* seconds to batch remove requests */
+#define REPLICA_BATCH_LIMIT	100	/* flush after this many requests */
+#define REPLICA_PENDING_LIMIT	10000	/* discard after this many requests */
+
+#define REPLICA_STAT_IO		(-2)	/* connection is unusable */
+
+static VSTREAM *replica_stream;		/* cached connection */
+static time_t replica_retry_time;	/* no connection before this time */
+static ARGV *replica_removals;		/* pending remove requests */
+
+/* replica_clnt_open - connect to the peer */
+
+static VSTREAM *replica_clnt_open(void)
+{
+    int     fd;
+
+    if (time((time_t *) 0) < replica_retry_time)
+	return (0);
+    if ((fd = inet_connect(var_queue_repl_peer, BLOCKING,
+			   var_queue_repl_tmout)) < 0) {
+	msg_warn("connect to queue replication peer %s: %m",
+		 var_queue_repl_peer);
+	replica_retry_time = time((time_t *) 0) + REPLICA_RETRY_DELAY;
+	return (0);
+    }
+    close_on_exec(fd, CLOSE_ON_EXEC);
+    replica_stream = vstream_fdopen(fd, O_RDWR);
+    vstream_control(replica_stream,
+		    CA_VSTREAM_CTL_PATH(var_queue_repl_peer),
+		    CA_VSTREAM_CTL_TIMEOUT(var_queue_repl_tmout),
+		    CA_VSTREAM_CTL_END);
+    if (attr_scan(replica_stream, ATTR_FLAG_STRICT,
+		  RECV_ATTR_STREQ(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_REPLICA),
+		  ATTR_TYPE_END) != 0
+	|| vstream_feof(replica_stream)) {
+	msg_warn("queue replication peer %s: access denied or protocol error",
+		 var_queue_repl_peer);
+	(void) vstream_fclose(replica_stream);
+	replica_stream = 0;
+	replica_retry_time = time((time_t *) 0) + REPLICA_RETRY_DELAY;
+    }
+    return (replica_stream);
+}
+
+/* replica_clnt_close - drop the connection, optionally back off */
+
+static void replica_clnt_close(int back_off)
+{
+    (void) vstream_fclose(replica_stream);
+    replica_stream = 0;
+    if (back_off)
+	replica_retry_time = time((time_t *) 0) + REPLICA_RETRY_DELAY;
+}
+
+/* replica_clnt_send - send one queue file and receive the status */
+
+static int replica_clnt_send(const char *queue_id, int fd, off_t size)
+{
+    char    buf[VSTREAM_BUFSIZE];
+    off_t   offset;
+    ssize_t count;
+    int     status;
+
+    attr_print(replica_stream, ATTR_FLAG_NONE,
+	       SEND_ATTR_STR(MAIL_ATTR_REQ, REPLICA_REQ_STORE),
+	       SEND_ATTR_STR(REPLICA_ATTR_ORIGIN, var_myhostname),
+	       SEND_ATTR_STR(MAIL_ATTR_QUEUEID, queue_id),
+	       SEND_ATTR_LONG(MAIL_ATTR_SIZE, (long) size),
+	       ATTR_TYPE_END);
+    for (offset = 0; offset < size; offset += count) {
+	count = (size - offset < (off_t) sizeof(buf) ?
+		 size - offset : sizeof(buf));
+	if ((count = pread(fd, buf, count, offset)) <= 0) {
+	    /* The peer discards an incomplete file. */
+	    if (count < 0)
+		msg_warn("%s: read queue file: %m", queue_id);
+	    else
+		msg_warn("%s: queue file is shorter than %ld bytes",
+			 queue_id, (long) size);
+	    replica_clnt_close(0);
+	    return (REPLICA_STAT_FAIL);
+	}
+	if (vstream_fwrite(replica_stream, buf, count) != count)
+	    return (REPLICA_STAT_IO);
+    }
+    if (vstream_fflush(replica_stream) != 0
+	|| attr_scan(replica_stream, ATTR_FLAG_STRICT,
+		     RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+		     ATTR_TYPE_END) != 1)
+	return (REPLICA_STAT_IO);
+    if (status != REPLICA_STAT_OK) {
+	msg_warn("%s: queue replication peer %s did not store the file",
+		 queue_id, var_queue_repl_peer);
+	return (REPLICA_STAT_FAIL);
+    }
+    return (REPLICA_STAT_OK);
+}
+
+/* replica_clnt_store - replicate queue file to peer */
+
+int     replica_clnt_store(const char *queue_id, int fd)
+{
+    struct stat st;
+    int     status;
+    int     reused;
+    int     tries;
+
+    if (*var_queue_repl_peer == 0)
+	return (REPLICA_STAT_FAIL);
+    if (fstat(fd, &st) < 0) {
+	msg_warn("%s: fstat queue file: %m", queue_id);
+	return (REPLICA_STAT_FAIL);
+    }
+
+    /*
+     * Retry once when a cached connection turns out to be stale, for example
+     * because the peer was reloaded.
+     */
+    for (tries = 0; tries < 2; tries++) {
+	reused = (replica_stream != 0);
+	if (!reused && replica_clnt_open() == 0)
+	    return (REPLICA_STAT_FAIL);
+	if ((status = replica_clnt_send(queue_id, fd, st.st_size))
+	    != REPLICA_STAT_IO)
+	    return (status);
+	replica_clnt_close(!reused);
+	if (!reused)
+	    break;
+    }
+    msg_warn("%s: lost connection with queue replication peer %s",
+	     queue_id, var_queue_repl_peer);
+    return (REPLICA_STAT_FAIL);
+}
+
+/* replica_clnt_event - flush remove requests after timer event */
+
+static void replica_clnt_event(int unused_event, void *unused_context)
+{
+    replica_clnt_flush();
+}
+
+/* replica_clnt_remove - request replica removal */
+
+void    replica_clnt_remove(const char *queue_id)
+{
+    if (*var_queue_repl_peer == 0)
+	return;
+    if (replica_removals == 0)
+	replica_removals = argv_alloc(REPLICA_BATCH_LIMIT);
+    argv_add(replica_removals, queue_id, (char *) 0);
+    if (replica_removals->argc >= REPLICA_BATCH_LIMIT)
+	replica_clnt_flush();
+    else if (replica_removals->argc == 1)
+	event_request_timer(replica_clnt_event, (void *) 0,
+			    REPLICA_FLUSH_DELAY);
+}
+
+/* replica_clnt_flush - send pending remove requests */
+
+void    replica_clnt_flush(void)
+{
+    char  **cpp;
+    int     status;
+    int     reused;
+    int     tries;
+    ssize_t count;
+
+    if (replica_removals == 0 || replica_removals->argc == 0)
+	return;
+    event_cancel_timer(replica_clnt_event, (void *) 0);
+
+    /*
+     * Pipeline the requests, then read the replies. A request may be sent
+     * twice; the peer ignores a request for a replica that does not exist.
+     */
+    for (tries = 0; tries < 2; tries++) {
+	reused = (replica_stream != 0);
+	if (!reused && replica_clnt_open() == 0)
+	    break;
+	for (cpp = replica_removals->argv; *cpp; cpp++)
+	    attr_print(replica_stream, ATTR_FLAG_NONE,
+		       SEND_ATTR_STR(MAIL_ATTR_REQ, REPLICA_REQ_REMOVE),
+		       SEND_ATTR_STR(REPLICA_ATTR_ORIGIN, var_myhostname),
+		       SEND_ATTR_STR(MAIL_ATTR_QUEUEID, *cpp),
+		       ATTR_TYPE_END);
+	if (vstream_fflush(replica_stream) == 0) {
+	    for (count = 0; count < replica_removals->argc; count++)
+		if (attr_scan(replica_stream, ATTR_FLAG_STRICT,
+			      RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
+			      ATTR_TYPE_END) != 1)
+		    break;
+	    if (count == replica_removals->argc) {
+		argv_truncate(replica_removals, 0);
+		return;
+	    }
+	}
+	replica_clnt_close(!reused);
+	if (!reused)
+	    break;
+    }
+
+    /*
+     * Try again later. A replica that is not removed results in a duplicate
+     * delivery only when the peer recovers this node's mail.
+     */
+    if (replica_removals->argc >= REPLICA_PENDING_LIMIT) {
+	msg_warn("queue replication peer %s: discarding %ld remove requests",
+		 var_queue_repl_peer, (long) replica_removals->argc);
+	argv_truncate(replica_removals, 0);
+    } else {
+	event_request_timer(replica_clnt_event, (void *) 0,
+			    REPLICA_RETRY_DELAY);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef _REPLICA_CLNT_H_INCLUDED_
+#define _REPLICA_CLNT_H_INCLUDED_
+
+/*++
+/* NAME
+/*	replica_clnt 3h
+/* SUMMARY
+/*	queue file replication client
+/* SYNOPSIS
+/*	#include <replica_clnt.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Protocol interface. A store request is followed by exactly "size" bytes
+  * of raw queue file content.
+  */
+#define REPLICA_REQ_STORE	"store"	/* origin, queue_id, size, content */
+#define REPLICA_REQ_REMOVE	"remove"	/* origin, queue_id */
+
+#define REPLICA_ATTR_ORIGIN	"origin"	/* sender's myhostname */
+
+#define REPLICA_STAT_OK		0
+#define REPLICA_STAT_FAIL	(-1)
+
+ /*
+  * External interface.
+  */
+extern int replica_clnt_store(const char *, int);
+extern void replica_clnt_remove(const char *);
+extern void replica_clnt_flush(void);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
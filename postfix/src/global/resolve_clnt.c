@@ -28,6 +28,18 @@
 /*	const char *address;
 /*	RESOLVE_REPLY *reply;
 /*
+/*	void	resolve_clnt_query_batch_from(sender, addrs, count, replies)
+/*	const char *sender;
+/*	const char **addrs;
+/*	ssize_t	count;
+/*	RESOLVE_REPLY *replies;
+/*
+/*	void	resolve_clnt_verify_batch_from(sender, addrs, count, replies)
+/*	const char *sender;
+/*	const char **addrs;
+/*	ssize_t	count;
+/*	RESOLVE_REPLY *replies;
+/*
 /*	void	resolve_clnt_free(reply)
 /*	RESOLVE_REPLY *reply;
 /* DESCRIPTION
@@ -48,6 +60,17 @@
 /*	resolve_clnt_verify_from() implements an alternative version that can
 /*	be used for address verification.
 /*
+/*	resolve_clnt_query_batch_from() and resolve_clnt_verify_batch_from()
+/*	resolve \fIcount\fR addresses with the same sender, and store
+/*	the results in the \fIreplies\fR array, which must contain
+/*	\fIcount\fR initialized reply structures. Addresses are sent
+/*	to the resolver daemon in batches of up to RESOLVE_BATCH_LIMIT
+/*	requests, so that a list of N addresses costs N/RESOLVE_BATCH_LIMIT
+/*	round trips instead of N. When a batch request fails, for
+/*	example because the resolver daemon does not support the batch
+/*	protocol, the addresses in that batch are resolved one at a
+/*	time with resolve_clnt_query_from() or resolve_clnt_verify_from().
+/*
 /*	In the resolver reply, the flags member is the bit-wise OR of
 /*	zero or more of the following:
 /* .IP RESOLVE_FLAG_FINAL
@@ -293,6 +316,123 @@ void    resolve_clnt(const char *class, const char *sender,
     last_expire = time((time_t *) 0) + 30;	/* XXX make configurable */
 }
 
+/* resolve_clnt_batch_chunk - resolve up to RESOLVE_BATCH_LIMIT addresses */
+
+static int resolve_clnt_batch_chunk(const char *class, const char *sender,
+				            const char **addrs, ssize_t count,
+				            RESOLVE_REPLY *replies)
+{
+    const char *myname = "resolve_clnt_batch_chunk";
+    VSTREAM *stream;
+    RESOLVE_REPLY *reply;
+    int     server_flags;
+    int     disconnect = 0;
+    ssize_t n;
+
+    if (rewrite_clnt_stream == 0)
+	rewrite_clnt_stream = clnt_stream_create(MAIL_CLASS_PRIVATE,
+						 var_rewrite_service,
+						 var_ipc_idle_limit,
+						 var_ipc_ttl_limit,
+						 resolve_clnt_handshake);
+
+    /*
+     * Send the entire batch, then read the replies. The server reads all
+     * addresses before it sends the first reply, so this can't deadlock.
+     */
+    if ((stream = clnt_stream_access(rewrite_clnt_stream)) == 0)
+	return (-1);
+    errno = 0;
+    if (attr_print(stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_STR(MAIL_ATTR_REQ, class),
+		   SEND_ATTR_STR(MAIL_ATTR_SENDER, sender),
+		   SEND_ATTR_INT(MAIL_ATTR_ADDR_COUNT, count),
+		   ATTR_TYPE_END) != 0)
+	return (-1);
+    for (n = 0; n < count; n++)
+	if (attr_print(stream, ATTR_FLAG_NONE,
+		       SEND_ATTR_STR(MAIL_ATTR_ADDR, addrs[n]),
+		       ATTR_TYPE_END) != 0)
+	    return (-1);
+    if (vstream_fflush(stream) != 0)
+	return (-1);
+
+    for (n = 0; n < count; n++) {
+	reply = replies + n;
+	if (attr_scan(stream, ATTR_FLAG_STRICT,
+		      RECV_ATTR_INT(MAIL_ATTR_FLAGS, &server_flags),
+		      RECV_ATTR_STR(MAIL_ATTR_TRANSPORT, reply->transport),
+		      RECV_ATTR_STR(MAIL_ATTR_NEXTHOP, reply->nexthop),
+		      RECV_ATTR_STR(MAIL_ATTR_RECIP, reply->recipient),
+		      RECV_ATTR_INT(MAIL_ATTR_FLAGS, &reply->flags),
+		      ATTR_TYPE_END) != 5)
+	    return (-1);
+	if (msg_verbose)
+	    msg_info("%s: `%s' -> `%s' -> transp=`%s' host=`%s' rcpt=`%s' flags=0x%x",
+		     myname, sender, addrs[n], STR(reply->transport),
+		     STR(reply->nexthop), STR(reply->recipient), reply->flags);
+	if (STR(reply->transport)[0] == 0) {
+	    msg_warn("%s: null transport result for: <%s>", myname, addrs[n]);
+	    return (-1);
+	} else if (STR(reply->recipient)[0] == 0 && *addrs[n] != 0) {
+	    msg_warn("%s: null recipient result for: <%s>", myname, addrs[n]);
+	    return (-1);
+	}
+	disconnect |= server_flags;
+    }
+    /* Server-requested disconnect. */
+    if (disconnect != 0)
+	clnt_stream_recover(rewrite_clnt_stream);
+    return (0);
+}
+
+/* resolve_clnt_batch - resolve a list of addresses */
+
+void    resolve_clnt_batch(const char *class, const char *sender,
+			           const char **addrs, ssize_t count,
+			           RESOLVE_REPLY *replies)
+{
+    const char *myname = "resolve_clnt_batch";
+    const char *one_class;
+    ssize_t chunk;
+    ssize_t n;
+
+    if (strcmp(class, RESOLVE_REGULAR_BATCH) == 0)
+	one_class = RESOLVE_REGULAR;
+    else if (strcmp(class, RESOLVE_VERIFY_BATCH) == 0)
+	one_class = RESOLVE_VERIFY;
+    else
+	msg_panic("%s: unknown request class: %s", myname, class);
+
+    /*
+     * Sanity check. The result must not clobber the input because we may
+     * have to retransmit the request.
+     */
+    for (n = 0; n < count; n++)
+	if (addrs[n] == STR(replies[n].recipient))
+	    msg_panic("%s: result clobbers input", myname);
+
+    /*
+     * Don't bother with the batch protocol for single addresses; those
+     * benefit from the one-entry cache in resolve_clnt().
+     */
+    for ( /* void */ ; count > 0; addrs += chunk, replies += chunk, count -= chunk) {
+	chunk = (count > RESOLVE_BATCH_LIMIT ? RESOLVE_BATCH_LIMIT : count);
+	if (chunk > 1
+	    && resolve_clnt_batch_chunk(class, sender, addrs, chunk,
+					replies) == 0)
+	    continue;
+	if (chunk > 1) {
+	    if (msg_verbose || (errno && errno != EPIPE && errno != ENOENT))
+		msg_warn("problem talking to service %s: %m",
+			 var_rewrite_service);
+	    clnt_stream_recover(rewrite_clnt_stream);
+	}
+	for (n = 0; n < chunk; n++)
+	    resolve_clnt(one_class, sender, addrs[n], replies + n);
+    }
+}
+
 /* resolve_clnt_free - destroy reply */
 
 void    resolve_clnt_free(RESOLVE_REPLY *reply)
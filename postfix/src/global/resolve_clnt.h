@@ -21,6 +21,10 @@
   */
 #define RESOLVE_REGULAR	"resolve"
 #define RESOLVE_VERIFY	"verify"
+#define RESOLVE_REGULAR_BATCH	"resolve_batch"
+#define RESOLVE_VERIFY_BATCH	"verify_batch"
+
+#define RESOLVE_BATCH_LIMIT	100	/* max addresses per batch request */
 
 #define RESOLVE_FLAG_FINAL	(1<<0)	/* final delivery */
 #define RESOLVE_FLAG_ROUTED	(1<<1)	/* routed destination */
@@ -50,6 +54,8 @@ typedef struct RESOLVE_REPLY {
 extern void resolve_clnt_init(RESOLVE_REPLY *);
 extern void resolve_clnt(const char *, const char *, const char *, RESOLVE_REPLY *);
 extern void resolve_clnt_free(RESOLVE_REPLY *);
+extern void resolve_clnt_batch(const char *, const char *, const char **,
+			               ssize_t, RESOLVE_REPLY *);
 
 #define RESOLVE_NULL_FROM	""
 
@@ -57,6 +63,10 @@ extern void resolve_clnt_free(RESOLVE_REPLY *);
 	resolve_clnt(RESOLVE_REGULAR, (f), (a), (r))
 #define resolve_clnt_verify_from(f, a, r) \
 	resolve_clnt(RESOLVE_VERIFY, (f), (a), (r))
+#define resolve_clnt_query_batch_from(f, a, n, r) \
+	resolve_clnt_batch(RESOLVE_REGULAR_BATCH, (f), (a), (n), (r))
+#define resolve_clnt_verify_batch_from(f, a, n, r) \
+	resolve_clnt_batch(RESOLVE_VERIFY_BATCH, (f), (a), (n), (r))
 
 #define RESOLVE_CLNT_ASSIGN(reply, transport, nexthop, recipient) { \
 	(reply).transport = (transport); \
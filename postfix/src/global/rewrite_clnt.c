@@ -15,6 +15,18 @@
 /*	const char *ruleset;
 /*	const char *address;
 /*	VSTRING	*result;
+/*
+/*	void	rewrite_clnt_pipeline(ruleset, addrs, count, results)
+/*	const char *ruleset;
+/*	const char **addrs;
+/*	ssize_t	count;
+/*	VSTRING	**results;
+/*
+/*	void	rewrite_clnt_internal_pipeline(ruleset, addrs, count, results)
+/*	const char *ruleset;
+/*	const char **addrs;
+/*	ssize_t	count;
+/*	VSTRING	**results;
 /* DESCRIPTION
 /*	This module implements a mail address rewriting client.
 /*
@@ -26,6 +38,17 @@
 /*	rewrite_clnt_internal() performs the same functionality but takes
 /*	input in internal (unquoted) form, and produces output in internal
 /*	(unquoted) form.
+/*
+/*	rewrite_clnt_pipeline() and rewrite_clnt_internal_pipeline()
+/*	rewrite \fIcount\fR independent addresses with the same
+/*	rule set, and store the result for \fIaddrs[n]\fR in
+/*	\fIresults[n]\fR. The requests are sent in groups of up to
+/*	REWRITE_PIPELINE_LIMIT before the replies are read, so that
+/*	N addresses cost one round trip instead of N. The server
+/*	needs no protocol support for this. When a pipelined group
+/*	fails, the addresses in that group are rewritten one at a
+/*	time with rewrite_clnt(). These functions do not use the
+/*	one-entry cache.
 /* DIAGNOSTICS
 /*	Warnings: communication failure. Fatal error: mail system is down.
 /* SEE ALSO
@@ -56,6 +79,7 @@
 /* Utility library. */
 
 #include <msg.h>
+#include <mymalloc.h>
 #include <vstring.h>
 #include <vstream.h>
 #include <vstring_vstream.h>
@@ -186,6 +210,93 @@ VSTRING *rewrite_clnt(const char *rule, const char *addr, VSTRING *result)
     return (result);
 }
 
+/* rewrite_clnt_pipeline_chunk - send requests, then read replies */
+
+static int rewrite_clnt_pipeline_chunk(const char *rule, const char **addrs,
+				               ssize_t count, VSTRING **results)
+{
+    VSTREAM *stream;
+    int     server_flags;
+    int     disconnect = 0;
+    ssize_t n;
+
+    /*
+     * Send all requests, then read all replies. The replies are short, and
+     * the group size is limited, so that the server will not block while
+     * we are still sending.
+     */
+    if ((stream = clnt_stream_access(rewrite_clnt_stream)) == 0)
+	return (-1);
+    errno = 0;
+    for (n = 0; n < count; n++)
+	if (attr_print(stream, ATTR_FLAG_NONE,
+		       SEND_ATTR_STR(MAIL_ATTR_REQ, REWRITE_ADDR),
+		       SEND_ATTR_STR(MAIL_ATTR_RULE, rule),
+		       SEND_ATTR_STR(MAIL_ATTR_ADDR, addrs[n]),
+		       ATTR_TYPE_END) != 0)
+	    return (-1);
+    if (vstream_fflush(stream) != 0)
+	return (-1);
+    for (n = 0; n < count; n++) {
+	if (attr_scan(stream, ATTR_FLAG_STRICT,
+		      RECV_ATTR_INT(MAIL_ATTR_FLAGS, &server_flags),
+		      RECV_ATTR_STR(MAIL_ATTR_ADDR, results[n]),
+		      ATTR_TYPE_END) != 2)
+	    return (-1);
+	if (msg_verbose)
+	    msg_info("rewrite_clnt_pipeline: %s: %s -> %s",
+		     rule, addrs[n], vstring_str(results[n]));
+	disconnect |= server_flags;
+    }
+    /* Server-requested disconnect. */
+    if (disconnect != 0)
+	clnt_stream_recover(rewrite_clnt_stream);
+    return (0);
+}
+
+/* rewrite_clnt_pipeline - rewrite a list of addresses */
+
+void    rewrite_clnt_pipeline(const char *rule, const char **addrs,
+			              ssize_t count, VSTRING **results)
+{
+    ssize_t chunk;
+    ssize_t n;
+
+    /*
+     * Sanity check. The result must not clobber the input, because we may
+     * have to retransmit the query.
+     */
+    for (n = 0; n < count; n++)
+	if (addrs[n] == STR(results[n]))
+	    msg_panic("rewrite_clnt_pipeline: result clobbers input");
+
+    if (rewrite_clnt_stream == 0)
+	rewrite_clnt_stream = clnt_stream_create(MAIL_CLASS_PRIVATE,
+						 var_rewrite_service,
+						 var_ipc_idle_limit,
+						 var_ipc_ttl_limit,
+						 rewrite_clnt_handshake);
+
+    /*
+     * Don't bother with pipelining for single addresses; those benefit from
+     * the one-entry cache in rewrite_clnt().
+     */
+    for ( /* void */ ; count > 0; addrs += chunk, results += chunk, count -= chunk) {
+	chunk = (count > REWRITE_PIPELINE_LIMIT ? REWRITE_PIPELINE_LIMIT : count);
+	if (chunk > 1
+	    && rewrite_clnt_pipeline_chunk(rule, addrs, chunk, results) == 0)
+	    continue;
+	if (chunk > 1) {
+	    if (msg_verbose || (errno && errno != EPIPE && errno != ENOENT))
+		msg_warn("problem talking to service %s: %m",
+			 var_rewrite_service);
+	    clnt_stream_recover(rewrite_clnt_stream);
+	}
+	for (n = 0; n < chunk; n++)
+	    rewrite_clnt(rule, addrs[n], results[n]);
+    }
+}
+
 /* rewrite_clnt_internal - rewrite from/to internal form */
 
 VSTRING *rewrite_clnt_internal(const char *ruleset, const char *addr, VSTRING *result)
@@ -205,6 +316,36 @@ VSTRING *rewrite_clnt_internal(const char *ruleset, const char *addr, VSTRING *r
     return (result);
 }
 
+/* rewrite_clnt_internal_pipeline - rewrite list from/to internal form */
+
+void    rewrite_clnt_internal_pipeline(const char *ruleset, const char **addrs,
+				               ssize_t count, VSTRING **results)
+{
+    const char **src;
+    VSTRING **buf;
+    ssize_t n;
+
+    /*
+     * Convert the addresses from internal address form to external RFC822
+     * form, then rewrite them. After rewriting, convert to internal form.
+     */
+    src = (const char **) mymalloc(count * sizeof(*src));
+    buf = (VSTRING **) mymalloc(2 * count * sizeof(*buf));
+    for (n = 0; n < count; n++) {
+	buf[n] = quote_822_local(vstring_alloc(100), addrs[n]);
+	buf[count + n] = vstring_alloc(100);
+	src[n] = STR(buf[n]);
+    }
+    rewrite_clnt_pipeline(ruleset, src, count, buf + count);
+    for (n = 0; n < count; n++) {
+	unquote_822_local(results[n], STR(buf[count + n]));
+	vstring_free(buf[n]);
+	vstring_free(buf[count + n]);
+    }
+    myfree((void *) buf);
+    myfree((void *) src);
+}
+
 #ifdef TEST
 
 #include <stdlib.h>
@@ -29,6 +29,12 @@
 
 extern VSTRING *rewrite_clnt(const char *, const char *, VSTRING *);
 extern VSTRING *rewrite_clnt_internal(const char *, const char *, VSTRING *);
+extern void rewrite_clnt_pipeline(const char *, const char **, ssize_t,
+				          VSTRING **);
+extern void rewrite_clnt_internal_pipeline(const char *, const char **,
+					           ssize_t, VSTRING **);
+
+#define REWRITE_PIPELINE_LIMIT	100	/* max requests in flight */
 
 /* LICENSE
 /* .ad
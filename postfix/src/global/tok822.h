@@ -76,6 +76,7 @@ extern TOK822 **tok822_grep(TOK822 *, int);
   */
 extern TOK822 *tok822_scan_limit(const char *, TOK822 **, int);
 extern TOK822 *tok822_scan_addr(const char *);
+extern int tok822_simple_addr(const char *, ssize_t);
 extern TOK822 *tok822_parse_limit(const char *, int);
 extern VSTRING *tok822_externalize(VSTRING *, TOK822 *, int);
 extern VSTRING *tok822_internalize(VSTRING *, TOK822 *, int);
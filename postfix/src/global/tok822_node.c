@@ -25,6 +25,12 @@
 /*
 /*	tok822_free() releases the memory used for the specified token
 /*	and conveniently returns a null pointer value.
+/*
+/*	Parsing one address header allocates a token for each word
+/*	and special character. To avoid a malloc()/free() pair per
+/*	token, tok822_free() saves a limited number of token
+/*	structures and small string buffers for reuse by
+/*	tok822_alloc().
 /* LICENSE
 /* .ad
 /* .fi
@@ -50,6 +56,18 @@
 
 #include "tok822.h"
 
+ /*
+  * Saved tokens and string buffers. Don't hoard large string buffers; those
+  * are rare.
+  */
+#define TOK822_SAVE_MAX		1024
+#define TOK822_SAVE_VSTR_SIZE	256
+
+static TOK822 *tok822_saved_list;
+static int tok822_saved_count;
+static VSTRING *tok822_saved_vstr[TOK822_SAVE_MAX];
+static int tok822_saved_vstr_count;
+
 /* tok822_alloc - allocate and initialize token */
 
 TOK822 *tok822_alloc(int type, const char *strval)
@@ -59,12 +77,28 @@ TOK822 *tok822_alloc(int type, const char *strval)
 #define CONTAINER_TOKEN(x) \
 	((x) == TOK822_ADDR || (x) == TOK822_STARTGRP)
 
-    tp = (TOK822 *) mymalloc(sizeof(*tp));
+    if ((tp = tok822_saved_list) != 0) {
+	tok822_saved_list = tp->next;
+	tok822_saved_count--;
+    } else {
+	tp = (TOK822 *) mymalloc(sizeof(*tp));
+    }
     tp->type = type;
     tp->next = tp->prev = tp->head = tp->tail = tp->owner = 0;
-    tp->vstr = (type < TOK822_MINTOK || CONTAINER_TOKEN(type) ? 0 :
-		strval == 0 ? vstring_alloc(10) :
-		vstring_strcpy(vstring_alloc(strlen(strval) + 1), strval));
+    if (type < TOK822_MINTOK || CONTAINER_TOKEN(type)) {
+	tp->vstr = 0;
+    } else if (tok822_saved_vstr_count > 0) {
+	tp->vstr = tok822_saved_vstr[--tok822_saved_vstr_count];
+	if (strval == 0) {
+	    VSTRING_RESET(tp->vstr);
+	    VSTRING_TERMINATE(tp->vstr);
+	} else {
+	    vstring_strcpy(tp->vstr, strval);
+	}
+    } else {
+	tp->vstr = (strval == 0 ? vstring_alloc(10) :
+		 vstring_strcpy(vstring_alloc(strlen(strval) + 1), strval));
+    }
     return (tp);
 }
 
@@ -72,8 +106,19 @@ TOK822 *tok822_alloc(int type, const char *strval)
 
 TOK822 *tok822_free(TOK822 *tp)
 {
-    if (tp->vstr)
-	vstring_free(tp->vstr);
-    myfree((void *) tp);
+    if (tp->vstr) {
+	if (tok822_saved_vstr_count < TOK822_SAVE_MAX
+	    && tp->vstr->vbuf.len <= TOK822_SAVE_VSTR_SIZE)
+	    tok822_saved_vstr[tok822_saved_vstr_count++] = tp->vstr;
+	else
+	    vstring_free(tp->vstr);
+    }
+    if (tok822_saved_count < TOK822_SAVE_MAX) {
+	tp->next = tok822_saved_list;
+	tok822_saved_list = tp;
+	tok822_saved_count++;
+    } else {
+	myfree((void *) tp);
+    }
     return (0);
 }
@@ -25,6 +25,10 @@
 /*	TOK822	*tok822_scan_addr(str)
 /*	const char *str;
 /*
+/*	int	tok822_simple_addr(str, len)
+/*	const char *str;
+/*	ssize_t	len;
+/*
 /*	VSTRING	*tok822_externalize(buffer, tree, flags)
 /*	VSTRING	*buffer;
 /*	TOK822	*tree;
@@ -65,6 +69,16 @@
 /*	suitable for data that should contain just one address and no
 /*	other information.
 /*
+/*	tok822_simple_addr() recognizes a plain local-part@domain
+/*	address without building a token tree. The local-part is a
+/*	dot-atom of 7-bit characters other than the % ! and |
+/*	operators; the domain consists of letters, digits, hyphens
+/*	and non-empty labels, without trailing dot. Such an address
+/*	has the same external and internal form, and parsing it
+/*	produces a single address with that form. The \fIlen\fR
+/*	argument is the string length, or -1 for a null-terminated
+/*	string. The result is non-zero for a simple address.
+/*
 /*	tok822_externalize() converts a token list to external form.
 /*	Where appropriate, characters and strings are quoted and white
 /*	space is inserted. The \fIflags\fR argument is the binary OR of
@@ -653,6 +667,40 @@ TOK822 *tok822_scan_addr(const char *addr)
     return (tree);
 }
 
+/* tok822_simple_addr - recognize address that needs no parsing */
+
+int     tok822_simple_addr(const char *str, ssize_t len)
+{
+    static const char atext_extra[] = "#$&'*+/=?^_`{}~";
+    const char *cp;
+    const char *end;
+    const char *at = 0;
+    int     ch;
+    int     prev = '.';
+
+    /*
+     * Anything that is not a dot-atom local-part, an @, and a domain name,
+     * goes through the full parser. There is no empty atom or label.
+     */
+    if (len < 0)
+	len = strlen(str);
+    for (cp = str, end = str + len; cp < end; prev = ch, cp++) {
+	ch = *(unsigned char *) cp;
+	if (ISALNUM(ch) || ch == '-')
+	    continue;
+	if (ch == '.' || ch == '@') {
+	    if (prev == '.' || prev == '@' || (ch == '@' && at != 0))
+		return (0);
+	    if (ch == '@')
+		at = cp;
+	    continue;
+	}
+	if (at != 0 || ch == 0 || strchr(atext_extra, ch) == 0)
+	    return (0);
+    }
+    return (at != 0 && prev != '.' && prev != '@');
+}
+
 #ifdef TEST
 
 #include <unistd.h>
@@ -724,3 +772,71 @@ int     main(int unused_argc, char **unused_argv)
 }
 
 #endif
+
+#ifdef BENCH
+
+ /*
+  * Time parsing and externalizing of typical address header values.
+  */
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vstream.h>
+
+static const char *bench_corpus[] = {
+    "wietse@porcupine.org",
+    "Wietse Venema <wietse@porcupine.org>",
+    "\"Venema, Wietse\" <wietse@porcupine.org>",
+    "wietse@porcupine.org (Wietse Venema)",
+    "postmaster, root@localhost, <MAILER-DAEMON>",
+    "Undisclosed recipients:;",
+    "team: alice@example.com, Bob <bob@example.net>;, carol@example.org",
+    "\"very long display name with many words in it\" <some.user+tag@sub.domain.example.co.uk>",
+    "<@relay1.example,@relay2.example:user@example.com>",
+    "user@[192.168.1.1], user@[IPv6:2001:db8::1]",
+    0,
+};
+
+static double bench_since(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec) * 1e9
+	    + (now.tv_usec - start->tv_usec) * 1e3);
+}
+
+int     main(int argc, char **argv)
+{
+    long    rounds = (argc > 1 ? atol(argv[1]) : 100000);
+    VSTRING *buf = vstring_alloc(100);
+    struct timeval start;
+    double  t_parse = 0;
+    double  t_extern = 0;
+    TOK822 *tree;
+    const char **cpp;
+    long    count = 0;
+    long    n;
+
+    if (rounds <= 0)
+	msg_fatal("usage: %s [rounds]", argv[0]);
+    for (n = 0; n < rounds; n++) {
+	for (cpp = bench_corpus; *cpp; cpp++) {
+	    GETTIMEOFDAY(&start);
+	    tree = tok822_parse(*cpp);
+	    t_parse += bench_since(&start);
+	    GETTIMEOFDAY(&start);
+	    tok822_externalize(buf, tree, TOK822_STR_DEFL);
+	    t_extern += bench_since(&start);
+	    tok822_free_tree(tree);
+	    count++;
+	}
+    }
+    vstream_printf("tok822: %ld header values, ns/operation: parse %.0f "
+		   "externalize %.0f\n", count, t_parse / count,
+		   t_extern / count);
+    vstream_fflush(VSTREAM_OUT);
+    vstring_free(buf);
+    return (0);
+}
+
+#endif
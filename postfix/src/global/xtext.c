@@ -73,6 +73,8 @@
 #define STR(x)	vstring_str(x)
 #define LEN(x)	VSTRING_LEN(x)
 
+static const char xtext_hex[] = "0123456789ABCDEF";
+
 /* xtext_quote_append - append unquoted data to quoted data */
 
 VSTRING *xtext_quote_append(VSTRING *quoted, const char *unquoted,
@@ -86,7 +88,9 @@ VSTRING *xtext_quote_append(VSTRING *quoted, const char *unquoted,
 	    && (*special == 0 || strchr(special, ch) == 0)) {
 	    VSTRING_ADDCH(quoted, ch);
 	} else {
-	    vstring_sprintf_append(quoted, "+%02X", ch);
+	    VSTRING_ADDCH(quoted, '+');
+	    VSTRING_ADDCH(quoted, xtext_hex[ch >> 4]);
+	    VSTRING_ADDCH(quoted, xtext_hex[ch & 0xf]);
 	}
     }
     VSTRING_TERMINATE(quoted);
@@ -18,6 +18,13 @@
 /*	a recipient is listed in her own .forward file. Expansions
 /*	are scrutinized with the forward_expansion_filter parameter.
 /*
+/*	With a non-zero local_forward_cache_ttl setting, the result
+/*	of each .forward file lookup is remembered for that amount
+/*	of time, so that repeated deliveries to the same recipient
+/*	don't access the file system. This includes non-existent
+/*	files. After that time, a file whose device, inode, size,
+/*	modification and change time are unchanged is not read again.
+/*
 /*	Arguments:
 /* .IP state
 /*	Message delivery attributes (sender, recipient etc.).
@@ -56,6 +63,7 @@
 #include <paths.h>
 #endif
 #include <string.h>
+#include <time.h>
 
 /* Utility library. */
 
@@ -90,6 +98,165 @@
 #define NO	0
 #define YES	1
 
+ /*
+  * Per-process .forward file lookup cache. A local(8) process handles a
+  * limited number of requests ($max_use), so there is no need for LRU; when
+  * the table is full, new files are not added.
+  */
+typedef struct {
+    time_t  expires;			/* time to lookup file again */
+    int     exists;			/* lstat() succeeded */
+    struct stat st;			/* lstat() result */
+    VSTRING *content;			/* file content, or null */
+} FORWARD_CACHE;
+
+static HTABLE *forward_cache;
+
+#define FORWARD_CACHE_LIMIT	1000	/* max number of files */
+#define FORWARD_CACHE_MAXSIZE	10240	/* max file size */
+
+#define FORWARD_CACHE_SAME_FILE(a, b) \
+	((a)->st_dev == (b)->st_dev && (a)->st_ino == (b)->st_ino \
+	&& (a)->st_size == (b)->st_size && (a)->st_mtime == (b)->st_mtime \
+	&& (a)->st_ctime == (b)->st_ctime && (a)->st_uid == (b)->st_uid \
+	&& (a)->st_mode == (b)->st_mode)
+
+/* forward_cache_free - destroy cache entry */
+
+static void forward_cache_free(void *ptr)
+{
+    FORWARD_CACHE *entry = (FORWARD_CACHE *) ptr;
+
+    if (entry->content)
+	vstring_free(entry->content);
+    myfree((void *) entry);
+}
+
+/* forward_cache_enter - create or replace cache entry */
+
+static FORWARD_CACHE *forward_cache_enter(const char *key, struct stat *st)
+{
+    FORWARD_CACHE *entry;
+
+    if (htable_locate(forward_cache, key) != 0)
+	htable_delete(forward_cache, key, forward_cache_free);
+    else if (forward_cache->used >= FORWARD_CACHE_LIMIT)
+	return (0);
+    entry = (FORWARD_CACHE *) mymalloc(sizeof(*entry));
+    if ((entry->exists = (st != 0)) != 0)
+	entry->st = *st;
+    entry->content = 0;
+    entry->expires = time((time_t *) 0) + var_fwd_cache_ttl;
+    htable_enter(forward_cache, key, (void *) entry);
+    return (entry);
+}
+
+/* forward_cache_lstat - cached lstat_as() */
+
+static int forward_cache_lstat(const char *path, struct stat *st,
+			               USER_ATTR *usr_attr,
+			               FORWARD_CACHE **entryp)
+{
+    static VSTRING *key;
+    FORWARD_CACHE *entry;
+    int     saved_errno;
+
+    *entryp = 0;
+    if (var_fwd_cache_ttl <= 0)
+	return (lstat_as(path, st, usr_attr->uid, usr_attr->gid));
+
+    /*
+     * Use a fresh cache entry without accessing the file system.
+     */
+    if (key == 0)
+	key = vstring_alloc(100);
+    vstring_sprintf(key, "%ld:%s", (long) usr_attr->uid, path);
+    if (forward_cache == 0)
+	forward_cache = htable_create(13);
+    if ((entry = (FORWARD_CACHE *) htable_find(forward_cache, STR(key))) != 0
+	&& time((time_t *) 0) < entry->expires) {
+	if (entry->exists == 0) {
+	    errno = ENOENT;
+	    return (-1);
+	}
+	*st = entry->st;
+	*entryp = entry;
+	return (0);
+    }
+
+    /*
+     * Otherwise, look up the file. Keep the saved content when the file has
+     * not changed. Remember "no such file", but no other errors.
+     */
+    if (lstat_as(path, st, usr_attr->uid, usr_attr->gid) < 0) {
+	saved_errno = errno;
+	if (saved_errno == ENOENT)
+	    (void) forward_cache_enter(STR(key), (struct stat *) 0);
+	else if (entry != 0)
+	    htable_delete(forward_cache, STR(key), forward_cache_free);
+	errno = saved_errno;
+	return (-1);
+    }
+    if (entry != 0 && entry->exists && FORWARD_CACHE_SAME_FILE(&entry->st, st))
+	entry->expires = time((time_t *) 0) + var_fwd_cache_ttl;
+    else
+	entry = forward_cache_enter(STR(key), st);
+    *entryp = entry;
+    return (0);
+}
+
+/* forward_cache_open - open .forward file, or a copy of its saved content */
+
+static VSTREAM *forward_cache_open(const char *path, struct stat *st,
+				           USER_ATTR *usr_attr,
+				           FORWARD_CACHE *entry,
+				           VSTRING **copyp)
+{
+    struct stat fst;
+    int     fd;
+    VSTREAM *fp;
+
+    /*
+     * Read from a private copy; expanding this file may involve recursive
+     * .forward lookups that update the cache.
+     */
+#define FORWARD_CACHE_COPY(entry, copyp) \
+	vstream_memopen(*(copyp) = vstring_memcpy( \
+	    vstring_alloc(VSTRING_LEN((entry)->content) + 1), \
+	    STR((entry)->content), VSTRING_LEN((entry)->content)), O_RDONLY)
+
+    *copyp = 0;
+    if (entry != 0 && entry->content != 0)
+	return (FORWARD_CACHE_COPY(entry, copyp));
+
+    if ((fd = open_as(path, O_RDONLY, 0, usr_attr->uid, usr_attr->gid)) < 0)
+	return (0);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+    fp = vstream_fdopen(fd, O_RDONLY);
+
+    /*
+     * Save the content of a small file that did not change between lstat()
+     * and open().
+     */
+    if (entry != 0 && st->st_size <= FORWARD_CACHE_MAXSIZE
+	&& fstat(fd, &fst) == 0 && FORWARD_CACHE_SAME_FILE(st, &fst)) {
+	entry->content = vstring_alloc(st->st_size + 1);
+	if (vstream_fread_buf(fp, entry->content, st->st_size + 1)
+	    == st->st_size && vstream_ferror(fp) == 0) {
+	    if (vstream_fclose(fp))
+		msg_warn("close file %s: %m", path);
+	    return (FORWARD_CACHE_COPY(entry, copyp));
+	}
+	entry->content = vstring_free(entry->content);
+	if (vstream_fseek(fp, (off_t) 0, SEEK_SET) < 0) {
+	    msg_warn("seek file %s: %m", path);
+	    (void) vstream_fclose(fp);
+	    return (0);
+	}
+    }
+    return (fp);
+}
+
 /* deliver_dotforward - expand contents of .forward file */
 
 int     deliver_dotforward(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
@@ -98,7 +265,8 @@ int     deliver_dotforward(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
     struct stat st;
     VSTRING *path;
     struct mypasswd *mypwd;
-    int     fd;
+    FORWARD_CACHE *cache_entry = 0;
+    VSTRING *copy;
     VSTREAM *fp;
     int     status;
     int     forward_found = NO;
@@ -199,7 +367,7 @@ int     deliver_dotforward(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
 				     var_fwd_exp_filter);
 	if ((expand_status & (MAC_PARSE_ERROR | MAC_PARSE_UNDEF)) == 0) {
 	    lookup_status =
-		lstat_as(STR(path), &st, usr_attr.uid, usr_attr.gid);
+		forward_cache_lstat(STR(path), &st, &usr_attr, &cache_entry);
 	    if (msg_verbose)
 		msg_info("%s: path %s expand_status %d look_status %d", myname,
 			 STR(path), expand_status, lookup_status);
@@ -245,7 +413,8 @@ int     deliver_dotforward(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
 			 STR(path), (long) st.st_uid);
 	    } else if (st.st_mode & 002) {
 		msg_warn("file %s is world writable", STR(path));
-	    } else if ((fd = open_as(STR(path), O_RDONLY, 0, usr_attr.uid, usr_attr.gid)) < 0) {
+	    } else if ((fp = forward_cache_open(STR(path), &st, &usr_attr,
+						cache_entry, &copy)) == 0) {
 		msg_warn("cannot open file %s: %m", STR(path));
 	    } else {
 
@@ -257,9 +426,7 @@ int     deliver_dotforward(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
 		 * propagated to the forwarding addresses, except that any
 		 * SUCCESS keyword is removed.
 		 */
-		close_on_exec(fd, CLOSE_ON_EXEC);
 		addr_count = 0;
-		fp = vstream_fdopen(fd, O_RDONLY);
 		saved_notify = state.msg_attr.rcpt.dsn_notify;
 		state.msg_attr.rcpt.dsn_notify =
 		    (saved_notify == DSN_NOTIFY_SUCCESS ?
@@ -267,6 +434,8 @@ int     deliver_dotforward(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
 		status = deliver_token_stream(state, usr_attr, fp, &addr_count);
 		if (vstream_fclose(fp))
 		    msg_warn("close file %s: %m", STR(path));
+		if (copy)
+		    vstring_free(copy);
 		if (addr_count > 0) {
 		    forward_found = YES;
 		    been_here(state.dup_filter, "forward-done %s", STR(path));
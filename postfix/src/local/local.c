@@ -492,6 +492,11 @@
 /* .IP "\fBlocal_destination_recipient_limit (1)\fR"
 /*	The maximal number of recipients per message delivery via the
 /*	local mail delivery transport.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBlocal_forward_cache_ttl (0s)\fR"
+/*	How long a \fBlocal\fR(8) process remembers the result of a
+/*	\fBforward_path\fR file lookup, including files that do not exist.
 /* SECURITY CONTROLS
 /* .ad
 /* .fi
@@ -688,6 +693,7 @@ char   *var_fbck_transp_maps;
 char   *var_exec_directory;
 char   *var_exec_exp_filter;
 char   *var_forward_path;
+int     var_fwd_cache_ttl;
 char   *var_cmd_exp_filter;
 char   *var_fwd_exp_filter;
 char   *var_prop_extension;
@@ -920,6 +926,7 @@ int     main(int argc, char **argv)
 {
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_COMMAND_MAXTIME, DEF_COMMAND_MAXTIME, &var_command_maxtime, 1, 0,
+	VAR_FWD_CACHE_TTL, DEF_FWD_CACHE_TTL, &var_fwd_cache_ttl, 0, 0,
 	0,
     };
     static const CONFIG_INT_TABLE int_table[] = {
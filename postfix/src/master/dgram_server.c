@@ -202,6 +202,7 @@
 #include <mail_version.h>
 #include <bounce.h>
 #include <maillog_client.h>
+#include <metrics_clnt.h>
 
 /* Process manager. */
 
@@ -628,6 +629,11 @@ NORETURN dgram_server_main(int argc, char **argv, DGRAM_SERVER_FN service,...)
     if (post_init)
 	post_init(dgram_server_name, dgram_server_argv);
 
+    /*
+     * Optional memory accounting reports.
+     */
+    metrics_memory();
+
     /*
      * Running as a semi-resident server. Service requests. Terminate when we
      * have serviced a sufficient number of requests, when no-one has been
@@ -652,6 +658,8 @@ NORETURN dgram_server_main(int argc, char **argv, DGRAM_SERVER_FN service,...)
      */
     while (var_use_limit == 0 || use_count < var_use_limit) {
 	if (dgram_server_lock != 0) {
+	    /* Don't sit on metrics updates while waiting for the lock. */
+	    metrics_flush();
 	    watchdog_stop(watchdog);
 	    if (myflock(vstream_fileno(dgram_server_lock), INTERNAL_LOCK,
 			MYFLOCK_OP_EXCLUSIVE) < 0)
@@ -146,6 +146,21 @@
 /*	(var_max_use * var_max_idle) seconds or some sane constant,
 /*	stop accepting new connections and terminate voluntarily
 /*	when the process becomes idle.
+/* .IP "CA_MAIL_SERVER_CLIENT_LIMIT(int *)"
+/*	Stop accepting new connections while the process serves
+/*	this many clients, and report to the master that the process
+/*	is busy, so that the master will start another process when
+/*	more clients arrive. The process resumes accepting new
+/*	connections when the number of clients drops below the
+/*	limit. Specify a zero value to disable the limit (the
+/*	default). The value is used after command-line and main.cf
+/*	file processing. The limit is ignored when the service is
+/*	configured with a process limit of 1.
+/* .IP "CA_MAIL_SERVER_SOLITARY_STATUS(int *)"
+/*	Store a non-zero value when the service is configured with
+/*	a process limit of 1, and zero otherwise. This is an
+/*	alternative to CA_MAIL_SERVER_SOLITARY for a service that
+/*	can run multiple processes under some conditions only.
 /* .PP
 /*	event_server_disconnect() should be called by the application
 /*	to close a client connection.
@@ -245,6 +260,7 @@
 #include <mail_version.h>
 #include <bounce.h>
 #include <maillog_client.h>
+#include <metrics_clnt.h>
 
 /* Process manager. */
 
@@ -273,6 +289,9 @@ static unsigned event_server_generation;
 static void (*event_server_pre_disconn) (VSTREAM *, char *, char **);
 static void (*event_server_slow_exit) (char *, char **);
 static int event_server_watchdog = 1000;
+static int event_server_client_limit;
+static int event_server_throttled;
+static int event_server_exclusive;	/* exclusive wakeup */
 
 /* event_server_exit - normal termination */
 
@@ -343,6 +362,8 @@ int     event_server_drain(void)
 		msg_warn("%s: dup2(%d, %d): %m", myname, STDIN_FILENO, fd);
 	}
 	var_use_limit = 1;
+	event_server_client_limit = 0;
+	event_server_throttled = 0;
 	return (0);
 	/* Let the master start a new process. */
     default:
@@ -350,16 +371,44 @@ int     event_server_drain(void)
     }
 }
 
+/* event_server_listen - enable connection request events */
+
+static void event_server_listen(void)
+{
+    int     fd;
+
+    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
+	if (event_server_exclusive == 0
+	    || event_enable_read_exclusive(fd, event_server_accept,
+					   CAST_INT_TO_VOID_PTR(fd)) < 0) {
+	    event_server_exclusive = 0;
+	    event_enable_read(fd, event_server_accept, CAST_INT_TO_VOID_PTR(fd));
+	}
+    }
+}
+
 /* event_server_disconnect - terminate client session */
 
 void    event_server_disconnect(VSTREAM *stream)
 {
+    int     fd;
+
     if (msg_verbose)
 	msg_info("connection closed fd %d", vstream_fileno(stream));
     if (event_server_pre_disconn)
 	event_server_pre_disconn(stream, event_server_name, event_server_argv);
     (void) vstream_fclose(stream);
     client_count--;
+
+    /*
+     * Resume accepting connections when we drop below the client limit.
+     */
+    if (event_server_throttled && client_count < event_server_client_limit) {
+	event_server_listen();
+	event_server_throttled = 0;
+	if (master_notify(var_pid, event_server_generation, MASTER_STAT_AVAIL) < 0)
+	    event_server_abort(EVENT_NULL_TYPE, EVENT_NULL_CONTEXT);
+    }
     /* Avoid integer wrap-around in a persistent process.  */
     if (use_count < INT_MAX)
 	use_count++;
@@ -373,6 +422,8 @@ static void event_server_execute(int unused_event, void *context)
 {
     VSTREAM *stream = (VSTREAM *) context;
     HTABLE *attr = (HTABLE *) vstream_context(stream);
+    int     was_throttled = event_server_throttled;
+    int     fd;
 
     if (event_server_lock != 0
 	&& myflock(vstream_fileno(event_server_lock), INTERNAL_LOCK,
@@ -384,10 +435,28 @@ static void event_server_execute(int unused_event, void *context)
      * already accepted client request after "postfix reload"; that would be
      * rude.
      */
-    if (master_notify(var_pid, event_server_generation, MASTER_STAT_TAKEN) < 0)
+    if (was_throttled == 0
+	&& master_notify(var_pid, event_server_generation, MASTER_STAT_TAKEN) < 0)
 	 /* void */ ;
     event_server_service(stream, event_server_name, event_server_argv);
-    if (master_notify(var_pid, event_server_generation, MASTER_STAT_AVAIL) < 0)
+
+    /*
+     * Stop accepting connections when we reach the client limit, and stay
+     * in the "taken" state so that the master will start another process
+     * for new clients. Don't report "available" twice: the master would
+     * panic. That can happen when a client was accepted before we reached
+     * the limit, but its service request was delayed.
+     */
+    if (event_server_client_limit > 0
+	&& client_count >= event_server_client_limit) {
+	if (event_server_throttled == 0) {
+	    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++)
+		event_disable_readwrite(fd);
+	    event_server_throttled = 1;
+	}
+    } else if (was_throttled == 0
+	       && master_notify(var_pid, event_server_generation,
+				MASTER_STAT_AVAIL) < 0)
 	event_server_abort(EVENT_NULL_TYPE, EVENT_NULL_CONTEXT);
     if (attr)
 	htable_free(attr, myfree);
@@ -399,6 +468,7 @@ static void event_server_wakeup(int fd, HTABLE *attr)
 {
     VSTREAM *stream;
     char   *tmp;
+    int     listen_fd;
 
 #if defined(F_DUPFD) && (EVENTS_STYLE != EVENTS_STYLE_SELECT)
 #ifndef THRESHOLD_FD_WORKAROUND
@@ -430,6 +500,22 @@ static void event_server_wakeup(int fd, HTABLE *attr)
 		    CA_VSTREAM_CTL_END);
     myfree(tmp);
     timed_ipc_setup(stream);
+
+    /*
+     * With in_flow_delay, stop accepting connections before the service
+     * request is delayed; otherwise a process would accept any number of
+     * clients while it waits. event_server_execute() won't report "taken"
+     * again.
+     */
+    if (event_server_client_limit > 0 && event_server_throttled == 0
+	&& client_count >= event_server_client_limit) {
+	for (listen_fd = MASTER_LISTEN_FD;
+	     listen_fd < MASTER_LISTEN_FD + socket_count; listen_fd++)
+	    event_disable_readwrite(listen_fd);
+	event_server_throttled = 1;
+	if (master_notify(var_pid, event_server_generation, MASTER_STAT_TAKEN) < 0)
+	     /* void */ ;
+    }
     if (event_server_in_flow_delay && mail_flow_get(1) < 0)
 	event_request_timer(event_server_execute, (void *) stream,
 			    var_in_flow_delay);
@@ -797,6 +883,14 @@ NORETURN event_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
 	case MAIL_SERVER_WATCHDOG:
 	    event_server_watchdog = *va_arg(ap, int *);
 	    break;
+	case MAIL_SERVER_CLIENT_LIMIT:
+	    event_server_client_limit = *va_arg(ap, int *);
+	    if (alone)
+		event_server_client_limit = 0;
+	    break;
+	case MAIL_SERVER_SOLITARY_STATUS:
+	    *va_arg(ap, int *) = alone;
+	    break;
 	case MAIL_SERVER_SLOW_EXIT:
 	    event_server_slow_exit = va_arg(ap, MAIL_SERVER_SLOW_EXIT_FN);
 	    break;
@@ -914,6 +1008,11 @@ NORETURN event_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
     if (post_init)
 	post_init(event_server_name, event_server_argv);
 
+    /*
+     * Optional memory accounting reports.
+     */
+    metrics_memory();
+
     /*
      * Are we running as a one-shot server with the client connection on
      * standard input? If so, make sure the output is written to stdout so as
@@ -939,10 +1038,18 @@ NORETURN event_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
 	event_request_timer(event_server_timeout, (void *) 0, var_idle_limit);
     if (retire_me)
 	event_request_timer(event_server_retire, (void *) 0, retire_me);
-    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
-	event_enable_read(fd, event_server_accept, CAST_INT_TO_VOID_PTR(fd));
-	close_on_exec(fd, CLOSE_ON_EXEC);
+    /*
+     * When the kernel can wake up just one of the processes that wait for a
+     * connection, the lock file is not needed.
+     */
+    event_server_exclusive = (event_server_lock != 0 && var_excl_accept);
+    event_server_listen();
+    if (event_server_exclusive) {
+	(void) vstream_fclose(event_server_lock);
+	event_server_lock = 0;
     }
+    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++)
+	close_on_exec(fd, CLOSE_ON_EXEC);
     event_enable_read(MASTER_STATUS_FD, event_server_abort, (void *) 0);
     close_on_exec(MASTER_STATUS_FD, CLOSE_ON_EXEC);
     close_on_exec(MASTER_FLOW_READ, CLOSE_ON_EXEC);
@@ -954,7 +1061,10 @@ NORETURN event_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
      * The event loop, at last.
      */
     while (var_use_limit == 0 || use_count < var_use_limit || client_count > 0) {
-	if (event_server_lock != 0) {
+	/* Don't hold the accept lock while not accepting connections. */
+	if (event_server_lock != 0 && event_server_throttled == 0) {
+	    /* Don't sit on metrics updates while waiting for the lock. */
+	    metrics_flush();
 	    watchdog_stop(watchdog);
 	    if (myflock(vstream_fileno(event_server_lock), INTERNAL_LOCK,
 			MYFLOCK_OP_EXCLUSIVE) < 0)
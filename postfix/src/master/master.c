@@ -123,6 +123,31 @@
 /* .IP "\fBmaster_service_disable (empty)\fR"
 /*	Selectively disable \fBmaster\fR(8) listener ports by service type
 /*	or by service name and type.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBmaster_stats_file (empty)\fR"
+/*	The name of a file, relative to the queue directory, to which
+/*	the \fBmaster\fR(8) daemon periodically writes per-service
+/*	process management statistics.
+/* .IP "\fBmaster_stats_update_interval (10s)\fR"
+/*	The time between \fBmaster\fR(8) statistics file updates.
+/* .IP "\fBmaster_limit_grow_delay (2s)\fR"
+/*	How long a service with an adaptive process limit must be
+/*	running at its limit before the \fBmaster\fR(8) daemon raises
+/*	the limit.
+/* .IP "\fBmaster_limit_shrink_delay (300s)\fR"
+/*	How long a service must stay below a raised adaptive process
+/*	limit before the \fBmaster\fR(8) daemon lowers the limit.
+/* .IP "\fBmaster_limit_memory_reserve (0)\fR"
+/*	The amount of free physical memory in bytes below which the
+/*	\fBmaster\fR(8) daemon does not raise adaptive process limits.
+/* .IP "\fBmaster_cpu_affinity (empty)\fR"
+/*	Optional CPU sets or NUMA nodes for the processes of specific
+/*	\fBmaster.cf\fR services.
+/* .IP "\fBmaster_incremental_reload (no)\fR"
+/*	When \fBmain.cf\fR has not changed, "\fBpostfix reload\fR"
+/*	replaces only the child processes of services whose
+/*	\fBmaster.cf\fR entry or command file has changed.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -543,6 +568,7 @@ int     main(int argc, char **argv)
      * results when we SIGHUP the server to reload configuration files.
      */
     master_config();
+    master_stats_init();
     master_sigsetup();
     master_flow_init();
     maillog_client_init(mail_task(var_procname),
@@ -585,6 +611,7 @@ int     main(int argc, char **argv)
 	    master_gotsighup = 0;		/* this first */
 	    master_vars_init();			/* then this */
 	    master_refresh();			/* then this */
+	    master_stats_init();
 	    maillog_client_init(mail_task(var_procname),
 				MAILLOG_CLIENT_FLAG_LOGWRITER_FALLBACK);
 	}
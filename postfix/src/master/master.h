@@ -8,6 +8,31 @@
 /* DESCRIPTION
 /* .nf
 
+ /*
+  * System library.
+  */
+#include <sys/time.h>
+
+ /*
+  * Per-service process management statistics, see master_stats(3).
+  */
+typedef struct MASTER_STATS {
+    long    spawned;			/* processes created */
+    long    waits;			/* requests found no process */
+    double  wait_time;			/* total wait for a process */
+    double  wait_max;			/* maximal wait for a process */
+    struct timeval wait_start;		/* request waiting since */
+    long    limit_reached;		/* all busy at process limit */
+    double  limit_time;			/* total time at process limit */
+    struct timeval limit_start;		/* at process limit since */
+    long    exit_ok;			/* normal termination */
+    long    exit_error;			/* non-zero exit status */
+    long    killed;			/* killed by unexpected signal */
+    long    startup_error;		/* died before first request */
+    double  lifetime;			/* total process lifetime */
+    double  lifetime_max;		/* maximal process lifetime */
+} MASTER_STATS;
+
  /*
   * Server processes that provide the same service share a common "listen"
   * socket to accept connection requests, and share a common pipe to the
@@ -42,7 +67,15 @@ typedef struct MASTER_SERV {
 #define MASTER_INET_PORT(s)	((s)->endpoint.inet_ep.port)
     }       endpoint;
     int     max_proc;			/* upper bound on # processes */
+    int     base_proc;			/* configured process limit */
+    int     bound_proc;			/* adaptive process limit bound */
+    double  scale_limit_time;		/* limit time at last grow check */
+    long    scale_limit_count;		/* limit count at last shrink check */
+    int     min_idle;			/* lower bound on # idle processes */
     char   *path;			/* command pathname */
+    dev_t   path_dev;			/* command file identity */
+    ino_t   path_ino;			/* command file identity */
+    time_t  path_mtime;			/* command file identity */
     struct ARGV *args;			/* argument vector */
     char   *stress_param_val;		/* stress value: "yes" or empty */
     time_t  stress_expire_time;		/* stress pulse stretcher */
@@ -51,6 +84,8 @@ typedef struct MASTER_SERV {
     int     throttle_delay;		/* failure recovery parameter */
     int     status_fd[2];		/* child status reports */
     struct BINHASH *children;		/* linkage */
+    MASTER_STATS stats;			/* process management statistics */
+    struct MASTER_AFFINITY *affinity;	/* CPU placement */
     struct MASTER_SERV *next;		/* linkage */
 } MASTER_SERV;
 
@@ -65,6 +100,8 @@ typedef struct MASTER_SERV {
 #define MASTER_FLAG_INETHOST	(1<<3)	/* endpoint name specifies host */
 #define MASTER_FLAG_LOCAL_ONLY	(1<<4)	/* no remote clients */
 #define MASTER_FLAG_LISTEN	(1<<5)	/* monitor this port */
+#define MASTER_FLAG_GROW	(1<<6)	/* limit grow check pending */
+#define MASTER_FLAG_SHRINK	(1<<7)	/* limit shrink check pending */
 
 #define MASTER_THROTTLED(f)	((f)->flags & MASTER_FLAG_THROTTLE)
 #define MASTER_MARKED_FOR_DELETION(f) ((f)->flags & MASTER_FLAG_MARK)
@@ -99,6 +136,7 @@ typedef struct MASTER_PROC {
     int     avail;			/* availability */
     MASTER_SERV *serv;			/* parent linkage */
     int     use_count;			/* number of service requests */
+    struct timeval start_time;		/* process creation time */
 } MASTER_PROC;
 
  /*
@@ -132,6 +170,23 @@ extern void master_refresh(void);
   * master_vars.c
   */
 extern void master_vars_init(void);
+extern int master_conf_snap_fd;
+extern int master_main_cf_changed;
+
+ /*
+  * master_stats.c
+  */
+extern void master_stats_init(void);
+extern double master_stats_since(struct timeval *);
+
+ /*
+  * master_affinity.c
+  */
+typedef struct MASTER_AFFINITY MASTER_AFFINITY;
+extern MASTER_AFFINITY *master_affinity_create(const char *);
+extern void master_affinity_apply(MASTER_AFFINITY *);
+extern void master_affinity_next(MASTER_AFFINITY *);
+extern void master_affinity_free(MASTER_AFFINITY *);
 
  /*
   * master_service.c
@@ -140,6 +195,7 @@ extern MASTER_SERV *master_head;
 extern void master_start_service(MASTER_SERV *);
 extern void master_stop_service(MASTER_SERV *);
 extern void master_restart_service(MASTER_SERV *, int);
+extern void master_update_service(MASTER_SERV *);
 
 #define DO_CONF_RELOAD	1	/* config files were reloaded */
 #define NO_CONF_RELOAD	0	/* no config file was reloaded */
@@ -0,0 +1,262 @@
+/*++
+/* NAME
+/*	master_affinity 3
+/* SUMMARY
+/*	Postfix master - CPU placement of child processes
+/* SYNOPSIS
+/*	#include "master.h"
+/*
+/*	MASTER_AFFINITY *master_affinity_create(service)
+/*	const char *service;
+/*
+/*	void	master_affinity_apply(affinity)
+/*	MASTER_AFFINITY *affinity;
+/*
+/*	void	master_affinity_next(affinity)
+/*	MASTER_AFFINITY *affinity;
+/*
+/*	void	master_affinity_free(affinity)
+/*	MASTER_AFFINITY *affinity;
+/* DESCRIPTION
+/*	This module restricts the child processes of a service to
+/*	the CPU sets specified with the master_cpu_affinity parameter.
+/*	That parameter specifies zero or more \fIservice/type=sets\fR
+/*	entries separated by whitespace, where \fIsets\fR is one or
+/*	more CPU sets separated by ":". A CPU set is either a list
+/*	of CPU numbers and ranges in Linux "cpulist" form (for
+/*	example, 0-3,8-11), or \fBnode\fIN\fR for the CPUs of NUMA
+/*	node \fIN\fR. When a service has multiple CPU sets, its child
+/*	processes are distributed round-robin over those sets.
+/*
+/*	master_affinity_create() looks up the CPU sets for the
+/*	specified \fIname/type\fR service, and returns a null pointer
+/*	when there are none, or when the system does not support
+/*	CPU affinity.
+/*
+/*	master_affinity_apply() is called by a child process before
+/*	it executes the service command. It restricts the calling
+/*	process to the current CPU set. A null argument is allowed
+/*	and has no effect.
+/*
+/*	master_affinity_next() is called by the parent after creating
+/*	a child process, and selects the CPU set for the next child
+/*	process. A null argument is allowed and has no effect.
+/*
+/*	master_affinity_free() destroys the result from
+/*	master_affinity_create(). A null argument is allowed and
+/*	has no effect.
+/* DIAGNOSTICS
+/*	Warnings: invalid master_cpu_affinity entries, unknown NUMA
+/*	nodes, no CPU affinity support. Such entries are ignored.
+/* BUGS
+/*	Round-robin placement does not account for differences in
+/*	child process lifetime.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#define _GNU_SOURCE			/* sched_setaffinity(), CPU_SET() */
+#include <sys_defs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#ifdef HAS_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <vstring_vstream.h>
+#include <stringops.h>
+#include <split_at.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+
+/* Application-specific. */
+
+#include "master.h"
+
+#ifdef HAS_SCHED_SETAFFINITY
+
+struct MASTER_AFFINITY {
+    int     count;			/* number of CPU sets */
+    int     next;			/* set for the next child */
+    cpu_set_t *sets;			/* CPU sets */
+};
+
+#define MASTER_AFFINITY_NODE_PATH "/sys/devices/system/node/node%s/cpulist"
+
+/* master_affinity_cpulist - parse CPU numbers and ranges */
+
+static int master_affinity_cpulist(const char *list, cpu_set_t *set)
+{
+    char   *saved_list;
+    char   *bp;
+    char   *range;
+    char   *hi;
+    int     lo_cpu;
+    int     hi_cpu;
+    int     ok = 1;
+
+    CPU_ZERO(set);
+    bp = saved_list = mystrdup(list);
+    while (ok && (range = mystrtok(&bp, ", \t\r\n")) != 0) {
+	if ((hi = strchr(range, '-')) != 0)
+	    *hi++ = 0;
+	else
+	    hi = range;
+	if (!alldig(range) || !alldig(hi)
+	    || (lo_cpu = atoi(range)) >= CPU_SETSIZE
+	    || (hi_cpu = atoi(hi)) >= CPU_SETSIZE || lo_cpu > hi_cpu) {
+	    ok = 0;
+	} else {
+	    while (lo_cpu <= hi_cpu)
+		CPU_SET(lo_cpu++, set);
+	}
+    }
+    myfree(saved_list);
+    return (ok && CPU_COUNT(set) > 0);
+}
+
+/* master_affinity_node - look up CPUs of NUMA node */
+
+static int master_affinity_node(const char *node, cpu_set_t *set)
+{
+    VSTRING *buf;
+    VSTREAM *fp;
+    int     ok;
+
+    if (*node == 0 || !alldig(node))
+	return (0);
+    buf = vstring_alloc(100);
+    vstring_sprintf(buf, MASTER_AFFINITY_NODE_PATH, node);
+    if ((fp = vstream_fopen(vstring_str(buf), O_RDONLY, 0)) == 0) {
+	msg_warn("open %s: %m", vstring_str(buf));
+	ok = 0;
+    } else {
+	ok = (vstring_get_nonl(buf, fp) != VSTREAM_EOF
+	      && master_affinity_cpulist(vstring_str(buf), set));
+	(void) vstream_fclose(fp);
+    }
+    vstring_free(buf);
+    return (ok);
+}
+
+/* master_affinity_parse - parse one or more CPU sets */
+
+static MASTER_AFFINITY *master_affinity_parse(const char *service,
+					              char *sets)
+{
+    MASTER_AFFINITY *aff;
+    char   *cp;
+    int     ok;
+
+    aff = (MASTER_AFFINITY *) mymalloc(sizeof(*aff));
+    aff->count = 0;
+    aff->next = 0;
+    aff->sets = (cpu_set_t *) mymalloc(sizeof(cpu_set_t)
+				       * (1 + strlen(sets) / 2));
+    while ((cp = mystrtok(&sets, ":")) != 0) {
+	if (strncasecmp(cp, "node", 4) == 0)
+	    ok = master_affinity_node(cp + 4, aff->sets + aff->count);
+	else
+	    ok = master_affinity_cpulist(cp, aff->sets + aff->count);
+	if (ok == 0) {
+	    msg_warn("%s: ignoring invalid CPU set \"%s\" for service %s",
+		     VAR_MASTER_CPU_AFFINITY, cp, service);
+	    master_affinity_free(aff);
+	    return (0);
+	}
+	aff->count += 1;
+    }
+    if (aff->count == 0) {
+	master_affinity_free(aff);
+	return (0);
+    }
+    return (aff);
+}
+
+#endif
+
+/* master_affinity_create - look up service CPU sets */
+
+MASTER_AFFINITY *master_affinity_create(const char *service)
+{
+    MASTER_AFFINITY *aff = 0;
+    char   *saved_entries;
+    char   *bp;
+    char   *entry;
+    char   *sets;
+
+    if (*var_master_cpu_affinity == 0)
+	return (0);
+
+    /*
+     * Use the last matching entry, like other Postfix service lists.
+     */
+    bp = saved_entries = mystrdup(var_master_cpu_affinity);
+    while ((entry = mystrtok(&bp, CHARS_SPACE)) != 0) {
+	sets = split_at(entry, '=');
+	if (strcmp(entry, service) != 0)
+	    continue;
+	if (sets == 0 || *sets == 0) {
+	    msg_warn("%s: ignoring entry \"%s\" without CPU set",
+		     VAR_MASTER_CPU_AFFINITY, entry);
+	    continue;
+	}
+#ifdef HAS_SCHED_SETAFFINITY
+	if (aff)
+	    master_affinity_free(aff);
+	aff = master_affinity_parse(service, sets);
+#else
+	msg_warn("%s: CPU affinity is not supported on this system",
+		 VAR_MASTER_CPU_AFFINITY);
+#endif
+    }
+    myfree(saved_entries);
+    return (aff);
+}
+
+/* master_affinity_apply - restrict this process to the current CPU set */
+
+void    master_affinity_apply(MASTER_AFFINITY *aff)
+{
+#ifdef HAS_SCHED_SETAFFINITY
+    if (aff != 0
+	&& sched_setaffinity(0, sizeof(cpu_set_t), aff->sets + aff->next) < 0)
+	msg_warn("sched_setaffinity: %m");
+#endif
+}
+
+/* master_affinity_next - select the CPU set for the next child */
+
+void    master_affinity_next(MASTER_AFFINITY *aff)
+{
+#ifdef HAS_SCHED_SETAFFINITY
+    if (aff != 0 && ++aff->next >= aff->count)
+	aff->next = 0;
+#endif
+}
+
+/* master_affinity_free - destroy service CPU sets */
+
+void    master_affinity_free(MASTER_AFFINITY *aff)
+{
+#ifdef HAS_SCHED_SETAFFINITY
+    if (aff != 0) {
+	myfree((void *) aff->sets);
+	myfree((void *) aff);
+    }
+#endif
+}
@@ -31,6 +31,24 @@
 /*	servers are asked to restart at their convenience, and new
 /*	servers are created with stress mode enabled.
 /*
+/*	When the service has a process minimum (master.cf process
+/*	limit field of the form \fIlimit/minimum\fR), this module
+/*	also creates processes ahead of demand, until that many
+/*	processes are available or the process limit is reached.
+/*	Processes that terminate after max_idle or max_use are
+/*	replaced in the same manner.
+/*
+/*	When the service has an adaptive process limit (master.cf
+/*	process limit field of the form \fIlimit\fR:\fImaximum\fR),
+/*	this module raises the effective process limit by 25%, up
+/*	to the maximum, when all processes were busy at the limit
+/*	for at least half of $master_limit_grow_delay, and while the
+/*	free physical memory exceeds $master_limit_memory_reserve.
+/*	It lowers the effective limit again, down to the configured
+/*	limit, after $master_limit_shrink_delay without reaching the
+/*	effective limit. Lowering the limit does not terminate
+/*	processes; they terminate after $max_idle or $max_use.
+/*
 /*	master_avail_listen() ensures that someone monitors the service's
 /*	listen socket for connection requests (as long as resources
 /*	to handle connection requests are available).  This function may
@@ -40,7 +58,7 @@
 /*
 /*	master_avail_cleanup() should be called when the named service
 /*	is taken out of operation. It terminates child processes by
-/*	sending SIGTERM.
+/*	sending SIGTERM, and cancels pending process creation.
 /*
 /*	master_avail_more() should be called when the named process
 /*	has become available for servicing new connection requests.
@@ -70,17 +88,117 @@
 /* System libraries. */
 
 #include <sys_defs.h>
+#include <unistd.h>
 
 /* Utility library. */
 
 #include <events.h>
 #include <msg.h>
 
+/* Global library. */
+
+#include <mail_params.h>
+
 /* Application-specific. */
 
 #include "master_proto.h"
 #include "master.h"
 
+/* master_avail_limit_time - time at process limit */
+
+static double master_avail_limit_time(MASTER_SERV *serv)
+{
+    return (serv->stats.limit_time + (serv->stats.limit_start.tv_sec ?
+			     master_stats_since(&serv->stats.limit_start) : 0));
+}
+
+/* master_avail_memory_ok - enough memory for more processes */
+
+static int master_avail_memory_ok(void)
+{
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+    long    pages;
+    long    page_size;
+
+    if (var_limit_mem_reserve > 0
+	&& (pages = sysconf(_SC_AVPHYS_PAGES)) > 0
+	&& (page_size = sysconf(_SC_PAGESIZE)) > 0
+	&& pages < var_limit_mem_reserve / page_size)
+	return (0);
+#endif
+    return (1);
+}
+
+/* master_avail_shrink - lower adaptive process limit */
+
+static void master_avail_shrink(int unused_event, void *context)
+{
+    MASTER_SERV *serv = (MASTER_SERV *) context;
+    int     limit;
+
+    /*
+     * Lower the limit when the service did not reach it since the last
+     * check. Don't terminate processes; they will go away when idle.
+     */
+    serv->flags &= ~MASTER_FLAG_SHRINK;
+    if (serv->max_proc > serv->base_proc
+	&& serv->stats.limit_reached == serv->scale_limit_count
+	&& serv->stats.limit_start.tv_sec == 0) {
+	limit = serv->max_proc - (serv->max_proc + 4) / 5;
+	if (limit < serv->base_proc)
+	    limit = serv->base_proc;
+	msg_info("service \"%s\" (%s): lowering process limit from %d to %d",
+		 serv->ext_name, serv->name, serv->max_proc, limit);
+	serv->max_proc = limit;
+	master_avail_listen(serv);
+    }
+    if (serv->max_proc > serv->base_proc) {
+	serv->flags |= MASTER_FLAG_SHRINK;
+	serv->scale_limit_count = serv->stats.limit_reached;
+	event_request_timer(master_avail_shrink, (void *) serv,
+			    var_limit_shrink_delay);
+    }
+}
+
+/* master_avail_grow - raise adaptive process limit */
+
+static void master_avail_grow(int unused_event, void *context)
+{
+    MASTER_SERV *serv = (MASTER_SERV *) context;
+    double  busy;
+    int     limit;
+
+    /*
+     * Raise the limit when clients had to wait for a process for at least
+     * half the time since the service reached its limit.
+     */
+    serv->flags &= ~MASTER_FLAG_GROW;
+    busy = master_avail_limit_time(serv) - serv->scale_limit_time;
+    if (!MASTER_THROTTLED(serv) && serv->max_proc < serv->bound_proc
+	&& busy >= var_limit_grow_delay / 2.0) {
+	if (master_avail_memory_ok() == 0) {
+	    msg_warn("service \"%s\" (%s): not raising process limit %d: "
+		     "free memory is below %s", serv->ext_name, serv->name,
+		     serv->max_proc, VAR_LIMIT_MEM_RESERVE);
+	} else {
+	    limit = serv->max_proc + (serv->max_proc + 3) / 4;
+	    if (limit > serv->bound_proc)
+		limit = serv->bound_proc;
+	    msg_info("service \"%s\" (%s): raising process limit from %d to %d",
+		     serv->ext_name, serv->name, serv->max_proc, limit);
+	    serv->max_proc = limit;
+	    if ((serv->flags & MASTER_FLAG_SHRINK) == 0) {
+		serv->flags |= MASTER_FLAG_SHRINK;
+		event_request_timer(master_avail_shrink, (void *) serv,
+				    var_limit_shrink_delay);
+	    }
+	}
+    }
+    /* Prevent an immediate shrink, and check again if still at the limit. */
+    serv->scale_limit_count = serv->stats.limit_reached - 1;
+    master_avail_listen(serv);
+}
+
 /* master_avail_event - create child process to handle connection request */
 
 static void master_avail_event(int event, void *context)
@@ -108,6 +226,9 @@ static void master_avail_event(int event, void *context)
 	 * the proper serv->stress_param_val value when exec-ing a server
 	 * process.
 	 */
+	serv->stats.waits++;
+	if (serv->stats.wait_start.tv_sec == 0)
+	    GETTIMEOFDAY(&serv->stats.wait_start);
 	if (serv->stress_param_val != 0
 	    && !MASTER_LIMIT_OK(serv->max_proc, serv->total_proc + 1)) {
 	    now = event_time();
@@ -119,12 +240,30 @@ static void master_avail_event(int event, void *context)
     }
 }
 
+/* master_avail_prefork - create child process ahead of demand */
+
+static void master_avail_prefork(int unused_event, void *context)
+{
+    MASTER_SERV *serv = (MASTER_SERV *) context;
+
+    /*
+     * Things may have changed since this request was made. Creating one
+     * process results in a master_avail_more() call, which requests another
+     * process if needed. Thus, process creation is spread out over multiple
+     * event loop iterations, instead of happening all at once.
+     */
+    if (!MASTER_THROTTLED(serv) && serv->avail_proc < serv->min_idle
+	&& MASTER_LIMIT_OK(serv->max_proc, serv->total_proc))
+	master_spawn(serv);
+}
+
 /* master_avail_listen - enforce the socket monitoring policy */
 
 void    master_avail_listen(MASTER_SERV *serv)
 {
     const char *myname = "master_avail_listen";
     int     listen_flag;
+    int     at_limit;
     time_t  now;
     int     n;
 
@@ -162,6 +301,40 @@ void    master_avail_listen(MASTER_SERV *serv)
 	    }
 	}
     }
+    /*
+     * Account for the time that all processes are busy at the process limit.
+     */
+    at_limit = (!MASTER_THROTTLED(serv) && serv->avail_proc == 0
+		&& !MASTER_LIMIT_OK(serv->max_proc, serv->total_proc));
+    if (at_limit && serv->stats.limit_start.tv_sec == 0) {
+	serv->stats.limit_reached++;
+	GETTIMEOFDAY(&serv->stats.limit_start);
+    } else if (!at_limit && serv->stats.limit_start.tv_sec != 0) {
+	serv->stats.limit_time += master_stats_since(&serv->stats.limit_start);
+	serv->stats.limit_start.tv_sec = 0;
+    }
+
+    /*
+     * With an adaptive process limit, find out later if clients are waiting
+     * for a process. We can't change the limit here; see the caution above.
+     */
+    if (at_limit && serv->max_proc < serv->bound_proc
+	&& (serv->flags & MASTER_FLAG_GROW) == 0) {
+	serv->flags |= MASTER_FLAG_GROW;
+	serv->scale_limit_time = master_avail_limit_time(serv);
+	event_request_timer(master_avail_grow, (void *) serv,
+			    var_limit_grow_delay);
+    }
+
+    /*
+     * Keep a minimum number of initialized processes available, so that
+     * clients don't have to wait for process creation and initialization.
+     * We can't call master_spawn() here; see the caution above.
+     */
+    if (!MASTER_THROTTLED(serv) && serv->avail_proc < serv->min_idle
+	&& MASTER_LIMIT_OK(serv->max_proc, serv->total_proc))
+	event_request_timer(master_avail_prefork, (void *) serv, 0);
+
     if (listen_flag && !MASTER_LISTENING(serv)) {
 	if (msg_verbose)
 	    msg_info("%s: enable events %s", myname, serv->name);
@@ -186,6 +359,10 @@ void    master_avail_cleanup(MASTER_SERV *serv)
 
     master_delete_children(serv);		/* XXX calls
 						 * master_avail_listen */
+    event_cancel_timer(master_avail_prefork, (void *) serv);
+    event_cancel_timer(master_avail_grow, (void *) serv);
+    event_cancel_timer(master_avail_shrink, (void *) serv);
+    serv->flags &= ~(MASTER_FLAG_GROW | MASTER_FLAG_SHRINK);
 
     /*
      * This code is redundant because master_delete_children() throttles the
@@ -230,6 +407,7 @@ void    master_avail_more(MASTER_SERV *serv, MASTER_PROC *proc)
 void    master_avail_less(MASTER_SERV *serv, MASTER_PROC *proc)
 {
     const char *myname = "master_avail_less";
+    double  wait_time;
 
     /*
      * Caution: several other master_XXX modules call master_avail_listen(),
@@ -247,5 +425,16 @@ void    master_avail_less(MASTER_SERV *serv, MASTER_PROC *proc)
 	msg_panic("%s: process not available", myname);
     serv->avail_proc--;
     proc->avail = MASTER_STAT_TAKEN;
+
+    /*
+     * A process has picked up the request that found no process available.
+     */
+    if (serv->stats.wait_start.tv_sec != 0) {
+	wait_time = master_stats_since(&serv->stats.wait_start);
+	serv->stats.wait_time += wait_time;
+	if (wait_time > serv->stats.wait_max)
+	    serv->stats.wait_max = wait_time;
+	serv->stats.wait_start.tv_sec = 0;
+    }
     master_avail_listen(serv);
 }
@@ -17,6 +17,12 @@
 /*
 /*	Use master_refresh() to re-read the master.cf configuration file
 /*	when the process is already running.
+/*
+/*	By default, a reload makes the child processes of all existing
+/*	services terminate at their convenience. With
+/*	master_incremental_reload enabled, and when main.cf did not
+/*	change, a reload makes only the child processes terminate
+/*	of services whose master.cf entry or command file changed.
 /* DIAGNOSTICS
 /* BUGS
 /* SEE ALSO
@@ -48,6 +54,10 @@
 #include <msg.h>
 #include <argv.h>
 
+/* Global library. */
+
+#include <mail_params.h>
+
 /* Application-specific. */
 
 #include "master.h"
@@ -87,12 +97,44 @@ void    master_refresh(void)
     }
 }
 
+/* master_ent_changed - child processes need the new master.cf entry */
+
+static int master_ent_changed(MASTER_SERV *serv, MASTER_SERV *entry)
+{
+    int     n;
+
+    if (strcmp(serv->path, entry->path) != 0
+	|| serv->path_dev != entry->path_dev
+	|| serv->path_ino != entry->path_ino
+	|| serv->path_mtime != entry->path_mtime
+	|| serv->args->argc != entry->args->argc)
+	return (1);
+
+    /*
+     * The stress=value argument is updated in place by the master, and is
+     * the same for both entries when the other arguments are the same.
+     */
+    for (n = 0; n < serv->args->argc; n++) {
+	if (serv->stress_param_val != 0 && entry->stress_param_val != 0
+	    && serv->stress_param_val == serv->args->argv[n]
+	    + sizeof("stress=") - 1
+	    && entry->stress_param_val == entry->args->argv[n]
+	    + sizeof("stress=") - 1)
+	    continue;
+	if (strcmp(serv->args->argv[n], entry->args->argv[n]) != 0)
+	    return (1);
+    }
+    return (0);
+}
+
 /* master_config - read config file */
 
 void    master_config(void)
 {
     MASTER_SERV *entry;
     MASTER_SERV *serv;
+    int     changed;
+    int     kept = 0;
 
 #define STR_DIFF	strcmp
 #define STR_SAME	!strcmp
@@ -137,16 +179,38 @@ void    master_config(void)
 		serv->flags |= MASTER_FLAG_CONDWAKE;
 	    else
 		serv->flags &= ~MASTER_FLAG_CONDWAKE;
+	    changed = (var_master_incr_reload == 0 || master_main_cf_changed
+		       || master_ent_changed(serv, entry));
 	    serv->wakeup_time = entry->wakeup_time;
-	    serv->max_proc = entry->max_proc;
+	    /* Keep an adaptive limit that is still within bounds. */
+	    if (entry->bound_proc == 0 || serv->bound_proc == 0
+		|| serv->max_proc < entry->base_proc)
+		serv->max_proc = entry->base_proc;
+	    else if (serv->max_proc > entry->bound_proc)
+		serv->max_proc = entry->bound_proc;
+	    serv->base_proc = entry->base_proc;
+	    serv->bound_proc = entry->bound_proc;
+	    serv->min_idle = entry->min_idle;
 	    serv->throttle_delay = entry->throttle_delay;
 	    SWAP(char *, serv->ext_name, entry->ext_name);
 	    SWAP(char *, serv->path, entry->path);
 	    SWAP(ARGV *, serv->args, entry->args);
+	    SWAP(MASTER_AFFINITY *, serv->affinity, entry->affinity);
 	    SWAP(char *, serv->stress_param_val, entry->stress_param_val);
-	    master_restart_service(serv, DO_CONF_RELOAD);
+	    if (changed) {
+		master_restart_service(serv, DO_CONF_RELOAD);
+	    } else {
+		if (msg_verbose)
+		    msg_info("keeping child processes for unchanged service "
+			     "\"%s\" (%s)", serv->ext_name, serv->name);
+		master_update_service(serv);
+		kept += 1;
+	    }
 	    free_master_ent(entry);
 	}
     }
     end_master_ent();
+    if (kept > 0)
+	msg_info("incremental reload: kept the child processes of "
+		 "%d unchanged service%s", kept, kept > 1 ? "s" : "");
 }
@@ -67,6 +67,7 @@
 /* System libraries. */
 
 #include <sys_defs.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <stdarg.h>
 #include <string.h>
@@ -264,6 +265,7 @@ MASTER_SERV *get_master_ent()
     VSTRING *buf = vstring_alloc(100);
     VSTRING *junk = vstring_alloc(100);
     MASTER_SERV *serv;
+    struct stat st;
     char   *cp;
     char   *name;
     char   *host = 0;
@@ -273,6 +275,8 @@ MASTER_SERV *get_master_ent()
     int     unprivileged;		/* passed on to child */
     int     chroot;			/* passed on to child */
     char   *command;
+    char   *idle;
+    char   *bound;
     int     n;
     char   *bufp;
     char   *atmp;
@@ -325,6 +329,7 @@ MASTER_SERV *get_master_ent()
      */
     serv = (MASTER_SERV *) mymalloc(sizeof(MASTER_SERV));
     serv->next = 0;
+    serv->affinity = master_affinity_create(vstring_str(junk));
 
     /*
      * Flags member.
@@ -336,6 +341,11 @@ MASTER_SERV *get_master_ent()
      */
     serv->busy_warn_time = 0;
 
+    /*
+     * Process management statistics.
+     */
+    memset((void *) &serv->stats, 0, sizeof(serv->stats));
+
     /*
      * Service name. Syntax is transport-specific.
      */
@@ -515,10 +525,42 @@ MASTER_SERV *get_master_ent()
 	serv->flags |= MASTER_FLAG_CONDWAKE;
 
     /*
-     * Concurrency limit. Zero means no limit.
+     * Concurrency limit. Zero means no limit. An optional "/number" suffix
+     * specifies how many initialized processes to keep available. An
+     * optional ":number" suffix after the limit specifies how far the limit
+     * may grow while clients wait for a process.
      */
     vstring_sprintf(junk, "%d", var_proc_limit);
-    serv->max_proc = get_int_ent(&bufp, "max_proc", vstring_str(junk), 0);
+    cp = get_str_ent(&bufp, "max_proc", vstring_str(junk));
+    if ((idle = strchr(cp, '/')) != 0) {
+	*idle++ = 0;
+	if (!ISDIGIT(*idle) || idle[strspn(idle, "0123456789")] != 0)
+	    fatal_invalid_field("max_proc", idle);
+	serv->min_idle = atoi(idle);
+    } else {
+	serv->min_idle = 0;
+    }
+    if ((bound = strchr(cp, ':')) != 0) {
+	*bound++ = 0;
+	if (!ISDIGIT(*bound) || bound[strspn(bound, "0123456789")] != 0)
+	    fatal_invalid_field("max_proc", bound);
+	serv->bound_proc = atoi(bound);
+    } else {
+	serv->bound_proc = 0;
+    }
+    if (strcmp(cp, "-") == 0)
+	cp = vstring_str(junk);
+    if (!ISDIGIT(*cp) || cp[strspn(cp, "0123456789")] != 0)
+	fatal_invalid_field("max_proc", cp);
+    serv->max_proc = serv->base_proc = atoi(cp);
+    if (serv->max_proc > 0 && serv->min_idle > serv->max_proc)
+	fatal_with_context("process minimum %d exceeds process limit %d",
+			   serv->min_idle, serv->max_proc);
+    if (serv->bound_proc > 0
+	&& (serv->max_proc < 2 || serv->bound_proc <= serv->max_proc))
+	fatal_with_context("adaptive process limit %d:%d requires "
+			   "1 < limit < maximum",
+			   serv->max_proc, serv->bound_proc);
 
     /*
      * Path to command,
@@ -526,6 +568,20 @@ MASTER_SERV *get_master_ent()
     command = get_str_ent(&bufp, "command", (char *) 0);
     serv->path = concatenate(var_daemon_dir, "/", command, (char *) 0);
 
+    /*
+     * Command file identity, so that a reload can tell whether running
+     * processes use an outdated program file.
+     */
+    if (stat(serv->path, &st) == 0) {
+	serv->path_dev = st.st_dev;
+	serv->path_ino = st.st_ino;
+	serv->path_mtime = st.st_mtime;
+    } else {
+	serv->path_dev = 0;
+	serv->path_ino = 0;
+	serv->path_mtime = 0;
+    }
+
     /*
      * Idle and total process count.
      */
@@ -617,6 +673,8 @@ void    print_master_ent(MASTER_SERV *serv)
     msg_info("listen_fd_count: %d", serv->listen_fd_count);
     msg_info("wakeup: %d", serv->wakeup_time);
     msg_info("max_proc: %d", serv->max_proc);
+    msg_info("bound_proc: %d", serv->bound_proc);
+    msg_info("min_idle: %d", serv->min_idle);
     msg_info("path: %s", serv->path);
     for (cpp = serv->args->argv; *cpp; cpp++)
 	msg_info("arg[%d]: %s", (int) (cpp - serv->args->argv), *cpp);
@@ -647,6 +705,7 @@ void    free_master_ent(MASTER_SERV *serv)
     myfree(serv->name);
     myfree(serv->path);
     argv_free(serv->args);
+    master_affinity_free(serv->affinity);
     myfree((void *) serv->listen_fd);
     myfree((void *) serv);
 }
@@ -15,6 +15,9 @@
 /*	void	master_restart_service(serv, conf_reload)
 /*	MASTER_SERV *serv;
 /*	int	conf_reload;
+/*
+/*	void	master_update_service(serv)
+/*	MASTER_SERV *serv;
 /* DESCRIPTION
 /*	master_start_service() enables the named service.
 /*
@@ -24,6 +27,12 @@
 /*	commit suicide.  The conf_reload argument is either DO_CONF_RELOAD
 /*	(configuration files were reloaded, re-evaluate the child process
 /*	creation policy) or NO_CONF_RELOAD. 
+/*
+/*	master_update_service() re-evaluates the wakeup timer and
+/*	the child process creation policy after a configuration
+/*	reload, without disturbing running child processes. This
+/*	is used for services whose child processes are not affected
+/*	by the configuration change.
 /* DIAGNOSTICS
 /* BUGS
 /* SEE ALSO
@@ -111,3 +120,17 @@ void    master_restart_service(MASTER_SERV *serv, int conf_reload)
     if (conf_reload)
 	master_avail_listen(serv);
 }
+
+/* master_update_service - update service after configuration reload */
+
+void    master_update_service(MASTER_SERV *serv)
+{
+
+    /*
+     * Keep the status channel, so that running child processes stay in the
+     * current generation. Pick up wakeup time and process limit changes.
+     */
+    master_wakeup_cleanup(serv);
+    master_wakeup_init(serv);
+    master_avail_listen(serv);
+}
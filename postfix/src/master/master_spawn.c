@@ -22,7 +22,8 @@
 /*	master_spawn() spawns off a child process for the specified service,
 /*	making the child process available for servicing connection requests.
 /*	It is an error to call this function then the specified service is
-/*	throttled.
+/*	throttled, or when it already has as many available processes as
+/*	its process minimum (or at least one).
 /*
 /*	master_reap_child() cleans up all dead child processes.  One typically
 /*	runs this function at a convenient moment after receiving a SIGCHLD
@@ -69,6 +70,7 @@
 #include <events.h>
 #include <vstring.h>
 #include <argv.h>
+#include <iostuff.h>
 
 /* Global library. */
 
@@ -144,11 +146,14 @@ void    master_spawn(MASTER_SERV *serv)
     int     n;
     static unsigned master_generation = 0;
     static VSTRING *env_gen = 0;
+    static VSTRING *env_snap = 0;
 
     if (master_child_table == 0)
 	master_child_table = binhash_create(0);
     if (env_gen == 0)
 	env_gen = vstring_alloc(100);
+    if (env_snap == 0)
+	env_snap = vstring_alloc(100);
 
     /*
      * Sanity checks. The master_avail module is supposed to know what it is
@@ -156,7 +161,7 @@ void    master_spawn(MASTER_SERV *serv)
      */
     if (!MASTER_LIMIT_OK(serv->max_proc, serv->total_proc))
 	msg_panic("%s: at process limit %d", myname, serv->total_proc);
-    if (serv->avail_proc > 0)
+    if (serv->avail_proc > 0 && serv->avail_proc >= serv->min_idle)
 	msg_panic("%s: processes available: %d", myname, serv->avail_proc);
     if (serv->flags & MASTER_FLAG_THROTTLE)
 	msg_panic("%s: throttled service: %s", myname, serv->path);
@@ -225,8 +230,16 @@ void    master_spawn(MASTER_SERV *serv)
 	vstring_sprintf(env_gen, "%s=%o", MASTER_GEN_NAME, master_generation);
 	if (putenv(vstring_str(env_gen)) < 0)
 	    msg_fatal("%s: putenv: %m", myname);
+	if (master_conf_snap_fd >= 0) {
+	    close_on_exec(master_conf_snap_fd, PASS_ON_EXEC);
+	    vstring_sprintf(env_snap, "%s=%d", CONF_ENV_SNAP,
+			    master_conf_snap_fd);
+	    if (putenv(vstring_str(env_snap)) < 0)
+		msg_fatal("%s: putenv: %m", myname);
+	}
 	if (serv->stress_param_val && serv->stress_expire_time > event_time())
 	    serv->stress_param_val[0] = CONFIG_BOOL_YES[0];
+	master_affinity_apply(serv->affinity);
 
 	execvp(serv->path, serv->args->argv);
 	msg_fatal("%s: exec %s: %m", myname, serv->path);
@@ -247,6 +260,9 @@ void    master_spawn(MASTER_SERV *serv)
 	proc->gen = master_generation;
 	proc->use_count = 0;
 	proc->avail = 0;
+	GETTIMEOFDAY(&proc->start_time);
+	serv->stats.spawned++;
+	master_affinity_next(serv->affinity);
 	binhash_enter(master_child_table, (void *) &pid,
 		      sizeof(pid), (void *) proc);
 	serv->total_proc++;
@@ -291,6 +307,7 @@ void    master_reap_child(void)
     MASTER_PROC *proc;
     MASTER_PID pid;
     WAIT_STATUS_T status;
+    double  lifetime;
 
     /*
      * Pick up termination status of all dead children. When a process failed
@@ -328,19 +345,30 @@ void    master_reap_child(void)
 			 serv->path, pid, WSTOPSIG(status));
 		continue;
 	    }
-	    if (WIFEXITED(status))
+	    if (WIFEXITED(status)) {
 		msg_warn("process %s pid %d exit status %d",
 			 serv->path, pid, WEXITSTATUS(status));
-	    if (WIFSIGNALED(status) && !MASTER_SENT_SIGNAL(serv, status))
+		serv->stats.exit_error++;
+	    }
+	    if (WIFSIGNALED(status) && !MASTER_SENT_SIGNAL(serv, status)) {
 		msg_warn("process %s pid %d killed by signal %d",
 			 serv->path, pid, WTERMSIG(status));
+		serv->stats.killed++;
+	    }
 	    /* master_delete_children() throttles first, then kills. */
 	    if (proc->use_count == 0
 		&& (serv->flags & MASTER_FLAG_THROTTLE) == 0) {
 		msg_warn("%s: bad command startup -- throttling", serv->path);
+		serv->stats.startup_error++;
 		master_throttle(serv);
 	    }
+	} else {
+	    serv->stats.exit_ok++;
 	}
+	lifetime = master_stats_since(&proc->start_time);
+	serv->stats.lifetime += lifetime;
+	if (lifetime > serv->stats.lifetime_max)
+	    serv->stats.lifetime_max = lifetime;
 	master_delete_child(proc);
     }
 }
@@ -0,0 +1,173 @@
+/*++
+/* NAME
+/*	master_stats 3
+/* SUMMARY
+/*	Postfix master - per-service statistics snapshots
+/* SYNOPSIS
+/*	#include "master.h"
+/*
+/*	void	master_stats_init()
+/*
+/*	double	master_stats_since(start)
+/*	struct timeval *start;
+/* DESCRIPTION
+/*	This module periodically writes a snapshot of per-service
+/*	process management statistics to the file specified with
+/*	the master_stats_file parameter, so that process limits can
+/*	be sized with data instead of "process limit reached"
+/*	warnings. The counters are maintained by the master_spawn
+/*	and master_avail modules; this module only reports them.
+/*
+/*	The snapshot is written to a temporary file that is then
+/*	renamed, so that readers never see a partial snapshot.
+/*	Each line describes one service, and consists of the word
+/*	"service" followed by \fIname\fR=\fIvalue\fR pairs: the
+/*	service name and type, the current numbers of processes and
+/*	available processes, the process limit, minimum and adaptive
+/*	maximum (zero when the limit is fixed), and the
+/*	following counters that accumulate since the service was
+/*	created:
+/* .IP spawned
+/*	The number of processes created.
+/* .IP "waits, wait_time, wait_max"
+/*	The number of times that a connection request arrived while
+/*	no process was available, and the total and maximal time in
+/*	seconds until a process started to serve the service.
+/* .IP "limit_reached, limit_time"
+/*	The number of times that all processes were busy at the
+/*	process limit, and the total time in seconds spent in that
+/*	state.
+/* .IP "exit_ok, exit_error, killed, startup_error"
+/*	The numbers of processes that terminated normally, with a
+/*	non-zero exit status, by a signal that was not sent by the
+/*	master, and before completing their first request.
+/* .IP "lifetime, lifetime_max"
+/*	The total and maximal process lifetime in seconds.
+/* .PP
+/*	master_stats_init() (re)starts the snapshot pseudo thread.
+/*	It must be called after each configuration reload. It does
+/*	nothing when the master_stats_file parameter value is empty,
+/*	or when master_stats_update_interval is zero.
+/*
+/*	master_stats_since() returns the time in seconds since the
+/*	specified start time.
+/* DIAGNOSTICS
+/*	Warnings: snapshot update errors.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/time.h>
+#include <stdio.h>			/* rename() */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <events.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+
+/* Application-specific. */
+
+#include "master.h"
+
+static VSTRING *master_stats_temp;
+
+#define STR(x)	vstring_str(x)
+
+/* master_stats_since - elapsed time */
+
+double  master_stats_since(struct timeval * start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec)
+	    + (now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+/* master_stats_update - write statistics snapshot */
+
+static void master_stats_update(void)
+{
+    static const char *type_names[] = {
+	"", "unix", "inet", "fifo", "pass", "unix-dgram",
+    };
+    MASTER_SERV *serv;
+    MASTER_STATS *sp;
+    VSTREAM *fp;
+
+    /*
+     * The master runs as root. Don't follow a planted symlink.
+     */
+    if (unlink(STR(master_stats_temp)) < 0 && errno != ENOENT)
+	msg_warn("remove %s: %m", STR(master_stats_temp));
+    if ((fp = vstream_fopen(STR(master_stats_temp),
+			    O_CREAT | O_EXCL | O_WRONLY, 0644)) == 0) {
+	msg_warn("open %s: %m", STR(master_stats_temp));
+	return;
+    }
+    for (serv = master_head; serv != 0; serv = serv->next) {
+	sp = &serv->stats;
+	vstream_fprintf(fp, "service name=%s type=%s processes=%d"
+			" available=%d process_limit=%d process_minimum=%d"
+			" process_maximum=%d"
+			" spawned=%ld waits=%ld wait_time=%.3f wait_max=%.3f"
+			" limit_reached=%ld limit_time=%.3f exit_ok=%ld"
+			" exit_error=%ld killed=%ld startup_error=%ld"
+			" lifetime=%.3f lifetime_max=%.3f throttled=%d\n",
+			serv->ext_name, type_names[serv->type],
+			serv->total_proc, serv->avail_proc, serv->max_proc,
+			serv->min_idle, serv->bound_proc, sp->spawned, sp->waits,
+			sp->wait_time, sp->wait_max, sp->limit_reached,
+			sp->limit_time + (sp->limit_start.tv_sec ?
+				       master_stats_since(&sp->limit_start) : 0),
+			sp->exit_ok, sp->exit_error, sp->killed,
+			sp->startup_error, sp->lifetime, sp->lifetime_max,
+			MASTER_THROTTLED(serv) ? 1 : 0);
+    }
+    if (vstream_fclose(fp) != 0) {
+	msg_warn("write %s: %m", STR(master_stats_temp));
+	(void) unlink(STR(master_stats_temp));
+    } else if (rename(STR(master_stats_temp), var_master_stats_file) < 0) {
+	msg_warn("rename %s to %s: %m",
+		 STR(master_stats_temp), var_master_stats_file);
+	(void) unlink(STR(master_stats_temp));
+    }
+}
+
+/* master_stats_event - periodic snapshot */
+
+static void master_stats_event(int unused_event, void *unused_context)
+{
+    master_stats_update();
+    event_request_timer(master_stats_event, (void *) 0,
+			var_master_stats_int);
+}
+
+/* master_stats_init - (re)start snapshot pseudo thread */
+
+void    master_stats_init(void)
+{
+    event_cancel_timer(master_stats_event, (void *) 0);
+    if (*var_master_stats_file == 0 || var_master_stats_int <= 0)
+	return;
+    if (master_stats_temp == 0)
+	master_stats_temp = vstring_alloc(100);
+    vstring_sprintf(master_stats_temp, "%s.%ld",
+		    var_master_stats_file, (long) var_pid);
+    event_request_timer(master_stats_event, (void *) 0,
+			var_master_stats_int);
+}
@@ -11,6 +11,15 @@
 /*	master_vars_init() reads values from the global Postfix configuration
 /*	file and assigns them to tunable program parameters. Where no value
 /*	is specified, a compiled-in default value is used.
+/*
+/*	As a side effect, master_vars_init() saves a pre-parsed copy of
+/*	main.cf to an anonymous file, and updates master_conf_snap_fd.
+/*	Child processes inherit this file, and use it instead of
+/*	parsing main.cf when that file has not changed.
+/*
+/*	master_main_cf_changed is non-zero when the main.cf file
+/*	was created, modified, or replaced since the previous
+/*	master_vars_init() call, and always after the first call.
 /* LICENSE
 /* .ad
 /* .fi
@@ -30,6 +39,7 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -53,18 +63,52 @@
   */
 int     var_throttle_time;
 char   *var_master_disable;
+char   *var_master_cpu_affinity;
+char   *var_master_stats_file;
+int     var_master_stats_int;
+int     var_limit_grow_delay;
+int     var_limit_shrink_delay;
+long    var_limit_mem_reserve;
+bool    var_master_incr_reload;
+
+ /*
+  * Pre-parsed main.cf snapshot for child processes.
+  */
+int     master_conf_snap_fd = -1;
+
+ /*
+  * main.cf change detection for incremental reload.
+  */
+int     master_main_cf_changed;
 
 /* master_vars_init - initialize from global Postfix configuration file */
 
 void    master_vars_init(void)
 {
     char   *path;
+    char   *conf_path;
+    struct stat st;
+    static struct stat saved_st;
+    static int saved_st_ok = 0;
     static const CONFIG_STR_TABLE str_table[] = {
 	VAR_MASTER_DISABLE, DEF_MASTER_DISABLE, &var_master_disable, 0, 0,
+	VAR_MASTER_CPU_AFFINITY, DEF_MASTER_CPU_AFFINITY, &var_master_cpu_affinity, 0, 0,
+	VAR_MASTER_STATS_FILE, DEF_MASTER_STATS_FILE, &var_master_stats_file, 0, 0,
 	0,
     };
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_THROTTLE_TIME, DEF_THROTTLE_TIME, &var_throttle_time, 1, 0,
+	VAR_MASTER_STATS_INT, DEF_MASTER_STATS_INT, &var_master_stats_int, 0, 0,
+	VAR_LIMIT_GROW_DELAY, DEF_LIMIT_GROW_DELAY, &var_limit_grow_delay, 1, 0,
+	VAR_LIMIT_SHRINK_DELAY, DEF_LIMIT_SHRINK_DELAY, &var_limit_shrink_delay, 1, 0,
+	0,
+    };
+    static const CONFIG_LONG_TABLE long_table[] = {
+	VAR_LIMIT_MEM_RESERVE, DEF_LIMIT_MEM_RESERVE, &var_limit_mem_reserve, 0, 0,
+	0,
+    };
+    static const CONFIG_BOOL_TABLE bool_table[] = {
+	VAR_MASTER_INCR_RELOAD, DEF_MASTER_INCR_RELOAD, &var_master_incr_reload,
 	0,
     };
     static char *saved_inet_protocols;
@@ -87,10 +131,44 @@ void    master_vars_init(void)
     mail_conf_read();
     get_mail_conf_str_table(str_table);
     get_mail_conf_time_table(time_table);
+    get_mail_conf_long_table(long_table);
+    get_mail_conf_bool_table(bool_table);
     path = concatenate(var_config_dir, "/", MASTER_CONF_FILE, (void *) 0);
     fset_master_ent(path);
     myfree(path);
 
+    /*
+     * Replace the pre-parsed main.cf snapshot. Child processes that are
+     * still running have their own copy of the old one, if they need it.
+     */
+    if (master_conf_snap_fd >= 0)
+	(void) close(master_conf_snap_fd);
+    conf_path = concatenate(var_config_dir, "/", "main.cf", (void *) 0);
+
+    /*
+     * Remember whether main.cf changed since the last reload. Compare the
+     * same file attributes as mail_conf_snap_load() does, so that "touch
+     * main.cf" is sufficient to force a complete reload.
+     */
+    if (stat(conf_path, &st) < 0) {
+	master_main_cf_changed = 1;
+	saved_st_ok = 0;
+    } else {
+	master_main_cf_changed = (saved_st_ok == 0
+				  || st.st_dev != saved_st.st_dev
+				  || st.st_ino != saved_st.st_ino
+				  || st.st_size != saved_st.st_size
+				  || st.st_mtime != saved_st.st_mtime
+				  || st.st_ctime != saved_st.st_ctime);
+	saved_st = st;
+	saved_st_ok = 1;
+    }
+    path = concatenate(var_queue_dir, "/", DEF_PID_DIR, "/",
+		       var_procname, ".conf", (void *) 0);
+    master_conf_snap_fd = mail_conf_snap_create(conf_path, path);
+    myfree(path);
+    myfree(conf_path);
+
     /*
      * Look for parameter changes that require special attention.
      */
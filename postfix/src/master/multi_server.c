@@ -39,6 +39,13 @@
 /*	master.cf file.
 /*	The argv argument specifies command-line arguments left over
 /*	after options processing.
+/*
+/*	A client may send more than one request before it reads
+/*	the replies. When the service function returns while the
+/*	stream still has unread input buffered, the skeleton calls
+/*	the service function again, instead of waiting for the
+/*	client socket to become readable. Requests from one client
+/*	are thus served in the order that they were sent.
 /* .PP
 /*	Optional arguments are specified as a null-terminated list
 /*	with macros that have zero or more arguments:
@@ -136,6 +143,18 @@
 /* .IP "CA_MAIL_SERVER_BOUNCE_INIT(const char *, const char **)"
 /*	Initialize the DSN filter for the bounce/defer service
 /*	clients with the specified map source and map names.
+/* .IP "CA_MAIL_SERVER_CLIENT_LIMIT(int *)"
+/*	Stop accepting new connections while the process serves
+/*	this many clients, and report to the master that the process
+/*	is busy, so that the master will start another process when
+/*	more clients arrive. This limits the number of clients that
+/*	have to wait while the process handles a slow request. The
+/*	process resumes accepting new connections when the number
+/*	of clients drops below the limit. Specify a zero value to
+/*	disable the limit (the default). The value is used after
+/*	command-line and main.cf file processing. The limit is
+/*	ignored when the service is configured with a process limit
+/*	of 1.
 /* .PP
 /*	multi_server_disconnect() should be called by the application
 /*	to close a client connection.
@@ -233,6 +252,7 @@
 #include <mail_version.h>
 #include <bounce.h>
 #include <maillog_client.h>
+#include <metrics_clnt.h>
 
 /* Process manager. */
 
@@ -260,6 +280,11 @@ static VSTREAM *multi_server_lock;
 static int multi_server_in_flow_delay;
 static unsigned multi_server_generation;
 static void (*multi_server_pre_disconn) (VSTREAM *, char *, char **);
+static int multi_server_client_limit;
+static int multi_server_throttled;
+static int multi_server_exclusive;	/* exclusive wakeup */
+static int multi_server_busy;		/* serving a request */
+static VSTREAM *multi_server_current;	/* stream being served */
 
 /* multi_server_exit - normal termination */
 
@@ -311,6 +336,8 @@ int     multi_server_drain(void)
 		msg_warn("%s: dup2(%d, %d): %m", myname, STDIN_FILENO, fd);
 	}
 	var_use_limit = 1;
+	multi_server_client_limit = 0;
+	multi_server_throttled = 0;
 	return (0);
 	/* Let the master start a new process. */
     default:
@@ -318,6 +345,22 @@ int     multi_server_drain(void)
     }
 }
 
+/* multi_server_listen - enable connection request events */
+
+static void multi_server_listen(void)
+{
+    int     fd;
+
+    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
+	if (multi_server_exclusive == 0
+	    || event_enable_read_exclusive(fd, multi_server_accept,
+					   CAST_INT_TO_VOID_PTR(fd)) < 0) {
+	    multi_server_exclusive = 0;
+	    event_enable_read(fd, multi_server_accept, CAST_INT_TO_VOID_PTR(fd));
+	}
+    }
+}
+
 /* multi_server_disconnect - terminate client session */
 
 void    multi_server_disconnect(VSTREAM *stream)
@@ -327,8 +370,24 @@ void    multi_server_disconnect(VSTREAM *stream)
     if (multi_server_pre_disconn)
 	multi_server_pre_disconn(stream, multi_server_name, multi_server_argv);
     event_disable_readwrite(vstream_fileno(stream));
+    if (stream == multi_server_current)
+	multi_server_current = 0;
     (void) vstream_fclose(stream);
     client_count--;
+
+    /*
+     * Resume accepting connections when we drop below the client limit.
+     * Don't report "available" while the process is serving a request; the
+     * caller will do that.
+     */
+    if (multi_server_throttled && client_count < multi_server_client_limit) {
+	multi_server_listen();
+	multi_server_throttled = 0;
+	if (multi_server_busy == 0
+	    && master_notify(var_pid, multi_server_generation,
+			     MASTER_STAT_AVAIL) < 0)
+	    multi_server_abort(EVENT_NULL_TYPE, EVENT_NULL_CONTEXT);
+    }
     /* Avoid integer wrap-around in a persistent process.  */
     if (use_count < INT_MAX)
 	use_count++;
@@ -341,6 +400,7 @@ void    multi_server_disconnect(VSTREAM *stream)
 static void multi_server_execute(int unused_event, void *context)
 {
     VSTREAM *stream = (VSTREAM *) context;
+    int     was_throttled = multi_server_throttled;
 
     if (multi_server_lock != 0
 	&& myflock(vstream_fileno(multi_server_lock), INTERNAL_LOCK,
@@ -353,10 +413,31 @@ static void multi_server_execute(int unused_event, void *context)
      * be rude.
      */
     if (peekfd(vstream_fileno(stream)) > 0) {
-	if (master_notify(var_pid, multi_server_generation, MASTER_STAT_TAKEN) < 0)
+	if (was_throttled == 0
+	    && master_notify(var_pid, multi_server_generation,
+			     MASTER_STAT_TAKEN) < 0)
 	     /* void */ ;
-	multi_server_service(stream, multi_server_name, multi_server_argv);
-	if (master_notify(var_pid, multi_server_generation, MASTER_STAT_AVAIL) < 0)
+	multi_server_busy = 1;
+
+	/*
+	 * Serve pipelined requests that are already in the stream buffer;
+	 * the client socket will not become readable for those. Stop when
+	 * the service function has closed the stream.
+	 */
+	multi_server_current = stream;
+	do {
+	    multi_server_service(stream, multi_server_name, multi_server_argv);
+	} while (multi_server_current == stream && vstream_peek(stream) > 0);
+	multi_server_current = 0;
+	multi_server_busy = 0;
+
+	/*
+	 * Stay in the "taken" state while the process is at its client
+	 * limit.
+	 */
+	if (multi_server_throttled == 0
+	    && master_notify(var_pid, multi_server_generation,
+			     MASTER_STAT_AVAIL) < 0)
 	    multi_server_abort(EVENT_NULL_TYPE, EVENT_NULL_CONTEXT);
     } else {
 	multi_server_disconnect(stream);
@@ -378,6 +459,7 @@ static void multi_server_wakeup(int fd, HTABLE *attr)
 {
     VSTREAM *stream;
     char   *tmp;
+    int     n;
 
 #if defined(F_DUPFD) && (EVENTS_STYLE != EVENTS_STYLE_SELECT)
 #ifndef THRESHOLD_FD_WORKAROUND
@@ -401,10 +483,30 @@ static void multi_server_wakeup(int fd, HTABLE *attr)
     non_blocking(fd, BLOCKING);
     close_on_exec(fd, CLOSE_ON_EXEC);
     client_count++;
+
+    /*
+     * Stop accepting connections when we reach the client limit, and report
+     * "taken" so that the master will start another process for new clients.
+     */
+    if (multi_server_client_limit > 0
+	&& client_count >= multi_server_client_limit
+	&& multi_server_throttled == 0) {
+	for (n = MASTER_LISTEN_FD; n < MASTER_LISTEN_FD + socket_count; n++)
+	    event_disable_readwrite(n);
+	multi_server_throttled = 1;
+	if (master_notify(var_pid, multi_server_generation, MASTER_STAT_TAKEN) < 0)
+	     /* void */ ;
+    }
     stream = vstream_fdopen(fd, O_RDWR);
     tmp = concatenate(multi_server_name, " socket", (char *) 0);
+
+    /*
+     * Double buffering, so that sending a reply does not discard pipelined
+     * requests that were already read into the stream buffer.
+     */
     vstream_control(stream,
 		    CA_VSTREAM_CTL_PATH(tmp),
+		    CA_VSTREAM_CTL_DOUBLE,
 		    CA_VSTREAM_CTL_END);
     myfree(tmp);
     timed_ipc_setup(stream);
@@ -775,6 +877,11 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
 		msg_fatal("service %s requires privileged operation",
 			  service_name);
 	    break;
+	case MAIL_SERVER_CLIENT_LIMIT:
+	    multi_server_client_limit = *va_arg(ap, int *);
+	    if (alone)
+		multi_server_client_limit = 0;
+	    break;
 	case MAIL_SERVER_BOUNCE_INIT:
 	    dsn_filter_title = va_arg(ap, const char *);
 	    dsn_filter_maps = va_arg(ap, const char **);
@@ -880,6 +987,11 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
     if (post_init)
 	post_init(multi_server_name, multi_server_argv);
 
+    /*
+     * Optional memory accounting reports.
+     */
+    metrics_memory();
+
     /*
      * Are we running as a one-shot server with the client connection on
      * standard input? If so, make sure the output is written to stdout so as
@@ -903,9 +1015,17 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
      */
     if (var_idle_limit > 0)
 	event_request_timer(multi_server_timeout, (void *) 0, var_idle_limit);
-    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
-	event_enable_read(fd, multi_server_accept, CAST_INT_TO_VOID_PTR(fd));
+    /*
+     * When the kernel can wake up just one of the processes that wait for a
+     * connection, the lock file is not needed.
+     */
+    multi_server_exclusive = (multi_server_lock != 0 && var_excl_accept);
+    multi_server_listen();
+    for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++)
 	close_on_exec(fd, CLOSE_ON_EXEC);
+    if (multi_server_exclusive) {
+	(void) vstream_fclose(multi_server_lock);
+	multi_server_lock = 0;
     }
     event_enable_read(MASTER_STATUS_FD, multi_server_abort, (void *) 0);
     close_on_exec(MASTER_STATUS_FD, CLOSE_ON_EXEC);
@@ -917,7 +1037,10 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
      * The event loop, at last.
      */
     while (var_use_limit == 0 || use_count < var_use_limit || client_count > 0) {
-	if (multi_server_lock != 0) {
+	/* Don't hold the accept lock while not accepting connections. */
+	if (multi_server_lock != 0 && multi_server_throttled == 0) {
+	    /* Don't sit on metrics updates while waiting for the lock. */
+	    metrics_flush();
 	    watchdog_stop(watchdog);
 	    if (myflock(vstream_fileno(multi_server_lock), INTERNAL_LOCK,
 			MYFLOCK_OP_EXCLUSIVE) < 0)
@@ -210,6 +210,7 @@
 #include <mail_version.h>
 #include <bounce.h>
 #include <maillog_client.h>
+#include <metrics_clnt.h>
 
 /* Process manager. */
 
@@ -458,6 +459,7 @@ NORETURN single_server_main(int argc, char **argv, SINGLE_SERVER_FN service,...)
     const char **dsn_filter_maps;
     int     retire_me_from_flags = 0;
     int     retire_me = 0;
+    int     exclusive;
 
     /*
      * Process environment options as early as we can.
@@ -769,6 +771,11 @@ NORETURN single_server_main(int argc, char **argv, SINGLE_SERVER_FN service,...)
     if (post_init)
 	post_init(single_server_name, single_server_argv);
 
+    /*
+     * Optional memory accounting reports.
+     */
+    metrics_memory();
+
     /*
      * Are we running as a one-shot server with the client connection on
      * standard input? If so, make sure the output is written to stdout so as
@@ -794,10 +801,24 @@ NORETURN single_server_main(int argc, char **argv, SINGLE_SERVER_FN service,...)
 	event_request_timer(single_server_timeout, (void *) 0, var_idle_limit);
     if (retire_me)
 	event_request_timer(single_server_retire, (void *) 0, retire_me);
+    /*
+     * When the kernel can wake up just one of the processes that wait for a
+     * connection, the lock file is not needed.
+     */
+    exclusive = (single_server_lock != 0 && var_excl_accept);
     for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
-	event_enable_read(fd, single_server_accept, CAST_INT_TO_VOID_PTR(fd));
+	if (exclusive == 0
+	    || event_enable_read_exclusive(fd, single_server_accept,
+					   CAST_INT_TO_VOID_PTR(fd)) < 0) {
+	    exclusive = 0;
+	    event_enable_read(fd, single_server_accept, CAST_INT_TO_VOID_PTR(fd));
+	}
 	close_on_exec(fd, CLOSE_ON_EXEC);
     }
+    if (exclusive) {
+	(void) vstream_fclose(single_server_lock);
+	single_server_lock = 0;
+    }
     event_enable_read(MASTER_STATUS_FD, single_server_abort, (void *) 0);
     close_on_exec(MASTER_STATUS_FD, CLOSE_ON_EXEC);
     close_on_exec(MASTER_FLOW_READ, CLOSE_ON_EXEC);
@@ -809,6 +830,8 @@ NORETURN single_server_main(int argc, char **argv, SINGLE_SERVER_FN service,...)
      */
     while (var_use_limit == 0 || use_count < var_use_limit) {
 	if (single_server_lock != 0) {
+	    /* Don't sit on metrics updates while waiting for the lock. */
+	    metrics_flush();
 	    watchdog_stop(watchdog);
 	    if (myflock(vstream_fileno(single_server_lock), INTERNAL_LOCK,
 			MYFLOCK_OP_EXCLUSIVE) < 0)
@@ -212,6 +212,7 @@
 #include <mail_version.h>
 #include <bounce.h>
 #include <maillog_client.h>
+#include <metrics_clnt.h>
 
 /* Process manager. */
 
@@ -760,6 +761,11 @@ NORETURN trigger_server_main(int argc, char **argv, TRIGGER_SERVER_FN service,..
     if (post_init)
 	post_init(trigger_server_name, trigger_server_argv);
 
+    /*
+     * Optional memory accounting reports.
+     */
+    metrics_memory();
+
     /*
      * Are we running as a one-shot server with the client connection on
      * standard input?
@@ -796,6 +802,8 @@ NORETURN trigger_server_main(int argc, char **argv, TRIGGER_SERVER_FN service,..
      */
     while (var_use_limit == 0 || use_count < var_use_limit) {
 	if (trigger_server_lock != 0) {
+	    /* Don't sit on metrics updates while waiting for the lock. */
+	    metrics_flush();
 	    watchdog_stop(watchdog);
 	    if (myflock(vstream_fileno(trigger_server_lock), INTERNAL_LOCK,
 			MYFLOCK_OP_EXCLUSIVE) < 0)
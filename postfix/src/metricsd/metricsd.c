@@ -0,0 +1,617 @@
+/*++
+/* NAME
+/*	metricsd 8
+/* SUMMARY
+/*	Postfix metrics collector
+/* SYNOPSIS
+/*	\fBmetricsd\fR [generic Postfix daemon options]
+/* DESCRIPTION
+/*	The \fBmetricsd\fR(8) server aggregates counters, gauges and
+/*	histograms that Postfix daemon processes report when
+/*	\fBenable_metrics\fR is turned on, and makes them available
+/*	for scraping over HTTP, in the Prometheus text exposition
+/*	format.
+/*
+/*	Postfix daemon processes aggregate updates in memory and
+/*	send them at most once per second as datagrams to the
+/*	\fBmetricsd\fR(8) socket, without waiting for a reply.
+/*
+/*	The \fBmetricsd\fR(8) server listens for HTTP requests on
+/*	the address specified with \fBmetrics_http_address\fR, and
+/*	replies to "GET /metrics" requests. It does not implement
+/*	other HTTP features.
+/*
+/*	The following metrics are reported:
+/* .IP "\fBpostfix_smtpd_connections_total\fR"
+/*	SMTP sessions handled by \fBsmtpd\fR(8).
+/* .IP "\fBpostfix_smtpd_messages_total\fR"
+/*	Messages accepted by \fBsmtpd\fR(8).
+/* .IP "\fBpostfix_smtpd_rejects_total{restriction,code}\fR"
+/*	Access restriction rejects, by restriction name and reply
+/*	code class (4xx or 5xx).
+/* .IP "\fBpostfix_cleanup_messages_total{status}\fR"
+/*	Messages processed by \fBcleanup\fR(8), by status (queued,
+/*	discarded, or rejected).
+/* .IP "\fBpostfix_cleanup_bytes_total\fR"
+/*	Message content bytes queued by \fBcleanup\fR(8).
+/* .IP "\fBpostfix_qmgr_active_messages\fR, \fBpostfix_qmgr_active_recipients\fR"
+/*	In-memory message and recipient counts of the queue manager.
+/* .IP "\fBpostfix_qmgr_active_memory_bytes\fR"
+/*	The \fBqmgr\fR(8) estimate of its memory use for in-memory
+/*	messages and recipients.
+/* .IP "\fBpostfix_qmgr_transport_pending{transport}\fR, \fBpostfix_qmgr_transport_busy{transport}\fR"
+/*	Recipient entries waiting for, and in, delivery, per
+/*	transport.
+/* .IP "\fBpostfix_delivery_delay_seconds{service,status}\fR"
+/*	Histogram of end-to-end delivery delays, by master.cf
+/*	service name and delivery status.
+/* .IP "\fBpostfix_tls_handshakes_total{role,resumed}\fR"
+/*	Completed TLS handshakes, by role (client or server) and
+/*	whether a session was resumed.
+/* .IP "\fBpostfix_tls_handshake_failures_total{role}\fR"
+/*	Failed TLS handshakes.
+/* .IP "\fBpostfix_memory_bytes{process,tag}\fR, \fBpostfix_memory_blocks{process,tag}\fR"
+/*	Memory in use per process name and subsystem, reported
+/*	when \fBmetrics_memory_accounting\fR is turned on.
+/* BUGS
+/*	Values are kept in memory only. Counters restart at zero
+/*	after "\fBpostfix reload\fR"; Prometheus handles counter
+/*	resets.
+/*
+/*	Updates that are sent while the \fBmetricsd\fR(8) service
+/*	is unavailable, or while its socket queue is full, are lost.
+/* SECURITY
+/* .ad
+/* .fi
+/*	The HTTP endpoint has no access control. By default it
+/*	listens on the loopback interface only.
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/*	Changes to \fBmain.cf\fR are picked up after "\fBpostfix
+/*	reload\fR".
+/*
+/*	The text below provides only a parameter summary. See
+/*	\fBpostconf\fR(5) for more details including examples.
+/* .IP "\fBenable_metrics (no)\fR"
+/*	Enable reporting of counters, gauges, and histograms to the
+/*	\fBmetricsd\fR(8) service.
+/* .IP "\fBmetrics_service_name (metrics)\fR"
+/*	The name of the \fBmetricsd\fR(8) service entry in master.cf.
+/* .IP "\fBmetrics_http_address (127.0.0.1:9154)\fR"
+/*	The address and port where the \fBmetricsd\fR(8) server
+/*	accepts HTTP requests.
+/* .IP "\fBmetrics_memory_accounting (no)\fR"
+/*	Report the memory in use by each Postfix daemon process,
+/*	broken down by subsystem.
+/* .IP "\fBconfig_directory (see 'postconf -d' output)\fR"
+/*	The default location of the Postfix main.cf and master.cf
+/*	configuration files.
+/* .IP "\fBipc_timeout (3600s)\fR"
+/*	The time limit for sending or receiving information over an internal
+/*	communication channel.
+/* .IP "\fBprocess_id (read-only)\fR"
+/*	The process ID of a Postfix command or daemon process.
+/* .IP "\fBprocess_name (read-only)\fR"
+/*	The process name of a Postfix command or daemon process.
+/* .IP "\fBsyslog_facility (mail)\fR"
+/*	The syslog facility of Postfix logging.
+/* .IP "\fBsyslog_name (see 'postconf -d' output)\fR"
+/*	A prefix that is prepended to the process name in syslog
+/*	records, so that, for example, "smtpd" becomes "prefix/smtpd".
+/* SEE ALSO
+/*	master(5), generic daemon options
+/*	postconf(5), configuration parameters
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* HISTORY
+/* .ad
+/* .fi
+/*	This service was introduced with Postfix version 3.9.
+/*--*/
+
+ /*
+  * System library.
+  */
+#include <sys_defs.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+ /*
+  * Utility library.
+  */
+#include <msg.h>
+#include <mymalloc.h>
+#include <htable.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <events.h>
+#include <listen.h>
+#include <iostuff.h>
+#include <sane_accept.h>
+#include <stringops.h>
+
+ /*
+  * Global library.
+  */
+#include <mail_params.h>
+#include <mail_version.h>
+#include <metrics_clnt.h>
+
+ /*
+  * Server skeleton.
+  */
+#include <mail_server.h>
+
+ /*
+  * Tunable parameters.
+  */
+char   *var_metrics_http_addr;
+
+ /*
+  * Aggregated values, keyed by name{labels}.
+  */
+typedef struct {
+    int     type;			/* counter, gauge, histogram */
+    double  value;			/* total, value, or sum */
+    double  count;			/* histogram observations */
+    double  buckets[METRICS_BUCKET_COUNT];	/* histogram buckets */
+} METRICSD_ENTRY;
+
+static HTABLE *metricsd_table;
+static int metricsd_http_fd = -1;
+
+static const double metricsd_bounds[] = {METRICS_BUCKET_BOUNDS};
+
+#define METRICSD_KEY_MAXLEN	1024
+#define METRICSD_HTTP_TIMEOUT	10	/* time limit per HTTP request */
+#define METRICSD_HTTP_READ_SIZE	1024
+#define METRICSD_HTTP_REQ_MAX	8192	/* request line and headers */
+
+ /*
+  * Per-client HTTP state. The request is read and the response is written
+  * without blocking, so that a slow client does not stall metrics updates.
+  */
+typedef struct {
+    int     fd;				/* client connection */
+    VSTRING *buf;			/* request, then response */
+    ssize_t offset;			/* response bytes sent */
+} METRICSD_HTTP;
+
+static void metricsd_http_timeout(int, void *);
+
+ /*
+  * Silly little macros.
+  */
+#define STR(x)			vstring_str(x)
+#define STREQ(x, y)		(strcmp((x), (y)) == 0)
+
+/* metricsd_valid_key - sanity check name{labels} */
+
+static int metricsd_valid_key(const char *key)
+{
+    const char *cp;
+
+    if (strlen(key) > METRICSD_KEY_MAXLEN
+	|| !(ISALPHA(*key) || *key == '_' || *key == ':'))
+	return (0);
+    for (cp = key; *cp && *cp != '{'; cp++)
+	if (!(ISALNUM(*cp) || *cp == '_' || *cp == ':'))
+	    return (0);
+    return (*cp == 0 || cp[strlen(cp) - 1] == '}');
+}
+
+/* metricsd_update - process one update record */
+
+static void metricsd_update(char *line)
+{
+    char   *cp = line;
+    char   *type;
+    char   *key;
+    char   *arg;
+    char   *end;
+    double  vals[2 + METRICS_BUCKET_COUNT];
+    int     nvals;
+    int     need;
+    METRICSD_ENTRY *mp;
+    int     n;
+
+    /*
+     * Parse "type key number...".
+     */
+    if ((type = mystrtok(&cp, CHARS_SPACE)) == 0
+	|| (key = mystrtok(&cp, CHARS_SPACE)) == 0)
+	return;
+    switch (*type) {
+    case METRICS_TYPE_COUNTER:
+    case METRICS_TYPE_GAUGE:
+	need = 1;
+	break;
+    case METRICS_TYPE_HISTOGRAM:
+	need = 2 + METRICS_BUCKET_COUNT;
+	break;
+    default:
+	need = -1;
+	break;
+    }
+    for (nvals = 0; nvals < need && (arg = mystrtok(&cp, CHARS_SPACE)) != 0;
+	 nvals++) {
+	vals[nvals] = strtod(arg, &end);
+	if (*end != 0)
+	    break;
+    }
+    if (type[1] != 0 || need < 0 || nvals != need
+	|| mystrtok(&cp, CHARS_SPACE) != 0 || !metricsd_valid_key(key)) {
+	msg_warn("ignoring malformed metrics update: %.100s", line);
+	return;
+    }
+
+    /*
+     * Update the aggregate.
+     */
+    if ((mp = (METRICSD_ENTRY *) htable_find(metricsd_table, key)) == 0) {
+	mp = (METRICSD_ENTRY *) mymalloc(sizeof(*mp));
+	memset((void *) mp, 0, sizeof(*mp));
+	mp->type = *type;
+	(void) htable_enter(metricsd_table, key, (void *) mp);
+    } else if (mp->type != *type) {
+	msg_warn("ignoring metrics update with conflicting type: %.100s", key);
+	return;
+    }
+    switch (mp->type) {
+    case METRICS_TYPE_COUNTER:
+	mp->value += vals[0];
+	break;
+    case METRICS_TYPE_GAUGE:
+	mp->value = vals[0];
+	break;
+    case METRICS_TYPE_HISTOGRAM:
+	mp->count += vals[0];
+	mp->value += vals[1];
+	for (n = 0; n < METRICS_BUCKET_COUNT; n++)
+	    mp->buckets[n] += vals[2 + n];
+	break;
+    }
+}
+
+/* metricsd_service - process one datagram */
+
+static void metricsd_service(char *buf, ssize_t len, char *unused_service,
+			             char **unused_argv)
+{
+    static VSTRING *copy;
+    char   *cp;
+    char   *line;
+
+    if (copy == 0)
+	copy = vstring_alloc(DGRAM_BUF_SIZE);
+    vstring_strncpy(copy, buf, len);
+    cp = STR(copy);
+    while ((line = mystrtok(&cp, "\n")) != 0)
+	metricsd_update(line);
+}
+
+/* metricsd_compare - order by metric name, then labels */
+
+static int metricsd_compare(const void *a, const void *b)
+{
+    const char *ka = (*(const HTABLE_INFO **) a)->key;
+    const char *kb = (*(const HTABLE_INFO **) b)->key;
+    size_t  la = strcspn(ka, "{");
+    size_t  lb = strcspn(kb, "{");
+    int     diff;
+
+    if ((diff = strncmp(ka, kb, la < lb ? la : lb)) != 0)
+	return (diff);
+    if (la != lb)
+	return (la < lb ? -1 : 1);
+    return (strcmp(ka + la, kb + lb));
+}
+
+/* metricsd_print - print one metric, with an optional extra label */
+
+static void metricsd_print(VSTREAM *fp, const char *key, const char *suffix,
+			           const char *extra, double value)
+{
+    size_t  len = strcspn(key, "{");
+    const char *labels = key + len;
+
+    vstream_fprintf(fp, "%.*s%s", (int) len, key, suffix);
+    if (*labels && extra)
+	vstream_fprintf(fp, "%.*s,%s}", (int) strlen(labels) - 1, labels, extra);
+    else if (extra)
+	vstream_fprintf(fp, "{%s}", extra);
+    else
+	vstream_fprintf(fp, "%s", labels);
+    vstream_fprintf(fp, " %.15g\n", value);
+}
+
+/* metricsd_export - print all metrics in text exposition format */
+
+static void metricsd_export(VSTREAM *fp)
+{
+    static VSTRING *le;
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    METRICSD_ENTRY *mp;
+    const char *key;
+    const char *prev = 0;
+    size_t  prev_len = 0;
+    size_t  len;
+    double  total;
+    int     n;
+
+    if (le == 0)
+	le = vstring_alloc(20);
+    list = htable_list(metricsd_table);
+    qsort((void *) list, metricsd_table->used, sizeof(*list), metricsd_compare);
+    for (ht = list; *ht; ht++) {
+	key = ht[0]->key;
+	mp = (METRICSD_ENTRY *) ht[0]->value;
+	len = strcspn(key, "{");
+	if (prev == 0 || len != prev_len || strncmp(key, prev, len) != 0)
+	    vstream_fprintf(fp, "# TYPE %.*s %s\n", (int) len, key,
+			    mp->type == METRICS_TYPE_COUNTER ? "counter" :
+			    mp->type == METRICS_TYPE_GAUGE ? "gauge" :
+			    "histogram");
+	prev = key;
+	prev_len = len;
+	if (mp->type != METRICS_TYPE_HISTOGRAM) {
+	    metricsd_print(fp, key, "", (char *) 0, mp->value);
+	    continue;
+	}
+	for (total = 0, n = 0; n < METRICS_BUCKET_COUNT; n++) {
+	    total += mp->buckets[n];
+	    if (n < METRICS_BUCKET_COUNT - 1)
+		vstring_sprintf(le, "le=\"%g\"", metricsd_bounds[n]);
+	    else
+		vstring_strcpy(le, "le=\"+Inf\"");
+	    metricsd_print(fp, key, "_bucket", STR(le), total);
+	}
+	metricsd_print(fp, key, "_sum", (char *) 0, mp->value);
+	metricsd_print(fp, key, "_count", (char *) 0, mp->count);
+    }
+    myfree((void *) list);
+}
+
+/* metricsd_http_close - destroy HTTP client state */
+
+static void metricsd_http_close(METRICSD_HTTP *hp)
+{
+    event_disable_readwrite(hp->fd);
+    event_cancel_timer(metricsd_http_timeout, (void *) hp);
+    if (close(hp->fd) < 0 && msg_verbose)
+	msg_info("HTTP client close error: %m");
+    vstring_free(hp->buf);
+    myfree((void *) hp);
+}
+
+/* metricsd_http_timeout - give up on a slow HTTP client */
+
+static void metricsd_http_timeout(int unused_event, void *context)
+{
+    METRICSD_HTTP *hp = (METRICSD_HTTP *) context;
+
+    if (msg_verbose)
+	msg_info("HTTP client timeout");
+    metricsd_http_close(hp);
+}
+
+/* metricsd_http_write - send more of the response */
+
+static void metricsd_http_write(int unused_event, void *context)
+{
+    METRICSD_HTTP *hp = (METRICSD_HTTP *) context;
+    ssize_t count;
+
+    count = write(hp->fd, STR(hp->buf) + hp->offset,
+		  VSTRING_LEN(hp->buf) - hp->offset);
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+	return;
+    if (count < 0) {
+	if (msg_verbose)
+	    msg_info("HTTP client write error: %m");
+	metricsd_http_close(hp);
+	return;
+    }
+    if ((hp->offset += count) >= VSTRING_LEN(hp->buf))
+	metricsd_http_close(hp);
+}
+
+/* metricsd_http_reply - format the response for a complete request */
+
+static void metricsd_http_reply(METRICSD_HTTP *hp)
+{
+    VSTREAM *fp;
+    char   *cp;
+    char   *method;
+    char   *path;
+    int     status;
+
+    /*
+     * Look at the request line only. The request headers are ignored.
+     */
+    cp = STR(hp->buf);
+    cp[strcspn(cp, "\r\n")] = 0;
+    method = mystrtok(&cp, CHARS_SPACE);
+    path = mystrtok(&cp, CHARS_SPACE);
+    if (method == 0 || !STREQ(method, "GET"))
+	status = 405;
+    else if (path == 0 || !STREQ(path, "/metrics"))
+	status = 404;
+    else
+	status = 200;
+
+    /*
+     * Format the response in memory, and send it when the client is ready
+     * to receive. A client that does not read can't block this process.
+     */
+    VSTRING_RESET(hp->buf);
+    if ((fp = vstream_memopen(hp->buf, O_WRONLY)) == 0)
+	msg_fatal("open memory stream: %m");
+    switch (status) {
+    case 405:
+	vstream_fputs("HTTP/1.0 405 Method Not Allowed\r\n"
+		      "Allow: GET\r\n"
+		      "Connection: close\r\n\r\n", fp);
+	break;
+    case 404:
+	vstream_fputs("HTTP/1.0 404 Not Found\r\n"
+		      "Connection: close\r\n\r\n", fp);
+	break;
+    default:
+	vstream_fputs("HTTP/1.0 200 OK\r\n"
+		      "Content-Type: text/plain; version=0.0.4\r\n"
+		      "Connection: close\r\n\r\n", fp);
+	metricsd_export(fp);
+	break;
+    }
+    if (vstream_fclose(fp))
+	msg_fatal("close memory stream: %m");
+    hp->offset = 0;
+    event_disable_readwrite(hp->fd);
+    event_enable_write(hp->fd, metricsd_http_write, (void *) hp);
+}
+
+/* metricsd_http_read - receive more of the request */
+
+static void metricsd_http_read(int unused_event, void *context)
+{
+    METRICSD_HTTP *hp = (METRICSD_HTTP *) context;
+    char    buf[METRICSD_HTTP_READ_SIZE];
+    ssize_t count;
+    char   *cp;
+    char   *end;
+
+    count = read(hp->fd, buf, sizeof(buf));
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+	return;
+    if (count <= 0) {
+	metricsd_http_close(hp);
+	return;
+    }
+    vstring_memcat(hp->buf, buf, count);
+    VSTRING_TERMINATE(hp->buf);
+
+    /*
+     * The request is complete after a request line without HTTP version, or
+     * after the empty line that ends the request headers. Don't buffer an
+     * unreasonable amount of request headers.
+     */
+    if ((end = strchr(STR(hp->buf), '\n')) == 0) {
+	if (VSTRING_LEN(hp->buf) > METRICSD_HTTP_REQ_MAX)
+	    metricsd_http_close(hp);
+	return;
+    }
+#define HTTP_BLANK	" \t"
+#define HTTP_WORD_END	" \t\r\n"
+
+    cp = STR(hp->buf) + strspn(STR(hp->buf), HTTP_BLANK);
+    cp += strcspn(cp, HTTP_WORD_END);		/* method */
+    cp += strspn(cp, HTTP_BLANK);
+    cp += strcspn(cp, HTTP_WORD_END);		/* path */
+    cp += strspn(cp, HTTP_BLANK);
+    if (*cp == '\r' || *cp == '\n'
+	|| strstr(end, "\n\n") != 0 || strstr(end, "\n\r\n") != 0
+	|| VSTRING_LEN(hp->buf) > METRICSD_HTTP_REQ_MAX)
+	metricsd_http_reply(hp);
+}
+
+/* metricsd_http_accept - accept an HTTP client connection */
+
+static void metricsd_http_accept(int unused_event, void *unused_context)
+{
+    METRICSD_HTTP *hp;
+    int     fd;
+
+    if ((fd = sane_accept(metricsd_http_fd, (struct sockaddr *) 0,
+			  (SOCKADDR_SIZE *) 0)) < 0)
+	return;
+    non_blocking(fd, NON_BLOCKING);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+    hp = (METRICSD_HTTP *) mymalloc(sizeof(*hp));
+    hp->fd = fd;
+    hp->buf = vstring_alloc(100);
+    hp->offset = 0;
+
+    /*
+     * The time limit is for the entire request and response, so that a slow
+     * client can't tie up resources forever.
+     */
+    event_enable_read(fd, metricsd_http_read, (void *) hp);
+    event_request_timer(metricsd_http_timeout, (void *) hp,
+			METRICSD_HTTP_TIMEOUT);
+}
+
+/* pre_jail_init - pre-jail handling */
+
+static void pre_jail_init(char *unused_service_name, char **argv)
+{
+
+    /*
+     * Sanity check. This service takes no command-line arguments.
+     */
+    if (argv[0])
+	msg_fatal("unexpected command-line argument: %s", argv[0]);
+
+    /*
+     * Open the HTTP listener before dropping privileges, so that it can use
+     * a privileged port.
+     */
+    if (*var_metrics_http_addr) {
+	metricsd_http_fd = inet_listen(var_metrics_http_addr, 10, NON_BLOCKING);
+	close_on_exec(metricsd_http_fd, CLOSE_ON_EXEC);
+    }
+}
+
+/* post_jail_init - post-jail initialization */
+
+static void post_jail_init(char *unused_name, char **unused_argv)
+{
+
+    /*
+     * This process keeps the aggregated values in memory. Prevent automatic
+     * process suicide after a limited number of client requests or after a
+     * limited amount of idle time.
+     */
+    var_use_limit = 0;
+    var_idle_limit = 0;
+    metricsd_table = htable_create(100);
+    if (metricsd_http_fd >= 0)
+	event_enable_read(metricsd_http_fd, metricsd_http_accept, (void *) 0);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+/* main - pass control to the multi-threaded skeleton */
+
+int     main(int argc, char **argv)
+{
+    static const CONFIG_STR_TABLE str_table[] = {
+	VAR_METRICS_HTTP_ADDR, DEF_METRICS_HTTP_ADDR, &var_metrics_http_addr, 0, 0,
+	0,
+    };
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    /*
+     * This is a datagram service, so that clients never wait for the
+     * collector, and so that updates remain queued in the kernel while a
+     * new metricsd process starts up.
+     */
+    dgram_server_main(argc, argv, metricsd_service,
+		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
+		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
+		      CA_MAIL_SERVER_SOLITARY,
+		      0);
+}
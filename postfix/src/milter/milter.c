@@ -201,6 +201,15 @@
 /*	by a preceding milter. This function must be called with
 /*	as argument an open Postfix queue file.
 /*
+/*	With "milter_parallel_events = yes", the event functions
+/*	above send an event to all milters before they receive
+/*	the replies, so that the time to handle an event is the
+/*	time of the slowest milter, instead of the sum. The result
+/*	is the same as without parallel events, except that all
+/*	milters see an event even when a preceding milter rejects
+/*	it. milter_message() does this only for consecutive milters
+/*	that did not negotiate any message modification actions.
+/*
 /*	milter_abort() cancels a mail transaction in progress.  To
 /*	simplify usage, redundant calls of this function are NO-OPs
 /*	and don't raise a run-time error.
@@ -394,6 +403,45 @@ void    milter_edit_callback(MILTERS *milters,
     milters->chg_context = chg_context;
 }
 
+/* milter_collect - collect deferred replies */
+
+static const char *milter_collect(MILTERS *milters, MILTER *stop,
+				          const char *resp)
+{
+    const char *reply;
+    const char *first = 0;
+    MILTER *m;
+
+    /*
+     * With milter_parallel_events, an event is sent to a number of Milters
+     * before their replies are received. Receive all replies, so that each
+     * Milter stays in sync with the protocol, and return the first non-null
+     * reply in Milter list order. That is the reply that would have been
+     * returned without parallel events. The caller's non-null reply, if
+     * any, came from the last Milter before "stop", which has nothing to
+     * collect.
+     */
+    for (m = milters->milter_list; m != stop; m = m->next) {
+	if ((m->flags & MILTER_FLAG_DEFER_REPLY) == 0)
+	    continue;
+	m->flags &= ~MILTER_FLAG_DEFER_REPLY;
+	if ((reply = m->deferred_reply(m)) != 0 && first == 0)
+	    first = reply;
+    }
+    return (first ? first : resp);
+}
+
+ /*
+  * Opt-in parallel events: request that a Milter defers its reply.
+  */
+#define MILTER_DEFER_REPLY(m) do { \
+	if (var_milt_parallel) \
+	    (m)->flags |= MILTER_FLAG_DEFER_REPLY; \
+    } while (0)
+
+#define MILTER_COLLECT(milters, m, resp) \
+	(var_milt_parallel ? milter_collect((milters), (m), (resp)) : (resp))
+
 /* milter_conn_event - report connect event */
 
 const char *milter_conn_event(MILTERS *milters,
@@ -414,17 +462,33 @@ const char *milter_conn_event(MILTERS *milters,
 		    (global_macros = \
 		         milter_macro_lookup(milters, milters->macros->member)))
 
+    /*
+     * Don't evaluate macros for a Milter that will not receive the event,
+     * for example after it accepted or rejected the connection or message.
+     * The lookups may involve address resolution and quoting.
+     */
+#define MILTER_ACTIVE_MACRO_EVAL(global_macros, m, milters, member) \
+	(m->active(m) ? \
+	    MILTER_MACRO_EVAL(global_macros, m, milters, member) : (ARGV *) 0)
+
+#define MILTER_MACRO_FREE(any_macros, global_macros) do { \
+	if ((any_macros) != 0 && (any_macros) != (global_macros)) \
+	    argv_free(any_macros); \
+    } while (0)
+
     if (msg_verbose)
 	msg_info("report connect to all milters");
     for (resp = 0, m = milters->milter_list; resp == 0 && m != 0; m = m->next) {
 	if (m->connect_on_demand != 0)
 	    m->connect_on_demand(m);
-	any_macros = MILTER_MACRO_EVAL(global_macros, m, milters, conn_macros);
+	any_macros =
+	    MILTER_ACTIVE_MACRO_EVAL(global_macros, m, milters, conn_macros);
+	MILTER_DEFER_REPLY(m);
 	resp = m->conn_event(m, client_name, client_addr, client_port,
 			     addr_family, any_macros);
-	if (any_macros != global_macros)
-	    argv_free(any_macros);
+	MILTER_MACRO_FREE(any_macros, global_macros);
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_macros)
 	argv_free(global_macros);
     return (resp);
@@ -444,10 +508,11 @@ const char *milter_helo_event(MILTERS *milters, const char *helo_name,
 	msg_info("report helo to all milters");
     for (resp = 0, m = milters->milter_list; resp == 0 && m != 0; m = m->next) {
 	any_macros = MILTER_MACRO_EVAL(global_macros, m, milters, helo_macros);
+	MILTER_DEFER_REPLY(m);
 	resp = m->helo_event(m, helo_name, esmtp_flag, any_macros);
-	if (any_macros != global_macros)
-	    argv_free(any_macros);
+	MILTER_MACRO_FREE(any_macros, global_macros);
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_macros)
 	argv_free(global_macros);
     return (resp);
@@ -465,11 +530,13 @@ const char *milter_mail_event(MILTERS *milters, const char **argv)
     if (msg_verbose)
 	msg_info("report sender to all milters");
     for (resp = 0, m = milters->milter_list; resp == 0 && m != 0; m = m->next) {
-	any_macros = MILTER_MACRO_EVAL(global_macros, m, milters, mail_macros);
+	any_macros =
+	    MILTER_ACTIVE_MACRO_EVAL(global_macros, m, milters, mail_macros);
+	MILTER_DEFER_REPLY(m);
 	resp = m->mail_event(m, argv, any_macros);
-	if (any_macros != global_macros)
-	    argv_free(any_macros);
+	MILTER_MACRO_FREE(any_macros, global_macros);
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_macros)
 	argv_free(global_macros);
     return (resp);
@@ -490,12 +557,13 @@ const char *milter_rcpt_event(MILTERS *milters, int flags, const char **argv)
 	if ((flags & MILTER_FLAG_WANT_RCPT_REJ) == 0
 	    || (m->flags & MILTER_FLAG_WANT_RCPT_REJ) != 0) {
 	    any_macros =
-		MILTER_MACRO_EVAL(global_macros, m, milters, rcpt_macros);
+		MILTER_ACTIVE_MACRO_EVAL(global_macros, m, milters, rcpt_macros);
+	    MILTER_DEFER_REPLY(m);
 	    resp = m->rcpt_event(m, argv, any_macros);
-	    if (any_macros != global_macros)
-		argv_free(any_macros);
+	    MILTER_MACRO_FREE(any_macros, global_macros);
 	}
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_macros)
 	argv_free(global_macros);
     return (resp);
@@ -513,11 +581,13 @@ const char *milter_data_event(MILTERS *milters)
     if (msg_verbose)
 	msg_info("report data to all milters");
     for (resp = 0, m = milters->milter_list; resp == 0 && m != 0; m = m->next) {
-	any_macros = MILTER_MACRO_EVAL(global_macros, m, milters, data_macros);
+	any_macros =
+	    MILTER_ACTIVE_MACRO_EVAL(global_macros, m, milters, data_macros);
+	MILTER_DEFER_REPLY(m);
 	resp = m->data_event(m, any_macros);
-	if (any_macros != global_macros)
-	    argv_free(any_macros);
+	MILTER_MACRO_FREE(any_macros, global_macros);
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_macros)
 	argv_free(global_macros);
     return (resp);
@@ -535,11 +605,13 @@ const char *milter_unknown_event(MILTERS *milters, const char *command)
     if (msg_verbose)
 	msg_info("report unknown command to all milters");
     for (resp = 0, m = milters->milter_list; resp == 0 && m != 0; m = m->next) {
-	any_macros = MILTER_MACRO_EVAL(global_macros, m, milters, unk_macros);
+	any_macros =
+	    MILTER_ACTIVE_MACRO_EVAL(global_macros, m, milters, unk_macros);
+	MILTER_DEFER_REPLY(m);
 	resp = m->unknown_event(m, command, any_macros);
-	if (any_macros != global_macros)
-	    argv_free(any_macros);
+	MILTER_MACRO_FREE(any_macros, global_macros);
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_macros)
 	argv_free(global_macros);
     return (resp);
@@ -574,15 +646,28 @@ const char *milter_message(MILTERS *milters, VSTREAM *fp, off_t data_offset,
     if (msg_verbose)
 	msg_info("inspect content by all milters");
     for (resp = 0, m = milters->milter_list; resp == 0 && m != 0; m = m->next) {
-	any_eoh_macros = MILTER_MACRO_EVAL(global_eoh_macros, m, milters, eoh_macros);
-	any_eod_macros = MILTER_MACRO_EVAL(global_eod_macros, m, milters, eod_macros);
+
+	/*
+	 * Each Milter must see the changes made by preceding Milters. Only
+	 * Milters that can't change the message are inspected in parallel;
+	 * collect their replies before a Milter that can.
+	 */
+	if (var_milt_parallel) {
+	    if (m->read_only(m))
+		m->flags |= MILTER_FLAG_DEFER_REPLY;
+	    else if ((resp = milter_collect(milters, m, (char *) 0)) != 0)
+		break;
+	}
+	any_eoh_macros = MILTER_ACTIVE_MACRO_EVAL(global_eoh_macros, m, milters,
+						  eoh_macros);
+	any_eod_macros = MILTER_ACTIVE_MACRO_EVAL(global_eod_macros, m, milters,
+						  eod_macros);
 	resp = m->message(m, fp, data_offset, any_eoh_macros, any_eod_macros,
 			  auto_hdrs);
-	if (any_eoh_macros != global_eoh_macros)
-	    argv_free(any_eoh_macros);
-	if (any_eod_macros != global_eod_macros)
-	    argv_free(any_eod_macros);
+	MILTER_MACRO_FREE(any_eoh_macros, global_eoh_macros);
+	MILTER_MACRO_FREE(any_eod_macros, global_eod_macros);
     }
+    resp = MILTER_COLLECT(milters, m, resp);
     if (global_eoh_macros)
 	argv_free(global_eoh_macros);
     if (global_eod_macros)
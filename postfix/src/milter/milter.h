@@ -46,6 +46,8 @@ typedef struct MILTER {
     const char *(*other_event) (struct MILTER *);
     void    (*abort) (struct MILTER *);
     void    (*disc_event) (struct MILTER *);
+    const char *(*deferred_reply) (struct MILTER *);
+    int     (*read_only) (struct MILTER *);
     int     (*active) (struct MILTER *);
     int     (*send) (struct MILTER *, VSTREAM *);
     void    (*free) (struct MILTER *);
@@ -53,6 +55,7 @@ typedef struct MILTER {
 
 #define MILTER_FLAG_NONE		(0)
 #define MILTER_FLAG_WANT_RCPT_REJ	(1<<0)	/* see S8_RCPT_MAILER_ERROR */
+#define MILTER_FLAG_DEFER_REPLY	(1<<1)	/* see milter_parallel_events */
 
 extern MILTER *milter8_create(const char *, int, int, int, const char *, const char *, struct MILTERS *);
 extern MILTER *milter8_receive(VSTREAM *, struct MILTERS *);
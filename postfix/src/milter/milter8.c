@@ -90,6 +90,7 @@
 #include <name_code.h>
 #include <stringops.h>
 #include <compat_va_copy.h>
+#include <iostuff.h>
 
 /* Global library. */
 
@@ -233,6 +234,9 @@ static const NAME_CODE smfir_table[] = {
 #define SMFIP_NR_EOH		(1L<<18)/* filter won't reply for eoh */
 #define SMFIP_NR_BODY		(1L<<19)/* filter won't reply for body chunk */
 #define SMFIP_HDR_LEADSPC	(1L<<20)/* header value has leading space */
+ /* Introduced with Sendmail 8.14.4. */
+#define SMFIP_MDS_256K		(1L<<28)/* MILTER_MAX_DATA_SIZE=256K */
+#define SMFIP_MDS_1M		(1L<<29)/* MILTER_MAX_DATA_SIZE=1M */
 
 #define SMFIP_NOSEND_MASK \
 	(SMFIP_NOCONNECT | SMFIP_NOHELO | SMFIP_NOMAIL | SMFIP_NORCPT \
@@ -267,6 +271,8 @@ static const NAME_MASK smfip_table[] = {
     "SMFIP_NR_EOH", SMFIP_NR_EOH,
     "SMFIP_NR_BODY", SMFIP_NR_BODY,
     "SMFIP_HDR_LEADSPC", SMFIP_HDR_LEADSPC,
+    "SMFIP_MDS_256K", SMFIP_MDS_256K,
+    "SMFIP_MDS_1M", SMFIP_MDS_1M,
     0, 0,
 };
 
@@ -350,9 +356,29 @@ static const size_t milter8_macro_offsets[] = {
 	((char **) (((char *) (__macros)) + milter8_macro_offsets[(__class)]))
 
  /*
-  * How much buffer space is available for sending body content.
+  * How much buffer space is available for sending body content. A Milter
+  * may ask for larger body chunks, so that a large message needs fewer
+  * round trips. The limits are one less than a power of two, as with
+  * libmilter.
   */
 #define MILTER_CHUNK_SIZE	65535	/* body chunk size */
+#define MILTER_MDS_256K		((256 * 1024) - 1)
+#define MILTER_MDS_1M		((1024 * 1024) - 1)
+
+#define MILTER8_CHUNK_SIZE(m) \
+	(((m)->ev_mask & SMFIP_MDS_1M) ? MILTER_MDS_1M : \
+	 ((m)->ev_mask & SMFIP_MDS_256K) ? MILTER_MDS_256K : MILTER_CHUNK_SIZE)
+
+ /*
+  * Avoid one write() per 4096 bytes of message content. This applies
+  * especially to Milters that don't reply for each body chunk.
+  */
+#define MILTER8_STREAM_BUFSIZE(fp) do { \
+	if (var_msg_stream_bufsize > 0) \
+	    vstream_control((fp), \
+		    CA_VSTREAM_CTL_BUFSIZE((ssize_t) var_msg_stream_bufsize), \
+			    CA_VSTREAM_CTL_END); \
+    } while (0)
 
 /*#define msg_verbose 2*/
 
@@ -381,16 +407,24 @@ typedef struct {
     int     state;			/* MILTER8_STAT_mumble */
     char   *def_reply;			/* error response or null */
     int     skip_event_type;		/* skip operations of this type */
+    int     reply_event;		/* event with deferred reply */
 } MILTER8;
 
  /*
   * XXX Sendmail 8 libmilter automatically closes the MTA-to-filter socket
   * when it finds out that the SMTP client has disconnected. Because of this
   * behavior, Postfix has to open a new MTA-to-filter socket each time an
-  * SMTP client connects.
+  * SMTP client connects, unless the Milter supports SMFIC_QUIT_NC and
+  * milter_connection_reuse is enabled.
   */
 #define LIBMILTER_AUTO_DISCONNECT
 
+ /*
+  * SMFIC_QUIT_NC was introduced with protocol version 6.
+  */
+#define MILTER8_CAN_QUIT_NC(milter) \
+	(var_milt_conn_reuse && (milter)->version >= 6)
+
  /*
   * Milter internal state. For the external representation we use SMTP
   * replies (4XX X.Y.Z text, 5XX X.Y.Z text) and one-letter strings
@@ -446,7 +480,8 @@ typedef struct {
 #define MILTER8_V4_PROTO_MASK	(MILTER8_V3_PROTO_MASK | SMFIP_NODATA)
 #define MILTER8_V6_PROTO_MASK \
 	(MILTER8_V4_PROTO_MASK | SMFIP_SKIP | SMFIP_RCPT_REJ \
-	| SMFIP_NOREPLY_MASK | SMFIP_HDR_LEADSPC)
+	| SMFIP_NOREPLY_MASK | SMFIP_HDR_LEADSPC \
+	| SMFIP_MDS_256K | SMFIP_MDS_1M)
 
  /*
   * What events we can send to the milter application. The milter8_protocol
@@ -948,6 +983,8 @@ static int milter8_write_cmd(MILTER8 *milter, int command,...)
     return (err);
 }
 
+static const char *milter8_event_reply(MILTER8 *, int);
+
 /* milter8_event - report event and receive reply */
 
 static const char *milter8_event(MILTER8 *milter, int event,
@@ -960,17 +997,7 @@ static const char *milter8_event(MILTER8 *milter, int event,
     va_list ap2;
     ssize_t data_len;
     int     err;
-    unsigned char cmd;
-    ssize_t data_size;
     const char *smfic_name;
-    const char *smfir_name;
-    MILTERS *parent = milter->m.parent;
-    UINT32_TYPE index;
-    const char *edit_resp = 0;
-    const char *retval = 0;
-    VSTRING *body_line_buf = 0;
-    int     done = 0;
-    int     body_edit_lockout = 0;
 
 #define DONT_SKIP_REPLY	0
 
@@ -1092,6 +1119,48 @@ static const char *milter8_event(MILTER8 *milter, int event,
 	return (milter->def_reply);
     }
 
+    /*
+     * Fan-out support: flush the request and let milter(3) collect the
+     * reply after it has sent the same event to other Milters. Never defer
+     * the reply for a header or body chunk; those are followed by more
+     * events for the same Milter.
+     */
+#define MILTER8_CAN_DEFER(e) \
+	((e) != SMFIC_HEADER && (e) != SMFIC_EOH && (e) != SMFIC_BODY)
+
+    if ((milter->m.flags & MILTER_FLAG_DEFER_REPLY) != 0
+	&& MILTER8_CAN_DEFER(event)) {
+	if (vstream_fflush(milter->fp) != 0) {
+	    msg_warn("milter %s: error writing command: %m", milter->m.name);
+	    milter8_comm_error(milter);
+	    return (milter->def_reply);
+	}
+	if (msg_verbose)
+	    msg_info("deferring reply for event %s from milter %s",
+		     (smfic_name = str_name_code(smfic_table, event)) != 0 ?
+		     smfic_name : "(unknown MTA event)", milter->m.name);
+	milter->reply_event = event;
+	return (milter->def_reply);
+    }
+    return (milter8_event_reply(milter, event));
+}
+
+/* milter8_event_reply - receive reply for event */
+
+static const char *milter8_event_reply(MILTER8 *milter, int event)
+{
+    unsigned char cmd;
+    ssize_t data_size;
+    const char *smfic_name;
+    const char *smfir_name;
+    MILTERS *parent = milter->m.parent;
+    UINT32_TYPE index;
+    const char *edit_resp = 0;
+    const char *retval = 0;
+    VSTRING *body_line_buf = 0;
+    int     done = 0;
+    int     body_edit_lockout = 0;
+
     /*
      * Receive the reply or replies.
      * 
@@ -1601,7 +1670,7 @@ static const char *milter8_event(MILTER8 *milter, int event,
 	 */
 	msg_warn("milter %s: reply %s was followed by %ld data bytes",
 	milter->m.name, (smfir_name = str_name_code(smfir_table, cmd)) != 0 ?
-		 smfir_name : "unknown", (long) data_len);
+		 smfir_name : "unknown", (long) data_size);
 	milter8_comm_error(milter);
 	MILTER8_EVENT_BREAK(milter->def_reply);
     }
@@ -1752,6 +1821,7 @@ static void milter8_connect(MILTER8 *milter)
     /* Avoid poor performance when TCP MSS > VSTREAM_BUFSIZE. */
     if (connect_fn == inet_connect)
 	vstream_tweak_tcp(milter->fp);
+    MILTER8_STREAM_BUFSIZE(milter->fp);
 
     /*
      * Open the negotiations by sending what actions the Milter may request
@@ -1873,6 +1943,7 @@ static void milter8_connect(MILTER8 *milter)
     milter->state = MILTER8_STAT_READY;
     milter8_def_reply(milter, 0);
     milter->skip_event_type = 0;
+    milter->reply_event = 0;
 
     /*
      * Secondary negotiations: override lists of macro names.
@@ -1909,6 +1980,36 @@ static void milter8_connect(MILTER8 *milter)
     }
 }
 
+/* milter8_connect_on_demand - connect, or reuse idle connection */
+
+static void milter8_connect_on_demand(MILTER *m)
+{
+    const char *myname = "milter8_connect_on_demand";
+    MILTER8 *milter = (MILTER8 *) m;
+
+    /*
+     * After SMFIC_QUIT_NC the Milter application sends nothing until it
+     * receives the next request. If the socket is readable, then the
+     * application has closed the connection or is out of sync, and we make
+     * a new connection instead.
+     */
+    if (milter->fp != 0) {
+	if (milter->state == MILTER8_STAT_READY
+	    && vstream_peek(milter->fp) == 0
+	    && readable(vstream_fileno(milter->fp)) == 0) {
+	    if (msg_verbose)
+		msg_info("%s: reuse connection to milter %s",
+			 myname, milter->m.name);
+	    return;
+	}
+	if (msg_verbose)
+	    msg_info("%s: drop stale connection to milter %s",
+		     myname, milter->m.name);
+	milter8_close_stream(milter);
+    }
+    milter8_connect(milter);
+}
+
 /* milter8_conn_event - report connect event to Sendmail 8 milter */
 
 static const char *milter8_conn_event(MILTER *m,
@@ -2074,6 +2175,12 @@ static const char *milter8_mail_event(MILTER *m, const char **argv,
 		     myname, milter->m.name, STR(buf));
 	    vstring_free(buf);
 	}
+
+	/*
+	 * A new message starts here. Don't let an SMFIR_SKIP for the body
+	 * of an earlier message on the same connection skip events now.
+	 */
+	milter->skip_event_type = 0;
 	skip_reply = ((milter->ev_mask & SMFIP_NR_MAIL) != 0);
 	return (milter8_event(milter, SMFIC_MAIL, SMFIP_NOMAIL,
 			      skip_reply, macros,
@@ -2278,6 +2385,21 @@ static void milter8_disc_event(MILTER *m)
     case MILTER8_STAT_REJECT_CON:
 #endif
     case MILTER8_STAT_ACCEPT_MSG:
+	if (MILTER8_CAN_QUIT_NC(milter)) {
+	    if (msg_verbose)
+		msg_info("%s: quit milter %s, keep connection",
+			 myname, milter->m.name);
+	    if (milter8_write_cmd(milter, SMFIC_QUIT_NC,
+				  MILTER8_DATA_END) == 0
+		&& vstream_fflush(milter->fp) == 0) {
+		milter->state = MILTER8_STAT_READY;
+		milter8_def_reply(milter, 0);
+		milter->skip_event_type = 0;
+		milter->reply_event = 0;
+		return;
+	    }
+	    break;
+	}
 	if (msg_verbose)
 	    msg_info("%s: quit milter %s", myname, milter->m.name);
 	(void) milter8_write_cmd(milter, SMFIC_QUIT, MILTER8_DATA_END);
@@ -2416,6 +2538,7 @@ static void milter8_body(void *ptr, int rec_type,
     ssize_t space;
     ssize_t count;
     int     skip_reply;
+    ssize_t chunk_size = MILTER8_CHUNK_SIZE(milter);
 
     if (MILTER8_MESSAGE_DONE(milter, msg_ctx))
 	return;
@@ -2452,7 +2575,7 @@ static void milter8_body(void *ptr, int rec_type,
     }
     while (todo > 0) {
 	/* Append one REC_TYPE_NORM or REC_TYPE_CONT to body chunk buffer. */
-	space = MILTER_CHUNK_SIZE - LEN(milter->body);
+	space = chunk_size - LEN(milter->body);
 	if (space <= 0)
 	    msg_panic("%s: bad buffer size: %ld",
 		      myname, (long) LEN(milter->body));
@@ -2461,7 +2584,7 @@ static void milter8_body(void *ptr, int rec_type,
 	bp += count;
 	todo -= count;
 	/* Flush body chunk buffer when full. See also milter8_eob(). */
-	if (LEN(milter->body) == MILTER_CHUNK_SIZE) {
+	if (LEN(milter->body) == chunk_size) {
 	    msg_ctx->resp =
 		milter8_event(milter, SMFIC_BODY, SMFIP_NOBODY,
 			      skip_reply, msg_ctx->eod_macros,
@@ -2521,6 +2644,20 @@ static void milter8_eob(void *ptr)
 		      MILTER8_DATA_END);
 }
 
+/* milter8_message_done - clean up after message inspection */
+
+static void milter8_message_done(MILTER8 *milter)
+{
+    if (milter->fp)
+	vstream_control(milter->fp,
+			CA_VSTREAM_CTL_DOUBLE,
+			CA_VSTREAM_CTL_TIMEOUT(milter->cmd_timeout),
+			CA_VSTREAM_CTL_END);
+    if (milter->state == MILTER8_STAT_MESSAGE
+	|| milter->state == MILTER8_STAT_ACCEPT_MSG)
+	milter->state = MILTER8_STAT_ENVELOPE;
+}
+
 /* milter8_message - send message content and receive reply */
 
 static const char *milter8_message(MILTER *m, VSTREAM *qfile,
@@ -2614,14 +2751,8 @@ static const char *milter8_message(MILTER *m, VSTREAM *qfile,
 	}
 	mime_state_free(mime_state);
 	vstring_free(buf);
-	if (milter->fp)
-	    vstream_control(milter->fp,
-			    CA_VSTREAM_CTL_DOUBLE,
-			    CA_VSTREAM_CTL_TIMEOUT(milter->cmd_timeout),
-			    CA_VSTREAM_CTL_END);
-	if (milter->state == MILTER8_STAT_MESSAGE
-	    || milter->state == MILTER8_STAT_ACCEPT_MSG)
-	    milter->state = MILTER8_STAT_ENVELOPE;
+	if (milter->reply_event == 0)
+	    milter8_message_done(milter);
 	return (msg_ctx.resp);
     default:
 	msg_panic("%s: milter %s: bad state %d",
@@ -2645,6 +2776,40 @@ static const char *milter8_message(MILTER *m, VSTREAM *qfile,
 #define MAIL_ATTR_MILT_ACT	"milter_action"
 #define MAIL_ATTR_MILT_MAC	"milter_macro_list"
 
+/* milter8_deferred_reply - receive deferred reply */
+
+static const char *milter8_deferred_reply(MILTER *m)
+{
+    MILTER8 *milter = (MILTER8 *) m;
+    int     event = milter->reply_event;
+    const char *resp;
+
+    if (event == 0)
+	return (0);
+    milter->reply_event = 0;
+    if (milter->fp == 0)
+	/* The stream was closed after an error. */
+	resp = milter->def_reply;
+    else
+	resp = milter8_event_reply(milter, event);
+    if (event == SMFIC_BODYEOB)
+	milter8_message_done(milter);
+    return (resp);
+}
+
+/* milter8_read_only - report if this milter can't change messages */
+
+static int milter8_read_only(MILTER *m)
+{
+    MILTER8 *milter = (MILTER8 *) m;
+
+#define MILTER8_EDIT_MASK \
+	(SMFIF_ADDHDRS | SMFIF_CHGBODY | SMFIF_ADDRCPT | SMFIF_DELRCPT \
+	| SMFIF_CHGHDRS | SMFIF_CHGFROM | SMFIF_ADDRCPT_PAR)
+
+    return ((milter->rq_mask & MILTER8_EDIT_MASK) == 0);
+}
+
 /* milter8_active - report if this milter still wants events */
 
 static int milter8_active(MILTER *m)
@@ -2799,6 +2964,7 @@ MILTER *milter8_receive(VSTREAM *stream, MILTERS *parent)
 	vstream_control(milter->fp, CA_VSTREAM_CTL_DOUBLE, CA_VSTREAM_CTL_END);
 	/* Avoid poor performance when TCP MSS > VSTREAM_BUFSIZE. */
 	vstream_tweak_sock(milter->fp);
+	MILTER8_STREAM_BUFSIZE(milter->fp);
 	milter->version = version;
 	milter->rq_mask = rq_mask;
 	milter->ev_mask = ev_mask;
@@ -2855,7 +3021,7 @@ static MILTER8 *milter8_alloc(const char *name, int conn_timeout,
     milter->m.parent = parent;
     milter->m.macros = 0;
 #ifdef LIBMILTER_AUTO_DISCONNECT
-    milter->m.connect_on_demand = (void (*) (struct MILTER *)) milter8_connect;
+    milter->m.connect_on_demand = milter8_connect_on_demand;
 #else
     milter->m.connect_on_demand = 0;
 #endif
@@ -2869,6 +3035,8 @@ static MILTER8 *milter8_alloc(const char *name, int conn_timeout,
     milter->m.other_event = milter8_other_event;
     milter->m.abort = milter8_abort;
     milter->m.disc_event = milter8_disc_event;
+    milter->m.deferred_reply = milter8_deferred_reply;
+    milter->m.read_only = milter8_read_only;
     milter->m.active = milter8_active;
     milter->m.send = milter8_send;
     milter->m.free = milter8_free;
@@ -2886,6 +3054,7 @@ static MILTER8 *milter8_alloc(const char *name, int conn_timeout,
     milter->def_action = mystrdup(def_action);
     milter->def_reply = 0;
     milter->skip_event_type = 0;
+    milter->reply_event = 0;
 
     return (milter);
 }
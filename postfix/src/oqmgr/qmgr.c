@@ -108,6 +108,9 @@
 /*	Wakeup call, This is used by the master server to instantiate
 /*	servers that should not go away forever. The action is to start
 /*	an incoming queue scan.
+/* .IP "\fBQ\fIqueueid\fR\e0 (QMGR_REQ_EXPEDITE)\fR"
+/*	Start an incoming queue scan. The queue ID, which is followed
+/*	by a null byte, is ignored.
 /* .PP
 /*	The \fBqmgr\fR(8) daemon reads an entire buffer worth of triggers.
 /*	Multiple identical trigger requests are collapsed into one, and
@@ -401,6 +404,7 @@
 #include <mail_proto.h>			/* QMGR_SCAN constants */
 #include <mail_flow.h>
 #include <flush_clnt.h>
+#include <metrics_clnt.h>
 
 /* Master process interface */
 
@@ -462,11 +466,44 @@ static void qmgr_deferred_run_event(int unused_event, void *dummy)
     event_request_timer(qmgr_deferred_run_event, dummy, var_queue_run_delay);
 }
 
+#define QMGR_METRICS_INTERVAL	10	/* seconds */
+
+/* qmgr_metrics_event - report in-memory queue gauges */
+
+static void qmgr_metrics_event(int unused_event, void *dummy)
+{
+    QMGR_TRANSPORT *transport;
+    QMGR_QUEUE *queue;
+    int     todo;
+    int     busy;
+
+    metrics_gauge("postfix_qmgr_active_messages",
+		  (double) qmgr_message_count, (char *) 0);
+    metrics_gauge("postfix_qmgr_active_recipients",
+		  (double) qmgr_recipient_count, (char *) 0);
+    for (transport = qmgr_transport_list.next; transport;
+	 transport = transport->peers.next) {
+	todo = busy = 0;
+	for (queue = transport->queue_list.next; queue;
+	     queue = queue->peers.next) {
+	    todo += queue->todo_refcount;
+	    busy += queue->busy_refcount;
+	}
+	metrics_gauge("postfix_qmgr_transport_pending", (double) todo,
+		      "transport", transport->name, (char *) 0);
+	metrics_gauge("postfix_qmgr_transport_busy", (double) busy,
+		      "transport", transport->name, (char *) 0);
+    }
+    metrics_flush();
+    event_request_timer(qmgr_metrics_event, dummy, QMGR_METRICS_INTERVAL);
+}
+
 /* qmgr_trigger_event - respond to external trigger(s) */
 
 static void qmgr_trigger_event(char *buf, ssize_t len,
 			               char *unused_service, char **argv)
 {
+    static int skip_queue_id;
     int     incoming_flag = 0;
     int     deferred_flag = 0;
     int     i;
@@ -486,6 +523,17 @@ static void qmgr_trigger_event(char *buf, ssize_t len,
 #define QMGR_FLUSH_BEFORE	(QMGR_FLUSH_ONCE | QMGR_FLUSH_DFXP)
 
     for (i = 0; i < len; i++) {
+
+	/*
+	 * An expedite request names an incoming queue file. Skip the queue
+	 * ID, which may continue in the next trigger buffer, and scan the
+	 * incoming queue instead.
+	 */
+	if (skip_queue_id) {
+	    if (buf[i] == 0)
+		skip_queue_id = 0;
+	    continue;
+	}
 	if (msg_verbose)
 	    msg_info("request: %d (%c)",
 		     buf[i], ISALNUM(buf[i]) ? buf[i] : '?');
@@ -505,6 +553,10 @@ static void qmgr_trigger_event(char *buf, ssize_t len,
 	    deferred_flag |= QMGR_SCAN_ALL;
 	    incoming_flag |= QMGR_SCAN_ALL;
 	    break;
+	case QMGR_REQ_EXPEDITE:
+	    incoming_flag |= QMGR_SCAN_START;
+	    skip_queue_id = 1;
+	    break;
 	default:
 	    if (msg_verbose)
 		msg_info("request ignored");
@@ -662,6 +714,8 @@ static void qmgr_post_init(char *unused_name, char **unused_argv)
     qmgr_scans[QMGR_SCAN_IDX_DEFERRED] = qmgr_scan_create(MAIL_QUEUE_DEFERRED);
     qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_INCOMING], QMGR_SCAN_START);
     qmgr_deferred_run_event(0, (void *) 0);
+    if (var_metrics_enable)
+	qmgr_metrics_event(0, (void *) 0);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
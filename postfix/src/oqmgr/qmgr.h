@@ -318,6 +318,8 @@ struct QMGR_MESSAGE {
     char   *sasl_sender;		/* SASL sender */
     char   *log_ident;			/* up-stream queue ID */
     char   *rewrite_context;		/* address qualification */
+    char   *stage_times;		/* cleanup stage times */
+    struct timeval handoff_time;	/* first delivery request */
     RECIPIENT_LIST rcpt_list;		/* complete addresses */
 };
 
@@ -55,7 +55,9 @@
 /*	into the future by a minimal backoff time, whichever is more.
 /*	The minimal_backoff_time parameter specifies the minimal
 /*	amount of time between delivery attempts; maximal_backoff_time
-/*	specifies an upper limit.
+/*	specifies an upper limit. With enable_stage_timing, a summary
+/*	of per-message stage times is logged before the queue file
+/*	is removed.
 /* DIAGNOSTICS
 /*	Fatal: queue file access failures, out of memory.
 /*	Panic: interface violations, internal consistency errors.
@@ -83,6 +85,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <stdlib.h>
+#include <stdio.h>			/* sscanf() */
 #include <unistd.h>
 #include <string.h>
 #include <utime.h>
@@ -98,6 +101,7 @@
 #include <events.h>
 #include <mymalloc.h>
 #include <vstream.h>
+#include <vstring.h>
 #include <warn_stat.h>
 
 /* Global library. */
@@ -113,6 +117,8 @@
 #include <rec_type.h>
 #include <qmgr_user.h>
 #include <info_log_addr_form.h>
+#include <mail_proto.h>
+#include <replica_clnt.h>
 
 /* Application-specific. */
 
@@ -128,6 +134,7 @@ static void qmgr_active_done_25_generic(QMGR_MESSAGE *);
 static void qmgr_active_done_3_defer_flush(int, void *);
 static void qmgr_active_done_3_defer_warn(int, void *);
 static void qmgr_active_done_3_generic(QMGR_MESSAGE *);
+static void qmgr_active_stages(QMGR_MESSAGE *);
 
 /* qmgr_active_corrupt - move corrupted file out of the way */
 
@@ -172,6 +179,69 @@ static void qmgr_active_defer(const char *queue_name, const char *queue_id,
     }
 }
 
+/* qmgr_active_stages - log per-message stage times */
+
+static void qmgr_active_stages(QMGR_MESSAGE *message)
+{
+    VSTRING *buf;
+    struct timeval now;
+    long    t[7];
+    long    queued;
+    long    active;
+    long    handoff;
+    long    removed;
+
+    /*
+     * The cleanup server stores microsecond offsets from the arrival time:
+     * session (time from connect to MAIL FROM), start of content, end of
+     * content, ready to commit, and time spent in trivial-rewrite, table
+     * lookups, and Milter applications. Unknown values are -1.
+     */
+    if (sscanf(message->stage_times, "%ld %ld %ld %ld %ld %ld %ld",
+	       t, t + 1, t + 2, t + 3, t + 4, t + 5, t + 6) != 7) {
+	msg_warn("%s: ignoring malformed %s attribute: %.100s",
+		 message->queue_id, MAIL_ATTR_STAGE_TIMES,
+		 message->stage_times);
+	return;
+    }
+    GETTIMEOFDAY(&now);
+#define USEC_SINCE_ARRIVAL(tv) ((tv).tv_sec == 0 ? -1L : \
+	(long) ((tv).tv_sec - message->arrival_time.tv_sec) * 1000000L \
+	+ (long) ((tv).tv_usec - message->arrival_time.tv_usec))
+
+    queued = t[3];
+    active = USEC_SINCE_ARRIVAL(message->active_time);
+    handoff = USEC_SINCE_ARRIVAL(message->handoff_time);
+    removed = USEC_SINCE_ARRIVAL(now);
+
+    /*
+     * Log intervals in seconds with microsecond resolution, and omit
+     * intervals whose end points are unknown.
+     */
+#define STAGE_APPEND(name, usec) do { \
+	if ((usec) >= 0) \
+	    vstring_sprintf_append(buf, " %s=%ld.%06ld", (name), \
+				   (usec) / 1000000L, (usec) % 1000000L); \
+    } while (0)
+#define STAGE_DIFF(end, start) \
+	((end) < 0 || (start) < 0 ? -1L : (end) - (start))
+
+    buf = vstring_alloc(100);
+    STAGE_APPEND("session", t[0]);
+    STAGE_APPEND("envelope", t[1]);
+    STAGE_APPEND("data", STAGE_DIFF(t[2], t[1]));
+    STAGE_APPEND("cleanup", STAGE_DIFF(queued, t[2]));
+    STAGE_APPEND("rewrite", t[4]);
+    STAGE_APPEND("maps", t[5]);
+    STAGE_APPEND("milter", t[6]);
+    STAGE_APPEND("queue", STAGE_DIFF(active, queued));
+    STAGE_APPEND("handoff", STAGE_DIFF(handoff, active));
+    STAGE_APPEND("delivery", STAGE_DIFF(removed, handoff));
+    STAGE_APPEND("total", t[0] < 0 ? removed : removed + t[0]);
+    msg_info("%s: stages:%s", message->queue_id, vstring_str(buf));
+    vstring_free(buf);
+}
+
 /* qmgr_active_feed - feed one message into active queue */
 
 int     qmgr_active_feed(QMGR_SCAN *scan_info, const char *queue_id)
@@ -578,8 +648,11 @@ static void qmgr_active_done_3_generic(QMGR_MESSAGE *message)
 	    msg_warn("%s: remove %s from %s: %m", myname,
 		     message->queue_id, message->queue_name);
 	} else {
+	    if (var_stage_timing && message->stage_times)
+		qmgr_active_stages(message);
 	    /* Same format as logged by postsuper. */
 	    msg_info("%s: removed", message->queue_id);
+	    replica_clnt_remove(message->queue_id);
 	}
     }
 
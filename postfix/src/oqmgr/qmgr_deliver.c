@@ -443,6 +443,8 @@ void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
      */
     qmgr_deliver_concurrency++;
     entry->stream = stream;
+    if (entry->message->handoff_time.tv_sec == 0)
+	GETTIMEOFDAY(&entry->message->handoff_time);
     event_enable_read(vstream_fileno(stream),
 		      qmgr_deliver_update, (void *) entry);
 
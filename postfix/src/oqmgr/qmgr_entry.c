@@ -85,7 +85,9 @@
 
 #include <msg.h>
 #include <mymalloc.h>
+#include <mypool.h>
 #include <events.h>
+#include <probes.h>
 #include <vstream.h>
 
 /* Global library. */
@@ -97,6 +99,11 @@
 
 #include "qmgr.h"
 
+ /*
+  * Queue entries are created and destroyed for each delivery request.
+  */
+static MYPOOL *qmgr_entry_pool;
+
 /* qmgr_entry_select - select queue entry for delivery */
 
 QMGR_ENTRY *qmgr_entry_select(QMGR_QUEUE *queue)
@@ -109,6 +116,8 @@ QMGR_ENTRY *qmgr_entry_select(QMGR_QUEUE *queue)
 	queue->todo_refcount--;
 	QMGR_LIST_APPEND(queue->busy, entry);
 	queue->busy_refcount++;
+	POSTFIX_PROBE3(qmgr_entry_select, queue->transport->name,
+		       queue->name, entry->message->queue_id);
 
 	/*
 	 * With opportunistic session caching, the delivery agent must not
@@ -132,14 +141,20 @@ QMGR_ENTRY *qmgr_entry_select(QMGR_QUEUE *queue)
 #define BACK_TO_BACK_DELIVERY() \
 		(queue->last_done + 1 >= event_time())
 
+#define BACKLOG_EXCEEDS_WINDOW() \
+		(queue->todo_refcount + queue->busy_refcount > queue->window)
+
 	/*
 	 * Turn on session caching after we get up to speed. Don't enable
 	 * session caching just because we have concurrent deliveries. This
 	 * prevents unnecessary session caching when we have a burst of mail
-	 * <= the initial concurrency limit.
+	 * <= the initial concurrency limit. But do enable session caching
+	 * when the backlog exceeds the concurrency window: some entries must
+	 * wait for a delivery to finish, and can reuse its session instead of
+	 * making a new one.
 	 */
 	if ((queue->dflags & DEL_REQ_FLAG_CONN_STORE) == 0) {
-	    if (BACK_TO_BACK_DELIVERY()) {
+	    if (BACK_TO_BACK_DELIVERY() || BACKLOG_EXCEEDS_WINDOW()) {
 		if (msg_verbose)
 		    msg_info("%s: allowing on-demand session caching for %s",
 			     myname, queue->name);
@@ -238,7 +253,7 @@ void    qmgr_entry_done(QMGR_ENTRY *entry, int which)
     qmgr_recipient_count -= entry->rcpt_list.len;
     recipient_list_free(&entry->rcpt_list);
 
-    myfree((void *) entry);
+    mypool_free(qmgr_entry_pool, (void *) entry);
 
     /*
      * Maintain back-to-back delivery status.
@@ -314,7 +329,9 @@ QMGR_ENTRY *qmgr_entry_create(QMGR_QUEUE *queue, QMGR_MESSAGE *message)
     /*
      * Create the delivery request.
      */
-    entry = (QMGR_ENTRY *) mymalloc(sizeof(QMGR_ENTRY));
+    if (qmgr_entry_pool == 0)
+	qmgr_entry_pool = mypool_create("qmgr_entry", sizeof(QMGR_ENTRY));
+    entry = (QMGR_ENTRY *) mypool_alloc(qmgr_entry_pool);
     entry->stream = 0;
     entry->message = message;
     recipient_list_init(&entry->rcpt_list, RCPT_LIST_INIT_QUEUE);
@@ -128,6 +128,7 @@
 #include <canon_addr.h>
 #include <record.h>
 #include <rec_type.h>
+#include <rec_size_trailer.h>
 #include <sent.h>
 #include <deliver_completed.h>
 #include <opened.h>
@@ -198,6 +199,8 @@ static QMGR_MESSAGE *qmgr_message_create(const char *queue_name,
     message->sasl_sender = 0;
     message->log_ident = 0;
     message->rewrite_context = 0;
+    message->stage_times = 0;
+    message->handoff_time.tv_sec = message->handoff_time.tv_usec = 0;
     recipient_list_init(&message->rcpt_list, RCPT_LIST_INIT_QUEUE);
     return (message);
 }
@@ -544,6 +547,15 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	    continue;
 	if (rec_type == REC_TYPE_SIZE) {
 	    if (message->data_offset == 0) {
+		if (strcmp(start, REC_TYPE_SIZE_TRAILER) == 0) {
+		    if (rec_size_trailer(message->fp, buf) != REC_TYPE_SIZE) {
+			msg_warn("%s: message rejected: bad size trailer",
+				 message->queue_id);
+			rec_type = REC_TYPE_ERROR;
+			break;
+		    }
+		    start = vstring_str(buf);
+		}
 		if ((count = sscanf(start, "%ld %ld %d %d %ld %d",
 				 &message->data_size, &message->data_offset,
 				    &nrcpt, &message->rflags,
@@ -723,6 +735,9 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			     message->queue_id, MAIL_ATTR_LOG_IDENT, value);
+	    } else if (strcmp(name, MAIL_ATTR_STAGE_TIMES) == 0) {
+		if (message->stage_times == 0)
+		    message->stage_times = mystrdup(value);
 	    } else if (strcmp(name, MAIL_ATTR_RWR_CONTEXT) == 0) {
 		if (message->rewrite_context == 0)
 		    message->rewrite_context = mystrdup(value);
@@ -1365,6 +1380,8 @@ void    qmgr_message_free(QMGR_MESSAGE *message)
 	myfree(message->sasl_sender);
     if (message->log_ident)
 	myfree(message->log_ident);
+    if (message->stage_times)
+	myfree(message->stage_times);
     if (message->rewrite_context)
 	myfree(message->rewrite_context);
     recipient_list_free(&message->rcpt_list);
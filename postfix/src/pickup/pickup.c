@@ -8,7 +8,9 @@
 /* DESCRIPTION
 /*	The \fBpickup\fR(8) daemon waits for hints that new mail has been
 /*	dropped into the \fBmaildrop\fR directory, and feeds it into the
-/*	\fBcleanup\fR(8) daemon.
+/*	\fBcleanup\fR(8) daemon. Optionally, the \fBpickup\fR(8) daemon
+/*	sends the next message to another \fBcleanup\fR(8) server
+/*	before the preceding messages are safely queued.
 /*	Ill-formatted files are deleted without notifying the originator.
 /*	This program expects to be run from the \fBmaster\fR(8) process
 /*	manager.
@@ -90,6 +92,11 @@
 /* .IP "\fBinfo_log_address_format (external)\fR"
 /*	The email address form that will be used in non-debug logging
 /*	(info, warning, etc.).
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBpickup_cleanup_parallelism (1)\fR"
+/*	The maximal number of messages that the \fBpickup\fR(8) daemon
+/*	has in flight to \fBcleanup\fR(8) servers.
 /* SEE ALSO
 /*	cleanup(8), message canonicalization
 /*	sendmail(1), Sendmail-compatible interface
@@ -166,6 +173,7 @@
 
 char   *var_filter_xport;
 char   *var_input_transp;
+int     var_pickup_parallel;
 
  /*
   * Structure to bundle a bunch of information about a queue file.
@@ -175,6 +183,7 @@ typedef struct {
     struct stat st;			/* queue file status */
     char   *path;			/* name for open/remove */
     char   *sender;			/* sender address */
+    VSTREAM *cleanup;			/* awaiting cleanup reply */
 } PICKUP_INFO;
 
  /*
@@ -184,6 +193,13 @@ typedef struct {
   */
 #define REMOVE_MESSAGE_FILE	1
 #define KEEP_MESSAGE_FILE	2
+#define AWAIT_CLEANUP_REPLY	3
+
+ /*
+  * Messages that were sent to a cleanup server, oldest first.
+  */
+static PICKUP_INFO *pickup_pending;
+static int pickup_pending_count;
 
  /*
   * Transparency: before mail is queued, do we allow address mapping,
@@ -407,11 +423,25 @@ static int pickup_copy(VSTREAM *qfile, VSTREAM *cleanup,
 	return (status);
 
     /*
-     * There are no errors. Send the end-of-data marker, and get the cleanup
-     * service completion status. XXX Since the pickup service is unable to
-     * bounce, the cleanup service can report only soft errors here.
+     * There are no errors. Send the end-of-data marker. The caller decides
+     * when to receive the cleanup service completion status.
      */
     rec_fputs(cleanup, REC_TYPE_END, "");
+    if (vstream_fflush(cleanup) != 0)
+	return (cleanup_service_error(info, CLEANUP_STAT_WRITE));
+    return (0);
+}
+
+/* pickup_reply - receive cleanup service completion status */
+
+static int pickup_reply(VSTREAM *cleanup, PICKUP_INFO *info, VSTRING *buf)
+{
+    int     status;
+
+    /*
+     * XXX Since the pickup service is unable to bounce, the cleanup service
+     * can report only soft errors here.
+     */
     if (attr_scan(cleanup, ATTR_FLAG_MISSING,
 		  RECV_ATTR_INT(MAIL_ATTR_STATUS, &status),
 		  RECV_ATTR_STR(MAIL_ATTR_WHY, buf),
@@ -497,10 +527,20 @@ static int pickup_file(PICKUP_INFO *info)
 	status = KEEP_MESSAGE_FILE;
     } else {
 	info->id = mystrdup(vstring_str(buf));
-	status = pickup_copy(qfile, cleanup, info, buf);
+	if ((status = pickup_copy(qfile, cleanup, info, buf)) == 0) {
+	    if (var_pickup_parallel > 1) {
+		info->cleanup = cleanup;
+		pickup_pending[pickup_pending_count++] = *info;
+		cleanup = 0;
+		status = AWAIT_CLEANUP_REPLY;
+	    } else {
+		status = pickup_reply(cleanup, info, buf);
+	    }
+	}
     }
     vstream_fclose(qfile);
-    vstream_fclose(cleanup);
+    if (cleanup)
+	vstream_fclose(cleanup);
     vstring_free(buf);
     return (status);
 }
@@ -512,6 +552,7 @@ static void pickup_init(PICKUP_INFO *info)
     info->id = 0;
     info->path = 0;
     info->sender = 0;
+    info->cleanup = 0;
 }
 
 /* pickup_free - wipe info structure */
@@ -525,6 +566,40 @@ static void pickup_free(PICKUP_INFO *info)
     SAFE_FREE(info->sender);
 }
 
+/* pickup_done - remove message file if requested */
+
+static int pickup_done(PICKUP_INFO *info, int status)
+{
+    int     removed = 0;
+
+    if (status == REMOVE_MESSAGE_FILE) {
+	if (REMOVE(info->path))
+	    msg_warn("remove %s: %m", info->path);
+	else
+	    removed = 1;
+    }
+    pickup_free(info);
+    return (removed);
+}
+
+/* pickup_wait - finish the oldest message that was sent to cleanup */
+
+static int pickup_wait(void)
+{
+    VSTRING *buf = vstring_alloc(100);
+    PICKUP_INFO info = pickup_pending[0];
+    int     status;
+
+    pickup_pending_count -= 1;
+    memmove((void *) pickup_pending, (void *) (pickup_pending + 1),
+	    sizeof(*pickup_pending) * pickup_pending_count);
+    watchdog_pat();
+    status = pickup_reply(info.cleanup, &info, buf);
+    vstream_fclose(info.cleanup);
+    vstring_free(buf);
+    return (pickup_done(&info, status));
+}
+
 /* pickup_service - service client */
 
 static void pickup_service(char *unused_buf, ssize_t unused_len,
@@ -536,6 +611,7 @@ static void pickup_service(char *unused_buf, ssize_t unused_len,
     const char *path;
     char   *id;
     int     file_count;
+    int     status;
 
     /*
      * Sanity check. This service takes no command-line arguments.
@@ -552,6 +628,9 @@ static void pickup_service(char *unused_buf, ssize_t unused_len,
      * When we find a file, stroke the watchdog so that it will not bark while
      * some application is keeping us busy by injecting lots of mail into the
      * maildrop directory.
+     * 
+     * Receive all pending cleanup replies before scanning the directory
+     * again, so that we won't send the same file twice.
      */
     queue_name = MAIL_QUEUE_MAILDROP;		/* XXX should be a list */
     do {
@@ -559,18 +638,18 @@ static void pickup_service(char *unused_buf, ssize_t unused_len,
 	scan = scan_dir_open(queue_name);
 	while ((id = scan_dir_next(scan)) != 0) {
 	    if (mail_open_ok(queue_name, id, &info.st, &path) == MAIL_OPEN_YES) {
+		if (var_pickup_parallel > 1
+		    && pickup_pending_count >= var_pickup_parallel)
+		    file_count += pickup_wait();
 		pickup_init(&info);
 		info.path = mystrdup(path);
 		watchdog_pat();
-		if (pickup_file(&info) == REMOVE_MESSAGE_FILE) {
-		    if (REMOVE(info.path))
-			msg_warn("remove %s: %m", info.path);
-		    else
-			file_count++;
-		}
-		pickup_free(&info);
+		if ((status = pickup_file(&info)) != AWAIT_CLEANUP_REPLY)
+		    file_count += pickup_done(&info, status);
 	    }
 	}
+	while (pickup_pending_count > 0)
+	    file_count += pickup_wait();
 	scan_dir_close(scan);
     } while (file_count);
 }
@@ -592,6 +671,10 @@ static void post_jail_init(char *unused_name, char **unused_argv)
      */
     pickup_input_transp_mask =
 	input_transp_mask(VAR_INPUT_TRANSP, var_input_transp);
+
+    if (var_pickup_parallel > 1)
+	pickup_pending = (PICKUP_INFO *)
+	    mymalloc(sizeof(*pickup_pending) * var_pickup_parallel);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -605,6 +688,10 @@ int     main(int argc, char **argv)
 	VAR_INPUT_TRANSP, DEF_INPUT_TRANSP, &var_input_transp, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_PICKUP_PARALLEL, DEF_PICKUP_PARALLEL, &var_pickup_parallel, 1, 0,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -623,6 +710,7 @@ int     main(int argc, char **argv)
      * submissions.
      */
     trigger_server_main(argc, argv, pickup_service,
+			CA_MAIL_SERVER_INT_TABLE(int_table),
 			CA_MAIL_SERVER_STR_TABLE(str_table),
 			CA_MAIL_SERVER_POST_INIT(post_jail_init),
 			CA_MAIL_SERVER_SOLITARY,
@@ -173,6 +173,41 @@
 /* NOTE: DO NOT put quotes around the command, $sender, or $recipient.
 /* .IP
 /*	This feature is available as of Postfix 2.3.
+/* .IP "\fBpersistent\fR=\fByes\fR|\fBno\fR (optional, default: \fBno\fR)"
+/*	Start the command once per \fBpipe\fR(8) process, and deliver
+/*	all messages for that process to the same command, instead
+/*	of executing the command for each message. This avoids
+/*	fork/exec and interpreter start-up overhead for commands
+/*	written in scripting languages. The command terminates when
+/*	its standard input reaches end-of-file, which happens when
+/*	the \fBpipe\fR(8) process terminates (see \fBmax_idle\fR and
+/*	\fBmax_use\fR).
+/* .sp
+/*	For each message, the command receives on standard input
+/*	\fIname\fB=\fIvalue\fR envelope lines for \fBsender\fR,
+/*	\fBqueue_id\fR, \fBnexthop\fR, and \fBsize\fR, followed by
+/*	\fBoriginal_recipient\fR and \fBrecipient\fR for each
+/*	recipient, and an empty line. Then follows the message
+/*	content, with lines that start with "." prefixed with
+/*	another ".", terminated with a line that contains only ".".
+/*	The sender, recipient, and nexthop values are subject to
+/*	the \fBq\fR, \fBu\fR, and \fBh\fR flags, as with the
+/*	corresponding command-line macros. A message is returned
+/*	as undeliverable when an envelope value contains a control
+/*	character.
+/*	The command must reply on standard output with one line
+/*	that contains a \fB<sysexits.h>\fR compatible status (zero
+/*	means success), optionally followed by whitespace and text.
+/*	Text that starts with an RFC 3463 enhanced status code is
+/*	handled as with non-persistent commands.
+/* .sp
+/*	The command argument vector is not subject to macro
+/*	expansion. When the command does not reply within
+/*	\fItransport\fB_time_limit\fR seconds, or when it breaks
+/*	the protocol, the command is terminated and the message is
+/*	deferred.
+/* .sp
+/*	This feature is available as of Postfix 3.9.
 /* .IP "\fBsize\fR=\fIsize_limit\fR (optional)"
 /*	Don't deliver messages that exceed this size limit (in
 /*	bytes); return them to the sender instead.
@@ -464,14 +499,21 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <syslog.h>
 #include <pwd.h>
 #include <grp.h>
 #include <fcntl.h>
 #include <ctype.h>
 
+#ifdef USE_PATHS_H
+#include <paths.h>
+#endif
+
 #ifdef STRCASECMP_IN_STRINGS_H
 #include <strings.h>
 #endif
@@ -480,6 +522,7 @@
 
 #include <msg.h>
 #include <vstream.h>
+#include <vstring_vstream.h>
 #include <vstring.h>
 #include <argv.h>
 #include <htable.h>
@@ -488,6 +531,9 @@
 #include <mymalloc.h>
 #include <mac_parse.h>
 #include <set_eugid.h>
+#include <set_ugid.h>
+#include <chroot_uid.h>
+#include <clean_env.h>
 #include <split_at.h>
 #include <stringops.h>
 
@@ -612,6 +658,7 @@ typedef struct {
     VSTRING *eol;			/* output record delimiter */
     VSTRING *null_sender;		/* null sender expansion */
     off_t   size_limit;			/* max size in bytes we will accept */
+    int     persistent;			/* long-running command */
 } PIPE_ATTR;
 
  /*
@@ -883,6 +930,7 @@ static void get_service_attr(PIPE_ATTR *attr, char **argv)
     attr->eol = vstring_strcpy(vstring_alloc(1), "\n");
     attr->null_sender = vstring_strcpy(vstring_alloc(1), MAIL_ADDR_MAIL_DAEMON);
     attr->size_limit = 0;
+    attr->persistent = 0;
 
     /*
      * Iterate over the command-line attribute list.
@@ -992,6 +1040,20 @@ static void get_service_attr(PIPE_ATTR *attr, char **argv)
 		msg_fatal("%s: bad size= value: %s", myname, size);
 	}
 
+	/*
+	 * persistent=yes|no
+	 */
+	else if (strncasecmp("persistent=", *argv,
+			     sizeof("persistent=") - 1) == 0) {
+	    cp = *argv + sizeof("persistent=") - 1;
+	    if (strcasecmp(cp, "yes") == 0)
+		attr->persistent = 1;
+	    else if (strcasecmp(cp, "no") == 0)
+		attr->persistent = 0;
+	    else
+		msg_fatal("%s: bad persistent= value: %s", myname, cp);
+	}
+
 	/*
 	 * argv=command...
 	 */
@@ -1033,9 +1095,9 @@ static void get_service_attr(PIPE_ATTR *attr, char **argv)
      * Give the poor tester a clue of what is going on.
      */
     if (msg_verbose)
-	msg_info("%s: uid %ld, gid %ld, flags %d, size %ld",
+	msg_info("%s: uid %ld, gid %ld, flags %d, size %ld, persistent %d",
 		 myname, (long) attr->uid, (long) attr->gid,
-		 attr->flags, (long) attr->size_limit);
+		 attr->flags, (long) attr->size_limit, attr->persistent);
 }
 
 /* eval_command_status - do something with command completion status */
@@ -1111,6 +1173,318 @@ static int eval_command_status(int command_status, char *service,
     return (result);
 }
 
+ /*
+  * Persistent command state. Each pipe(8) process runs at most one
+  * persistent command, which lives as long as the pipe(8) process, or until
+  * the command misbehaves.
+  */
+typedef struct {
+    pid_t   pid;			/* command process, or zero */
+    VSTREAM *to_cmd;			/* command standard input */
+    VSTREAM *from_cmd;			/* command standard output */
+} PIPE_WORKER;
+
+static PIPE_WORKER pipe_worker;
+
+#define PIPE_WORKER_REPLY_MAX	1000	/* status reply length limit */
+
+/* pipe_worker_stop - forcibly terminate persistent command */
+
+static void pipe_worker_stop(PIPE_ATTR *attr)
+{
+    WAIT_STATUS_T wait_status;
+
+    if (pipe_worker.pid == 0)
+	return;
+    (void) vstream_fclose(pipe_worker.to_cmd);
+    (void) vstream_fclose(pipe_worker.from_cmd);
+
+    /*
+     * Switch privileges to that of the command. Terminate the command and
+     * its offspring.
+     */
+    set_eugid(attr->uid, attr->gid);
+    if (kill(-pipe_worker.pid, SIGKILL) < 0)
+	(void) kill(pipe_worker.pid, SIGKILL);
+    set_eugid(var_owner_uid, var_owner_gid);
+    if (waitpid(pipe_worker.pid, &wait_status, 0) < 0)
+	msg_warn("waitpid: %m");
+    pipe_worker.pid = 0;
+}
+
+/* pipe_worker_start - start persistent command */
+
+static int pipe_worker_start(PIPE_ATTR *attr, DSN_BUF *why)
+{
+    int     to_cmd[2];
+    int     from_cmd[2];
+    ARGV   *export_env;
+    pid_t   pid;
+
+    if (pipe(to_cmd) < 0 || pipe(from_cmd) < 0)
+	msg_fatal("pipe: %m");
+
+    switch (pid = fork()) {
+
+	/*
+	 * Error. Back off, and try again later.
+	 */
+    case -1:
+	msg_warn("fork: %m");
+	(void) close(to_cmd[0]);
+	(void) close(to_cmd[1]);
+	(void) close(from_cmd[0]);
+	(void) close(from_cmd[1]);
+	dsb_unix(why, "4.3.0", sys_exits_detail(EX_OSERR)->text,
+		 "Delivery failed: %m");
+	return (-1);
+
+	/*
+	 * Child. Same privilege, directory and environment plumbing as with
+	 * pipe_command(). There is no command output to capture, so errors
+	 * are logged by the child itself.
+	 */
+    case 0:
+	if (attr->chroot_dir) {
+	    if (seteuid(0) < 0)
+		msg_fatal("seteuid(0): %m");
+	    chroot_uid(attr->chroot_dir, (char *) 0);
+	}
+	set_ugid(attr->uid, attr->gid);
+	if (setsid() < 0)
+	    msg_warn("setsid failed: %m");
+	(void) close(to_cmd[1]);
+	(void) close(from_cmd[0]);
+	if (DUP2(to_cmd[0], STDIN_FILENO) < 0
+	    || DUP2(from_cmd[1], STDOUT_FILENO) < 0)
+	    msg_fatal("dup2: %m");
+	(void) close(to_cmd[0]);
+	(void) close(from_cmd[1]);
+	if (attr->exec_dir && chdir(attr->exec_dir) < 0)
+	    msg_fatal("cannot change directory to \"%s\" for uid=%lu gid=%lu: %m",
+		      attr->exec_dir, (unsigned long) attr->uid,
+		      (unsigned long) attr->gid);
+	export_env = mail_parm_split(VAR_EXPORT_ENVIRON, var_export_environ);
+	clean_env(export_env->argv);
+	if (setenv("PATH", _PATH_DEFPATH, 1))
+	    msg_fatal("setenv: %m");
+	closelog();
+	execvp(attr->command[0], attr->command);
+	msg_fatal("execvp %s: %m", attr->command[0]);
+	/* NOTREACHED */
+
+	/*
+	 * Parent.
+	 */
+    default:
+	if (msg_verbose)
+	    msg_info("started persistent command %s, pid %lu",
+		     attr->command[0], (unsigned long) pid);
+	(void) close(to_cmd[0]);
+	(void) close(from_cmd[1]);
+	close_on_exec(to_cmd[1], CLOSE_ON_EXEC);
+	close_on_exec(from_cmd[0], CLOSE_ON_EXEC);
+	pipe_worker.pid = pid;
+	pipe_worker.to_cmd = vstream_fdopen(to_cmd[1], O_WRONLY);
+	pipe_worker.from_cmd = vstream_fdopen(from_cmd[0], O_RDONLY);
+	return (0);
+    }
+}
+
+/* pipe_worker_envelope - append one envelope line */
+
+static int pipe_worker_envelope(VSTRING *buf, const char *name,
+				        const char *value)
+{
+    const char *cp;
+
+    /*
+     * The name=value protocol has no quoting. Don't let a value inject
+     * envelope lines or terminate the envelope early.
+     */
+    for (cp = value; *cp; cp++)
+	if (ISCNTRL(*cp))
+	    return (-1);
+    vstring_sprintf_append(buf, "%s=%s\n", name, value);
+    return (0);
+}
+
+/* pipe_worker_deliver - deliver message to persistent command */
+
+static int pipe_worker_deliver(DELIVER_REQUEST *request, PIPE_PARAMS *conf,
+			               PIPE_ATTR *attr, const char *sender,
+			               DSN_BUF *why)
+{
+    RECIPIENT_LIST *rcpt_list = &request->rcpt_list;
+    static VSTRING *reply;
+    static VSTRING *envelope;
+    static VSTRING *buf;
+    WAIT_STATUS_T wait_status;
+    const SYS_EXITS_DETAIL *sp;
+    DSN_SPLIT dp;
+    VSTREAM *content;
+    int     write_status;
+    int     fd;
+    int     n;
+    char   *text;
+    char   *end;
+    long    code;
+
+    if (reply == 0) {
+	reply = vstring_alloc(100);
+	envelope = vstring_alloc(100);
+	buf = vstring_alloc(100);
+    }
+
+    /*
+     * Format the envelope as name=value lines, terminated with an empty
+     * line. Addresses are quoted and case-folded as with command-line macro
+     * expansion.
+     */
+#define PIPE_WORKER_ENVELOPE(name, value, dsn) do { \
+	if (pipe_worker_envelope(envelope, (name), (value)) < 0) { \
+	    dsb_simple(why, (dsn), "control character in envelope %s: %s", \
+		       (name), printable(STR(buf), '?')); \
+	    return (PIPE_STAT_BOUNCE); \
+	} \
+    } while (0)
+
+    VSTRING_RESET(envelope);
+    if (*sender && (attr->flags & PIPE_OPT_QUOTE_LOCAL))
+	quote_822_local(buf, sender);
+    else
+	vstring_strcpy(buf, sender);
+    PIPE_WORKER_ENVELOPE("sender", STR(buf), "5.1.7");
+    vstring_strcpy(buf, request->queue_id);
+    PIPE_WORKER_ENVELOPE("queue_id", STR(buf), "5.3.5");
+    if (attr->flags & PIPE_OPT_FOLD_HOST)
+	casefold(buf, request->nexthop);
+    else
+	vstring_strcpy(buf, request->nexthop);
+    PIPE_WORKER_ENVELOPE("nexthop", STR(buf), "5.3.5");
+    vstring_sprintf_append(envelope, "size=%ld\n", (long) request->data_size);
+    for (n = 0; n < rcpt_list->len; n++) {
+	morph_recipient(buf, rcpt_list->info[n].orig_addr, attr->flags);
+	PIPE_WORKER_ENVELOPE("original_recipient", STR(buf), "5.1.3");
+	morph_recipient(buf, rcpt_list->info[n].address, attr->flags);
+	PIPE_WORKER_ENVELOPE("recipient", STR(buf), "5.1.3");
+    }
+    VSTRING_ADDCH(envelope, '\n');
+    VSTRING_TERMINATE(envelope);
+
+    /*
+     * Restart the command if it has terminated since the previous delivery.
+     */
+    if (pipe_worker.pid != 0
+	&& waitpid(pipe_worker.pid, &wait_status, WNOHANG) == pipe_worker.pid) {
+	msg_warn("persistent command %s terminated unexpectedly",
+		 attr->command[0]);
+	(void) vstream_fclose(pipe_worker.to_cmd);
+	(void) vstream_fclose(pipe_worker.from_cmd);
+	pipe_worker.pid = 0;
+    }
+    if (pipe_worker.pid == 0 && pipe_worker_start(attr, why) < 0)
+	return (PIPE_STAT_DEFER);
+    vstream_control(pipe_worker.to_cmd,
+		    CA_VSTREAM_CTL_TIMEOUT(conf->time_limit),
+		    CA_VSTREAM_CTL_END);
+    vstream_control(pipe_worker.from_cmd,
+		    CA_VSTREAM_CTL_TIMEOUT(conf->time_limit),
+		    CA_VSTREAM_CTL_END);
+
+    /*
+     * Send the envelope.
+     */
+    vstream_fwrite(pipe_worker.to_cmd, STR(envelope), VSTRING_LEN(envelope));
+    write_status = vstream_fflush(pipe_worker.to_cmd) ?
+	MAIL_COPY_STAT_WRITE : 0;
+
+    /*
+     * Send the content with dot-stuffing, terminated with a line that
+     * contains only ".". mail_copy() closes its output stream, so we give it
+     * a stream of its own.
+     */
+    if (write_status == 0) {
+	if ((fd = dup(vstream_fileno(pipe_worker.to_cmd))) < 0)
+	    msg_fatal("dup: %m");
+	content = vstream_fdopen(fd, O_WRONLY);
+	vstream_control(content,
+			CA_VSTREAM_CTL_TIMEOUT(conf->time_limit),
+			CA_VSTREAM_CTL_END);
+	write_status = mail_copy(sender, rcpt_list->info[0].orig_addr,
+				 rcpt_list->info[0].address, request->fp,
+				 content, attr->flags | MAIL_COPY_DOT,
+				 STR(attr->eol), why);
+    }
+    if (write_status == 0) {
+	vstream_fprintf(pipe_worker.to_cmd, ".%s", STR(attr->eol));
+	if (vstream_fflush(pipe_worker.to_cmd))
+	    write_status = MAIL_COPY_STAT_WRITE;
+    }
+
+    /*
+     * After an incomplete message, the command and Postfix no longer agree
+     * on the protocol state.
+     */
+    if (write_status & MAIL_COPY_STAT_CORRUPT) {
+	pipe_worker_stop(attr);
+	return (PIPE_STAT_CORRUPT);
+    }
+    if (write_status & MAIL_COPY_STAT_READ) {
+	pipe_worker_stop(attr);
+	return (PIPE_STAT_DEFER);
+    }
+
+    /*
+     * Read the per-message status reply: a <sysexits.h> compatible status,
+     * optionally followed by text. Text that starts with an enhanced status
+     * code takes precedence over a non-zero status, as with pipe_command().
+     */
+    if (write_status != 0
+	|| vstring_get_nonl_bound(reply, pipe_worker.from_cmd,
+				  PIPE_WORKER_REPLY_MAX) == VSTREAM_EOF) {
+	dsb_unix(why, "4.3.0", sys_exits_detail(EX_TEMPFAIL)->text,
+		 "%s: \"%s\"", vstream_ftimeout(pipe_worker.to_cmd)
+		 || vstream_ftimeout(pipe_worker.from_cmd) ?
+		 "Command time limit exceeded" :
+		 "Persistent command terminated", attr->command[0]);
+	pipe_worker_stop(attr);
+	return (PIPE_STAT_DEFER);
+    }
+    code = strtol(STR(reply), &end, 10);
+    if (end == STR(reply) || code < 0 || (*end != 0 && !ISSPACE(*end))) {
+	msg_warn("persistent command %s: malformed status reply: %.100s",
+		 attr->command[0], STR(reply));
+	dsb_unix(why, "4.3.0", sys_exits_detail(EX_PROTOCOL)->text,
+		 "Malformed command status reply: \"%s\"", attr->command[0]);
+	pipe_worker_stop(attr);
+	return (PIPE_STAT_DEFER);
+    }
+    while (*end && ISSPACE(*end))
+	end++;
+    text = printable(end, '_');
+    if (code == 0) {
+	vstring_strcpy(why->reason, text);
+	return (PIPE_STAT_OK);
+    } else if (dsn_valid(text) > 0) {
+	dsn_split(&dp, "5.3.0", text);
+	dsb_unix(why, DSN_STATUS(dp.dsn), dp.text, "%s", dp.text);
+	return (DSN_CLASS(dp.dsn) == '4' ? PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
+    } else if (SYS_EXITS_CODE(code)) {
+	sp = sys_exits_detail(code);
+	dsb_unix(why, sp->dsn, *text ? text : sp->text, "%s%s%s", sp->text,
+		 *text ? ". Command output: " : "", text);
+	return (sp->dsn[0] == '4' ? PIPE_STAT_DEFER : PIPE_STAT_BOUNCE);
+    } else {
+	sp = sys_exits_detail(code);
+	dsb_unix(why, sp->dsn, *text ? text : sp->text,
+		 "Command returned status %ld: \"%s\"%s%s",
+		 code, attr->command[0],
+		 *text ? ". Command output: " : "", text);
+	return (PIPE_STAT_BOUNCE);
+    }
+}
+
 /* deliver_message - deliver message with extreme prejudice */
 
 static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
@@ -1289,6 +1663,19 @@ static int deliver_message(DELIVER_REQUEST *request, char *service, char **argv)
 		request->dsn_envid);
     vstring_free(buf);
 
+    /*
+     * A persistent command receives the envelope with each message, instead
+     * of command-line arguments.
+     */
+    if (attr.persistent) {
+	command_status = pipe_worker_deliver(request, &conf, &attr,
+					     sender, why);
+	deliver_status = eval_command_status(command_status, service,
+					     request, &attr, why);
+	DELIVER_MSG_CLEANUP();
+	return (deliver_status);
+    }
+
     if ((expanded_argv = expand_argv(service, attr.command,
 				     rcpt_list, attr.flags)) == 0) {
 	dsb_simple(why, "4.3.5", "mail system configuration error");
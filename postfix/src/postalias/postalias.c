@@ -56,6 +56,10 @@
 /*	Incremental mode. Read entries from standard input and do not
 /*	truncate an existing database. By default, \fBpostalias\fR(1) creates
 /*	a new database from the entries in \fIfile_name\fR.
+/* .sp
+/*	With Postfix 3.9 and later, when standard input is a regular
+/*	file, an \fBlmdb\fR database is updated with one transaction,
+/*	so that readers see either none or all of the changes.
 /* .IP \fB-N\fR
 /*	Include the terminating null character that terminates lookup keys
 /*	and values. By default, \fBpostalias\fR(1) does whatever
@@ -327,6 +331,17 @@ static void postalias(char *map_type, char *path_name, int postalias_flags,
     if (fstat(vstream_fileno(source_fp), &st) < 0)
 	msg_fatal("fstat %s: %m", path_name);
 
+    /*
+     * In incremental mode, apply input from a regular file as one bulk
+     * update, so that a transactional database (lmdb) commits all changes
+     * at once instead of one transaction per entry. A bulk update may be
+     * restarted from the beginning after a recoverable error, and that
+     * requires input that can be rewound.
+     */
+    if ((open_flags & O_TRUNC) == 0 && S_ISREG(st.st_mode)
+	&& strcmp(map_type, DICT_TYPE_PROXY) != 0)
+	dict_flags |= DICT_FLAG_BULK_UPDATE;
+
     /*
      * Turn off group/other read permissions as indicated in the source file.
      */
@@ -128,6 +128,7 @@
 
 #include <record.h>
 #include <rec_type.h>
+#include <rec_size_trailer.h>
 #include <mail_queue.h>
 #include <mail_conf.h>
 #include <mail_params.h>
@@ -181,6 +182,7 @@ static void postcat(VSTREAM *fp, VSTRING *buffer, int flags)
     int     do_print;			/* state machine, output control */
     long    data_offset;		/* state machine, read optimization */
     long    data_size;			/* state machine, read optimization */
+    int     have_trailer;		/* size record at end of file */
 
 #define TEXT_RECORD(rec_type) \
 	    (rec_type == REC_TYPE_CONT || rec_type == REC_TYPE_NORM)
@@ -222,6 +224,7 @@ static void postcat(VSTREAM *fp, VSTRING *buffer, int flags)
     state = PC_STATE_ENV;
     do_print = (flags & PC_FLAG_PRINT_ENV);
     data_offset = data_size = -1;
+    have_trailer = 0;
 
     /*
      * Now look at the rest.
@@ -341,8 +344,16 @@ static void postcat(VSTREAM *fp, VSTRING *buffer, int flags)
 		PRINT_RECORD(flags, offset, rec_type, STR(buffer));
 	    /* Read the message size/offset for the state machine optimizer. */
 	    if (data_size >= 0 || data_offset >= 0) {
-		msg_warn("file contains multiple size records");
+		/* The size trailer is expected in raw mode. */
+		if (have_trailer == 0)
+		    msg_warn("file contains multiple size records");
 	    } else {
+		/* The actual values are in a trailer at the end of the file. */
+		if (strcmp(STR(buffer), REC_TYPE_SIZE_TRAILER) == 0) {
+		    if (rec_size_trailer(fp, buffer) != REC_TYPE_SIZE)
+			msg_fatal("bad size trailer, or input is not seekable");
+		    have_trailer = 1;
+		}
 		if (sscanf(STR(buffer), "%ld %ld", &data_size, &data_offset) != 2
 		    || data_offset <= 0 || data_size <= 0)
 		    msg_warn("invalid size record: %.100s", STR(buffer));
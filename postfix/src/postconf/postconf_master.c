@@ -343,7 +343,16 @@ static void pcf_check_master_entry(ARGV *argv, const char *raw_text)
 		      cp, raw_text);
 
     cp = argv->argv[PCF_MASTER_FLD_MAXPROC];
-    if (strcmp("-", cp) != 0 && cp[strspn(cp, "0123456789")] != 0)
+    len = strcspn(cp, ":/");
+    if (len == 0
+	|| (!(cp[0] == '-' && len == 1) && strspn(cp, "0123456789") != len)
+	|| (cp[len] == ':' && (cp[len + 1] == 0
+			       || (len = len + 1 + strspn(cp + len + 1,
+							  "0123456789"),
+				   cp[len] != 0 && cp[len] != '/')))
+	|| (cp[len] == '/' && (cp[len + 1] == 0
+			       || strspn(cp + len + 1, "0123456789")
+			       != strlen(cp + len + 1))))
 	pcf_fix_fatal("invalid " PCF_MASTER_NAME_MAXPROC " field \"%s\" in \"%s\"",
 		      cp, raw_text);
 }
@@ -9,6 +9,15 @@
 /*	The \fBpostdrop\fR(1) command creates a file in the \fBmaildrop\fR
 /*	directory and copies its standard input to the file.
 /*
+/*	Optionally, the \fBpostdrop\fR(1) command sends its standard
+/*	input directly to the \fBcleanup\fR(8) service, and does
+/*	what the \fBpickup\fR(8) daemon would do: it adds a
+/*	\fBReceived:\fR header with the submitting user ID, and
+/*	applies the main.cf content filter and receive override
+/*	settings. When the \fBcleanup\fR(8) service is not available,
+/*	the \fBpostdrop\fR(1) command uses the \fBmaildrop\fR directory
+/*	as usual.
+/*
 /*	Options:
 /* .IP "\fB-c \fIconfig_dir\fR"
 /*	The \fBmain.cf\fR configuration file is in the named directory
@@ -94,6 +103,17 @@
 /* .IP "\fBrecipient_delimiter (empty)\fR"
 /*	The set of characters that can separate an email address
 /*	localpart, user name, or a .forward file name from its extension.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBpostdrop_direct_cleanup (no)\fR"
+/*	Enable direct submission from the \fBpostdrop\fR(1) command to
+/*	the \fBcleanup\fR(8) service.
+/* .IP "\fBcontent_filter (empty)\fR"
+/*	After the message is queued, send the entire message to the
+/*	specified \fItransport:destination\fR.
+/* .IP "\fBreceive_override_options (empty)\fR"
+/*	Enable or disable recipient validation, built-in content
+/*	filtering, or address mapping.
 /* FILES
 /*	/var/spool/postfix/maildrop, maildrop queue
 /* SEE ALSO
@@ -161,6 +181,11 @@
 #include <mail_parm_split.h>
 #include <maillog_client.h>
 #include <login_sender_match.h>
+#include <input_transp.h>
+#include <smtputf8.h>
+#include <mail_date.h>
+#include <lex_822.h>
+#include <info_log_addr_form.h>
 
 /* Application-specific. */
 
@@ -184,10 +209,24 @@ char   *var_submit_acl;
 char   *var_local_login_snd_maps;
 char   *var_null_local_login_snd_maps_key;
 
+ /*
+  * Direct submission to the cleanup service.
+  */
+bool    var_postdrop_direct;
+char   *var_filter_xport;
+char   *var_input_transp;
+
 static const CONFIG_STR_TABLE str_table[] = {
     VAR_SUBMIT_ACL, DEF_SUBMIT_ACL, &var_submit_acl, 0, 0,
     VAR_LOCAL_LOGIN_SND_MAPS, DEF_LOCAL_LOGIN_SND_MAPS, &var_local_login_snd_maps, 0, 0,
     VAR_NULL_LOCAL_LOGIN_SND_MAPS_KEY, DEF_NULL_LOCAL_LOGIN_SND_MAPS_KEY, &var_null_local_login_snd_maps_key, 0, 0,
+    VAR_FILTER_XPORT, DEF_FILTER_XPORT, &var_filter_xport, 0, 0,
+    VAR_INPUT_TRANSP, DEF_INPUT_TRANSP, &var_input_transp, 0, 0,
+    0,
+};
+
+static const CONFIG_BOOL_TABLE bool_table[] = {
+    VAR_POSTDROP_DIRECT, DEF_POSTDROP_DIRECT, &var_postdrop_direct,
     0,
 };
 
@@ -238,6 +277,40 @@ static void postdrop_cleanup(void)
     postdrop_sig(0);
 }
 
+/* postdrop_direct - submit directly to the cleanup service */
+
+static MAIL_STREAM *postdrop_direct(void)
+{
+    MAIL_STREAM *dst;
+    int     cleanup_flags;
+
+    /*
+     * Use the same cleanup flags as the pickup daemon. The cleanup service
+     * is never "requeued" mail here.
+     */
+    if ((dst = mail_stream_service_nowait(MAIL_CLASS_PUBLIC,
+					  var_cleanup_service)) == 0) {
+	if (msg_verbose)
+	    msg_info("cannot connect to the %s service -- using %s",
+		     var_cleanup_service, MAIL_QUEUE_MAILDROP);
+	return (0);
+    }
+    cleanup_flags =
+	input_transp_cleanup(CLEANUP_FLAG_BOUNCE | CLEANUP_FLAG_MASK_EXTERNAL,
+			     input_transp_mask(VAR_INPUT_TRANSP,
+					       var_input_transp))
+	| smtputf8_autodetect(MAIL_SRC_MASK_SENDMAIL);
+    if (attr_print(dst->stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, cleanup_flags),
+		   ATTR_TYPE_END) != 0) {
+	mail_stream_cleanup(dst);
+	return (0);
+    }
+    if (*var_filter_xport)
+	rec_fprintf(dst->stream, REC_TYPE_FILT, "%s", var_filter_xport);
+    return (dst);
+}
+
 /* check_login_sender_acl - check if a user is authorized to use this sender */
 
 static int check_login_sender_acl(uid_t uid, VSTRING *sender_buf,
@@ -336,6 +409,7 @@ int     main(int argc, char **argv)
     int     from_count = 0;
     int     rcpt_count = 0;
     int     validate_input = 1;
+    int     check_first = 0;
 
     /*
      * Fingerprint executables and core dumps.
@@ -401,6 +475,7 @@ int     main(int argc, char **argv)
     /* Re-evaluate mail_task() after reading main.cf. */
     maillog_client_init(mail_task("postdrop"), MAILLOG_CLIENT_FLAG_NONE);
     get_mail_conf_str_table(str_table);
+    get_mail_conf_bool_table(bool_table);
 
     /*
      * Stop run-away process accidents by limiting the queue file size. This
@@ -461,18 +536,24 @@ int     main(int argc, char **argv)
     GETTIMEOFDAY(&start);
 
     /*
-     * Create queue file. mail_stream_file() never fails. Send the queue ID
-     * to the caller. Stash away a copy of the queue file name so we can
-     * clean up in case of a fatal error or an interrupt.
+     * Optionally, send the message directly to the cleanup service. There
+     * is no queue file to clean up; the cleanup service discards the
+     * message when we go away before the end of the message.
+     * 
+     * Otherwise, create queue file. mail_stream_file() never fails. Send the
+     * queue ID to the caller. Stash away a copy of the queue file name so we
+     * can clean up in case of a fatal error or an interrupt.
      */
-    dst = mail_stream_file(MAIL_QUEUE_MAILDROP, MAIL_CLASS_PUBLIC,
-			   var_pickup_service, 0444);
+    if (var_postdrop_direct == 0 || (dst = postdrop_direct()) == 0) {
+	dst = mail_stream_file(MAIL_QUEUE_MAILDROP, MAIL_CLASS_PUBLIC,
+			       var_pickup_service, 0444);
+	postdrop_path = mystrdup(VSTREAM_PATH(dst->stream));
+    }
     attr_print(VSTREAM_OUT, ATTR_FLAG_NONE,
 	       SEND_ATTR_STR(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_POSTDROP),
 	       SEND_ATTR_STR(MAIL_ATTR_QUEUEID, dst->id),
 	       ATTR_TYPE_END);
     vstream_fflush(VSTREAM_OUT);
-    postdrop_path = mystrdup(VSTREAM_PATH(dst->stream));
 
     /*
      * Copy stdin to file. The format is checked so that we can recognize
@@ -499,6 +580,8 @@ int     main(int argc, char **argv)
 	rec_type = rec_get_raw(VSTREAM_IN, buf, var_line_limit, REC_FLAG_NONE);
 	if (rec_type == REC_TYPE_EOF) {		/* request canceled */
 	    mail_stream_cleanup(dst);
+	    if (postdrop_path == 0)
+		exit(0);
 	    if (remove(postdrop_path))
 		msg_warn("uid=%ld: remove %s: %m", (long) uid, postdrop_path);
 	    else if (msg_verbose)
@@ -520,6 +603,9 @@ int     main(int argc, char **argv)
 	if (rec_type == REC_TYPE_FROM) {
 	    status |= check_login_sender_acl(uid, buf, reason);
 	    from_count++;
+	    if (postdrop_path == 0 && status == CLEANUP_STAT_OK)
+		msg_info("%s: uid=%d from=<%s>", dst->id, (int) uid,
+			 info_log_addr_form_sender(vstring_str(buf)));
 	}
 	if (rec_type == REC_TYPE_RCPT)
 	    rcpt_count++;
@@ -552,6 +638,36 @@ int     main(int argc, char **argv)
 	    }
 	    continue;
 	}
+
+
+	/*
+	 * With direct submission, prepend the Received: header that the
+	 * pickup daemon would add. Don't send the end-of-message record
+	 * before the input is validated, because the cleanup service would
+	 * accept the message. Force an empty record when the message
+	 * content begins with whitespace, so that it won't be considered as
+	 * being part of our own Received: header.
+	 */
+	if (postdrop_path == 0 && status == CLEANUP_STAT_OK) {
+	    if (rec_type == REC_TYPE_END)
+		break;
+	    if (rec_type == REC_TYPE_MESG) {
+		rec_fputs(dst->stream, REC_TYPE_MESG, "");
+		rec_fprintf(dst->stream, REC_TYPE_NORM,
+			    "Received: by %s (%s, from userid %ld)",
+			    var_myhostname, var_mail_name, (long) uid);
+		rec_fprintf(dst->stream, REC_TYPE_NORM, "\tid %s; %s",
+			    dst->id, mail_date(start.tv_sec));
+		check_first = 1;
+		continue;
+	    }
+	    if (check_first
+		&& (rec_type == REC_TYPE_NORM || rec_type == REC_TYPE_CONT)) {
+		check_first = 0;
+		if (VSTRING_LEN(buf) > 0 && IS_SPACE_TAB(vstring_str(buf)[0]))
+		    rec_put(dst->stream, REC_TYPE_NORM, "", 0);
+	    }
+	}
 	if (status != CLEANUP_STAT_OK
 	    || REC_PUT_BUF(dst->stream, rec_type, buf) < 0) {
 	    /* rec_get() errors must not clobber errno. */
@@ -597,11 +713,16 @@ int     main(int argc, char **argv)
     }
 
     /*
-     * Finish the file.
+     * Finish the file, or commit the direct submission.
      */
-    else if ((status = mail_stream_finish(dst, reason)) != 0) {
-	msg_warn("uid=%ld: %m", (long) uid);
-	postdrop_cleanup();
+    else {
+	if (postdrop_path == 0)
+	    rec_fputs(dst->stream, REC_TYPE_END, "");
+	if ((status = mail_stream_finish(dst, reason)) != 0) {
+	    if (postdrop_path)
+		msg_warn("uid=%ld: %m", (long) uid);
+	    postdrop_cleanup();
+	}
     }
 
     /*
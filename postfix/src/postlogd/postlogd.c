@@ -28,6 +28,11 @@
 /*	or if their executable file has set-gid permission. Do not
 /*	set this permission on programs other than \fBpostdrop\fR(1),
 /*	\fBpostqueue\fR(1) and (Postfix >= 3.7) \fBpostlog\fR(1).
+/*
+/*	\fBpostlogd\fR(8) reads all records that are queued on its
+/*	socket before it writes them to \fB$maillog_file\fR with one
+/*	write() system call. Records that were read, but not yet
+/*	written, are lost when a \fBpostlogd\fR(8) process is killed.
 /* CONFIGURATION PARAMETERS
 /* .ad
 /* .fi
@@ -62,6 +67,11 @@
 /*	The file access permissions that will be set when the file
 /*	$maillog_file is created for the first time, or when the file is
 /*	created after an existing file is rotated.
+/* .IP "\fBmaillog_file_format (text)\fR"
+/*	The format of records in $maillog_file: \fBtext\fR or \fBjson\fR.
+/* .IP "\fBpostlogd_fsync_interval (0s)\fR"
+/*	How often the \fBpostlogd\fR(8) service will force records in
+/*	$maillog_file to stable storage with fsync().
 /* SEE ALSO
 /*	postconf(5), configuration parameters
 /*	syslogd(8), system logging
@@ -92,10 +102,13 @@
   * System library.
   */
 #include <sys_defs.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
  /*
   * Utility library.
   */
+#include <events.h>
 #include <logwriter.h>
 #include <msg.h>
 #include <msg_logger.h>
@@ -109,6 +122,7 @@
 #include <mail_task.h>
 #include <mail_version.h>
 #include <maillog_client.h>
+#include <master_proto.h>
 
  /*
   * Server skeleton.
@@ -119,6 +133,7 @@
   * Tunable parameters.
   */
 int     var_postlogd_watchdog;
+int     var_postlogd_fsync_time;
 
  /*
   * Silly little macros.
@@ -130,6 +145,16 @@ int     var_postlogd_watchdog;
   * Logfile stream.
   */
 static VSTREAM *postlogd_stream = 0;
+static int postlogd_fsync_pending = 0;
+
+ /*
+  * Batching. A batch ends when the socket has no more queued records, or
+  * after POSTLOGD_BATCH_LIMIT records so that the server skeleton can run
+  * its timers and other events. The stream buffer is large enough that
+  * a typical batch needs only one write() system call.
+  */
+#define POSTLOGD_BATCH_LIMIT	1000
+#define POSTLOGD_BUFSIZE	(64 * 1024)
 
 /* postlogd_fallback - log messages from postlogd(8) itself */
 
@@ -138,14 +163,40 @@ static void postlogd_fallback(const char *buf)
     (void) logwriter_write(postlogd_stream, buf, strlen(buf));
 }
 
+/* postlogd_fsync - force logfile to stable storage */
+
+static void postlogd_fsync(int unused_event, void *unused_context)
+{
+    postlogd_fsync_pending = 0;
+    if (fsync(vstream_fileno(postlogd_stream)) < 0)
+	msg_warn("fsync %s: %m", var_maillog_file);
+}
+
 /* postlogd_service - perform service for client */
 
 static void postlogd_service(char *buf, ssize_t len, char *unused_service,
 			             char **unused_argv)
 {
+    char    more[DGRAM_BUF_SIZE];
+    int     count;
 
+    /*
+     * Write this record and all records that are queued on the socket as
+     * one batch. The socket is non-blocking.
+     */
     if (postlogd_stream) {
-	(void) logwriter_write(postlogd_stream, buf, len);
+	(void) logwriter_append(postlogd_stream, buf, len);
+	for (count = 1; count < POSTLOGD_BATCH_LIMIT; count++) {
+	    if ((len = recv(MASTER_LISTEN_FD, more, sizeof(more), 0)) < 0)
+		break;
+	    (void) logwriter_append(postlogd_stream, more, len);
+	}
+	if (logwriter_flush(postlogd_stream) == 0
+	    && var_postlogd_fsync_time > 0 && postlogd_fsync_pending == 0) {
+	    event_request_timer(postlogd_fsync, (void *) 0,
+				var_postlogd_fsync_time);
+	    postlogd_fsync_pending = 1;
+	}
     }
 
     /*
@@ -216,6 +267,9 @@ static void pre_jail_init(char *unused_service_name, char **argv)
 	 * Instantiate the logwriter or bust.
 	 */
 	postlogd_stream = logwriter_open_or_die(var_maillog_file);
+	vstream_control(postlogd_stream,
+			CA_VSTREAM_CTL_BUFSIZE(POSTLOGD_BUFSIZE),
+			CA_VSTREAM_CTL_END);
 
 	/*
 	 * Inform the msg_logger client to stop using the postlog socket, and
@@ -247,6 +301,7 @@ int     main(int argc, char **argv)
 {
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_POSTLOGD_WATCHDOG, DEF_POSTLOGD_WATCHDOG, &var_postlogd_watchdog, 10, 0,
+	VAR_POSTLOGD_FSYNC_TIME, DEF_POSTLOGD_FSYNC_TIME, &var_postlogd_fsync_time, 0, 0,
 	0,
     };
 
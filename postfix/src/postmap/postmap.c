@@ -136,6 +136,10 @@
 /*	Incremental mode. Read entries from standard input and do not
 /*	truncate an existing database. By default, \fBpostmap\fR(1) creates
 /*	a new database from the entries in \fBfile_name\fR.
+/* .sp
+/*	With Postfix 3.9 and later, when standard input is a regular
+/*	file, an \fBlmdb\fR database is updated with one transaction,
+/*	so that readers see either none or all of the changes.
 /* .IP \fB-m\fR
 /*	Enable MIME parsing with "\fB-b\fR" and "\fB-h\fR".
 /* .sp
@@ -205,6 +209,11 @@
 /*	The \fBpostmap\fR(1) command can query any supported file type,
 /*	but it can create only the following file types:
 /* .RS
+/* .IP \fBbloom\fR
+/*	The output file is a Bloom filter, named \fIfile_name\fB.bloom\fR.
+/*	It stores only the keys, with a small rate of false positives;
+/*	a successful lookup returns \fBDUNNO\fR. This is available
+/*	with Postfix 3.9 and later.
 /* .IP \fBbtree\fR
 /*	The output file is a btree file, named \fIfile_name\fB.db\fR.
 /*	This is available on systems with support for \fBdb\fR databases.
@@ -420,6 +429,17 @@ static void postmap(char *map_type, char *path_name, int postmap_flags,
     if (fstat(vstream_fileno(source_fp), &st) < 0)
 	msg_fatal("fstat %s: %m", path_name);
 
+    /*
+     * In incremental mode, apply input from a regular file as one bulk
+     * update, so that a transactional database (lmdb) commits all changes
+     * at once instead of one transaction per entry. A bulk update may be
+     * restarted from the beginning after a recoverable error, and that
+     * requires input that can be rewound.
+     */
+    if ((open_flags & O_TRUNC) == 0 && S_ISREG(st.st_mode)
+	&& strcmp(map_type, DICT_TYPE_PROXY) != 0)
+	dict_flags |= DICT_FLAG_BULK_UPDATE;
+
     /*
      * Turn off group/other read permissions as indicated in the source file.
      */
@@ -16,9 +16,11 @@
 /* .ti -4
 /*	\fBTo list the mail queue\fR:
 /*
-/*	\fBpostqueue\fR [\fB-v\fR] [\fB-c \fIconfig_dir\fR] \fB-j\fR
+/*	\fBpostqueue\fR [\fB-bv\fR] [\fB-c \fIconfig_dir\fR]
+/*	[\fB-F \fIname=value\fR ...] \fB-j\fR
 /*
-/*	\fBpostqueue\fR [\fB-v\fR] [\fB-c \fIconfig_dir\fR] \fB-p\fR
+/*	\fBpostqueue\fR [\fB-bv\fR] [\fB-c \fIconfig_dir\fR]
+/*	[\fB-F \fIname=value\fR ...] \fB-p\fR
 /* DESCRIPTION
 /*	The \fBpostqueue\fR(1) command implements the Postfix user interface
 /*	for queue management. It implements operations that are
@@ -28,6 +30,15 @@
 /*	from the queue or changing the status of a message.
 /*
 /*	The following options are recognized:
+/* .IP \fB-b\fR
+/*	With \fB-j\fR or \fB-p\fR, produce a brief queue listing
+/*	that shows the queue ID, message size, arrival time and
+/*	sender, but no recipients or deferral reasons. This is
+/*	much faster with a large queue, because the \fBshowq\fR(8)
+/*	daemon reads only the start of each queue file. In JSON
+/*	format, the recipient list is empty.
+/*
+/*	This feature is available in Postfix 3.9 and later.
 /* .IP "\fB-c \fIconfig_dir\fR"
 /*	The \fBmain.cf\fR configuration file is in the named directory
 /*	instead of the default configuration directory. See also the
@@ -40,6 +51,32 @@
 /*
 /*	Warning: flushing undeliverable mail frequently will result in
 /*	poor delivery performance of all other mail.
+/* .IP "\fB-F \fIname=value\fR"
+/*	With \fB-j\fR or \fB-p\fR, list only messages that match
+/*	the specified filter. The \fBshowq\fR(8) daemon applies
+/*	the filter, so that messages that don't match are not sent
+/*	to \fBpostqueue\fR(1). Specify multiple \fB-F\fR options
+/*	to list only messages that match all filters. The following
+/*	filters are supported:
+/* .RS
+/* .IP "\fBqueue=\fIname\fR[,\fIname\fR...]"
+/*	The message is in one of the named queues: \fBmaildrop\fR,
+/*	\fBhold\fR, \fBincoming\fR, \fBactive\fR, or \fBdeferred\fR.
+/* .IP "\fBsender=\fIaddress\fR"
+/*	The envelope sender address equals \fIaddress\fR (case is
+/*	ignored). The null sender address is listed as
+/*	\fBMAILER-DAEMON\fR (see \fBempty_address_recipient\fR).
+/* .IP "\fBdomain=\fIdomain\fR"
+/*	At least one recipient address is in \fIdomain\fR (case
+/*	is ignored).
+/* .IP "\fBmin_age=\fItime\fR"
+/*	The message is at least \fItime\fR old. Specify a non-zero
+/*	value followed by an optional time unit (s: seconds, m:
+/*	minutes, h: hours, d: days, w: weeks). The default time unit
+/*	is s.
+/* .RE
+/* .IP
+/*	This feature is available in Postfix 3.9 and later.
 /* .IP "\fB-i \fIqueue_id\fR"
 /*	Schedule immediate delivery of deferred mail with the
 /*	specified queue ID.
@@ -278,6 +315,7 @@
 #include <flush_clnt.h>
 #include <smtp_stream.h>
 #include <user_acl.h>
+#include <conv_time.h>
 #include <valid_mailhost_addr.h>
 #include <mail_dict.h>
 #include <mail_parm_split.h>
@@ -313,7 +351,8 @@
   * the client needs to restrict expensive requests to privileged users only.
   * 
   * We don't have this problem with queue listings. The showq server detects an
-  * EPIPE error after reporting a few queue entries.
+  * EPIPE error after reporting a few queue entries, or end-of-file when the
+  * listing filters suppress all output.
   */
 #define PQ_MODE_DEFAULT		0	/* noop */
 #define PQ_MODE_MAILQ_LIST	1	/* list mail queue */
@@ -339,14 +378,88 @@ static const CONFIG_STR_TABLE str_table[] = {
     0,
 };
 
+ /*
+  * Queue listing filters. Empty strings and zero values match everything.
+  */
+typedef struct {
+    VSTRING *queues;			/* comma-separated queue names */
+    char   *sender;			/* sender address */
+    char   *domain;			/* recipient domain */
+    int     min_age;			/* minimal age in seconds */
+    int     flags;			/* SHOWQ_FLAG_XXX */
+} PQ_FILTER;
+
+/* parse_filters - parse and sanitize queue listing filters */
+
+static void parse_filters(PQ_FILTER *filter, ARGV *filter_args)
+{
+    static const char *queue_names[] = {
+	MAIL_QUEUE_MAILDROP, MAIL_QUEUE_HOLD, MAIL_QUEUE_INCOMING,
+	MAIL_QUEUE_ACTIVE, MAIL_QUEUE_DEFERRED, 0,
+    };
+    const char **qp;
+    char  **cpp;
+    char   *saved_arg;
+    char   *name;
+    char   *value;
+    char   *cp;
+    const char *err;
+
+#define PQ_FILTER_MAXLEN	1000
+
+    for (cpp = filter_args->argv; *cpp; cpp++) {
+	if (strlen(*cpp) > PQ_FILTER_MAXLEN || !allprint(*cpp))
+	    msg_fatal_status(EX_USAGE, "invalid -F filter: \"%.100s%s\"",
+			     *cpp, strlen(*cpp) > 100 ? "..." : "");
+	saved_arg = mystrdup(*cpp);
+	if ((err = split_nameval(saved_arg, &name, &value)) != 0)
+	    msg_fatal_status(EX_USAGE, "-F %s: %s", *cpp, err);
+	if (*value == 0)
+	    msg_fatal_status(EX_USAGE, "-F %s: empty value", *cpp);
+	if (strcmp(name, "queue") == 0) {
+	    for (cp = value; (name = mystrtok(&cp, CHARS_COMMA_SP)) != 0; /* */ ) {
+		for (qp = queue_names; *qp != 0; qp++)
+		    if (strcmp(*qp, name) == 0)
+			break;
+		if (*qp == 0)
+		    msg_fatal_status(EX_USAGE, "-F %s: unknown queue name", *cpp);
+		if (VSTRING_LEN(filter->queues) > 0)
+		    VSTRING_ADDCH(filter->queues, ',');
+		vstring_strcat(filter->queues, name);
+	    }
+	} else if (strcmp(name, "sender") == 0) {
+	    filter->sender = mystrdup(value);
+	} else if (strcmp(name, "domain") == 0) {
+	    filter->domain = mystrdup(value);
+	} else if (strcmp(name, "min_age") == 0) {
+	    if (!conv_time(value, &filter->min_age, 's') || filter->min_age <= 0)
+		msg_fatal_status(EX_USAGE, "-F %s: bad time value", *cpp);
+	} else {
+	    msg_fatal_status(EX_USAGE, "-F %s: unknown filter name", *cpp);
+	}
+	myfree(saved_arg);
+    }
+}
+
 /* showq_client - run the appropriate showq protocol client */
 
-static void showq_client(int mode, VSTREAM *showq)
+static void showq_client(int mode, VSTREAM *showq, PQ_FILTER *filter)
 {
     if (attr_scan(showq, ATTR_FLAG_STRICT,
 		  RECV_ATTR_STREQ(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_SHOWQ),
 		  ATTR_TYPE_END) != 0)
 	msg_fatal_status(EX_SOFTWARE, "malformed showq server response");
+    if (attr_print(showq, ATTR_FLAG_NONE,
+		   SEND_ATTR_STR(MAIL_ATTR_SHOWQ_QUEUES,
+				 STR(filter->queues)),
+		   SEND_ATTR_STR(MAIL_ATTR_SHOWQ_SENDER, filter->sender),
+		   SEND_ATTR_STR(MAIL_ATTR_SHOWQ_DOMAIN, filter->domain),
+		   SEND_ATTR_LONG(MAIL_ATTR_SHOWQ_MIN_AGE,
+				  (long) filter->min_age),
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, filter->flags),
+		   ATTR_TYPE_END) != 0
+	|| vstream_fflush(showq) != 0)
+	msg_fatal_status(EX_SOFTWARE, "cannot send showq request: %m");
     switch (mode) {
     case PQ_MODE_MAILQ_LIST:
 	showq_compat(showq);
@@ -361,7 +474,7 @@ static void showq_client(int mode, VSTREAM *showq)
 
 /* show_queue - show queue status */
 
-static void show_queue(int mode)
+static void show_queue(int mode, PQ_FILTER *filter)
 {
     const char *errstr;
     VSTREAM *showq;
@@ -379,7 +492,7 @@ static void show_queue(int mode)
      * Connect to the show queue service.
      */
     if ((showq = mail_connect(MAIL_CLASS_PUBLIC, var_showq_service, BLOCKING)) != 0) {
-	showq_client(mode, showq);
+	showq_client(mode, showq, filter);
 	if (vstream_fclose(showq))
 	    msg_warn("close: %m");
     }
@@ -413,12 +526,12 @@ static void show_queue(int mode)
 	for (n = 0; n < msg_verbose; n++)
 	    argv_add(argv, "-v", (char *) 0);
 	argv_terminate(argv);
-	if ((showq = vstream_popen(O_RDONLY,
+	if ((showq = vstream_popen(O_RDWR,
 				   CA_VSTREAM_POPEN_ARGV(argv->argv),
 				   CA_VSTREAM_POPEN_END)) == 0) {
 	    stat = -1;
 	} else {
-	    showq_client(mode, showq);
+	    showq_client(mode, showq, filter);
 	    stat = vstream_pclose(showq);
 	}
 	argv_free(argv);
@@ -543,7 +656,7 @@ static void unavailable(void)
 
 static NORETURN usage(void)
 {
-    msg_fatal_status(EX_USAGE, "usage: postqueue -f | postqueue -i queueid | postqueue -j | postqueue -p | postqueue -s site");
+    msg_fatal_status(EX_USAGE, "usage: postqueue -f | postqueue -i queueid | postqueue [-b] [-F name=value] -j | postqueue [-b] [-F name=value] -p | postqueue -s site");
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -560,6 +673,8 @@ int     main(int argc, char **argv)
     char   *id_to_flush = 0;
     ARGV   *import_env;
     int     bad_site;
+    PQ_FILTER filter;
+    ARGV   *filter_args;
 
     /*
      * Fingerprint executables and core dumps.
@@ -603,8 +718,19 @@ int     main(int argc, char **argv)
      * mail configuration read routine. Don't do complex things until we have
      * completed initializations.
      */
-    while ((c = GETOPT(argc, argv, "c:fi:jps:v")) > 0) {
+    filter.queues = vstring_alloc(10);
+    filter.sender = filter.domain = "";
+    filter.min_age = 0;
+    filter.flags = SHOWQ_FLAG_NONE;
+    filter_args = argv_alloc(1);
+    while ((c = GETOPT(argc, argv, "bc:F:fi:jps:v")) > 0) {
 	switch (c) {
+	case 'b':				/* brief listing */
+	    filter.flags |= SHOWQ_FLAG_BRIEF;
+	    break;
+	case 'F':				/* listing filter */
+	    argv_add(filter_args, optarg, (char *) 0);
+	    break;
 	case 'c':				/* non-default configuration */
 	    if (setenv(CONF_ENV_PATH, optarg, 1) < 0)
 		msg_fatal_status(EX_UNAVAILABLE, "out of memory");
@@ -646,6 +772,9 @@ int     main(int argc, char **argv)
     }
     if (argc > optind)
 	usage();
+    if ((filter.flags != 0 || filter_args->argc > 0)
+	&& mode != PQ_MODE_MAILQ_LIST && mode != PQ_MODE_JSON_LIST)
+	usage();
 
     /*
      * Further initialization...
@@ -693,6 +822,9 @@ int     main(int argc, char **argv)
 		       "Cannot flush queue ID - invalid name: \"%.100s%s\"",
 		       id_to_flush, strlen(id_to_flush) > 100 ? "..." : "");
     }
+    if (filter_args->argc > 0)
+	parse_filters(&filter, filter_args);
+    argv_free(filter_args);
 
     /*
      * Start processing.
@@ -703,7 +835,7 @@ int     main(int argc, char **argv)
 	/* NOTREACHED */
     case PQ_MODE_MAILQ_LIST:
     case PQ_MODE_JSON_LIST:
-	show_queue(mode);
+	show_queue(mode, &filter);
 	exit(0);
 	break;
     case PQ_MODE_FLUSH_SITE:
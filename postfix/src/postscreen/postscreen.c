@@ -242,6 +242,15 @@
 /*	Allow a remote SMTP client to skip "before" and "after 220
 /*	greeting" protocol tests, based on its combined DNSBL score as
 /*	defined with the postscreen_dnsbl_sites parameter.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBpostscreen_dnsbl_builtin_resolver (no)\fR"
+/*	Send DNSBL and DNSWL queries with a built-in event-driven DNS
+/*	client, instead of through the \fBdnsblog\fR(8) service.
+/* .IP "\fBpostscreen_dnsbl_cache_limit (10000)\fR"
+/*	The number of DNSBL and DNSWL replies that \fBpostscreen\fR(8)
+/*	keeps in memory for their reply TTL, so that a returning
+/*	client does not trigger new queries.
 /* AFTER 220 GREETING TESTS
 /* .ad
 /* .fi
@@ -290,6 +299,10 @@
 /* .IP "\fBpostscreen_cache_retention_time (7d)\fR"
 /*	The amount of time that \fBpostscreen\fR(8) will cache an expired
 /*	temporary allowlist entry before it is removed.
+/* .IP "\fBpostscreen_cache_memory_limit (10000)\fR"
+/*	The number of \fBpostscreen\fR(8) cache entries that are also
+/*	kept in memory, so that repeat clients don't need a
+/*	postscreen_cache_map lookup (available in Postfix 3.9 and later).
 /* .IP "\fBpostscreen_bare_newline_ttl (30d)\fR"
 /*	The amount of time that \fBpostscreen\fR(8) remembers that a client
 /*	IP address passed a "bare newline" SMTP protocol test, before it
@@ -342,6 +355,13 @@
 /*	How much time a \fBpostscreen\fR(8) process may take to respond to
 /*	a remote SMTP client command or to perform a cache operation before it
 /*	is terminated by a built-in watchdog timer.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBpostscreen_process_client_limit (1000)\fR"
+/*	When the \fBpostscreen\fR(8) service is configured with a
+/*	master.cf process limit greater than 1, the number of
+/*	connections that one \fBpostscreen\fR(8) process will handle
+/*	before the master starts another process.
 /* STARTTLS CONTROLS
 /* .ad
 /* .fi
@@ -394,6 +414,11 @@
 /* .IP "\fBinfo_log_address_format (external)\fR"
 /*	The email address form that will be used in non-debug logging
 /*	(info, warning, etc.).
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBreopen_changed_tables (no)\fR"
+/*	Reopen a changed read-only lookup table in the running
+/*	process, instead of terminating the process.
 /* SEE ALSO
 /*	smtpd(8), Postfix SMTP server
 /*	tlsproxy(8), Postfix TLS proxy server
@@ -437,6 +462,7 @@
 #include <sys_defs.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Utility library. */
 
@@ -445,6 +471,7 @@
 #include <events.h>
 #include <myaddrinfo.h>
 #include <dict_cache.h>
+#include <dict_lmdb.h>
 #include <set_eugid.h>
 #include <vstream.h>
 #include <name_code.h>
@@ -458,6 +485,8 @@
 #include <mail_proto.h>
 #include <data_redirect.h>
 #include <string_list.h>
+#include <dict_proxy.h>
+#include <dict_memcache.h>
 
 /* Master server protocols. */
 
@@ -499,6 +528,8 @@ bool    var_psc_helo_required;
 char   *var_psc_cache_map;
 int     var_psc_cache_scan;
 int     var_psc_cache_ret;
+int     var_psc_cache_mem;
+int     var_psc_proc_clients;
 int     var_psc_post_queue_limit;
 int     var_psc_pre_queue_limit;
 int     var_psc_watchdog;
@@ -521,6 +552,8 @@ char   *var_psc_dnsbl_action;
 int     var_psc_dnsbl_min_ttl;
 int     var_psc_dnsbl_max_ttl;
 int     var_psc_dnsbl_tmout;
+bool    var_psc_dnsbl_builtin;
+int     var_psc_dnsbl_cache;
 
 bool    var_psc_pipel_enable;
 char   *var_psc_pipel_action;
@@ -583,6 +616,7 @@ HTABLE *psc_client_concurrency;		/* per-client concurrency */
   * Local variables and functions.
   */
 static ARGV *psc_acl;			/* permanent allow/denylist */
+static int psc_solitary;		/* process limit is 1 */
 static int psc_dnlist_action;		/* PSC_ACT_DROP/ENFORCE/etc */
 static ADDR_MATCH_LIST *psc_allist_if;	/* allowlist interfaces */
 
@@ -925,6 +959,22 @@ static void pre_jail_init(char *unused_name, char **unused_argv)
      * other Postfix daemons.
      */
     psc_acl_pre_jail_init(var_mynetworks, VAR_PSC_ACL);
+
+    /*
+     * Multiple postscreen processes can share the same listening socket, but
+     * they must not open the same local cache file. Each process keeps its
+     * own DNSBL score cache and per-client connection counts.
+     */
+#define PSC_CACHE_IS(type) \
+	(strncmp(var_psc_cache_map, type ":", sizeof(type ":") - 1) == 0)
+
+    if (!psc_solitary && *var_psc_cache_map
+	&& !PSC_CACHE_IS(DICT_TYPE_PROXY) && !PSC_CACHE_IS(DICT_TYPE_MEMCACHE)
+	&& !PSC_CACHE_IS(DICT_TYPE_LMDB))
+	msg_fatal("a postscreen process limit other than 1 requires that "
+		  "%s specifies a %s:, %s: or %s: table",
+		  VAR_PSC_CACHE_MAP, DICT_TYPE_PROXY, DICT_TYPE_MEMCACHE,
+		  DICT_TYPE_LMDB);
     if (*var_psc_acl)
 	psc_acl = psc_acl_parse(var_psc_acl, VAR_PSC_ACL);
     /* Ignore smtpd_forbid_cmds lookup errors. Non-critical feature. */
@@ -994,7 +1044,8 @@ static void pre_accept(char *unused_name, char **unused_argv)
      */
     new_event_time = event_time();
     if (new_event_time >= last_event_time + 1
-	&& (name = dict_changed_name()) != 0) {
+	&& (name = dict_changed_name()) != 0
+	&& (var_reopen_tables == 0 || (name = dict_reload_changed()) != 0)) {
 	msg_info("table %s has changed - finishing in the background", name);
 	event_server_drain();
     } else {
@@ -1184,6 +1235,9 @@ int     main(int argc, char **argv)
 	VAR_PSC_DNSBL_THRESH, DEF_PSC_DNSBL_THRESH, &var_psc_dnsbl_thresh, 1, 0,
 	VAR_PSC_CMD_COUNT, DEF_PSC_CMD_COUNT, &var_psc_cmd_count, 1, 0,
 	VAR_SMTPD_CCONN_LIMIT, DEF_SMTPD_CCONN_LIMIT, &var_smtpd_cconn_limit, 0, 0,
+	VAR_PSC_CACHE_MEM, DEF_PSC_CACHE_MEM, &var_psc_cache_mem, 0, 0,
+	VAR_PSC_PROC_CLIENTS, DEF_PSC_PROC_CLIENTS, &var_psc_proc_clients, 0, 0,
+	VAR_PSC_DNSBL_CACHE, DEF_PSC_DNSBL_CACHE, &var_psc_dnsbl_cache, 0, 0,
 	0,
     };
     static const CONFIG_NINT_TABLE nint_table[] = {
@@ -1218,6 +1272,7 @@ int     main(int argc, char **argv)
 	VAR_PSC_PIPEL_ENABLE, DEF_PSC_PIPEL_ENABLE, &var_psc_pipel_enable,
 	VAR_PSC_NSMTP_ENABLE, DEF_PSC_NSMTP_ENABLE, &var_psc_nsmtp_enable,
 	VAR_PSC_BARLF_ENABLE, DEF_PSC_BARLF_ENABLE, &var_psc_barlf_enable,
+	VAR_PSC_DNSBL_BUILTIN, DEF_PSC_DNSBL_BUILTIN, &var_psc_dnsbl_builtin,
 	0,
     };
     static const CONFIG_RAW_TABLE raw_table[] = {
@@ -1251,7 +1306,8 @@ int     main(int argc, char **argv)
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
 		      CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
-		      CA_MAIL_SERVER_SOLITARY,
+		      CA_MAIL_SERVER_SOLITARY_STATUS(&psc_solitary),
+		      CA_MAIL_SERVER_CLIENT_LIMIT(&var_psc_proc_clients),
 		      CA_MAIL_SERVER_SLOW_EXIT(psc_drain),
 		      CA_MAIL_SERVER_EXIT(psc_dump),
 		      CA_MAIL_SERVER_WATCHDOG(&var_psc_watchdog),
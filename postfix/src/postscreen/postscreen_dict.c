@@ -36,7 +36,13 @@
 /*	addr_match_list_match().
 /*
 /*	psc_cache_lookup() and psc_cache_update() are wrappers around
-/*	the corresponding dict_cache() methods.
+/*	the corresponding dict_cache() methods. Up to
+/*	$postscreen_cache_memory_limit entries are also kept in an
+/*	in-memory LRU cache, so that a repeat client does not need
+/*	a persistent cache lookup. Lookups that find nothing are
+/*	not remembered, so that a client will see updates that are
+/*	made by other postscreen(8) instances that share the same
+/*	persistent cache.
 /*
 /*	psc_dict_get() and psc_maps_find() are wrappers around
 /*	dict_get() and maps_find(), respectively.
@@ -59,9 +65,12 @@
 
 #include <msg.h>
 #include <dict.h>
+#include <mymalloc.h>
+#include <ctable.h>
 
 /* Global library. */
 
+#include <mail_params.h>
 #include <maps.h>
 
 /* Application-specific. */
@@ -127,6 +136,45 @@ int     psc_addr_match_list_match(ADDR_MATCH_LIST *addr_list,
     return (result);
 }
 
+ /*
+  * In-memory front end for the persistent cache. postscreen(8) is a single
+  * process, so this stays coherent with its own updates. The value for a
+  * new or refreshed entry is passed via psc_cache_mem_value.
+  */
+static CTABLE *psc_cache_mem;
+static const char *psc_cache_mem_value;
+
+/* psc_cache_mem_create - save cache entry after lookup or update */
+
+static void *psc_cache_mem_create(const char *unused_key, void *unused_ctx)
+{
+    return (mystrdup(psc_cache_mem_value));
+}
+
+/* psc_cache_mem_delete - destroy in-memory cache entry */
+
+static void psc_cache_mem_delete(void *value, void *unused_ctx)
+{
+    myfree(value);
+}
+
+/* psc_cache_mem_save - save entry in in-memory cache */
+
+static const char *psc_cache_mem_save(const char *key, const char *value)
+{
+    if (psc_cache_mem == 0) {
+	if (var_psc_cache_mem <= 0)
+	    return (value);
+	psc_cache_mem = ctable_create(var_psc_cache_mem, psc_cache_mem_create,
+				      psc_cache_mem_delete, (void *) 0);
+    }
+    psc_cache_mem_value = value;
+    if (ctable_exists(psc_cache_mem, key))
+	return (ctable_refresh(psc_cache_mem, key));
+    else
+	return (ctable_locate(psc_cache_mem, key));
+}
+
 /* psc_cache_lookup - time-critical cache lookup */
 
 const char *psc_cache_lookup(DICT_CACHE *cache, const char *key)
@@ -135,9 +183,14 @@ const char *psc_cache_lookup(DICT_CACHE *cache, const char *key)
     const char *result;
     static double latency_ms;
 
+    if (psc_cache_mem != 0 && ctable_exists(psc_cache_mem, key))
+	return (ctable_locate(psc_cache_mem, key));
+
     PSC_GET_TIME_BEFORE_LOOKUP;
     result = dict_cache_lookup(cache, key);
     PSC_CHECK_TIME_AFTER_LOOKUP(dict_cache_name(cache), "lookup", latency_ms);
+    if (result != 0)
+	result = psc_cache_mem_save(key, result);
     return (result);
 }
 
@@ -151,6 +204,7 @@ void    psc_cache_update(DICT_CACHE *cache, const char *key, const char *value)
     PSC_GET_TIME_BEFORE_LOOKUP;
     dict_cache_update(cache, key, value);
     PSC_CHECK_TIME_AFTER_LOOKUP(dict_cache_name(cache), "update", latency_ms);
+    (void) psc_cache_mem_save(key, value);
 }
 
 /* psc_dict_get - time-critical table lookup */
@@ -44,6 +44,22 @@
 /*	reference count. The reply TTL value is clamped to
 /*	postscreen_dnsbl_min_ttl and postscreen_dnsbl_max_ttl.  It
 /*	is an error to retrieve a score without requesting it first.
+/*
+/*	With postscreen_dnsbl_builtin_resolver = yes, DNSBL queries
+/*	are sent with the built-in event-driven DNS client,
+/*	instead of the \fBdnsblog\fR(8) service. This falls back to
+/*	the \fBdnsblog\fR(8) service when no query can be sent.
+/*
+/*	The requestor is notified before all DNSBL replies are in,
+/*	when the replies that are still pending can no longer change
+/*	the outcome of the postscreen_dnsbl_threshold and
+/*	postscreen_dnsbl_allowlist_threshold comparisons. Late
+/*	replies are still saved in the reply cache.
+/*
+/*	Up to postscreen_dnsbl_cache_limit DNSBL replies (including
+/*	"not listed" replies) are cached per DNSBL domain and client
+/*	IP address, for the reply TTL but no longer than
+/*	postscreen_dnsbl_max_ttl.
 /* LICENSE
 /* .ad
 /* .fi
@@ -83,12 +99,18 @@
 #include <ip_match.h>
 #include <myaddrinfo.h>
 #include <stringops.h>
+#include <sock_addr.h>
+#include <ctable.h>
 
 /* Global library. */
 
 #include <mail_params.h>
 #include <mail_proto.h>
 
+/* DNS library. */
+
+#include <dns.h>
+
 /* Application-specific. */
 
 #include <postscreen.h>
@@ -117,6 +139,8 @@ static HTABLE_INFO **dnsbl_site_list;	/* flattened cache */
 typedef struct {
     const char *safe_dnsbl;		/* from postscreen_dnsbl_reply_map */
     struct PSC_DNSBL_SITE *first;	/* list of (filter, weight) tuples */
+    int     pos_weight;			/* sum of positive weights */
+    int     neg_weight;			/* sum of negative weights */
 } PSC_DNSBL_HEAD;
 
 typedef struct PSC_DNSBL_SITE {
@@ -155,6 +179,9 @@ typedef struct {
     int     pass_ttl;			/* combined reply TTL */
     int     refcount;			/* score reference count */
     int     pending_lookups;		/* nr of DNS requests in flight */
+    int     pending_pos;		/* max score change in flight */
+    int     pending_neg;		/* min score change in flight */
+    int     settled;			/* pending can't change outcome */
     int     request_id;			/* duplicate suppression */
     /* Call-back table support. */
     int     index;			/* next table index */
@@ -215,6 +242,21 @@ typedef struct {
 static VSTRING *reply_client;		/* client address in DNSBLOG reply */
 static VSTRING *reply_dnsbl;		/* domain in DNSBLOG reply */
 static VSTRING *reply_addr;		/* address list in DNSBLOG reply */
+static VSTRING *query_name;		/* built-in DNS client query */
+
+ /*
+  * Per-DNSBL, per-client reply cache. A returning client does not trigger
+  * new queries until the reply TTL expires. The reply is passed to the cache
+  * create function via dnsbl_reply_value.
+  */
+typedef struct {
+    char   *reply_addrs;		/* address list, may be empty */
+    time_t  expires;			/* reply TTL expiration */
+} PSC_DNSBL_REPLY;
+
+static CTABLE *dnsbl_reply_cache;
+static PSC_DNSBL_REPLY dnsbl_reply_value;
+static VSTRING *dnsbl_reply_key;
 
 /* psc_dnsbl_add_site - add DNSBL site information */
 
@@ -279,6 +321,8 @@ static void psc_dnsbl_add_site(const char *site)
 	    msg_fatal("%s:%s lookup error", psc_dnsbl_reply->type,
 		      psc_dnsbl_reply->name);
 	head->first = 0;
+	head->pos_weight = 0;
+	head->neg_weight = 0;
     }
 
     /*
@@ -291,6 +335,10 @@ static void psc_dnsbl_add_site(const char *site)
     new_site->weight = weight;
     new_site->next = head->first;
     head->first = new_site;
+    if (weight > 0)
+	head->pos_weight += weight;
+    else
+	head->neg_weight += weight;
 
     myfree(saved_site);
     if (byte_codes)
@@ -363,36 +411,223 @@ int     psc_dnsbl_retrieve(const char *client_addr, const char **dnsbl_name,
     return (result_score);
 }
 
-/* psc_dnsbl_receive - receive DNSBL reply, update blocklist score */
+/* psc_dnsbl_reply_create - save DNSBL reply after cache miss or refresh */
 
-static void psc_dnsbl_receive(int event, void *context)
+static void *psc_dnsbl_reply_create(const char *unused_key, void *unused_ctx)
 {
-    const char *myname = "psc_dnsbl_receive";
-    VSTREAM *stream = (VSTREAM *) context;
-    PSC_DNSBL_SCORE *score;
+    PSC_DNSBL_REPLY *reply = (PSC_DNSBL_REPLY *) mymalloc(sizeof(*reply));
+
+    reply->reply_addrs = mystrdup(dnsbl_reply_value.reply_addrs);
+    reply->expires = dnsbl_reply_value.expires;
+    return ((void *) reply);
+}
+
+/* psc_dnsbl_reply_delete - destroy cached DNSBL reply */
+
+static void psc_dnsbl_reply_delete(void *value, void *unused_ctx)
+{
+    PSC_DNSBL_REPLY *reply = (PSC_DNSBL_REPLY *) value;
+
+    myfree(reply->reply_addrs);
+    myfree((void *) reply);
+}
+
+/* psc_dnsbl_reply_save - save DNSBL reply for its reply TTL */
+
+static void psc_dnsbl_reply_save(const char *dnsbl_domain,
+				         const char *client_addr,
+				         const char *reply_addrs, int dnsbl_ttl)
+{
+    /* As with dnsblog(8), a value < 0 means no reply TTL. */
+    if (dnsbl_reply_cache == 0 || dnsbl_ttl <= 0)
+	return;
+    if (dnsbl_ttl > var_psc_dnsbl_max_ttl)
+	dnsbl_ttl = var_psc_dnsbl_max_ttl;
+    vstring_sprintf(dnsbl_reply_key, "%s %s", dnsbl_domain, client_addr);
+    dnsbl_reply_value.reply_addrs = (char *) reply_addrs;
+    dnsbl_reply_value.expires = event_time() + dnsbl_ttl;
+    if (ctable_exists(dnsbl_reply_cache, STR(dnsbl_reply_key)))
+	(void) ctable_refresh(dnsbl_reply_cache, STR(dnsbl_reply_key));
+    else
+	(void) ctable_locate(dnsbl_reply_cache, STR(dnsbl_reply_key));
+}
+
+/* psc_dnsbl_reply_find - find unexpired DNSBL reply */
+
+static const PSC_DNSBL_REPLY *psc_dnsbl_reply_find(const char *dnsbl_domain,
+						        const char *client_addr)
+{
+    const PSC_DNSBL_REPLY *reply;
+
+    if (dnsbl_reply_cache == 0)
+	return (0);
+    vstring_sprintf(dnsbl_reply_key, "%s %s", dnsbl_domain, client_addr);
+    if (!ctable_exists(dnsbl_reply_cache, STR(dnsbl_reply_key)))
+	return (0);
+    reply = (const PSC_DNSBL_REPLY *)
+	ctable_locate(dnsbl_reply_cache, STR(dnsbl_reply_key));
+    return (reply->expires > event_time() ? reply : 0);
+}
+
+/* psc_dnsbl_score - update blocklist score with DNSBL reply */
+
+static void psc_dnsbl_score(PSC_DNSBL_SCORE *score, const char *dnsbl_domain,
+			            const char *client_addr,
+			            const char *reply_addrs, int dnsbl_ttl)
+{
+    const char *myname = "psc_dnsbl_score";
     PSC_DNSBL_HEAD *head;
     PSC_DNSBL_SITE *site;
     ARGV   *reply_argv;
-    int     request_id;
-    int     dnsbl_ttl;
-
-    PSC_CLEAR_EVENT_REQUEST(vstream_fileno(stream), psc_dnsbl_receive, context);
 
     /*
-     * Receive the DNSBL lookup result.
-     * 
-     * This is preliminary code to explore the field. Later, DNSBL lookup will
-     * be handled by an UDP-based DNS client that is built directly into some
-     * Postfix daemon.
-     * 
-     * Don't bother looking up the blocklist score when the client IP address is
-     * not listed at the DNSBL.
+     * Run this response past all applicable DNSBL filters and update the
+     * blocklist score for this client IP address.
      * 
+     * Don't panic when the DNSBL domain name is not found. The DNSBLOG server
+     * may be messed up.
+     */
+    if (msg_verbose > 1)
+	msg_info("%s: client=\"%s\" score=%d domain=\"%s\" reply=\"%d %s\"",
+		 myname, client_addr, score->total,
+		 dnsbl_domain, dnsbl_ttl, reply_addrs);
+    head = (PSC_DNSBL_HEAD *) htable_find(dnsbl_site_cache, dnsbl_domain);
+    if (head == 0) {
+	/* Bogus domain. Do nothing. */
+    } else if (*reply_addrs != 0) {
+	/* DNS reputation record(s) found. */
+	reply_argv = 0;
+	for (site = head->first; site != 0; site = site->next) {
+	    if (site->byte_codes == 0
+		|| psc_dnsbl_match(site->byte_codes, reply_argv ? reply_argv :
+				   (reply_argv = argv_split(reply_addrs, " ")))) {
+		if (score->dnsbl_name == 0
+		    || score->dnsbl_weight < site->weight) {
+		    score->dnsbl_name = head->safe_dnsbl;
+		    score->dnsbl_weight = site->weight;
+		}
+		score->total += site->weight;
+		if (msg_verbose > 1)
+		    msg_info("%s: filter=\"%s\" weight=%d score=%d",
+			     myname, site->filter ? site->filter : "null",
+			     site->weight, score->total);
+	    }
+	    /* As with dnsblog(8), a value < 0 means no reply TTL. */
+	    if (site->weight > 0) {
+		if (score->fail_ttl < 0 || score->fail_ttl > dnsbl_ttl)
+		    score->fail_ttl = dnsbl_ttl;
+	    } else {
+		if (score->pass_ttl < 0 || score->pass_ttl > dnsbl_ttl)
+		    score->pass_ttl = dnsbl_ttl;
+	    }
+	}
+	if (reply_argv != 0)
+	    argv_free(reply_argv);
+    } else {
+	/* No DNS reputation record found. */
+	for (site = head->first; site != 0; site = site->next) {
+	    /* As with dnsblog(8), a value < 0 means no reply TTL. */
+	    if (site->weight > 0) {
+		if (score->pass_ttl < 0 || score->pass_ttl > dnsbl_ttl)
+		    score->pass_ttl = dnsbl_ttl;
+	    } else {
+		if (score->fail_ttl < 0 || score->fail_ttl > dnsbl_ttl)
+		    score->fail_ttl = dnsbl_ttl;
+	    }
+	}
+    }
+}
+
+/* psc_dnsbl_settled - pending replies cannot change the outcome */
+
+static int psc_dnsbl_settled(PSC_DNSBL_SCORE *score)
+{
+    int     max_total = score->total + score->pending_pos;
+    int     min_total = score->total + score->pending_neg;
+
+    /*
+     * The outcome is the result of the postscreen_dnsbl_threshold
+     * comparison, and of the optional postscreen_dnsbl_allowlist_threshold
+     * comparison. A reply can add any combination of the weights of its
+     * DNSBL domain.
+     */
+    if (min_total < var_psc_dnsbl_thresh && max_total >= var_psc_dnsbl_thresh)
+	return (0);
+    if (var_psc_dnsbl_althresh < 0
+	&& min_total <= var_psc_dnsbl_althresh
+	&& max_total > var_psc_dnsbl_althresh)
+	return (0);
+    return (1);
+}
+
+/* psc_dnsbl_update - update blocklist score and notify requestors */
+
+static void psc_dnsbl_update(const char *dnsbl_domain, const char *client_addr,
+			             int request_id, const char *reply_addrs,
+			             int dnsbl_ttl)
+{
+    const char *myname = "psc_dnsbl_update";
+    PSC_DNSBL_SCORE *score;
+    PSC_DNSBL_HEAD *head;
+
+    /*
+     * Remember the reply for a returning client, even if nobody is waiting
+     * for it.
+     */
+    if (htable_find(dnsbl_site_cache, dnsbl_domain) != 0)
+	psc_dnsbl_reply_save(dnsbl_domain, client_addr, reply_addrs,
+			     dnsbl_ttl);
+
+    /*
      * Don't panic when the blocklist score no longer exists. It may be deleted
      * when the client triggers a "drop" action after pregreet, when the
      * client does not pregreet and the DNSBL reply arrives late, or when the
      * client triggers a "drop" action after hanging up.
      */
+    if ((score = (PSC_DNSBL_SCORE *)
+	 htable_find(dnsbl_score_cache, client_addr)) == 0
+	|| score->request_id != request_id)
+	return;
+    psc_dnsbl_score(score, dnsbl_domain, client_addr, reply_addrs, dnsbl_ttl);
+    if ((head = (PSC_DNSBL_HEAD *)
+	 htable_find(dnsbl_site_cache, dnsbl_domain)) != 0) {
+	score->pending_pos -= head->pos_weight;
+	score->pending_neg -= head->neg_weight;
+    }
+
+    /*
+     * Notify the requestor(s) that the result is ready to be picked up. If
+     * this call isn't made, clients have to sit out the entire pre-handshake
+     * delay. Don't wait for the remaining replies when they can no longer
+     * change the outcome.
+     */
+    score->pending_lookups -= 1;
+    if (score->pending_lookups == 0) {
+	PSC_CALL_BACK_NOTIFY(score, PSC_NULL_EVENT);
+    } else if (score->settled == 0 && psc_dnsbl_settled(score)) {
+	if (msg_verbose)
+	    msg_info("%s: addr=%s score=%d settled with %d pending",
+		     myname, client_addr, score->total,
+		     score->pending_lookups);
+	score->settled = 1;
+	PSC_CALL_BACK_NOTIFY(score, PSC_NULL_EVENT);
+    }
+}
+
+/* psc_dnsbl_receive - receive DNSBLOG reply, update blocklist score */
+
+static void psc_dnsbl_receive(int event, void *context)
+{
+    const char *myname = "psc_dnsbl_receive";
+    VSTREAM *stream = (VSTREAM *) context;
+    int     request_id;
+    int     dnsbl_ttl;
+
+    PSC_CLEAR_EVENT_REQUEST(vstream_fileno(stream), psc_dnsbl_receive, context);
+
+    /*
+     * Receive the DNSBL lookup result.
+     */
     if (event == EVENT_READ
 	&& attr_scan(stream,
 		     ATTR_FLAG_STRICT,
@@ -401,85 +636,111 @@ static void psc_dnsbl_receive(int event, void *context)
 		     RECV_ATTR_INT(MAIL_ATTR_LABEL, &request_id),
 		     RECV_ATTR_STR(MAIL_ATTR_RBL_ADDR, reply_addr),
 		     RECV_ATTR_INT(MAIL_ATTR_TTL, &dnsbl_ttl),
-		     ATTR_TYPE_END) == 5
-	&& (score = (PSC_DNSBL_SCORE *)
-	    htable_find(dnsbl_score_cache, STR(reply_client))) != 0
-	&& score->request_id == request_id) {
-
-	/*
-	 * Run this response past all applicable DNSBL filters and update the
-	 * blocklist score for this client IP address.
-	 * 
-	 * Don't panic when the DNSBL domain name is not found. The DNSBLOG
-	 * server may be messed up.
-	 */
-	if (msg_verbose > 1)
-	    msg_info("%s: client=\"%s\" score=%d domain=\"%s\" reply=\"%d %s\"",
-		     myname, STR(reply_client), score->total,
-		     STR(reply_dnsbl), dnsbl_ttl, STR(reply_addr));
-	head = (PSC_DNSBL_HEAD *)
-	    htable_find(dnsbl_site_cache, STR(reply_dnsbl));
-	if (head == 0) {
-	    /* Bogus domain. Do nothing. */
-	} else if (*STR(reply_addr) != 0) {
-	    /* DNS reputation record(s) found. */
-	    reply_argv = 0;
-	    for (site = head->first; site != 0; site = site->next) {
-		if (site->byte_codes == 0
-		    || psc_dnsbl_match(site->byte_codes, reply_argv ? reply_argv :
-			 (reply_argv = argv_split(STR(reply_addr), " ")))) {
-		    if (score->dnsbl_name == 0
-			|| score->dnsbl_weight < site->weight) {
-			score->dnsbl_name = head->safe_dnsbl;
-			score->dnsbl_weight = site->weight;
-		    }
-		    score->total += site->weight;
-		    if (msg_verbose > 1)
-			msg_info("%s: filter=\"%s\" weight=%d score=%d",
-			       myname, site->filter ? site->filter : "null",
-				 site->weight, score->total);
-		}
-		/* As with dnsblog(8), a value < 0 means no reply TTL. */
-		if (site->weight > 0) {
-		    if (score->fail_ttl < 0 || score->fail_ttl > dnsbl_ttl)
-			score->fail_ttl = dnsbl_ttl;
-		} else {
-		    if (score->pass_ttl < 0 || score->pass_ttl > dnsbl_ttl)
-			score->pass_ttl = dnsbl_ttl;
-		}
-	    }
-	    if (reply_argv != 0)
-		argv_free(reply_argv);
-	} else {
-	    /* No DNS reputation record found. */
-	    for (site = head->first; site != 0; site = site->next) {
-		/* As with dnsblog(8), a value < 0 means no reply TTL. */
-		if (site->weight > 0) {
-		    if (score->pass_ttl < 0 || score->pass_ttl > dnsbl_ttl)
-			score->pass_ttl = dnsbl_ttl;
-		} else {
-		    if (score->fail_ttl < 0 || score->fail_ttl > dnsbl_ttl)
-			score->fail_ttl = dnsbl_ttl;
-		}
-	    }
-	}
-
-	/*
-	 * Notify the requestor(s) that the result is ready to be picked up.
-	 * If this call isn't made, clients have to sit out the entire
-	 * pre-handshake delay.
-	 */
-	score->pending_lookups -= 1;
-	if (score->pending_lookups == 0)
-	    PSC_CALL_BACK_NOTIFY(score, PSC_NULL_EVENT);
+		     ATTR_TYPE_END) == 5) {
+	psc_dnsbl_update(STR(reply_dnsbl), STR(reply_client), request_id,
+			 STR(reply_addr), dnsbl_ttl);
     } else if (event == EVENT_TIME) {
 	msg_warn("dnsblog reply timeout %ds for %s",
 		 var_psc_dnsbl_tmout, (char *) vstream_context(stream));
     }
-    /* Here, score may be a null pointer. */
     vstream_fclose(stream);
 }
 
+/* psc_dnsbl_query_name - reverse client address, append DNSBL domain */
+
+static const char *psc_dnsbl_query_name(VSTRING *query, const char *addr,
+					        const char *dnsbl_domain)
+{
+    const char *myname = "psc_dnsbl_query_name";
+    ARGV   *octets;
+    int     i;
+    struct addrinfo *res;
+    unsigned char *ipv6_addr;
+
+    VSTRING_RESET(query);
+
+    /*
+     * As with dnsblog(8), reverse an IPv6 address as 32 hexadecimal nibbles,
+     * and an IPv4 address as four decimal octets.
+     */
+#ifdef HAS_IPV6
+    if (valid_ipv6_hostaddr(addr, DONT_GRIPE)) {
+	if (hostaddr_to_sockaddr(addr, (char *) 0, 0, &res) != 0
+	    || res->ai_family != PF_INET6)
+	    msg_fatal("%s: unable to convert address %s", myname, addr);
+	ipv6_addr = (unsigned char *) &SOCK_ADDR_IN6_ADDR(res->ai_addr);
+	for (i = sizeof(SOCK_ADDR_IN6_ADDR(res->ai_addr)) - 1; i >= 0; i--)
+	    vstring_sprintf_append(query, "%x.%x.",
+				   ipv6_addr[i] & 0xf, ipv6_addr[i] >> 4);
+	freeaddrinfo(res);
+    } else
+#endif
+    {
+	octets = argv_split(addr, ".");
+	for (i = octets->argc - 1; i >= 0; i--) {
+	    vstring_strcat(query, octets->argv[i]);
+	    vstring_strcat(query, ".");
+	}
+	argv_free(octets);
+    }
+    vstring_strcat(query, dnsbl_domain);
+    return (STR(query));
+}
+
+ /*
+  * Per-query state for the built-in DNS client.
+  */
+typedef struct {
+    char   *client_addr;		/* client IP address */
+    const char *dnsbl_domain;		/* dnsbl_site_cache key */
+    int     request_id;			/* duplicate suppression */
+} PSC_DNSBL_QUERY;
+
+/* psc_dnsbl_dns_receive - receive built-in DNS client reply */
+
+static void psc_dnsbl_dns_receive(int status, DNS_RR *rr_list, void *context)
+{
+    const char *myname = "psc_dnsbl_dns_receive";
+    PSC_DNSBL_QUERY *query = (PSC_DNSBL_QUERY *) context;
+    MAI_HOSTADDR_STR hostaddr;
+    DNS_RR *rr;
+    int     dnsbl_ttl = -1;
+
+    /*
+     * Convert the reply to the form that dnsblog(8) would send, and log
+     * matches as dnsblog(8) would.
+     */
+    VSTRING_RESET(reply_addr);
+    if (status == DNS_OK) {
+	for (rr = rr_list; rr != 0; rr = rr->next) {
+	    if (dns_rr_to_pa(rr, &hostaddr) == 0) {
+		msg_warn("%s: skipping reply record type %s for %s: %m",
+			 myname, dns_strtype(rr->type), query->client_addr);
+	    } else {
+		msg_info("addr %s listed by domain %s as %s",
+			 query->client_addr, query->dnsbl_domain, hostaddr.buf);
+		if (LEN(reply_addr) > 0)
+		    vstring_strcat(reply_addr, " ");
+		vstring_strcat(reply_addr, hostaddr.buf);
+		if (dnsbl_ttl < 0 || dnsbl_ttl > rr->ttl)
+		    dnsbl_ttl = rr->ttl;
+	    }
+	}
+    } else if (status == DNS_NOTFOUND) {
+	for (rr = rr_list; rr != 0; rr = rr->next)
+	    if (rr->type == T_SOA && (dnsbl_ttl < 0 || dnsbl_ttl > rr->ttl))
+		dnsbl_ttl = rr->ttl;
+    } else if (status == DNS_RETRY) {
+	msg_warn("DNS lookup error for addr %s domain %s",
+		 query->client_addr, query->dnsbl_domain);
+    }
+    VSTRING_TERMINATE(reply_addr);
+    psc_dnsbl_update(query->dnsbl_domain, query->client_addr,
+		     query->request_id, STR(reply_addr), dnsbl_ttl);
+    myfree(query->client_addr);
+    myfree((void *) query);
+}
+
 /* psc_dnsbl_request  - send dnsbl query, increment reference count */
 
 int     psc_dnsbl_request(const char *client_addr,
@@ -492,6 +753,8 @@ int     psc_dnsbl_request(const char *client_addr,
     HTABLE_INFO **ht;
     PSC_DNSBL_SCORE *score;
     HTABLE_INFO *hash_node;
+    PSC_DNSBL_QUERY *query;
+    const PSC_DNSBL_REPLY *reply;
     static int request_count;
 
     /*
@@ -525,7 +788,7 @@ int     psc_dnsbl_request(const char *client_addr,
 	    msg_info("%s: reuse blocklist score for %s refcount=%d pending=%d",
 		     myname, client_addr, score->refcount,
 		     score->pending_lookups);
-	if (score->pending_lookups == 0)
+	if (score->pending_lookups == 0 || score->settled)
 	    event_request_timer(callback, context, EVENT_NULL_DELAY);
 	return (PSC_CALL_BACK_INDEX_OF_LAST(score));
     }
@@ -541,17 +804,51 @@ int     psc_dnsbl_request(const char *client_addr,
     score->total = 0;
     score->refcount = 1;
     score->pending_lookups = 0;
+    score->pending_pos = 0;
+    score->pending_neg = 0;
+    score->settled = 0;
     PSC_CALL_BACK_INIT(score);
     PSC_CALL_BACK_ENTER(score, callback, context);
     (void) htable_enter(dnsbl_score_cache, client_addr, (void *) score);
 
     /*
-     * Send a query to all DNSBL servers. Later, DNSBL lookup will be done
-     * with an UDP-based DNS client that is built directly into Postfix code.
-     * We therefore do not optimize the maximum out of this temporary
-     * implementation.
+     * Send a query to all DNSBL servers, with the built-in DNS client if
+     * enabled, otherwise or if that fails, through the DNSBLOG service.
+     * Skip DNSBL servers whose reply for this client is still cached.
      */
+#define PSC_DNSBL_PENDING(score, ht) do { \
+	PSC_DNSBL_HEAD *_head_ = (PSC_DNSBL_HEAD *) (ht)->value; \
+	(score)->pending_lookups += 1; \
+	(score)->pending_pos += _head_->pos_weight; \
+	(score)->pending_neg += _head_->neg_weight; \
+    } while (0)
+
     for (ht = dnsbl_site_list; *ht; ht++) {
+	if ((reply = psc_dnsbl_reply_find(ht[0]->key, client_addr)) != 0) {
+	    if (msg_verbose > 1)
+		msg_info("%s: cached reply for %s from %s",
+			 myname, client_addr, ht[0]->key);
+	    psc_dnsbl_score(score, ht[0]->key, client_addr,
+			    reply->reply_addrs,
+			    (int) (reply->expires - event_time()));
+	    continue;
+	}
+	if (var_psc_dnsbl_builtin) {
+	    query = (PSC_DNSBL_QUERY *) mymalloc(sizeof(*query));
+	    query->client_addr = mystrdup(client_addr);
+	    query->dnsbl_domain = ht[0]->key;
+	    query->request_id = score->request_id;
+	    if (dns_lookup_async(psc_dnsbl_query_name(query_name, client_addr,
+						      ht[0]->key),
+				 T_A, DNS_REQ_FLAG_NCACHE_TTL,
+				 var_psc_dnsbl_tmout, psc_dnsbl_dns_receive,
+				 (void *) query) == 0) {
+		PSC_DNSBL_PENDING(score, ht[0]);
+		continue;
+	    }
+	    myfree(query->client_addr);
+	    myfree((void *) query);
+	}
 	if ((fd = LOCAL_CONNECT(psc_dnsbl_service, NON_BLOCKING, 1)) < 0) {
 	    msg_warn("%s: connect to %s service: %m",
 		     myname, psc_dnsbl_service);
@@ -574,8 +871,17 @@ int     psc_dnsbl_request(const char *client_addr,
 	}
 	PSC_READ_EVENT_REQUEST(vstream_fileno(stream), psc_dnsbl_receive,
 			       (void *) stream, var_psc_dnsbl_tmout);
-	score->pending_lookups += 1;
+	PSC_DNSBL_PENDING(score, ht[0]);
     }
+
+    /*
+     * As above, notify the requestor later when all replies are already in,
+     * or when the cached replies already settle the outcome.
+     */
+    if (score->pending_lookups > 0 && psc_dnsbl_settled(score))
+	score->settled = 1;
+    if (score->pending_lookups == 0 || score->settled)
+	event_request_timer(callback, context, EVENT_NULL_DELAY);
     return (PSC_CALL_BACK_INDEX_OF_LAST(score));
 }
 
@@ -621,4 +927,15 @@ void    psc_dnsbl_init(void)
     reply_client = vstring_alloc(100);
     reply_dnsbl = vstring_alloc(100);
     reply_addr = vstring_alloc(100);
+    query_name = vstring_alloc(100);
+
+    /*
+     * The optional DNSBL reply cache.
+     */
+    if (var_psc_dnsbl_cache > 0) {
+	dnsbl_reply_cache = ctable_create(var_psc_dnsbl_cache,
+					  psc_dnsbl_reply_create,
+					  psc_dnsbl_reply_delete, (void *) 0);
+	dnsbl_reply_key = vstring_alloc(100);
+    }
 }
@@ -28,7 +28,8 @@
 /*
 /*	psc_send_reply() does a best effort to send the reply, but
 /*	it won't block when the output is throttled by a hostile
-/*	peer.
+/*	peer. A per-session output buffer is allocated only for
+/*	text that could not be sent immediately.
 /*
 /*	PSC_SEND_REPLY() is a legacy wrapper for psc_send_reply().
 /*	It will eventually be replaced by its expansion.
@@ -38,6 +39,13 @@
 /*	This function must be called after all other session-related
 /*	work is finished including postscreen cache updates.
 /*
+/*	psc_send_socket() logs a warning, at most once per minute,
+/*	when the real SMTP server is slow to pick up a connection.
+/*	The warning reports how many connections took more than one
+/*	second, the largest delay, and the number of connections
+/*	that are in transit. This is a hint to increase the smtpd(8)
+/*	process limit in master.cf.
+/*
 /*	In case of an immediate error, psc_send_socket() sends a 421
 /*	reply to the remote SMTP client and closes the connection.
 /*	If the 220- greeting was sent, sending 421 would be invalid;
@@ -93,6 +101,12 @@ static MAPS *psc_rej_ftr_maps;
 #define PSC_SEND_SOCK_CONNECT_TIMEOUT	1
 #define PSC_SEND_SOCK_NOTIFY_TIMEOUT	100
 
+ /*
+  * Real SMTP server backlog reporting.
+  */
+#define PSC_SEND_SOCK_SLOW_DELAY	1000	/* milliseconds */
+#define PSC_SEND_SOCK_WARN_INTERVAL	60	/* seconds */
+
 /* pcs_send_pre_jail_init - initialize */
 
 void    pcs_send_pre_jail_init(void)
@@ -128,6 +142,8 @@ static const char *psc_get_footer(const char *text, ssize_t text_len)
 
 int     psc_send_reply(PSC_STATE *state, const char *text)
 {
+    static VSTRING *send_temp;
+    VSTRING *send_buf;
     ssize_t start;
     int     ret;
     const char *footer;
@@ -139,10 +155,17 @@ int     psc_send_reply(PSC_STATE *state, const char *text)
 
     /*
      * Append the new text to earlier text that could not be sent because the
-     * output was throttled.
+     * output was throttled. Without such text, format the reply in a shared
+     * buffer.
      */
-    start = VSTRING_LEN(state->send_buf);
-    vstring_strcat(state->send_buf, text);
+    if ((send_buf = state->send_buf) == 0) {
+	if (send_temp == 0)
+	    send_temp = vstring_alloc(100);
+	send_buf = send_temp;
+	VSTRING_RESET(send_buf);
+    }
+    start = VSTRING_LEN(send_buf);
+    vstring_strcat(send_buf, text);
 
     /*
      * For soft_bounce support, we also fix the REJECT logging before the
@@ -151,9 +174,9 @@ int     psc_send_reply(PSC_STATE *state, const char *text)
      */
     if (var_soft_bounce) {
 	if (text[0] == '5')
-	    STR(state->send_buf)[start + 0] = '4';
+	    STR(send_buf)[start + 0] = '4';
 	if (text[4] == '5')
-	    STR(state->send_buf)[start + 4] = '4';
+	    STR(send_buf)[start + 4] = '4';
     }
 
     /*
@@ -163,7 +186,7 @@ int     psc_send_reply(PSC_STATE *state, const char *text)
 	&& ((psc_rej_ftr_maps != 0
 	     && (footer = psc_get_footer(text, text_len)) != 0)
 	    || *(footer = var_psc_rej_footer) != 0))
-	smtp_reply_footer(state->send_buf, start, footer,
+	smtp_reply_footer(send_buf, start, footer,
 			  STR(psc_expand_filter), psc_expand_lookup,
 			  (void *) state);
 
@@ -172,15 +195,55 @@ int     psc_send_reply(PSC_STATE *state, const char *text)
      * throttled by a hostile peer.
      */
     ret = write(vstream_fileno(state->smtp_client_stream),
-		STR(state->send_buf), LEN(state->send_buf));
+		STR(send_buf), LEN(send_buf));
     if (ret > 0)
-	vstring_truncate(state->send_buf, ret - LEN(state->send_buf));
+	vstring_truncate(send_buf, ret - LEN(send_buf));
+
+    /*
+     * Keep unsent text with the session.
+     */
+    if (send_buf == send_temp && LEN(send_buf) > 0)
+	state->send_buf = vstring_memcpy(vstring_alloc(LEN(send_buf)),
+					 STR(send_buf), LEN(send_buf));
     if (ret < 0 && errno != EAGAIN && errno != EPIPE && errno != ECONNRESET)
 	msg_warn("write [%s]:%s: %m", state->smtp_client_addr,
 		 state->smtp_client_port);
     return (ret < 0 && errno != EAGAIN);
 }
 
+/* psc_send_socket_delay - report real SMTP server backlog */
+
+static void psc_send_socket_delay(PSC_STATE *state)
+{
+    static time_t last_warning;
+    static int slow_count;
+    static long max_delay;
+    struct timeval now;
+    long    delay;
+
+    /*
+     * The start time was reset when the connection was sent.
+     */
+    GETTIMEOFDAY(&now);
+    delay = (now.tv_sec - state->start_time.tv_sec) * 1000
+	+ (now.tv_usec - state->start_time.tv_usec) / 1000;
+    if (delay < PSC_SEND_SOCK_SLOW_DELAY)
+	return;
+    slow_count += 1;
+    if (delay > max_delay)
+	max_delay = delay;
+    if (now.tv_sec - last_warning >= PSC_SEND_SOCK_WARN_INTERVAL) {
+	msg_warn("service %s: %d connection(s) waited up to %ld.%03lds "
+		 "for pickup, %d in transit; consider increasing the "
+		 "process limit in %s/%s", psc_smtpd_service_name,
+		 slow_count, max_delay / 1000, max_delay % 1000,
+		 psc_post_queue_length, var_config_dir, MASTER_CONF_FILE);
+	last_warning = now.tv_sec;
+	slow_count = 0;
+	max_delay = 0;
+    }
+}
+
 /* psc_send_socket_close_event - file descriptor has arrived or timeout */
 
 static void psc_send_socket_close_event(int event, void *context)
@@ -205,6 +268,8 @@ static void psc_send_socket_close_event(int event, void *context)
     if (event == EVENT_TIME)
 	msg_warn("timeout sending connection to service %s",
 		 psc_smtpd_service_name);
+    else
+	psc_send_socket_delay(state);
     psc_free_session_state(state);
 }
 
@@ -286,6 +351,7 @@ void    psc_send_socket(PSC_STATE *state)
 	PSC_DEL_CLIENT_STATE(state);
 #endif
 	PSC_ADD_SERVER_STATE(state, server_fd);
+	GETTIMEOFDAY(&state->start_time);
 	PSC_READ_EVENT_REQUEST(state->smtp_server_fd, psc_send_socket_close_event,
 			       (void *) state, PSC_SEND_SOCK_NOTIFY_TIMEOUT);
 	return;
@@ -69,7 +69,8 @@
 /*	port arguments are null-terminated strings with the remote
 /*	SMTP client endpoint. The _reply members are set to
 /*	polite "try again" SMTP replies. The protocol member is set
-/*	to "SMTP".
+/*	to "SMTP". The output buffer is allocated only when output
+/*	to the remote SMTP client is throttled.
 /*
 /*	The psc_stress variable is set to non-zero when
 /*	psc_check_queue_length passes over a high-water mark.
@@ -133,6 +134,7 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <string.h>
 
 /* Utility library. */
 
@@ -162,16 +164,31 @@ PSC_STATE *psc_new_session_state(VSTREAM *stream,
 				         const char *server_port)
 {
     PSC_STATE *state;
+    size_t  client_addr_len = strlen(client_addr) + 1;
+    size_t  client_port_len = strlen(client_port) + 1;
+    size_t  server_addr_len = strlen(server_addr) + 1;
+    size_t  server_port_len = strlen(server_port) + 1;
+    char   *cp;
 
+    /*
+     * With tens of thousands of idle zombie connections, every allocation
+     * counts. Save the four endpoint strings in one memory block, and don't
+     * allocate an output buffer until the client throttles our output.
+     */
     state = (PSC_STATE *) mymalloc(sizeof(*state));
     if ((state->smtp_client_stream = stream) != 0)
 	psc_check_queue_length++;
     state->smtp_server_fd = (-1);
-    state->smtp_client_addr = mystrdup(client_addr);
-    state->smtp_client_port = mystrdup(client_port);
-    state->smtp_server_addr = mystrdup(server_addr);
-    state->smtp_server_port = mystrdup(server_port);
-    state->send_buf = vstring_alloc(100);
+    cp = mymalloc(client_addr_len + client_port_len
+		  + server_addr_len + server_port_len);
+    state->smtp_client_addr = memcpy(cp, client_addr, client_addr_len);
+    state->smtp_client_port = memcpy(cp += client_addr_len,
+				     client_port, client_port_len);
+    state->smtp_server_addr = memcpy(cp += client_port_len,
+				     server_addr, server_addr_len);
+    state->smtp_server_port = memcpy(cp += server_addr_len,
+				     server_port, server_port_len);
+    state->send_buf = 0;
     state->test_name = "TEST NAME HERE";
     state->dnsbl_reply = 0;
     state->final_reply = "421 4.3.2 Service currently unavailable\r\n";
@@ -241,10 +258,7 @@ void    psc_free_session_state(PSC_STATE *state)
     }
     if (state->send_buf != 0)
 	state->send_buf = vstring_free(state->send_buf);
-    myfree(state->smtp_client_addr);
-    myfree(state->smtp_client_port);
-    myfree(state->smtp_server_addr);
-    myfree(state->smtp_server_port);
+    myfree(state->smtp_client_addr);		/* also frees port and server */
     if (state->dnsbl_reply)
 	vstring_free(state->dnsbl_reply);
     if (state->helo_name)
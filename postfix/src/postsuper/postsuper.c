@@ -9,7 +9,8 @@
 /*		[\fB-c \fIconfig_dir\fR] [\fB-d \fIqueue_id\fR]
 /*		[\fB-e \fIqueue_id\fR] [\fB-f \fIqueue_id\fR]
 /*		[\fB-h \fIqueue_id\fR] [\fB-H \fIqueue_id\fR]
-/*		[\fB-r \fIqueue_id\fR] [\fIdirectory ...\fR]
+/*		[\fB-r \fIqueue_id\fR] [\fB-R \fIorigin\fR]
+/*		[\fIdirectory ...\fR]
 /* DESCRIPTION
 /*	The \fBpostsuper\fR(1) command does maintenance jobs on the Postfix
 /*	queue. Use of the command is restricted to the superuser.
@@ -58,6 +59,13 @@
 /*	 ' | tr -d '*!' | postsuper -d -
 /* .fi
 /* .sp
+/*	When standard input lists many queue IDs, \fBpostsuper\fR(1)
+/*	reads the entire list first, and scans each queue directory
+/*	once instead of looking up each queue ID in each queue. This
+/*	also applies to the \fB-e\fR, \fB-f\fR, \fB-h\fR, \fB-H\fR
+/*	and \fB-r\fR options. This feature is available in Postfix
+/*	3.9 and later.
+/* .sp
 /*	Specify "\fB-d ALL\fR" to remove all messages; for example, specify
 /*	"\fB-d ALL deferred\fR" to delete all mail in the \fBdeferred\fR queue.
 /*	As a safety measure, the word \fBALL\fR must be specified in upper
@@ -207,6 +215,20 @@
 /*	system is running, but no harm should be done.
 /* .sp
 /*	This feature is available in Postfix 1.1 and later.
+/* .IP "\fB-R \fIorigin\fR"
+/*	Recover the mail of a failed peer node whose \fBmyhostname\fR
+/*	value is \fIorigin\fR. Move the queue file copies that the
+/*	\fBreplicad\fR(8) server received from that node into the
+/*	\fBmaildrop\fR queue, from where they are requeued as with
+/*	\fB-r\fR. A copy is skipped when the \fBmaildrop\fR queue
+/*	already has a file with the same name; run the command again
+/*	after that file is picked up.
+/* .sp
+/*	Do not recover mail from a node that is still running, or
+/*	that will be brought back with its mail queue intact, as
+/*	that delivers the mail twice.
+/* .sp
+/*	This feature is available in Postfix 3.9 and later.
 /* .IP \fB-s\fR
 /*	Structure check and structure repair.  This should be done once
 /*	before Postfix startup.
@@ -260,6 +282,7 @@
 /*	the number of messages expired or released with \fB-f\fR,
 /*	the number of messages held or released with \fB-h\fR or
 /*	\fB-H\fR, the number of messages requeued with \fB-r\fR,
+/*	the number of messages recovered with \fB-R\fR,
 /*	and the number of messages whose queue file name was fixed
 /*	with \fB-s\fR. The report is written to the standard error
 /*	stream and to \fBsyslogd\fR(8) or \fBpostlogd\fR(8).
@@ -302,10 +325,17 @@
 /*	Available in Postfix version 2.9 and later:
 /* .IP "\fBenable_long_queue_ids (no)\fR"
 /*	Enable long, non-repeating, queue IDs (queue file names).
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBqueue_stripe_directories (empty)\fR"
+/*	Subdirectories of the queue directory, typically mount points
+/*	on different devices, across which message queue files are
+/*	striped.
 /* SEE ALSO
 /*	sendmail(1), Sendmail-compatible user interface
 /*	postqueue(1), unprivileged queue operations
 /*	postlogd(8), Postfix logging
+/*	replicad(8), queue file replication
 /*	syslogd(8), system logging
 /* LICENSE
 /* .ad
@@ -328,6 +358,7 @@
 #include <sys_defs.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
@@ -353,6 +384,9 @@
 #include <clean_env.h>
 #include <safe_open.h>
 #include <name_mask.h>
+#include <htable.h>
+#include <valid_hostname.h>
+#include <iostuff.h>
 
 /* Global library. */
 
@@ -363,6 +397,7 @@
 #define MAIL_QUEUE_INTERNAL
 #include <mail_queue.h>
 #include <mail_open_ok.h>
+#include <mail_scan_dir.h>
 #include <file_id.h>
 #include <mail_parm_split.h>
 #include <maillog_client.h>
@@ -387,6 +422,7 @@
 #define ACTION_EXPIRE_ALL (1<<12)	/* expire all queue file(s) */
 #define ACTION_EXP_REL_ONE (1<<13)	/* expire+release named queue file(s) */
 #define ACTION_EXP_REL_ALL (1<<14)	/* expire+release all queue file(s) */
+#define ACTION_RECOVER	(1<<15)		/* requeue a peer node's replicas */
 
 #define ACTION_DEFAULT	(ACTION_STRUCT | ACTION_PURGE)
 
@@ -470,6 +506,7 @@ static int message_held = 0;		/* messages put on hold */
 static int message_released = 0;	/* messages released from hold */
 static int message_deleted = 0;		/* deleted messages */
 static int message_expired = 0;		/* expired messages */
+static int message_recovered = 0;	/* requeued replicas */
 static int inode_fixed = 0;		/* queue id matched to inode number */
 static int inode_mismatch = 0;		/* queue id inode mismatch */
 static int position_mismatch = 0;	/* file position mismatch */
@@ -550,18 +587,60 @@ static int postexpire(const char *path)
     POSTEXPIRE_RETURN(0);
 }
 
+/* postcopy - move file to other file system with extreme prejudice */
+
+static int postcopy(const char *old, const char *new)
+{
+    char    buf[VSTREAM_BUFSIZE];
+    struct stat st;
+    ssize_t count;
+    int     old_fd;
+    int     new_fd;
+
+    /*
+     * The maildrop queue is not striped, so "postsuper -r" may move a queue
+     * file to a different file system. Don't make the copy ready for pickup
+     * until it is complete.
+     */
+    if ((old_fd = open(old, O_RDONLY, 0)) < 0) {
+	if (errno != ENOENT)
+	    msg_fatal("open file %s: %m", old);
+	return (-1);
+    }
+    if (fstat(old_fd, &st) < 0)
+	msg_fatal("fstat file %s: %m", old);
+    if ((new_fd = open(new, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0)
+	msg_fatal("create file %s: %m", new);
+    while ((count = read(old_fd, buf, sizeof(buf))) > 0)
+	if (write_buf(new_fd, buf, count, 0) < 0)
+	    break;
+    if (count != 0 || fsync(new_fd) < 0
+	|| fchmod(new_fd, st.st_mode & ~S_IFMT) < 0 || close(new_fd) < 0) {
+	(void) unlink(new);
+	msg_fatal("copy file %s to %s: %m", old, new);
+    }
+    (void) close(old_fd);
+    if (unlink(old) < 0 && errno != ENOENT)
+	msg_fatal("remove file %s: %m", old);
+    if (msg_verbose)
+	msg_info("copied file %s to %s", old, new);
+    return (0);
+}
+
 /* postrename - rename file with extreme prejudice */
 
 static int postrename(const char *old, const char *new)
 {
     int     ret;
 
-    if ((ret = sane_rename(old, new)) < 0) {
-	if (errno != ENOENT
-	    || mail_queue_mkdirs(new) < 0
-	    || (ret = sane_rename(old, new)) < 0)
-	    if (errno != ENOENT)
-		msg_fatal("rename file %s as %s: %m", old, new);
+    if ((ret = sane_rename(old, new)) < 0 && errno == ENOENT
+	&& mail_queue_mkdirs(new) == 0)
+	ret = sane_rename(old, new);
+    if (ret < 0 && errno == EXDEV)
+	return (postcopy(old, new));
+    if (ret < 0) {
+	if (errno != ENOENT)
+	    msg_fatal("rename file %s as %s: %m", old, new);
     } else {
 	if (msg_verbose)
 	    msg_info("renamed file %s as %s", old, new);
@@ -587,7 +666,7 @@ static int postrmdir(const char *path)
 
 /* delete_one - delete one message instance and all its associated files */
 
-static void delete_one(const char **queue_names, const char *queue_id)
+static int delete_one(const char **queue_names, const char *queue_id)
 {
     struct stat st;
     const char **msg_qpp;
@@ -602,7 +681,7 @@ static void delete_one(const char **queue_names, const char *queue_id)
      */
     if (!mail_queue_id_ok(queue_id)) {
 	msg_warn("invalid mail queue id: %s", queue_id);
-	return;
+	return (0);
     }
     log_path_buf = vstring_alloc(100);
 
@@ -629,11 +708,12 @@ static void delete_one(const char **queue_names, const char *queue_id)
     }
     vstring_free(log_path_buf);
     message_deleted += found;
+    return (found);
 }
 
 /* requeue_one - requeue one message instance and delete its logfiles */
 
-static void requeue_one(const char **queue_names, const char *queue_id)
+static int requeue_one(const char **queue_names, const char *queue_id)
 {
     struct stat st;
     const char **msg_qpp;
@@ -648,7 +728,7 @@ static void requeue_one(const char **queue_names, const char *queue_id)
      */
     if (!mail_queue_id_ok(queue_id)) {
 	msg_warn("invalid mail queue id: %s", queue_id);
-	return;
+	return (0);
     }
     new_path_buf = vstring_alloc(100);
 
@@ -679,11 +759,12 @@ static void requeue_one(const char **queue_names, const char *queue_id)
     }
     vstring_free(new_path_buf);
     message_requeued += found;
+    return (found);
 }
 
 /* hold_one - put "on hold" one message instance */
 
-static void hold_one(const char **queue_names, const char *queue_id)
+static int hold_one(const char **queue_names, const char *queue_id)
 {
     struct stat st;
     const char **msg_qpp;
@@ -697,7 +778,7 @@ static void hold_one(const char **queue_names, const char *queue_id)
      */
     if (!mail_queue_id_ok(queue_id)) {
 	msg_warn("invalid mail queue id: %s", queue_id);
-	return;
+	return (0);
     }
     new_path_buf = vstring_alloc(100);
 
@@ -730,11 +811,12 @@ static void hold_one(const char **queue_names, const char *queue_id)
     }
     vstring_free(new_path_buf);
     message_held += found;
+    return (found);
 }
 
 /* release_one - release one message instance that was placed "on hold" */
 
-static void release_one(const char **queue_names, const char *queue_id)
+static int release_one(const char **queue_names, const char *queue_id)
 {
     struct stat st;
     const char **msg_qpp;
@@ -747,7 +829,7 @@ static void release_one(const char **queue_names, const char *queue_id)
      */
     if (!mail_queue_id_ok(queue_id)) {
 	msg_warn("invalid mail queue id: %s", queue_id);
-	return;
+	return (0);
     }
     new_path_buf = vstring_alloc(100);
 
@@ -770,11 +852,12 @@ static void release_one(const char **queue_names, const char *queue_id)
     }
     vstring_free(new_path_buf);
     message_released += found;
+    return (found);
 }
 
 /* expire_one - expire one message instance */
 
-static void expire_one(const char **queue_names, const char *queue_id)
+static int expire_one(const char **queue_names, const char *queue_id)
 {
     struct stat st;
     const char **msg_qpp;
@@ -787,7 +870,7 @@ static void expire_one(const char **queue_names, const char *queue_id)
      */
     if (!mail_queue_id_ok(queue_id)) {
 	msg_warn("invalid mail queue id: %s", queue_id);
-	return;
+	return (0);
     }
 
     /*
@@ -809,28 +892,140 @@ static void expire_one(const char **queue_names, const char *queue_id)
 	}
     }
     message_expired += found;
+    return (found);
 }
 
 /* exp_rel_one - expire or release one message instance */
 
-static void exp_rel_one(const char **queue_names, const char *queue_id)
+static int exp_rel_one(const char **queue_names, const char *queue_id)
 {
-    expire_one(queue_names, queue_id);
-    release_one(queue_names, queue_id);
+    int     found;
+
+    found = expire_one(queue_names, queue_id);
+    found |= release_one(queue_names, queue_id);
+    return (found);
 }
 
 /* operate_stream - operate on queue IDs given on stream */
 
 static void operate_stream(VSTREAM *fp,
-		             void (*operator) (const char **, const char *),
+			           int (*operator) (const char **, const char *),
 			           const char **queues)
 {
     VSTRING *buf = vstring_alloc(20);
+    ARGV   *ids = argv_alloc(100);
+    HTABLE *todo;
+    HTABLE_INFO *ht;
+    SCAN_DIR *scan;
+    const char **qpp;
+    const char *one_queue[2];
+    char   *id;
+    char  **cpp;
 
-    while (vstring_get_nonl(buf, fp) != VSTREAM_EOF)
-	operator(queues, STR(buf));
+    /*
+     * With a short list, look up each queue ID in all applicable queues.
+     */
+#define BULK_ID_MIN	1000
 
+    while (vstring_get_nonl(buf, fp) != VSTREAM_EOF)
+	argv_add(ids, STR(buf), (char *) 0);
     vstring_free(buf);
+    if (ids->argc < BULK_ID_MIN) {
+	for (cpp = ids->argv; *cpp; cpp++)
+	    (void) operator(queues, *cpp);
+	argv_free(ids);
+	return;
+    }
+
+    /*
+     * With a long list, that costs several lstat() calls per queue ID. We
+     * instead scan each queue directory once, and operate only on queue
+     * files that are listed. The operator still verifies each queue file
+     * before it acts, so this is only an optimization.
+     */
+    todo = htable_create(ids->argc);
+    for (cpp = ids->argv; *cpp; cpp++) {
+	if (!mail_queue_id_ok(*cpp))
+	    msg_warn("invalid mail queue id: %s", *cpp);
+	else if (htable_locate(todo, *cpp) == 0)
+	    (void) htable_enter(todo, *cpp, (void *) 0);
+    }
+    one_queue[1] = 0;
+    for (qpp = queues; todo->used > 0 && *qpp != 0; qpp++) {
+	if (!MESSAGE_QUEUE(find_queue_info(*qpp)))
+	    continue;
+	one_queue[0] = *qpp;
+	scan = scan_dir_open(*qpp);
+	while ((id = mail_scan_dir_next(scan)) != 0)
+	    if (htable_locate(todo, id) != 0 && operator(one_queue, id))
+		htable_delete(todo, id, (void (*) (void *)) 0);
+	scan_dir_close(scan);
+    }
+
+    /*
+     * A queue file may have moved to a queue that we already scanned, or
+     * the operator may not apply to the queue where we found it. Look up
+     * the remaining queue IDs the slow way.
+     */
+    for (cpp = ids->argv; *cpp; cpp++) {
+	if ((ht = htable_locate(todo, *cpp)) != 0) {
+	    (void) operator(queues, ht->key);
+	    htable_delete(todo, *cpp, (void (*) (void *)) 0);
+	}
+    }
+    htable_free(todo, (void (*) (void *)) 0);
+    argv_free(ids);
+}
+
+/* recover_replicas - requeue the queue file copies from a peer node */
+
+static void recover_replicas(const char *origin)
+{
+    VSTRING *replica_dir = vstring_alloc(100);
+    VSTRING *old_path = vstring_alloc(100);
+    VSTRING *new_path = vstring_alloc(100);
+    SCAN_DIR *scan;
+    struct stat st;
+    struct utimbuf tbuf;
+    char   *queue_id;
+
+    /*
+     * Sanity check. The origin name becomes part of a pathname.
+     */
+    if (!valid_hostname(origin, DONT_GRIPE))
+	msg_fatal("invalid origin name: %s", origin);
+    vstring_sprintf(replica_dir, "%s/%s", MAIL_QUEUE_REPLICA, origin);
+
+    /*
+     * Skip replicad(8) temporary files; those do not have a valid queue ID.
+     * Don't replace a maildrop file: the name may be in use by a local
+     * submission or by a requeued message.
+     */
+    scan = scan_dir_open(STR(replica_dir));
+    while ((queue_id = scan_dir_next(scan)) != 0) {
+	if (!mail_queue_id_ok(queue_id))
+	    continue;
+	vstring_sprintf(old_path, "%s/%s", STR(replica_dir), queue_id);
+	if (lstat(STR(old_path), &st) < 0 || !S_ISREG(st.st_mode)
+	    || !READY_MESSAGE(st))
+	    continue;
+	(void) mail_queue_path(new_path, MAIL_QUEUE_MAILDROP, queue_id);
+	if (lstat(STR(new_path), &st) == 0) {
+	    msg_warn("%s: file %s exists -- skipping", queue_id, STR(new_path));
+	    continue;
+	}
+	if (postrename(STR(old_path), STR(new_path)) == 0) {
+	    tbuf.actime = tbuf.modtime = time((time_t *) 0);
+	    if (utime(STR(new_path), &tbuf) < 0)
+		msg_warn("%s: reset time stamps: %m", STR(new_path));
+	    msg_info("%s: requeued from %s", queue_id, origin);
+	    message_recovered++;
+	}
+    }
+    scan_dir_close(scan);
+    vstring_free(replica_dir);
+    vstring_free(old_path);
+    vstring_free(new_path);
 }
 
 /* fix_queue_id - make message queue ID match inode number */
@@ -907,6 +1102,7 @@ static void super(const char **queues, int action)
     const char *queue_name;
     SCAN_DIR *info;
     char   *path;
+    const char *stripe_dir;
     int     actual_depth;
     int     wanted_depth;
     char  **cpp;
@@ -966,11 +1162,18 @@ static void super(const char **queues, int action)
 
 	    /*
 	     * If we reach the end of a subdirectory, return to its parent.
-	     * Delete subdirectories that are no longer needed.
+	     * Delete subdirectories that are no longer needed. At the end of
+	     * a striped queue, continue with the next stripe.
 	     */
 	    if ((path = scan_dir_next(info)) == 0) {
-		if (actual_depth == 0)
-		    break;
+		if (actual_depth == 0) {
+		    stripe_dir = mail_queue_stripe_next(scan_dir_path(info));
+		    if (stripe_dir == 0)
+			break;
+		    scan_dir_pop(info);
+		    scan_dir_push(info, stripe_dir);
+		    continue;
+		}
 		if (actual_depth > wanted_depth)
 		    postrmdir(scan_dir_path(info));
 		scan_dir_pop(info);
@@ -1350,7 +1553,7 @@ int     main(int argc, char **argv)
      * First, find out what kind of actions are requested, without executing
      * them. Later, we execute actions in mostly user-specified order.
      */
-#define GETOPT_LIST "c:d:e:f:h:H:pr:sSv"
+#define GETOPT_LIST "c:d:e:f:h:H:pr:R:sSv"
 
     saved_optind = optind;
     while ((c = GETOPT(argc, argv, GETOPT_LIST)) > 0) {
@@ -1363,6 +1566,7 @@ int     main(int argc, char **argv)
 		      "[-f queue_id (expire and/or un-hold)] "
 		      "[-h queue_id (hold)] [-H queue_id (un-hold)] "
 		      "[-p (purge temporary files)] [-r queue_id (requeue)] "
+		      "[-R origin (recover peer node mail)] "
 		      "[-s (structure fix)] [-S (redundant structure fix)]"
 		      "[-v (verbose)] [queue...]", argv[0]);
 	case 'c':
@@ -1398,6 +1602,9 @@ int     main(int argc, char **argv)
 	    action |= (strcmp(optarg, "ALL") == 0 ?
 		       ACTION_REQUEUE_ALL : ACTION_REQUEUE_ONE);
 	    break;
+	case 'R':
+	    action |= ACTION_RECOVER;
+	    break;
 	case 'S':
 	    action |= ACTION_STRUCT_RED;
 	    /* FALLTHROUGH */
@@ -1571,6 +1778,9 @@ int     main(int argc, char **argv)
 	    else
 		requeue_one(queues, optarg);
 	    break;
+	case 'R':
+	    recover_replicas(optarg);
+	    break;
 	}
     }
 
@@ -1580,6 +1790,9 @@ int     main(int argc, char **argv)
     if (action & (ACTION_REQUEUE_ONE | ACTION_REQUEUE_ALL))
 	msg_info("Requeued: %d message%s", message_requeued,
 		 message_requeued != 1 ? "s" : "");
+    if (action & ACTION_RECOVER)
+	msg_info("Recovered: %d message%s", message_recovered,
+		 message_recovered != 1 ? "s" : "");
     if (action & (ACTION_DELETE_ONE | ACTION_DELETE_ALL))
 	msg_info("Deleted: %d message%s", message_deleted,
 		 message_deleted != 1 ? "s" : "");
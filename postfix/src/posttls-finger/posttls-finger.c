@@ -60,6 +60,23 @@
 /*	number of times (default 5) that can be specified via the \fB-m\fR
 /*	option.
 /*
+/*	With the \fB-N \fIcount\fR option, \fBposttls-finger\fR(1)
+/*	becomes a TLS handshake load generator. It makes \fIcount\fR
+/*	sessions with the destination, spread over the number of parallel
+/*	processes specified with \fB-n\fR, optionally at the aggregate
+/*	rate specified with \fB-q\fR. Each session does the greeting,
+/*	EHLO, STARTTLS and the TLS handshake through the same TLS client
+/*	library code as \fBsmtp\fR(8), and then sends QUIT. Each process
+/*	keeps its own TLS session cache, so that sessions after the first
+/*	are resumed when the server allows; specify \fB-u\fR to force a
+/*	full handshake for every session. Specify "\fB-o
+/*	tls_ssl_options=NO_TICKET\fR" to resume with server-side session
+/*	ids instead of session tickets. At the end, \fBposttls-finger\fR(1)
+/*	reports the session rate, the number of resumed and failed
+/*	sessions, and the minimum, median, 90th and 99th percentile, and
+/*	maximum latency of full handshakes, of resumed handshakes, and
+/*	of complete sessions.
+/*
 /*	The choice of SMTP or LMTP (\fB-S\fR option) determines the syntax of
 /*	the destination argument. With SMTP, one can specify a service on a
 /*	non-default port as \fIhost\fR:\fIservice\fR, and disable MX (mail
@@ -219,6 +236,14 @@
 /*	nexthop destination security level is \fBdane\fR, but the MX
 /*	record was found via an "insecure" MX lookup.  See the main.cf
 /*	documentation for smtp_tls_dane_insecure_mx_policy for details.
+/* .IP "\fB-n \fIparallel\fR (default: \fB1\fR)"
+/*	With \fB-N\fR, the number of processes that make sessions in
+/*	parallel.
+/* .IP "\fB-N \fIcount\fR"
+/*	Generate load: make \fIcount\fR sessions, and report handshake
+/*	rate and latency statistics instead of server details. With this
+/*	option the \fB-L\fR default is \fBnone\fR. This option cannot
+/*	be combined with \fB-r\fR or \fB-X\fR.
 /* .IP "\fB-o \fIname=value\fR"
 /*	Specify zero or more times to override the value of the main.cf
 /*	parameter \fIname\fR with \fIvalue\fR.  Possible use-cases include
@@ -231,6 +256,9 @@
 /*	The OpenSSL CApath/ directory (indexed via c_rehash(1)) for remote
 /*	SMTP server certificate verification.  By default no CApath is used
 /*	and no public CAs are trusted.
+/* .IP "\fB-q \fIrate\fR (default: \fB0\fR)"
+/*	With \fB-N\fR, the target aggregate session rate per second.
+/*	Specify 0 to make sessions as fast as the server allows.
 /* .IP "\fB-r \fIdelay\fR"
 /*	With a cacheable TLS session, disconnect and reconnect after \fIdelay\fR
 /*	seconds. Report whether the session is re-used. Retry if a new server
@@ -255,6 +283,9 @@
 /*	reading the remote server's 220 banner.
 /* .IP "\fB-T \fItimeout\fR (default: \fB30\fR)"
 /*	The SMTP/LMTP command timeout for EHLO/LHLO, STARTTLS and QUIT.
+/* .IP "\fB-u\fR"
+/*	With \fB-N\fR, disable TLS session resumption, so that every
+/*	session does a full handshake.
 /* .IP "\fB-v\fR"
 /*	Enable verbose Postfix logging.  Specify more than once to increase
 /*	the level of verbose logging.
@@ -351,6 +382,8 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
@@ -509,6 +542,12 @@ typedef struct STATE {
     char   *protocols;			/* Protocol inclusion/exclusion */
     int     mxinsec_level;		/* DANE for insecure MX RRs? */
     int     tlsproxy_mode;
+    int     load_count;			/* -N option */
+    int     load_parallel;		/* -n option */
+    double  load_rate;			/* -q option */
+    int     load_noresume;		/* -u option */
+    double  tls_time;			/* handshake latency or -1 */
+    int     tls_reused;			/* handshake resumed session */
 #endif
     OPTIONS options;			/* JCL */
 } STATE;
@@ -754,6 +793,8 @@ static int starttls(STATE *state)
     VSTREAM *tlsproxy;
     VSTRING *port_buf;
     int     cwd_fd;
+    struct timeval start;
+    struct timeval done;
 
     if (state->wrapper_mode == 0) {
 	/* SMTP stream with deadline timeouts */
@@ -798,6 +839,7 @@ static int starttls(STATE *state)
 	ADD_EXCLUDE(cipher_exclusions, "eNULL");
 
     smtp_stream_setup(stream, smtp_tmout, /* deadline */ 1, /* minrate */ 0);
+    GETTIMEOFDAY(&start);
     if (state->tlsproxy_mode) {
 	TLS_CLIENT_PARAMS tls_params;
 
@@ -941,7 +983,13 @@ static int starttls(STATE *state)
 			     mdalg = state->mdalg,
 			  dane = state->ddane ? state->ddane : state->dane);
     }						/* tlsproxy_mode */
+    GETTIMEOFDAY(&done);
     vstring_free(cipher_exclusions);
+    if (state->tls_context != 0) {
+	state->tls_time = done.tv_sec - start.tv_sec
+	    + (done.tv_usec - start.tv_usec) / 1000000.0;
+	state->tls_reused = state->tls_context->session_reused;
+    }
     if (state->helo) {
 	myfree(state->helo);
 	state->helo = 0;
@@ -1784,10 +1832,192 @@ static int finger(STATE *state)
     return (0);
 }
 
+#ifdef USE_TLS
+
+/* load_elapsed - seconds since start time */
+
+static double load_elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return (now.tv_sec - start->tv_sec
+	    + (now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+/* load_worker - make a share of the load-generation sessions */
+
+static NORETURN load_worker(STATE *state, int fd, int count,
+			            double offset, double interval)
+{
+    VSTRING *buf = vstring_alloc(100);
+    struct timeval start;
+    struct timeval session_start;
+    double  delay;
+    int     err;
+    int     n;
+
+    GETTIMEOFDAY(&start);
+    for (n = 0; n < count; n++) {
+	if (interval > 0
+	    && (delay = offset + n * interval - load_elapsed(&start)) > 0)
+	    doze((unsigned) (delay * 1000000));
+	GETTIMEOFDAY(&session_start);
+	state->tls_time = -1;
+	state->tls_reused = 0;
+	state->buffer = vstring_alloc(100);
+	state->why = dsb_create();
+	if ((err = connect_dest(state)) == 0)
+	    err = doproto(state);
+	disconnect_dest(state);
+
+	/*
+	 * One short line per session; writes up to PIPE_BUF bytes are atomic,
+	 * so that results from different workers don't get mixed up.
+	 */
+	vstring_sprintf(buf, "%d %d %.6f %.6f\n",
+			err == 0 && state->tls_time >= 0, state->tls_reused,
+			state->tls_time, load_elapsed(&session_start));
+	if (write(fd, STR(buf), VSTRING_LEN(buf)) != VSTRING_LEN(buf))
+	    msg_fatal("write results: %m");
+    }
+    exit(0);
+}
+
+/* load_compare - qsort callback */
+
+static int load_compare(const void *a, const void *b)
+{
+    double  da = *(const double *) a;
+    double  db = *(const double *) b;
+
+    return (da < db ? -1 : da > db ? 1 : 0);
+}
+
+/* load_report - report latency percentiles in milliseconds */
+
+static void load_report(const char *what, double *list, int count)
+{
+
+#define LOAD_PCT(p)	(1000 * list[(count - 1) * (p) / 100])
+
+    if (count == 0)
+	return;
+    qsort((void *) list, count, sizeof(*list), load_compare);
+    msg_info("%s latency (ms, %d samples): min %.2f, 50%% %.2f, "
+	     "90%% %.2f, 99%% %.2f, max %.2f", what, count, LOAD_PCT(0),
+	     LOAD_PCT(50), LOAD_PCT(90), LOAD_PCT(99), LOAD_PCT(100));
+}
+
+/* load - run parallel sessions and report statistics */
+
+static int load(STATE *state)
+{
+    int     parallel = state->load_parallel;
+    int     count = state->load_count;
+    double  interval;
+    int     pipefd[2];
+    VSTREAM *results;
+    VSTRING *buf;
+    struct timeval start;
+    double  elapsed;
+    double *full_list;
+    double *reused_list;
+    double *session_list;
+    int     full_count = 0;
+    int     reused_count = 0;
+    int     session_count = 0;
+    int     ok;
+    int     reused;
+    double  tls_time;
+    double  session_time;
+    int     workers;
+    int     share;
+    int     status;
+    int     n;
+
+    if (state->tls_ctx == 0)
+	msg_fatal("The -N option requires TLS");
+    if (parallel > count)
+	parallel = count;
+    interval = state->load_rate > 0 ? parallel / state->load_rate : 0;
+
+    /*
+     * Each worker looks up the server address once, and reuses it for all
+     * its sessions.
+     */
+    state->reconnect = 1;
+    if (pipe(pipefd) < 0)
+	msg_fatal("pipe: %m");
+    vstream_fflush(VSTREAM_OUT);
+    GETTIMEOFDAY(&start);
+    for (workers = 0; workers < parallel; workers++) {
+	share = count / parallel + (workers < count % parallel);
+	switch (fork()) {
+	case -1:
+	    msg_fatal("fork: %m");
+	case 0:
+	    (void) close(pipefd[0]);
+	    load_worker(state, pipefd[1], share,
+			interval * workers / parallel, interval);
+	}
+    }
+    (void) close(pipefd[1]);
+
+    full_list = (double *) mymalloc(count * sizeof(*full_list));
+    reused_list = (double *) mymalloc(count * sizeof(*reused_list));
+    session_list = (double *) mymalloc(count * sizeof(*session_list));
+    results = vstream_fdopen(pipefd[0], O_RDONLY);
+    buf = vstring_alloc(100);
+    while (session_count < count
+	   && vstring_get_nonl(buf, results) != VSTREAM_EOF) {
+	if (sscanf(STR(buf), "%d %d %lf %lf",
+		   &ok, &reused, &tls_time, &session_time) != 4)
+	    msg_fatal("malformed worker result: %s", STR(buf));
+	if (!ok)
+	    continue;
+	session_list[session_count++] = session_time;
+	if (reused)
+	    reused_list[reused_count++] = tls_time;
+	else
+	    full_list[full_count++] = tls_time;
+    }
+    elapsed = load_elapsed(&start);
+    (void) vstream_fclose(results);
+    vstring_free(buf);
+
+    for (n = 0; n < workers; n++)
+	if (wait(&status) < 0)
+	    msg_fatal("wait: %m");
+	else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    msg_warn("load worker terminated abnormally");
+
+    msg_info("%d sessions with %d parallel processes in %.3f seconds: "
+	     "%.1f sessions/second", count, parallel, elapsed,
+	     elapsed > 0 ? session_count / elapsed : 0);
+    msg_info("%d full handshakes, %d resumed, %d failed",
+	     full_count, reused_count, count - session_count);
+    load_report("Full handshake", full_list, full_count);
+    load_report("Resumed handshake", reused_list, reused_count);
+    load_report("Session", session_list, session_count);
+
+    myfree((void *) full_list);
+    myfree((void *) reused_list);
+    myfree((void *) session_list);
+    state->reconnect = -1;
+    return (session_count < count);
+}
+
+#endif
+
 /* run - do what we were asked to do. */
 
 static int run(STATE *state)
 {
+#ifdef USE_TLS
+    if (state->load_count > 0)
+	return (load(state));
+#endif
 
     while (1) {
 	if (finger(state) != 0)
@@ -1853,7 +2083,8 @@ static void usage(void)
 	 "[-h host_lookup] [-l level] [-d mdalg] [-g grade] [-p protocols]",
 	    "[-A tafile] [-F CAfile.pem] [-P CApath/] [-s servername]",
 	    "[ [-H chainfiles] | [-k certfile [-K keyfile]] ]",
-	    "[-m count] [-r delay] [-o name=value]");
+	    "[-m count] [-r delay] [-N count [-n parallel] [-q rate] [-u]] "
+	    "[-o name=value]");
 #else
     fprintf(stderr, "usage: %s [-acRStTv] [-h host_lookup] [-o name=value]"
 	    " destination\n", var_procname);
@@ -1926,7 +2157,7 @@ static void parse_options(STATE *state, int argc, char *argv[])
 
 #define OPTS "a:ch:o:RSt:T:v"
 #ifdef USE_TLS
-#define TLSOPTS "A:Cd:fF:g:H:k:K:l:L:m:M:p:P:r:s:wxX"
+#define TLSOPTS "A:Cd:fF:g:H:k:K:l:L:m:M:n:N:p:P:q:r:s:uwxX"
 
     state->mdalg = 0;
     state->CApath = mystrdup("");
@@ -1941,6 +2172,10 @@ static void parse_options(STATE *state, int argc, char *argv[])
     state->level = TLS_LEV_DANE;
     state->mxinsec_level = TLS_LEV_DANE;
     state->tlsproxy_mode = 0;
+    state->load_count = 0;
+    state->load_parallel = 1;
+    state->load_rate = 0;
+    state->load_noresume = 0;
 #else
 #define TLSOPTS ""
     state->level = TLS_LEV_NONE;
@@ -2053,6 +2288,14 @@ static void parse_options(STATE *state, int argc, char *argv[])
 		msg_fatal("bad '-M' option value: %s", optarg);
 	    }
 	    break;
+	case 'n':
+	    if ((state->load_parallel = atoi(optarg)) <= 0)
+		msg_fatal("bad '-n' option value: %s", optarg);
+	    break;
+	case 'N':
+	    if ((state->load_count = atoi(optarg)) <= 0)
+		msg_fatal("bad '-N' option value: %s", optarg);
+	    break;
 	case 'p':
 	    myfree(state->protocols);
 	    state->protocols = mystrdup(optarg);
@@ -2061,6 +2304,10 @@ static void parse_options(STATE *state, int argc, char *argv[])
 	    myfree(state->CApath);
 	    state->CApath = mystrdup(optarg);
 	    break;
+	case 'q':
+	    if ((state->load_rate = atof(optarg)) < 0)
+		msg_fatal("bad '-q' option value: %s", optarg);
+	    break;
 	case 'r':
 	    state->reconnect = atoi(optarg);
 	    break;
@@ -2068,6 +2315,9 @@ static void parse_options(STATE *state, int argc, char *argv[])
 	    myfree(state->sni);
 	    state->sni = mystrdup(optarg);
 	    break;
+	case 'u':
+	    state->load_noresume = 1;
+	    break;
 	case 'w':
 	    state->wrapper_mode = 1;
 	    break;
@@ -2093,6 +2343,18 @@ static void parse_options(STATE *state, int argc, char *argv[])
 #ifdef USE_TLS
     if (state->tlsproxy_mode && state->reconnect >= 0)
 	msg_fatal("The -X and -r options are mutually exclusive");
+    if (state->load_count > 0) {
+	if (state->tlsproxy_mode)
+	    msg_fatal("The -X and -N options are mutually exclusive");
+	if (state->reconnect >= 0)
+	    msg_fatal("The -r and -N options are mutually exclusive");
+
+	/*
+	 * Each session speaks only STARTTLS and QUIT.
+	 */
+	state->nochat = 1;
+	state->pass = 2;
+    }
 #endif
 
     /*
@@ -2108,11 +2370,13 @@ static void parse_options(STATE *state, int argc, char *argv[])
 	msg_fatal("When the '-H' option is used, neither the '-k',"
 		  " nor the '-K' options may be used");
 
-    if (state->reconnect < 0)
+    if (state->reconnect < 0
+	&& (state->load_count == 0 || state->load_noresume))
 	tlsmgrmem_disable();
 
     if (state->options.logopts == 0)
-	state->options.logopts = mystrdup("routine,certmatch");
+	state->options.logopts = mystrdup(state->load_count > 0 ?
+					  "none" : "routine,certmatch");
     state->log_mask = tls_log_mask("-L option", state->options.logopts);
     tls_dane_loglevel("-L option", state->options.logopts);
 
@@ -51,6 +51,16 @@
 /*	the lookup result value.
 /*	The \fImaptype:mapname\fR and \fIflags\fR are the same
 /*	as with the \fBopen\fR request.
+/* .IP "\fBlookup_first\fR \fImaptype:mapname flags count key...\fR"
+/*	Look up \fIcount\fR keys in the specified order, and stop
+/*	at the first key that is found or that causes a lookup
+/*	error. The reply is the request completion status code,
+/*	the position of that key (\fIcount\fR when no key was
+/*	found), and the lookup result value. A client uses this
+/*	to search, for example, a domain and its parent domains
+/*	with one request.
+/* .sp
+/*	This request is supported in Postfix 3.9 and later.
 /* .IP "\fBupdate\fR \fImaptype:mapname flags key value\fR"
 /*	Update the data stored under the requested key.
 /*	The reply is the request completion status code.
@@ -82,6 +92,15 @@
 /*	request) or DENY (the table is not approved for proxy read
 /*	or update access).
 /*
+/*	With Postfix 3.9 and later, the read-only service can cache
+/*	\fBlookup\fR results, so that a key that is looked up by
+/*	many client processes results in one query to, for example,
+/*	an LDAP or SQL database. Successful and "not found" results
+/*	are cached for \fBproxymap_positive_cache_time\fR and
+/*	\fBproxymap_negative_cache_time\fR seconds, respectively.
+/*	Lookup errors are not cached. The cache is maintained per
+/*	\fBproxymap\fR(8) process.
+/*
 /*	There is no \fBclose\fR command, nor are tables implicitly closed
 /*	when a client disconnects. The purpose is to share tables among
 /*	multiple client processes.
@@ -186,6 +205,25 @@
 /*	Available in Postfix 3.3 and later:
 /* .IP "\fBservice_name (read-only)\fR"
 /*	The master.cf service name of a Postfix daemon process.
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBproxymap_positive_cache_time (0s)\fR"
+/*	The amount of time that the \fBproxymap\fR(8) read-only service
+/*	caches a successful lookup result; specify zero to disable
+/*	the lookup result cache.
+/* .IP "\fBproxymap_negative_cache_time (0s)\fR"
+/*	The amount of time that the \fBproxymap\fR(8) read-only service
+/*	caches a "not found" lookup result.
+/* .IP "\fBproxymap_cache_size_limit (10000)\fR"
+/*	The maximal number of lookup results that the \fBproxymap\fR(8)
+/*	read-only service caches per lookup table.
+/* .IP "\fBproxymap_client_limit (0)\fR"
+/*	The maximal number of clients that a \fBproxymap\fR(8)
+/*	process will serve before the \fBmaster\fR(8) daemon starts
+/*	another \fBproxymap\fR(8) process.
+/* .IP "\fBreopen_changed_tables (no)\fR"
+/*	Reopen a changed read-only lookup table in the running
+/*	process, instead of terminating the process.
 /* SEE ALSO
 /*	postconf(5), configuration parameters
 /*	master(5), generic daemon options
@@ -230,6 +268,9 @@
 #include <mymalloc.h>
 #include <vstring.h>
 #include <htable.h>
+#include <argv.h>
+#include <ctable.h>
+#include <events.h>
 #include <stringops.h>
 #include <dict.h>
 #include <dict_pipe.h>
@@ -271,6 +312,10 @@ char   *var_smtpd_snd_auth_maps;
 char   *var_psc_cache_map;
 char   *var_proxy_read_maps;
 char   *var_proxy_write_maps;
+int     var_proxy_pos_ttl;
+int     var_proxy_neg_ttl;
+int     var_proxy_cache_size;
+int     var_proxy_client_limit;
 
  /*
   * The pre-approved, pre-parsed list of maps.
@@ -284,7 +329,22 @@ static VSTRING *request;
 static VSTRING *request_map;
 static VSTRING *request_key;
 static VSTRING *request_value;
+static ARGV *request_keys;
 static VSTRING *map_type_name_flags;
+static VSTRING *cache_key;
+
+ /*
+  * Optional lookup result cache for the read-only service, with one cache
+  * per table instance. Lookup errors are not cached, so that a temporary
+  * database outage does not outlive the outage.
+  */
+typedef struct {
+    int     status;			/* PROXY_STAT_OK or PROXY_STAT_NOKEY */
+    char   *value;			/* lookup result, or null */
+    time_t  expires;			/* time of expiration */
+} PROXY_CACHE_ENTRY;
+
+static HTABLE *proxy_cache_tables;
 
  /*
   * Are we a proxy writer or not?
@@ -378,6 +438,113 @@ static DICT *proxy_map_find(const char *map_type_name, int request_flags,
     return (dict);
 }
 
+/* proxy_map_get - look up key, map dict status to proxy status */
+
+static int proxy_map_get(DICT *dict, const char *key, const char **value)
+{
+    if ((*value = dict_get(dict, key)) != 0) {
+	return (PROXY_STAT_OK);
+    } else if (dict->error == 0) {
+	*value = "";
+	return (PROXY_STAT_NOKEY);
+    } else {
+	*value = "";
+	return (dict->error == DICT_ERR_RETRY ?
+		PROXY_STAT_RETRY : PROXY_STAT_CONFIG);
+    }
+}
+
+/* proxy_cache_create - look up key and save the result */
+
+static void *proxy_cache_create(const char *key, void *context)
+{
+    DICT   *dict = (DICT *) context;
+    PROXY_CACHE_ENTRY *entry;
+    const char *value;
+    int     tag;
+
+    /*
+     * The cache key is the request flags, a colon, and the lookup key. Don't
+     * charge the table's own memory to the cache.
+     */
+    entry = (PROXY_CACHE_ENTRY *) mymalloc(sizeof(*entry));
+    tag = mymalloc_set_tag(MYMALLOC_TAG_OTHER);
+    entry->status = proxy_map_get(dict, strchr(key, ':') + 1, &value);
+    (void) mymalloc_set_tag(tag);
+    switch (entry->status) {
+    case PROXY_STAT_OK:
+	entry->value = mystrdup(value);
+	entry->expires = event_time() + var_proxy_pos_ttl;
+	break;
+    case PROXY_STAT_NOKEY:
+	entry->value = 0;
+	entry->expires = event_time() + var_proxy_neg_ttl;
+	break;
+    default:
+	entry->value = 0;
+	entry->expires = 0;
+	break;
+    }
+    return ((void *) entry);
+}
+
+/* proxy_cache_delete - destroy cached result */
+
+static void proxy_cache_delete(void *data, void *unused_context)
+{
+    PROXY_CACHE_ENTRY *entry = (PROXY_CACHE_ENTRY *) data;
+
+    if (entry->value)
+	myfree(entry->value);
+    myfree((void *) entry);
+}
+
+/* proxy_map_lookup - look up key, optionally via the result cache */
+
+static int proxy_map_lookup(DICT *dict, int request_flags, const char *key,
+			            const char **value)
+{
+    CTABLE *cache;
+    const PROXY_CACHE_ENTRY *entry;
+    int     was_cached;
+    int     tag;
+
+    /*
+     * Bypass the cache if it is not enabled. Otherwise, find or create the
+     * cache for this table instance; the instance name was computed by
+     * proxy_map_find().
+     */
+    if (proxy_cache_tables == 0)
+	return (proxy_map_get(dict, key, value));
+    tag = mymalloc_set_tag(MYMALLOC_TAG_DICT_CACHE);
+    if ((cache = (CTABLE *) htable_find(proxy_cache_tables,
+					STR(map_type_name_flags))) == 0) {
+	cache = ctable_create(var_proxy_cache_size, proxy_cache_create,
+			      proxy_cache_delete, (void *) dict);
+	(void) htable_enter(proxy_cache_tables, STR(map_type_name_flags),
+			    (void *) cache);
+    }
+
+    /*
+     * Look up the cached result, and refresh a result that has expired. A
+     * result that was created just now is not refreshed, even if it was a
+     * lookup error.
+     */
+    vstring_sprintf(cache_key, "%x:%s",
+		    request_flags & DICT_FLAG_RQST_MASK, key);
+    was_cached = ctable_exists(cache, STR(cache_key));
+    entry = (const PROXY_CACHE_ENTRY *) ctable_locate(cache, STR(cache_key));
+    if (was_cached && entry->expires <= event_time()) {
+	if (msg_verbose)
+	    msg_info("proxy_map_lookup: refresh %s key %s",
+		     STR(map_type_name_flags), key);
+	entry = (const PROXY_CACHE_ENTRY *) ctable_refresh(cache, STR(cache_key));
+    }
+    (void) mymalloc_set_tag(tag);
+    *value = (entry->value ? entry->value : "");
+    return (entry->status);
+}
+
 /* proxymap_sequence_service - remote sequence service */
 
 static void proxymap_sequence_service(VSTREAM *client_stream)
@@ -453,17 +620,69 @@ static void proxymap_lookup_service(VSTREAM *client_stream)
     } else if ((dict = proxy_map_find(STR(request_map), request_flags,
 				      &reply_status)) == 0) {
 	reply_value = "";
-    } else if (dict->flags = ((dict->flags & ~DICT_FLAG_RQST_MASK)
-			      | (request_flags & DICT_FLAG_RQST_MASK)),
-	       (reply_value = dict_get(dict, STR(request_key))) != 0) {
-	reply_status = PROXY_STAT_OK;
-    } else if (dict->error == 0) {
-	reply_status = PROXY_STAT_NOKEY;
-	reply_value = "";
     } else {
-	reply_status = (dict->error == DICT_ERR_RETRY ?
-			PROXY_STAT_RETRY : PROXY_STAT_CONFIG);
+	dict->flags = ((dict->flags & ~DICT_FLAG_RQST_MASK)
+		       | (request_flags & DICT_FLAG_RQST_MASK));
+	reply_status = proxy_map_lookup(dict, request_flags,
+					STR(request_key), &reply_value);
+    }
+
+    /*
+     * Respond to the client.
+     */
+    attr_print(client_stream, ATTR_FLAG_NONE,
+	       SEND_ATTR_INT(MAIL_ATTR_STATUS, reply_status),
+	       SEND_ATTR_STR(MAIL_ATTR_VALUE, reply_value),
+	       ATTR_TYPE_END);
+}
+
+/* proxymap_lookup_first_service - remote multi-key lookup service */
+
+static void proxymap_lookup_first_service(VSTREAM *client_stream)
+{
+    int     request_flags;
+    int     key_count;
+    DICT   *dict;
+    const char *reply_value;
+    int     reply_status;
+    int     reply_index = 0;
+
+    /*
+     * Process the request. The keys follow the request, one per attribute
+     * list.
+     */
+    argv_truncate(request_keys, 0);
+    if (attr_scan(client_stream, ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_TABLE, request_map),
+		  RECV_ATTR_INT(MAIL_ATTR_FLAGS, &request_flags),
+		  RECV_ATTR_INT(MAIL_ATTR_KEY_COUNT, &key_count),
+		  ATTR_TYPE_END) != 3
+	|| key_count <= 0 || key_count > PROXY_LOOKUP_FIRST_LIMIT) {
+	reply_status = PROXY_STAT_BAD;
 	reply_value = "";
+    } else {
+	while (request_keys->argc < key_count
+	       && attr_scan(client_stream, ATTR_FLAG_STRICT,
+			    RECV_ATTR_STR(MAIL_ATTR_KEY, request_key),
+			    ATTR_TYPE_END) == 1)
+	    argv_add(request_keys, STR(request_key), ARGV_END);
+	if (request_keys->argc < key_count) {
+	    reply_status = PROXY_STAT_BAD;
+	    reply_value = "";
+	} else if ((dict = proxy_map_find(STR(request_map), request_flags,
+					  &reply_status)) == 0) {
+	    reply_value = "";
+	} else {
+	    dict->flags = ((dict->flags & ~DICT_FLAG_RQST_MASK)
+			   | (request_flags & DICT_FLAG_RQST_MASK));
+	    for (reply_index = 0; reply_index < key_count; reply_index++) {
+		reply_status = proxy_map_lookup(dict, request_flags,
+					  request_keys->argv[reply_index],
+						&reply_value);
+		if (reply_status != PROXY_STAT_NOKEY)
+		    break;
+	    }
+	}
     }
 
     /*
@@ -471,6 +690,7 @@ static void proxymap_lookup_service(VSTREAM *client_stream)
      */
     attr_print(client_stream, ATTR_FLAG_NONE,
 	       SEND_ATTR_INT(MAIL_ATTR_STATUS, reply_status),
+	       SEND_ATTR_INT(MAIL_ATTR_KEY_INDEX, reply_index),
 	       SEND_ATTR_STR(MAIL_ATTR_VALUE, reply_value),
 	       ATTR_TYPE_END);
 }
@@ -650,6 +870,8 @@ static void proxymap_service(VSTREAM *client_stream, char *unused_service,
 		  ATTR_TYPE_END) == 1) {
 	if (VSTREQ(request, PROXY_REQ_LOOKUP)) {
 	    proxymap_lookup_service(client_stream);
+	} else if (VSTREQ(request, PROXY_REQ_LOOKUP_FIRST)) {
+	    proxymap_lookup_first_service(client_stream);
 	} else if (VSTREQ(request, PROXY_REQ_UPDATE)) {
 	    proxymap_update_service(client_stream);
 	} else if (VSTREQ(request, PROXY_REQ_DELETE)) {
@@ -764,7 +986,17 @@ static void post_jail_init(char *service_name, char **unused_argv)
     request_map = vstring_alloc(10);
     request_key = vstring_alloc(10);
     request_value = vstring_alloc(10);
+    request_keys = argv_alloc(PROXY_LOOKUP_FIRST_LIMIT);
     map_type_name_flags = vstring_alloc(10);
+    cache_key = vstring_alloc(10);
+
+    /*
+     * The read-only service may cache lookup results. The read-write
+     * service must not, because its clients expect to see their own
+     * updates.
+     */
+    if (proxy_writer == 0 && var_proxy_pos_ttl > 0)
+	proxy_cache_tables = htable_create(13);
 
     /*
      * Prepare the pre-approved list of proxied tables.
@@ -790,8 +1022,20 @@ static void pre_accept(char *unused_name, char **unused_argv)
     const char *table;
 
     if (proxy_writer == 0 && (table = dict_changed_name()) != 0) {
-	msg_info("table %s has changed -- restarting", table);
-	exit(0);
+	if (var_reopen_tables == 0 || (table = dict_reload_changed()) != 0) {
+	    msg_info("table %s has changed -- restarting", table);
+	    exit(0);
+	}
+
+	/*
+	 * Each lookup result cache remembers the table handle that it was
+	 * created with, and that handle may have been replaced. Start over
+	 * with empty caches.
+	 */
+	if (proxy_cache_tables != 0) {
+	    htable_free(proxy_cache_tables, (void (*) (void *)) ctable_free);
+	    proxy_cache_tables = htable_create(13);
+	}
     }
 }
 
@@ -837,6 +1081,16 @@ int     main(int argc, char **argv)
 	VAR_PROXY_WRITE_MAPS, DEF_PROXY_WRITE_MAPS, &var_proxy_write_maps, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_PROXY_CACHE_SIZE, DEF_PROXY_CACHE_SIZE, &var_proxy_cache_size, 1, 0,
+	VAR_PROXY_CLIENT_LIMIT, DEF_PROXY_CLIENT_LIMIT, &var_proxy_client_limit, 0, 0,
+	0,
+    };
+    static const CONFIG_TIME_TABLE time_table[] = {
+	VAR_PROXY_POS_TTL, DEF_PROXY_POS_TTL, &var_proxy_pos_ttl, 0, 0,
+	VAR_PROXY_NEG_TTL, DEF_PROXY_NEG_TTL, &var_proxy_neg_ttl, 0, 0,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -875,9 +1129,12 @@ int     main(int argc, char **argv)
      */
     multi_server_main(argc, argv, proxymap_service,
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
+		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
 		      CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
 		      CA_MAIL_SERVER_POST_ACCEPT(post_accept),
+		      CA_MAIL_SERVER_CLIENT_LIMIT(&var_proxy_client_limit),
     /* XXX CA_MAIL_SERVER_SOLITARY if proxywrite */
 		      0);
 }
@@ -112,6 +112,11 @@
 /*	Wakeup call, This is used by the master server to instantiate
 /*	servers that should not go away forever. The action is to start
 /*	an incoming queue scan.
+/* .IP "\fBQ\fIqueueid\fR\e0 (QMGR_REQ_EXPEDITE)\fR"
+/*	Bring the named incoming queue file into the active queue
+/*	without an incoming queue scan. The queue ID is followed
+/*	by a null byte. This is used by the \fBcleanup\fR(8) server
+/*	for new mail, and by the \fBflush\fR(8) server.
 /* .PP
 /*	The \fBqmgr\fR(8) daemon reads an entire buffer worth of triggers.
 /*	Multiple identical trigger requests are collapsed into one, and
@@ -211,6 +216,61 @@
 /*	A transport-specific override for the default_recipient_refill_delay
 /*	parameter value, where \fItransport\fR is the master.cf name of
 /*	the message delivery transport.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBqmgr_queue_index_map (empty)\fR"
+/*	Optional persistent index with the next delivery attempt time
+/*	of deferred queue files, so that deferred queue scans can skip
+/*	mail that is not yet due without looking up file attributes.
+/* .IP "\fBqmgr_queue_index_cleanup_interval (12h)\fR"
+/*	The amount of time between \fBqmgr\fR(8) queue index cleanup runs.
+/* .IP "\fBqmgr_deferred_full_scan_interval (0s)\fR"
+/*	When non-zero, the maximal time between full deferred queue
+/*	directory scans; other deferred queue scans visit only
+/*	messages that are due.
+/* .IP "\fBqmgr_deferred_feed_rate (0)\fR"
+/*	When non-zero, the maximal number of messages per second that
+/*	\fBqmgr\fR(8) moves from the deferred queue into the active
+/*	queue.
+/* .IP "\fBqmgr_shard_count (1)\fR"
+/*	The number of \fBqmgr\fR(8) processes that share the queue.
+/* .IP "\fBqmgr_shard_index (0)\fR"
+/*	The queue share of this \fBqmgr\fR(8) process, a number in
+/*	the range 0..\fBqmgr_shard_count\fR-1.
+/* .IP "\fBqmgr_shard_trigger_services (empty)\fR"
+/*	The names of \fBqmgr\fR(8) services that this process forwards
+/*	trigger requests to.
+/* .IP "\fBqmgr_status_file (empty)\fR"
+/*	The name of a file, relative to the queue directory, to which
+/*	\fBqmgr\fR(8) periodically writes a snapshot of its scheduler
+/*	state.
+/* .IP "\fBqmgr_status_update_interval (10s)\fR"
+/*	The time between \fBqmgr\fR(8) scheduler status file updates.
+/* .IP "\fBqmgr_feedback_state_file (empty)\fR"
+/*	The name of a file, relative to the queue directory, in which
+/*	\fBqmgr\fR(8) saves per-destination concurrency feedback
+/*	state, so that it survives a restart.
+/* .IP "\fBqmgr_feedback_state_update_interval (60s)\fR"
+/*	The time between \fBqmgr\fR(8) feedback state file updates.
+/* .IP "\fBqmgr_feedback_state_max_age (1h)\fR"
+/*	The age at which saved \fBqmgr\fR(8) feedback state is no
+/*	longer used.
+/* .IP "\fBqmgr_message_memory_limit (0)\fR"
+/*	When non-zero, the approximate number of bytes of memory for
+/*	in-core messages, queue entries and recipients, in addition
+/*	to the qmgr_message_active_limit and qmgr_message_recipient_limit
+/*	counts.
+/* .IP "\fBqmgr_dead_destination_parking (no)\fR"
+/*	Skip deferred messages whose recipients were all deferred
+/*	because of the same dead destination, without reading them,
+/*	until a delivery to that destination succeeds.
+/* .IP "\fBqmgr_priority_time_offset (3600s)\fR"
+/*	How much earlier (later) than its actual arrival time a message
+/*	with PRIORITY class high (low) is scheduled for delivery.
+/* .IP "\fBqmgr_dns_prefetch_transports (empty)\fR"
+/*	The names of message delivery transports whose next-hop
+/*	destination MX and address records \fBqmgr\fR(8) looks up
+/*	in the background when a new destination queue is created.
 /* DELIVERY CONCURRENCY CONTROLS
 /* .ad
 /* .fi
@@ -261,6 +321,17 @@
 /* .IP "\fBdestination_concurrency_feedback_debug (no)\fR"
 /*	Make the queue manager's feedback algorithm verbose for performance
 /*	analysis purposes.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBdefault_destination_concurrency_feedback_mode (count)\fR"
+/*	How the per-destination delivery concurrency is adjusted: with
+/*	\fBcount\fR, based only on delivery success and failure; with
+/*	\fBlatency\fR, also based on the measured delivery latency.
+/* .IP "\fBtransport_destination_concurrency_feedback_mode ($default_destination_concurrency_feedback_mode)\fR"
+/*	A transport-specific override for the
+/*	default_destination_concurrency_feedback_mode parameter value,
+/*	where \fItransport\fR is the master.cf name of the message delivery
+/*	transport.
 /* RECIPIENT SCHEDULING CONTROLS
 /* .ad
 /* .fi
@@ -451,12 +522,15 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <string.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <events.h>
 #include <vstream.h>
+#include <vstring.h>
+#include <stringops.h>
 #include <dict.h>
 
 /* Global library. */
@@ -469,6 +543,7 @@
 #include <mail_proto.h>			/* QMGR_SCAN constants */
 #include <mail_flow.h>
 #include <flush_clnt.h>
+#include <metrics_clnt.h>
 
 /* Master process interface */
 
@@ -509,6 +584,7 @@ bool    var_verp_bounce_off;
 int     var_qmgr_clog_warn_time;
 char   *var_conc_pos_feedback;
 char   *var_conc_neg_feedback;
+char   *var_conc_fdback_mode;
 int     var_conc_cohort_limit;
 int     var_conc_feedback_debug;
 int     var_xport_rate_delay;
@@ -518,6 +594,22 @@ int     var_qmgr_daemon_timeout;
 int     var_qmgr_ipc_timeout;
 int     var_dsn_delay_cleared;
 int     var_vrfy_pend_limit;
+char   *var_qmgr_index_map;
+int     var_qmgr_index_scan;
+int     var_qmgr_full_scan_int;
+int     var_qmgr_dfr_feed_rate;
+int     var_qmgr_shard_count;
+int     var_qmgr_shard_index;
+char   *var_qmgr_shard_triggers;
+char   *var_qmgr_status_file;
+int     var_qmgr_status_int;
+char   *var_qmgr_fbstate_file;
+int     var_qmgr_fbstate_int;
+int     var_qmgr_fbstate_maxage;
+long    var_qmgr_memory_limit;
+bool    var_qmgr_park_dead;
+int     var_qmgr_prio_offset;
+char   *var_qmgr_prefetch_xports;
 
 static QMGR_SCAN *qmgr_scans[2];
 
@@ -538,6 +630,104 @@ static void qmgr_deferred_run_event(int unused_event, void *dummy)
     event_request_timer(qmgr_deferred_run_event, dummy, var_queue_run_delay);
 }
 
+#define QMGR_METRICS_INTERVAL	10	/* seconds */
+
+/* qmgr_metrics_event - report in-memory queue gauges */
+
+static void qmgr_metrics_event(int unused_event, void *dummy)
+{
+    QMGR_TRANSPORT *transport;
+    QMGR_QUEUE *queue;
+    int     todo;
+    int     busy;
+
+    metrics_gauge("postfix_qmgr_active_messages",
+		  (double) qmgr_message_count, (char *) 0);
+    metrics_gauge("postfix_qmgr_active_recipients",
+		  (double) qmgr_recipient_count, (char *) 0);
+    metrics_gauge("postfix_qmgr_active_memory_bytes",
+		  (double) qmgr_memory_used, (char *) 0);
+    for (transport = qmgr_transport_list.next; transport;
+	 transport = transport->peers.next) {
+	todo = busy = 0;
+	for (queue = transport->queue_list.next; queue;
+	     queue = queue->peers.next) {
+	    todo += queue->todo_refcount;
+	    busy += queue->busy_refcount;
+	}
+	metrics_gauge("postfix_qmgr_transport_pending", (double) todo,
+		      "transport", transport->name, (char *) 0);
+	metrics_gauge("postfix_qmgr_transport_busy", (double) busy,
+		      "transport", transport->name, (char *) 0);
+    }
+    metrics_flush();
+    event_request_timer(qmgr_metrics_event, dummy, QMGR_METRICS_INTERVAL);
+}
+
+ /*
+  * Expedite request split over two trigger buffers. The limit is generous
+  * compared to the length of a queue ID.
+  */
+#define QMGR_EXPEDITE_MAXLEN	100
+
+static int qmgr_expedite_partial;
+
+ /*
+  * Expedite requests are not reliable: a trigger is dropped when the queue
+  * manager's listen queue is full, and then nothing else names that queue
+  * file. Follow up expedite requests with one incoming queue scan, so that
+  * such a file does not wait for the next periodic wakeup. Under load this
+  * still replaces many scans with one scan per interval.
+  */
+#define QMGR_EXPEDITE_CATCHUP	1	/* seconds */
+
+static int qmgr_expedite_catchup_pending;
+
+/* qmgr_expedite_catchup - incoming scan after expedite requests */
+
+static void qmgr_expedite_catchup(int unused_event, void *unused_context)
+{
+    qmgr_expedite_catchup_pending = 0;
+    qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_INCOMING], QMGR_SCAN_START);
+}
+
+/* qmgr_trigger_expedite - collect queue ID from expedite request */
+
+static ssize_t qmgr_trigger_expedite(char *buf, ssize_t len)
+{
+    static VSTRING *queue_id;
+    char   *end;
+
+    /*
+     * An expedite request may be split over two trigger buffers. Save the
+     * incomplete part, and finish it when the next buffer arrives.
+     */
+    if (queue_id == 0)
+	queue_id = vstring_alloc(20);
+    if ((end = memchr(buf, 0, len)) == 0) {
+	vstring_strncat(queue_id, buf, len);
+	if ((qmgr_expedite_partial =
+	     (VSTRING_LEN(queue_id) <= QMGR_EXPEDITE_MAXLEN)) == 0)
+	    VSTRING_RESET(queue_id);
+	return (len);
+    }
+    vstring_strncat(queue_id, buf, end - buf);
+    qmgr_expedite_partial = 0;
+    if (mail_queue_id_ok(vstring_str(queue_id))) {
+	qmgr_scan_expedite(qmgr_scans[QMGR_SCAN_IDX_INCOMING],
+			   vstring_str(queue_id));
+	if (qmgr_expedite_catchup_pending == 0) {
+	    event_request_timer(qmgr_expedite_catchup, (void *) 0,
+				QMGR_EXPEDITE_CATCHUP);
+	    qmgr_expedite_catchup_pending = 1;
+	}
+    } else
+	msg_warn("bad queue id \"%.30s\" in expedite request",
+		 printable(vstring_str(queue_id), '?'));
+    VSTRING_RESET(queue_id);
+    return (end - buf + 1);
+}
+
 /* qmgr_trigger_event - respond to external trigger(s) */
 
 static void qmgr_trigger_event(char *buf, ssize_t len,
@@ -553,6 +743,11 @@ static void qmgr_trigger_event(char *buf, ssize_t len,
     if (argv[0])
 	msg_fatal("unexpected command-line argument: %s", argv[0]);
 
+    /*
+     * Pass the request on to the other queue manager shards, if any.
+     */
+    qmgr_shard_trigger(buf, len);
+
     /*
      * Collapse identical requests that have arrived since we looked last
      * time. There is no client feedback so there is no need to process each
@@ -561,7 +756,8 @@ static void qmgr_trigger_event(char *buf, ssize_t len,
      */
 #define QMGR_FLUSH_BEFORE	(QMGR_FLUSH_ONCE | QMGR_FLUSH_DFXP)
 
-    for (i = 0; i < len; i++) {
+    i = (qmgr_expedite_partial ? qmgr_trigger_expedite(buf, len) : 0);
+    for ( /* void */ ; i < len; i++) {
 	if (msg_verbose)
 	    msg_info("request: %d (%c)",
 		     buf[i], ISALNUM(buf[i]) ? buf[i] : '?');
@@ -581,6 +777,9 @@ static void qmgr_trigger_event(char *buf, ssize_t len,
 	    deferred_flag |= QMGR_SCAN_ALL;
 	    incoming_flag |= QMGR_SCAN_ALL;
 	    break;
+	case QMGR_REQ_EXPEDITE:
+	    i += qmgr_trigger_expedite(buf + i + 1, len - i - 1);
+	    break;
 	default:
 	    if (msg_verbose)
 		msg_info("request ignored");
@@ -610,6 +809,9 @@ static int qmgr_loop(char *unused_name, char **unused_argv)
     static int first_scan_idx = QMGR_SCAN_IDX_INCOMING;
     int     last_scan_idx = QMGR_SCAN_IDX_COUNT - 1;
     int     delay;
+    int     paced = 0;
+    static time_t feed_time;		/* deferred feed rate interval */
+    static int feed_count;		/* deferred messages this interval */
 
     /*
      * This routine runs as part of the event handling loop, after the event
@@ -620,6 +822,11 @@ static int qmgr_loop(char *unused_name, char **unused_argv)
      */
 #define DONT_WAIT	0
 #define WAIT_FOR_EVENT	(-1)
+#define QMGR_ADMIT_OK() \
+	(qmgr_message_count < var_qmgr_active_limit && QMGR_MEMORY_OK())
+#define QMGR_FEED_PACED(idx) \
+	((idx) == QMGR_SCAN_IDX_DEFERRED && var_qmgr_dfr_feed_rate > 0 \
+	    && feed_time == event_time() && feed_count >= var_qmgr_dfr_feed_rate)
 
     /*
      * Attempt to drain the active queue by allocating a suitable delivery
@@ -629,29 +836,51 @@ static int qmgr_loop(char *unused_name, char **unused_argv)
     qmgr_active_drain();
 
     /*
-     * Let some new blood into the active queue when the queue size is
-     * smaller than some configurable limit.
+     * Let some new blood into the active queue when the queue size, and
+     * the memory that is used for in-core messages, are smaller than some
+     * configurable limit.
      * 
      * We import one message per interrupt, to optimally tune the input count
      * for the number of delivery agent protocol wait states, as explained in
      * qmgr_transport.c.
+     * 
+     * Optionally, limit the rate at which deferred mail enters the active
+     * queue, so that flushing a large deferred queue (postqueue -f, or the
+     * end of an outage) does not swamp trivial-rewrite, the disk, and the
+     * destinations that just came back. The scan position is kept, and the
+     * scan continues in the next second. New mail is not paced.
      */
     delay = WAIT_FOR_EVENT;
-    for (scan_idx = 0; qmgr_message_count < var_qmgr_active_limit
+    for (scan_idx = 0; QMGR_ADMIT_OK()
 	 && scan_idx < QMGR_SCAN_IDX_COUNT; ++scan_idx) {
 	last_scan_idx = (scan_idx + first_scan_idx) % QMGR_SCAN_IDX_COUNT;
+	if (QMGR_FEED_PACED(last_scan_idx)) {
+	    paced = 1;
+	    continue;
+	}
 	if ((path = qmgr_scan_next(qmgr_scans[last_scan_idx])) != 0) {
 	    delay = DONT_WAIT;
-	    if ((feed = qmgr_active_feed(qmgr_scans[last_scan_idx], path)) != 0)
+	    if ((feed = qmgr_active_feed(qmgr_scans[last_scan_idx], path)) != 0) {
+		if (last_scan_idx == QMGR_SCAN_IDX_DEFERRED
+		    && var_qmgr_dfr_feed_rate > 0) {
+		    if (feed_time != event_time()) {
+			feed_time = event_time();
+			feed_count = 0;
+		    }
+		    feed_count++;
+		}
 		break;
+	    }
 	}
     }
+    if (paced && delay == WAIT_FOR_EVENT)
+	delay = 1;
 
     /*
      * Round-robin the queue scans. When the active queue becomes full,
      * prefer new mail over deferred mail.
      */
-    if (qmgr_message_count < var_qmgr_active_limit) {
+    if (QMGR_ADMIT_OK()) {
 	first_scan_idx = (last_scan_idx + 1) % QMGR_SCAN_IDX_COUNT;
     } else if (first_scan_idx != QMGR_SCAN_IDX_INCOMING) {
 	first_scan_idx = QMGR_SCAN_IDX_INCOMING;
@@ -692,6 +921,8 @@ static void pre_accept(char *unused_name, char **unused_argv)
 static void qmgr_pre_init(char *unused_name, char **unused_argv)
 {
     flush_init();
+    qmgr_index_pre_jail_init();
+    qmgr_prefetch_init();
 }
 
 /* qmgr_post_init - post-jail initialization */
@@ -740,11 +971,17 @@ static void qmgr_post_init(char *name, char **unused_argv)
     var_ipc_timeout = var_qmgr_ipc_timeout;
     var_use_limit = 0;
     var_idle_limit = 0;
+    qmgr_shard_init();
     qmgr_move(MAIL_QUEUE_ACTIVE, MAIL_QUEUE_INCOMING, event_time());
+    qmgr_index_post_jail_init();
     qmgr_scans[QMGR_SCAN_IDX_INCOMING] = qmgr_scan_create(MAIL_QUEUE_INCOMING);
     qmgr_scans[QMGR_SCAN_IDX_DEFERRED] = qmgr_scan_create(MAIL_QUEUE_DEFERRED);
     qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_INCOMING], QMGR_SCAN_START);
     qmgr_deferred_run_event(0, (void *) 0);
+    if (var_metrics_enable)
+	qmgr_metrics_event(0, (void *) 0);
+    qmgr_status_init();
+    qmgr_fbstate_init();
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -757,7 +994,13 @@ int     main(int argc, char **argv)
 	VAR_DEFER_XPORTS, DEF_DEFER_XPORTS, &var_defer_xports, 0, 0,
 	VAR_CONC_POS_FDBACK, DEF_CONC_POS_FDBACK, &var_conc_pos_feedback, 1, 0,
 	VAR_CONC_NEG_FDBACK, DEF_CONC_NEG_FDBACK, &var_conc_neg_feedback, 1, 0,
+	VAR_CONC_FDBACK_MODE, DEF_CONC_FDBACK_MODE, &var_conc_fdback_mode, 1, 0,
 	VAR_DEF_FILTER_NEXTHOP, DEF_DEF_FILTER_NEXTHOP, &var_def_filter_nexthop, 0, 0,
+	VAR_QMGR_INDEX_MAP, DEF_QMGR_INDEX_MAP, &var_qmgr_index_map, 0, 0,
+	VAR_QMGR_SHARD_TRIGGERS, DEF_QMGR_SHARD_TRIGGERS, &var_qmgr_shard_triggers, 0, 0,
+	VAR_QMGR_STATUS_FILE, DEF_QMGR_STATUS_FILE, &var_qmgr_status_file, 0, 0,
+	VAR_QMGR_FBSTATE_FILE, DEF_QMGR_FBSTATE_FILE, &var_qmgr_fbstate_file, 0, 0,
+	VAR_QMGR_PREFETCH_XPORTS, DEF_QMGR_PREFETCH_XPORTS, &var_qmgr_prefetch_xports, 0, 0,
 	0,
     };
     static const CONFIG_TIME_TABLE time_table[] = {
@@ -773,6 +1016,12 @@ int     main(int argc, char **argv)
 	VAR_DEST_RATE_DELAY, DEF_DEST_RATE_DELAY, &var_dest_rate_delay, 0, 0,
 	VAR_QMGR_DAEMON_TIMEOUT, DEF_QMGR_DAEMON_TIMEOUT, &var_qmgr_daemon_timeout, 1, 0,
 	VAR_QMGR_IPC_TIMEOUT, DEF_QMGR_IPC_TIMEOUT, &var_qmgr_ipc_timeout, 1, 0,
+	VAR_QMGR_INDEX_SCAN, DEF_QMGR_INDEX_SCAN, &var_qmgr_index_scan, 0, 0,
+	VAR_QMGR_FULL_SCAN_INT, DEF_QMGR_FULL_SCAN_INT, &var_qmgr_full_scan_int, 0, 0,
+	VAR_QMGR_STATUS_INT, DEF_QMGR_STATUS_INT, &var_qmgr_status_int, 0, 0,
+	VAR_QMGR_FBSTATE_INT, DEF_QMGR_FBSTATE_INT, &var_qmgr_fbstate_int, 0, 0,
+	VAR_QMGR_FBSTATE_MAXAGE, DEF_QMGR_FBSTATE_MAXAGE, &var_qmgr_fbstate_maxage, 1, 0,
+	VAR_QMGR_PRIO_OFFSET, DEF_QMGR_PRIO_OFFSET, &var_qmgr_prio_offset, 0, 0,
 	0,
     };
     static const CONFIG_INT_TABLE int_table[] = {
@@ -793,12 +1042,20 @@ int     main(int argc, char **argv)
 	VAR_LOCAL_CON_LIMIT, DEF_LOCAL_CON_LIMIT, &var_local_con_lim, 0, 0,
 	VAR_CONC_COHORT_LIM, DEF_CONC_COHORT_LIM, &var_conc_cohort_limit, 0, 0,
 	VAR_VRFY_PEND_LIMIT, DEF_VRFY_PEND_LIMIT, &var_vrfy_pend_limit, 1, 0,
+	VAR_QMGR_SHARD_COUNT, DEF_QMGR_SHARD_COUNT, &var_qmgr_shard_count, 1, 0,
+	VAR_QMGR_SHARD_INDEX, DEF_QMGR_SHARD_INDEX, &var_qmgr_shard_index, 0, 0,
+	VAR_QMGR_DFR_FEED_RATE, DEF_QMGR_DFR_FEED_RATE, &var_qmgr_dfr_feed_rate, 0, 0,
+	0,
+    };
+    static const CONFIG_LONG_TABLE long_table[] = {
+	VAR_QMGR_MEMORY_LIMIT, DEF_QMGR_MEMORY_LIMIT, &var_qmgr_memory_limit, 0, 0,
 	0,
     };
     static const CONFIG_BOOL_TABLE bool_table[] = {
 	VAR_VERP_BOUNCE_OFF, DEF_VERP_BOUNCE_OFF, &var_verp_bounce_off,
 	VAR_CONC_FDBACK_DEBUG, DEF_CONC_FDBACK_DEBUG, &var_conc_feedback_debug,
 	VAR_DSN_DELAY_CLEARED, DEF_DSN_DELAY_CLEARED, &var_dsn_delay_cleared,
+	VAR_QMGR_PARK_DEAD, DEF_QMGR_PARK_DEAD, &var_qmgr_park_dead,
 	0,
     };
 
@@ -814,6 +1071,7 @@ int     main(int argc, char **argv)
      */
     trigger_server_main(argc, argv, qmgr_trigger_event,
 			CA_MAIL_SERVER_INT_TABLE(int_table),
+			CA_MAIL_SERVER_LONG_TABLE(long_table),
 			CA_MAIL_SERVER_STR_TABLE(str_table),
 			CA_MAIL_SERVER_BOOL_TABLE(bool_table),
 			CA_MAIL_SERVER_TIME_TABLE(time_table),
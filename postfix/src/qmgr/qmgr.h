@@ -140,6 +140,24 @@ struct QMGR_FEEDBACK {
 
 extern void qmgr_feedback_init(QMGR_FEEDBACK *, const char *, const char *, const char *, const char *);
 
+ /*
+  * With latency feedback, the scheduler also measures how long a destination
+  * takes to deliver one recipient. When deliveries take longer than they
+  * would at low concurrency, the extra concurrency is waiting at the remote
+  * end instead of adding throughput. The estimated number of waiting
+  * deliveries determines whether concurrency may grow, must stay, or must
+  * shrink.
+  */
+#define QMGR_FEEDBACK_MODE_COUNT	0	/* success/failure counts */
+#define QMGR_FEEDBACK_MODE_LATENCY	1	/* also delivery latency */
+
+#define QMGR_FEEDBACK_BACKLOG_LOW	1	/* grow below this */
+#define QMGR_FEEDBACK_BACKLOG_HIGH	3	/* shrink above this */
+
+extern int qmgr_feedback_mode(const char *);
+extern void qmgr_feedback_latency(QMGR_QUEUE *, QMGR_ENTRY *);
+extern double qmgr_feedback_backlog(QMGR_QUEUE *);
+
 #ifndef QMGR_FEEDBACK_IDX_SQRT_WIN
 #define QMGR_FEEDBACK_VAL(fb, win) \
     ((fb).index == QMGR_FEEDBACK_IDX_NONE ? (fb).base : (fb).base / (win))
@@ -203,6 +221,7 @@ struct QMGR_TRANSPORT {
     DSN    *dsn;			/* why unavailable */
     QMGR_FEEDBACK pos_feedback;		/* positive feedback control */
     QMGR_FEEDBACK neg_feedback;		/* negative feedback control */
+    int     fbck_mode;			/* count or latency feedback */
     int     fail_cohort_limit;		/* flow shutdown control */
     int     xport_rate_delay;		/* suspend per delivery */
     int     rate_delay;			/* suspend per delivery */
@@ -244,13 +263,17 @@ struct QMGR_QUEUE {
     double  success;			/* accumulated positive feedback */
     double  failure;			/* accumulated negative feedback */
     double  fail_cohorts;		/* pseudo-cohort failure count */
+    double  lat_avg;			/* recent per-recipient latency */
+    double  lat_min;			/* uncongested per-recipient latency */
     QMGR_TRANSPORT *transport;		/* transport linkage */
     QMGR_ENTRY_LIST todo;		/* todo queue entries */
     QMGR_ENTRY_LIST busy;		/* messages on the wire */
     QMGR_QUEUE_LIST peers;		/* neighbor queues */
     DSN    *dsn;			/* why unavailable */
+    time_t  retry_time;			/* when unavailable site is retried */
     time_t  clog_time_to_warn;		/* time of last warning */
     int     blocker_tag;		/* tagged if blocks job list */
+    int     sort_rank;			/* for recipient sorting */
 };
 
 #define	QMGR_QUEUE_TODO	1		/* waiting for service */
@@ -262,6 +285,7 @@ extern QMGR_QUEUE *qmgr_queue_create(QMGR_TRANSPORT *, const char *, const char
 extern void qmgr_queue_done(QMGR_QUEUE *);
 extern void qmgr_queue_throttle(QMGR_QUEUE *, DSN *);
 extern void qmgr_queue_unthrottle(QMGR_QUEUE *);
+extern void qmgr_queue_mark_dead(QMGR_QUEUE *, DSN *, int);
 extern QMGR_QUEUE *qmgr_queue_find(QMGR_TRANSPORT *, const char *);
 extern void qmgr_queue_suspend(QMGR_QUEUE *, int);
 
@@ -302,10 +326,12 @@ struct QMGR_ENTRY {
     VSTREAM *stream;			/* delivery process */
     QMGR_MESSAGE *message;		/* message info */
     RECIPIENT_LIST rcpt_list;		/* as many as it takes */
+    long    rcpt_memory;		/* rcpt_list memory estimate */
     QMGR_QUEUE *queue;			/* parent linkage */
     QMGR_PEER *peer;			/* parent linkage */
     QMGR_ENTRY_LIST queue_peers;	/* per queue neighbor entries */
     QMGR_ENTRY_LIST peer_peers;		/* per peer neighbor entries */
+    struct timeval deliver_start;	/* delivery request time */
 };
 
 extern QMGR_ENTRY *qmgr_entry_select(QMGR_PEER *);
@@ -363,10 +389,16 @@ struct QMGR_MESSAGE {
     char   *sasl_sender;		/* SASL sender */
     char   *log_ident;			/* up-stream queue ID */
     char   *rewrite_context;		/* address qualification */
+    char   *stage_times;		/* cleanup stage times */
+    struct timeval handoff_time;	/* first delivery request */
     RECIPIENT_LIST rcpt_list;		/* complete addresses */
+    long    rcpt_memory;		/* rcpt_list memory estimate */
     int     rcpt_count;			/* used recipient slots */
     int     rcpt_limit;			/* maximum read in-core */
     int     rcpt_unread;		/* # of recipients left in queue file */
+    char   *park_dest;			/* dead destination, or null */
+    int     park_ok;			/* all deferrals for park_dest */
+    int     priority;			/* scheduling class */
     QMGR_JOB_LIST job_list;		/* jobs delivering this message (1
 					 * per transport) */
 };
@@ -381,6 +413,19 @@ struct QMGR_MESSAGE {
 extern int qmgr_message_count;
 extern int qmgr_recipient_count;
 extern int qmgr_vrfy_pend_count;
+extern long qmgr_memory_used;
+
+ /*
+  * Approximate memory accounting for qmgr_message_memory_limit. The
+  * estimate is charged when a recipient is read or assigned to a queue
+  * entry, and is remembered so that it can be refunded exactly.
+  */
+#define QMGR_RCPT_MEMORY(rcpt) \
+	(sizeof(RECIPIENT) + strlen((rcpt)->address) \
+	 + strlen((rcpt)->orig_addr) + strlen((rcpt)->dsn_orcpt) + 3)
+
+#define QMGR_MEMORY_OK() \
+	(var_qmgr_memory_limit == 0 || qmgr_memory_used < var_qmgr_memory_limit)
 
 extern void qmgr_message_free(QMGR_MESSAGE *);
 extern void qmgr_message_update_warn(QMGR_MESSAGE *);
@@ -419,7 +464,8 @@ struct QMGR_JOB {
     int     blocker_tag;		/* tagged if blocks the job list */
     struct HTABLE *peer_byname;		/* message job peers, indexed by
 					 * domain */
-    QMGR_PEER_LIST peer_list;		/* list of message job peers */
+    QMGR_PEER_LIST peer_list;		/* message job peers with todo
+					 * entries */
     int     slots_used;			/* slots used during preemption */
     int     slots_available;		/* slots available for preemption (in
 					 * multiples of slot_cost) */
@@ -497,8 +543,17 @@ struct QMGR_SCAN {
     int     flags;			/* private, this run */
     int     nflags;			/* private, next run */
     struct SCAN_DIR *handle;		/* scan */
+    struct BINHASH *schedule;		/* queue IDs by time bucket */
+    struct ARGV *due;			/* scheduled scan */
+    ssize_t due_pos;			/* scheduled scan progress */
+    time_t  full_time;			/* last full directory scan */
+    struct ARGV *expedite;		/* files to visit first */
+    ssize_t expedite_pos;		/* expedite progress */
+    QMGR_SCAN *next;			/* linkage */
 };
 
+#define QMGR_SCAN_BUSY(s)	((s)->handle != 0 || (s)->due != 0)
+
  /*
   * Flags that control queue scans or destination selection. These are
   * similar to the QMGR_REQ_XXX request codes.
@@ -516,6 +571,8 @@ struct QMGR_SCAN {
 extern QMGR_SCAN *qmgr_scan_create(const char *);
 extern void qmgr_scan_request(QMGR_SCAN *, int);
 extern char *qmgr_scan_next(QMGR_SCAN *);
+extern void qmgr_scan_schedule(const char *, const char *, time_t);
+extern void qmgr_scan_expedite(QMGR_SCAN *, const char *);
 
  /*
   * qmgr_error.c
@@ -524,6 +581,51 @@ extern QMGR_TRANSPORT *qmgr_error_transport(const char *);
 extern QMGR_QUEUE *qmgr_error_queue(const char *, DSN *);
 extern char *qmgr_error_nexthop(DSN *);
 
+ /*
+  * qmgr_index.c
+  */
+extern void qmgr_index_pre_jail_init(void);
+extern void qmgr_index_post_jail_init(void);
+extern void qmgr_index_update(const char *, time_t);
+extern int qmgr_index_lookup(const char *, time_t *);
+extern void qmgr_index_delete(const char *);
+
+ /*
+  * qmgr_park.c
+  */
+extern void qmgr_park_note(QMGR_MESSAGE *, QMGR_QUEUE *);
+extern void qmgr_park_spoil(QMGR_MESSAGE *);
+extern void qmgr_park_enter(QMGR_MESSAGE *, time_t);
+extern int qmgr_park_skip(const char *, time_t *);
+extern void qmgr_park_release(QMGR_QUEUE *);
+extern void qmgr_park_flush(void);
+
+ /*
+  * qmgr_shard.c
+  */
+extern void qmgr_shard_init(void);
+extern int qmgr_shard_owned(const char *);
+extern int qmgr_shard_limit(int);
+extern void qmgr_shard_trigger(const char *, ssize_t);
+
+ /*
+  * qmgr_status.c
+  */
+extern void qmgr_status_init(void);
+
+ /*
+  * qmgr_fbstate.c
+  */
+extern void qmgr_fbstate_init(void);
+extern void qmgr_fbstate_restore(QMGR_QUEUE *);
+extern void qmgr_fbstate_save(QMGR_QUEUE *);
+
+ /*
+  * qmgr_prefetch.c
+  */
+extern void qmgr_prefetch_init(void);
+extern void qmgr_prefetch(QMGR_QUEUE *);
+
 /* LICENSE
 /* .ad
 /* .fi
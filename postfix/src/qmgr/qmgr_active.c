@@ -31,7 +31,8 @@
 /* .IP QMGR_SCAN_ALL
 /*	Examine all queue files. Normally, deferred queue files with
 /*	future time stamps are ignored, and incoming queue files with
-/*	future time stamps are frowned upon.
+/*	future time stamps are frowned upon. This also ignores the
+/*	deferred queue index and dead destination parking.
 /* .PP
 /*	qmgr_active_drain() allocates one delivery process.
 /*	Process allocation is asynchronous. Once the delivery
@@ -55,7 +56,11 @@
 /*	into the future by a minimal backoff time, whichever is more.
 /*	The minimal_backoff_time parameter specifies the minimal
 /*	amount of time between delivery attempts; maximal_backoff_time
-/*	specifies an upper limit.
+/*	specifies an upper limit. A deferred message whose recipients
+/*	were all deferred because of the same dead destination may
+/*	be parked, see qmgr_park(3). With enable_stage_timing, a summary
+/*	of per-message stage times is logged before the queue file
+/*	is removed.
 /* DIAGNOSTICS
 /*	Fatal: queue file access failures, out of memory.
 /*	Panic: interface violations, internal consistency errors.
@@ -83,6 +88,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <stdlib.h>
+#include <stdio.h>			/* sscanf() */
 #include <unistd.h>
 #include <string.h>
 #include <utime.h>
@@ -98,6 +104,7 @@
 #include <events.h>
 #include <mymalloc.h>
 #include <vstream.h>
+#include <vstring.h>
 #include <warn_stat.h>
 
 /* Global library. */
@@ -113,6 +120,8 @@
 #include <rec_type.h>
 #include <qmgr_user.h>
 #include <info_log_addr_form.h>
+#include <mail_proto.h>
+#include <replica_clnt.h>
 
 /* Application-specific. */
 
@@ -128,6 +137,7 @@ static void qmgr_active_done_25_generic(QMGR_MESSAGE *);
 static void qmgr_active_done_3_defer_flush(int, void *);
 static void qmgr_active_done_3_defer_warn(int, void *);
 static void qmgr_active_done_3_generic(QMGR_MESSAGE *);
+static void qmgr_active_stages(QMGR_MESSAGE *);
 
 /* qmgr_active_corrupt - move corrupted file out of the way */
 
@@ -167,9 +177,76 @@ static void qmgr_active_defer(const char *queue_name, const char *queue_id,
 		      queue_id, queue_name, dest_queue);
 	msg_warn("%s: rename %s from %s to %s: %m", myname,
 		 queue_id, queue_name, dest_queue);
-    } else if (msg_verbose) {
-	msg_info("%s: defer %s", myname, queue_id);
+    } else {
+	if (strcmp(dest_queue, MAIL_QUEUE_DEFERRED) == 0)
+	    qmgr_index_update(queue_id, tbuf.modtime);
+	qmgr_scan_schedule(dest_queue, queue_id, tbuf.modtime);
+	if (msg_verbose)
+	    msg_info("%s: defer %s", myname, queue_id);
+    }
+}
+
+/* qmgr_active_stages - log per-message stage times */
+
+static void qmgr_active_stages(QMGR_MESSAGE *message)
+{
+    VSTRING *buf;
+    struct timeval now;
+    long    t[7];
+    long    queued;
+    long    active;
+    long    handoff;
+    long    removed;
+
+    /*
+     * The cleanup server stores microsecond offsets from the arrival time:
+     * session (time from connect to MAIL FROM), start of content, end of
+     * content, ready to commit, and time spent in trivial-rewrite, table
+     * lookups, and Milter applications. Unknown values are -1.
+     */
+    if (sscanf(message->stage_times, "%ld %ld %ld %ld %ld %ld %ld",
+	       t, t + 1, t + 2, t + 3, t + 4, t + 5, t + 6) != 7) {
+	msg_warn("%s: ignoring malformed %s attribute: %.100s",
+		 message->queue_id, MAIL_ATTR_STAGE_TIMES,
+		 message->stage_times);
+	return;
     }
+    GETTIMEOFDAY(&now);
+#define USEC_SINCE_ARRIVAL(tv) ((tv).tv_sec == 0 ? -1L : \
+	(long) ((tv).tv_sec - message->arrival_time.tv_sec) * 1000000L \
+	+ (long) ((tv).tv_usec - message->arrival_time.tv_usec))
+
+    queued = t[3];
+    active = USEC_SINCE_ARRIVAL(message->active_time);
+    handoff = USEC_SINCE_ARRIVAL(message->handoff_time);
+    removed = USEC_SINCE_ARRIVAL(now);
+
+    /*
+     * Log intervals in seconds with microsecond resolution, and omit
+     * intervals whose end points are unknown.
+     */
+#define STAGE_APPEND(name, usec) do { \
+	if ((usec) >= 0) \
+	    vstring_sprintf_append(buf, " %s=%ld.%06ld", (name), \
+				   (usec) / 1000000L, (usec) % 1000000L); \
+    } while (0)
+#define STAGE_DIFF(end, start) \
+	((end) < 0 || (start) < 0 ? -1L : (end) - (start))
+
+    buf = vstring_alloc(100);
+    STAGE_APPEND("session", t[0]);
+    STAGE_APPEND("envelope", t[1]);
+    STAGE_APPEND("data", STAGE_DIFF(t[2], t[1]));
+    STAGE_APPEND("cleanup", STAGE_DIFF(queued, t[2]));
+    STAGE_APPEND("rewrite", t[4]);
+    STAGE_APPEND("maps", t[5]);
+    STAGE_APPEND("milter", t[6]);
+    STAGE_APPEND("queue", STAGE_DIFF(active, queued));
+    STAGE_APPEND("handoff", STAGE_DIFF(handoff, active));
+    STAGE_APPEND("delivery", STAGE_DIFF(removed, handoff));
+    STAGE_APPEND("total", t[0] < 0 ? removed : removed + t[0]);
+    msg_info("%s: stages:%s", message->queue_id, vstring_str(buf));
+    vstring_free(buf);
 }
 
 /* qmgr_active_feed - feed one message into active queue */
@@ -180,12 +257,46 @@ int     qmgr_active_feed(QMGR_SCAN *scan_info, const char *queue_id)
     QMGR_MESSAGE *message;
     struct stat st;
     const char *path;
+    time_t  retry_time;
 
     if (strcmp(scan_info->queue, MAIL_QUEUE_ACTIVE) == 0)
 	msg_panic("%s: bad queue %s", myname, scan_info->queue);
     if (msg_verbose)
 	msg_info("%s: queue %s", myname, scan_info->queue);
 
+    /*
+     * Leave queue files alone that belong to a different queue manager.
+     */
+    if (!qmgr_shard_owned(queue_id))
+	return (0);
+
+    /*
+     * Skip deferred queue files that the queue index says need to cool down,
+     * without looking up file attributes. The index entry is the time stamp
+     * that we gave the queue file when it was deferred.
+     */
+    if ((scan_info->flags & QMGR_SCAN_ALL) == 0
+	&& strcmp(scan_info->queue, MAIL_QUEUE_DEFERRED) == 0
+	&& qmgr_index_lookup(queue_id, &retry_time)
+	&& retry_time > time((time_t *) 0) + 1) {
+	if (msg_verbose)
+	    msg_info("%s: skip %s (%ld seconds, indexed)", myname, queue_id,
+		     (long) (retry_time - time((time_t *) 0)));
+	qmgr_scan_schedule(scan_info->queue, queue_id, retry_time);
+	return (0);
+    }
+
+    /*
+     * Skip deferred queue files that wait for a dead destination, without
+     * looking up file attributes.
+     */
+    if ((scan_info->flags & QMGR_SCAN_ALL) == 0
+	&& strcmp(scan_info->queue, MAIL_QUEUE_DEFERRED) == 0
+	&& qmgr_park_skip(queue_id, &retry_time)) {
+	qmgr_scan_schedule(scan_info->queue, queue_id, retry_time);
+	return (0);
+    }
+
     /*
      * Make sure this is something we are willing to open.
      */
@@ -204,6 +315,7 @@ int     qmgr_active_feed(QMGR_SCAN *scan_info, const char *queue_id)
 	if (msg_verbose)
 	    msg_info("%s: skip %s (%ld seconds)", myname, queue_id,
 		     (long) (st.st_mtime - event_time()));
+	qmgr_scan_schedule(scan_info->queue, queue_id, st.st_mtime);
 	return (0);
     }
 
@@ -218,6 +330,8 @@ int     qmgr_active_feed(QMGR_SCAN *scan_info, const char *queue_id)
 		 queue_id, scan_info->queue, MAIL_QUEUE_ACTIVE);
 	return (0);
     }
+    if (strcmp(scan_info->queue, MAIL_QUEUE_DEFERRED) == 0)
+	qmgr_index_delete(queue_id);
 
     /*
      * Extract envelope information: sender and recipients. At this point,
@@ -345,6 +459,8 @@ static void qmgr_active_done_2_bounce_flush(int status, void *context)
      * Process abounce_flush() status and continue processing.
      */
     message->flags |= status;
+    if (status != 0)
+	qmgr_park_spoil(message);
     qmgr_active_done_2_generic(message);
 }
 
@@ -430,6 +546,8 @@ static void qmgr_active_done_25_trace_flush(int status, void *context)
     if (status == 0 && message->tflags_offset)
 	qmgr_message_kill_record(message, message->tflags_offset);
     message->flags |= status;
+    if (status != 0)
+	qmgr_park_spoil(message);
     qmgr_active_done_25_generic(message);
 }
 
@@ -532,6 +650,7 @@ static void qmgr_active_done_3_defer_flush(int status, void *context)
      * Process adefer_flush() status and continue processing.
      */
     message->flags = status;
+    qmgr_park_spoil(message);
     qmgr_active_done_3_generic(message);
 }
 
@@ -565,6 +684,7 @@ static void qmgr_active_done_3_generic(QMGR_MESSAGE *message)
 	}
 	qmgr_active_defer(message->queue_name, message->queue_id,
 			  MAIL_QUEUE_DEFERRED, delay);
+	qmgr_park_enter(message, event_time() + delay);
     }
 
     /*
@@ -578,8 +698,11 @@ static void qmgr_active_done_3_generic(QMGR_MESSAGE *message)
 	    msg_warn("%s: remove %s from %s: %m", myname,
 		     message->queue_id, message->queue_name);
 	} else {
+	    if (var_stage_timing && message->stage_times)
+		qmgr_active_stages(message);
 	    /* Same format as logged by postsuper. */
 	    msg_info("%s: removed", message->queue_id);
+	    replica_clnt_remove(message->queue_id);
 	}
     }
 
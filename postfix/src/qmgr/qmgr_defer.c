@@ -134,6 +134,10 @@ void    qmgr_defer_todo(QMGR_QUEUE *queue, DSN *dsn)
      */
     for (entry = queue->todo.next; entry != 0; entry = next) {
 	next = entry->queue_peers.next;
+	if (QMGR_QUEUE_THROTTLED(queue))
+	    qmgr_park_note(entry->message, queue);
+	else
+	    qmgr_park_spoil(entry->message);
 	if (retry_queue != 0) {
 	    qmgr_entry_move_todo(retry_queue, entry);
 	    continue;
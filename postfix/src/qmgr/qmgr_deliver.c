@@ -290,6 +290,7 @@ static void qmgr_deliver_update(int unused_event, void *context)
      */
     if (status == DELIVER_STAT_CRASH) {
 	message->flags |= DELIVER_STAT_DEFER;
+	qmgr_park_spoil(message);
 #if 0
 	whatsup = concatenate("unknown ", transport->name,
 			      " mail transport error", (char *) 0);
@@ -351,6 +352,17 @@ static void qmgr_deliver_update(int unused_event, void *context)
 		    qmgr_defer_todo(queue, &dsb->dsn);
 	    }
 	}
+
+	/*
+	 * Deferrals by the retry service were classified when the recipients
+	 * were redirected.
+	 */
+	if (strcmp(transport->name, MAIL_SERVICE_RETRY) != 0) {
+	    if (QMGR_QUEUE_THROTTLED(queue))
+		qmgr_park_note(message, queue);
+	    else
+		qmgr_park_spoil(message);
+	}
     }
 
     /*
@@ -359,8 +371,13 @@ static void qmgr_deliver_update(int unused_event, void *context)
      */
     if (status != DELIVER_STAT_CRASH) {
 	qmgr_transport_unthrottle(transport);
-	if (VSTRING_LEN(dsb->reason) == 0)
+	if (VSTRING_LEN(dsb->reason) == 0) {
+	    if (transport->fbck_mode == QMGR_FEEDBACK_MODE_LATENCY
+		&& status == DELIVER_STAT_OK && QMGR_QUEUE_READY(queue))
+		qmgr_feedback_latency(queue, entry);
 	    qmgr_queue_unthrottle(queue);
+	    qmgr_park_release(queue);
+	}
     }
 
     /*
@@ -446,6 +463,9 @@ void    qmgr_deliver(QMGR_TRANSPORT *transport, VSTREAM *stream)
      */
     qmgr_deliver_concurrency++;
     entry->stream = stream;
+    GETTIMEOFDAY(&entry->deliver_start);
+    if (entry->message->handoff_time.tv_sec == 0)
+	entry->message->handoff_time = entry->deliver_start;
     event_enable_read(vstream_fileno(stream),
 		      qmgr_deliver_update, (void *) entry);
 
@@ -93,7 +93,9 @@
 
 #include <msg.h>
 #include <mymalloc.h>
+#include <mypool.h>
 #include <events.h>
+#include <probes.h>
 #include <vstream.h>
 
 /* Global library. */
@@ -105,6 +107,11 @@
 
 #include "qmgr.h"
 
+ /*
+  * Queue entries are created and destroyed for each delivery request.
+  */
+static MYPOOL *qmgr_entry_pool;
+
 /* qmgr_entry_select - select queue entry for delivery */
 
 QMGR_ENTRY *qmgr_entry_select(QMGR_PEER *peer)
@@ -119,7 +126,11 @@ QMGR_ENTRY *qmgr_entry_select(QMGR_PEER *peer)
 	queue->todo_refcount--;
 	QMGR_LIST_APPEND(queue->busy, entry, queue_peers);
 	queue->busy_refcount++;
+	POSTFIX_PROBE3(qmgr_entry_select, queue->transport->name,
+		       queue->name, entry->message->queue_id);
 	QMGR_LIST_UNLINK(peer->entry_list, QMGR_ENTRY *, entry, peer_peers);
+	if (peer->entry_list.next == 0)
+	    QMGR_LIST_UNLINK(peer->job->peer_list, QMGR_PEER *, peer, peers);
 	peer->job->selected_entries++;
 
 	/*
@@ -144,14 +155,20 @@ QMGR_ENTRY *qmgr_entry_select(QMGR_PEER *peer)
 #define BACK_TO_BACK_DELIVERY() \
 		(queue->last_done + 1 >= event_time())
 
+#define BACKLOG_EXCEEDS_WINDOW() \
+		(queue->todo_refcount + queue->busy_refcount > queue->window)
+
 	/*
 	 * Turn on session caching after we get up to speed. Don't enable
 	 * session caching just because we have concurrent deliveries. This
 	 * prevents unnecessary session caching when we have a burst of mail
-	 * <= the initial concurrency limit.
+	 * <= the initial concurrency limit. But do enable session caching
+	 * when the backlog exceeds the concurrency window: some entries must
+	 * wait for a delivery to finish, and can reuse its session instead of
+	 * making a new one.
 	 */
 	if ((queue->dflags & DEL_REQ_FLAG_CONN_STORE) == 0) {
-	    if (BACK_TO_BACK_DELIVERY()) {
+	    if (BACK_TO_BACK_DELIVERY() || BACKLOG_EXCEEDS_WINDOW()) {
 		if (msg_verbose)
 		    msg_info("%s: allowing on-demand session caching for %s",
 			     myname, queue->name);
@@ -194,6 +211,8 @@ void    qmgr_entry_unselect(QMGR_ENTRY *entry)
     queue->busy_refcount--;
     QMGR_LIST_APPEND(queue->todo, entry, queue_peers);
     queue->todo_refcount++;
+    if (peer->entry_list.next == 0)
+	QMGR_LIST_APPEND(peer->job->peer_list, peer, peers);
     QMGR_LIST_PREPEND(peer->entry_list, entry, peer_peers);
     peer->job->selected_entries--;
 }
@@ -237,6 +256,8 @@ void    qmgr_entry_move_todo(QMGR_QUEUE *dst_queue, QMGR_ENTRY *entry)
     new_entry = qmgr_entry_create(dst_peer, message);
 
     recipient_list_swap(&entry->rcpt_list, &new_entry->rcpt_list);
+    new_entry->rcpt_memory = entry->rcpt_memory;
+    entry->rcpt_memory = 0;
 
     src_job->rcpt_count -= rcpt_count;
     dst_job->rcpt_count += rcpt_count;
@@ -265,6 +286,8 @@ void    qmgr_entry_done(QMGR_ENTRY *entry, int which)
 	queue->busy_refcount--;
     } else if (which == QMGR_QUEUE_TODO) {
 	QMGR_LIST_UNLINK(peer->entry_list, QMGR_ENTRY *, entry, peer_peers);
+	if (peer->entry_list.next == 0)
+	    QMGR_LIST_UNLINK(job->peer_list, QMGR_PEER *, peer, peers);
 	job->selected_entries++;
 	QMGR_LIST_UNLINK(queue->todo, QMGR_ENTRY *, entry, queue_peers);
 	queue->todo_refcount--;
@@ -279,8 +302,9 @@ void    qmgr_entry_done(QMGR_ENTRY *entry, int which)
     job->rcpt_count -= entry->rcpt_list.len;
     message->rcpt_count -= entry->rcpt_list.len;
     qmgr_recipient_count -= entry->rcpt_list.len;
+    qmgr_memory_used -= sizeof(*entry) + entry->rcpt_memory;
     recipient_list_free(&entry->rcpt_list);
-    myfree((void *) entry);
+    mypool_free(qmgr_entry_pool, (void *) entry);
 
     /*
      * Make sure that the transport of any retired or finishing job that
@@ -361,6 +385,7 @@ QMGR_ENTRY *qmgr_entry_create(QMGR_PEER *peer, QMGR_MESSAGE *message)
 {
     QMGR_ENTRY *entry;
     QMGR_QUEUE *queue = peer->queue;
+    int     tag;
 
     /*
      * Sanity check.
@@ -371,12 +396,21 @@ QMGR_ENTRY *qmgr_entry_create(QMGR_PEER *peer, QMGR_MESSAGE *message)
     /*
      * Create the delivery request.
      */
-    entry = (QMGR_ENTRY *) mymalloc(sizeof(QMGR_ENTRY));
+    tag = mymalloc_set_tag(MYMALLOC_TAG_QMGR_ENTRY);
+    if (qmgr_entry_pool == 0)
+	qmgr_entry_pool = mypool_create("qmgr_entry", sizeof(QMGR_ENTRY));
+    entry = (QMGR_ENTRY *) mypool_alloc(qmgr_entry_pool);
     entry->stream = 0;
     entry->message = message;
-    recipient_list_init(&entry->rcpt_list, RCPT_LIST_INIT_QUEUE);
+    recipient_list_init(&entry->rcpt_list,
+			RCPT_LIST_INIT_QUEUE | RCPT_LIST_FLAG_POOL);
+    (void) mymalloc_set_tag(tag);
+    entry->rcpt_memory = 0;
+    qmgr_memory_used += sizeof(*entry);
     message->refcount++;
     entry->peer = peer;
+    if (peer->entry_list.next == 0)
+	QMGR_LIST_APPEND(peer->job->peer_list, peer, peers);
     QMGR_LIST_APPEND(peer->entry_list, entry, peer_peers);
     peer->refcount++;
     entry->queue = queue;
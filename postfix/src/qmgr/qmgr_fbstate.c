@@ -0,0 +1,425 @@
+/*++
+/* NAME
+/*	qmgr_fbstate 3
+/* SUMMARY
+/*	persistent destination feedback state
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_fbstate_init()
+/*
+/*	void	qmgr_fbstate_restore(queue)
+/*	QMGR_QUEUE *queue;
+/*
+/*	void	qmgr_fbstate_save(queue)
+/*	QMGR_QUEUE *queue;
+/* DESCRIPTION
+/*	This module saves the per-destination concurrency feedback
+/*	state to the file specified with the qmgr_feedback_state_file
+/*	parameter, so that a restarted queue manager does not have
+/*	to learn again which destinations accept mail at high
+/*	concurrency and which destinations are dead.
+/*
+/*	The state is saved periodically, because the queue manager
+/*	is normally terminated with a signal. Each update includes
+/*	the in-core queues, and the last state of destinations whose
+/*	in-core queue was deleted after it became empty. The file is written
+/*	to a temporary file that is then renamed, so that a restarted
+/*	queue manager never sees a partial file. Each line has the
+/*	time of observation, the transport and queue name, the
+/*	concurrency window, the positive and negative feedback
+/*	hysteresis, the pseudo-cohort failure count, and for a dead
+/*	destination, the time of the next delivery attempt and the
+/*	reason why the destination is unavailable. Destinations in
+/*	the initial state are not saved, and neither are destinations
+/*	of the error and retry transports.
+/*
+/*	qmgr_fbstate_init() reads the saved state and starts the
+/*	update pseudo thread. It does nothing when the
+/*	qmgr_feedback_state_file parameter value is empty, or when
+/*	qmgr_feedback_state_update_interval is zero.
+/*
+/*	qmgr_fbstate_restore() is called when an in-core queue is
+/*	created, and restores saved state for that destination.
+/*	Saved state decays linearly with age: the concurrency window
+/*	moves back to the transport's initial destination concurrency,
+/*	and feedback counts move back to zero, until state that is
+/*	qmgr_feedback_state_max_age old is ignored. A dead destination
+/*	stays dead until its saved retry time. Latency measurements
+/*	are not saved; they are measured again with new deliveries.
+/*	Saved state that is not used is carried over to the next
+/*	update until it expires.
+/*
+/*	qmgr_fbstate_save() is called before an in-core queue is
+/*	deleted, and remembers its state for the next update. This
+/*	state is used only after a restart; while the queue manager
+/*	runs, a new in-core queue starts in the initial state as
+/*	before.
+/* DIAGNOSTICS
+/*	Warnings: state file read or update errors, malformed entries.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdio.h>			/* rename(), sscanf() */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <vstring_vstream.h>
+#include <argv.h>
+#include <htable.h>
+#include <stringops.h>
+#include <events.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_proto.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+ /*
+  * Saved state for one destination.
+  */
+typedef struct {
+    time_t  time;			/* time of observation */
+    int     window;			/* concurrency window, or zero */
+    double  success;			/* accumulated positive feedback */
+    double  failure;			/* accumulated negative feedback */
+    double  fail_cohorts;		/* pseudo-cohort failure count */
+    time_t  retry_time;			/* dead destination retry time */
+    char   *status;			/* why unavailable */
+    char   *reason;			/* why unavailable */
+    int     loaded;			/* from before the restart */
+} QMGR_FBSTATE;
+
+static HTABLE *qmgr_fbstate_table;
+static VSTRING *qmgr_fbstate_temp;
+static VSTRING *qmgr_fbstate_key;
+
+#define STR(x)	vstring_str(x)
+
+#define QMGR_FBSTATE_SKIP(transport) \
+	(strcmp((transport)->name, MAIL_SERVICE_RETRY) == 0 \
+	    || strcmp((transport)->name, MAIL_SERVICE_ERROR) == 0)
+
+/* qmgr_fbstate_free - destroy saved state */
+
+static void qmgr_fbstate_free(void *ptr)
+{
+    QMGR_FBSTATE *fb = (QMGR_FBSTATE *) ptr;
+
+    if (fb->status)
+	myfree(fb->status);
+    if (fb->reason)
+	myfree(fb->reason);
+    myfree((void *) fb);
+}
+
+/* qmgr_fbstate_print - write one destination */
+
+static void qmgr_fbstate_print(VSTREAM *fp, const char *key,
+			               QMGR_FBSTATE *fb)
+{
+    VSTRING *reason;
+
+    vstream_fprintf(fp, "%ld\t%s\t%d\t%g\t%g\t%g\t%ld",
+		    (long) fb->time, key, fb->window, fb->success,
+		    fb->failure, fb->fail_cohorts, (long) fb->retry_time);
+    if (fb->retry_time) {
+	reason = vstring_alloc(100);
+	vstring_strcpy(reason, fb->reason);
+	vstream_fprintf(fp, "\t%s\t%s", fb->status,
+			printable(STR(reason), '?'));
+	vstring_free(reason);
+    }
+    VSTREAM_PUTC('\n', fp);
+}
+
+/* qmgr_fbstate_capture - get state of in-core queue */
+
+static int qmgr_fbstate_capture(QMGR_FBSTATE *fb, QMGR_QUEUE *queue)
+{
+    QMGR_TRANSPORT *transport = queue->transport;
+
+    /*
+     * A queue that is suspended or waiting for cleanup has no usable
+     * window; that state is not worth saving.
+     */
+    if (QMGR_FBSTATE_SKIP(transport) || !allprint(queue->name))
+	return (0);
+    if (QMGR_QUEUE_READY(queue)) {
+	if (queue->window == transport->init_dest_concurrency
+	    && queue->success == 0 && queue->failure == 0
+	    && queue->fail_cohorts == 0)
+	    return (0);
+	fb->window = queue->window;
+	fb->retry_time = 0;
+	fb->status = fb->reason = 0;
+    } else if (QMGR_QUEUE_THROTTLED(queue)) {
+	fb->window = 0;
+	fb->retry_time = queue->retry_time;
+	fb->status = (char *) queue->dsn->status;
+	fb->reason = (char *) queue->dsn->reason;
+    } else {
+	return (0);
+    }
+    fb->time = event_time();
+    fb->success = queue->success;
+    fb->failure = queue->failure;
+    fb->fail_cohorts = queue->fail_cohorts;
+    fb->loaded = 0;
+    vstring_sprintf(qmgr_fbstate_key, "%s\t%s", transport->name, queue->name);
+    return (1);
+}
+
+/* qmgr_fbstate_update - write feedback state snapshot */
+
+static void qmgr_fbstate_update(void)
+{
+    VSTREAM *fp;
+    QMGR_TRANSPORT *transport;
+    QMGR_QUEUE *queue;
+    QMGR_FBSTATE fb;
+    HTABLE_INFO **ht_info;
+    HTABLE_INFO **ht;
+    time_t  now = event_time();
+
+    if ((fp = vstream_fopen(STR(qmgr_fbstate_temp),
+			    O_CREAT | O_TRUNC | O_WRONLY, 0600)) == 0) {
+	msg_warn("open %s: %m", STR(qmgr_fbstate_temp));
+	return;
+    }
+
+    for (transport = qmgr_transport_list.next; transport;
+	 transport = transport->peers.next)
+	for (queue = transport->queue_list.next; queue;
+	     queue = queue->peers.next)
+	    if (qmgr_fbstate_capture(&fb, queue))
+		qmgr_fbstate_print(fp, STR(qmgr_fbstate_key), &fb);
+
+    /*
+     * Destinations without in-core queue, until their state expires.
+     */
+    ht_info = htable_list(qmgr_fbstate_table);
+    for (ht = ht_info; *ht; ht++) {
+	QMGR_FBSTATE *saved = (QMGR_FBSTATE *) ht[0]->value;
+
+	if (now - saved->time >= var_qmgr_fbstate_maxage
+	    || (saved->window == 0 && saved->retry_time <= now))
+	    htable_delete(qmgr_fbstate_table, ht[0]->key, qmgr_fbstate_free);
+	else
+	    qmgr_fbstate_print(fp, ht[0]->key, saved);
+    }
+    myfree((void *) ht_info);
+
+    if (vstream_fclose(fp) != 0) {
+	msg_warn("write %s: %m", STR(qmgr_fbstate_temp));
+	(void) unlink(STR(qmgr_fbstate_temp));
+    } else if (rename(STR(qmgr_fbstate_temp), var_qmgr_fbstate_file) < 0) {
+	msg_warn("rename %s to %s: %m",
+		 STR(qmgr_fbstate_temp), var_qmgr_fbstate_file);
+	(void) unlink(STR(qmgr_fbstate_temp));
+    }
+}
+
+/* qmgr_fbstate_event - periodic update */
+
+static void qmgr_fbstate_event(int unused_event, void *unused_context)
+{
+    qmgr_fbstate_update();
+    event_request_timer(qmgr_fbstate_event, (void *) 0,
+			var_qmgr_fbstate_int);
+}
+
+/* qmgr_fbstate_parse - parse one saved destination */
+
+static QMGR_FBSTATE *qmgr_fbstate_parse(ARGV *argv)
+{
+    QMGR_FBSTATE *fb;
+    long    when;
+    long    retry_time;
+    int     window;
+    double  success;
+    double  failure;
+    double  fail_cohorts;
+
+    if ((argv->argc != 8 && argv->argc != 10)
+	|| sscanf(argv->argv[0], "%ld", &when) != 1
+	|| sscanf(argv->argv[3], "%d", &window) != 1
+	|| sscanf(argv->argv[4], "%lf", &success) != 1
+	|| sscanf(argv->argv[5], "%lf", &failure) != 1
+	|| sscanf(argv->argv[6], "%lf", &fail_cohorts) != 1
+	|| sscanf(argv->argv[7], "%ld", &retry_time) != 1
+	|| window < 0 || (retry_time != 0) != (argv->argc == 10))
+	return (0);
+    fb = (QMGR_FBSTATE *) mymalloc(sizeof(*fb));
+    fb->time = when;
+    fb->window = window;
+    fb->success = success;
+    fb->failure = failure;
+    fb->fail_cohorts = fail_cohorts;
+    fb->retry_time = retry_time;
+    fb->loaded = 1;
+    if (retry_time) {
+	fb->status = mystrdup(argv->argv[8]);
+	fb->reason = mystrdup(argv->argv[9]);
+    } else {
+	fb->status = fb->reason = 0;
+    }
+    return (fb);
+}
+
+/* qmgr_fbstate_load - read saved state */
+
+static void qmgr_fbstate_load(void)
+{
+    VSTREAM *fp;
+    VSTRING *line;
+    ARGV   *argv;
+    QMGR_FBSTATE *fb;
+    int     lineno = 0;
+    time_t  now = event_time();
+
+    if ((fp = vstream_fopen(var_qmgr_fbstate_file, O_RDONLY, 0)) == 0) {
+	if (errno != ENOENT)
+	    msg_warn("open %s: %m", var_qmgr_fbstate_file);
+	return;
+    }
+    line = vstring_alloc(100);
+    while (vstring_get_nonl(line, fp) != VSTREAM_EOF) {
+	lineno++;
+	argv = argv_split(STR(line), "\t");
+	if ((fb = qmgr_fbstate_parse(argv)) == 0) {
+	    msg_warn("%s, line %d: malformed entry -- ignored",
+		     var_qmgr_fbstate_file, lineno);
+	} else if (now - fb->time >= var_qmgr_fbstate_maxage) {
+	    qmgr_fbstate_free((void *) fb);
+	} else {
+	    vstring_sprintf(qmgr_fbstate_key, "%s\t%s",
+			    argv->argv[1], argv->argv[2]);
+	    if (htable_locate(qmgr_fbstate_table,
+			      STR(qmgr_fbstate_key)) != 0)
+		qmgr_fbstate_free((void *) fb);
+	    else
+		htable_enter(qmgr_fbstate_table, STR(qmgr_fbstate_key),
+			     (void *) fb);
+	}
+	argv_free(argv);
+    }
+    if (vstream_ferror(fp))
+	msg_warn("read %s: %m", var_qmgr_fbstate_file);
+    (void) vstream_fclose(fp);
+    vstring_free(line);
+    if (msg_verbose)
+	msg_info("%s: %ld destinations", var_qmgr_fbstate_file,
+		 (long) qmgr_fbstate_table->used);
+}
+
+/* qmgr_fbstate_restore - restore saved state for new queue */
+
+void    qmgr_fbstate_restore(QMGR_QUEUE *queue)
+{
+    const char *myname = "qmgr_fbstate_restore";
+    QMGR_TRANSPORT *transport = queue->transport;
+    QMGR_FBSTATE *fb;
+    DSN     dsn;
+    time_t  now = event_time();
+    double  weight;
+    int     window;
+
+    if (qmgr_fbstate_table == 0 || qmgr_fbstate_table->used == 0)
+	return;
+    vstring_sprintf(qmgr_fbstate_key, "%s\t%s", transport->name, queue->name);
+    if ((fb = (QMGR_FBSTATE *) htable_find(qmgr_fbstate_table,
+					   STR(qmgr_fbstate_key))) == 0)
+	return;
+
+    /*
+     * State that was saved while this process runs is replaced by the state
+     * of the new in-core queue. A dead destination stays dead until its
+     * saved retry time. Otherwise, move the saved state towards the initial
+     * state as it ages.
+     */
+    if (fb->loaded) {
+	if (fb->retry_time > now) {
+	    qmgr_queue_mark_dead(queue,
+				 DSN_SIMPLE(&dsn, fb->status, fb->reason),
+				 fb->retry_time - now);
+	} else if (fb->window > 0 && now - fb->time < var_qmgr_fbstate_maxage) {
+	    weight = now > fb->time ?
+		1.0 - (double) (now - fb->time) / var_qmgr_fbstate_maxage : 1.0;
+	    window = transport->init_dest_concurrency
+		+ (fb->window - transport->init_dest_concurrency) * weight + 0.5;
+	    if (transport->dest_concurrency_limit > 0
+		&& window > transport->dest_concurrency_limit)
+		window = transport->dest_concurrency_limit;
+	    if (window < 1)
+		window = 1;
+	    queue->window = window;
+	    queue->success = fb->success * weight;
+	    queue->failure = fb->failure * weight;
+	    queue->fail_cohorts = fb->fail_cohorts * weight;
+	}
+	if (msg_verbose)
+	    msg_info("%s: queue %s: %s window %d fail_cohorts %g",
+		     myname, STR(qmgr_fbstate_key), QMGR_QUEUE_STATUS(queue),
+		     queue->window, queue->fail_cohorts);
+    }
+    htable_delete(qmgr_fbstate_table, STR(qmgr_fbstate_key),
+		  qmgr_fbstate_free);
+}
+
+/* qmgr_fbstate_save - remember state of in-core queue */
+
+void    qmgr_fbstate_save(QMGR_QUEUE *queue)
+{
+    QMGR_FBSTATE fb;
+    QMGR_FBSTATE *saved;
+    HTABLE_INFO *ht;
+
+    if (qmgr_fbstate_table == 0 || qmgr_fbstate_capture(&fb, queue) == 0)
+	return;
+    saved = (QMGR_FBSTATE *) mymalloc(sizeof(*saved));
+    *saved = fb;
+    if (fb.status) {
+	saved->status = mystrdup(fb.status);
+	saved->reason = mystrdup(fb.reason);
+    }
+    if ((ht = htable_locate(qmgr_fbstate_table, STR(qmgr_fbstate_key))) != 0) {
+	qmgr_fbstate_free(ht->value);
+	ht->value = (void *) saved;
+    } else {
+	htable_enter(qmgr_fbstate_table, STR(qmgr_fbstate_key), (void *) saved);
+    }
+}
+
+/* qmgr_fbstate_init - read saved state, start update pseudo thread */
+
+void    qmgr_fbstate_init(void)
+{
+    if (*var_qmgr_fbstate_file == 0 || var_qmgr_fbstate_int <= 0)
+	return;
+    qmgr_fbstate_table = htable_create(100);
+    qmgr_fbstate_key = vstring_alloc(100);
+    qmgr_fbstate_temp = vstring_alloc(100);
+    vstring_sprintf(qmgr_fbstate_temp, "%s.%ld",
+		    var_qmgr_fbstate_file, (long) var_pid);
+    qmgr_fbstate_load();
+    event_request_timer(qmgr_fbstate_event, (void *) 0,
+			var_qmgr_fbstate_int);
+}
@@ -17,6 +17,16 @@
 /*	double	QMGR_FEEDBACK_VAL(fbck_ctl, concurrency)
 /*	QMGR_FEEDBACK *fbck_ctl;
 /*	const int concurrency;
+/*
+/*	int	qmgr_feedback_mode(name_prefix)
+/*	const char *name_prefix;
+/*
+/*	void	qmgr_feedback_latency(queue, entry)
+/*	QMGR_QUEUE *queue;
+/*	QMGR_ENTRY *entry;
+/*
+/*	double	qmgr_feedback_backlog(queue)
+/*	QMGR_QUEUE *queue;
 /* DESCRIPTION
 /*	Upon completion of a delivery request, a delivery agent
 /*	provides a hint that the scheduler should dedicate fewer or
@@ -31,6 +41,22 @@
 /*	current concurrency window. This is an "unsafe" macro that
 /*	evaluates some arguments multiple times.
 /*
+/*	qmgr_feedback_mode() looks up the transport-dependent
+/*	concurrency feedback mode from main.cf: QMGR_FEEDBACK_MODE_COUNT
+/*	(success and failure counts only) or QMGR_FEEDBACK_MODE_LATENCY
+/*	(also per-destination delivery latency).
+/*
+/*	qmgr_feedback_latency() updates the per-destination latency
+/*	estimates with the time that the specified queue entry took
+/*	to deliver, divided by its number of recipients. This should
+/*	be called only for successful deliveries.
+/*
+/*	qmgr_feedback_backlog() estimates how many of the deliveries
+/*	in progress for the specified destination are not adding
+/*	throughput, because they take longer than deliveries would
+/*	at low concurrency. The result is zero when there are no
+/*	latency estimates.
+/*
 /*	Arguments:
 /* .IP fbck_ctl
 /*	Pointer to QMGR_FEEDBACK structure where the result will
@@ -48,6 +74,10 @@
 /*	The value of the default feedback parameter.
 /* .IP concurrency
 /*	Delivery concurrency for concurrency-dependent feedback calculation.
+/* .IP queue
+/*	Destination queue.
+/* .IP entry
+/*	Queue entry whose delivery has completed.
 /* DIAGNOSTICS
 /*	Warning: configuration error or unreasonable input. The program
 /*	uses name_tail feedback instead.
@@ -103,6 +133,24 @@ const NAME_CODE qmgr_feedback_map[] = {
     0, QMGR_FEEDBACK_IDX_NONE,
 };
 
+ /*
+  * Lookup table for main.cf feedback mode names.
+  */
+static const NAME_CODE qmgr_feedback_mode_map[] = {
+    CONC_FDBACK_MODE_COUNT, QMGR_FEEDBACK_MODE_COUNT,
+    CONC_FDBACK_MODE_LATENCY, QMGR_FEEDBACK_MODE_LATENCY,
+    0, -1,
+};
+
+ /*
+  * Latency estimates. The average follows recent deliveries; the baseline
+  * is the fastest delivery seen. The baseline does not drift towards the
+  * average, because that would hide congestion that persists. Instead, it
+  * is forgotten when the in-core queue goes away.
+  */
+#define QMGR_LATENCY_AVG_WEIGHT		8	/* new sample weight 1/8 */
+#define QMGR_LATENCY_RESOLUTION		1e-6	/* timer resolution */
+
 /* qmgr_feedback_init - initialize feedback control */
 
 void    qmgr_feedback_init(QMGR_FEEDBACK *fb,
@@ -180,3 +228,63 @@ void    qmgr_feedback_init(QMGR_FEEDBACK *fb,
     myfree(fbck_name);
     myfree(fbck_val);
 }
+
+/* qmgr_feedback_mode - look up concurrency feedback mode */
+
+int     qmgr_feedback_mode(const char *name_prefix)
+{
+    char   *mode_val;
+    int     mode;
+
+    mode_val = get_mail_conf_str2(name_prefix, _CONC_FDBACK_MODE,
+				  var_conc_fdback_mode, 1, 0);
+    if ((mode = name_code(qmgr_feedback_mode_map, NAME_CODE_FLAG_NONE,
+			  mode_val)) < 0) {
+	msg_warn("%s%s: ignoring unknown feedback mode: %s",
+		 name_prefix, _CONC_FDBACK_MODE, mode_val);
+	mode = QMGR_FEEDBACK_MODE_COUNT;
+    }
+    if (var_conc_feedback_debug)
+	msg_info("%s: feedback mode %s", name_prefix, mode_val);
+    myfree(mode_val);
+    return (mode);
+}
+
+/* qmgr_feedback_latency - update per-destination latency estimates */
+
+void    qmgr_feedback_latency(QMGR_QUEUE *queue, QMGR_ENTRY *entry)
+{
+    struct timeval now;
+    double  sample;
+
+    GETTIMEOFDAY(&now);
+    sample = (now.tv_sec - entry->deliver_start.tv_sec)
+	+ (now.tv_usec - entry->deliver_start.tv_usec) / 1000000.0;
+    if (entry->rcpt_list.len > 1)
+	sample /= entry->rcpt_list.len;
+    if (sample < QMGR_LATENCY_RESOLUTION)
+	sample = QMGR_LATENCY_RESOLUTION;
+
+    if (queue->lat_avg == 0) {
+	queue->lat_avg = queue->lat_min = sample;
+    } else {
+	queue->lat_avg += (sample - queue->lat_avg) / QMGR_LATENCY_AVG_WEIGHT;
+	if (sample < queue->lat_min)
+	    queue->lat_min = sample;
+    }
+}
+
+/* qmgr_feedback_backlog - estimate deliveries that add no throughput */
+
+double  qmgr_feedback_backlog(QMGR_QUEUE *queue)
+{
+
+    /*
+     * With N deliveries in progress, each taking lat_avg instead of lat_min,
+     * the destination handles only N * lat_min / lat_avg of them in the time
+     * of an uncongested delivery. The remainder is waiting at the remote end.
+     */
+    if (queue->lat_avg <= 0)
+	return (0);
+    return (queue->busy_refcount * (1 - queue->lat_min / queue->lat_avg));
+}
@@ -0,0 +1,202 @@
+/*++
+/* NAME
+/*	qmgr_index 3
+/* SUMMARY
+/*	persistent deferred queue index
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_index_pre_jail_init()
+/*
+/*	void	qmgr_index_post_jail_init()
+/*
+/*	void	qmgr_index_update(queue_id, retry_time)
+/*	const char *queue_id;
+/*	time_t	retry_time;
+/*
+/*	int	qmgr_index_lookup(queue_id, retry_time)
+/*	const char *queue_id;
+/*	time_t	*retry_time;
+/*
+/*	void	qmgr_index_delete(queue_id)
+/*	const char *queue_id;
+/* DESCRIPTION
+/*	This module maintains an optional persistent index with
+/*	the next delivery attempt time of each message in the
+/*	deferred queue. With this, a deferred queue scan can skip
+/*	messages that are not yet due, without having to look up
+/*	queue file attributes. This speeds up deferred queue scans
+/*	after "postfix reload" or "postfix start" with large queues.
+/*
+/*	The index is only a hint. A message without index entry
+/*	is handled as if there were no index; and the index entry
+/*	for a message is identical to the time stamp that the queue
+/*	manager sets on the deferred queue file. Loss of index
+/*	updates after a system crash therefore will not delay mail
+/*	beyond its scheduled time. Deferred queue scans that ignore
+/*	queue file time stamps (QMGR_SCAN_ALL) do not use the index.
+/*
+/*	qmgr_index_pre_jail_init() opens the index specified with
+/*	the qmgr_queue_index_map parameter. This must be called
+/*	before the process enters the chroot jail. It does nothing
+/*	when the parameter value is empty.
+/*
+/*	qmgr_index_post_jail_init() starts the index cleanup pseudo
+/*	thread, which removes entries for messages that are no longer
+/*	in the deferred or hold queue.
+/*
+/*	qmgr_index_update() records the next delivery attempt time
+/*	for the named deferred queue file.
+/*
+/*	qmgr_index_lookup() looks up the next delivery attempt time
+/*	for the named deferred queue file. The result is non-zero
+/*	when an index entry was found.
+/*
+/*	qmgr_index_delete() removes the index entry for the named
+/*	queue file, if one exists.
+/* DIAGNOSTICS
+/*	Fatal errors: index access errors. Panic: interface violations.
+/*	Warnings: malformed index entries are ignored.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>			/* snprintf() */
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstring.h>
+#include <dict.h>
+#include <dict_cache.h>
+#include <set_eugid.h>
+#include <stringops.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_queue.h>
+#include <data_redirect.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+ /*
+  * The index is a hint, so there is no need to sync it after each update.
+  */
+#define QMGR_INDEX_OPEN_FLAGS	(DICT_FLAG_DUP_REPLACE | DICT_FLAG_OPEN_LOCK)
+
+static DICT_CACHE *qmgr_index;
+
+/* qmgr_index_validator - keep entries for files that still exist */
+
+static int qmgr_index_validator(const char *queue_id, const char *unused_val,
+				        void *unused_context)
+{
+    struct stat st;
+
+    /*
+     * This function is called by the cache cleanup pseudo thread. An entry
+     * becomes stale when a message is removed or requeued with postsuper(1).
+     * Mail that is on hold keeps its entry, so that the index is valid when
+     * the message is released into the deferred queue.
+     */
+    return (stat(mail_queue_path((VSTRING *) 0, MAIL_QUEUE_DEFERRED,
+				 queue_id), &st) == 0
+	    || stat(mail_queue_path((VSTRING *) 0, MAIL_QUEUE_HOLD,
+				    queue_id), &st) == 0);
+}
+
+/* qmgr_index_pre_jail_init - open index before entering the jail */
+
+void    qmgr_index_pre_jail_init(void)
+{
+    VSTRING *redirect;
+
+    if (*var_qmgr_index_map == 0)
+	return;
+
+    /*
+     * Security: don't create root-owned files that contain untrusted data.
+     * And don't create Postfix-owned files in root-owned directories,
+     * either.
+     */
+    SAVE_AND_SET_EUGID(var_owner_uid, var_owner_gid);
+    redirect = vstring_alloc(100);
+    qmgr_index = dict_cache_open(data_redirect_map(redirect, var_qmgr_index_map),
+				 O_CREAT | O_RDWR, QMGR_INDEX_OPEN_FLAGS);
+    vstring_free(redirect);
+    RESTORE_SAVED_EUGID();
+}
+
+/* qmgr_index_post_jail_init - start index maintenance */
+
+void    qmgr_index_post_jail_init(void)
+{
+    int     cache_flags;
+
+    if (qmgr_index == 0 || var_qmgr_index_scan <= 0)
+	return;
+    cache_flags = DICT_CACHE_FLAG_STATISTICS;
+    if (msg_verbose > 1)
+	cache_flags |= DICT_CACHE_FLAG_VERBOSE;
+    dict_cache_control(qmgr_index,
+		       CA_DICT_CACHE_CTL_FLAGS(cache_flags),
+		       CA_DICT_CACHE_CTL_INTERVAL(var_qmgr_index_scan),
+		       CA_DICT_CACHE_CTL_VALIDATOR(qmgr_index_validator),
+		       CA_DICT_CACHE_CTL_CONTEXT((void *) 0),
+		       CA_DICT_CACHE_CTL_END);
+}
+
+/* qmgr_index_update - record the next delivery attempt time */
+
+void    qmgr_index_update(const char *queue_id, time_t retry_time)
+{
+    char    buf[sizeof(long) * 3 + 2];
+
+    if (qmgr_index == 0)
+	return;
+    if (msg_verbose)
+	msg_info("qmgr_index_update: %s %ld", queue_id, (long) retry_time);
+    (void) snprintf(buf, sizeof(buf), "%ld", (long) retry_time);
+    dict_cache_update(qmgr_index, queue_id, buf);
+}
+
+/* qmgr_index_lookup - look up the next delivery attempt time */
+
+int     qmgr_index_lookup(const char *queue_id, time_t *retry_time)
+{
+    const char *value;
+    char   *end;
+    long    when;
+
+    if (qmgr_index == 0
+	|| (value = dict_cache_lookup(qmgr_index, queue_id)) == 0)
+	return (0);
+    when = strtol(value, &end, 10);
+    if (*value == 0 || *end != 0 || when <= 0) {
+	msg_warn("%s: ignoring malformed index entry for %s: \"%.100s\"",
+		 dict_cache_name(qmgr_index), queue_id, value);
+	return (0);
+    }
+    *retry_time = when;
+    return (1);
+}
+
+/* qmgr_index_delete - forget a queue file */
+
+void    qmgr_index_delete(const char *queue_id)
+{
+    if (qmgr_index == 0)
+	return;
+    (void) dict_cache_delete(qmgr_index, queue_id);
+}
@@ -9,6 +9,7 @@
 /*	int	qmgr_message_count;
 /*	int	qmgr_recipient_count;
 /*	int	qmgr_vrfy_pend_count;
+/*	long	qmgr_memory_used;
 /*
 /*	QMGR_MESSAGE *qmgr_message_alloc(class, name, qflags, mode)
 /*	const char *class;
@@ -46,14 +47,22 @@
 /*	This is a backup mechanism for a more refined enforcement
 /*	mechanism in the verify(8) daemon.
 /*
+/*	qmgr_memory_used is a global estimate of the memory used for
+/*	in-core message structures, queue entries and recipients.
+/*	When the qmgr_message_memory_limit parameter is non-zero,
+/*	the queue manager stops admitting messages into the active
+/*	queue, and reads fewer recipients, when this estimate reaches
+/*	that limit.
+/*
 /*	qmgr_message_alloc() creates an in-core message structure
 /*	with sender and recipient information taken from the named queue
 /*	file. A null result means the queue file could not be read or
 /*	that the queue file contained incorrect information. A result
 /*	QMGR_MESSAGE_LOCKED means delivery must be deferred. The number
 /*	of recipients read from a queue file is limited by the global
-/*	var_qmgr_rcpt_limit configuration parameter. When the limit
-/*	is reached, the \fIrcpt_offset\fR structure member is set to
+/*	var_qmgr_rcpt_limit configuration parameter, and, except for
+/*	the first var_qmgr_msg_rcpt_limit recipients, by the
+/*	var_qmgr_memory_limit parameter. When the limit is reached, the \fIrcpt_offset\fR structure member is set to
 /*	the position where the read was terminated. Recipients are
 /*	run through the resolver, and are assigned to destination
 /*	queues. Recipients that cannot be assigned are deferred or
@@ -115,6 +124,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>			/* INT_MAX */
 
 /* Utility library. */
 
@@ -137,6 +147,7 @@
 #include <canon_addr.h>
 #include <record.h>
 #include <rec_type.h>
+#include <rec_size_trailer.h>
 #include <sent.h>
 #include <deliver_completed.h>
 #include <opened.h>
@@ -146,6 +157,7 @@
 #include <split_addr.h>
 #include <dsn_mask.h>
 #include <rec_attr_map.h>
+#include <mail_priority.h>
 
 /* Client stubs. */
 
@@ -159,6 +171,7 @@
 int     qmgr_message_count;
 int     qmgr_recipient_count;
 int     qmgr_vrfy_pend_count;
+long    qmgr_memory_used;
 
 /* qmgr_message_create - create in-core message structure */
 
@@ -166,9 +179,12 @@ static QMGR_MESSAGE *qmgr_message_create(const char *queue_name,
 				           const char *queue_id, int qflags)
 {
     QMGR_MESSAGE *message;
+    int     tag;
 
+    tag = mymalloc_set_tag(MYMALLOC_TAG_QMGR_MESSAGE);
     message = (QMGR_MESSAGE *) mymalloc(sizeof(QMGR_MESSAGE));
     qmgr_message_count++;
+    qmgr_memory_used += sizeof(*message);
     message->flags = 0;
     message->qflags = qflags;
     message->tflags = 0;
@@ -209,14 +225,33 @@ static QMGR_MESSAGE *qmgr_message_create(const char *queue_name,
     message->sasl_sender = 0;
     message->log_ident = 0;
     message->rewrite_context = 0;
-    recipient_list_init(&message->rcpt_list, RCPT_LIST_INIT_QUEUE);
+    message->stage_times = 0;
+    message->handoff_time.tv_sec = message->handoff_time.tv_usec = 0;
+    recipient_list_init(&message->rcpt_list,
+			RCPT_LIST_INIT_QUEUE | RCPT_LIST_FLAG_POOL);
+    message->rcpt_memory = 0;
     message->rcpt_count = 0;
     message->rcpt_limit = var_qmgr_msg_rcpt_limit;
     message->rcpt_unread = 0;
+    message->park_dest = 0;
+    message->park_ok = 1;
+    message->priority = MAIL_PRIORITY_NORMAL;
     QMGR_LIST_INIT(message->job_list);
+    (void) mymalloc_set_tag(tag);
     return (message);
 }
 
+/* qmgr_message_rcpt_reset - discard the in-core recipient list */
+
+static void qmgr_message_rcpt_reset(QMGR_MESSAGE *message)
+{
+    recipient_list_free(&message->rcpt_list);
+    recipient_list_init(&message->rcpt_list,
+			RCPT_LIST_INIT_QUEUE | RCPT_LIST_FLAG_POOL);
+    qmgr_memory_used -= message->rcpt_memory;
+    message->rcpt_memory = 0;
+}
+
 /* qmgr_message_close - close queue file */
 
 static void qmgr_message_close(QMGR_MESSAGE *message)
@@ -251,6 +286,30 @@ static int qmgr_message_open(QMGR_MESSAGE *message)
     return (0);
 }
 
+/* qmgr_message_prefetch - start reading envelope into page cache */
+
+static void qmgr_message_prefetch(QMGR_MESSAGE *message)
+{
+
+    /*
+     * Start reading the envelope and the extracted segment into the page
+     * cache, so that we don't stall the event loop one block at a time
+     * while we read a long recipient list. Skip the message content: we
+     * never read it, and a delivery agent reads it only when it gets that
+     * far. For a large deferred message that is retried while its
+     * destination is down, the content would be read from disk for nothing,
+     * and would push more useful data out of the cache. This is only a
+     * hint, so errors don't matter.
+     */
+#ifdef POSIX_FADV_WILLNEED
+    (void) posix_fadvise(vstream_fileno(message->fp), 0,
+			 message->data_offset, POSIX_FADV_WILLNEED);
+    (void) posix_fadvise(vstream_fileno(message->fp),
+			 message->data_offset + message->data_size, 0,
+			 POSIX_FADV_WILLNEED);
+#endif
+}
+
 /* qmgr_message_oldstyle_scan - support for Postfix < 1.0 queue files */
 
 static void qmgr_message_oldstyle_scan(QMGR_MESSAGE *message)
@@ -338,6 +397,8 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
     int     save_unread = message->rcpt_unread;	/* save a count */
     char   *start;
     int     recipient_limit;
+    int     recipient_minimum;
+    long    rcpt_memory;
     const char *error_text;
     char   *name;
     char   *value;
@@ -350,10 +411,12 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
     static const char env_rec_types[] = REC_TYPE_ENVELOPE REC_TYPE_EXTRACT;
     static const char extra_rec_type[] = {REC_TYPE_XTRA, 0};
     const char *expected_rec_types;
+    int     tag;
 
     /*
      * Initialize. No early returns or we have a memory leak.
      */
+    tag = mymalloc_set_tag(MYMALLOC_TAG_QMGR_MESSAGE);
     buf = vstring_alloc(100);
 
     /*
@@ -377,14 +440,18 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	    msg_fatal("seek file %s: %m", VSTREAM_PATH(message->fp));
 	message->rcpt_offset = 0;
 	recipient_limit = message->rcpt_limit - message->rcpt_count;
+	recipient_minimum = recipient_limit;
     } else {
 	recipient_limit = var_qmgr_rcpt_limit - qmgr_recipient_count;
 	if (recipient_limit < message->rcpt_limit)
 	    recipient_limit = message->rcpt_limit;
+	recipient_minimum = message->rcpt_limit;
     }
     /* Keep interrupt latency in check. */
     if (recipient_limit > 5000)
 	recipient_limit = 5000;
+    if (recipient_minimum > recipient_limit)
+	recipient_minimum = recipient_limit;
     if (recipient_limit <= 0)
 	msg_panic("%s: no recipient slots available", message->queue_id);
     if (msg_verbose)
@@ -475,10 +542,16 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	    /* See also below for code setting orig_rcpt etc. */
 	    if (message->rcpt_offset == 0) {
 		message->rcpt_unread--;
+		(void) mymalloc_set_tag(MYMALLOC_TAG_QMGR_RCPT);
 		recipient_list_add(&message->rcpt_list, curr_offset,
 				   dsn_orcpt ? dsn_orcpt : "",
 				   dsn_notify ? dsn_notify : 0,
 				   orig_rcpt ? orig_rcpt : "", start);
+		(void) mymalloc_set_tag(MYMALLOC_TAG_QMGR_MESSAGE);
+		rcpt_memory = QMGR_RCPT_MEMORY(message->rcpt_list.info
+					       + message->rcpt_list.len - 1);
+		message->rcpt_memory += rcpt_memory;
+		qmgr_memory_used += rcpt_memory;
 		if (dsn_orcpt) {
 		    myfree(dsn_orcpt);
 		    dsn_orcpt = 0;
@@ -489,7 +562,9 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 		}
 		if (dsn_notify)
 		    dsn_notify = 0;
-		if (message->rcpt_list.len >= recipient_limit) {
+		if (message->rcpt_list.len >= recipient_limit
+		    || (message->rcpt_list.len >= recipient_minimum
+			&& !QMGR_MEMORY_OK())) {
 		    if ((message->rcpt_offset = vstream_ftell(message->fp)) < 0)
 			msg_fatal("vstream_ftell %s: %m",
 				  VSTREAM_PATH(message->fp));
@@ -585,6 +660,15 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	    continue;
 	if (rec_type == REC_TYPE_SIZE) {
 	    if (message->data_offset == 0) {
+		if (strcmp(start, REC_TYPE_SIZE_TRAILER) == 0) {
+		    if (rec_size_trailer(message->fp, buf) != REC_TYPE_SIZE) {
+			msg_warn("%s: message rejected: bad size trailer",
+				 message->queue_id);
+			rec_type = REC_TYPE_ERROR;
+			break;
+		    }
+		    start = vstring_str(buf);
+		}
 		if ((count = sscanf(start, "%ld %ld %d %d %ld %d",
 				 &message->data_size, &message->data_offset,
 				    &message->rcpt_unread, &message->rflags,
@@ -603,6 +687,7 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 			rec_type = REC_TYPE_ERROR;
 			break;
 		    }
+		    qmgr_message_prefetch(message);
 		} else if (count == 1) {
 		    /* Postfix < 1.0 (a.k.a. 20010228). */
 		    qmgr_message_oldstyle_scan(message);
@@ -683,6 +768,13 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 		    myfree(message->encoding);
 		message->encoding = mystrdup(value);
 	    }
+	    if (strcmp(name, MAIL_ATTR_PRIORITY) == 0) {
+		if ((n = mail_priority_code(value)) == MAIL_PRIORITY_UNKNOWN)
+		    msg_warn("%s: ignoring unknown priority class: %.100s",
+			     message->queue_id, value);
+		else
+		    message->priority = n;
+	    }
 
 	    /*
 	     * Backwards compatibility. Before Postfix 2.3, the logging
@@ -764,6 +856,9 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			     message->queue_id, MAIL_ATTR_LOG_IDENT, value);
+	    } else if (strcmp(name, MAIL_ATTR_STAGE_TIMES) == 0) {
+		if (message->stage_times == 0)
+		    message->stage_times = mystrdup(value);
 	    } else if (strcmp(name, MAIL_ATTR_RWR_CONTEXT) == 0) {
 		if (message->rewrite_context == 0)
 		    message->rewrite_context = mystrdup(value);
@@ -887,6 +982,7 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
      * Clean up.
      */
     vstring_free(buf);
+    (void) mymalloc_set_tag(tag);
 
     /*
      * Sanity checks. Verify that all required information was found,
@@ -914,8 +1010,7 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
     }
     message->rcpt_offset = save_offset;		/* restore flag */
     message->rcpt_unread = save_unread;		/* restore count */
-    recipient_list_free(&message->rcpt_list);
-    recipient_list_init(&message->rcpt_list, RCPT_LIST_INIT_QUEUE);
+    qmgr_message_rcpt_reset(message);
     return (-1);
 }
 
@@ -950,16 +1045,48 @@ void    qmgr_message_kill_record(QMGR_MESSAGE *message, long offset)
     qmgr_message_close(message);
 }
 
+/*
+  * Recipient sort keys. The string comparisons that don't depend on the
+  * other recipient are done once per recipient instead of once per
+  * comparison: the queue (transport name, queue name) is replaced by its
+  * rank among the queues of this recipient list, and the recipient domain
+  * is looked up in advance.
+  */
+typedef struct {
+    RECIPIENT *rcpt;			/* recipient */
+    const char *domain;			/* recipient domain or null */
+    int     rank;			/* queue order */
+} QMGR_SORT_KEY;
+
+#define QMGR_SORT_RANK_NONE	INT_MAX		/* NULL queue sorts last */
+
+/* qmgr_message_sort_queue_compare - compare queue information */
+
+static int qmgr_message_sort_queue_compare(const void *p1, const void *p2)
+{
+    QMGR_QUEUE *queue1 = *(QMGR_QUEUE **) p1;
+    QMGR_QUEUE *queue2 = *(QMGR_QUEUE **) p2;
+    int     result;
+
+    /*
+     * Compare message transport.
+     */
+    if ((result = strcmp(queue1->transport->name,
+			 queue2->transport->name)) != 0)
+	return (result);
+
+    /*
+     * Compare queue name (nexthop or recipient@nexthop).
+     */
+    return (strcmp(queue1->name, queue2->name));
+}
+
 /* qmgr_message_sort_compare - compare recipient information */
 
 static int qmgr_message_sort_compare(const void *p1, const void *p2)
 {
-    RECIPIENT *rcpt1 = (RECIPIENT *) p1;
-    RECIPIENT *rcpt2 = (RECIPIENT *) p2;
-    QMGR_QUEUE *queue1;
-    QMGR_QUEUE *queue2;
-    char   *at1;
-    char   *at2;
+    QMGR_SORT_KEY *key1 = (QMGR_SORT_KEY *) p1;
+    QMGR_SORT_KEY *key2 = (QMGR_SORT_KEY *) p2;
     int     result;
 
     /*
@@ -967,54 +1094,84 @@ static int qmgr_message_sort_compare(const void *p1, const void *p2)
      * The comparison function must be transitive, so NULL values need to be
      * assigned an ordinal (we set NULL last).
      */
-
-    queue1 = rcpt1->u.queue;
-    queue2 = rcpt2->u.queue;
-    if (queue1 != 0 && queue2 == 0)
-	return (-1);
-    if (queue1 == 0 && queue2 != 0)
-	return (1);
-    if (queue1 != 0 && queue2 != 0) {
-
-	/*
-	 * Compare message transport.
-	 */
-	if ((result = strcmp(queue1->transport->name,
-			     queue2->transport->name)) != 0)
-	    return (result);
-
-	/*
-	 * Compare queue name (nexthop or recipient@nexthop).
-	 */
-	if ((result = strcmp(queue1->name, queue2->name)) != 0)
-	    return (result);
-    }
+    if (key1->rank != key2->rank)
+	return (key1->rank < key2->rank ? -1 : 1);
 
     /*
-     * Compare recipient domain.
+     * Compare recipient domain. Identical domains are common in large
+     * recipient lists, so try the cheap test first.
      */
-    at1 = strrchr(rcpt1->address, '@');
-    at2 = strrchr(rcpt2->address, '@');
-    if (at1 == 0 && at2 != 0)
+    if (key1->domain == 0 && key2->domain != 0)
 	return (1);
-    if (at1 != 0 && at2 == 0)
+    if (key1->domain != 0 && key2->domain == 0)
 	return (-1);
-    if (at1 != 0 && at2 != 0
-	&& (result = strcasecmp_utf8(at1, at2)) != 0)
+    if (key1->domain != 0 && key2->domain != 0
+	&& strcmp(key1->domain, key2->domain) != 0
+	&& (result = strcasecmp_utf8(key1->domain, key2->domain)) != 0)
 	return (result);
 
     /*
      * Compare recipient address.
      */
-    return (strcmp(rcpt1->address, rcpt2->address));
+    return (strcmp(key1->rcpt->address, key2->rcpt->address));
 }
 
 /* qmgr_message_sort - sort message recipient addresses by domain */
 
 static void qmgr_message_sort(QMGR_MESSAGE *message)
 {
-    qsort((void *) message->rcpt_list.info, message->rcpt_list.len,
-	  sizeof(message->rcpt_list.info[0]), qmgr_message_sort_compare);
+    RECIPIENT_LIST *list = &message->rcpt_list;
+    QMGR_SORT_KEY *keys;
+    QMGR_QUEUE **queues;
+    RECIPIENT *sorted;
+    QMGR_QUEUE *queue;
+    ssize_t queue_count = 0;
+    ssize_t n;
+
+    if (list->len > 1) {
+
+	/*
+	 * Rank the distinct queues of this recipient list. There are usually
+	 * far fewer queues than recipients, so this is where the queue name
+	 * string comparisons happen.
+	 */
+	queues = (QMGR_QUEUE **) mymalloc(sizeof(*queues) * list->len);
+	for (n = 0; n < list->len; n++)
+	    if ((queue = list->info[n].u.queue) != 0)
+		queue->sort_rank = -1;
+	for (n = 0; n < list->len; n++) {
+	    if ((queue = list->info[n].u.queue) != 0 && queue->sort_rank < 0) {
+		queue->sort_rank = 0;
+		queues[queue_count++] = queue;
+	    }
+	}
+	if (queue_count > 1)
+	    qsort((void *) queues, queue_count, sizeof(queues[0]),
+		  qmgr_message_sort_queue_compare);
+	for (n = 0; n < queue_count; n++)
+	    queues[n]->sort_rank = n;
+	myfree((void *) queues);
+
+	/*
+	 * Sort the recipient keys, then put the recipients in that order.
+	 */
+	keys = (QMGR_SORT_KEY *) mymalloc(sizeof(*keys) * list->len);
+	for (n = 0; n < list->len; n++) {
+	    keys[n].rcpt = list->info + n;
+	    keys[n].domain = strrchr(list->info[n].address, '@');
+	    keys[n].rank = ((queue = list->info[n].u.queue) != 0 ?
+			    queue->sort_rank : QMGR_SORT_RANK_NONE);
+	}
+	qsort((void *) keys, list->len, sizeof(keys[0]),
+	      qmgr_message_sort_compare);
+	sorted = (RECIPIENT *) mymalloc(sizeof(*sorted) * list->len);
+	for (n = 0; n < list->len; n++)
+	    sorted[n] = *keys[n].rcpt;
+	memcpy((void *) list->info, (void *) sorted,
+	       sizeof(*sorted) * list->len);
+	myfree((void *) sorted);
+	myfree((void *) keys);
+    }
     if (msg_verbose) {
 	RECIPIENT_LIST list = message->rcpt_list;
 	RECIPIENT *rcpt;
@@ -1026,10 +1183,9 @@ static void qmgr_message_sort(QMGR_MESSAGE *message)
     }
 }
 
-/* qmgr_resolve_one - resolve or skip one recipient */
+/* qmgr_resolve_status - handle resolver errors */
 
-static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
-			            const char *addr, RESOLVE_REPLY *reply)
+static int qmgr_resolve_status(RESOLVE_REPLY *reply)
 {
 #define QMGR_REDIRECT(rp, tp, np) do { \
 	(rp)->flags = 0; \
@@ -1037,10 +1193,6 @@ static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
 	vstring_strcpy((rp)->nexthop, (np)); \
     } while (0)
 
-    if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) == 0)
-	resolve_clnt_query_from(message->sender, addr, reply);
-    else
-	resolve_clnt_verify_from(message->sender, addr, reply);
     if (reply->flags & RESOLVE_FLAG_FAIL) {
 	QMGR_REDIRECT(reply, MAIL_SERVICE_RETRY,
 		      "4.3.0 address resolver failure");
@@ -1054,6 +1206,67 @@ static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
     }
 }
 
+/* qmgr_resolve_one - resolve or skip one recipient */
+
+static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
+			            const char *addr, RESOLVE_REPLY *reply)
+{
+    if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) == 0)
+	resolve_clnt_query_from(message->sender, addr, reply);
+    else
+	resolve_clnt_verify_from(message->sender, addr, reply);
+    return (qmgr_resolve_status(reply));
+}
+
+/* qmgr_resolve_batch - resolve one recipient, batching lookups ahead */
+
+static int qmgr_resolve_batch(QMGR_MESSAGE *message, RECIPIENT_LIST *list,
+			              RECIPIENT *recipient, ssize_t *batch_start,
+			              ssize_t *batch_end, RESOLVE_REPLY *reply)
+{
+    static RESOLVE_REPLY *batch_reply;
+    static const char **batch_addr;
+    ssize_t pos = recipient - list->info;
+    ssize_t n;
+
+    /*
+     * Resolve the next RESOLVE_BATCH_LIMIT recipients with one request to
+     * the resolver daemon, instead of one round trip per recipient. A
+     * recipient's address is updated only after that recipient is
+     * resolved, so looking ahead gives the same results.
+     */
+    if (pos < *batch_start || pos >= *batch_end) {
+	if (batch_reply == 0) {
+	    batch_reply = (RESOLVE_REPLY *)
+		mymalloc(sizeof(*batch_reply) * RESOLVE_BATCH_LIMIT);
+	    for (n = 0; n < RESOLVE_BATCH_LIMIT; n++)
+		resolve_clnt_init(batch_reply + n);
+	    batch_addr = (const char **)
+		mymalloc(sizeof(*batch_addr) * RESOLVE_BATCH_LIMIT);
+	}
+	*batch_start = pos;
+	*batch_end = pos + RESOLVE_BATCH_LIMIT;
+	if (*batch_end > list->len)
+	    *batch_end = list->len;
+	for (n = 0; n < *batch_end - *batch_start; n++)
+	    batch_addr[n] = recipient[n].address;
+	if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) == 0)
+	    resolve_clnt_query_batch_from(message->sender, batch_addr,
+					  *batch_end - *batch_start,
+					  batch_reply);
+	else
+	    resolve_clnt_verify_batch_from(message->sender, batch_addr,
+					   *batch_end - *batch_start,
+					   batch_reply);
+    }
+    n = pos - *batch_start;
+    vstring_strcpy(reply->transport, vstring_str(batch_reply[n].transport));
+    vstring_strcpy(reply->nexthop, vstring_str(batch_reply[n].nexthop));
+    vstring_strcpy(reply->recipient, vstring_str(batch_reply[n].recipient));
+    reply->flags = batch_reply[n].flags;
+    return (qmgr_resolve_status(reply));
+}
+
 /* qmgr_message_resolve - resolve recipients */
 
 static void qmgr_message_resolve(QMGR_MESSAGE *message)
@@ -1073,6 +1286,8 @@ static void qmgr_message_resolve(QMGR_MESSAGE *message)
     DSN     dsn;
     MSG_STATS stats;
     DSN    *saved_dsn;
+    ssize_t batch_start = 0;
+    ssize_t batch_end = 0;
 
 #define STREQ(x,y)	(strcmp(x,y) == 0)
 #define STR		vstring_str
@@ -1097,12 +1312,14 @@ static void qmgr_message_resolve(QMGR_MESSAGE *message)
 
 	    rewrite_clnt_internal(REWRITE_CANON, message->redirect_addr,
 				  reply.recipient);
-	    RECIPIENT_UPDATE(recipient->address, STR(reply.recipient));
+	    RECIPIENT_LIST_UPDATE(&message->rcpt_list, recipient->address,
+				      STR(reply.recipient));
 	    if (qmgr_resolve_one(message, recipient,
 				 recipient->address, &reply) < 0)
 		continue;
 	    if (!STREQ(recipient->address, STR(reply.recipient)))
-		RECIPIENT_UPDATE(recipient->address, STR(reply.recipient));
+		RECIPIENT_LIST_UPDATE(&message->rcpt_list, recipient->address,
+				      STR(reply.recipient));
 	}
 
 	/*
@@ -1136,11 +1353,12 @@ static void qmgr_message_resolve(QMGR_MESSAGE *message)
 	 * result address may differ from the one specified by the sender.
 	 */
 	else {
-	    if (qmgr_resolve_one(message, recipient,
-				 recipient->address, &reply) < 0)
+	    if (qmgr_resolve_batch(message, &list, recipient, &batch_start,
+				   &batch_end, &reply) < 0)
 		continue;
 	    if (!STREQ(recipient->address, STR(reply.recipient)))
-		RECIPIENT_UPDATE(recipient->address, STR(reply.recipient));
+		RECIPIENT_LIST_UPDATE(&message->rcpt_list, recipient->address,
+				      STR(reply.recipient));
 	}
 
 	/*
@@ -1326,14 +1544,19 @@ static void qmgr_message_resolve(QMGR_MESSAGE *message)
 	    qmgr_queue_unthrottle(queue);
 
 	/*
-	 * This queue is dead. Defer delivery to this recipient.
+	 * This queue is dead. Defer delivery to this recipient. Any other
+	 * redirection to the retry service is a deferral for a different
+	 * reason.
 	 */
 	if (QMGR_QUEUE_THROTTLED(queue)) {
+	    qmgr_park_note(message, queue);
 	    saved_dsn = queue->dsn;
 	    if ((queue = qmgr_error_queue(MAIL_SERVICE_RETRY, saved_dsn)) == 0) {
 		qmgr_defer_recipient(message, recipient, saved_dsn);
 		continue;
 	    }
+	} else if (strcmp(transport->name, MAIL_SERVICE_RETRY) == 0) {
+	    qmgr_park_spoil(message);
 	}
 
 	/*
@@ -1355,6 +1578,8 @@ static void qmgr_message_assign(QMGR_MESSAGE *message)
     QMGR_QUEUE *queue;
     QMGR_JOB *job = 0;
     QMGR_PEER *peer = 0;
+    long    rcpt_memory;
+    int     tag;
 
     /*
      * Try to bundle as many recipients in a delivery request as we can. When
@@ -1401,9 +1626,14 @@ static void qmgr_message_assign(QMGR_MESSAGE *message)
 	 * Add the recipient to the current entry and increase all those
 	 * recipient counters accordingly.
 	 */
+	tag = mymalloc_set_tag(MYMALLOC_TAG_QMGR_RCPT);
 	recipient_list_add(&entry->rcpt_list, recipient->offset,
 			   recipient->dsn_orcpt, recipient->dsn_notify,
 			   recipient->orig_addr, recipient->address);
+	(void) mymalloc_set_tag(tag);
+	rcpt_memory = QMGR_RCPT_MEMORY(recipient);
+	entry->rcpt_memory += rcpt_memory;
+	qmgr_memory_used += rcpt_memory;
 	job->rcpt_count++;
 	message->rcpt_count++;
 	qmgr_recipient_count++;
@@ -1413,8 +1643,7 @@ static void qmgr_message_assign(QMGR_MESSAGE *message)
      * Release the message recipient list and reinitialize it for the next
      * time.
      */
-    recipient_list_free(&message->rcpt_list);
-    recipient_list_init(&message->rcpt_list, RCPT_LIST_INIT_QUEUE);
+    qmgr_message_rcpt_reset(message);
 
     /*
      * Note that even if qmgr_job_obtain() reset the job candidate cache of
@@ -1486,10 +1715,15 @@ void    qmgr_message_free(QMGR_MESSAGE *message)
 	myfree(message->sasl_sender);
     if (message->log_ident)
 	myfree(message->log_ident);
+    if (message->stage_times)
+	myfree(message->stage_times);
     if (message->rewrite_context)
 	myfree(message->rewrite_context);
+    if (message->park_dest)
+	myfree(message->park_dest);
     recipient_list_free(&message->rcpt_list);
     qmgr_message_count--;
+    qmgr_memory_used -= sizeof(*message) + message->rcpt_memory;
     if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) != 0)
 	qmgr_vrfy_pend_count--;
     myfree((void *) message);
@@ -1541,6 +1775,16 @@ QMGR_MESSAGE *qmgr_message_alloc(const char *queue_name, const char *queue_id,
 	if (mode != 0 && fchmod(vstream_fileno(message->fp), mode) < 0)
 	    msg_fatal("fchmod %s: %m", VSTREAM_PATH(message->fp));
 
+	/*
+	 * The per-transport job lists and the preemption scores are based
+	 * on the time that a message entered the active queue. Schedule
+	 * high-priority mail as if it arrived earlier, and low-priority mail
+	 * as if it arrived later. This bounds the delay of bulk mail to the
+	 * same offset.
+	 */
+	message->queued_time -= (message->priority - MAIL_PRIORITY_NORMAL)
+	    * var_qmgr_prio_offset;
+
 	/*
 	 * If this message is forced to expire, use the existing defer
 	 * logfile records and do not assign any deliveries, leaving the
@@ -71,6 +71,8 @@ void    qmgr_move(const char *src_queue, const char *dst_queue,
     queue_dir = scan_dir_open(src_queue);
     while ((queue_id = mail_scan_dir_next(queue_dir)) != 0) {
 	if (mail_queue_id_ok(queue_id)) {
+	    if (!qmgr_shard_owned(queue_id))
+		continue;
 	    if (time_stamp > 0) {
 		tbuf.actime = tbuf.modtime = time_stamp;
 		path = mail_queue_path((VSTRING *) 0, src_queue, queue_id);
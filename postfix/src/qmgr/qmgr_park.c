@@ -0,0 +1,373 @@
+/*++
+/* NAME
+/*	qmgr_park 3
+/* SUMMARY
+/*	dead destination parking
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_park_note(message, queue)
+/*	QMGR_MESSAGE *message;
+/*	QMGR_QUEUE *queue;
+/*
+/*	void	qmgr_park_spoil(message)
+/*	QMGR_MESSAGE *message;
+/*
+/*	void	qmgr_park_enter(message, retry_time)
+/*	QMGR_MESSAGE *message;
+/*	time_t	retry_time;
+/*
+/*	int	qmgr_park_skip(queue_id, when)
+/*	const char *queue_id;
+/*	time_t	*when;
+/*
+/*	void	qmgr_park_release(queue)
+/*	QMGR_QUEUE *queue;
+/*
+/*	void	qmgr_park_flush()
+/* DESCRIPTION
+/*	This module remembers deferred messages whose only deferred
+/*	recipients were deferred because their destination is dead,
+/*	so that deferred queue scans can skip those messages without
+/*	reading them, until a delivery to that destination succeeds.
+/*	One message per minimal_backoff_time interval is let through
+/*	as a probe. The information is kept in memory only.
+/*
+/*	qmgr_park_note() records that recipients of the named message
+/*	were deferred because the named destination queue is dead.
+/*	A message that has deferrals for more than one destination
+/*	is not parked.
+/*
+/*	qmgr_park_spoil() records that recipients of the named
+/*	message were deferred for some other reason. Such a message
+/*	is not parked.
+/*
+/*	qmgr_park_enter() parks the named message as it is moved to
+/*	the deferred queue with the specified next delivery attempt
+/*	time, provided that all its deferrals were for the same dead
+/*	destination, and that the qmgr_dead_destination_parking
+/*	feature is enabled. A message is not parked when it is due
+/*	for a delay warning or for expiration before its next delivery
+/*	attempt.
+/*
+/*	qmgr_park_skip() decides whether a deferred queue scan should
+/*	skip the named queue file. The result is non-zero when the
+/*	file should be skipped, with the time when the file should be
+/*	looked at again. A parked message is let through (and forgotten)
+/*	when it is due for a delay warning or expiration, or when it
+/*	is the first due message after the destination's probe interval
+/*	has passed.
+/*
+/*	qmgr_park_release() forgets all messages that are parked for
+/*	the named destination, after a successful delivery.
+/*
+/*	qmgr_park_flush() forgets all parked messages, as with "postqueue
+/*	-f".
+/*
+/*	Once per minimal_backoff_time interval, parked messages are
+/*	forgotten when their queue file no longer exists in the
+/*	deferred queue, for example after "postsuper -d" or "postsuper
+/*	-h". A destination is forgotten when it has no parked messages.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <htable.h>
+#include <ring.h>
+#include <vstring.h>
+#include <events.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_queue.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+ /*
+  * A parked destination, with the messages that wait for it, and the time
+  * when the next probe message may be let through.
+  */
+typedef struct QMGR_PARK_DEST {
+    char   *name;			/* transport:queue */
+    RING    messages;			/* parked messages */
+    time_t  probe_time;			/* next probe */
+} QMGR_PARK_DEST;
+
+typedef struct QMGR_PARK_MSG {
+    RING    ring;			/* destination linkage, must be first */
+    char   *queue_id;			/* deferred queue file */
+    QMGR_PARK_DEST *dest;		/* what it waits for */
+    time_t  retry_time;			/* queue file time stamp */
+    time_t  look_time;			/* delay warning or expiration */
+} QMGR_PARK_MSG;
+
+#define RING_TO_PARK_MSG(r)	((QMGR_PARK_MSG *) (r))
+
+static HTABLE *qmgr_park_dests;		/* destinations, by name */
+static HTABLE *qmgr_park_msgs;		/* messages, by queue ID */
+
+/* qmgr_park_name - destination lookup key */
+
+static const char *qmgr_park_name(QMGR_QUEUE *queue)
+{
+    static VSTRING *buf;
+
+    if (buf == 0)
+	buf = vstring_alloc(100);
+    vstring_sprintf(buf, "%s:%s", queue->transport->name, queue->name);
+    return (vstring_str(buf));
+}
+
+/* qmgr_park_msg_free - forget one parked message */
+
+static void qmgr_park_msg_free(void *ptr)
+{
+    QMGR_PARK_MSG *park = (QMGR_PARK_MSG *) ptr;
+
+    ring_detach(&park->ring);
+    myfree(park->queue_id);
+    myfree((void *) park);
+}
+
+/* qmgr_park_dest_free - forget destination and its messages */
+
+static void qmgr_park_dest_free(void *ptr)
+{
+    QMGR_PARK_DEST *dest = (QMGR_PARK_DEST *) ptr;
+    QMGR_PARK_MSG *park;
+    time_t  now = event_time();
+
+    /*
+     * The messages are now subject to their own retry times. Make sure that
+     * time-ordered deferred queue scans visit them.
+     */
+    while (ring_succ(&dest->messages) != &dest->messages) {
+	park = RING_TO_PARK_MSG(ring_succ(&dest->messages));
+	qmgr_scan_schedule(MAIL_QUEUE_DEFERRED, park->queue_id,
+			   park->retry_time > now ? park->retry_time : now);
+	htable_delete(qmgr_park_msgs, park->queue_id, qmgr_park_msg_free);
+    }
+    myfree(dest->name);
+    myfree((void *) dest);
+}
+
+/* qmgr_park_forget - forget one message, and its destination if unused */
+
+static void qmgr_park_forget(QMGR_PARK_MSG *park)
+{
+    QMGR_PARK_DEST *dest = park->dest;
+
+    htable_delete(qmgr_park_msgs, park->queue_id, qmgr_park_msg_free);
+    if (ring_succ(&dest->messages) == &dest->messages)
+	htable_delete(qmgr_park_dests, dest->name, qmgr_park_dest_free);
+}
+
+/* qmgr_park_sweep - forget messages whose queue file went away */
+
+static void qmgr_park_sweep(int unused_event, void *unused_context)
+{
+    static VSTRING *path;
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    struct stat st;
+
+    if (qmgr_park_msgs == 0 || qmgr_park_msgs->used == 0)
+	return;
+    if (path == 0)
+	path = vstring_alloc(100);
+
+    /*
+     * A parked queue file is not read until it is let through, so deleted or
+     * held files would be remembered forever. A stat() call per parked file
+     * per minimal backoff time is cheap compared to reading the file.
+     */
+    list = htable_list(qmgr_park_msgs);
+    for (ht = list; *ht; ht++) {
+	if (stat(mail_queue_path(path, MAIL_QUEUE_DEFERRED, ht[0]->key),
+		 &st) < 0 && errno == ENOENT) {
+	    if (msg_verbose)
+		msg_info("qmgr_park_sweep: %s is gone", ht[0]->key);
+	    qmgr_park_forget((QMGR_PARK_MSG *) ht[0]->value);
+	}
+    }
+    myfree((void *) list);
+    if (qmgr_park_msgs->used > 0)
+	event_request_timer(qmgr_park_sweep, (void *) 0, var_min_backoff_time);
+}
+
+/* qmgr_park_note - deferral because of dead destination */
+
+void    qmgr_park_note(QMGR_MESSAGE *message, QMGR_QUEUE *queue)
+{
+    const char *name;
+
+    if (message->park_ok == 0)
+	return;
+    name = qmgr_park_name(queue);
+    if (message->park_dest == 0) {
+	message->park_dest = mystrdup(name);
+    } else if (strcmp(message->park_dest, name) != 0) {
+	qmgr_park_spoil(message);
+    }
+}
+
+/* qmgr_park_spoil - deferral for other reason */
+
+void    qmgr_park_spoil(QMGR_MESSAGE *message)
+{
+    message->park_ok = 0;
+    if (message->park_dest) {
+	myfree(message->park_dest);
+	message->park_dest = 0;
+    }
+}
+
+/* qmgr_park_enter - park deferred message */
+
+void    qmgr_park_enter(QMGR_MESSAGE *message, time_t retry_time)
+{
+    QMGR_PARK_DEST *dest;
+    QMGR_PARK_MSG *park;
+    time_t  look_time;
+    time_t  now = event_time();
+
+    if (var_qmgr_park_dead == 0 || message->park_ok == 0
+	|| message->park_dest == 0)
+	return;
+
+    /*
+     * Don't park a message that needs attention before it would be read
+     * anyway.
+     */
+    look_time = message->create_time
+	+ (*message->sender ? var_max_queue_time : var_dsn_queue_time);
+    if (message->warn_time > 0 && message->warn_time < look_time)
+	look_time = message->warn_time;
+    if (message->create_time <= 0 || look_time <= retry_time)
+	return;
+
+    if (qmgr_park_dests == 0) {
+	qmgr_park_dests = htable_create(0);
+	qmgr_park_msgs = htable_create(0);
+    }
+    if ((dest = (QMGR_PARK_DEST *)
+	 htable_find(qmgr_park_dests, message->park_dest)) == 0) {
+	dest = (QMGR_PARK_DEST *) mymalloc(sizeof(*dest));
+	dest->name = mystrdup(message->park_dest);
+	ring_init(&dest->messages);
+	dest->probe_time = 0;
+	htable_enter(qmgr_park_dests, dest->name, (void *) dest);
+    }
+
+    /*
+     * Like the in-core dead queue, let the next probe through after the
+     * minimal backoff time.
+     */
+    if (dest->probe_time <= now)
+	dest->probe_time = now + var_min_backoff_time;
+    if ((park = (QMGR_PARK_MSG *)
+	 htable_find(qmgr_park_msgs, message->queue_id)) != 0) {
+	ring_detach(&park->ring);
+	if (park->dest != dest
+	    && ring_succ(&park->dest->messages) == &park->dest->messages)
+	    htable_delete(qmgr_park_dests, park->dest->name,
+			  qmgr_park_dest_free);
+    } else {
+	park = (QMGR_PARK_MSG *) mymalloc(sizeof(*park));
+	park->queue_id = mystrdup(message->queue_id);
+	htable_enter(qmgr_park_msgs, park->queue_id, (void *) park);
+	if (qmgr_park_msgs->used == 1)
+	    event_request_timer(qmgr_park_sweep, (void *) 0,
+				var_min_backoff_time);
+    }
+    park->dest = dest;
+    park->retry_time = retry_time;
+    park->look_time = look_time;
+    ring_append(&dest->messages, &park->ring);
+    if (msg_verbose)
+	msg_info("qmgr_park_enter: %s waits for %s",
+		 message->queue_id, dest->name);
+}
+
+/* qmgr_park_skip - skip parked deferred queue file */
+
+int     qmgr_park_skip(const char *queue_id, time_t *when)
+{
+    QMGR_PARK_MSG *park;
+    time_t  now;
+
+    if (qmgr_park_msgs == 0 || qmgr_park_msgs->used == 0
+	|| (park = (QMGR_PARK_MSG *) htable_find(qmgr_park_msgs,
+						 queue_id)) == 0)
+	return (0);
+
+    /*
+     * A message that is not yet due is handled as usual.
+     */
+    now = time((time_t *) 0);
+    if (now < park->retry_time)
+	return (0);
+
+    /*
+     * Skip the message while its destination is dead.
+     */
+    if (now < park->look_time && now < park->dest->probe_time) {
+	*when = (park->look_time < park->dest->probe_time ?
+		 park->look_time : park->dest->probe_time);
+	if (msg_verbose)
+	    msg_info("qmgr_park_skip: %s waits for %s",
+		     queue_id, park->dest->name);
+	return (1);
+    }
+
+    /*
+     * Let this message through as a delay warning, expiration, or probe.
+     */
+    if (now >= park->dest->probe_time)
+	park->dest->probe_time = now + var_min_backoff_time;
+    qmgr_park_forget(park);
+    return (0);
+}
+
+/* qmgr_park_release - destination is alive */
+
+void    qmgr_park_release(QMGR_QUEUE *queue)
+{
+    const char *name;
+
+    if (qmgr_park_dests == 0 || qmgr_park_dests->used == 0)
+	return;
+    name = qmgr_park_name(queue);
+    if (htable_locate(qmgr_park_dests, name) != 0) {
+	if (msg_verbose)
+	    msg_info("qmgr_park_release: %s", name);
+	htable_delete(qmgr_park_dests, name, qmgr_park_dest_free);
+    }
+}
+
+/* qmgr_park_flush - forget all parked messages */
+
+void    qmgr_park_flush(void)
+{
+    if (qmgr_park_dests == 0 || qmgr_park_dests->used == 0)
+	return;
+    htable_free(qmgr_park_dests, qmgr_park_dest_free);
+    qmgr_park_dests = htable_create(0);
+}
@@ -47,7 +47,11 @@
 /*
 /*	qmgr_peer_select() attempts to find a peer of named job that
 /*	has messages pending delivery.  This routine implements
-/*	round-robin search among job's peers.
+/*	round-robin search among job's peers. The search is limited
+/*	to peers with entries that are not yet selected for delivery;
+/*	qmgr_entry(3) keeps only those on the job's peer list, so
+/*	that destinations that are waiting for delivery agents to
+/*	finish do not slow down the search.
 /* DIAGNOSTICS
 /*	Panic: consistency check failure.
 /* LICENSE
@@ -82,7 +86,7 @@ QMGR_PEER *qmgr_peer_create(QMGR_JOB *job, QMGR_QUEUE *queue)
     peer = (QMGR_PEER *) mymalloc(sizeof(QMGR_PEER));
     peer->queue = queue;
     peer->job = job;
-    QMGR_LIST_APPEND(job->peer_list, peer, peers);
+    peer->peers.next = peer->peers.prev = 0;
     htable_enter(job->peer_byname, queue->name, (void *) peer);
     peer->refcount = 0;
     QMGR_LIST_INIT(peer->entry_list);
@@ -105,7 +109,6 @@ void    qmgr_peer_free(QMGR_PEER *peer)
     if (peer->entry_list.next != 0)
 	msg_panic("%s: entry list not empty: %s", myname, queue->name);
 
-    QMGR_LIST_UNLINK(job->peer_list, QMGR_PEER *, peer, peers);
     htable_delete(job->peer_byname, queue->name, (void (*) (void *)) 0);
     myfree((void *) peer);
 }
@@ -141,7 +144,7 @@ QMGR_PEER *qmgr_peer_select(QMGR_JOB *job)
      */
     for (peer = job->peer_list.next; peer; peer = peer->peers.next) {
 	queue = peer->queue;
-	if (queue->window > queue->busy_refcount && peer->entry_list.next != 0) {
+	if (queue->window > queue->busy_refcount) {
 	    QMGR_LIST_ROTATE(job->peer_list, peer, peers);
 	    if (msg_verbose)
 		msg_info("qmgr_peer_select: %s %s %s (%d of %d)",
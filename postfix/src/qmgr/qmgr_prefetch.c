@@ -0,0 +1,183 @@
+/*++
+/* NAME
+/*	qmgr_prefetch 3
+/* SUMMARY
+/*	DNS prefetch for new destinations
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_prefetch_init()
+/*
+/*	void	qmgr_prefetch(queue)
+/*	QMGR_QUEUE *queue;
+/* DESCRIPTION
+/*	This module looks up the DNS information for a new in-memory
+/*	destination queue in the background, while its first delivery
+/*	request waits for a delivery agent. The results are not used
+/*	by the queue manager; the purpose is that the Postfix SMTP
+/*	client finds the information in a local caching name server.
+/*
+/*	qmgr_prefetch_init() performs one-time initialization. Call
+/*	it before entering the chroot jail.
+/*
+/*	qmgr_prefetch() does nothing unless the queue's transport
+/*	is listed with the qmgr_dns_prefetch_transports parameter.
+/*	For a next-hop domain it looks up the MX records, and then
+/*	the addresses of the most-preferred MX hosts, or the addresses
+/*	of the domain itself when it has no MX records. For a
+/*	[host] or [host]:port next-hop destination it looks up
+/*	only the addresses of the host. The address types are
+/*	determined by the inet_protocols parameter. Numerical
+/*	addresses, lists of destinations and UNIX-domain pathnames
+/*	are skipped.
+/*
+/*	Queries are sent with dns_lookup_async(), so that the queue
+/*	manager never waits for DNS; a query that cannot be sent is
+/*	skipped.
+/* DIAGNOSTICS
+/*	With verbose logging, the prefetch queries and their status.
+/* SEE ALSO
+/*	dns_lookup(3), event-driven DNS lookup
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <valid_hostname.h>
+#include <host_port.h>
+#include <inet_proto.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <string_list.h>
+
+/* DNS library. */
+
+#include <dns.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+static STRING_LIST *qmgr_prefetch_xports;
+
+ /*
+  * Don't look up the addresses of every MX host of a large provider; the
+  * Postfix SMTP client tries the most-preferred hosts first.
+  */
+#define QMGR_PREFETCH_MX_LIMIT	3
+#define QMGR_PREFETCH_TIMEOUT	10
+
+/* qmgr_prefetch_done - ignore prefetch result */
+
+static void qmgr_prefetch_done(int status, DNS_RR *unused_list,
+			               void *context)
+{
+    if (msg_verbose)
+	msg_info("qmgr_prefetch_done: %s: status %d",
+		 (char *) context, status);
+    myfree((void *) context);
+}
+
+/* qmgr_prefetch_send - send one query */
+
+static void qmgr_prefetch_send(const char *name, unsigned type,
+			               DNS_ASYNC_FN callback)
+{
+    char   *context = mystrdup(name);
+
+    if (dns_lookup_async(name, type, 0, QMGR_PREFETCH_TIMEOUT,
+			 callback, (void *) context) < 0)
+	myfree(context);
+}
+
+/* qmgr_prefetch_addr - look up host addresses */
+
+static void qmgr_prefetch_addr(const char *host)
+{
+    const INET_PROTO_INFO *proto_info = inet_proto_info();
+    unsigned *type;
+
+    for (type = proto_info->dns_atype_list; *type; type++) {
+	if (msg_verbose)
+	    msg_info("qmgr_prefetch_addr: %s (%s)", host, dns_strtype(*type));
+	qmgr_prefetch_send(host, *type, qmgr_prefetch_done);
+    }
+}
+
+/* qmgr_prefetch_mx_done - look up MX host addresses */
+
+static void qmgr_prefetch_mx_done(int status, DNS_RR *list, void *context)
+{
+    char   *domain = (char *) context;
+    DNS_RR *rr;
+    int     count;
+    int     best_pref = -1;
+
+    if (msg_verbose)
+	msg_info("qmgr_prefetch_mx_done: %s: status %d", domain, status);
+    if (status == DNS_OK) {
+	for (rr = list; rr != 0; rr = rr->next)
+	    if (rr->type == T_MX && (best_pref < 0 || rr->pref < best_pref))
+		best_pref = rr->pref;
+	for (count = 0, rr = list; rr != 0 && count < QMGR_PREFETCH_MX_LIMIT;
+	     rr = rr->next) {
+	    if (rr->type == T_MX && rr->pref == best_pref
+		&& valid_hostname(rr->data, DONT_GRIPE)) {
+		qmgr_prefetch_addr(rr->data);
+		count++;
+	    }
+	}
+    } else if (status == DNS_NOTFOUND) {
+	qmgr_prefetch_addr(domain);
+    }
+    myfree(domain);
+}
+
+/* qmgr_prefetch - look up DNS information for new destination */
+
+void    qmgr_prefetch(QMGR_QUEUE *queue)
+{
+    char   *saved_nexthop;
+    char   *host;
+    char   *port;
+
+    if (qmgr_prefetch_xports == 0
+	|| !string_list_match(qmgr_prefetch_xports, queue->transport->name)
+	|| queue->nexthop[strcspn(queue->nexthop, ", \t/")] != 0)
+	return;
+
+    saved_nexthop = mystrdup(queue->nexthop);
+    if (host_port(saved_nexthop, &host, (char *) 0, &port, "0") == 0
+	&& valid_hostname(host, DONT_GRIPE)) {
+	if (*queue->nexthop == '[') {
+	    qmgr_prefetch_addr(host);
+	} else {
+	    if (msg_verbose)
+		msg_info("qmgr_prefetch: %s (MX)", host);
+	    qmgr_prefetch_send(host, T_MX, qmgr_prefetch_mx_done);
+	}
+    }
+    myfree(saved_nexthop);
+}
+
+/* qmgr_prefetch_init - one-time initialization */
+
+void    qmgr_prefetch_init(void)
+{
+    if (*var_qmgr_prefetch_xports)
+	qmgr_prefetch_xports =
+	    string_list_init(VAR_QMGR_PREFETCH_XPORTS, MATCH_FLAG_RETURN,
+			     var_qmgr_prefetch_xports);
+}
@@ -27,6 +27,11 @@
 /*	void	qmgr_queue_unthrottle(queue)
 /*	QMGR_QUEUE *queue;
 /*
+/*	void	qmgr_queue_mark_dead(queue, dsn, delay)
+/*	QMGR_QUEUE *queue;
+/*	DSN	*dsn;
+/*	int	delay;
+/*
 /*	void	qmgr_queue_suspend(queue, delay)
 /*	QMGR_QUEUE *queue;
 /*	int	delay;
@@ -44,11 +49,13 @@
 /*	concurrency limit as specified with the
 /*	\fIinitial_destination_concurrency\fR configuration parameter,
 /*	provided that it does not exceed the transport-specific
-/*	concurrency limit.
+/*	concurrency limit. qmgr_queue_create() also restores the
+/*	optional saved feedback state, and starts the optional DNS
+/*	prefetch for the destination.
 /*
 /*	qmgr_queue_done() disposes of a per-destination queue after all
-/*	its entries have been taken care of. It is an error to dispose
-/*	of a dead queue.
+/*	its entries have been taken care of, and remembers its optional
+/*	feedback state. It is an error to dispose of a dead queue.
 /*
 /*	qmgr_queue_find() looks up the named queue for the named
 /*	transport. A null result means that the queue was not found.
@@ -65,6 +72,11 @@
 /*	limit specified for the transport. This routine implements
 /*	"slow open" mode, and eliminates the "thundering herd" problem.
 /*
+/*	qmgr_queue_mark_dead() declares a new destination dead
+/*	without any delivery attempt, and starts a timer to re-enable
+/*	delivery after the specified delay. This is used to restore
+/*	saved feedback state.
+/*
 /*	qmgr_queue_suspend() suspends delivery for this destination
 /*	briefly. This function invalidates any scheduling decisions
 /*	that are based on the present queue's concurrency window.
@@ -217,6 +229,7 @@ void    qmgr_queue_unthrottle(QMGR_QUEUE *queue)
     const char *myname = "qmgr_queue_unthrottle";
     QMGR_TRANSPORT *transport = queue->transport;
     double  feedback;
+    double  backlog;
 
     if (msg_verbose)
 	msg_info("%s: queue %s", myname, queue->name);
@@ -251,10 +264,45 @@ void    qmgr_queue_unthrottle(QMGR_QUEUE *queue)
 	else
 	    queue->window = transport->init_dest_concurrency;
 	queue->success = queue->failure = 0;
+	queue->lat_avg = queue->lat_min = 0;
 	QMGR_LOG_WINDOW(queue);
 	return;
     }
 
+    /*
+     * With latency feedback, don't increase the destination's concurrency
+     * while deliveries are already waiting at the remote end, and decrease
+     * it when too many are waiting. A destination that accepts mail slowly
+     * does not deliver more mail per second with more connections. The
+     * decrease uses the negative feedback hysteresis, but unlike delivery
+     * failures it never counts towards declaring the destination dead.
+     */
+    if (transport->fbck_mode == QMGR_FEEDBACK_MODE_LATENCY) {
+	backlog = qmgr_feedback_backlog(queue);
+	if (var_conc_feedback_debug && !QMGR_ERROR_OR_RETRY_QUEUE(queue))
+	    msg_info("%s: queue %s: latency %g baseline %g backlog %g",
+		     myname, queue->name, queue->lat_avg, queue->lat_min,
+		     backlog);
+	if (backlog > QMGR_FEEDBACK_BACKLOG_HIGH) {
+	    feedback = QMGR_FEEDBACK_VAL(transport->neg_feedback, queue->window);
+	    QMGR_LOG_FEEDBACK(-feedback);
+	    queue->failure -= feedback;
+	    /* Prepare for overshoot (feedback > hysteresis, rounding error). */
+	    while (queue->failure - feedback / 2 < 0) {
+		queue->window -= transport->neg_feedback.hysteresis;
+		queue->success = 0;
+		queue->failure += transport->neg_feedback.hysteresis;
+	    }
+	    /* Prepare for overshoot. */
+	    if (queue->window < 1)
+		queue->window = 1;
+	}
+	if (backlog >= QMGR_FEEDBACK_BACKLOG_LOW) {
+	    QMGR_LOG_WINDOW(queue);
+	    return;
+	}
+    }
+
     /*
      * Increase the destination's concurrency limit until we reach the
      * transport's concurrency limit. Allow for a margin the size of the
@@ -358,13 +406,38 @@ void    qmgr_queue_throttle(QMGR_QUEUE *queue, DSN *dsn)
      */
     if (QMGR_QUEUE_THROTTLED(queue)) {
 	queue->dsn = DSN_COPY(dsn);
-	event_request_timer(qmgr_queue_unthrottle_wrapper,
-			    (void *) queue, var_min_backoff_time);
+	queue->retry_time = event_request_timer(qmgr_queue_unthrottle_wrapper,
+					 (void *) queue, var_min_backoff_time);
 	queue->dflags = 0;
     }
     QMGR_LOG_WINDOW(queue);
 }
 
+/* qmgr_queue_mark_dead - restore dead destination */
+
+void    qmgr_queue_mark_dead(QMGR_QUEUE *queue, DSN *dsn, int delay)
+{
+    const char *myname = "qmgr_queue_mark_dead";
+
+    /*
+     * Sanity checks.
+     */
+    if (!QMGR_QUEUE_READY(queue))
+	msg_panic("%s: bad queue status: %s", myname, QMGR_QUEUE_STATUS(queue));
+    if (queue->dsn)
+	msg_panic("%s: queue %s: spurious reason %s",
+		  myname, queue->name, queue->dsn->reason);
+    if (queue->busy_refcount != 0 || queue->todo_refcount != 0)
+	msg_panic("%s: queue %s: not empty", myname, queue->name);
+
+    queue->window = QMGR_QUEUE_STAT_THROTTLED;
+    queue->dsn = DSN_COPY(dsn);
+    queue->retry_time = event_request_timer(qmgr_queue_unthrottle_wrapper,
+					    (void *) queue, delay);
+    queue->dflags = 0;
+    QMGR_LOG_WINDOW(queue);
+}
+
 /* qmgr_queue_done - delete in-core queue for site */
 
 void    qmgr_queue_done(QMGR_QUEUE *queue)
@@ -390,6 +463,7 @@ void    qmgr_queue_done(QMGR_QUEUE *queue)
     /*
      * Clean up this in-core queue.
      */
+    qmgr_fbstate_save(queue);
     QMGR_LIST_UNLINK(transport->queue_list, QMGR_QUEUE *, queue, peers);
     htable_delete(transport->queue_byname, queue->name, (void (*) (void *)) 0);
     myfree(queue->name);
@@ -421,13 +495,18 @@ QMGR_QUEUE *qmgr_queue_create(QMGR_TRANSPORT *transport, const char *name,
     queue->transport = transport;
     queue->window = transport->init_dest_concurrency;
     queue->success = queue->failure = queue->fail_cohorts = 0;
+    queue->lat_avg = queue->lat_min = 0;
     QMGR_LIST_INIT(queue->todo);
     QMGR_LIST_INIT(queue->busy);
     queue->dsn = 0;
+    queue->retry_time = 0;
     queue->clog_time_to_warn = 0;
     queue->blocker_tag = 0;
+    queue->sort_rank = 0;
     QMGR_LIST_APPEND(transport->queue_list, queue, peers);
     htable_enter(transport->queue_byname, name, (void *) queue);
+    qmgr_fbstate_restore(queue);
+    qmgr_prefetch(queue);
     return (queue);
 }
 
@@ -12,6 +12,15 @@
 /*	char	*qmgr_scan_next(scan_info)
 /*	QMGR_SCAN *scan_info;
 /*
+/*	void	qmgr_scan_schedule(queue_name, queue_id, when)
+/*	const char *queue_name;
+/*	const char *queue_id;
+/*	time_t	when;
+/*
+/*	void	qmgr_scan_expedite(scan_info, queue_id)
+/*	QMGR_SCAN *scan_info;
+/*	const char *queue_id;
+/*
 /*	void	qmgr_scan_request(scan_info, flags)
 /*	QMGR_SCAN *scan_info;
 /*	int	flags;
@@ -28,6 +37,27 @@
 /*	automagically restarts a queue scan when a scan request had
 /*	arrived while the scan was in progress.
 /*
+/*	When time-ordered deferred queue scans are enabled with
+/*	qmgr_deferred_full_scan_interval, the deferred queue scan
+/*	context also remembers the queue IDs of messages that are
+/*	not yet due, bucketed by their next delivery attempt time.
+/*	A full directory scan then happens at most once per interval
+/*	(or when a scan request has the QMGR_SCAN_ALL flag); other
+/*	scans visit only messages whose bucket time has come. Messages
+/*	that enter the deferred queue without help from the queue
+/*	manager, for example with "postsuper -H", are found with
+/*	the next full scan.
+/*
+/*	qmgr_scan_schedule() remembers that the named queue file in
+/*	the named queue will be due at the specified time. This
+/*	request is ignored when the queue's scan context does not
+/*	support time-ordered scans.
+/*
+/*	qmgr_scan_expedite() arranges that qmgr_scan_next() returns
+/*	the named queue file before any other file, whether or not a
+/*	queue scan is in progress. When too many files are waiting,
+/*	it requests a queue scan instead.
+/*
 /*	qmgr_scan_request() records a request for the next queue scan. The
 /*	flags argument is the bit-wise OR of zero or more of the following,
 /*	unrecognized flags being ignored:
@@ -62,21 +92,86 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <string.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <mymalloc.h>
 #include <scan_dir.h>
+#include <argv.h>
+#include <binhash.h>
+#include <events.h>
 
 /* Global library. */
 
+#include <mail_params.h>
+#include <mail_queue.h>
 #include <mail_scan_dir.h>
 
 /* Application-specific. */
 
 #include "qmgr.h"
 
+ /*
+  * Scan contexts, so that qmgr_scan_schedule() can find them by queue name.
+  */
+static QMGR_SCAN *qmgr_scan_list;
+
+ /*
+  * Time-ordered scans put queue IDs into buckets. The bucket width is an
+  * engineering compromise between wakeup precision and the number of
+  * buckets. It does not need to be smaller than queue_run_delay.
+  */
+#define QMGR_SCAN_BUCKET_WIDTH	60
+#define QMGR_SCAN_BUCKET(t)	((long) (t) / QMGR_SCAN_BUCKET_WIDTH)
+
+ /*
+  * Upper bound on the number of queue files that wait for an expedited
+  * visit. Beyond this, a queue scan is cheaper than remembering names.
+  */
+#define QMGR_SCAN_EXPEDITE_LIMIT	1000
+
+/* qmgr_scan_bucket_free - destroy one time bucket */
+
+static void qmgr_scan_bucket_free(void *ptr)
+{
+    argv_free((ARGV *) ptr);
+}
+
+/* qmgr_scan_collect - collect queue IDs that are due */
+
+static ARGV *qmgr_scan_collect(QMGR_SCAN *scan_info)
+{
+    BINHASH_INFO **list;
+    BINHASH_INFO **ht;
+    ARGV   *due = argv_alloc(10);
+    ARGV   *bucket;
+    long    now_bucket = QMGR_SCAN_BUCKET(event_time());
+    long    bucket_key;
+    char  **cpp;
+
+    /*
+     * Move the IDs from past and present buckets into one list, and delete
+     * those buckets. Duplicates are harmless: qmgr_active_feed() skips IDs
+     * that are not found or not yet due.
+     */
+    list = binhash_list(scan_info->schedule);
+    for (ht = list; *ht; ht++) {
+	memcpy((void *) &bucket_key, ht[0]->key, sizeof(bucket_key));
+	if (bucket_key > now_bucket)
+	    continue;
+	bucket = (ARGV *) ht[0]->value;
+	for (cpp = bucket->argv; *cpp; cpp++)
+	    argv_add(due, *cpp, ARGV_END);
+	binhash_delete(scan_info->schedule, (void *) &bucket_key,
+		       sizeof(bucket_key), qmgr_scan_bucket_free);
+    }
+    myfree((void *) list);
+    argv_terminate(due);
+    return (due);
+}
+
 /* qmgr_scan_start - start queue scan */
 
 static void qmgr_scan_start(QMGR_SCAN *scan_info)
@@ -86,7 +181,7 @@ static void qmgr_scan_start(QMGR_SCAN *scan_info)
     /*
      * Sanity check.
      */
-    if (scan_info->handle)
+    if (QMGR_SCAN_BUSY(scan_info))
 	msg_panic("%s: %s queue scan in progress",
 		  myname, scan_info->queue);
 
@@ -104,7 +199,71 @@ static void qmgr_scan_start(QMGR_SCAN *scan_info)
      */
     scan_info->flags = scan_info->nflags;
     scan_info->nflags = 0;
-    scan_info->handle = scan_dir_open(scan_info->queue);
+
+    /*
+     * With time-ordered scans, visit only the messages that are due, unless
+     * it is time for a full directory scan. A full scan rebuilds the time
+     * buckets from scratch, as qmgr_active_feed() reports files that are not
+     * yet due.
+     */
+    if (scan_info->schedule != 0
+	&& (scan_info->flags & QMGR_SCAN_ALL) == 0
+	&& event_time() < scan_info->full_time + var_qmgr_full_scan_int) {
+	scan_info->due = qmgr_scan_collect(scan_info);
+	scan_info->due_pos = 0;
+	if (msg_verbose)
+	    msg_info("%s: %s queue: %ld scheduled files", myname,
+		     scan_info->queue, (long) scan_info->due->argc);
+    } else {
+	if (scan_info->schedule != 0) {
+	    binhash_free(scan_info->schedule, qmgr_scan_bucket_free);
+	    scan_info->schedule = binhash_create(0);
+	    scan_info->full_time = event_time();
+	}
+	scan_info->handle = scan_dir_open(scan_info->queue);
+    }
+}
+
+/* qmgr_scan_schedule - remember when a queue file will be due */
+
+void    qmgr_scan_schedule(const char *queue, const char *queue_id, time_t when)
+{
+    QMGR_SCAN *scan_info;
+    ARGV   *bucket;
+    long    bucket_key;
+
+    for (scan_info = qmgr_scan_list; scan_info; scan_info = scan_info->next)
+	if (strcmp(scan_info->queue, queue) == 0)
+	    break;
+    if (scan_info == 0 || scan_info->schedule == 0)
+	return;
+    bucket_key = QMGR_SCAN_BUCKET(when);
+    if ((bucket = (ARGV *) binhash_find(scan_info->schedule,
+					(void *) &bucket_key,
+					sizeof(bucket_key))) == 0) {
+	bucket = argv_alloc(10);
+	binhash_enter(scan_info->schedule, (void *) &bucket_key,
+		      sizeof(bucket_key), (void *) bucket);
+    }
+    argv_add(bucket, queue_id, ARGV_END);
+}
+
+/* qmgr_scan_expedite - visit named queue file first */
+
+void    qmgr_scan_expedite(QMGR_SCAN *scan_info, const char *queue_id)
+{
+    if (scan_info->expedite == 0) {
+	scan_info->expedite = argv_alloc(10);
+	scan_info->expedite_pos = 0;
+    }
+    if (scan_info->expedite->argc - scan_info->expedite_pos
+	>= QMGR_SCAN_EXPEDITE_LIMIT) {
+	qmgr_scan_request(scan_info, QMGR_SCAN_START);
+	return;
+    }
+    if (msg_verbose)
+	msg_info("expedite %s queue file %s", scan_info->queue, queue_id);
+    argv_add(scan_info->expedite, queue_id, ARGV_END);
 }
 
 /* qmgr_scan_request - request for future scan */
@@ -122,51 +281,78 @@ void    qmgr_scan_request(QMGR_SCAN *scan_info, int flags)
      * sometimes it also comes with QMGR_SCAN_ALL. It becomes a completely
      * different story when a flush request is encoded in file permissions.
      */
-    if (flags & QMGR_FLUSH_ONCE)
+    if (flags & QMGR_FLUSH_ONCE) {
 	qmgr_enable_all();
+	qmgr_park_flush();
+    }
 
     /*
      * Apply "ignore time stamp" requests also towards the scan that is
      * already in progress.
      */
-    if (scan_info->handle != 0 && (flags & QMGR_SCAN_ALL))
+    if (QMGR_SCAN_BUSY(scan_info) && (flags & QMGR_SCAN_ALL))
 	scan_info->flags |= QMGR_SCAN_ALL;
 
     /*
      * Apply "override defer_transports" requests also towards the scan that
      * is already in progress.
      */
-    if (scan_info->handle != 0 && (flags & QMGR_FLUSH_DFXP))
+    if (QMGR_SCAN_BUSY(scan_info) && (flags & QMGR_FLUSH_DFXP))
 	scan_info->flags |= QMGR_FLUSH_DFXP;
 
     /*
      * If a scan is in progress, just record the request.
      */
     scan_info->nflags |= flags;
-    if (scan_info->handle == 0 && (flags & QMGR_SCAN_START) != 0) {
+    if (!QMGR_SCAN_BUSY(scan_info) && (flags & QMGR_SCAN_START) != 0) {
 	scan_info->nflags &= ~QMGR_SCAN_START;
 	qmgr_scan_start(scan_info);
     }
 }
 
+/* qmgr_scan_due_next - next queue file from scheduled scan */
+
+static char *qmgr_scan_due_next(QMGR_SCAN *scan_info)
+{
+    if (scan_info->due_pos < scan_info->due->argc)
+	return (scan_info->due->argv[scan_info->due_pos++]);
+    return (0);
+}
+
 /* qmgr_scan_next - look for next queue file */
 
 char   *qmgr_scan_next(QMGR_SCAN *scan_info)
 {
     char   *path = 0;
 
+    /*
+     * Expedited queue files go first. They were named in a trigger request,
+     * and need no directory scan.
+     */
+    if (scan_info->expedite) {
+	if (scan_info->expedite_pos < scan_info->expedite->argc)
+	    return (scan_info->expedite->argv[scan_info->expedite_pos++]);
+	scan_info->expedite = argv_free(scan_info->expedite);
+    }
+
     /*
      * Restart the scan if we reach the end and a queue scan request has
      * arrived in the mean time.
      */
+    if (scan_info->due && (path = qmgr_scan_due_next(scan_info)) == 0) {
+	scan_info->due = argv_free(scan_info->due);
+	if (msg_verbose && (scan_info->nflags & QMGR_SCAN_START) == 0)
+	    msg_info("done %s queue scheduled scan", scan_info->queue);
+    }
     if (scan_info->handle && (path = mail_scan_dir_next(scan_info->handle)) == 0) {
 	scan_info->handle = scan_dir_close(scan_info->handle);
 	if (msg_verbose && (scan_info->nflags & QMGR_SCAN_START) == 0)
 	    msg_info("done %s queue scan", scan_info->queue);
     }
-    if (!scan_info->handle && (scan_info->nflags & QMGR_SCAN_START)) {
+    if (!QMGR_SCAN_BUSY(scan_info) && (scan_info->nflags & QMGR_SCAN_START)) {
 	qmgr_scan_start(scan_info);
-	path = mail_scan_dir_next(scan_info->handle);
+	path = (scan_info->due ? qmgr_scan_due_next(scan_info) :
+		mail_scan_dir_next(scan_info->handle));
     }
     return (path);
 }
@@ -181,5 +367,16 @@ QMGR_SCAN *qmgr_scan_create(const char *queue)
     scan_info->queue = mystrdup(queue);
     scan_info->flags = scan_info->nflags = 0;
     scan_info->handle = 0;
+    if (var_qmgr_full_scan_int > 0 && strcmp(queue, MAIL_QUEUE_DEFERRED) == 0)
+	scan_info->schedule = binhash_create(0);
+    else
+	scan_info->schedule = 0;
+    scan_info->due = 0;
+    scan_info->due_pos = 0;
+    scan_info->full_time = 0;
+    scan_info->expedite = 0;
+    scan_info->expedite_pos = 0;
+    scan_info->next = qmgr_scan_list;
+    qmgr_scan_list = scan_info;
     return (scan_info);
 }
@@ -0,0 +1,142 @@
+/*++
+/* NAME
+/*	qmgr_shard 3
+/* SUMMARY
+/*	queue manager sharding support
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_shard_init()
+/*
+/*	int	qmgr_shard_owned(queue_id)
+/*	const char *queue_id;
+/*
+/*	int	qmgr_shard_limit(limit)
+/*	int	limit;
+/*
+/*	void	qmgr_shard_trigger(buf, len)
+/*	const char *buf;
+/*	ssize_t	len;
+/* DESCRIPTION
+/*	This module allows multiple queue manager processes to
+/*	share the queue of one Postfix instance. Each process is
+/*	configured in master.cf with its own service name, the same
+/*	qmgr_shard_count value, and a different qmgr_shard_index
+/*	value. A process handles only mail whose queue ID hashes
+/*	to its own shard index, and it ignores other queue files.
+/*
+/*	There is no run-time coordination between shards. Per-destination
+/*	concurrency is coordinated statically instead: each shard
+/*	uses its share of the configured per-destination limits.
+/*
+/*	qmgr_shard_init() validates the sharding configuration.
+/*
+/*	qmgr_shard_owned() returns non-zero when the named queue
+/*	file belongs to this queue manager shard. The result is
+/*	always non-zero when sharding is turned off.
+/*
+/*	qmgr_shard_limit() returns this shard's share of the
+/*	specified per-destination limit. A zero (unlimited) limit
+/*	is returned unchanged, and the result is at least 1.
+/*
+/*	qmgr_shard_trigger() forwards a trigger request to the
+/*	queue manager services listed with qmgr_shard_trigger_services.
+/*	Postfix programs send their requests to the queue manager
+/*	service named with the queue_service_name parameter, and
+/*	that process must pass them on to the other shards.
+/* DIAGNOSTICS
+/*	Fatal errors: invalid sharding configuration.
+/*	Warnings: trigger forwarding errors.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <argv.h>
+#include <stringops.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_proto.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+static ARGV *qmgr_shard_services;
+
+/* qmgr_shard_hash - hash queue ID */
+
+static unsigned qmgr_shard_hash(const char *queue_id)
+{
+    unsigned long h = 2166136261UL;
+
+    /*
+     * All shards must compute the same hash for the same queue ID, so we
+     * can't use the seeded hash_fnv(3) functions. This is FNV-1a.
+     */
+    while (*queue_id) {
+	h ^= (unsigned char) *queue_id++;
+	h = (h * 16777619UL) & 0xffffffffUL;
+    }
+    return (h);
+}
+
+/* qmgr_shard_init - validate sharding configuration */
+
+void    qmgr_shard_init(void)
+{
+    if (var_qmgr_shard_index >= var_qmgr_shard_count)
+	msg_fatal("%s value %d must be less than %s value %d",
+		  VAR_QMGR_SHARD_INDEX, var_qmgr_shard_index,
+		  VAR_QMGR_SHARD_COUNT, var_qmgr_shard_count);
+    if (*var_qmgr_shard_triggers)
+	qmgr_shard_services = argv_split(var_qmgr_shard_triggers,
+					 CHARS_COMMA_SP);
+    if (var_qmgr_shard_count > 1 && msg_verbose)
+	msg_info("queue manager shard %d of %d",
+		 var_qmgr_shard_index, var_qmgr_shard_count);
+}
+
+/* qmgr_shard_owned - does this queue file belong to us */
+
+int     qmgr_shard_owned(const char *queue_id)
+{
+    if (var_qmgr_shard_count <= 1)
+	return (1);
+    return (qmgr_shard_hash(queue_id) % var_qmgr_shard_count
+	    == var_qmgr_shard_index);
+}
+
+/* qmgr_shard_limit - our share of a per-destination limit */
+
+int     qmgr_shard_limit(int limit)
+{
+    if (var_qmgr_shard_count <= 1 || limit == 0)
+	return (limit);
+    limit /= var_qmgr_shard_count;
+    return (limit > 0 ? limit : 1);
+}
+
+/* qmgr_shard_trigger - pass a trigger request on to the other shards */
+
+void    qmgr_shard_trigger(const char *buf, ssize_t len)
+{
+    char  **cpp;
+
+    if (qmgr_shard_services == 0)
+	return;
+    for (cpp = qmgr_shard_services->argv; *cpp; cpp++)
+	if (mail_trigger(MAIL_CLASS_PUBLIC, *cpp, buf, len) < 0)
+	    msg_warn("unable to forward request to service %s: %m", *cpp);
+}
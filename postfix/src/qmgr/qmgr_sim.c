@@ -0,0 +1,1301 @@
+/*++
+/* NAME
+/*	qmgr_sim 1
+/* SUMMARY
+/*	queue manager scheduler simulator
+/* SYNOPSIS
+/*	\fBqmgr_sim\fR [\fB-v\fR] [\fB-c \fIconfig_dir\fR]
+/*	[\fB-m \fImodel_file\fR] [\fB-o \fIname=value\fR]
+/*	[\fB-p \fIprocess_limit\fR] [\fB-s \fIseed\fR] [\fItrace_file\fR]
+/* DESCRIPTION
+/*	qmgr_sim replays a message arrival trace through the
+/*	scheduling code of the qmgr(8) queue manager, against a
+/*	synthetic model of delivery agents and destinations, in
+/*	simulated time. It reports the delivery throughput, the
+/*	message latency per PRIORITY class, and per-destination
+/*	statistics.
+/*
+/*	The program links the unmodified qmgr_transport, qmgr_queue,
+/*	qmgr_entry, qmgr_job, qmgr_peer and qmgr_feedback modules,
+/*	so that changes to job preemption, concurrency feedback or
+/*	rate delays, and changes to main.cf settings, can be compared
+/*	without production traffic. Queue file access, address
+/*	resolution, delivery agent communication and the event loop
+/*	are replaced by the simulation. The program is built with
+/*	"make qmgr_sim" and is not installed.
+/*
+/*	Options:
+/* .IP "\fB-c \fIconfig_dir\fR"
+/*	Read main.cf settings from the specified configuration
+/*	directory instead of using built-in defaults. The qmgr(8)
+/*	scheduler parameters and their transport-specific overrides
+/*	are used; other settings are ignored.
+/* .IP "\fB-m \fImodel_file\fR"
+/*	Read the delivery agent and destination model from the
+/*	specified file (see MODEL FORMAT below). By default, every
+/*	destination completes every delivery in one second.
+/* .IP "\fB-o \fIname=value\fR"
+/*	Override a main.cf parameter setting. This option may be
+/*	specified multiple times.
+/* .IP "\fB-p \fIprocess_limit\fR"
+/*	The default number of delivery agent processes per transport
+/*	(default: 100).
+/* .IP "\fB-s \fIseed\fR"
+/*	Seed for the random failure model (default: 1).
+/* .IP \fB-v\fR
+/*	Enable verbose logging. Specify multiple times for more detail.
+/* TRACE FORMAT
+/* .ad
+/* .fi
+/*	The trace is read from the named file or from standard
+/*	input. Each line describes one message:
+/* .sp
+/* .nf
+/*	    \fItime class transport destination\fR ...
+/* .fi
+/* .sp
+/*	The arrival \fItime\fR is in seconds (fractions allowed);
+/*	lines must be in time order, and the first arrival is the
+/*	start of the simulation. The \fIclass\fR is a PRIORITY class
+/*	(\fBlow\fR, \fBnormal\fR or \fBhigh\fR). Each \fIdestination\fR
+/*	is a next-hop name, optionally followed by \fB*\fIcount\fR
+/*	to specify \fIcount\fR recipients for that next hop (default:
+/*	one). Empty lines and lines starting with "#" are ignored.
+/*
+/*	A trace can be derived from a Postfix logfile: the qmgr(8)
+/*	"from=<\fIsender\fR>, size=\fIsize\fR, nrcpt=\fIcount\fR
+/*	(queue active)" record gives the arrival time of a queue
+/*	ID, and the delivery agent "to=<\fIrecipient\fR>,
+/*	relay=\fIhost\fR" records with the same queue ID give the
+/*	transport and the next-hop domains.
+/* MODEL FORMAT
+/* .ad
+/* .fi
+/*	Each model file line has the form:
+/* .sp
+/* .nf
+/*	    \fBdestination \fIname attribute=value\fR ...
+/*	    \fBtransport \fIname attribute=value\fR ...
+/* .fi
+/* .sp
+/*	The destination name "*" specifies the defaults for next
+/*	hops that are not listed. Destination attributes:
+/* .IP "\fBlatency\fR (default: 1)"
+/*	The time in seconds to complete one delivery request.
+/* .IP "\fBrcpt_time\fR (default: 0)"
+/*	The additional time in seconds per recipient in a request.
+/* .IP "\fBcapacity\fR (default: 0, unlimited)"
+/*	The number of concurrent deliveries that the destination
+/*	handles without slowing down. With more concurrent
+/*	deliveries, each delivery takes proportionally longer.
+/* .IP "\fBlimit\fR (default: 0, unlimited)"
+/*	The maximal number of concurrent deliveries. A delivery
+/*	in excess of the limit fails with a temporary site error
+/*	after the base latency, like a server that replies "421
+/*	too many connections".
+/* .IP "\fBfail\fR (default: 0)"
+/*	The probability that a delivery fails with a temporary
+/*	site error after the base latency.
+/* .PP
+/*	Transport attributes:
+/* .IP "\fBprocess_limit\fR (default: see the \fB-p\fR option)"
+/*	The maximal number of delivery agent processes for the
+/*	transport, as with the master.cf process limit.
+/* .PP
+/*	The simulator does not retry deferred mail; a message with
+/*	at least one deferred recipient is reported as deferred
+/*	and is excluded from the latency statistics.
+/* DIAGNOSTICS
+/*	Problems are reported to the standard error stream. The
+/*	report is written to the standard output stream.
+/* SEE ALSO
+/*	qmgr(8), queue manager
+/*	SCHEDULER_README, scheduling algorithm
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <msg_vstream.h>
+#include <mymalloc.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <vstring_vstream.h>
+#include <argv.h>
+#include <htable.h>
+#include <events.h>
+#include <myrand.h>
+#include <stringops.h>
+#include <split_at.h>
+#include <sane_time.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_conf.h>
+#include <mail_priority.h>
+#include <recipient_list.h>
+#include <qmgr_user.h>
+#include <dsn.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+ /*
+  * Tunables, as in qmgr.c.
+  */
+int     var_min_backoff_time;
+int     var_qmgr_active_limit;
+int     var_qmgr_rcpt_limit;
+int     var_qmgr_msg_rcpt_limit;
+int     var_xport_rcpt_limit;
+int     var_stack_rcpt_limit;
+int     var_xport_refill_limit;
+int     var_xport_refill_delay;
+int     var_delivery_slot_cost;
+int     var_delivery_slot_loan;
+int     var_delivery_slot_discount;
+int     var_min_delivery_slots;
+int     var_init_dest_concurrency;
+int     var_transport_retry_time;
+int     var_dest_con_limit;
+int     var_dest_rcpt_limit;
+int     var_local_con_lim;
+int     var_local_rcpt_lim;
+int     var_qmgr_clog_warn_time;
+char   *var_conc_pos_feedback;
+char   *var_conc_neg_feedback;
+char   *var_conc_fdback_mode;
+int     var_conc_cohort_limit;
+int     var_conc_feedback_debug;
+int     var_xport_rate_delay;
+int     var_dest_rate_delay;
+int     var_qmgr_shard_count;
+long    var_qmgr_memory_limit;
+int     var_qmgr_prio_offset;
+
+ /*
+  * Globals that qmgr_message.c would provide.
+  */
+int     qmgr_message_count;
+int     qmgr_recipient_count;
+long    qmgr_memory_used;
+
+ /*
+  * Simulated time. The first arrival is at SIM_EPOCH, so that time stamps
+  * look like those of a real queue manager.
+  */
+#define SIM_EPOCH	1000000000.0
+
+static double sim_now = SIM_EPOCH;
+static double sim_last_done = SIM_EPOCH;
+
+ /*
+  * Timer requests, in time order. Timers with the same time run in the
+  * order that they were requested, as with the event(3) library.
+  */
+typedef struct SIM_TIMER {
+    double  when;			/* expiration time */
+    EVENT_NOTIFY_TIME_FN callback;	/* callback function */
+    void   *context;			/* callback context */
+    struct SIM_TIMER *next;		/* linkage */
+} SIM_TIMER;
+
+static SIM_TIMER *sim_timer_list;
+
+ /*
+  * Destination model and per-destination statistics.
+  */
+typedef struct SIM_DEST {
+    char   *name;			/* next-hop name */
+    double  latency;			/* time per delivery request */
+    double  rcpt_time;			/* time per recipient */
+    int     capacity;			/* concurrency without slowdown */
+    int     limit;			/* concurrency before rejection */
+    double  fail;			/* site failure probability */
+    int     busy;			/* concurrent deliveries */
+    int     max_busy;			/* peak concurrent deliveries */
+    int     max_window;			/* peak concurrency window */
+    long    requests;			/* delivery requests */
+    long    failures;			/* failed delivery requests */
+} SIM_DEST;
+
+static HTABLE *sim_dest_table;
+static SIM_DEST sim_dest_default = {"*", 1.0, 0.0, 0, 0, 0.0};
+
+ /*
+  * Delivery agent model.
+  */
+typedef struct SIM_XPORT {
+    int     process_limit;		/* master.cf process limit */
+    int     busy;			/* processes in use */
+    int     waiting;			/* connections waiting for process */
+} SIM_XPORT;
+
+static HTABLE *sim_xport_table;
+static int sim_process_limit = 100;
+
+typedef struct SIM_ALLOC {
+    QMGR_TRANSPORT *transport;
+} SIM_ALLOC;
+
+ /*
+  * One delivery request in progress.
+  */
+typedef struct SIM_DELIVERY {
+    QMGR_ENTRY *entry;			/* queue entry */
+    SIM_DEST *dest;			/* destination model */
+    double  start;			/* delivery request time */
+    const char *reason;			/* site failure, or null */
+} SIM_DELIVERY;
+
+#define SIM_REASON_FAIL		"simulated site failure"
+#define SIM_REASON_LIMIT	"simulated concurrency limit"
+#define SUSPENDED		"delivery temporarily suspended: "
+#define DELIVER_STAT_DEFER	1	/* as in qmgr_deliver.c */
+
+ /*
+  * In-core message. The simulator-specific information follows the queue
+  * manager's message structure.
+  */
+typedef struct SIM_MESSAGE {
+    QMGR_MESSAGE message;		/* must be first */
+    double  arrival;			/* arrival time */
+    char   *transport;			/* transport name */
+    ARGV   *dests;			/* next hops */
+    int    *counts;			/* recipients per next hop */
+    int     dest_pos;			/* next unread next hop */
+    int     dest_done;			/* recipients read for that hop */
+    int     delivered;			/* delivered recipients */
+    int     deferred;			/* deferred recipients */
+    struct SIM_MESSAGE *next;		/* incoming queue linkage */
+} SIM_MESSAGE;
+
+#define SIM_MSG(m)	((SIM_MESSAGE *) (m))
+
+static SIM_MESSAGE *sim_incoming_head;
+static SIM_MESSAGE *sim_incoming_tail;
+static int sim_incoming_count;
+
+ /*
+  * Trace input with one line of look-ahead.
+  */
+static VSTREAM *sim_trace;
+static VSTRING *sim_trace_buf;
+static const char *sim_trace_name;
+static int sim_trace_lineno;
+static SIM_MESSAGE *sim_trace_next;
+static double sim_trace_start = -1;
+static double sim_trace_last;
+static long sim_msg_seqno;
+
+ /*
+  * Statistics per PRIORITY class.
+  */
+typedef struct SIM_CLASS {
+    double *latency;			/* per completed message */
+    int     len;			/* latency samples */
+    int     size;			/* latency array size */
+    int     deferred;			/* messages with deferred rcpts */
+} SIM_CLASS;
+
+static SIM_CLASS sim_class[MAIL_PRIORITY_HIGH + 1];
+static long sim_rcpt_delivered;
+static long sim_rcpt_deferred;
+static long sim_msg_done;
+
+/* event_time - simulated time */
+
+time_t  event_time(void)
+{
+    return ((time_t) sim_now);
+}
+
+/* sane_time - simulated time */
+
+time_t  sane_time(void)
+{
+    return ((time_t) sim_now);
+}
+
+/* sim_timer_enter - schedule timer at absolute time */
+
+static void sim_timer_enter(double when, EVENT_NOTIFY_TIME_FN callback,
+			            void *context)
+{
+    SIM_TIMER *timer;
+    SIM_TIMER **tpp;
+
+    (void) event_cancel_timer(callback, context);
+    timer = (SIM_TIMER *) mymalloc(sizeof(*timer));
+    timer->when = when;
+    timer->callback = callback;
+    timer->context = context;
+    for (tpp = &sim_timer_list; *tpp && (*tpp)->when <= when; tpp = &(*tpp)->next)
+	 /* void */ ;
+    timer->next = *tpp;
+    *tpp = timer;
+}
+
+/* event_request_timer - schedule timer in simulated time */
+
+time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context,
+			            int delay)
+{
+    if (delay < 0)
+	msg_panic("event_request_timer: invalid delay: %d", delay);
+    sim_timer_enter(sim_now + delay, callback, context);
+    return ((time_t) (sim_now + delay));
+}
+
+/* event_cancel_timer - cancel timer */
+
+int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
+{
+    SIM_TIMER *timer;
+    SIM_TIMER **tpp;
+    int     time_left = -1;
+
+    for (tpp = &sim_timer_list; (timer = *tpp) != 0; tpp = &timer->next) {
+	if (timer->callback == callback && timer->context == context) {
+	    if ((time_left = timer->when - sim_now) < 0)
+		time_left = 0;
+	    *tpp = timer->next;
+	    myfree((void *) timer);
+	    break;
+	}
+    }
+    return (time_left);
+}
+
+/* event_enable_read - not used in simulation */
+
+void    event_enable_read(int unused_fd, EVENT_NOTIFY_RDWR_FN unused_callback,
+			          void *unused_context)
+{
+    msg_panic("event_enable_read: not available in simulation");
+}
+
+/* event_disable_readwrite - not used in simulation */
+
+void    event_disable_readwrite(int unused_fd)
+{
+    msg_panic("event_disable_readwrite: not available in simulation");
+}
+
+/* qmgr_fbstate_restore, qmgr_fbstate_save - no saved state in simulation */
+
+void    qmgr_fbstate_restore(QMGR_QUEUE *unused_queue)
+{
+}
+
+void    qmgr_fbstate_save(QMGR_QUEUE *unused_queue)
+{
+}
+
+/* qmgr_prefetch - no DNS in simulation */
+
+void    qmgr_prefetch(QMGR_QUEUE *unused_queue)
+{
+}
+
+/* qmgr_shard_limit - divide limit among shards, as in qmgr_shard.c */
+
+int     qmgr_shard_limit(int limit)
+{
+    if (var_qmgr_shard_count <= 1 || limit == 0)
+	return (limit);
+    limit /= var_qmgr_shard_count;
+    return (limit > 0 ? limit : 1);
+}
+
+/* sim_dest_find - look up or instantiate destination model */
+
+static SIM_DEST *sim_dest_find(const char *name)
+{
+    SIM_DEST *dest;
+    SIM_DEST *model;
+
+    if ((dest = (SIM_DEST *) htable_find(sim_dest_table, name)) == 0) {
+	if ((model = (SIM_DEST *) htable_find(sim_dest_table, "*")) == 0)
+	    model = &sim_dest_default;
+	dest = (SIM_DEST *) mymalloc(sizeof(*dest));
+	*dest = *model;
+	dest->name = mystrdup(name);
+	dest->busy = dest->max_busy = dest->max_window = 0;
+	dest->requests = dest->failures = 0;
+	htable_enter(sim_dest_table, name, (void *) dest);
+    }
+    return (dest);
+}
+
+/* sim_xport_find - look up or instantiate delivery agent model */
+
+static SIM_XPORT *sim_xport_find(const char *name)
+{
+    SIM_XPORT *xport;
+
+    if ((xport = (SIM_XPORT *) htable_find(sim_xport_table, name)) == 0) {
+	xport = (SIM_XPORT *) mymalloc(sizeof(*xport));
+	xport->process_limit = sim_process_limit;
+	xport->busy = xport->waiting = 0;
+	htable_enter(sim_xport_table, name, (void *) xport);
+    }
+    return (xport);
+}
+
+/* sim_parse_number - parse model or trace number */
+
+static double sim_parse_number(const char *file, int lineno,
+			               const char *name, const char *value)
+{
+    char   *end;
+    double  result;
+
+    result = strtod(value, &end);
+    if (*value == 0 || *end != 0 || result < 0)
+	msg_fatal("%s: line %d: bad %s value: \"%s\"",
+		  file, lineno, name, value);
+    return (result);
+}
+
+/* sim_model_read - read destination and transport model */
+
+static void sim_model_read(const char *path)
+{
+    VSTREAM *fp;
+    VSTRING *buf = vstring_alloc(100);
+    int     lineno = 0;
+    char   *cp;
+    char   *type;
+    char   *name;
+    char   *attr;
+    char   *attr_name;
+    char   *attr_value;
+    const char *err;
+    SIM_DEST *dest;
+    SIM_XPORT *xport;
+
+    if ((fp = vstream_fopen(path, O_RDONLY, 0)) == 0)
+	msg_fatal("open %s: %m", path);
+    while (vstring_get_nonl(buf, fp) != VSTREAM_EOF) {
+	lineno++;
+	cp = vstring_str(buf);
+	if ((type = mystrtok(&cp, CHARS_SPACE)) == 0 || *type == '#')
+	    continue;
+	if ((name = mystrtok(&cp, CHARS_SPACE)) == 0)
+	    msg_fatal("%s: line %d: missing name", path, lineno);
+	dest = 0;
+	xport = 0;
+	if (strcmp(type, "destination") == 0)
+	    dest = sim_dest_find(name);
+	else if (strcmp(type, "transport") == 0)
+	    xport = sim_xport_find(name);
+	else
+	    msg_fatal("%s: line %d: unknown type: \"%s\"", path, lineno, type);
+	while ((attr = mystrtok(&cp, CHARS_SPACE)) != 0) {
+	    if ((err = split_nameval(attr, &attr_name, &attr_value)) != 0)
+		msg_fatal("%s: line %d: %s: \"%s\"", path, lineno, err, attr);
+#define SIM_NUMBER() \
+	sim_parse_number(path, lineno, attr_name, attr_value)
+
+	    if (dest != 0 && strcmp(attr_name, "latency") == 0)
+		dest->latency = SIM_NUMBER();
+	    else if (dest != 0 && strcmp(attr_name, "rcpt_time") == 0)
+		dest->rcpt_time = SIM_NUMBER();
+	    else if (dest != 0 && strcmp(attr_name, "capacity") == 0)
+		dest->capacity = SIM_NUMBER();
+	    else if (dest != 0 && strcmp(attr_name, "limit") == 0)
+		dest->limit = SIM_NUMBER();
+	    else if (dest != 0 && strcmp(attr_name, "fail") == 0)
+		dest->fail = SIM_NUMBER();
+	    else if (xport != 0 && strcmp(attr_name, "process_limit") == 0)
+		xport->process_limit = SIM_NUMBER();
+	    else
+		msg_fatal("%s: line %d: unknown %s attribute: \"%s\"",
+			  path, lineno, type, attr_name);
+	}
+	if (xport != 0 && xport->process_limit < 1)
+	    msg_fatal("%s: line %d: bad process_limit value", path, lineno);
+    }
+    if (vstream_fclose(fp))
+	msg_fatal("read %s: %m", path);
+    vstring_free(buf);
+}
+
+/* sim_trace_read - read next message from trace */
+
+static SIM_MESSAGE *sim_trace_read(void)
+{
+    SIM_MESSAGE *sim;
+    QMGR_MESSAGE *message;
+    char   *cp;
+    char   *arrival;
+    char   *class;
+    char   *transport;
+    char   *dest;
+    char   *count;
+    int     priority;
+    int     ndest = 0;
+    int     nrcpt = 0;
+    double  when;
+    char    queue_id[32];
+
+    for (;;) {
+	if (vstring_get_nonl(sim_trace_buf, sim_trace) == VSTREAM_EOF)
+	    return (0);
+	sim_trace_lineno++;
+	cp = vstring_str(sim_trace_buf);
+	if ((arrival = mystrtok(&cp, CHARS_SPACE)) != 0 && *arrival != '#')
+	    break;
+    }
+    if ((class = mystrtok(&cp, CHARS_SPACE)) == 0
+	|| (transport = mystrtok(&cp, CHARS_SPACE)) == 0
+	|| *cp == 0)
+	msg_fatal("%s: line %d: expected \"time class transport destination...\"",
+		  sim_trace_name, sim_trace_lineno);
+    when = sim_parse_number(sim_trace_name, sim_trace_lineno, "time", arrival);
+    if (sim_trace_start < 0)
+	sim_trace_start = when;
+    when += SIM_EPOCH - sim_trace_start;
+    if (when < sim_trace_last)
+	msg_fatal("%s: line %d: time goes backwards",
+		  sim_trace_name, sim_trace_lineno);
+    sim_trace_last = when;
+    if ((priority = mail_priority_code(class)) == MAIL_PRIORITY_UNKNOWN)
+	msg_fatal("%s: line %d: unknown class: \"%s\"",
+		  sim_trace_name, sim_trace_lineno, class);
+
+    /*
+     * Initialize the in-core message as qmgr_message_create() would.
+     */
+    sim = (SIM_MESSAGE *) mymalloc(sizeof(*sim));
+    memset((void *) sim, 0, sizeof(*sim));
+    message = &sim->message;
+    sprintf(queue_id, "M%ld", ++sim_msg_seqno);
+    message->queue_id = mystrdup(queue_id);
+    message->queue_name = mystrdup("active");
+    message->rflags = QMGR_READ_FLAG_DEFAULT;
+    message->priority = priority;
+    QMGR_LIST_INIT(message->job_list);
+    sim->arrival = when;
+    sim->transport = mystrdup(transport);
+    sim->dests = argv_alloc(1);
+    while ((dest = mystrtok(&cp, CHARS_SPACE)) != 0) {
+	if ((count = split_at_right(dest, '*')) != 0) {
+	    nrcpt = sim_parse_number(sim_trace_name, sim_trace_lineno,
+				     "count", count);
+	    if (nrcpt < 1)
+		msg_fatal("%s: line %d: bad count: \"%s\"",
+			  sim_trace_name, sim_trace_lineno, count);
+	} else
+	    nrcpt = 1;
+	argv_add(sim->dests, dest, (char *) 0);
+	sim->counts = (int *) (ndest == 0 ? mymalloc(sizeof(int)) :
+			       myrealloc((void *) sim->counts,
+					 (ndest + 1) * sizeof(int)));
+	sim->counts[ndest++] = nrcpt;
+	message->rcpt_unread += nrcpt;
+    }
+    argv_terminate(sim->dests);
+    return (sim);
+}
+
+/* sim_trace_due - move arrived messages to the incoming queue */
+
+static void sim_trace_due(void)
+{
+    while (sim_trace_next != 0 && sim_trace_next->arrival <= sim_now) {
+	sim_trace_next->next = 0;
+	if (sim_incoming_tail)
+	    sim_incoming_tail->next = sim_trace_next;
+	else
+	    sim_incoming_head = sim_trace_next;
+	sim_incoming_tail = sim_trace_next;
+	sim_incoming_count++;
+	sim_trace_next = sim_trace_read();
+    }
+}
+
+/* sim_message_read - read recipients and assign them to queue entries */
+
+static void sim_message_read(QMGR_MESSAGE *message)
+{
+    SIM_MESSAGE *sim = SIM_MSG(message);
+    int     recipient_limit;
+    int     recipient_minimum;
+    int     count;
+    QMGR_TRANSPORT *transport;
+    QMGR_QUEUE *queue;
+    QMGR_JOB *job = 0;
+    QMGR_PEER *peer = 0;
+    QMGR_ENTRY *entry;
+    RECIPIENT *recipient;
+    long    rcpt_memory;
+    const char *nexthop;
+
+    /*
+     * Recipient limits, as in qmgr_message_read().
+     */
+    if (message->rcpt_offset) {
+	message->rcpt_offset = 0;
+	recipient_limit = message->rcpt_limit - message->rcpt_count;
+	recipient_minimum = recipient_limit;
+    } else {
+	recipient_limit = var_qmgr_rcpt_limit - qmgr_recipient_count;
+	if (recipient_limit < message->rcpt_limit)
+	    recipient_limit = message->rcpt_limit;
+	recipient_minimum = message->rcpt_limit;
+    }
+    if (recipient_limit > 5000)
+	recipient_limit = 5000;
+    if (recipient_minimum > recipient_limit)
+	recipient_minimum = recipient_limit;
+    if (recipient_limit <= 0)
+	msg_panic("%s: no recipient slots available", message->queue_id);
+
+    /*
+     * Resolve and assign recipients, as in qmgr_message_resolve() and
+     * qmgr_message_assign(). Recipients for the same next hop are adjacent
+     * in the trace, so they need no sorting.
+     */
+#define LIMIT_OK(limit, count) ((limit) == 0 || ((count) < (limit)))
+
+    if ((transport = qmgr_transport_find(sim->transport)) == 0)
+	transport = qmgr_transport_create(sim->transport);
+    for (count = 0; sim->dest_pos < sim->dests->argc; count++) {
+	if (count >= recipient_limit
+	    || (count >= recipient_minimum && !QMGR_MEMORY_OK())) {
+	    message->rcpt_offset = 1;
+	    break;
+	}
+	nexthop = sim->dests->argv[sim->dest_pos];
+	if (++sim->dest_done >= sim->counts[sim->dest_pos]) {
+	    sim->dest_pos++;
+	    sim->dest_done = 0;
+	}
+	message->rcpt_unread--;
+	if (QMGR_TRANSPORT_THROTTLED(transport)) {
+	    message->flags |= DELIVER_STAT_DEFER;
+	    sim->deferred++;
+	    continue;
+	}
+	if ((queue = qmgr_queue_find(transport, nexthop)) == 0)
+	    queue = qmgr_queue_create(transport, nexthop, nexthop);
+	if (QMGR_QUEUE_THROTTLED(queue)) {
+	    message->flags |= DELIVER_STAT_DEFER;
+	    sim->deferred++;
+	    continue;
+	}
+	if (job == 0)
+	    job = qmgr_job_obtain(message, transport);
+	if (peer == 0 || queue != peer->queue)
+	    peer = qmgr_peer_obtain(job, queue);
+	entry = peer->entry_list.prev;
+	if (message->single_rcpt || entry == 0
+	    || !LIMIT_OK(transport->recipient_limit, entry->rcpt_list.len))
+	    entry = qmgr_entry_create(peer, message);
+	recipient_list_add(&entry->rcpt_list, (long) count, "", 0, "", nexthop);
+	recipient = entry->rcpt_list.info + entry->rcpt_list.len - 1;
+	rcpt_memory = QMGR_RCPT_MEMORY(recipient);
+	entry->rcpt_memory += rcpt_memory;
+	qmgr_memory_used += rcpt_memory;
+	job->rcpt_count++;
+	message->rcpt_count++;
+	qmgr_recipient_count++;
+    }
+    message->refill_time = sane_time();
+    for (job = message->job_list.next; job; job = job->message_peers.next)
+	if (job->selected_entries < job->read_entries
+	    && job->blocker_tag != job->transport->blocker_tag)
+	    job->transport->candidate_cache_current = 0;
+    if (message->rcpt_offset == 0)
+	for (job = message->job_list.next; job; job = job->message_peers.next)
+	    qmgr_job_move_limits(job);
+}
+
+/* qmgr_message_realloc - read more recipients */
+
+QMGR_MESSAGE *qmgr_message_realloc(QMGR_MESSAGE *message)
+{
+    if (message->rcpt_offset <= 0)
+	msg_panic("qmgr_message_realloc: invalid offset: %ld",
+		  message->rcpt_offset);
+    if (msg_verbose)
+	msg_info("qmgr_message_realloc: %s", message->queue_id);
+    sim_message_read(message);
+    return (message);
+}
+
+/* qmgr_active_done - dispose of message after delivery attempts */
+
+void    qmgr_active_done(QMGR_MESSAGE *message)
+{
+    SIM_MESSAGE *sim = SIM_MSG(message);
+    SIM_CLASS *class = sim_class + message->priority;
+    QMGR_JOB *job;
+
+    if (msg_verbose)
+	msg_info("qmgr_active_done: %s", message->queue_id);
+
+    /*
+     * Read more recipients, as in qmgr_active_done().
+     */
+    if (message->rcpt_offset > 0) {
+	qmgr_message_realloc(message);
+	if (message->refcount == 0)
+	    qmgr_active_done(message);
+	return;
+    }
+
+    /*
+     * Update the statistics.
+     */
+    sim_last_done = sim_now;
+    sim_msg_done++;
+    sim_rcpt_delivered += sim->delivered;
+    sim_rcpt_deferred += sim->deferred;
+    if (sim->deferred > 0) {
+	class->deferred++;
+    } else {
+	if (class->size == 0) {
+	    class->size = 100;
+	    class->latency = (double *)
+		mymalloc(class->size * sizeof(*class->latency));
+	} else if (class->len >= class->size) {
+	    class->size *= 2;
+	    class->latency = (double *)
+		myrealloc((void *) class->latency,
+			  class->size * sizeof(*class->latency));
+	}
+	class->latency[class->len++] = sim_now - sim->arrival;
+    }
+
+    /*
+     * Dispose of the message, as in qmgr_message_free().
+     */
+    while ((job = message->job_list.next) != 0)
+	qmgr_job_free(job);
+    myfree(message->queue_id);
+    myfree(message->queue_name);
+    myfree(sim->transport);
+    argv_free(sim->dests);
+    myfree((void *) sim->counts);
+    qmgr_message_count--;
+    qmgr_memory_used -= sizeof(*message);
+    myfree((void *) sim);
+}
+
+/* sim_active_feed - move message from incoming to active queue */
+
+static void sim_active_feed(SIM_MESSAGE *sim)
+{
+    QMGR_MESSAGE *message = &sim->message;
+
+    if (msg_verbose)
+	msg_info("sim_active_feed: %s", message->queue_id);
+    qmgr_message_count++;
+    qmgr_memory_used += sizeof(*message);
+    message->active_time.tv_sec = (time_t) sim_now;
+    message->queued_time = sane_time()
+	- (message->priority - MAIL_PRIORITY_NORMAL) * var_qmgr_prio_offset;
+    message->rcpt_limit = var_qmgr_msg_rcpt_limit;
+    sim_message_read(message);
+    if (message->refcount == 0)
+	qmgr_active_done(message);
+}
+
+/* sim_defer_todo - defer todo entries, as in qmgr_defer_todo() */
+
+static void sim_defer_todo(QMGR_QUEUE *queue)
+{
+    QMGR_ENTRY *entry;
+    QMGR_ENTRY *next;
+
+    for (entry = queue->todo.next; entry != 0; entry = next) {
+	next = entry->queue_peers.next;
+	SIM_MSG(entry->message)->deferred += entry->rcpt_list.len;
+	entry->message->flags |= DELIVER_STAT_DEFER;
+	qmgr_entry_done(entry, QMGR_QUEUE_TODO);
+    }
+}
+
+/* sim_agent_release - delivery agent process becomes available */
+
+static void sim_agent_release(QMGR_TRANSPORT *transport);
+
+/* sim_deliver_update - delivery request completion */
+
+static void sim_deliver_update(int unused_event, void *context)
+{
+    SIM_DELIVERY *delivery = (SIM_DELIVERY *) context;
+    QMGR_ENTRY *entry = delivery->entry;
+    QMGR_QUEUE *queue = entry->queue;
+    QMGR_TRANSPORT *transport = queue->transport;
+    QMGR_MESSAGE *message = entry->message;
+    SIM_DEST *dest = delivery->dest;
+    double  elapsed = sim_now - delivery->start;
+    DSN     dsn;
+    VSTRING *why = 0;
+
+    dest->busy--;
+
+    /*
+     * Mirror qmgr_deliver_update(): a site failure updates the negative
+     * feedback and may throttle the queue, and a success updates the
+     * positive (and latency) feedback.
+     */
+    if (delivery->reason != 0) {
+	message->flags |= DELIVER_STAT_DEFER;
+	SIM_MSG(message)->deferred += entry->rcpt_list.len;
+	dest->failures++;
+	if (QMGR_QUEUE_READY(queue)) {
+	    why = vstring_alloc(100);
+	    vstring_sprintf(why, "%s%s", SUSPENDED, delivery->reason);
+	    qmgr_queue_throttle(queue, DSN_SIMPLE(&dsn, "4.0.0",
+						  vstring_str(why)));
+	    if (QMGR_QUEUE_THROTTLED(queue))
+		sim_defer_todo(queue);
+	    vstring_free(why);
+	}
+    } else {
+	SIM_MSG(message)->delivered += entry->rcpt_list.len;
+    }
+    qmgr_transport_unthrottle(transport);
+    if (delivery->reason == 0) {
+	if (transport->fbck_mode == QMGR_FEEDBACK_MODE_LATENCY
+	    && QMGR_QUEUE_READY(queue)) {
+
+	    /*
+	     * qmgr_feedback_latency() measures the elapsed real time since
+	     * deliver_start. Backdate deliver_start by the simulated delivery
+	     * time.
+	     */
+	    GETTIMEOFDAY(&entry->deliver_start);
+	    entry->deliver_start.tv_sec -= (time_t) elapsed;
+	    entry->deliver_start.tv_usec -=
+		(long) ((elapsed - (time_t) elapsed) * 1000000);
+	    if (entry->deliver_start.tv_usec < 0) {
+		entry->deliver_start.tv_usec += 1000000;
+		entry->deliver_start.tv_sec -= 1;
+	    }
+	    qmgr_feedback_latency(queue, entry);
+	}
+	qmgr_queue_unthrottle(queue);
+    }
+    myfree((void *) delivery);
+    sim_agent_release(transport);
+    qmgr_entry_done(entry, QMGR_QUEUE_BUSY);
+}
+
+/* sim_deliver - deliver one queue entry, as in qmgr_deliver() */
+
+static void sim_deliver(QMGR_TRANSPORT *transport)
+{
+    QMGR_ENTRY *entry;
+    QMGR_QUEUE *queue;
+    SIM_DELIVERY *delivery;
+    SIM_DEST *dest;
+    double  delay;
+
+    if ((entry = qmgr_job_entry_select(transport)) == 0) {
+	sim_agent_release(transport);
+	return;
+    }
+    queue = entry->queue;
+    dest = sim_dest_find(queue->nexthop);
+    dest->busy++;
+    dest->requests++;
+    if (dest->busy > dest->max_busy)
+	dest->max_busy = dest->busy;
+    if (queue->window > dest->max_window)
+	dest->max_window = queue->window;
+
+    delivery = (SIM_DELIVERY *) mymalloc(sizeof(*delivery));
+    delivery->entry = entry;
+    delivery->dest = dest;
+    delivery->start = sim_now;
+    delivery->reason = 0;
+    if (dest->limit > 0 && dest->busy > dest->limit) {
+	delivery->reason = SIM_REASON_LIMIT;
+	delay = dest->latency;
+    } else if (dest->fail > 0
+	       && myrand() / (RAND_MAX + 1.0) < dest->fail) {
+	delivery->reason = SIM_REASON_FAIL;
+	delay = dest->latency;
+    } else {
+	delay = dest->latency + dest->rcpt_time * entry->rcpt_list.len;
+	if (dest->capacity > 0 && dest->busy > dest->capacity)
+	    delay *= (double) dest->busy / dest->capacity;
+    }
+    if (msg_verbose)
+	msg_info("sim_deliver: %s %s/%s rcpt=%d busy=%d window=%d delay=%.3f%s%s",
+		 entry->message->queue_id, transport->name, queue->name,
+		 entry->rcpt_list.len, dest->busy, queue->window, delay,
+		 delivery->reason ? " " : "",
+		 delivery->reason ? delivery->reason : "");
+    sim_timer_enter(sim_now + delay, sim_deliver_update, (void *) delivery);
+}
+
+/* sim_transport_rate_event - delivery process availability notice */
+
+static void sim_transport_rate_event(int unused_event, void *context)
+{
+    SIM_ALLOC *alloc = (SIM_ALLOC *) context;
+
+    sim_deliver(alloc->transport);
+    myfree((void *) alloc);
+}
+
+/* sim_transport_event - delivery process availability notice */
+
+static void sim_transport_event(int unused_event, void *context)
+{
+    SIM_ALLOC *alloc = (SIM_ALLOC *) context;
+    QMGR_TRANSPORT *transport = alloc->transport;
+
+    transport->pending -= 1;
+    if (transport->xport_rate_delay > 0) {
+	(void) event_request_timer(sim_transport_rate_event, (void *) alloc,
+				   transport->xport_rate_delay);
+    } else {
+	sim_deliver(transport);
+	myfree((void *) alloc);
+    }
+}
+
+/* sim_agent_connect - connect to available delivery agent */
+
+static void sim_agent_connect(QMGR_TRANSPORT *transport)
+{
+    SIM_ALLOC *alloc;
+
+    alloc = (SIM_ALLOC *) mymalloc(sizeof(*alloc));
+    alloc->transport = transport;
+    sim_timer_enter(sim_now, sim_transport_event, (void *) alloc);
+}
+
+/* sim_agent_release - delivery agent process becomes available */
+
+static void sim_agent_release(QMGR_TRANSPORT *transport)
+{
+    SIM_XPORT *xport = sim_xport_find(transport->name);
+
+    if (xport->waiting > 0) {
+	xport->waiting--;
+	sim_agent_connect(transport);
+    } else {
+	xport->busy--;
+    }
+}
+
+/* sim_transport_alloc - allocate delivery process */
+
+static void sim_transport_alloc(QMGR_TRANSPORT *transport)
+{
+    SIM_XPORT *xport = sim_xport_find(transport->name);
+
+    /*
+     * Mirror qmgr_transport_alloc(). A connection request waits when all
+     * delivery agent processes for this transport are busy, as it would
+     * wait for the master(8) process limit.
+     */
+    if (transport->xport_rate_delay > 0)
+	transport->flags |= QMGR_TRANSPORT_STAT_RATE_LOCK;
+    transport->pending += 1;
+    if (xport->busy < xport->process_limit) {
+	xport->busy++;
+	sim_agent_connect(transport);
+    } else {
+	xport->waiting++;
+    }
+}
+
+/* sim_timer_run - run expired timers */
+
+static int sim_timer_run(void)
+{
+    SIM_TIMER *timer;
+    EVENT_NOTIFY_TIME_FN callback;
+    void   *context;
+    int     count = 0;
+
+    while ((timer = sim_timer_list) != 0 && timer->when <= sim_now) {
+	sim_timer_list = timer->next;
+	callback = timer->callback;
+	context = timer->context;
+	myfree((void *) timer);
+	callback(EVENT_TIME, context);
+	count++;
+    }
+    return (count);
+}
+
+/* sim_compare_double - qsort callback */
+
+static int sim_compare_double(const void *a, const void *b)
+{
+    double  x = *(const double *) a;
+    double  y = *(const double *) b;
+
+    return (x < y ? -1 : x > y ? 1 : 0);
+}
+
+/* sim_compare_dest - qsort callback */
+
+static int sim_compare_dest(const void *a, const void *b)
+{
+    return (strcmp((*(HTABLE_INFO * const *) a)->key,
+		   (*(HTABLE_INFO * const *) b)->key));
+}
+
+/* sim_report - report simulation results */
+
+static void sim_report(void)
+{
+    double  elapsed = sim_last_done - SIM_EPOCH;
+    SIM_CLASS *class;
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    SIM_DEST *dest;
+    int     prio;
+    int     n;
+    double  sum;
+
+#define SIM_PCT(c, p) \
+	((c)->latency[(int) (((c)->len - 1) * (p) / 100.0 + 0.5)])
+
+    vstream_printf("time: %.1fs messages: %ld (deferred: %ld, unfinished: %d)\n",
+		   elapsed, sim_msg_done,
+		   (long) (sim_class[MAIL_PRIORITY_LOW].deferred
+			   + sim_class[MAIL_PRIORITY_NORMAL].deferred
+			   + sim_class[MAIL_PRIORITY_HIGH].deferred),
+		   qmgr_message_count + sim_incoming_count);
+    vstream_printf("recipients: delivered: %ld deferred: %ld\n",
+		   sim_rcpt_delivered, sim_rcpt_deferred);
+    vstream_printf("throughput: %.2f recipients/s %.2f messages/s\n",
+		   elapsed > 0 ? sim_rcpt_delivered / elapsed : 0,
+		   elapsed > 0 ? sim_msg_done / elapsed : 0);
+    vstream_printf("%-8s %8s %9s %9s %9s %9s %9s\n",
+		   "class", "messages", "mean", "50%", "90%", "99%", "max");
+    for (prio = MAIL_PRIORITY_HIGH; prio >= MAIL_PRIORITY_LOW; prio--) {
+	class = sim_class + prio;
+	if (class->len == 0)
+	    continue;
+	qsort((void *) class->latency, class->len, sizeof(*class->latency),
+	      sim_compare_double);
+	for (sum = 0, n = 0; n < class->len; n++)
+	    sum += class->latency[n];
+	vstream_printf("%-8s %8d %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+		       str_mail_priority(prio), class->len, sum / class->len,
+		       SIM_PCT(class, 50), SIM_PCT(class, 90),
+		       SIM_PCT(class, 99), class->latency[class->len - 1]);
+    }
+    vstream_printf("%-30s %9s %9s %9s %9s\n",
+		   "destination", "requests", "failures", "max-busy",
+		   "max-window");
+    list = htable_list(sim_dest_table);
+    qsort((void *) list, sim_dest_table->used, sizeof(*list),
+	  sim_compare_dest);
+    for (ht = list; *ht; ht++) {
+	dest = (SIM_DEST *) ht[0]->value;
+	if (dest->requests == 0)
+	    continue;
+	vstream_printf("%-30s %9ld %9ld %9d %9d\n", dest->name,
+		       dest->requests, dest->failures, dest->max_busy,
+		       dest->max_window);
+    }
+    myfree((void *) list);
+    vstream_fflush(VSTREAM_OUT);
+}
+
+/* usage - explain */
+
+static NORETURN usage(const char *myname)
+{
+    msg_fatal("usage: %s [-v] [-c config_dir] [-m model_file] [-o name=value] [-p process_limit] [-s seed] [trace_file]",
+	      myname);
+}
+
+/* main - simulate queue manager scheduling */
+
+int     main(int argc, char **argv)
+{
+    static const CONFIG_STR_TABLE str_table[] = {
+	VAR_CONC_POS_FDBACK, DEF_CONC_POS_FDBACK, &var_conc_pos_feedback, 1, 0,
+	VAR_CONC_NEG_FDBACK, DEF_CONC_NEG_FDBACK, &var_conc_neg_feedback, 1, 0,
+	VAR_CONC_FDBACK_MODE, DEF_CONC_FDBACK_MODE, &var_conc_fdback_mode, 1, 0,
+	0,
+    };
+    static const CONFIG_TIME_TABLE time_table[] = {
+	VAR_MIN_BACKOFF_TIME, DEF_MIN_BACKOFF_TIME, &var_min_backoff_time, 1, 0,
+	VAR_XPORT_RETRY_TIME, DEF_XPORT_RETRY_TIME, &var_transport_retry_time, 1, 0,
+	VAR_QMGR_CLOG_WARN_TIME, DEF_QMGR_CLOG_WARN_TIME, &var_qmgr_clog_warn_time, 0, 0,
+	VAR_XPORT_REFILL_DELAY, DEF_XPORT_REFILL_DELAY, &var_xport_refill_delay, 1, 0,
+	VAR_XPORT_RATE_DELAY, DEF_XPORT_RATE_DELAY, &var_xport_rate_delay, 0, 0,
+	VAR_DEST_RATE_DELAY, DEF_DEST_RATE_DELAY, &var_dest_rate_delay, 0, 0,
+	VAR_QMGR_PRIO_OFFSET, DEF_QMGR_PRIO_OFFSET, &var_qmgr_prio_offset, 0, 0,
+	0,
+    };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_QMGR_ACT_LIMIT, DEF_QMGR_ACT_LIMIT, &var_qmgr_active_limit, 1, 0,
+	VAR_QMGR_RCPT_LIMIT, DEF_QMGR_RCPT_LIMIT, &var_qmgr_rcpt_limit, 1, 0,
+	VAR_QMGR_MSG_RCPT_LIMIT, DEF_QMGR_MSG_RCPT_LIMIT, &var_qmgr_msg_rcpt_limit, 1, 0,
+	VAR_XPORT_RCPT_LIMIT, DEF_XPORT_RCPT_LIMIT, &var_xport_rcpt_limit, 0, 0,
+	VAR_STACK_RCPT_LIMIT, DEF_STACK_RCPT_LIMIT, &var_stack_rcpt_limit, 0, 0,
+	VAR_XPORT_REFILL_LIMIT, DEF_XPORT_REFILL_LIMIT, &var_xport_refill_limit, 1, 0,
+	VAR_DELIVERY_SLOT_COST, DEF_DELIVERY_SLOT_COST, &var_delivery_slot_cost, 0, 0,
+	VAR_DELIVERY_SLOT_LOAN, DEF_DELIVERY_SLOT_LOAN, &var_delivery_slot_loan, 0, 0,
+	VAR_DELIVERY_SLOT_DISCOUNT, DEF_DELIVERY_SLOT_DISCOUNT, &var_delivery_slot_discount, 0, 100,
+	VAR_MIN_DELIVERY_SLOTS, DEF_MIN_DELIVERY_SLOTS, &var_min_delivery_slots, 0, 0,
+	VAR_INIT_DEST_CON, DEF_INIT_DEST_CON, &var_init_dest_concurrency, 1, 0,
+	VAR_DEST_CON_LIMIT, DEF_DEST_CON_LIMIT, &var_dest_con_limit, 0, 0,
+	VAR_DEST_RCPT_LIMIT, DEF_DEST_RCPT_LIMIT, &var_dest_rcpt_limit, 0, 0,
+	VAR_LOCAL_RCPT_LIMIT, DEF_LOCAL_RCPT_LIMIT, &var_local_rcpt_lim, 0, 0,
+	VAR_LOCAL_CON_LIMIT, DEF_LOCAL_CON_LIMIT, &var_local_con_lim, 0, 0,
+	VAR_CONC_COHORT_LIM, DEF_CONC_COHORT_LIM, &var_conc_cohort_limit, 0, 0,
+	VAR_QMGR_SHARD_COUNT, DEF_QMGR_SHARD_COUNT, &var_qmgr_shard_count, 1, 0,
+	0,
+    };
+    static const CONFIG_LONG_TABLE long_table[] = {
+	VAR_QMGR_MEMORY_LIMIT, DEF_QMGR_MEMORY_LIMIT, &var_qmgr_memory_limit, 0, 0,
+	0,
+    };
+    static const CONFIG_BOOL_TABLE bool_table[] = {
+	VAR_CONC_FDBACK_DEBUG, DEF_CONC_FDBACK_DEBUG, &var_conc_feedback_debug,
+	0,
+    };
+    QMGR_TRANSPORT *transport;
+    char   *model_file = 0;
+    ARGV   *override = argv_alloc(1);
+    char   *name;
+    char   *value;
+    const char *err;
+    char  **cpp;
+    int     seed = 1;
+    int     ch;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    sim_dest_table = htable_create(0);
+    sim_xport_table = htable_create(0);
+    while ((ch = GETOPT(argc, argv, "c:m:o:p:s:v")) > 0) {
+	switch (ch) {
+	case 'c':
+	    if (setenv(CONF_ENV_PATH, optarg, 1) < 0)
+		msg_fatal("out of memory");
+	    mail_conf_suck();
+	    break;
+	case 'm':
+	    model_file = optarg;
+	    break;
+	case 'o':
+	    argv_add(override, optarg, (char *) 0);
+	    break;
+	case 'p':
+	    if ((sim_process_limit = atoi(optarg)) < 1)
+		msg_fatal("bad process limit: %s", optarg);
+	    break;
+	case 's':
+	    seed = atoi(optarg);
+	    break;
+	case 'v':
+	    msg_verbose++;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (argc > optind + 1)
+	usage(argv[0]);
+
+    /*
+     * Configuration, as the queue manager would see it. Command-line
+     * settings override main.cf settings.
+     */
+    for (cpp = override->argv; *cpp; cpp++) {
+	value = mystrdup(*cpp);
+	if ((err = split_nameval(value, &name, &value)) != 0)
+	    msg_fatal("-o %s: %s", *cpp, err);
+	mail_conf_update(name, value);
+    }
+    argv_free(override);
+    get_mail_conf_str_table(str_table);
+    get_mail_conf_time_table(time_table);
+    get_mail_conf_int_table(int_table);
+    get_mail_conf_long_table(long_table);
+    get_mail_conf_bool_table(bool_table);
+
+    /*
+     * Not in the tables above: postconf(1) collects table entries from all
+     * programs, and these variables are owned by the global library.
+     */
+    var_daemon_timeout =
+	get_mail_conf_time(VAR_DAEMON_TIMEOUT, DEF_DAEMON_TIMEOUT, 1, 0);
+    var_helpful_warnings =
+	get_mail_conf_bool(VAR_HELPFUL_WARNINGS, DEF_HELPFUL_WARNINGS);
+    mysrand(seed);
+    if (model_file)
+	sim_model_read(model_file);
+
+    if (argc > optind) {
+	sim_trace_name = argv[optind];
+	if ((sim_trace = vstream_fopen(sim_trace_name, O_RDONLY, 0)) == 0)
+	    msg_fatal("open %s: %m", sim_trace_name);
+    } else {
+	sim_trace_name = "stdin";
+	sim_trace = VSTREAM_IN;
+    }
+    sim_trace_buf = vstring_alloc(100);
+    sim_trace_next = sim_trace_read();
+
+    /*
+     * The main loop, as in qmgr_loop() and event_loop(): let new mail into
+     * the active queue while the active queue limits permit, allocate
+     * delivery agents, and advance the simulated time to the next event.
+     */
+#define QMGR_ADMIT_OK() \
+	(qmgr_message_count < var_qmgr_active_limit && QMGR_MEMORY_OK())
+
+    if (sim_trace_next != 0)
+	sim_now = sim_trace_next->arrival;
+    for (;;) {
+	sim_trace_due();
+	while (sim_incoming_head != 0 && QMGR_ADMIT_OK()) {
+	    SIM_MESSAGE *sim = sim_incoming_head;
+
+	    if ((sim_incoming_head = sim->next) == 0)
+		sim_incoming_tail = 0;
+	    sim_incoming_count--;
+	    sim_active_feed(sim);
+	}
+	while ((transport = qmgr_transport_select()) != 0)
+	    sim_transport_alloc(transport);
+	if (sim_timer_run() > 0)
+	    continue;
+	if (sim_timer_list != 0
+	    && (sim_trace_next == 0 || sim_timer_list->when < sim_trace_next->arrival))
+	    sim_now = sim_timer_list->when;
+	else if (sim_trace_next != 0)
+	    sim_now = sim_trace_next->arrival;
+	else
+	    break;
+    }
+    if (sim_trace != VSTREAM_IN)
+	(void) vstream_fclose(sim_trace);
+    vstring_free(sim_trace_buf);
+    sim_report();
+    exit(0);
+}
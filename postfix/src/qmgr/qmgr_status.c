@@ -0,0 +1,186 @@
+/*++
+/* NAME
+/*	qmgr_status 3
+/* SUMMARY
+/*	queue manager scheduler status snapshots
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_status_init()
+/* DESCRIPTION
+/*	This module periodically writes a snapshot of the in-memory
+/*	scheduler state to the file specified with the qmgr_status_file
+/*	parameter, so that delivery concurrency and destination
+/*	congestion can be monitored without parsing the maillog.
+/*
+/*	The snapshot is written to a temporary file that is then
+/*	renamed, so that readers never see a partial snapshot. All
+/*	information is in-memory state; making a snapshot does not
+/*	require any file system lookups other than the update itself.
+/*
+/*	Each line of the snapshot describes one object, and consists
+/*	of the object type followed by \fIname\fR=\fIvalue\fR pairs:
+/* .IP "status"
+/*	Snapshot time, the numbers of in-core messages, recipients
+/*	and pending address verification requests, and the approximate
+/*	amount of memory that is used for messages and recipients.
+/* .IP "transport"
+/*	Per-transport concurrency settings, the number of pending
+/*	delivery agent connections, and whether the transport is
+/*	throttled.
+/* .IP "queue"
+/*	Per-destination concurrency window, accumulated positive and
+/*	negative feedback, the numbers of todo and busy entries,
+/*	and whether the destination is throttled, or blocking the
+/*	transport job list.
+/* .IP "job"
+/*	Per-message, per-transport recipient slot usage, the numbers
+/*	of entries read and selected so far, and whether the job is
+/*	blocked by per-destination concurrency limits.
+/* .PP
+/*	qmgr_status_init() starts the snapshot pseudo thread. It
+/*	does nothing when the qmgr_status_file parameter value is
+/*	empty, or when qmgr_status_update_interval is zero.
+/* DIAGNOSTICS
+/*	Warnings: snapshot update errors.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdio.h>			/* rename() */
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <events.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+static VSTRING *qmgr_status_temp;
+
+#define STR(x)	vstring_str(x)
+
+/* qmgr_status_queue - report one destination */
+
+static void qmgr_status_queue(VSTREAM *fp, QMGR_QUEUE *queue)
+{
+    QMGR_TRANSPORT *transport = queue->transport;
+
+    vstream_fprintf(fp, "queue transport=%s name=%s nexthop=%s"
+		    " window=%d success=%g failure=%g fail_cohorts=%g"
+		    " latency=%g latency_baseline=%g"
+		    " todo=%d busy=%d throttled=%d blocker=%d\n",
+		    transport->name, queue->name, queue->nexthop,
+		    QMGR_QUEUE_THROTTLED(queue) ? 0 : queue->window,
+		    queue->success, queue->failure, queue->fail_cohorts,
+		    queue->lat_avg, queue->lat_min,
+		    queue->todo_refcount, queue->busy_refcount,
+		    QMGR_QUEUE_THROTTLED(queue) ? 1 : 0,
+		    queue->blocker_tag == transport->blocker_tag);
+}
+
+/* qmgr_status_job - report one message job */
+
+static void qmgr_status_job(VSTREAM *fp, QMGR_JOB *job)
+{
+    QMGR_TRANSPORT *transport = job->transport;
+
+    vstream_fprintf(fp, "job transport=%s queue_id=%s"
+		    " rcpt_count=%d rcpt_limit=%d read_entries=%d"
+		    " selected_entries=%d slots_used=%d stack_level=%d"
+		    " blocker=%d current=%d\n",
+		    transport->name, job->message->queue_id,
+		    job->rcpt_count, job->rcpt_limit, job->read_entries,
+		    job->selected_entries, job->slots_used, job->stack_level,
+		    job->blocker_tag == transport->blocker_tag,
+		    job == transport->job_current);
+}
+
+/* qmgr_status_update - write scheduler snapshot */
+
+static void qmgr_status_update(void)
+{
+    VSTREAM *fp;
+    QMGR_TRANSPORT *transport;
+    QMGR_QUEUE *queue;
+    QMGR_JOB *job;
+    int     queue_count;
+
+    if ((fp = vstream_fopen(STR(qmgr_status_temp),
+			    O_CREAT | O_TRUNC | O_WRONLY, 0644)) == 0) {
+	msg_warn("open %s: %m", STR(qmgr_status_temp));
+	return;
+    }
+    vstream_fprintf(fp, "status time=%ld messages=%d recipients=%d"
+		    " verify_pending=%d memory=%ld\n",
+		    (long) event_time(), qmgr_message_count,
+		    qmgr_recipient_count, qmgr_vrfy_pend_count,
+		    qmgr_memory_used);
+    for (transport = qmgr_transport_list.next; transport;
+	 transport = transport->peers.next) {
+	queue_count = 0;
+	for (queue = transport->queue_list.next; queue;
+	     queue = queue->peers.next)
+	    queue_count++;
+	vstream_fprintf(fp, "transport name=%s pending=%d"
+			" dest_concurrency_limit=%d init_dest_concurrency=%d"
+			" recipient_limit=%d rate_delay=%d queues=%d"
+			" throttled=%d\n",
+			transport->name, transport->pending,
+			transport->dest_concurrency_limit,
+			transport->init_dest_concurrency,
+			transport->recipient_limit, transport->rate_delay,
+			queue_count, QMGR_TRANSPORT_THROTTLED(transport) ? 1 : 0);
+	for (queue = transport->queue_list.next; queue;
+	     queue = queue->peers.next)
+	    qmgr_status_queue(fp, queue);
+	for (job = transport->job_list.next; job;
+	     job = job->transport_peers.next)
+	    qmgr_status_job(fp, job);
+    }
+    if (vstream_fclose(fp) != 0) {
+	msg_warn("write %s: %m", STR(qmgr_status_temp));
+	(void) unlink(STR(qmgr_status_temp));
+    } else if (rename(STR(qmgr_status_temp), var_qmgr_status_file) < 0) {
+	msg_warn("rename %s to %s: %m",
+		 STR(qmgr_status_temp), var_qmgr_status_file);
+	(void) unlink(STR(qmgr_status_temp));
+    }
+}
+
+/* qmgr_status_event - periodic snapshot */
+
+static void qmgr_status_event(int unused_event, void *unused_context)
+{
+    qmgr_status_update();
+    event_request_timer(qmgr_status_event, (void *) 0,
+			var_qmgr_status_int);
+}
+
+/* qmgr_status_init - start snapshot pseudo thread */
+
+void    qmgr_status_init(void)
+{
+    if (*var_qmgr_status_file == 0 || var_qmgr_status_int <= 0)
+	return;
+    qmgr_status_temp = vstring_alloc(100);
+    vstring_sprintf(qmgr_status_temp, "%s.%ld",
+		    var_qmgr_status_file, (long) var_pid);
+    event_request_timer(qmgr_status_event, (void *) 0,
+			var_qmgr_status_int);
+}
@@ -442,6 +442,18 @@ QMGR_TRANSPORT *qmgr_transport_create(const char *name)
 						var_dest_rate_delay,
 						's', 0, 0);
 
+    /*
+     * With multiple queue manager shards, each shard gets its share of the
+     * per-destination concurrency, and spaces out its deliveries so that
+     * the shards together respect the per-destination rate delay.
+     */
+    transport->dest_concurrency_limit =
+	qmgr_shard_limit(transport->dest_concurrency_limit);
+    transport->init_dest_concurrency =
+	qmgr_shard_limit(transport->init_dest_concurrency);
+    if (var_qmgr_shard_count > 1)
+	transport->rate_delay *= var_qmgr_shard_count;
+
     if (transport->rate_delay > 0)
 	transport->dest_concurrency_limit = 1;
     if (transport->dest_concurrency_limit != 0
@@ -482,6 +494,7 @@ QMGR_TRANSPORT *qmgr_transport_create(const char *name)
 		       VAR_CONC_POS_FDBACK, var_conc_pos_feedback);
     qmgr_feedback_init(&transport->neg_feedback, name, _CONC_NEG_FDBACK,
 		       VAR_CONC_NEG_FDBACK, var_conc_neg_feedback);
+    transport->fbck_mode = qmgr_feedback_mode(name);
     transport->fail_cohort_limit =
 	get_mail_conf_int2(name, _CONC_COHORT_LIM,
 			   var_conc_cohort_limit, 0, 0);
@@ -0,0 +1,446 @@
+/*++
+/* NAME
+/*	replicad 8
+/* SUMMARY
+/*	Postfix queue file replication server
+/* SYNOPSIS
+/*	\fBreplicad\fR [generic Postfix daemon options]
+/* DESCRIPTION
+/*	The \fBreplicad\fR(8) server keeps copies of queue files
+/*	that the \fBcleanup\fR(8) server on a peer node sends when
+/*	that node is configured with \fBqueue_replication_peer\fR.
+/*	On the peer node, a message is acknowledged to the client
+/*	as soon as this server has stored a copy, instead of after
+/*	a local file system sync. Acceptance latency is then bounded
+/*	by the network round-trip time instead of the disk flush
+/*	time.
+/*
+/*	A copy is stored as \fBreplica/\fIorigin\fB/\fIqueue_id\fR
+/*	under the Postfix queue directory, where \fIorigin\fR is
+/*	the \fBmyhostname\fR value of the peer node. The peer node's
+/*	queue manager requests removal of a copy after it has
+/*	removed the queue file, that is, after the message is
+/*	delivered or returned to the sender.
+/*
+/*	Two nodes can replicate to each other.
+/* FAILOVER
+/* .ad
+/* .fi
+/*	When a peer node has failed permanently, recover its mail
+/*	with "\fBpostsuper -R \fIorigin\fR". This moves the copies
+/*	into the \fBmaildrop\fR queue, from where they are requeued
+/*	as with "\fBpostsuper -r\fR". Do not recover mail from a
+/*	node that is still running, or that will be brought back
+/*	with its queue intact, as that delivers the mail twice.
+/* BUGS
+/*	A copy is written without a file system sync. Mail is lost
+/*	when both nodes fail before the copy, or the original queue
+/*	file, has been written to stable storage.
+/*
+/*	A copy reflects the queue file at the time it was received.
+/*	After recovery, recipients that were delivered on the failed
+/*	node before the failure may receive the message again; so
+/*	may recipients of messages that were removed with
+/*	"\fBpostsuper -d\fR" or requeued with "\fBpostsuper -r\fR"
+/*	on the failed node.
+/* SECURITY
+/* .ad
+/* .fi
+/*	The \fBreplicad\fR(8) server accepts queue files only from
+/*	clients that match \fBqueue_replication_clients\fR, and
+/*	stores them without inspection. The protocol has no
+/*	encryption. Use it on a private network only.
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/*	Changes to \fBmain.cf\fR are picked up automatically, as
+/*	\fBreplicad\fR(8) processes run for only a limited amount of
+/*	time. Use the command "\fBpostfix reload\fR" to speed up a
+/*	change.
+/*
+/*	The text below provides only a parameter summary. See
+/*	\fBpostconf\fR(5) for more details including examples.
+/* .IP "\fBqueue_replication_clients (empty)\fR"
+/*	The network addresses of peer nodes that may store queue
+/*	file copies with the \fBreplicad\fR(8) server.
+/* .IP "\fBconfig_directory (see 'postconf -d' output)\fR"
+/*	The default location of the Postfix main.cf and master.cf
+/*	configuration files.
+/* .IP "\fBipc_timeout (3600s)\fR"
+/*	The time limit for sending or receiving information over an internal
+/*	communication channel.
+/* .IP "\fBmax_idle (100s)\fR"
+/*	The maximum amount of time that an idle Postfix daemon process waits
+/*	for an incoming connection before terminating voluntarily.
+/* .IP "\fBmax_use (100)\fR"
+/*	The maximal number of incoming connections that a Postfix daemon
+/*	process will service before terminating voluntarily.
+/* .IP "\fBprocess_id (read-only)\fR"
+/*	The process ID of a Postfix command or daemon process.
+/* .IP "\fBprocess_name (read-only)\fR"
+/*	The process name of a Postfix command or daemon process.
+/* .IP "\fBqueue_directory (see 'postconf -d' output)\fR"
+/*	The location of the Postfix top-level queue directory.
+/* .IP "\fBsyslog_facility (mail)\fR"
+/*	The syslog facility of Postfix logging.
+/* .IP "\fBsyslog_name (see 'postconf -d' output)\fR"
+/*	A prefix that is prepended to the process name in syslog
+/*	records, so that, for example, "smtpd" becomes "prefix/smtpd".
+/* EXAMPLE
+/* .ad
+/* .fi
+/*	On each node, with the addresses of the other node:
+/*
+/* .nf
+/*	/etc/postfix/main.cf:
+/*	    queue_replication_peer = 192.168.1.2:2526
+/*	    queue_replication_clients = 192.168.1.2
+/*
+/*	/etc/postfix/master.cf:
+/*	    192.168.1.1:2526 inet n - n - - replicad
+/* .fi
+/* SEE ALSO
+/*	cleanup(8), canonicalize and enqueue mail
+/*	qmgr(8), queue manager
+/*	postsuper(1), queue maintenance
+/*	postconf(5), configuration parameters
+/*	master(5), generic daemon options
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* HISTORY
+/* .ad
+/* .fi
+/*	This service was introduced with Postfix version 3.9.
+/*--*/
+
+ /*
+  * System library.
+  */
+#include <sys_defs.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <stdio.h>			/* rename() */
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+ /*
+  * Utility library.
+  */
+#include <msg.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <iostuff.h>
+#include <myaddrinfo.h>
+#include <sock_addr.h>
+#include <valid_hostname.h>
+#include <stringops.h>
+
+ /*
+  * Global library.
+  */
+#include <mail_params.h>
+#include <mail_proto.h>
+#include <mail_queue.h>
+#include <mail_version.h>
+#include <addr_match_list.h>
+#include <replica_clnt.h>
+
+ /*
+  * Server skeleton.
+  */
+#include <mail_server.h>
+
+ /*
+  * Tunable parameters.
+  */
+char   *var_queue_repl_clients;
+
+ /*
+  * Request state, reused across requests.
+  */
+static ADDR_MATCH_LIST *replicad_clients;
+static VSTRING *replicad_request;
+static VSTRING *replicad_origin;
+static VSTRING *replicad_queue_id;
+static VSTRING *replicad_path;
+static VSTRING *replicad_temp;
+
+#define REPLICAD_STAT_IO	(-2)	/* client is out of sync */
+#define REPLICAD_TEMP_SUFFIX	".tmp"	/* fails mail_queue_id_ok() */
+
+ /*
+  * Silly little macros.
+  */
+#define STR(x)			vstring_str(x)
+#define STREQ(x, y)		(strcmp((x), (y)) == 0)
+
+/* replicad_valid - sanity check origin and queue ID, set replica pathname */
+
+static int replicad_valid(const char *origin, const char *queue_id)
+{
+    if (!valid_hostname(origin, DONT_GRIPE)) {
+	msg_warn("invalid origin name: \"%.100s\"", origin);
+	return (0);
+    }
+    if (!mail_queue_id_ok(queue_id)) {
+	msg_warn("invalid queue id: \"%.100s\"", queue_id);
+	return (0);
+    }
+    vstring_sprintf(replicad_path, "%s/%s/%s",
+		    MAIL_QUEUE_REPLICA, origin, queue_id);
+    return (1);
+}
+
+/* replicad_create - create temporary file, and origin directory */
+
+static int replicad_create(const char *path, const char *origin)
+{
+    VSTRING *dir;
+    int     fd;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0
+	&& errno == ENOENT) {
+	dir = vstring_alloc(100);
+	vstring_sprintf(dir, "%s/%s", MAIL_QUEUE_REPLICA, origin);
+	if (mkdir(STR(dir), 0700) == 0 || errno == EEXIST)
+	    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	vstring_free(dir);
+    }
+    return (fd);
+}
+
+/* replicad_store - receive one queue file */
+
+static int replicad_store(VSTREAM *client_stream, const char *origin,
+			          const char *queue_id, long size)
+{
+    char    buf[VSTREAM_BUFSIZE];
+    ssize_t count;
+    int     status = REPLICA_STAT_OK;
+    int     fd;
+
+    vstring_sprintf(replicad_temp, "%s%s",
+		    STR(replicad_path), REPLICAD_TEMP_SUFFIX);
+    if ((fd = replicad_create(STR(replicad_temp), origin)) < 0) {
+	msg_warn("create file %s: %m", STR(replicad_temp));
+	status = REPLICA_STAT_FAIL;
+    }
+
+    /*
+     * Receive all content even after a local error, so that the client
+     * stays in sync.
+     */
+    for ( /* void */ ; size > 0; size -= count) {
+	count = (size < (long) sizeof(buf) ? size : sizeof(buf));
+	if (vstream_fread(client_stream, buf, count) != count) {
+	    msg_warn("%s: lost connection with %s while receiving queue file",
+		     queue_id, origin);
+	    if (fd >= 0) {
+		(void) close(fd);
+		(void) unlink(STR(replicad_temp));
+	    }
+	    return (REPLICAD_STAT_IO);
+	}
+	if (status == REPLICA_STAT_OK && write_buf(fd, buf, count, 0) < 0) {
+	    msg_warn("write file %s: %m", STR(replicad_temp));
+	    status = REPLICA_STAT_FAIL;
+	}
+    }
+
+    /*
+     * Make the copy look like a finished queue file, so that it can be
+     * requeued as is. Don't sync; that is the point of this service.
+     */
+    if (fd >= 0) {
+	if (status == REPLICA_STAT_OK
+	    && fchmod(fd, MAIL_QUEUE_STAT_READY) < 0) {
+	    msg_warn("change mode of file %s: %m", STR(replicad_temp));
+	    status = REPLICA_STAT_FAIL;
+	}
+	if (close(fd) < 0 && status == REPLICA_STAT_OK) {
+	    msg_warn("close file %s: %m", STR(replicad_temp));
+	    status = REPLICA_STAT_FAIL;
+	}
+	if (status == REPLICA_STAT_OK
+	    && rename(STR(replicad_temp), STR(replicad_path)) < 0) {
+	    msg_warn("rename file %s as %s: %m",
+		     STR(replicad_temp), STR(replicad_path));
+	    status = REPLICA_STAT_FAIL;
+	}
+	if (status != REPLICA_STAT_OK)
+	    (void) unlink(STR(replicad_temp));
+    }
+    if (msg_verbose && status == REPLICA_STAT_OK)
+	msg_info("%s: stored replica from %s", queue_id, origin);
+    return (status);
+}
+
+/* replicad_remove - remove one copy */
+
+static int replicad_remove(const char *origin, const char *queue_id)
+{
+    if (unlink(STR(replicad_path)) < 0) {
+	if (errno == ENOENT)
+	    return (REPLICA_STAT_OK);
+	msg_warn("remove file %s: %m", STR(replicad_path));
+	return (REPLICA_STAT_FAIL);
+    }
+    if (msg_verbose)
+	msg_info("%s: removed replica from %s", queue_id, origin);
+    return (REPLICA_STAT_OK);
+}
+
+/* replicad_service - perform service for client */
+
+static void replicad_service(VSTREAM *client_stream, char *unused_service,
+			             char **argv)
+{
+    long    size;
+    int     status;
+
+    /*
+     * Sanity check. This service takes no command-line arguments.
+     */
+    if (argv[0])
+	msg_fatal("unexpected command-line argument: %s", argv[0]);
+
+    /*
+     * This routine runs whenever a client sends a request. The client keeps
+     * the connection open for the next request. After a protocol error, we
+     * can't find the start of the next request; drop the client.
+     */
+    if (attr_scan(client_stream,
+		  ATTR_FLAG_MORE | ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_REQ, replicad_request),
+		  ATTR_TYPE_END) != 1) {
+	multi_server_disconnect(client_stream);
+	return;
+    }
+    if (STREQ(STR(replicad_request), REPLICA_REQ_STORE)) {
+	if (attr_scan(client_stream, ATTR_FLAG_STRICT,
+		      RECV_ATTR_STR(REPLICA_ATTR_ORIGIN, replicad_origin),
+		      RECV_ATTR_STR(MAIL_ATTR_QUEUEID, replicad_queue_id),
+		      RECV_ATTR_LONG(MAIL_ATTR_SIZE, &size),
+		      ATTR_TYPE_END) != 3
+	    || !replicad_valid(STR(replicad_origin), STR(replicad_queue_id))
+	    || size < 0
+	    || (status = replicad_store(client_stream, STR(replicad_origin),
+					STR(replicad_queue_id), size))
+	    == REPLICAD_STAT_IO) {
+	    multi_server_disconnect(client_stream);
+	    return;
+	}
+    } else if (STREQ(STR(replicad_request), REPLICA_REQ_REMOVE)) {
+	if (attr_scan(client_stream, ATTR_FLAG_STRICT,
+		      RECV_ATTR_STR(REPLICA_ATTR_ORIGIN, replicad_origin),
+		      RECV_ATTR_STR(MAIL_ATTR_QUEUEID, replicad_queue_id),
+		      ATTR_TYPE_END) != 2
+	    || !replicad_valid(STR(replicad_origin), STR(replicad_queue_id))) {
+	    multi_server_disconnect(client_stream);
+	    return;
+	}
+	status = replicad_remove(STR(replicad_origin), STR(replicad_queue_id));
+    } else {
+	msg_warn("unrecognized request: \"%s\"", STR(replicad_request));
+	multi_server_disconnect(client_stream);
+	return;
+    }
+    attr_print(client_stream, ATTR_FLAG_NONE,
+	       SEND_ATTR_INT(MAIL_ATTR_STATUS, status),
+	       ATTR_TYPE_END);
+    vstream_fflush(client_stream);
+}
+
+/* replicad_post_accept - enforce client access, announce our protocol */
+
+static void replicad_post_accept(VSTREAM *stream, char *unused_name,
+			              char **unused_argv, HTABLE *unused_table)
+{
+    struct sockaddr_storage ss;
+    SOCKADDR_SIZE sa_len = sizeof(ss);
+    MAI_HOSTADDR_STR addr;
+    const char *cp;
+
+    /*
+     * Local (UNIX-domain) clients are always allowed.
+     */
+    if (getpeername(vstream_fileno(stream), (struct sockaddr *) &ss,
+		    &sa_len) == 0
+	&& (ss.ss_family == AF_INET
+#ifdef HAS_IPV6
+	    || ss.ss_family == AF_INET6
+#endif
+	    )) {
+	if (sockaddr_to_hostaddr((struct sockaddr *) &ss, sa_len, &addr,
+				 (MAI_SERVPORT_STR *) 0, 0) != 0) {
+	    multi_server_disconnect(stream);
+	    return;
+	}
+	cp = addr.buf;
+	if (strncasecmp(cp, "::ffff:", 7) == 0 && strchr(cp, '.') != 0)
+	    cp += 7;
+	if (!addr_match_list_match(replicad_clients, cp)) {
+	    msg_warn("connect from %s: not found in %s",
+		     cp, VAR_QUEUE_REPL_CLIENTS);
+	    multi_server_disconnect(stream);
+	    return;
+	}
+    }
+    attr_print(stream, ATTR_FLAG_NONE,
+	       SEND_ATTR_STR(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_REPLICA),
+	       ATTR_TYPE_END);
+    (void) vstream_fflush(stream);
+}
+
+/* pre_jail_init - pre-jail initialization */
+
+static void pre_jail_init(char *unused_name, char **unused_argv)
+{
+
+    /*
+     * Open the client list before entering the chroot jail, in case it
+     * names files or tables.
+     */
+    replicad_clients = addr_match_list_init(VAR_QUEUE_REPL_CLIENTS,
+					    MATCH_FLAG_RETURN,
+					    var_queue_repl_clients);
+}
+
+/* post_jail_init - post-jail initialization */
+
+static void post_jail_init(char *unused_name, char **unused_argv)
+{
+    replicad_request = vstring_alloc(10);
+    replicad_origin = vstring_alloc(100);
+    replicad_queue_id = vstring_alloc(20);
+    replicad_path = vstring_alloc(100);
+    replicad_temp = vstring_alloc(100);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+/* main - pass control to the multi-threaded skeleton */
+
+int     main(int argc, char **argv)
+{
+    static const CONFIG_STR_TABLE str_table[] = {
+	VAR_QUEUE_REPL_CLIENTS, DEF_QUEUE_REPL_CLIENTS, &var_queue_repl_clients, 0, 0,
+	0,
+    };
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    multi_server_main(argc, argv, replicad_service,
+		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
+		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
+		      CA_MAIL_SERVER_POST_ACCEPT(replicad_post_accept),
+		      0);
+}
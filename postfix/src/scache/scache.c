@@ -90,6 +90,12 @@
 /*	How frequently the \fBscache\fR(8) server logs usage statistics with
 /*	connection cache hit and miss rates for logical destinations and for
 /*	physical endpoints.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBconnection_cache_demand_ttl_limit (0s)\fR"
+/*	The maximal time-to-live value that the \fBscache\fR(8) server
+/*	allows for connections to a destination that is looked up
+/*	frequently; specify 0 to disable.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -160,6 +166,7 @@
 #include <msg.h>
 #include <iostuff.h>
 #include <htable.h>
+#include <mymalloc.h>
 #include <ring.h>
 #include <events.h>
 
@@ -182,6 +189,7 @@
   */
 int     var_scache_ttl_lim;
 int     var_scache_stat_time;
+int     var_scache_dem_lim;
 
  /*
   * Request parameters.
@@ -214,12 +222,113 @@ static int scache_endp_count;
 static int scache_sess_count;
 time_t  scache_start_time;
 
+ /*
+  * Demand tracking. For each logical destination we maintain a running
+  * average of the time between lookup requests. When a destination is
+  * looked up more frequently than $connection_cache_demand_ttl_limit, we
+  * keep its connections around for about twice the average request
+  * interval, so that they survive the gap between deliveries. The extended
+  * time-to-live of a destination is remembered here until the client saves
+  * the corresponding physical endpoint.
+  */
+typedef struct {
+    time_t  last;			/* time of last lookup */
+    double  avg;			/* average lookup interval, or -1 */
+} SCACHE_DEMAND;
+
+static HTABLE *scache_demand;
+static HTABLE *scache_demand_endp;
+static int scache_demand_count;
+
  /*
   * Silly little macros.
   */
 #define STR(x)			vstring_str(x)
 #define VSTREQ(x,y)		(strcmp(STR(x),y) == 0)
 
+/* scache_demand_update - update destination lookup statistics */
+
+static void scache_demand_update(const char *dest_label)
+{
+    SCACHE_DEMAND *dp;
+    time_t  now = event_time();
+    double  interval;
+
+    if (var_scache_dem_lim <= 0)
+	return;
+    if ((dp = (SCACHE_DEMAND *) htable_find(scache_demand, dest_label)) == 0) {
+	dp = (SCACHE_DEMAND *) mymalloc(sizeof(*dp));
+	dp->last = now;
+	dp->avg = -1;
+	htable_enter(scache_demand, dest_label, (void *) dp);
+	return;
+    }
+    interval = now - dp->last;
+    dp->avg = (dp->avg < 0 || interval > var_scache_dem_lim) ?
+	interval : (3 * dp->avg + interval) / 4;
+    dp->last = now;
+}
+
+/* scache_demand_ttl - determine time-to-live for destination->endpoint binding */
+
+static int scache_demand_ttl(const char *dest_label, const char *endp_label,
+			             int ttl)
+{
+    SCACHE_DEMAND *dp;
+    HTABLE_INFO *ht;
+    int     demand_ttl;
+
+    if (var_scache_dem_lim <= 0
+	|| (dp = (SCACHE_DEMAND *) htable_find(scache_demand, dest_label)) == 0
+	|| dp->avg < 0 || dp->avg >= var_scache_dem_lim)
+	return (ttl);
+    demand_ttl = 2 * dp->avg + 1;
+    if (demand_ttl > var_scache_dem_lim)
+	demand_ttl = var_scache_dem_lim;
+    if (demand_ttl <= ttl)
+	return (ttl);
+    if (msg_verbose)
+	msg_info("%s: dest=%s avg=%.1f ttl=%d", "scache_demand_ttl",
+		 dest_label, dp->avg, demand_ttl);
+    if ((ht = htable_locate(scache_demand_endp, endp_label)) == 0)
+	ht = htable_enter(scache_demand_endp, endp_label, (void *) 0);
+    ht->value = (void *) (long) demand_ttl;
+    scache_demand_count++;
+    return (demand_ttl);
+}
+
+/* scache_demand_endp_ttl - determine time-to-live for endpoint->stream binding */
+
+static int scache_demand_endp_ttl(const char *endp_label, int ttl)
+{
+    HTABLE_INFO *ht;
+    int     demand_ttl;
+
+    if (var_scache_dem_lim <= 0
+	|| (ht = htable_locate(scache_demand_endp, endp_label)) == 0)
+	return (ttl);
+    demand_ttl = (int) (long) ht->value;
+    htable_delete(scache_demand_endp, endp_label, (void (*) (void *)) 0);
+    return (demand_ttl > ttl ? demand_ttl : ttl);
+}
+
+/* scache_demand_prune - forget about destinations that are no longer busy */
+
+static void scache_demand_prune(void)
+{
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    time_t  now = event_time();
+
+    list = htable_list(scache_demand);
+    for (ht = list; *ht; ht++)
+	if (now - ((SCACHE_DEMAND *) (ht[0]->value))->last > var_scache_dem_lim)
+	    htable_delete(scache_demand, ht[0]->key, myfree);
+    myfree((void *) list);
+    htable_free(scache_demand_endp, (void (*) (void *)) 0);
+    scache_demand_endp = htable_create(1);
+}
+
 /* scache_save_endp_service - protocol to save endpoint->stream binding */
 
 static void scache_save_endp_service(VSTREAM *client_stream)
@@ -259,7 +368,8 @@ static void scache_save_endp_service(VSTREAM *client_stream)
 	return;
     } else {
 	scache_save_endp(scache,
-			 ttl > var_scache_ttl_lim ? var_scache_ttl_lim : ttl,
+			 scache_demand_endp_ttl(STR(scache_endp_label),
+			   ttl > var_scache_ttl_lim ? var_scache_ttl_lim : ttl),
 			 STR(scache_endp_label), STR(scache_endp_prop), fd);
 	(void) attr_print(client_stream, ATTR_FLAG_NONE,
 			  SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_OK),
@@ -347,7 +457,9 @@ static void scache_save_dest_service(VSTREAM *client_stream)
 	return;
     } else {
 	scache_save_dest(scache,
-			 ttl > var_scache_ttl_lim ? var_scache_ttl_lim : ttl,
+			 scache_demand_ttl(STR(scache_dest_label),
+					   STR(scache_endp_label),
+			   ttl > var_scache_ttl_lim ? var_scache_ttl_lim : ttl),
 			 STR(scache_dest_label), STR(scache_dest_prop),
 			 STR(scache_endp_label));
 	attr_print(client_stream, ATTR_FLAG_NONE,
@@ -380,9 +492,10 @@ static void scache_find_dest_service(VSTREAM *client_stream)
 		   SEND_ATTR_STR(MAIL_ATTR_PROP, ""),
 		   ATTR_TYPE_END);
 	return;
-    } else if ((fd = scache_find_dest(scache, STR(scache_dest_label),
-				      scache_dest_prop,
-				      scache_endp_prop)) < 0) {
+    }
+    scache_demand_update(STR(scache_dest_label));
+    if ((fd = scache_find_dest(scache, STR(scache_dest_label),
+			       scache_dest_prop, scache_endp_prop)) < 0) {
 	attr_print(client_stream, ATTR_FLAG_NONE,
 		   SEND_ATTR_INT(MAIL_ATTR_STATUS, SCACHE_STAT_FAIL),
 		   SEND_ATTR_STR(MAIL_ATTR_PROP, ""),
@@ -498,6 +611,11 @@ static void scache_status_dump(char *unused_name, char **unused_argv)
 	scache_endp_count = 0;
 	scache_sess_count = 0;
     }
+    if (scache_demand_count) {
+	msg_info("statistics: demand-extended time-to-live=%d",
+		 scache_demand_count);
+	scache_demand_count = 0;
+    }
     scache_start_time = event_time();
 }
 
@@ -506,6 +624,8 @@ static void scache_status_dump(char *unused_name, char **unused_argv)
 static void scache_status_update(int unused_event, void *context)
 {
     scache_status_dump((char *) 0, (char **) 0);
+    if (var_scache_dem_lim > 0)
+	scache_demand_prune();
     event_request_timer(scache_status_update, context, var_scache_stat_time);
 }
 
@@ -518,6 +638,8 @@ static void post_jail_init(char *unused_name, char **unused_argv)
      * Pre-allocate the cache instance.
      */
     scache = scache_multi_create();
+    scache_demand = htable_create(1);
+    scache_demand_endp = htable_create(1);
 
     /*
      * Pre-allocate buffers.
@@ -568,6 +690,7 @@ int     main(int argc, char **argv)
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_SCACHE_TTL_LIM, DEF_SCACHE_TTL_LIM, &var_scache_ttl_lim, 1, 0,
 	VAR_SCACHE_STAT_TIME, DEF_SCACHE_STAT_TIME, &var_scache_stat_time, 1, 0,
+	VAR_SCACHE_DEM_LIM, DEF_SCACHE_DEM_LIM, &var_scache_dem_lim, 0, 0,
 	0,
     };
 
@@ -13,13 +13,22 @@
 /*	The \fBshowq\fR(8) daemon can also be run in stand-alone mode
 /*	by the superuser. This mode of operation is used to emulate
 /*	the `mailq' command while the Postfix mail system is down.
+/*
+/*	The client request specifies optional filters: a list of
+/*	queue names, a sender address, a recipient domain, and a
+/*	minimal message age. Only messages that match all specified
+/*	filters are reported. In brief mode, the \fBshowq\fR(8)
+/*	daemon reports only the message envelope sender, and does
+/*	not read recipients or deferral reasons.
 /* SECURITY
 /* .ad
 /* .fi
 /*	The \fBshowq\fR(8) daemon can run in a chroot jail at fixed low
-/*	privilege, and takes no input from the client. Its service port
-/*	is accessible to local untrusted users, so the service can be
-/*	susceptible to denial of service attacks.
+/*	privilege, and takes only filter settings from the client. Its
+/*	service port is accessible to local untrusted users, so the
+/*	service can be susceptible to denial of service attacks. The
+/*	daemon stops listing when the client goes away, even when no
+/*	queue file matches the filters.
 /* STANDARDS
 /* .ad
 /* .fi
@@ -126,6 +135,8 @@
 #include <stringops.h>
 #include <mymalloc.h>
 #include <htable.h>
+#include <argv.h>
+#include <iostuff.h>
 
 /* Global library. */
 
@@ -139,6 +150,7 @@
 #include <mail_conf.h>
 #include <record.h>
 #include <rec_type.h>
+#include <rec_size_trailer.h>
 #include <quote_822_local.h>
 #include <mail_addr.h>
 #include <bounce_log.h>
@@ -157,11 +169,55 @@ static void showq_reasons(VSTREAM *, BOUNCE_LOG *, RCPT_BUF *, DSN_BUF *,
 
 #define STR(x)	vstring_str(x)
 
+ /*
+  * Filters from the client request. Empty strings and zero values match
+  * everything.
+  */
+typedef struct {
+    ARGV   *queues;			/* null or queue names */
+    VSTRING *sender;			/* sender address */
+    VSTRING *domain;			/* recipient domain */
+    long    min_age;			/* minimal age in seconds */
+    int     flags;			/* SHOWQ_FLAG_XXX */
+} SHOWQ_FILTER;
+
+/* showq_match_domain - find recipient in domain */
+
+static int showq_match_domain(VSTREAM *qfile, VSTRING *buf,
+			              long msg_size, const char *domain)
+{
+    off_t   saved_offset;
+    int     rec_type;
+    int     match = 0;
+    char   *at;
+
+    /*
+     * Look ahead for a matching recipient, and return to where we were, so
+     * that the caller can report this message as usual.
+     */
+    if ((saved_offset = vstream_ftell(qfile)) < 0)
+	msg_fatal("vstream_ftell file %s: %m", VSTREAM_PATH(qfile));
+    while (match == 0 && (rec_type = rec_get(qfile, buf, 0)) > 0) {
+	if (rec_type == REC_TYPE_RCPT) {
+	    match = ((at = strrchr(STR(buf), '@')) != 0
+		     && strcasecmp_utf8(at + 1, domain) == 0);
+	} else if (rec_type == REC_TYPE_MESG) {
+	    if (msg_size < 0 || vstream_fseek(qfile, msg_size, SEEK_CUR) < 0)
+		break;
+	} else if (rec_type == REC_TYPE_END) {
+	    break;
+	}
+    }
+    if (vstream_fseek(qfile, saved_offset, SEEK_SET) < 0)
+	msg_fatal("seek file %s: %m", VSTREAM_PATH(qfile));
+    return (match);
+}
+
 /* showq_report - report status of sender and recipients */
 
-static void showq_report(VSTREAM *client, char *queue, char *id,
-			         VSTREAM *qfile, long size, time_t mtime,
-			         mode_t mode)
+static int showq_report(VSTREAM *client, char *queue, char *id,
+			        VSTREAM *qfile, long size, time_t mtime,
+			        mode_t mode, SHOWQ_FILTER *filter)
 {
     VSTRING *buf = vstring_alloc(100);
     VSTRING *printable_quoted_addr = vstring_alloc(100);
@@ -190,6 +246,7 @@ static void showq_report(VSTREAM *client, char *queue, char *id,
 	    dsb_free(dsn_buf); \
 	if (dup_filter) \
 	    htable_free(dup_filter, (void (*) (void *)) 0); \
+	return (sender_seen); \
     }
 
     /*
@@ -214,6 +271,9 @@ static void showq_report(VSTREAM *client, char *queue, char *id,
 	    break;
 	case REC_TYPE_SIZE:
 	    if (msg_size_ok == 0) {
+		if (strcmp(start, REC_TYPE_SIZE_TRAILER) == 0
+		    && rec_size_trailer(qfile, buf) == REC_TYPE_SIZE)
+		    start = vstring_str(buf);
 		msg_size_ok = (start[strspn(start, "0123456789 ")] == 0
 			       && (msg_size = atol(start)) >= 0);
 		if (msg_size_ok == 0) {
@@ -227,6 +287,21 @@ static void showq_report(VSTREAM *client, char *queue, char *id,
 	case REC_TYPE_FROM:
 	    if (*start == 0)
 		start = var_empty_addr;
+
+	    /*
+	     * Apply the client's filters before reporting anything.
+	     */
+	    if (sender_seen == 0
+		&& ((filter->min_age > 0
+		     && time((time_t *) 0) - (arrival_time > 0 ? arrival_time : mtime)
+		     < filter->min_age)
+		    || (VSTRING_LEN(filter->sender) > 0
+			&& strcasecmp_utf8(start, STR(filter->sender)) != 0)
+		    || (VSTRING_LEN(filter->domain) > 0
+			&& showq_match_domain(qfile, printable_quoted_addr,
+					      msg_size_ok ? msg_size : -1,
+					      STR(filter->domain)) == 0)))
+		SHOWQ_CLEANUP_AND_RETURN;
 	    quote_822_local(printable_quoted_addr, start);
 	    /* For consistency with REC_TYPE_RCPT below. */
 	    printable(STR(printable_quoted_addr), '?');
@@ -247,6 +322,8 @@ static void showq_report(VSTREAM *client, char *queue, char *id,
 		       SEND_ATTR_STR(MAIL_ATTR_SENDER,
 				     STR(printable_quoted_addr)),
 		       ATTR_TYPE_END);
+	    if (filter->flags & SHOWQ_FLAG_BRIEF)
+		SHOWQ_CLEANUP_AND_RETURN;
 	    break;
 	case REC_TYPE_RCPT:
 	    if (sender_seen == 0) {
@@ -336,9 +413,11 @@ static void showq_reasons(VSTREAM *client, BOUNCE_LOG *bp, RCPT_BUF *rcpt_buf,
 
 static void showq_service(VSTREAM *client, char *unused_service, char **argv)
 {
+    static SHOWQ_FILTER filter;
+    VSTRING *queues;
     VSTREAM *qfile;
-    const char *path;
-    int     status;
+    int     reported;
+    int     client_gone = 0;
     char   *id;
     struct stat st;
     struct queue_info {
@@ -368,15 +447,49 @@ static void showq_service(VSTREAM *client, char *unused_service, char **argv)
     (void) attr_print(client, ATTR_FLAG_NONE,
 		      SEND_ATTR_STR(MAIL_ATTR_PROTO, MAIL_ATTR_PROTO_SHOWQ),
 		      ATTR_TYPE_END);
+    (void) vstream_fflush(client);
+
+    /*
+     * Receive the filters.
+     */
+    if (filter.sender == 0) {
+	filter.sender = vstring_alloc(100);
+	filter.domain = vstring_alloc(100);
+    }
+    queues = vstring_alloc(100);
+    if (attr_scan(client, ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_SHOWQ_QUEUES, queues),
+		  RECV_ATTR_STR(MAIL_ATTR_SHOWQ_SENDER, filter.sender),
+		  RECV_ATTR_STR(MAIL_ATTR_SHOWQ_DOMAIN, filter.domain),
+		  RECV_ATTR_LONG(MAIL_ATTR_SHOWQ_MIN_AGE, &filter.min_age),
+		  RECV_ATTR_INT(MAIL_ATTR_FLAGS, &filter.flags),
+		  ATTR_TYPE_END) != 5) {
+	msg_warn("malformed request");
+	vstring_free(queues);
+	return;
+    }
+    filter.queues = (VSTRING_LEN(queues) > 0 ?
+		     argv_split(STR(queues), CHARS_COMMA_SP) : 0);
+    vstring_free(queues);
 
     /*
      * Skip any files that have the wrong permissions. If we can't open an
      * existing file, assume the system is out of resources or that it is
      * mis-configured, and force backoff by raising a fatal error.
      */
-    for (qp = queue_info; qp->name != 0; qp++) {
-	SCAN_DIR *scan = scan_dir_open(qp->name);
+    for (qp = queue_info; qp->name != 0 && client_gone == 0; qp++) {
+	SCAN_DIR *scan;
 	char   *saved_id = 0;
+	char  **cpp;
+
+	if (filter.queues != 0) {
+	    for (cpp = filter.queues->argv; *cpp; cpp++)
+		if (strcmp(*cpp, qp->name) == 0)
+		    break;
+	    if (*cpp == 0)
+		continue;
+	}
+	scan = scan_dir_open(qp->name);
 
 	while ((id = qp->scan_next(scan)) != 0) {
 
@@ -393,24 +506,34 @@ static void showq_service(VSTREAM *client, char *unused_service, char **argv)
 		myfree(saved_id);
 	    }
 	    saved_id = mystrdup(id);
-	    status = mail_open_ok(qp->name, id, &st, &path);
-	    if (status == MAIL_OPEN_YES) {
-		if ((qfile = mail_queue_open(qp->name, id, O_RDONLY, 0)) != 0) {
-		    showq_report(client, qp->name, id, qfile, (long) st.st_size,
-				 st.st_mtime, st.st_mode);
-		    if (vstream_fclose(qfile))
-			msg_warn("close file %s %s: %m", qp->name, id);
-		} else if (errno != ENOENT) {
-		    msg_warn("open %s %s: %m", qp->name, id);
-		}
+	    reported = 0;
+	    if ((qfile = mail_open_ok_stream(qp->name, id, O_RDONLY, &st)) != 0) {
+		reported = showq_report(client, qp->name, id, qfile,
+					(long) st.st_size, st.st_mtime,
+					st.st_mode, &filter);
+		if (vstream_fclose(qfile))
+		    msg_warn("close file %s %s: %m", qp->name, id);
 	    }
 	    vstream_fflush(client);
+
+	    /*
+	     * Without output, we would not notice that the client went away.
+	     * The client sends nothing after its request, so any input means
+	     * end-of-file.
+	     */
+	    if (vstream_ferror(client)
+		|| (reported == 0 && readable(vstream_fileno(client)))) {
+		client_gone = 1;
+		break;
+	    }
 	}
 	if (saved_id)
 	    myfree(saved_id);
 	scan_dir_close(scan);
     }
     attr_print(client, ATTR_FLAG_NONE, ATTR_TYPE_END);
+    if (filter.queues)
+	filter.queues = argv_free(filter.queues);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
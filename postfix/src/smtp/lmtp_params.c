@@ -71,6 +71,8 @@
     };
     static const CONFIG_TIME_TABLE lmtp_time_table[] = {
 	VAR_LMTP_CONN_TMOUT, DEF_LMTP_CONN_TMOUT, &var_smtp_conn_tmout, 0, 0,
+	VAR_LMTP_CONN_DELAY, DEF_LMTP_CONN_DELAY, &var_smtp_conn_delay, 0, 0,
+	VAR_LMTP_DNS_CACHE_TIME, DEF_LMTP_DNS_CACHE_TIME, &var_smtp_dns_cache_time, 0, 0,
 	VAR_LMTP_HELO_TMOUT, DEF_LMTP_HELO_TMOUT, &var_smtp_helo_tmout, 1, 0,
 	VAR_LMTP_XFWD_TMOUT, DEF_LMTP_XFWD_TMOUT, &var_smtp_xfwd_tmout, 1, 0,
 	VAR_LMTP_MAIL_TMOUT, DEF_LMTP_MAIL_TMOUT, &var_smtp_mail_tmout, 1, 0,
@@ -133,6 +135,7 @@
 	VAR_LMTP_BIND_ADDR_ENFORCE, DEF_LMTP_BIND_ADDR_ENFORCE, &var_smtp_bind_addr_enforce,
 	VAR_IGN_SRV_LOOKUP_ERR, DEF_IGN_SRV_LOOKUP_ERR, &var_ign_srv_lookup_err,
 	VAR_ALLOW_SRV_FALLBACK, DEF_ALLOW_SRV_FALLBACK, &var_allow_srv_fallback,
+	VAR_LMTP_RSET_PIPELINING, DEF_LMTP_RSET_PIPELINING, &var_smtp_rset_pipelining,
 	0,
     };
     static const CONFIG_NBOOL_TABLE lmtp_nbool_table[] = {
@@ -746,6 +746,18 @@
 /*	The minimum plaintext data transfer rate in bytes/second for
 /*	DATA requests, when deadlines are enabled with smtp_per_request_deadline.
 /* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBsmtp_connection_attempt_delay (0s)\fR"
+/*	The time after which the Postfix SMTP client starts a connection
+/*	attempt to the next address with the same MX preference, while
+/*	the previous attempt is still pending; specify 0 to disable.
+/* .IP "\fBsmtp_dns_cache_ttl_limit (0s)\fR"
+/*	The maximal time that a Postfix SMTP client process caches a
+/*	successful DNS lookup result; specify 0 to disable.
+/* .IP "\fBsmtp_rset_pipelining (no)\fR"
+/*	Reset a to-be-cached connection with RSET in the same command
+/*	group as the end-of-data, and reuse it without RSET probe.
+/* .PP
 /*	Implemented in the qmgr(8) daemon:
 /* .IP "\fBtransport_destination_concurrency_limit ($default_destination_concurrency_limit)\fR"
 /*	A transport-specific override for the
@@ -1012,6 +1024,7 @@
   * by settings in the global Postfix configuration file.
   */
 int     var_smtp_conn_tmout;
+int     var_smtp_conn_delay;
 int     var_smtp_helo_tmout;
 int     var_smtp_xfwd_tmout;
 int     var_smtp_mail_tmout;
@@ -1128,6 +1141,7 @@ char   *var_smtp_dns_support;
 bool    var_smtp_dummy_mail_auth;
 char   *var_smtp_dsn_filter;
 char   *var_smtp_dns_re_filter;
+int     var_smtp_dns_cache_time;
 bool    var_smtp_balance_inet_proto;
 bool    var_smtp_req_deadline;
 int     var_smtp_min_data_rate;
@@ -1142,6 +1156,7 @@ bool    var_smtp_sasl_auth_soft_bounce;
 
 char   *var_hfrom_format;
 bool    var_smtp_bind_addr_enforce;
+bool    var_smtp_rset_pipelining;
 
  /*
   * Global variables.
@@ -1461,6 +1476,11 @@ static void post_init(char *unused_name, char **argv)
 					       var_use_srv_lookup);
 }
 
+ /*
+  * Room for the MX and address lookup results of this many destinations.
+  */
+#define SMTP_DNS_CACHE_SIZE	1000
+
 /* pre_init - pre-jail initialization */
 
 static void pre_init(char *unused_name, char **unused_argv)
@@ -1646,6 +1666,12 @@ static void pre_init(char *unused_name, char **unused_argv)
     if (*var_smtp_dns_re_filter)
 	dns_rr_filter_compile(VAR_LMTP_SMTP(DNS_RE_FILTER),
 			      var_smtp_dns_re_filter);
+
+    /*
+     * DNS lookup result cache.
+     */
+    if (var_smtp_dns_cache_time > 0)
+	dns_lookup_cache(SMTP_DNS_CACHE_SIZE, var_smtp_dns_cache_time);
 }
 
 /* pre_accept - see if tables have changed */
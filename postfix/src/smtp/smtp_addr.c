@@ -336,36 +336,39 @@ static DNS_RR *smtp_addr_list(DNS_RR *mx_names, DSN_BUF *why)
 static DNS_RR *smtp_find_self(DNS_RR *addr_list)
 {
     const char *myname = "smtp_find_self";
-    INET_ADDR_LIST *self;
-    INET_ADDR_LIST *proxy;
     DNS_RR *addr;
-    int     i;
-
-    self = own_inet_addr_list();
-    proxy = proxy_inet_addr_list();
+    struct sockaddr_storage ss;
+    struct sockaddr *sa = (struct sockaddr *) &ss;
+    SOCKADDR_SIZE salen;
 
     for (addr = addr_list; addr; addr = addr->next) {
 
+	/*
+	 * Use the indexed address lookups, instead of comparing each address
+	 * with each of our own (possibly many) interface addresses.
+	 */
+	salen = sizeof(ss);
+	if (dns_rr_to_sa(addr, 0, sa, &salen) != 0)
+	    continue;
+
 	/*
 	 * Find out if this mail system is listening on this address.
 	 */
-	for (i = 0; i < self->used; i++)
-	    if (DNS_RR_EQ_SA(addr, (struct sockaddr *) (self->addrs + i))) {
-		if (msg_verbose)
-		    msg_info("%s: found self at pref %d", myname, addr->pref);
-		return (addr);
-	    }
+	if (own_inet_addr(sa)) {
+	    if (msg_verbose)
+		msg_info("%s: found self at pref %d", myname, addr->pref);
+	    return (addr);
+	}
 
 	/*
 	 * Find out if this mail system has a proxy listening on this
 	 * address.
 	 */
-	for (i = 0; i < proxy->used; i++)
-	    if (DNS_RR_EQ_SA(addr, (struct sockaddr *) (proxy->addrs + i))) {
-		if (msg_verbose)
-		    msg_info("%s: found proxy at pref %d", myname, addr->pref);
-		return (addr);
-	    }
+	if (proxy_inet_addr(sa)) {
+	    if (msg_verbose)
+		msg_info("%s: found proxy at pref %d", myname, addr->pref);
+	    return (addr);
+	}
     }
 
     /*
@@ -34,6 +34,13 @@
 /*	suppress mail exchanger lookups.
 /*
 /*	Numerical address information should always be quoted with `[]'.
+/*
+/*	When smtp_connection_attempt_delay is non-zero, and a
+/*	connection attempt does not complete within that time, this
+/*	layer starts a connection attempt to the next address with the
+/*	same MX preference while the first attempt is still pending
+/*	(RFC 8305 style). The first connection that completes is used,
+/*	and the other pending attempts are abandoned.
 /* DIAGNOSTICS
 /*	The delivery status is the result value.
 /* SEE ALSO
@@ -74,6 +81,18 @@
 #include <fcntl.h>
 #include <ctype.h>
 
+#if defined(USE_SYSV_POLL) || defined(USE_SYSV_POLL_THEN_SELECT)
+#include <poll.h>
+#define SMTP_CAN_RACE
+#define SMTP_CONN_RACE_MAX	4	/* max parallel connection attempts */
+#endif
+
+#ifdef HAS_IPV6
+#define SMTP_RR_FAMILY(rr)	((rr)->type == T_AAAA ? AF_INET6 : AF_INET)
+#else
+#define SMTP_RR_FAMILY(rr)	AF_INET
+#endif
+
 #ifndef IPPORT_SMTP
 #define IPPORT_SMTP 25
 #endif
@@ -121,6 +140,8 @@
 static SMTP_SESSION *smtp_connect_sock(int, struct sockaddr *, int,
 				               SMTP_ITERATOR *, DSN_BUF *,
 				               int);
+static SMTP_SESSION *smtp_connect_stream(int, int, SMTP_ITERATOR *,
+					         time_t, int);
 
 /* smtp_connect_unix - connect to UNIX-domain address */
 
@@ -170,34 +191,27 @@ static SMTP_SESSION *smtp_connect_unix(SMTP_ITERATOR *iter, DSN_BUF *why,
 			      sizeof(sock_un), iter, why, sess_flags));
 }
 
-/* smtp_connect_addr - connect to explicit address */
+/* smtp_addr_sock - create and bind socket for explicit address */
 
-static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
-				               int sess_flags)
+static int smtp_addr_sock(DNS_RR *addr, unsigned port, struct sockaddr *sa,
+			          SOCKADDR_SIZE *salen, DSN_BUF *why)
 {
-    const char *myname = "smtp_connect_addr";
-    struct sockaddr_storage ss;		/* remote */
-    struct sockaddr *sa = (struct sockaddr *) &ss;
-    SOCKADDR_SIZE salen = sizeof(ss);
+    const char *myname = "smtp_addr_sock";
     MAI_HOSTADDR_STR hostaddr;
-    DNS_RR *addr = iter->rr;
-    unsigned port = iter->port;
     int     sock;
     char   *bind_addr;
     char   *bind_var;
     char   *saved_bind_addr = 0;
     char   *tail;
 
-    dsb_reset(why);				/* Paranoia */
-
     /*
      * Sanity checks.
      */
-    if (dns_rr_to_sa(addr, port, sa, &salen) != 0) {
+    if (dns_rr_to_sa(addr, port, sa, salen) != 0) {
 	msg_warn("%s: skip address type %s: %m",
 		 myname, dns_strtype(addr->type));
 	dsb_simple(why, "4.4.0", "network address conversion failed: %m");
-	return (0);
+	return (-1);
     }
 
     /*
@@ -210,7 +224,7 @@ static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
 	if (saved_bind_addr) \
 	    myfree(saved_bind_addr); \
 	(void) close(sock); \
-	return (0); \
+	return (-1); \
     } while (0)
 
     if (inet_windowsize > 0)
@@ -291,6 +305,28 @@ static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
 	    }
 	}
     }
+    return (sock);
+}
+
+/* smtp_connect_addr - connect to explicit address */
+
+static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
+				               int sess_flags)
+{
+    const char *myname = "smtp_connect_addr";
+    struct sockaddr_storage ss;		/* remote */
+    struct sockaddr *sa = (struct sockaddr *) &ss;
+    SOCKADDR_SIZE salen = sizeof(ss);
+    unsigned port = iter->port;
+    int     sock;
+
+    dsb_reset(why);				/* Paranoia */
+
+    /*
+     * Initialize.
+     */
+    if ((sock = smtp_addr_sock(iter->rr, port, sa, &salen, why)) < 0)
+	return (0);
 
     /*
      * Connect to the server.
@@ -302,6 +338,197 @@ static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
     return (smtp_connect_sock(sock, sa, salen, iter, why, sess_flags));
 }
 
+#ifdef SMTP_CAN_RACE
+
+ /*
+  * Each failed attempt overwrites the failure reason. Log the previous
+  * reason first. Our caller logs the last one.
+  */
+#define SMTP_RACE_LOG(why, unlogged) do { \
+	if (*(unlogged)) { \
+	    msg_info("%s", STR((why)->reason)); \
+	    *(unlogged) = 0; \
+	} \
+    } while (0)
+
+/* smtp_race_fail - record failed connection attempt */
+
+static void smtp_race_fail(DNS_RR *addr, unsigned port, DSN_BUF *why,
+			           int *unlogged)
+{
+    MAI_HOSTADDR_STR hostaddr;
+    int     saved_errno = errno;
+
+    SMTP_RACE_LOG(why, unlogged);
+    *unlogged = 1;
+    if (dns_rr_to_pa(addr, &hostaddr) == 0)
+	strncpy(hostaddr.buf, "unknown", sizeof(hostaddr.buf));
+    errno = saved_errno;
+    dsb_simple(why, "4.4.1", "connect to %s[%s]:%d: %m",
+	       SMTP_HNAME(addr), hostaddr.buf, ntohs(port));
+}
+
+/* smtp_connect_race - staggered connection attempts */
+
+static int smtp_connect_race(DNS_RR **addr_list, DNS_RR **addrp,
+			             int limit, unsigned port,
+			             DSN_BUF *why, int *tried)
+{
+    const char *myname = "smtp_connect_race";
+    DNS_RR *addr = *addrp;
+    DNS_RR *rr[SMTP_CONN_RACE_MAX];
+    struct pollfd pfd[SMTP_CONN_RACE_MAX];
+    struct sockaddr_storage ss;
+    struct sockaddr *sa = (struct sockaddr *) &ss;
+    SOCKADDR_SIZE salen;
+    DNS_RR **linkp;
+    time_t  now;
+    time_t  deadline;
+    time_t  next_start;
+    int     wait_time;
+    int     started;
+    int     pending;
+    int     unlogged = 0;
+    int     winner = -1;
+    int     sock;
+    int     error;
+    SOCKOPT_SIZE error_len;
+    int     n;
+    int     i;
+
+    /*
+     * Race only the addresses that have the same MX preference as the
+     * current address, within the limit for the number of addresses that
+     * we may try. Addresses are sorted by preference.
+     */
+    *tried = 0;
+    for (rr[0] = addr, n = 1; n < SMTP_CONN_RACE_MAX && n < limit
+	 && rr[n - 1]->next != 0 && rr[n - 1]->next->pref == addr->pref; n++)
+	rr[n] = rr[n - 1]->next;
+    if (n < 2)
+	return (-1);
+
+    now = time((time_t *) 0);
+    deadline = now + var_smtp_conn_tmout;
+    next_start = now;
+    for (started = pending = 0; /* void */ ; /* void */ ) {
+
+	/*
+	 * Start the next connection attempt when the previous one did not
+	 * complete in time, or when all pending attempts have failed.
+	 */
+	if (started < n && (pending == 0 || now >= next_start)) {
+	    pfd[started].fd = -1;
+	    pfd[started].events = POLLOUT;
+	    pfd[started].revents = 0;
+	    salen = sizeof(ss);
+	    SMTP_RACE_LOG(why, &unlogged);
+	    if ((sock = smtp_addr_sock(rr[started], port, sa, &salen, why)) < 0) {
+		unlogged = 1;
+	    } else {
+		if (msg_verbose)
+		    msg_info("%s: trying: %s port %d...",
+			     myname, SMTP_HNAME(rr[started]), ntohs(port));
+		non_blocking(sock, NON_BLOCKING);
+		if (sane_connect(sock, sa, salen) == 0) {
+		    winner = started;
+		    pfd[started++].fd = sock;
+		    break;
+		} else if (errno == EINPROGRESS) {
+		    pfd[started].fd = sock;
+		    pending++;
+		} else {
+		    smtp_race_fail(rr[started], port, why, &unlogged);
+		    (void) close(sock);
+		}
+	    }
+	    started++;
+	    next_start = now + var_smtp_conn_delay;
+	    continue;
+	}
+	if (pending == 0)
+	    break;
+
+	/*
+	 * Wait until a pending attempt completes, until it is time to start
+	 * the next attempt, or until the connect time limit.
+	 */
+	if (var_smtp_conn_tmout > 0 && now >= deadline) {
+	    for (i = 0; i < started; i++) {
+		if (pfd[i].fd >= 0) {
+		    errno = ETIMEDOUT;
+		    smtp_race_fail(rr[i], port, why, &unlogged);
+		    (void) close(pfd[i].fd);
+		    pfd[i].fd = -1;
+		}
+	    }
+	    break;
+	}
+	wait_time = (started < n ? next_start - now :
+		     var_smtp_conn_tmout > 0 ? deadline - now : -1);
+	if (var_smtp_conn_tmout > 0 && deadline - now < wait_time)
+	    wait_time = deadline - now;
+	if (poll(pfd, started, wait_time < 0 ? -1 : wait_time * 1000) < 0) {
+	    if (errno != EINTR)
+		msg_fatal("%s: poll: %m", myname);
+	    now = time((time_t *) 0);
+	    continue;
+	}
+	for (i = 0; i < started; i++) {
+	    if (pfd[i].fd < 0 || pfd[i].revents == 0)
+		continue;
+	    error = 0;
+	    error_len = sizeof(error);
+	    if (getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR,
+			   (void *) &error, &error_len) < 0)
+		error = errno;
+	    if (error == 0) {
+		winner = i;
+		break;
+	    }
+	    errno = error;
+	    smtp_race_fail(rr[i], port, why, &unlogged);
+	    (void) close(pfd[i].fd);
+	    pfd[i].fd = -1;
+	    pending--;
+	}
+	if (winner >= 0)
+	    break;
+	now = time((time_t *) 0);
+    }
+
+    /*
+     * All attempts failed. The caller logs the last failure reason.
+     */
+    if (winner < 0) {
+	*tried = n;
+	return (-1);
+    }
+
+    /*
+     * Abandon the other pending attempts, and move the winner in front of
+     * the addresses that it raced against, so that those will be tried
+     * later as usual.
+     */
+    SMTP_RACE_LOG(why, &unlogged);
+    dsb_reset(why);
+    for (i = 0; i < started; i++)
+	if (i != winner && pfd[i].fd >= 0)
+	    (void) close(pfd[i].fd);
+    sock = pfd[winner].fd;
+    non_blocking(sock, BLOCKING);
+    if (winner > 0) {
+	for (linkp = addr_list; *linkp != addr; linkp = &(*linkp)->next)
+	     /* void */ ;
+	rr[winner - 1]->next = rr[winner]->next;
+	rr[winner]->next = addr;
+	*linkp = *addrp = rr[winner];
+    }
+    return (sock);
+}
+
+#endif
+
 /* smtp_connect_sock - connect a socket over some transport */
 
 static SMTP_SESSION *smtp_connect_sock(int sock, struct sockaddr *sa,
@@ -312,7 +539,6 @@ static SMTP_SESSION *smtp_connect_sock(int sock, struct sockaddr *sa,
 {
     int     conn_stat;
     int     saved_errno;
-    VSTREAM *stream;
     time_t  start_time;
     const char *name = STR(iter->host);
     const char *addr = STR(iter->addr);
@@ -337,14 +563,27 @@ static SMTP_SESSION *smtp_connect_sock(int sock, struct sockaddr *sa,
 	close(sock);
 	return (0);
     }
+    return (smtp_connect_stream(sock, sa->sa_family, iter, start_time,
+				sess_flags));
+}
+
+/* smtp_connect_stream - bundle up connected socket */
+
+static SMTP_SESSION *smtp_connect_stream(int sock, int family,
+					         SMTP_ITERATOR *iter,
+					         time_t start_time,
+					         int sess_flags)
+{
+    VSTREAM *stream;
+
     stream = vstream_fdopen(sock, O_RDWR);
 
     /*
      * Avoid poor performance when TCP MSS > VSTREAM_BUFSIZE.
      */
-    if (sa->sa_family == AF_INET
+    if (family == AF_INET
 #ifdef AF_INET6
-	|| sa->sa_family == AF_INET6
+	|| family == AF_INET6
 #endif
 	)
 	vstream_tweak_tcp(stream);
@@ -863,6 +1102,9 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	DNS_RR *addr_list;
 	DNS_RR *addr;
 	DNS_RR *next;
+	int     race_sock = -1;
+	int     race_tried;
+	time_t  race_start;
 	int     addr_count;
 	int     sess_count;
 	SMTP_SESSION *session;
@@ -1037,9 +1279,47 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	 * guaranteed not to use TLS.
 	 */
 	for (addr = addr_list; SMTP_RCPT_LEFT(state) > 0 && addr; addr = next) {
+	    if (race_sock >= 0) {
+		(void) close(race_sock);
+		race_sock = -1;
+	    }
 	    next = addr->next;
 	    if (++addr_count == var_smtp_mxaddr_limit)
 		next = 0;
+#ifdef SMTP_CAN_RACE
+
+	    /*
+	     * Staggered connection attempts to addresses with the same MX
+	     * preference. The winner is moved in front of the addresses
+	     * that it raced against. Don't race when we would retry the
+	     * same address, or when we may reuse a cached connection.
+	     */
+	    if (var_smtp_conn_delay > 0 && next != 0
+#ifdef USE_TLS
+		&& retry_plain == 0
+#endif
+		&& ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
+		    || addr->pref == domain_best_pref)) {
+		race_start = time((time_t *) 0);
+		if ((race_sock = smtp_connect_race(&addr_list, &addr,
+						   var_smtp_mxaddr_limit > 0 ?
+				       var_smtp_mxaddr_limit - addr_count + 1 :
+						   SMTP_CONN_RACE_MAX,
+						   iter->port, why,
+						   &race_tried)) >= 0) {
+		    next = addr->next;
+		} else if (race_tried > 0) {
+		    /* The reason already includes the IP address and TCP port. */
+		    msg_info("%s", STR(why->reason));
+		    while (--race_tried > 0 && next != 0) {
+			next = next->next;
+			if (++addr_count == var_smtp_mxaddr_limit)
+			    next = 0;
+		    }
+		    continue;
+		}
+	    }
+#endif
 	    if (dns_rr_to_pa(addr, &hostaddr) == 0) {
 		msg_warn("cannot convert type %s record to printable address",
 			 dns_strtype(addr->type));
@@ -1070,8 +1350,16 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
 		|| addr->pref == domain_best_pref
 		|| !(session = smtp_reuse_addr(state,
-					  SMTP_KEY_MASK_SCACHE_ENDP_LABEL)))
-		session = smtp_connect_addr(iter, why, state->misc_flags);
+					  SMTP_KEY_MASK_SCACHE_ENDP_LABEL))) {
+		if (race_sock >= 0) {
+		    session = smtp_connect_stream(race_sock,
+						  SMTP_RR_FAMILY(addr),
+						  iter, race_start,
+						  state->misc_flags);
+		    race_sock = -1;
+		} else
+		    session = smtp_connect_addr(iter, why, state->misc_flags);
+	    }
 	    if ((state->session = session) != 0) {
 		session->state = state;
 #ifdef USE_TLS
@@ -1135,6 +1423,8 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	    }
 	    /* XXX Code above assumes there is no code at this loop ending. */
 	}
+	if (race_sock >= 0)
+	    (void) close(race_sock);
 	dns_rr_free(addr_list);
 	if (iter->mx) {
 	    dns_rr_free(iter->mx);
@@ -72,6 +72,8 @@
     };
     static const CONFIG_TIME_TABLE smtp_time_table[] = {
 	VAR_SMTP_CONN_TMOUT, DEF_SMTP_CONN_TMOUT, &var_smtp_conn_tmout, 0, 0,
+	VAR_SMTP_CONN_DELAY, DEF_SMTP_CONN_DELAY, &var_smtp_conn_delay, 0, 0,
+	VAR_SMTP_DNS_CACHE_TIME, DEF_SMTP_DNS_CACHE_TIME, &var_smtp_dns_cache_time, 0, 0,
 	VAR_SMTP_HELO_TMOUT, DEF_SMTP_HELO_TMOUT, &var_smtp_helo_tmout, 1, 0,
 	VAR_SMTP_XFWD_TMOUT, DEF_SMTP_XFWD_TMOUT, &var_smtp_xfwd_tmout, 1, 0,
 	VAR_SMTP_MAIL_TMOUT, DEF_SMTP_MAIL_TMOUT, &var_smtp_mail_tmout, 1, 0,
@@ -137,6 +139,7 @@
 	VAR_SMTP_BIND_ADDR_ENFORCE, DEF_SMTP_BIND_ADDR_ENFORCE, &var_smtp_bind_addr_enforce,
 	VAR_IGN_SRV_LOOKUP_ERR, DEF_IGN_SRV_LOOKUP_ERR, &var_ign_srv_lookup_err,
 	VAR_ALLOW_SRV_FALLBACK, DEF_ALLOW_SRV_FALLBACK, &var_allow_srv_fallback,
+	VAR_SMTP_RSET_PIPELINING, DEF_SMTP_RSET_PIPELINING, &var_smtp_rset_pipelining,
 	0,
     };
     static const CONFIG_NBOOL_TABLE smtp_nbool_table[] = {
@@ -173,6 +173,10 @@
   * RSET probe should be sent before attempting to reuse an open connection
   * for a new transaction.
   * 
+  * With smtp_rset_pipelining, such sessions proceed as
+  * MAIL->RCPT->DATA->DOT->RSET->LAST, where RSET is sent together with the
+  * end-of-data, and the RSET probe is skipped when the session is reused.
+  * 
   * The code to send an RSET probe is a special case with its own initial state
   * and with its own dedicated state transitions. The session proceeds as
   * RSET->LAST. This code is kept inside the main protocol engine for
@@ -1483,6 +1487,7 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
     int     rec_type;
     NOCLOBBER int prev_type = 0;
     NOCLOBBER int mail_from_rejected;
+    NOCLOBBER int pipelined_rset = 0;
     NOCLOBBER int downgrading;
     int     mime_errs;
     SMTP_RESP fake;
@@ -1820,6 +1825,17 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		DONT_CACHE_THIS_SESSION;
 	    next_state = THIS_SESSION_IS_CACHED ?
 		SMTP_STATE_LAST : SMTP_STATE_QUIT;
+
+	    /*
+	     * Reset a to-be-cached session in the same command group as the
+	     * end-of-data (RFC 2920 section 3.1), so that the next delivery
+	     * can skip the RSET probe.
+	     */
+	    if (next_state == SMTP_STATE_LAST && var_smtp_rset_pipelining
+		&& (session->features & SMTP_FEATURE_PIPELINING)) {
+		pipelined_rset = 1;
+		next_state = SMTP_STATE_RSET;
+	    }
 	    break;
 
 	    /*
@@ -2188,8 +2204,10 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		     * otherwise the sender and receiver loops get out of
 		     * sync. The caller will call smtp_quit() if appropriate.
 		     */
-		    if (var_skip_quit_resp || THIS_SESSION_IS_CACHED
-			|| LOST_CONNECTION_INSIDE_DATA)
+		    if (pipelined_rset && !LOST_CONNECTION_INSIDE_DATA)
+			recv_state = SMTP_STATE_RSET;
+		    else if (var_skip_quit_resp || THIS_SESSION_IS_CACHED
+			     || LOST_CONNECTION_INSIDE_DATA)
 			recv_state = SMTP_STATE_LAST;
 		    else
 			recv_state = SMTP_STATE_QUIT;
@@ -2224,6 +2242,8 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 		case SMTP_STATE_RSET:
 		    if (resp->code / 100 != 2)
 			CANT_RSET_THIS_SESSION;
+		    else if (pipelined_rset)
+			session->features |= SMTP_FEATURE_RSET_DONE;
 		    recv_state = SMTP_STATE_LAST;
 		    break;
 
@@ -2282,6 +2302,17 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 	    smtp_stream_setup(session->stream, var_smtp_data1_tmout,
 			      var_smtp_req_deadline, var_smtp_min_data_rate);
 
+	    /*
+	     * Send message content through a large buffer, so that a large
+	     * message needs fewer write(2) or TLS write calls. The stream
+	     * buffer size can only grow, and the queue file is already read
+	     * through a buffer of this size.
+	     */
+	    if (var_msg_stream_bufsize > 0)
+		vstream_control(session->stream,
+		      CA_VSTREAM_CTL_BUFSIZE((ssize_t) var_msg_stream_bufsize),
+				CA_VSTREAM_CTL_END);
+
 	    if ((except = vstream_setjmp(session->stream)) == 0) {
 
 		if (vstream_fseek(state->src, request->data_offset, SEEK_SET) < 0)
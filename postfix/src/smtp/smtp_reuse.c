@@ -44,6 +44,11 @@
 /*	MX" bit, and does not override the iterator dest, host and
 /*	addr fields. The result is null in case of failure.
 /*
+/*	A session that was reset in the same command group as the
+/*	previous end-of-data (see smtp_rset_pipelining) is not
+/*	probed with RSET. Instead, it is discarded when the server
+/*	has sent data or closed the connection while it was cached.
+/*
 /*	Arguments:
 /* .IP state
 /*	SMTP client state, including the current session, the original
@@ -89,6 +94,7 @@
 #include <vstring.h>
 #include <htable.h>
 #include <stringops.h>
+#include <iostuff.h>
 
 /* Global library. */
 
@@ -191,9 +197,21 @@ static SMTP_SESSION *smtp_reuse_common(SMTP_STATE *state, int fd,
     session->state = state;
 
     /*
-     * Send an RSET probe to verify that the session is still good.
+     * Send an RSET probe to verify that the session is still good. Skip the
+     * probe if the session was already reset after the previous delivery,
+     * and the server has not sent anything since (typically, a 421 reply
+     * or a disconnect).
      */
-    if (smtp_rset(state) < 0
+    if ((session->features & SMTP_FEATURE_RSET_DONE) != 0) {
+	session->features &= ~SMTP_FEATURE_RSET_DONE;
+	if (readable(vstream_fileno(session->stream))) {
+	    if (msg_verbose)
+		msg_info("%s: %s: server sent data or closed connection",
+			 myname, label);
+	    smtp_session_free(session);
+	    return (state->session = 0);
+	}
+    } else if (smtp_rset(state) < 0
 	|| (session->features & SMTP_FEATURE_RSET_REJECTED) != 0) {
 	smtp_session_free(session);
 	return (state->session = 0);
@@ -285,6 +285,16 @@
 /* .IP "\fBsmtpd_milter_maps (empty)\fR"
 /*	Lookup tables with Milter settings per remote SMTP client IP
 /*	address.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBmilter_parallel_events (no)\fR"
+/*	Send each event to all Milter applications before receiving
+/*	their replies, so that the Milter latency is that of the
+/*	slowest application instead of the sum.
+/* .IP "\fBmilter_connection_reuse (no)\fR"
+/*	Keep a connection to a Milter application open after the end
+/*	of an SMTP session or message, and use it again for the next
+/*	one.
 /* GENERAL CONTENT INSPECTION CONTROLS
 /* .ad
 /* .fi
@@ -642,6 +652,11 @@
 /*	Enable logging of the named "permit" actions in SMTP server
 /*	access lists (by default, the SMTP server logs "reject" actions but
 /*	not "permit" actions).
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBsmtpd_session_shape_logging (no)\fR"
+/*	Log the shape of each SMTP session, without addresses, names
+/*	or message content, for replay with smtp-replay(1).
 /* KNOWN VERSUS UNKNOWN RECIPIENT CONTROLS
 /* .ad
 /* .fi
@@ -724,6 +739,13 @@
 /*	The Postfix SMTP server reply code when a recipient address matches
 /*	$virtual_mailbox_domains, and $virtual_mailbox_maps specifies a list
 /*	of lookup tables that does not match the recipient address.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBsmtpd_recipient_filter_maps (empty)\fR"
+/*	Optional lookup tables, typically a \fBbloom\fR:\fIfile\fR
+/*	filter, that list every recipient address that the other
+/*	recipient tables could accept; a recipient that is not found
+/*	is rejected as unknown without querying those tables.
 /* RESOURCE AND RATE CONTROLS
 /* .ad
 /* .fi
@@ -756,6 +778,17 @@
 /*	Attempt to look up the remote SMTP client hostname, and verify that
 /*	the name matches the client IP address.
 /* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBsmtpd_peername_cache_map (empty)\fR"
+/*	Optional table that is shared by Postfix SMTP server processes
+/*	to remember remote SMTP client hostname lookup results.
+/* .IP "\fBsmtpd_peername_cache_ttl (3600s)\fR"
+/*	How long a successful or permanently failed client hostname
+/*	lookup result is used from the smtpd_peername_cache_map.
+/* .IP "\fBsmtpd_peername_cache_temp_ttl (60s)\fR"
+/*	How long a temporarily failed client hostname lookup result
+/*	is used from the smtpd_peername_cache_map.
+/* .PP
 /*	The per SMTP client connection count and request rate limits are
 /*	implemented in co-operation with the \fBanvil\fR(8) service, and
 /*	are available in Postfix version 2.2 and later.
@@ -822,6 +855,11 @@
 /* .IP "\fBsmtpd_forbid_unauth_pipelining (Postfix >= 3.9: yes)\fR"
 /*	Disconnect remote SMTP clients that violate RFC 2920 (or 5321)
 /*	command pipelining constraints.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBmessage_stream_buffer_size (65536)\fR"
+/*	The I/O buffer size in bytes for message content, including
+/*	large BDAT chunks that the Postfix SMTP server receives.
 /* TARPIT CONTROLS
 /* .ad
 /* .fi
@@ -830,7 +868,7 @@
 /*	run-away software.  The behavior is controlled by an error counter
 /*	that counts the number of errors within an SMTP session that a
 /*	client makes without delivering mail.
-/* .IP "\fBsmtpd_error_sleep_time (1s)\fR"
+/* .IP "\fBsmtpd_error_sleep_time (normal: 1s, overload: 0s)\fR"
 /*	With Postfix version 2.1 and later: the SMTP server response delay after
 /*	a client has made more than $smtpd_soft_error_limit errors, and
 /*	fewer than $smtpd_hard_error_limit errors, without delivering mail.
@@ -976,7 +1014,7 @@
 /*	How many times to query the \fBverify\fR(8) service for the completion
 /*	of an address verification request in progress.
 /* .IP "\fBaddress_verify_poll_delay (3s)\fR"
-/*	The delay between queries for the completion of an address
+/*	The maximal delay between queries for the completion of an address
 /*	verification request in progress.
 /* .IP "\fBaddress_verify_sender ($double_bounce_sender)\fR"
 /*	The sender address to use in address verification probes; prior
@@ -1084,6 +1122,13 @@
 /*	The Postfix SMTP server's action when reject_unknown_sender_domain
 /*	or reject_unknown_recipient_domain fail due to a temporary error
 /*	condition.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBsmtpd_dnsbl_prefetch (no)\fR"
+/*	Look up all DNS allow/deny lists in a restriction list in
+/*	parallel, before the restrictions are evaluated.
+/* .IP "\fBsmtpd_dnsbl_prefetch_timeout (5s)\fR"
+/*	The time limit for smtpd_dnsbl_prefetch lookups.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -1157,6 +1202,11 @@
 /* .IP "\fBsmtpd_reject_footer_maps (empty)\fR"
 /*	Lookup tables, indexed by the complete Postfix SMTP server 4xx or
 /*	5xx response, with reject footer templates.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBsmtpd_session_time_logging (no)\fR"
+/*	Enable logging of the time spent in each SMTP session phase,
+/*	at the end of the "disconnect from" record.
 /* SEE ALSO
 /*	anvil(8), connection/rate limiting
 /*	cleanup(8), message canonicalization
@@ -1259,6 +1309,7 @@
 #include <split_at.h>
 #include <name_code.h>
 #include <inet_proto.h>
+#include <format_tv.h>
 
 /* Global library. */
 
@@ -1299,6 +1350,8 @@
 #include <normalize_mailhost_addr.h>
 #include <info_log_addr_form.h>
 #include <hfrom_format.h>
+#include <metrics_clnt.h>
+#include <mail_priority.h>
 
 /* Single-threaded server skeleton. */
 
@@ -1406,6 +1459,7 @@ char   *var_unv_from_why;
 char   *var_unv_rcpt_why;
 int     var_mul_rcpt_code;
 char   *var_relay_rcpt_maps;
+char   *var_smtpd_rcpt_filter_maps;
 int     var_local_rcpt_code;
 int     var_virt_alias_code;
 int     var_virt_mailbox_code;
@@ -1490,6 +1544,9 @@ int     var_smtpd_tls_enable_rpk;
 #endif
 
 bool    var_smtpd_peername_lookup;
+char   *var_smtpd_peer_cache_map;
+int     var_smtpd_peer_cache_ttl;
+int     var_smtpd_peer_cache_temp_ttl;
 int     var_plaintext_code;
 bool    var_smtpd_delay_open;
 char   *var_smtpd_milters;
@@ -1511,7 +1568,9 @@ char   *var_milt_eod_macros;
 char   *var_milt_unk_macros;
 char   *var_milt_macro_deflts;
 bool    var_smtpd_client_port_log;
+bool    var_smtpd_sess_time_log;
 bool    var_smtpd_forbid_unauth_pipe;
+bool    var_smtpd_shape_log;
 char   *var_stress;
 
 char   *var_reject_tmpf_act;
@@ -1531,6 +1590,8 @@ char   *var_smtpd_uproxy_proto;
 int     var_smtpd_uproxy_tmout;
 bool    var_relay_before_rcpt_checks;
 bool    var_smtpd_req_deadline;
+bool    var_smtpd_dnsbl_prefetch;
+int     var_smtpd_dnsbl_pf_tmout;
 int     var_smtpd_min_data_rate;
 char   *var_hfrom_format;
 
@@ -1549,6 +1610,8 @@ static MAPS *ehlo_discard_maps;
   * Per-client Milter support.
   */
 static MAPS *smtpd_milter_maps;
+static MILTERS *smtpd_idle_milters;	/* milter_connection_reuse */
+static char *smtpd_idle_milter_string;
 static void setup_milters(SMTPD_STATE *);
 static void teardown_milters(SMTPD_STATE *);
 
@@ -1665,6 +1728,31 @@ static int sasl_client_exception(SMTPD_STATE *state)
 
 #endif
 
+/* smtpd_time_add - add elapsed time since start to running total */
+
+static void smtpd_time_add(struct timeval *total, struct timeval *start)
+{
+    struct timeval now;
+
+    /*
+     * XXX Apparently, Solaris gettimeofday() can return out-of-range
+     * microsecond values.
+     */
+    GETTIMEOFDAY(&now);
+    total->tv_sec += now.tv_sec - start->tv_sec;
+    total->tv_usec += now.tv_usec - start->tv_usec;
+    while (total->tv_usec < 0) {
+	total->tv_usec += 1000000;
+	total->tv_sec -= 1;
+    }
+    while (total->tv_usec >= 1000000) {
+	total->tv_usec -= 1000000;
+	total->tv_sec += 1;
+    }
+    if (total->tv_sec < 0)
+	total->tv_sec = total->tv_usec = 0;
+}
+
 /* smtpd_whatsup - gather available evidence for logging */
 
 static const char *smtpd_whatsup(SMTPD_STATE *state)
@@ -2273,6 +2361,15 @@ static int mail_open_stream(SMTPD_STATE *state)
 	    rec_fprintf(state->cleanup, REC_TYPE_ATTR, "%s=%s",
 			MAIL_ATTR_LOG_PROTO_NAME, FORWARD_PROTO(state));
 
+	    /*
+	     * Start of the session, for per-message stage timing.
+	     */
+	    if (var_stage_timing)
+		rec_fprintf(state->cleanup, REC_TYPE_ATTR, "%s=%ld.%06ld",
+			    MAIL_ATTR_STAGE_CONNECT,
+			    (long) state->session_start.tv_sec,
+			    (long) state->session_start.tv_usec);
+
 	    /*
 	     * Attributes with actual client information. These are used by
 	     * the smtpd Milter client for policy decisions. Mail that is
@@ -2379,6 +2476,31 @@ static int extract_addr(SMTPD_STATE *state, SMTPD_TOKEN *arg,
      */
     if (msg_verbose)
 	msg_info("%s: input: %s", myname, STR(arg->vstrval));
+
+    /*
+     * Fast path: a plain <local-part@domain> address needs no parser. Its
+     * internal form is the same as its external form.
+     */
+    if (LEN(arg->vstrval) > 2
+	&& STR(arg->vstrval)[0] == '<'
+	&& STR(arg->vstrval)[LEN(arg->vstrval) - 1] == '>'
+	&& tok822_simple_addr(STR(arg->vstrval) + 1, LEN(arg->vstrval) - 2)) {
+	vstring_strncpy(state->addr_buf, STR(arg->vstrval) + 1,
+			LEN(arg->vstrval) - 2);
+	if (SMTPD_STAND_ALONE(state) == 0
+	    && smtpd_check_addr(strcmp(state->where, SMTPD_CMD_MAIL) == 0 ?
+				state->recipient : state->sender,
+				STR(state->addr_buf), smtputf8) != 0) {
+	    msg_warn("Illegal address syntax from %s in %s command: %s",
+		     state->namaddr, state->where,
+		     printable(STR(arg->vstrval), '?'));
+	    err = 1;
+	}
+	if (msg_verbose)
+	    msg_info("%s: in: %s, result: %s",
+		     myname, STR(arg->vstrval), STR(state->addr_buf));
+	return (err);
+    }
     if (STR(arg->vstrval)[0] == '<'
 	&& STR(arg->vstrval)[LEN(arg->vstrval) - 1] == '>') {
 	junk = text = mystrndup(STR(arg->vstrval) + 1, LEN(arg->vstrval) - 2);
@@ -2845,6 +2967,7 @@ static void mail_reset(SMTPD_STATE *state)
 	state->saved_bcc = 0;
     }
     state->saved_flags = 0;
+    state->saved_priority = 0;
 #ifdef DELAY_ACTION
     state->saved_delay = 0;
 #endif
@@ -3586,6 +3709,8 @@ static void receive_data_message(SMTPD_STATE *state,
     int     curr_rec_type;
     int     prev_rec_type;
     int     first = 1;
+    int     in_header = 1;
+    int     header_count = 0;
 
     /*
      * If deadlines are enabled, increase the time budget as message content
@@ -3627,6 +3752,12 @@ static void receive_data_message(SMTPD_STATE *state,
 	if (prev_rec_type != REC_TYPE_CONT && *start == '.'
 	    && (proxy == 0 ? (++start, --len) == 0 : len == 1))
 	    break;
+	if (in_header && prev_rec_type != REC_TYPE_CONT) {
+	    if (len == 0)
+		in_header = 0;
+	    else if (!IS_SPACE_TAB(*start))
+		header_count++;
+	}
 	if (state->err == CLEANUP_STAT_OK) {
 	    if (ENFORCING_SIZE_LIMIT(var_message_limit)
 		&& var_message_limit - state->act_size < len + 2) {
@@ -3641,6 +3772,11 @@ static void receive_data_message(SMTPD_STATE *state,
 	}
     }
     state->where = SMTPD_AFTER_EOM;
+    if (state->shape) {
+	GETTIMEOFDAY(&state->shape_query);
+	smtpd_chat_shape(state, ".:%ld:%d", (long) state->act_size,
+			 header_count);
+    }
 }
 
 /* common_post_message_handling - commit message or report error */
@@ -3652,6 +3788,7 @@ static int common_post_message_handling(SMTPD_STATE *state)
     VSTRING *why = 0;
     int     saved_err;
     const CLEANUP_STAT_DETAIL *detail;
+    struct timeval start;
 
 #define IS_SMTP_REJECT(s) \
 	(((s)[0] == '4' || (s)[0] == '5') \
@@ -3676,6 +3813,7 @@ static int common_post_message_handling(SMTPD_STATE *state)
      * Send the end of DATA and finish the proxy connection. Set the
      * CLEANUP_STAT_PROXY error flag in case of trouble.
      */
+    GETTIMEOFDAY(&start);
     if (proxy) {
 	if (state->err == CLEANUP_STAT_OK) {
 	    (void) proxy->cmd(state, SMTPD_PROX_WANT_ANY, ".");
@@ -3713,6 +3851,10 @@ static int common_post_message_handling(SMTPD_STATE *state)
 	    if (state->saved_flags)
 		rec_fprintf(state->cleanup, REC_TYPE_FLGS, "%d",
 			    state->saved_flags);
+	    if (state->saved_priority)
+		rec_fprintf(state->cleanup, REC_TYPE_ATTR, "%s=%s",
+			    MAIL_ATTR_PRIORITY,
+			    str_mail_priority(state->saved_priority));
 #ifdef DELAY_ACTION
 	    if (state->saved_delay)
 		rec_fprintf(state->cleanup, REC_TYPE_DELAY, "%d",
@@ -3737,6 +3879,7 @@ static int common_post_message_handling(SMTPD_STATE *state)
 	state->dest = 0;
 	state->cleanup = 0;
     }
+    smtpd_time_add(&state->commit_time, &start);
 
     /*
      * XXX If we lose the cleanup server while it is editing a queue file,
@@ -3770,6 +3913,7 @@ static int common_post_message_handling(SMTPD_STATE *state)
 	state->error_count = 0;
 	state->error_mask = 0;
 	state->junk_cmds = 0;
+	metrics_count("postfix_smtpd_messages_total", 1, (char *) 0);
 	if (proxy)
 	    smtpd_chat_reply(state, "%s", STR(proxy->reply));
 	else if (SMTPD_PROCESSING_BDAT(state))
@@ -3856,6 +4000,10 @@ static int common_post_message_handling(SMTPD_STATE *state)
 
 /* skip_bdat - skip content and respond to BDAT error */
 
+#define SMTPD_BDAT_FRAG_SIZE \
+	(var_msg_stream_bufsize > VSTREAM_BUFSIZE ? \
+	 (ssize_t) var_msg_stream_bufsize : VSTREAM_BUFSIZE)
+
 static int skip_bdat(SMTPD_STATE *state, off_t chunk_size,
 		             bool final_chunk, const char *format,...)
 {
@@ -3868,8 +4016,8 @@ static int skip_bdat(SMTPD_STATE *state, off_t chunk_size,
      * connection in case of overload.
      */
     for (done = 0; done < chunk_size; done += len) {
-	if ((len = chunk_size - done) > VSTREAM_BUFSIZE)
-	    len = VSTREAM_BUFSIZE;
+	if ((len = chunk_size - done) > SMTPD_BDAT_FRAG_SIZE)
+	    len = SMTPD_BDAT_FRAG_SIZE;
 	smtp_fread_buf(state->buffer, len, state->client);
     }
 
@@ -3907,6 +4055,7 @@ static int bdat_cmd(SMTPD_STATE *state, int argc, SMTPD_TOKEN *argv)
     int     (*out_fprintf) (VSTREAM *, int, const char *,...);
     VSTREAM *out_stream;
     int     out_error;
+    ssize_t frag_size;
 
     /*
      * Hang up if the BDAT command is disabled. The next input would be raw
@@ -4053,6 +4202,18 @@ static int bdat_cmd(SMTPD_STATE *state, int argc, SMTPD_TOKEN *argv)
     state->bdat_state = SMTPD_BDAT_STAT_OK;
     state->where = SMTPD_AFTER_BDAT;
 
+    /*
+     * Read a large chunk in fragments of message_stream_buffer_size bytes,
+     * through a client stream buffer of the same size, instead of 4096-byte
+     * fragments and read(2) calls. The stream buffer is enlarged only once
+     * a client actually sends a large chunk.
+     */
+    frag_size = SMTPD_BDAT_FRAG_SIZE;
+    if (chunk_size > VSTREAM_BUFSIZE && frag_size > VSTREAM_BUFSIZE)
+	vstream_control(state->client,
+			CA_VSTREAM_CTL_BUFSIZE(frag_size),
+			CA_VSTREAM_CTL_END);
+
     /*
      * Copy the message content. If the cleanup process has a problem, keep
      * reading until the remote stops sending, then complain. Produce typed
@@ -4074,8 +4235,8 @@ static int bdat_cmd(SMTPD_STATE *state, int argc, SMTPD_TOKEN *argv)
 	 * 
 	 * Caution: smtp_fread_buf() will long jump after EOF or timeout.
 	 */
-	if ((read_len = chunk_size - done) > VSTREAM_BUFSIZE)
-	    read_len = VSTREAM_BUFSIZE;
+	if ((read_len = chunk_size - done) > frag_size)
+	    read_len = frag_size;
 	smtp_fread_buf(state->buffer, read_len, state->client);
 	state->bdat_get_stream = vstream_memreopen(
 			   state->bdat_get_stream, state->buffer, O_RDONLY);
@@ -5433,6 +5594,7 @@ typedef struct SMTPD_CMD {
     int     flags;
     int     success_count;
     int     total_count;
+    struct timeval time_spent;
 } SMTPD_CMD;
 
  /*
@@ -5513,6 +5675,7 @@ static void smtpd_proto(SMTPD_STATE *state)
     const char *err;
     int     status;
     const char *cp;
+    struct timeval start;
 
 #ifdef USE_TLS
     int     tls_rate;
@@ -5756,6 +5919,7 @@ static void smtpd_proto(SMTPD_STATE *state)
 		smtpd_chat_reply(state, "220 %s", var_smtpd_banner);
 	    }
 	}
+	smtpd_time_add(&state->greet_time, &state->session_start);
 
 	/*
 	 * SASL initialization for plaintext mode.
@@ -5836,6 +6000,16 @@ static void smtpd_proto(SMTPD_STATE *state)
 		if (strcasecmp(argv[0].strval, cmdp->name) == 0)
 		    break;
 	    cmdp->total_count += 1;
+	    if (state->shape) {
+		if (cmdp->name == 0)
+		    smtpd_chat_shape(state, "OTHER");
+		else if (cmdp->action == bdat_cmd && argc > 1
+			 && alldig(argv[1].strval))
+		    smtpd_chat_shape(state, "%s:%.20s%s", cmdp->name,
+				     argv[1].strval, argc > 2 ? ":LAST" : "");
+		else
+		    smtpd_chat_shape(state, "%s", cmdp->name);
+	    }
 	    /* Ignore smtpd_forbid_cmds lookup errors. Non-critical feature. */
 	    if (cmdp->name == 0) {
 		state->where = SMTPD_CMD_UNKNOWN;
@@ -5900,10 +6074,12 @@ static void smtpd_proto(SMTPD_STATE *state)
 			  "554 5.5.0 Error: SMTP protocol synchronization");
 		break;
 	    }
+	    GETTIMEOFDAY(&start);
 	    if (cmdp->action(state, argc, argv) != 0)
 		state->error_count++;
 	    else
 		cmdp->success_count += 1;
+	    smtpd_time_add(&cmdp->time_spent, &start);
 	    if ((cmdp->flags & SMTPD_CMD_FLAG_LIMIT)
 		&& state->junk_cmds++ > var_smtpd_junk_cmd_limit)
 		state->error_count++;
@@ -5979,9 +6155,42 @@ static void smtpd_proto(SMTPD_STATE *state)
 	milter_disc_event(state->milters);
 }
 
+/* smtpd_format_time_stats - format per-phase time statistics */
+
+static void smtpd_format_time_stats(SMTPD_STATE *state, VSTRING *buf)
+{
+    SMTPD_CMD *cmdp;
+    struct timeval total;
+
+    /*
+     * Display small numbers with only two significant digits, as long as
+     * they do not exceed the time resolution, like the delays= logging.
+     * Time that is not accounted for was spent waiting for the client.
+     */
+#define SIG_DIGS	2
+#define PRETTY_FORMAT(b, text, x) \
+    do { \
+	vstring_strcat((b), text); \
+	format_tv((b), (x).tv_sec, (x).tv_usec, SIG_DIGS, var_delay_max_res); \
+    } while (0)
+
+    PRETTY_FORMAT(buf, " times=greet:", state->greet_time);
+    for (cmdp = smtpd_cmd_table; cmdp->name != 0; cmdp++) {
+	if (cmdp->total_count > 0) {
+	    vstring_sprintf_append(buf, ",%s:", cmdp->name);
+	    PRETTY_FORMAT(buf, "", cmdp->time_spent);
+	}
+    }
+    if (state->commit_time.tv_sec > 0 || state->commit_time.tv_usec > 0)
+	PRETTY_FORMAT(buf, ",commit:", state->commit_time);
+    total.tv_sec = total.tv_usec = 0;
+    smtpd_time_add(&total, &state->session_start);
+    PRETTY_FORMAT(buf, ",total:", total);
+}
+
 /* smtpd_format_cmd_stats - format per-command statistics */
 
-static char *smtpd_format_cmd_stats(VSTRING *buf)
+static char *smtpd_format_cmd_stats(SMTPD_STATE *state, VSTRING *buf)
 {
     SMTPD_CMD *cmdp;
     int     all_success = 0;
@@ -6006,6 +6215,23 @@ static char *smtpd_format_cmd_stats(VSTRING *buf)
 	    break;
     }
 
+    /*
+     * Log total numbers, so that logfile analyzers will see something even
+     * if the above loop produced no output. When no commands were received
+     * log "0/0" to simplify the identification of abnormal sessions: any
+     * statistics with [0-9]/ indicate that there was a problem.
+     */
+    vstring_sprintf_append(buf, " commands=%d", all_success);
+    if (all_success != all_total || all_total == 0)
+	vstring_sprintf_append(buf, "/%d", all_total);
+
+    /*
+     * Optionally, log where the time went. This is off by default, because
+     * it could break logfile processors.
+     */
+    if (var_smtpd_sess_time_log)
+	smtpd_format_time_stats(state, buf);
+
     /*
      * Reset the per-command counters.
      * 
@@ -6016,19 +6242,10 @@ static char *smtpd_format_cmd_stats(VSTRING *buf)
      */
     for (cmdp = smtpd_cmd_table; /* see below */ ; cmdp++) {
 	cmdp->success_count = cmdp->total_count = 0;
+	cmdp->time_spent.tv_sec = cmdp->time_spent.tv_usec = 0;
 	if (cmdp->name == 0)
 	    break;
     }
-
-    /*
-     * Log total numbers, so that logfile analyzers will see something even
-     * if the above loop produced no output. When no commands were received
-     * log "0/0" to simplify the identification of abnormal sessions: any
-     * statistics with [0-9]/ indicate that there was a problem.
-     */
-    vstring_sprintf_append(buf, " commands=%d", all_success);
-    if (all_success != all_total || all_total == 0)
-	vstring_sprintf_append(buf, "/%d", all_total);
     return (lowercase(STR(buf)));
 }
 
@@ -6049,6 +6266,25 @@ static void setup_milters(SMTPD_STATE *state)
 		 maps_find(smtpd_milter_maps, state->addr, 0)) != 0)
 	    || *(milter_string = var_smtpd_milters) != 0)
 	&& strcasecmp(milter_string, SMTPD_MILTERS_DISABLE) != 0) {
+
+	/*
+	 * With milter_connection_reuse, the Milters from the previous session
+	 * may still have an open connection. Use them only if this client
+	 * gets the same Milter list.
+	 */
+	if (smtpd_idle_milters != 0
+	    && strcmp(smtpd_idle_milter_string, milter_string) == 0) {
+	    state->milters = smtpd_idle_milters;
+	    smtpd_idle_milters = 0;
+	    return;
+	}
+	if (smtpd_idle_milters != 0) {
+	    milter_free(smtpd_idle_milters);
+	    smtpd_idle_milters = 0;
+	}
+	if (smtpd_idle_milter_string)
+	    myfree(smtpd_idle_milter_string);
+	smtpd_idle_milter_string = mystrdup(milter_string);
 	state->milters = milter_create(milter_string,
 				       var_milt_conn_time,
 				       var_milt_cmd_time,
@@ -6080,7 +6316,10 @@ static void setup_milters(SMTPD_STATE *state)
 static void teardown_milters(SMTPD_STATE *state)
 {
     if (state->milters) {
-	milter_free(state->milters);
+	if (var_milt_conn_reuse && smtpd_idle_milters == 0)
+	    smtpd_idle_milters = state->milters;
+	else
+	    milter_free(state->milters);
 	state->milters = 0;
     }
     smtpd_input_transp_mask =
@@ -6121,6 +6360,7 @@ static void smtpd_service(VSTREAM *stream, char *service, char **argv)
      */
     smtpd_state_init(&state, stream, service);
     msg_info("connect from %s", state.namaddr);
+    metrics_count("postfix_smtpd_connections_total", 1, (char *) 0);
 
     /*
      * Disable TLS when running in stand-alone mode via "sendmail -bs".
@@ -6162,8 +6402,9 @@ static void smtpd_service(VSTREAM *stream, char *service, char **argv)
      * After the client has gone away, clean up whatever we have set up at
      * connection time.
      */
+    smtpd_chat_shape_log(&state);
     msg_info("disconnect from %s%s", state.namaddr,
-	     smtpd_format_cmd_stats(state.buffer));
+	     smtpd_format_cmd_stats(&state, state.buffer));
     teardown_milters(&state);			/* duplicates xclient_cmd */
     smtpd_state_reset(&state);
     debug_peer_restore();
@@ -6219,6 +6460,10 @@ static void pre_jail_init(char *unused_name, char **unused_argv)
 	smtpd_check_init();
     smtpd_expand_init();
     debug_peer_init();
+    if (*var_smtpd_peer_cache_map && var_smtpd_peername_lookup)
+	smtpd_peer_cache_init(var_smtpd_peer_cache_map,
+			      var_smtpd_peer_cache_ttl,
+			      var_smtpd_peer_cache_temp_ttl);
 
     if (var_smtpd_sasl_enable)
 #ifdef USE_SASL_AUTH
@@ -6526,6 +6771,8 @@ int     main(int argc, char **argv)
     };
     static const CONFIG_TIME_TABLE time_table[] = {
 	VAR_SMTPD_TMOUT, DEF_SMTPD_TMOUT, &var_smtpd_tmout, 1, 0,
+	VAR_SMTPD_PEER_CACHE_TTL, DEF_SMTPD_PEER_CACHE_TTL, &var_smtpd_peer_cache_ttl, 0, 0,
+	VAR_SMTPD_PEER_CACHE_TEMP_TTL, DEF_SMTPD_PEER_CACHE_TEMP_TTL, &var_smtpd_peer_cache_temp_ttl, 0, 0,
 	VAR_SMTPD_ERR_SLEEP, DEF_SMTPD_ERR_SLEEP, &var_smtpd_err_sleep, 0, 0,
 	VAR_SMTPD_PROXY_TMOUT, DEF_SMTPD_PROXY_TMOUT, &var_smtpd_proxy_tmout, 1, 0,
 	VAR_VERIFY_POLL_DELAY, DEF_VERIFY_POLL_DELAY, &var_verify_poll_delay, 1, 0,
@@ -6541,6 +6788,7 @@ int     main(int argc, char **argv)
 	VAR_VERIFY_SENDER_TTL, DEF_VERIFY_SENDER_TTL, &var_verify_sender_ttl, 0, 0,
 	VAR_SMTPD_UPROXY_TMOUT, DEF_SMTPD_UPROXY_TMOUT, &var_smtpd_uproxy_tmout, 1, 0,
 	VAR_SMTPD_POLICY_TRY_DELAY, DEF_SMTPD_POLICY_TRY_DELAY, &var_smtpd_policy_try_delay, 1, 0,
+	VAR_SMTPD_DNSBL_PF_TMOUT, DEF_SMTPD_DNSBL_PF_TMOUT, &var_smtpd_dnsbl_pf_tmout, 1, 0,
 	0,
     };
     static const CONFIG_BOOL_TABLE bool_table[] = {
@@ -6569,7 +6817,10 @@ int     main(int argc, char **argv)
 	VAR_SMTPD_PEERNAME_LOOKUP, DEF_SMTPD_PEERNAME_LOOKUP, &var_smtpd_peername_lookup,
 	VAR_SMTPD_DELAY_OPEN, DEF_SMTPD_DELAY_OPEN, &var_smtpd_delay_open,
 	VAR_SMTPD_CLIENT_PORT_LOG, DEF_SMTPD_CLIENT_PORT_LOG, &var_smtpd_client_port_log,
+	VAR_SMTPD_SESS_TIME_LOG, DEF_SMTPD_SESS_TIME_LOG, &var_smtpd_sess_time_log,
 	VAR_SMTPD_FORBID_UNAUTH_PIPE, DEF_SMTPD_FORBID_UNAUTH_PIPE, &var_smtpd_forbid_unauth_pipe,
+	VAR_SMTPD_SHAPE_LOG, DEF_SMTPD_SHAPE_LOG, &var_smtpd_shape_log,
+	VAR_SMTPD_DNSBL_PREFETCH, DEF_SMTPD_DNSBL_PREFETCH, &var_smtpd_dnsbl_prefetch,
 	0,
     };
     static const CONFIG_NBOOL_TABLE nbool_table[] = {
@@ -6579,6 +6830,7 @@ int     main(int argc, char **argv)
     };
     static const CONFIG_STR_TABLE str_table[] = {
 	VAR_SMTPD_BANNER, DEF_SMTPD_BANNER, &var_smtpd_banner, 1, 0,
+	VAR_SMTPD_PEER_CACHE_MAP, DEF_SMTPD_PEER_CACHE_MAP, &var_smtpd_peer_cache_map, 0, 0,
 	VAR_NOTIFY_CLASSES, DEF_NOTIFY_CLASSES, &var_notify_classes, 0, 0,
 	VAR_CLIENT_CHECKS, DEF_CLIENT_CHECKS, &var_client_checks, 0, 0,
 	VAR_HELO_CHECKS, DEF_HELO_CHECKS, &var_helo_checks, 0, 0,
@@ -6613,6 +6865,7 @@ int     main(int argc, char **argv)
 	VAR_SMTPD_FORBID_CMDS, DEF_SMTPD_FORBID_CMDS, &var_smtpd_forbid_cmds, 0, 0,
 	VAR_SMTPD_NULL_KEY, DEF_SMTPD_NULL_KEY, &var_smtpd_null_key, 0, 0,
 	VAR_RELAY_RCPT_MAPS, DEF_RELAY_RCPT_MAPS, &var_relay_rcpt_maps, 0, 0,
+	VAR_SMTPD_RCPT_FILTER_MAPS, DEF_SMTPD_RCPT_FILTER_MAPS, &var_smtpd_rcpt_filter_maps, 0, 0,
 	VAR_VERIFY_SENDER, DEF_VERIFY_SENDER, &var_verify_sender, 0, 0,
 	VAR_VERP_CLIENTS, DEF_VERP_CLIENTS, &var_verp_clients, 0, 0,
 	VAR_SMTPD_PROXY_FILT, DEF_SMTPD_PROXY_FILT, &var_smtpd_proxy_filt, 0, 0,
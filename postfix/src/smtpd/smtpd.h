@@ -100,6 +100,10 @@ typedef struct {
     int     rcpt_count;			/* number of accepted recipients */
     char   *access_denied;		/* fixme */
     ARGV   *history;			/* protocol transcript */
+    VSTRING *shape;			/* sanitized session shape */
+    struct timeval shape_query;		/* last request arrival */
+    struct timeval shape_reply;		/* last reply sent */
+    int     shape_pending;		/* reply code not yet recorded */
     char   *reason;			/* cause of connection loss */
     char   *sender;			/* sender address */
     char   *encoding;			/* owned by mail_cmd() */
@@ -143,6 +147,7 @@ typedef struct {
     char   *saved_redirect;		/* postponed redirect action */
     ARGV   *saved_bcc;			/* postponed bcc action */
     int     saved_flags;		/* postponed hold/discard */
+    int     saved_priority;		/* postponed priority action */
 #ifdef DELAY_ACTION
     int     saved_delay;		/* postponed deferred delay */
 #endif
@@ -201,6 +206,13 @@ typedef struct {
     VSTREAM *bdat_get_stream;		/* memory stream from BDAT chunk */
     VSTRING *bdat_get_buffer;		/* read from memory stream */
     int     bdat_prev_rec_type;
+
+    /*
+     * Session time accounting, see smtpd_session_time_logging.
+     */
+    struct timeval session_start;	/* connection handed to smtpd */
+    struct timeval greet_time;		/* connect to greeting */
+    struct timeval commit_time;		/* waiting for cleanup server */
 } SMTPD_STATE;
 
 #define SMTPD_FLAG_HANGUP	   (1<<0)	/* 421/521 disconnect */
@@ -349,6 +361,7 @@ extern void smtpd_peer_init(SMTPD_STATE *state);
 extern void smtpd_peer_reset(SMTPD_STATE *state);
 extern void smtpd_peer_from_default(SMTPD_STATE *);
 extern int smtpd_peer_from_haproxy(SMTPD_STATE *);
+extern void smtpd_peer_cache_init(const char *, int, int);
 
 #define	SMTPD_PEER_CODE_OK	2
 #define SMTPD_PEER_CODE_TEMP	4
@@ -25,6 +25,13 @@
 /*
 /*	void	smtpd_chat_reset(state)
 /*	SMTPD_STATE *state;
+/*
+/*	void	smtpd_chat_shape(state, format, ...)
+/*	SMTPD_STATE *state;
+/*	const char *format;
+/*
+/*	void	smtpd_chat_shape_log(state)
+/*	SMTPD_STATE *state;
 /* DESCRIPTION
 /*	This module implements SMTP server support for request/reply
 /*	conversations, and maintains a limited SMTP transaction log.
@@ -53,6 +60,22 @@
 /*	smtpd_chat_reset() resets the transaction log. This is
 /*	typically done at the beginning of an SMTP session, or
 /*	within a session to discard non-error information.
+/*
+/*	smtpd_chat_shape() appends one element to the session shape,
+/*	a record of the SMTP session without addresses, names or
+/*	message content, for use with smtp-replay(1). The format
+/*	argument specifies the command name, or "." followed by the
+/*	message size and header count for the end of message content.
+/*	The element has the form \fIname/delay/code\fR, where
+/*	\fIdelay\fR is the time in milliseconds from the previous
+/*	server reply until the latest client request, followed by
+/*	"p" when the client had already sent more input (pipelining),
+/*	and where \fIcode\fR is the three-digit code of the server
+/*	reply. This function must be called only when the session
+/*	shape is enabled with smtpd_session_shape_logging. The shape
+/*	is truncated after SMTPD_SHAPE_LIMIT bytes.
+/*
+/*	smtpd_chat_shape_log() logs the session shape, if any.
 /* DIAGNOSTICS
 /*	Panic: interface violations. Fatal errors: out of memory.
 /*	internal protocol errors.
@@ -119,6 +142,14 @@ static MAPS *smtpd_rej_ftr_maps;
 #define STR	vstring_str
 #define LEN	VSTRING_LEN
 
+ /*
+  * Session shape. Keep the logfile record well within syslog limits.
+  */
+#define SMTPD_SHAPE_LIMIT	1800
+#define SMTPD_SHAPE_MSEC(t1, t0) \
+	((long) (((t1).tv_sec - (t0).tv_sec) * 1000 \
+		 + ((t1).tv_usec - (t0).tv_usec) / 1000))
+
 /* smtpd_chat_pre_jail_init - initialize */
 
 void    smtpd_chat_pre_jail_init(void)
@@ -177,6 +208,8 @@ int     smtpd_chat_query_limit(SMTPD_STATE *state, int limit)
     last_char = smtp_get(state->buffer, state->client, limit,
 			 SMTP_GET_FLAG_SKIP);
     smtp_chat_append(state, "In:  ", STR(state->buffer));
+    if (state->shape)
+	GETTIMEOFDAY(&state->shape_query);
     if (last_char != '\n')
 	msg_warn("%s: request longer than %d: %.30s...",
 		 state->namaddr, limit,
@@ -217,6 +250,16 @@ void    vsmtpd_chat_reply(SMTPD_STATE *state, const char *format, va_list ap)
 
     vstring_vsprintf(state->buffer, format, ap);
 
+    if (state->shape) {
+	if (state->shape_pending) {
+	    vstring_sprintf_append(state->shape, "/%.3s", STR(state->buffer));
+	    state->shape_pending = 0;
+	    if (LEN(state->shape) > SMTPD_SHAPE_LIMIT)
+		vstring_strcat(state->shape, " ...");
+	}
+	GETTIMEOFDAY(&state->shape_reply);
+    }
+
     if ((*(cp = STR(state->buffer)) == '4' || *cp == '5')
 	&& ((smtpd_rej_ftr_maps != 0
 	     && (footer = maps_find(smtpd_rej_ftr_maps, cp, 0)) != 0)
@@ -279,6 +322,38 @@ void    vsmtpd_chat_reply(SMTPD_STATE *state, const char *format, va_list ap)
 	state->flags |= SMTPD_FLAG_HANGUP;
 }
 
+/* smtpd_chat_shape - append element to session shape */
+
+void    smtpd_chat_shape(SMTPD_STATE *state, const char *format,...)
+{
+    const char *myname = "smtpd_chat_shape";
+    va_list ap;
+    long    delay;
+
+    if (state->shape == 0)
+	msg_panic("%s: session shape is not enabled", myname);
+    if (LEN(state->shape) > SMTPD_SHAPE_LIMIT)
+	return;
+    if ((delay = SMTPD_SHAPE_MSEC(state->shape_query,
+				  state->shape_reply)) < 0)
+	delay = 0;
+    VSTRING_ADDCH(state->shape, ' ');
+    va_start(ap, format);
+    vstring_vsprintf_append(state->shape, format, ap);
+    va_end(ap);
+    vstring_sprintf_append(state->shape, "/%ld%s", delay,
+			   vstream_peek(state->client) > 0 ? "p" : "");
+    state->shape_pending = 1;
+}
+
+/* smtpd_chat_shape_log - log session shape */
+
+void    smtpd_chat_shape_log(SMTPD_STATE *state)
+{
+    if (state->shape && LEN(state->shape) > 0)
+	msg_info("session shape: %s", STR(state->shape) + 1);
+}
+
 /* print_line - line_wrap callback */
 
 static void print_line(const char *str, int len, int indent, void *context)
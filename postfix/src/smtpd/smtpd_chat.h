@@ -24,6 +24,8 @@ extern void smtpd_chat_query(SMTPD_STATE *);
 extern void PRINTFLIKE(2, 3) smtpd_chat_reply(SMTPD_STATE *, const char *,...);
 extern void vsmtpd_chat_reply(SMTPD_STATE *, const char *, va_list);
 extern void smtpd_chat_notify(SMTPD_STATE *);
+extern void PRINTFLIKE(2, 3) smtpd_chat_shape(SMTPD_STATE *, const char *,...);
+extern void smtpd_chat_shape_log(SMTPD_STATE *);
 
 #define smtpd_chat_query(state) \
 	((void) smtpd_chat_query_limit((state), var_line_limit))
@@ -217,6 +217,7 @@
 #include <midna_domain.h>
 #include <mynetworks.h>
 #include <name_code.h>
+#include <iostuff.h>
 
 /* DNS library. */
 
@@ -254,6 +255,8 @@
 #include <map_search.h>
 #include <info_log_addr_form.h>
 #include <mail_version.h>
+#include <metrics_clnt.h>
+#include <mail_priority.h>
 
 /* Application-specific. */
 
@@ -284,6 +287,17 @@ static VSTRING *error_text;
 static CTABLE *smtpd_rbl_cache;
 static CTABLE *smtpd_rbl_byte_cache;
 
+ /*
+  * The top-level restriction that is being evaluated, for reject metrics.
+  */
+static const char *smtpd_check_rest_name;
+
+ /*
+  * DNSXL queries that smtpd_dnsbl_prefetch found to be not listed, and that
+  * are not yet in smtpd_rbl_cache.
+  */
+static HTABLE *smtpd_rbl_notfound;
+
  /*
   * Pre-opened SMTP recipient maps so we can reject mail for unknown users.
   * XXX This does not belong here and will eventually become part of the
@@ -296,6 +310,7 @@ static MAPS *canonical_maps;
 static MAPS *virt_alias_maps;
 static MAPS *virt_mailbox_maps;
 static MAPS *relay_rcpt_maps;
+static MAPS *rcpt_filter_maps;
 
 #ifdef TEST
 
@@ -826,6 +841,10 @@ void    smtpd_check_init(void)
     relay_rcpt_maps = maps_create(VAR_RELAY_RCPT_MAPS, var_relay_rcpt_maps,
 				  DICT_FLAG_LOCK | DICT_FLAG_FOLD_FIX
 				  | DICT_FLAG_UTF8_REQUEST);
+    rcpt_filter_maps = maps_create(VAR_SMTPD_RCPT_FILTER_MAPS,
+				   var_smtpd_rcpt_filter_maps,
+				   DICT_FLAG_LOCK | DICT_FLAG_FOLD_FIX
+				   | DICT_FLAG_UTF8_REQUEST);
 
 #ifdef TEST
     virt_alias_doms = string_list_init(VAR_VIRT_ALIAS_DOMS, MATCH_FLAG_NONE,
@@ -869,6 +888,8 @@ void    smtpd_check_init(void)
     smtpd_rbl_cache = ctable_create(100, rbl_pagein, rbl_pageout, (void *) 0);
     smtpd_rbl_byte_cache = ctable_create(1000, rbl_byte_pagein,
 					 rbl_byte_pageout, (void *) 0);
+    if (var_smtpd_dnsbl_prefetch)
+	smtpd_rbl_notfound = htable_create(10);
 
     /*
      * Initialize access map search list support before parsing restriction
@@ -1166,6 +1187,12 @@ static int smtpd_check_reject(SMTPD_STATE *state, int error_class,
      * rejected. Print the request, client name/address, and response.
      */
     log_whatsup(state, whatsup, STR(error_text));
+    if (!warn_if_reject)
+	metrics_count("postfix_smtpd_rejects_total", 1,
+		      "restriction", smtpd_check_rest_name ?
+		      smtpd_check_rest_name : "other",
+		      "code", STR(error_text)[0] == '5' ? "5xx" : "4xx",
+		      (char *) 0);
 
     return (warn_if_reject ? 0 : SMTPD_CHECK_REJECT);
 }
@@ -2237,22 +2264,39 @@ static int reject_unverified_address(SMTPD_STATE *state, const char *addr,
     int     rqst_status = SMTPD_CHECK_DUNNO;
     int     rcpt_status;
     int     verify_status;
-    int     count;
+    long    budget;
+    long    delay;
     int     reject_code = 0;
 
     if (msg_verbose)
 	msg_info("%s: %s", myname, addr);
 
     /*
-     * Verify the address. Don't waste too much of their or our time.
+     * Verify the address. Don't waste too much of their or our time. A
+     * probe that the queue manager can deliver over a cached connection
+     * completes in a fraction of a second, so we poll at increasing
+     * intervals up to $address_verify_poll_delay, instead of sleeping that
+     * long each time. The total wait stays the same as with fixed-interval
+     * polling: ($address_verify_poll_count - 1) * $address_verify_poll_delay.
      */
-    for (count = 0; /* see below */ ; /* see below */ ) {
+#define VERIFY_POLL_MIN_DELAY	100000		/* microseconds */
+#define VERIFY_POLL_MAX_DELAY	(var_verify_poll_delay * 1000000L)
+
+    budget = (var_verify_poll_count - 1) * VERIFY_POLL_MAX_DELAY;
+    delay = VERIFY_POLL_MIN_DELAY;
+    for (;;) {
 	verify_status = verify_clnt_query(addr, &rcpt_status, why);
 	if (verify_status != VRFY_STAT_OK || rcpt_status != DEL_RCPT_STAT_TODO)
 	    break;
-	if (++count >= var_verify_poll_count)
+	if (budget <= 0)
 	    break;
-	sleep(var_verify_poll_delay);
+	if (delay > VERIFY_POLL_MAX_DELAY)
+	    delay = VERIFY_POLL_MAX_DELAY;
+	if (delay > budget)
+	    delay = budget;
+	doze(delay);
+	budget -= delay;
+	delay *= 2;
     }
     if (verify_status != VRFY_STAT_OK) {
 	msg_warn("%s service failure", var_verify_service);
@@ -2506,6 +2550,33 @@ static int check_table_result(SMTPD_STATE *state, const char *table,
 	}
     }
 
+    /*
+     * PRIORITY means schedule delivery before or after other mail. But we
+     * may still change our mind, and reject/discard the message for other
+     * reasons.
+     */
+    if (STREQUAL(value, "PRIORITY", cmd_len)) {
+	int     code;
+
+#ifndef TEST
+	if (can_delegate_action(state, table, "PRIORITY", reply_class) == 0)
+	    return (SMTPD_CHECK_DUNNO);
+#endif
+	if ((code = mail_priority_code(cmd_text)) == MAIL_PRIORITY_UNKNOWN) {
+	    msg_warn("access table %s entry \"%s\" requires high, normal or low",
+		     table, datum);
+	    return (SMTPD_CHECK_DUNNO);
+	} else {
+	    vstring_sprintf(error_text, "<%s>: %s triggers PRIORITY %s",
+			    reply_name, reply_class, cmd_text);
+	    log_whatsup(state, "priority", STR(error_text));
+#ifndef TEST
+	    state->saved_priority = code;
+#endif
+	    return (SMTPD_CHECK_DUNNO);
+	}
+    }
+
     /*
      * HOLD means deliver later. But we may still change our mind, and
      * reject/discard the message for other reasons.
@@ -2821,6 +2892,8 @@ static int check_access(SMTPD_STATE *state, const char *table, const char *name,
 
 /* check_domain_access - domainname-based table lookup */
 
+#define CHK_DOMAIN_KEYS	20		/* keys per table query */
+
 static int check_domain_access(SMTPD_STATE *state, const char *table,
 			               const char *domain, int flags,
 			               int *found, const char *reply_name,
@@ -2833,6 +2906,10 @@ static int check_domain_access(SMTPD_STATE *state, const char *table,
     const char *value;
     MAPS   *maps;
     int     maybe_numerical = 1;
+    const char *keys[CHK_DOMAIN_KEYS];
+    int     key_flags[CHK_DOMAIN_KEYS];
+    ssize_t count;
+    ssize_t key_index;
 
     if (msg_verbose)
 	msg_info("%s: %s", myname, domain);
@@ -2855,8 +2932,27 @@ static int check_domain_access(SMTPD_STATE *state, const char *table,
 					     domain, reply_name, reply_class,
 					     def_acl), FOUND);
     }
-    for (name = domain; *name != 0; name = next) {
-	if ((value = maps_find(maps, name, flags)) != 0)
+    for (name = domain; *name != 0; /* void */ ) {
+
+	/*
+	 * Collect the name and its parent domains, and search them with one
+	 * query per table.
+	 */
+	for (count = 0; count < CHK_DOMAIN_KEYS && *name != 0; name = next) {
+	    keys[count] = name;
+	    key_flags[count++] = flags;
+	    flags = PARTIAL;
+	    /* Don't apply subdomain magic to numerical hostnames. */
+	    if (maybe_numerical
+		&& (maybe_numerical = valid_hostaddr(domain, DONT_GRIPE)) != 0)
+		next = "";
+	    else if ((next = strchr(name + 1, '.')) == 0)
+		next = "";
+	    else if (access_parent_style == MATCH_FLAG_PARENT)
+		next += 1;
+	}
+	if ((value = maps_find_first(maps, keys, key_flags, count,
+				     &key_index)) != 0)
 	    CHK_DOMAIN_RETURN(check_table_result(state, table, value,
 					    domain, reply_name, reply_class,
 						 def_acl), FOUND);
@@ -2867,15 +2963,6 @@ static int check_domain_access(SMTPD_STATE *state, const char *table,
 					    domain, reply_name, reply_class,
 						 def_acl), FOUND);
 	}
-	/* Don't apply subdomain magic to numerical hostnames. */
-	if (maybe_numerical
-	    && (maybe_numerical = valid_hostaddr(domain, DONT_GRIPE)) != 0)
-	    break;
-	if ((next = strchr(name + 1, '.')) == 0)
-	    break;
-	if (access_parent_style == MATCH_FLAG_PARENT)
-	    next += 1;
-	flags = PARTIAL;
     }
     CHK_DOMAIN_RETURN(SMTPD_CHECK_DUNNO, MISSED);
 }
@@ -3429,6 +3516,13 @@ static void *rbl_pagein(const char *query, void *unused_context)
      * 
      * Don't do this for AAAA records. Yet.
      */
+    if (smtpd_rbl_notfound != 0
+	&& htable_locate(smtpd_rbl_notfound, query) != 0) {
+	if (msg_verbose)
+	    msg_info("%s: prefetched: not found", query);
+	htable_delete(smtpd_rbl_notfound, query, (void (*) (void *)) 0);
+	return (0);
+    }
     why = vstring_alloc(10);
     dns_status = dns_lookup(query, T_A, 0, &addr_list, (VSTRING *) 0, why);
     if (dns_status != DNS_OK && dns_status != DNS_NOTFOUND) {
@@ -3647,23 +3741,18 @@ static int rbl_match_addr(SMTPD_RBL_STATE *rbl, const char *byte_codes)
     return (0);
 }
 
-/* find_dnsxl_addr - look up address in DNSXL */
+/* dnsxl_addr_query - format DNSXL query for address */
 
-static const SMTPD_RBL_STATE *find_dnsxl_addr(SMTPD_STATE *state,
-					              const char *rbl_domain,
-					              const char *addr)
+static void dnsxl_addr_query(VSTRING *query, const char *rbl_domain,
+			             const char *addr)
 {
-    const char *myname = "find_dnsxl_addr";
+    const char *myname = "dnsxl_addr_query";
     ARGV   *octets;
-    VSTRING *query;
     int     i;
-    SMTPD_RBL_STATE *rbl;
-    const char *reply_addr;
-    const char *byte_codes;
     struct addrinfo *res;
     unsigned char *ipv6_addr;
 
-    query = vstring_alloc(100);
+    VSTRING_RESET(query);
 
     /*
      * Reverse the client IPV6 address, represented as 32 hexadecimal
@@ -3698,9 +3787,27 @@ static const SMTPD_RBL_STATE *find_dnsxl_addr(SMTPD_STATE *state,
     }
 
     /*
-     * Tack on the RBL domain name and query the DNS for an A record.
+     * Tack on the RBL domain name.
      */
     vstring_strcat(query, rbl_domain);
+}
+
+/* find_dnsxl_addr - look up address in DNSXL */
+
+static const SMTPD_RBL_STATE *find_dnsxl_addr(SMTPD_STATE *state,
+					              const char *rbl_domain,
+					              const char *addr)
+{
+    VSTRING *query;
+    SMTPD_RBL_STATE *rbl;
+    const char *reply_addr;
+    const char *byte_codes;
+
+    /*
+     * Query the DNS for an A record.
+     */
+    query = vstring_alloc(100);
+    dnsxl_addr_query(query, rbl_domain, addr);
     reply_addr = split_at(STR(query), '=');
     rbl = (SMTPD_RBL_STATE *) ctable_locate(smtpd_rbl_cache, STR(query));
     if (reply_addr != 0)
@@ -3770,27 +3877,23 @@ static int permit_dnswl_addr(SMTPD_STATE *state, const char *dnswl_domain,
     }
 }
 
-/* find_dnsxl_domain - reject if domain in DNS deny list */
+/* dnsxl_domain_query - format DNSXL query for domain */
 
-static const SMTPD_RBL_STATE *find_dnsxl_domain(SMTPD_STATE *state,
-			           const char *rbl_domain, const char *what)
+static int dnsxl_domain_query(VSTRING *query, const char *rbl_domain,
+			              const char *what)
 {
-    VSTRING *query;
-    SMTPD_RBL_STATE *rbl;
     const char *domain;
-    const char *reply_addr;
-    const char *byte_codes;
     const char *suffix;
     const char *adomain;
 
     /*
-     * Extract the domain, tack on the RBL domain name and query the DNS for
-     * an A record.
+     * Extract the domain, and tack on the RBL domain name. Return zero if
+     * the domain must not be looked up.
      */
     if ((domain = strrchr(what, '@')) != 0) {
 	domain += 1;
 	if (domain[0] == '[')
-	    return (SMTPD_CHECK_DUNNO);
+	    return (0);
     } else
 	domain = what;
 
@@ -3800,10 +3903,10 @@ static const SMTPD_RBL_STATE *find_dnsxl_domain(SMTPD_STATE *state,
      * RHSBL and RHSWL queries for names ending in a numerical suffix.
      */
     if (domain[0] == 0)
-	return (SMTPD_CHECK_DUNNO);
+	return (0);
     suffix = strrchr(domain, '.');
     if (alldig(suffix == 0 ? domain : suffix + 1))
-	return (SMTPD_CHECK_DUNNO);
+	return (0);
 
     /*
      * Fix 20140706: convert domain to ASCII.
@@ -3816,10 +3919,29 @@ static const SMTPD_RBL_STATE *find_dnsxl_domain(SMTPD_STATE *state,
     }
 #endif
     if (domain[0] == 0 || valid_hostname(domain, DONT_GRIPE) == 0)
-	return (SMTPD_CHECK_DUNNO);
+	return (0);
+    vstring_sprintf(query, "%s.%s", domain, rbl_domain);
+    return (1);
+}
 
+/* find_dnsxl_domain - reject if domain in DNS deny list */
+
+static const SMTPD_RBL_STATE *find_dnsxl_domain(SMTPD_STATE *state,
+			           const char *rbl_domain, const char *what)
+{
+    VSTRING *query;
+    SMTPD_RBL_STATE *rbl;
+    const char *reply_addr;
+    const char *byte_codes;
+
+    /*
+     * Query the DNS for an A record.
+     */
     query = vstring_alloc(100);
-    vstring_sprintf(query, "%s.%s", domain, rbl_domain);
+    if (dnsxl_domain_query(query, rbl_domain, what) == 0) {
+	vstring_free(query);
+	return (SMTPD_CHECK_DUNNO);
+    }
     reply_addr = split_at(STR(query), '=');
     rbl = (SMTPD_RBL_STATE *) ctable_locate(smtpd_rbl_cache, STR(query));
     if (reply_addr != 0)
@@ -3924,6 +4046,84 @@ static int reject_maps_rbl(SMTPD_STATE *state)
     return (result);
 }
 
+/* dnsxl_prefetch - look up DNSXL names in a restriction list in parallel */
+
+static void dnsxl_prefetch(SMTPD_STATE *state, ARGV *restrictions)
+{
+    const char *myname = "dnsxl_prefetch";
+    ARGV   *queries = argv_alloc(10);
+    VSTRING *query = vstring_alloc(100);
+    char  **cpp;
+    const char *name;
+    const char *what;
+    int    *status;
+    int     i;
+
+    /*
+     * Find the DNSXL restrictions whose result is not yet cached, and format
+     * their queries the same way as find_dnsxl_addr() and
+     * find_dnsxl_domain() do. Restrictions that are evaluated later may
+     * not need a lookup at all; that costs one unused query.
+     */
+    for (cpp = restrictions->argv; (name = *cpp) != 0 && cpp[1] != 0; cpp++) {
+	if (strcasecmp(name, REJECT_RBL_CLIENT) == 0
+	    || strcasecmp(name, REJECT_RBL) == 0
+	    || strcasecmp(name, PERMIT_DNSWL_CLIENT) == 0) {
+	    dnsxl_addr_query(query, *(cpp += 1), state->addr);
+	} else {
+	    if (strcasecmp(name, REJECT_RHSBL_CLIENT) == 0
+		|| strcasecmp(name, PERMIT_RHSWL_CLIENT) == 0)
+		what = strcasecmp(state->name, "unknown") ? state->name : 0;
+	    else if (strcasecmp(name, REJECT_RHSBL_REVERSE_CLIENT) == 0)
+		what = strcasecmp(state->reverse_name, "unknown") ?
+		    state->reverse_name : 0;
+	    else if (strcasecmp(name, REJECT_RHSBL_HELO) == 0)
+		what = state->helo_name;
+	    else if (strcasecmp(name, REJECT_RHSBL_SENDER) == 0)
+		what = (state->sender && *state->sender) ? state->sender : 0;
+	    else if (strcasecmp(name, REJECT_RHSBL_RECIPIENT) == 0)
+		what = state->recipient;
+	    else
+		continue;
+	    if (what == 0 || dnsxl_domain_query(query, *(cpp += 1), what) == 0)
+		continue;
+	}
+	(void) split_at(STR(query), '=');
+	if (ctable_exists(smtpd_rbl_cache, STR(query))
+	    || htable_locate(smtpd_rbl_notfound, STR(query)) != 0)
+	    continue;
+	for (i = 0; i < queries->argc; i++)
+	    if (strcmp(queries->argv[i], STR(query)) == 0)
+		break;
+	if (i == queries->argc)
+	    argv_add(queries, STR(query), (char *) 0);
+    }
+    vstring_free(query);
+
+    /*
+     * We need at least two queries to gain anything. Remember the names
+     * that are not listed, so that rbl_pagein() need not look them up
+     * again. Listed names still go through dns_lookup(), for the TXT
+     * record, CNAME processing, and the DNS reply filter.
+     */
+    if (queries->argc > 1) {
+	status = (int *) mymalloc(queries->argc * sizeof(*status));
+	dns_lookup_batch((const char **) queries->argv, queries->argc, T_A,
+			 status, var_smtpd_dnsbl_pf_tmout);
+	for (i = 0; i < queries->argc; i++) {
+	    if (msg_verbose)
+		msg_info("%s: %s: %s", myname, queries->argv[i],
+			 status[i] == DNS_NOTFOUND ? "not listed" :
+			 "look up later");
+	    if (status[i] == DNS_NOTFOUND)
+		(void) htable_enter(smtpd_rbl_notfound, queries->argv[i],
+				    (void *) 0);
+	}
+	myfree((void *) status);
+    }
+    argv_free(queries);
+}
+
 #ifdef USE_SASL_AUTH
 
 /* reject_auth_sender_login_mismatch - logged in client must own sender address */
@@ -4191,10 +4391,200 @@ static int check_policy_service(SMTPD_STATE *state, const char *server,
     return (ret);
 }
 
+/* smtpd_rest_code - map restriction name to restriction code */
+
+ /*
+  * Restriction names are resolved to a code once, so that generic_checks()
+  * and smtpd_check_rewrite() can dispatch on an integer instead of doing a
+  * string comparison for each restriction that comes earlier in their
+  * if-else chain. Names that are not built-in restrictions (restriction
+  * classes, maptype:mapname shorthand) have code SMTPD_REST_NONE.
+  */
+#define SMTPD_REST_NONE			0
+#define SMTPD_REST_WARN_IF_REJECT	1
+#define SMTPD_REST_PERMIT_ALL		2
+#define SMTPD_REST_DEFER_ALL		3
+#define SMTPD_REST_REJECT_ALL		4
+#define SMTPD_REST_REJECT_UNAUTH_PIPE	5
+#define SMTPD_REST_CHECK_POLICY_SERVICE	6
+#define SMTPD_REST_DEFER_IF_PERMIT	7
+#define SMTPD_REST_DEFER_IF_REJECT	8
+#define SMTPD_REST_SLEEP		9
+#define SMTPD_REST_REJECT_PLAINTEXT_SESSION 10
+#define SMTPD_REST_REJECT_UNKNOWN_CLIENT_HOSTNAME 11
+#define SMTPD_REST_REJECT_UNKNOWN_REVERSE_HOSTNAME 12
+#define SMTPD_REST_PERMIT_INET_INTERFACES 13
+#define SMTPD_REST_PERMIT_MYNETWORKS	14
+#define SMTPD_REST_CHECK_CLIENT_ACL	15
+#define SMTPD_REST_CHECK_REVERSE_CLIENT_ACL 16
+#define SMTPD_REST_REJECT_MAPS_RBL	17
+#define SMTPD_REST_REJECT_RBL_CLIENT	18
+#define SMTPD_REST_PERMIT_DNSWL_CLIENT	19
+#define SMTPD_REST_REJECT_RHSBL_CLIENT	20
+#define SMTPD_REST_PERMIT_RHSWL_CLIENT	21
+#define SMTPD_REST_REJECT_RHSBL_REVERSE_CLIENT 22
+#define SMTPD_REST_CHECK_CCERT_ACL	23
+#define SMTPD_REST_CHECK_SASL_ACL	24
+#define SMTPD_REST_CHECK_CLIENT_NS_ACL	25
+#define SMTPD_REST_CHECK_CLIENT_MX_ACL	26
+#define SMTPD_REST_CHECK_CLIENT_A_ACL	27
+#define SMTPD_REST_CHECK_REVERSE_CLIENT_NS_ACL 28
+#define SMTPD_REST_CHECK_REVERSE_CLIENT_MX_ACL 29
+#define SMTPD_REST_CHECK_REVERSE_CLIENT_A_ACL 30
+#define SMTPD_REST_CHECK_HELO_ACL	31
+#define SMTPD_REST_REJECT_INVALID_HELO_HOSTNAME 32
+#define SMTPD_REST_REJECT_UNKNOWN_HELO_HOSTNAME 33
+#define SMTPD_REST_PERMIT_NAKED_IP_ADDR	34
+#define SMTPD_REST_CHECK_HELO_NS_ACL	35
+#define SMTPD_REST_CHECK_HELO_MX_ACL	36
+#define SMTPD_REST_CHECK_HELO_A_ACL	37
+#define SMTPD_REST_REJECT_NON_FQDN_HELO_HOSTNAME 38
+#define SMTPD_REST_REJECT_RHSBL_HELO	39
+#define SMTPD_REST_CHECK_SENDER_ACL	40
+#define SMTPD_REST_REJECT_UNKNOWN_ADDRESS 41
+#define SMTPD_REST_REJECT_UNKNOWN_SENDDOM 42
+#define SMTPD_REST_REJECT_UNVERIFIED_SENDER 43
+#define SMTPD_REST_REJECT_NON_FQDN_SENDER 44
+#define SMTPD_REST_REJECT_AUTH_SENDER_LOGIN_MISMATCH 45
+#define SMTPD_REST_REJECT_KNOWN_SENDER_LOGIN_MISMATCH 46
+#define SMTPD_REST_REJECT_UNAUTH_SENDER_LOGIN_MISMATCH 47
+#define SMTPD_REST_CHECK_SENDER_NS_ACL	48
+#define SMTPD_REST_CHECK_SENDER_MX_ACL	49
+#define SMTPD_REST_CHECK_SENDER_A_ACL	50
+#define SMTPD_REST_REJECT_RHSBL_SENDER	51
+#define SMTPD_REST_REJECT_UNLISTED_SENDER 52
+#define SMTPD_REST_CHECK_RECIP_ACL	53
+#define SMTPD_REST_PERMIT_MX_BACKUP	54
+#define SMTPD_REST_PERMIT_AUTH_DEST	55
+#define SMTPD_REST_REJECT_UNAUTH_DEST	56
+#define SMTPD_REST_DEFER_UNAUTH_DEST	57
+#define SMTPD_REST_CHECK_RELAY_DOMAINS	58
+#define SMTPD_REST_PERMIT_SASL_AUTH	59
+#define SMTPD_REST_PERMIT_TLS_ALL_CLIENTCERTS 60
+#define SMTPD_REST_PERMIT_TLS_CLIENTCERTS 61
+#define SMTPD_REST_REJECT_UNKNOWN_RCPTDOM 62
+#define SMTPD_REST_REJECT_NON_FQDN_RCPT	63
+#define SMTPD_REST_CHECK_RECIP_NS_ACL	64
+#define SMTPD_REST_CHECK_RECIP_MX_ACL	65
+#define SMTPD_REST_CHECK_RECIP_A_ACL	66
+#define SMTPD_REST_REJECT_RHSBL_RECIPIENT 67
+#define SMTPD_REST_CHECK_RCPT_MAPS	68
+#define SMTPD_REST_REJECT_MUL_RCPT_BOUNCE 69
+#define SMTPD_REST_REJECT_UNVERIFIED_RECIP 70
+#define SMTPD_REST_CHECK_ETRN_ACL	71
+#define SMTPD_REST_CHECK_ADDR_MAP	72
+
+static const NAME_CODE smtpd_rest_codes[] = {
+    WARN_IF_REJECT, SMTPD_REST_WARN_IF_REJECT,
+    PERMIT_ALL, SMTPD_REST_PERMIT_ALL,
+    DEFER_ALL, SMTPD_REST_DEFER_ALL,
+    REJECT_ALL, SMTPD_REST_REJECT_ALL,
+    REJECT_UNAUTH_PIPE, SMTPD_REST_REJECT_UNAUTH_PIPE,
+    CHECK_POLICY_SERVICE, SMTPD_REST_CHECK_POLICY_SERVICE,
+    DEFER_IF_PERMIT, SMTPD_REST_DEFER_IF_PERMIT,
+    DEFER_IF_REJECT, SMTPD_REST_DEFER_IF_REJECT,
+    SLEEP, SMTPD_REST_SLEEP,
+    REJECT_PLAINTEXT_SESSION, SMTPD_REST_REJECT_PLAINTEXT_SESSION,
+    REJECT_UNKNOWN_CLIENT_HOSTNAME, SMTPD_REST_REJECT_UNKNOWN_CLIENT_HOSTNAME,
+    REJECT_UNKNOWN_CLIENT, SMTPD_REST_REJECT_UNKNOWN_CLIENT_HOSTNAME,
+    REJECT_UNKNOWN_REVERSE_HOSTNAME, SMTPD_REST_REJECT_UNKNOWN_REVERSE_HOSTNAME,
+    PERMIT_INET_INTERFACES, SMTPD_REST_PERMIT_INET_INTERFACES,
+    PERMIT_MYNETWORKS, SMTPD_REST_PERMIT_MYNETWORKS,
+    CHECK_CLIENT_ACL, SMTPD_REST_CHECK_CLIENT_ACL,
+    CHECK_REVERSE_CLIENT_ACL, SMTPD_REST_CHECK_REVERSE_CLIENT_ACL,
+    REJECT_MAPS_RBL, SMTPD_REST_REJECT_MAPS_RBL,
+    REJECT_RBL_CLIENT, SMTPD_REST_REJECT_RBL_CLIENT,
+    REJECT_RBL, SMTPD_REST_REJECT_RBL_CLIENT,
+    PERMIT_DNSWL_CLIENT, SMTPD_REST_PERMIT_DNSWL_CLIENT,
+    REJECT_RHSBL_CLIENT, SMTPD_REST_REJECT_RHSBL_CLIENT,
+    PERMIT_RHSWL_CLIENT, SMTPD_REST_PERMIT_RHSWL_CLIENT,
+    REJECT_RHSBL_REVERSE_CLIENT, SMTPD_REST_REJECT_RHSBL_REVERSE_CLIENT,
+    CHECK_CCERT_ACL, SMTPD_REST_CHECK_CCERT_ACL,
+    CHECK_SASL_ACL, SMTPD_REST_CHECK_SASL_ACL,
+    CHECK_CLIENT_NS_ACL, SMTPD_REST_CHECK_CLIENT_NS_ACL,
+    CHECK_CLIENT_MX_ACL, SMTPD_REST_CHECK_CLIENT_MX_ACL,
+    CHECK_CLIENT_A_ACL, SMTPD_REST_CHECK_CLIENT_A_ACL,
+    CHECK_REVERSE_CLIENT_NS_ACL, SMTPD_REST_CHECK_REVERSE_CLIENT_NS_ACL,
+    CHECK_REVERSE_CLIENT_MX_ACL, SMTPD_REST_CHECK_REVERSE_CLIENT_MX_ACL,
+    CHECK_REVERSE_CLIENT_A_ACL, SMTPD_REST_CHECK_REVERSE_CLIENT_A_ACL,
+    CHECK_HELO_ACL, SMTPD_REST_CHECK_HELO_ACL,
+    REJECT_INVALID_HELO_HOSTNAME, SMTPD_REST_REJECT_INVALID_HELO_HOSTNAME,
+    REJECT_INVALID_HOSTNAME, SMTPD_REST_REJECT_INVALID_HELO_HOSTNAME,
+    REJECT_UNKNOWN_HELO_HOSTNAME, SMTPD_REST_REJECT_UNKNOWN_HELO_HOSTNAME,
+    REJECT_UNKNOWN_HOSTNAME, SMTPD_REST_REJECT_UNKNOWN_HELO_HOSTNAME,
+    PERMIT_NAKED_IP_ADDR, SMTPD_REST_PERMIT_NAKED_IP_ADDR,
+    CHECK_HELO_NS_ACL, SMTPD_REST_CHECK_HELO_NS_ACL,
+    CHECK_HELO_MX_ACL, SMTPD_REST_CHECK_HELO_MX_ACL,
+    CHECK_HELO_A_ACL, SMTPD_REST_CHECK_HELO_A_ACL,
+    REJECT_NON_FQDN_HELO_HOSTNAME, SMTPD_REST_REJECT_NON_FQDN_HELO_HOSTNAME,
+    REJECT_NON_FQDN_HOSTNAME, SMTPD_REST_REJECT_NON_FQDN_HELO_HOSTNAME,
+    REJECT_RHSBL_HELO, SMTPD_REST_REJECT_RHSBL_HELO,
+    CHECK_SENDER_ACL, SMTPD_REST_CHECK_SENDER_ACL,
+    REJECT_UNKNOWN_ADDRESS, SMTPD_REST_REJECT_UNKNOWN_ADDRESS,
+    REJECT_UNKNOWN_SENDDOM, SMTPD_REST_REJECT_UNKNOWN_SENDDOM,
+    REJECT_UNVERIFIED_SENDER, SMTPD_REST_REJECT_UNVERIFIED_SENDER,
+    REJECT_NON_FQDN_SENDER, SMTPD_REST_REJECT_NON_FQDN_SENDER,
+    REJECT_AUTH_SENDER_LOGIN_MISMATCH, SMTPD_REST_REJECT_AUTH_SENDER_LOGIN_MISMATCH,
+    REJECT_KNOWN_SENDER_LOGIN_MISMATCH, SMTPD_REST_REJECT_KNOWN_SENDER_LOGIN_MISMATCH,
+    REJECT_UNAUTH_SENDER_LOGIN_MISMATCH, SMTPD_REST_REJECT_UNAUTH_SENDER_LOGIN_MISMATCH,
+    CHECK_SENDER_NS_ACL, SMTPD_REST_CHECK_SENDER_NS_ACL,
+    CHECK_SENDER_MX_ACL, SMTPD_REST_CHECK_SENDER_MX_ACL,
+    CHECK_SENDER_A_ACL, SMTPD_REST_CHECK_SENDER_A_ACL,
+    REJECT_RHSBL_SENDER, SMTPD_REST_REJECT_RHSBL_SENDER,
+    REJECT_UNLISTED_SENDER, SMTPD_REST_REJECT_UNLISTED_SENDER,
+    CHECK_RECIP_ACL, SMTPD_REST_CHECK_RECIP_ACL,
+    PERMIT_MX_BACKUP, SMTPD_REST_PERMIT_MX_BACKUP,
+    PERMIT_AUTH_DEST, SMTPD_REST_PERMIT_AUTH_DEST,
+    REJECT_UNAUTH_DEST, SMTPD_REST_REJECT_UNAUTH_DEST,
+    DEFER_UNAUTH_DEST, SMTPD_REST_DEFER_UNAUTH_DEST,
+    CHECK_RELAY_DOMAINS, SMTPD_REST_CHECK_RELAY_DOMAINS,
+    PERMIT_SASL_AUTH, SMTPD_REST_PERMIT_SASL_AUTH,
+    PERMIT_TLS_ALL_CLIENTCERTS, SMTPD_REST_PERMIT_TLS_ALL_CLIENTCERTS,
+    PERMIT_TLS_CLIENTCERTS, SMTPD_REST_PERMIT_TLS_CLIENTCERTS,
+    REJECT_UNKNOWN_RCPTDOM, SMTPD_REST_REJECT_UNKNOWN_RCPTDOM,
+    REJECT_NON_FQDN_RCPT, SMTPD_REST_REJECT_NON_FQDN_RCPT,
+    CHECK_RECIP_NS_ACL, SMTPD_REST_CHECK_RECIP_NS_ACL,
+    CHECK_RECIP_MX_ACL, SMTPD_REST_CHECK_RECIP_MX_ACL,
+    CHECK_RECIP_A_ACL, SMTPD_REST_CHECK_RECIP_A_ACL,
+    REJECT_RHSBL_RECIPIENT, SMTPD_REST_REJECT_RHSBL_RECIPIENT,
+    CHECK_RCPT_MAPS, SMTPD_REST_CHECK_RCPT_MAPS,
+    REJECT_UNLISTED_RCPT, SMTPD_REST_CHECK_RCPT_MAPS,
+    REJECT_MUL_RCPT_BOUNCE, SMTPD_REST_REJECT_MUL_RCPT_BOUNCE,
+    REJECT_UNVERIFIED_RECIP, SMTPD_REST_REJECT_UNVERIFIED_RECIP,
+    CHECK_ETRN_ACL, SMTPD_REST_CHECK_ETRN_ACL,
+    CHECK_ADDR_MAP, SMTPD_REST_CHECK_ADDR_MAP,
+    0, SMTPD_REST_NONE,
+};
+
+ /*
+  * The name-to-code cache is keyed by the name as written, so that a lookup
+  * needs no case folding. The size limit is a safety net against oddball
+  * access map results; real configurations use far fewer names.
+  */
+static HTABLE *smtpd_rest_code_cache;
+
+#define SMTPD_REST_CODE_CACHE_LIMIT	1000
+
+static int smtpd_rest_code(const char *name)
+{
+    HTABLE_INFO *ht;
+    int     code;
+
+    if (smtpd_rest_code_cache == 0)
+	smtpd_rest_code_cache = htable_create(100);
+    if ((ht = htable_locate(smtpd_rest_code_cache, name)) != 0)
+	return (CAST_ANY_PTR_TO_INT(ht->value));
+    code = name_code(smtpd_rest_codes, NAME_CODE_FLAG_NONE, name);
+    if (smtpd_rest_code_cache->used < SMTPD_REST_CODE_CACHE_LIMIT)
+	(void) htable_enter(smtpd_rest_code_cache, name,
+			    CAST_INT_TO_VOID_PTR(code));
+    return (code);
+}
+
 /* is_map_command - restriction has form: check_xxx_access type:name */
 
 static int is_map_command(SMTPD_STATE *state, const char *name,
-			          const char *command, char ***argp)
+			          int code, int command, char ***argp)
 {
 
     /*
@@ -4204,11 +4594,11 @@ static int is_map_command(SMTPD_STATE *state, const char *name,
      * result values, so we use regular returns for (a) and (c), and use long
      * jumps for the error case (b).
      */
-    if (strcasecmp(name, command) != 0) {
+    if (code != command) {
 	return (0);
     } else if (*(*argp + 1) == 0 || strchr(*(*argp += 1), ':') == 0) {
 	msg_warn("restriction %s: bad argument \"%s\": need maptype:mapname",
-		 command, **argp);
+		 name, **argp);
 	reject_server_error(state);
     } else {
 	return (1);
@@ -4238,6 +4628,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
     const char *myname = "generic_checks";
     char  **cpp;
     const char *name;
+    int     code;
     int     status = 0;
     ARGV   *list;
     int     found;
@@ -4246,6 +4637,20 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
     if (msg_verbose)
 	msg_info(">>> START %s RESTRICTIONS <<<", reply_class);
 
+    /*
+     * Look up the DNSXL restrictions in parallel. A not-listed result is
+     * good only for the restrictions that are evaluated now; don't let it
+     * linger until the next client.
+     */
+    if (smtpd_rbl_notfound != 0) {
+	if (saved_recursion == 0 && smtpd_rbl_notfound->used > 0) {
+	    htable_free(smtpd_rbl_notfound, (void (*) (void *)) 0);
+	    smtpd_rbl_notfound = htable_create(10);
+	}
+	dnsxl_prefetch(state, restrictions);
+    }
+    if (saved_recursion == 0)
+	smtpd_check_rest_name = 0;
     for (cpp = restrictions->argv; (name = *cpp) != 0; cpp++) {
 
 	if (state->discard != 0)
@@ -4253,11 +4658,12 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 
 	if (msg_verbose)
 	    msg_info("%s: name=%s", myname, name);
+	code = smtpd_rest_code(name);
 
 	/*
 	 * Pseudo restrictions.
 	 */
-	if (strcasecmp(name, WARN_IF_REJECT) == 0) {
+	if (code == SMTPD_REST_WARN_IF_REJECT) {
 	    if (state->warn_if_reject == 0)
 		state->warn_if_reject = state->recursion;
 	    continue;
@@ -4277,19 +4683,22 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		reject_server_error(state);
 	    }
 	    name = def_acl;
+	    code = smtpd_rest_code(name);
 	    cpp -= 1;
 	}
+	if (saved_recursion == 0)
+	    smtpd_check_rest_name = name;
 
 	/*
 	 * Generic restrictions.
 	 */
-	if (strcasecmp(name, PERMIT_ALL) == 0) {
+	if (code == SMTPD_REST_PERMIT_ALL) {
 	    status = smtpd_acl_permit(state, name, reply_class,
 				      reply_name, NO_PRINT_ARGS);
 	    if (status == SMTPD_CHECK_OK && cpp[1] != 0)
 		msg_warn("restriction `%s' after `%s' is ignored",
 			 cpp[1], PERMIT_ALL);
-	} else if (strcasecmp(name, DEFER_ALL) == 0) {
+	} else if (code == SMTPD_REST_DEFER_ALL) {
 	    status = smtpd_check_reject(state, MAIL_ERROR_POLICY,
 					var_defer_code, "4.3.2",
 					"<%s>: %s rejected: Try again later",
@@ -4297,7 +4706,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    if (cpp[1] != 0 && state->warn_if_reject == 0)
 		msg_warn("restriction `%s' after `%s' is ignored",
 			 cpp[1], DEFER_ALL);
-	} else if (strcasecmp(name, REJECT_ALL) == 0) {
+	} else if (code == SMTPD_REST_REJECT_ALL) {
 	    status = smtpd_check_reject(state, MAIL_ERROR_POLICY,
 					var_reject_code, "5.7.1",
 					"<%s>: %s rejected: Access denied",
@@ -4305,9 +4714,9 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    if (cpp[1] != 0 && state->warn_if_reject == 0)
 		msg_warn("restriction `%s' after `%s' is ignored",
 			 cpp[1], REJECT_ALL);
-	} else if (strcasecmp(name, REJECT_UNAUTH_PIPE) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNAUTH_PIPE) {
 	    status = reject_unauth_pipelining(state, reply_name, reply_class);
-	} else if (strcasecmp(name, CHECK_POLICY_SERVICE) == 0) {
+	} else if (code == SMTPD_REST_CHECK_POLICY_SERVICE) {
 	    if (cpp[1] == 0 || strchr(cpp[1], ':') == 0) {
 		msg_warn("restriction %s must be followed by transport:server",
 			 CHECK_POLICY_SERVICE);
@@ -4315,64 +4724,64 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    } else
 		status = check_policy_service(state, *++cpp, reply_name,
 					      reply_class, def_acl);
-	} else if (strcasecmp(name, DEFER_IF_PERMIT) == 0) {
+	} else if (code == SMTPD_REST_DEFER_IF_PERMIT) {
 	    status = DEFER_IF_PERMIT2(DEFER_IF_PERMIT_ACT,
 				      state, MAIL_ERROR_POLICY,
 				      450, "4.7.0",
 			     "<%s>: %s rejected: defer_if_permit requested",
 				      reply_name, reply_class);
-	} else if (strcasecmp(name, DEFER_IF_REJECT) == 0) {
+	} else if (code == SMTPD_REST_DEFER_IF_REJECT) {
 	    DEFER_IF_REJECT2(state, MAIL_ERROR_POLICY,
 			     450, "4.7.0",
 			     "<%s>: %s rejected: defer_if_reject requested",
 			     reply_name, reply_class);
-	} else if (strcasecmp(name, SLEEP) == 0) {
+	} else if (code == SMTPD_REST_SLEEP) {
 	    if (cpp[1] == 0 || alldig(cpp[1]) == 0) {
 		msg_warn("restriction %s must be followed by number", SLEEP);
 		reject_server_error(state);
 	    } else
 		sleep(atoi(*++cpp));
-	} else if (strcasecmp(name, REJECT_PLAINTEXT_SESSION) == 0) {
+	} else if (code == SMTPD_REST_REJECT_PLAINTEXT_SESSION) {
 	    status = reject_plaintext_session(state);
 	}
 
 	/*
 	 * Client name/address restrictions.
 	 */
-	else if (strcasecmp(name, REJECT_UNKNOWN_CLIENT_HOSTNAME) == 0
-		 || strcasecmp(name, REJECT_UNKNOWN_CLIENT) == 0) {
+	else if (code == SMTPD_REST_REJECT_UNKNOWN_CLIENT_HOSTNAME) {
 	    status = reject_unknown_client(state);
-	} else if (strcasecmp(name, REJECT_UNKNOWN_REVERSE_HOSTNAME) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNKNOWN_REVERSE_HOSTNAME) {
 	    status = reject_unknown_reverse_name(state);
-	} else if (strcasecmp(name, PERMIT_INET_INTERFACES) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_INET_INTERFACES) {
 	    status = permit_inet_interfaces(state);
 	    if (status == SMTPD_CHECK_OK)
 		status = smtpd_acl_permit(state, name, SMTPD_NAME_CLIENT,
 					  state->namaddr, NO_PRINT_ARGS);
-	} else if (strcasecmp(name, PERMIT_MYNETWORKS) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_MYNETWORKS) {
 	    status = permit_mynetworks(state);
 	    if (status == SMTPD_CHECK_OK)
 		status = smtpd_acl_permit(state, name, SMTPD_NAME_CLIENT,
 					  state->namaddr, NO_PRINT_ARGS);
-	} else if (is_map_command(state, name, CHECK_CLIENT_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_CLIENT_ACL, &cpp)) {
 	    status = check_namadr_access(state, *cpp, state->name, state->addr,
 					 FULL, &found, state->namaddr,
 					 SMTPD_NAME_CLIENT, def_acl);
-	} else if (is_map_command(state, name, CHECK_REVERSE_CLIENT_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_REVERSE_CLIENT_ACL, &cpp)) {
 	    status = check_namadr_access(state, *cpp, state->reverse_name, state->addr,
 					 FULL, &found, state->reverse_name,
 					 SMTPD_NAME_REV_CLIENT, def_acl);
 	    forbid_allowlist(state, name, status, state->reverse_name);
-	} else if (strcasecmp(name, REJECT_MAPS_RBL) == 0) {
+	} else if (code == SMTPD_REST_REJECT_MAPS_RBL) {
 	    status = reject_maps_rbl(state);
-	} else if (strcasecmp(name, REJECT_RBL_CLIENT) == 0
-		   || strcasecmp(name, REJECT_RBL) == 0) {
+	} else if (code == SMTPD_REST_REJECT_RBL_CLIENT) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument", name);
 	    else
 		status = reject_rbl_addr(state, *(cpp += 1), state->addr,
 					 SMTPD_NAME_CLIENT);
-	} else if (strcasecmp(name, PERMIT_DNSWL_CLIENT) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_DNSWL_CLIENT) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument", name);
 	    else {
@@ -4382,7 +4791,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = smtpd_acl_permit(state, name, SMTPD_NAME_CLIENT,
 					      state->namaddr, NO_PRINT_ARGS);
 	    }
-	} else if (strcasecmp(name, REJECT_RHSBL_CLIENT) == 0) {
+	} else if (code == SMTPD_REST_REJECT_RHSBL_CLIENT) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument",
 			 name);
@@ -4392,7 +4801,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_rbl_domain(state, *cpp, state->name,
 					       SMTPD_NAME_CLIENT);
 	    }
-	} else if (strcasecmp(name, PERMIT_RHSWL_CLIENT) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_RHSWL_CLIENT) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument",
 			 name);
@@ -4406,7 +4815,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 			  SMTPD_NAME_CLIENT, state->namaddr, NO_PRINT_ARGS);
 		}
 	    }
-	} else if (strcasecmp(name, REJECT_RHSBL_REVERSE_CLIENT) == 0) {
+	} else if (code == SMTPD_REST_REJECT_RHSBL_REVERSE_CLIENT) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument",
 			 name);
@@ -4416,9 +4825,11 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_rbl_domain(state, *cpp, state->reverse_name,
 					       SMTPD_NAME_REV_CLIENT);
 	    }
-	} else if (is_map_command(state, name, CHECK_CCERT_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_CCERT_ACL, &cpp)) {
 	    status = check_ccert_access(state, *cpp, def_acl);
-	} else if (is_map_command(state, name, CHECK_SASL_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_SASL_ACL, &cpp)) {
 #ifdef USE_SASL_AUTH
 	    if (var_smtpd_sasl_enable) {
 		if (state->sasl_username && state->sasl_username[0])
@@ -4426,42 +4837,48 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    } else
 #endif
 		msg_warn("restriction `%s' ignored: no SASL support", name);
-	} else if (is_map_command(state, name, CHECK_CLIENT_NS_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_CLIENT_NS_ACL, &cpp)) {
 	    if (strcasecmp(state->name, "unknown") != 0) {
 		status = check_server_access(state, *cpp, state->name,
 					     T_NS, state->namaddr,
 					     SMTPD_NAME_CLIENT, def_acl);
 		forbid_allowlist(state, name, status, state->name);
 	    }
-	} else if (is_map_command(state, name, CHECK_CLIENT_MX_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_CLIENT_MX_ACL, &cpp)) {
 	    if (strcasecmp(state->name, "unknown") != 0) {
 		status = check_server_access(state, *cpp, state->name,
 					     T_MX, state->namaddr,
 					     SMTPD_NAME_CLIENT, def_acl);
 		forbid_allowlist(state, name, status, state->name);
 	    }
-	} else if (is_map_command(state, name, CHECK_CLIENT_A_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_CLIENT_A_ACL, &cpp)) {
 	    if (strcasecmp(state->name, "unknown") != 0) {
 		status = check_server_access(state, *cpp, state->name,
 					     T_A, state->namaddr,
 					     SMTPD_NAME_CLIENT, def_acl);
 		forbid_allowlist(state, name, status, state->name);
 	    }
-	} else if (is_map_command(state, name, CHECK_REVERSE_CLIENT_NS_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_REVERSE_CLIENT_NS_ACL, &cpp)) {
 	    if (strcasecmp(state->reverse_name, "unknown") != 0) {
 		status = check_server_access(state, *cpp, state->reverse_name,
 					     T_NS, state->reverse_name,
 					     SMTPD_NAME_REV_CLIENT, def_acl);
 		forbid_allowlist(state, name, status, state->reverse_name);
 	    }
-	} else if (is_map_command(state, name, CHECK_REVERSE_CLIENT_MX_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_REVERSE_CLIENT_MX_ACL, &cpp)) {
 	    if (strcasecmp(state->reverse_name, "unknown") != 0) {
 		status = check_server_access(state, *cpp, state->reverse_name,
 					     T_MX, state->reverse_name,
 					     SMTPD_NAME_REV_CLIENT, def_acl);
 		forbid_allowlist(state, name, status, state->reverse_name);
 	    }
-	} else if (is_map_command(state, name, CHECK_REVERSE_CLIENT_A_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_REVERSE_CLIENT_A_ACL, &cpp)) {
 	    if (strcasecmp(state->reverse_name, "unknown") != 0) {
 		status = check_server_access(state, *cpp, state->reverse_name,
 					     T_A, state->reverse_name,
@@ -4473,13 +4890,13 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	/*
 	 * HELO/EHLO parameter restrictions.
 	 */
-	else if (is_map_command(state, name, CHECK_HELO_ACL, &cpp)) {
+	else if (is_map_command(state, name, code,
+				SMTPD_REST_CHECK_HELO_ACL, &cpp)) {
 	    if (state->helo_name)
 		status = check_domain_access(state, *cpp, state->helo_name,
 					     FULL, &found, state->helo_name,
 					     SMTPD_NAME_HELO, def_acl);
-	} else if (strcasecmp(name, REJECT_INVALID_HELO_HOSTNAME) == 0
-		   || strcasecmp(name, REJECT_INVALID_HOSTNAME) == 0) {
+	} else if (code == SMTPD_REST_REJECT_INVALID_HELO_HOSTNAME) {
 	    if (state->helo_name) {
 		if (*state->helo_name != '[')
 		    status = reject_invalid_hostname(state, state->helo_name,
@@ -4488,8 +4905,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_invalid_hostaddr(state, state->helo_name,
 					 state->helo_name, SMTPD_NAME_HELO);
 	    }
-	} else if (strcasecmp(name, REJECT_UNKNOWN_HELO_HOSTNAME) == 0
-		   || strcasecmp(name, REJECT_UNKNOWN_HOSTNAME) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNKNOWN_HELO_HOSTNAME) {
 	    if (state->helo_name) {
 		if (*state->helo_name != '[')
 		    status = reject_unknown_hostname(state, state->helo_name,
@@ -4498,7 +4914,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_invalid_hostaddr(state, state->helo_name,
 					 state->helo_name, SMTPD_NAME_HELO);
 	    }
-	} else if (strcasecmp(name, PERMIT_NAKED_IP_ADDR) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_NAKED_IP_ADDR) {
 	    msg_warn("restriction %s is deprecated. Use %s or %s instead",
 		 PERMIT_NAKED_IP_ADDR, PERMIT_MYNETWORKS, PERMIT_SASL_AUTH);
 	    if (state->helo_name) {
@@ -4508,29 +4924,31 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = smtpd_acl_permit(state, name, SMTPD_NAME_HELO,
 					   state->helo_name, NO_PRINT_ARGS);
 	    }
-	} else if (is_map_command(state, name, CHECK_HELO_NS_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_HELO_NS_ACL, &cpp)) {
 	    if (state->helo_name) {
 		status = check_server_access(state, *cpp, state->helo_name,
 					     T_NS, state->helo_name,
 					     SMTPD_NAME_HELO, def_acl);
 		forbid_allowlist(state, name, status, state->helo_name);
 	    }
-	} else if (is_map_command(state, name, CHECK_HELO_MX_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_HELO_MX_ACL, &cpp)) {
 	    if (state->helo_name) {
 		status = check_server_access(state, *cpp, state->helo_name,
 					     T_MX, state->helo_name,
 					     SMTPD_NAME_HELO, def_acl);
 		forbid_allowlist(state, name, status, state->helo_name);
 	    }
-	} else if (is_map_command(state, name, CHECK_HELO_A_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_HELO_A_ACL, &cpp)) {
 	    if (state->helo_name) {
 		status = check_server_access(state, *cpp, state->helo_name,
 					     T_A, state->helo_name,
 					     SMTPD_NAME_HELO, def_acl);
 		forbid_allowlist(state, name, status, state->helo_name);
 	    }
-	} else if (strcasecmp(name, REJECT_NON_FQDN_HELO_HOSTNAME) == 0
-		   || strcasecmp(name, REJECT_NON_FQDN_HOSTNAME) == 0) {
+	} else if (code == SMTPD_REST_REJECT_NON_FQDN_HELO_HOSTNAME) {
 	    if (state->helo_name) {
 		if (*state->helo_name != '[')
 		    status = reject_non_fqdn_hostname(state, state->helo_name,
@@ -4539,7 +4957,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_invalid_hostaddr(state, state->helo_name,
 					 state->helo_name, SMTPD_NAME_HELO);
 	    }
-	} else if (strcasecmp(name, REJECT_RHSBL_HELO) == 0) {
+	} else if (code == SMTPD_REST_REJECT_RHSBL_HELO) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument",
 			 name);
@@ -4554,7 +4972,8 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	/*
 	 * Sender mail address restrictions.
 	 */
-	else if (is_map_command(state, name, CHECK_SENDER_ACL, &cpp)) {
+	else if (is_map_command(state, name, code,
+				SMTPD_REST_CHECK_SENDER_ACL, &cpp)) {
 	    if (state->sender && *state->sender)
 		status = check_mail_access(state, *cpp, state->sender,
 					   &found, state->sender,
@@ -4563,26 +4982,26 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		status = check_access(state, *cpp, var_smtpd_null_key, FULL,
 				      &found, state->sender,
 				      SMTPD_NAME_SENDER, def_acl);
-	} else if (strcasecmp(name, REJECT_UNKNOWN_ADDRESS) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNKNOWN_ADDRESS) {
 	    if (state->sender && *state->sender)
 		status = reject_unknown_address(state, state->sender,
 					  state->sender, SMTPD_NAME_SENDER);
-	} else if (strcasecmp(name, REJECT_UNKNOWN_SENDDOM) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNKNOWN_SENDDOM) {
 	    if (state->sender && *state->sender)
 		status = reject_unknown_address(state, state->sender,
 					  state->sender, SMTPD_NAME_SENDER);
-	} else if (strcasecmp(name, REJECT_UNVERIFIED_SENDER) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNVERIFIED_SENDER) {
 	    if (state->sender && *state->sender)
 		status = reject_unverified_address(state, state->sender,
 					   state->sender, SMTPD_NAME_SENDER,
 				     var_unv_from_dcode, var_unv_from_rcode,
 						   unv_from_tf_act,
 						   var_unv_from_why);
-	} else if (strcasecmp(name, REJECT_NON_FQDN_SENDER) == 0) {
+	} else if (code == SMTPD_REST_REJECT_NON_FQDN_SENDER) {
 	    if (state->sender && *state->sender)
 		status = reject_non_fqdn_address(state, state->sender,
 					  state->sender, SMTPD_NAME_SENDER);
-	} else if (strcasecmp(name, REJECT_AUTH_SENDER_LOGIN_MISMATCH) == 0) {
+	} else if (code == SMTPD_REST_REJECT_AUTH_SENDER_LOGIN_MISMATCH) {
 #ifdef USE_SASL_AUTH
 	    if (var_smtpd_sasl_enable) {
 		if (state->sender && *state->sender)
@@ -4591,7 +5010,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    } else
 #endif
 		msg_warn("restriction `%s' ignored: no SASL support", name);
-	} else if (strcasecmp(name, REJECT_KNOWN_SENDER_LOGIN_MISMATCH) == 0) {
+	} else if (code == SMTPD_REST_REJECT_KNOWN_SENDER_LOGIN_MISMATCH) {
 #ifdef USE_SASL_AUTH
 	    if (var_smtpd_sasl_enable) {
 		if (state->sender && *state->sender) {
@@ -4604,7 +5023,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    } else
 #endif
 		msg_warn("restriction `%s' ignored: no SASL support", name);
-	} else if (strcasecmp(name, REJECT_UNAUTH_SENDER_LOGIN_MISMATCH) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNAUTH_SENDER_LOGIN_MISMATCH) {
 #ifdef USE_SASL_AUTH
 	    if (var_smtpd_sasl_enable) {
 		if (state->sender && *state->sender)
@@ -4612,28 +5031,31 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    } else
 #endif
 		msg_warn("restriction `%s' ignored: no SASL support", name);
-	} else if (is_map_command(state, name, CHECK_SENDER_NS_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_SENDER_NS_ACL, &cpp)) {
 	    if (state->sender && *state->sender) {
 		status = check_server_access(state, *cpp, state->sender,
 					     T_NS, state->sender,
 					     SMTPD_NAME_SENDER, def_acl);
 		forbid_allowlist(state, name, status, state->sender);
 	    }
-	} else if (is_map_command(state, name, CHECK_SENDER_MX_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_SENDER_MX_ACL, &cpp)) {
 	    if (state->sender && *state->sender) {
 		status = check_server_access(state, *cpp, state->sender,
 					     T_MX, state->sender,
 					     SMTPD_NAME_SENDER, def_acl);
 		forbid_allowlist(state, name, status, state->sender);
 	    }
-	} else if (is_map_command(state, name, CHECK_SENDER_A_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_SENDER_A_ACL, &cpp)) {
 	    if (state->sender && *state->sender) {
 		status = check_server_access(state, *cpp, state->sender,
 					     T_A, state->sender,
 					     SMTPD_NAME_SENDER, def_acl);
 		forbid_allowlist(state, name, status, state->sender);
 	    }
-	} else if (strcasecmp(name, REJECT_RHSBL_SENDER) == 0) {
+	} else if (code == SMTPD_REST_REJECT_RHSBL_SENDER) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument", name);
 	    else {
@@ -4642,7 +5064,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_rbl_domain(state, *cpp, state->sender,
 					       SMTPD_NAME_SENDER);
 	    }
-	} else if (strcasecmp(name, REJECT_UNLISTED_SENDER) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNLISTED_SENDER) {
 	    if (state->sender && *state->sender)
 		status = check_sender_rcpt_maps(state, state->sender);
 	}
@@ -4650,12 +5072,13 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	/*
 	 * Recipient mail address restrictions.
 	 */
-	else if (is_map_command(state, name, CHECK_RECIP_ACL, &cpp)) {
+	else if (is_map_command(state, name, code,
+				SMTPD_REST_CHECK_RECIP_ACL, &cpp)) {
 	    if (state->recipient)
 		status = check_mail_access(state, *cpp, state->recipient,
 					   &found, state->recipient,
 					   SMTPD_NAME_RECIPIENT, def_acl);
-	} else if (strcasecmp(name, PERMIT_MX_BACKUP) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_MX_BACKUP) {
 	    if (state->recipient) {
 		status = permit_mx_backup(state, state->recipient,
 				    state->recipient, SMTPD_NAME_RECIPIENT);
@@ -4663,22 +5086,22 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = smtpd_acl_permit(state, name, SMTPD_NAME_RECIPIENT,
 					   state->recipient, NO_PRINT_ARGS);
 	    }
-	} else if (strcasecmp(name, PERMIT_AUTH_DEST) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_AUTH_DEST) {
 	    if (state->recipient) {
 		status = permit_auth_destination(state, state->recipient);
 		if (status == SMTPD_CHECK_OK)
 		    status = smtpd_acl_permit(state, name, SMTPD_NAME_RECIPIENT,
 					   state->recipient, NO_PRINT_ARGS);
 	    }
-	} else if (strcasecmp(name, REJECT_UNAUTH_DEST) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNAUTH_DEST) {
 	    if (state->recipient)
 		status = reject_unauth_destination(state, state->recipient,
 						   var_relay_code, "5.7.1");
-	} else if (strcasecmp(name, DEFER_UNAUTH_DEST) == 0) {
+	} else if (code == SMTPD_REST_DEFER_UNAUTH_DEST) {
 	    if (state->recipient)
 		status = reject_unauth_destination(state, state->recipient,
 					     var_relay_code - 100, "4.7.1");
-	} else if (strcasecmp(name, CHECK_RELAY_DOMAINS) == 0) {
+	} else if (code == SMTPD_REST_CHECK_RELAY_DOMAINS) {
 	    if (state->recipient)
 		status = check_relay_domains(state, state->recipient,
 				    state->recipient, SMTPD_NAME_RECIPIENT);
@@ -4688,7 +5111,7 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	    if (cpp[1] != 0 && state->warn_if_reject == 0)
 		msg_warn("restriction `%s' after `%s' is ignored",
 			 cpp[1], CHECK_RELAY_DOMAINS);
-	} else if (strcasecmp(name, PERMIT_SASL_AUTH) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_SASL_AUTH) {
 #ifdef USE_SASL_AUTH
 	    if (smtpd_sasl_is_active(state)) {
 		status = permit_sasl_auth(state,
@@ -4698,46 +5121,49 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 					      state->namaddr, NO_PRINT_ARGS);
 	    }
 #endif
-	} else if (strcasecmp(name, PERMIT_TLS_ALL_CLIENTCERTS) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_TLS_ALL_CLIENTCERTS) {
 	    status = permit_tls_clientcerts(state, 1);
 	    if (status == SMTPD_CHECK_OK)
 		status = smtpd_acl_permit(state, name, SMTPD_NAME_CLIENT,
 					  state->namaddr, NO_PRINT_ARGS);
-	} else if (strcasecmp(name, PERMIT_TLS_CLIENTCERTS) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_TLS_CLIENTCERTS) {
 	    status = permit_tls_clientcerts(state, 0);
 	    if (status == SMTPD_CHECK_OK)
 		status = smtpd_acl_permit(state, name, SMTPD_NAME_CLIENT,
 					  state->namaddr, NO_PRINT_ARGS);
-	} else if (strcasecmp(name, REJECT_UNKNOWN_RCPTDOM) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNKNOWN_RCPTDOM) {
 	    if (state->recipient)
 		status = reject_unknown_address(state, state->recipient,
 				    state->recipient, SMTPD_NAME_RECIPIENT);
-	} else if (strcasecmp(name, REJECT_NON_FQDN_RCPT) == 0) {
+	} else if (code == SMTPD_REST_REJECT_NON_FQDN_RCPT) {
 	    if (state->recipient)
 		status = reject_non_fqdn_address(state, state->recipient,
 				    state->recipient, SMTPD_NAME_RECIPIENT);
-	} else if (is_map_command(state, name, CHECK_RECIP_NS_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_RECIP_NS_ACL, &cpp)) {
 	    if (state->recipient && *state->recipient) {
 		status = check_server_access(state, *cpp, state->recipient,
 					     T_NS, state->recipient,
 					     SMTPD_NAME_RECIPIENT, def_acl);
 		forbid_allowlist(state, name, status, state->recipient);
 	    }
-	} else if (is_map_command(state, name, CHECK_RECIP_MX_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_RECIP_MX_ACL, &cpp)) {
 	    if (state->recipient && *state->recipient) {
 		status = check_server_access(state, *cpp, state->recipient,
 					     T_MX, state->recipient,
 					     SMTPD_NAME_RECIPIENT, def_acl);
 		forbid_allowlist(state, name, status, state->recipient);
 	    }
-	} else if (is_map_command(state, name, CHECK_RECIP_A_ACL, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_RECIP_A_ACL, &cpp)) {
 	    if (state->recipient && *state->recipient) {
 		status = check_server_access(state, *cpp, state->recipient,
 					     T_A, state->recipient,
 					     SMTPD_NAME_RECIPIENT, def_acl);
 		forbid_allowlist(state, name, status, state->recipient);
 	    }
-	} else if (strcasecmp(name, REJECT_RHSBL_RECIPIENT) == 0) {
+	} else if (code == SMTPD_REST_REJECT_RHSBL_RECIPIENT) {
 	    if (cpp[1] == 0)
 		msg_warn("restriction %s requires domain name argument", name);
 	    else {
@@ -4746,18 +5172,17 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 		    status = reject_rbl_domain(state, *cpp, state->recipient,
 					       SMTPD_NAME_RECIPIENT);
 	    }
-	} else if (strcasecmp(name, CHECK_RCPT_MAPS) == 0
-		   || strcasecmp(name, REJECT_UNLISTED_RCPT) == 0) {
+	} else if (code == SMTPD_REST_CHECK_RCPT_MAPS) {
 	    if (state->recipient && *state->recipient)
 		status = check_recipient_rcpt_maps(state, state->recipient);
-	} else if (strcasecmp(name, REJECT_MUL_RCPT_BOUNCE) == 0) {
+	} else if (code == SMTPD_REST_REJECT_MUL_RCPT_BOUNCE) {
 	    if (state->sender && *state->sender == 0 && state->rcpt_count
 		> (strcmp(state->where, SMTPD_CMD_RCPT) != 0))
 		status = smtpd_check_reject(state, MAIL_ERROR_POLICY,
 					    var_mul_rcpt_code, "5.5.3",
 				"<%s>: %s rejected: Multi-recipient bounce",
 					    reply_name, reply_class);
-	} else if (strcasecmp(name, REJECT_UNVERIFIED_RECIP) == 0) {
+	} else if (code == SMTPD_REST_REJECT_UNVERIFIED_RECIP) {
 	    if (state->recipient && *state->recipient)
 		status = reject_unverified_address(state, state->recipient,
 				     state->recipient, SMTPD_NAME_RECIPIENT,
@@ -4769,7 +5194,8 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	/*
 	 * ETRN domain name restrictions.
 	 */
-	else if (is_map_command(state, name, CHECK_ETRN_ACL, &cpp)) {
+	else if (is_map_command(state, name, code,
+				SMTPD_REST_CHECK_ETRN_ACL, &cpp)) {
 	    if (state->etrn_name)
 		status = check_domain_access(state, *cpp, state->etrn_name,
 					     FULL, &found, state->etrn_name,
@@ -4813,6 +5239,8 @@ static int generic_checks(SMTPD_STATE *state, ARGV *restrictions,
 	msg_info(">>> END %s RESTRICTIONS <<<", reply_class);
 
     state->recursion = saved_recursion;
+    if (saved_recursion == 0)
+	smtpd_check_rest_name = 0;
 
     /* In case the list terminated with one or more warn_if_mumble. */
     if (state->warn_if_reject >= state->recursion)
@@ -4866,6 +5294,7 @@ char   *smtpd_check_rewrite(SMTPD_STATE *state)
     char  **cpp;
     MAPS   *maps;
     char   *name;
+    int     code;
 
     /*
      * We don't use generic_checks() because it produces results that aren't
@@ -4879,11 +5308,13 @@ char   *smtpd_check_rewrite(SMTPD_STATE *state)
 	    name = CHECK_ADDR_MAP;
 	    cpp -= 1;
 	}
-	if (strcasecmp(name, PERMIT_INET_INTERFACES) == 0) {
+	code = smtpd_rest_code(name);
+	if (code == SMTPD_REST_PERMIT_INET_INTERFACES) {
 	    status = permit_inet_interfaces(state);
-	} else if (strcasecmp(name, PERMIT_MYNETWORKS) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_MYNETWORKS) {
 	    status = permit_mynetworks(state);
-	} else if (is_map_command(state, name, CHECK_ADDR_MAP, &cpp)) {
+	} else if (is_map_command(state, name, code,
+				  SMTPD_REST_CHECK_ADDR_MAP, &cpp)) {
 	    if ((maps = (MAPS *) htable_find(map_command_table, *cpp)) == 0)
 		msg_panic("%s: dictionary not found: %s", myname, *cpp);
 	    if (maps_find(maps, state->addr, 0) != 0)
@@ -4892,15 +5323,15 @@ char   *smtpd_check_rewrite(SMTPD_STATE *state)
 		/* Warning is already logged. */
 		status = maps->error;
 	    }
-	} else if (strcasecmp(name, PERMIT_SASL_AUTH) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_SASL_AUTH) {
 #ifdef USE_SASL_AUTH
 	    if (smtpd_sasl_is_active(state))
 		status = permit_sasl_auth(state, SMTPD_CHECK_OK,
 					  SMTPD_CHECK_DUNNO);
 #endif
-	} else if (strcasecmp(name, PERMIT_TLS_ALL_CLIENTCERTS) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_TLS_ALL_CLIENTCERTS) {
 	    status = permit_tls_clientcerts(state, 1);
-	} else if (strcasecmp(name, PERMIT_TLS_CLIENTCERTS) == 0) {
+	} else if (code == SMTPD_REST_PERMIT_TLS_CLIENTCERTS) {
 	    status = permit_tls_clientcerts(state, 0);
 	} else {
 	    msg_warn("parameter %s: invalid request: %s",
@@ -5318,6 +5749,7 @@ static int check_rcpt_maps(SMTPD_STATE *state, const char *sender,
 {
     const RESOLVE_REPLY *reply;
     DSN_SPLIT dp;
+    int     filter_miss;
 
     if (msg_verbose)
 	msg_info(">>> CHECKING %s VALIDATION MAPS <<<", reply_class);
@@ -5337,6 +5769,27 @@ static int check_rcpt_maps(SMTPD_STATE *state, const char *sender,
 
 #define NOMATCH(map, rcpt) (MATCH(map, rcpt) == 0)
 
+    /*
+     * A recipient that is not in smtpd_recipient_filter_maps is not in any
+     * table below, so we reject it without querying those tables, which may
+     * involve proxymap(8), LDAP or SQL round trips. This matters during
+     * dictionary attacks, where almost every recipient is unknown. The
+     * filter applies only in address classes that have a recipient table.
+     */
+#define RCPT_CLASS_HAS_MAPS(flags) \
+	(((flags) & RESOLVE_CLASS_LOCAL) ? *var_local_rcpt_maps : \
+	 ((flags) & RESOLVE_CLASS_VIRTUAL) ? *var_virt_mailbox_maps : \
+	 ((flags) & RESOLVE_CLASS_RELAY) ? *var_relay_rcpt_maps : \
+	 ((flags) & RESOLVE_CLASS_ALIAS) != 0)
+
+    filter_miss = (*var_smtpd_rcpt_filter_maps
+		   && strcmp(reply_class, SMTPD_NAME_RECIPIENT) == 0
+		   && RCPT_CLASS_HAS_MAPS(reply->flags)
+		   && NOMATCH(rcpt_filter_maps, CONST_STR(reply->recipient)));
+    if (msg_verbose && filter_miss)
+	msg_info("%s: %s not found in %s", reply_class,
+		 recipient, VAR_SMTPD_RCPT_FILTER_MAPS);
+
     /*
      * XXX We assume the recipient address is OK if it matches a canonical
      * map or virtual alias map. Eventually, the address resolver should give
@@ -5345,11 +5798,12 @@ static int check_rcpt_maps(SMTPD_STATE *state, const char *sender,
      * stream. See also the next comment block on recipients in virtual alias
      * domains.
      */
-    if (MATCH(rcpt_canon_maps, CONST_STR(reply->recipient))
-	|| (strcmp(reply_class, SMTPD_NAME_SENDER) == 0
-	    && MATCH(send_canon_maps, CONST_STR(reply->recipient)))
-	|| MATCH(canonical_maps, CONST_STR(reply->recipient))
-	|| MATCH(virt_alias_maps, CONST_STR(reply->recipient)))
+    if (!filter_miss
+	&& (MATCH(rcpt_canon_maps, CONST_STR(reply->recipient))
+	    || (strcmp(reply_class, SMTPD_NAME_SENDER) == 0
+		&& MATCH(send_canon_maps, CONST_STR(reply->recipient)))
+	    || MATCH(canonical_maps, CONST_STR(reply->recipient))
+	    || MATCH(virt_alias_maps, CONST_STR(reply->recipient))))
 	return (0);
 
     /*
@@ -5414,7 +5868,8 @@ static int check_rcpt_maps(SMTPD_STATE *state, const char *sender,
 	/* Generated by bounce. */
 	  && !MATCH_LEFT(MAIL_ADDR_MAIL_DAEMON, CONST_STR(reply->recipient),
 			 strlen(MAIL_ADDR_MAIL_DAEMON))
-	    && NOMATCH(local_rcpt_maps, CONST_STR(reply->recipient)))
+	    && (filter_miss
+		|| NOMATCH(local_rcpt_maps, CONST_STR(reply->recipient))))
 	    return (smtpd_check_reject(state, MAIL_ERROR_BOUNCE,
 				       var_local_rcpt_code,
 			       strcmp(reply_class, SMTPD_NAME_SENDER) == 0 ?
@@ -5430,7 +5885,8 @@ static int check_rcpt_maps(SMTPD_STATE *state, const char *sender,
 	 */
     case RESOLVE_CLASS_VIRTUAL:
 	if (*var_virt_mailbox_maps
-	    && NOMATCH(virt_mailbox_maps, CONST_STR(reply->recipient)))
+	    && (filter_miss
+		|| NOMATCH(virt_mailbox_maps, CONST_STR(reply->recipient))))
 	    return (smtpd_check_reject(state, MAIL_ERROR_BOUNCE,
 				       var_virt_mailbox_code,
 			       strcmp(reply_class, SMTPD_NAME_SENDER) == 0 ?
@@ -5446,7 +5902,8 @@ static int check_rcpt_maps(SMTPD_STATE *state, const char *sender,
 	 */
     case RESOLVE_CLASS_RELAY:
 	if (*var_relay_rcpt_maps
-	    && NOMATCH(relay_rcpt_maps, CONST_STR(reply->recipient)))
+	    && (filter_miss
+		|| NOMATCH(relay_rcpt_maps, CONST_STR(reply->recipient))))
 	    return (smtpd_check_reject(state, MAIL_ERROR_BOUNCE,
 				       var_relay_rcpt_code,
 			       strcmp(reply_class, SMTPD_NAME_SENDER) == 0 ?
@@ -5703,6 +6160,7 @@ char   *var_rbl_reply_maps;
 char   *var_smtpd_exp_filter;
 char   *var_def_rbl_reply;
 char   *var_relay_rcpt_maps;
+char   *var_smtpd_rcpt_filter_maps;
 char   *var_verify_sender;
 char   *var_smtpd_sasl_opts;
 char   *var_local_rwr_clients;
@@ -5754,6 +6212,7 @@ static const STRING_TABLE string_table[] = {
     VAR_SMTPD_EXP_FILTER, DEF_SMTPD_EXP_FILTER, &var_smtpd_exp_filter,
     VAR_DEF_RBL_REPLY, DEF_DEF_RBL_REPLY, &var_def_rbl_reply,
     VAR_RELAY_RCPT_MAPS, DEF_RELAY_RCPT_MAPS, &var_relay_rcpt_maps,
+    VAR_SMTPD_RCPT_FILTER_MAPS, DEF_SMTPD_RCPT_FILTER_MAPS, &var_smtpd_rcpt_filter_maps,
     VAR_VERIFY_SENDER, DEF_VERIFY_SENDER, &var_verify_sender,
     VAR_MAIL_NAME, DEF_MAIL_NAME, &var_mail_name,
     VAR_SMTPD_SASL_OPTS, DEF_SMTPD_SASL_OPTS, &var_smtpd_sasl_opts,
@@ -5854,6 +6313,8 @@ bool    var_smtpd_tls_ask_ccert;
 int     var_smtpd_cipv4_prefix;
 int     var_smtpd_cipv6_prefix;
 bool	var_smtpd_tls_enable_rpk;
+bool    var_smtpd_dnsbl_prefetch;
+int     var_smtpd_dnsbl_pf_tmout;
 
 #define int_table test_int_table
 
@@ -5892,6 +6353,7 @@ static const INT_TABLE int_table[] = {
     VAR_SMTPD_CIPV4_PREFIX, DEF_SMTPD_CIPV4_PREFIX, &var_smtpd_cipv4_prefix,
     VAR_SMTPD_CIPV6_PREFIX, DEF_SMTPD_CIPV6_PREFIX, &var_smtpd_cipv6_prefix,
     VAR_SMTPD_TLS_ENABLE_RPK, DEF_SMTPD_TLS_ENABLE_RPK, &var_smtpd_tls_enable_rpk,
+    VAR_SMTPD_DNSBL_PREFETCH, DEF_SMTPD_DNSBL_PREFETCH, &var_smtpd_dnsbl_prefetch,
     0,
 };
 
@@ -5999,6 +6461,7 @@ void    resolve_clnt_free(RESOLVE_REPLY *reply)
 }
 
 bool    var_smtpd_sasl_enable = 0;
+bool    var_smtpd_shape_log = 0;
 
 #ifdef USE_SASL_AUTH
 
@@ -6056,6 +6519,17 @@ VSTRING *rewrite_clnt_internal(const char *context, const char *addr,
     return (result);
 }
 
+/* rewrite_clnt_internal_pipeline - stub */
+
+void    rewrite_clnt_internal_pipeline(const char *context, const char **addrs,
+				               ssize_t count, VSTRING **results)
+{
+    ssize_t n;
+
+    for (n = 0; n < count; n++)
+	rewrite_clnt_internal(context, addrs[n], results[n]);
+}
+
 /* resolve_clnt_query - stub */
 
 void    resolve_clnt(const char *class, const char *unused_sender, const char *addr,
@@ -6297,6 +6771,14 @@ int     main(int argc, char **argv)
 		resp = 0;
 		break;
 	    }
+	    if (strcasecmp(args->argv[0], VAR_SMTPD_RCPT_FILTER_MAPS) == 0) {
+		UPDATE_STRING(var_smtpd_rcpt_filter_maps, args->argv[1]);
+		UPDATE_MAPS(rcpt_filter_maps, VAR_SMTPD_RCPT_FILTER_MAPS,
+			    var_smtpd_rcpt_filter_maps, DICT_FLAG_LOCK
+			    | DICT_FLAG_FOLD_FIX | DICT_FLAG_UTF8_REQUEST);
+		resp = 0;
+		break;
+	    }
 	    if (strcasecmp(args->argv[0], VAR_CANONICAL_MAPS) == 0) {
 		UPDATE_STRING(var_canonical_maps, args->argv[1]);
 		UPDATE_MAPS(canonical_maps, VAR_CANONICAL_MAPS,
@@ -14,6 +14,11 @@
 /* AUXILIARY METHODS
 /*	void	smtpd_peer_from_default(state)
 /*	SMTPD_STATE *state;
+/*
+/*	void	smtpd_peer_cache_init(map, ttl, temp_ttl)
+/*	const char *map;
+/*	int	ttl;
+/*	int	temp_ttl;
 /* DESCRIPTION
 /*	The smtpd_peer_init() routine attempts to produce a printable
 /*	version of the peer name and address of the specified socket.
@@ -103,6 +108,13 @@
 /*	smtpd_peer_from_default() looks up connection information
 /*	when an up-stream proxy indicates that a connection is not
 /*	proxied.
+/*
+/*	smtpd_peer_cache_init() opens the specified table as a cache
+/*	for the client hostname lookup results: name, reverse_name,
+/*	name_status and reverse_name_status. A cached result is
+/*	used for \fIttl\fR seconds, or \fItemp_ttl\fR seconds
+/*	when name_status or reverse_name_status is 4. Call this
+/*	before entering the chroot jail.
 /* LICENSE
 /* .ad
 /* .fi
@@ -127,7 +139,10 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>
+#include <stdio.h>			/* sscanf() */
 #include <string.h>
+#include <fcntl.h>
+#include <time.h>
 #include <htable.h>
 
 /* Utility library. */
@@ -140,6 +155,8 @@
 #include <inet_proto.h>
 #include <split_at.h>
 #include <inet_prefix_top.h>
+#include <valid_hostname.h>
+#include <dict.h>
 
 /* Global library. */
 
@@ -154,6 +171,16 @@
 
 static const INET_PROTO_INFO *proto_info;
 
+ /*
+  * Optional client hostname lookup result cache. Each value contains a time
+  * stamp, the name and reverse_name status codes, and the name and
+  * reverse_name. The time stamp is checked upon lookup, so that the table
+  * needs no cleanup other than for addresses that never connect again.
+  */
+static DICT *smtpd_peer_cache;
+static int smtpd_peer_cache_ttl;
+static int smtpd_peer_cache_temp_ttl;
+
  /*
   * XXX If we make local port information available via logging, then we must
   * also support these attributes with the XFORWARD command.
@@ -316,6 +343,106 @@ static int smtpd_peer_sockaddr_to_hostaddr(SMTPD_STATE *state)
     }
 }
 
+/* smtpd_peer_cache_init - open hostname lookup cache */
+
+void    smtpd_peer_cache_init(const char *map, int ttl, int temp_ttl)
+{
+#define CACHE_DICT_OPEN_FLAGS \
+	(DICT_FLAG_DUP_REPLACE | DICT_FLAG_SYNC_UPDATE | DICT_FLAG_UTF8_REQUEST)
+
+    smtpd_peer_cache = dict_open(map, O_CREAT | O_RDWR, CACHE_DICT_OPEN_FLAGS);
+    smtpd_peer_cache_ttl = ttl;
+    smtpd_peer_cache_temp_ttl = temp_ttl;
+}
+
+/* smtpd_peer_cache_valid_name - sanity check cached name */
+
+static int smtpd_peer_cache_valid_name(const char *name, int status)
+{
+    if (status == SMTPD_PEER_CODE_OK)
+	return (valid_hostname(name, DONT_GRIPE));
+    return (strcmp(name, CLIENT_NAME_UNKNOWN) == 0);
+}
+
+/* smtpd_peer_cache_valid_status - sanity check cached status */
+
+static int smtpd_peer_cache_valid_status(int status)
+{
+    return (status == SMTPD_PEER_CODE_OK || status == SMTPD_PEER_CODE_TEMP
+	    || status == SMTPD_PEER_CODE_PERM
+	    || status == SMTPD_PEER_CODE_FORGED);
+}
+
+/* smtpd_peer_cache_find - look up cached hostname information */
+
+static int smtpd_peer_cache_find(SMTPD_STATE *state)
+{
+    const char *entry;
+    char   *saved_entry;
+    char   *cp;
+    char   *name;
+    char   *reverse_name;
+    unsigned long time_stamp;
+    int     name_status;
+    int     reverse_name_status;
+    int     ttl;
+    int     found = 0;
+
+    if ((entry = dict_get(smtpd_peer_cache, state->addr)) == 0) {
+	if (smtpd_peer_cache->error)
+	    msg_warn("%s: lookup failed for %s",
+		     smtpd_peer_cache->name, state->addr);
+	return (0);
+    }
+    cp = saved_entry = mystrdup(entry);
+    if (sscanf(cp, "%lu;%d;%d;", &time_stamp, &name_status,
+	       &reverse_name_status) != 3
+	|| (cp = split_at(cp, ';')) == 0 || (cp = split_at(cp, ';')) == 0
+	|| (name = split_at(cp, ';')) == 0
+	|| (reverse_name = split_at(name, ';')) == 0
+	|| !smtpd_peer_cache_valid_status(name_status)
+	|| !smtpd_peer_cache_valid_status(reverse_name_status)
+	|| reverse_name_status == SMTPD_PEER_CODE_FORGED
+	|| !smtpd_peer_cache_valid_name(name, name_status)
+	|| !smtpd_peer_cache_valid_name(reverse_name, reverse_name_status)) {
+	msg_warn("%s: bad cache entry for %s: %.100s",
+		 smtpd_peer_cache->name, state->addr, entry);
+    } else {
+	ttl = (name_status == SMTPD_PEER_CODE_TEMP
+	       || reverse_name_status == SMTPD_PEER_CODE_TEMP) ?
+	    smtpd_peer_cache_temp_ttl : smtpd_peer_cache_ttl;
+	if (time_stamp + ttl >= (unsigned long) time((time_t *) 0)) {
+	    state->name = mystrdup(name);
+	    state->reverse_name = mystrdup(reverse_name);
+	    state->name_status = name_status;
+	    state->reverse_name_status = reverse_name_status;
+	    found = 1;
+	}
+    }
+    myfree(saved_entry);
+    if (msg_verbose)
+	msg_info("smtpd_peer_cache_find: %s: %s", state->addr,
+		 found ? "found" : "expired or invalid");
+    return (found);
+}
+
+/* smtpd_peer_cache_store - save hostname information */
+
+static void smtpd_peer_cache_store(SMTPD_STATE *state)
+{
+    VSTRING *buf = vstring_alloc(100);
+
+    vstring_sprintf(buf, "%lu;%d;%d;%s;%s",
+		    (unsigned long) time((time_t *) 0),
+		    state->name_status, state->reverse_name_status,
+		    state->name, state->reverse_name);
+    if (dict_put(smtpd_peer_cache, state->addr, vstring_str(buf)) != 0
+	&& smtpd_peer_cache->error)
+	msg_warn("%s: update failed for %s",
+		 smtpd_peer_cache->name, state->addr);
+    vstring_free(buf);
+}
+
 /* smtpd_peer_sockaddr_to_hostname - client hostname lookup */
 
 static void smtpd_peer_sockaddr_to_hostname(SMTPD_STATE *state)
@@ -348,6 +475,9 @@ static void smtpd_peer_sockaddr_to_hostname(SMTPD_STATE *state)
 	state->reverse_name = mystrdup(CLIENT_NAME_UNKNOWN);
 	state->name_status = SMTPD_PEER_CODE_PERM;
 	state->reverse_name_status = SMTPD_PEER_CODE_PERM;
+	return;
+    } else if (smtpd_peer_cache != 0 && smtpd_peer_cache_find(state)) {
+	return;
     } else if ((aierr = sockaddr_to_hostname(sa, sa_length, &client_name,
 					 (MAI_SERVNAME_STR *) 0, 0)) != 0) {
 	state->name = mystrdup(CLIENT_NAME_UNKNOWN);
@@ -397,6 +527,8 @@ static void smtpd_peer_sockaddr_to_hostname(SMTPD_STATE *state)
 	    freeaddrinfo(res0);
 	}
     }
+    if (smtpd_peer_cache != 0)
+	smtpd_peer_cache_store(state);
 }
 
 /* smtpd_peer_hostaddr_to_sockaddr - convert numeric string to binary */
@@ -92,6 +92,8 @@ static void *resolve_pagein(const char *sender_plus_addr, void *unused_context)
     RESOLVE_REPLY *reply;
     const char *sender;
     const char *addr;
+    const char *addrs[2];
+    VSTRING *results[2];
 
     /*
      * Initialize on the fly.
@@ -117,10 +119,14 @@ static void *resolve_pagein(const char *sender_plus_addr, void *unused_context)
 	msg_panic("%s: bad search key: \"%s\"", myname, sender_plus_addr);
 
     /*
-     * Resolve the address.
+     * Resolve the address. The sender and recipient are rewritten with one
+     * round trip to the rewriting service.
      */
-    rewrite_clnt_internal(MAIL_ATTR_RWR_LOCAL, sender, sender_buf);
-    rewrite_clnt_internal(MAIL_ATTR_RWR_LOCAL, addr, query);
+    addrs[0] = sender;
+    addrs[1] = addr;
+    results[0] = sender_buf;
+    results[1] = query;
+    rewrite_clnt_internal_pipeline(MAIL_ATTR_RWR_LOCAL, addrs, 2, results);
     resolve_clnt_query_from(STR(sender_buf), STR(query), reply);
     vstring_strcpy(junk, STR(reply->recipient));
     casefold(reply->recipient, STR(junk));	/* XXX */
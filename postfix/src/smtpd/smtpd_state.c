@@ -87,6 +87,9 @@ void    smtpd_state_init(SMTPD_STATE *state, VSTREAM *stream,
     state->err = CLEANUP_STAT_OK;
     state->client = stream;
     state->service = mystrdup(service);
+    GETTIMEOFDAY(&state->session_start);
+    state->greet_time.tv_sec = state->greet_time.tv_usec = 0;
+    state->commit_time.tv_sec = state->commit_time.tv_usec = 0;
     state->buffer = vstring_alloc(100);
     state->addr_buf = vstring_alloc(100);
     state->conn_count = state->conn_rate = 0;
@@ -101,6 +104,9 @@ void    smtpd_state_init(SMTPD_STATE *state, VSTREAM *stream,
     state->rcpt_count = 0;
     state->access_denied = 0;
     state->history = 0;
+    state->shape = var_smtpd_shape_log ? vstring_alloc(100) : 0;
+    state->shape_pending = 0;
+    GETTIMEOFDAY(&state->shape_reply);
     state->reason = 0;
     state->sender = 0;
     state->verp_delims = 0;
@@ -129,6 +135,7 @@ void    smtpd_state_init(SMTPD_STATE *state, VSTREAM *stream,
     state->saved_redirect = 0;
     state->saved_bcc = 0;
     state->saved_flags = 0;
+    state->saved_priority = 0;
 #ifdef DELAY_ACTION
     state->saved_delay = 0;
 #endif
@@ -211,6 +218,8 @@ void    smtpd_state_reset(SMTPD_STATE *state)
 	myfree(state->access_denied);
     if (state->protocol)
 	myfree(state->protocol);
+    if (state->shape)
+	vstring_free(state->shape);
     smtpd_peer_reset(state);
 
     /*
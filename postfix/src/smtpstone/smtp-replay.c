@@ -0,0 +1,738 @@
+/*++
+/* NAME
+/*	smtp-replay 1
+/* SUMMARY
+/*	replay SMTP session shapes
+/* SYNOPSIS
+/* .fi
+/*	\fBsmtp-replay\fR [\fIoptions\fR] [\fBinet:\fR]\fIhost\fR[:\fIport\fR]
+/*	[\fIfile ...\fR]
+/*
+/*	\fBsmtp-replay\fR [\fIoptions\fR] \fBunix:\fIpathname\fR
+/*	[\fIfile ...\fR]
+/* DESCRIPTION
+/*	\fBsmtp-replay\fR reads the "session shape" records that the
+/*	Postfix SMTP server logs with "\fBsmtpd_session_shape_logging
+/*	= yes\fR", and re-drives those sessions against a test
+/*	server, in order to benchmark SMTP server access restrictions
+/*	and Milter applications with a realistic mix of commands,
+/*	recipient counts, message sizes, header counts, pipelining,
+/*	and rejected requests. Records are read from the named
+/*	files (typically, a copy of the maillog file), or from
+/*	standard input. Other records are ignored.
+/*
+/*	Each session shape is replayed as follows:
+/* .IP \(bu
+/*	HELO, EHLO, MAIL, RCPT, DATA, RSET, NOOP, VRFY, ETRN and
+/*	QUIT commands are sent with the addresses and names that
+/*	are specified with command-line options. An RCPT command
+/*	that was rejected in the recorded session is sent with the
+/*	address specified with \fB-R\fR, if any.
+/* .IP \(bu
+/*	DATA content and BDAT chunks are generated with the recorded
+/*	size and number of message headers.
+/* .IP \(bu
+/*	Commands that the client sent without waiting for the
+/*	server reply, are sent as one pipelined group.
+/* .IP \(bu
+/*	Before each command that was not pipelined, the client
+/*	waits for the recorded time between the previous server
+/*	reply and the command, multiplied by the \fB-D\fR factor.
+/* .IP \(bu
+/*	STARTTLS, AUTH, XCLIENT and XFORWARD commands are skipped;
+/*	sessions are replayed without TLS. Unrecognized commands
+/*	are replayed as an unknown command.
+/* .PP
+/*	Upon exit, \fBsmtp-replay\fR reports the session and message
+/*	rate, the number of replies with a different reply class
+/*	than in the recorded session, and latency percentiles in
+/*	milliseconds per SMTP command.
+/*
+/*	Note: this is an unsupported test program. No attempt is made
+/*	to maintain compatibility between successive versions.
+/*
+/*	Arguments:
+/* .IP "\fB-D \fIfactor\fR"
+/*	Multiply recorded client delays by \fIfactor\fR (default: 1).
+/*	Specify 0 to replay sessions as fast as possible.
+/* .IP "\fB-f \fIfrom\fR"
+/*	Use the specified sender address (default: <foo@my-hostname>).
+/* .IP "\fB-m \fIsession_count\fR"
+/*	Replay the specified number of sessions, cycling through
+/*	the session shapes as needed (default: replay each session
+/*	shape once).
+/* .IP "\fB-M \fImy-hostname\fR"
+/*	Use the specified hostname or [address] in the HELO command
+/*	and in the default sender and recipient addresses, instead
+/*	of the machine hostname.
+/* .IP "\fB-R \fIaddress\fR"
+/*	Use the specified recipient address for RCPT commands that
+/*	were rejected in the recorded session (default: the \fB-t\fR
+/*	address). Specify an address that the test server rejects,
+/*	to exercise the same restrictions.
+/* .IP "\fB-s \fIsession_count\fR"
+/*	Run the specified number of SMTP sessions in parallel, each
+/*	in its own process (default: 1).
+/* .IP "\fB-t \fIto\fR"
+/*	Use the specified recipient address (default: <foo@my-hostname>).
+/* .IP \fB-v\fR
+/*	Make the program more verbose, for debugging purposes.
+/* .IP [\fBinet:\fR]\fIhost\fR[:\fIport\fR]
+/*	Connect via TCP to host \fIhost\fR, port \fIport\fR. The default
+/*	port is \fBsmtp\fR.
+/* .IP \fBunix:\fIpathname\fR
+/*	Connect to the UNIX-domain socket at \fIpathname\fR.
+/* BUGS
+/*	Sessions start back-to-back in each process; the time between
+/*	recorded sessions is not replayed.
+/*
+/*	BDAT commands are replayed even if the test server does not
+/*	announce CHUNKING support.
+/* SEE ALSO
+/*	smtpd(8), Postfix SMTP server
+/*	smtp-source(1), SMTP/LMTP message generator
+/*	smtp-sink(1), SMTP/LMTP message dump
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <msg_vstream.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <vstring_vstream.h>
+#include <argv.h>
+#include <get_hostname.h>
+#include <connect.h>
+#include <mymalloc.h>
+#include <iostuff.h>
+#include <host_port.h>
+#include <inet_proto.h>
+#include <stringops.h>
+#include <valid_hostname.h>
+#include <valid_mailhost_addr.h>
+
+/* Global library. */
+
+#include <smtp_stream.h>
+#include <mail_version.h>
+
+#define STR	vstring_str
+#define LEN	VSTRING_LEN
+
+ /*
+  * One element of a session shape: name/delay[p]/code, where the name is
+  * a command name, BDAT:size[:LAST], or .:size:headers for the end of DATA
+  * content.
+  */
+typedef struct {
+    char   *name;			/* command name, or "." */
+    long    size;			/* content or chunk size */
+    int     headers;			/* header count, or BDAT LAST */
+    long    delay;			/* client delay in milliseconds */
+    int     pipelined;			/* more input was already sent */
+    int     code;			/* recorded reply code */
+} STEP;
+
+ /*
+  * Latency samples per SMTP command, in milliseconds.
+  */
+typedef struct {
+    const char *name;			/* protocol phase */
+    double *sample;			/* latency samples */
+    ssize_t count;			/* # of samples */
+    ssize_t size;			/* # of sample slots */
+    ssize_t differ;			/* # of different reply classes */
+} LATENCY;
+
+static LATENCY latency[] = {
+    "connect", 0, 0, 0, 0,
+    "banner", 0, 0, 0, 0,
+    "HELO", 0, 0, 0, 0,
+    "EHLO", 0, 0, 0, 0,
+    "MAIL", 0, 0, 0, 0,
+    "RCPT", 0, 0, 0, 0,
+    "DATA", 0, 0, 0, 0,
+    ".", 0, 0, 0, 0,
+    "BDAT", 0, 0, 0, 0,
+    "RSET", 0, 0, 0, 0,
+    "NOOP", 0, 0, 0, 0,
+    "VRFY", 0, 0, 0, 0,
+    "ETRN", 0, 0, 0, 0,
+    "QUIT", 0, 0, 0, 0,
+    "OTHER", 0, 0, 0, 0,
+    0,
+};
+
+#define LAT_CONNECT	0
+#define LAT_BANNER	1
+#define LAT_OTHER	(sizeof(latency) / sizeof(latency[0]) - 2)
+
+static int var_line_limit = 10240;
+static int var_timeout = 300;
+static const char *var_myhostname;
+static char *server;
+static char *sender;
+static char *recipient;
+static char *reject_recipient;
+static double delay_factor = 1;
+static VSTRING *buffer;
+static VSTRING *content;
+static int result_fd;
+
+#define SHAPE_PREFIX	"session shape: "
+
+/* elapsed_ms - milliseconds since start time */
+
+static double elapsed_ms(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec) * 1000.0
+	    + (now.tv_usec - start->tv_usec) / 1000.0);
+}
+
+/* latency_phase - map command name to protocol phase */
+
+static int latency_phase(const char *name)
+{
+    LATENCY *lp;
+
+    for (lp = latency; lp->name; lp++)
+	if (strcmp(lp->name, name) == 0)
+	    return (lp - latency);
+    return (LAT_OTHER);
+}
+
+/* result - report one result to the parent process */
+
+static void PRINTFLIKE(1, 2) result(const char *fmt,...)
+{
+    static VSTRING *buf;
+    va_list ap;
+
+    if (buf == 0)
+	buf = vstring_alloc(100);
+
+    /*
+     * Keep results from different workers separate: one short line per
+     * write, and writes up to PIPE_BUF bytes are atomic.
+     */
+    va_start(ap, fmt);
+    vstring_vsprintf(buf, fmt, ap);
+    va_end(ap);
+    if (write(result_fd, STR(buf), LEN(buf)) != LEN(buf))
+	msg_fatal("write results: %m");
+}
+
+/* parse_shape - split session shape into steps */
+
+static STEP *parse_shape(const char *shape, int *count)
+{
+    ARGV   *argv = argv_split(shape, " ");
+    STEP   *steps = (STEP *) mymalloc((argv->argc + 1) * sizeof(*steps));
+    STEP   *sp = steps;
+    char  **cpp;
+    char   *name;
+    char   *delay;
+    char   *code;
+    char   *cp;
+
+    for (cpp = argv->argv; *cpp; cpp++) {
+	cp = *cpp;
+	if ((name = mystrtok(&cp, "/")) == 0
+	    || (delay = mystrtok(&cp, "/")) == 0
+	    || (code = mystrtok(&cp, "/")) == 0)
+	    break;				/* truncated, or garbage */
+	sp->size = 0;
+	sp->headers = 0;
+	if (*name == '.') {
+	    sp->name = mystrdup(".");
+	    if (sscanf(name, ".:%ld:%d", &sp->size, &sp->headers) != 2)
+		break;
+	} else if (strncmp(name, "BDAT:", 5) == 0) {
+	    sp->name = mystrdup("BDAT");
+	    sp->size = atol(name + 5);
+	    sp->headers = (strstr(name + 5, ":LAST") != 0);
+	} else {
+	    sp->name = mystrdup(name);
+	}
+	sp->delay = atol(delay);
+	sp->pipelined = (strchr(delay, 'p') != 0);
+	sp->code = atoi(code);
+	sp++;
+    }
+    argv_free(argv);
+    *count = sp - steps;
+    return (steps);
+}
+
+/* free_shape - destroy parsed session shape */
+
+static void free_shape(STEP *steps, int count)
+{
+    while (count-- > 0)
+	myfree(steps[count].name);
+    myfree((void *) steps);
+}
+
+/* send_content - send message content or BDAT chunk */
+
+static void send_content(VSTREAM *stream, long size, int headers)
+{
+    static const char filler[] =
+    "XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX\r\n";
+    long    done;
+    long    len;
+    int     n;
+
+    /*
+     * The recorded size includes CRLF after each line. The last filler line
+     * is the tail of a full line, so that it still ends in CRLF, and so that
+     * a BDAT chunk has exactly the requested size.
+     */
+    VSTRING_RESET(content);
+    for (n = 0; n < headers; n++)
+	vstring_sprintf_append(content, "X-Replay-%d: header\r\n", n);
+    if (headers > 0)
+	vstring_strcat(content, "\r\n");
+    smtp_fwrite(STR(content), LEN(content), stream);
+    for (done = LEN(content); done < size; done += len) {
+	if ((len = size - done) > sizeof(filler) - 1)
+	    len = sizeof(filler) - 1;
+	smtp_fwrite(filler + sizeof(filler) - 1 - len, len, stream);
+    }
+}
+
+/* send_step - send one command, return zero if skipped */
+
+static int send_step(VSTREAM *stream, STEP *sp)
+{
+    if (msg_verbose)
+	msg_info(">>> %s", sp->name);
+    if (strcmp(sp->name, "HELO") == 0 || strcmp(sp->name, "EHLO") == 0) {
+	smtp_printf(stream, "%s %s", sp->name, var_myhostname);
+    } else if (strcmp(sp->name, "MAIL") == 0) {
+	smtp_printf(stream, "MAIL FROM:<%s>", sender);
+    } else if (strcmp(sp->name, "RCPT") == 0) {
+	smtp_printf(stream, "RCPT TO:<%s>",
+		    sp->code / 100 != 2 && reject_recipient ?
+		    reject_recipient : recipient);
+    } else if (strcmp(sp->name, "DATA") == 0
+	       || strcmp(sp->name, "RSET") == 0
+	       || strcmp(sp->name, "NOOP") == 0
+	       || strcmp(sp->name, "QUIT") == 0) {
+	smtp_printf(stream, "%s", sp->name);
+    } else if (strcmp(sp->name, "VRFY") == 0) {
+	smtp_printf(stream, "VRFY postmaster");
+    } else if (strcmp(sp->name, "ETRN") == 0) {
+	smtp_printf(stream, "ETRN %s", var_myhostname);
+    } else if (strcmp(sp->name, ".") == 0) {
+	send_content(stream, sp->size, sp->headers);
+	smtp_printf(stream, ".");
+    } else if (strcmp(sp->name, "BDAT") == 0) {
+	smtp_printf(stream, "BDAT %ld%s", sp->size, sp->headers ? " LAST" : "");
+	send_content(stream, sp->size, 0);
+    } else if (strcmp(sp->name, "OTHER") == 0) {
+	smtp_printf(stream, "XREPLAY");
+    } else {
+	return (0);				/* STARTTLS, AUTH, XCLIENT, ... */
+    }
+    return (1);
+}
+
+/* response - read SMTP server response, return reply code */
+
+static int response(VSTREAM *stream)
+{
+    int     code;
+    char   *cp;
+
+    do {
+	smtp_get(buffer, stream, var_line_limit, SMTP_GET_FLAG_SKIP);
+	if (msg_verbose)
+	    msg_info("<<< %s", printable(STR(buffer), '?'));
+	for (cp = STR(buffer); ISDIGIT(*cp); cp++)
+	     /* void */ ;
+	code = (cp - STR(buffer) == 3 ? atoi(STR(buffer)) : 0);
+    } while (*cp == '-');
+    return (code);
+}
+
+/* replay - replay one session shape */
+
+static int replay(const char *shape)
+{
+    VSTREAM *stream;
+    STEP   *steps;
+    STEP  **group;
+    int     count;
+    int     pending = 0;
+    int     data_ok = 0;
+    int     except;
+    int     code;
+    int     fd;
+    int     n;
+    struct timeval start;
+    STEP   *sp;
+
+    GETTIMEOFDAY(&start);
+    if (strncmp(server, "unix:", 5) == 0)
+	fd = unix_connect(server + 5, BLOCKING, var_timeout);
+    else
+	fd = inet_connect(server, BLOCKING, var_timeout);
+    if (fd < 0) {
+	msg_warn("connect to %s: %m", server);
+	return (-1);
+    }
+    result("L %d %.3f %d\n", LAT_CONNECT, elapsed_ms(&start), 1);
+    stream = vstream_fdopen(fd, O_RDWR);
+    smtp_stream_setup(stream, var_timeout, /* deadline */ 1, /* minrate */ 0);
+    steps = parse_shape(shape, &count);
+    group = (STEP **) mymalloc((count + 1) * sizeof(*group));
+
+    if ((except = vstream_setjmp(stream)) != 0) {
+	msg_warn("%s: %s", server, except == SMTP_ERR_TIME ?
+		 "timeout" : "lost connection");
+	free_shape(steps, count);
+	myfree((void *) group);
+	(void) vstream_fclose(stream);
+	return (-1);
+    }
+    GETTIMEOFDAY(&start);
+    code = response(stream);
+    result("L %d %.3f %d\n", LAT_BANNER, elapsed_ms(&start),
+	   code / 100 == 2);
+
+    /*
+     * Send pipelined commands as one group, then collect the replies.
+     * Always wait for the DATA reply, so that we know whether to send the
+     * message content.
+     */
+    for (sp = steps; sp < steps + count; sp++) {
+	if (strcmp(sp->name, ".") == 0 && !data_ok)
+	    continue;
+	if (pending == 0) {
+	    if (delay_factor > 0 && sp->delay > 0)
+		doze((unsigned) (sp->delay * delay_factor * 1000));
+	    GETTIMEOFDAY(&start);
+	}
+	if (send_step(stream, sp) == 0)
+	    continue;
+	group[pending++] = sp;
+	if (sp->pipelined && strcmp(sp->name, "DATA") != 0
+	    && sp + 1 < steps + count)
+	    continue;
+	smtp_flush(stream);
+	for (n = 0; n < pending; n++) {
+	    code = response(stream);
+	    result("L %d %.3f %d\n", latency_phase(group[n]->name),
+		   elapsed_ms(&start), code / 100 == group[n]->code / 100);
+	    if (strcmp(group[n]->name, "DATA") == 0)
+		data_ok = (code == 354);
+	    else if (code / 100 == 2
+		     && (strcmp(group[n]->name, ".") == 0
+			 || (strcmp(group[n]->name, "BDAT") == 0
+			     && group[n]->headers)))
+		result("M\n");
+	}
+	pending = 0;
+    }
+    free_shape(steps, count);
+    myfree((void *) group);
+    (void) vstream_fclose(stream);
+    return (0);
+}
+
+/* worker - replay a share of the session shapes */
+
+static NORETURN worker(int fd, ARGV *shapes, int first, int step,
+		               int limit)
+{
+    int     n;
+
+    result_fd = fd;
+    for (n = first; n < limit; n += step)
+	result("S %d\n", replay(shapes->argv[n % shapes->argc]) == 0);
+    exit(0);
+}
+
+/* latency_add - save one latency sample */
+
+static void latency_add(int phase, double ms, int same)
+{
+    LATENCY *lp = latency + phase;
+
+    if (lp->count >= lp->size) {
+	lp->size = (lp->size ? 2 * lp->size : 1024);
+	lp->sample = (double *) (lp->sample ?
+				 myrealloc((void *) lp->sample,
+					   lp->size * sizeof(*lp->sample)) :
+				 mymalloc(lp->size * sizeof(*lp->sample)));
+    }
+    lp->sample[lp->count++] = ms;
+    if (!same)
+	lp->differ++;
+}
+
+/* latency_compare - qsort callback */
+
+static int latency_compare(const void *a, const void *b)
+{
+    double  da = *(const double *) a;
+    double  db = *(const double *) b;
+
+    return (da < db ? -1 : da > db ? 1 : 0);
+}
+
+/* latency_report - report latency percentiles */
+
+static void latency_report(void)
+{
+    LATENCY *lp;
+
+    /*
+     * Nearest-rank percentiles.
+     */
+#define PERCENTILE(lp, p) \
+    ((lp)->sample[((lp)->count * (p) + 99) / 100 - 1])
+
+    vstream_printf("%-9s %8s %8s %9s %9s %9s %9s %9s\n", "command",
+		   "count", "differ", "min", "p50", "p90", "p99", "max");
+    for (lp = latency; lp->name; lp++) {
+	if (lp->count == 0)
+	    continue;
+	qsort((void *) lp->sample, lp->count, sizeof(*lp->sample),
+	      latency_compare);
+	vstream_printf("%-9s %8ld %8ld %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+		       lp->name, (long) lp->count, (long) lp->differ,
+		       lp->sample[0], PERCENTILE(lp, 50), PERCENTILE(lp, 90),
+		       PERCENTILE(lp, 99), lp->sample[lp->count - 1]);
+    }
+}
+
+/* read_shapes - extract session shapes from logfile records */
+
+static void read_shapes(ARGV *shapes, VSTREAM *fp, const char *path)
+{
+    char   *cp;
+
+    while (vstring_get_nonl(buffer, fp) != VSTREAM_EOF)
+	if ((cp = strstr(STR(buffer), SHAPE_PREFIX)) != 0)
+	    argv_add(shapes, cp + sizeof(SHAPE_PREFIX) - 1, ARGV_END);
+    if (vstream_ferror(fp))
+	msg_fatal("read %s: %m", path);
+}
+
+static void usage(char *myname)
+{
+    msg_fatal("usage: %s -v -D factor -s sess -m sessions -M myhostname -f from -t to -R reject_to host[:port] [file ...]", myname);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+/* main - parse JCL and replay */
+
+int     main(int argc, char **argv)
+{
+    int     sessions = 1;
+    int     limit = 0;
+    ARGV   *shapes;
+    VSTREAM *fp;
+    VSTREAM *results;
+    int     pipefd[2];
+    int     workers;
+    int     status;
+    int     phase;
+    double  ms;
+    int     same;
+    int     ok;
+    long    done = 0;
+    long    failed = 0;
+    long    messages = 0;
+    struct timeval start;
+    double  elapsed;
+    char   *host;
+    char   *port;
+    char   *buf;
+    const char *parse_err;
+    int     ch;
+    int     n;
+
+    /*
+     * Fingerprint executables and core dumps.
+     */
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    signal(SIGPIPE, SIG_IGN);
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+
+    /*
+     * Parse JCL.
+     */
+    while ((ch = GETOPT(argc, argv, "D:f:m:M:R:s:t:v")) > 0) {
+	switch (ch) {
+	case 'D':
+	    if ((delay_factor = atof(optarg)) < 0)
+		msg_fatal("bad delay factor: %s", optarg);
+	    break;
+	case 'f':
+	    sender = optarg;
+	    break;
+	case 'm':
+	    if ((limit = atoi(optarg)) <= 0)
+		msg_fatal("bad session count: %s", optarg);
+	    break;
+	case 'M':
+	    if (*optarg == '[') {
+		if (!valid_mailhost_literal(optarg, DO_GRIPE))
+		    msg_fatal("bad address literal: %s", optarg);
+	    } else {
+		if (!valid_hostname(optarg, DO_GRIPE))
+		    msg_fatal("bad hostname: %s", optarg);
+	    }
+	    var_myhostname = optarg;
+	    break;
+	case 'R':
+	    reject_recipient = optarg;
+	    break;
+	case 's':
+	    if ((sessions = atoi(optarg)) <= 0)
+		msg_fatal("bad session count: %s", optarg);
+	    break;
+	case 't':
+	    recipient = optarg;
+	    break;
+	case 'v':
+	    msg_verbose++;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (argc - optind < 1)
+	usage(argv[0]);
+
+    /*
+     * Translate endpoint address to the form that inet_connect() expects.
+     */
+    (void) inet_proto_init("protocols", INET_PROTO_NAME_ALL);
+    if (strncmp(argv[optind], "unix:", 5) == 0) {
+	server = argv[optind];
+    } else {
+	if (strncmp(argv[optind], "inet:", 5) == 0)
+	    argv[optind] += 5;
+	buf = mystrdup(argv[optind]);
+	if ((parse_err = host_port(buf, &host, (char *) 0, &port, "smtp")) != 0)
+	    msg_fatal("%s: %s", argv[optind], parse_err);
+	server = concatenate("[", host, "]:", port, (char *) 0);
+	myfree(buf);
+    }
+
+    buffer = vstring_alloc(100);
+    content = vstring_alloc(100);
+
+    /*
+     * Make sure we have sender and recipient addresses.
+     */
+    if (var_myhostname == 0)
+	var_myhostname = get_hostname();
+    if (sender == 0 || recipient == 0) {
+	vstring_sprintf(buffer, "foo@%s", var_myhostname);
+	if (sender == 0)
+	    sender = mystrdup(STR(buffer));
+	if (recipient == 0)
+	    recipient = mystrdup(STR(buffer));
+    }
+
+    /*
+     * Read the session shapes.
+     */
+    shapes = argv_alloc(100);
+    if (argc - optind == 1) {
+	read_shapes(shapes, VSTREAM_IN, "standard input");
+    } else {
+	for (n = optind + 1; n < argc; n++) {
+	    if ((fp = vstream_fopen(argv[n], O_RDONLY, 0)) == 0)
+		msg_fatal("open %s: %m", argv[n]);
+	    read_shapes(shapes, fp, argv[n]);
+	    (void) vstream_fclose(fp);
+	}
+    }
+    if (shapes->argc == 0)
+	msg_fatal("no \"%s\" records found", SHAPE_PREFIX);
+    if (limit == 0)
+	limit = shapes->argc;
+    if (sessions > limit)
+	sessions = limit;
+
+    /*
+     * Start the workers, and collect their results.
+     */
+    if (pipe(pipefd) < 0)
+	msg_fatal("pipe: %m");
+    vstream_fflush(VSTREAM_OUT);
+    GETTIMEOFDAY(&start);
+    for (workers = 0; workers < sessions; workers++) {
+	switch (fork()) {
+	case -1:
+	    msg_fatal("fork: %m");
+	case 0:
+	    (void) close(pipefd[0]);
+	    worker(pipefd[1], shapes, workers, sessions, limit);
+	}
+    }
+    (void) close(pipefd[1]);
+    results = vstream_fdopen(pipefd[0], O_RDONLY);
+    while (vstring_get_nonl(buffer, results) != VSTREAM_EOF) {
+	if (sscanf(STR(buffer), "L %d %lf %d", &phase, &ms, &same) == 3
+	    && phase >= 0 && phase <= LAT_OTHER) {
+	    latency_add(phase, ms, same);
+	} else if (sscanf(STR(buffer), "S %d", &ok) == 1) {
+	    done++;
+	    if (!ok)
+		failed++;
+	} else if (strcmp(STR(buffer), "M") == 0) {
+	    messages++;
+	} else {
+	    msg_warn("unexpected worker result: %s", STR(buffer));
+	}
+    }
+    elapsed = elapsed_ms(&start) / 1000;
+    (void) vstream_fclose(results);
+    for (n = 0; n < workers; n++)
+	if (wait(&status) < 0)
+	    msg_fatal("wait: %m");
+	else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    msg_warn("worker process terminated abnormally");
+
+    /*
+     * Report.
+     */
+    vstream_printf("%ld sessions (%ld failed), %ld messages in %.3f seconds:"
+		   " %.1f sessions/s, %.1f messages/s\n", done, failed,
+		   messages, elapsed, elapsed > 0 ? done / elapsed : 0,
+		   elapsed > 0 ? messages / elapsed : 0);
+    latency_report();
+    vstream_fflush(VSTREAM_OUT);
+    exit(failed > 0 || done < limit);
+}
@@ -100,6 +100,9 @@
 /*	in seconds). Combine with a large test message and a small
 /*	TCP window size (see the \fB-T\fR option) to test the Postfix
 /*	client write_wait() implementation.
+/* .IP "\fB-K \fIkeyfile\fR"
+/*	The private key for the \fB-Z\fR option (default: the
+/*	certificate file).
 /* .IP \fB-L\fR
 /*	Enable LMTP instead of SMTP.
 /* .IP "\fB-m \fIcount\fR (default: 256)"
@@ -184,6 +187,11 @@
 /*	random multiplier is equal to the number of times the program
 /*	needs to roll a dice with a range of 0..99 inclusive, before
 /*	the dice produces a result greater than or equal to \fIodds\fR.
+/* .IP "\fB-Z \fIcertfile\fR"
+/*	Announce STARTTLS support, and use the PEM server certificate
+/*	in \fIcertfile\fR. TLS sessions are not cached, and client
+/*	certificates are not requested. This option is available
+/*	when Postfix is built with TLS support.
 /* .IP [\fBinet:\fR][\fIhost\fR]:\fIport\fR
 /*	Listen on network interface \fIhost\fR (default: any interface)
 /*	TCP port \fIport\fR. Both \fIhost\fR and \fIport\fR may be
@@ -244,6 +252,8 @@
 /* .IP \fItime-stamp\fR
 /*	A time stamp as defined in RFC 2822.
 /* .RE
+/* BUGS
+/*	The TLS handshake blocks other sessions.
 /* SEE ALSO
 /*	smtp-source(1), SMTP/LMTP message generator
 /* LICENSE
@@ -309,6 +319,8 @@
 
 /* Application-specific. */
 
+#include "stone_tls.h"
+
 typedef struct SINK_STATE {
     VSTREAM *stream;
     VSTRING *buffer;
@@ -327,6 +339,9 @@ typedef struct SINK_STATE {
     VSTREAM *dump_file;			/* dump file or null */
     void    (*delayed_response) (struct SINK_STATE *state, const char *);
     char   *delayed_args;
+#ifdef USE_TLS
+    TLS_SESS_STATE *tls_context;	/* TLS session state */
+#endif
 } SINK_STATE;
 
 #define ST_ANY			0
@@ -340,6 +355,17 @@ typedef struct SINK_STATE {
 #define PUSH_BACK_GET(state)		(*(state)->push_back_ptr++)
 #define PUSH_BACK_SET(state, text)	((state)->push_back_ptr = (text))
 
+ /*
+  * TLS may buffer decrypted input that the kernel no longer reports as
+  * readable.
+  */
+#ifdef USE_TLS
+#define TLS_PENDING(state) \
+    ((state)->tls_context != 0 && SSL_pending((state)->tls_context->con) > 0)
+#else
+#define TLS_PENDING(state)		0
+#endif
+
 #ifndef DEF_MAX_CLIENT_COUNT
 #define DEF_MAX_CLIENT_COUNT	256
 #endif
@@ -394,6 +420,10 @@ static VSTRING *start_string;		/* dump content prefix */
 
 static const INET_PROTO_INFO *proto_info;
 
+#ifdef USE_TLS
+static TLS_APPL_STATE *tls_ctx;		/* null unless -Z */
+#endif
+
 #define STR(x)	vstring_str(x)
 
 /* do_stats - show counters */
@@ -644,6 +674,10 @@ static void ehlo_response(SINK_STATE *state, const char *args)
 	smtp_printf(state->stream, "250-ENHANCEDSTATUSCODES");
     if (!disable_dsn)
 	smtp_printf(state->stream, "250-DSN");
+#ifdef USE_TLS
+    if (tls_ctx != 0 && state->tls_context == 0)
+	smtp_printf(state->stream, "250-STARTTLS");
+#endif
     /* RFC 821/2821/5321: Format is replycode<SPACE>optional-text<CRLF> */
     smtp_printf(state->stream, "250 ");
     SMTP_FLUSH(state->stream);
@@ -672,6 +706,59 @@ static void helo_response(SINK_STATE *state, const char *args)
     }
 }
 
+/* starttls_response - respond to STARTTLS command */
+
+static void starttls_response(SINK_STATE *state, const char *unused_args)
+{
+#ifdef USE_TLS
+    TLS_SERVER_START_PROPS props;
+
+    if (state->tls_context != 0) {
+	smtp_printf(state->stream, "554 5.5.1 Error: TLS already active");
+	SMTP_FLUSH(state->stream);
+	return;
+    }
+    smtp_printf(state->stream, "220 2.0.0 Ready to start TLS");
+    smtp_flush(state->stream);
+
+    /*
+     * Discard plaintext that the client sent after STARTTLS.
+     */
+    vstream_fpurge(state->stream, VSTREAM_PURGE_READ);
+    PUSH_BACK_SET(state, "");
+
+    /*
+     * The handshake uses blocking I/O, and blocks other sessions.
+     */
+    state->tls_context =
+	TLS_SERVER_START(&props,
+			 ctx = tls_ctx,
+			 stream = state->stream,
+			 fd = -1,
+			 timeout = var_tmout,
+			 enable_rpk = 0,
+			 requirecert = 0,
+			 serverid = "smtp-sink",
+			 namaddr = state->client_addr.buf,
+			 cipher_grade = STONE_TLS_GRADE,
+			 cipher_exclusions = "",
+			 mdalg = STONE_TLS_DGST);
+    if (state->tls_context == 0) {
+	msg_warn("TLS handshake failed");
+	vstream_longjmp(state->stream, SMTP_ERR_EOF);
+    }
+
+    /*
+     * RFC 3207: the client must say hello again.
+     */
+    mail_cmd_reset(state);
+    if (state->helo_args) {
+	myfree(state->helo_args);
+	state->helo_args = 0;
+    }
+#endif
+}
+
 /* ok_response - send 250 OK */
 
 static void ok_response(SINK_STATE *state, const char *unused_args)
@@ -963,7 +1050,7 @@ static int data_read(SINK_STATE *state)
 	 * We must avoid blocking I/O, so get out of here as soon as both the
 	 * VSTREAM and kernel read buffers dry up.
 	 */
-	if (vstream_peek(state->stream) <= 0
+	if (vstream_peek(state->stream) <= 0 && !TLS_PENDING(state)
 	    && readable(vstream_fileno(state->stream)) <= 0)
 	    return (0);
     }
@@ -998,6 +1085,7 @@ static SINK_COMMAND command_table[] = {
     "xclient", ok_response, hard_err_resp, soft_err_resp, FLAG_ENABLE, 0, 0,
     "xforward", ok_response, hard_err_resp, soft_err_resp, FLAG_ENABLE, 0, 0,
     "auth", ok_response, hard_err_resp, soft_err_resp, FLAG_ENABLE, 0, 0,
+    "starttls", starttls_response, hard_err_resp, soft_err_resp, 0, 0, 0,
     "mail", mail_response, hard_err_resp, soft_err_resp, FLAG_ENABLE, 0, 0,
     "rcpt", rcpt_response, hard_err_resp, soft_err_resp, FLAG_ENABLE, 0, 0,
     "data", data_response, hard_err_resp, soft_err_resp, FLAG_ENABLE, 0, 0,
@@ -1206,6 +1294,7 @@ static int command_read(SINK_STATE *state)
 	 * 20020604.
 	 */
 	if (PUSH_BACK_PEEK(state) == 0 && vstream_peek(state->stream) <= 0
+	    && !TLS_PENDING(state)
 	    && readable(vstream_fileno(state->stream)) <= 0)
 	    return (0);
     }
@@ -1298,7 +1387,8 @@ static void read_event(int unused_event, void *context)
 		return;
 	    }
 	}
-    } while (PUSH_BACK_PEEK(state) != 0 || vstream_peek(state->stream) > 0);
+    } while (PUSH_BACK_PEEK(state) != 0 || vstream_peek(state->stream) > 0
+	     || TLS_PENDING(state));
 
     /*
      * Reset the idle timer. Wait until the next input event, or until the
@@ -1319,6 +1409,11 @@ static void disconnect(SINK_STATE *state)
 	sess_count++;
 	do_stats();
     }
+#ifdef USE_TLS
+    if (state->tls_context)
+	tls_server_stop(tls_ctx, state->stream, var_tmout, 0,
+			state->tls_context);
+#endif
     vstream_fclose(state->stream);
     vstring_free(state->buffer);
     /* Clean up file capture attributes. */
@@ -1380,6 +1475,9 @@ static void connect_event(int unused_event, void *unused_context)
 	state->rcpts = 0;
 	state->delayed_response = 0;
 	state->delayed_args = 0;
+#ifdef USE_TLS
+	state->tls_context = 0;
+#endif
 	/* Initialize file capture attributes. */
 #ifdef AF_INET6
 	if (sa->sa_family == AF_INET6)
@@ -1431,7 +1529,7 @@ static void connect_event(int unused_event, void *unused_context)
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s [-468acCeEFLpPv] [-A abort_delay] [-b soft_bounce_reply] [-B hard_bounce_reply] [-d dump-template] [-D dump-template] [-f commands] [-h hostname] [-m max_concurrency] [-M message_quit_count] [-n quit_count] [-q commands] [-r commands] [-R root-dir] [-s commands] [-S start-string] [-u user_privs] [-w delay] [host]:port backlog", myname);
+    msg_fatal("usage: %s [-468acCeEFLpPv] [-A abort_delay] [-b soft_bounce_reply] [-B hard_bounce_reply] [-d dump-template] [-D dump-template] [-f commands] [-h hostname] [-K keyfile] [-m max_concurrency] [-M message_quit_count] [-n quit_count] [-q commands] [-r commands] [-R root-dir] [-s commands] [-S start-string] [-u user_privs] [-w delay] [-Z certfile] [host]:port backlog", myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -1444,6 +1542,8 @@ int     main(int argc, char **argv)
     const char *protocols = INET_PROTO_NAME_ALL;
     const char *root_dir = 0;
     const char *user_privs = 0;
+    const char *tls_cert_file = 0;
+    const char *tls_key_file = 0;
 
     /*
      * Fingerprint executables and core dumps.
@@ -1463,7 +1563,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "468aA:b:B:cCd:D:eEf:Fh:H:Ln:m:M:NpPq:Q:r:R:s:S:t:T:u:vw:W:")) > 0) {
+    while ((ch = GETOPT(argc, argv, "468aA:b:B:cCd:D:eEf:Fh:H:K:Ln:m:M:NpPq:Q:r:R:s:S:t:T:u:vw:W:Z:")) > 0) {
 	switch (ch) {
 	case '4':
 	    protocols = INET_PROTO_NAME_IPV4;
@@ -1529,6 +1629,9 @@ int     main(int argc, char **argv)
 	    if ((data_read_delay = atoi(optarg)) <= 0)
 		msg_fatal("bad data read delay: %s", optarg);
 	    break;
+	case 'K':
+	    tls_key_file = optarg;
+	    break;
 	case 'L':
 	    enable_lmtp = 1;
 	    break;
@@ -1597,6 +1700,13 @@ int     main(int argc, char **argv)
 	case 'W':
 	    set_cmd_delay_arg(optarg);
 	    break;
+	case 'Z':
+#ifdef USE_TLS
+	    tls_cert_file = optarg;
+#else
+	    msg_fatal("TLS support is not compiled in");
+#endif
+	    break;
 	default:
 	    usage(argv[0]);
 	}
@@ -1609,6 +1719,8 @@ int     main(int argc, char **argv)
 	msg_fatal("use only one of -d or -D, but not both");
     if (geteuid() == 0 && user_privs == 0)
 	msg_fatal("-u option is required if running as root");
+    if (tls_key_file && tls_cert_file == 0)
+	msg_fatal("-K option requires -Z");
 
     /*
      * Initialize.
@@ -1626,6 +1738,18 @@ int     main(int argc, char **argv)
 	    argv[optind] += 5;
 	sock = inet_listen(argv[optind], backlog, BLOCKING);
     }
+
+    /*
+     * Load the server certificate before dropping privileges.
+     */
+#ifdef USE_TLS
+    if (tls_cert_file) {
+	if (disable_esmtp || enable_lmtp)
+	    msg_fatal("-Z option requires ESMTP");
+	tls_ctx = stone_tls_server_init(tls_cert_file, tls_key_file);
+	set_cmd_flags("starttls", FLAG_ENABLE);
+    }
+#endif
     if (user_privs)
 	chroot_uid(root_dir, user_privs);
 
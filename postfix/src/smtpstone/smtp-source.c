@@ -27,6 +27,16 @@
 /* .IP \fB-6\fR
 /*	Connect to the server with IPv6. This option is not available when
 /*	Postfix is built without IPv6 support.
+/* .IP "\fB-a \fIrate\fR"
+/*	Open-loop load generation: start \fIrate\fR new sessions
+/*	per second, each delivering one message, independent of
+/*	how fast the server completes earlier sessions. Sessions
+/*	are started in batches, once per second. The \fB-s\fR option
+/*	specifies the maximal number of sessions in progress; an
+/*	arrival that would exceed that limit is skipped and counted
+/*	as such. The \fB-m\fR option specifies the total number of
+/*	arrivals. The \fB-d\fR, \fB-R\fR and \fB-w\fR options are
+/*	ignored.
 /* .IP "\fB-A\fR"
 /*	Don't abort when the server sends something other than the
 /*	expected positive reply code.
@@ -84,6 +94,12 @@
 /* .RE
 /* .IP \fB-o\fR
 /*	Old mode: don't send HELO, and don't send message headers.
+/* .IP \fB-P\fR
+/*	Upon exit, report latency percentiles in milliseconds for
+/*	each protocol phase: TCP connection setup (connect), the
+/*	server greeting after connection setup (banner), the STARTTLS
+/*	command and TLS handshake (starttls), the MAIL command
+/*	(mail), and the end of message data (data).
 /* .IP "\fB-r \fIrecipient_count\fR"
 /*	Send the specified number of recipients per transaction
 /*	(default: 1), and generate recipient addresses as described
@@ -106,6 +122,11 @@
 /* .IP "\fB-w \fIinterval\fR"
 /*	Wait a fixed time between messages.
 /*	Suspending one thread does not affect other delivery threads.
+/* .IP \fB-Z\fR
+/*	Send EHLO instead of HELO, and use STARTTLS before sending
+/*	mail. The TLS handshake is done without session resumption,
+/*	and the server certificate is not verified. This option
+/*	is available when Postfix is built with TLS support.
 /* .IP [\fBinet:\fR]\fIhost\fR[:\fIport\fR]
 /*	Connect via TCP to host \fIhost\fR, port \fIport\fR. The default
 /*	port is \fBsmtp\fR.
@@ -113,6 +134,8 @@
 /*	Connect to the UNIX-domain socket at \fIpathname\fR.
 /* BUGS
 /*	No SMTP command pipelining support.
+/*
+/*	The TLS handshake blocks other sessions.
 /* SEE ALSO
 /*	smtp-sink(1), SMTP/LMTP message dump
 /* LICENSE
@@ -176,6 +199,8 @@
 
 /* Application-specific. */
 
+#include "stone_tls.h"
+
  /*
   * Per-session data structure with state.
   * 
@@ -194,6 +219,10 @@ typedef struct SESSION {
     VSTREAM *stream;			/* open connection */
     int     connect_count;		/* # of connect()s to retry */
     struct SESSION *next;		/* connect() queue linkage */
+    struct timeval start;		/* latency measurement */
+#ifdef USE_TLS
+    TLS_SESS_STATE *tls_context;	/* TLS session state */
+#endif
 } SESSION;
 
 static SESSION *last_session;		/* connect() queue tail */
@@ -242,6 +271,41 @@ static char *subject = 0;
 static int global_rcpt_suffix = 0;
 static int global_rcpt_done = 0;
 static int allow_reject = 0;
+static int arrival_rate = 0;
+static int arrival_skipped = 0;
+static int max_sessions = 1;
+static int show_latency = 0;
+static int use_starttls = 0;
+
+#ifdef USE_TLS
+static TLS_APPL_STATE *tls_ctx;
+static const char *tls_peer;
+#endif
+
+ /*
+  * Latency samples per protocol phase, in milliseconds.
+  */
+typedef struct {
+    const char *name;			/* protocol phase */
+    double *sample;			/* latency samples */
+    ssize_t count;			/* # of samples */
+    ssize_t size;			/* # of sample slots */
+} LATENCY;
+
+#define LAT_CONNECT	0
+#define LAT_BANNER	1
+#define LAT_STARTTLS	2
+#define LAT_MAIL	3
+#define LAT_DATA	4
+
+static LATENCY latency[] = {
+    "connect", 0, 0, 0,
+    "banner", 0, 0, 0,
+    "starttls", 0, 0, 0,
+    "mail", 0, 0, 0,
+    "data", 0, 0, 0,
+    0,
+};
 
 static void enqueue_connect(SESSION *);
 static void start_connect(SESSION *);
@@ -249,6 +313,9 @@ static void connect_done(int, void *);
 static void read_banner(int, void *);
 static void send_helo(SESSION *);
 static void helo_done(int, void *);
+#ifdef USE_TLS
+static void send_starttls(SESSION *);
+#endif
 static void send_mail(SESSION *);
 static void mail_done(int, void *);
 static void send_rcpt(int, void *);
@@ -283,6 +350,72 @@ static int random_interval(int interval)
     return (rand() % (interval + 1));
 }
 
+/* latency_start - start the clock for a protocol phase */
+
+static void latency_start(SESSION *session)
+{
+    if (show_latency)
+	GETTIMEOFDAY(&session->start);
+}
+
+/* latency_done - save the latency for a protocol phase */
+
+static void latency_done(SESSION *session, int phase)
+{
+    LATENCY *lp = latency + phase;
+    struct timeval now;
+
+    if (show_latency == 0)
+	return;
+    GETTIMEOFDAY(&now);
+    if (lp->count >= lp->size) {
+	lp->size = (lp->size ? 2 * lp->size : 1024);
+	lp->sample = (double *) (lp->sample ?
+				 myrealloc((void *) lp->sample,
+					   lp->size * sizeof(*lp->sample)) :
+				 mymalloc(lp->size * sizeof(*lp->sample)));
+    }
+    lp->sample[lp->count++] = (now.tv_sec - session->start.tv_sec) * 1000.0
+	+ (now.tv_usec - session->start.tv_usec) / 1000.0;
+}
+
+/* latency_compare - qsort callback */
+
+static int latency_compare(const void *a, const void *b)
+{
+    double  da = *(const double *) a;
+    double  db = *(const double *) b;
+
+    return (da < db ? -1 : da > db ? 1 : 0);
+}
+
+/* latency_report - report latency percentiles */
+
+static void latency_report(void)
+{
+    LATENCY *lp;
+
+    /*
+     * Nearest-rank percentiles.
+     */
+#define PERCENTILE(lp, p) \
+    ((lp)->sample[((lp)->count * (p) + 99) / 100 - 1])
+
+    vstream_printf("%-9s %8s %9s %9s %9s %9s %9s\n",
+		   "phase", "count", "min", "p50", "p90", "p99", "max");
+    for (lp = latency; lp->name; lp++) {
+	if (lp->count == 0)
+	    continue;
+	qsort((void *) lp->sample, lp->count, sizeof(*lp->sample),
+	      latency_compare);
+	vstream_printf("%-9s %8ld %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+		       lp->name, (long) lp->count, lp->sample[0],
+		       PERCENTILE(lp, 50), PERCENTILE(lp, 90),
+		       PERCENTILE(lp, 99), lp->sample[lp->count - 1]);
+    }
+    vstream_fflush(VSTREAM_OUT);
+}
+
 /* command - send an SMTP command */
 
 static void command(VSTREAM *stream, char *fmt,...)
@@ -428,7 +561,10 @@ static void start_event(int unused_event, void *context)
 
 static void start_another(SESSION *session)
 {
-    if (random_delay > 0) {
+    if (arrival_rate > 0) {
+	myfree((void *) session);
+	session_count--;
+    } else if (random_delay > 0) {
 	event_request_timer(start_event, (void *) session,
 			    random_interval(random_delay));
     } else if (fixed_delay > 0) {
@@ -438,6 +574,46 @@ static void start_another(SESSION *session)
     }
 }
 
+/* new_session - create session */
+
+static SESSION *new_session(void)
+{
+    SESSION *session;
+
+    session = (SESSION *) mymalloc(sizeof(*session));
+    session->stream = 0;
+    session->xfer_count = 0;
+    session->connect_count = connect_count;
+    session->next = 0;
+#ifdef USE_TLS
+    session->tls_context = 0;
+#endif
+    session_count++;
+    return (session);
+}
+
+/* arrival_event - start new sessions at a fixed rate */
+
+static void arrival_event(int unused_event, void *unused_context)
+{
+    int     n;
+
+    /*
+     * Open-loop load: the arrival rate does not depend on how fast the
+     * server completes earlier sessions.
+     */
+    for (n = 0; n < arrival_rate && message_count > 0; n++) {
+	if (session_count >= max_sessions) {
+	    message_count--;
+	    arrival_skipped++;
+	} else {
+	    startup(new_session());
+	}
+    }
+    if (message_count > 0)
+	event_request_timer(arrival_event, (void *) 0, 1);
+}
+
 /* enqueue_connect - queue a connection request */
 
 static void enqueue_connect(SESSION *session)
@@ -507,6 +683,7 @@ static void start_connect(SESSION *session)
 		   sizeof(linger)) < 0)
 	msg_warn("setsockopt SO_LINGER %d: %m", linger.l_linger);
     session->stream = vstream_fdopen(fd, O_RDWR);
+    latency_start(session);
     event_enable_write(fd, connect_done, (void *) session);
     smtp_timeout_setup(session->stream, var_timeout);
     if (inet_windowsize > 0)
@@ -529,6 +706,8 @@ static void connect_done(int unused_event, void *context)
     if (socket_error(fd) < 0) {
 	fail_connect(session);
     } else {
+	latency_done(session, LAT_CONNECT);
+	latency_start(session);
 	non_blocking(fd, BLOCKING);
 	/* Disable write events. */
 	event_disable_readwrite(fd);
@@ -562,7 +741,7 @@ static void read_banner(int unused_event, void *context)
      * Read and parse the server's SMTP greeting banner.
      */
     if (((resp = response(session->stream, buffer))->code / 100) == 2) {
-	 /* void */ ;
+	latency_done(session, LAT_BANNER);
     } else if (allow_reject) {
 	msg_warn("rejected at server banner: %d %s", resp->code, resp->str);
     } else {
@@ -583,7 +762,8 @@ static void read_banner(int unused_event, void *context)
 static void send_helo(SESSION *session)
 {
     int     except;
-    const char *NOCLOBBER protocol = (talk_lmtp ? "LHLO" : "HELO");
+    const char *NOCLOBBER protocol = (talk_lmtp ? "LHLO" :
+				      use_starttls ? "EHLO" : "HELO");
 
     /*
      * Send the standard greeting with our hostname
@@ -606,7 +786,8 @@ static void helo_done(int unused_event, void *context)
     SESSION *session = (SESSION *) context;
     RESPONSE *resp;
     int     except;
-    const char *protocol = (talk_lmtp ? "LHLO" : "HELO");
+    const char *protocol = (talk_lmtp ? "LHLO" :
+			    use_starttls ? "EHLO" : "HELO");
 
     /*
      * Get response to HELO command.
@@ -626,9 +807,79 @@ static void helo_done(int unused_event, void *context)
 	msg_fatal("%s rejected: %d %s", protocol, resp->code, resp->str);
     }
 
+#ifdef USE_TLS
+    if (use_starttls && session->tls_context == 0) {
+	send_starttls(session);
+	return;
+    }
+#endif
     send_mail(session);
 }
 
+#ifdef USE_TLS
+
+/* send_starttls - request TLS, and do the TLS handshake */
+
+static void send_starttls(SESSION *session)
+{
+    RESPONSE *resp;
+    int     except;
+    TLS_CLIENT_START_PROPS props;
+
+    if ((except = vstream_setjmp(session->stream)) != 0)
+	msg_fatal("%s while sending STARTTLS", exception_text(except));
+
+    /*
+     * The handshake uses blocking I/O, and blocks other sessions. Wait for
+     * the server response here, instead of going through the event loop,
+     * so that we never have multiple handshakes pending. Otherwise, a
+     * single-threaded server such as smtp-sink could block in the handshake
+     * for one session, while we block in the handshake for another one.
+     */
+    latency_start(session);
+    command(session->stream, "STARTTLS");
+    if ((resp = response(session->stream, buffer))->code / 100 == 2) {
+	 /* void */ ;
+    } else if (allow_reject) {
+	msg_warn("STARTTLS rejected: %d %s", resp->code, resp->str);
+	close_session(session);
+	return;
+    } else {
+	msg_fatal("STARTTLS rejected: %d %s", resp->code, resp->str);
+    }
+
+    session->tls_context =
+	TLS_CLIENT_START(&props,
+			 ctx = tls_ctx,
+			 stream = session->stream,
+			 fd = -1,
+			 timeout = var_timeout,
+			 enable_rpk = 0,
+			 tls_level = TLS_LEV_ENCRYPT,
+			 nexthop = tls_peer,
+			 host = tls_peer,
+			 namaddr = tls_peer,
+			 sni = 0,
+			 serverid = tls_peer,
+			 helo = "",
+			 protocols = STONE_TLS_PROTOCOLS,
+			 cipher_grade = STONE_TLS_GRADE,
+			 cipher_exclusions = "",
+			 matchargv = 0,
+			 mdalg = STONE_TLS_DGST,
+			 dane = 0);
+    if (session->tls_context == 0)
+	msg_fatal("TLS handshake failed");
+    latency_done(session, LAT_STARTTLS);
+
+    /*
+     * Say hello again, as required by RFC 3207.
+     */
+    send_helo(session);
+}
+
+#endif
+
 /* send_mail - send envelope sender */
 
 static void send_mail(SESSION *session)
@@ -641,6 +892,7 @@ static void send_mail(SESSION *session)
     if ((except = vstream_setjmp(session->stream)) != 0)
 	msg_fatal("%s while sending sender", exception_text(except));
 
+    latency_start(session);
     command(session->stream, "MAIL FROM:<%s>", sender);
 
     /*
@@ -664,6 +916,7 @@ static void mail_done(int unused, void *context)
 	msg_fatal("%s while sending sender", exception_text(except));
 
     if ((resp = response(session->stream, buffer))->code / 100 == 2) {
+	latency_done(session, LAT_MAIL);
 	session->rcpt_count = recipients;
 	session->rcpt_done = 0;
 	session->rcpt_accepted = 0;
@@ -841,6 +1094,7 @@ static void data_done(int unused, void *context)
     /*
      * Send end of message and process the server response.
      */
+    latency_start(session);
     command(session->stream, ".");
 
     /*
@@ -884,6 +1138,7 @@ static void dot_done(int unused_event, void *context)
 	    msg_fatal("end of data rejected: %d %s", resp->code, resp->str);
 	}
     } while (talk_lmtp && --session->rcpt_done > 0);
+    latency_done(session, LAT_DATA);
     session->xfer_count++;
 
     /*
@@ -958,10 +1213,7 @@ static void quit_done(int unused_event, void *context)
     SESSION *session = (SESSION *) context;
 
     (void) response(session->stream, buffer);
-    event_disable_readwrite(vstream_fileno(session->stream));
-    vstream_fclose(session->stream);
-    session->stream = 0;
-    start_another(session);
+    close_session(session);
 }
 
 /* close_session - disconnect, for example after 421 or 521 reply */
@@ -969,6 +1221,13 @@ static void quit_done(int unused_event, void *context)
 static void close_session(SESSION *session)
 {
     event_disable_readwrite(vstream_fileno(session->stream));
+#ifdef USE_TLS
+    if (session->tls_context) {
+	tls_client_stop(tls_ctx, session->stream, var_timeout, 0,
+			session->tls_context);
+	session->tls_context = 0;
+    }
+#endif
     vstream_fclose(session->stream);
     session->stream = 0;
     start_another(session);
@@ -978,7 +1237,7 @@ static void close_session(SESSION *session)
 
 static void usage(char *myname)
 {
-    msg_fatal("usage: %s -cdLNov -s sess -l msglen -m msgs -C count -M myhostname -f from -t to -r rcptcount -R delay -w delay host[:port]", myname);
+    msg_fatal("usage: %s -cdLNoPvZ -a rate -s sess -l msglen -m msgs -C count -M myhostname -f from -t to -r rcptcount -R delay -w delay host[:port]", myname);
 }
 
 MAIL_VERSION_STAMP_DECLARE;
@@ -987,7 +1246,6 @@ MAIL_VERSION_STAMP_DECLARE;
 
 int     main(int argc, char **argv)
 {
-    SESSION *session;
     char   *host;
     char   *port;
     char   *path;
@@ -1013,7 +1271,7 @@ int     main(int argc, char **argv)
     /*
      * Parse JCL.
      */
-    while ((ch = GETOPT(argc, argv, "46AcC:df:F:l:Lm:M:Nor:R:s:S:t:T:vw:")) > 0) {
+    while ((ch = GETOPT(argc, argv, "46a:AcC:df:F:l:Lm:M:NoPr:R:s:S:t:T:vw:Z")) > 0) {
 	switch (ch) {
 	case '4':
 	    protocols = INET_PROTO_NAME_IPV4;
@@ -1021,6 +1279,10 @@ int     main(int argc, char **argv)
 	case '6':
 	    protocols = INET_PROTO_NAME_IPV6;
 	    break;
+	case 'a':
+	    if ((arrival_rate = atoi(optarg)) <= 0)
+		msg_fatal("bad arrival rate: %s", optarg);
+	    break;
 	case 'A':
 	    allow_reject = 1;
 	    break;
@@ -1072,6 +1334,9 @@ int     main(int argc, char **argv)
 	    send_helo_first = 0;
 	    send_headers = 0;
 	    break;
+	case 'P':
+	    show_latency = 1;
+	    break;
 	case 'r':
 	    if ((recipients = atoi(optarg)) <= 0)
 		msg_fatal("bad recipient count: %s", optarg);
@@ -1106,12 +1371,21 @@ int     main(int argc, char **argv)
 	    if ((fixed_delay = atoi(optarg)) <= 0)
 		msg_fatal("bad fixed delay: %s", optarg);
 	    break;
+	case 'Z':
+#ifdef USE_TLS
+	    use_starttls = 1;
+#else
+	    msg_fatal("TLS support is not compiled in");
+#endif
+	    break;
 	default:
 	    usage(argv[0]);
 	}
     }
     if (argc - optind != 1)
 	usage(argv[0]);
+    if (use_starttls && send_helo_first == 0)
+	msg_fatal("do not use -o and -Z options at the same time");
 
     if (random_delay > 0)
 	srand(getpid());
@@ -1209,17 +1483,24 @@ int     main(int argc, char **argv)
 	    recipient = make_recipient(defaddr);
     }
 
+#ifdef USE_TLS
+    if (use_starttls) {
+	tls_ctx = stone_tls_client_init();
+	tls_peer = argv[optind];
+    }
+#endif
+
     /*
-     * Start sessions.
+     * Start sessions. With an arrival rate, each session sends one message,
+     * and the session count limits the number of concurrent sessions.
      */
-    while (sessions-- > 0) {
-	session = (SESSION *) mymalloc(sizeof(*session));
-	session->stream = 0;
-	session->xfer_count = 0;
-	session->connect_count = connect_count;
-	session->next = 0;
-	session_count++;
-	startup(session);
+    if (arrival_rate > 0) {
+	max_sessions = sessions;
+	disconnect = 1;
+	arrival_event(0, (void *) 0);
+    } else {
+	while (sessions-- > 0)
+	    startup(new_session());
     }
     for (;;) {
 	event_loop(-1);
@@ -1228,6 +1509,11 @@ int     main(int argc, char **argv)
 		VSTREAM_PUTC('\n', VSTREAM_OUT);
 		vstream_fflush(VSTREAM_OUT);
 	    }
+	    if (arrival_skipped > 0)
+		msg_warn("%d arrivals skipped: session limit %d reached",
+			 arrival_skipped, max_sessions);
+	    if (show_latency)
+		latency_report();
 	    exit(0);
 	}
     }
@@ -0,0 +1,159 @@
+/*++
+/* NAME
+/*	stone_tls 3
+/* SUMMARY
+/*	TLS support for SMTP test programs
+/* SYNOPSIS
+/*	#include "stone_tls.h"
+/*
+/*	TLS_APPL_STATE *stone_tls_client_init()
+/*
+/*	TLS_APPL_STATE *stone_tls_server_init(cert_file, key_file)
+/*	const char *cert_file;
+/*	const char *key_file;
+/* DESCRIPTION
+/*	This module initializes the Postfix TLS library for the
+/*	smtp-source(1) and smtp-sink(1) test programs. These programs
+/*	run outside a Postfix instance, and do not read main.cf.
+/*
+/*	stone_tls_client_init() creates a TLS client context without
+/*	certificates. Server certificates are not verified.
+/*
+/*	stone_tls_server_init() creates a TLS server context with
+/*	the specified certificate and private key file names. The
+/*	key may be stored in the certificate file.
+/*
+/*	This module also replaces the tlsmgr(8) client functions of
+/*	the TLS library with stubs: the entropy pool is seeded by
+/*	OpenSSL only, and TLS sessions are not cached and no session
+/*	tickets are issued, so that every TLS handshake is a full
+/*	handshake.
+/* DIAGNOSTICS
+/*	Fatal errors: TLS initialization failed.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+
+#ifdef USE_TLS
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstring.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+
+/* TLS library. */
+
+#include <tls_mgr.h>
+
+/* Application-specific. */
+
+#include "stone_tls.h"
+
+/* stone_tls_client_init - initialize client-side TLS engine */
+
+TLS_APPL_STATE *stone_tls_client_init(void)
+{
+    TLS_CLIENT_INIT_PROPS props;
+    TLS_APPL_STATE *ctx;
+
+    ctx = TLS_CLIENT_INIT(&props,
+			  log_param = "TLS client",
+			  log_level = msg_verbose ? "1" : "0",
+			  verifydepth = DEF_SMTP_TLS_SCERT_VD,
+			  cache_type = TLS_MGR_SCACHE_SMTP,
+			  chain_files = "",
+			  cert_file = "",
+			  key_file = "",
+			  dcert_file = "",
+			  dkey_file = "",
+			  eccert_file = "",
+			  eckey_file = "",
+			  CAfile = "",
+			  CApath = "",
+			  mdalg = STONE_TLS_DGST);
+    if (ctx == 0)
+	msg_fatal("cannot initialize TLS client engine");
+    return (ctx);
+}
+
+/* stone_tls_server_init - initialize server-side TLS engine */
+
+TLS_APPL_STATE *stone_tls_server_init(const char *cert_file,
+				              const char *key_file)
+{
+    TLS_SERVER_INIT_PROPS props;
+    TLS_APPL_STATE *ctx;
+
+    ctx = TLS_SERVER_INIT(&props,
+			  log_param = "TLS server",
+			  log_level = msg_verbose ? "1" : "0",
+			  verifydepth = DEF_SMTPD_TLS_CCERT_VD,
+			  cache_type = TLS_MGR_SCACHE_SMTPD,
+			  set_sessid = 0,
+			  chain_files = "",
+			  cert_file = cert_file,
+			  key_file = key_file ? key_file : cert_file,
+			  dcert_file = "",
+			  dkey_file = "",
+			  eccert_file = "",
+			  eckey_file = "",
+			  CAfile = "",
+			  CApath = "",
+			  protocols = STONE_TLS_PROTOCOLS,
+			  eecdh_grade = DEF_SMTPD_TLS_EECDH,
+			  dh1024_param_file = "",
+			  dh512_param_file = "",
+			  ask_ccert = 0,
+			  mdalg = STONE_TLS_DGST);
+    if (ctx == 0)
+	msg_fatal("cannot initialize TLS server engine");
+    return (ctx);
+}
+
+/* tls_mgr_* - stubs that do not talk to the TLS manager */
+
+int     tls_mgr_seed(VSTRING *unused_buf, int unused_len)
+{
+    return (TLS_MGR_STAT_OK);
+}
+
+int     tls_mgr_policy(const char *unused_type, int *cachable, int *timeout)
+{
+    *cachable = 0;
+    *timeout = 0;
+    return (TLS_MGR_STAT_OK);
+}
+
+int     tls_mgr_lookup(const char *unused_type, const char *unused_key,
+		               VSTRING *unused_buf)
+{
+    return (TLS_MGR_STAT_ERR);
+}
+
+int     tls_mgr_update(const char *unused_type, const char *unused_key,
+		               const char *unused_buf, ssize_t unused_len)
+{
+    return (TLS_MGR_STAT_ERR);
+}
+
+int     tls_mgr_delete(const char *unused_type, const char *unused_key)
+{
+    return (TLS_MGR_STAT_ERR);
+}
+
+TLS_TICKET_KEY *tls_mgr_key(unsigned char *unused_name, int unused_timeout)
+{
+    return (0);
+}
+
+#endif
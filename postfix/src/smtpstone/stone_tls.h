@@ -0,0 +1,37 @@
+/*++
+/* NAME
+/*	stone_tls 3h
+/* SUMMARY
+/*	TLS support for SMTP test programs
+/* SYNOPSIS
+/*	#include "stone_tls.h"
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * TLS library.
+  */
+#ifdef USE_TLS
+#include <tls.h>
+
+ /*
+  * External interface.
+  */
+extern TLS_APPL_STATE *stone_tls_client_init(void);
+extern TLS_APPL_STATE *stone_tls_server_init(const char *, const char *);
+
+ /*
+  * Handshake parameters. The test programs have their own var_myhostname
+  * etc., and cannot include <mail_params.h> for the defaults.
+  */
+#define STONE_TLS_PROTOCOLS	">=TLSv1"
+#define STONE_TLS_GRADE		"medium"
+#define STONE_TLS_DGST		"sha256"
+
+#endif
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
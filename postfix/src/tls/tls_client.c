@@ -174,11 +174,13 @@
 #include <stringops.h>
 #include <msg.h>
 #include <iostuff.h>			/* non-blocking */
+#include <probes.h>
 #include <midna_domain.h>
 
 /* Global library. */
 
 #include <mail_params.h>
+#include <metrics_clnt.h>
 
 /* TLS library. */
 
@@ -1233,8 +1235,10 @@ TLS_SESS_STATE *tls_client_start(const TLS_CLIENT_START_PROPS *props)
      * Error handling: If the SSL handshake fails, we print out an error message
      * and remove all TLS state concerning this session.
      */
+    POSTFIX_PROBE2(tls_handshake_start, "client", props->namaddr);
     sts = tls_bio_connect(vstream_fileno(props->stream), props->timeout,
 			  TLScontext);
+    POSTFIX_PROBE3(tls_handshake_done, "client", props->namaddr, sts);
     if (sts <= 0) {
 	if (ERR_peek_error() != 0) {
 	    msg_info("SSL_connect error to %s: %d", props->namaddr, sts);
@@ -1246,6 +1250,8 @@ TLS_SESS_STATE *tls_client_start(const TLS_CLIENT_START_PROPS *props)
 		     props->namaddr);
 	}
 	uncache_session(app_ctx->ssl_ctx, TLScontext);
+	metrics_count("postfix_tls_handshake_failures_total", 1,
+		      "role", "client", (char *) 0);
 	tls_free_context(TLScontext);
 	return (0);
     }
@@ -1270,6 +1276,9 @@ TLS_SESS_STATE *tls_client_post_connect(TLS_SESS_STATE *TLScontext,
      * session was negotiated.
      */
     TLScontext->session_reused = SSL_session_reused(TLScontext->con);
+    metrics_count("postfix_tls_handshakes_total", 1, "role", "client",
+		  "resumed", TLScontext->session_reused ? "yes" : "no",
+		  (char *) 0);
     if ((TLScontext->log_mask & TLS_LOG_CACHE) && TLScontext->session_reused)
 	msg_info("%s: Reusing old session", TLScontext->namaddr);
 
@@ -260,11 +260,14 @@ typedef struct dane_mtype {
 
 /*
  * This is not intended to be a long-term cache of pre-parsed TLSA data,
- * rather we primarily want to avoid fetching and parsing the TLSA records
- * for a single multi-homed MX host more than once per delivery. Therefore,
- * we keep the table reasonably small.
+ * rather we want to avoid fetching and parsing the TLSA records for the
+ * same MX host more than once per delivery, and more than once per TTL
+ * during the lifetime of a delivery agent process. Entries expire with the
+ * TLSA RRset TTL, and the table is sized for the number of MX hosts that a
+ * process may encounter before it is recycled. Sharing between processes
+ * is left to the DNSSEC-validating resolver that DANE requires anyway.
  */
-#define CACHE_SIZE 20
+#define CACHE_SIZE 100
 static CTABLE *dane_cache;
 
 static int log_mask;
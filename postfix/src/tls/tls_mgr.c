@@ -43,15 +43,20 @@
 /*	Pseudo Random Number Generator (PRNG) pool.
 /*
 /*	tls_mgr_policy() requests the session caching policy.
+/*	When the cache type is enabled, sessions of that type are
+/*	also kept in a small per-process cache, for the session
+/*	cache timeout that tlsmgr(8) reports.
 /*
 /*	tls_mgr_lookup() loads the specified session from
-/*	the specified session cache.
+/*	the specified session cache. It consults the per-process
+/*	cache first, and remembers a session that it receives from
+/*	tlsmgr(8).
 /*
 /*	tls_mgr_update() saves the specified session to
-/*	the specified session cache.
+/*	the specified session cache, and to the per-process cache.
 /*
 /*	tls_mgr_delete() removes specified session from
-/*	the specified session cache.
+/*	the specified session cache, and from the per-process cache.
 /*
 /*	tls_mgr_key() is used to retrieve the current TLS session ticket
 /*	encryption or decryption keys.
@@ -133,6 +138,8 @@
 #include <attr_clnt.h>
 #include <mymalloc.h>
 #include <stringops.h>
+#include <htable.h>
+#include <ctable.h>
 
 /* Global library. */
 
@@ -149,6 +156,120 @@
 
 static ATTR_CLNT *tls_mgr;
 
+ /*
+  * Per-process session cache. A server or delivery agent process that talks
+  * to the same peer repeatedly finds the session here, without a round trip
+  * to the tlsmgr(8) server. Updates and deletions are still sent to tlsmgr(8)
+  * so that sibling processes share sessions. An entry may outlive the
+  * corresponding tlsmgr(8) entry; that is safe, because a stale session
+  * merely fails to resume.
+  */
+#define TLS_MGR_LOCAL_SIZE	100
+
+typedef struct {
+    VSTRING *session;			/* serialized session */
+    time_t  expires;			/* zero: deleted */
+} TLS_MGR_LOCAL_ENTRY;
+
+typedef struct {
+    const char *buf;			/* serialized session */
+    ssize_t len;			/* zero: delete */
+    int     timeout;			/* session cache timeout */
+} TLS_MGR_LOCAL_REQUEST;
+
+static CTABLE *tls_mgr_local;
+static HTABLE *tls_mgr_local_timeout;
+static TLS_MGR_LOCAL_REQUEST tls_mgr_local_request;
+static VSTRING *tls_mgr_local_key;
+
+/* tls_mgr_local_create - save session after lookup or update */
+
+static void *tls_mgr_local_create(const char *unused_key, void *unused_ctx)
+{
+    TLS_MGR_LOCAL_REQUEST *rp = &tls_mgr_local_request;
+    TLS_MGR_LOCAL_ENTRY *ep;
+
+    ep = (TLS_MGR_LOCAL_ENTRY *) mymalloc(sizeof(*ep));
+    ep->session = vstring_alloc(rp->len > 0 ? rp->len : 1);
+    vstring_memcpy(ep->session, rp->buf, rp->len);
+    ep->expires = rp->len > 0 ? time((time_t *) 0) + rp->timeout : 0;
+    return ((void *) ep);
+}
+
+/* tls_mgr_local_delete - destroy cache entry */
+
+static void tls_mgr_local_delete(void *value, void *unused_ctx)
+{
+    TLS_MGR_LOCAL_ENTRY *ep = (TLS_MGR_LOCAL_ENTRY *) value;
+
+    vstring_free(ep->session);
+    myfree((void *) ep);
+}
+
+/* tls_mgr_local_enable - enable the per-process cache for a cache type */
+
+static void tls_mgr_local_enable(const char *cache_type, int timeout)
+{
+    int    *tp;
+
+    if (tls_mgr_local == 0) {
+	tls_mgr_local = ctable_create(TLS_MGR_LOCAL_SIZE, tls_mgr_local_create,
+				      tls_mgr_local_delete, (void *) 0);
+	tls_mgr_local_timeout = htable_create(1);
+	tls_mgr_local_key = vstring_alloc(100);
+    }
+    if ((tp = (int *) htable_find(tls_mgr_local_timeout, cache_type)) == 0) {
+	tp = (int *) mymalloc(sizeof(*tp));
+	htable_enter(tls_mgr_local_timeout, cache_type, (void *) tp);
+    }
+    *tp = timeout;
+}
+
+/* tls_mgr_local_find - look up session in per-process cache */
+
+static const TLS_MGR_LOCAL_ENTRY *tls_mgr_local_find(const char *key)
+{
+    const TLS_MGR_LOCAL_ENTRY *ep;
+
+    if (!ctable_exists(tls_mgr_local, key))
+	return (0);
+    ep = (const TLS_MGR_LOCAL_ENTRY *) ctable_locate(tls_mgr_local, key);
+    if (ep->expires == 0 || ep->expires < time((time_t *) 0))
+	return (0);
+    return (ep);
+}
+
+/* tls_mgr_local_save - save or delete session in per-process cache */
+
+static void tls_mgr_local_save(const char *key, const char *buf, ssize_t len,
+			               int timeout)
+{
+    TLS_MGR_LOCAL_REQUEST *rp = &tls_mgr_local_request;
+
+    rp->buf = buf;
+    rp->len = len;
+    rp->timeout = timeout;
+    if (ctable_exists(tls_mgr_local, key))
+	(void) ctable_refresh(tls_mgr_local, key);
+    else if (len > 0)
+	(void) ctable_locate(tls_mgr_local, key);
+}
+
+/* tls_mgr_local_lookup_key - per-process cache key, or null if disabled */
+
+static const char *tls_mgr_local_lookup_key(const char *cache_type,
+				            const char *cache_id, int *timeout)
+{
+    int    *tp;
+
+    if (tls_mgr_local == 0
+	|| (tp = (int *) htable_find(tls_mgr_local_timeout, cache_type)) == 0)
+	return (0);
+    *timeout = *tp;
+    vstring_sprintf(tls_mgr_local_key, "%s:%s", cache_type, cache_id);
+    return (STR(tls_mgr_local_key));
+}
+
 /* tls_mgr_handshake - receive server protocol announcement */
 
 static int tls_mgr_handshake(VSTREAM *stream)
@@ -240,6 +361,8 @@ int     tls_mgr_policy(const char *cache_type, int *cachable, int *timeout)
 			  RECV_ATTR_INT(TLS_MGR_ATTR_SESSTOUT, timeout),
 			  ATTR_TYPE_END) != 3)
 	status = TLS_MGR_STAT_FAIL;
+    if (status == TLS_MGR_STAT_OK && *cachable && *timeout > 0)
+	tls_mgr_local_enable(cache_type, *timeout);
     return (status);
 }
 
@@ -248,8 +371,21 @@ int     tls_mgr_policy(const char *cache_type, int *cachable, int *timeout)
 int     tls_mgr_lookup(const char *cache_type, const char *cache_id,
 		               VSTRING *buf)
 {
+    const TLS_MGR_LOCAL_ENTRY *ep;
+    const char *local_key;
+    int     timeout;
     int     status;
 
+    /*
+     * Try the per-process cache first.
+     */
+    if ((local_key = tls_mgr_local_lookup_key(cache_type, cache_id,
+					      &timeout)) != 0
+	&& (ep = tls_mgr_local_find(local_key)) != 0) {
+	vstring_memcpy(buf, STR(ep->session), LEN(ep->session));
+	return (TLS_MGR_STAT_OK);
+    }
+
     /*
      * Create the tlsmgr client handle.
      */
@@ -270,6 +406,8 @@ int     tls_mgr_lookup(const char *cache_type, const char *cache_id,
 			  RECV_ATTR_DATA(TLS_MGR_ATTR_SESSION, buf),
 			  ATTR_TYPE_END) != 2)
 	status = TLS_MGR_STAT_FAIL;
+    if (status == TLS_MGR_STAT_OK && local_key != 0 && LEN(buf) > 0)
+	tls_mgr_local_save(local_key, STR(buf), LEN(buf), timeout);
     return (status);
 }
 
@@ -278,8 +416,17 @@ int     tls_mgr_lookup(const char *cache_type, const char *cache_id,
 int     tls_mgr_update(const char *cache_type, const char *cache_id,
 		               const char *buf, ssize_t len)
 {
+    const char *local_key;
+    int     timeout;
     int     status;
 
+    /*
+     * Update the per-process cache even if tlsmgr(8) is unavailable.
+     */
+    if ((local_key = tls_mgr_local_lookup_key(cache_type, cache_id,
+					      &timeout)) != 0)
+	tls_mgr_local_save(local_key, buf, len, timeout);
+
     /*
      * Create the tlsmgr client handle.
      */
@@ -307,8 +454,17 @@ int     tls_mgr_update(const char *cache_type, const char *cache_id,
 
 int     tls_mgr_delete(const char *cache_type, const char *cache_id)
 {
+    const char *local_key;
+    int     timeout;
     int     status;
 
+    /*
+     * Remove the session from the per-process cache.
+     */
+    if ((local_key = tls_mgr_local_lookup_key(cache_type, cache_id,
+					      &timeout)) != 0)
+	tls_mgr_local_save(local_key, "", 0, 0);
+
     /*
      * Create the tlsmgr client handle.
      */
@@ -497,6 +497,11 @@ static const LONG_NAME_MASK ssl_op_tweaks[] = {
 #endif
     NAME_SSL_OP(ENABLE_MIDDLEBOX_COMPAT),
 
+#ifndef SSL_OP_ENABLE_KTLS
+#define SSL_OP_ENABLE_KTLS		0
+#endif
+    NAME_SSL_OP(ENABLE_KTLS),
+
     0, 0,
 };
 
@@ -1260,6 +1265,23 @@ void    tls_log_summary(TLS_ROLE role, TLS_USAGE usage, TLS_SESS_STATE *ctx)
 	    vstring_sprintf_append(msg, " client-digest %s",
 				   ctx->clnt_sig_dgst);
     }
+
+    /*
+     * With "tls_ssl_options = ENABLE_KTLS", OpenSSL hands record encryption
+     * to the kernel after the handshake, when the kernel and cipher support
+     * it. Log the outcome, so that it can be verified without tracing.
+     */
+#ifdef BIO_get_ktls_send
+    if (ctx->con != 0) {
+	int     ktls_send = BIO_get_ktls_send(SSL_get_wbio(ctx->con));
+	int     ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(ctx->con));
+
+	if (ktls_send || ktls_recv)
+	    vstring_sprintf_append(msg, " kernel-tls %s",
+				   ktls_send && ktls_recv ? "send,receive" :
+				   ktls_send ? "send" : "receive");
+    }
+#endif
     msg_info("%s", vstring_str(msg));
     vstring_free(msg);
 }
@@ -1270,8 +1292,11 @@ TLS_APPL_STATE *tls_alloc_app_context(SSL_CTX *ssl_ctx, SSL_CTX *sni_ctx,
 				              int log_mask)
 {
     TLS_APPL_STATE *app_ctx;
+    int     tag;
 
+    tag = mymalloc_set_tag(MYMALLOC_TAG_TLS);
     app_ctx = (TLS_APPL_STATE *) mymalloc(sizeof(*app_ctx));
+    (void) mymalloc_set_tag(tag);
 
     /* See portability note below with other memset() call. */
     memset((void *) app_ctx, 0, sizeof(*app_ctx));
@@ -1307,6 +1332,7 @@ void    tls_free_app_context(TLS_APPL_STATE *app_ctx)
 TLS_SESS_STATE *tls_alloc_sess_context(int log_mask, const char *namaddr)
 {
     TLS_SESS_STATE *TLScontext;
+    int     tag;
 
     /*
      * PORTABILITY: Do not assume that null pointers are all-zero bits. Use
@@ -1317,6 +1343,7 @@ TLS_SESS_STATE *tls_alloc_sess_context(int log_mask, const char *namaddr)
      * 
      * However, it's OK to use memset() to zero integer values.
      */
+    tag = mymalloc_set_tag(MYMALLOC_TAG_TLS);
     TLScontext = (TLS_SESS_STATE *) mymalloc(sizeof(TLS_SESS_STATE));
     memset((void *) TLScontext, 0, sizeof(*TLScontext));
     TLScontext->con = 0;
@@ -1341,6 +1368,7 @@ TLS_SESS_STATE *tls_alloc_sess_context(int log_mask, const char *namaddr)
     TLScontext->srvr_sig_dgst = 0;
     TLScontext->log_mask = log_mask;
     TLScontext->namaddr = lowercase(mystrdup(namaddr));
+    (void) mymalloc_set_tag(tag);
     TLScontext->mdalg = 0;			/* Alias for props->mdalg */
     TLScontext->dane = 0;			/* Alias for props->dane */
     TLScontext->errordepth = -1;
@@ -141,10 +141,12 @@
 #include <msg.h>
 #include <hex_code.h>
 #include <iostuff.h>			/* non-blocking */
+#include <probes.h>
 
 /* Global library. */
 
 #include <mail_params.h>
+#include <metrics_clnt.h>
 
 /* TLS library. */
 
@@ -383,6 +385,46 @@ static int ticket_cb(SSL *con, unsigned char name[], unsigned char iv[],
 #endif					/* defined(SSL_OP_NO_TICKET) &&
 					 * !defined(OPENSSL_NO_TLSEXT) */
 
+/* store_client_CA_names - client CA names from the certificate store */
+
+static STACK_OF(X509_NAME) *store_client_CA_names(SSL_CTX *ctx)
+{
+    STACK_OF(X509_OBJECT) *objs;
+    STACK_OF(X509_NAME) *calist;
+    X509_NAME *name;
+    X509   *cert;
+    int     i;
+    int     j;
+
+    /*
+     * Right after tls_set_ca_certificate_info(), the store holds exactly the
+     * certificates from the CAfile (CApath lookups happen on demand). This
+     * avoids parsing a large CAfile a second time with
+     * SSL_load_client_CA_file(). The list order may differ from the file
+     * order, which is not significant in a certificate request.
+     */
+    if ((calist = sk_X509_NAME_new_null()) == 0)
+	return (0);
+    objs = X509_STORE_get0_objects(SSL_CTX_get_cert_store(ctx));
+    for (i = 0; i < sk_X509_OBJECT_num(objs); i++) {
+	if ((cert = X509_OBJECT_get0_X509(sk_X509_OBJECT_value(objs, i))) == 0)
+	    continue;				/* CRL */
+	name = X509_get_subject_name(cert);
+	for (j = 0; j < sk_X509_NAME_num(calist); j++)
+	    if (X509_NAME_cmp(name, sk_X509_NAME_value(calist, j)) == 0)
+		break;
+	if (j < sk_X509_NAME_num(calist))
+	    continue;				/* duplicate */
+	if ((name = X509_NAME_dup(name)) == 0
+	    || !sk_X509_NAME_push(calist, name)) {
+	    X509_NAME_free(name);
+	    sk_X509_NAME_pop_free(calist, X509_NAME_free);
+	    return (0);
+	}
+    }
+    return (calist);
+}
+
 /* tls_server_init - initialize the server-side TLS engine */
 
 TLS_APPL_STATE *tls_server_init(const TLS_SERVER_INIT_PROPS *props)
@@ -726,7 +768,9 @@ TLS_APPL_STATE *tls_server_init(const TLS_SERVER_INIT_PROPS *props)
     SSL_CTX_set_verify(sni_ctx, verify_flags,
 		       tls_verify_certificate_callback);
     if (props->ask_ccert && *props->CAfile) {
-	STACK_OF(X509_NAME) *calist = SSL_load_client_CA_file(props->CAfile);
+	STACK_OF(X509_NAME) *calist = var_tls_append_def_CA ?
+	SSL_load_client_CA_file(props->CAfile) :
+	store_client_CA_names(server_ctx);
 
 	if (calist == 0) {
 	    /* Not generally critical */
@@ -937,8 +981,10 @@ TLS_SESS_STATE *tls_server_start(const TLS_SERVER_START_PROPS *props)
      * Error handling: If the SSL handshake fails, we print out an error message
      * and remove all TLS state concerning this session.
      */
+    POSTFIX_PROBE2(tls_handshake_start, "server", props->namaddr);
     sts = tls_bio_accept(vstream_fileno(props->stream), props->timeout,
 			 TLScontext);
+    POSTFIX_PROBE3(tls_handshake_done, "server", props->namaddr, sts);
     if (sts <= 0) {
 	if (ERR_peek_error() != 0) {
 	    msg_info("SSL_accept error from %s: %d", props->namaddr, sts);
@@ -949,6 +995,8 @@ TLS_SESS_STATE *tls_server_start(const TLS_SERVER_START_PROPS *props)
 	    msg_info("SSL_accept error from %s: lost connection",
 		     props->namaddr);
 	}
+	metrics_count("postfix_tls_handshake_failures_total", 1,
+		      "role", "server", (char *) 0);
 	tls_free_context(TLScontext);
 	return (0);
     }
@@ -973,6 +1021,9 @@ TLS_SESS_STATE *tls_server_post_accept(TLS_SESS_STATE *TLScontext)
      * session was negotiated.
      */
     TLScontext->session_reused = SSL_session_reused(TLScontext->con);
+    metrics_count("postfix_tls_handshakes_total", 1, "role", "server",
+		  "resumed", TLScontext->session_reused ? "yes" : "no",
+		  (char *) 0);
     if ((TLScontext->log_mask & TLS_LOG_CACHE) && TLScontext->session_reused)
 	msg_info("%s: Reusing old session%s", TLScontext->namaddr,
 		 TLScontext->ticketed ? " (RFC 5077 session ticket)" : "");
@@ -91,6 +91,13 @@
 /* .IP "\fBsmtpd_tls_session_cache_timeout (3600s)\fR"
 /*	The expiration time of Postfix SMTP server TLS session cache
 /*	information.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBtls_session_ticket_secret_file (empty)\fR"
+/*	Optional file with a secret that is shared by all members of
+/*	a server cluster, from which \fBtlsmgr\fR(8) derives the TLS
+/*	session ticket keys, so that a client can resume a session
+/*	with any cluster member.
 /* PSEUDO RANDOM NUMBER GENERATOR
 /* .ad
 /* .fi
@@ -187,6 +194,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/time.h>			/* gettimeofday, not POSIX */
 #include <limits.h>
 
@@ -198,6 +206,8 @@
 
 #ifdef USE_TLS
 #include <openssl/rand.h>		/* For the PRNG */
+#include <openssl/evp.h>
+#include <openssl/hmac.h>		/* Ticket key derivation */
 #endif
 
 /* Utility library. */
@@ -256,6 +266,7 @@ char   *var_lmtp_tls_loglevel;
 char   *var_lmtp_tls_scache_db;
 int     var_lmtp_tls_scache_timeout;
 char   *var_tls_rand_exch_name;
+char   *var_tls_tkt_secret;
 
  /*
   * Bound the time that we are willing to wait for an I/O operation. This
@@ -276,6 +287,14 @@ static TLS_PRNG_SRC *rand_source_dev;
 static TLS_PRNG_SRC *rand_source_egd;
 static TLS_PRNG_SRC *rand_source_file;
 
+ /*
+  * Shared secret for cluster-wide session ticket keys.
+  */
+static VSTRING *tkt_secret;
+
+#define TLS_TKT_SECRET_MIN	32	/* bytes */
+#define TLS_TKT_SECRET_MAX	1024	/* bytes */
+
  /*
   * The external entropy source type is encoded in the source name. The
   * obvious alternative is to have separate configuration parameters per
@@ -470,6 +489,46 @@ static void tlsmgr_cache_run_event(int unused_event, void *ctx)
 			cache->cache_info->timeout);
 }
 
+/* tlsmgr_derive_key - derive session ticket key from shared secret */
+
+static int tlsmgr_derive_key(TLS_TICKET_KEY *key, time_t epoch, int timeout)
+{
+    static const char label[] = "postfix session ticket key";
+    unsigned char msg[sizeof(label) + 8 + 1];
+    unsigned char out[EVP_MAX_MD_SIZE];
+    unsigned int out_len;
+    unsigned char *dst[3];
+    size_t  dst_len[3];
+    int     i;
+
+    /*
+     * All cluster members derive the same keys for the same time interval.
+     * The key name, AES key and HMAC key are the first bytes of consecutive
+     * HMAC-SHA256 blocks with the shared secret, over a fixed label, the
+     * interval number, and a block counter.
+     */
+    memcpy(msg, label, sizeof(label));
+    for (i = 0; i < 8; i++)
+	msg[sizeof(label) + i] =
+	    (unsigned char) ((unsigned long long) epoch >> (8 * (7 - i)));
+    dst[0] = key->name;
+    dst_len[0] = TLS_TICKET_NAMELEN;
+    dst[1] = key->bits;
+    dst_len[1] = TLS_TICKET_KEYLEN;
+    dst[2] = key->hmac;
+    dst_len[2] = TLS_TICKET_MACLEN;
+    for (i = 0; i < 3; i++) {
+	msg[sizeof(msg) - 1] = i + 1;
+	if (HMAC(EVP_sha256(), STR(tkt_secret), LEN(tkt_secret),
+		 msg, sizeof(msg), out, &out_len) == 0
+	    || out_len < dst_len[i])
+	    return (-1);
+	memcpy(dst[i], out, dst_len[i]);
+    }
+    key->tout = (epoch + 1) * timeout - 1;
+    return (0);
+}
+
 /* tlsmgr_key - return matching or current RFC 5077 session ticket keys */
 
 static int tlsmgr_key(VSTRING *buffer, int timeout)
@@ -478,19 +537,32 @@ static int tlsmgr_key(VSTRING *buffer, int timeout)
     TLS_TICKET_KEY tmp;
     unsigned char *name;
     time_t  now = time((time_t *) 0);
+    time_t  epoch;
 
     /* In tlsmgr requests we encode null key names as empty strings. */
     name = LEN(buffer) ? (unsigned char *) STR(buffer) : 0;
 
     /*
      * Each key's encrypt and subsequent decrypt-only timeout is half of the
-     * total session timeout.
+     * total session timeout. Don't divide by zero when the session timeout
+     * is one second.
      */
-    timeout /= 2;
+    if ((timeout /= 2) < 1)
+	timeout = 1;
 
     /* Attempt to locate existing key */
     if ((key = tls_scache_key(name, now, timeout)) == 0) {
-	if (name == 0) {
+	if (tkt_secret != 0) {
+	    /* Derive current encryption key, or recent decryption key */
+	    epoch = now / timeout;
+	    if (tlsmgr_derive_key(&tmp, epoch, timeout) < 0)
+		return (TLS_MGR_STAT_ERR);
+	    if (name != 0 && memcmp(name, tmp.name, TLS_TICKET_NAMELEN) != 0
+		&& (tlsmgr_derive_key(&tmp, epoch - 1, timeout) < 0
+		    || memcmp(name, tmp.name, TLS_TICKET_NAMELEN) != 0))
+		return (TLS_MGR_STAT_ERR);
+	    key = tls_scache_key_rotate(&tmp);
+	} else if (name == 0) {
 	    /* Create new encryption key */
 	    if (RAND_bytes(tmp.name, TLS_TICKET_NAMELEN) <= 0
 		|| RAND_bytes(tmp.bits, TLS_TICKET_KEYLEN) <= 0
@@ -897,6 +969,29 @@ static void tlsmgr_pre_init(char *unused_name, char **unused_argv)
 	msg_warn("encryption keys etc. may be predictable");
     }
 
+    /*
+     * Read the shared session ticket key secret while still privileged, so
+     * that the file can be readable by root only.
+     */
+    if (*var_tls_tkt_secret) {
+	VSTREAM *fp;
+
+	if ((fp = vstream_fopen(var_tls_tkt_secret, O_RDONLY, 0)) == 0)
+	    msg_fatal("open %s: %m", var_tls_tkt_secret);
+	tkt_secret = vstring_alloc(TLS_TKT_SECRET_MAX);
+	VSTRING_SPACE(tkt_secret, TLS_TKT_SECRET_MAX);
+	vstring_set_payload_size(tkt_secret,
+				 vstream_fread(fp, STR(tkt_secret),
+					       TLS_TKT_SECRET_MAX));
+	if (vstream_ferror(fp))
+	    msg_fatal("read %s: %m", var_tls_tkt_secret);
+	(void) vstream_fclose(fp);
+	if (LEN(tkt_secret) < TLS_TKT_SECRET_MIN)
+	    msg_fatal("%s: file %s must contain at least %d bytes",
+		      VAR_TLS_TKT_SECRET, var_tls_tkt_secret,
+		      TLS_TKT_SECRET_MIN);
+    }
+
     /*
      * Security: don't create root-owned files that contain untrusted data.
      * And don't create Postfix-owned files in root-owned directories,
@@ -1047,6 +1142,7 @@ int     main(int argc, char **argv)
 	VAR_SMTPD_TLS_LOGLEVEL, DEF_SMTPD_TLS_LOGLEVEL, &var_smtpd_tls_loglevel, 0, 0,
 	VAR_SMTP_TLS_LOGLEVEL, DEF_SMTP_TLS_LOGLEVEL, &var_smtp_tls_loglevel, 0, 0,
 	VAR_LMTP_TLS_LOGLEVEL, DEF_LMTP_TLS_LOGLEVEL, &var_lmtp_tls_loglevel, 0, 0,
+	VAR_TLS_TKT_SECRET, DEF_TLS_TKT_SECRET, &var_tls_tkt_secret, 0, 0,
 	0,
     };
     static const CONFIG_TIME_TABLE time_table[] = {
@@ -340,6 +340,16 @@
 /* .IP "\fBtlsproxy_watchdog_timeout (10s)\fR"
 /*	How much time a \fBtlsproxy\fR(8) process may take to process local
 /*	or remote I/O before it is terminated by a built-in watchdog timer.
+/* .PP
+/*	Available in Postfix version 3.9 and later:
+/* .IP "\fBtlsproxy_tls_async_mode (no)\fR"
+/*	Enable OpenSSL asynchronous mode, so that a \fBtlsproxy\fR(8)
+/*	process can serve other connections while an asynchronous
+/*	crypto engine computes a TLS handshake or record operation.
+/* .IP "\fBtlsproxy_client_limit (0)\fR"
+/*	The maximal number of connections that a \fBtlsproxy\fR(8)
+/*	process will serve before the master starts another process,
+/*	so that TLS processing is spread over multiple CPU cores.
 /* MISCELLANEOUS CONTROLS
 /* .ad
 /* .fi
@@ -496,6 +506,8 @@ char   *var_tlsp_tls_fpt_dgst;
 char   *var_tlsp_tls_level;
 
 int     var_tlsp_watchdog;
+bool    var_tlsp_tls_async;
+int     var_tlsp_client_limit;
 
  /*
   * Defaults for tlsp_clnt_*.
@@ -607,9 +619,24 @@ static BH_TABLE *tlsp_params_mismatch_filter;	/* per-client nag filter */
   */
 
 static void tlsp_ciphertext_event(int, void *);
+static void tlsp_strategy(TLSP_STATE *);
 
 #define TLSP_INIT_TIMEOUT	100
 
+ /*
+  * Plaintext buffer size. Each SSL_write() call produces at most one TLS
+  * record per buffer-full of plaintext, and each SSL_read() call delivers at
+  * most one record. With a VSTREAM_BUFSIZE (4096-byte) buffer, a bulk
+  * transfer therefore used four times as many TLS records, SSL_write() and
+  * SSL_read() calls, and event loop iterations as needed. A buffer that
+  * holds one maximal-size TLS record avoids that overhead.
+  */
+#ifdef SSL3_RT_MAX_PLAIN_LENGTH
+#define TLSP_PLAINTEXT_BUFSIZE	SSL3_RT_MAX_PLAIN_LENGTH
+#else
+#define TLSP_PLAINTEXT_BUFSIZE	16384
+#endif
+
 static void tlsp_plaintext_event(int event, void *context);
 
 /* tlsp_drain - delayed exit after "postfix reload" */
@@ -640,12 +667,54 @@ static void tlsp_drain(char *unused_service, char **unused_argv)
     }
 }
 
+#ifdef SSL_MODE_ASYNC
+
+/* tlsp_async_event - paused asynchronous crypto job may be resumed */
+
+static void tlsp_async_event(int unused_event, void *context)
+{
+    TLSP_STATE *state = (TLSP_STATE *) context;
+
+    /*
+     * Repeat the SSL function call that returned SSL_ERROR_WANT_ASYNC or
+     * SSL_ERROR_WANT_ASYNC_JOB. tlsp_eval_tls_error() turns off the async
+     * read or timer event when the TLS engine reports a different result.
+     */
+    tlsp_strategy(state);
+    /* At this point, state could be a dangling pointer. */
+}
+
+/* tlsp_async_done - stop waiting for asynchronous crypto job */
+
+static void tlsp_async_done(TLSP_STATE *state)
+{
+    if (state->async_fd >= 0) {
+	event_disable_readwrite(state->async_fd);
+	state->async_fd = -1;
+    }
+    if (state->async_event) {
+	event_cancel_timer(state->async_event, (void *) state);
+	state->async_event = 0;
+    }
+    /* Ciphertext read/write events are already turned off. */
+    state->ssl_last_err = SSL_ERROR_NONE;
+}
+
+#endif
+
 /* tlsp_eval_tls_error - translate TLS "error" result into action */
 
 static int tlsp_eval_tls_error(TLSP_STATE *state, int err)
 {
     int     ciphertext_fd = state->ciphertext_fd;
 
+#ifdef SSL_MODE_ASYNC
+    if ((state->ssl_last_err == SSL_ERROR_WANT_ASYNC
+	 || state->ssl_last_err == SSL_ERROR_WANT_ASYNC_JOB)
+	&& err != state->ssl_last_err)
+	tlsp_async_done(state);
+#endif
+
     /*
      * The ciphertext file descriptor is in non-blocking mode, meaning that
      * each SSL_accept/connect/read/write/shutdown request may return an
@@ -676,10 +745,8 @@ static int tlsp_eval_tls_error(TLSP_STATE *state, int err)
 	 * write/timeout events on the ciphertext stream.
 	 */
     case SSL_ERROR_WANT_WRITE:
-	if (state->ssl_last_err == SSL_ERROR_WANT_READ)
-	    event_disable_readwrite(ciphertext_fd);
 	if (state->ssl_last_err != SSL_ERROR_WANT_WRITE) {
-	    event_enable_write(ciphertext_fd, tlsp_ciphertext_event,
+	    event_switch_write(ciphertext_fd, tlsp_ciphertext_event,
 			       (void *) state);
 	    state->ssl_last_err = SSL_ERROR_WANT_WRITE;
 	}
@@ -692,10 +759,8 @@ static int tlsp_eval_tls_error(TLSP_STATE *state, int err)
 	 * read/timeout events on the ciphertext stream.
 	 */
     case SSL_ERROR_WANT_READ:
-	if (state->ssl_last_err == SSL_ERROR_WANT_WRITE)
-	    event_disable_readwrite(ciphertext_fd);
 	if (state->ssl_last_err != SSL_ERROR_WANT_READ) {
-	    event_enable_read(ciphertext_fd, tlsp_ciphertext_event,
+	    event_switch_read(ciphertext_fd, tlsp_ciphertext_event,
 			      (void *) state);
 	    state->ssl_last_err = SSL_ERROR_WANT_READ;
 	}
@@ -703,6 +768,55 @@ static int tlsp_eval_tls_error(TLSP_STATE *state, int err)
 			    state->timeout);
 	return (TLSP_STAT_OK);
 
+#ifdef SSL_MODE_ASYNC
+
+	/*
+	 * An asynchronous crypto engine is working on our behalf. Turn off
+	 * ciphertext read/write events, and resume the paused SSL function
+	 * call when the engine's wait file descriptor becomes readable.
+	 */
+    case SSL_ERROR_WANT_ASYNC:
+	if (state->ssl_last_err == SSL_ERROR_WANT_READ
+	    || state->ssl_last_err == SSL_ERROR_WANT_WRITE)
+	    event_disable_readwrite(ciphertext_fd);
+	if (state->ssl_last_err != SSL_ERROR_WANT_ASYNC) {
+	    OSSL_ASYNC_FD async_fd;
+	    size_t  numfds = 0;
+
+	    if (SSL_get_all_async_fds(state->tls_context->con,
+				      (OSSL_ASYNC_FD *) 0, &numfds) != 1
+		|| numfds != 1
+		|| SSL_get_all_async_fds(state->tls_context->con,
+					 &async_fd, &numfds) != 1) {
+		msg_warn("%s: unsupported number of asynchronous job wait "
+			 "file descriptors: %lu", state->remote_endpt,
+			 (unsigned long) numfds);
+		tlsp_state_free(state);
+		return (TLSP_STAT_ERR);
+	    }
+	    event_enable_read(async_fd, tlsp_async_event, (void *) state);
+	    state->async_fd = async_fd;
+	    state->ssl_last_err = SSL_ERROR_WANT_ASYNC;
+	}
+	event_request_timer(tlsp_ciphertext_event, (void *) state,
+			    state->timeout);
+	return (TLSP_STAT_OK);
+
+	/*
+	 * The asynchronous job pool is exhausted. Try again later.
+	 */
+    case SSL_ERROR_WANT_ASYNC_JOB:
+	if (state->ssl_last_err == SSL_ERROR_WANT_READ
+	    || state->ssl_last_err == SSL_ERROR_WANT_WRITE)
+	    event_disable_readwrite(ciphertext_fd);
+	state->async_event = tlsp_async_event;
+	event_request_timer(tlsp_async_event, (void *) state, 1);
+	state->ssl_last_err = SSL_ERROR_WANT_ASYNC_JOB;
+	event_request_timer(tlsp_ciphertext_event, (void *) state,
+			    state->timeout);
+	return (TLSP_STAT_OK);
+#endif
+
 	/*
 	 * Some error. Self-destruct. This automagically cleans up all
 	 * pending read/write and timeout event requests, making state a
@@ -783,7 +897,7 @@ static int tlsp_post_handshake(TLSP_STATE *state)
      */
     state->plaintext_buf =
 	nbbio_create(vstream_fileno(state->plaintext_stream),
-		     VSTREAM_BUFSIZE, state->server_id,
+		     TLSP_PLAINTEXT_BUFSIZE, state->server_id,
 		     tlsp_plaintext_event,
 		     (void *) state);
     return (TLSP_STAT_OK);
@@ -908,20 +1022,50 @@ static void tlsp_strategy(TLSP_STATE *state)
 	 * is no "read" equivalent of the SSL_R_BAD_WRITE_RETRY,
 	 * SSL_MODE_ENABLE_PARTIAL_WRITE or
 	 * SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER features.
+	 * 
+	 * Do not call SSL_read() while an SSL_write() job is paused: OpenSSL
+	 * would resume that job and report its result as the SSL_read()
+	 * result.
 	 */
+#ifdef SSL_MODE_ASYNC
+#define TLSP_ASYNC_PAUSED(err) \
+	((err) == SSL_ERROR_WANT_ASYNC || (err) == SSL_ERROR_WANT_ASYNC_JOB)
+#else
+#define TLSP_ASYNC_PAUSED(err) 0
+#endif
+#define TLSP_CAN_WRITE_NOW(buf) \
+	(NBBIO_WRITE_PEND(buf) > 0 && !NBBIO_ERROR_FLAGS(buf) \
+	 && (NBBIO_ACTIVE_FLAGS(buf) & NBBIO_FLAG_WRITE) == 0)
+
 	ssl_read_err = SSL_ERROR_NONE;
-	while (NBBIO_WRITE_PEND(state->plaintext_buf) < NBBIO_BUFSIZE(plaintext_buf)) {
-	    ERR_clear_error();
-	    ssl_stat = SSL_read(tls_context->con,
-				NBBIO_WRITE_BUF(plaintext_buf)
-				+ NBBIO_WRITE_PEND(state->plaintext_buf),
-				NBBIO_BUFSIZE(plaintext_buf)
-				- NBBIO_WRITE_PEND(state->plaintext_buf));
-	    ssl_read_err = SSL_get_error(tls_context->con, ssl_stat);
-	    if (ssl_read_err != SSL_ERROR_NONE)
-		break;
-	    NBBIO_WRITE_PEND(plaintext_buf) += ssl_stat;
-	}
+	do {
+	    while (!TLSP_ASYNC_PAUSED(ssl_write_err)
+		   && NBBIO_WRITE_PEND(state->plaintext_buf) < NBBIO_BUFSIZE(plaintext_buf)) {
+		ERR_clear_error();
+		ssl_stat = SSL_read(tls_context->con,
+				    NBBIO_WRITE_BUF(plaintext_buf)
+				    + NBBIO_WRITE_PEND(state->plaintext_buf),
+				    NBBIO_BUFSIZE(plaintext_buf)
+				    - NBBIO_WRITE_PEND(state->plaintext_buf));
+		ssl_read_err = SSL_get_error(tls_context->con, ssl_stat);
+		if (ssl_read_err != SSL_ERROR_NONE)
+		    break;
+		NBBIO_WRITE_PEND(plaintext_buf) += ssl_stat;
+	    }
+
+	    /*
+	     * Hand off the plaintext to the client right away, instead of
+	     * waiting for a plaintext write event. This saves an event loop
+	     * iteration and several event (de)registration system calls per
+	     * SMTP reply or TLS record. If the plaintext write buffer was
+	     * full, read more from the TLS engine, because a ciphertext read
+	     * event may never happen for data that is already buffered
+	     * there. If the client is not ready, wait for a write event.
+	     */
+	} while (TLSP_CAN_WRITE_NOW(plaintext_buf)
+		 && nbbio_write_now(plaintext_buf) > 0
+		 && ssl_read_err == SSL_ERROR_NONE
+		 && !TLSP_ASYNC_PAUSED(ssl_write_err));
 
 	/*
 	 * Try to enable/disable ciphertext read/write events. If SSL_write()
@@ -965,12 +1109,8 @@ static void tlsp_strategy(TLSP_STATE *state)
      * deal with it.
      */
     if (NBBIO_WRITE_PEND(plaintext_buf) > 0) {
-	if (NBBIO_ACTIVE_FLAGS(plaintext_buf) & NBBIO_FLAG_READ)
-	    nbbio_disable_readwrite(plaintext_buf);
 	nbbio_enable_write(plaintext_buf, state->timeout);
     } else if (NBBIO_READ_PEND(plaintext_buf) < NBBIO_BUFSIZE(plaintext_buf)) {
-	if (NBBIO_ACTIVE_FLAGS(plaintext_buf) & NBBIO_FLAG_WRITE)
-	    nbbio_disable_readwrite(plaintext_buf);
 	nbbio_enable_read(plaintext_buf, state->timeout);
     } else {
 	if (NBBIO_ACTIVE_FLAGS(plaintext_buf))
@@ -1224,6 +1364,27 @@ static void tlsp_log_config_diff(const char *server_cfg, const char *client_cfg)
     myfree(saved_server);
 }
 
+/* tlsp_set_async_mode - optionally enable OpenSSL asynchronous mode */
+
+static void tlsp_set_async_mode(SSL_CTX *ssl_ctx)
+{
+
+    /*
+     * With an asynchronous crypto engine (configured in the OpenSSL
+     * configuration file), a handshake or record operation may return
+     * SSL_ERROR_WANT_ASYNC instead of blocking this event-driven process.
+     * Without such an engine, asynchronous mode only adds overhead.
+     */
+    if (var_tlsp_tls_async) {
+#ifdef SSL_MODE_ASYNC
+	SSL_CTX_set_mode(ssl_ctx, SSL_MODE_ASYNC);
+#else
+	msg_warn("%s is not supported with this OpenSSL version",
+		 VAR_TLSP_TLS_ASYNC);
+#endif
+    }
+}
+
 /* tlsp_client_init - initialize a TLS client engine */
 
 static TLS_APPL_STATE *tlsp_client_init(TLS_CLIENT_PARAMS *tls_params,
@@ -1345,6 +1506,7 @@ static TLS_APPL_STATE *tlsp_client_init(TLS_CLIENT_PARAMS *tls_params,
 	SSL_CTX_set_mode(appl_state->ssl_ctx,
 			 SSL_MODE_ENABLE_PARTIAL_WRITE
 			 | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	tlsp_set_async_mode(appl_state->ssl_ctx);
     }
     vstring_free(init_buf);
     vstring_free(param_buf);
@@ -1657,10 +1819,12 @@ static void pre_jail_init_server(void)
      * but is not supported by documentation. If this code stops working then
      * no-one can be held responsible.
      */
-    if (tlsp_server_ctx)
+    if (tlsp_server_ctx) {
 	SSL_CTX_set_mode(tlsp_server_ctx->ssl_ctx,
 			 SSL_MODE_ENABLE_PARTIAL_WRITE
 			 | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	tlsp_set_async_mode(tlsp_server_ctx->ssl_ctx);
+    }
 }
 
 /* pre_jail_init_client - pre-jail initialization */
@@ -1822,6 +1986,10 @@ int     main(int argc, char **argv)
 	VAR_SMTP_TLS_SCERT_VD, DEF_SMTP_TLS_SCERT_VD, &var_smtp_tls_scert_vd, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_TLSP_CLIENT_LIMIT, DEF_TLSP_CLIENT_LIMIT, &var_tlsp_client_limit, 0, 0,
+	0,
+    };
     static const CONFIG_NINT_TABLE nint_table[] = {
 	VAR_TLSP_TLS_CCERT_VD, DEF_TLSP_TLS_CCERT_VD, &var_tlsp_tls_ccert_vd, 0, 0,
 	VAR_TLSP_CLNT_SCERT_VD, DEF_TLSP_CLNT_SCERT_VD, &var_tlsp_clnt_scert_vd, 0, 0,
@@ -1831,6 +1999,10 @@ int     main(int argc, char **argv)
 	VAR_TLSP_WATCHDOG, DEF_TLSP_WATCHDOG, &var_tlsp_watchdog, 10, 0,
 	0,
     };
+    static const CONFIG_BOOL_TABLE bool_table[] = {
+	VAR_TLSP_TLS_ASYNC, DEF_TLSP_TLS_ASYNC, &var_tlsp_tls_async,
+	0,
+    };
     static const CONFIG_BOOL_TABLE compat_bool_table[] = {
 	VAR_SMTPD_USE_TLS, DEF_SMTPD_USE_TLS, &var_smtpd_use_tls,
 	VAR_SMTPD_ENFORCE_TLS, DEF_SMTPD_ENFORCE_TLS, &var_smtpd_enforce_tls,
@@ -1941,16 +2113,19 @@ int     main(int argc, char **argv)
      */
     event_server_main(argc, argv, tlsp_service,
 		      CA_MAIL_SERVER_INT_TABLE(compat_int_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
 		      CA_MAIL_SERVER_NINT_TABLE(nint_table),
 		      CA_MAIL_SERVER_STR_TABLE(compat_str_table),
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
 		      CA_MAIL_SERVER_BOOL_TABLE(compat_bool_table),
+		      CA_MAIL_SERVER_BOOL_TABLE(bool_table),
 		      CA_MAIL_SERVER_NBOOL_TABLE(nbool_table),
 		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		      CA_MAIL_SERVER_SLOW_EXIT(tlsp_drain),
 		      CA_MAIL_SERVER_RETIRE_ME,
 		      CA_MAIL_SERVER_WATCHDOG(&var_tlsp_watchdog),
+		      CA_MAIL_SERVER_CLIENT_LIMIT(&var_tlsp_client_limit),
 		      CA_MAIL_SERVER_UNLIMITED,
 		      0);
 }
@@ -39,6 +39,8 @@ typedef struct {
     TLS_APPL_STATE *appl_state;		/* libtls state */
     TLS_SESS_STATE *tls_context;	/* libtls state */
     int     ssl_last_err;		/* TLS I/O state */
+    int     async_fd;			/* OpenSSL async job wait fd */
+    EVENT_NOTIFY_FN async_event;	/* kludge */
     TLS_CLIENT_PARAMS *tls_params;	/* globals not part of init_props */
     TLS_SERVER_INIT_PROPS *server_init_props;
     TLS_SERVER_START_PROPS *server_start_props;
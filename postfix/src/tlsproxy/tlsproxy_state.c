@@ -42,6 +42,12 @@
 /*	and close the file handle.
 /* .IP ciphertext_timer
 /*	The destructor will automatically turn off this time event.
+/* .IP async_fd
+/*	The wait file descriptor of a paused OpenSSL asynchronous job.
+/*	The destructor will automatically turn off read events. The
+/*	file descriptor is owned by OpenSSL.
+/* .IP async_event
+/*	The destructor will automatically turn off this time event.
 /* .IP timeout
 /*	Time limit for plaintext and ciphertext I/O.
 /* .IP remote_endpt
@@ -111,10 +117,13 @@ TLSP_STATE *tlsp_state_create(const char *service,
     state->plaintext_buf = 0;
     state->ciphertext_fd = -1;
     state->ciphertext_timer = 0;
+    state->async_fd = -1;
+    state->async_event = 0;
     state->timeout = -1;
     state->remote_endpt = 0;
     state->server_id = 0;
     state->tls_context = 0;
+    state->ssl_last_err = SSL_ERROR_NONE;
     state->tls_params = 0;
     state->server_init_props = 0;
     state->server_start_props = 0;
@@ -145,6 +154,10 @@ void    tlsp_state_free(TLSP_STATE *state)
     }
     if (state->ciphertext_timer)
 	event_cancel_timer(state->ciphertext_timer, (void *) state);
+    if (state->async_fd >= 0)
+	event_disable_readwrite(state->async_fd);
+    if (state->async_event)
+	event_cancel_timer(state->async_event, (void *) state);
     if (state->remote_endpt) {
 	msg_info("DISCONNECT %s", state->remote_endpt);
 	myfree(state->remote_endpt);
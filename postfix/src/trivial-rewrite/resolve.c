@@ -8,12 +8,19 @@
 /*
 /*	void	resolve_init(void)
 /*
+/*	void	resolve_cache_init(context)
+/*	RES_CONTEXT *context;
+/*
 /*	int	resolve_class(domain)
 /*	const char *domain;
 /*
 /*	void	resolve_proto(context, stream)
 /*	RES_CONTEXT *context;
 /*	VSTREAM	*stream;
+/*
+/*	void	resolve_batch_proto(context, stream)
+/*	RES_CONTEXT *context;
+/*	VSTREAM	*stream;
 /* DESCRIPTION
 /*	This module implements the trivial address resolving engine.
 /*	It distinguishes between local and remote mail, and optionally
@@ -24,12 +31,31 @@
 /*	to this module. It should be called once before using the
 /*	actual resolver routines.
 /*
+/*	resolve_cache_init() enables the resolve result cache for
+/*	the specified resolver personality. Results are cached for
+/*	$resolve_cache_time seconds. Results that involve a table
+/*	lookup error are not cached. This also enables a cache,
+/*	shared by all personalities, for the address class of each
+/*	recipient domain (local, virtual alias, virtual mailbox,
+/*	relay), so that an address that is not in the result cache
+/*	still skips the domain list lookups for a known domain.
+/*	Both caches are discarded when a lookup table is replaced
+/*	with dict_replace(3), and along with the process after a
+/*	"postfix reload".
+/*
 /*	resolve_class() returns the address class for the specified
 /*	domain, or -1 in case of error.
 /*
 /*	resolve_proto() implements the client-server protocol:
 /*	read one address in FQDN form, reply with a (transport,
 /*	nexthop, internalized recipient) triple.
+/*
+/*	resolve_batch_proto() implements the batched protocol
+/*	variant: read one sender and a list of addresses, then
+/*	send one reply per address in request order, with a single
+/*	flush at the end. All addresses are read before the first
+/*	reply is sent, so that a client that writes the whole batch
+/*	before it reads the replies cannot deadlock.
 /* STANDARDS
 /* DIAGNOSTICS
 /*	Problems and transactions are logged to \fBsyslogd\fR(8)
@@ -72,6 +98,9 @@
 #include <valid_utf8_hostname.h>
 #include <stringops.h>
 #include <mymalloc.h>
+#include <argv.h>
+#include <ctable.h>
+#include <events.h>
 
 /* Global library. */
 
@@ -87,6 +116,7 @@
 #include <maps.h>
 #include <mail_addr_find.h>
 #include <valid_mailhost_addr.h>
+#include <resolve_clnt.h>
 
 /* Application-specific. */
 
@@ -145,6 +175,99 @@ static STRING_LIST *virt_mailbox_doms;
 
 static MAPS *relocated_maps;
 
+ /*
+  * The optional domain class cache remembers, for each domain, the result
+  * of resolve_local() and of the domain list matches. A domain list match
+  * result is 1 (found), 0 (not found) or -1 (lookup error). An entry that
+  * contains an error expires immediately.
+  */
+#define RES_DOM_LOCAL	0		/* resolve_local() */
+#define RES_DOM_ALIAS	1		/* virtual_alias_domains */
+#define RES_DOM_MAILBOX	2		/* virtual_mailbox_domains */
+#define RES_DOM_RELAY	3		/* relay_domains */
+#define RES_DOM_COUNT	4
+
+typedef struct {
+    int     match[RES_DOM_COUNT];	/* see above */
+    time_t  expires;			/* zero if uncacheable */
+} RES_DOMAIN_ENTRY;
+
+static struct ctable *domain_cache;
+static int domain_cache_gen;		/* dict_replace_count snapshot */
+
+/* resolve_domain_list - search one domain list */
+
+static int resolve_domain_list(int which, const char *domain)
+{
+    STRING_LIST *list;
+
+    switch (which) {
+    case RES_DOM_LOCAL:
+	return (resolve_local(domain));
+    case RES_DOM_ALIAS:
+	list = virt_alias_doms;
+	break;
+    case RES_DOM_MAILBOX:
+	list = virt_mailbox_doms;
+	break;
+    case RES_DOM_RELAY:
+	list = relay_domains;
+	break;
+    default:
+	msg_panic("resolve_domain_list: bad list selector: %d", which);
+    }
+    if (list == 0)
+	return (0);
+    if (string_list_match(list, domain))
+	return (1);
+    return (list->error ? -1 : 0);
+}
+
+/* resolve_domain_create - classify domain after cache miss */
+
+static void *resolve_domain_create(const char *domain, void *unused_context)
+{
+    RES_DOMAIN_ENTRY *dp;
+    int     which;
+
+    dp = (RES_DOMAIN_ENTRY *) mymalloc(sizeof(*dp));
+    dp->expires = event_time() + var_resolve_cache_time;
+    for (which = 0; which < RES_DOM_COUNT; which++)
+	if ((dp->match[which] = resolve_domain_list(which, domain)) < 0)
+	    dp->expires = 0;
+    return ((void *) dp);
+}
+
+/* resolve_domain_delete - destroy domain class cache entry */
+
+static void resolve_domain_delete(void *value, void *unused_context)
+{
+    myfree(value);
+}
+
+/* resolve_domain_match - search domain list, with optional cache */
+
+static int resolve_domain_match(int which, const char *domain)
+{
+    const RES_DOMAIN_ENTRY *dp;
+    int     was_cached;
+
+    if (domain_cache == 0)
+	return (resolve_domain_list(which, domain));
+    if (domain_cache_gen != dict_replace_count) {
+	ctable_free(domain_cache);
+	domain_cache = ctable_create(var_resolve_cache_size,
+				     resolve_domain_create,
+				     resolve_domain_delete, (void *) 0);
+	domain_cache_gen = dict_replace_count;
+    }
+    was_cached = ctable_exists(domain_cache, domain);
+    dp = (const RES_DOMAIN_ENTRY *) ctable_locate(domain_cache, domain);
+    if (was_cached && dp->expires <= event_time())
+	dp = (const RES_DOMAIN_ENTRY *) ctable_refresh(domain_cache, domain);
+    return (dp->match[which]);
+}
+
 /* resolve_class - determine domain address class */
 
 int     resolve_class(const char *domain)
@@ -154,26 +277,14 @@ int     resolve_class(const char *domain)
     /*
      * Same order as in resolve_addr().
      */
-    if ((ret = resolve_local(domain)) != 0)
+    if ((ret = resolve_domain_match(RES_DOM_LOCAL, domain)) != 0)
 	return (ret > 0 ? RESOLVE_CLASS_LOCAL : -1);
-    if (virt_alias_doms) {
-	if (string_list_match(virt_alias_doms, domain))
-	    return (RESOLVE_CLASS_ALIAS);
-	if (virt_alias_doms->error)
-	    return (-1);
-    }
-    if (virt_mailbox_doms) {
-	if (string_list_match(virt_mailbox_doms, domain))
-	    return (RESOLVE_CLASS_VIRTUAL);
-	if (virt_mailbox_doms->error)
-	    return (-1);
-    }
-    if (relay_domains) {
-	if (string_list_match(relay_domains, domain))
-	    return (RESOLVE_CLASS_RELAY);
-	if (relay_domains->error)
-	    return (-1);
-    }
+    if ((ret = resolve_domain_match(RES_DOM_ALIAS, domain)) != 0)
+	return (ret > 0 ? RESOLVE_CLASS_ALIAS : -1);
+    if ((ret = resolve_domain_match(RES_DOM_MAILBOX, domain)) != 0)
+	return (ret > 0 ? RESOLVE_CLASS_VIRTUAL : -1);
+    if ((ret = resolve_domain_match(RES_DOM_RELAY, domain)) != 0)
+	return (ret > 0 ? RESOLVE_CLASS_RELAY : -1);
     return (RESOLVE_CLASS_DEFAULT);
 }
 
@@ -259,7 +370,8 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
      * under "make resolve_clnt_test" in the global directory.
      */
 #define RESOLVE_LOCAL(domain) \
-    resolve_local(STR(tok822_internalize(addr_buf, domain, TOK822_STR_DEFL)))
+    resolve_domain_match(RES_DOM_LOCAL, \
+		STR(tok822_internalize(addr_buf, domain, TOK822_STR_DEFL)))
 
     for (loop_count = 0, loop_max = addr_len + 100; /* void */ ; loop_count++) {
 
@@ -435,7 +547,7 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 	    vstring_insert(nextrcpt, rcpt_domain - STR(nextrcpt), "[", 1);
 	    vstring_strcat(nextrcpt, "]");
 	    rcpt_domain = strrchr(STR(nextrcpt), '@') + 1;
-	    if ((rc = resolve_local(rcpt_domain)) > 0)	/* XXX */
+	    if ((rc = resolve_domain_match(RES_DOM_LOCAL, rcpt_domain)) > 0)
 		domain = 0;
 	    else if (rc < 0) {
 		*flags |= RESOLVE_FLAG_FAIL;
@@ -490,16 +602,13 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 	/*
 	 * Virtual alias domain.
 	 */
-	if (virt_alias_doms
-	    && string_list_match(virt_alias_doms, rcpt_domain)) {
+	if ((rc = resolve_domain_match(RES_DOM_ALIAS, rcpt_domain)) > 0) {
 	    if (var_helpful_warnings) {
-		if (virt_mailbox_doms
-		    && string_list_match(virt_mailbox_doms, rcpt_domain))
+		if (resolve_domain_match(RES_DOM_MAILBOX, rcpt_domain) > 0)
 		    msg_warn("do not list domain %s in BOTH %s and %s",
 			     rcpt_domain, VAR_VIRT_ALIAS_DOMS,
 			     VAR_VIRT_MAILBOX_DOMS);
-		if (relay_domains
-		    && domain_list_match(relay_domains, rcpt_domain))
+		if (resolve_domain_match(RES_DOM_RELAY, rcpt_domain) > 0)
 		    msg_warn("do not list domain %s in BOTH %s and %s",
 			     rcpt_domain, VAR_VIRT_ALIAS_DOMS,
 			     VAR_RELAY_DOMAINS);
@@ -514,7 +623,7 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 			    var_show_unk_rcpt_table ?
 			    " in virtual alias table" : "");
 	    *flags |= RESOLVE_CLASS_ALIAS;
-	} else if (virt_alias_doms && virt_alias_doms->error != 0) {
+	} else if (rc < 0) {
 	    msg_warn("%s lookup failure", VAR_VIRT_ALIAS_DOMS);
 	    *flags |= RESOLVE_FLAG_FAIL;
 	    FREE_MEMORY_AND_RETURN;
@@ -523,11 +632,10 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 	/*
 	 * Virtual mailbox domain.
 	 */
-	else if (virt_mailbox_doms
-		 && string_list_match(virt_mailbox_doms, rcpt_domain)) {
+	else if ((rc = resolve_domain_match(RES_DOM_MAILBOX,
+					    rcpt_domain)) > 0) {
 	    if (var_helpful_warnings) {
-		if (relay_domains
-		    && domain_list_match(relay_domains, rcpt_domain))
+		if (resolve_domain_match(RES_DOM_RELAY, rcpt_domain) > 0)
 		    msg_warn("do not list domain %s in BOTH %s and %s",
 			     rcpt_domain, VAR_VIRT_MAILBOX_DOMS,
 			     VAR_RELAY_DOMAINS);
@@ -536,7 +644,7 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 	    vstring_strcpy(nexthop, rcpt_domain);
 	    blame = rp->virt_transport_name;
 	    *flags |= RESOLVE_CLASS_VIRTUAL;
-	} else if (virt_mailbox_doms && virt_mailbox_doms->error != 0) {
+	} else if (rc < 0) {
 	    msg_warn("%s lookup failure", VAR_VIRT_MAILBOX_DOMS);
 	    *flags |= RESOLVE_FLAG_FAIL;
 	    FREE_MEMORY_AND_RETURN;
@@ -545,12 +653,11 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
 	    /*
 	     * Off-host relay destination.
 	     */
-	    if (relay_domains
-		&& domain_list_match(relay_domains, rcpt_domain)) {
+	    if ((rc = resolve_domain_match(RES_DOM_RELAY, rcpt_domain)) > 0) {
 		vstring_strcpy(channel, RES_PARAM_VALUE(rp->relay_transport));
 		blame = rp->relay_transport_name;
 		*flags |= RESOLVE_CLASS_RELAY;
-	    } else if (relay_domains && relay_domains->error != 0) {
+	    } else if (rc < 0) {
 		msg_warn("%s lookup failure", VAR_RELAY_DOMAINS);
 		*flags |= RESOLVE_FLAG_FAIL;
 		FREE_MEMORY_AND_RETURN;
@@ -626,12 +733,10 @@ static void resolve_addr(RES_CONTEXT *rp, char *sender, char *addr,
      */
     else {
 	if (var_helpful_warnings) {
-	    if (virt_alias_doms
-		&& string_list_match(virt_alias_doms, rcpt_domain))
+	    if (resolve_domain_match(RES_DOM_ALIAS, rcpt_domain) > 0)
 		msg_warn("do not list domain %s in BOTH %s and %s",
 			 rcpt_domain, VAR_MYDEST, VAR_VIRT_ALIAS_DOMS);
-	    if (virt_mailbox_doms
-		&& string_list_match(virt_mailbox_doms, rcpt_domain))
+	    if (resolve_domain_match(RES_DOM_MAILBOX, rcpt_domain) > 0)
 		msg_warn("do not list domain %s in BOTH %s and %s",
 			 rcpt_domain, VAR_MYDEST, VAR_VIRT_MAILBOX_DOMS);
 	}
@@ -758,6 +863,115 @@ static VSTRING *nexthop;
 static VSTRING *nextrcpt;
 static VSTRING *query;
 static VSTRING *sender;
+static ARGV *queries;
+static VSTRING *cache_key;
+
+ /*
+  * The resolve result cache is indexed by the sender length, sender, and
+  * address, so that the key is unambiguous. The sender is included only if
+  * the result can depend on it.
+  */
+typedef struct {
+    VSTRING *channel;			/* transport */
+    VSTRING *nexthop;			/* next-hop destination */
+    VSTRING *nextrcpt;			/* recipient */
+    int     flags;			/* see resolve_clnt.h */
+    time_t  expires;			/* zero if uncacheable */
+} RES_CACHE_ENTRY;
+
+#define RES_CACHE_SENDER(rp, sender) \
+	(((rp)->snd_def_xp_info || (rp)->snd_relay_info) ? (sender) : "")
+
+/* resolve_cache_create - resolve address after cache miss */
+
+static void *resolve_cache_create(const char *key, void *context)
+{
+    RES_CONTEXT *rp = (RES_CONTEXT *) context;
+    RES_CACHE_ENTRY *ep;
+    VSTRING *key_sender;
+    VSTRING *key_addr;
+    char   *cp;
+    long    len;
+
+    len = strtol(key, &cp, 10);
+    if (*cp != ':' || len < 0 || (size_t) len > strlen(cp + 1))
+	msg_panic("resolve_cache_create: bad cache key: %s", key);
+    key_sender = vstring_strncpy(vstring_alloc(100), cp + 1, len);
+    key_addr = vstring_strcpy(vstring_alloc(100), cp + 1 + len);
+
+    ep = (RES_CACHE_ENTRY *) mymalloc(sizeof(*ep));
+    ep->channel = vstring_alloc(10);
+    ep->nexthop = vstring_alloc(10);
+    ep->nextrcpt = vstring_alloc(10);
+    resolve_addr(rp, STR(key_sender), STR(key_addr),
+		 ep->channel, ep->nexthop, ep->nextrcpt, &ep->flags);
+    ep->expires = (ep->flags & RESOLVE_FLAG_FAIL) ? 0 :
+	event_time() + var_resolve_cache_time;
+    vstring_free(key_sender);
+    vstring_free(key_addr);
+    return ((void *) ep);
+}
+
+/* resolve_cache_delete - destroy resolve cache entry */
+
+static void resolve_cache_delete(void *value, void *unused_context)
+{
+    RES_CACHE_ENTRY *ep = (RES_CACHE_ENTRY *) value;
+
+    vstring_free(ep->channel);
+    vstring_free(ep->nexthop);
+    vstring_free(ep->nextrcpt);
+    myfree((void *) ep);
+}
+
+/* resolve_cache_init - enable resolve result cache */
+
+void    resolve_cache_init(RES_CONTEXT *rp)
+{
+    if (cache_key == 0)
+	cache_key = vstring_alloc(100);
+    if (rp->cache)
+	ctable_free(rp->cache);
+    rp->cache = ctable_create(var_resolve_cache_size, resolve_cache_create,
+			      resolve_cache_delete, (void *) rp);
+    rp->cache_gen = dict_replace_count;
+    if (domain_cache == 0) {
+	domain_cache = ctable_create(var_resolve_cache_size,
+				     resolve_domain_create,
+				     resolve_domain_delete, (void *) 0);
+	domain_cache_gen = dict_replace_count;
+    }
+}
+
+/* resolve_cached - resolve address, with optional result cache */
+
+static void resolve_cached(RES_CONTEXT *rp, char *sender, char *addr,
+			           VSTRING *channel, VSTRING *nexthop,
+			           VSTRING *nextrcpt, int *flags)
+{
+    const RES_CACHE_ENTRY *ep;
+    const char *key_sender;
+    int     was_cached;
+
+    if (rp->cache == 0) {
+	resolve_addr(rp, sender, addr, channel, nexthop, nextrcpt, flags);
+	return;
+    }
+    if (rp->cache_gen != dict_replace_count)
+	resolve_cache_init(rp);
+    key_sender = RES_CACHE_SENDER(rp, sender);
+    vstring_sprintf(cache_key, "%ld:%s%s",
+		    (long) strlen(key_sender), key_sender, addr);
+    was_cached = ctable_exists(rp->cache, STR(cache_key));
+    ep = (const RES_CACHE_ENTRY *) ctable_locate(rp->cache, STR(cache_key));
+    if (was_cached && ep->expires <= event_time())
+	ep = (const RES_CACHE_ENTRY *) ctable_refresh(rp->cache,
+						      STR(cache_key));
+    vstring_strcpy(channel, STR(ep->channel));
+    vstring_strcpy(nexthop, STR(ep->nexthop));
+    vstring_strcpy(nextrcpt, STR(ep->nextrcpt));
+    *flags = ep->flags;
+}
 
 /* resolve_proto - read request and send reply */
 
@@ -771,8 +985,8 @@ int     resolve_proto(RES_CONTEXT *context, VSTREAM *stream)
 		  ATTR_TYPE_END) != 2)
 	return (-1);
 
-    resolve_addr(context, STR(sender), STR(query),
-		 channel, nexthop, nextrcpt, &flags);
+    resolve_cached(context, STR(sender), STR(query),
+		   channel, nexthop, nextrcpt, &flags);
 
     if (msg_verbose)
 	msg_info("`%s' -> `%s' -> (`%s' `%s' `%s' `%d')",
@@ -794,6 +1008,62 @@ int     resolve_proto(RES_CONTEXT *context, VSTREAM *stream)
     return (0);
 }
 
+/* resolve_batch_proto - read batched request and send replies */
+
+int     resolve_batch_proto(RES_CONTEXT *context, VSTREAM *stream)
+{
+    int     count;
+    int     flags;
+    char  **cpp;
+
+    if (attr_scan(stream, ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_SENDER, sender),
+		  RECV_ATTR_INT(MAIL_ATTR_ADDR_COUNT, &count),
+		  ATTR_TYPE_END) != 2)
+	return (-1);
+    if (count <= 0 || count > RESOLVE_BATCH_LIMIT) {
+	msg_warn("bad resolver batch size: %d", count);
+	return (-1);
+    }
+
+    /*
+     * Read the entire batch first. The client sends all addresses before
+     * it reads any reply.
+     */
+    argv_truncate(queries, 0);
+    while (count-- > 0) {
+	if (attr_scan(stream, ATTR_FLAG_STRICT,
+		      RECV_ATTR_STR(MAIL_ATTR_ADDR, query),
+		      ATTR_TYPE_END) != 1)
+	    return (-1);
+	argv_add(queries, STR(query), ARGV_END);
+    }
+
+    for (cpp = queries->argv; *cpp; cpp++) {
+	resolve_cached(context, STR(sender), *cpp,
+		       channel, nexthop, nextrcpt, &flags);
+
+	if (msg_verbose)
+	    msg_info("`%s' -> `%s' -> (`%s' `%s' `%s' `%d')",
+		     STR(sender), *cpp, STR(channel),
+		     STR(nexthop), STR(nextrcpt), flags);
+
+	attr_print(stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, server_flags),
+		   SEND_ATTR_STR(MAIL_ATTR_TRANSPORT, STR(channel)),
+		   SEND_ATTR_STR(MAIL_ATTR_NEXTHOP, STR(nexthop)),
+		   SEND_ATTR_STR(MAIL_ATTR_RECIP, STR(nextrcpt)),
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, flags),
+		   ATTR_TYPE_END);
+    }
+
+    if (vstream_fflush(stream) != 0) {
+	msg_warn("write resolver reply: %m");
+	return (-1);
+    }
+    return (0);
+}
+
 /* resolve_init - module initializations */
 
 void    resolve_init(void)
@@ -803,6 +1073,7 @@ void    resolve_init(void)
     channel = vstring_alloc(100);
     nexthop = vstring_alloc(100);
     nextrcpt = vstring_alloc(100);
+    queries = argv_alloc(RESOLVE_BATCH_LIMIT);
 
     if (*var_virt_alias_doms)
 	virt_alias_doms =
@@ -114,8 +114,9 @@ void    rewrite_tree(RWR_CONTEXT *context, TOK822 *tree)
 
     /*
      * XXX If you change this module, quote_822_local.c, or tok822_parse.c,
-     * be sure to re-run the tests under "make rewrite_clnt_test" and "make
-     * resolve_clnt_test" in the global directory.
+     * update the rewrite_proto() fast path if needed, and be sure to re-run
+     * the tests under "make rewrite_clnt_test" and "make resolve_clnt_test"
+     * in the global directory.
      */
 
     /*
@@ -267,6 +268,16 @@ int     rewrite_proto(VSTREAM *stream)
 	vstring_strcpy(result, vstring_str(address));
     }
 
+    /*
+     * Fast path: rewrite_tree() does not change a plain local-part@domain
+     * address whose domain contains a dot, and the token list would
+     * externalize to the same string.
+     */
+    else if (tok822_simple_addr(vstring_str(address), VSTRING_LEN(address))
+	     && strchr(strrchr(vstring_str(address), '@'), '.') != 0) {
+	vstring_strcpy(result, vstring_str(address));
+    }
+
     /*
      * Convert the address from externalized (quoted) form to token list,
      * rewrite it, and convert back.
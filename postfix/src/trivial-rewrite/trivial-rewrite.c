@@ -259,6 +259,22 @@
 /*	Available in Postfix 3.3 and later:
 /* .IP "\fBservice_name (read-only)\fR"
 /*	The master.cf service name of a Postfix daemon process.
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBresolve_cache_time (0s)\fR"
+/*	The amount of time that a \fBtrivial-rewrite\fR(8) process
+/*	caches an address resolver result; specify zero to disable
+/*	the cache.
+/* .IP "\fBresolve_cache_size_limit (10000)\fR"
+/*	The maximal number of address resolver results that a
+/*	\fBtrivial-rewrite\fR(8) process caches per resolver personality.
+/* .IP "\fBtrivial_rewrite_client_limit (0)\fR"
+/*	The maximal number of clients that a \fBtrivial-rewrite\fR(8)
+/*	process will serve before the \fBmaster\fR(8) daemon starts
+/*	another \fBtrivial-rewrite\fR(8) process.
+/* .IP "\fBreopen_changed_tables (no)\fR"
+/*	Reopen a changed read-only lookup table in the running
+/*	process, instead of terminating the process.
 /* SEE ALSO
 /*	postconf(5), configuration parameters
 /*	transport(5), transport table format
@@ -358,6 +374,9 @@ char   *var_remote_rwr_domain;
 char   *var_snd_relay_maps;
 char   *var_null_relay_maps_key;
 char   *var_null_def_xport_maps_key;
+int     var_resolve_cache_time;
+int     var_resolve_cache_size;
+int     var_rewrite_client_limit;
 int     var_resolve_num_dom;
 bool    var_allow_min_user;
 
@@ -474,7 +493,9 @@ static void rewrite_service(VSTREAM *stream, char *unused_service, char **argv)
      */
 #ifdef DETACH_AND_ASK_CLIENTS_TO_RECONNECT
     if (server_flags == 0 && (now = event_time()) - last > 10) {
-	if ((table = dict_changed_name()) != 0) {
+	if ((table = dict_changed_name()) != 0
+	    && (var_reopen_tables == 0
+		|| (table = dict_reload_changed()) != 0)) {
 	    msg_info("table %s has changed -- restarting", table);
 	    if (multi_server_drain() == 0)
 		server_flags = 1;
@@ -497,6 +518,10 @@ static void rewrite_service(VSTREAM *stream, char *unused_service, char **argv)
 	    status = resolve_proto(&resolve_regular, stream);
 	} else if (strcmp(vstring_str(command), RESOLVE_VERIFY) == 0) {
 	    status = resolve_proto(&resolve_verify, stream);
+	} else if (strcmp(vstring_str(command), RESOLVE_REGULAR_BATCH) == 0) {
+	    status = resolve_batch_proto(&resolve_regular, stream);
+	} else if (strcmp(vstring_str(command), RESOLVE_VERIFY_BATCH) == 0) {
+	    status = resolve_batch_proto(&resolve_verify, stream);
 	} else {
 	    msg_warn("bad command %.30s", printable(vstring_str(command), '?'));
 	}
@@ -513,7 +538,8 @@ static void pre_accept(char *unused_name, char **unused_argv)
 {
     const char *table;
 
-    if ((table = dict_changed_name()) != 0) {
+    if ((table = dict_changed_name()) != 0
+	&& (var_reopen_tables == 0 || (table = dict_reload_changed()) != 0)) {
 	msg_info("table %s has changed -- restarting", table);
 	exit(0);
     }
@@ -540,7 +566,8 @@ static void check_table_stats(int unused_event, void *unused_context)
 {
     const char *table;
 
-    if ((table = dict_changed_name()) != 0) {
+    if ((table = dict_changed_name()) != 0
+	&& (var_reopen_tables == 0 || (table = dict_reload_changed()) != 0)) {
 	msg_info("table %s has changed -- restarting", table);
 	exit(0);
     }
@@ -596,6 +623,10 @@ static void post_jail_init(char *unused_name, char **unused_argv)
 	transport_post_init(resolve_regular.transport_info);
     if (resolve_verify.transport_info)
 	transport_post_init(resolve_verify.transport_info);
+    if (var_resolve_cache_time > 0) {
+	resolve_cache_init(&resolve_regular);
+	resolve_cache_init(&resolve_verify);
+    }
     check_table_stats(0, (void *) 0);
 }
 
@@ -647,6 +678,15 @@ int     main(int argc, char **argv)
 	VAR_APP_DOT_MYDOMAIN, DEF_APP_DOT_MYDOMAIN, &var_append_dot_mydomain,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_RESOLVE_CACHE_SIZE, DEF_RESOLVE_CACHE_SIZE, &var_resolve_cache_size, 1, 0,
+	VAR_REWRITE_CLIENT_LIMIT, DEF_REWRITE_CLIENT_LIMIT, &var_rewrite_client_limit, 0, 0,
+	0,
+    };
+    static const CONFIG_TIME_TABLE time_table[] = {
+	VAR_RESOLVE_CACHE_TIME, DEF_RESOLVE_CACHE_TIME, &var_resolve_cache_time, 0, 0,
+	0,
+    };
 
     /*
      * Fingerprint executables and core dumps.
@@ -657,11 +697,14 @@ int     main(int argc, char **argv)
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
 		      CA_MAIL_SERVER_BOOL_TABLE(bool_table),
 		      CA_MAIL_SERVER_NBOOL_TABLE(nbool_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
+		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
 #ifdef CHECK_TABLE_STATS_BEFORE_ACCEPT
 		      CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
 #endif
 		      CA_MAIL_SERVER_POST_ACCEPT(post_accept),
+		      CA_MAIL_SERVER_CLIENT_LIMIT(&var_rewrite_client_limit),
 		      0);
 }
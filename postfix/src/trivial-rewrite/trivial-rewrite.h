@@ -67,12 +67,16 @@ typedef struct {
     const char *transport_maps_name;	/* name of variable */
     char  **transport_maps;		/* maptype:mapname */
     struct TRANSPORT_INFO *transport_info;	/* handle */
+    struct ctable *cache;		/* resolve result cache */
+    int     cache_gen;			/* dict_replace_count snapshot */
 } RES_CONTEXT;
 
 #define RES_PARAM_VALUE(x) (*(x))	/* make it easy to do it right */
 
 extern void resolve_init(void);
+extern void resolve_cache_init(RES_CONTEXT *);
 extern int resolve_proto(RES_CONTEXT *, VSTREAM *);
+extern int resolve_batch_proto(RES_CONTEXT *, VSTREAM *);
 extern int resolve_class(const char *);
 
 /* LICENSE
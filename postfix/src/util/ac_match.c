@@ -0,0 +1,542 @@
+/*++
+/* NAME
+/*	ac_match 3
+/* SUMMARY
+/*	multi-string search
+/* SYNOPSIS
+/*	#include <ac_match.h>
+/*
+/*	AC_MATCH *ac_match_create()
+/*
+/*	int	ac_match_add(ac, literal, len)
+/*	AC_MATCH *ac;
+/*	const char *literal;
+/*	ssize_t	len;
+/*
+/*	void	ac_match_compile(ac)
+/*	AC_MATCH *ac;
+/*
+/*	void	ac_match_scan(ac, string, len)
+/*	AC_MATCH *ac;
+/*	const char *string;
+/*	ssize_t	len;
+/*
+/*	int	ac_match_found(ac, id)
+/*	AC_MATCH *ac;
+/*	int	id;
+/*
+/*	int	ac_match_next(ac, id)
+/*	AC_MATCH *ac;
+/*	int	id;
+/*
+/*	int	ac_match_count(ac)
+/*	AC_MATCH *ac;
+/*
+/*	void	ac_match_free(ac)
+/*	AC_MATCH *ac;
+/* DESCRIPTION
+/*	This module finds out which of a (large) set of literal
+/*	strings occur in a string, with one pass over that string.
+/*	The time to scan a string does not depend on the number of
+/*	literal strings. Matching is case-insensitive for ASCII
+/*	letters. The implementation is an Aho-Corasick automaton,
+/*	with transitions for all characters that appear in a literal
+/*	string.
+/*
+/*	ac_match_create() creates an empty set of literal strings.
+/*
+/*	ac_match_add() adds a literal string with the specified
+/*	length, and returns an identifier for use with ac_match_found().
+/*	Identifiers are assigned sequentially, starting at zero.
+/*	The literal must not be empty.
+/*
+/*	ac_match_compile() builds the automaton. After this, no
+/*	more literal strings can be added.
+/*
+/*	ac_match_scan() searches the specified string for all literal
+/*	strings.
+/*
+/*	ac_match_found() returns non-zero when the literal string
+/*	with the specified identifier was found by the last
+/*	ac_match_scan() call.
+/*
+/*	ac_match_next() returns the smallest identifier greater than
+/*	or equal to \fIid\fR of a literal string that was found by
+/*	the last ac_match_scan() call, or -1 when there is none. The
+/*	time does not depend on the number of literal strings that
+/*	were not found.
+/*
+/*	ac_match_count() returns the number of literal strings.
+/*
+/*	ac_match_free() destroys the specified set of literal strings.
+/* DIAGNOSTICS
+/*	Panic: interface violations. Fatal error: out of memory.
+/* SEE ALSO
+/*	A. V. Aho, M. J. Corasick, Efficient string matching: an aid
+/*	to bibliographic search, Communications of the ACM 18(6),
+/*	June 1975.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <stringops.h>
+#include <ac_match.h>
+
+ /*
+  * The automaton. All characters that do not appear in a literal string
+  * share character class 0, so that the transition table has one row per
+  * state, and one column per character class.
+  * 
+  * After a transition to state s, the literals that end at the current input
+  * position are found by following the chain output[s], link[output[s]],
+  * and so on, until -1. output[s] is s itself when a literal ends in s,
+  * otherwise it is the nearest such state on the failure path of s.
+  */
+struct AC_MATCH {
+    /* Literal strings, until compiled. */
+    char  **lit;			/* literal strings */
+    ssize_t *lit_len;			/* literal lengths */
+    int     lit_count;			/* number of literals */
+    int     lit_size;			/* allocated literals */
+    /* The compiled automaton. */
+    int    *lit_state;			/* final state per literal */
+    unsigned char class[256];		/* character to class */
+    int     class_count;		/* number of classes */
+    int    *delta;			/* state x class -> state */
+    int    *output;			/* first final state or -1 */
+    int    *link;			/* next final state or -1 */
+    int     state_count;		/* number of states */
+    int    *state_lit;			/* first literal per final state */
+    int    *lit_next;			/* next literal, same final state */
+    /* Scan results. */
+    unsigned *seen;			/* per-state scan generation */
+    unsigned generation;		/* current scan generation */
+    int    *hit;			/* final states seen in this scan */
+    int     hit_count;			/* number of final states seen */
+    int    *found;			/* sorted literals, or null */
+    int     found_count;		/* number of literals found */
+    int     found_valid;		/* found[] is up-to-date */
+};
+
+#define AC_MATCH_COMPILED(ac)	((ac)->delta != 0)
+
+#define DELTA(ac, s, c) ((ac)->delta[(s) * (ac)->class_count + (c)])
+
+/* ac_match_create - create empty literal set */
+
+AC_MATCH *ac_match_create(void)
+{
+    AC_MATCH *ac = (AC_MATCH *) mymalloc(sizeof(*ac));
+
+    ac->lit_size = 10;
+    ac->lit = (char **) mymalloc(ac->lit_size * sizeof(*ac->lit));
+    ac->lit_len = (ssize_t *) mymalloc(ac->lit_size * sizeof(*ac->lit_len));
+    ac->lit_count = 0;
+    ac->lit_state = 0;
+    ac->class_count = 0;
+    ac->delta = 0;
+    ac->output = 0;
+    ac->link = 0;
+    ac->state_count = 0;
+    ac->state_lit = 0;
+    ac->lit_next = 0;
+    ac->seen = 0;
+    ac->generation = 0;
+    ac->hit = 0;
+    ac->hit_count = 0;
+    ac->found = 0;
+    ac->found_count = 0;
+    ac->found_valid = 0;
+    return (ac);
+}
+
+/* ac_match_add - add one literal string */
+
+int     ac_match_add(AC_MATCH *ac, const char *literal, ssize_t len)
+{
+    const char *myname = "ac_match_add";
+    char   *cp;
+    char   *end;
+
+    if (AC_MATCH_COMPILED(ac))
+	msg_panic("%s: automaton is already compiled", myname);
+    if (len <= 0)
+	msg_panic("%s: bad literal length: %ld", myname, (long) len);
+    if (ac->lit_count >= ac->lit_size) {
+	ac->lit_size *= 2;
+	ac->lit = (char **)
+	    myrealloc((void *) ac->lit, ac->lit_size * sizeof(*ac->lit));
+	ac->lit_len = (ssize_t *)
+	    myrealloc((void *) ac->lit_len, ac->lit_size * sizeof(*ac->lit_len));
+    }
+    ac->lit[ac->lit_count] = cp = mymemdup(literal, len);
+    for (end = cp + len; cp < end; cp++)
+	*cp = TOLOWER(*cp);
+    ac->lit_len[ac->lit_count] = len;
+    return (ac->lit_count++);
+}
+
+/* ac_match_compile - build automaton */
+
+void    ac_match_compile(AC_MATCH *ac)
+{
+    const char *myname = "ac_match_compile";
+    int    *failure;
+    int    *queue;
+    int     head;
+    int     tail;
+    int     max_states;
+    int     state;
+    int     next;
+    int     fail;
+    int     n;
+    int     c;
+    ssize_t i;
+
+    if (AC_MATCH_COMPILED(ac))
+	msg_panic("%s: automaton is already compiled", myname);
+
+    /*
+     * Assign character classes. Upper-case and lower-case ASCII letters
+     * share a class, so that scanning does not need to fold case.
+     */
+    memset(ac->class, 0, sizeof(ac->class));
+    ac->class_count = 1;
+    for (max_states = 1, n = 0; n < ac->lit_count; n++) {
+	max_states += ac->lit_len[n];
+	for (i = 0; i < ac->lit_len[n]; i++) {
+	    c = (unsigned char) ac->lit[n][i];
+	    if (ac->class[c] == 0) {
+		ac->class[c] = ac->class_count;
+		ac->class[TOUPPER(c)] = ac->class_count;
+		ac->class_count++;
+	    }
+	}
+    }
+
+    /*
+     * Build the trie. Remember the final state for each literal.
+     */
+    ac->delta = (int *)
+	mymalloc(max_states * ac->class_count * sizeof(*ac->delta));
+    for (n = 0; n < max_states * ac->class_count; n++)
+	ac->delta[n] = -1;
+    ac->output = (int *) mymalloc(max_states * sizeof(*ac->output));
+    for (n = 0; n < max_states; n++)
+	ac->output[n] = -1;
+    ac->lit_state = (int *)
+	mymalloc((ac->lit_count > 0 ? ac->lit_count : 1) * sizeof(int));
+    ac->state_count = 1;
+    for (n = 0; n < ac->lit_count; n++) {
+	for (state = 0, i = 0; i < ac->lit_len[n]; i++) {
+	    c = ac->class[(unsigned char) ac->lit[n][i]];
+	    if ((next = DELTA(ac, state, c)) < 0)
+		next = DELTA(ac, state, c) = ac->state_count++;
+	    state = next;
+	}
+	ac->output[state] = state;
+	ac->lit_state[n] = state;
+	myfree(ac->lit[n]);
+    }
+    myfree((void *) ac->lit);
+    ac->lit = 0;
+    myfree((void *) ac->lit_len);
+    ac->lit_len = 0;
+    ac->delta = (int *) myrealloc((void *) ac->delta, ac->state_count
+				  * ac->class_count * sizeof(*ac->delta));
+    ac->output = (int *) myrealloc((void *) ac->output,
+				   ac->state_count * sizeof(*ac->output));
+
+    /*
+     * Breadth first, compute the failure transitions and fold them into the
+     * transition table. A state's failure state is at a smaller depth, and
+     * therefore its row is complete when it is needed.
+     */
+    ac->link = (int *) mymalloc(ac->state_count * sizeof(*ac->link));
+    failure = (int *) mymalloc(ac->state_count * sizeof(*failure));
+    queue = (int *) mymalloc(ac->state_count * sizeof(*queue));
+    head = tail = 0;
+    ac->link[0] = -1;
+    for (c = 0; c < ac->class_count; c++) {
+	if ((next = DELTA(ac, 0, c)) < 0) {
+	    DELTA(ac, 0, c) = 0;
+	} else {
+	    failure[next] = 0;
+	    queue[tail++] = next;
+	}
+    }
+    while (head < tail) {
+	state = queue[head++];
+	fail = failure[state];
+	ac->link[state] = ac->output[fail];
+	if (ac->output[state] < 0)
+	    ac->output[state] = ac->output[fail];
+	for (c = 0; c < ac->class_count; c++) {
+	    if ((next = DELTA(ac, state, c)) < 0) {
+		DELTA(ac, state, c) = DELTA(ac, fail, c);
+	    } else {
+		failure[next] = DELTA(ac, fail, c);
+		queue[tail++] = next;
+	    }
+	}
+    }
+    myfree((void *) failure);
+    myfree((void *) queue);
+
+    /*
+     * The literals that end in each final state, in increasing order. A
+     * state has more than one literal when a literal is added more than once.
+     */
+    ac->state_lit = (int *) mymalloc(ac->state_count * sizeof(*ac->state_lit));
+    for (n = 0; n < ac->state_count; n++)
+	ac->state_lit[n] = -1;
+    ac->lit_next = (int *)
+	mymalloc((ac->lit_count > 0 ? ac->lit_count : 1) * sizeof(int));
+    for (n = ac->lit_count - 1; n >= 0; n--) {
+	ac->lit_next[n] = ac->state_lit[ac->lit_state[n]];
+	ac->state_lit[ac->lit_state[n]] = n;
+    }
+
+    /*
+     * Scan results.
+     */
+    ac->seen = (unsigned *) mymalloc(ac->state_count * sizeof(*ac->seen));
+    memset((void *) ac->seen, 0, ac->state_count * sizeof(*ac->seen));
+    ac->generation = 0;
+    ac->hit = (int *) mymalloc(ac->state_count * sizeof(*ac->hit));
+    ac->hit_count = 0;
+    ac->found = (int *)
+	mymalloc((ac->lit_count > 0 ? ac->lit_count : 1) * sizeof(int));
+    ac->found_count = 0;
+    ac->found_valid = 0;
+}
+
+/* ac_match_scan - find all literals in string */
+
+void    ac_match_scan(AC_MATCH *ac, const char *string, ssize_t len)
+{
+    const unsigned char *cp = (const unsigned char *) string;
+    const unsigned char *end = cp + len;
+    int     state;
+    int     hit;
+
+    if (!AC_MATCH_COMPILED(ac))
+	msg_panic("ac_match_scan: automaton is not compiled");
+
+    /*
+     * Avoid clearing the results of the previous scan.
+     */
+    if (++ac->generation == 0) {
+	memset((void *) ac->seen, 0, ac->state_count * sizeof(*ac->seen));
+	ac->generation = 1;
+    }
+    ac->hit_count = 0;
+    ac->found_valid = 0;
+
+    /*
+     * When a final state was already seen in this scan, so were the final
+     * states that follow it in the output chain.
+     */
+    for (state = 0; cp < end; cp++) {
+	state = DELTA(ac, state, ac->class[*cp]);
+	for (hit = ac->output[state];
+	     hit >= 0 && ac->seen[hit] != ac->generation;
+	     hit = ac->link[hit]) {
+	    ac->seen[hit] = ac->generation;
+	    ac->hit[ac->hit_count++] = hit;
+	}
+    }
+}
+
+/* ac_match_found - was literal found by last scan */
+
+int     ac_match_found(AC_MATCH *ac, int id)
+{
+    if (!AC_MATCH_COMPILED(ac) || id < 0 || id >= ac->lit_count)
+	msg_panic("ac_match_found: bad request for literal %d", id);
+    return (ac->generation != 0
+	    && ac->seen[ac->lit_state[id]] == ac->generation);
+}
+
+/* ac_match_int_cmp - qsort callback */
+
+static int ac_match_int_cmp(const void *a, const void *b)
+{
+    return (*(const int *) a - *(const int *) b);
+}
+
+/* ac_match_next - find next literal found by last scan */
+
+int     ac_match_next(AC_MATCH *ac, int id)
+{
+    int     lo;
+    int     hi;
+    int     mid;
+    int     n;
+    int     lit;
+
+    if (!AC_MATCH_COMPILED(ac) || id < 0 || id >= ac->lit_count)
+	msg_panic("ac_match_next: bad request for literal %d", id);
+
+    /*
+     * Sort the literals found by the last scan, once per scan.
+     */
+    if (ac->found_valid == 0) {
+	for (ac->found_count = 0, n = 0; n < ac->hit_count; n++)
+	    for (lit = ac->state_lit[ac->hit[n]]; lit >= 0; lit = ac->lit_next[lit])
+		ac->found[ac->found_count++] = lit;
+	if (ac->found_count > 1)
+	    qsort((void *) ac->found, ac->found_count, sizeof(*ac->found),
+		  ac_match_int_cmp);
+	ac->found_valid = 1;
+    }
+
+    /*
+     * Binary search for the first literal >= id.
+     */
+    for (lo = 0, hi = ac->found_count; lo < hi; /* void */ ) {
+	mid = (lo + hi) / 2;
+	if (ac->found[mid] < id)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (lo < ac->found_count ? ac->found[lo] : -1);
+}
+
+/* ac_match_count - number of literals */
+
+int     ac_match_count(AC_MATCH *ac)
+{
+    return (ac->lit_count);
+}
+
+/* ac_match_free - destroy literal set */
+
+void    ac_match_free(AC_MATCH *ac)
+{
+    int     n;
+
+    if (ac->lit) {
+	for (n = 0; n < ac->lit_count; n++)
+	    myfree(ac->lit[n]);
+	myfree((void *) ac->lit);
+    }
+    if (ac->lit_len)
+	myfree((void *) ac->lit_len);
+    if (ac->lit_state)
+	myfree((void *) ac->lit_state);
+    if (ac->delta)
+	myfree((void *) ac->delta);
+    if (ac->output)
+	myfree((void *) ac->output);
+    if (ac->link)
+	myfree((void *) ac->link);
+    if (ac->state_lit)
+	myfree((void *) ac->state_lit);
+    if (ac->lit_next)
+	myfree((void *) ac->lit_next);
+    if (ac->seen)
+	myfree((void *) ac->seen);
+    if (ac->hit)
+	myfree((void *) ac->hit);
+    if (ac->found)
+	myfree((void *) ac->found);
+    myfree((void *) ac);
+}
+
+#ifdef TEST
+
+ /*
+  * Compare the results of ac_match_scan() with a brute-force search, for
+  * pseudo-random literals and strings over a small alphabet, so that there
+  * are many overlapping and repeated matches.
+  */
+#include <msg_vstream.h>
+
+#define TEST_LITERALS	60
+#define TEST_STRINGS	2000
+
+static int brute_force(const char *lit, const char *str)
+{
+    const char *cp;
+    size_t  len = strlen(lit);
+
+    for (cp = str; strlen(cp) >= len; cp++)
+	if (strncasecmp(cp, lit, len) == 0)
+	    return (1);
+    return (0);
+}
+
+static void random_string(char *buf, int len, const char *alphabet)
+{
+    int     n;
+
+    for (n = 0; n < len; n++)
+	buf[n] = alphabet[rand() % strlen(alphabet)];
+    buf[len] = 0;
+}
+
+int     main(int argc, char **argv)
+{
+    char    lit[TEST_LITERALS][8];
+    char    str[40];
+    AC_MATCH *ac;
+    int     n;
+    int     k;
+    int     next;
+    int     fail = 0;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    srand(1);
+    ac = ac_match_create();
+    for (n = 0; n < TEST_LITERALS; n++) {
+	random_string(lit[n], 1 + rand() % 5, "abcA");
+	if (ac_match_add(ac, lit[n], strlen(lit[n])) != n)
+	    msg_fatal("ac_match_add: unexpected literal id");
+    }
+    ac_match_compile(ac);
+    if (ac_match_count(ac) != TEST_LITERALS)
+	msg_fatal("ac_match_count: unexpected literal count");
+    for (k = 0; k < TEST_STRINGS; k++) {
+	random_string(str, rand() % (sizeof(str) - 1), "aAbcd");
+	ac_match_scan(ac, str, strlen(str));
+	for (next = -1, n = TEST_LITERALS - 1; n >= 0; n--) {
+	    if (brute_force(lit[n], str))
+		next = n;
+	    if (ac_match_next(ac, n) != next) {
+		msg_warn("string \"%s\": next literal from %d: want %d, got %d",
+			 str, n, next, ac_match_next(ac, n));
+		fail++;
+	    }
+	}
+	for (n = 0; n < TEST_LITERALS; n++) {
+	    if (ac_match_found(ac, n) != brute_force(lit[n], str)) {
+		msg_warn("literal \"%s\" string \"%s\": want %d, got %d",
+			 lit[n], str, brute_force(lit[n], str),
+			 ac_match_found(ac, n));
+		fail++;
+	    }
+	}
+    }
+    ac_match_free(ac);
+    if (fail)
+	msg_fatal("%d failures", fail);
+    msg_info("PASS: %d strings, %d literals", TEST_STRINGS, TEST_LITERALS);
+    exit(0);
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _AC_MATCH_H_INCLUDED_
+#define _AC_MATCH_H_INCLUDED_
+
+/*++
+/* NAME
+/*	ac_match 3h
+/* SUMMARY
+/*	multi-string search
+/* SYNOPSIS
+/*	#include <ac_match.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * System library.
+  */
+#include <sys/types.h>
+
+ /*
+  * External interface.
+  */
+typedef struct AC_MATCH AC_MATCH;
+
+extern AC_MATCH *ac_match_create(void);
+extern int ac_match_add(AC_MATCH *, const char *, ssize_t);
+extern void ac_match_compile(AC_MATCH *);
+extern void ac_match_scan(AC_MATCH *, const char *, ssize_t);
+extern int ac_match_found(AC_MATCH *, int);
+extern int ac_match_next(AC_MATCH *, int);
+extern int ac_match_count(AC_MATCH *);
+extern void ac_match_free(AC_MATCH *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
@@ -12,9 +12,17 @@
 /*	int	allascii_len(buffer, len)
 /*	const char *buffer;
 /*	ssize_t	len;
+/*
+/*	ssize_t	allascii_span(buffer, len)
+/*	const char *buffer;
+/*	ssize_t	len;
 /* DESCRIPTION
 /*	allascii() determines if its argument is an all-ASCII string.
 /*
+/*	allascii_span() returns the length of the initial segment
+/*	of its argument that contains only non-null ASCII characters.
+/*	It examines one machine word at a time.
+/*
 /*	Arguments:
 /* .IP buffer
 /*	The null-terminated input string.
@@ -46,20 +54,51 @@
 
 #include "stringops.h"
 
-/* allascii_len - return true if string is all ASCII */
 
-int     allascii_len(const char *string, ssize_t len)
+ /*
+  * Word-at-a-time tests: a word contains a non-ASCII byte when a high bit is
+  * set, and it contains a null byte when subtracting one from each byte
+  * borrows into a high bit that was clear.
+  */
+#define ASCII_WORD_ONES		(~(unsigned long) 0 / 0xff)
+#define ASCII_WORD_HIGH		(ASCII_WORD_ONES * 0x80)
+#define ASCII_WORD_OK(w) \
+	((((w) & ASCII_WORD_HIGH) | (((w) - ASCII_WORD_ONES) & ~(w) \
+	  & ASCII_WORD_HIGH)) == 0)
+
+/* allascii_span - length of initial non-null ASCII segment */
+
+ssize_t allascii_span(const char *string, ssize_t len)
 {
     const char *cp;
+    const char *end;
+    unsigned long word;
     int     ch;
 
+    if (len < 0)
+	len = strlen(string);
+    end = string + len;
+    for (cp = string; end - cp >= (ssize_t) sizeof(word); cp += sizeof(word)) {
+	memcpy((void *) &word, cp, sizeof(word));
+	if (!ASCII_WORD_OK(word))
+	    break;
+    }
+    for ( /* void */ ; cp < end && (ch = *(unsigned char *) cp) != 0; cp++)
+	if (!ISASCII(ch))
+	    break;
+    return (cp - string);
+}
+
+/* allascii_len - return true if string is all ASCII */
+
+int     allascii_len(const char *string, ssize_t len)
+{
+    ssize_t span;
+
     if (len < 0)
 	len = strlen(string);
     if (len == 0)
 	return (0);
-    for (cp = string; cp < string + len
-	 && (ch = *(unsigned char *) cp) != 0; cp++)
-	if (!ISASCII(ch))
-	    return (0);
-    return (1);
+    span = allascii_span(string, len);
+    return (span == len || string[span] == 0);
 }
@@ -158,6 +158,29 @@ extern int attr_scan_more_plain(VSTREAM *);
 extern int WARN_UNUSED_RESULT attr_scan_plain(VSTREAM *, int,...);
 extern int WARN_UNUSED_RESULT attr_vscan_plain(VSTREAM *, int, va_list);
 
+ /*
+  * attr_print_bin.c.
+  */
+extern int attr_print_bin(VSTREAM *, int,...);
+extern int attr_vprint_bin(VSTREAM *, int, va_list);
+extern int attr_print_bin_mark(VSTREAM *);
+
+ /*
+  * attr_scan_bin.c.
+  */
+extern int WARN_UNUSED_RESULT attr_scan_bin(VSTREAM *, int,...);
+extern int WARN_UNUSED_RESULT attr_vscan_bin(VSTREAM *, int, va_list);
+extern int WARN_UNUSED_RESULT attr_scan_more_bin(VSTREAM *);
+extern int WARN_UNUSED_RESULT attr_scan_bin_mark(VSTREAM *);
+
+ /*
+  * Marker that precedes a binary request. An attr_scan0() or
+  * attr_scan_plain() receiver rejects this as an unexpected attribute
+  * name, instead of waiting for more input.
+  */
+#define ATTR_BIN_MARK		"\377\0\n"
+#define ATTR_BIN_MARK_LEN	(sizeof(ATTR_BIN_MARK) - 1)
+
  /*
   * Attribute names for testing the compatibility of the read and write
   * routines.
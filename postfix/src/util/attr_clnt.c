@@ -69,6 +69,15 @@
 /* .IP "ATTR_CLNT_CTL_HANDSHAKE(VSTREAM *)"
 /*      A pointer to function that will be called at the start of a
 /*      new connection, and that returns 0 in case of success.
+/* .IP "ATTR_CLNT_CTL_BINARY(int)"
+/*	When non-zero, send requests and receive replies with
+/*	attr_print_bin(3) and attr_scan_bin(3), instead of the
+/*	functions specified with ATTR_CLNT_CTL_PROTO. If the server
+/*	disconnects after it receives the first binary request on
+/*	a connection, the client assumes that the server does not
+/*	support the binary format, and uses the ATTR_CLNT_CTL_PROTO
+/*	functions until it makes a new connection. Other errors are
+/*	handled as with the text format.
 /* DIAGNOSTICS
 /*	Warnings: communication failure.
 /* SEE ALSO
@@ -120,8 +129,23 @@ struct ATTR_CLNT {
     int     req_count;
     int     try_limit;
     int     try_delay;
+    int     bin_wanted;			/* ATTR_CLNT_CTL_BINARY */
+    int     bin_state;			/* see below */
+    int     bin_conn;			/* connection that bin_state is for */
+    int     bin_fallbacks;		/* fallbacks to the text format */
 };
 
+#define ATTR_CLNT_BIN_OFF	0	/* use text protocol */
+#define ATTR_CLNT_BIN_TRY	1	/* binary, not yet confirmed */
+#define ATTR_CLNT_BIN_ON	2	/* binary, server supports it */
+
+ /*
+  * The server may be upgraded or downgraded at any time, so bin_state is
+  * about one connection only. A server that does not support the binary
+  * format disconnects, so the text format is used for the next connection,
+  * and the binary format is tried again with the connection after that.
+  */
+
 #define ATTR_CLNT_DEF_REQ_LIMIT	(0)	/* default per-session request limit */
 #define ATTR_CLNT_DEF_TRY_LIMIT	(2)	/* default request (re)try limit */
 #define ATTR_CLNT_DEF_TRY_DELAY	(1)	/* default request (re)try delay */
@@ -149,6 +173,10 @@ ATTR_CLNT *attr_clnt_create(const char *service, int timeout,
     client->req_count = 0;
     client->try_limit = ATTR_CLNT_DEF_TRY_LIMIT;
     client->try_delay = ATTR_CLNT_DEF_TRY_DELAY;
+    client->bin_wanted = 0;
+    client->bin_state = ATTR_CLNT_BIN_OFF;
+    client->bin_conn = 0;
+    client->bin_fallbacks = 0;
     return (client);
 }
 
@@ -165,6 +193,8 @@ int     attr_clnt_request(ATTR_CLNT *client, int send_flags,...)
     int     recv_flags;
     int     err;
     int     ret;
+    int     use_bin;
+    int     mismatch;
 
     /*
      * XXX If the stream is readable before we send anything, then assume the
@@ -186,12 +216,24 @@ int     attr_clnt_request(ATTR_CLNT *client, int send_flags,...)
     va_start(saved_ap, send_flags);
     for (;;) {
 	errno = 0;
+	mismatch = 0;
 	if ((stream = auto_clnt_access(client->auto_clnt)) != 0
-	    && readable(vstream_fileno(stream)) == 0) {
+	    && client->bin_wanted
+	    && client->bin_conn != auto_clnt_conn_count(client->auto_clnt)) {
+	    client->bin_state = ATTR_CLNT_BIN_TRY;
+	    client->bin_conn = auto_clnt_conn_count(client->auto_clnt);
+	}
+	if (stream != 0 && readable(vstream_fileno(stream)) == 0) {
 	    errno = 0;
+	    use_bin = (client->bin_state != ATTR_CLNT_BIN_OFF);
 	    VA_COPY(ap, saved_ap);
-	    err = (client->print(stream, send_flags, ap) != 0
-		   || vstream_fflush(stream) != 0);
+	    if (use_bin)
+		err = (attr_print_bin_mark(stream) != 0
+		       || attr_vprint_bin(stream, send_flags, ap) != 0
+		       || vstream_fflush(stream) != 0);
+	    else
+		err = (client->print(stream, send_flags, ap) != 0
+		       || vstream_fflush(stream) != 0);
 	    va_end(ap);
 	    if (err == 0) {
 		VA_COPY(ap, saved_ap);
@@ -218,10 +260,17 @@ int     attr_clnt_request(ATTR_CLNT *client, int send_flags,...)
 		    }
 		}
 		recv_flags = va_arg(ap, int);
-		ret = client->scan(stream, recv_flags, ap);
+		if (use_bin)
+		    ret = attr_vscan_bin(stream, recv_flags, ap);
+		else
+		    ret = client->scan(stream, recv_flags, ap);
 		va_end(ap);
+		mismatch = (ret == 0 && client->bin_state == ATTR_CLNT_BIN_TRY
+			    && vstream_feof(stream) && !vstream_ftimeout(stream));
 		/* Finalize argument lists before returning. */
 		if (ret > 0) {
+		    if (use_bin)
+			client->bin_state = ATTR_CLNT_BIN_ON;
 		    if (client->req_limit > 0
 			&& (client->req_count += 1) >= client->req_limit) {
 			auto_clnt_recover(client->auto_clnt);
@@ -231,6 +280,22 @@ int     attr_clnt_request(ATTR_CLNT *client, int send_flags,...)
 		}
 	    }
 	}
+
+	/*
+	 * An older server drops the connection after it receives the binary
+	 * request marker. Use the text protocol for the next connection, and
+	 * try again without delay.
+	 */
+	if (mismatch) {
+	    if (client->bin_fallbacks++ == 0 || msg_verbose)
+		msg_info("server %s does not support binary attributes"
+			 " -- using text", auto_clnt_name(client->auto_clnt));
+	    client->bin_state = ATTR_CLNT_BIN_OFF;
+	    auto_clnt_recover(client->auto_clnt);
+	    client->bin_conn = auto_clnt_conn_count(client->auto_clnt) + 1;
+	    client->req_count = 0;
+	    continue;
+	}
 	if ((++count >= client->try_limit && client->try_limit > 0)
 	    || msg_verbose
 	    || (errno && errno != EPIPE && errno != ENOENT && errno != ECONNRESET))
@@ -269,6 +334,11 @@ void    attr_clnt_control(ATTR_CLNT *client, int name,...)
 			      va_arg(ap, ATTR_CLNT_HANDSHAKE_FN),
 			      AUTO_CLNT_CTL_END);
 	    break;
+	case ATTR_CLNT_CTL_BINARY:
+	    client->bin_wanted = (va_arg(ap, int) != 0);
+	    client->bin_state = ATTR_CLNT_BIN_OFF;
+	    client->bin_conn = 0;
+	    break;
 	case ATTR_CLNT_CTL_REQ_LIMIT:
 	    client->req_limit = va_arg(ap, int);
 	    if (client->req_limit < 0)
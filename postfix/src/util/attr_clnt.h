@@ -40,6 +40,7 @@ extern void attr_clnt_control(ATTR_CLNT *, int,...);
 #define ATTR_CLNT_CTL_TRY_LIMIT	3	/* attempts per request */
 #define ATTR_CLNT_CTL_TRY_DELAY	4	/* pause between requests */
 #define ATTR_CLNT_CTL_HANDSHAKE	5	/* handshake before first request */
+#define ATTR_CLNT_CTL_BINARY	6	/* binary attribute format */
 
 /* LICENSE
 /* .ad
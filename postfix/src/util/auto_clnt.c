@@ -23,6 +23,9 @@
 /*	const char *auto_clnt_name(auto_clnt)
 /*	AUTO_CLNT *auto_clnt;
 /*
+/*	int	auto_clnt_conn_count(auto_clnt)
+/*	AUTO_CLNT *auto_clnt;
+/*
 /*	void	auto_clnt_free(auto_clnt)
 /*	AUTO_CLNT *auto_clnt;
 /*
@@ -51,6 +54,11 @@
 /*
 /*	auto_clnt_name() returns the name of the specified client endpoint.
 /*
+/*	auto_clnt_conn_count() returns the number of connections that
+/*	were made for the specified client endpoint. A change in this
+/*	value tells the caller that auto_clnt_access() returned a new
+/*	connection.
+/*
 /*	auto_clnt_free() destroys of the specified client endpoint.
 /*
 /*	auto_clnt_control() allows the user to fine tune the behavior of
@@ -145,6 +153,7 @@ struct AUTO_CLNT {
     int     max_idle;			/* time before client disconnect */
     int     max_ttl;			/* time before client disconnect */
     AUTO_CLNT_HANDSHAKE_FN handshake;	/* new connection only */
+    int     conn_count;			/* connections made */
     int     (*connect) (const char *, int, int);	/* unix, local, inet */
 };
 
@@ -215,6 +224,7 @@ static void auto_clnt_open(AUTO_CLNT *auto_clnt)
 	if (msg_verbose)
 	    msg_info("%s: connected to %s", myname, auto_clnt->endpoint);
 	auto_clnt->vstream = vstream_fdopen(fd, O_RDWR);
+	auto_clnt->conn_count += 1;
 	vstream_control(auto_clnt->vstream,
 			CA_VSTREAM_CTL_PATH(auto_clnt->endpoint),
 			CA_VSTREAM_CTL_TIMEOUT(auto_clnt->timeout),
@@ -321,6 +331,7 @@ AUTO_CLNT *auto_clnt_create(const char *service, int timeout,
     auto_clnt->max_idle = max_idle;
     auto_clnt->max_ttl = max_ttl;
     auto_clnt->handshake = 0;
+    auto_clnt->conn_count = 0;
     if (strcmp(transport, "inet") == 0) {
 	auto_clnt->connect = inet_connect;
     } else if (strcmp(transport, "local") == 0) {
@@ -342,6 +353,13 @@ const char *auto_clnt_name(AUTO_CLNT *auto_clnt)
     return (auto_clnt->endpoint);
 }
 
+/* auto_clnt_conn_count - return number of connections made */
+
+int     auto_clnt_conn_count(AUTO_CLNT *auto_clnt)
+{
+    return (auto_clnt->conn_count);
+}
+
 /* auto_clnt_free - destroy client stream instance */
 
 void    auto_clnt_free(AUTO_CLNT *auto_clnt)
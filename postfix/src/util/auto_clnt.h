@@ -26,6 +26,7 @@ extern AUTO_CLNT *auto_clnt_create(const char *, int, int, int);
 extern VSTREAM *auto_clnt_access(AUTO_CLNT *);
 extern void auto_clnt_recover(AUTO_CLNT *);
 extern const char *auto_clnt_name(AUTO_CLNT *);
+extern int auto_clnt_conn_count(AUTO_CLNT *);
 extern void auto_clnt_free(AUTO_CLNT *);
 extern void auto_clnt_control(AUTO_CLNT *, int,...);
 
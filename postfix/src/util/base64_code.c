@@ -96,32 +96,37 @@ VSTRING *base64_encode_opt(VSTRING *result, const char *in, ssize_t len,
 			           int flags)
 {
     const unsigned char *cp;
+    unsigned char *out;
     ssize_t count;
 
     /*
-     * Encode 3 -> 4.
+     * Encode 3 -> 4. Reserve space for the entire result, so that the inner
+     * loop needs no buffer checks.
      */
     if ((flags & BASE64_FLAG_APPEND) == 0)
 	VSTRING_RESET(result);
-    for (cp = UNSIG_CHAR_PTR(in), count = len; count > 0; count -= 3, cp += 3) {
-	VSTRING_ADDCH(result, to_b64[cp[0] >> 2]);
+    VSTRING_SPACE(result, (len + 2) / 3 * 4);
+    out = UNSIG_CHAR_PTR(vstring_end(result));
+    for (cp = UNSIG_CHAR_PTR(in), count = len; count > 2; count -= 3, cp += 3) {
+	out[0] = to_b64[cp[0] >> 2];
+	out[1] = to_b64[(cp[0] & 0x3) << 4 | cp[1] >> 4];
+	out[2] = to_b64[(cp[1] & 0xf) << 2 | cp[2] >> 6];
+	out[3] = to_b64[cp[2] & 0x3f];
+	out += 4;
+    }
+    if (count > 0) {
+	out[0] = to_b64[cp[0] >> 2];
 	if (count > 1) {
-	    VSTRING_ADDCH(result, to_b64[(cp[0] & 0x3) << 4 | cp[1] >> 4]);
-	    if (count > 2) {
-		VSTRING_ADDCH(result, to_b64[(cp[1] & 0xf) << 2 | cp[2] >> 6]);
-		VSTRING_ADDCH(result, to_b64[cp[2] & 0x3f]);
-	    } else {
-		VSTRING_ADDCH(result, to_b64[(cp[1] & 0xf) << 2]);
-		VSTRING_ADDCH(result, '=');
-		break;
-	    }
+	    out[1] = to_b64[(cp[0] & 0x3) << 4 | cp[1] >> 4];
+	    out[2] = to_b64[(cp[1] & 0xf) << 2];
 	} else {
-	    VSTRING_ADDCH(result, to_b64[(cp[0] & 0x3) << 4]);
-	    VSTRING_ADDCH(result, '=');
-	    VSTRING_ADDCH(result, '=');
-	    break;
+	    out[1] = to_b64[(cp[0] & 0x3) << 4];
+	    out[2] = '=';
 	}
+	out[3] = '=';
+	out += 4;
     }
+    vstring_set_payload_size(result, (char *) out - vstring_str(result));
     VSTRING_TERMINATE(result);
     return (result);
 }
@@ -142,6 +147,7 @@ VSTRING *base64_decode_opt(VSTRING *result, const char *in, ssize_t len,
 {
     static unsigned char *un_b64 = 0;
     const unsigned char *cp;
+    unsigned char *out;
     ssize_t count;
     unsigned int ch0;
     unsigned int ch1;
@@ -168,26 +174,41 @@ VSTRING *base64_decode_opt(VSTRING *result, const char *in, ssize_t len,
     }
 
     /*
-     * Decode 4 -> 3.
+     * Decode 4 -> 3. Reserve space for the entire result, so that the inner
+     * loop needs no buffer checks. A quantum without '=' or invalid input
+     * takes the fast path (valid input decodes to values below 64).
      */
     if ((flags & BASE64_FLAG_APPEND) == 0)
 	VSTRING_RESET(result);
-    for (cp = UNSIG_CHAR_PTR(in), count = 0; count < len; count += 4) {
-	if ((ch0 = un_b64[*cp++]) == INVALID
-	    || (ch1 = un_b64[*cp++]) == INVALID)
+    VSTRING_SPACE(result, len / 4 * 3);
+    out = UNSIG_CHAR_PTR(vstring_end(result));
+    for (cp = UNSIG_CHAR_PTR(in), count = 0; count < len; count += 4, cp += 4) {
+	ch0 = un_b64[cp[0]];
+	ch1 = un_b64[cp[1]];
+	ch2 = un_b64[cp[2]];
+	ch3 = un_b64[cp[3]];
+	if (((ch0 | ch1 | ch2 | ch3) & 0xc0) == 0) {
+	    out[0] = ch0 << 2 | ch1 >> 4;
+	    out[1] = ch1 << 4 | ch2 >> 2;
+	    out[2] = ch2 << 6 | ch3;
+	    out += 3;
+	    continue;
+	}
+	if (ch0 == INVALID || ch1 == INVALID)
 	    return (0);
-	VSTRING_ADDCH(result, ch0 << 2 | ch1 >> 4);
-	if ((ch2 = *cp++) == '=')
+	*out++ = ch0 << 2 | ch1 >> 4;
+	if (cp[2] == '=')
 	    break;
-	if ((ch2 = un_b64[ch2]) == INVALID)
+	if (ch2 == INVALID)
 	    return (0);
-	VSTRING_ADDCH(result, ch1 << 4 | ch2 >> 2);
-	if ((ch3 = *cp++) == '=')
+	*out++ = ch1 << 4 | ch2 >> 2;
+	if (cp[3] == '=')
 	    break;
-	if ((ch3 = un_b64[ch3]) == INVALID)
+	if (ch3 == INVALID)
 	    return (0);
-	VSTRING_ADDCH(result, ch2 << 6 | ch3);
+	*out++ = ch2 << 6 | ch3;
     }
+    vstring_set_payload_size(result, (char *) out - vstring_str(result));
     VSTRING_TERMINATE(result);
     return (result);
 }
@@ -207,19 +228,31 @@ int     main(int unused_argc, char **unused_argv)
     VSTRING *b2 = vstring_alloc(1);
     char    test[256];
     int     n;
+    int     len;
 
     for (n = 0; n < sizeof(test); n++)
 	test[n] = n;
-    base64_encode(b1, test, sizeof(test));
-    if (base64_decode(b2, STR(b1), LEN(b1)) == 0)
-	msg_panic("bad base64: %s", STR(b1));
-    if (LEN(b2) != sizeof(test))
-	msg_panic("bad decode length: %ld != %ld",
-		  (long) LEN(b2), (long) sizeof(test));
-    for (n = 0; n < sizeof(test); n++)
-	if (STR(b2)[n] != test[n])
-	    msg_panic("bad decode value %d != %d",
-		      (unsigned char) STR(b2)[n], (unsigned char) test[n]);
+
+    /*
+     * Exercise all padding cases.
+     */
+    for (len = 0; len <= sizeof(test); len++) {
+	base64_encode(b1, test, len);
+	if (LEN(b1) != (len + 2) / 3 * 4)
+	    msg_panic("bad encode length: %ld != %ld",
+		      (long) LEN(b1), (long) (len + 2) / 3 * 4);
+	if (base64_decode(b2, STR(b1), LEN(b1)) == 0)
+	    msg_panic("bad base64: %s", STR(b1));
+	if (LEN(b2) != len)
+	    msg_panic("bad decode length: %ld != %ld",
+		      (long) LEN(b2), (long) len);
+	for (n = 0; n < len; n++)
+	    if (STR(b2)[n] != test[n])
+		msg_panic("bad decode value %d != %d",
+			(unsigned char) STR(b2)[n], (unsigned char) test[n]);
+    }
+    if (base64_decode(b2, "AB*D", 4) != 0)
+	msg_panic("undetected invalid input");
     vstring_free(b1);
     vstring_free(b2);
     return (0);
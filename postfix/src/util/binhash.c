@@ -144,11 +144,11 @@
 #ifndef NO_HASH_FNV
 #include "hash_fnv.h"
 
-#define binhash_hash(key, len, size) (hash_fnv((key), (len)) % (size))
+#define binhash_hash(key, len) ((size_t) hash_word((key), (len)))
 
 #else
 
-static size_t binhash_hash(const void *key, ssize_t len, size_t size)
+static size_t binhash_hash(const void *key, ssize_t len)
 {
     size_t  h = 0;
     size_t  g;
@@ -164,7 +164,7 @@ static size_t binhash_hash(const void *key, ssize_t len, size_t size)
 	    h ^= g;
 	}
     }
-    return (h % size);
+    return (h);
 }
 
 #endif
@@ -172,7 +172,7 @@ static size_t binhash_hash(const void *key, ssize_t len, size_t size)
 /* binhash_link - insert element into table */
 
 #define binhash_link(table, elm) { \
-    BINHASH_INFO **_h = table->data + binhash_hash(elm->key, elm->key_len, table->size);\
+    BINHASH_INFO **_h = table->data + elm->hash % table->size; \
     elm->prev = 0; \
     if ((elm->next = *_h) != 0) \
 	(*_h)->prev = elm; \
@@ -241,6 +241,7 @@ BINHASH_INFO *binhash_enter(BINHASH *table, const void *key, ssize_t key_len, vo
     ht->key = mymemdup(key, key_len);
     ht->key_len = key_len;
     ht->value = value;
+    ht->hash = binhash_hash(key, key_len);
     binhash_link(table, ht);
     return (ht);
 }
@@ -250,13 +251,17 @@ BINHASH_INFO *binhash_enter(BINHASH *table, const void *key, ssize_t key_len, vo
 void   *binhash_find(BINHASH *table, const void *key, ssize_t key_len)
 {
     BINHASH_INFO *ht;
+    size_t  hash;
 
 #define	KEY_EQ(x,y,l) (((unsigned char *) x)[0] == ((unsigned char *) y)[0] && memcmp(x,y,l) == 0)
 
-    if (table != 0)
-	for (ht = table->data[binhash_hash(key, key_len, table->size)]; ht; ht = ht->next)
-	    if (key_len == ht->key_len && KEY_EQ(key, ht->key, key_len))
+    if (table != 0) {
+	hash = binhash_hash(key, key_len);
+	for (ht = table->data[hash % table->size]; ht; ht = ht->next)
+	    if (ht->hash == hash && key_len == ht->key_len
+		&& KEY_EQ(key, ht->key, key_len))
 		return (ht->value);
+    }
     return (0);
 }
 
@@ -265,11 +270,15 @@ void   *binhash_find(BINHASH *table, const void *key, ssize_t key_len)
 BINHASH_INFO *binhash_locate(BINHASH *table, const void *key, ssize_t key_len)
 {
     BINHASH_INFO *ht;
+    size_t  hash;
 
-    if (table != 0)
-	for (ht = table->data[binhash_hash(key, key_len, table->size)]; ht; ht = ht->next)
-	    if (key_len == ht->key_len && KEY_EQ(key, ht->key, key_len))
+    if (table != 0) {
+	hash = binhash_hash(key, key_len);
+	for (ht = table->data[hash % table->size]; ht; ht = ht->next)
+	    if (ht->hash == hash && key_len == ht->key_len
+		&& KEY_EQ(key, ht->key, key_len))
 		return (ht);
+    }
     return (0);
 }
 
@@ -279,10 +288,12 @@ void    binhash_delete(BINHASH *table, const void *key, ssize_t key_len, void (*
 {
     if (table != 0) {
 	BINHASH_INFO *ht;
-	BINHASH_INFO **h = table->data + binhash_hash(key, key_len, table->size);
+	size_t  hash = binhash_hash(key, key_len);
+	BINHASH_INFO **h = table->data + hash % table->size;
 
 	for (ht = *h; ht; ht = ht->next) {
-	    if (key_len == ht->key_len && KEY_EQ(key, ht->key, key_len)) {
+	    if (ht->hash == hash && key_len == ht->key_len
+		&& KEY_EQ(key, ht->key, key_len)) {
 		if (ht->next)
 		    ht->next->prev = ht->prev;
 		if (ht->prev)
@@ -445,3 +456,96 @@ int     main(int unused_argc, char **unused_argv)
 }
 
 #endif
+
+#ifdef BENCH
+
+ /*
+  * Time the insertion, successful and unsuccessful lookup, and deletion of
+  * a large number of binary keys. The keys look like the (device, inode)
+  * pairs that binhash users typically store.
+  */
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <vstream.h>
+#include <myrand.h>
+
+typedef struct {
+    dev_t   dev;
+    ino_t   ino;
+} BENCH_KEY;
+
+static double bench_since(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec) * 1e9
+	    + (now.tv_usec - start->tv_usec) * 1e3);
+}
+
+static long bench_maxrss(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+	msg_fatal("getrusage: %m");
+    return ((long) usage.ru_maxrss);
+}
+
+int     main(int argc, char **argv)
+{
+    ssize_t count = (argc > 1 ? atol(argv[1]) : 1000000);
+    BINHASH *hash;
+    BENCH_KEY *keys;
+    BENCH_KEY miss;
+    struct timeval start;
+    double  t_enter, t_hit, t_miss, t_delete;
+    ssize_t i;
+    ssize_t found = 0;
+    long    rss;
+
+    if (count <= 0)
+	msg_fatal("usage: %s [count]", argv[0]);
+    keys = (BENCH_KEY *) mymalloc(sizeof(*keys) * count);
+    memset((void *) keys, 0, sizeof(*keys) * count);
+    for (i = 0; i < count; i++) {
+	keys[i].dev = 0x801;
+	keys[i].ino = (ino_t) myrand() << 20 | i;
+    }
+    rss = bench_maxrss();
+    hash = binhash_create(0);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++)
+	binhash_enter(hash, keys + i, sizeof(*keys), (void *) (keys + i));
+    t_enter = bench_since(&start);
+    rss = bench_maxrss() - rss;
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++)
+	found += (binhash_find(hash, keys + (i * 7919) % count,
+			       sizeof(*keys)) != 0);
+    t_hit = bench_since(&start);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++) {
+	miss = keys[i];
+	miss.dev += 1;
+	found += (binhash_find(hash, &miss, sizeof(miss)) != 0);
+    }
+    t_miss = bench_since(&start);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++)
+	binhash_delete(hash, keys + i, sizeof(*keys), (void (*) (void *)) 0);
+    t_delete = bench_since(&start);
+    if (found != count)
+	msg_panic("found %ld of %ld keys", (long) found, (long) count);
+    vstream_printf("binhash: %ld keys, ns/operation: enter %.0f find %.0f "
+		   "miss %.0f delete %.0f, maxrss +%ld kB\n",
+		   (long) count, t_enter / count, t_hit / count,
+		   t_miss / count, t_delete / count, rss);
+    vstream_fflush(VSTREAM_OUT);
+    binhash_free(hash, (void (*) (void *)) 0);
+    myfree((void *) keys);
+    return (0);
+}
+
+#endif
@@ -17,6 +17,7 @@ typedef struct BINHASH_INFO {
     void   *key;			/* lookup key */
     ssize_t key_len;			/* key length */
     void   *value;			/* associated value */
+    size_t  hash;			/* full hash of key */
     struct BINHASH_INFO *next;		/* colliding entry */
     struct BINHASH_INFO *prev;		/* colliding entry */
 } BINHASH_INFO;
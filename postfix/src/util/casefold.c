@@ -109,12 +109,32 @@
 #define STR(x) vstring_str(x)
 #define LEN(x) VSTRING_LEN(x)
 
+/* casefold_ascii - append lowercase copy, one pass */
+
+static char *casefold_ascii(VSTRING *dest, const char *src, ssize_t len)
+{
+    const char *cp;
+    const char *end = src + len;
+    char   *dp;
+    int     ch;
+
+    /*
+     * Copy and lowercase in one pass, stopping at a null byte like
+     * vstring_strncat(). Non-ASCII bytes are copied unchanged.
+     */
+    VSTRING_SPACE(dest, len + 1);
+    for (dp = vstring_end(dest), cp = src;
+	 cp < end && (ch = *(unsigned char *) cp) != 0; cp++)
+	*dp++ = (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+    vstring_set_payload_size(dest, dp - STR(dest));
+    VSTRING_TERMINATE(dest);
+    return (STR(dest));
+}
+
 /* casefoldx - casefold an UTF-8 string */
 
 char   *casefoldx(int flags, VSTRING *dest, const char *src, ssize_t len)
 {
-    size_t  old_len;
-
 #ifdef NO_EAI
 
     /*
@@ -124,20 +144,19 @@ char   *casefoldx(int flags, VSTRING *dest, const char *src, ssize_t len)
 	len = strlen(src);
     if ((flags & CASEF_FLAG_APPEND) == 0)
 	VSTRING_RESET(dest);
-    old_len = VSTRING_LEN(dest);
-    vstring_strncat(dest, src, len);
-    lowercase(STR(dest) + old_len);
-    return (STR(dest));
+    return (casefold_ascii(dest, src, len));
 #else
 
     /*
      * Unicode mode.
      */
     const char myname[] = "casefold";
+    size_t  old_len;
     static VSTRING *fold_buf = 0;
     static UCaseMap *csm = 0;
     UErrorCode error;
     ssize_t space_needed;
+    ssize_t span;
     int     n;
 
     /*
@@ -154,11 +173,9 @@ char   *casefoldx(int flags, VSTRING *dest, const char *src, ssize_t len)
     /*
      * All-ASCII input, or ASCII mode only.
      */
-    if ((flags & CASEF_FLAG_UTF8) == 0 || allascii(src)) {
-	vstring_strncat(dest, src, len);
-	lowercase(STR(dest) + old_len);
-	return (STR(dest));
-    }
+    if ((flags & CASEF_FLAG_UTF8) == 0
+	|| (span = allascii_span(src, len)) == len || src[span] == 0)
+	return (casefold_ascii(dest, src, len));
 
     /*
      * ICU 4.8 ucasemap_utf8FoldCase() does not complain about UTF-8 syntax
@@ -22,6 +22,12 @@
 /*
 /*	void	cidr_match_endif(info)
 /*	CIDR_MATCH *info;
+/*
+/*	void	cidr_match_index(list)
+/*	CIDR_MATCH *list;
+/*
+/*	void	cidr_match_index_free(list)
+/*	CIDR_MATCH *list;
 /* DESCRIPTION
 /*	This module parses address or address/length patterns and
 /*	provides simple address matching. The implementation is
@@ -50,6 +56,21 @@
 /*	cidr_match_execute() matches the specified address against
 /*	a list of parsed expressions, and returns the matching
 /*	expression's data structure.
+/*
+/*	cidr_match_index() speeds up cidr_match_execute() for long
+/*	lists such as CIDR tables. It builds a path-compressed
+/*	binary trie for each run of consecutive positive address
+/*	patterns (i.e. not IF, ENDIF or negated), so that a run is
+/*	searched in time proportional to the address length instead
+/*	of the number of patterns. The result is the same as with
+/*	a linear search: the first matching pattern in list order,
+/*	not the longest match. Short runs are not indexed. This
+/*	function must be called after the list is complete, and at
+/*	most once.
+/*
+/*	cidr_match_index_free() destroys the indexes that were
+/*	created with cidr_match_index(). The list itself is not
+/*	changed otherwise.
 /* SEE ALSO
 /*	dict_cidr(3) CIDR-style lookup table
 /* AUTHOR(S)
@@ -78,6 +99,7 @@
 /* Utility library. */
 
 #include <msg.h>
+#include <mymalloc.h>
 #include <vstring.h>
 #include <stringops.h>
 #include <split_at.h>
@@ -111,6 +133,217 @@
      (msg_panic("%s: bad address family %d", myname, (f)), 0))
 #endif
 
+ /*
+  * A cidr_match_index() trie node. Each node represents the first len bits
+  * of key[]; a node that corresponds to a pattern knows the first pattern in
+  * the indexed run with that network and mask, and its position in the run.
+  * Nodes without pattern join subtrees whose keys differ after len bits.
+  */
+typedef struct CIDR_MATCH_NODE {
+    const unsigned char *key;		/* network bits */
+    int     len;			/* prefix length */
+    CIDR_MATCH *entry;			/* first pattern, or null */
+    int     seq;			/* pattern position in run */
+    struct CIDR_MATCH_NODE *child[2];	/* next bit is 0 or 1 */
+} CIDR_MATCH_NODE;
+
+struct CIDR_MATCH_INDEX {
+    CIDR_MATCH_NODE *v4_root;		/* IPv4 patterns */
+    CIDR_MATCH_NODE *v6_root;		/* IPv6 patterns */
+    CIDR_MATCH *last;			/* last pattern in run */
+};
+
+ /*
+  * Don't bother to index runs that are this short.
+  */
+#define CIDR_MATCH_INDEX_MIN	4
+
+#define CIDR_MATCH_INDEXABLE(e) \
+	((e)->op == CIDR_MATCH_OP_MATCH && (e)->match != CIDR_MATCH_FALSE)
+
+#define CIDR_MATCH_BIT(key, n)	(((key)[(n) >> 3] >> (7 - ((n) & 7))) & 1)
+
+/* cidr_match_prefix_len - length of common prefix, up to limit bits */
+
+static int cidr_match_prefix_len(const unsigned char *a,
+				         const unsigned char *b, int limit)
+{
+    int     len;
+    unsigned char diff;
+
+    for (len = 0; len < limit; len += 8, a++, b++) {
+	if ((diff = *a ^ *b) != 0) {
+	    while ((diff & 0x80) == 0) {
+		diff <<= 1;
+		len++;
+	    }
+	    break;
+	}
+    }
+    return (len < limit ? len : limit);
+}
+
+/* cidr_match_node_alloc - create trie node */
+
+static CIDR_MATCH_NODE *cidr_match_node_alloc(const unsigned char *key,
+					              int len, CIDR_MATCH *entry,
+					              int seq)
+{
+    CIDR_MATCH_NODE *node;
+
+    node = (CIDR_MATCH_NODE *) mymalloc(sizeof(*node));
+    node->key = key;
+    node->len = len;
+    node->entry = entry;
+    node->seq = seq;
+    node->child[0] = node->child[1] = 0;
+    return (node);
+}
+
+/* cidr_match_node_insert - add pattern to trie */
+
+static void cidr_match_node_insert(CIDR_MATCH_NODE **nodep,
+				           CIDR_MATCH *entry, int seq)
+{
+    const unsigned char *key = entry->net_bytes;
+    int     len = entry->mask_shift;
+    CIDR_MATCH_NODE *node;
+    CIDR_MATCH_NODE *join;
+    int     common;
+
+    while ((node = *nodep) != 0) {
+	common = cidr_match_prefix_len(node->key, key,
+				  node->len < len ? node->len : len);
+	if (common < node->len) {
+	    /* The new pattern is a prefix of this node. */
+	    if (common == len) {
+		join = cidr_match_node_alloc(key, len, entry, seq);
+	    }
+	    /* The new pattern and this node diverge. */
+	    else {
+		join = cidr_match_node_alloc(key, common, (CIDR_MATCH *) 0, 0);
+		join->child[CIDR_MATCH_BIT(key, common)] =
+		    cidr_match_node_alloc(key, len, entry, seq);
+	    }
+	    join->child[CIDR_MATCH_BIT(node->key, common)] = node;
+	    *nodep = join;
+	    return;
+	}
+	if (node->len == len) {
+	    /* Earlier patterns win. */
+	    if (node->entry == 0) {
+		node->entry = entry;
+		node->seq = seq;
+	    }
+	    return;
+	}
+	nodep = node->child + CIDR_MATCH_BIT(key, node->len);
+    }
+    *nodep = cidr_match_node_alloc(key, len, entry, seq);
+}
+
+/* cidr_match_node_free - destroy trie */
+
+static void cidr_match_node_free(CIDR_MATCH_NODE *node)
+{
+    if (node != 0) {
+	cidr_match_node_free(node->child[0]);
+	cidr_match_node_free(node->child[1]);
+	myfree((void *) node);
+    }
+}
+
+/* cidr_match_index_search - find first matching pattern in indexed run */
+
+static CIDR_MATCH *cidr_match_index_search(struct CIDR_MATCH_INDEX *index,
+					           unsigned addr_family,
+					        unsigned char *addr_bytes)
+{
+    CIDR_MATCH_NODE *node;
+    CIDR_MATCH_NODE *best = 0;
+    int     addr_bits;
+
+    if (addr_family == AF_INET) {
+	node = index->v4_root;
+	addr_bits = MAI_V4ADDR_BITS;
+    }
+#ifdef HAS_IPV6
+    else if (addr_family == AF_INET6) {
+	node = index->v6_root;
+	addr_bits = MAI_V6ADDR_BITS;
+    }
+#endif
+    else
+	return (0);
+
+    /*
+     * All nodes on the path whose prefix matches the address correspond to
+     * matching patterns. Return the one that comes first in the list.
+     */
+    while (node != 0
+	   && cidr_match_prefix_len(node->key, addr_bytes, node->len)
+	   == node->len) {
+	if (node->entry != 0 && (best == 0 || node->seq < best->seq))
+	    best = node;
+	if (node->len >= addr_bits)
+	    break;
+	node = node->child[CIDR_MATCH_BIT(addr_bytes, node->len)];
+    }
+    return (best ? best->entry : 0);
+}
+
+/* cidr_match_index - build tries for long runs of plain patterns */
+
+void    cidr_match_index(CIDR_MATCH *list)
+{
+    struct CIDR_MATCH_INDEX *index;
+    CIDR_MATCH *first;
+    CIDR_MATCH *entry;
+    CIDR_MATCH *last;
+    int     count;
+
+    for (first = list; first != 0; first = last->next) {
+	last = first;
+	if (!CIDR_MATCH_INDEXABLE(first))
+	    continue;
+	for (count = 1; last->next && CIDR_MATCH_INDEXABLE(last->next); count++)
+	    last = last->next;
+	if (count < CIDR_MATCH_INDEX_MIN)
+	    continue;
+
+	/*
+	 * The first pattern of the run owns the index.
+	 */
+	index = (struct CIDR_MATCH_INDEX *) mymalloc(sizeof(*index));
+	index->v4_root = index->v6_root = 0;
+	index->last = last;
+	for (entry = first, count = 0; /* void */ ; entry = entry->next, count++) {
+	    cidr_match_node_insert(entry->addr_family == AF_INET ?
+				   &index->v4_root : &index->v6_root,
+				   entry, count);
+	    if (entry == last)
+		break;
+	}
+	first->index = index;
+    }
+}
+
+/* cidr_match_index_free - destroy run indexes */
+
+void    cidr_match_index_free(CIDR_MATCH *list)
+{
+    CIDR_MATCH *entry;
+
+    for (entry = list; entry != 0; entry = entry->next) {
+	if (entry->index != 0) {
+	    cidr_match_node_free(entry->index->v4_root);
+	    cidr_match_node_free(entry->index->v6_root);
+	    myfree((void *) entry->index);
+	    entry->index = 0;
+	}
+    }
+}
+
 /* cidr_match_entry - match one entry */
 
 static inline int cidr_match_entry(CIDR_MATCH *entry,
@@ -150,6 +383,7 @@ CIDR_MATCH *cidr_match_execute(CIDR_MATCH *list, const char *addr)
     unsigned char addr_bytes[CIDR_MATCH_ABYTES];
     unsigned addr_family;
     CIDR_MATCH *entry;
+    CIDR_MATCH *match;
 
     addr_family = CIDR_MATCH_ADDR_FAMILY(addr);
     if (inet_pton(addr_family, addr, addr_bytes) != 1)
@@ -160,6 +394,13 @@ CIDR_MATCH *cidr_match_execute(CIDR_MATCH *list, const char *addr)
 	switch (entry->op) {
 
 	case CIDR_MATCH_OP_MATCH:
+	    if (entry->index != 0) {
+		if ((match = cidr_match_index_search(entry->index, addr_family,
+						     addr_bytes)) != 0)
+		    return (match);
+		entry = entry->index->last;
+		continue;
+	    }
 	    if (entry->addr_family == addr_family)
 		if (cidr_match_entry(entry, addr_bytes))
 		    return (entry);
@@ -289,6 +530,7 @@ VSTRING *cidr_match_parse(CIDR_MATCH *ip, char *pattern, int match,
     ip->match = match;
     ip->next = 0;
     ip->block_end = 0;
+    ip->index = 0;
 
     return (0);
 }
@@ -313,4 +555,5 @@ void    cidr_match_endif(CIDR_MATCH *ip)
     ip->op = CIDR_MATCH_OP_ENDIF;
     ip->next = 0;				/* maybe not all bits 0 */
     ip->block_end = 0;
+    ip->index = 0;
 }
@@ -48,6 +48,7 @@ typedef struct CIDR_MATCH {
     unsigned char mask_shift;		/* optimization */
     struct CIDR_MATCH *next;		/* next entry */
     struct CIDR_MATCH *block_end;	/* block terminator */
+    struct CIDR_MATCH_INDEX *index;	/* optional, see cidr_match_index() */
 } CIDR_MATCH;
 
 #define CIDR_MATCH_OP_MATCH	1	/* Match this pattern */
@@ -63,6 +64,9 @@ extern void cidr_match_endif(CIDR_MATCH *);
 
 extern CIDR_MATCH *cidr_match_execute(CIDR_MATCH *, const char *);
 
+extern void cidr_match_index(CIDR_MATCH *);
+extern void cidr_match_index_free(CIDR_MATCH *);
+
 /* LICENSE
 /* .ad
 /* .fi
@@ -11,6 +11,10 @@
 /*
 /*	void	update_env(preserve_list)
 /*	const char **preserve_list;
+/*
+/*	ARGV	*clean_env_argv(preserve_list, override_list)
+/*	const char **preserve_list;
+/*	const char **override_list;
 /* DESCRIPTION
 /*	clean_env() reduces the process environment to the bare minimum.
 /*	The function takes a null-terminated list of arguments.
@@ -20,6 +24,14 @@
 /*
 /*	update_env() applies name=value settings, but otherwise does not
 /*	change the process environment.
+/*
+/*	clean_env_argv() returns the environment that clean_env()
+/*	would produce, followed by setenv() calls for each name,
+/*	value pair in override_list, as a list of name=value strings.
+/*	The process environment is not changed. A null preserve_list
+/*	preserves the entire process environment; a null override_list
+/*	is treated as an empty list. This is for use before vfork(),
+/*	when the child process must not update the environment.
 /* DIAGNOSTICS
 /*	Fatal error: out of memory.
 /* SEE ALSO
@@ -145,6 +157,72 @@ void    update_env(char **preserve_list)
     argv_free(save_list);
 }
 
+/* clean_env_argv_set - add or replace name=value */
+
+static void clean_env_argv_set(ARGV *env, const char *name, const char *value)
+{
+    size_t  len = strlen(name);
+    char   *nameval = concatenate(name, "=", value, (char *) 0);
+    char  **cpp;
+
+    for (cpp = env->argv; *cpp; cpp++) {
+	if (strncmp(*cpp, name, len) == 0 && (*cpp)[len] == '=') {
+	    myfree(*cpp);
+	    *cpp = nameval;
+	    return;
+	}
+    }
+    argv_add(env, nameval, (char *) 0);
+    myfree(nameval);
+}
+
+/* clean_env_argv - compute clean environment, without changing it */
+
+ARGV   *clean_env_argv(char **preserve_list, char **override_list)
+{
+    extern char **environ;
+    ARGV   *env;
+    char   *value;
+    char  **cpp;
+    char   *copy;
+    char   *key;
+    char   *val;
+    const char *err;
+
+    /*
+     * Start with the preserved or specified environment variables, or with
+     * the entire process environment.
+     */
+    env = argv_alloc(10);
+    if (preserve_list == 0) {
+	if (environ)
+	    for (cpp = environ; *cpp; cpp++)
+		argv_add(env, *cpp, (char *) 0);
+    } else {
+	for (cpp = preserve_list; *cpp; cpp++) {
+	    if (strchr(*cpp, '=') != 0) {
+		copy = mystrdup(*cpp);
+		err = split_nameval(copy, &key, &val);
+		if (err != 0)
+		    msg_fatal("clean_env_argv: %s in: %s", err, *cpp);
+		clean_env_argv_set(env, key, val);
+		myfree(copy);
+	    } else if ((value = safe_getenv(*cpp)) != 0) {
+		clean_env_argv_set(env, *cpp, value);
+	    }
+	}
+    }
+
+    /*
+     * Apply overrides.
+     */
+    if (override_list)
+	for (cpp = override_list; *cpp; cpp += 2)
+	    clean_env_argv_set(env, cpp[0], cpp[1]);
+    argv_terminate(env);
+    return (env);
+}
+
 #ifdef TEST
 
 #include <stdlib.h>
@@ -11,11 +11,17 @@
 /* DESCRIPTION
 /* .nf
 
+ /*
+  * Utility library.
+  */
+#include <argv.h>
+
  /*
   * External interface.
   */
 extern void clean_env(char **);
 extern void update_env(char **);
+extern ARGV *clean_env_argv(char **, char **);
 
 /* LICENSE
 /* .ad
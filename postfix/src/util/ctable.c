@@ -20,6 +20,10 @@
 /*	CTABLE	*cache;
 /*	const char *key;
 /*
+/*	int	ctable_exists(cache, key)
+/*	CTABLE	*cache;
+/*	const char *key;
+/*
 /*	const void *ctable_newcontext(cache, context)
 /*	CTABLE	*cache;
 /*	void	*context;
@@ -49,6 +53,10 @@
 /*	ctable_refresh() flushes the value (if any) associated with
 /*	the specified key, and returns the same result as ctable_locate().
 /*
+/*	ctable_exists() returns non-zero when the cache has a value
+/*	for the specified key. It neither creates a value nor changes
+/*	the order in which cache items are purged.
+/*
 /*	ctable_newcontext() updates the context that is passed on
 /*	to call-back routines.
 /*
@@ -141,14 +149,17 @@ const void *ctable_locate(CTABLE *cache, const char *key)
 {
     const char *myname = "ctable_locate";
     CTABLE_ENTRY *entry;
+    size_t  hash = htable_keyhash(key);
 
     /*
      * If the entry is not in the cache, make sure there is room for a new
      * entry and install it at the front of the MRU chain. Otherwise, move
      * the entry to the front of the MRU chain if it is not already there.
-     * All this means that the cache never shrinks.
+     * All this means that the cache never shrinks. The key is hashed only
+     * once for the lookup and the update.
      */
-    if ((entry = (CTABLE_ENTRY *) htable_find(cache->table, key)) == 0) {
+    if ((entry = (CTABLE_ENTRY *) htable_find_hash(cache->table, key,
+						   hash)) == 0) {
 	if (cache->used >= cache->limit) {
 	    entry = RING_TO_CTABLE_ENTRY(ring_pred(RING_PTR_OF(cache)));
 	    if (msg_verbose)
@@ -161,7 +172,8 @@ const void *ctable_locate(CTABLE *cache, const char *key)
 	    cache->used++;
 	}
 	entry->value = cache->create(key, cache->context);
-	entry->key = htable_enter(cache->table, key, (void *) entry)->key;
+	entry->key = htable_enter_hash(cache->table, key, hash,
+				       (void *) entry)->key;
 	ring_append(RING_PTR_OF(cache), RING_PTR_OF(entry));
 	if (msg_verbose)
 	    msg_info("%s: install entry key %s", myname, entry->key);
@@ -202,6 +214,13 @@ const void *ctable_refresh(CTABLE *cache, const char *key)
     return (entry->value);
 }
 
+/* ctable_exists - test if key is cached */
+
+int     ctable_exists(CTABLE *cache, const char *key)
+{
+    return (htable_locate(cache->table, key) != 0);
+}
+
 /* ctable_newcontext - update call-back context */
 
 void    ctable_newcontext(CTABLE *cache, void *context)
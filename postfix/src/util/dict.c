@@ -49,6 +49,15 @@
 /*
 /*	const char *dict_changed_name()
 /*
+/*	int	dict_handle_changed(dict)
+/*	DICT	*dict;
+/*
+/*	void	dict_replace(old_dict, new_dict)
+/*	DICT	*old_dict;
+/*	DICT	*new_dict;
+/*
+/*	int	dict_replace_count;
+/*
 /*	void	DICT_OWNER_AGGREGATE_INIT(aggregate)
 /*	DICT_OWNER aggregate;
 /*
@@ -151,6 +160,18 @@
 /*	be re-opened because it has changed or because it was unlinked.
 /*	A non-zero result is the name of a changed dictionary.
 /*
+/*	dict_handle_changed() returns non-zero when the specified
+/*	dictionary has changed or was unlinked, as described for
+/*	dict_changed_name().
+/*
+/*	dict_replace() replaces each registration of \fIold_dict\fR
+/*	by \fInew_dict\fR, preserving names and reference counts,
+/*	and closes \fIold_dict\fR. Lookup results from \fIold_dict\fR
+/*	become invalid.  dict_reload_changed(3) uses this to reopen
+/*	a changed dictionary without restarting the process.
+/*	Each call increments dict_replace_count, so that a caller
+/*	can tell when to discard lookup results that it keeps.
+/*
 /*	dict_load_file_xt() reads name-value entries from the named file.
 /*	Lines that begin with whitespace are concatenated to the preceding
 /*	line (the newline is deleted).
@@ -275,6 +296,8 @@
 
 static HTABLE *dict_table;
 
+int     dict_replace_count;
+
  /*
   * Each (name, dictionary) instance has a reference count. The count is part
   * of the name, not the dictionary. The same dictionary may be registered
@@ -580,40 +603,66 @@ void    dict_walk(DICT_WALK_ACTION action, void *ptr)
 
     ht_info_list = htable_list(dict_table);
     for (ht = ht_info_list; (h = *ht) != 0; ht++)
-	action(h->key, (DICT *) h->value, ptr);
+	action(h->key, ((DICT_NODE *) h->value)->dict, ptr);
     myfree((void *) ht_info_list);
 }
 
+/* dict_handle_changed - see if a dictionary has changed */
+
+int     dict_handle_changed(DICT *dict)
+{
+    const char *myname = "dict_handle_changed";
+    struct stat st;
+
+    if (dict->stat_fd < 0)			/* not file-based */
+	return (0);
+    if (dict->mtime == 0)			/* not bloody likely */
+	msg_warn("%s: table %s:%s: null time stamp",
+		 myname, dict->type, dict->name);
+    if (fstat(dict->stat_fd, &st) < 0)
+	msg_fatal("%s: fstat: %m", myname);
+    return (((dict->flags & DICT_FLAG_MULTI_WRITER) == 0
+	     && st.st_mtime != dict->mtime)
+	    || st.st_nlink == 0);
+}
+
 /* dict_changed_name - see if any dictionary has changed */
 
 const char *dict_changed_name(void)
 {
-    const char *myname = "dict_changed_name";
-    struct stat st;
     HTABLE_INFO **ht_info_list;
     HTABLE_INFO **ht;
     HTABLE_INFO *h;
     const char *status;
-    DICT   *dict;
 
     ht_info_list = htable_list(dict_table);
-    for (status = 0, ht = ht_info_list; status == 0 && (h = *ht) != 0; ht++) {
-	dict = ((DICT_NODE *) h->value)->dict;
-	if (dict->stat_fd < 0)			/* not file-based */
-	    continue;
-	if (dict->mtime == 0)			/* not bloody likely */
-	    msg_warn("%s: table %s: null time stamp", myname, h->key);
-	if (fstat(dict->stat_fd, &st) < 0)
-	    msg_fatal("%s: fstat: %m", myname);
-	if (((dict->flags & DICT_FLAG_MULTI_WRITER) == 0
-	     && st.st_mtime != dict->mtime)
-	    || st.st_nlink == 0)
+    for (status = 0, ht = ht_info_list; status == 0 && (h = *ht) != 0; ht++)
+	if (dict_handle_changed(((DICT_NODE *) h->value)->dict))
 	    status = h->key;
-    }
     myfree((void *) ht_info_list);
     return (status);
 }
 
+/* dict_replace - replace dictionary under all its names */
+
+void    dict_replace(DICT *old_dict, DICT *new_dict)
+{
+    HTABLE_INFO **ht_info_list;
+    HTABLE_INFO **ht;
+    DICT_NODE *node;
+
+    ht_info_list = htable_list(dict_table);
+    for (ht = ht_info_list; *ht != 0; ht++) {
+	node = (DICT_NODE *) ht[0]->value;
+	if (node->dict == old_dict)
+	    node->dict = new_dict;
+    }
+    myfree((void *) ht_info_list);
+    dict_replace_count += 1;
+    if (old_dict->close)
+	old_dict->close(old_dict);
+}
+
 /* dict_changed - backwards compatibility */
 
 int     dict_changed(void)
@@ -86,6 +86,8 @@ typedef struct DICT {
     int     (*sequence) (struct DICT *, int, const char **, const char **);
     int     (*lock) (struct DICT *, int);
     void    (*close) (struct DICT *);
+    const char *(*lookup_first) (struct DICT *, const char **, ssize_t,
+				         ssize_t *);
     int     lock_type;			/* for read/write lock */
     int     lock_fd;			/* for read/write lock */
     int     stat_fd;			/* change detection */
@@ -97,6 +99,9 @@ typedef struct DICT {
     struct DICT_UTF8_BACKUP *utf8_backup;	/* see below */
     struct VSTRING *file_buf;		/* dict_file_to_buf() */
     struct VSTRING *file_b64;		/* dict_file_to_b64() */
+    int     open_flags;			/* dict_open3() argument, or -1 */
+    int     open_dict_flags;		/* dict_open3() argument */
+    struct DICT_STATS *stats;		/* dict_stats(3) */
 } DICT;
 
 extern DICT *dict_alloc(const char *, const char *, ssize_t);
@@ -245,6 +250,8 @@ extern const DICT_OPEN_INFO *dict_open_lookup(const char *);
 extern DICT_OPEN_EXTEND_FN dict_open_extend(DICT_OPEN_EXTEND_FN);
 
 #define dict_get(dp, key)	((const char *) (dp)->lookup((dp), (key)))
+#define dict_get_first(dp, keys, count, index) \
+	((const char *) (dp)->lookup_first((dp), (keys), (count), (index)))
 #define dict_put(dp, key, val)	(dp)->update((dp), (key), (val))
 #define dict_del(dp, key)	(dp)->delete((dp), (key))
 #define dict_seq(dp, f, key, val) (dp)->sequence((dp), (f), (key), (val))
@@ -253,6 +260,10 @@ typedef void (*DICT_WALK_ACTION) (const char *, DICT *, void *);
 extern void dict_walk(DICT_WALK_ACTION, void *);
 extern int dict_changed(void);
 extern const char *dict_changed_name(void);
+extern int dict_handle_changed(DICT *);
+extern void dict_replace(DICT *, DICT *);
+extern int dict_replace_count;
+extern const char *dict_reload_changed(void);
 extern const char *dict_flags_str(int);
 extern int dict_flags_mask(const char *);
 extern void dict_type_override(DICT *, const char *);
@@ -268,6 +279,14 @@ typedef struct DICT_UTF8_BACKUP {
 
 extern DICT *dict_utf8_activate(DICT *);
 
+ /*
+  * Per-table lookup statistics.
+  */
+extern int dict_stats_interval;
+extern void dict_stats_activate(DICT *);
+extern void dict_stats_log(void);
+extern void dict_stats_free(DICT *);
+
  /*
   * Driver for interactive or scripted tests.
   */
@@ -35,6 +35,12 @@
 /*	exclusively after it is opened) for databases that are not
 /*	multi-writer safe.
 /*
+/*	Another exception is the default lookup_first function. It
+/*	looks up the specified keys one at a time with dict_get(),
+/*	in the specified order, and stops at the first key that is
+/*	found or that causes a lookup error. A client-server
+/*	dictionary may override this to send all keys in one request.
+/*
 /*	dict_free() releases memory and cleans up after dict_alloc().
 /*	It is up to the caller to dispose of any memory that was allocated
 /*	by the caller.
@@ -127,6 +133,22 @@ static int dict_default_lock(DICT *dict, int operation)
     }
 }
 
+/* dict_default_lookup_first - look up keys one at a time */
+
+static const char *dict_default_lookup_first(DICT *dict, const char **keys,
+					             ssize_t count,
+					             ssize_t *index)
+{
+    const char *value = 0;
+    ssize_t n;
+
+    for (n = 0; n < count; n++)
+	if ((value = dict_get(dict, keys[n])) != 0 || dict->error != 0)
+	    break;
+    *index = n;
+    return (value);
+}
+
 /* dict_default_close - trap unimplemented operation */
 
 static void dict_default_close(DICT *dict)
@@ -150,6 +172,7 @@ DICT   *dict_alloc(const char *dict_type, const char *dict_name, ssize_t size)
     dict->sequence = dict_default_sequence;
     dict->close = dict_default_close;
     dict->lock = dict_default_lock;
+    dict->lookup_first = dict_default_lookup_first;
     dict->lock_type = INTERNAL_LOCK;
     dict->lock_fd = -1;
     dict->stat_fd = -1;
@@ -162,6 +185,9 @@ DICT   *dict_alloc(const char *dict_type, const char *dict_name, ssize_t size)
     dict->utf8_backup = 0;
     dict->file_buf = 0;
     dict->file_b64 = 0;
+    dict->open_flags = -1;
+    dict->open_dict_flags = 0;
+    dict->stats = 0;
     return dict;
 }
 
@@ -169,6 +195,8 @@ DICT   *dict_alloc(const char *dict_type, const char *dict_name, ssize_t size)
 
 void    dict_free(DICT *dict)
 {
+    if (dict->stats)
+	dict_stats_free(dict);
     myfree(dict->type);
     myfree(dict->name);
     if (dict->jbuf)
@@ -0,0 +1,450 @@
+/*++
+/* NAME
+/*	dict_bloom 3
+/* SUMMARY
+/*	dictionary manager interface to Bloom filter files
+/* SYNOPSIS
+/*	#include <dict_bloom.h>
+/*
+/*	DICT	*dict_bloom_open(path, open_flags, dict_flags)
+/*	const char *path;
+/*	int	open_flags;
+/*	int	dict_flags;
+/* DESCRIPTION
+/*	dict_bloom_open() opens the specified Bloom filter file. The
+/*	result is a pointer to a structure that can be used to access
+/*	the dictionary using the generic methods documented in
+/*	dict_open(3).
+/*
+/*	A Bloom filter stores only a fixed-size fingerprint of each
+/*	key, and no values. A lookup never fails to find a key that
+/*	was stored, but may find a key that was not stored (a false
+/*	positive). With the built-in sizing of DICT_BLOOM_BITS_PER_KEY
+/*	bits per key, fewer than one in 1000 lookups of a key that
+/*	was not stored will find it. A successful lookup returns
+/*	the string "DUNNO", so that a Bloom filter that is used by
+/*	mistake as an access table makes no decision.
+/*
+/*	In query mode, the file is memory-mapped, and a lookup costs
+/*	DICT_BLOOM_HASH_COUNT memory accesses and no system calls.
+/*	In create mode, the key fingerprints are collected in memory,
+/*	and the file is written when the dictionary is closed. The
+/*	filter is sized for the number of keys that was stored.
+/*	Duplicate keys are not detected.
+/*
+/*	The file format is specific to the byte order of the system
+/*	that created it.
+/*
+/*	Arguments:
+/* .IP path
+/*	The database pathname, not including the ".bloom" suffix.
+/* .IP open_flags
+/*	Flags passed to open(). Specify O_RDONLY or O_WRONLY|O_CREAT|O_TRUNC.
+/* .IP dict_flags
+/*	Flags used by the dictionary interface.
+/* SEE ALSO
+/*	dict(3) generic dictionary manager
+/* DIAGNOSTICS
+/*	Fatal errors: write error, out of memory. A file that cannot
+/*	be opened, or that is not a valid Bloom filter file, results
+/*	in a surrogate dictionary that reports an error for each
+/*	lookup.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <stringops.h>
+#include <iostuff.h>
+#include <myflock.h>
+#include <dict.h>
+#include <dict_bloom.h>
+
+ /*
+  * File format: a header, followed by the bit array. All numbers are in
+  * host byte order.
+  */
+#define DICT_BLOOM_SUFFIX	".bloom"
+#define DICT_BLOOM_TMP_SUFFIX	DICT_BLOOM_SUFFIX ".tmp"
+
+#define DICT_BLOOM_MAGIC	"PFBLOOM1"
+#define DICT_BLOOM_BYTE_ORDER	0x01020304
+
+typedef struct {
+    char    magic[8];			/* DICT_BLOOM_MAGIC */
+    uint32_t byte_order;		/* DICT_BLOOM_BYTE_ORDER */
+    uint32_t hash_count;		/* bits set per key */
+    uint64_t bit_count;			/* bit array size */
+    uint64_t key_count;			/* informational */
+} DICT_BLOOM_HDR;
+
+ /*
+  * Sizing: 16 bits and 11 hash functions per key give a false positive rate
+  * of about 0.05%.
+  */
+#define DICT_BLOOM_BITS_PER_KEY	16
+#define DICT_BLOOM_HASH_COUNT	11
+#define DICT_BLOOM_MIN_BITS	64
+
+#define DICT_BLOOM_FOUND	"DUNNO"
+
+/* Application-specific. */
+
+typedef struct {
+    DICT    dict;			/* generic members */
+    const DICT_BLOOM_HDR *hdr;		/* memory-mapped file */
+    const unsigned char *bits;		/* bit array */
+    size_t  map_size;			/* mapping size */
+} DICT_BLOOMQ;				/* query interface */
+
+typedef struct {
+    DICT    dict;			/* generic members */
+    int     fd;				/* temporary file */
+    char   *bloom_path;			/* final pathname (.bloom) */
+    char   *tmp_path;			/* temporary pathname (.tmp) */
+    uint64_t *hashes;			/* two hashes per key */
+    size_t  key_count;			/* keys stored */
+    size_t  key_limit;			/* hashes[] capacity */
+} DICT_BLOOMM;				/* create interface */
+
+/* dict_bloom_hash - compute the two base hashes for a key */
+
+static void dict_bloom_hash(const char *key, uint64_t *h1, uint64_t *h2)
+{
+    const unsigned char *cp;
+    uint64_t h;
+
+    /*
+     * An unseeded FNV-1a hash, because the result must not change between
+     * processes. The second hash is derived by mixing the first one, and is
+     * odd so that all bits are reachable when the bit count is even.
+     */
+    for (h = 0xcbf29ce484222325ULL, cp = (const unsigned char *) key; *cp; cp++)
+	h = (h ^ *cp) * 0x00000100000001B3ULL;
+    *h1 = h;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    *h2 = h | 1;
+}
+
+/* dict_bloom_fold - optionally fold the key */
+
+static const char *dict_bloom_fold(DICT *dict, const char *name)
+{
+    if ((dict->flags & DICT_FLAG_FOLD_FIX) && lowercase_needed(name)) {
+	if (dict->fold_buf == 0)
+	    dict->fold_buf = vstring_alloc(10);
+	vstring_strcpy(dict->fold_buf, name);
+	name = lowercase(vstring_str(dict->fold_buf));
+    }
+    return (name);
+}
+
+/* dict_bloomq_lookup - find database entry, query mode */
+
+static const char *dict_bloomq_lookup(DICT *dict, const char *name)
+{
+    DICT_BLOOMQ *dict_bloomq = (DICT_BLOOMQ *) dict;
+    uint64_t nbits = dict_bloomq->hdr->bit_count;
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t bit;
+    uint32_t n;
+
+    dict->error = 0;
+
+    /* The file is never modified in place, so do not try to acquire a lock. */
+
+    name = dict_bloom_fold(dict, name);
+    dict_bloom_hash(name, &h1, &h2);
+    for (n = 0; n < dict_bloomq->hdr->hash_count; n++) {
+	bit = (h1 + n * h2) % nbits;
+	if ((dict_bloomq->bits[bit >> 3] & (1 << (bit & 7))) == 0)
+	    return (0);
+    }
+    return (DICT_BLOOM_FOUND);
+}
+
+/* dict_bloomq_close - close data base, query mode */
+
+static void dict_bloomq_close(DICT *dict)
+{
+    DICT_BLOOMQ *dict_bloomq = (DICT_BLOOMQ *) dict;
+
+    (void) munmap((void *) dict_bloomq->hdr, dict_bloomq->map_size);
+    (void) close(dict->stat_fd);
+    if (dict->fold_buf)
+	vstring_free(dict->fold_buf);
+    dict_free(dict);
+}
+
+/* dict_bloomq_open - open data base, query mode */
+
+static DICT *dict_bloomq_open(const char *path, int dict_flags)
+{
+    DICT_BLOOMQ *dict_bloomq;
+    const DICT_BLOOM_HDR *hdr;
+    struct stat st;
+    char   *bloom_path;
+    void   *map;
+    int     fd;
+
+    /*
+     * Let the optimizer worry about eliminating redundant code.
+     */
+#define DICT_BLOOMQ_OPEN_RETURN(d) do { \
+	DICT *__d = (d); \
+	myfree(bloom_path); \
+	return (__d); \
+    } while (0)
+
+    bloom_path = concatenate(path, DICT_BLOOM_SUFFIX, (char *) 0);
+
+    if ((fd = open(bloom_path, O_RDONLY)) < 0)
+	DICT_BLOOMQ_OPEN_RETURN(dict_surrogate(DICT_TYPE_BLOOM, path,
+					       O_RDONLY, dict_flags,
+					 "open database %s: %m", bloom_path));
+    if (fstat(fd, &st) < 0)
+	msg_fatal("dict_bloomq_open: fstat %s: %m", bloom_path);
+
+    /*
+     * Validate the header before trusting the bit count.
+     */
+    if (st.st_size < (off_t) sizeof(*hdr)) {
+	(void) close(fd);
+	DICT_BLOOMQ_OPEN_RETURN(dict_surrogate(DICT_TYPE_BLOOM, path,
+					       O_RDONLY, dict_flags,
+			  "open database %s: file is too short", bloom_path));
+    }
+    if ((map = mmap((void *) 0, st.st_size, PROT_READ, MAP_SHARED,
+		    fd, (off_t) 0)) == MAP_FAILED) {
+	DICT   *surrogate = dict_surrogate(DICT_TYPE_BLOOM, path,
+					   O_RDONLY, dict_flags,
+					   "mmap database %s: %m", bloom_path);
+
+	(void) close(fd);
+	DICT_BLOOMQ_OPEN_RETURN(surrogate);
+    }
+    hdr = (const DICT_BLOOM_HDR *) map;
+    if (memcmp(hdr->magic, DICT_BLOOM_MAGIC, sizeof(hdr->magic)) != 0
+	|| hdr->byte_order != DICT_BLOOM_BYTE_ORDER
+	|| hdr->hash_count == 0 || hdr->bit_count == 0
+	|| (uint64_t) (st.st_size - sizeof(*hdr)) != (hdr->bit_count + 7) / 8) {
+	(void) munmap(map, st.st_size);
+	(void) close(fd);
+	DICT_BLOOMQ_OPEN_RETURN(dict_surrogate(DICT_TYPE_BLOOM, path,
+					       O_RDONLY, dict_flags,
+				 "open database %s: not a Bloom filter file"
+					       " for this system", bloom_path));
+    }
+    dict_bloomq = (DICT_BLOOMQ *) dict_alloc(DICT_TYPE_BLOOM,
+					     bloom_path, sizeof(*dict_bloomq));
+    dict_bloomq->hdr = hdr;
+    dict_bloomq->bits = (const unsigned char *) (hdr + 1);
+    dict_bloomq->map_size = st.st_size;
+    dict_bloomq->dict.lookup = dict_bloomq_lookup;
+    dict_bloomq->dict.close = dict_bloomq_close;
+    dict_bloomq->dict.stat_fd = fd;
+    dict_bloomq->dict.mtime = st.st_mtime;
+    dict_bloomq->dict.owner.uid = st.st_uid;
+    dict_bloomq->dict.owner.status = (st.st_uid != 0);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+
+    /*
+     * Warn if the source file is newer than the indexed file, except when
+     * the source file changed only seconds ago.
+     */
+    if (stat(path, &st) == 0
+	&& st.st_mtime > dict_bloomq->dict.mtime
+	&& st.st_mtime < time((time_t *) 0) - 100)
+	msg_warn("database %s is older than source file %s", bloom_path, path);
+
+    dict_bloomq->dict.flags = dict_flags | DICT_FLAG_FIXED;
+    if (dict_flags & DICT_FLAG_FOLD_FIX)
+	dict_bloomq->dict.fold_buf = vstring_alloc(10);
+
+    DICT_BLOOMQ_OPEN_RETURN(DICT_DEBUG (&dict_bloomq->dict));
+}
+
+/* dict_bloomm_update - add database entry, create mode */
+
+static int dict_bloomm_update(DICT *dict, const char *name,
+			              const char *unused_value)
+{
+    DICT_BLOOMM *dict_bloomm = (DICT_BLOOMM *) dict;
+    uint64_t *hp;
+
+    dict->error = 0;
+
+    name = dict_bloom_fold(dict, name);
+    if (dict_bloomm->key_count >= dict_bloomm->key_limit) {
+	dict_bloomm->key_limit *= 2;
+	dict_bloomm->hashes = (uint64_t *)
+	    myrealloc((void *) dict_bloomm->hashes,
+		      2 * dict_bloomm->key_limit * sizeof(uint64_t));
+    }
+    hp = dict_bloomm->hashes + 2 * dict_bloomm->key_count++;
+    dict_bloom_hash(name, hp, hp + 1);
+    return (DICT_STAT_SUCCESS);
+}
+
+/* dict_bloomm_close - write filter and rename file.tmp to file.bloom */
+
+static void dict_bloomm_close(DICT *dict)
+{
+    DICT_BLOOMM *dict_bloomm = (DICT_BLOOMM *) dict;
+    DICT_BLOOM_HDR hdr;
+    unsigned char *bits;
+    size_t  bit_bytes;
+    uint64_t *hp;
+    uint64_t bit;
+    size_t  i;
+    uint32_t n;
+
+    /*
+     * Size the filter for the actual number of keys.
+     */
+    memset((void *) &hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DICT_BLOOM_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = DICT_BLOOM_BYTE_ORDER;
+    hdr.hash_count = DICT_BLOOM_HASH_COUNT;
+    hdr.key_count = dict_bloomm->key_count;
+    hdr.bit_count = (uint64_t) dict_bloomm->key_count * DICT_BLOOM_BITS_PER_KEY;
+    if (hdr.bit_count < DICT_BLOOM_MIN_BITS)
+	hdr.bit_count = DICT_BLOOM_MIN_BITS;
+    bit_bytes = (hdr.bit_count + 7) / 8;
+    bits = (unsigned char *) mymalloc(bit_bytes);
+    memset((void *) bits, 0, bit_bytes);
+
+    for (i = 0, hp = dict_bloomm->hashes; i < dict_bloomm->key_count; i++, hp += 2) {
+	for (n = 0; n < hdr.hash_count; n++) {
+	    bit = (hp[0] + n * hp[1]) % hdr.bit_count;
+	    bits[bit >> 3] |= (1 << (bit & 7));
+	}
+    }
+    if (write_buf(dict_bloomm->fd, (char *) &hdr, sizeof(hdr), 0) < 0
+	|| write_buf(dict_bloomm->fd, (char *) bits, bit_bytes, 0) < 0)
+	msg_fatal("error writing %s: %m", dict_bloomm->tmp_path);
+    if (rename(dict_bloomm->tmp_path, dict_bloomm->bloom_path) < 0)
+	msg_fatal("rename database from %s to %s: %m",
+		  dict_bloomm->tmp_path, dict_bloomm->bloom_path);
+    if (close(dict_bloomm->fd) < 0)		/* releases a lock */
+	msg_fatal("close database %s: %m", dict_bloomm->bloom_path);
+    myfree((void *) bits);
+    myfree((void *) dict_bloomm->hashes);
+    myfree(dict_bloomm->bloom_path);
+    myfree(dict_bloomm->tmp_path);
+    if (dict->fold_buf)
+	vstring_free(dict->fold_buf);
+    dict_free(dict);
+}
+
+/* dict_bloomm_open - create database as file.tmp */
+
+static DICT *dict_bloomm_open(const char *path, int dict_flags)
+{
+    DICT_BLOOMM *dict_bloomm;
+    char   *bloom_path;
+    char   *tmp_path;
+    int     fd;
+    struct stat st0, st1;
+
+    /*
+     * Let the optimizer worry about eliminating redundant code.
+     */
+#define DICT_BLOOMM_OPEN_RETURN(d) do { \
+	DICT *__d = (d); \
+	if (bloom_path) \
+	    myfree(bloom_path); \
+	if (tmp_path) \
+	    myfree(tmp_path); \
+	return (__d); \
+    } while (0)
+
+    bloom_path = concatenate(path, DICT_BLOOM_SUFFIX, (char *) 0);
+    tmp_path = concatenate(path, DICT_BLOOM_TMP_SUFFIX, (char *) 0);
+
+    /*
+     * As with CDB files, repeat until we have opened *and* locked an
+     * *existing* temporary file, because a concurrent postmap process may
+     * have renamed it away.
+     */
+    for (;;) {
+	if ((fd = open(tmp_path, O_RDWR | O_CREAT, 0644)) < 0)
+	    DICT_BLOOMM_OPEN_RETURN(dict_surrogate(DICT_TYPE_BLOOM, path,
+						   O_RDWR, dict_flags,
+						   "open database %s: %m",
+						   tmp_path));
+	if (fstat(fd, &st0) < 0)
+	    msg_fatal("fstat(%s): %m", tmp_path);
+	if (myflock(fd, INTERNAL_LOCK, MYFLOCK_OP_EXCLUSIVE) < 0)
+	    msg_fatal("lock %s: %m", tmp_path);
+	if (stat(tmp_path, &st1) < 0)
+	    msg_fatal("stat(%s): %m", tmp_path);
+	if (st0.st_ino == st1.st_ino && st0.st_dev == st1.st_dev
+	    && st0.st_rdev == st1.st_rdev && st0.st_nlink == st1.st_nlink
+	    && st0.st_nlink > 0)
+	    break;				/* successfully opened */
+	close(fd);
+    }
+    if (st0.st_size > 0 && ftruncate(fd, (off_t) 0) < 0)
+	msg_fatal("truncate %s: %m", tmp_path);
+
+    dict_bloomm = (DICT_BLOOMM *) dict_alloc(DICT_TYPE_BLOOM, path,
+					     sizeof(*dict_bloomm));
+    dict_bloomm->dict.close = dict_bloomm_close;
+    dict_bloomm->dict.update = dict_bloomm_update;
+    dict_bloomm->fd = fd;
+    dict_bloomm->bloom_path = bloom_path;
+    dict_bloomm->tmp_path = tmp_path;
+    bloom_path = tmp_path = 0;			/* DICT_BLOOMM_OPEN_RETURN() */
+    dict_bloomm->key_count = 0;
+    dict_bloomm->key_limit = 1024;
+    dict_bloomm->hashes = (uint64_t *)
+	mymalloc(2 * dict_bloomm->key_limit * sizeof(uint64_t));
+    dict_bloomm->dict.owner.uid = st1.st_uid;
+    dict_bloomm->dict.owner.status = (st1.st_uid != 0);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+
+    dict_bloomm->dict.flags = dict_flags | DICT_FLAG_FIXED;
+    if (dict_flags & DICT_FLAG_FOLD_FIX)
+	dict_bloomm->dict.fold_buf = vstring_alloc(10);
+
+    DICT_BLOOMM_OPEN_RETURN(DICT_DEBUG (&dict_bloomm->dict));
+}
+
+/* dict_bloom_open - open data base for query mode or create mode */
+
+DICT   *dict_bloom_open(const char *path, int open_flags, int dict_flags)
+{
+    switch (open_flags & (O_RDONLY | O_RDWR | O_WRONLY | O_CREAT | O_TRUNC)) {
+    case O_RDONLY:				/* query mode */
+	return (dict_bloomq_open(path, dict_flags));
+    case O_WRONLY | O_CREAT | O_TRUNC:		/* create mode */
+    case O_RDWR | O_CREAT | O_TRUNC:		/* sloppiness */
+	return (dict_bloomm_open(path, dict_flags));
+    default:
+	msg_fatal("dict_bloom_open: inappropriate open flags for bloom database"
+		  " - specify O_RDONLY or O_WRONLY|O_CREAT|O_TRUNC");
+    }
+}
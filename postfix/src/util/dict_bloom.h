@@ -0,0 +1,34 @@
+#ifndef _DICT_BLOOM_H_INCLUDED_
+#define _DICT_BLOOM_H_INCLUDED_
+
+/*++
+/* NAME
+/*	dict_bloom 3h
+/* SUMMARY
+/*	dictionary manager interface to Bloom filter files
+/* SYNOPSIS
+/*	#include <dict_bloom.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <dict.h>
+#include <mkmap.h>
+
+ /*
+  * External interface.
+  */
+#define DICT_TYPE_BLOOM "bloom"
+
+extern DICT *dict_bloom_open(const char *, int, int);
+extern MKMAP *mkmap_bloom_open(const char *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
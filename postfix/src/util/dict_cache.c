@@ -79,7 +79,8 @@
 /*	the entry is scheduled for "delete behind", the delete
 /*	operation is canceled (because of this, the cache must be
 /*	opened with DICT_FLAG_DUP_REPLACE). This function does not
-/*	return in case of error.
+/*	return in case of error. With write-behind, a database
+/*	error is logged when the change is written.
 /*
 /*	dict_cache_delete() removes the specified cache entry.  If
 /*	this is the "current" entry of a "sequence" operation, the
@@ -118,6 +119,20 @@
 /*	interval to stop cache cleanup.
 /* .IP "CA_DICT_CACHE_CTL_CONTEXT(void *context)"
 /*	Application context that is passed to the validator function.
+/* .IP "CA_DICT_CACHE_CTL_MEM_SIZE(int size)"
+/*	Keep up to \fIsize\fR recently-used entries in memory, including
+/*	entries that were not found, and serve lookups from memory.
+/*	This assumes that all updates are made through this cache
+/*	handle. Specify zero to disable (default).
+/* .IP "CA_DICT_CACHE_CTL_WRITE_DELAY(int delay)"
+/*	Enable write-behind: dict_cache_update() and dict_cache_delete()
+/*	queue their change in memory, and the changes are written
+/*	to the database every \fIdelay\fR seconds, before a "sequence"
+/*	operation starts, when many changes are queued, and when
+/*	the cache is closed. With DICT_FLAG_SYNC_UPDATE, only the
+/*	last write of a batch is synchronized. Changes that are still
+/*	queued when the process crashes are lost. Specify zero to
+/*	write each change immediately (default).
 /* .RE
 /* .PP
 /*	dict_cache_name() returns the name of the specified cache.
@@ -193,6 +208,8 @@
 #include <dict.h>
 #include <mymalloc.h>
 #include <events.h>
+#include <htable.h>
+#include <ctable.h>
 #include <dict_cache.h>
 
 /* Application-specific. */
@@ -229,6 +246,11 @@ struct DICT_CACHE {
     int     retained;			/* entries retained in cleanup run */
     int     dropped;			/* entries removed in cleanup run */
 
+    /* In-memory cache and write-behind support. */
+    CTABLE *mem_cache;			/* recently-used entries, or null */
+    HTABLE *pending;			/* queued changes, or null */
+    int     write_delay;		/* time between write-behind runs */
+
     /* Rate-limited logging support. */
     int     log_delay;
     time_t  upd_log_stamp;		/* last update warning */
@@ -265,13 +287,217 @@ struct DICT_CACHE {
   */
 #define DC_LAST_CACHE_CLEANUP_COMPLETED "_LAST_CACHE_CLEANUP_COMPLETED_"
 
+ /*
+  * An in-memory cache entry. A null value means that the entry was not
+  * found; an entry with a lookup error is refreshed upon the next access.
+  * The pending change table has the same null-value convention: a null
+  * value means "delete".
+  */
+typedef struct {
+    char   *value;			/* cache_val, or null */
+    int     error;			/* database error */
+} DC_MEM_ENTRY;
+
+ /*
+  * Write queued changes before the queue becomes unreasonably large.
+  */
+#define DC_PENDING_LIMIT	1000
+
+ /*
+  * Value that dict_cache_mem_create() stores instead of looking up the
+  * database.
+  */
+static int dc_mem_preset;
+static const char *dc_mem_preset_val;
+
+/* dict_cache_mem_create - ctable call-back, create in-memory entry */
+
+static void *dict_cache_mem_create(const char *cache_key, void *context)
+{
+    DICT_CACHE *cp = (DICT_CACHE *) context;
+    DC_MEM_ENTRY *ep = (DC_MEM_ENTRY *) mymalloc(sizeof(*ep));
+    const char *cache_val;
+
+    if (dc_mem_preset) {
+	cache_val = dc_mem_preset_val;
+	ep->error = DICT_ERR_NONE;
+    } else {
+	cache_val = dict_get(cp->db, cache_key);
+	ep->error = cp->db->error;
+    }
+    ep->value = cache_val ? mystrdup(cache_val) : 0;
+    return ((void *) ep);
+}
+
+/* dict_cache_mem_delete - ctable call-back, destroy in-memory entry */
+
+static void dict_cache_mem_delete(void *data, void *unused_context)
+{
+    DC_MEM_ENTRY *ep = (DC_MEM_ENTRY *) data;
+
+    if (ep->value)
+	myfree(ep->value);
+    myfree((void *) ep);
+}
+
+/* dict_cache_mem_get - find in-memory entry, load from database */
+
+static const DC_MEM_ENTRY *dict_cache_mem_get(DICT_CACHE *cp,
+					              const char *cache_key)
+{
+    const DC_MEM_ENTRY *ep;
+    int     was_cached;
+
+    was_cached = ctable_exists(cp->mem_cache, cache_key);
+    ep = (const DC_MEM_ENTRY *) ctable_locate(cp->mem_cache, cache_key);
+    if (was_cached && ep->error != 0)
+	ep = (const DC_MEM_ENTRY *) ctable_refresh(cp->mem_cache, cache_key);
+    return (ep);
+}
+
+/* dict_cache_mem_set - replace in-memory entry */
+
+static void dict_cache_mem_set(DICT_CACHE *cp, const char *cache_key,
+			               int preset, const char *cache_val)
+{
+    if (cp->mem_cache == 0)
+	return;
+    dc_mem_preset = preset;
+    dc_mem_preset_val = cache_val;
+    (void) ctable_refresh(cp->mem_cache, cache_key);
+    dc_mem_preset = 0;
+    dc_mem_preset_val = 0;
+}
+
+#define DC_MEM_SET(cp, key, val)	dict_cache_mem_set((cp), (key), 1, (val))
+#define DC_MEM_RELOAD(cp, key)		dict_cache_mem_set((cp), (key), 0, (char *) 0)
+
+/* dict_cache_pending_free - destroy queued change */
+
+static void dict_cache_pending_free(void *value)
+{
+    if (value)
+	myfree(value);
+}
+
+/* dict_cache_flush - write queued changes */
+
+static void dict_cache_flush(DICT_CACHE *cp)
+{
+    const char *myname = "dict_cache_flush";
+    HTABLE_INFO **ht_list;
+    HTABLE_INFO **ht;
+    DICT   *db = cp->db;
+    int     saved_flags;
+    const char *cache_key;
+    const char *cache_val;
+
+    if (cp->pending == 0 || cp->pending->used == 0)
+	return;
+    if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
+	msg_info("%s: %s: %ld changes", myname, cp->name,
+		 (long) cp->pending->used);
+
+    /*
+     * Synchronize only after the last update in the batch.
+     */
+    saved_flags = db->flags;
+    db->flags &= ~DICT_FLAG_SYNC_UPDATE;
+    ht_list = htable_list(cp->pending);
+    for (ht = ht_list; *ht; ht++) {
+	if (ht[1] == 0)
+	    db->flags = saved_flags;
+	cache_key = ht[0]->key;
+	cache_val = (const char *) ht[0]->value;
+
+	/*
+	 * Don't delete the "current" entry of a "sequence" operation; use
+	 * delete-behind instead, as with dict_cache_delete().
+	 */
+	if (cache_val != 0) {
+	    if (DC_IS_SCHEDULED_FOR_DELETE_BEHIND(cp)
+		&& DC_MATCH_SAVED_CURRENT_KEY(cp, cache_key))
+		DC_CANCEL_DELETE_BEHIND(cp);
+	    if (dict_put(db, cache_key, cache_val) != 0) {
+		msg_rate_delay(&cp->upd_log_stamp, cp->log_delay, msg_warn,
+			       "%s: could not update entry for %s",
+			       cp->name, cache_key);
+		DC_MEM_RELOAD(cp, cache_key);
+	    }
+	} else if (DC_MATCH_SAVED_CURRENT_KEY(cp, cache_key)) {
+	    DC_SCHEDULE_FOR_DELETE_BEHIND(cp);
+	} else if (dict_del(db, cache_key) != 0 && db->error != 0) {
+	    msg_rate_delay(&cp->del_log_stamp, cp->log_delay, msg_warn,
+			   "%s: could not delete entry for %s",
+			   cp->name, cache_key);
+	    DC_MEM_RELOAD(cp, cache_key);
+	}
+    }
+    db->flags = saved_flags;
+    myfree((void *) ht_list);
+    htable_free(cp->pending, dict_cache_pending_free);
+    cp->pending = htable_create(DC_PENDING_LIMIT);
+}
+
+/* dict_cache_flush_event - periodic write-behind */
+
+static void dict_cache_flush_event(int unused_event, void *cache_context)
+{
+    DICT_CACHE *cp = (DICT_CACHE *) cache_context;
+
+    dict_cache_flush(cp);
+    event_request_timer(dict_cache_flush_event, cache_context,
+			cp->write_delay);
+}
+
+/* dict_cache_pending_put - queue change */
+
+static void dict_cache_pending_put(DICT_CACHE *cp, const char *cache_key,
+				           const char *cache_val)
+{
+    HTABLE_INFO *ht;
+    char   *saved_val = cache_val ? mystrdup(cache_val) : 0;
+
+    if ((ht = htable_locate(cp->pending, cache_key)) != 0) {
+	dict_cache_pending_free(ht->value);
+	ht->value = saved_val;
+    } else {
+	(void) htable_enter(cp->pending, cache_key, saved_val);
+	if (cp->pending->used >= DC_PENDING_LIMIT)
+	    dict_cache_flush(cp);
+    }
+}
+
+/* dict_cache_get - look up entry in memory or database */
+
+static const char *dict_cache_get(DICT_CACHE *cp, const char *cache_key,
+				          int *error)
+{
+    HTABLE_INFO *ht;
+    const DC_MEM_ENTRY *ep;
+    const char *cache_val;
+
+    if (cp->pending && (ht = htable_locate(cp->pending, cache_key)) != 0) {
+	*error = DICT_ERR_NONE;
+	return ((const char *) ht->value);
+    }
+    if (cp->mem_cache) {
+	ep = dict_cache_mem_get(cp, cache_key);
+	*error = ep->error;
+	return (ep->value);
+    }
+    cache_val = dict_get(cp->db, cache_key);
+    *error = cp->db->error;
+    return (cache_val);
+}
+
 /* dict_cache_lookup - load entry from cache */
 
 const char *dict_cache_lookup(DICT_CACHE *cp, const char *cache_key)
 {
     const char *myname = "dict_cache_lookup";
     const char *cache_val;
-    DICT   *db = cp->db;
+    int     error;
 
     /*
      * Search for the cache entry. Don't return an entry that is scheduled
@@ -284,16 +510,16 @@ const char *dict_cache_lookup(DICT_CACHE *cp, const char *cache_key)
 		     myname, cache_key);
 	DICT_ERR_VAL_RETURN(cp, DICT_ERR_NONE, (char *) 0);
     } else {
-	cache_val = dict_get(db, cache_key);
-	if (cache_val == 0 && db->error != 0)
+	cache_val = dict_cache_get(cp, cache_key, &error);
+	if (cache_val == 0 && error != 0)
 	    msg_rate_delay(&cp->get_log_stamp, cp->log_delay, msg_warn,
 			   "%s: cache lookup for '%s' failed due to error",
 			   cp->name, cache_key);
 	if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
 	    msg_info("%s: key=%s value=%s", myname, cache_key,
-		     cache_val ? cache_val : db->error ?
+		     cache_val ? cache_val : error ?
 		     "error" : "(not found)");
-	DICT_ERR_VAL_RETURN(cp, db->error, cache_val);
+	DICT_ERR_VAL_RETURN(cp, error, cache_val);
     }
 }
 
@@ -317,10 +543,19 @@ int     dict_cache_update(DICT_CACHE *cp, const char *cache_key,
     }
     if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
 	msg_info("%s: key=%s value=%s", myname, cache_key, cache_val);
+    if (cp->pending) {
+	dict_cache_pending_put(cp, cache_key, cache_val);
+	DC_MEM_SET(cp, cache_key, cache_val);
+	DICT_ERR_VAL_RETURN(cp, DICT_ERR_NONE, DICT_STAT_SUCCESS);
+    }
     put_res = dict_put(db, cache_key, cache_val);
-    if (put_res != 0)
+    if (put_res != 0) {
 	msg_rate_delay(&cp->upd_log_stamp, cp->log_delay, msg_warn,
 		  "%s: could not update entry for %s", cp->name, cache_key);
+	DC_MEM_RELOAD(cp, cache_key);
+    } else {
+	DC_MEM_SET(cp, cache_key, cache_val);
+    }
     DICT_ERR_VAL_RETURN(cp, db->error, put_res);
 }
 
@@ -330,6 +565,7 @@ int     dict_cache_delete(DICT_CACHE *cp, const char *cache_key)
 {
     const char *myname = "dict_cache_delete";
     int     del_res;
+    int     error;
     DICT   *db = cp->db;
 
     /*
@@ -343,11 +579,27 @@ int     dict_cache_delete(DICT_CACHE *cp, const char *cache_key)
 	    msg_info("%s: key=%s (current entry - schedule for delete-behind)",
 		     myname, cache_key);
 	DICT_ERR_VAL_RETURN(cp, DICT_ERR_NONE, DICT_STAT_SUCCESS);
+    } else if (cp->pending) {
+	if (dict_cache_get(cp, cache_key, &error) == 0) {
+	    if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
+		msg_info("%s: key=%s (%s)", myname, cache_key,
+			 error ? "error" : "not found");
+	    DICT_ERR_VAL_RETURN(cp, error, DICT_STAT_FAIL);
+	}
+	dict_cache_pending_put(cp, cache_key, (char *) 0);
+	DC_MEM_SET(cp, cache_key, (char *) 0);
+	if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
+	    msg_info("%s: key=%s (found - queued)", myname, cache_key);
+	DICT_ERR_VAL_RETURN(cp, DICT_ERR_NONE, DICT_STAT_SUCCESS);
     } else {
 	del_res = dict_del(db, cache_key);
 	if (del_res != 0)
 	    msg_rate_delay(&cp->del_log_stamp, cp->log_delay, msg_warn,
 		  "%s: could not delete entry for %s", cp->name, cache_key);
+	if (del_res == 0 || db->error == 0)
+	    DC_MEM_SET(cp, cache_key, (char *) 0);
+	else
+	    DC_MEM_RELOAD(cp, cache_key);
 	if (cp->user_flags & DICT_CACHE_FLAG_VERBOSE)
 	    msg_info("%s: key=%s (%s)", myname, cache_key,
 		     del_res == 0 ? "found" :
@@ -370,6 +622,12 @@ int     dict_cache_sequence(DICT_CACHE *cp, int first_next,
     char   *previous_curr_val;
     DICT   *db = cp->db;
 
+    /*
+     * Write queued changes, so that a new scan sees them.
+     */
+    if (first_next == DICT_SEQ_FUN_FIRST)
+	dict_cache_flush(cp);
+
     /*
      * Find the first or next database entry. Hide the record with the cache
      * cleanup completion time stamp.
@@ -419,6 +677,9 @@ int     dict_cache_sequence(DICT_CACHE *cp, int first_next,
 	    msg_rate_delay(&cp->del_log_stamp, cp->log_delay, msg_warn,
 			   "%s: could not delete entry for %s",
 			   cp->name, previous_curr_key);
+	if (cp->pending == 0
+	    || htable_locate(cp->pending, previous_curr_key) == 0)
+	    DC_MEM_SET(cp, previous_curr_key, (char *) 0);
     }
 
     /*
@@ -544,6 +805,7 @@ void    dict_cache_control(DICT_CACHE *cp,...)
     int     cache_cleanup_is_active = (cp->exp_validator && cp->exp_interval);
     va_list ap;
     int     name;
+    int     size;
 
     /*
      * Update the control settings.
@@ -570,6 +832,35 @@ void    dict_cache_control(DICT_CACHE *cp,...)
 	case DICT_CACHE_CTL_CONTEXT:
 	    cp->exp_context = va_arg(ap, void *);
 	    break;
+	case DICT_CACHE_CTL_MEM_SIZE:
+	    if ((size = va_arg(ap, int)) < 0)
+		msg_panic("%s: bad %s memory cache size %d",
+			  myname, cp->name, size);
+	    if (cp->mem_cache) {
+		ctable_free(cp->mem_cache);
+		cp->mem_cache = 0;
+	    }
+	    if (size > 0)
+		cp->mem_cache = ctable_create(size, dict_cache_mem_create,
+					      dict_cache_mem_delete,
+					      (void *) cp);
+	    break;
+	case DICT_CACHE_CTL_WRITE_DELAY:
+	    if ((cp->write_delay = va_arg(ap, int)) < 0)
+		msg_panic("%s: bad %s write delay %d",
+			  myname, cp->name, cp->write_delay);
+	    if (cp->pending) {
+		dict_cache_flush(cp);
+		htable_free(cp->pending, dict_cache_pending_free);
+		cp->pending = 0;
+		event_cancel_timer(dict_cache_flush_event, (void *) cp);
+	    }
+	    if (cp->write_delay > 0) {
+		cp->pending = htable_create(DC_PENDING_LIMIT);
+		event_request_timer(dict_cache_flush_event, (void *) cp,
+				    cp->write_delay);
+	    }
+	    break;
 	default:
 	    msg_panic("%s: bad command: %d", myname, name);
 	}
@@ -645,6 +936,9 @@ DICT_CACHE *dict_cache_open(const char *dbname, int open_flags, int dict_flags)
     cp->exp_context = 0;
     cp->retained = 0;
     cp->dropped = 0;
+    cp->mem_cache = 0;
+    cp->pending = 0;
+    cp->write_delay = 0;
     cp->log_delay = DC_DEF_LOG_DELAY;
     cp->upd_log_stamp = cp->get_log_stamp =
 	cp->del_log_stamp = cp->seq_log_stamp = 0;
@@ -659,9 +953,12 @@ void    dict_cache_close(DICT_CACHE *cp)
 
     /*
      * Cancel the cache cleanup thread. This also logs (and resets)
-     * statistics for a scan that is in progress.
+     * statistics for a scan that is in progress. Write queued changes, and
+     * discard the in-memory cache.
      */
-    dict_cache_control(cp, DICT_CACHE_CTL_INTERVAL, 0, DICT_CACHE_CTL_END);
+    dict_cache_control(cp, DICT_CACHE_CTL_INTERVAL, 0,
+		       DICT_CACHE_CTL_WRITE_DELAY, 0,
+		       DICT_CACHE_CTL_MEM_SIZE, 0, DICT_CACHE_CTL_END);
 
     /*
      * Destroy the DICT_CACHE object.
@@ -706,6 +1003,8 @@ const char *dict_cache_name(DICT_CACHE *cp)
 		"\n\telapsed <level> (0=don't show elapsed time)" \
 		"\n\tlmdb_map_size <limit> (initial LMDB size limit)" \
 		"\n\tcache <type>:<name> (switch to named database)" \
+		"\n\tmemory <size> (in-memory cache size, 0=off)" \
+		"\n\twrite_delay <time> (write-behind interval, 0=off)" \
 		"\n\tstatus (show map size, cache, pending requests)" \
 		"\n\n\tTo manage pending requests:" \
 		"\n\treset (discard pending requests)" \
@@ -881,6 +1180,8 @@ static void show_status(DICT_CACHE_TEST *tp, DICT_CACHE *dp)
     vstream_printf("lmdb_map_size\t%ld\n", (long) dict_lmdb_map_size);
 #endif
     vstream_printf("cache\t%s\n", dp ? dp->name : "(none)");
+    if (dp && dp->pending)
+	vstream_printf("pending\t%ld\n", (long) dp->pending->used);
 
     if (tp->used == 0)
 	vstream_printf("No pending requests\n");
@@ -1104,6 +1405,21 @@ int     main(int argc, char **argv)
 		dict_cache_close(cache);
 	    cache = dict_cache_open(args->argv[1], O_CREAT | O_RDWR,
 				    DICT_CACHE_OPEN_FLAGS);
+	} else if (strcmp(args->argv[0], "memory") == 0 && args->argc == 2) {
+	    if (cache == 0)
+		msg_warn("no cache");
+	    else
+		dict_cache_control(cache, CA_DICT_CACHE_CTL_MEM_SIZE(
+						      atoi(args->argv[1])),
+				   CA_DICT_CACHE_CTL_END);
+	} else if (strcmp(args->argv[0], "write_delay") == 0
+		   && args->argc == 2) {
+	    if (cache == 0)
+		msg_warn("no cache");
+	    else
+		dict_cache_control(cache, CA_DICT_CACHE_CTL_WRITE_DELAY(
+						      atoi(args->argv[1])),
+				   CA_DICT_CACHE_CTL_END);
 	} else if (strcmp(args->argv[0], "reset") == 0 && args->argc == 1) {
 	    reset_requests(test_job);
 	} else if (strcmp(args->argv[0], "run") == 0 && args->argc == 1) {
@@ -41,6 +41,8 @@ extern const char *dict_cache_name(DICT_CACHE *);
 #define DICT_CACHE_CTL_INTERVAL		2	/* cleanup interval */
 #define DICT_CACHE_CTL_VALIDATOR	3	/* call-back validator */
 #define DICT_CACHE_CTL_CONTEXT		4	/* call-back context */
+#define DICT_CACHE_CTL_MEM_SIZE		5	/* in-memory cache size */
+#define DICT_CACHE_CTL_WRITE_DELAY	6	/* write-behind interval */
 
 /* Safer API: type-checked arguments, external use. */
 #define CA_DICT_CACHE_CTL_END		DICT_CACHE_CTL_END
@@ -48,6 +50,8 @@ extern const char *dict_cache_name(DICT_CACHE *);
 #define CA_DICT_CACHE_CTL_INTERVAL(v)	DICT_CACHE_CTL_INTERVAL, CHECK_VAL(DICT_CACHE, int, (v))
 #define CA_DICT_CACHE_CTL_VALIDATOR(v)	DICT_CACHE_CTL_VALIDATOR, CHECK_VAL(DICT_CACHE, DICT_CACHE_VALIDATOR_FN, (v))
 #define CA_DICT_CACHE_CTL_CONTEXT(v)	DICT_CACHE_CTL_CONTEXT, CHECK_PTR(DICT_CACHE, void, (v))
+#define CA_DICT_CACHE_CTL_MEM_SIZE(v)	DICT_CACHE_CTL_MEM_SIZE, CHECK_VAL(DICT_CACHE, int, (v))
+#define CA_DICT_CACHE_CTL_WRITE_DELAY(v) DICT_CACHE_CTL_WRITE_DELAY, CHECK_VAL(DICT_CACHE, int, (v))
 
 CHECK_VAL_HELPER_DCL(DICT_CACHE, int);
 CHECK_VAL_HELPER_DCL(DICT_CACHE, DICT_CACHE_VALIDATOR_FN);
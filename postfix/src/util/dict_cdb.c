@@ -23,6 +23,13 @@
 /*	Flags passed to open(). Specify O_RDONLY or O_WRONLY|O_CREAT|O_TRUNC.
 /* .IP dict_flags
 /*	Flags used by the dictionary interface.
+/* .PP
+/*	With TinyCDB, a lookup result that was stored with a null
+/*	terminator is returned as a pointer into the memory-mapped
+/*	database instead of a copy. The database file is never
+/*	modified in place, so the result remains valid until the
+/*	dictionary is closed, which is longer than the dict(3) API
+/*	promises.
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
 /* DIAGNOSTICS
@@ -109,9 +116,9 @@ static const char *dict_cdbq_lookup(DICT *dict, const char *name)
     /* CDB is constant, so do not try to acquire a lock. */
 
     /*
-     * Optionally fold the key.
+     * Optionally fold the key. Don't copy a key that is already folded.
      */
-    if (dict->flags & DICT_FLAG_FOLD_FIX) {
+    if ((dict->flags & DICT_FLAG_FOLD_FIX) && lowercase_needed(name)) {
 	if (dict->fold_buf == 0)
 	    dict->fold_buf = vstring_alloc(10);
 	vstring_strcpy(dict->fold_buf, name);
@@ -142,6 +149,17 @@ static const char *dict_cdbq_lookup(DICT *dict, const char *name)
 
     if (status) {
 	vlen = cdb_datalen(&dict_cdbq->cdb);
+
+	/*
+	 * Zero-copy: return a null-terminated value from the memory-mapped
+	 * database.
+	 */
+#ifdef TINYCDB_VERSION
+	if (vlen > 0 && (result = cdb_getdata(&dict_cdbq->cdb)) != 0
+	    && result[vlen - 1] == 0)
+	    return (result);
+	result = 0;
+#endif
 	if (len < vlen) {
 	    if (buf == 0)
 		buf = mymalloc(vlen + 1);
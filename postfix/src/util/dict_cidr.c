@@ -104,6 +104,8 @@ static void dict_cidr_close(DICT *dict)
     DICT_CIDR_ENTRY *entry;
     DICT_CIDR_ENTRY *next;
 
+    if (dict_cidr->head)
+	cidr_match_index_free(&(dict_cidr->head->cidr_info));
     for (entry = dict_cidr->head; entry; entry = next) {
 	next = (DICT_CIDR_ENTRY *) entry->cidr_info.next;
 	myfree(entry->value);
@@ -357,6 +359,13 @@ DICT   *dict_cidr_open(const char *mapname, int open_flags, int dict_flags)
     if (rule_stack)
 	(void) mvect_free(&mvect);
 
+    /*
+     * Large tables are mostly plain address patterns. Search those in time
+     * proportional to the address length instead of the number of rules.
+     */
+    if (dict_cidr->head)
+	cidr_match_index(&(dict_cidr->head->cidr_info));
+
     dict_file_purge_buffers(&dict_cidr->dict);
     DICT_CIDR_OPEN_RETURN(DICT_DEBUG (&dict_cidr->dict));
 }
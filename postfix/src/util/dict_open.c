@@ -26,6 +26,12 @@
 /*	DICT	*dict;
 /*	const char *key;
 /*
+/*	const char *dict_get_first(dict, keys, count, index)
+/*	DICT	*dict;
+/*	const char **keys;
+/*	ssize_t	count;
+/*	ssize_t	*index;
+/*
 /*	int	dict_del(dict, key)
 /*	DICT	*dict;
 /*	const char *key;
@@ -39,6 +45,8 @@
 /*	void	dict_close(dict)
 /*	DICT	*dict;
 /*
+/*	const char *dict_reload_changed()
+/*
 /*	typedef struct {
 /* .in +4
 /*	    char   *type;
@@ -232,6 +240,14 @@
 /*	implementation. Make a copy if the result is to be modified,
 /*	or if the result is to survive multiple table lookups.
 /*
+/*	dict_get_first() looks up \fIcount\fR keys in the specified
+/*	order, and returns the value for the first key that is
+/*	found. The \fIindex\fR result is the position of that key,
+/*	of the key that caused a lookup error (see dict->error), or
+/*	\fIcount\fR when no key was found. By default this is
+/*	implemented with dict_get(); a client-server table such as
+/*	proxy: can send all keys in one request.
+/*
 /*	dict_put() stores the specified key and value into the named
 /*	dictionary. A zero (DICT_STAT_SUCCESS) result means the
 /*	update was made.
@@ -247,6 +263,19 @@
 /*	dict_close() closes the specified dictionary and cleans up the
 /*	associated data structures.
 /*
+/*	dict_reload_changed() reopens each registered dictionary
+/*	that has changed (see dict_changed_name(3)) with the
+/*	dict_open3() arguments that were used to open it, and
+/*	replaces the old dictionary handle under all its names (see
+/*	dict_replace(3)). Only read-only dictionaries are reopened.
+/*	Lookup results from the old handle become invalid; call
+/*	this function between requests, not while a caller may still
+/*	use a lookup result. The result is a null pointer when all
+/*	changed dictionaries were reopened, otherwise the name of a
+/*	changed dictionary that could not be reopened, for example
+/*	because the file is not accessible after chroot(2). The
+/*	caller should then restart the process as before.
+/*
 /*	dict_open_register() adds support for a new dictionary type.
 /*	NOTE: this function does not copy its argument.
 /*
@@ -336,6 +365,7 @@
 #include <mymalloc.h>
 #include <msg.h>
 #include <dict.h>
+#include <dict_bloom.h>
 #include <dict_cdb.h>
 #include <dict_env.h>
 #include <dict_unix.h>
@@ -401,6 +431,7 @@ static const DICT_OPEN_INFO dict_open_info[] = {
     DICT_TYPE_RANDOM, dict_random_open, 0,
     DICT_TYPE_UNION, dict_union_open, 0,
     DICT_TYPE_INLINE, dict_inline_open, 0,
+    DICT_TYPE_BLOOM, dict_bloom_open, mkmap_bloom_open,
 #ifndef USE_DYNAMIC_MAPS
 #ifdef HAS_PCRE
     DICT_TYPE_PCRE, dict_pcre_open, 0,
@@ -513,9 +544,64 @@ DICT   *dict_open3(const char *dict_type, const char *dict_name,
     if ((dict->flags & DICT_FLAG_UTF8_ACTIVE) == 0
 	&& DICT_NEED_UTF8_ACTIVATION(util_utf8_enable, dict_flags))
 	dict = dict_utf8_activate(dict);
+    /* Optional lookup statistics, outside the UTF-8 proxy. */
+    if (dict_stats_interval > 0 && dict->stats == 0)
+	dict_stats_activate(dict);
+    /* Remember how to reopen this dictionary. */
+    dict->open_flags = open_flags;
+    dict->open_dict_flags = dict_flags;
     return (dict);
 }
 
+/* dict_reload_one - dict_walk() call-back */
+
+static void dict_reload_one(const char *dict_name, DICT *dict, void *context)
+{
+    const char **failed = (const char **) context;
+    int     saved_allow_surrogate;
+    DICT   *new_dict;
+
+    if (*failed != 0 || dict_handle_changed(dict) == 0)
+	return;
+
+    /*
+     * Don't reopen a dictionary that may be updated by this process, or
+     * that was not opened with dict_open3().
+     */
+    if (dict->open_flags != O_RDONLY) {
+	*failed = dict_name;
+	return;
+    }
+
+    /*
+     * Reopen without terminating on error. A surrogate dictionary has no
+     * file to check for changes, and would replace a working dictionary
+     * with one that fails all requests.
+     */
+    saved_allow_surrogate = dict_allow_surrogate;
+    dict_allow_surrogate = 1;
+    new_dict = dict_open3(dict->type, dict->name, dict->open_flags,
+			  dict->open_dict_flags);
+    dict_allow_surrogate = saved_allow_surrogate;
+    if (new_dict->stat_fd < 0) {
+	dict_close(new_dict);
+	*failed = dict_name;
+	return;
+    }
+    msg_info("table %s has changed -- reopened", dict_name);
+    dict_replace(dict, new_dict);
+}
+
+/* dict_reload_changed - reopen changed dictionaries in place */
+
+const char *dict_reload_changed(void)
+{
+    const char *failed = 0;
+
+    dict_walk(dict_reload_one, (void *) &failed);
+    return (failed);
+}
+
 /* dict_open_register - register dictionary type */
 
 void    dict_open_register(const DICT_OPEN_INFO *dp)
@@ -615,3 +701,240 @@ int     main(int argc, char **argv)
 }
 
 #endif
+
+#ifdef BENCH
+
+ /*
+  * Time successful and unsuccessful lookups, and measure the memory used by
+  * an open table, for the specified dictionary types. The memory figure is
+  * the growth of the process high-water mark, so it is meaningful only for
+  * the first table. Each table is built
+  * from generated entries that look like typical access(5), transport(5)
+  * or mynetworks data: host names for lookup tables and lists of regular
+  * expressions, and network blocks for CIDR tables.
+  */
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <msg_vstream.h>
+
+#define BENCH_PATH	"dict_open_bench"
+#define BENCH_LIST_MAX	1000		/* linear-search table size */
+
+#define STR(x)	vstring_str(x)
+
+static double bench_since(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec) * 1e9
+	    + (now.tv_usec - start->tv_usec) * 1e3);
+}
+
+static long bench_maxrss(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+	msg_fatal("getrusage: %m");
+    return ((long) usage.ru_maxrss);
+}
+
+/* bench_key - generate lookup key for entry i, or a near miss */
+
+static const char *bench_key(VSTRING *buf, const char *type, long i, int hit)
+{
+    if (strcmp(type, DICT_TYPE_CIDR) == 0)
+	vstring_sprintf(buf, "%d.%ld.%ld.%ld", hit ? 10 : 11,
+			(i >> 8) & 0xff, i & 0xff, (i * 7) & 0xff);
+    else
+	vstring_sprintf(buf, "%s%lx.client.example.com", hit ? "" : "x", i);
+    return (vstring_str(buf));
+}
+
+/* bench_table - build table with the specified number of entries */
+
+static char *bench_table(const char *type, long *count)
+{
+    VSTRING *buf = vstring_alloc(100);
+    VSTRING *key = vstring_alloc(100);
+    VSTREAM *fp;
+    MKMAP  *mkmap;
+    char   *spec;
+    long    i;
+
+    /*
+     * Tables that are searched linearly are small in practice.
+     */
+    if (strcmp(type, DICT_TYPE_CIDR) == 0 || strcmp(type, DICT_TYPE_PCRE) == 0
+	|| strcmp(type, DICT_TYPE_REGEXP) == 0
+	|| strcmp(type, DICT_TYPE_INLINE) == 0
+	|| strcmp(type, DICT_TYPE_PIPE) == 0
+	|| strcmp(type, DICT_TYPE_UNION) == 0)
+	if (*count > BENCH_LIST_MAX)
+	    *count = BENCH_LIST_MAX;
+
+    /*
+     * Inline tables and compositions of inline tables.
+     */
+    if (strcmp(type, DICT_TYPE_INLINE) == 0
+	|| strcmp(type, DICT_TYPE_PIPE) == 0
+	|| strcmp(type, DICT_TYPE_UNION) == 0) {
+	vstring_sprintf(buf, "%s:{", DICT_TYPE_INLINE);
+	for (i = 0; i < *count; i++)
+	    vstring_sprintf_append(buf, "%s%s=OK", i ? ", " : "",
+				   bench_key(key, type, i, 1));
+	vstring_strcat(buf, "}");
+	if (strcmp(type, DICT_TYPE_PIPE) == 0)
+	    vstring_sprintf(key, "%s:{%s, %s:{OK=DUNNO}}", type, STR(buf),
+			    DICT_TYPE_INLINE);
+	else if (strcmp(type, DICT_TYPE_UNION) == 0)
+	    vstring_sprintf(key, "%s:{%s:{x=y}, %s}", type, DICT_TYPE_INLINE,
+			    STR(buf));
+	else
+	    vstring_strcpy(key, STR(buf));
+	spec = mystrdup(STR(key));
+    }
+
+    /*
+     * Text-file based tables.
+     */
+    else if (strcmp(type, DICT_TYPE_CIDR) == 0
+	     || strcmp(type, DICT_TYPE_PCRE) == 0
+	     || strcmp(type, DICT_TYPE_REGEXP) == 0
+	     || strcmp(type, DICT_TYPE_THASH) == 0) {
+	if ((fp = vstream_fopen(BENCH_PATH, O_WRONLY | O_CREAT | O_TRUNC,
+				0644)) == 0)
+	    msg_fatal("open %s: %m", BENCH_PATH);
+	for (i = 0; i < *count; i++) {
+	    if (strcmp(type, DICT_TYPE_CIDR) == 0)
+		vstream_fprintf(fp, "10.%ld.%ld.0/24 OK\n",
+				(i >> 8) & 0xff, i & 0xff);
+	    else if (strcmp(type, DICT_TYPE_THASH) == 0)
+		vstream_fprintf(fp, "%s OK\n", bench_key(key, type, i, 1));
+	    else
+		vstream_fprintf(fp, "/^%lx\\.client\\.example\\.com$/ OK\n", i);
+	}
+	if (vstream_fclose(fp))
+	    msg_fatal("write %s: %m", BENCH_PATH);
+	spec = concatenate(type, ":", BENCH_PATH, (char *) 0);
+    }
+
+    /*
+     * Indexed tables, built as with postmap(1).
+     */
+    else {
+	mkmap = mkmap_open(type, BENCH_PATH, O_RDWR | O_CREAT | O_TRUNC,
+			   DICT_FLAG_DUP_REPLACE);
+	for (i = 0; i < *count; i++)
+	    mkmap_append(mkmap, bench_key(key, type, i, 1), "OK");
+	mkmap_close(mkmap);
+	spec = concatenate(type, ":", BENCH_PATH, (char *) 0);
+    }
+    vstring_free(key);
+    vstring_free(buf);
+    return (spec);
+}
+
+/* bench_cleanup - remove table files */
+
+static void bench_cleanup(const char *type)
+{
+    char   *path;
+
+    (void) unlink(BENCH_PATH);
+    path = concatenate(BENCH_PATH, ".", type, (char *) 0);
+    (void) unlink(path);
+    myfree(path);
+    path = concatenate(BENCH_PATH, ".db", (char *) 0);
+    (void) unlink(path);
+    myfree(path);
+}
+
+int     main(int argc, char **argv)
+{
+    VSTRING *key = vstring_alloc(100);
+    ARGV   *types;
+    DICT   *dict;
+    char   *spec;
+    struct timeval start;
+    double  t_hit, t_miss;
+    long    rss;
+    long    count;
+    long    lookups = 100000;
+    long    found;
+    long    i;
+    long    n;
+    int     ch;
+    char  **cpp;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    count = 100000;
+    while ((ch = GETOPT(argc, argv, "l:n:")) > 0) {
+	switch (ch) {
+	case 'l':
+	    if ((lookups = atol(optarg)) <= 0)
+		msg_fatal("bad lookup count: %s", optarg);
+	    break;
+	case 'n':
+	    if ((count = atol(optarg)) <= 0)
+		msg_fatal("bad entry count: %s", optarg);
+	    break;
+	default:
+	    msg_fatal("usage: %s [-l lookups] [-n entries] type...", argv[0]);
+	}
+    }
+    types = dict_mapnames();
+    for (argv += optind; *argv; argv++) {
+	for (cpp = types->argv; *cpp; cpp++)
+	    if (strcmp(*cpp, *argv) == 0)
+		break;
+	if (*cpp == 0) {
+	    vstream_printf("%s: not available\n", *argv);
+	    vstream_fflush(VSTREAM_OUT);
+	    continue;
+	}
+	i = count;
+	spec = bench_table(*argv, &i);
+	rss = bench_maxrss();
+	dict = dict_open(spec, O_RDONLY, DICT_FLAG_LOCK);
+	rss = bench_maxrss() - rss;
+
+	/*
+	 * Look up keys in an order that defeats caching.
+	 */
+	found = 0;
+	GETTIMEOFDAY(&start);
+	for (n = 0; n < lookups; n++)
+	    found += (dict_get(dict, bench_key(key, *argv,
+					       (n * 7919) % i, 1)) != 0);
+	t_hit = bench_since(&start);
+	if (found != lookups)
+	    msg_fatal("%s: found %ld of %ld keys", spec, found, lookups);
+	GETTIMEOFDAY(&start);
+	for (n = 0; n < lookups; n++)
+	    found += (dict_get(dict, bench_key(key, *argv,
+					       (n * 7919) % i, 0)) != 0);
+	t_miss = bench_since(&start);
+	if (found != lookups)
+	    msg_fatal("%s: found non-existent keys", *argv);
+	vstream_printf("%s: %ld entries, ns/lookup: hit %.0f miss %.0f, "
+		       "lookups/s %.0f, maxrss +%ld kB\n",
+		       *argv, i, t_hit / lookups, t_miss / lookups,
+		       2e9 * lookups / (t_hit + t_miss), rss);
+	vstream_fflush(VSTREAM_OUT);
+	dict_close(dict);
+	myfree(spec);
+	bench_cleanup(*argv);
+    }
+    argv_free(types);
+    vstring_free(key);
+    return (0);
+}
+
+#endif
@@ -14,6 +14,35 @@
 /*	dict_pcre_open() opens the named file and compiles the contained
 /*	regular expressions. The result object can be used to match strings
 /*	against the table.
+/*
+/*	As an optimization, dict_pcre_open() extracts from each
+/*	pattern a literal string that every match must contain, when
+/*	the pattern is simple enough. Of the literals that qualify, it
+/*	chooses the one that is used by the fewest patterns, so that a
+/*	common prefix such as "^Subject:" does not defeat the
+/*	optimization. A lookup first searches the lookup string for
+/*	all those literals at once, and then skips each pattern whose
+/*	literal was not found, without calling the PCRE library. With
+/*	large tables, most patterns are skipped this way. Within a
+/*	sequence of patterns that each have a literal, a lookup
+/*	proceeds directly to the first pattern whose literal was
+/*	found, so that the time to skip patterns does not depend on
+/*	the number of patterns.
+/*
+/*	Patterns are JIT compiled when the PCRE library supports
+/*	it. With PCRE2, all patterns in a table share one JIT stack
+/*	and one match data block, so that a lookup does not allocate
+/*	memory. PCRE2 JIT compilation is postponed until a pattern
+/*	is executed for the first time. This makes opening a large
+/*	table several times faster, so that a process that never
+/*	reaches a pattern does not pay for its JIT compilation.
+/*	Patterns are still compiled, and syntax errors are still
+/*	reported, when the table is opened.
+/*
+/*	When dict_pcre_open() is called with verbose logging enabled
+/*	(for example, "postmap -v -q"), each rule keeps count of its
+/*	pattern executions, matches, and execution time. These
+/*	statistics are logged when the table is closed.
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
 /*	pcre_table(5) PCRE table configuration
@@ -42,6 +71,7 @@
 /* System library. */
 
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <stdio.h>			/* sprintf() prototype */
 #include <stdlib.h>
 #include <unistd.h>
@@ -75,6 +105,9 @@
 #include "mac_parse.h"
 #include "warn_stat.h"
 #include "mvect.h"
+#include "ac_match.h"
+#include "argv.h"
+#include "re_prefilter.h"
 
  /*
   * Backwards compatibility.
@@ -82,8 +115,10 @@
 #if HAS_PCRE == 1
  /* PCRE Legacy JIT supprt. */
 #ifdef PCRE_STUDY_JIT_COMPILE
+#define DICT_PCRE_STUDY_OPTIONS	PCRE_STUDY_JIT_COMPILE
 #define DICT_PCRE_FREE_STUDY(x)	pcre_free_study(x)
 #else
+#define DICT_PCRE_STUDY_OPTIONS	0
 #define DICT_PCRE_FREE_STUDY(x)	pcre_free((char *) (x))
 #endif
 
@@ -121,12 +156,21 @@
 #define DICT_PCRE_CODE		pcre2_code
 #define DICT_PCRE_CODE_FREE(x)	pcre2_code_free(x)
 
- /* PCRE2 Old-style hints versus new-style match_data. */
-#define DICT_PCRE_MATCH_HINT_TYPE pcre2_match_data *
-#define DICT_PCRE_MATCH_HINT_NAME match_data
+ /*
+  * PCRE2 has no per-pattern hints. Instead, the rule remembers the JIT
+  * compilation status; the match_data is shared by all rules in a table.
+  */
+#define DICT_PCRE_MATCH_HINT_TYPE int
+#define DICT_PCRE_MATCH_HINT_NAME jit_status
 #define DICT_PCRE_MATCH_HINT(x)	((x)->DICT_PCRE_MATCH_HINT_NAME)
-#define DICT_PCRE_MATCH_HINT_FREE(x) \
-	pcre2_match_data_free(DICT_PCRE_MATCH_HINT(x))
+#define DICT_PCRE_MATCH_HINT_FREE(x) ((void) 0)
+
+ /* PCRE2 JIT compilation status before the first pattern execution. */
+#define DICT_PCRE_JIT_PENDING	1
+
+ /* PCRE2 JIT stack, shared by all rules in a table. */
+#define DICT_PCRE_JIT_STACK_START (32 * 1024)
+#define DICT_PCRE_JIT_STACK_MAX	(512 * 1024)
 
  /* PCRE2 Pattern options. */
 #define DICT_PCRE_CASELESS	PCRE2_CASELESS
@@ -171,6 +215,15 @@ typedef struct {
     DICT_PCRE_MATCH_HINT_TYPE DICT_PCRE_MATCH_HINT_NAME;
 } DICT_PCRE_ENGINE;
 
+ /*
+  * Per-rule statistics, maintained only with verbose logging.
+  */
+typedef struct {
+    long    execs;			/* pattern executions */
+    long    matches;			/* successful executions */
+    long    usecs;			/* total execution time */
+} DICT_PCRE_STATS;
+
  /*
   * Compiled generic rule, and subclasses that derive from it.
   */
@@ -187,6 +240,10 @@ typedef struct {
     char   *replacement;		/* replacement string */
     int     match;			/* positive or negative match */
     size_t  max_sub;			/* largest $number in replacement */
+    int     literal;			/* pre-filter literal ID or -1 */
+    ARGV   *candidates;			/* literals, until compiled */
+    int     run_last;			/* last literal ID in run, or -1 */
+    DICT_PCRE_STATS stats;		/* verbose mode statistics */
 } DICT_PCRE_MATCH_RULE;
 
 typedef struct {
@@ -195,6 +252,9 @@ typedef struct {
     DICT_PCRE_MATCH_HINT_TYPE DICT_PCRE_MATCH_HINT_NAME;
     int     match;			/* positive or negative match */
     struct DICT_PCRE_RULE *endif_rule;	/* matching endif rule */
+    int     literal;			/* pre-filter literal ID or -1 */
+    ARGV   *candidates;			/* literals, until compiled */
+    DICT_PCRE_STATS stats;		/* verbose mode statistics */
 } DICT_PCRE_IF_RULE;
 
  /*
@@ -204,8 +264,31 @@ typedef struct {
     DICT    dict;			/* generic members */
     DICT_PCRE_RULE *head;
     VSTRING *expansion_buf;		/* lookup result */
+    AC_MATCH *literals;			/* pre-filter */
+    DICT_PCRE_RULE **literal_rules;	/* literal ID to rule */
+#if HAS_PCRE == 2
+    pcre2_match_data *match_data;	/* shared by all rules */
+    pcre2_match_context *match_context;	/* JIT stack binding */
+    pcre2_jit_stack *jit_stack;		/* shared by all rules */
+#endif
+    int     stats;			/* maintain rule statistics */
 } DICT_PCRE;
 
+ /*
+  * Pre-filter. A pattern can't match when the literal that every match
+  * must contain is not found in the lookup string. See re_prefilter(3).
+  */
+#define DICT_PCRE_CANT_MATCH(dict_pcre, literal) \
+	((literal) >= 0 && !ac_match_found((dict_pcre)->literals, (literal)))
+
+ /*
+  * Candidate selection. A run is a sequence of two or more positive match
+  * rules that each have a literal; their literal IDs are consecutive. When
+  * a rule in a run can't match, the lookup resumes at the first rule in the
+  * run whose literal was found, or at the first rule after the run.
+  */
+#define DICT_PCRE_MIN_RUN	2
+
 #if HAS_PCRE == 1
 static int dict_pcre_init = 0;		/* flag need to init pcre library */
 
@@ -395,23 +478,133 @@ static void dict_pcre_exec_error(const char *mapname, int lineno, int errval)
   * Inlined to reduce function call overhead in the time-critical loop.
   */
 #if HAS_PCRE == 1
-#define DICT_PCRE_EXEC(ctxt, map, line, pattern, hints, match, str, len) \
+#define DICT_PCRE_EXEC(ctxt, dp, line, pattern, hints, match, str, len) \
     ((ctxt).matches = pcre_exec((pattern), (hints), (str), (len), \
 				NULL_STARTOFFSET, NULL_EXEC_OPTIONS, \
 				(ctxt).offsets, PCRE_MAX_CAPTURE * 3), \
      (ctxt).matches > 0 ? (match) : \
      (ctxt).matches == PCRE_ERROR_NOMATCH ? !(match) : \
-     (dict_pcre_exec_error((map), (line), (ctxt).matches), 0))
+     (dict_pcre_exec_error((dp)->dict.name, (line), (ctxt).matches), 0))
 #else
-#define DICT_PCRE_EXEC(ctxt, map, line, pattern, match_data, match, str, len) \
+#define DICT_PCRE_EXEC(ctxt, dp, line, pattern, jit_status, match, str, len) \
     ((ctxt).matches = pcre2_match((pattern), (unsigned char *) (str), (len), \
 				NULL_STARTOFFSET, NULL_EXEC_OPTIONS, \
-				(match_data), (pcre2_match_context *) 0), \
+				(dp)->match_data, (dp)->match_context), \
      (ctxt).matches > 0 ? (match) : \
      (ctxt).matches == PCRE2_ERROR_NOMATCH ? !(match) : \
-     (dict_pcre_exec_error((map), (line), (ctxt).matches), 0))
+     (dict_pcre_exec_error((dp)->dict.name, (line), (ctxt).matches), 0))
 #endif
 
+ /*
+  * Statistics, for "postmap -v -q". The clock is read only when statistics
+  * are enabled.
+  */
+#define DICT_PCRE_STATS_START(dp, start) do { \
+	if ((dp)->stats) \
+	    GETTIMEOFDAY(start); \
+    } while (0)
+
+#define DICT_PCRE_STATS_END(dp, sp, start, found) do { \
+	if ((dp)->stats) \
+	    dict_pcre_stats_update((sp), (start), (found)); \
+    } while (0)
+
+#define DICT_PCRE_STATS_INIT(sp) do { \
+	(sp)->execs = (sp)->matches = (sp)->usecs = 0; \
+    } while (0)
+
+ /*
+  * Whether a pattern was JIT compiled.
+  */
+#if HAS_PCRE == 1
+#ifdef PCRE_INFO_JIT
+#define DICT_PCRE_JIT(x) dict_pcre_jit((x)->pattern, (x)->hints)
+
+/* dict_pcre_jit - find out if legacy pattern was JIT compiled */
+
+static int dict_pcre_jit(const pcre *pattern, const pcre_extra *hints)
+{
+    int     jit;
+
+    return (pcre_fullinfo(pattern, hints, PCRE_INFO_JIT, (void *) &jit) == 0
+	    && jit != 0);
+}
+
+#else
+#define DICT_PCRE_JIT(x) 0
+#endif
+#else					/* HAS_PCRE */
+#define DICT_PCRE_JIT(x) ((x)->jit_status == 0)
+#endif					/* HAS_PCRE */
+
+ /*
+  * Deferred JIT compilation, before a pattern is executed.
+  */
+#if HAS_PCRE == 1
+#define DICT_PCRE_JIT_LAZY(dp, x) ((void) 0)
+#else
+#define DICT_PCRE_JIT_LAZY(dp, x) do { \
+	if ((x)->jit_status == DICT_PCRE_JIT_PENDING) \
+	    (x)->jit_status = dict_pcre_jit_compile((dp), (x)->pattern); \
+    } while (0)
+
+/* dict_pcre_jit_compile - JIT compile pattern upon first use */
+
+static int dict_pcre_jit_compile(DICT_PCRE *dict_pcre, pcre2_code *pattern)
+{
+    int     jit_status;
+
+    /* Fall back to the interpreter if JIT is unavailable. */
+    if ((jit_status = pcre2_jit_compile(pattern, PCRE2_JIT_COMPLETE)) != 0)
+	return (jit_status);
+
+    /*
+     * One JIT stack is reused by all rules and all lookups. Without it,
+     * complex patterns are limited to 32kB of JIT stack.
+     */
+    if (dict_pcre->jit_stack == 0) {
+	dict_pcre->jit_stack =
+	    pcre2_jit_stack_create(DICT_PCRE_JIT_STACK_START,
+				   DICT_PCRE_JIT_STACK_MAX,
+				   (pcre2_general_context *) 0);
+	dict_pcre->match_context =
+	    pcre2_match_context_create((pcre2_general_context *) 0);
+	if (dict_pcre->jit_stack == 0 || dict_pcre->match_context == 0)
+	    msg_fatal("pcre map %s: out of memory", dict_pcre->dict.name);
+	pcre2_jit_stack_assign(dict_pcre->match_context,
+			       (pcre2_jit_callback) 0, dict_pcre->jit_stack);
+    }
+    return (0);
+}
+
+#endif					/* HAS_PCRE */
+
+/* dict_pcre_stats_update - update rule statistics */
+
+static void dict_pcre_stats_update(DICT_PCRE_STATS *sp,
+				           struct timeval *start, int found)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    sp->execs += 1;
+    sp->matches += (found != 0);
+    sp->usecs += (now.tv_sec - start->tv_sec) * 1000000
+	+ (now.tv_usec - start->tv_usec);
+}
+
+/* dict_pcre_stats_log - log rule statistics */
+
+static void dict_pcre_stats_log(DICT_PCRE *dict_pcre, DICT_PCRE_RULE *rule,
+				        DICT_PCRE_STATS *sp, int jit)
+{
+    if (sp->execs > 0)
+	msg_info("pcre map %s, line %d: %ld executions, %ld matches, "
+		 "%ld.%03ld ms%s", dict_pcre->dict.name, rule->lineno,
+		 sp->execs, sp->matches, sp->usecs / 1000, sp->usecs % 1000,
+		 jit ? "" : " (no JIT)");
+}
+
 /* dict_pcre_lookup - match string and perform optional substitution */
 
 static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
@@ -422,6 +615,9 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
     DICT_PCRE_MATCH_RULE *match_rule;
     int     lookup_len = strlen(lookup_string);
     DICT_PCRE_EXPAND_CONTEXT ctxt;
+    int     next;
+    int     found;
+    struct timeval start;
 
     dict->error = 0;
 
@@ -437,6 +633,13 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 	vstring_strcpy(dict->fold_buf, lookup_string);
 	lookup_string = lowercase(vstring_str(dict->fold_buf));
     }
+
+    /*
+     * Pre-filter: find all pattern literals in the lookup string.
+     */
+    if (dict_pcre->literals)
+	ac_match_scan(dict_pcre->literals, lookup_string, lookup_len);
+
     for (rule = dict_pcre->head; rule; rule = rule->next) {
 
 	switch (rule->op) {
@@ -446,10 +649,31 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 	     */
 	case DICT_PCRE_OP_MATCH:
 	    match_rule = (DICT_PCRE_MATCH_RULE *) rule;
-	    if (!DICT_PCRE_EXEC(ctxt, dict->name, rule->lineno,
-				match_rule->pattern,
-				DICT_PCRE_MATCH_HINT(match_rule),
-			      match_rule->match, lookup_string, lookup_len))
+	    if (match_rule->run_last >= 0) {
+		next = ac_match_next(dict_pcre->literals, match_rule->literal);
+		if (next != match_rule->literal) {
+		    /* Resume after the rule that precedes the candidate. */
+		    if (next < 0 || next > match_rule->run_last)
+			rule = dict_pcre->literal_rules[match_rule->run_last];
+		    else
+			rule = dict_pcre->literal_rules[next - 1];
+		    continue;
+		}
+	    } else if (DICT_PCRE_CANT_MATCH(dict_pcre, match_rule->literal)) {
+		if (match_rule->match)
+		    continue;
+		/* Negative match; the pre-scan ensured that max_sub == 0. */
+		return (match_rule->replacement);
+	    }
+	    DICT_PCRE_JIT_LAZY(dict_pcre, match_rule);
+	    DICT_PCRE_STATS_START(dict_pcre, &start);
+	    found = DICT_PCRE_EXEC(ctxt, dict_pcre, rule->lineno,
+				   match_rule->pattern,
+				   DICT_PCRE_MATCH_HINT(match_rule),
+				   match_rule->match, lookup_string,
+				   lookup_len);
+	    DICT_PCRE_STATS_END(dict_pcre, &match_rule->stats, &start, found);
+	    if (!found)
 		continue;
 
 	    /*
@@ -470,7 +694,7 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 #if HAS_PCRE == 1
 	    ctxt.match_rule = match_rule;
 #else
-	    ctxt.ovector = pcre2_get_ovector_pointer(match_rule->match_data);
+	    ctxt.ovector = pcre2_get_ovector_pointer(dict_pcre->match_data);
 #endif
 	    ctxt.lookup_string = lookup_string;
 
@@ -490,10 +714,19 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 	     */
 	case DICT_PCRE_OP_IF:
 	    if_rule = (DICT_PCRE_IF_RULE *) rule;
-	    if (DICT_PCRE_EXEC(ctxt, dict->name, rule->lineno,
-			       if_rule->pattern,
-			       DICT_PCRE_MATCH_HINT(if_rule),
-			       if_rule->match, lookup_string, lookup_len))
+	    if (DICT_PCRE_CANT_MATCH(dict_pcre, if_rule->literal)) {
+		found = !if_rule->match;
+	    } else {
+		DICT_PCRE_JIT_LAZY(dict_pcre, if_rule);
+		DICT_PCRE_STATS_START(dict_pcre, &start);
+		found = DICT_PCRE_EXEC(ctxt, dict_pcre, rule->lineno,
+				       if_rule->pattern,
+				       DICT_PCRE_MATCH_HINT(if_rule),
+				       if_rule->match, lookup_string,
+				       lookup_len);
+		DICT_PCRE_STATS_END(dict_pcre, &if_rule->stats, &start, found);
+	    }
+	    if (found)
 		continue;
 	    /* An IF without matching ENDIF has no "endif" rule. */
 	    if ((rule = if_rule->endif_rule) == 0)
@@ -528,6 +761,9 @@ static void dict_pcre_close(DICT *dict)
 	switch (rule->op) {
 	case DICT_PCRE_OP_MATCH:
 	    match_rule = (DICT_PCRE_MATCH_RULE *) rule;
+	    if (dict_pcre->stats)
+		dict_pcre_stats_log(dict_pcre, rule, &match_rule->stats,
+				    DICT_PCRE_JIT(match_rule));
 	    if (match_rule->pattern)
 		DICT_PCRE_CODE_FREE(match_rule->pattern);
 	    DICT_PCRE_MATCH_HINT_FREE(match_rule);
@@ -536,6 +772,9 @@ static void dict_pcre_close(DICT *dict)
 	    break;
 	case DICT_PCRE_OP_IF:
 	    if_rule = (DICT_PCRE_IF_RULE *) rule;
+	    if (dict_pcre->stats)
+		dict_pcre_stats_log(dict_pcre, rule, &if_rule->stats,
+				    DICT_PCRE_JIT(if_rule));
 	    if (if_rule->pattern)
 		DICT_PCRE_CODE_FREE(if_rule->pattern);
 	    DICT_PCRE_MATCH_HINT_FREE(if_rule);
@@ -549,6 +788,18 @@ static void dict_pcre_close(DICT *dict)
     }
     if (dict_pcre->expansion_buf)
 	vstring_free(dict_pcre->expansion_buf);
+    if (dict_pcre->literals)
+	ac_match_free(dict_pcre->literals);
+    if (dict_pcre->literal_rules)
+	myfree((void *) dict_pcre->literal_rules);
+#if HAS_PCRE == 2
+    if (dict_pcre->match_data)
+	pcre2_match_data_free(dict_pcre->match_data);
+    if (dict_pcre->match_context)
+	pcre2_match_context_free(dict_pcre->match_context);
+    if (dict_pcre->jit_stack)
+	pcre2_jit_stack_free(dict_pcre->jit_stack);
+#endif
     if (dict->fold_buf)
 	vstring_free(dict->fold_buf);
     dict_free(dict);
@@ -703,7 +954,8 @@ static int dict_pcre_compile(const char *mapname, int lineno,
 		 mapname, lineno, errptr, error);
 	return (0);
     }
-    engine->hints = pcre_study(engine->pattern, 0, &error);
+    engine->hints = pcre_study(engine->pattern, DICT_PCRE_STUDY_OPTIONS,
+				&error);
     if (error != 0) {
 	msg_warn("pcre map %s, line %d: error while studying regex: %s",
 		 mapname, lineno, error);
@@ -726,12 +978,134 @@ static int dict_pcre_compile(const char *mapname, int lineno,
 	vstring_free(buf);
 	return (0);
     }
-    engine->match_data = pcre2_match_data_create_from_pattern(
-					       engine->pattern, (void *) 0);
+    /* Postpone JIT compilation until the pattern is used. */
+    engine->jit_status = DICT_PCRE_JIT_PENDING;
 #endif
     return (1);
 }
 
+/* dict_pcre_candidates - save pattern literals for the pre-filter */
+
+static ARGV *dict_pcre_candidates(const DICT_PCRE_REGEXP *pattern)
+{
+    if (pattern->options & DICT_PCRE_EXTENDED)
+	return (0);
+    return (re_prefilter_literals(pattern->regexp, RE_PREFILTER_SYNTAX_PCRE));
+}
+
+/* dict_pcre_prefilter - choose pattern literals, build the pre-filter */
+
+static void dict_pcre_prefilter(DICT_PCRE *dict_pcre)
+{
+    DICT_PCRE_RULE *rule;
+    DICT_PCRE_RULE **rules;
+    ARGV  **candidates;
+    ARGV  **cand_list;
+    int    *literal;
+    int     count;
+    int     first;
+    int     last;
+    int     n;
+
+    /*
+     * Only IF and MATCH rules have literals.
+     */
+#define DICT_PCRE_RULE_LITERAL(r, c, l) do { \
+	if ((r)->op == DICT_PCRE_OP_MATCH) { \
+	    (c) = &((DICT_PCRE_MATCH_RULE *) (r))->candidates; \
+	    (l) = &((DICT_PCRE_MATCH_RULE *) (r))->literal; \
+	} else if ((r)->op == DICT_PCRE_OP_IF) { \
+	    (c) = &((DICT_PCRE_IF_RULE *) (r))->candidates; \
+	    (l) = &((DICT_PCRE_IF_RULE *) (r))->literal; \
+	} else { \
+	    (c) = 0; \
+	    (l) = 0; \
+	} \
+    } while (0)
+
+    for (count = 0, rule = dict_pcre->head; rule; rule = rule->next) {
+	DICT_PCRE_RULE_LITERAL(rule, candidates, literal);
+	if (candidates != 0 && *candidates != 0)
+	    count++;
+    }
+    if (count == 0)
+	return;
+
+    /*
+     * Literal IDs are assigned in rule order.
+     */
+    rules = dict_pcre->literal_rules =
+	(DICT_PCRE_RULE **) mymalloc(count * sizeof(*rules));
+    cand_list = (ARGV **) mymalloc(count * sizeof(*cand_list));
+    for (n = 0, rule = dict_pcre->head; rule; rule = rule->next) {
+	DICT_PCRE_RULE_LITERAL(rule, candidates, literal);
+	if (candidates == 0 || *candidates == 0)
+	    continue;
+	cand_list[n] = *candidates;
+	*candidates = 0;
+	*literal = n;
+	rules[n++] = rule;
+    }
+    dict_pcre->literals = re_prefilter_create(cand_list, count);
+    myfree((void *) cand_list);
+
+    /*
+     * Find sequences of adjacent positive match rules.
+     */
+#define DICT_PCRE_RUN_RULE(r) ((r)->op == DICT_PCRE_OP_MATCH \
+	&& ((DICT_PCRE_MATCH_RULE *) (r))->match)
+
+    for (first = 0; first < count; first = last + 1) {
+	last = first;
+	if (DICT_PCRE_RUN_RULE(rules[first])) {
+	    while (last + 1 < count && rules[last]->next == rules[last + 1]
+		   && DICT_PCRE_RUN_RULE(rules[last + 1]))
+		last++;
+	    if (last - first + 1 >= DICT_PCRE_MIN_RUN)
+		for (n = first; n <= last; n++)
+		    ((DICT_PCRE_MATCH_RULE *) rules[n])->run_last = last;
+	}
+    }
+}
+
+#if HAS_PCRE == 2
+
+/* dict_pcre_match_init - set up match data for all rules */
+
+static void dict_pcre_match_init(DICT_PCRE *dict_pcre)
+{
+    DICT_PCRE_RULE *rule;
+    DICT_PCRE_CODE *pattern;
+    uint32_t capture_count;
+    uint32_t max_capture = 0;
+
+    /*
+     * One match_data block, large enough for the pattern with the most
+     * captures, is reused by all rules and all lookups.
+     */
+    for (rule = dict_pcre->head; rule; rule = rule->next) {
+	if (rule->op == DICT_PCRE_OP_MATCH) {
+	    pattern = ((DICT_PCRE_MATCH_RULE *) rule)->pattern;
+	} else if (rule->op == DICT_PCRE_OP_IF) {
+	    pattern = ((DICT_PCRE_IF_RULE *) rule)->pattern;
+	} else {
+	    continue;
+	}
+	if (pcre2_pattern_info(pattern, PCRE2_INFO_CAPTURECOUNT,
+			       (void *) &capture_count) != 0)
+	    msg_panic("pcre map %s, line %d: pcre2_pattern_info failed",
+		      dict_pcre->dict.name, rule->lineno);
+	if (capture_count > max_capture)
+	    max_capture = capture_count;
+    }
+    dict_pcre->match_data =
+	pcre2_match_data_create(max_capture + 1, (pcre2_general_context *) 0);
+    if (dict_pcre->match_data == 0)
+	msg_fatal("pcre map %s: out of memory", dict_pcre->dict.name);
+}
+
+#endif
+
 /* dict_pcre_rule_alloc - fill in a generic rule structure */
 
 static DICT_PCRE_RULE *dict_pcre_rule_alloc(int op, int lineno, size_t size)
@@ -898,6 +1272,10 @@ static DICT_PCRE_RULE *dict_pcre_parse_rule(DICT *dict, const char *mapname,
 	    match_rule->replacement = mystrdup(p);
 	match_rule->pattern = engine.pattern;
 	DICT_PCRE_MATCH_HINT(match_rule) = DICT_PCRE_MATCH_HINT(&engine);
+	match_rule->literal = -1;
+	match_rule->candidates = dict_pcre_candidates(&regexp);
+	match_rule->run_last = -1;
+	DICT_PCRE_STATS_INIT(&match_rule->stats);
 	return ((DICT_PCRE_RULE *) match_rule);
     }
 
@@ -947,6 +1325,9 @@ static DICT_PCRE_RULE *dict_pcre_parse_rule(DICT *dict, const char *mapname,
 	if_rule->pattern = engine.pattern;
 	DICT_PCRE_MATCH_HINT(if_rule) = DICT_PCRE_MATCH_HINT(&engine);
 	if_rule->endif_rule = 0;
+	if_rule->literal = -1;
+	if_rule->candidates = dict_pcre_candidates(&regexp);
+	DICT_PCRE_STATS_INIT(&if_rule->stats);
 	return ((DICT_PCRE_RULE *) if_rule);
     }
 
@@ -1055,6 +1436,14 @@ DICT   *dict_pcre_open(const char *mapname, int open_flags, int dict_flags)
 	dict_pcre->dict.fold_buf = vstring_alloc(10);
     dict_pcre->head = 0;
     dict_pcre->expansion_buf = 0;
+    dict_pcre->literals = 0;
+    dict_pcre->literal_rules = 0;
+#if HAS_PCRE == 2
+    dict_pcre->match_data = 0;
+    dict_pcre->match_context = 0;
+    dict_pcre->jit_stack = 0;
+#endif
+    dict_pcre->stats = (msg_verbose > 0);
 
 #if HAS_PCRE == 1
     if (dict_pcre_init == 0) {
@@ -1114,6 +1503,11 @@ DICT   *dict_pcre_open(const char *mapname, int open_flags, int dict_flags)
     if (rule_stack)
 	(void) mvect_free(&mvect);
 
+    dict_pcre_prefilter(dict_pcre);
+#if HAS_PCRE == 2
+    dict_pcre_match_init(dict_pcre);
+#endif
+
     dict_file_purge_buffers(&dict_pcre->dict);
     DICT_PCRE_OPEN_RETURN(DICT_DEBUG (&dict_pcre->dict));
 }
@@ -14,6 +14,19 @@
 /*	dict_regexp_open() opens the named file and compiles the contained
 /*	regular expressions. The result object can be used to match strings
 /*	against the table.
+/*
+/*	As an optimization, dict_regexp_open() extracts from each
+/*	primary pattern a literal string that every match must
+/*	contain, when the pattern is simple enough. Of the literals
+/*	that qualify, it chooses the one that is used by the fewest
+/*	patterns, so that a common prefix such as "^Subject:" does not
+/*	defeat the optimization. A lookup first searches the lookup
+/*	string for all those literals at once, and then skips each
+/*	pattern whose literal was not found, without calling
+/*	regexec(). Within a sequence of patterns that each have a
+/*	literal, a lookup proceeds directly to the first pattern whose
+/*	literal was found, so that the time to skip patterns does not
+/*	depend on the number of patterns.
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
 /*	regexp_table(5) regular expression table configuration
@@ -68,6 +81,9 @@
 #include "mac_parse.h"
 #include "warn_stat.h"
 #include "mvect.h"
+#include "ac_match.h"
+#include "argv.h"
+#include "re_prefilter.h"
 
  /*
   * Support for IF/ENDIF based on an idea by Bert Driehuis.
@@ -102,6 +118,9 @@ typedef struct {
     int     second_match;		/* positive or negative match */
     char   *replacement;		/* replacement text */
     size_t  max_sub;			/* largest $number in replacement */
+    int     literal;			/* pre-filter literal ID or -1 */
+    ARGV   *candidates;			/* literals, until compiled */
+    int     run_last;			/* last literal ID in run, or -1 */
 } DICT_REGEXP_MATCH_RULE;
 
 typedef struct {
@@ -109,6 +128,8 @@ typedef struct {
     regex_t *expr;			/* the condition */
     int     match;			/* positive or negative match */
     struct DICT_REGEXP_RULE *endif_rule;/* matching endif rule */
+    int     literal;			/* pre-filter literal ID or -1 */
+    ARGV   *candidates;			/* literals, until compiled */
 } DICT_REGEXP_IF_RULE;
 
  /*
@@ -119,8 +140,26 @@ typedef struct {
     regmatch_t *pmatch;			/* matched substring info */
     DICT_REGEXP_RULE *head;		/* first rule */
     VSTRING *expansion_buf;		/* lookup result */
+    AC_MATCH *literals;			/* pre-filter */
+    DICT_REGEXP_RULE **literal_rules;	/* literal ID to rule */
 } DICT_REGEXP;
 
+ /*
+  * Pre-filter. A pattern can't match when the literal that every match
+  * must contain is not found in the lookup string. See re_prefilter(3).
+  */
+#define DICT_REGEXP_CANT_MATCH(dict_regexp, literal) \
+	((literal) >= 0 && !ac_match_found((dict_regexp)->literals, (literal)))
+
+ /*
+  * Candidate selection. A run is a sequence of two or more match rules with
+  * a positive primary pattern that each have a literal; their literal IDs
+  * are consecutive. When a rule in a run can't match, the lookup resumes at
+  * the first rule in the run whose literal was found, or at the first rule
+  * after the run.
+  */
+#define DICT_REGEXP_MIN_RUN	2
+
  /*
   * Macros to make dense code more readable.
   */
@@ -222,6 +261,7 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
     DICT_REGEXP_MATCH_RULE *match_rule;
     DICT_REGEXP_EXPAND_CONTEXT expand_context;
     int     error;
+    int     next;
 
     dict->error = 0;
 
@@ -237,6 +277,14 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 	vstring_strcpy(dict->fold_buf, lookup_string);
 	lookup_string = lowercase(vstring_str(dict->fold_buf));
     }
+
+    /*
+     * Pre-filter: find all pattern literals in the lookup string.
+     */
+    if (dict_regexp->literals)
+	ac_match_scan(dict_regexp->literals, lookup_string,
+		      strlen(lookup_string));
+
     for (rule = dict_regexp->head; rule; rule = rule->next) {
 
 	switch (rule->op) {
@@ -247,13 +295,28 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 	     */
 	case DICT_REGEXP_OP_MATCH:
 	    match_rule = (DICT_REGEXP_MATCH_RULE *) rule;
-	    if (!DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
-				     match_rule->first_exp,
-				     match_rule->first_match,
-				     lookup_string,
-				     match_rule->max_sub > 0 ?
-				     match_rule->max_sub + 1 : 0,
-				     dict_regexp->pmatch))
+	    if (match_rule->run_last >= 0) {
+		next = ac_match_next(dict_regexp->literals, match_rule->literal);
+		if (next != match_rule->literal) {
+		    /* Resume after the rule that precedes the candidate. */
+		    if (next < 0 || next > match_rule->run_last)
+			rule = dict_regexp->literal_rules[match_rule->run_last];
+		    else
+			rule = dict_regexp->literal_rules[next - 1];
+		    continue;
+		}
+	    }
+	    if (DICT_REGEXP_CANT_MATCH(dict_regexp, match_rule->literal)) {
+		/* Negative match; the pre-scan ensured that max_sub == 0. */
+		if (match_rule->first_match)
+		    continue;
+	    } else if (!DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
+					    match_rule->first_exp,
+					    match_rule->first_match,
+					    lookup_string,
+					    match_rule->max_sub > 0 ?
+					    match_rule->max_sub + 1 : 0,
+					    dict_regexp->pmatch))
 		continue;
 	    if (match_rule->second_exp
 		&& !DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
@@ -297,7 +360,9 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 	     */
 	case DICT_REGEXP_OP_IF:
 	    if_rule = (DICT_REGEXP_IF_RULE *) rule;
-	    if (DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
+	    if (DICT_REGEXP_CANT_MATCH(dict_regexp, if_rule->literal) ?
+		!if_rule->match :
+		DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
 			       if_rule->expr, if_rule->match, lookup_string,
 				    NULL_SUBSTITUTIONS, NULL_MATCH_RESULT))
 		continue;
@@ -363,6 +428,10 @@ static void dict_regexp_close(DICT *dict)
 	myfree((void *) dict_regexp->pmatch);
     if (dict_regexp->expansion_buf)
 	vstring_free(dict_regexp->expansion_buf);
+    if (dict_regexp->literals)
+	ac_match_free(dict_regexp->literals);
+    if (dict_regexp->literal_rules)
+	myfree((void *) dict_regexp->literal_rules);
     if (dict->fold_buf)
 	vstring_free(dict->fold_buf);
     dict_free(dict);
@@ -530,6 +599,91 @@ static regex_t *dict_regexp_compile_pat(const char *mapname, int lineno,
     return (expr);
 }
 
+/* dict_regexp_candidates - save pattern literals for the pre-filter */
+
+static ARGV *dict_regexp_candidates(const DICT_REGEXP_PATTERN *pat)
+{
+    if ((pat->options & REG_EXTENDED) == 0)
+	return (0);
+    return (re_prefilter_literals(pat->regexp, RE_PREFILTER_SYNTAX_ERE));
+}
+
+/* dict_regexp_prefilter - choose pattern literals, build the pre-filter */
+
+static void dict_regexp_prefilter(DICT_REGEXP *dict_regexp)
+{
+    DICT_REGEXP_RULE *rule;
+    DICT_REGEXP_RULE **rules;
+    ARGV  **candidates;
+    ARGV  **cand_list;
+    int    *literal;
+    int     count;
+    int     first;
+    int     last;
+    int     n;
+
+    /*
+     * Only IF and MATCH rules have literals.
+     */
+#define DICT_REGEXP_RULE_LITERAL(r, c, l) do { \
+	if ((r)->op == DICT_REGEXP_OP_MATCH) { \
+	    (c) = &((DICT_REGEXP_MATCH_RULE *) (r))->candidates; \
+	    (l) = &((DICT_REGEXP_MATCH_RULE *) (r))->literal; \
+	} else if ((r)->op == DICT_REGEXP_OP_IF) { \
+	    (c) = &((DICT_REGEXP_IF_RULE *) (r))->candidates; \
+	    (l) = &((DICT_REGEXP_IF_RULE *) (r))->literal; \
+	} else { \
+	    (c) = 0; \
+	    (l) = 0; \
+	} \
+    } while (0)
+
+    for (count = 0, rule = dict_regexp->head; rule; rule = rule->next) {
+	DICT_REGEXP_RULE_LITERAL(rule, candidates, literal);
+	if (candidates != 0 && *candidates != 0)
+	    count++;
+    }
+    if (count == 0)
+	return;
+
+    /*
+     * Literal IDs are assigned in rule order.
+     */
+    rules = dict_regexp->literal_rules =
+	(DICT_REGEXP_RULE **) mymalloc(count * sizeof(*rules));
+    cand_list = (ARGV **) mymalloc(count * sizeof(*cand_list));
+    for (n = 0, rule = dict_regexp->head; rule; rule = rule->next) {
+	DICT_REGEXP_RULE_LITERAL(rule, candidates, literal);
+	if (candidates == 0 || *candidates == 0)
+	    continue;
+	cand_list[n] = *candidates;
+	*candidates = 0;
+	*literal = n;
+	rules[n++] = rule;
+    }
+    dict_regexp->literals = re_prefilter_create(cand_list, count);
+    myfree((void *) cand_list);
+
+    /*
+     * Find sequences of adjacent match rules with a positive primary
+     * pattern.
+     */
+#define DICT_REGEXP_RUN_RULE(r) ((r)->op == DICT_REGEXP_OP_MATCH \
+	&& ((DICT_REGEXP_MATCH_RULE *) (r))->first_match)
+
+    for (first = 0; first < count; first = last + 1) {
+	last = first;
+	if (DICT_REGEXP_RUN_RULE(rules[first])) {
+	    while (last + 1 < count && rules[last]->next == rules[last + 1]
+		   && DICT_REGEXP_RUN_RULE(rules[last + 1]))
+		last++;
+	    if (last - first + 1 >= DICT_REGEXP_MIN_RUN)
+		for (n = first; n <= last; n++)
+		    ((DICT_REGEXP_MATCH_RULE *) rules[n])->run_last = last;
+	}
+    }
+}
+
 /* dict_regexp_rule_alloc - fill in a generic rule structure */
 
 static DICT_REGEXP_RULE *dict_regexp_rule_alloc(int op, int lineno, size_t size)
@@ -675,6 +829,9 @@ static DICT_REGEXP_RULE *dict_regexp_parseline(DICT *dict, const char *mapname,
 	    match_rule->replacement = prescan_context.literal;
 	else
 	    match_rule->replacement = mystrdup(p);
+	match_rule->literal = -1;
+	match_rule->candidates = dict_regexp_candidates(&first_pat);
+	match_rule->run_last = -1;
 	return ((DICT_REGEXP_RULE *) match_rule);
     }
 
@@ -707,6 +864,8 @@ static DICT_REGEXP_RULE *dict_regexp_parseline(DICT *dict, const char *mapname,
 	if_rule->expr = expr;
 	if_rule->match = pattern.match;
 	if_rule->endif_rule = 0;
+	if_rule->literal = -1;
+	if_rule->candidates = dict_regexp_candidates(&pattern);
 	return ((DICT_REGEXP_RULE *) if_rule);
     }
 
@@ -805,6 +964,8 @@ DICT   *dict_regexp_open(const char *mapname, int open_flags, int dict_flags)
     dict_regexp->head = 0;
     dict_regexp->pmatch = 0;
     dict_regexp->expansion_buf = 0;
+    dict_regexp->literals = 0;
+    dict_regexp->literal_rules = 0;
     dict_regexp->dict.owner.uid = st.st_uid;
     dict_regexp->dict.owner.status = (st.st_uid != 0);
 
@@ -867,6 +1028,8 @@ DICT   *dict_regexp_open(const char *mapname, int open_flags, int dict_flags)
 	dict_regexp->pmatch =
 	    (regmatch_t *) mymalloc(sizeof(regmatch_t) * (max_sub + 1));
 
+    dict_regexp_prefilter(dict_regexp);
+
     dict_file_purge_buffers(&dict_regexp->dict);
     DICT_REGEXP_OPEN_RETURN(DICT_DEBUG (&dict_regexp->dict));
 }
@@ -6,6 +6,9 @@
 /* SYNOPSIS
 /*	#include <dict_sockmap.h>
 /*
+/*	int	dict_sockmap_max_idle;
+/*	int	dict_sockmap_max_ttl;
+/*
 /*	DICT	*dict_sockmap_open(map, open_flags, dict_flags)
 /*	const char *map;
 /*	int	open_flags;
@@ -25,6 +28,12 @@
 /*	programs. Run "./netstring nc -l portnumber" as the server,
 /*	and "./dict_open socketmap:127.0.0.1:portnumber:socketmapname"
 /*	as the client.
+/*
+/*	dict_sockmap_max_idle and dict_sockmap_max_ttl specify the
+/*	time in seconds after which an idle connection, or a
+/*	connection of any age, is closed. These settings take effect
+/*	when a server endpoint is first opened; a connection is shared
+/*	by all socketmaps with the same server endpoint in a process.
 /* PROTOCOL
 /* .ad
 /* .fi
@@ -64,7 +73,7 @@
 /*	Fatal errors: out of memory, unknown host or service name,
 /*	attempt to update or iterate over map.
 /* BUGS
-/*	The protocol limits are not yet configurable.
+/*	The timeout and reply size limits are not yet configurable.
 /* LICENSE
 /* .ad
 /* .fi
@@ -120,8 +129,8 @@ typedef struct {
   */
 static int dict_sockmap_timeout = DICT_SOCKMAP_DEF_TIMEOUT;
 static int dict_sockmap_max_reply = DICT_SOCKMAP_DEF_MAX_REPLY;
-static int dict_sockmap_max_idle = DICT_SOCKMAP_DEF_MAX_IDLE;
-static int dict_sockmap_max_ttl = DICT_SOCKMAP_DEF_MAX_TTL;
+int     dict_sockmap_max_idle = DICT_SOCKMAP_DEF_MAX_IDLE;
+int     dict_sockmap_max_ttl = DICT_SOCKMAP_DEF_MAX_TTL;
 
  /*
   * The client handle is shared between socketmap instances that have the
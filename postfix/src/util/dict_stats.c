@@ -0,0 +1,193 @@
+/*++
+/* NAME
+/*	dict_stats 3
+/* SUMMARY
+/*	dictionary lookup statistics
+/* SYNOPSIS
+/*	#include <dict.h>
+/*
+/*	int	dict_stats_interval;
+/*
+/*	void	dict_stats_activate(dict)
+/*	DICT	*dict;
+/*
+/*	void	dict_stats_log()
+/*
+/*	void	dict_stats_free(dict)
+/*	DICT	*dict;
+/* DESCRIPTION
+/*	This module maintains per-table lookup statistics: the number
+/*	of lookups, hits, and errors, and the total and maximal
+/*	lookup latency. This helps to find slow tables without
+/*	verbose logging.
+/*
+/*	dict_stats_interval specifies how often (in seconds) each
+/*	process logs its table statistics. The default value zero
+/*	disables statistics collection.
+/*
+/*	dict_stats_activate() wraps a dictionary's lookup method with
+/*	code that maintains statistics, similar to dict_utf8_activate().
+/*	dict_open3() calls this function for each dictionary when
+/*	dict_stats_interval is non-zero. dict_stats_activate() does
+/*	not nest.
+/*
+/*	dict_stats_log() logs the statistics for each dictionary
+/*	that had lookups since the previous call, and resets the
+/*	counters. This function is called after a lookup when the
+/*	logging interval has passed, and when the process terminates
+/*	with exit().
+/*
+/*	dict_stats_free() logs the statistics for the specified
+/*	dictionary and destroys them. This is called by dict_free().
+/*
+/*	Statistics are kept per process. The proxymap(8) server
+/*	logs statistics for the tables that it serves.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+ /*
+  * System library.
+  */
+#include <sys_defs.h>
+#include <stdlib.h>
+#include <time.h>
+
+ /*
+  * Utility library.
+  */
+#include <msg.h>
+#include <mymalloc.h>
+#include <ring.h>
+#include <dict.h>
+
+ /*
+  * Configuration.
+  */
+int     dict_stats_interval = 0;
+
+ /*
+  * Saved method and counters, attached behind the dictionary object.
+  */
+typedef struct DICT_STATS {
+    RING    ring;			/* linkage, must be first */
+    DICT   *dict;			/* back pointer */
+    const char *(*lookup) (DICT *, const char *);	/* encapsulated method */
+    long    lookups;			/* lookups since last report */
+    long    hits;			/* lookups that found a result */
+    long    errors;			/* lookups that failed */
+    long    usec_total;			/* total lookup time */
+    long    usec_max;			/* maximal lookup time */
+} DICT_STATS;
+
+static RING dict_stats_ring;
+static time_t dict_stats_next;
+
+/* dict_stats_log_one - log and reset statistics for one table */
+
+static void dict_stats_log_one(DICT *dict)
+{
+    DICT_STATS *stats = dict->stats;
+
+    if (stats->lookups == 0)
+	return;
+    msg_info("table statistics: %s:%s lookups=%ld hits=%ld errors=%ld"
+	     " avg=%.3fms max=%.3fms",
+	     dict->type, dict->name, stats->lookups, stats->hits,
+	     stats->errors, stats->usec_total / 1000.0 / stats->lookups,
+	     stats->usec_max / 1000.0);
+    stats->lookups = stats->hits = stats->errors = 0;
+    stats->usec_total = stats->usec_max = 0;
+}
+
+/* dict_stats_log - log and reset statistics for all tables */
+
+void    dict_stats_log(void)
+{
+    RING   *entry;
+
+    RING_FOREACH(entry, &dict_stats_ring)
+	dict_stats_log_one(((DICT_STATS *) entry)->dict);
+}
+
+/* dict_stats_lookup - lookup method wrapper */
+
+static const char *dict_stats_lookup(DICT *dict, const char *key)
+{
+    DICT_STATS *stats = dict->stats;
+    struct timeval start;
+    struct timeval done;
+    const char *value;
+    long    usec;
+
+    GETTIMEOFDAY(&start);
+    value = stats->lookup(dict, key);
+    GETTIMEOFDAY(&done);
+    usec = (done.tv_sec - start.tv_sec) * 1000000L
+	+ (done.tv_usec - start.tv_usec);
+    if (usec < 0)
+	usec = 0;
+    stats->lookups += 1;
+    stats->usec_total += usec;
+    if (usec > stats->usec_max)
+	stats->usec_max = usec;
+    if (value != 0)
+	stats->hits += 1;
+    else if (dict->error != 0)
+	stats->errors += 1;
+
+    /*
+     * The result remains valid; logging does not use any dictionaries. Use
+     * the same clock for scheduling; time() may lag behind gettimeofday().
+     */
+    if (done.tv_sec >= dict_stats_next) {
+	dict_stats_next = done.tv_sec + dict_stats_interval;
+	dict_stats_log();
+    }
+    return (value);
+}
+
+/* dict_stats_activate - interpose on lookup method */
+
+void    dict_stats_activate(DICT *dict)
+{
+    const char myname[] = "dict_stats_activate";
+    static int exit_handler;
+    DICT_STATS *stats;
+
+    if (dict->stats != 0)
+	msg_panic("%s: %s:%s statistics are already activated",
+		  myname, dict->type, dict->name);
+
+    if (exit_handler == 0) {
+	exit_handler = 1;
+	ring_init(&dict_stats_ring);
+	dict_stats_next = time((time_t *) 0) + dict_stats_interval;
+	atexit(dict_stats_log);
+    }
+
+    /*
+     * Like dict_utf8_activate(), attach behind the dictionary object, so
+     * that there is no need to propagate data members between a proxy and
+     * the encapsulated object.
+     */
+    stats = dict->stats = (DICT_STATS *) mymalloc(sizeof(*stats));
+    stats->dict = dict;
+    stats->lookup = dict->lookup;
+    stats->lookups = stats->hits = stats->errors = 0;
+    stats->usec_total = stats->usec_max = 0;
+    ring_append(&dict_stats_ring, &stats->ring);
+    dict->lookup = dict_stats_lookup;
+}
+
+/* dict_stats_free - log and destroy statistics */
+
+void    dict_stats_free(DICT *dict)
+{
+    dict_stats_log_one(dict);
+    ring_detach(&dict->stats->ring);
+    myfree((void *) dict->stats);
+    dict->stats = 0;
+}
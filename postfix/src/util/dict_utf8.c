@@ -96,22 +96,24 @@ static char *dict_utf8_check_fold(DICT *dict, const char *string,
 				          CONST_CHAR_STAR *err)
 {
     int     fold_flag = (dict->flags & DICT_FLAG_FOLD_ANY);
+    int     ascii = allascii(string);
 
     /*
      * Validate UTF-8 without casefolding.
      */
-    if (!allascii(string) && valid_utf8_stringz(string) == 0) {
+    if (!ascii && valid_utf8_stringz(string) == 0) {
 	if (err)
 	    *err = "malformed UTF-8 or invalid codepoint";
 	return (0);
     }
 
     /*
-     * Casefold UTF-8.
+     * Casefold UTF-8. An ASCII string without uppercase is already folded.
      */
     if (fold_flag != 0
 	&& (fold_flag & ((dict->flags & DICT_FLAG_FIXED) ?
-			 DICT_FLAG_FOLD_FIX : DICT_FLAG_FOLD_MUL))) {
+			 DICT_FLAG_FOLD_FIX : DICT_FLAG_FOLD_MUL))
+	&& (!ascii || lowercase_needed(string))) {
 	if (dict->fold_buf == 0)
 	    dict->fold_buf = vstring_alloc(10);
 	return (casefold(dict->fold_buf, string));
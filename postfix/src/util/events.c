@@ -25,6 +25,11 @@
 /*	void	(*callback)(int event, void *context);
 /*	void	*context;
 /*
+/*	int	event_enable_read_exclusive(fd, callback, context)
+/*	int	fd;
+/*	void	(*callback)(int event, void *context);
+/*	void	*context;
+/*
 /*	void	event_enable_write(fd, callback, context)
 /*	int	fd;
 /*	void	(*callback)(int event, void *context);
@@ -33,6 +38,16 @@
 /*	void	event_disable_readwrite(fd)
 /*	int	fd;
 /*
+/*	void	event_switch_read(fd, callback, context)
+/*	int	fd;
+/*	void	(*callback)(int event, void *context);
+/*	void	*context;
+/*
+/*	void	event_switch_write(fd, callback, context)
+/*	int	fd;
+/*	void	(*callback)(int event, void *context);
+/*	void	*context;
+/*
 /*	void	event_drain(time_limit)
 /*	int	time_limit;
 /*
@@ -85,6 +100,15 @@
 /*	kernel-based event filters this is preferred usage, because
 /*	each disable and enable request would cost a system call.
 /*
+/*	event_enable_read_exclusive() is like event_enable_read(),
+/*	for a descriptor that is shared with other processes such
+/*	as a listening socket. It asks the kernel to wake up only
+/*	one of the processes that wait for the same event, instead
+/*	of all. The result is zero in case of success, -1 when this
+/*	is not supported (the request is then not enabled). Do not
+/*	use event_switch_read() or event_switch_write() with such
+/*	a request.
+/*
 /*	The manifest constants EVENT_NULL_CONTEXT and EVENT_NULL_TYPE
 /*	provide convenient null values.
 /*
@@ -108,6 +132,13 @@
 /*	I/O channel. The application is allowed to cancel non-existing
 /*	I/O event requests.
 /*
+/*	event_switch_read() (event_switch_write()) is like
+/*	event_enable_read() (event_enable_write()), but replaces a
+/*	pending write (read) request on the same I/O channel instead
+/*	of treating it as an error. With epoll this costs one system
+/*	call instead of two for event_disable_readwrite() followed
+/*	by event_enable_read() (event_enable_write()).
+/*
 /*	event_drain() repeatedly calls event_loop() until no more timer
 /*	events or I/O events are pending or until the time limit is reached.
 /*	This routine must not be called from an event_whatever() callback
@@ -143,7 +174,6 @@
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
-#include <stddef.h>			/* offsetof() */
 #include <string.h>			/* bzero() prototype for 44BSD */
 #include <limits.h>			/* INT_MAX */
 
@@ -156,13 +186,24 @@
 #include "mymalloc.h"
 #include "msg.h"
 #include "iostuff.h"
-#include "ring.h"
+#include "binhash.h"
 #include "events.h"
+#include "probes.h"
 
 #if !defined(EVENTS_STYLE)
 #error "must define EVENTS_STYLE"
 #endif
 
+ /*
+  * I/O event call-back dispatch, with optional tracepoints.
+  */
+#define EVENT_CALLBACK(fd, fdp, event) do { \
+	EVENT_NOTIFY_RDWR_FN _callback = (fdp)->callback; \
+	POSTFIX_PROBE3(event_start, (fd), (event), _callback); \
+	_callback((event), (fdp)->context); \
+	POSTFIX_PROBE3(event_done, (fd), (event), _callback); \
+    } while (0)
+
  /*
   * Traditional BSD-style select(2). Works everywhere, but has a built-in
   * upper bound on the number of file descriptors, and that limit is hard to
@@ -440,6 +481,12 @@ typedef struct pollfd EVENT_BUFFER;
 #if (EVENTS_STYLE == EVENTS_STYLE_EPOLL)
 #include <sys/epoll.h>
 
+ /*
+  * Deliver up to this many I/O events per kernel call. A busy postscreen(8)
+  * or tlsproxy(8) process can have many more ready descriptors than that.
+  */
+#define EVENT_BUFFER_COUNT	1024
+
  /*
   * Macros to initialize the kernel-based filter; see event_init().
   */
@@ -472,11 +519,21 @@ static int event_epollfd;		/* epoll handle */
 #define EVENT_REG_ADD_WRITE(e, f)  EVENT_REG_ADD_OP((e), (f), EPOLLOUT)
 #define EVENT_REG_ADD_TEXT         "epoll_ctl EPOLL_CTL_ADD"
 
+#ifdef EPOLLEXCLUSIVE
+#define EVENT_REG_ADD_READ_EXCL(e, f) \
+	EVENT_REG_ADD_OP((e), (f), EPOLLIN | EPOLLEXCLUSIVE)
+#endif
+
 #define EVENT_REG_DEL_OP(e, f, ev) EVENT_REG_FD_OP((e), (f), (ev), EPOLL_CTL_DEL)
 #define EVENT_REG_DEL_READ(e, f)   EVENT_REG_DEL_OP((e), (f), EPOLLIN)
 #define EVENT_REG_DEL_WRITE(e, f)  EVENT_REG_DEL_OP((e), (f), EPOLLOUT)
 #define EVENT_REG_DEL_TEXT         "epoll_ctl EPOLL_CTL_DEL"
 
+#define EVENT_REG_MOD_OP(e, f, ev) EVENT_REG_FD_OP((e), (f), (ev), EPOLL_CTL_MOD)
+#define EVENT_REG_MOD_READ(e, f)   EVENT_REG_MOD_OP((e), (f), EPOLLIN)
+#define EVENT_REG_MOD_WRITE(e, f)  EVENT_REG_MOD_OP((e), (f), EPOLLOUT)
+#define EVENT_REG_MOD_TEXT         "epoll_ctl EPOLL_CTL_MOD"
+
  /*
   * Macros to retrieve event buffers from the kernel; see event_loop().
   */
@@ -499,8 +556,341 @@ typedef struct epoll_event EVENT_BUFFER;
 #endif
 
  /*
-  * Timer events. Timer requests are kept sorted, in a circular list. We use
-  * the RING abstraction, so we get to use a couple ugly macros.
+  * Linux io_uring, used as a readiness notification mechanism much like
+  * epoll. Each registered descriptor has one single-shot IORING_OP_POLL_ADD
+  * request outstanding, which is re-armed when it completes. Unlike epoll,
+  * new and re-armed requests are only queued in the submission ring; they
+  * are handed to the kernel together with the wait for completions, in one
+  * io_uring_enter() system call per event_loop() iteration.
+  * 
+  * Requests are cancelled with IORING_OP_POLL_REMOVE, which is submitted right
+  * away: a pending poll request holds a reference to the open file, and the
+  * application may close the descriptor as soon as event_disable_readwrite()
+  * returns. Completions from requests that were cancelled or replaced carry
+  * an old per-descriptor generation number in their user data, and are
+  * ignored.
+  * 
+  * This needs Linux 5.5 or later (IORING_FEAT_NODROP). We use the raw system
+  * call interface so that there is no dependency on liburing.
+  */
+#if (EVENTS_STYLE == EVENTS_STYLE_URING)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+
+#define EVENT_BUFFER_COUNT	1024
+#define EVENT_URING_ENTRIES	1024
+
+ /*
+  * The user data of a poll request is the descriptor and its generation
+  * number. Other requests (cancellations and time limits) are not reported.
+  */
+#define EVENT_URING_DATA(fd, gen) \
+	(((unsigned long long) (gen) << 32) | (unsigned) (fd))
+#define EVENT_URING_DATA_FD(data)	((int) ((data) & 0xffffffff))
+#define EVENT_URING_DATA_GEN(data)	((unsigned) ((data) >> 32))
+#define EVENT_URING_IGNORE		(~0ULL)
+
+typedef struct {
+    int     fd;				/* io_uring handle */
+    unsigned char *sq_ring;		/* submission ring mapping */
+    size_t  sq_ring_size;
+    unsigned char *cq_ring;		/* completion ring mapping */
+    size_t  cq_ring_size;
+    struct io_uring_sqe *sqes;		/* submission queue entries */
+    size_t  sqes_size;
+    unsigned *sq_head;			/* updated by kernel */
+    unsigned *sq_tail;			/* updated by us */
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    unsigned sq_queued;			/* not yet visible to kernel */
+    unsigned *cq_head;			/* updated by us */
+    unsigned *cq_tail;			/* updated by kernel */
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+} EVENT_URING;
+
+static EVENT_URING event_uring = {-1};
+static unsigned *event_uring_gen;	/* per-descriptor generation */
+static int event_uring_gen_slots;
+
+/* event_uring_extend - make room for more generation numbers */
+
+static int event_uring_extend(int new_slots)
+{
+    if (event_uring_gen == 0)
+	event_uring_gen = (unsigned *)
+	    mymalloc(sizeof(*event_uring_gen) * new_slots);
+    else
+	event_uring_gen = (unsigned *)
+	    myrealloc((void *) event_uring_gen,
+		      sizeof(*event_uring_gen) * new_slots);
+    if (new_slots > event_uring_gen_slots)
+	memset((void *) (event_uring_gen + event_uring_gen_slots), 0,
+	       sizeof(*event_uring_gen) * (new_slots - event_uring_gen_slots));
+    event_uring_gen_slots = new_slots;
+    return (0);
+}
+
+/* event_uring_close - destroy io_uring handle */
+
+static void event_uring_close(void)
+{
+    if (event_uring.sqes)
+	(void) munmap((void *) event_uring.sqes, event_uring.sqes_size);
+    if (event_uring.cq_ring && event_uring.cq_ring != event_uring.sq_ring)
+	(void) munmap((void *) event_uring.cq_ring, event_uring.cq_ring_size);
+    if (event_uring.sq_ring)
+	(void) munmap((void *) event_uring.sq_ring, event_uring.sq_ring_size);
+    if (event_uring.fd >= 0)
+	(void) close(event_uring.fd);
+    memset((void *) &event_uring, 0, sizeof(event_uring));
+    event_uring.fd = -1;
+}
+
+/* event_uring_init - create io_uring handle */
+
+static int event_uring_init(int slots)
+{
+    struct io_uring_params params;
+    EVENT_URING *up = &event_uring;
+    void   *ptr;
+
+    if (slots > event_uring_gen_slots)
+	(void) event_uring_extend(slots);
+
+    memset((void *) &params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 4 * EVENT_URING_ENTRIES;
+    if ((up->fd = syscall(__NR_io_uring_setup, EVENT_URING_ENTRIES,
+			  &params)) < 0)
+	return (-1);
+    close_on_exec(up->fd, CLOSE_ON_EXEC);
+    if ((params.features & IORING_FEAT_NODROP) == 0) {
+	event_uring_close();
+	errno = ENOSYS;
+	return (-1);
+    }
+
+    /*
+     * Map the rings. Since Linux 5.4 the submission and completion rings
+     * share one mapping.
+     */
+    up->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    up->cq_ring_size = params.cq_off.cqes
+	+ params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+	if (up->cq_ring_size > up->sq_ring_size)
+	    up->sq_ring_size = up->cq_ring_size;
+	up->cq_ring_size = up->sq_ring_size;
+    }
+    if ((ptr = mmap((void *) 0, up->sq_ring_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, up->fd,
+		    IORING_OFF_SQ_RING)) == MAP_FAILED) {
+	event_uring_close();
+	return (-1);
+    }
+    up->sq_ring = (unsigned char *) ptr;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+	up->cq_ring = up->sq_ring;
+    } else if ((ptr = mmap((void *) 0, up->cq_ring_size,
+			   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			   up->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+	event_uring_close();
+	return (-1);
+    } else {
+	up->cq_ring = (unsigned char *) ptr;
+    }
+    up->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if ((ptr = mmap((void *) 0, up->sqes_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, up->fd,
+		    IORING_OFF_SQES)) == MAP_FAILED) {
+	event_uring_close();
+	return (-1);
+    }
+    up->sqes = (struct io_uring_sqe *) ptr;
+
+    up->sq_head = (unsigned *) (up->sq_ring + params.sq_off.head);
+    up->sq_tail = (unsigned *) (up->sq_ring + params.sq_off.tail);
+    up->sq_mask = *(unsigned *) (up->sq_ring + params.sq_off.ring_mask);
+    up->sq_entries = params.sq_entries;
+    up->sq_array = (unsigned *) (up->sq_ring + params.sq_off.array);
+    up->sq_queued = 0;
+    up->cq_head = (unsigned *) (up->cq_ring + params.cq_off.head);
+    up->cq_tail = (unsigned *) (up->cq_ring + params.cq_off.tail);
+    up->cq_mask = *(unsigned *) (up->cq_ring + params.cq_off.ring_mask);
+    up->cqes = (struct io_uring_cqe *) (up->cq_ring + params.cq_off.cqes);
+    return (0);
+}
+
+/* event_uring_enter - submit queued requests, optionally wait */
+
+static int event_uring_enter(unsigned min_complete)
+{
+    EVENT_URING *up = &event_uring;
+    unsigned tail;
+    int     ret;
+
+    tail = *up->sq_tail + up->sq_queued;
+    __atomic_store_n(up->sq_tail, tail, __ATOMIC_RELEASE);
+    up->sq_queued = 0;
+    ret = syscall(__NR_io_uring_enter, up->fd,
+		  tail - __atomic_load_n(up->sq_head, __ATOMIC_ACQUIRE),
+		  min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0,
+		  (void *) 0, 0);
+
+    /*
+     * With a full completion queue, the kernel stops accepting requests
+     * until we have reaped some completions. Those requests stay queued.
+     */
+    if (ret < 0 && (errno == EBUSY || errno == EAGAIN))
+	ret = 0;
+    return (ret);
+}
+
+/* event_uring_sqe - allocate submission queue entry */
+
+static struct io_uring_sqe *event_uring_sqe(void)
+{
+    const char *myname = "event_uring_sqe";
+    EVENT_URING *up = &event_uring;
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+#define EVENT_URING_SQ_FULL(up) \
+	(*(up)->sq_tail + (up)->sq_queued \
+	 - __atomic_load_n((up)->sq_head, __ATOMIC_ACQUIRE) >= (up)->sq_entries)
+
+    if (EVENT_URING_SQ_FULL(up)) {
+	if (event_uring_enter(0) < 0 && errno != EINTR)
+	    msg_fatal("%s: io_uring_enter: %m", myname);
+	if (EVENT_URING_SQ_FULL(up))
+	    msg_fatal("%s: submission queue is full", myname);
+    }
+    index = (*up->sq_tail + up->sq_queued) & up->sq_mask;
+    sqe = up->sqes + index;
+    memset((void *) sqe, 0, sizeof(*sqe));
+    up->sq_array[index] = index;
+    up->sq_queued += 1;
+    return (sqe);
+}
+
+/* event_uring_add - queue poll request */
+
+static int event_uring_add(int fd, unsigned events)
+{
+    struct io_uring_sqe *sqe = event_uring_sqe();
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll_events = events;
+    sqe->user_data = EVENT_URING_DATA(fd, event_uring_gen[fd]);
+    return (0);
+}
+
+/* event_uring_cancel - queue poll request cancellation */
+
+static void event_uring_cancel(int fd)
+{
+    struct io_uring_sqe *sqe = event_uring_sqe();
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = EVENT_URING_DATA(fd, event_uring_gen[fd]);
+    sqe->user_data = EVENT_URING_IGNORE;
+    event_uring_gen[fd] += 1;
+}
+
+/* event_uring_del - cancel poll request now */
+
+static int event_uring_del(int fd)
+{
+    event_uring_cancel(fd);
+    return (event_uring_enter(0) < 0 && errno != EINTR ? -1 : 0);
+}
+
+/* event_uring_mod - replace poll request */
+
+static int event_uring_mod(int fd, unsigned events)
+{
+    event_uring_cancel(fd);
+    return (event_uring_add(fd, events));
+}
+
+ /*
+  * Macros to initialize the kernel-based filter; see event_init().
+  */
+#define EVENT_REG_INIT_HANDLE(er, n) do { \
+	(er) = event_uring_init(n); \
+    } while (0)
+#define EVENT_REG_INIT_TEXT	"io_uring_setup"
+
+#define EVENT_REG_FORK_HANDLE(er, n) do { \
+	event_uring_close(); \
+	EVENT_REG_INIT_HANDLE(er, (n)); \
+    } while (0)
+
+#define EVENT_REG_UPD_HANDLE(er, n) do { \
+	(er) = event_uring_extend(n); \
+    } while (0)
+#define EVENT_REG_UPD_TEXT	"io_uring generation table"
+
+ /*
+  * Macros to update the kernel-based filter; see event_enable_read(),
+  * event_enable_write() and event_disable_readwrite().
+  */
+#define EVENT_REG_ADD_READ(e, f)   ((e) = event_uring_add((f), POLLIN))
+#define EVENT_REG_ADD_WRITE(e, f)  ((e) = event_uring_add((f), POLLOUT))
+#define EVENT_REG_ADD_TEXT         "io_uring IORING_OP_POLL_ADD"
+
+#define EVENT_REG_DEL_BOTH(e, f)   ((e) = event_uring_del(f))
+#define EVENT_REG_DEL_TEXT         "io_uring IORING_OP_POLL_REMOVE"
+
+#define EVENT_REG_MOD_OP(e, f, ev) ((e) = event_uring_mod((f), (ev)))
+#define EVENT_REG_MOD_READ(e, f)   EVENT_REG_MOD_OP((e), (f), POLLIN)
+#define EVENT_REG_MOD_WRITE(e, f)  EVENT_REG_MOD_OP((e), (f), POLLOUT)
+#define EVENT_REG_MOD_TEXT         "io_uring IORING_OP_POLL_REMOVE"
+
+ /*
+  * Macros to retrieve event buffers from the kernel; see event_loop().
+  */
+typedef struct {
+    int     fd;				/* file descriptor */
+    unsigned events;			/* poll(2) result */
+} EVENT_BUFFER;
+
+static int event_uring_wait(EVENT_BUFFER *, int, int);
+
+#define EVENT_BUFFER_READ(event_count, event_buf, buflen, delay) do { \
+	(event_count) = event_uring_wait((event_buf), (buflen), (delay)); \
+    } while (0)
+#define EVENT_BUFFER_READ_TEXT	"io_uring_enter"
+
+ /*
+  * Macros to process event buffers from the kernel; see event_loop().
+  */
+#define EVENT_GET_FD(bp)	((bp)->fd)
+#define EVENT_GET_TYPE(bp)	((bp)->events)
+#define EVENT_TEST_READ(bp)	(EVENT_GET_TYPE(bp) & POLLIN)
+#define EVENT_TEST_WRITE(bp)	(EVENT_GET_TYPE(bp) & POLLOUT)
+
+#endif
+
+ /*
+  * Default number of I/O events to retrieve per kernel call.
+  */
+#if (EVENTS_STYLE != EVENTS_STYLE_SELECT) && !defined(EVENT_BUFFER_COUNT)
+#define EVENT_BUFFER_COUNT	100
+#endif
+
+ /*
+  * Timer events. Timer requests are kept in a binary heap, ordered by time
+  * and then by request order, so that the earliest request is always at the
+  * top. Insertion and removal take O(log n) time. Requests are indexed by
+  * their (callback, context) pair, so that a request can be found without
+  * searching the heap.
   * 
   * When a call-back function adds a timer request, we label the request with
   * the event_loop() call instance that invoked the call-back. We use this to
@@ -509,25 +899,40 @@ typedef struct epoll_event EVENT_BUFFER;
   */
 typedef struct EVENT_TIMER EVENT_TIMER;
 
-struct EVENT_TIMER {
-    time_t  when;			/* when event is wanted */
+typedef struct {
     EVENT_NOTIFY_TIME_FN callback;	/* callback function */
     char   *context;			/* callback context */
+} EVENT_TIMER_KEY;
+
+struct EVENT_TIMER {
+    time_t  when;			/* when event is wanted */
+    EVENT_TIMER_KEY key;		/* callback and context */
     long    loop_instance;		/* event_loop() call instance */
-    RING    ring;			/* linkage */
+    unsigned long order;		/* request order */
+    ssize_t heap_index;			/* position in event_timer_heap */
 };
 
-static RING event_timer_head;		/* timer queue head */
+static EVENT_TIMER **event_timer_heap;	/* timer queue */
+static ssize_t event_timer_count;	/* queue length */
+static ssize_t event_timer_slots;	/* queue size */
+static BINHASH *event_timer_index;	/* (callback, context) index */
+static unsigned long event_timer_order;	/* request order */
 static long event_loop_instance;	/* event_loop() call instance */
 
-#define RING_TO_TIMER(r) \
-	((EVENT_TIMER *) ((void *) (r) - offsetof(EVENT_TIMER, ring)))
+#define EVENT_TIMER_INCR	(256)
 
-#define FOREACH_QUEUE_ENTRY(entry, head) \
-	for (entry = ring_succ(head); entry != (head); entry = ring_succ(entry))
+#define FIRST_TIMER() \
+	(event_timer_count > 0 ? event_timer_heap[0] : 0)
 
-#define FIRST_TIMER(head) \
-	(ring_succ(head) != (head) ? RING_TO_TIMER(ring_succ(head)) : 0)
+#define TIMER_BEFORE(a, b) \
+	((a)->when < (b)->when || ((a)->when == (b)->when \
+	 && (a)->order < (b)->order))
+
+#define TIMER_KEY_INIT(k, fn, ctx) do { \
+	memset((void *) &(k), 0, sizeof(k)); \
+	(k).callback = (fn); \
+	(k).context = (ctx); \
+    } while (0)
 
  /*
   * Other private data structures.
@@ -591,7 +996,11 @@ static void event_init(void)
     /*
      * Initialize timer stuff.
      */
-    ring_init(&event_timer_head);
+    event_timer_slots = EVENT_TIMER_INCR;
+    event_timer_heap = (EVENT_TIMER **)
+	mymalloc(sizeof(*event_timer_heap) * event_timer_slots);
+    event_timer_count = 0;
+    event_timer_index = binhash_create(EVENT_TIMER_INCR);
     (void) time(&event_present);
 
     /*
@@ -670,7 +1079,7 @@ void    event_drain(int time_limit)
     (void) time(&event_present);
     max_time = event_present + time_limit;
     while (event_present < max_time
-	   && (event_timer_head.pred != &event_timer_head
+	   && (event_timer_count > 0
 	       || EVENT_MASK_CMP(&zero_mask, &event_xmask) != 0)) {
 	event_loop(1);
 #if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
@@ -779,6 +1188,52 @@ void    event_enable_read(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
     }
 }
 
+/* event_enable_read_exclusive - enable read events, wake up one process */
+
+int     event_enable_read_exclusive(int fd, EVENT_NOTIFY_RDWR_FN callback,
+				            void *context)
+{
+#ifdef EVENT_REG_ADD_READ_EXCL
+    const char *myname = "event_enable_read_exclusive";
+    EVENT_FDTABLE *fdp;
+    int     err;
+
+    if (EVENT_INIT_NEEDED())
+	event_init();
+
+    /*
+     * Sanity checks.
+     */
+    if (fd < 0 || fd >= event_fdlimit)
+	msg_panic("%s: bad file descriptor: %d", myname, fd);
+
+    if (msg_verbose > 2)
+	msg_info("%s: fd %d", myname, fd);
+
+    if (fd >= event_fdslots)
+	event_extend(fd);
+
+    if (EVENT_MASK_ISSET(fd, &event_wmask))
+	msg_panic("%s: fd %d: read/write I/O request", myname, fd);
+
+    if (EVENT_MASK_ISSET(fd, &event_rmask) == 0) {
+	EVENT_MASK_SET(fd, &event_xmask);
+	EVENT_MASK_SET(fd, &event_rmask);
+	if (event_max_fd < fd)
+	    event_max_fd = fd;
+	EVENT_REG_ADD_READ_EXCL(err, fd);
+	if (err < 0)
+	    msg_fatal("%s: %s: %m", myname, EVENT_REG_ADD_TEXT);
+    }
+    fdp = event_fdtable + fd;
+    fdp->callback = callback;
+    fdp->context = context;
+    return (0);
+#else
+    return (-1);
+#endif
+}
+
 /* event_enable_write - enable write events */
 
 void    event_enable_write(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
@@ -889,12 +1344,139 @@ void    event_disable_readwrite(int fd)
     fdp->context = 0;
 }
 
+/* event_switch_readwrite - replace read request with write request or vice versa */
+
+static int event_switch_readwrite(int fd, EVENT_NOTIFY_RDWR_FN callback,
+			            void *context, EVENT_MASK *from_mask,
+				          EVENT_MASK *to_mask, int to_read)
+{
+    const char *myname = to_read ? "event_switch_read" : "event_switch_write";
+
+#ifdef EVENT_REG_MOD_OP
+    EVENT_FDTABLE *fdp;
+    int     err;
+
+#endif
+
+    if (EVENT_INIT_NEEDED())
+	event_init();
+
+    /*
+     * Sanity checks.
+     */
+    if (fd < 0 || fd >= event_fdlimit)
+	msg_panic("%s: bad file descriptor: %d", myname, fd);
+
+    if (fd >= event_fdslots || EVENT_MASK_ISSET(fd, from_mask) == 0)
+	return (0);
+
+    if (msg_verbose > 2)
+	msg_info("%s: fd %d", myname, fd);
+
+    /*
+     * Change the kernel-based filter in place, if possible.
+     */
+#ifdef EVENT_REG_MOD_OP
+    if (to_read)
+	EVENT_REG_MOD_READ(err, fd);
+    else
+	EVENT_REG_MOD_WRITE(err, fd);
+    if (err < 0)
+	msg_fatal("%s: %s: %m", myname, EVENT_REG_MOD_TEXT);
+    EVENT_MASK_CLR(fd, from_mask);
+    EVENT_MASK_SET(fd, to_mask);
+    fdp = event_fdtable + fd;
+    fdp->callback = callback;
+    fdp->context = context;
+    return (1);
+#else
+    event_disable_readwrite(fd);
+    return (0);
+#endif
+}
+
+/* event_switch_read - enable read events, replacing write events */
+
+void    event_switch_read(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
+{
+    if (event_switch_readwrite(fd, callback, context,
+			       &event_wmask, &event_rmask, 1) == 0)
+	event_enable_read(fd, callback, context);
+}
+
+/* event_switch_write - enable write events, replacing read events */
+
+void    event_switch_write(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
+{
+    if (event_switch_readwrite(fd, callback, context,
+			       &event_rmask, &event_wmask, 0) == 0)
+	event_enable_write(fd, callback, context);
+}
+
+/* event_timer_place - store timer at heap position */
+
+static void event_timer_place(EVENT_TIMER *timer, ssize_t index)
+{
+    event_timer_heap[index] = timer;
+    timer->heap_index = index;
+}
+
+/* event_timer_sift - restore heap order after timer was added or changed */
+
+static void event_timer_sift(EVENT_TIMER *timer)
+{
+    ssize_t index = timer->heap_index;
+    ssize_t parent;
+    ssize_t child;
+
+    /*
+     * Move the timer up while it goes off before its parent.
+     */
+    while (index > 0) {
+	parent = (index - 1) / 2;
+	if (!TIMER_BEFORE(timer, event_timer_heap[parent]))
+	    break;
+	event_timer_place(event_timer_heap[parent], index);
+	index = parent;
+    }
+
+    /*
+     * Move the timer down while a child goes off before it.
+     */
+    while ((child = 2 * index + 1) < event_timer_count) {
+	if (child + 1 < event_timer_count
+	    && TIMER_BEFORE(event_timer_heap[child + 1],
+			    event_timer_heap[child]))
+	    child += 1;
+	if (!TIMER_BEFORE(event_timer_heap[child], timer))
+	    break;
+	event_timer_place(event_timer_heap[child], index);
+	index = child;
+    }
+    event_timer_place(timer, index);
+}
+
+/* event_timer_detach - remove timer from heap and index */
+
+static void event_timer_detach(EVENT_TIMER *timer)
+{
+    EVENT_TIMER *last;
+
+    binhash_delete(event_timer_index, (void *) &timer->key,
+		   sizeof(timer->key), (void (*) (void *)) 0);
+    last = event_timer_heap[--event_timer_count];
+    if (last != timer) {
+	last->heap_index = timer->heap_index;
+	event_timer_sift(last);
+    }
+}
+
 /* event_request_timer - (re)set timer */
 
 time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context, int delay)
 {
     const char *myname = "event_request_timer";
-    RING   *ring;
+    EVENT_TIMER_KEY key;
     EVENT_TIMER *timer;
 
     if (EVENT_INIT_NEEDED())
@@ -912,50 +1494,48 @@ time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context, int de
     time(&event_present);
 
     /*
-     * See if they are resetting an existing timer request. If so, take the
-     * request away from the timer queue so that it can be inserted at the
-     * right place.
+     * See if they are resetting an existing timer request. If so, update the
+     * request in place, and move it to the right place in the queue.
      */
-    FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	timer = RING_TO_TIMER(ring);
-	if (timer->callback == callback && timer->context == context) {
-	    timer->when = event_present + delay;
-	    timer->loop_instance = event_loop_instance;
-	    ring_detach(ring);
-	    if (msg_verbose > 2)
-		msg_info("%s: reset 0x%lx 0x%lx %d", myname,
-			 (long) callback, (long) context, delay);
-	    break;
-	}
+    TIMER_KEY_INIT(key, callback, context);
+    if ((timer = (EVENT_TIMER *) binhash_find(event_timer_index,
+					      (void *) &key,
+					      sizeof(key))) != 0) {
+	if (msg_verbose > 2)
+	    msg_info("%s: reset 0x%lx 0x%lx %d", myname,
+		     (long) callback, (long) context, delay);
     }
 
     /*
      * If not found, schedule a new timer request.
      */
-    if (ring == &event_timer_head) {
+    else {
 	timer = (EVENT_TIMER *) mymalloc(sizeof(EVENT_TIMER));
-	timer->when = event_present + delay;
-	timer->callback = callback;
-	timer->context = context;
-	timer->loop_instance = event_loop_instance;
+	timer->key = key;
+	if (event_timer_count >= event_timer_slots) {
+	    event_timer_slots *= 2;
+	    event_timer_heap = (EVENT_TIMER **)
+		myrealloc((void *) event_timer_heap,
+			  sizeof(*event_timer_heap) * event_timer_slots);
+	}
+	timer->heap_index = event_timer_count++;
+	event_timer_heap[timer->heap_index] = timer;
+	binhash_enter(event_timer_index, (void *) &timer->key,
+		      sizeof(timer->key), (void *) timer);
 	if (msg_verbose > 2)
 	    msg_info("%s: set 0x%lx 0x%lx %d", myname,
 		     (long) callback, (long) context, delay);
     }
 
     /*
-     * Timer requests are kept sorted to reduce lookup overhead in the event
-     * loop.
-     * 
-     * XXX Append the new request after existing requests for the same time
+     * XXX Order the new request after existing requests for the same time
      * slot. The event_loop() routine depends on this to avoid starving I/O
      * events when a call-back function schedules a zero-delay timer request.
      */
-    FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	if (timer->when < RING_TO_TIMER(ring)->when)
-	    break;
-    }
-    ring_prepend(ring, &timer->ring);
+    timer->when = event_present + delay;
+    timer->loop_instance = event_loop_instance;
+    timer->order = event_timer_order++;
+    event_timer_sift(timer);
 
     return (timer->when);
 }
@@ -965,7 +1545,7 @@ time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context, int de
 int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
 {
     const char *myname = "event_cancel_timer";
-    RING   *ring;
+    EVENT_TIMER_KEY key;
     EVENT_TIMER *timer;
     int     time_left = -1;
 
@@ -977,15 +1557,14 @@ int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
      * when the request is not found. It might have been canceled from some
      * other thread.
      */
-    FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	timer = RING_TO_TIMER(ring);
-	if (timer->callback == callback && timer->context == context) {
-	    if ((time_left = timer->when - event_present) < 0)
-		time_left = 0;
-	    ring_detach(ring);
-	    myfree((void *) timer);
-	    break;
-	}
+    TIMER_KEY_INIT(key, callback, context);
+    if ((timer = (EVENT_TIMER *) binhash_find(event_timer_index,
+					      (void *) &key,
+					      sizeof(key))) != 0) {
+	if ((time_left = timer->when - event_present) < 0)
+	    time_left = 0;
+	event_timer_detach(timer);
+	myfree((void *) timer);
     }
     if (msg_verbose > 2)
 	msg_info("%s: 0x%lx 0x%lx %d", myname,
@@ -993,6 +1572,80 @@ int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
     return (time_left);
 }
 
+#if (EVENTS_STYLE == EVENTS_STYLE_URING)
+
+/* event_uring_wait - submit requests, wait for and collect poll results */
+
+static int event_uring_wait(EVENT_BUFFER *event_buf, int buflen, int delay)
+{
+    EVENT_URING *up = &event_uring;
+    static struct __kernel_timespec timeout;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    unsigned tail;
+    unsigned gen;
+    int     event_count = 0;
+    int     fd;
+
+    /*
+     * Wait only if no completion is already available. The time limit
+     * request completes as soon as any other request completes, so that it
+     * won't linger after we return.
+     */
+    head = *up->cq_head;
+    if (delay != 0 && head == __atomic_load_n(up->cq_tail, __ATOMIC_ACQUIRE)) {
+	if (delay > 0) {
+	    timeout.tv_sec = delay;
+	    timeout.tv_nsec = 0;
+	    sqe = event_uring_sqe();
+	    sqe->opcode = IORING_OP_TIMEOUT;
+	    sqe->fd = -1;
+	    sqe->addr = (unsigned long) &timeout;
+	    sqe->len = 1;
+	    sqe->off = 1;
+	    sqe->user_data = EVENT_URING_IGNORE;
+	}
+	if (event_uring_enter(1) < 0)
+	    return (-1);
+    } else if (up->sq_queued > 0) {
+	if (event_uring_enter(0) < 0)
+	    return (-1);
+    }
+
+    /*
+     * Collect results for current poll requests, and re-arm those requests.
+     * The re-armed requests are submitted with the next wait, after the
+     * application has handled the events that we report now.
+     */
+    tail = __atomic_load_n(up->cq_tail, __ATOMIC_ACQUIRE);
+    for (/* void */ ; head != tail && event_count < buflen; head++) {
+	cqe = up->cqes + (head & up->cq_mask);
+	if (cqe->user_data == EVENT_URING_IGNORE)
+	    continue;
+	fd = EVENT_URING_DATA_FD(cqe->user_data);
+	gen = EVENT_URING_DATA_GEN(cqe->user_data);
+	if (fd < 0 || fd >= event_fdslots || gen != event_uring_gen[fd]
+	    || !EVENT_MASK_ISSET(fd, &event_xmask))
+	    continue;
+	event_buf[event_count].fd = fd;
+	if (cqe->res < 0) {
+	    /* Report the problem, and don't spin on it. */
+	    event_buf[event_count].events = POLLERR;
+	    event_uring_gen[fd] += 1;
+	} else {
+	    event_buf[event_count].events = cqe->res;
+	    (void) event_uring_add(fd, EVENT_MASK_ISSET(fd, &event_rmask) ?
+				   POLLIN : POLLOUT);
+	}
+	event_count++;
+    }
+    __atomic_store_n(up->cq_head, head, __ATOMIC_RELEASE);
+    return (event_count);
+}
+
+#endif
+
 /* event_loop - wait for the next event */
 
 void    event_loop(int delay)
@@ -1009,7 +1662,7 @@ void    event_loop(int delay)
     int     new_max_fd;
 
 #else
-    EVENT_BUFFER event_buf[100];
+    EVENT_BUFFER event_buf[EVENT_BUFFER_COUNT];
     EVENT_BUFFER *bp;
 
 #endif
@@ -1026,21 +1679,22 @@ void    event_loop(int delay)
      * XXX Also print the select() masks?
      */
     if (msg_verbose > 2) {
-	RING   *ring;
+	ssize_t i;
 
-	FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	    timer = RING_TO_TIMER(ring);
+	for (i = 0; i < event_timer_count; i++) {
+	    timer = event_timer_heap[i];
 	    msg_info("%s: time left %3d for 0x%lx 0x%lx", myname,
 		     (int) (timer->when - event_present),
-		     (long) timer->callback, (long) timer->context);
+		     (long) timer->key.callback, (long) timer->key.context);
 	}
     }
 
     /*
-     * Find out when the next timer would go off. Timer requests are sorted.
-     * If any timer is scheduled, adjust the delay appropriately.
+     * Find out when the next timer would go off. The earliest timer request
+     * is at the top of the queue. If any timer is scheduled, adjust the
+     * delay appropriately.
      */
-    if ((timer = FIRST_TIMER(&event_timer_head)) != 0) {
+    if ((timer = FIRST_TIMER()) != 0) {
 	event_present = time((time_t *) 0);
 	if ((select_delay = timer->when - event_present) < 0) {
 	    select_delay = 0;
@@ -1102,9 +1756,9 @@ void    event_loop(int delay)
 
     /*
      * Deliver timer events. Allow the application to add/delete timer queue
-     * requests while it is being called back. Requests are sorted: we keep
-     * running over the timer request queue from the start, and stop when we
-     * reach the future or the list end. We also stop when we reach a timer
+     * requests while it is being called back. Requests are ordered: we keep
+     * taking the earliest request from the timer queue, and stop when we
+     * reach the future or the queue end. We also stop when we reach a timer
      * request that was added by a call-back that was invoked from this
      * event_loop() call instance, for reasons that are explained below.
      * 
@@ -1119,22 +1773,24 @@ void    event_loop(int delay)
      * instance that invoked the timer event call-back. We use this instance
      * label here to prevent zero-delay timer requests from running in a
      * tight loop and starving I/O events. To make this solution work,
-     * event_request_timer() appends a new request after existing requests
+     * event_request_timer() orders a new request after existing requests
      * for the same time slot.
      */
     event_present = time((time_t *) 0);
     event_loop_instance += 1;
 
-    while ((timer = FIRST_TIMER(&event_timer_head)) != 0) {
+    while ((timer = FIRST_TIMER()) != 0) {
 	if (timer->when > event_present)
 	    break;
 	if (timer->loop_instance == event_loop_instance)
 	    break;
-	ring_detach(&timer->ring);		/* first this */
+	event_timer_detach(timer);		/* first this */
 	if (msg_verbose > 2)
 	    msg_info("%s: timer 0x%lx 0x%lx", myname,
-		     (long) timer->callback, (long) timer->context);
-	timer->callback(EVENT_TIME, timer->context);	/* then this */
+		     (long) timer->key.callback, (long) timer->key.context);
+	POSTFIX_PROBE3(event_start, -1, EVENT_TIME, timer->key.callback);
+	timer->key.callback(EVENT_TIME, timer->key.context);	/* then this */
+	POSTFIX_PROBE3(event_done, -1, EVENT_TIME, timer->key.callback);
 	myfree((void *) timer);
     }
 
@@ -1156,17 +1812,17 @@ void    event_loop(int delay)
 		    if (msg_verbose > 2)
 			msg_info("%s: exception fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		    fdp->callback(EVENT_XCPT, fdp->context);
+		    EVENT_CALLBACK(fd, fdp, EVENT_XCPT);
 		} else if (FD_ISSET(fd, &wmask)) {
 		    if (msg_verbose > 2)
 			msg_info("%s: write fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		    fdp->callback(EVENT_WRITE, fdp->context);
+		    EVENT_CALLBACK(fd, fdp, EVENT_WRITE);
 		} else if (FD_ISSET(fd, &rmask)) {
 		    if (msg_verbose > 2)
 			msg_info("%s: read fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		    fdp->callback(EVENT_READ, fdp->context);
+		    EVENT_CALLBACK(fd, fdp, EVENT_READ);
 		}
 	    }
 	}
@@ -1183,18 +1839,18 @@ void    event_loop(int delay)
 		if (msg_verbose > 2)
 		    msg_info("%s: read fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		fdp->callback(EVENT_READ, fdp->context);
+		EVENT_CALLBACK(fd, fdp, EVENT_READ);
 	    } else if (EVENT_TEST_WRITE(bp)) {
 		if (msg_verbose > 2)
 		    msg_info("%s: write fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback,
 			     (long) fdp->context);
-		fdp->callback(EVENT_WRITE, fdp->context);
+		EVENT_CALLBACK(fd, fdp, EVENT_WRITE);
 	    } else {
 		if (msg_verbose > 2)
 		    msg_info("%s: other fd=%d act=0x%lx 0x%lx", myname,
 			     fd, (long) fdp->callback, (long) fdp->context);
-		fdp->callback(EVENT_XCPT, fdp->context);
+		EVENT_CALLBACK(fd, fdp, EVENT_XCPT);
 	    }
 	}
     }
@@ -26,8 +26,11 @@ typedef void (*EVENT_NOTIFY_FN) (int, void *);
 
 extern time_t event_time(void);
 extern void event_enable_read(int, EVENT_NOTIFY_RDWR_FN, void *);
+extern int event_enable_read_exclusive(int, EVENT_NOTIFY_RDWR_FN, void *);
 extern void event_enable_write(int, EVENT_NOTIFY_RDWR_FN, void *);
 extern void event_disable_readwrite(int);
+extern void event_switch_read(int, EVENT_NOTIFY_RDWR_FN, void *);
+extern void event_switch_write(int, EVENT_NOTIFY_RDWR_FN, void *);
 extern time_t event_request_timer(EVENT_NOTIFY_TIME_FN, void *, int);
 extern int event_cancel_timer(EVENT_NOTIFY_TIME_FN, void *);
 extern void event_loop(int);
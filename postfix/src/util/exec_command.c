@@ -8,12 +8,22 @@
 /*
 /*	NORETURN exec_command(command)
 /*	const char *command;
+/*
+/*	ARGV	*exec_command_argv(command)
+/*	const char *command;
 /* DESCRIPTION
 /*	\fIexec_command\fR() replaces the current process by an instance
 /*	of \fIcommand\fR. This routine uses a simple heuristic to avoid
 /*	the overhead of running a command shell interpreter.
+/*
+/*	exec_command_argv() implements that heuristic. It returns
+/*	the command split on whitespace when the command can be
+/*	executed without a shell, otherwise a null pointer. The
+/*	caller should try the shell when execvp() fails with ENOENT
+/*	and the command name contains no "/" (perhaps it is a shell
+/*	built-in command).
 /* DIAGNOSTICS
-/*	This routine never returns. All errors are fatal.
+/*	exec_command() never returns. All errors are fatal.
 /* LICENSE
 /* .ad
 /* .fi
@@ -46,11 +56,10 @@
 
 #define SPACE_TAB	" \t"
 
-/* exec_command - exec command */
+/* exec_command_argv - split command that needs no shell */
 
-NORETURN exec_command(const char *command)
+ARGV   *exec_command_argv(const char *command)
 {
-    ARGV   *argv;
 
     /*
      * Character filter. In this particular case, we allow space and tab in
@@ -61,17 +70,23 @@ abcdefghijklmnopqrstuvwxyz\
 ABCDEFGHIJKLMNOPQRSTUVWXYZ" SPACE_TAB;
 
     /*
-     * See if this command contains any shell magic characters.
+     * See if this command contains any shell magic characters. If none are
+     * found, we can try to avoid the overhead of running a shell. Just split
+     * the command on whitespace and exec the result directly.
      */
     if (command[strspn(command, ok_chars)] == 0
-	&& command[strspn(command, SPACE_TAB)] != 0) {
+	&& command[strspn(command, SPACE_TAB)] != 0)
+	return (argv_split(command, SPACE_TAB));
+    return (0);
+}
 
-	/*
-	 * No shell meta characters found, so we can try to avoid the overhead
-	 * of running a shell. Just split the command on whitespace and exec
-	 * the result directly.
-	 */
-	argv = argv_split(command, SPACE_TAB);
+/* exec_command - exec command */
+
+NORETURN exec_command(const char *command)
+{
+    ARGV   *argv;
+
+    if ((argv = exec_command_argv(command)) != 0) {
 	(void) execvp(argv->argv[0], argv->argv);
 
 	/*
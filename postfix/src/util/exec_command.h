@@ -11,10 +11,16 @@
 /* DESCRIPTION
 /* .nf
 
+ /*
+  * Utility library.
+  */
+#include <argv.h>
+
  /*
   * External interface.
   */
 extern NORETURN exec_command(const char *);
+extern ARGV *exec_command_argv(const char *);
 
 /* LICENSE
 /* .ad
@@ -25,6 +25,8 @@
 
 extern HASH_FNV_T hash_fnv(const void *, size_t);
 extern HASH_FNV_T hash_fnvz(const char *);
+extern HASH_FNV_T hash_word(const void *, size_t);
+extern HASH_FNV_T hash_wordz(const char *);
 
 /* LICENSE
 /* .ad
@@ -47,6 +47,25 @@
 /*	HTABLE_INFO **htable_list(table)
 /*	HTABLE	*table;
 /*
+/*	size_t	htable_keyhash(key)
+/*	const char *key;
+/*
+/*	HTABLE_INFO *htable_enter_hash(table, key, hash, value)
+/*	HTABLE	*table;
+/*	const char *key;
+/*	size_t	hash;
+/*	void	*value;
+/*
+/*	char	*htable_find_hash(table, key, hash)
+/*	HTABLE	*table;
+/*	const char *key;
+/*	size_t	hash;
+/*
+/*	HTABLE_INFO *htable_locate_hash(table, key, hash)
+/*	HTABLE	*table;
+/*	const char *key;
+/*	size_t	hash;
+/*
 /*	HTABLE_INFO *htable_sequence(table, how)
 /*	HTABLE	*table;
 /*	int	how;
@@ -95,6 +114,32 @@
 /*	to start a new sequence, HTABLE_SEQ_NEXT to continue, and
 /*	HTABLE_SEQ_STOP to terminate a sequence early.  The caller
 /*	must not delete an element before it is visited.
+/*
+/*	htable_keyhash() computes the hash value of a lookup key.
+/*	The result is the same for all tables in a process.
+/*	htable_enter_hash(), htable_find_hash() and htable_locate_hash()
+/*	are like htable_enter(), htable_find() and htable_locate(), but
+/*	use the specified hash value instead of computing it. Use these
+/*	to avoid hashing the same key more than once, for example when
+/*	a lookup that fails is followed by an update.
+/* IMPLEMENTATION
+/* .ad
+/* .fi
+/*	Each entry remembers the hash value of its key, so that a
+/*	table is resized without hashing all keys again, and most
+/*	key comparisons with non-matching entries are avoided.
+/*	By default, a table is an array of collision chains. When
+/*	compiled with -DUSE_FLAT_HTABLE, a table is an array of
+/*	entry pointers with open addressing, plus an array with one
+/*	control byte per slot that holds 7 bits of the key's hash
+/*	value. A lookup examines the control bytes of 8 slots at a
+/*	time, and compares keys only when those hash bits match.
+/*	Each entry is one memory allocation that includes the key,
+/*	and entries don't move when a table is resized, so that
+/*	entry and key pointers remain valid until the entry is
+/*	deleted. With either implementation the order of
+/*	htable_walk(), htable_list() and htable_sequence() is
+/*	unspecified.
 /* RESTRICTIONS
 /*	A callback function should not modify the hash table that is
 /*	specified to its caller.
@@ -125,10 +170,12 @@
 
 #include <sys_defs.h>
 #include <string.h>
+#include <stdint.h>
 
 /* Local stuff */
 
 #include "mymalloc.h"
+#include "mypool.h"
 #include "msg.h"
 #include "htable.h"
 
@@ -137,11 +184,11 @@
 #ifndef NO_HASH_FNV
 #include "hash_fnv.h"
 
-#define htable_hash(s, size) (hash_fnvz(s) % (size))
+#define htable_hashz(s) ((size_t) hash_wordz(s))
 
 #else
 
-static size_t htable_hash(const char *s, size_t size)
+static size_t htable_hashz(const char *s)
 {
     size_t  h = 0;
     size_t  g;
@@ -157,15 +204,29 @@ static size_t htable_hash(const char *s, size_t size)
 	    h ^= g;
 	}
     }
-    return (h % size);
+    return (h);
 }
 
 #endif
 
+/* htable_keyhash - hash a string for htable_*_hash() */
+
+size_t  htable_keyhash(const char *key)
+{
+    return (htable_hashz(key));
+}
+
+#ifndef USE_FLAT_HTABLE
+
+ /*
+  * Entries are allocated from one pool that is shared by all tables.
+  */
+static MYPOOL *htable_info_pool;
+
 /* htable_link - insert element into table */
 
 #define htable_link(table, element) { \
-     HTABLE_INFO **_h = table->data + htable_hash(element->key, table->size);\
+     HTABLE_INFO **_h = table->data + element->hash % table->size;\
     element->prev = 0; \
     if ((element->next = *_h) != 0) \
 	(*_h)->prev = element; \
@@ -178,10 +239,13 @@ static size_t htable_hash(const char *s, size_t size)
 static void htable_size(HTABLE *table, size_t size)
 {
     HTABLE_INFO **h;
+    int     tag;
 
     size |= 1;
 
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_HTABLE);
     table->data = h = (HTABLE_INFO **) mymalloc(size * sizeof(HTABLE_INFO *));
+    (void) mymalloc_set_tag(tag);
     table->size = size;
     table->used = 0;
 
@@ -194,8 +258,11 @@ static void htable_size(HTABLE *table, size_t size)
 HTABLE *htable_create(ssize_t size)
 {
     HTABLE *table;
+    int     tag;
 
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_HTABLE);
     table = (HTABLE *) mymalloc(sizeof(HTABLE));
+    (void) mymalloc_set_tag(tag);
     htable_size(table, size < 13 ? 13 : size);
     table->seq_bucket = table->seq_element = 0;
     return (table);
@@ -222,47 +289,39 @@ static void htable_grow(HTABLE *table)
     myfree((void *) old_entries);
 }
 
-/* htable_enter - enter (key, value) pair */
+/* htable_enter_hash - enter (key, value) pair with known hash */
 
-HTABLE_INFO *htable_enter(HTABLE *table, const char *key, void *value)
+HTABLE_INFO *htable_enter_hash(HTABLE *table, const char *key, size_t hash,
+			               void *value)
 {
     HTABLE_INFO *ht;
+    int     tag;
 
     if (table->used >= table->size)
 	htable_grow(table);
-    ht = (HTABLE_INFO *) mymalloc(sizeof(HTABLE_INFO));
+    if (htable_info_pool == 0)
+	htable_info_pool = mypool_create("htable_info", sizeof(HTABLE_INFO));
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_HTABLE);
+    ht = (HTABLE_INFO *) mypool_alloc(htable_info_pool);
     ht->key = mystrdup(key);
+    (void) mymalloc_set_tag(tag);
     ht->value = value;
+    ht->hash = hash;
     htable_link(table, ht);
     return (ht);
 }
 
-/* htable_find - lookup value */
-
-void   *htable_find(HTABLE *table, const char *key)
-{
-    HTABLE_INFO *ht;
-
-#define	STREQ(x,y) (x == y || (x[0] == y[0] && strcmp(x,y) == 0))
-
-    if (table)
-	for (ht = table->data[htable_hash(key, table->size)]; ht; ht = ht->next)
-	    if (STREQ(key, ht->key))
-		return (ht->value);
-    return (0);
-}
-
-/* htable_locate - lookup entry */
+/* htable_locate_hash - lookup entry with known hash */
 
-HTABLE_INFO *htable_locate(HTABLE *table, const char *key)
+HTABLE_INFO *htable_locate_hash(HTABLE *table, const char *key, size_t hash)
 {
     HTABLE_INFO *ht;
 
 #define	STREQ(x,y) (x == y || (x[0] == y[0] && strcmp(x,y) == 0))
 
     if (table)
-	for (ht = table->data[htable_hash(key, table->size)]; ht; ht = ht->next)
-	    if (STREQ(key, ht->key))
+	for (ht = table->data[hash % table->size]; ht; ht = ht->next)
+	    if (ht->hash == hash && STREQ(key, ht->key))
 		return (ht);
     return (0);
 }
@@ -273,12 +332,13 @@ void    htable_delete(HTABLE *table, const char *key, void (*free_fn) (void *))
 {
     if (table) {
 	HTABLE_INFO *ht;
-	HTABLE_INFO **h = table->data + htable_hash(key, table->size);
+	size_t  hash = htable_hashz(key);
+	HTABLE_INFO **h = table->data + hash % table->size;
 
 #define	STREQ(x,y) (x == y || (x[0] == y[0] && strcmp(x,y) == 0))
 
 	for (ht = *h; ht; ht = ht->next) {
-	    if (STREQ(key, ht->key)) {
+	    if (ht->hash == hash && STREQ(key, ht->key)) {
 		if (ht->next)
 		    ht->next->prev = ht->prev;
 		if (ht->prev)
@@ -289,7 +349,7 @@ void    htable_delete(HTABLE *table, const char *key, void (*free_fn) (void *))
 		myfree(ht->key);
 		if (free_fn && ht->value)
 		    (*free_fn) (ht->value);
-		myfree((void *) ht);
+		mypool_free(htable_info_pool, (void *) ht);
 		return;
 	    }
 	}
@@ -313,7 +373,7 @@ void    htable_free(HTABLE *table, void (*free_fn) (void *))
 		myfree(ht->key);
 		if (free_fn && ht->value)
 		    (*free_fn) (ht->value);
-		myfree((void *) ht);
+		mypool_free(htable_info_pool, (void *) ht);
 	    }
 	}
 	myfree((void *) table->data);
@@ -361,6 +421,333 @@ HTABLE_INFO **htable_list(HTABLE *table)
     return (list);
 }
 
+#else					/* USE_FLAT_HTABLE */
+
+ /*
+  * Control bytes: the high bit is set for an unused or deleted slot, and
+  * clear for a slot in use; then the low 7 bits hold part of the hash value.
+  * The control array is HTABLE_GROUP-1 bytes longer than the entries array,
+  * and those extra bytes mirror the first bytes of the control array, so
+  * that a probe can load HTABLE_GROUP bytes at any slot position.
+  */
+#define HTABLE_GROUP	8		/* slots examined per probe */
+#define HTABLE_EMPTY	0x80		/* never used */
+#define HTABLE_DELETED	0xfe		/* tombstone */
+#define HTABLE_FULL(c)	(((c) & 0x80) == 0)
+#define HTABLE_H1(h)	((h) >> 7)	/* probe start */
+#define HTABLE_H2(h)	((unsigned char) ((h) & 0x7f))	/* control bits */
+
+ /*
+  * Up to 7/8 of the slots may be in use or deleted.
+  */
+#define HTABLE_LIMIT(size)	((size) - (size) / 8)
+
+ /*
+  * Examine 8 control bytes with word-at-a-time operations. Each result has
+  * the high bit set in each byte that satisfies the condition (hash match
+  * results may include an occasional false positive). The bytes of a result
+  * are in the same memory order as the control bytes.
+  */
+typedef uint64_t HTABLE_WORD;
+
+#define HTABLE_LSB	((HTABLE_WORD) 0x0101010101010101ULL)
+#define HTABLE_MSB	((HTABLE_WORD) 0x8080808080808080ULL)
+
+#define htable_match_empty(w)	((w) & ~((w) << 6) & HTABLE_MSB)
+#define htable_match_free(w)	((w) & ~((w) << 7) & HTABLE_MSB)
+#define htable_match_slot(m, i)	(((unsigned char *) &(m))[i] & 0x80)
+
+static inline HTABLE_WORD htable_load(const unsigned char *cp)
+{
+    HTABLE_WORD w;
+
+    memcpy((void *) &w, (const void *) cp, sizeof(w));
+    return (w);
+}
+
+static inline HTABLE_WORD htable_match_hash(HTABLE_WORD w, unsigned char h2)
+{
+    HTABLE_WORD x = w ^ (HTABLE_LSB * h2);
+
+    return ((x - HTABLE_LSB) & ~x & HTABLE_MSB);
+}
+
+/* htable_set_ctrl - update control byte and its mirror */
+
+static inline void htable_set_ctrl(HTABLE *table, size_t slot,
+				           unsigned char c)
+{
+    size_t  mask = table->size - 1;
+
+    table->ctrl[slot] = c;
+    table->ctrl[((slot - (HTABLE_GROUP - 1)) & mask) + (HTABLE_GROUP - 1)] = c;
+}
+
+ /*
+  * Probe one group after another. The step size grows by one group each
+  * time, and because the table size is a power of two, the probe sequence
+  * visits every group.
+  */
+#define HTABLE_PROBE_INIT(table, hash, pos, step) \
+	((pos) = HTABLE_H1(hash) & ((table)->size - 1), (step) = 0)
+#define HTABLE_PROBE_NEXT(table, pos, step) \
+	((step) += HTABLE_GROUP, \
+	 (pos) = ((pos) + (step)) & ((table)->size - 1))
+
+/* htable_size - allocate and initialize hash table */
+
+static void htable_size(HTABLE *table, size_t size)
+{
+    size_t  want = size;
+    int     tag;
+
+    for (size = HTABLE_GROUP; HTABLE_LIMIT(size) < want; size *= 2)
+	 /* void */ ;
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_HTABLE);
+    table->data = (HTABLE_INFO **) mymalloc(size * sizeof(HTABLE_INFO *));
+    table->ctrl = (unsigned char *) mymalloc(size + HTABLE_GROUP - 1);
+    (void) mymalloc_set_tag(tag);
+    memset(table->ctrl, HTABLE_EMPTY, size + HTABLE_GROUP - 1);
+    table->size = size;
+    table->used = 0;
+    table->unused = HTABLE_LIMIT(size);
+}
+
+/* htable_link - insert element into table */
+
+static void htable_link(HTABLE *table, HTABLE_INFO *element)
+{
+    HTABLE_WORD match;
+    size_t  pos;
+    size_t  step;
+    size_t  slot;
+    int     i;
+
+    for (HTABLE_PROBE_INIT(table, element->hash, pos, step); /* void */ ;
+	 HTABLE_PROBE_NEXT(table, pos, step)) {
+	if ((match = htable_match_free(htable_load(table->ctrl + pos))) != 0)
+	    break;
+    }
+    for (i = 0; htable_match_slot(match, i) == 0; i++)
+	 /* void */ ;
+    slot = (pos + i) & (table->size - 1);
+    if (table->ctrl[slot] == HTABLE_EMPTY)
+	table->unused--;
+    htable_set_ctrl(table, slot, HTABLE_H2(element->hash));
+    table->data[slot] = element;
+    table->used++;
+}
+
+/* htable_slot - find slot for key */
+
+static ssize_t htable_slot(HTABLE *table, const char *key, size_t hash)
+{
+    HTABLE_WORD ctrl;
+    HTABLE_WORD match;
+    HTABLE_INFO *ht;
+    size_t  pos;
+    size_t  step;
+    size_t  slot;
+    int     i;
+
+#define	STREQ(x,y) (x == y || (x[0] == y[0] && strcmp(x,y) == 0))
+
+    for (HTABLE_PROBE_INIT(table, hash, pos, step); /* void */ ;
+	 HTABLE_PROBE_NEXT(table, pos, step)) {
+	ctrl = htable_load(table->ctrl + pos);
+	if ((match = htable_match_hash(ctrl, HTABLE_H2(hash))) != 0) {
+	    for (i = 0; i < HTABLE_GROUP; i++) {
+		if (htable_match_slot(match, i) == 0)
+		    continue;
+		slot = (pos + i) & (table->size - 1);
+		if (!HTABLE_FULL(table->ctrl[slot]))
+		    continue;
+		ht = table->data[slot];
+		if (ht->hash == hash && STREQ(key, ht->key))
+		    return (slot);
+	    }
+	}
+	if (htable_match_empty(ctrl) != 0)
+	    return (-1);
+    }
+}
+
+/* htable_create - create initial hash table */
+
+HTABLE *htable_create(ssize_t size)
+{
+    HTABLE *table;
+    int     tag;
+
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_HTABLE);
+    table = (HTABLE *) mymalloc(sizeof(HTABLE));
+    (void) mymalloc_set_tag(tag);
+    htable_size(table, size < 13 ? 13 : size);
+    table->seq_bucket = table->seq_element = 0;
+    return (table);
+}
+
+/* htable_grow - extend existing table, or purge deleted slots */
+
+static void htable_grow(HTABLE *table)
+{
+    ssize_t old_size = table->size;
+    HTABLE_INFO **old_entries = table->data;
+    unsigned char *old_ctrl = table->ctrl;
+    ssize_t i;
+
+    htable_size(table, table->used >= old_size / 2 ?
+		2 * HTABLE_LIMIT(old_size) : HTABLE_LIMIT(old_size));
+    for (i = 0; i < old_size; i++)
+	if (HTABLE_FULL(old_ctrl[i]))
+	    htable_link(table, old_entries[i]);
+    myfree((void *) old_entries);
+    myfree((void *) old_ctrl);
+}
+
+/* htable_enter_hash - enter (key, value) pair with known hash */
+
+HTABLE_INFO *htable_enter_hash(HTABLE *table, const char *key, size_t hash,
+			               void *value)
+{
+    HTABLE_INFO *ht;
+    size_t  len = strlen(key) + 1;
+    int     tag;
+
+    if (table->unused <= 0)
+	htable_grow(table);
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_HTABLE);
+    ht = (HTABLE_INFO *) mymalloc(sizeof(HTABLE_INFO) + len);
+    (void) mymalloc_set_tag(tag);
+    ht->key = memcpy((void *) (ht + 1), key, len);
+    ht->value = value;
+    ht->hash = hash;
+    htable_link(table, ht);
+    return (ht);
+}
+
+/* htable_locate_hash - lookup entry with known hash */
+
+HTABLE_INFO *htable_locate_hash(HTABLE *table, const char *key, size_t hash)
+{
+    ssize_t slot;
+
+    if (table && (slot = htable_slot(table, key, hash)) >= 0)
+	return (table->data[slot]);
+    return (0);
+}
+
+/* htable_delete - delete one entry */
+
+void    htable_delete(HTABLE *table, const char *key, void (*free_fn) (void *))
+{
+    if (table) {
+	HTABLE_INFO *ht;
+	ssize_t slot;
+
+	if ((slot = htable_slot(table, key, htable_hashz(key))) < 0)
+	    msg_panic("htable_delete: unknown_key: \"%s\"", key);
+	ht = table->data[slot];
+	htable_set_ctrl(table, slot, HTABLE_DELETED);
+	table->used--;
+	if (free_fn && ht->value)
+	    (*free_fn) (ht->value);
+	myfree((void *) ht);
+    }
+}
+
+/* htable_free - destroy hash table */
+
+void    htable_free(HTABLE *table, void (*free_fn) (void *))
+{
+    if (table) {
+	ssize_t i;
+	HTABLE_INFO *ht;
+
+	for (i = 0; i < table->size; i++) {
+	    if (HTABLE_FULL(table->ctrl[i])) {
+		ht = table->data[i];
+		if (free_fn && ht->value)
+		    (*free_fn) (ht->value);
+		myfree((void *) ht);
+	    }
+	}
+	myfree((void *) table->data);
+	table->data = 0;
+	myfree((void *) table->ctrl);
+	table->ctrl = 0;
+	if (table->seq_bucket)
+	    myfree((void *) table->seq_bucket);
+	table->seq_bucket = 0;
+	myfree((void *) table);
+    }
+}
+
+/* htable_walk - iterate over hash table */
+
+void    htable_walk(HTABLE *table, void (*action) (HTABLE_INFO *, void *),
+		            void *ptr) {
+    if (table) {
+	ssize_t i;
+
+	for (i = 0; i < table->size; i++)
+	    if (HTABLE_FULL(table->ctrl[i]))
+		(*action) (table->data[i], ptr);
+    }
+}
+
+/* htable_list - list all table members */
+
+HTABLE_INFO **htable_list(HTABLE *table)
+{
+    HTABLE_INFO **list;
+    ssize_t count = 0;
+    ssize_t i;
+
+    if (table != 0) {
+	list = (HTABLE_INFO **) mymalloc(sizeof(*list) * (table->used + 1));
+	for (i = 0; i < table->size; i++)
+	    if (HTABLE_FULL(table->ctrl[i]))
+		list[count++] = table->data[i];
+    } else {
+	list = (HTABLE_INFO **) mymalloc(sizeof(*list));
+    }
+    list[count] = 0;
+    return (list);
+}
+
+#endif					/* USE_FLAT_HTABLE */
+
+/* htable_enter - enter (key, value) pair */
+
+HTABLE_INFO *htable_enter(HTABLE *table, const char *key, void *value)
+{
+    return (htable_enter_hash(table, key, htable_hashz(key), value));
+}
+
+/* htable_locate - lookup entry */
+
+HTABLE_INFO *htable_locate(HTABLE *table, const char *key)
+{
+    return (table ? htable_locate_hash(table, key, htable_hashz(key)) : 0);
+}
+
+/* htable_find_hash - lookup value with known hash */
+
+void   *htable_find_hash(HTABLE *table, const char *key, size_t hash)
+{
+    HTABLE_INFO *ht;
+
+    return ((ht = htable_locate_hash(table, key, hash)) != 0 ? ht->value : 0);
+}
+
+/* htable_find - lookup value */
+
+void   *htable_find(HTABLE *table, const char *key)
+{
+    return (table ? htable_find_hash(table, key, htable_hashz(key)) : 0);
+}
+
 /* htable_sequence - dict(3) compatibility iterator */
 
 HTABLE_INFO *htable_sequence(HTABLE *table, int how)
@@ -426,8 +813,12 @@ int     main(int unused_argc, char **unused_argv)
 	ht_info[i] = ht_info[r];
 	ht_info[r] = info;
     }
-    for (ht = ht_info; *ht; ht++)
+    for (ht = ht_info; *ht; ht++) {
+	if (htable_locate_hash(hash, ht[0]->key,
+			       htable_keyhash(ht[0]->key)) != ht[0])
+	    msg_panic("entry not found by hash: \"%s\"", ht[0]->key);
 	htable_delete(hash, ht[0]->key, (void (*) (void *)) 0);
+    }
     if (hash->used > 0)
 	msg_panic("%ld entries not deleted", (long) hash->used);
     myfree((void *) ht_info);
@@ -437,3 +828,92 @@ int     main(int unused_argc, char **unused_argv)
 }
 
 #endif
+
+#ifdef BENCH
+
+ /*
+  * Compare implementations: time the insertion, successful and unsuccessful
+  * lookup, and deletion of a large number of keys. Build this program with
+  * and without -DUSE_FLAT_HTABLE.
+  */
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <vstream.h>
+#include <vstring.h>
+#include <myrand.h>
+
+#define BENCH_KEYFMT	"%lx.client.example.com"
+
+static double bench_since(struct timeval *start)
+{
+    struct timeval now;
+
+    GETTIMEOFDAY(&now);
+    return ((now.tv_sec - start->tv_sec) * 1e9
+	    + (now.tv_usec - start->tv_usec) * 1e3);
+}
+
+int     main(int argc, char **argv)
+{
+    ssize_t count = (argc > 1 ? atol(argv[1]) : 1000000);
+    VSTRING *buf = vstring_alloc(100);
+    HTABLE *hash;
+    char  **keys;
+    struct timeval start;
+    double  t_enter, t_hit, t_miss, t_delete;
+    ssize_t i;
+    ssize_t found = 0;
+    int     ch;
+
+    keys = (char **) mymalloc(sizeof(*keys) * count);
+    for (i = 0; i < count; i++) {
+	vstring_sprintf(buf, BENCH_KEYFMT, (long) myrand() << 16 | i);
+	keys[i] = mystrdup(vstring_str(buf));
+    }
+    hash = htable_create(0);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++)
+	htable_enter(hash, keys[i], (void *) keys[i]);
+    t_enter = bench_since(&start);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++)
+	found += (htable_find(hash, keys[(i * 7919) % count]) != 0);
+    t_hit = bench_since(&start);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++) {
+	ch = keys[i][0];
+	keys[i][0] = 'x';			/* not a hex digit */
+	found += (htable_find(hash, keys[i]) != 0);
+	keys[i][0] = ch;
+    }
+    t_miss = bench_since(&start);
+    htable_free(hash, (void (*) (void *)) 0);
+    hash = htable_create(0);
+    for (i = 0; i < count; i++)
+	htable_enter(hash, keys[i], (void *) 0);
+    GETTIMEOFDAY(&start);
+    for (i = 0; i < count; i++)
+	htable_delete(hash, keys[i], (void (*) (void *)) 0);
+    t_delete = bench_since(&start);
+    if (found != count)
+	msg_panic("found %ld of %ld keys", (long) found, (long) count);
+    vstream_printf("%s: %ld keys, ns/operation: enter %.0f find %.0f "
+		   "miss %.0f delete %.0f\n",
+#ifdef USE_FLAT_HTABLE
+		   "open addressing",
+#else
+		   "chaining",
+#endif
+		   (long) count, t_enter / count, t_hit / count,
+		   t_miss / count, t_delete / count);
+    vstream_fflush(VSTREAM_OUT);
+    htable_free(hash, (void (*) (void *)) 0);
+    for (i = 0; i < count; i++)
+	myfree(keys[i]);
+    myfree((void *) keys);
+    vstring_free(buf);
+    return (0);
+}
+
+#endif
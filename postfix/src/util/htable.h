@@ -13,9 +13,12 @@
 
  /* Structure of one hash table entry. */
 
+#ifndef USE_FLAT_HTABLE
+
 typedef struct HTABLE_INFO {
     char   *key;			/* lookup key */
     void   *value;			/* associated value */
+    size_t  hash;			/* full hash of key */
     struct HTABLE_INFO *next;		/* colliding entry */
     struct HTABLE_INFO *prev;		/* colliding entry */
 } HTABLE_INFO;
@@ -30,10 +33,36 @@ typedef struct HTABLE {
     HTABLE_INFO **seq_element;		/* current sequence element */
 } HTABLE;
 
+#else
+
+typedef struct HTABLE_INFO {
+    char   *key;			/* lookup key, stored inline */
+    void   *value;			/* associated value */
+    size_t  hash;			/* full hash of key */
+} HTABLE_INFO;
+
+ /* Structure of one hash table, with open addressing. */
+
+typedef struct HTABLE {
+    ssize_t size;			/* length of entries array */
+    ssize_t used;			/* number of entries in table */
+    ssize_t unused;			/* never-used slots left */
+    unsigned char *ctrl;		/* slot status and hash bits */
+    HTABLE_INFO **data;			/* entries array, auto-resized */
+    HTABLE_INFO **seq_bucket;		/* current sequence hash bucket */
+    HTABLE_INFO **seq_element;		/* current sequence element */
+} HTABLE;
+
+#endif
+
 extern HTABLE *htable_create(ssize_t);
 extern HTABLE_INFO *htable_enter(HTABLE *, const char *, void *);
 extern HTABLE_INFO *htable_locate(HTABLE *, const char *);
 extern void *htable_find(HTABLE *, const char *);
+extern size_t htable_keyhash(const char *);
+extern HTABLE_INFO *htable_enter_hash(HTABLE *, const char *, size_t, void *);
+extern HTABLE_INFO *htable_locate_hash(HTABLE *, const char *, size_t);
+extern void *htable_find_hash(HTABLE *, const char *, size_t);
 extern void htable_delete(HTABLE *, const char *, void (*) (void *));
 extern void htable_free(HTABLE *, void (*) (void *));
 extern void htable_walk(HTABLE *, void (*) (HTABLE_INFO *, void *), void *);
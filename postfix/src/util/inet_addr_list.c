@@ -16,6 +16,10 @@
 /*	void	inet_addr_list_uniq(list)
 /*	INET_ADDR_LIST *list;
 /*
+/*	int	inet_addr_list_find(list, addr)
+/*	INET_ADDR_LIST *list;
+/*	struct sockaddr *addr;
+/*
 /*	void	inet_addr_list_free(list)
 /*	INET_ADDR_LIST *list;
 /* DESCRIPTION
@@ -31,6 +35,11 @@
 /*	inet_addr_list_uniq() sorts the specified address list and
 /*	eliminates duplicates.
 /*
+/*	inet_addr_list_find() determines if the specified address
+/*	is a member of the specified list, with a binary search.
+/*	The list must have been sorted with inet_addr_list_uniq().
+/*	Only the address is compared, not the port.
+/*
 /*	inet_addr_list_free() reclaims memory used for the
 /*	specified address list.
 /* LICENSE
@@ -137,6 +146,14 @@ void    inet_addr_list_uniq(INET_ADDR_LIST *list)
     list->used = n;
 }
 
+/* inet_addr_list_find - search sorted internet address list */
+
+int     inet_addr_list_find(INET_ADDR_LIST *list, struct sockaddr *addr)
+{
+    return (bsearch((void *) addr, (void *) list->addrs, list->used,
+		    sizeof(list->addrs[0]), inet_addr_list_comp) != 0);
+}
+
 /* inet_addr_list_free - destroy internet address list */
 
 void    inet_addr_list_free(INET_ADDR_LIST *list)
@@ -168,6 +185,7 @@ int     main(int argc, char **argv)
 {
     INET_ADDR_LIST list;
     INET_PROTO_INFO *proto_info;
+    struct sockaddr_storage *sa;
 
     proto_info = inet_proto_init(argv[0], INET_PROTO_NAME_ALL);
     inet_addr_list_init(&list);
@@ -179,6 +197,11 @@ int     main(int argc, char **argv)
     inet_addr_list_uniq(&list);
     msg_info("list after sort/uniq");
     inet_addr_list_print(&list);
+    for (sa = list.addrs; sa < list.addrs + list.used; sa++)
+	if (!inet_addr_list_find(&list, SOCK_ADDR_PTR(sa)))
+	    msg_fatal("lookup failed for list member %d",
+		      (int) (sa - list.addrs));
+    msg_info("lookup of all list members succeeded");
     inet_addr_list_free(&list);
     return (0);
 }
@@ -29,6 +29,7 @@ extern void inet_addr_list_init(INET_ADDR_LIST *);
 extern void inet_addr_list_free(INET_ADDR_LIST *);
 extern void inet_addr_list_uniq(INET_ADDR_LIST *);
 extern void inet_addr_list_append(INET_ADDR_LIST *, struct sockaddr *);
+extern int inet_addr_list_find(INET_ADDR_LIST *, struct sockaddr *);
 
 /* LICENSE
 /* .ad
@@ -14,6 +14,14 @@
 /*	const char *buffer.
 /*	ssize_t	buflen)
 /*
+/*	int	logwriter_append(
+/*	VSTREAM	*file,
+/*	const char *buffer.
+/*	ssize_t	buflen)
+/*
+/*	int	logwriter_flush(
+/*	VSTREAM	*file)
+/*
 /*	int	logwriter_close(
 /*	VSTREAM	*file)
 /*
@@ -24,6 +32,9 @@
 /*
 /*	int	set_logwriter_create_perms(
 /*	const char *mode)
+/*
+/*	int	set_logwriter_format(
+/*	const char *format)
 /* DESCRIPTION
 /*	This module manages a logfile writer.
 /*
@@ -34,6 +45,15 @@
 /*	open logfile. The result is zero if successful, VSTREAM_EOF
 /*	if the operation failed.
 /*
+/*	logwriter_append() is like logwriter_write(), but leaves
+/*	the record in the VSTREAM buffer. This allows a logfile
+/*	writer to send a batch of records with one write() system
+/*	call.
+/*
+/*	logwriter_flush() writes buffered records to the logfile.
+/*	The result is zero if successful, VSTREAM_EOF if the operation
+/*	failed.
+/*
 /*	logwriter_close() closes the logfile and destroys the VSTREAM
 /*	instance. The result is zero if there were no errors writing
 /*	the file, VSTREAM_EOF otherwise.
@@ -46,10 +66,20 @@
 /*	will be used when creating a logfile. Valid inputs are
 /*	"644", "640", and "600". Leading zeros are allowed and
 /*	ignored.
+/*
+/*	set_logwriter_format() sets the logfile record format.
+/*	Specify "text" (the default) to write records as received,
+/*	or "json" to write each record as one JSON object with the
+/*	"timestamp", "host", "program", "pid", "severity" and
+/*	"message" members, parsed from the syslog-like record format
+/*	of msg_logger(3). Members that cannot be parsed are omitted;
+/*	text that is not valid UTF-8 is escaped byte by byte.
 /* DIAGNOSTICS
 /*	Fatal error: logfile create error; warning: logfile permission
 /*	change error. set_logwriter_create_perms() returns the file
 /*	create permission if the request is valid, -1 otherwise.
+/*	set_logwriter_format() returns a LOGWRITER_FORMAT_XXX value
+/*	if the request is valid, -1 otherwise.
 /* LICENSE
 /* .ad
 /* .fi
@@ -68,6 +98,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
 
  /*
   * Utility library.
@@ -77,13 +108,16 @@
 #include <msg.h>
 #include <mymalloc.h>
 #include <safe_open.h>
+#include <stringops.h>
 #include <vstream.h>
+#include <vstring.h>
 #include <name_code.h>
 
  /*
   * Application-specific.
   */
 static int logwriter_perms = 0600;
+static int logwriter_format = LOGWRITER_FORMAT_TEXT;
 
 /* logwriter_open_or_die - open logfile */
 
@@ -105,15 +139,130 @@ VSTREAM *logwriter_open_or_die(const char *path)
     return (fp);
 }
 
-/* logwriter_write - append to logfile */
+/* logwriter_json_string - append JSON string member */
 
-int     logwriter_write(VSTREAM *fp, const char *buf, ssize_t len)
+static void logwriter_json_string(VSTRING *out, const char *name,
+				          const char *str, ssize_t len,
+				          int utf8)
+{
+    const unsigned char *cp;
+    const unsigned char *end = (const unsigned char *) str + len;
+    int     ch;
+
+    if (VSTRING_LEN(out) > 1)
+	VSTRING_ADDCH(out, ',');
+    vstring_sprintf_append(out, "\"%s\":\"", name);
+    for (cp = (const unsigned char *) str; cp < end; cp++) {
+	ch = *cp;
+	if (ch == '"' || ch == '\\') {
+	    VSTRING_ADDCH(out, '\\');
+	    VSTRING_ADDCH(out, ch);
+	} else if (ch < 0x20 || ch == 0x7f || (ch >= 0x80 && !utf8)) {
+	    vstring_sprintf_append(out, "\\u%04x", ch);
+	} else {
+	    VSTRING_ADDCH(out, ch);
+	}
+    }
+    VSTRING_ADDCH(out, '"');
+}
+
+/* logwriter_json - convert msg_logger(3) record to JSON */
+
+static void logwriter_json(VSTRING *out, const char *buf, ssize_t len)
+{
+    static const char *severities[] = {
+	"warning", "error", "fatal", "panic", 0,
+    };
+    const char *end = buf + len;
+    const char *cp = buf;
+    const char *host;
+    const char *prog;
+    const char *pid;
+    const char **sp;
+    ssize_t n;
+    int     utf8;
+
+#define STAMP_LEN	15			/* "Mmm dd hh:mm:ss" */
+
+    utf8 = allascii_len(buf, len) || valid_utf8_string(buf, len);
+    VSTRING_RESET(out);
+    VSTRING_ADDCH(out, '{');
+
+    /*
+     * Time stamp, host name, and program[pid] as formatted by msg_logger(3).
+     * Give up on the prefix as soon as something does not match.
+     */
+    if (len > STAMP_LEN && cp[STAMP_LEN] == ' ') {
+	host = cp + STAMP_LEN + 1;
+	for (prog = host; prog < end && *prog != ' '; prog++)
+	     /* void */ ;
+	if (prog < end)
+	    prog++;
+	for (pid = prog; pid < end && *pid != '[' && *pid != ' '; pid++)
+	     /* void */ ;
+	for (cp = pid + 1; cp < end && ISDIGIT(*cp); cp++)
+	     /* void */ ;
+	if (pid < end && *pid == '[' && cp > pid + 1 && end - cp >= 3
+	    && strncmp(cp, "]: ", 3) == 0) {
+	    logwriter_json_string(out, "timestamp", buf, STAMP_LEN, utf8);
+	    logwriter_json_string(out, "host", host, prog - host - 1, utf8);
+	    logwriter_json_string(out, "program", prog, pid - prog, utf8);
+	    vstring_sprintf_append(out, ",\"pid\":%.*s",
+				   (int) (cp - pid - 1), pid + 1);
+	    cp += 3;
+	    for (sp = severities; *sp; sp++) {
+		n = strlen(*sp);
+		if (end - cp > n + 1 && strncmp(cp, *sp, n) == 0
+		    && strncmp(cp + n, ": ", 2) == 0) {
+		    logwriter_json_string(out, "severity", *sp, n, utf8);
+		    cp += n + 2;
+		    break;
+		}
+	    }
+	    if (*sp == 0)
+		logwriter_json_string(out, "severity", "info", 4, utf8);
+	} else {
+	    cp = buf;
+	}
+    }
+    logwriter_json_string(out, "message", cp, end - cp, utf8);
+    VSTRING_ADDCH(out, '}');
+    VSTRING_TERMINATE(out);
+}
+
+/* logwriter_append - append to logfile, without flushing */
+
+int     logwriter_append(VSTREAM *fp, const char *buf, ssize_t len)
 {
+    static VSTRING *json_buf;
+
     if (len < 0)
-	msg_panic("logwriter_write: negative length %ld", (long) len);
+	msg_panic("logwriter_append: negative length %ld", (long) len);
+    if (logwriter_format == LOGWRITER_FORMAT_JSON) {
+	if (json_buf == 0)
+	    json_buf = vstring_alloc(200);
+	logwriter_json(json_buf, buf, len);
+	buf = vstring_str(json_buf);
+	len = VSTRING_LEN(json_buf);
+    }
     if (vstream_fwrite(fp, buf, len) != len)
 	return (VSTREAM_EOF);
-    VSTREAM_PUTC('\n', fp);
+    return (VSTREAM_PUTC('\n', fp) == VSTREAM_EOF ? VSTREAM_EOF : 0);
+}
+
+/* logwriter_flush - write buffered records */
+
+int     logwriter_flush(VSTREAM *fp)
+{
+    return (vstream_fflush(fp));
+}
+
+/* logwriter_write - append to logfile */
+
+int     logwriter_write(VSTREAM *fp, const char *buf, ssize_t len)
+{
+    if (logwriter_append(fp, buf, len) != 0)
+	return (VSTREAM_EOF);
     return (vstream_fflush(fp));
 }
 
@@ -154,3 +303,19 @@ int     set_logwriter_create_perms(const char *mode_str)
 	logwriter_perms = perms;
     return (perms);
 }
+
+/* set_logwriter_format - logfile format control */
+
+int     set_logwriter_format(const char *format)
+{
+    static const NAME_CODE formats[] = {
+	LOGWRITER_FORMAT_NAME_TEXT, LOGWRITER_FORMAT_TEXT,
+	LOGWRITER_FORMAT_NAME_JSON, LOGWRITER_FORMAT_JSON,
+	0, -1,
+    };
+    int     code;
+
+    if ((code = name_code(formats, NAME_CODE_FLAG_NONE, format)) != -1)
+	logwriter_format = code;
+    return (code);
+}
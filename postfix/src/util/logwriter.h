@@ -21,9 +21,18 @@
   */
 extern VSTREAM *logwriter_open_or_die(const char *);
 extern int logwriter_write(VSTREAM *, const char *, ssize_t);
+extern int logwriter_append(VSTREAM *, const char *, ssize_t);
+extern int logwriter_flush(VSTREAM *);
 extern int logwriter_close(VSTREAM *);
 extern int logwriter_one_shot(const char *, const char *, ssize_t);
 extern int set_logwriter_create_perms(const char *);
+extern int set_logwriter_format(const char *);
+
+#define LOGWRITER_FORMAT_TEXT	0
+#define LOGWRITER_FORMAT_JSON	1
+
+#define LOGWRITER_FORMAT_NAME_TEXT	"text"
+#define LOGWRITER_FORMAT_NAME_JSON	"json"
 
 /* LICENSE
 /* .ad
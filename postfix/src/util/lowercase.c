@@ -8,9 +8,16 @@
 /*
 /*	char	*lowercase(buf)
 /*	char	*buf;
+/*
+/*	int	lowercase_needed(buf)
+/*	const char *buf;
 /* DESCRIPTION
 /*	lowercase() replaces uppercase characters in its null-terminated
 /*	input by their lowercase equivalent.
+/*
+/*	lowercase_needed() returns non-zero when lowercase() would
+/*	change its input. This avoids making a copy of input that
+/*	is already in lowercase.
 /* LICENSE
 /* .ad
 /* .fi
@@ -41,3 +48,16 @@ char   *lowercase(char *string)
 	    *cp = TOLOWER(ch);
     return (string);
 }
+
+/* lowercase_needed - does the string contain uppercase characters */
+
+int     lowercase_needed(const char *string)
+{
+    const char *cp;
+    int     ch;
+
+    for (cp = string; (ch = *(unsigned char *) cp) != 0; cp++)
+	if (ISUPPER(ch))
+	    return (1);
+    return (0);
+}
@@ -133,6 +133,15 @@
 /*	mac_exp_op_res_bool provides an array that converts a boolean
 /*	value (0 or 1) to the corresponding MAX_EXP_OP_RES_TRUE or
 /*	MAX_EXP_OP_RES_FALSE value.
+/*
+/*	mac_expand() remembers the parsed form of recently-used
+/*	patterns, so that a pattern that is expanded repeatedly
+/*	(for example, a configuration parameter value that is
+/*	expanded once per message or recipient) is split into
+/*	literal text and attribute references only once. A plain
+/*	$name or ${name} reference in a remembered pattern is looked
+/*	up directly; other references are evaluated as before.
+/*	Patterns with a syntax error are not remembered.
 /* DIAGNOSTICS
 /*	Fatal errors: out of memory.  Warnings: syntax errors, unreasonable
 /*	recursion depth.
@@ -179,6 +188,7 @@
 #include <name_code.h>
 #include <sane_strtol.h>
 #include <mac_parse.h>
+#include <ctable.h>
 #include <mac_expand.h>
 
  /*
@@ -189,10 +199,39 @@ MAC_EXP_OP_RES mac_exp_op_res_bool[2] = {
     MAC_EXP_OP_RES_TRUE
 };
 
+ /*
+  * The parsed form of a pattern: the sequence of literal text and attribute
+  * reference segments that mac_parse() reports for the top-level pattern.
+  * A simple segment is a plain attribute name without operators.
+  */
+typedef struct {
+    int     type;			/* MAC_PARSE_LITERAL or EXPR */
+    int     simple;			/* plain $name or ${name} */
+    char   *text;			/* literal text or expression */
+} MAC_EXP_SEG;
+
+typedef struct {
+    MAC_EXP_SEG *segs;			/* segments */
+    int     seg_count;			/* segments in use */
+    int     seg_size;			/* segments allocated */
+    int     compiled;			/* segments are complete */
+} MAC_EXP_TMPL;
+
+ /*
+  * Cache with the parsed form of recently-used top-level patterns. Nested
+  * mac_expand() calls bypass the cache, so that a pattern cannot be purged
+  * while it is being evaluated.
+  */
+#define MAC_EXP_CACHE_SIZE	100
+
+static CTABLE *mac_exp_cache;
+static int mac_exp_depth;
+
  /*
   * Little helper structure.
   */
 typedef struct {
+    MAC_EXP_TMPL *record;		/* parsed form, or null */
     VSTRING *result;			/* result buffer */
     int     flags;			/* features */
     const char *filter;			/* character filter */
@@ -535,6 +574,80 @@ void    mac_expand_add_relop(int *tok_list, const char *suffix,
     }
 }
 
+/* mac_exp_tmpl_create - create empty parsed form */
+
+static void *mac_exp_tmpl_create(const char *unused_key, void *unused_context)
+{
+    MAC_EXP_TMPL *tmpl = (MAC_EXP_TMPL *) mymalloc(sizeof(*tmpl));
+
+    tmpl->seg_size = 2;
+    tmpl->segs = (MAC_EXP_SEG *) mymalloc(sizeof(*tmpl->segs) * tmpl->seg_size);
+    tmpl->seg_count = 0;
+    tmpl->compiled = 0;
+    return ((void *) tmpl);
+}
+
+/* mac_exp_tmpl_reset - discard segments */
+
+static void mac_exp_tmpl_reset(MAC_EXP_TMPL *tmpl)
+{
+    while (tmpl->seg_count > 0)
+	myfree(tmpl->segs[--tmpl->seg_count].text);
+    tmpl->compiled = 0;
+}
+
+/* mac_exp_tmpl_free - destroy parsed form */
+
+static void mac_exp_tmpl_free(void *ptr, void *unused_context)
+{
+    MAC_EXP_TMPL *tmpl = (MAC_EXP_TMPL *) ptr;
+
+    mac_exp_tmpl_reset(tmpl);
+    myfree((void *) tmpl->segs);
+    myfree((void *) tmpl);
+}
+
+/* mac_exp_tmpl_add - append segment to parsed form */
+
+static void mac_exp_tmpl_add(MAC_EXP_TMPL *tmpl, int type, const char *text)
+{
+    MAC_EXP_SEG *seg;
+    const char *cp;
+
+    if (tmpl->seg_count >= tmpl->seg_size) {
+	tmpl->seg_size *= 2;
+	tmpl->segs = (MAC_EXP_SEG *) myrealloc((void *) tmpl->segs,
+				      sizeof(*tmpl->segs) * tmpl->seg_size);
+    }
+    seg = tmpl->segs + tmpl->seg_count++;
+    seg->type = type;
+    seg->text = mystrdup(text);
+    seg->simple = 0;
+    if (type == MAC_PARSE_EXPR && *text != 0) {
+	for (cp = text; ISALNUM(*cp) || *cp == '_'; cp++)
+	     /* void */ ;
+	seg->simple = (*cp == 0);
+    }
+}
+
+/* mac_exp_append_value - append filtered attribute value to result */
+
+static void mac_exp_append_value(MAC_EXP_CONTEXT *mc, const char *value)
+{
+    ssize_t res_len;
+    char   *cp;
+
+    res_len = VSTRING_LEN(mc->result);
+    vstring_strcat(mc->result, value);
+    if (mc->flags & MAC_EXP_FLAG_PRINTABLE) {
+	printable(vstring_str(mc->result) + res_len, '_');
+    } else if (mc->filter) {
+	cp = vstring_str(mc->result) + res_len;
+	while (*(cp += strspn(cp, mc->filter)))
+	    *cp++ = '_';
+    }
+}
+
 /* mac_expand_callback - callback for mac_parse */
 
 static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
@@ -545,11 +658,17 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
     const char *lookup;
     char   *cp;
     int     ch;
-    ssize_t res_len;
     ssize_t tmp_len;
     const char *res_iftrue;
     const char *res_iffalse;
 
+    /*
+     * Remember the top-level segments of a pattern that is being parsed for
+     * the first time.
+     */
+    if (mc->record != 0 && mc->level == 0)
+	mac_exp_tmpl_add(mc->record, type, vstring_str(buf));
+
     /*
      * Sanity check.
      */
@@ -679,15 +798,7 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
 		mc->status |= mac_parse(vstring_str(buf), mac_expand_callback,
 					(void *) mc);
 	    } else {
-		res_len = VSTRING_LEN(mc->result);
-		vstring_strcat(mc->result, lookup);
-		if (mc->flags & MAC_EXP_FLAG_PRINTABLE) {
-		    printable(vstring_str(mc->result) + res_len, '_');
-		} else if (mc->filter) {
-		    cp = vstring_str(mc->result) + res_len;
-		    while (*(cp += strspn(cp, mc->filter)))
-			*cp++ = '_';
-		}
+		mac_exp_append_value(mc, lookup);
 	    }
 	    break;
 	default:
@@ -706,6 +817,44 @@ static int mac_expand_callback(int type, VSTRING *buf, void *ptr)
     return (mc->status);
 }
 
+/* mac_exp_tmpl_eval - expand parsed form */
+
+static int mac_exp_tmpl_eval(MAC_EXP_CONTEXT *mc, MAC_EXP_TMPL *tmpl)
+{
+    MAC_EXP_SEG *seg;
+    VSTRING *buf = 0;
+    const char *lookup;
+
+    /*
+     * Plain $name references are looked up directly. Other references are
+     * handed to mac_expand_callback() as if they came from mac_parse(),
+     * with a private copy because that code modifies its input.
+     */
+    for (seg = tmpl->segs; seg < tmpl->segs + tmpl->seg_count; seg++) {
+	if (mc->status & MAC_PARSE_ERROR)
+	    break;
+	if (seg->type == MAC_PARSE_LITERAL) {
+	    if ((mc->flags & MAC_EXP_FLAG_SCAN) == 0)
+		vstring_strcat(mc->result, seg->text);
+	} else if (seg->simple
+		   && (mc->flags & (MAC_EXP_FLAG_SCAN | MAC_EXP_FLAG_RECURSE)) == 0) {
+	    if ((lookup = mc->lookup(seg->text, MAC_EXP_MODE_USE,
+				     mc->context)) == 0)
+		mc->status |= MAC_PARSE_UNDEF;
+	    else if (*lookup != 0)
+		mac_exp_append_value(mc, lookup);
+	} else {
+	    if (buf == 0)
+		buf = vstring_alloc(100);
+	    vstring_strcpy(buf, seg->text);
+	    (void) mac_expand_callback(seg->type, buf, (void *) mc);
+	}
+    }
+    if (buf)
+	vstring_free(buf);
+    return (mc->status);
+}
+
 /* mac_expand - expand $name instances */
 
 int     mac_expand(VSTRING *result, const char *pattern, int flags,
@@ -713,6 +862,7 @@ int     mac_expand(VSTRING *result, const char *pattern, int flags,
 		           MAC_EXP_LOOKUP_FN lookup, void *context)
 {
     MAC_EXP_CONTEXT mc;
+    MAC_EXP_TMPL *tmpl = 0;
     int     status;
 
     /*
@@ -725,9 +875,35 @@ int     mac_expand(VSTRING *result, const char *pattern, int flags,
     mc.context = context;
     mc.status = 0;
     mc.level = 0;
+    mc.record = 0;
     if ((flags & (MAC_EXP_FLAG_APPEND | MAC_EXP_FLAG_SCAN)) == 0)
 	VSTRING_RESET(result);
-    status = mac_parse(pattern, mac_expand_callback, (void *) &mc);
+
+    /*
+     * Use the parsed form of a recently-used top-level pattern. Otherwise,
+     * parse the pattern and remember the result if it is free of syntax
+     * errors.
+     */
+    if (mac_exp_depth++ == 0) {
+	if (mac_exp_cache == 0)
+	    mac_exp_cache = ctable_create(MAC_EXP_CACHE_SIZE,
+					  mac_exp_tmpl_create,
+					  mac_exp_tmpl_free, (void *) 0);
+	tmpl = (MAC_EXP_TMPL *) ctable_locate(mac_exp_cache, pattern);
+    }
+    if (tmpl != 0 && tmpl->compiled) {
+	status = mac_exp_tmpl_eval(&mc, tmpl);
+    } else {
+	mc.record = tmpl;
+	status = mac_parse(pattern, mac_expand_callback, (void *) &mc);
+	if (tmpl != 0) {
+	    if (status & MAC_PARSE_ERROR)
+		mac_exp_tmpl_reset(tmpl);
+	    else
+		tmpl->compiled = 1;
+	}
+    }
+    mac_exp_depth--;
     if ((flags & MAC_EXP_FLAG_SCAN) == 0)
 	VSTRING_TERMINATE(result);
 
@@ -780,11 +956,13 @@ int     main(int unused_argc, char **argv)
 {
     VSTRING *buf = vstring_alloc(100);
     VSTRING *result = vstring_alloc(100);
+    VSTRING *result2 = vstring_alloc(100);
     char   *cp;
     char   *name;
     char   *value;
     HTABLE *table;
     int     stat;
+    int     stat2;
     int     length_relops[] = {
 	MAC_EXP_OP_TOK_EQ, MAC_EXP_OP_TOK_NE,
 	MAC_EXP_OP_TOK_GT, MAC_EXP_OP_TOK_GE,
@@ -832,6 +1010,19 @@ int     main(int unused_argc, char **argv)
 			      (char *) 0, lookup, (void *) table);
 	    vstream_printf("stat=%d result=%s\n", stat, vstring_str(result));
 	    vstream_fflush(VSTREAM_OUT);
+
+	    /*
+	     * Expand the pattern again, this time from its parsed form.
+	     */
+	    if ((stat & MAC_PARSE_ERROR) == 0) {
+		vstring_strcpy(result2, vstring_str(result));
+		stat2 = mac_expand(result, vstring_str(buf), MAC_EXP_FLAG_NONE,
+				   (char *) 0, lookup, (void *) table);
+		if (stat2 != stat || strcmp(vstring_str(result),
+					    vstring_str(result2)) != 0)
+		    msg_warn("cached expansion: stat=%d result=%s",
+			     stat2, vstring_str(result));
+	    }
 	}
 	htable_free(table, myfree);
 	vstream_printf("\n");
@@ -842,6 +1033,7 @@ int     main(int unused_argc, char **argv)
      */
     vstring_free(buf);
     vstring_free(result);
+    vstring_free(result2);
     exit(0);
 }
 
@@ -44,6 +44,13 @@
 /*
 /*	match_list_free() releases storage allocated by match_list_init().
 /*
+/*	A long run of consecutive patterns with the same polarity,
+/*	that are not type:table or net/mask patterns, is stored in
+/*	a hash table. For such a run, match_list_match() replaces
+/*	the sequential comparisons by a few hash table lookups
+/*	(the string itself, and its parent domains where applicable).
+/*	This preserves the first-match semantics of the list.
+/*
 /*	Arguments:
 /* .IP pname
 /*	Parameter name or other identifying information that is
@@ -105,6 +112,7 @@
 #include <stringops.h>
 #include <argv.h>
 #include <dict.h>
+#include <htable.h>
 #include <match_list.h>
 
 /* Application-specific */
@@ -112,6 +120,39 @@
 #define MATCH_DICTIONARY(pattern) \
     ((pattern)[0] != '[' && strchr((pattern), ':') != 0)
 
+ /*
+  * A compiled pattern list element is either one pattern, or a hash table
+  * with a run of patterns that can be matched with hash table lookups.
+  */
+struct MATCH_LIST_ITEM {
+    int     match;			/* result for a hit */
+    const char *pattern;		/* one pattern, or null */
+    HTABLE *table;			/* indexed patterns, or null */
+};
+
+ /*
+  * How to match a run of patterns with hash table lookups, for each of the
+  * standard match functions.
+  */
+typedef struct {
+    MATCH_LIST_FN match;		/* match function */
+    int     (*indexable) (const char *);	/* pattern test */
+    MATCH_LIST_IDX_FN probe;		/* hash table lookup */
+} MATCH_LIST_IDX_INFO;
+
+static const MATCH_LIST_IDX_INFO match_list_idx_info[] = {
+    match_string, match_string_indexable, match_string_probe,
+    match_hostname, match_hostname_indexable, match_hostname_probe,
+    match_hostaddr, match_hostaddr_indexable, match_hostaddr_probe,
+    0,
+};
+
+ /*
+  * Shorter runs are matched sequentially; with only a few patterns that is
+  * as fast as computing hash values for a string and its parent domains.
+  */
+#define MATCH_LIST_IDX_MIN	10
+
 /* match_list_parse - parse buffer, destroy buffer */
 
 static ARGV *match_list_parse(MATCH_LIST *match_list, ARGV *pat_list,
@@ -187,6 +228,72 @@ static ARGV *match_list_parse(MATCH_LIST *match_list, ARGV *pat_list,
     return (pat_list);
 }
 
+/* match_list_indexable - pattern can be matched with hash table lookups */
+
+static int match_list_indexable(MATCH_LIST *list, const char *pattern)
+{
+    int     i;
+
+    if (list->match_probe == 0)
+	return (0);
+    for (i = 0; i < list->match_count; i++)
+	if (match_list_idx_info[list->match_probe[i]].indexable(pattern) == 0)
+	    return (0);
+    return (1);
+}
+
+/* match_list_compile - group runs of patterns into hash tables */
+
+static void match_list_compile(MATCH_LIST *list)
+{
+    struct MATCH_LIST_ITEM *item;
+    char  **cpp;
+    char  **run_end;
+    const char *pat;
+    int     match;
+    int     run_match = 0;
+
+    list->items = (struct MATCH_LIST_ITEM *)
+	mymalloc(sizeof(*list->items) * (list->patterns->argc + 1));
+    list->item_count = 0;
+    for (cpp = list->patterns->argv; *cpp != 0; cpp = run_end) {
+
+	/*
+	 * Find the run of indexable patterns with the same polarity that
+	 * starts here.
+	 */
+	for (run_end = cpp; (pat = *run_end) != 0; run_end++) {
+	    for (match = 1; *pat == '!'; pat++)
+		match = !match;
+	    if (run_end == cpp)
+		run_match = match;
+	    else if (match != run_match)
+		break;
+	    if (match_list_indexable(list, pat) == 0)
+		break;
+	}
+	item = list->items + list->item_count++;
+	if (run_end - cpp >= MATCH_LIST_IDX_MIN) {
+	    item->match = run_match;
+	    item->pattern = 0;
+	    item->table = htable_create(run_end - cpp);
+	    for ( /* void */ ; cpp < run_end; cpp++) {
+		for (pat = *cpp; *pat == '!'; pat++)
+		     /* void */ ;
+		if (htable_locate(item->table, pat) == 0)
+		    (void) htable_enter(item->table, pat, (void *) 0);
+	    }
+	} else {
+	    for (match = 1, pat = *cpp; *pat == '!'; pat++)
+		match = !match;
+	    item->match = match;
+	    item->pattern = pat;
+	    item->table = 0;
+	    run_end = cpp + 1;
+	}
+    }
+}
+
 /* match_list_init - initialize pattern list */
 
 MATCH_LIST *match_list_init(const char *pname, int flags,
@@ -196,6 +303,7 @@ MATCH_LIST *match_list_init(const char *pname, int flags,
     char   *saved_patterns;
     va_list ap;
     int     i;
+    const MATCH_LIST_IDX_INFO *ip;
 
     if (flags & ~MATCH_FLAG_ALL)
 	msg_panic("match_list_init: bad flags 0x%x", flags);
@@ -214,6 +322,25 @@ MATCH_LIST *match_list_init(const char *pname, int flags,
     va_end(ap);
     list->error = 0;
     list->fold_buf = vstring_alloc(20);
+    list->fold_args = (VSTRING **) mymalloc(match_count * sizeof(VSTRING *));
+    for (i = 0; i < match_count; i++)
+	list->fold_args[i] = vstring_alloc(20);
+
+    /*
+     * Hash table lookups work only with match functions that we know.
+     */
+    list->match_probe = (int *) mymalloc(match_count * sizeof(int));
+    for (i = 0; i < match_count; i++) {
+	for (ip = match_list_idx_info; ip->match != 0; ip++)
+	    if (ip->match == list->match_func[i])
+		break;
+	if (ip->match == 0) {
+	    myfree((void *) list->match_probe);
+	    list->match_probe = 0;
+	    break;
+	}
+	list->match_probe[i] = ip - match_list_idx_info;
+    }
 
 #define DO_MATCH	1
 
@@ -222,6 +349,7 @@ MATCH_LIST *match_list_init(const char *pname, int flags,
 				      DO_MATCH);
     argv_terminate(list->patterns);
     myfree(saved_patterns);
+    match_list_compile(list);
     return (list);
 }
 
@@ -230,28 +358,38 @@ MATCH_LIST *match_list_init(const char *pname, int flags,
 int     match_list_match(MATCH_LIST *list,...)
 {
     const char *myname = "match_list_match";
-    char  **cpp;
-    char   *pat;
-    int     match;
+    struct MATCH_LIST_ITEM *item;
+    const char *fold_arg;
     int     i;
     va_list ap;
 
     /*
-     * Iterate over all patterns in the list, stop at the first match.
+     * Casefold the search strings once, not once per pattern.
      */
     va_start(ap, list);
-    for (i = 0; i < list->match_count; i++)
+    for (i = 0; i < list->match_count; i++) {
 	list->match_args[i] = va_arg(ap, const char *);
+	casefold(list->fold_args[i], list->match_args[i]);
+    }
     va_end(ap);
 
+    /*
+     * Iterate over all patterns in the list, stop at the first match.
+     */
     list->error = 0;
-    for (cpp = list->patterns->argv; (pat = *cpp) != 0; cpp++) {
-	for (match = 1; *pat == '!'; pat++)
-	    match = !match;
+    for (item = list->items; item < list->items + list->item_count; item++) {
 	for (i = 0; i < list->match_count; i++) {
-	    casefold(list->fold_buf, list->match_args[i]);
-	    if (list->match_func[i] (list, STR(list->fold_buf), pat))
-		return (match);
+	    fold_arg = STR(list->fold_args[i]);
+	    if (item->table != 0) {
+		if (match_list_idx_info[list->match_probe[i]].probe(list,
+						       item->table, fold_arg)) {
+		    if (msg_verbose)
+			msg_info("%s: %s: %s: found in indexed patterns",
+				 myname, list->pname, list->match_args[i]);
+		    return (item->match);
+		}
+	    } else if (list->match_func[i] (list, fold_arg, item->pattern))
+		return (item->match);
 	    else if (list->error != 0)
 		return (0);
 	}
@@ -266,11 +404,23 @@ int     match_list_match(MATCH_LIST *list,...)
 
 void    match_list_free(MATCH_LIST *list)
 {
+    struct MATCH_LIST_ITEM *item;
+    int     i;
+
     /* XXX Should decrement map refcounts. */
     myfree(list->pname);
+    for (item = list->items; item < list->items + list->item_count; item++)
+	if (item->table != 0)
+	    htable_free(item->table, (void (*) (void *)) 0);
+    myfree((void *) list->items);
     argv_free(list->patterns);
     myfree((void *) list->match_func);
     myfree((void *) list->match_args);
+    if (list->match_probe)
+	myfree((void *) list->match_probe);
+    for (i = 0; i < list->match_count; i++)
+	vstring_free(list->fold_args[i]);
+    myfree((void *) list->fold_args);
     vstring_free(list->fold_buf);
     myfree((void *) list);
 }
@@ -16,6 +16,7 @@
   */
 #include <argv.h>
 #include <vstring.h>
+#include <htable.h>
 
  /*
   * External interface.
@@ -23,6 +24,7 @@
 typedef struct MATCH_LIST MATCH_LIST;
 
 typedef int (*MATCH_LIST_FN) (MATCH_LIST *, const char *, const char *);
+typedef int (*MATCH_LIST_IDX_FN) (MATCH_LIST *, HTABLE *, const char *);
 
 struct MATCH_LIST {
     char   *pname;			/* used in error messages */
@@ -33,6 +35,10 @@ struct MATCH_LIST {
     const char **match_args;		/* match arguments */
     VSTRING *fold_buf;			/* case-folded pattern string */
     int     error;			/* last operation */
+    VSTRING **fold_args;		/* case-folded match arguments */
+    int    *match_probe;		/* hash table lookup methods */
+    struct MATCH_LIST_ITEM *items;	/* compiled patterns */
+    int     item_count;			/* compiled pattern count */
 };
 
 #define MATCH_FLAG_NONE		0
@@ -51,6 +57,12 @@ extern void match_list_free(MATCH_LIST *);
 extern int match_string(MATCH_LIST *, const char *, const char *);
 extern int match_hostname(MATCH_LIST *, const char *, const char *);
 extern int match_hostaddr(MATCH_LIST *, const char *, const char *);
+extern int match_string_indexable(const char *);
+extern int match_hostname_indexable(const char *);
+extern int match_hostaddr_indexable(const char *);
+extern int match_string_probe(MATCH_LIST *, HTABLE *, const char *);
+extern int match_hostname_probe(MATCH_LIST *, HTABLE *, const char *);
+extern int match_hostaddr_probe(MATCH_LIST *, HTABLE *, const char *);
 
 /* LICENSE
 /* .ad
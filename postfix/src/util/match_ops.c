@@ -20,6 +20,30 @@
 /*	MATCH_LIST *list;
 /*	const char *addr;
 /*	const char *pattern;
+/* INTERNAL FUNCTIONS
+/*	int	match_string_indexable(pattern)
+/*	const char *pattern;
+/*
+/*	int	match_string_probe(list, table, string)
+/*	MATCH_LIST *list;
+/*	HTABLE	*table;
+/*	const char *string;
+/*
+/*	int	match_hostname_indexable(pattern)
+/*	const char *pattern;
+/*
+/*	int	match_hostname_probe(list, table, name)
+/*	MATCH_LIST *list;
+/*	HTABLE	*table;
+/*	const char *name;
+/*
+/*	int	match_hostaddr_indexable(pattern)
+/*	const char *pattern;
+/*
+/*	int	match_hostaddr_probe(list, table, addr)
+/*	MATCH_LIST *list;
+/*	HTABLE	*table;
+/*	const char *addr;
 /* DESCRIPTION
 /*	This module implements simple string and host name or address
 /*	matching. The matching process is case insensitive. If a pattern
@@ -49,6 +73,14 @@
 /*	that contains the address. The mask specifies the number of
 /*	bits in the network part of the pattern. The flags argument is
 /*	not used.
+/*
+/*	The *_indexable() functions return non-zero when the
+/*	corresponding match function compares the pattern only as
+/*	a literal string, so that the pattern may be stored in a
+/*	hash table. The *_probe() functions return non-zero when
+/*	the corresponding match function would match at least one
+/*	pattern in the hash table. These functions are used by
+/*	match_list(3).
 /* LICENSE
 /* .ad
 /* .fi
@@ -79,6 +111,7 @@
 #include <mymalloc.h>
 #include <split_at.h>
 #include <dict.h>
+#include <htable.h>
 #include <match_list.h>
 #include <stringops.h>
 #include <cidr_match.h>
@@ -310,3 +343,80 @@ int     match_hostaddr(MATCH_LIST *list, const char *addr, const char *pattern)
     }
     return (cidr_match_execute(&match_info, addr) != 0);
 }
+
+/* match_string_indexable - match_string() uses exact comparison */
+
+int     match_string_indexable(const char *pattern)
+{
+    return (!MATCH_DICTIONARY(pattern));
+}
+
+/* match_string_probe - match string against indexed patterns */
+
+int     match_string_probe(MATCH_LIST *unused_list, HTABLE *table,
+			           const char *string)
+{
+    return (htable_locate(table, string) != 0);
+}
+
+/* match_hostname_indexable - match_hostname() uses string comparison */
+
+int     match_hostname_indexable(const char *pattern)
+{
+    return (!MATCH_DICTIONARY(pattern));
+}
+
+/* match_hostname_probe - match host name against indexed patterns */
+
+int     match_hostname_probe(MATCH_LIST *list, HTABLE *table,
+			             const char *name)
+{
+    const char *pd;
+
+    /*
+     * Look up the name, and the names of its parent domains in the form
+     * that match_hostname() compares them with: "example.com" with
+     * MATCH_FLAG_PARENT, otherwise ".example.com".
+     */
+    if (htable_locate(table, name) != 0)
+	return (1);
+    for (pd = name; (pd = strchr(pd, '.')) != 0; pd++) {
+	if (list->flags & MATCH_FLAG_PARENT) {
+	    if (htable_locate(table, pd + 1) != 0)
+		return (1);
+	} else if (pd > name) {
+	    if (htable_locate(table, pd) != 0)
+		return (1);
+	}
+    }
+    return (0);
+}
+
+/* match_hostaddr_indexable - match_hostaddr() uses string comparison */
+
+int     match_hostaddr_indexable(const char *pattern)
+{
+
+    /*
+     * Patterns without ':' or '/' are never compared as net/mask or as an
+     * IPv6 address with multiple valid representations.
+     */
+    return (!MATCH_DICTIONARY(pattern) && pattern[strcspn(pattern, ":/")] == 0);
+}
+
+/* match_hostaddr_probe - match host address against indexed patterns */
+
+int     match_hostaddr_probe(MATCH_LIST *unused_list, HTABLE *table,
+			             const char *addr)
+{
+    static VSTRING *buf;
+
+    if (addr[strspn(addr, V6_ADDR_STRING_CHARS)] != 0)
+	return (0);
+    if (htable_locate(table, addr) != 0)
+	return (1);
+    if (buf == 0)
+	buf = vstring_alloc(100);
+    vstring_sprintf(buf, "[%s]", addr);
+    return (htable_locate(table, vstring_str(buf)) != 0);
+}
@@ -48,6 +48,10 @@
 /*	same operations as midna_domain_to_ascii() and
 /*	midna_domain_to_utf8().
 /*
+/*	A name that contains only ASCII letters, digits, hyphens
+/*	and dots, that contains no "--", and that passes valid_hostname(),
+/*	is converted to lower case without calling the ICU library.
+/*
 /*	midna_domain_cache_size specifies the size of the conversion
 /*	result cache.  This value is used only once, upon the first
 /*	lookup request.
@@ -164,6 +168,27 @@ void    midna_domain_pre_chroot(void)
     uidna_close(idna);
 }
 
+/* midna_domain_ldh_create - convert LDH domain without ICU */
+
+static char *midna_domain_ldh_create(const char *name)
+{
+    const char *cp;
+
+    /*
+     * UTS 46 maps an ASCII letter-digit-hyphen name to lower case in both
+     * directions. Exclude "--", because that may start an A-label or may
+     * be a HYPHEN_3_4 error. Names that fail valid_hostname(), or that are
+     * longer than UTS 46 allows, are left to the ICU library, so that
+     * errors are reported as before.
+     */
+    for (cp = name; *cp; cp++)
+	if (!ISALNUM(*cp) && *cp != '.' && (*cp != '-' || cp[1] == '-'))
+	    return (0);
+    if (cp - name > 253 || !valid_hostname(name, DONT_GRIPE))
+	return (0);
+    return (lowercase(mystrdup(name)));
+}
+
 /* midna_domain_to_ascii_create - convert domain to ASCII */
 
 static void *midna_domain_to_ascii_create(const char *name, void *unused_context)
@@ -174,6 +199,13 @@ static void *midna_domain_to_ascii_create(const char *name, void *unused_context
     UIDNAInfo info = UIDNA_INFO_INITIALIZER;
     UIDNA  *idna;
     int     anl;
+    char   *ldh;
+
+    /*
+     * Fast path: no need to call ICU for plain LDH names.
+     */
+    if ((ldh = midna_domain_ldh_create(name)) != 0)
+	return (ldh);
 
     /*
      * Paranoia: do not expose uidna_*() to unfiltered network data.
@@ -228,6 +260,13 @@ static void *midna_domain_to_utf8_create(const char *name, void *unused_context)
     UIDNAInfo info = UIDNA_INFO_INITIALIZER;
     UIDNA  *idna;
     int     anl;
+    char   *ldh;
+
+    /*
+     * Fast path: no need to call ICU for plain LDH names.
+     */
+    if ((ldh = midna_domain_ldh_create(name)) != 0)
+	return (ldh);
 
     /*
      * Paranoia: do not expose uidna_*() to unfiltered network data.
@@ -0,0 +1,48 @@
+/*++
+/* NAME
+/*	mkmap_bloom 3
+/* SUMMARY
+/*	create or open database, Bloom filter style
+/* SYNOPSIS
+/*	#include <dict_bloom.h>
+/*
+/*	MKMAP	*mkmap_bloom_open(path)
+/*	const char *path;
+/* DESCRIPTION
+/*	This module implements support for creating Bloom filter
+/*	files. The dict_bloom module creates the file with the
+/*	".bloom.tmp" suffix, and on close renames it to the file
+/*	name with the ".bloom" suffix.
+/*	This routine is a Bloom filter specific helper for the more
+/*	general mkmap_open() interface.
+/*	All errors are fatal.
+/* SEE ALSO
+/*	dict_bloom(3), Bloom filter dictionary interface.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+
+/* Utility library. */
+
+#include <mymalloc.h>
+#include <dict_bloom.h>
+
+ /*
+  * Dummy module: the dict_bloom module has all the functionality built-in,
+  * including the lock on the temporary file.
+  */
+MKMAP  *mkmap_bloom_open(const char *unused_path)
+{
+    MKMAP  *mkmap = (MKMAP *) mymalloc(sizeof(*mkmap));
+
+    mkmap->open = dict_bloom_open;
+    mkmap->after_open = 0;
+    mkmap->after_close = 0;
+    return (mkmap);
+}
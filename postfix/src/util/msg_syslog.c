@@ -15,6 +15,9 @@
 /*	const char *facility_name;
 /*
 /*	void	msg_syslog_disable(void)
+/*
+/*	void	msg_syslog_set_buffer_size(size)
+/*	ssize_t	size;
 /* DESCRIPTION
 /*	This module implements support to report msg(3) diagnostics
 /*	via the syslog daemon.
@@ -31,6 +34,22 @@
 /*
 /*	msg_syslog_disable() turns off the msg_syslog client,
 /*	until a subsequent msg_syslog_init() call.
+/*
+/*	msg_syslog_set_buffer_size() selects the syslog client
+/*	implementation. With a zero size (the default), records are
+/*	sent with the syslog(3) library routine, which blocks when
+/*	the syslog daemon is not receiving. With a positive size,
+/*	records are sent directly to the local syslog socket, without
+/*	blocking. When the syslog daemon falls behind, up to \fIsize\fR
+/*	bytes of records are kept in memory and sent with a later
+/*	record. Records that do not fit are dropped and counted
+/*	(fatal and panic records are never dropped), and
+/*	the number of dropped records is logged after the syslog
+/*	daemon catches up, at most once per minute. After a fatal
+/*	or panic record, and when the process calls exit(), the
+/*	client waits up to 10 seconds for buffered records to be
+/*	sent. The socket is opened immediately, so that it remains
+/*	available after a chroot() call.
 /* SEE ALSO
 /*	syslog(3) syslog library
 /*	msg(3)	diagnostics module
@@ -57,12 +76,14 @@
 /* System libraries. */
 
 #include <sys_defs.h>
+#include <sys/socket.h>
 #include <stdlib.h>			/* 44BSD stdarg.h uses abort() */
 #include <stdarg.h>
 #include <errno.h>
 #include <syslog.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 /* Application-specific. */
 
@@ -72,6 +93,8 @@
 #include "msg_output.h"
 #include "msg_syslog.h"
 #include "safe.h"
+#include "iostuff.h"
+#include "connect.h"
 #include <mymalloc.h>
 
  /*
@@ -155,6 +178,206 @@ static struct facility_list facility_list[] = {
 static int msg_syslog_facility;
 static int msg_syslog_enable;
 
+ /*
+  * Direct non-blocking client state. The queue holds null-terminated
+  * records that are waiting to be sent; the head offset skips records that
+  * were sent already.
+  */
+#ifndef _PATH_LOG
+#define _PATH_LOG	"/dev/log"
+#endif
+#ifndef LOG_PRIMASK
+#define LOG_PRIMASK	0x07
+#endif
+
+#define MSG_SYSLOG_SOCK_NONE	(-1)
+#define MSG_SYSLOG_EXIT_WAIT	10		/* seconds */
+#define MSG_SYSLOG_DROP_REPORT	60		/* seconds */
+
+static ssize_t msg_syslog_buf_size;		/* 0: use syslog(3) */
+static int msg_syslog_sock = MSG_SYSLOG_SOCK_NONE;
+static char *msg_syslog_ident;
+static int msg_syslog_logopt;
+static int msg_syslog_init_facility;
+static VSTRING *msg_syslog_text;
+static VSTRING *msg_syslog_rec;
+static VSTRING *msg_syslog_queue;
+static ssize_t msg_syslog_head;
+static pid_t msg_syslog_owner;			/* queue owner process */
+static unsigned long msg_syslog_dropped;
+static time_t msg_syslog_reported;
+
+/* msg_syslog_connect - connect to local syslog socket */
+
+static void msg_syslog_connect(void)
+{
+    if (msg_syslog_sock == MSG_SYSLOG_SOCK_NONE
+	&& (msg_syslog_sock = unix_dgram_connect(_PATH_LOG, NON_BLOCKING)) >= 0)
+	close_on_exec(msg_syslog_sock, CLOSE_ON_EXEC);
+}
+
+/* msg_syslog_send - send one record, reconnecting once if needed */
+
+static int msg_syslog_send(const char *rec, ssize_t len)
+{
+    int     attempt;
+
+    for (attempt = 0; attempt < 2; attempt++) {
+	msg_syslog_connect();
+	if (msg_syslog_sock == MSG_SYSLOG_SOCK_NONE)
+	    return (-1);
+	if (send(msg_syslog_sock, rec, len, 0) == len)
+	    return (0);
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+	    return (1);
+	if (errno != ECONNREFUSED && errno != ENOTCONN && errno != ECONNRESET)
+	    return (-1);
+	/* The syslog daemon was restarted. */
+	(void) close(msg_syslog_sock);
+	msg_syslog_sock = MSG_SYSLOG_SOCK_NONE;
+    }
+    return (-1);
+}
+
+/* msg_syslog_flush - send queued records until the socket would block */
+
+static int msg_syslog_flush(void)
+{
+    const char *rec;
+    ssize_t len;
+
+    while (msg_syslog_head < VSTRING_LEN(msg_syslog_queue)) {
+	rec = vstring_str(msg_syslog_queue) + msg_syslog_head;
+	len = strlen(rec);
+	if (msg_syslog_send(rec, len) > 0)
+	    return (1);
+	msg_syslog_head += len + 1;		/* sent or dropped */
+    }
+    VSTRING_RESET(msg_syslog_queue);
+    msg_syslog_head = 0;
+    return (0);
+}
+
+/* msg_syslog_format - format one record */
+
+static void msg_syslog_format(int priority, const char *text)
+{
+    struct tm *lt;
+    time_t  now;
+    size_t  len;
+
+    VSTRING_RESET(msg_syslog_rec);
+    vstring_sprintf(msg_syslog_rec, "<%d>", priority);
+    if (time(&now) < 0)
+	now = 0;
+    lt = localtime(&now);
+    VSTRING_SPACE(msg_syslog_rec, 100);
+    if ((len = strftime(vstring_end(msg_syslog_rec),
+			vstring_avail(msg_syslog_rec),
+			"%b %d %H:%M:%S ", lt)) > 0)
+	vstring_set_payload_size(msg_syslog_rec,
+				 VSTRING_LEN(msg_syslog_rec) + len);
+    if (msg_syslog_logopt & LOG_PID)
+	vstring_sprintf_append(msg_syslog_rec, "%s[%ld]: %s",
+			       msg_syslog_ident, (long) getpid(), text);
+    else
+	vstring_sprintf_append(msg_syslog_rec, "%s: %s",
+			       msg_syslog_ident, text);
+}
+
+/* msg_syslog_report - report dropped records */
+
+static int msg_syslog_report(int facility)
+{
+    VSTRING *report = vstring_alloc(100);
+    int     pending;
+
+    vstring_sprintf(report, "warning: msg_syslog: dropped %lu record(s)"
+		    " while the syslog daemon was not receiving",
+		    msg_syslog_dropped);
+    msg_syslog_format(facility | LOG_WARNING, vstring_str(report));
+    vstring_free(report);
+    if ((pending = msg_syslog_send(vstring_str(msg_syslog_rec),
+				   VSTRING_LEN(msg_syslog_rec))) == 0) {
+	msg_syslog_dropped = 0;
+	msg_syslog_reported = time((time_t *) 0);
+    }
+    return (pending);
+}
+
+/* msg_syslog_drain - wait until queued records are sent */
+
+static void msg_syslog_drain(void)
+{
+    int     pending;
+
+    if (msg_syslog_owner != getpid())
+	return;
+    for (;;) {
+	if ((pending = msg_syslog_flush()) == 0 && msg_syslog_dropped > 0)
+	    pending = msg_syslog_report(msg_syslog_facility ?
+					msg_syslog_facility :
+					msg_syslog_init_facility);
+	if (pending <= 0
+	    || write_wait(msg_syslog_sock, MSG_SYSLOG_EXIT_WAIT) < 0)
+	    break;
+    }
+}
+
+/* msg_syslog_direct - send or queue one record without blocking */
+
+static void msg_syslog_direct(int level, int priority, const char *text)
+{
+    int     pending;
+
+    if (msg_syslog_rec == 0) {
+	msg_syslog_rec = vstring_alloc(100);
+	msg_syslog_queue = vstring_alloc(100);
+	(void) atexit(msg_syslog_drain);
+    }
+
+    /*
+     * Don't send records that were queued by the parent of a forked
+     * process; the parent will send those itself.
+     */
+    if (msg_syslog_owner != getpid()) {
+	VSTRING_RESET(msg_syslog_queue);
+	msg_syslog_head = 0;
+	msg_syslog_owner = getpid();
+    }
+
+    /*
+     * Preserve the record order: send queued records first. Report drops
+     * after the syslog daemon has caught up, at most once per minute.
+     */
+    pending = msg_syslog_flush();
+    if (pending == 0 && msg_syslog_dropped > 0
+	&& time((time_t *) 0) - msg_syslog_reported >= MSG_SYSLOG_DROP_REPORT)
+	pending = msg_syslog_report(priority & ~LOG_PRIMASK);
+    msg_syslog_format(priority, text);
+    if (pending == 0)
+	pending = msg_syslog_send(vstring_str(msg_syslog_rec),
+				  VSTRING_LEN(msg_syslog_rec));
+    if (pending > 0) {
+	if (level < MSG_FATAL && VSTRING_LEN(msg_syslog_queue) - msg_syslog_head
+	    + VSTRING_LEN(msg_syslog_rec) + 1 > msg_syslog_buf_size) {
+	    msg_syslog_dropped++;
+	} else {
+	    vstring_memcat(msg_syslog_queue, vstring_str(msg_syslog_rec),
+			   VSTRING_LEN(msg_syslog_rec) + 1);
+	}
+    } else if (pending < 0) {
+	msg_syslog_dropped++;
+    }
+
+    /*
+     * The process is about to terminate, possibly without calling exit().
+     * Give the syslog daemon a chance to receive what is still queued.
+     */
+    if (level >= MSG_FATAL)
+	msg_syslog_drain();
+}
+
 /* msg_syslog_print - log info to syslog daemon */
 
 static void msg_syslog_print(int level, const char *text)
@@ -172,7 +395,19 @@ static void msg_syslog_print(int level, const char *text)
     if (level < 0 || level >= (int) (sizeof(log_level) / sizeof(log_level[0])))
 	msg_panic("msg_syslog_print: invalid severity level: %d", level);
 
-    if (level == MSG_INFO) {
+    if (msg_syslog_buf_size > 0) {
+	if (msg_syslog_text == 0)
+	    msg_syslog_text = vstring_alloc(100);
+	if (level == MSG_INFO)
+	    vstring_sprintf(msg_syslog_text, "%.*s",
+			    (int) MSG_SYSLOG_RECLEN, text);
+	else
+	    vstring_sprintf(msg_syslog_text, "%s: %.*s", severity_name[level],
+			    (int) MSG_SYSLOG_RECLEN, text);
+	msg_syslog_direct(level, (msg_syslog_facility ? msg_syslog_facility :
+				  msg_syslog_init_facility) | log_level[level],
+			  vstring_str(msg_syslog_text));
+    } else if (level == MSG_INFO) {
 	syslog(msg_syslog_facility | log_level[level], "%.*s",
 	       (int) MSG_SYSLOG_RECLEN, text);
     } else {
@@ -205,6 +440,13 @@ void    msg_syslog_init(const char *name, int logopt, int facility)
     if (strchr(name, '[') != 0)
 	logopt &= ~LOG_PID;
     openlog(name, LOG_NDELAY | logopt, facility);
+    if (msg_syslog_ident)
+	myfree(msg_syslog_ident);
+    msg_syslog_ident = mystrdup(name);
+    msg_syslog_logopt = logopt;
+    msg_syslog_init_facility = facility;
+    if (msg_syslog_buf_size > 0)
+	msg_syslog_connect();
     if (first_call) {
 	first_call = 0;
 	msg_output(msg_syslog_print);
@@ -234,6 +476,14 @@ void    msg_syslog_disable(void)
     msg_syslog_enable = 0;
 }
 
+/* msg_syslog_set_buffer_size - select syslog client implementation */
+
+void    msg_syslog_set_buffer_size(ssize_t size)
+{
+    if ((msg_syslog_buf_size = size) > 0 && msg_syslog_enable)
+	msg_syslog_connect();
+}
+
 #ifdef TEST
 
  /*
@@ -21,6 +21,7 @@
 extern void msg_syslog_init(const char *, int, int);
 extern int msg_syslog_set_facility(const char *);
 extern void msg_syslog_disable(void);
+extern void msg_syslog_set_buffer_size(ssize_t);
 
 /* LICENSE
 /* .ad
@@ -26,6 +26,18 @@
 /*	void	*mymemdup(ptr, len)
 /*	const void *ptr;
 /*	ssize_t	len;
+/*
+/*	int	mymalloc_set_tag(tag)
+/*	int	tag;
+/*
+/*	int	mymalloc_set_default_tag(tag)
+/*	int	tag;
+/*
+/*	const MYMALLOC_STAT *mymalloc_stat(tag)
+/*	int	tag;
+/*
+/*	const char *mymalloc_tag_name(tag)
+/*	int	tag;
 /* DESCRIPTION
 /*	This module performs low-level memory management with error
 /*	handling. A call of these functions either succeeds or it does
@@ -57,6 +69,26 @@
 /*	mymemdup() makes a copy of the memory pointed to by \fIptr\fR
 /*	with length \fIlen\fR. The result is NOT null-terminated.
 /*	This routine uses mymalloc().
+/*
+/*	mymalloc_set_tag() sets the accounting tag for memory that
+/*	is allocated with mymalloc() and its derivatives, and returns
+/*	the previous tag. Callers restore the previous tag when they
+/*	are done. A memory block keeps its tag when it is resized
+/*	with myrealloc(). The initial tag is MYMALLOC_TAG_OTHER.
+/*
+/*	mymalloc_set_default_tag() is used by general-purpose
+/*	containers such as vstring(3) and htable(3). It sets the
+/*	specified tag only if the current tag is MYMALLOC_TAG_OTHER,
+/*	so that a container is charged to the subsystem that creates
+/*	it, and returns the previous tag.
+/*
+/*	mymalloc_stat() returns the number of memory blocks and bytes
+/*	that are in use with the specified tag. The counts are
+/*	always maintained; they cost one addition per allocation,
+/*	resize or release.
+/*
+/*	mymalloc_tag_name() returns the name of the specified tag,
+/*	for example "vstring".
 /* SEE ALSO
 /*	msg(3) diagnostics interface
 /* DIAGNOSTICS
@@ -100,6 +132,7 @@
   */
 typedef struct MBLOCK {
     int     signature;			/* set when block is active */
+    int     tag;			/* accounting tag */
     ssize_t length;			/* user requested length */
     union {
 	ALIGN_TYPE align;
@@ -123,12 +156,37 @@ typedef struct MBLOCK {
 
 #define CHECK_OUT_PTR(ptr, real_ptr, len) { \
     real_ptr->signature = SIGNATURE; \
+    real_ptr->tag = mymalloc_tag; \
     real_ptr->length = len; \
     ptr = real_ptr->u.payload; \
 }
 
 #define SPACE_FOR(len)	(offsetof(MBLOCK, u.payload[0]) + len)
 
+ /*
+  * Per-tag accounting. The tag is stored in the block header, so that
+  * myfree() and myrealloc() update the counts for the tag that was in effect
+  * when the block was allocated.
+  */
+static int mymalloc_tag = MYMALLOC_TAG_OTHER;
+static MYMALLOC_STAT mymalloc_stats[MYMALLOC_TAG_COUNT];
+
+static const char *mymalloc_tag_names[MYMALLOC_TAG_COUNT] = {
+    "other",				/* MYMALLOC_TAG_OTHER */
+    "vstring",				/* MYMALLOC_TAG_VSTRING */
+    "htable",				/* MYMALLOC_TAG_HTABLE */
+    "dict_cache",			/* MYMALLOC_TAG_DICT_CACHE */
+    "qmgr_message",			/* MYMALLOC_TAG_QMGR_MESSAGE */
+    "qmgr_entry",			/* MYMALLOC_TAG_QMGR_ENTRY */
+    "qmgr_rcpt",			/* MYMALLOC_TAG_QMGR_RCPT */
+    "tls",				/* MYMALLOC_TAG_TLS */
+};
+
+#define MYMALLOC_ACCOUNT(tag, delta_blocks, delta_bytes) { \
+    mymalloc_stats[tag].blocks += (delta_blocks); \
+    mymalloc_stats[tag].bytes += (delta_bytes); \
+}
+
  /*
   * Optimization for short strings. We share one copy with multiple callers.
   * This differs from normal heap memory in two ways, because the memory is
@@ -166,6 +224,7 @@ void   *mymalloc(ssize_t len)
 	msg_fatal("mymalloc: insufficient memory for %ld bytes: %m",
 		  (long) len);
     CHECK_OUT_PTR(ptr, real_ptr, len);
+    MYMALLOC_ACCOUNT(real_ptr->tag, 1, len);
     memset(ptr, FILLER, len);
     return (ptr);
 }
@@ -176,6 +235,7 @@ void   *myrealloc(void *ptr, ssize_t len)
 {
     MBLOCK *real_ptr;
     ssize_t old_len;
+    int     tag;
 
 #ifndef NO_SHARED_EMPTY_STRINGS
     if (ptr == empty_string)
@@ -193,10 +253,13 @@ void   *myrealloc(void *ptr, ssize_t len)
     len += MYMALLOC_FUZZ;
 #endif
     CHECK_IN_PTR(ptr, real_ptr, old_len, "myrealloc");
+    tag = real_ptr->tag;
     if ((real_ptr = (MBLOCK *) realloc((void *) real_ptr, SPACE_FOR(len))) == 0)
 	msg_fatal("myrealloc: insufficient memory for %ld bytes: %m",
 		  (long) len);
     CHECK_OUT_PTR(ptr, real_ptr, len);
+    real_ptr->tag = tag;
+    MYMALLOC_ACCOUNT(tag, 0, len - old_len);
     if (len > old_len)
 	memset(ptr + old_len, FILLER, len - old_len);
     return (ptr);
@@ -213,6 +276,7 @@ void    myfree(void *ptr)
     if (ptr != empty_string) {
 #endif
 	CHECK_IN_PTR(ptr, real_ptr, len, "myfree");
+	MYMALLOC_ACCOUNT(real_ptr->tag, -1, -len);
 	memset((void *) real_ptr, FILLER, SPACE_FOR(len));
 	free((void *) real_ptr);
 #ifndef NO_SHARED_EMPTY_STRINGS
@@ -267,3 +331,44 @@ void   *mymemdup(const void *ptr, ssize_t len)
 	msg_panic("mymemdup: null pointer argument");
     return (memcpy(mymalloc(len), ptr, len));
 }
+
+/* mymalloc_set_tag - set accounting tag, return previous tag */
+
+int     mymalloc_set_tag(int tag)
+{
+    int     prev = mymalloc_tag;
+
+    if (tag < 0 || tag >= MYMALLOC_TAG_COUNT)
+	msg_panic("mymalloc_set_tag: bad tag %d", tag);
+    mymalloc_tag = tag;
+    return (prev);
+}
+
+/* mymalloc_set_default_tag - set tag unless one is in effect */
+
+int     mymalloc_set_default_tag(int tag)
+{
+    int     prev = mymalloc_tag;
+
+    if (prev == MYMALLOC_TAG_OTHER)
+	(void) mymalloc_set_tag(tag);
+    return (prev);
+}
+
+/* mymalloc_stat - return accounting counts for tag */
+
+const MYMALLOC_STAT *mymalloc_stat(int tag)
+{
+    if (tag < 0 || tag >= MYMALLOC_TAG_COUNT)
+	msg_panic("mymalloc_stat: bad tag %d", tag);
+    return (mymalloc_stats + tag);
+}
+
+/* mymalloc_tag_name - return tag name */
+
+const char *mymalloc_tag_name(int tag)
+{
+    if (tag < 0 || tag >= MYMALLOC_TAG_COUNT)
+	msg_panic("mymalloc_tag_name: bad tag %d", tag);
+    return (mymalloc_tag_names[tag]);
+}
@@ -21,6 +21,29 @@ extern char *mystrdup(const char *);
 extern char *mystrndup(const char *, ssize_t);
 extern void *mymemdup(const void *, ssize_t);
 
+ /*
+  * Memory accounting by subsystem.
+  */
+#define MYMALLOC_TAG_OTHER		0
+#define MYMALLOC_TAG_VSTRING		1
+#define MYMALLOC_TAG_HTABLE		2
+#define MYMALLOC_TAG_DICT_CACHE		3
+#define MYMALLOC_TAG_QMGR_MESSAGE	4
+#define MYMALLOC_TAG_QMGR_ENTRY		5
+#define MYMALLOC_TAG_QMGR_RCPT		6
+#define MYMALLOC_TAG_TLS		7
+#define MYMALLOC_TAG_COUNT		8
+
+typedef struct MYMALLOC_STAT {
+    ssize_t blocks;			/* blocks in use */
+    ssize_t bytes;			/* bytes in use */
+} MYMALLOC_STAT;
+
+extern int mymalloc_set_tag(int);
+extern int mymalloc_set_default_tag(int);
+extern const MYMALLOC_STAT *mymalloc_stat(int);
+extern const char *mymalloc_tag_name(int);
+
 /* LICENSE
 /* .ad
 /* .fi
@@ -0,0 +1,237 @@
+/*++
+/* NAME
+/*	mypool 3
+/* SUMMARY
+/*	memory pool for fixed-size objects
+/* SYNOPSIS
+/*	#include <mypool.h>
+/*
+/*	MYPOOL	*mypool_create(name, size)
+/*	const char *name;
+/*	ssize_t	size;
+/*
+/*	void	*mypool_alloc(pool)
+/*	MYPOOL	*pool;
+/*
+/*	void	mypool_free(pool, ptr)
+/*	MYPOOL	*pool;
+/*	void	*ptr;
+/* DESCRIPTION
+/*	This module manages memory for objects of one size that are
+/*	allocated and freed at a high rate. Memory is obtained from
+/*	mymalloc() in chunks that hold many objects, and a freed
+/*	object is kept on a free list for reuse by the same pool.
+/*	Memory is never returned to mymalloc(). This avoids the
+/*	per-object malloc() overhead and the per-object mymalloc()
+/*	header.
+/*
+/*	mypool_create() creates a pool for objects of the specified
+/*	size. The name is used for diagnostics. A pool is typically
+/*	created once, and used for the life of the process.
+/*
+/*	mypool_alloc() returns an object from the specified pool.
+/*	Like mymalloc(), it fills the object with a non-zero pattern.
+/*
+/*	mypool_free() returns an object to the pool that it was
+/*	allocated from, and overwrites the object with a non-zero
+/*	pattern.
+/*
+/*	When compiled with -DNO_MYPOOL, each object is allocated
+/*	and freed with mymalloc() and myfree(), with their sanity
+/*	checks. Use this when looking for memory errors with tools
+/*	such as valgrind.
+/* DIAGNOSTICS
+/*	Problems are reported via the msg(3) diagnostics routines:
+/*	the requests always succeed or they cause the program to
+/*	terminate. Panic: a null pointer argument, or an attempt
+/*	to free an object that is already on the free list of the
+/*	pool.
+/* SEE ALSO
+/*	mymalloc(3) memory management wrapper
+/*	msg(3) diagnostics interface
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <mypool.h>
+
+ /*
+  * A free object starts with a link to the next free object, and with a
+  * pointer to its pool. The latter is never found in an object that is in
+  * use, so that it reveals an attempt to free an object twice.
+  */
+typedef struct MYPOOL_FREE {
+    struct MYPOOL_FREE *next;		/* next free object */
+    MYPOOL *pool;			/* owner, while free */
+} MYPOOL_FREE;
+
+struct MYPOOL {
+    char   *name;			/* for diagnostics */
+    ssize_t size;			/* rounded-up object size */
+    ssize_t chunk_count;		/* objects in next chunk */
+    MYPOOL_FREE *free_list;		/* objects ready for reuse */
+};
+
+#define MYPOOL_FILLER		0xff
+#define MYPOOL_ALIGN		sizeof(ALIGN_TYPE)
+#define MYPOOL_CHUNK_MIN	4096	/* first chunk size in bytes */
+#define MYPOOL_CHUNK_MAX	65536	/* max chunk size in bytes */
+
+/* mypool_create - create pool for objects of one size */
+
+MYPOOL *mypool_create(const char *name, ssize_t size)
+{
+    MYPOOL *pool;
+
+    if (size < 1)
+	msg_panic("mypool_create: %s: requested size %ld", name, (long) size);
+    if (size < (ssize_t) sizeof(MYPOOL_FREE))
+	size = sizeof(MYPOOL_FREE);
+    size = (size + MYPOOL_ALIGN - 1) / MYPOOL_ALIGN * MYPOOL_ALIGN;
+
+    pool = (MYPOOL *) mymalloc(sizeof(*pool));
+    pool->name = mystrdup(name);
+    pool->size = size;
+    pool->chunk_count = MYPOOL_CHUNK_MIN / size + 1;
+    pool->free_list = 0;
+    return (pool);
+}
+
+#ifndef NO_MYPOOL
+
+/* mypool_grow - add one chunk of free objects */
+
+static void mypool_grow(MYPOOL *pool)
+{
+    char   *chunk;
+    MYPOOL_FREE *obj;
+    ssize_t n;
+
+    chunk = (char *) mymalloc(pool->chunk_count * pool->size);
+    for (n = pool->chunk_count - 1; n >= 0; n--) {
+	obj = (MYPOOL_FREE *) (chunk + n * pool->size);
+	obj->next = pool->free_list;
+	obj->pool = pool;
+	pool->free_list = obj;
+    }
+    if (pool->chunk_count * pool->size < MYPOOL_CHUNK_MAX)
+	pool->chunk_count *= 2;
+}
+
+/* mypool_alloc - allocate object */
+
+void   *mypool_alloc(MYPOOL *pool)
+{
+    MYPOOL_FREE *obj;
+
+    if (pool->free_list == 0)
+	mypool_grow(pool);
+    obj = pool->free_list;
+    if (obj->pool != pool)
+	msg_panic("mypool_alloc: %s: corrupt free list", pool->name);
+    pool->free_list = obj->next;
+    memset((void *) obj, MYPOOL_FILLER, pool->size);
+    return ((void *) obj);
+}
+
+/* mypool_free - release object */
+
+void    mypool_free(MYPOOL *pool, void *ptr)
+{
+    MYPOOL_FREE *obj = (MYPOOL_FREE *) ptr;
+
+    if (obj == 0)
+	msg_panic("mypool_free: %s: null pointer input", pool->name);
+    if (obj->pool == pool)
+	msg_panic("mypool_free: %s: object is already free", pool->name);
+    memset((void *) obj, MYPOOL_FILLER, pool->size);
+    obj->next = pool->free_list;
+    obj->pool = pool;
+    pool->free_list = obj;
+}
+
+#else					/* NO_MYPOOL */
+
+/* mypool_alloc - allocate object */
+
+void   *mypool_alloc(MYPOOL *pool)
+{
+    return (mymalloc(pool->size));
+}
+
+/* mypool_free - release object */
+
+void    mypool_free(MYPOOL *unused_pool, void *ptr)
+{
+    myfree(ptr);
+}
+
+#endif					/* NO_MYPOOL */
+
+#ifdef TEST
+
+ /*
+  * Proof-of-concept test program. Allocate many objects, free every other
+  * one, allocate again, and verify that no object overlaps another.
+  */
+#include <stdlib.h>
+
+#define TEST_COUNT	10000
+
+typedef struct {
+    long    id;
+    char    filler[20];
+} TEST_OBJ;
+
+int     main(int unused_argc, char **unused_argv)
+{
+    MYPOOL *pool = mypool_create("test", sizeof(TEST_OBJ));
+    TEST_OBJ **objs;
+    int     pass = 0;
+    int     fail = 0;
+    int     n;
+
+    objs = (TEST_OBJ **) mymalloc(TEST_COUNT * sizeof(*objs));
+    for (n = 0; n < TEST_COUNT; n++) {
+	objs[n] = (TEST_OBJ *) mypool_alloc(pool);
+	objs[n]->id = n;
+    }
+    for (n = 0; n < TEST_COUNT; n += 2)
+	mypool_free(pool, (void *) objs[n]);
+    for (n = 0; n < TEST_COUNT; n += 2) {
+	objs[n] = (TEST_OBJ *) mypool_alloc(pool);
+	objs[n]->id = n;
+    }
+    for (n = 0; n < TEST_COUNT; n++) {
+	if (objs[n]->id != n) {
+	    msg_warn("object %d has id %ld", n, objs[n]->id);
+	    fail += 1;
+	    break;
+	}
+    }
+    if (n == TEST_COUNT) {
+	pass += 1;
+	msg_info("PASS: %d objects are distinct", TEST_COUNT);
+    } else {
+	msg_info("FAIL: %d objects are distinct", TEST_COUNT);
+    }
+    for (n = 0; n < TEST_COUNT; n++)
+	mypool_free(pool, (void *) objs[n]);
+    myfree((void *) objs);
+
+    msg_info("PASS=%d FAIL=%d", pass, fail);
+    return (fail != 0);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _MYPOOL_H_INCLUDED_
+#define _MYPOOL_H_INCLUDED_
+
+/*++
+/* NAME
+/*	mypool 3h
+/* SUMMARY
+/*	memory pool for fixed-size objects
+/* SYNOPSIS
+/*	#include <mypool.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * External interface.
+  */
+typedef struct MYPOOL MYPOOL;
+
+extern MYPOOL *mypool_create(const char *, ssize_t);
+extern void *mypool_alloc(MYPOOL *);
+extern void mypool_free(MYPOOL *, void *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
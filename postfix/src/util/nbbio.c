@@ -31,6 +31,9 @@
 /*	NBBIO	*np;
 /*	int	timeout;
 /*
+/*	ssize_t	nbbio_write_now(np)
+/*	NBBIO	*np;
+/*
 /*	int	NBBIO_ACTIVE_FLAGS(np)
 /*	NBBIO	*np;
 /*
@@ -76,15 +79,17 @@
 /*
 /*	nbbio_enable_read() enables a read pseudothread (if one
 /*	does not already exist) for the named buffer pair, and
-/*	(re)starts the buffer pair's timer. It is an error to enable
-/*	a read pseudothread while the read buffer is full, or while
-/*	a write pseudothread is still enabled.
+/*	(re)starts the buffer pair's timer. An enabled write
+/*	pseudothread is replaced, which is cheaper than calling
+/*	nbbio_disable_readwrite() first. It is an error to enable
+/*	a read pseudothread while the read buffer is full.
 /*
 /*	nbbio_enable_write() enables a write pseudothread (if one
 /*	does not already exist) for the named buffer pair, and
-/*	(re)starts the buffer pair's timer. It is an error to enable
-/*	a write pseudothread while the write buffer is empty, or
-/*	while a read pseudothread is still enabled.
+/*	(re)starts the buffer pair's timer. An enabled read
+/*	pseudothread is replaced, which is cheaper than calling
+/*	nbbio_disable_readwrite() first. It is an error to enable
+/*	a write pseudothread while the write buffer is empty.
 /*
 /*	nbbio_disable_readwrite() disables any read/write pseudothreads
 /*	for the named buffer pair, including timeouts. To ensure
@@ -97,6 +102,17 @@
 /*	buffer liveness. It is no error to call this function while
 /*	no read/write pseudothread is enabled.
 /*
+/*	nbbio_write_now() writes pending data from the write buffer
+/*	without waiting for a write event, and without invoking the
+/*	application call-back routine. This saves an event loop
+/*	iteration and event (de)registration system calls when the
+/*	socket has room for the data. The result is the number of
+/*	bytes written, or -1 in case of error (including EAGAIN);
+/*	errors are left to be reported by a write pseudothread. It
+/*	is an error to call this function while the write buffer
+/*	is empty, or while a read/write pseudothread is enabled
+/*	for writing.
+/*
 /*	NBBIO_ERROR_FLAGS() returns the error flags for the named buffer
 /*	pair: zero or more of NBBIO_FLAG_EOF (read EOF), NBBIO_FLAG_ERROR
 /*	(read/write error) or NBBIO_FLAG_TIMEOUT (time limit
@@ -267,9 +283,6 @@ void    nbbio_enable_read(NBBIO *np, int timeout)
     /*
      * Sanity checks.
      */
-    if (np->flags & (NBBIO_MASK_ACTIVE & ~NBBIO_FLAG_READ))
-	msg_panic("%s: socket fd=%d is enabled for %s",
-		  myname, np->fd, NBBIO_OP_NAME(np));
     if (timeout <= 0)
 	msg_panic("%s: socket fd=%d: bad timeout %d",
 		  myname, np->fd, timeout);
@@ -280,7 +293,11 @@ void    nbbio_enable_read(NBBIO *np, int timeout)
     /*
      * Enable events.
      */
-    if ((np->flags & NBBIO_FLAG_READ) == 0) {
+    if (np->flags & NBBIO_FLAG_WRITE) {
+	event_switch_read(np->fd, nbbio_event, (void *) np);
+	np->flags &= ~NBBIO_FLAG_WRITE;
+	np->flags |= NBBIO_FLAG_READ;
+    } else if ((np->flags & NBBIO_FLAG_READ) == 0) {
 	event_enable_read(np->fd, nbbio_event, (void *) np);
 	np->flags |= NBBIO_FLAG_READ;
     }
@@ -296,9 +313,6 @@ void    nbbio_enable_write(NBBIO *np, int timeout)
     /*
      * Sanity checks.
      */
-    if (np->flags & (NBBIO_MASK_ACTIVE & ~NBBIO_FLAG_WRITE))
-	msg_panic("%s: socket fd=%d is enabled for %s",
-		  myname, np->fd, NBBIO_OP_NAME(np));
     if (timeout <= 0)
 	msg_panic("%s: socket fd=%d: bad timeout %d",
 		  myname, np->fd, timeout);
@@ -309,7 +323,11 @@ void    nbbio_enable_write(NBBIO *np, int timeout)
     /*
      * Enable events.
      */
-    if ((np->flags & NBBIO_FLAG_WRITE) == 0) {
+    if (np->flags & NBBIO_FLAG_READ) {
+	event_switch_write(np->fd, nbbio_event, (void *) np);
+	np->flags &= ~NBBIO_FLAG_READ;
+	np->flags |= NBBIO_FLAG_WRITE;
+    } else if ((np->flags & NBBIO_FLAG_WRITE) == 0) {
 	event_enable_write(np->fd, nbbio_event, (void *) np);
 	np->flags |= NBBIO_FLAG_WRITE;
     }
@@ -334,6 +352,38 @@ void    nbbio_slumber(NBBIO *np, int timeout)
     event_request_timer(nbbio_event, (void *) np, timeout);
 }
 
+/* nbbio_write_now - write without waiting for a write event */
+
+ssize_t nbbio_write_now(NBBIO *np)
+{
+    const char *myname = "nbbio_write_now";
+    ssize_t count;
+
+    /*
+     * Sanity checks.
+     */
+    if (np->flags & NBBIO_FLAG_WRITE)
+	msg_panic("%s: socket fd=%d is enabled for %s",
+		  myname, np->fd, NBBIO_OP_NAME(np));
+    if (np->write_pend <= 0 || np->write_pend > np->bufsize)
+	msg_panic("%s: socket fd=%d: bad pending write count %ld",
+		  myname, np->fd, (long) np->write_pend);
+
+    /*
+     * Leave the error handling to the write pseudothread.
+     */
+    count = write(np->fd, np->write_buf, np->write_pend);
+    if (count > 0) {
+	np->write_pend -= count;
+	if (np->write_pend > 0)
+	    memmove(np->write_buf, np->write_buf + count, np->write_pend);
+	if (msg_verbose)
+	    msg_info("%s: wrote %ld on %s fd=%d",
+		     myname, (long) count, np->label, np->fd);
+    }
+    return (count);
+}
+
 /* nbbio_create - create socket buffer */
 
 NBBIO  *nbbio_create(int fd, ssize_t bufsize, const char *label,
@@ -70,6 +70,7 @@ extern void nbbio_enable_read(NBBIO *, int);
 extern void nbbio_enable_write(NBBIO *, int);
 extern void nbbio_disable_readwrite(NBBIO *);
 extern void nbbio_slumber(NBBIO *, int);
+extern ssize_t nbbio_write_now(NBBIO *);
 
 /* LICENSE
 /* .ad
@@ -0,0 +1,101 @@
+#ifndef _PROBES_H_INCLUDED_
+#define _PROBES_H_INCLUDED_
+
+/*++
+/* NAME
+/*	probes 3h
+/* SUMMARY
+/*	static tracepoints
+/* SYNOPSIS
+/*	#include <probes.h>
+/*
+/*	void	POSTFIX_PROBE0(name)
+/*
+/*	void	POSTFIX_PROBE1(name, arg1)
+/*
+/*	void	POSTFIX_PROBE2(name, arg1, arg2)
+/*
+/*	void	POSTFIX_PROBE3(name, arg1, arg2, arg3)
+/*
+/*	void	POSTFIX_PROBE4(name, arg1, arg2, arg3, arg4)
+/* DESCRIPTION
+/*	These macros define statically-defined tracepoints (USDT) in
+/*	provider "postfix", for use with tools such as bpftrace,
+/*	SystemTap, perf, or DTrace. Arguments must be integers or
+/*	pointers; strings are passed as pointers.
+/*
+/*	The macros expand to nothing unless Postfix is built with
+/*	-DUSE_SDT_PROBES and the <sys/sdt.h> header file (on Linux,
+/*	from the systemtap-sdt-dev or systemtap-sdt-devel package).
+/*	When built in, a probe site is a single no-op instruction
+/*	until a tracer attaches to it; tracers compute durations
+/*	from pairs of *_start and *_done probes.
+/*
+/*	Probes, and their arguments:
+/* .IP "event_start, event_done (fd, event, callback)"
+/*	Event call-back dispatch. The fd is -1 for a timer event.
+/* .IP "maps_lookup_start (maps_title, map_name, key)"
+/* .IP "maps_lookup_done (maps_title, map_name, key, result)"
+/*	Lookup in one table of a maps_find() search. The result is
+/*	null when the key was not found, or when the lookup failed.
+/* .IP "maps_cache_hit (maps_title, key, result)"
+/*	maps_find() lookup result from the per-process cache.
+/* .IP "record_get (stream, type, length)"
+/* .IP "record_put (stream, type, length)"
+/*	Queue file record read or write.
+/* .IP "tls_handshake_start (role, namaddr)"
+/* .IP "tls_handshake_done (role, namaddr, status)"
+/*	TLS handshake by tls_client_start() or tls_server_start().
+/*	The role is "client" or "server"; status > 0 means success.
+/* .IP "queue_file_sync_start (path)"
+/* .IP "queue_file_sync_done (path, status)"
+/*	Flush, time stamp, and fsync() or group commit of a new
+/*	queue file. Status is zero when the file is safely stored.
+/* .IP "qmgr_entry_select (transport, queue, queue_id)"
+/*	The queue manager selects a recipient entry for delivery.
+/* .PP
+/*	For example, to show the time spent in table lookups:
+/* .sp
+/* .nf
+/*	bpftrace -e '
+/*	usdt:/usr/libexec/postfix/cleanup:postfix:maps_lookup_start
+/*	    { @start[tid] = nsecs; }
+/*	usdt:/usr/libexec/postfix/cleanup:postfix:maps_lookup_done
+/*	    /@start[tid]/ { @us[str(arg1)] = hist((nsecs - @start[tid])
+/*	    / 1000); delete(@start[tid]); }'
+/* .fi
+/* .PP
+/*	With dynamically-linked Postfix builds, specify the library
+/*	that contains the probe, for example, libpostfix-util.so.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#ifdef USE_SDT_PROBES
+
+#include <sys/sdt.h>
+
+#define POSTFIX_PROBE0(name) \
+	DTRACE_PROBE(postfix, name)
+#define POSTFIX_PROBE1(name, a1) \
+	DTRACE_PROBE1(postfix, name, (a1))
+#define POSTFIX_PROBE2(name, a1, a2) \
+	DTRACE_PROBE2(postfix, name, (a1), (a2))
+#define POSTFIX_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(postfix, name, (a1), (a2), (a3))
+#define POSTFIX_PROBE4(name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(postfix, name, (a1), (a2), (a3), (a4))
+
+#else
+
+#define POSTFIX_PROBE0(name)			((void) 0)
+#define POSTFIX_PROBE1(name, a1)		((void) 0)
+#define POSTFIX_PROBE2(name, a1, a2)		((void) 0)
+#define POSTFIX_PROBE3(name, a1, a2, a3)	((void) 0)
+#define POSTFIX_PROBE4(name, a1, a2, a3, a4)	((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+/*++
+/* NAME
+/*	re_prefilter 3
+/* SUMMARY
+/*	literal pre-filter for regular expression tables
+/* SYNOPSIS
+/*	#include <re_prefilter.h>
+/*
+/*	ARGV	*re_prefilter_literals(regexp, syntax)
+/*	const char *regexp;
+/*	int	syntax;
+/*
+/*	AC_MATCH *re_prefilter_create(candidates, count)
+/*	ARGV	**candidates;
+/*	int	count;
+/* DESCRIPTION
+/*	This module implements the pattern pre-filter that is shared
+/*	by the regexp: and pcre: lookup tables. A pattern can't
+/*	match when a literal string that every match must contain
+/*	is not found in the lookup string. Such literals are found
+/*	with one ac_match_scan() call for all patterns in a table.
+/*
+/*	re_prefilter_literals() returns the literal strings of at
+/*	least three characters that every match of the specified
+/*	pattern must contain, with ASCII letters folded to lower
+/*	case. The result is a null pointer when the pattern is not
+/*	simple enough, or has no such literal. Only text outside
+/*	parentheses is used, and a quantifier removes the character
+/*	before it. Non-ASCII text ends a literal, so that
+/*	locale-dependent or UTF-8 case folding rules don't matter.
+/*	The \fIsyntax\fR argument is one of:
+/* .IP RE_PREFILTER_SYNTAX_ERE
+/*	POSIX extended regular expression syntax. The caller must
+/*	not use this for basic regular expressions. Backslash
+/*	followed by a letter or digit, and the GNU word and buffer
+/*	anchors, end a literal.
+/* .IP RE_PREFILTER_SYNTAX_PCRE
+/*	Perl-compatible regular expression syntax. The caller must
+/*	not use this for patterns with the "x" flag. Escape sequences
+/*	that match something other than one fixed character, (?x),
+/*	comments, and (*VERB) or (*OPTION) items are not supported.
+/* .PP
+/*	re_prefilter_create() chooses for each of \fIcount\fR
+/*	patterns one literal from its \fIcandidates\fR list, and
+/*	returns an ac_match(3) automaton with those literals. Of
+/*	the candidates of a pattern, it chooses the one that is
+/*	used by the fewest patterns, preferring longer literals,
+/*	so that a common prefix such as "^Subject:" does not defeat
+/*	the pre-filter. The literal of candidates[i] has ac_match(3)
+/*	identifier \fIi\fR. The candidate lists are destroyed, and
+/*	their array elements are set to null pointers.
+/* DIAGNOSTICS
+/*	Panic: interface violations. Fatal error: out of memory.
+/* SEE ALSO
+/*	ac_match(3), multi-string search
+/*	dict_regexp(3), POSIX regular expression table
+/*	dict_pcre(3), Perl-compatible regular expression table
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstring.h>
+#include <stringops.h>
+#include <htable.h>
+#include <re_prefilter.h>
+
+ /*
+  * Shorter literals would be found in most lookup strings.
+  */
+#define RE_PREFILTER_MIN_LITERAL	3
+
+/* re_prefilter_scan - find literal text that every match must contain */
+
+static int re_prefilter_scan(const char *regexp, int syntax,
+			             ARGV *found, VSTRING *run)
+{
+    const char *cp;
+    const char *ep;
+    int     depth = 0;
+    int     ch;
+
+    /*
+     * Give up on anything that is not obviously safe: alternatives at the
+     * top level, and malformed bracket expressions or intervals.
+     */
+#define RE_PREFILTER_LITERAL_END() do { \
+	if (VSTRING_LEN(run) >= RE_PREFILTER_MIN_LITERAL) { \
+	    VSTRING_TERMINATE(run); \
+	    argv_add(found, vstring_str(run), ARGV_END); \
+	} \
+	VSTRING_RESET(run); \
+    } while (0)
+
+    VSTRING_RESET(run);
+    for (cp = regexp; (ch = *(unsigned char *) cp) != 0; cp++) {
+	switch (ch) {
+	case '\\':
+	    if ((ch = *(unsigned char *) ++cp) == 0)
+		return (0);
+	    if (syntax == RE_PREFILTER_SYNTAX_PCRE && ISALNUM(ch)
+		&& strchr("AbBdDeGhHKnrRsStvVwWzZf", ch) == 0)
+		return (0);
+	    if (ISALNUM(ch) || (syntax == RE_PREFILTER_SYNTAX_ERE
+				&& strchr("<>`'", ch) != 0)) {
+		RE_PREFILTER_LITERAL_END();
+		continue;
+	    }
+	    break;
+	case '[':
+	    ep = cp + 1;
+	    if (*ep == '^')
+		ep++;
+	    if (*ep == ']')
+		ep++;
+	    for ( /* void */ ; *ep != ']'; ep++) {
+		if (*ep == 0)
+		    return (0);
+		if (syntax == RE_PREFILTER_SYNTAX_PCRE) {
+		    if (*ep == '\\') {
+			if (ep[1] == 0 || ep[1] == 'Q')
+			    return (0);
+			ep++;
+		    } else if (ep[0] == '[' && ep[1] == ':'
+			       && (cp = strstr(ep + 2, ":]")) != 0) {
+			ep = cp + 1;
+		    }
+		} else {
+		    /* Backslash is not special inside a bracket expression. */
+		    if (ep[0] == '['
+			&& (ep[1] == ':' || ep[1] == '.' || ep[1] == '=')) {
+			for (cp = ep + 2; cp[0] != ep[1] || cp[1] != ']'; cp++)
+			    if (*cp == 0)
+				return (0);
+			ep = cp + 1;
+		    }
+		}
+	    }
+	    cp = ep;
+	    RE_PREFILTER_LITERAL_END();
+	    continue;
+	case '(':
+	    if (syntax == RE_PREFILTER_SYNTAX_PCRE) {
+		if (cp[1] == '*')
+		    return (0);
+		if (cp[1] == '?') {
+		    if (cp[2] == '#')
+			return (0);
+		    for (ep = cp + 2; ISALPHA(*ep) || *ep == '-' || *ep == '^';
+			 ep++)
+			if (*ep == 'x')
+			    return (0);
+		}
+	    }
+	    depth++;
+	    RE_PREFILTER_LITERAL_END();
+	    continue;
+	case ')':
+	    depth--;
+	    RE_PREFILTER_LITERAL_END();
+	    continue;
+	case '|':
+	    if (depth == 0)
+		return (0);
+	    continue;
+	case '{':
+	    for (ep = cp + 1; ISDIGIT(*ep) || *ep == ','; ep++)
+		 /* void */ ;
+	    if (*ep != '}')
+		return (0);
+	    cp = ep;
+	    /* FALLTHROUGH */
+	case '*':
+	case '?':
+	    if (depth == 0 && VSTRING_LEN(run) > 0)
+		vstring_truncate(run, VSTRING_LEN(run) - 1);
+	    /* FALLTHROUGH */
+	case '+':
+	case '.':
+	case '^':
+	case '$':
+	    RE_PREFILTER_LITERAL_END();
+	    continue;
+	}
+	if (depth > 0)
+	    continue;
+	if (!ISASCII(ch)) {
+	    RE_PREFILTER_LITERAL_END();
+	    continue;
+	}
+	VSTRING_ADDCH(run, TOLOWER(ch));
+    }
+    RE_PREFILTER_LITERAL_END();
+    return (depth == 0 && found->argc > 0);
+}
+
+/* re_prefilter_literals - save pattern literals for the pre-filter */
+
+ARGV   *re_prefilter_literals(const char *regexp, int syntax)
+{
+    const char *myname = "re_prefilter_literals";
+    ARGV   *candidates;
+    static VSTRING *run;
+
+    if (syntax != RE_PREFILTER_SYNTAX_ERE
+	&& syntax != RE_PREFILTER_SYNTAX_PCRE)
+	msg_panic("%s: bad syntax: %d", myname, syntax);
+    if (run == 0)
+	run = vstring_alloc(100);
+    candidates = argv_alloc(1);
+    if (re_prefilter_scan(regexp, syntax, candidates, run) == 0) {
+	argv_free(candidates);
+	return (0);
+    }
+    return (candidates);
+}
+
+/* re_prefilter_create - choose pattern literals, build the pre-filter */
+
+AC_MATCH *re_prefilter_create(ARGV **candidates, int count)
+{
+    const char *myname = "re_prefilter_create";
+    AC_MATCH *literals;
+    HTABLE *usage;
+    HTABLE_INFO *ht;
+    char   *best;
+    int     best_count;
+    int     n;
+    int     i;
+
+    /*
+     * Count how often each candidate literal is used.
+     */
+    usage = htable_create(100);
+    for (n = 0; n < count; n++) {
+	if (candidates[n] == 0)
+	    msg_panic("%s: no candidates for pattern %d", myname, n);
+	for (i = 0; i < candidates[n]->argc; i++) {
+	    if ((ht = htable_locate(usage, candidates[n]->argv[i])) == 0)
+		htable_enter(usage, candidates[n]->argv[i],
+			     CAST_INT_TO_VOID_PTR(1));
+	    else
+		ht->value =
+		    CAST_INT_TO_VOID_PTR(CAST_ANY_PTR_TO_INT(ht->value) + 1);
+	}
+    }
+
+    /*
+     * For each pattern, choose the least-used candidate, preferring longer
+     * literals. Literal IDs are assigned in pattern order.
+     */
+    literals = ac_match_create();
+    for (n = 0; n < count; n++) {
+	for (best = 0, best_count = 0, i = 0; i < candidates[n]->argc; i++) {
+	    ht = htable_locate(usage, candidates[n]->argv[i]);
+	    if (best == 0 || CAST_ANY_PTR_TO_INT(ht->value) < best_count
+		|| (CAST_ANY_PTR_TO_INT(ht->value) == best_count
+		    && strlen(ht->key) > strlen(best))) {
+		best = ht->key;
+		best_count = CAST_ANY_PTR_TO_INT(ht->value);
+	    }
+	}
+	if (ac_match_add(literals, best, strlen(best)) != n)
+	    msg_panic("%s: unexpected literal ID", myname);
+	argv_free(candidates[n]);
+	candidates[n] = 0;
+    }
+    htable_free(usage, (void (*) (void *)) 0);
+    ac_match_compile(literals);
+    return (literals);
+}
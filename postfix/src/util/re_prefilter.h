@@ -0,0 +1,35 @@
+#ifndef _RE_PREFILTER_H_INCLUDED_
+#define _RE_PREFILTER_H_INCLUDED_
+
+/*++
+/* NAME
+/*	re_prefilter 3h
+/* SUMMARY
+/*	literal pre-filter for regular expression tables
+/* SYNOPSIS
+/*	#include <re_prefilter.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <argv.h>
+#include <ac_match.h>
+
+ /*
+  * External interface.
+  */
+#define RE_PREFILTER_SYNTAX_ERE		1	/* POSIX extended syntax */
+#define RE_PREFILTER_SYNTAX_PCRE	2	/* Perl-compatible syntax */
+
+extern ARGV *re_prefilter_literals(const char *, int);
+extern AC_MATCH *re_prefilter_create(ARGV **, int);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
@@ -39,7 +39,8 @@
 /*	scan_dir_next() returns the next requested object in the specified
 /*	directory. It skips the "." and ".." entries.
 /*
-/*	scan_dir_path() returns the name of the directory being scanned.
+/*	scan_dir_path() returns the name of the directory being scanned,
+/*	or a null pointer after the last directory was popped.
 /*
 /*	scan_dir_push() causes the specified directory scan to enter the
 /*	named subdirectory.
@@ -116,7 +117,7 @@ struct SCAN_DIR {
 
 char   *scan_dir_path(SCAN_DIR *scan)
 {
-    return (SCAN_DIR_PATH(scan));
+    return (scan->current ? SCAN_DIR_PATH(scan) : 0);
 }
 
 /* scan_dir_push - enter directory */
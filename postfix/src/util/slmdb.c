@@ -70,7 +70,9 @@
 /*
 /*	slmdb_get() is an mdb_get() wrapper with automatic error
 /*	recovery.  The result value is an LMDB status code (zero
-/*	in case of success).
+/*	in case of success). Outside a bulk transaction, slmdb_get()
+/*	reuses one read-only transaction handle per database: the
+/*	transaction is renewed before, and reset after, each lookup.
 /*
 /*	slmdb_put() is an mdb_put() wrapper with automatic error
 /*	recovery.  The result value is an LMDB status code (zero
@@ -309,6 +311,12 @@
   * synchronization. Because the caller may release the external lock after
   * an SLMDB API call, each SLMDB API function must use a short-lived
   * transaction unless the transaction is a bulk-mode transaction.
+  * 
+  * For the same reason, slmdb_get() cannot hold one snapshot across multiple
+  * API calls. Instead, it saves the cost of creating and destroying a read
+  * transaction for each lookup: it resets the read transaction before
+  * returning, which releases the snapshot, and renews it upon the next
+  * lookup.
   */
 
 /* slmdb_cursor_close - close cursor and its read transaction */
@@ -428,6 +436,10 @@ static int slmdb_recover(SLMDB *slmdb, int status)
      */
     if (slmdb->cursor != 0)
 	slmdb_cursor_close(slmdb);
+    if (slmdb->rtxn != 0) {
+	mdb_txn_abort(slmdb->rtxn);
+	slmdb->rtxn = 0;
+    }
 
     /*
      * Limit the number of recovery attempts per slmdb(3) API request.
@@ -553,6 +565,23 @@ static int slmdb_txn_begin(SLMDB *slmdb, int rdonly, MDB_txn **txn)
     return (status);
 }
 
+/* slmdb_rtxn_renew - renew or create the reusable read transaction */
+
+static int slmdb_rtxn_renew(SLMDB *slmdb)
+{
+    int     status;
+
+    if (slmdb->rtxn == 0)
+	return (slmdb_txn_begin(slmdb, MDB_RDONLY, &slmdb->rtxn));
+    if ((status = mdb_txn_renew(slmdb->rtxn)) != 0) {
+	mdb_txn_abort(slmdb->rtxn);
+	slmdb->rtxn = 0;
+	if ((status = slmdb_recover(slmdb, status)) == 0)
+	    status = slmdb_rtxn_renew(slmdb);
+    }
+    return (status);
+}
+
 /* slmdb_get - mdb_get() wrapper with LMDB error recovery */
 
 int     slmdb_get(SLMDB *slmdb, MDB_val *mdb_key, MDB_val *mdb_value)
@@ -561,12 +590,14 @@ int     slmdb_get(SLMDB *slmdb, MDB_val *mdb_key, MDB_val *mdb_value)
     int     status;
 
     /*
-     * Start a read transaction if there's no bulk-mode txn.
+     * Renew the read transaction if there's no bulk-mode txn.
      */
     if (slmdb->txn)
 	txn = slmdb->txn;
-    else if ((status = slmdb_txn_begin(slmdb, MDB_RDONLY, &txn)) != 0)
+    else if ((status = slmdb_rtxn_renew(slmdb)) != 0)
 	SLMDB_API_RETURN(slmdb, status);
+    else
+	txn = slmdb->rtxn;
 
     /*
      * Do the lookup.
@@ -576,16 +607,19 @@ int     slmdb_get(SLMDB *slmdb, MDB_val *mdb_key, MDB_val *mdb_value)
 	mdb_txn_abort(txn);
 	if (txn == slmdb->txn)
 	    slmdb->txn = 0;
+	else
+	    slmdb->rtxn = 0;
 	if ((status = slmdb_recover(slmdb, status)) == 0)
 	    status = slmdb_get(slmdb, mdb_key, mdb_value);
 	SLMDB_API_RETURN(slmdb, status);
     }
 
     /*
-     * Close the read txn if it's not the bulk-mode txn.
+     * Release the snapshot if it's not the bulk-mode txn, but keep the
+     * transaction handle for the next lookup.
      */
     if (slmdb->txn == 0)
-	mdb_txn_abort(txn);
+	mdb_txn_reset(txn);
 
     SLMDB_API_RETURN(slmdb, status);
 }
@@ -699,6 +733,11 @@ int     slmdb_cursor_get(SLMDB *slmdb, MDB_val *mdb_key,
      * Open a read transaction and cursor if needed.
      */
     if (slmdb->cursor == 0) {
+	/* Without MDB_NOTLS, both would use the same reader slot. */
+	if (slmdb->rtxn != 0) {
+	    mdb_txn_abort(slmdb->rtxn);
+	    slmdb->rtxn = 0;
+	}
 	if ((status = slmdb_txn_begin(slmdb, MDB_RDONLY, &txn)) != 0)
 	    SLMDB_API_RETURN(slmdb, status);
 	if ((status = mdb_cursor_open(txn, slmdb->dbi, &slmdb->cursor)) != 0) {
@@ -827,6 +866,8 @@ int     slmdb_close(SLMDB *slmdb)
      */
     if (slmdb->cursor != 0)
 	slmdb_cursor_close(slmdb);
+    if (slmdb->rtxn != 0)
+	mdb_txn_abort(slmdb->rtxn);
 
     mdb_env_close(slmdb->env);
 
@@ -918,6 +959,7 @@ int     slmdb_open(SLMDB *slmdb, const char *path, int open_flags,
     slmdb->dbi = dbi;
     slmdb->db_fd = db_fd;
     slmdb->cursor = 0;
+    slmdb->rtxn = 0;
     slmdb_saved_key_init(slmdb);
     slmdb->api_retry_count = 0;
     slmdb->bulk_retry_count = 0;
@@ -49,6 +49,7 @@ typedef struct {
     MDB_env *env;			/* database environment */
     MDB_dbi dbi;			/* database instance */
     MDB_txn *txn;			/* bulk transaction */
+    MDB_txn *rtxn;			/* reusable read transaction */
     int     db_fd;			/* database file handle */
     MDB_cursor *cursor;			/* iterator */
     MDB_val saved_key;			/* saved cursor key buffer */
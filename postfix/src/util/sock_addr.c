@@ -120,7 +120,9 @@ int     sock_addr_cmp_addr(const struct sockaddr *sa,
      * sequence would invalidate the use of memcmp().
      */
     if (sa->sa_family == AF_INET) {
-	return (SOCK_ADDR_IN_ADDR(sa).s_addr - SOCK_ADDR_IN_ADDR(sb).s_addr);
+	/* Don't subtract; the result must be a consistent sort order. */
+	return (SOCK_ADDR_IN_ADDR(sa).s_addr < SOCK_ADDR_IN_ADDR(sb).s_addr ?
+		-1 : SOCK_ADDR_IN_ADDR(sa).s_addr > SOCK_ADDR_IN_ADDR(sb).s_addr);
 #ifdef HAS_IPV6
     } else if (sa->sa_family == AF_INET6) {
 	return (memcmp((void *) &(SOCK_ADDR_IN6_ADDR(sa)),
@@ -67,7 +67,7 @@
 /* .fi
 /*	The Secure Mailer license must be distributed with this software.
 /* SEE ALSO
-/*	exec_command(3) execute command
+/*	vfork_exec(3) run external command
 /* AUTHOR(S)
 /*	Wietse Venema
 /*	IBM T.J. Watson Research
@@ -84,20 +84,13 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
-#ifdef USE_PATHS_H
-#include <paths.h>
-#endif
-#include <syslog.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <timed_wait.h>
-#include <set_ugid.h>
-#include <argv.h>
 #include <spawn_command.h>
-#include <exec_command.h>
-#include <clean_env.h>
+#include <vfork_exec.h>
 
 /* Application-specific. */
 
@@ -205,8 +198,7 @@ WAIT_STATUS_T spawn_command(int key,...)
     pid_t   pid;
     WAIT_STATUS_T wait_status;
     struct spawn_args args;
-    char  **cpp;
-    ARGV   *argv;
+    VFORK_EXEC request;
     int     err;
 
     /*
@@ -225,89 +217,48 @@ WAIT_STATUS_T spawn_command(int key,...)
 
     /*
      * Spawn off a child process and irrevocably change privilege to the
-     * user. This includes revoking all rights on open files (via the close
-     * on exec flag). If we cannot run the command now, try again some time
-     * later.
+     * user. This includes revoking all rights on open files. Run the child
+     * in a separate process group so that the parent can kill not just the
+     * child but also its offspring. vfork_exec() avoids copying the page
+     * tables of this process.
      */
-    switch (pid = fork()) {
+    request.name = myname;
+    request.argv = args.argv;
+    request.command = args.argv ? 0 : args.command;
+    request.shell = args.shell;
+    request.uid = args.uid;
+    request.gid = args.gid;
+    request.chroot = 0;
+    request.cwd = 0;
+    request.stdin_fd = args.stdin_fd;
+    request.stdout_fd = args.stdout_fd;
+    request.stderr_fd = args.stderr_fd;
+    request.export = args.export;
+    request.env = args.env;
+    request.fail_status = 1;
 
-	/*
-	 * Error. Instead of trying again right now, back off, give the
-	 * system a chance to recover, and try again later.
-	 */
-    case -1:
+    /*
+     * Error. Instead of trying again right now, back off, give the system a
+     * chance to recover, and try again later.
+     */
+    if ((pid = vfork_exec(&request)) < 0)
 	msg_fatal("fork: %m");
 
-	/*
-	 * Child. Run the child in a separate process group so that the
-	 * parent can kill not just the child but also its offspring.
-	 */
-    case 0:
-	if (args.uid != (uid_t) - 1 || args.gid != (gid_t) - 1)
-	    set_ugid(args.uid, args.gid);
-	setsid();
-
-	/*
-	 * Pipe plumbing.
-	 */
-	if ((args.stdin_fd >= 0 && DUP2(args.stdin_fd, STDIN_FILENO) < 0)
-	 || (args.stdout_fd >= 0 && DUP2(args.stdout_fd, STDOUT_FILENO) < 0)
-	|| (args.stderr_fd >= 0 && DUP2(args.stderr_fd, STDERR_FILENO) < 0))
-	    msg_fatal("%s: dup2: %m", myname);
-
-	/*
-	 * Environment plumbing. Always reset the command search path. XXX
-	 * That should probably be done by clean_env().
-	 */
-	if (args.export)
-	    clean_env(args.export);
-	if (setenv("PATH", _PATH_DEFPATH, 1))
-	    msg_fatal("%s: setenv: %m", myname);
-	if (args.env)
-	    for (cpp = args.env; *cpp; cpp += 2)
-		if (setenv(cpp[0], cpp[1], 1))
-		    msg_fatal("setenv: %m");
-
-	/*
-	 * Process plumbing. If possible, avoid running a shell.
-	 */
-	closelog();
-	if (args.argv) {
-	    execvp(args.argv[0], args.argv);
-	    msg_fatal("%s: execvp %s: %m", myname, args.argv[0]);
-	} else if (args.shell && *args.shell) {
-	    argv = argv_split(args.shell, CHARS_SPACE);
-	    argv_add(argv, args.command, (char *) 0);
-	    argv_terminate(argv);
-	    execvp(argv->argv[0], argv->argv);
-	    msg_fatal("%s: execvp %s: %m", myname, argv->argv[0]);
-	} else {
-	    exec_command(args.command);
-	}
-	/* NOTREACHED */
-
-	/*
-	 * Parent.
-	 */
-    default:
-
-	/*
-	 * Be prepared for the situation that the child does not terminate.
-	 * Make sure that the child terminates before the parent attempts to
-	 * retrieve its exit status, otherwise the parent could become stuck,
-	 * and the mail system would eventually run out of exec daemons. Do a
-	 * thorough job, and kill not just the child process but also its
-	 * offspring.
-	 */
-	if ((err = timed_waitpid(pid, &wait_status, 0, args.time_limit)) < 0
-	    && errno == ETIMEDOUT) {
-	    msg_warn("%s: process id %lu: command time limit exceeded",
-		     args.command, (unsigned long) pid);
-	    kill(-pid, SIGKILL);
-	    err = waitpid(pid, &wait_status, 0);
-	}
-	if (err < 0)
-	    msg_fatal("wait: %m");
-	return (wait_status);
+    /*
+     * Be prepared for the situation that the child does not terminate. Make
+     * sure that the child terminates before the parent attempts to retrieve
+     * its exit status, otherwise the parent could become stuck, and the mail
+     * system would eventually run out of exec daemons. Do a thorough job,
+     * and kill not just the child process but also its offspring.
+     */
+    if ((err = timed_waitpid(pid, &wait_status, 0, args.time_limit)) < 0
+	&& errno == ETIMEDOUT) {
+	msg_warn("%s: process id %lu: command time limit exceeded",
+		 args.command, (unsigned long) pid);
+	kill(-pid, SIGKILL);
+	err = waitpid(pid, &wait_status, 0);
     }
+    if (err < 0)
+	msg_fatal("wait: %m");
+    return (wait_status);
 }
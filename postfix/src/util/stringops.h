@@ -23,6 +23,7 @@ extern int util_utf8_enable;
 extern char *printable_except(char *, int, const char *);
 extern char *neuter(char *, const char *, int);
 extern char *lowercase(char *);
+extern int lowercase_needed(const char *);
 extern char *casefoldx(int, VSTRING *, const char *, ssize_t);
 extern char *uppercase(char *);
 extern char *skipblanks(const char *);
@@ -57,6 +58,7 @@ extern int allalnum(const char *);
 extern int allprint(const char *);
 extern int allspace(const char *);
 extern int allascii_len(const char *, ssize_t);
+extern ssize_t allascii_span(const char *, ssize_t);
 extern const char *WARN_UNUSED_RESULT split_nameval(char *, char **, char **);
 extern const char *WARN_UNUSED_RESULT split_qnameval(char *, char **, char **);
 extern int valid_utf8_string(const char *, ssize_t);
@@ -774,6 +774,7 @@ extern int initgroups(const char *, int);
 #define INTERNAL_LOCK	MYFLOCK_STYLE_FLOCK
 #define DEF_MAILBOX_LOCK "fcntl, dotlock"	/* RedHat >= 4.x */
 #define HAS_FSYNC
+#define HAS_FDATASYNC
 #define HAS_DB
 #define NATIVE_DB_TYPE	"hash"
 #define ALIAS_DB_MAP	DEF_DB_TYPE ":/etc/aliases"
@@ -821,7 +822,9 @@ extern int initgroups(const char *, int);
 #define CANT_WRITE_BEFORE_SENDING_FD
 #endif
 #define PREFERRED_RAND_SOURCE	"dev:/dev/urandom"	/* introduced in 1.1 */
-#ifndef NO_EPOLL
+#if defined(USE_IO_URING)
+#define EVENTS_STYLE	EVENTS_STYLE_URING	/* introduced in 5.5 */
+#elif !defined(NO_EPOLL)
 #define EVENTS_STYLE	EVENTS_STYLE_EPOLL	/* introduced in 2.5 */
 #endif
 #define USE_SYSV_POLL
@@ -837,6 +840,15 @@ extern int initgroups(const char *, int);
 #if HAVE_GLIBC_API_VERSION_SUPPORT(2, 34)
 #define HAS_CLOSEFROM
 #endif
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 14)
+#define HAS_SYNCFS
+#endif
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 19)
+#define HAS_O_TMPFILE			/* kernel 3.11 and later */
+#endif
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 6)
+#define HAS_SCHED_SETAFFINITY
+#endif
 
 #endif
 
@@ -1398,6 +1410,7 @@ extern int inet_pton(int, const char *, void *);
 #define EVENTS_STYLE_KQUEUE	2	/* FreeBSD kqueue */
 #define EVENTS_STYLE_DEVPOLL	3	/* Solaris /dev/poll */
 #define EVENTS_STYLE_EPOLL	4	/* Linux epoll */
+#define EVENTS_STYLE_URING	5	/* Linux io_uring */
 
  /*
   * We use poll() for read/write time limit enforcement on modern systems. We
@@ -45,6 +45,7 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <string.h>
 
 /* Utility library. */
 
@@ -65,9 +66,12 @@ int     valid_utf8_string(const char *str, ssize_t len)
 	return (1);
 
     /*
-     * Ideally, the compiler will inline parse_utf8_char().
+     * Ideally, the compiler will inline parse_utf8_char(). Skip runs of
+     * ASCII characters a word at a time; most strings are all ASCII.
      */
     for (cp = str; cp < ep; cp++) {
+	if ((cp += allascii_span(cp, ep - cp)) >= ep)
+	    break;
 	if ((last = parse_utf8_char(cp, ep)) != 0)
 	    cp = last;
 	else
@@ -80,21 +84,12 @@ int     valid_utf8_string(const char *str, ssize_t len)
 
 int     valid_utf8_stringz(const char *str)
 {
-    const char *cp;
-    const char *last;
 
     /*
-     * Ideally, the compiler will inline parse_utf8_char(), propagate the
-     * null pointer constant value, and eliminate code branches that test
-     * whether 0 != 0.
+     * The string has no null byte before its end, therefore this produces
+     * the same result as a parse_utf8_char() loop that stops at the null.
      */
-    for (cp = str; *cp; cp++) {
-	if ((last = parse_utf8_char(cp, 0)) != 0)
-	    cp = last;
-	else
-	    return (0);
-    }
-    return (1);
+    return (valid_utf8_string(str, strlen(str)));
 }
 
  /*
@@ -0,0 +1,296 @@
+/*++
+/* NAME
+/*	vfork_exec 3
+/* SUMMARY
+/*	run external command without copying the address space
+/* SYNOPSIS
+/*	#include <vfork_exec.h>
+/*
+/*	pid_t	vfork_exec(request)
+/*	VFORK_EXEC *request;
+/* DESCRIPTION
+/*	vfork_exec() creates a child process that executes an
+/*	external command with the specified privileges, directory,
+/*	standard input/output/error, and environment. The parent
+/*	process does not wait for the command to terminate.
+/*
+/*	The child process is created with vfork(), so that its
+/*	creation does not copy the page tables of a large parent
+/*	process. Everything that allocates memory, or that updates
+/*	state that the child would share with the parent, is done
+/*	in the parent before the child is created: the environment
+/*	is computed with clean_env_argv(), and the command is split
+/*	with exec_command_argv(). Until it executes the command,
+/*	the child makes system calls only.
+/*
+/*	Compile with -DNO_VFORK to use fork() instead.
+/*
+/*	Request members:
+/* .IP name
+/*	Prefix for diagnostics from the child process.
+/* .IP argv
+/*	The command as an argument vector, passed without further
+/*	inspection to execvp().
+/* .IP command
+/*	The command as a string. This is executed as with
+/*	exec_command(), unless \fIshell\fR is specified.
+/*	Specify one of \fIargv\fR or \fIcommand\fR.
+/* .IP shell
+/*	Null pointer, or the shell to use when executing the
+/*	\fIcommand\fR. This shell is invoked regardless of the
+/*	command content.
+/* .IP "uid, gid"
+/*	The privileges to execute the command with, or -1. As with
+/*	set_ugid(), this drops all supplementary groups.
+/* .IP chroot
+/*	Null pointer, or the root directory for command execution.
+/* .IP cwd
+/*	Null pointer, or the working directory for command execution,
+/*	after changing privileges.
+/* .IP "stdin_fd, stdout_fd, stderr_fd"
+/*	File descriptors for the command's standard input, output
+/*	and error, or -1. The child closes all other descriptors.
+/* .IP export
+/*	Null pointer, or a clean_env() list of environment variables
+/*	that can be exported. By default, everything is exported.
+/* .IP env
+/*	Null pointer, or a null-terminated list of name, value
+/*	pairs with additional environment information. The command
+/*	search path is always set to _PATH_DEFPATH.
+/* .IP fail_status
+/*	The exit status of the child process when it cannot execute
+/*	the command.
+/* DIAGNOSTICS
+/*	vfork_exec() returns the child process ID, or -1 with errno
+/*	set when a child process cannot be created.
+/*
+/*	When the child cannot set up the command environment, or
+/*	cannot execute the command, it writes a one-line diagnostic
+/*	to its standard error and terminates with \fIfail_status\fR.
+/* SEE ALSO
+/*	spawn_command(3), run external command
+/*	exec_command(3), execute command
+/*	clean_env(3), clean up the environment
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <signal.h>
+#include <grp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#ifdef USE_PATHS_H
+#include <paths.h>
+#endif
+
+/* Utility library. */
+
+#include <msg.h>
+#include <argv.h>
+#include <stringops.h>
+#include <clean_env.h>
+#include <exec_command.h>
+#include <vfork_exec.h>
+
+/* Application-specific. */
+
+#ifdef NO_VFORK
+#define vfork	fork
+#endif
+
+#ifndef NSIG
+#define NSIG	32
+#endif
+
+/* vfork_exec_puts - write string to stderr, child only */
+
+static void vfork_exec_puts(const char *str)
+{
+    if (write(STDERR_FILENO, str, strlen(str)) < 0)
+	 /* void */ ;
+}
+
+/* vfork_exec_fail - report error and terminate, child only */
+
+static NORETURN vfork_exec_fail(VFORK_EXEC *vp, const char *what,
+				        const char *arg)
+{
+    const char *err = strerror(errno);
+
+    vfork_exec_puts(vp->name);
+    vfork_exec_puts(": ");
+    vfork_exec_puts(what);
+    vfork_exec_puts(" ");
+    vfork_exec_puts(arg);
+    vfork_exec_puts(": ");
+    vfork_exec_puts(err);
+    vfork_exec_puts("\n");
+    _exit(vp->fail_status);
+}
+
+/* vfork_exec_child - set up and execute command, child only */
+
+static NORETURN vfork_exec_child(VFORK_EXEC *vp, char **exec_argv,
+				         char **sh_argv, char **envp,
+				         sigset_t *saved_mask)
+{
+    extern char **environ;
+    struct sigaction action;
+    int     sig;
+
+    /*
+     * WARNING: until the command is executed, this code shares memory with
+     * the parent process. Don't allocate memory, don't update global state,
+     * don't use msg(3) or vstream(3), and don't return.
+     *
+     * Pipe plumbing first, so that diagnostics reach the caller.
+     */
+    if ((vp->stdin_fd >= 0 && DUP2(vp->stdin_fd, STDIN_FILENO) < 0)
+	|| (vp->stdout_fd >= 0 && DUP2(vp->stdout_fd, STDOUT_FILENO) < 0)
+	|| (vp->stderr_fd >= 0 && DUP2(vp->stderr_fd, STDERR_FILENO) < 0))
+	vfork_exec_fail(vp, "dup2", "");
+
+    /*
+     * Enter the jail and irrevocably change privilege to the user, as with
+     * chroot_uid() and set_ugid(). Run the command in a separate process
+     * group so that the parent can kill not just the command but also its
+     * offspring.
+     */
+    if (vp->chroot) {
+	if (seteuid(0) < 0)
+	    vfork_exec_fail(vp, "seteuid", "0");
+	if (chroot(vp->chroot) < 0)
+	    vfork_exec_fail(vp, "chroot", vp->chroot);
+	if (chdir("/") < 0)
+	    vfork_exec_fail(vp, "chdir", "/");
+    }
+    if (vp->uid != (uid_t) - 1 || vp->gid != (gid_t) - 1) {
+	if (geteuid() != 0 && seteuid(0) < 0)
+	    vfork_exec_fail(vp, "seteuid", "0");
+	if (setgid(vp->gid) < 0)
+	    vfork_exec_fail(vp, "setgid", "");
+	if (setgroups(1, &vp->gid) < 0)
+	    vfork_exec_fail(vp, "setgroups", "");
+	if (setuid(vp->uid) < 0)
+	    vfork_exec_fail(vp, "setuid", "");
+    }
+    (void) setsid();
+    if (vp->cwd && chdir(vp->cwd) < 0)
+	vfork_exec_fail(vp, "cannot change directory to", vp->cwd);
+
+    /*
+     * Don't leak descriptors such as the syslog socket; closelog() would
+     * update state that is shared with the parent.
+     */
+    (void) closefrom(STDERR_FILENO + 1);
+
+    /*
+     * A signal handler must not run in this process, because it would run
+     * on the parent's memory. Restore default handlers before unblocking
+     * signals. The command inherits the parent's signal mask as before.
+     */
+    for (sig = 1; sig < NSIG; sig++) {
+	if (sigaction(sig, (struct sigaction *) 0, &action) == 0
+	    && ((action.sa_flags & SA_SIGINFO) != 0
+		|| (action.sa_handler != SIG_DFL
+		    && action.sa_handler != SIG_IGN))) {
+	    sigemptyset(&action.sa_mask);
+	    action.sa_flags = 0;
+	    action.sa_handler = SIG_DFL;
+	    (void) sigaction(sig, &action, (struct sigaction *) 0);
+	}
+    }
+    (void) sigprocmask(SIG_SETMASK, saved_mask, (sigset_t *) 0);
+
+    /*
+     * Process plumbing. The parent restores its own environment pointer.
+     */
+    environ = envp;
+    if (exec_argv) {
+	(void) execvp(exec_argv[0], exec_argv);
+	if (sh_argv == 0 || errno != ENOENT || strchr(exec_argv[0], '/') != 0)
+	    vfork_exec_fail(vp, "execvp", exec_argv[0]);
+    }
+    (void) execv(_PATH_BSHELL, sh_argv);
+    vfork_exec_fail(vp, "execv", _PATH_BSHELL);
+}
+
+/* vfork_exec - run command without copying the address space */
+
+pid_t   vfork_exec(VFORK_EXEC *vp)
+{
+    const char *myname = "vfork_exec";
+    extern char **environ;
+    char  **saved_environ = environ;
+    ARGV   *override;
+    ARGV   *env;
+    ARGV   *argv = 0;
+    char  **exec_argv;
+    char   *sh_argv[4];
+    char  **cpp;
+    sigset_t block_mask;
+    sigset_t saved_mask;
+    pid_t   pid;
+    int     saved_errno;
+
+    if ((vp->argv == 0) == (vp->command == 0))
+	msg_panic("%s: specify one of argv or command", myname);
+
+    /*
+     * Compute the command environment. Always reset the command search
+     * path.
+     */
+    override = argv_alloc(10);
+    argv_add(override, "PATH", _PATH_DEFPATH, (char *) 0);
+    if (vp->env)
+	for (cpp = vp->env; *cpp; cpp += 2)
+	    argv_add(override, cpp[0], cpp[1], (char *) 0);
+    argv_terminate(override);
+    env = clean_env_argv(vp->export, override->argv);
+    argv_free(override);
+
+    /*
+     * Compute the argument vector. If possible, avoid running a shell.
+     */
+    sh_argv[0] = 0;
+    if (vp->argv) {
+	exec_argv = vp->argv;
+    } else if (vp->shell && *vp->shell) {
+	argv = argv_split(vp->shell, CHARS_SPACE);
+	argv_add(argv, vp->command, (char *) 0);
+	argv_terminate(argv);
+	exec_argv = argv->argv;
+    } else {
+	argv = exec_command_argv(vp->command);
+	exec_argv = argv ? argv->argv : 0;
+	sh_argv[0] = "sh";
+	sh_argv[1] = "-c";
+	sh_argv[2] = (char *) vp->command;
+	sh_argv[3] = 0;
+    }
+
+    /*
+     * Block signals until the child has disabled the parent's handlers.
+     */
+    sigfillset(&block_mask);
+    if (sigprocmask(SIG_SETMASK, &block_mask, &saved_mask) < 0)
+	msg_fatal("%s: sigprocmask: %m", myname);
+    if ((pid = vfork()) == 0)
+	vfork_exec_child(vp, exec_argv, sh_argv[0] ? sh_argv : (char **) 0,
+			 env->argv, &saved_mask);
+    saved_errno = errno;
+    environ = saved_environ;
+    if (sigprocmask(SIG_SETMASK, &saved_mask, (sigset_t *) 0) < 0)
+	msg_fatal("%s: sigprocmask: %m", myname);
+    if (argv)
+	argv_free(argv);
+    argv_free(env);
+    errno = saved_errno;
+    return (pid);
+}
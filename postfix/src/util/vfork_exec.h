@@ -0,0 +1,42 @@
+#ifndef _VFORK_EXEC_H_INCLUDED_
+#define _VFORK_EXEC_H_INCLUDED_
+
+/*++
+/* NAME
+/*	vfork_exec 3h
+/* SUMMARY
+/*	run external command without copying the address space
+/* SYNOPSIS
+/*	#include <vfork_exec.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * External interface.
+  */
+typedef struct VFORK_EXEC {
+    const char *name;			/* diagnostics prefix */
+    char  **argv;			/* argument vector */
+    const char *command;		/* or a plain string */
+    const char *shell;			/* command shell */
+    uid_t   uid;			/* privileges, or -1 */
+    gid_t   gid;			/* privileges, or -1 */
+    const char *chroot;			/* root directory */
+    const char *cwd;			/* working directory */
+    int     stdin_fd;			/* read stdin here, or -1 */
+    int     stdout_fd;			/* write stdout here, or -1 */
+    int     stderr_fd;			/* write stderr here, or -1 */
+    char  **export;			/* exportable environment */
+    char  **env;			/* extra environment */
+    int     fail_status;		/* child exit status on error */
+} VFORK_EXEC;
+
+extern pid_t vfork_exec(VFORK_EXEC *);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+#endif
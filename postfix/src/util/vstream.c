@@ -1865,6 +1865,9 @@ VSTREAM *vstream_memreopen(VSTREAM *stream, VSTRING *string, int flags)
     stream->read_fn = 0;
     stream->write_fn = 0;
     stream->vstring = string;
+    /* vstream_buf_alloc() may myrealloc() the VSTRING buffer. */
+    if (VSTREAM_ACC_MASK(flags) != O_RDONLY)
+	vstring_move_to_heap(string);
     memcpy(&stream->buf, &stream->vstring->vbuf, sizeof(stream->buf));
     stream->buf.flags |= VSTREAM_FLAG_MEMORY;
     switch (VSTREAM_ACC_MASK(flags)) {
@@ -123,6 +123,9 @@
 /*
 /*	VSTRING	*vstring_import(str)
 /*	char	*str;
+/*
+/*	void	vstring_move_to_heap(vp)
+/*	VSTRING	*vp;
 /* DESCRIPTION
 /*	The functions and macros in this module implement arbitrary-length
 /*	strings and common operations on those strings. The strings do not
@@ -132,7 +135,9 @@
 /*
 /*	vstring_alloc() allocates storage for a variable-length string
 /*	of at least "len" bytes. The minimal length is 1. The result
-/*	is a null-terminated string of length zero.
+/*	is a null-terminated string of length zero. Storage for a
+/*	short string is allocated together with the VSTRING structure.
+/*	When a string fills up, its storage is doubled in size.
 /*
 /*	vstring_ctl() gives additional control over VSTRING behavior.
 /*	The function takes a VSTRING pointer and a list of zero or
@@ -265,6 +270,12 @@
 /*	vstring_import() takes a `bare' string and converts it to
 /*	a VSTRING. The string argument must be obtained from mymalloc().
 /*	The string argument is not copied.
+/*
+/*	vstring_move_to_heap() ensures that the string value is
+/*	stored in memory that was obtained from mymalloc(), and
+/*	that may be resized with myrealloc(). By default, a short
+/*	string value is stored inside the VSTRING structure. This
+/*	function is for internal use by vstream(3) memory streams.
 /* DIAGNOSTICS
 /*	Fatal errors: memory allocation failure.
 /* BUGS
@@ -303,12 +314,26 @@
 #include "vbuf_print.h"
 #include "vstring.h"
 
+#ifndef VSTRING_INLINE_MAX
+#define VSTRING_INLINE_MAX	128	/* max inline buffer size */
+#endif
+
+ /*
+  * A short initial buffer is allocated together with the VSTRING header, so
+  * that a short string costs one mymalloc() call instead of two. The
+  * buffer is moved out of line when it needs to grow.
+  */
+#define VSTRING_INLINE_DATA(vp)	((unsigned char *) ((vp) + 1))
+#define VSTRING_IS_INLINE(vp)	((vp)->vbuf.data == VSTRING_INLINE_DATA(vp))
+
 /* vstring_extend - variable-length string buffer extension policy */
 
 static void vstring_extend(VBUF *bp, ssize_t incr)
 {
     size_t  used = bp->ptr - bp->data;
     ssize_t new_len;
+    unsigned char *data;
+    int     tag;
 
     /*
      * Note: vp->vbuf.len is the current buffer size (both on entry and on
@@ -322,13 +347,25 @@ static void vstring_extend(VBUF *bp, ssize_t incr)
      * 
      * Safety net: add a gratuitous null terminator so that C-style string
      * operations won't scribble past the end.
+     * 
+     * A buffer that lives inside the VSTRING header can't be resized in
+     * place. It is copied to a separate buffer, and the inline storage
+     * remains unused until the VSTRING is destroyed.
      */
     if ((bp->flags & VSTRING_FLAG_EXACT) == 0 && bp->len > incr)
 	incr = bp->len;
     if (bp->len > SSIZE_T_MAX - incr - 1)
 	msg_fatal("vstring_extend: length overflow");
     new_len = bp->len + incr;
-    bp->data = (unsigned char *) myrealloc((void *) bp->data, new_len + 1);
+    if (VSTRING_IS_INLINE((VSTRING *) bp)) {
+	tag = mymalloc_set_default_tag(MYMALLOC_TAG_VSTRING);
+	data = (unsigned char *) mymalloc(new_len + 1);
+	(void) mymalloc_set_tag(tag);
+	memcpy((void *) data, (void *) bp->data, bp->len + 1);
+	bp->data = data;
+    } else {
+	bp->data = (unsigned char *) myrealloc((void *) bp->data, new_len + 1);
+    }
     bp->data[new_len] = 0;
     bp->len = new_len;
     bp->ptr = bp->data + used;
@@ -368,6 +405,7 @@ static int vstring_buf_space(VBUF *bp, ssize_t len)
 VSTRING *vstring_alloc(ssize_t len)
 {
     VSTRING *vp;
+    int     tag;
 
     /*
      * Safety net: add a gratuitous null terminator so that C-style string
@@ -375,10 +413,16 @@ VSTRING *vstring_alloc(ssize_t len)
      */
     if (len < 1 || len > SSIZE_T_MAX - 1)
 	msg_panic("vstring_alloc: bad length %ld", (long) len);
-    vp = (VSTRING *) mymalloc(sizeof(*vp));
+    tag = mymalloc_set_default_tag(MYMALLOC_TAG_VSTRING);
+    if (len <= VSTRING_INLINE_MAX) {
+	vp = (VSTRING *) mymalloc(sizeof(*vp) + len + 1);
+	vp->vbuf.data = VSTRING_INLINE_DATA(vp);
+    } else {
+	vp = (VSTRING *) mymalloc(sizeof(*vp));
+	vp->vbuf.data = (unsigned char *) mymalloc(len + 1);
+    }
+    (void) mymalloc_set_tag(tag);
     vp->vbuf.flags = 0;
-    vp->vbuf.len = 0;
-    vp->vbuf.data = (unsigned char *) mymalloc(len + 1);
     vp->vbuf.data[len] = 0;
     vp->vbuf.len = len;
     VSTRING_RESET(vp);
@@ -393,12 +437,29 @@ VSTRING *vstring_alloc(ssize_t len)
 
 VSTRING *vstring_free(VSTRING *vp)
 {
-    if (vp->vbuf.data)
+    if (vp->vbuf.data && !VSTRING_IS_INLINE(vp))
 	myfree((void *) vp->vbuf.data);
     myfree((void *) vp);
     return (0);
 }
 
+/* vstring_move_to_heap - move inline buffer out of line */
+
+void    vstring_move_to_heap(VSTRING *vp)
+{
+    unsigned char *data;
+    int     tag;
+
+    if (VSTRING_IS_INLINE(vp)) {
+	tag = mymalloc_set_default_tag(MYMALLOC_TAG_VSTRING);
+	data = (unsigned char *) mymalloc(vp->vbuf.len + 1);
+	(void) mymalloc_set_tag(tag);
+	memcpy((void *) data, (void *) vp->vbuf.data, vp->vbuf.len + 1);
+	vp->vbuf.ptr = data + (vp->vbuf.ptr - vp->vbuf.data);
+	vp->vbuf.data = data;
+    }
+}
+
 /* vstring_ctl - modify memory management policy */
 
 void    vstring_ctl(VSTRING *vp,...)
@@ -591,6 +652,7 @@ char   *vstring_export(VSTRING *vp)
 {
     char   *cp;
 
+    vstring_move_to_heap(vp);
     cp = (char *) vp->vbuf.data;
     vp->vbuf.data = 0;
     myfree((void *) vp);
@@ -94,6 +94,8 @@ CHECK_VAL_HELPER_DCL(VSTRING_CTL, ssize_t);
 	(vp)->vbuf.ptr = (vp)->vbuf.data + (offset); \
 	(vp)->vbuf.cnt = (vp)->vbuf.len - (offset); \
     } while (0)
+
+extern void vstring_move_to_heap(VSTRING *);
 #endif
 
 extern VSTRING *vstring_vsprintf(VSTRING *, const char *, va_list);
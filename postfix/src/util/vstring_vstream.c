@@ -126,21 +126,59 @@
 #define VSTRING_GET_RESULT(vp, baselen) \
     (VSTRING_LEN(vp) > (base_len) ? vstring_end(vp)[-1] : VSTREAM_EOF)
 
+/* vstring_get_term - append text up to and including terminator */
+
+static int vstring_get_term(VSTRING *vp, VSTREAM *fp, int term, ssize_t bound)
+{
+    const char *data;
+    const char *cp;
+    ssize_t len;
+    int     c;
+
+    /*
+     * Instead of VSTREAM_GETC() and VSTRING_ADDCH() for every character,
+     * search the stream buffer with memchr(), which the system library
+     * typically implements with word-at-a-time or vector instructions, and
+     * append everything up to and including the terminator in one copy. We
+     * still use VSTREAM_GETC() to refill an empty buffer, so that timeouts,
+     * deadlines and read errors are handled in the usual place.
+     * 
+     * Return 1 when the terminator was found, 0 otherwise.
+     */
+    while (bound > 0) {
+	if ((len = vstream_peek(fp)) <= 0) {
+	    if ((c = VSTREAM_GETC(fp)) == VSTREAM_EOF)
+		return (0);
+	    VSTRING_ADDCH(vp, c);
+	    if (c == term)
+		return (1);
+	    bound -= 1;
+	    continue;
+	}
+	if (len > bound)
+	    len = bound;
+	data = vstream_peek_data(fp);
+	if ((cp = memchr(data, term, len)) != 0)
+	    len = cp - data + 1;
+	if (vstream_fread_app(fp, vp, len) != len)
+	    msg_panic("vstring_get_term: short read from stream buffer");
+	if (cp != 0)
+	    return (1);
+	bound -= len;
+    }
+    return (0);
+}
+
 /* vstring_get_flags - read line from file, keep newline */
 
 int     vstring_get_flags(VSTRING *vp, VSTREAM *fp, int flags)
 {
-    int     c;
     ssize_t base_len;
 
     if ((flags & VSTRING_GET_FLAG_APPEND) == 0)
 	VSTRING_RESET(vp);
     base_len = VSTRING_LEN(vp);
-    while ((c = VSTREAM_GETC(fp)) != VSTREAM_EOF) {
-	VSTRING_ADDCH(vp, c);
-	if (c == '\n')
-	    break;
-    }
+    (void) vstring_get_term(vp, fp, '\n', SSIZE_T_MAX);
     VSTRING_TERMINATE(vp);
     return (VSTRING_GET_RESULT(vp, baselen));
 }
@@ -149,32 +187,36 @@ int     vstring_get_flags(VSTRING *vp, VSTREAM *fp, int flags)
 
 int     vstring_get_flags_nonl(VSTRING *vp, VSTREAM *fp, int flags)
 {
-    int     c;
     ssize_t base_len;
 
     if ((flags & VSTRING_GET_FLAG_APPEND) == 0)
 	VSTRING_RESET(vp);
     base_len = VSTRING_LEN(vp);
-    while ((c = VSTREAM_GETC(fp)) != VSTREAM_EOF && c != '\n')
-	VSTRING_ADDCH(vp, c);
+    if (vstring_get_term(vp, fp, '\n', SSIZE_T_MAX)) {
+	vstring_truncate(vp, VSTRING_LEN(vp) - 1);
+	VSTRING_TERMINATE(vp);
+	return ('\n');
+    }
     VSTRING_TERMINATE(vp);
-    return (c == '\n' ? c : VSTRING_GET_RESULT(vp, baselen));
+    return (VSTRING_GET_RESULT(vp, baselen));
 }
 
 /* vstring_get_flags_null - read null-terminated string from file */
 
 int     vstring_get_flags_null(VSTRING *vp, VSTREAM *fp, int flags)
 {
-    int     c;
     ssize_t base_len;
 
     if ((flags & VSTRING_GET_FLAG_APPEND) == 0)
 	VSTRING_RESET(vp);
     base_len = VSTRING_LEN(vp);
-    while ((c = VSTREAM_GETC(fp)) != VSTREAM_EOF && c != 0)
-	VSTRING_ADDCH(vp, c);
+    if (vstring_get_term(vp, fp, 0, SSIZE_T_MAX)) {
+	vstring_truncate(vp, VSTRING_LEN(vp) - 1);
+	VSTRING_TERMINATE(vp);
+	return (0);
+    }
     VSTRING_TERMINATE(vp);
-    return (c == 0 ? c : VSTRING_GET_RESULT(vp, baselen));
+    return (VSTRING_GET_RESULT(vp, baselen));
 }
 
 /* vstring_get_flags_bound - read line from file, keep newline, up to bound */
@@ -182,7 +224,6 @@ int     vstring_get_flags_null(VSTRING *vp, VSTREAM *fp, int flags)
 int     vstring_get_flags_bound(VSTRING *vp, VSTREAM *fp, int flags,
 				        ssize_t bound)
 {
-    int     c;
     ssize_t base_len;
 
     if (bound <= 0)
@@ -191,11 +232,7 @@ int     vstring_get_flags_bound(VSTRING *vp, VSTREAM *fp, int flags,
     if ((flags & VSTRING_GET_FLAG_APPEND) == 0)
 	VSTRING_RESET(vp);
     base_len = VSTRING_LEN(vp);
-    while (bound-- > 0 && (c = VSTREAM_GETC(fp)) != VSTREAM_EOF) {
-	VSTRING_ADDCH(vp, c);
-	if (c == '\n')
-	    break;
-    }
+    (void) vstring_get_term(vp, fp, '\n', bound);
     VSTRING_TERMINATE(vp);
     return (VSTRING_GET_RESULT(vp, baselen));
 }
@@ -205,7 +242,6 @@ int     vstring_get_flags_bound(VSTRING *vp, VSTREAM *fp, int flags,
 int     vstring_get_flags_nonl_bound(VSTRING *vp, VSTREAM *fp, int flags,
 				             ssize_t bound)
 {
-    int     c;
     ssize_t base_len;
 
     if (bound <= 0)
@@ -214,10 +250,13 @@ int     vstring_get_flags_nonl_bound(VSTRING *vp, VSTREAM *fp, int flags,
     if ((flags & VSTRING_GET_FLAG_APPEND) == 0)
 	VSTRING_RESET(vp);
     base_len = VSTRING_LEN(vp);
-    while (bound-- > 0 && (c = VSTREAM_GETC(fp)) != VSTREAM_EOF && c != '\n')
-	VSTRING_ADDCH(vp, c);
+    if (vstring_get_term(vp, fp, '\n', bound)) {
+	vstring_truncate(vp, VSTRING_LEN(vp) - 1);
+	VSTRING_TERMINATE(vp);
+	return ('\n');
+    }
     VSTRING_TERMINATE(vp);
-    return (c == '\n' ? c : VSTRING_GET_RESULT(vp, baselen));
+    return (VSTRING_GET_RESULT(vp, baselen));
 }
 
 /* vstring_get_flags_null_bound - read null-terminated string from file */
@@ -225,7 +264,6 @@ int     vstring_get_flags_nonl_bound(VSTRING *vp, VSTREAM *fp, int flags,
 int     vstring_get_flags_null_bound(VSTRING *vp, VSTREAM *fp, int flags,
 				             ssize_t bound)
 {
-    int     c;
     ssize_t base_len;
 
     if (bound <= 0)
@@ -234,10 +272,13 @@ int     vstring_get_flags_null_bound(VSTRING *vp, VSTREAM *fp, int flags,
     if ((flags & VSTRING_GET_FLAG_APPEND) == 0)
 	VSTRING_RESET(vp);
     base_len = VSTRING_LEN(vp);
-    while (bound-- > 0 && (c = VSTREAM_GETC(fp)) != VSTREAM_EOF && c != 0)
-	VSTRING_ADDCH(vp, c);
+    if (vstring_get_term(vp, fp, 0, bound)) {
+	vstring_truncate(vp, VSTRING_LEN(vp) - 1);
+	VSTRING_TERMINATE(vp);
+	return (0);
+    }
     VSTRING_TERMINATE(vp);
-    return (c == 0 ? c : VSTRING_GET_RESULT(vp, baselen));
+    return (VSTRING_GET_RESULT(vp, baselen));
 }
 
 #ifdef TEST
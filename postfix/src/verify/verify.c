@@ -115,6 +115,14 @@
 /* .IP "\fBaddress_verify_cache_cleanup_interval (12h)\fR"
 /*	The amount of time between \fBverify\fR(8) address verification
 /*	database cleanup runs.
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBaddress_verify_cache_memory_size (0)\fR"
+/*	The number of recently-used address_verify_map entries that the
+/*	\fBverify\fR(8) daemon keeps in memory.
+/* .IP "\fBaddress_verify_cache_write_delay (0s)\fR"
+/*	The amount of time that the \fBverify\fR(8) daemon may delay
+/*	updates of the address_verify_map database.
 /* PROBE MESSAGE ROUTING CONTROLS
 /* .ad
 /* .fi
@@ -270,6 +278,8 @@ int     var_verify_pos_try;
 int     var_verify_neg_exp;
 int     var_verify_neg_try;
 int     var_verify_scan_cache;
+int     var_verify_mem_cache;
+int     var_verify_write_delay;
 
  /*
   * State.
@@ -645,6 +655,18 @@ static void post_jail_init(char *unused_name, char **unused_argv)
 	var_idle_limit = 0;
     }
 
+    /*
+     * Otherwise, optionally keep recently-used entries in memory, and
+     * batch database updates. We are the only process that updates the
+     * database, so the in-memory copy cannot become stale.
+     */
+    else {
+	dict_cache_control(verify_map,
+			   CA_DICT_CACHE_CTL_MEM_SIZE(var_verify_mem_cache),
+			CA_DICT_CACHE_CTL_WRITE_DELAY(var_verify_write_delay),
+			   CA_DICT_CACHE_CTL_END);
+    }
+
     /*
      * Start the cache cleanup thread.
      */
@@ -756,6 +778,11 @@ int     main(int argc, char **argv)
 	VAR_VERIFY_NEG_TRY, DEF_VERIFY_NEG_TRY, &var_verify_neg_try, 1, 0,
 	VAR_VERIFY_SCAN_CACHE, DEF_VERIFY_SCAN_CACHE, &var_verify_scan_cache, 0, 0,
 	VAR_VERIFY_SENDER_TTL, DEF_VERIFY_SENDER_TTL, &var_verify_sender_ttl, 0, 0,
+	VAR_VERIFY_WRITE_DELAY, DEF_VERIFY_WRITE_DELAY, &var_verify_write_delay, 0, 0,
+	0,
+    };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_VERIFY_MEM_CACHE, DEF_VERIFY_MEM_CACHE, &var_verify_mem_cache, 0, 0,
 	0,
     };
 
@@ -766,6 +793,7 @@ int     main(int argc, char **argv)
 
     multi_server_main(argc, argv, verify_service,
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
 		      CA_MAIL_SERVER_TIME_TABLE(time_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		      CA_MAIL_SERVER_POST_INIT(post_jail_init),
@@ -272,9 +272,9 @@ int     deliver_mailbox(LOCAL_STATE state, USER_ATTR usr_attr, int *statusp)
 #define LAST_CHAR(s) (s[strlen(s) - 1])
 
     if (LAST_CHAR(usr_attr.mailbox) == '/')
-	*statusp = deliver_maildir(state, usr_attr);
+	*statusp = parallel_deliver(state, usr_attr, deliver_maildir);
     else
-	*statusp = deliver_mailbox_file(state, usr_attr);
+	*statusp = parallel_deliver(state, usr_attr, deliver_mailbox_file);
 
     /*
      * Cleanup.
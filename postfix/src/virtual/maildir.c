@@ -9,9 +9,25 @@
 /*	int	deliver_maildir(state, usr_attr)
 /*	LOCAL_STATE state;
 /*	USER_ATTR usr_attr;
+/*
+/*	void	maildir_share_begin()
+/*
+/*	void	maildir_share_end()
 /* DESCRIPTION
 /*	deliver_maildir() delivers a message to a qmail-style maildir.
 /*
+/*	maildir_share_begin() enables single-copy delivery for the
+/*	remainder of a delivery request. The first maildir delivery
+/*	writes the message without the per-recipient Delivered-To:
+/*	and X-Original-To: headers, and keeps its tmp/ file. Later
+/*	maildir deliveries with the same user and group ID hard-link
+/*	that file into their own new/ directory, and fall back to
+/*	writing a full copy when the link fails (for example, the
+/*	maildir is on a different file system).
+/*
+/*	maildir_share_end() removes the shared tmp/ file, and
+/*	disables single-copy delivery.
+/*
 /*	Arguments:
 /* .IP state
 /*	The attributes that specify the message, recipient and more.
@@ -68,6 +84,70 @@
 
 #include "virtual.h"
 
+ /*
+  * Single-copy delivery state. The shared file stays in the tmp/ directory
+  * of the first maildir, and is owned by the user and group below.
+  */
+static int maildir_share_enable;
+static char *maildir_share_path;
+static uid_t maildir_share_uid;
+static gid_t maildir_share_gid;
+static int maildir_share_count;
+
+/* maildir_share_begin - enable single-copy delivery */
+
+void    maildir_share_begin(void)
+{
+    maildir_share_enable = 1;
+}
+
+/* maildir_share_end - clean up after single-copy delivery */
+
+void    maildir_share_end(void)
+{
+    if (maildir_share_path != 0) {
+	set_eugid(maildir_share_uid, maildir_share_gid);
+	if (unlink(maildir_share_path) < 0)
+	    msg_warn("remove %s: %m", maildir_share_path);
+	set_eugid(var_owner_uid, var_owner_gid);
+	myfree(maildir_share_path);
+	maildir_share_path = 0;
+    }
+    maildir_share_enable = 0;
+    maildir_share_count = 0;
+}
+
+/* maildir_share_link - link shared copy into maildir, as the recipient */
+
+static char *maildir_share_link(VSTRING *buf, const char *newdir,
+				        const char *curdir,
+				        struct timeval * starttime)
+{
+    struct stat st;
+    char   *newfile;
+
+    if (stat(maildir_share_path, &st) < 0)
+	return (0);
+    vstring_sprintf(buf, "%lu.V%lxI%lxM%luN%d.%s",
+		    (unsigned long) starttime->tv_sec,
+		    (unsigned long) st.st_dev,
+		    (unsigned long) st.st_ino,
+		    (unsigned long) starttime->tv_usec,
+		    ++maildir_share_count,
+		    get_hostname());
+    newfile = concatenate(newdir, STR(buf), (char *) 0);
+    if (sane_link(maildir_share_path, newfile) < 0
+	&& (errno != ENOENT
+	    || (make_dirs(curdir, 0700), make_dirs(newdir, 0700)) < 0
+	    || sane_link(maildir_share_path, newfile) < 0)) {
+	if (msg_verbose)
+	    msg_info("link %s to %s: %m", maildir_share_path, newfile);
+	myfree(newfile);
+	return (0);
+    }
+    return (newfile);
+}
+
 /* deliver_maildir - delivery to maildir-style mailbox */
 
 int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
@@ -115,8 +195,9 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
     mail_copy_status = MAIL_COPY_STAT_WRITE;
     buf = vstring_alloc(100);
 
-    copy_flags = MAIL_COPY_TOFILE | MAIL_COPY_RETURN_PATH
-	| MAIL_COPY_DELIVERED | MAIL_COPY_ORIG_RCPT;
+    copy_flags = MAIL_COPY_TOFILE | MAIL_COPY_RETURN_PATH;
+    if (maildir_share_enable == 0 || maildir_share_path != 0)
+	copy_flags |= MAIL_COPY_DELIVERED | MAIL_COPY_ORIG_RCPT;
 
     newdir = concatenate(usr_attr.mailbox, "new/", (char *) 0);
     tmpdir = concatenate(usr_attr.mailbox, "tmp/", (char *) 0);
@@ -175,11 +256,23 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
      * [...]
      */
     set_eugid(usr_attr.uid, usr_attr.gid);
-    vstring_sprintf(buf, "%lu.P%d.%s",
-		 (unsigned long) starttime.tv_sec, var_pid, get_hostname());
+    vstring_sprintf(buf, "%lu.P%d%s.%s",
+		    (unsigned long) starttime.tv_sec, var_pid,
+		    (copy_flags & MAIL_COPY_DELIVERED) ? "" : "S",
+		    get_hostname());
     tmpfile = concatenate(tmpdir, STR(buf), (char *) 0);
     newfile = 0;
-    if ((dst = vstream_fopen(tmpfile, O_WRONLY | O_CREAT | O_EXCL, 0600)) == 0
+
+    /*
+     * With single-copy delivery, try to link the shared copy first.
+     */
+    if (maildir_share_path != 0
+	&& maildir_share_uid == usr_attr.uid
+	&& maildir_share_gid == usr_attr.gid
+	&& (newfile = maildir_share_link(buf, newdir, curdir,
+					     &starttime)) != 0) {
+	mail_copy_status = 0;
+    } else if ((dst = vstream_fopen(tmpfile, O_WRONLY | O_CREAT | O_EXCL, 0600)) == 0
 	&& (errno != ENOENT
 	    || make_dirs(tmpdir, 0700) < 0
 	    || (dst = vstream_fopen(tmpfile, O_WRONLY | O_CREAT | O_EXCL, 0600)) == 0)) {
@@ -213,7 +306,13 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
 		mail_copy_status = MAIL_COPY_STAT_WRITE;
 	    }
 	}
-	if (unlink(tmpfile) < 0)
+	if (mail_copy_status == 0 && maildir_share_enable
+	    && maildir_share_path == 0) {
+	    maildir_share_path = tmpfile;
+	    maildir_share_uid = usr_attr.uid;
+	    maildir_share_gid = usr_attr.gid;
+	    tmpfile = 0;
+	} else if (unlink(tmpfile) < 0)
 	    msg_warn("remove %s: %m", tmpfile);
     }
     set_eugid(var_owner_uid, var_owner_gid);
@@ -247,7 +346,8 @@ int     deliver_maildir(LOCAL_STATE state, USER_ATTR usr_attr)
     myfree(newdir);
     myfree(tmpdir);
     myfree(curdir);
-    myfree(tmpfile);
+    if (tmpfile)
+	myfree(tmpfile);
     if (newfile)
 	myfree(newfile);
     return (deliver_status);
@@ -0,0 +1,223 @@
+/*++
+/* NAME
+/*	parallel 3
+/* SUMMARY
+/*	parallel mailbox delivery
+/* SYNOPSIS
+/*	#include "virtual.h"
+/*
+/*	void	parallel_begin(request, limit)
+/*	DELIVER_REQUEST *request;
+/*	int	limit;
+/*
+/*	int	parallel_deliver(state, usr_attr, deliver_fn)
+/*	LOCAL_STATE state;
+/*	USER_ATTR usr_attr;
+/*	int	(*deliver_fn)(LOCAL_STATE, USER_ATTR);
+/*
+/*	int	parallel_end()
+/* DESCRIPTION
+/*	This module runs the final step of mailbox or maildir delivery
+/*	in child processes, so that the file system latency of up to
+/*	\fIlimit\fR recipients of one delivery request overlaps.
+/*	Table lookups remain in the parent process, so that child
+/*	processes never use a table connection that the parent
+/*	process opened.
+/*
+/*	parallel_begin() enables parallel delivery for the specified
+/*	request, with at most \fIlimit\fR child processes at a time.
+/*	A limit < 2 disables parallel delivery.
+/*
+/*	parallel_deliver() calls \fIdeliver_fn\fR in a new child
+/*	process, after waiting until the number of child processes
+/*	is below the limit. The child process opens its own handle
+/*	for the queue file, and reports the recipient delivery
+/*	status itself with sent(), defer_append() or bounce_append().
+/*	The result is DEL_STAT_PENDING, or the \fIdeliver_fn\fR
+/*	result when parallel delivery is disabled or when a child
+/*	process cannot be created.
+/*
+/*	parallel_end() waits for all child processes, marks each
+/*	finished recipient as done in the queue file when the request
+/*	asks for that, and defers recipients whose child process
+/*	terminated abnormally. The result is zero or DEL_STAT_DEFER.
+/*	parallel_end() also disables parallel delivery.
+/* DIAGNOSTICS
+/*	Fatal errors: out of memory, wait() error.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstream.h>
+
+/* Global library. */
+
+#include <mail_queue.h>
+#include <deliver_completed.h>
+#include <defer.h>
+#include <sys_exits.h>
+
+/* Application-specific. */
+
+#include "virtual.h"
+
+ /*
+  * One entry per running child process. The delivery attributes are needed
+  * when the child process terminates abnormally.
+  */
+typedef struct {
+    pid_t   pid;			/* child process */
+    DELIVER_ATTR msg_attr;		/* message/recipient attributes */
+} PARALLEL_CHILD;
+
+static DELIVER_REQUEST *parallel_request;
+static PARALLEL_CHILD *parallel_children;
+static int parallel_limit;
+static int parallel_count;
+static int parallel_status;
+
+/* parallel_begin - enable parallel delivery */
+
+void    parallel_begin(DELIVER_REQUEST *request, int limit)
+{
+    if (limit < 2)
+	return;
+    parallel_request = request;
+    parallel_limit = limit;
+    parallel_count = 0;
+    parallel_status = 0;
+    parallel_children = (PARALLEL_CHILD *)
+	mymalloc(sizeof(*parallel_children) * limit);
+}
+
+/* parallel_wait - wait for one child, and update recipient status */
+
+static void parallel_wait(void)
+{
+    PARALLEL_CHILD *cp;
+    WAIT_STATUS_T wait_status;
+    pid_t   pid;
+
+    while ((pid = waitpid(-1, &wait_status, 0)) < 0) {
+	if (errno != EINTR)
+	    msg_fatal("waitpid: %m");
+    }
+    for (cp = parallel_children; cp < parallel_children + parallel_count; cp++)
+	if (cp->pid == pid)
+	    break;
+    if (cp >= parallel_children + parallel_count) {
+	msg_warn("unexpected child process %lu", (unsigned long) pid);
+	return;
+    }
+
+    /*
+     * The child reports the recipient status with sent(), defer_append() or
+     * bounce_append(). If it terminated before it could do so, defer the
+     * recipient here.
+     */
+    if (WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 0) {
+	if (parallel_request->flags & DEL_REQ_FLAG_SUCCESS)
+	    deliver_completed(parallel_request->fp, cp->msg_attr.rcpt.offset);
+    } else if (WIFEXITED(wait_status)
+	       && WEXITSTATUS(wait_status) == EX_TEMPFAIL) {
+	parallel_status = DEL_STAT_DEFER;
+    } else {
+	msg_warn("recipient %s: delivery process %lu terminated abnormally",
+		 cp->msg_attr.rcpt.address, (unsigned long) pid);
+	dsb_simple(cp->msg_attr.why, "4.3.0",
+		   "mail delivery process terminated abnormally");
+	parallel_status |= defer_append(BOUNCE_FLAGS(parallel_request),
+					BOUNCE_ATTR(cp->msg_attr));
+    }
+    *cp = parallel_children[--parallel_count];
+}
+
+/* parallel_deliver - deliver in child process */
+
+int     parallel_deliver(LOCAL_STATE state, USER_ATTR usr_attr,
+			         int (*deliver_fn) (LOCAL_STATE, USER_ATTR))
+{
+    DELIVER_REQUEST *request = state.request;
+    VSTREAM *fp;
+    pid_t   pid;
+    int     status;
+
+    if (parallel_limit == 0)
+	return (deliver_fn(state, usr_attr));
+
+    /*
+     * Respect the concurrency limit.
+     */
+    while (parallel_count >= parallel_limit)
+	parallel_wait();
+
+    /*
+     * Don't let the child inherit defer logfile records that the parent has
+     * not yet sent. The child sends its own records without delay.
+     */
+    defer_batch_end();
+    switch (pid = fork()) {
+    case -1:
+	msg_warn("fork: %m -- delivering in-process");
+	defer_batch_begin();
+	return (deliver_fn(state, usr_attr));
+
+	/*
+	 * Child. Do not share the queue file read position with the parent.
+	 * Don't flush the parent's buffered streams when exiting.
+	 */
+    case 0:
+	if ((fp = mail_queue_open(request->queue_name, request->queue_id,
+				  O_RDONLY, 0)) == 0)
+	    msg_fatal("open queue file %s/%s: %m",
+		      request->queue_name, request->queue_id);
+	state.msg_attr.fp = fp;
+	status = deliver_fn(state, usr_attr);
+	(void) vstream_fclose(fp);
+	_exit(status == 0 ? 0 : EX_TEMPFAIL);
+
+	/*
+	 * Parent.
+	 */
+    default:
+	defer_batch_begin();
+	parallel_children[parallel_count].pid = pid;
+	parallel_children[parallel_count].msg_attr = state.msg_attr;
+	parallel_children[parallel_count].msg_attr.user = 0;
+	parallel_count++;
+	return (DEL_STAT_PENDING);
+    }
+}
+
+/* parallel_end - wait for all child processes */
+
+int     parallel_end(void)
+{
+    int     status;
+
+    if (parallel_limit == 0)
+	return (0);
+    while (parallel_count > 0)
+	parallel_wait();
+    myfree((void *) parallel_children);
+    parallel_children = 0;
+    parallel_request = 0;
+    parallel_limit = 0;
+    status = parallel_status;
+    parallel_status = 0;
+    return (status);
+}
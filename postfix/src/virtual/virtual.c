@@ -188,6 +188,15 @@
 /*	Available in Postfix version 2.5.3 and later:
 /* .IP "\fBstrict_mailbox_ownership (yes)\fR"
 /*	Defer delivery when a mailbox file is not owned by its recipient.
+/* .PP
+/*	Available in Postfix 3.9 and later:
+/* .IP "\fBvirtual_maildir_single_copy (no)\fR"
+/*	With multi-recipient deliveries, write a maildir message file
+/*	once, and hard-link it into other maildirs with the same user
+/*	and group ID.
+/* .IP "\fBvirtual_recipient_parallelism (1)\fR"
+/*	The maximal number of recipients of one delivery request that
+/*	the \fBvirtual\fR(8) delivery agent delivers in parallel.
 /* LOCKING CONTROLS
 /* .ad
 /* .fi
@@ -363,6 +372,8 @@ long    var_virt_mailbox_limit;
 char   *var_mail_spool_dir;		/* XXX dependency fix */
 bool    var_strict_mbox_owner;
 char   *var_virt_dsn_filter;
+bool    var_virt_maildir_share;
+int     var_virt_rcpt_parallel;
 
  /*
   * Mappings.
@@ -413,14 +424,29 @@ static int local_deliver(DELIVER_REQUEST *rqst, char *service)
      * mail delivery status for a given recipient is definite (i.e. bounced
      * or delivered), update the message queue file and cross off the
      * recipient. Update the per-message delivery status.
+     * 
+     * Single-copy maildir delivery needs the first copy before it can link
+     * the next one, and takes precedence over parallel delivery. With
+     * parallel delivery, the final status of some recipients is known only
+     * after their delivery process terminates.
      */
+    if (rqst->rcpt_list.len > 1) {
+	if (var_virt_maildir_share)
+	    maildir_share_begin();
+	else
+	    parallel_begin(rqst, var_virt_rcpt_parallel);
+    }
     for (msg_stat = 0, rcpt = rqst->rcpt_list.info; rcpt < rcpt_end; rcpt++) {
 	state.msg_attr.rcpt = *rcpt;
 	rcpt_stat = deliver_recipient(state, usr_attr);
+	if (rcpt_stat == DEL_STAT_PENDING)
+	    continue;
 	if (rcpt_stat == 0 && (rqst->flags & DEL_REQ_FLAG_SUCCESS))
 	    deliver_completed(state.msg_attr.fp, rcpt->offset);
 	msg_stat |= rcpt_stat;
     }
+    msg_stat |= parallel_end();
+    maildir_share_end();
 
     deliver_attr_free(&state.msg_attr);
     return (msg_stat);
@@ -532,6 +558,7 @@ int     main(int argc, char **argv)
 {
     static const CONFIG_INT_TABLE int_table[] = {
 	VAR_VIRT_MINUID, DEF_VIRT_MINUID, &var_virt_minimum_uid, 1, 0,
+	VAR_VIRT_RCPT_PARALLEL, DEF_VIRT_RCPT_PARALLEL, &var_virt_rcpt_parallel, 1, 0,
 	0,
     };
     static const CONFIG_LONG_TABLE long_table[] = {
@@ -550,6 +577,7 @@ int     main(int argc, char **argv)
     };
     static const CONFIG_BOOL_TABLE bool_table[] = {
 	VAR_STRICT_MBOX_OWNER, DEF_STRICT_MBOX_OWNER, &var_strict_mbox_owner,
+	VAR_VIRT_MAILDIR_SHARE, DEF_VIRT_MAILDIR_SHARE, &var_virt_maildir_share,
 	0,
     };
 
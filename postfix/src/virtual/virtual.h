@@ -126,6 +126,18 @@ extern int deliver_recipient(LOCAL_STATE, USER_ATTR);
 extern int deliver_mailbox(LOCAL_STATE, USER_ATTR, int *);
 extern int deliver_file(LOCAL_STATE, USER_ATTR, char *);
 extern int deliver_maildir(LOCAL_STATE, USER_ATTR);
+extern void maildir_share_begin(void);
+extern void maildir_share_end(void);
+
+ /*
+  * Parallel delivery.
+  */
+#define DEL_STAT_PENDING	1	/* delivery in child process */
+
+extern void parallel_begin(DELIVER_REQUEST *, int);
+extern int parallel_deliver(LOCAL_STATE, USER_ATTR,
+			            int (*) (LOCAL_STATE, USER_ATTR));
+extern int parallel_end(void);
 extern int deliver_unknown(LOCAL_STATE);
 
  /*